@@ -3126,6 +3126,21 @@ primop  WriteTVarOp "writeTVar#" GenPrimOp
    out_of_line      = True
    effect = ReadWriteEffect
 
+primop  SetTVarWakeLimitOp "setTVarWakeLimit#" GenPrimOp
+       TVar# s a_levpoly
+    -> Int#
+    -> State# s -> State# s
+   {Set how many of the transactions blocked on a 'TVar#' by 'retry#' are
+    woken when a transaction that wrote it commits: all of them if the
+    limit is 0 (the default, and what negative limits mean), otherwise at
+    most that many, those that have waited longest first. This is meant for
+    'TVar#'s such as work queues, where every woken transaction that finds
+    something to do also writes the 'TVar#', so the next waiter is woken
+    in turn.}
+   with
+   out_of_line      = True
+   effect = ReadWriteEffect
+
 
 ------------------------------------------------------------------------
 section "Synchronized Mutable Variables"
@@ -3176,6 +3191,29 @@ primop  TryPutMVarOp "tryPutMVar#" GenPrimOp
    out_of_line      = True
    effect = ReadWriteEffect
 
+primop  BargingTakeMVarOp "bargingTakeMVar#" GenPrimOp
+   MVar# s a_levpoly -> State# s -> (# State# s, a_levpoly #)
+   {Like 'takeMVar#', except that if a single thread is blocked putting into
+    the 'MVar#', it is woken up to try its put again rather than having it
+    performed, so the 'MVar#' is left empty. This lets the current thread
+    put and take again without waiting for that thread to run, at the
+    expense of fairness.}
+   with
+   out_of_line      = True
+   effect = ReadWriteEffect
+
+primop  BargingPutMVarOp "bargingPutMVar#" GenPrimOp
+   MVar# s a_levpoly -> a_levpoly -> State# s -> State# s
+   {Like 'putMVar#', except that if a single thread is blocked taking from
+    the 'MVar#', it is woken up to try its take again rather than being
+    handed the value, so the 'MVar#' is left full. A thread using an
+    'MVar#' as a lock can then take it again straight away, rather than
+    waiting for the thread it would have handed it to to run, at the
+    expense of fairness.}
+   with
+   out_of_line      = True
+   effect = ReadWriteEffect
+
 primop  ReadMVarOp "readMVar#" GenPrimOp
    MVar# s a_levpoly -> State# s -> (# State# s, a_levpoly #)
    {If 'MVar#' is empty, block until it becomes full.
@@ -4034,6 +4072,15 @@ primop  SetThreadAllocationCounter "setThreadAllocationCounter#" GenPrimOp
    effect = ReadWriteEffect
    out_of_line      = True
 
+primop  SetThreadPriority "setThreadPriority#" GenPrimOp
+   Int# -> State# RealWorld -> State# RealWorld
+   { Sets the scheduling priority of the current thread, from 0 (the default)
+     to 3; values out of range are clamped. A runnable thread is scheduled
+     on its capability before any runnable thread of lower priority. }
+   with
+   effect = ReadWriteEffect
+   out_of_line      = True
+
 primtype StackSnapshot#
    { Haskell representation of a @StgStack*@ that was created (cloned)
      with a function in "GHC.Stack.CloneStack". Please check the
@@ -381,6 +381,9 @@ assembleI :: Platform
           -> Assembler ()
 assembleI platform i = case i of
   STKCHECK n               -> emit bci_STKCHECK [Op n]
+#if MIN_VERSION_rts(1,0,3)
+  HEAPCHECK n sz           -> emit bci_HEAPCHECK [Op n, wOp sz]
+#endif
   PUSH_L o1                -> emit bci_PUSH_L [wOp o1]
   PUSH_LL o1 o2            -> emit bci_PUSH_LL [wOp o1, wOp o2]
   PUSH_LLL o1 o2 o3        -> emit bci_PUSH_LLL [wOp o1, wOp o2, wOp o3]
@@ -503,6 +506,18 @@ assembleI platform i = case i of
   SWIZZLE   stkoff n       -> emit bci_SWIZZLE [wOp stkoff, IOp n]
   JMP       l              -> emit bci_JMP [LabelOp l]
   ENTER                    -> emit bci_ENTER []
+#if MIN_VERSION_rts(1,0,3)
+  -- Each of these gets a literal word of its own for its inline cache; see
+  -- Note [Interpreter inline caches] in rts/Interpreter.c
+  PUSH_L_ENTER o1          -> do ic <- word 0
+                                 emit bci_PUSH_L_ENTER [wOp o1, Op ic]
+  SLIDE_ENTER n by         -> do ic <- word 0
+                                 emit bci_SLIDE_ENTER [wOp n, wOp by, Op ic]
+  PUSH_L_SLIDE_ENTER o1 n by
+                           -> do ic <- word 0
+                                 emit bci_PUSH_L_SLIDE_ENTER
+                                      [wOp o1, wOp n, wOp by, Op ic]
+#endif
   RETURN rep               -> emit (return_non_tuple rep) []
   RETURN_TUPLE             -> emit bci_RETURN_T []
   CCALL off m_addr i       -> do np <- addr m_addr
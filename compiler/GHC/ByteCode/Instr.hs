@@ -8,7 +8,8 @@
 
 -- | Bytecode instruction definitions
 module GHC.ByteCode.Instr (
-        BCInstr(..), ProtoBCO(..), bciStackUse, LocalLabel(..)
+        BCInstr(..), ProtoBCO(..), bciStackUse, bciAllocation, bciStraightLine,
+        LocalLabel(..)
   ) where
 
 import GHC.Prelude
@@ -64,6 +65,12 @@ instance Outputable LocalLabel where
 data BCInstr
    -- Messing with the stack
    = STKCHECK  !Word
+#if MIN_VERSION_rts(1,0,3)
+   -- Make room in the nursery for the closures that the straight-line code
+   -- after it builds, this many closures with this many words of payload;
+   -- see Note [Interpreter heap checks] in rts/Interpreter.c
+   | HEAPCHECK !Word !WordOff
+#endif
 
    -- Push locals (existing bits of the stack)
    | PUSH_L    !WordOff{-offset-}
@@ -220,6 +227,14 @@ data BCInstr
 
    -- To Infinity And Beyond
    | ENTER
+#if MIN_VERSION_rts(1,0,3)
+   -- Superinstructions for common sequences of the above, chosen by the
+   -- peephole pass of GHC.StgToByteCode.mkProtoBCO; see
+   -- Note [Bytecode superinstructions] in rts/Interpreter.c
+   | PUSH_L_ENTER       !WordOff                   -- PUSH_L o; ENTER
+   | SLIDE_ENTER        !WordOff !WordOff          -- SLIDE n by; ENTER
+   | PUSH_L_SLIDE_ENTER !WordOff !WordOff !WordOff -- PUSH_L o; SLIDE n by; ENTER
+#endif
    | RETURN ArgRep -- return a non-tuple value, here's its rep; see
                    -- Note [Return convention for non-tuple values] in GHC.StgToByteCode
    | RETURN_TUPLE  -- return an unboxed tuple (info already on stack); see
@@ -305,6 +320,9 @@ pprStgRhsShort opts rhs = pprStgRhs opts rhs
 
 instance Outputable BCInstr where
    ppr (STKCHECK n)          = text "STKCHECK" <+> ppr n
+#if MIN_VERSION_rts(1,0,3)
+   ppr (HEAPCHECK n sz)      = text "HEAPCHECK" <+> ppr n <+> ppr sz
+#endif
    ppr (PUSH_L offset)       = text "PUSH_L  " <+> ppr offset
    ppr (PUSH_LL o1 o2)       = text "PUSH_LL " <+> ppr o1 <+> ppr o2
    ppr (PUSH_LLL o1 o2 o3)   = text "PUSH_LLL" <+> ppr o1 <+> ppr o2 <+> ppr o3
@@ -396,6 +414,13 @@ instance Outputable BCInstr where
    ppr (SWIZZLE stkoff n)    = text "SWIZZLE " <+> text "stkoff" <+> ppr stkoff
                                                <+> text "by" <+> ppr n
    ppr ENTER                 = text "ENTER"
+#if MIN_VERSION_rts(1,0,3)
+   ppr (PUSH_L_ENTER o)      = text "PUSH_L_ENTER" <+> ppr o
+   ppr (SLIDE_ENTER n d)     = text "SLIDE_ENTER" <+> ppr n <+> ppr d
+   ppr (PUSH_L_SLIDE_ENTER o n d)
+                             = text "PUSH_L_SLIDE_ENTER" <+> ppr o
+                                                         <+> ppr n <+> ppr d
+#endif
    ppr (RETURN pk)           = text "RETURN  " <+> ppr pk
    ppr (RETURN_TUPLE)        = text "RETURN_TUPLE"
    ppr (BRK_FUN _ _tick_mod tickx _info_mod infox _)
@@ -424,6 +449,9 @@ protoBCOStackUse bco = sum (map bciStackUse (protoBCOInstrs bco))
 
 bciStackUse :: BCInstr -> Word
 bciStackUse STKCHECK{}            = 0
+#if MIN_VERSION_rts(1,0,3)
+bciStackUse HEAPCHECK{}           = 0
+#endif
 bciStackUse PUSH_L{}              = 1
 bciStackUse PUSH_LL{}             = 2
 bciStackUse PUSH_LLL{}            = 3
@@ -497,6 +525,11 @@ bciStackUse TESTEQ_P{}            = 0
 bciStackUse CASEFAIL{}            = 0
 bciStackUse JMP{}                 = 0
 bciStackUse ENTER{}               = 0
+#if MIN_VERSION_rts(1,0,3)
+bciStackUse PUSH_L_ENTER{}        = 1
+bciStackUse SLIDE_ENTER{}         = 0
+bciStackUse PUSH_L_SLIDE_ENTER{}  = 1
+#endif
 bciStackUse RETURN{}              = 1 -- pushes stg_ret_X for some X
 bciStackUse RETURN_TUPLE{}        = 1 -- pushes stg_ret_t header
 bciStackUse CCALL{}               = 0
@@ -513,3 +546,65 @@ bciStackUse PACK{}                = 1 -- worst case is PACK 0 words
 #if MIN_VERSION_rts(1,0,3)
 bciStackUse BCO_NAME{}            = 0
 #endif
+
+-- -----------------------------------------------------------------------------
+-- Allocation, for placing HEAPCHECKs; see Note [Interpreter heap checks]
+-- in rts/Interpreter.c
+
+-- | The words of payload of the closure that this insn builds, if it builds
+-- one.
+bciAllocation :: BCInstr -> Maybe WordOff
+bciAllocation = \case
+  ALLOC_AP n        -> Just (fromIntegral n)
+  ALLOC_AP_NOUPD n  -> Just (fromIntegral n)
+  ALLOC_PAP _ n     -> Just (fromIntegral n)
+  PACK _ n          -> Just n
+  _                 -> Nothing
+
+-- | Whether this insn always goes on to the next one, without branching,
+-- leaving the interpreter or allocating anything other than what
+-- 'bciAllocation' says.
+bciStraightLine :: BCInstr -> Bool
+bciStraightLine = \case
+  PUSH_L{}          -> True
+  PUSH_LL{}         -> True
+  PUSH_LLL{}        -> True
+  PUSH8{}           -> True
+  PUSH16{}          -> True
+  PUSH32{}          -> True
+  PUSH8_W{}         -> True
+  PUSH16_W{}        -> True
+  PUSH32_W{}        -> True
+  PUSH_G{}          -> True
+  PUSH_PRIMOP{}     -> True
+  PUSH_BCO{}        -> True
+  PUSH_ALTS{}       -> True
+  PUSH_ALTS_TUPLE{} -> True
+  PUSH_PAD8         -> True
+  PUSH_PAD16        -> True
+  PUSH_PAD32        -> True
+  PUSH_UBX8{}       -> True
+  PUSH_UBX16{}      -> True
+  PUSH_UBX32{}      -> True
+  PUSH_UBX{}        -> True
+  PUSH_ADDR{}       -> True
+  PUSH_APPLY_N      -> True
+  PUSH_APPLY_V      -> True
+  PUSH_APPLY_F      -> True
+  PUSH_APPLY_D      -> True
+  PUSH_APPLY_L      -> True
+  PUSH_APPLY_P      -> True
+  PUSH_APPLY_PP     -> True
+  PUSH_APPLY_PPP    -> True
+  PUSH_APPLY_PPPP   -> True
+  PUSH_APPLY_PPPPP  -> True
+  PUSH_APPLY_PPPPPP -> True
+  SLIDE{}           -> True
+  ALLOC_AP{}        -> True
+  ALLOC_AP_NOUPD{}  -> True
+  ALLOC_PAP{}       -> True
+  MKAP{}            -> True
+  MKPAP{}           -> True
+  UNPACK{}          -> True
+  PACK{}            -> True
+  _                 -> False
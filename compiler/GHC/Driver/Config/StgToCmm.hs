@@ -35,17 +35,24 @@ initStgToCmmConfig dflags mod = StgToCmmConfig
   , stgToCmmTickyLNE      = gopt Opt_Ticky_LNE             dflags
   , stgToCmmTickyDynThunk = gopt Opt_Ticky_Dyn_Thunk       dflags
   , stgToCmmTickyTag      = gopt Opt_Ticky_Tag             dflags
+  , stgToCmmTickySample   = tickySample                    dflags
   -- flags
   , stgToCmmLoopification = gopt Opt_Loopification         dflags
   , stgToCmmAlignCheck    = gopt Opt_AlignmentSanitisation dflags
   , stgToCmmFastPAPCalls  = gopt Opt_FastPAPCalls          dflags
   , stgToCmmSCCProfiling  = sccProfilingEnabled            dflags
   , stgToCmmEagerBlackHole = gopt Opt_EagerBlackHoling     dflags
+  , stgToCmmAdaptiveBlackHole = gopt Opt_AdaptiveEagerBlackHoling dflags
+    -- The RTS attributes blackhole contention to thunks through their
+    -- stg_orig_thunk_info frames, so adaptive blackholing needs them.
   , stgToCmmOrigThunkInfo = gopt Opt_OrigThunkInfo         dflags
+                         || gopt Opt_AdaptiveEagerBlackHoling dflags
+  , stgToCmmHpcBoolean    = gopt Opt_HpcBoolean            dflags
   , stgToCmmInfoTableMap  = gopt Opt_InfoTableMap          dflags
   , stgToCmmInfoTableMapWithFallback = gopt Opt_InfoTableMapWithFallback dflags
   , stgToCmmInfoTableMapWithStack = gopt Opt_InfoTableMapWithStack dflags
   , stgToCmmOmitYields    = gopt Opt_OmitYields            dflags
+  , stgToCmmOmitLoopYields = gopt Opt_OmitLoopYields       dflags
   , stgToCmmOmitIfPragmas = gopt Opt_OmitInterfacePragmas  dflags
   , stgToCmmPIC           = gopt Opt_PIC                   dflags
   , stgToCmmPIE           = gopt Opt_PIE                   dflags
@@ -221,6 +221,9 @@ data DynFlags = DynFlags {
                                         --   this threshold will be dumped in a binary file
                                         --   by the assembler code generator. 0 and Nothing disables
                                         --   this feature. See 'GHC.StgToCmm.Config'.
+  tickySample           :: Int,         -- ^ Count one in this many of the events at each
+                                        --   ticky site (@-ticky-sample@); 1 counts them all.
+                                        --   See 'GHC.StgToCmm.Config'.
   liberateCaseThreshold :: Maybe Int,   -- ^ Threshold for LiberateCase
   floatLamArgs          :: Maybe Int,   -- ^ Arg count for lambda floating
                                         --   See 'GHC.Core.Opt.Monad.FloatOutSwitches'
@@ -545,6 +548,7 @@ defaultDynFlags mySettings =
         maxSimplIterations      = 4,
         ruleCheck               = Nothing,
         binBlobThreshold        = Just 500000, -- 500K is a good default (see #16190)
+        tickySample             = 1,
         maxRelevantBinds        = Just 6,
         maxValidHoleFits   = Just 6,
         maxRefHoleFits     = Just 6,
@@ -1167,6 +1171,7 @@ defaultFlags settings
       Opt_KeepHiFiles,
       Opt_KeepOFiles,
       Opt_OmitYields,
+      Opt_OmitLoopYields,
       Opt_PrintBindContents,
       Opt_ProfCountEntries,
       Opt_SharedImplib,
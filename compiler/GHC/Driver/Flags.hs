@@ -658,6 +658,7 @@ data GeneralFlag
    | Opt_CmmControlFlow
    | Opt_AsmShortcutting
    | Opt_OmitYields
+   | Opt_OmitLoopYields
    | Opt_FunToThunk               -- deprecated
    | Opt_DictsStrict                     -- be strict in argument dictionaries
    | Opt_DmdTxDictSel              -- ^ deprecated, no effect and behaviour is now default.
@@ -714,6 +715,7 @@ data GeneralFlag
    | Opt_IgnoreHpcChanges
    | Opt_ExcessPrecision
    | Opt_EagerBlackHoling
+   | Opt_AdaptiveEagerBlackHoling
    | Opt_OrigThunkInfo
    | Opt_NoHsMain
    | Opt_SplitSections
@@ -758,6 +760,7 @@ data GeneralFlag
    | Opt_RelativeDynlibPaths
    | Opt_CompactUnwind               -- ^ @-fcompact-unwind@
    | Opt_Hpc
+   | Opt_HpcBoolean                  -- ^ @-fhpc-boolean@
    | Opt_FamAppCache
    | Opt_ExternalInterpreter
    | Opt_OptimalApplicativeDo
@@ -941,10 +944,12 @@ codeGenFlags :: EnumSet GeneralFlag
 codeGenFlags = EnumSet.fromList
    [ -- Flags that affect runtime result
      Opt_EagerBlackHoling
+   , Opt_AdaptiveEagerBlackHoling
    , Opt_ExcessPrecision
    , Opt_DictsStrict
    , Opt_PedanticBottoms
    , Opt_OmitYields
+   , Opt_OmitLoopYields
 
      -- Flags that affect generated code
    , Opt_ExposeAllUnfoldings
@@ -952,6 +957,7 @@ codeGenFlags = EnumSet.fromList
    , Opt_NoTypeableBinds
    , Opt_ObjectDeterminism
    , Opt_Haddock
+   , Opt_HpcBoolean
 
      -- Flags that affect catching of runtime errors
    , Opt_CatchNonexhaustiveCases
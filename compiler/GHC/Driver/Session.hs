@@ -1345,6 +1345,11 @@ dynamic_flags_deps = [
         (NoArg (setGeneralFlag Opt_Ticky_Dyn_Thunk))
   , make_ord_flag defGhcFlag "ticky-tag-checks"
         (NoArg (setGeneralFlag Opt_Ticky_Tag))
+    -- Unlike -ticky, this doesn't imply -debug: sampled counters are meant
+    -- for optimised programs, with the usual RTS.
+  , make_ord_flag defGhcFlag "ticky-sample"
+        (intSuffix (\n d -> (setGeneralFlag' Opt_Ticky d)
+                                { tickySample = max 1 n }))
         ------- recompilation checker --------------------------------------
   , make_dep_flag defGhcFlag "recomp"
         (NoArg $ unSetGeneralFlag Opt_ForceRecomp)
@@ -2437,6 +2442,7 @@ fFlagsDeps = [
   flagSpec "do-lambda-eta-expansion"          Opt_DoLambdaEtaExpansion,
   flagSpec "do-clever-arg-eta-expansion"      Opt_DoCleverArgEtaExpansion, -- See Note [Eta expansion of arguments in CorePrep]
   flagSpec "eager-blackholing"                Opt_EagerBlackHoling,
+  flagSpec "adaptive-eager-blackholing"       Opt_AdaptiveEagerBlackHoling,
   flagSpec "orig-thunk-info"                  Opt_OrigThunkInfo,
   flagSpec "embed-manifest"                   Opt_EmbedManifest,
   flagSpec "enable-rewrite-rules"             Opt_EnableRewriteRules,
@@ -2468,6 +2474,7 @@ fFlagsDeps = [
   flagSpec "ghci-sandbox"                     Opt_GhciSandbox,
   flagSpec "helpful-errors"                   Opt_HelpfulErrors,
   flagSpec "hpc"                              Opt_Hpc,
+  flagSpec "hpc-boolean"                      Opt_HpcBoolean,
   flagSpec "ignore-asserts"                   Opt_IgnoreAsserts,
   flagSpec "ignore-interface-pragmas"         Opt_IgnoreInterfacePragmas,
   flagGhciSpec "implicit-import-qualified"    Opt_ImplicitImportQualified,
@@ -2482,6 +2489,7 @@ fFlagsDeps = [
   flagSpec "block-layout-weightless"          Opt_WeightlessBlocklayout,
   flagSpec "omit-interface-pragmas"           Opt_OmitInterfacePragmas,
   flagSpec "omit-yields"                      Opt_OmitYields,
+  flagSpec "omit-loop-yields"                 Opt_OmitLoopYields,
   flagSpec "optimal-applicative-do"           Opt_OptimalApplicativeDo,
   flagSpec "pedantic-bottoms"                 Opt_PedanticBottoms,
   flagSpec "pre-inlining"                     Opt_SimplPreInlining,
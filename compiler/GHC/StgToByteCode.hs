@@ -258,7 +258,8 @@ mkProtoBCO
 mkProtoBCO platform _add_bco_name nm instrs_ordlist origin arity bitmap_size bitmap is_ret ffis
    = ProtoBCO {
         protoBCOName = nm,
-        protoBCOInstrs = maybe_add_bco_name $ maybe_add_stack_check peep_d,
+        protoBCOInstrs = maybe_add_bco_name $ maybe_add_stack_check $
+                           add_heap_checks peep_d,
         protoBCOBitmap = bitmap,
         protoBCOBitmapSize = fromIntegral bitmap_size,
         protoBCOArity = arity,
@@ -274,6 +275,23 @@ mkProtoBCO platform _add_bco_name nm instrs_ordlist origin arity bitmap_size bit
 #endif
         maybe_add_bco_name instrs = instrs
 
+#if MIN_VERSION_rts(1,0,3)
+        -- Precede each straight-line run of insns that builds more than one
+        -- closure with a HEAPCHECK for all of them; see
+        -- Note [Interpreter heap checks] in rts/Interpreter.c
+        add_heap_checks instrs = case span bciStraightLine instrs of
+          (run, rest) -> heap_check run ++ run ++ case rest of
+            []     -> []
+            i : is -> i : add_heap_checks is
+
+        heap_check run = case mapMaybe bciAllocation run of
+          allocs@(_ : _ : _) -> [HEAPCHECK (fromIntegral (length allocs))
+                                           (sum allocs)]
+          _                  -> []
+#else
+        add_heap_checks instrs = instrs
+#endif
+
         -- Overestimate the stack usage (in words) of this BCO,
         -- and if >= iNTERP_STACK_CHECK_THRESH, add an explicit
         -- stack check.  (The interpreter always does a stack check
@@ -296,9 +314,18 @@ mkProtoBCO platform _add_bco_name nm instrs_ordlist origin arity bitmap_size bit
         -- We assume that this sum doesn't wrap
         stack_usage = sum (map bciStackUse peep_d)
 
-        -- Merge local pushes
+        -- Merge local pushes, and fuse the sequences that end in ENTER;
+        -- see Note [Bytecode superinstructions] in rts/Interpreter.c
         peep_d = peep (fromOL instrs_ordlist)
 
+#if MIN_VERSION_rts(1,0,3)
+        peep (PUSH_L off : SLIDE n by : ENTER : rest)
+           = PUSH_L_SLIDE_ENTER off n by : peep rest
+        peep (PUSH_L off : ENTER : rest)
+           = PUSH_L_ENTER off : peep rest
+        peep (SLIDE n by : ENTER : rest)
+           = SLIDE_ENTER n by : peep rest
+#endif
         peep (PUSH_L off1 : PUSH_L off2 : PUSH_L off3 : rest)
            = PUSH_LLL off1 (off2-1) (off3-2) : peep rest
         peep (PUSH_L off1 : PUSH_L off2 : rest)
@@ -699,7 +699,6 @@ emitBlackHoleCode :: CmmExpr -> FCode ()
 emitBlackHoleCode node = do
   cfg <- getStgToCmmConfig
   let profile     = stgToCmmProfile  cfg
-      platform    = stgToCmmPlatform cfg
       is_eager_bh = stgToCmmEagerBlackHole cfg
 
   -- Eager blackholing is normally disabled, but can be turned on with
@@ -725,7 +724,14 @@ emitBlackHoleCode node = do
              -- profiling), so currently eager blackholing doesn't
              -- work with profiling.
 
-  when eager_blackholing $ do
+  when eager_blackholing $ emitEagerBlackHole node
+
+-- | Overwrite the thunk @node@ with an @EAGER_BLACKHOLE@ owned by the
+-- current TSO.
+emitEagerBlackHole :: CmmExpr -> FCode ()
+emitEagerBlackHole node = do
+    profile <- getProfile
+    let platform = profilePlatform profile
     whenUpdRemSetEnabled $ emitUpdRemSetPushThunk node
     emitAtomicStore platform MemOrderRelease
         (cmmOffsetW platform node (fixedHdrSizeW profile))
@@ -760,11 +766,20 @@ setupUpdate closure_info node body
                 && not (stgToCmmSCCProfiling cfg)
                 && stgToCmmEagerBlackHole cfg
 
+              adaptive_bh = blackHoleOnEntry closure_info
+                && not (stgToCmmSCCProfiling cfg)
+                && not (stgToCmmEagerBlackHole cfg)
+                && stgToCmmAdaptiveBlackHole cfg
+
               lbl | bh        = mkBHUpdInfoLabel
                   | otherwise = mkUpdInfoLabel
 
+          frame_info <- if adaptive_bh
+                          then adaptiveBlackHole closure_info node
+                          else return (mkLblExpr lbl)
+
           pushOrigThunkInfoFrame closure_info
-            $ pushUpdateFrame lbl (CmmReg (CmmLocal node)) body
+            $ pushUpdateFrame frame_info (CmmReg (CmmLocal node)) body
 
   | otherwise   -- A static closure
   = do  { tickyUpdateBhCaf closure_info
@@ -773,10 +788,36 @@ setupUpdate closure_info node body
           then do       -- Blackhole the (updatable) CAF:
                 { upd_closure <- link_caf node
                 ; pushOrigThunkInfoFrame closure_info
-                    $ pushUpdateFrame mkBHUpdInfoLabel upd_closure body }
+                    $ pushUpdateFrame (mkLblExpr mkBHUpdInfoLabel) upd_closure body }
           else do {tickyUpdateFrameOmitted; body}
     }
 
+-- | Blackhole the thunk in @node@ eagerly if the RTS has marked its info
+-- table as contended, returning the info pointer of the update frame to push.
+-- See Note [Adaptive eager blackholing] in rts/BlackHoles.c.
+adaptiveBlackHole :: ClosureInfo -> LocalReg -> FCode CmmExpr
+adaptiveBlackHole closure_info node = do
+  profile <- getProfile
+  let platform  = profilePlatform profile
+      w         = wordWidth platform
+      n_sites   = pc_EAGER_BLACKHOLE_SITES (profileConstants profile)
+      info      = mkLblExpr (closureInfoLabel closure_info)
+      -- EAGER_BLACKHOLE_SITE(info) in rts/include/rts/Constants.h
+      site      = CmmMachOp (MO_And w)
+                    [ CmmMachOp (MO_U_Shr w) [info, mkIntExpr platform 3]
+                    , mkIntExpr platform (n_sites - 1) ]
+      sites     = mkLblExpr (mkRtsCmmDataLabel (fsLit "eager_blackhole_sites"))
+      is_hot    = CmmMachOp (MO_Ne W8)
+                    [ CmmLoad (cmmOffsetExpr platform sites site) b8 NaturallyAligned
+                    , CmmLit (CmmInt 0 W8) ]
+  frame_info <- newTemp (bWord platform)
+  eager_bh <- getCode $ emitEagerBlackHole (CmmReg (CmmLocal node))
+  emit =<< mkCmmIfThenElse' is_hot
+             (eager_bh <*> mkAssign (CmmLocal frame_info) (mkLblExpr mkBHUpdInfoLabel))
+             (mkAssign (CmmLocal frame_info) (mkLblExpr mkUpdInfoLabel))
+             (Just False)
+  return (CmmReg (CmmLocal frame_info))
+
 -----------------------------------------------------------------------------
 -- Setting up update frames
 
@@ -784,26 +825,30 @@ setupUpdate closure_info node body
 -- leaving room for the return address that is already
 -- at the old end of the area.
 --
-pushUpdateFrame :: CLabel -> CmmExpr -> FCode () -> FCode ()
-pushUpdateFrame lbl updatee body
+pushUpdateFrame :: CmmExpr -> CmmExpr -> FCode () -> FCode ()
+pushUpdateFrame frame_info updatee body
   = do
        updfr  <- getUpdFrameOff
        profile <- getProfile
        let hdr         = fixedHdrSize profile
            frame       = updfr + hdr + pc_SIZEOF_StgUpdateFrame_NoHdr (profileConstants profile)
        --
-       emitUpdateFrame (CmmStackSlot Old frame) lbl updatee
+       emitUpdateFrameInfo (CmmStackSlot Old frame) frame_info updatee
        withUpdFrameOff frame body
 
 emitUpdateFrame :: CmmExpr -> CLabel -> CmmExpr -> FCode ()
-emitUpdateFrame frame lbl updatee = do
+emitUpdateFrame frame lbl updatee
+  = emitUpdateFrameInfo frame (mkLblExpr lbl) updatee
+
+emitUpdateFrameInfo :: CmmExpr -> CmmExpr -> CmmExpr -> FCode ()
+emitUpdateFrameInfo frame frame_info updatee = do
   profile <- getProfile
   let
            hdr         = fixedHdrSize profile
            off_updatee = hdr + pc_OFFSET_StgUpdateFrame_updatee (platformConstants platform)
            platform    = profilePlatform profile
   --
-  emitStore frame (mkLblExpr lbl)
+  emitStore frame frame_info
   emitStore (cmmOffset platform frame off_updatee) updatee
   initUpdFrameProf frame
 
@@ -823,7 +868,9 @@ emitUpdateFrame frame lbl updatee = do
 -- accompany each update frame. As the name suggests, this frame captures the
 -- the original info table of the thunk being updated. The entry code for these
 -- frames has no operational effects; the frames merely exist as breadcrumbs
--- for debugging.
+-- for debugging. The runtime system also uses them to attribute
+-- contention on blackholes to thunks, which -fadaptive-eager-blackholing
+-- relies on; see Note [Blackhole contention] in rts/BlackHoles.c.
 
 pushOrigThunkInfoFrame :: ClosureInfo -> FCode () -> FCode ()
 pushOrigThunkInfoFrame closure_info body = do
@@ -43,17 +43,21 @@ data StgToCmmConfig = StgToCmmConfig
   , stgToCmmTickyDynThunk  :: !Bool              -- ^ True indicates ticky uses name-specific counters for
                                                  -- dynamic thunks
   , stgToCmmTickyTag       :: !Bool              -- ^ True indicates ticky will count number of avoided tag checks by tag inference.
+  , stgToCmmTickySample    :: !Int               -- ^ Count one in this many events at each ticky site (cf @-ticky-sample@)
   ---------------------------------- Flags --------------------------------------
   , stgToCmmLoopification  :: !Bool              -- ^ Loopification enabled (cf @-floopification@)
   , stgToCmmAlignCheck     :: !Bool              -- ^ Insert alignment check (cf @-falignment-sanitisation@)
   , stgToCmmFastPAPCalls   :: !Bool              -- ^
   , stgToCmmSCCProfiling   :: !Bool              -- ^ Check if cost-centre profiling is enabled
   , stgToCmmEagerBlackHole :: !Bool              -- ^
+  , stgToCmmAdaptiveBlackHole :: !Bool           -- ^ Eagerly blackhole thunks the RTS has seen contended (cf @-fadaptive-eager-blackholing@)
   , stgToCmmOrigThunkInfo  :: !Bool              -- ^ Push @stg_orig_thunk_info@ frames during thunk update.
+  , stgToCmmHpcBoolean     :: !Bool              -- ^ Only record whether HPC tick boxes were entered (cf @-fhpc-boolean@)
   , stgToCmmInfoTableMap   :: !Bool              -- ^ true means generate C Stub for IPE map, See Note [Mapping Info Tables to Source Positions]
   , stgToCmmInfoTableMapWithFallback :: !Bool    -- ^ Include info tables with fallback source locations in the info table map
   , stgToCmmInfoTableMapWithStack :: !Bool       -- ^ Include info tables for STACK closures in the info table map
   , stgToCmmOmitYields     :: !Bool              -- ^ true means omit heap checks when no allocation is performed
+  , stgToCmmOmitLoopYields :: !Bool              -- ^ ... even at the header of a self-recursive loop
   , stgToCmmOmitIfPragmas  :: !Bool              -- ^ true means don't generate interface programs (implied by -O0)
   , stgToCmmPIC            :: !Bool              -- ^ true if @-fPIC@
   , stgToCmmPIE            :: !Bool              -- ^ true if @-fPIE@
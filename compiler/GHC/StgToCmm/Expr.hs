@@ -1267,10 +1267,8 @@ emitEnter fun = do
 -- simply pass on the annotation as a @CmmTickish@.
 cgTick :: StgTickish -> FCode ()
 cgTick tick
-  = do { platform <- getPlatform
-       ; case tick of
-           ProfNote   cc t p -> emitSetCCC cc t p
-           HpcTick    m n    -> emit (mkTickBox platform m n)
-           SourceNote s n    -> emitTick $ SourceNote s n
-           _other            -> return () -- ignore
-       }
+  = case tick of
+      ProfNote   cc t p -> emitSetCCC cc t p
+      HpcTick    m n    -> emitTickBox m n
+      SourceNote s n    -> emitTick $ SourceNote s n
+      _other            -> return () -- ignore
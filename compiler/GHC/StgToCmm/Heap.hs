@@ -606,7 +606,8 @@ do_checks :: Maybe CmmExpr    -- Should we check the stack?
           -> CmmAGraph        -- What to do on failure
           -> FCode ()
 do_checks mb_stk_hwm checkYield mb_alloc_lit do_gc = do
-  omit_yields <- stgToCmmOmitYields <$> getStgToCmmConfig
+  omit_yields      <- stgToCmmOmitYields <$> getStgToCmmConfig
+  omit_loop_yields <- stgToCmmOmitLoopYields <$> getStgToCmmConfig
   platform    <- getPlatform
   gc_id       <- newBlockId
 
@@ -634,10 +635,11 @@ do_checks mb_stk_hwm checkYield mb_alloc_lit do_gc = do
   -- of a self-recursive tail call.
   -- See Note [Self-recursive loop header].
   self_loop_info <- getSelfLoop
-  case self_loop_info of
-    Just MkSelfLoopInfo { sli_header_block = loop_header_id }
-        | checkYield && isJust mb_stk_hwm -> emitLabel loop_header_id
-    _otherwise -> return ()
+  let loop_header = case self_loop_info of
+        Just MkSelfLoopInfo { sli_header_block = loop_header_id }
+            | checkYield && isJust mb_stk_hwm -> Just loop_header_id
+        _otherwise -> Nothing
+  mapM_ emitLabel loop_header
 
   case mb_alloc_lit of
     Just alloc_lit -> do
@@ -647,7 +649,9 @@ do_checks mb_stk_hwm checkYield mb_alloc_lit do_gc = do
      emitAssign (hpReg platform) bump_hp
      emit =<< mkCmmIfThen' hp_oflo (alloc_n <*> mkBranch gc_id) (Just False)
     Nothing ->
-      when (checkYield && not omit_yields) $ do
+      -- See Note [Yielding in loops]
+      when (checkYield && (not omit_yields
+                           || (isJust loop_header && not omit_loop_yields))) $ do
          -- Yielding if HpLim == 0
          let yielding = CmmMachOp (mo_wordEq platform)
                                   [CmmReg $ hpLimReg platform,
@@ -665,6 +669,24 @@ do_checks mb_stk_hwm checkYield mb_alloc_lit do_gc = do
                 -- with slop at the end of the current block, which can
                 -- confuse the LDV profiler.
 
+-- Note [Yielding in loops]
+-- ~~~~~~~~~~~~~~~~~~~~~~~~~
+-- A function that doesn't allocate has no heap check, and with
+-- -fomit-yields (the default) gets no yield check (HpLim == 0) in its
+-- place either. A thread running a non-allocating loop then never notices
+-- that the RTS wants it to stop: every other capability waits for it to
+-- reach the end of the loop before a GC can start (see --long-gc-sync).
+-- -fno-omit-yields puts the yield check back at the entry to every such
+-- function, which costs about 5% in code size.
+--
+-- Most of these loops are self-recursive tail calls, compiled to a jump
+-- back to the self-loop header (Note [Self-recursive loop header]).
+-- -fno-omit-loop-yields puts the yield check only after such a header,
+-- so it is made once per iteration of the loop, and nowhere else. The RTS
+-- sets HpLim to 0 when it wants a capability to stop (interruptCapability),
+-- so a GC sync then waits for at most one iteration of the loop. Loops
+-- through mutual recursion or unknown calls still need -fno-omit-yields.
+
 -- Note [Self-recursive loop header]
 -- ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 -- Self-recursive loop header is required by loopification optimization (See
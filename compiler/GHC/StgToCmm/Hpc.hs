@@ -6,11 +6,13 @@
 --
 -----------------------------------------------------------------------------
 
-module GHC.StgToCmm.Hpc ( mkTickBox ) where
+module GHC.StgToCmm.Hpc ( emitTickBox ) where
 
 import GHC.Prelude
 import GHC.Platform
 
+import GHC.StgToCmm.Config
+import GHC.StgToCmm.Monad
 
 import GHC.Cmm.Graph
 import GHC.Cmm.Expr
@@ -19,14 +21,28 @@ import GHC.Cmm.Utils
 
 import GHC.Unit.Module
 
-
-mkTickBox :: Platform -> Module -> Int -> CmmAGraph
-mkTickBox platform mod n
-  = mkStore tick_box (CmmMachOp (MO_Add W64)
-                                [ CmmLoad tick_box b64 NaturallyAligned
-                                , CmmLit (CmmInt 1 W64)
-                                ])
-  where
-    tick_box = cmmIndex platform W64
-                        (CmmLit $ CmmLabel $ mkHpcTicksLabel $ mod)
-                        n
+-- | Count an entry into tick box @n@ of a module.
+--
+-- With @-fhpc-boolean@ we only record that the box was entered, by setting it
+-- to 1 the first time. Once set, the box is only read, so the cache line it
+-- is on stays shared between the cores running the program, rather than
+-- bouncing between them as each increments its boxes.
+emitTickBox :: Module -> Int -> FCode ()
+emitTickBox mod n = do
+  cfg <- getStgToCmmConfig
+  let platform = stgToCmmPlatform cfg
+      tick_box = cmmIndex platform W64
+                          (CmmLit $ CmmLabel $ mkHpcTicksLabel $ mod)
+                          n
+      count    = CmmLoad tick_box b64 NaturallyAligned
+  if stgToCmmHpcBoolean cfg
+    then do
+      let unset = CmmMachOp (MO_Eq W64) [count, CmmLit (CmmInt 0 W64)]
+      emit =<< mkCmmIfThen' unset
+                 (mkStore tick_box (CmmLit (CmmInt 1 W64)))
+                 (Just False)
+    else
+      emit $ mkStore tick_box (CmmMachOp (MO_Add W64)
+                                         [ count
+                                         , CmmLit (CmmInt 1 W64)
+                                         ])
@@ -1708,11 +1708,14 @@ emitPrimOp cfg primop =
   ReadTVarOp -> alwaysExternal
   ReadTVarIOOp -> alwaysExternal
   WriteTVarOp -> alwaysExternal
+  SetTVarWakeLimitOp -> alwaysExternal
   NewMVarOp -> alwaysExternal
   TakeMVarOp -> alwaysExternal
   TryTakeMVarOp -> alwaysExternal
   PutMVarOp -> alwaysExternal
   TryPutMVarOp -> alwaysExternal
+  BargingTakeMVarOp -> alwaysExternal
+  BargingPutMVarOp -> alwaysExternal
   ReadMVarOp -> alwaysExternal
   TryReadMVarOp -> alwaysExternal
   IsEmptyMVarOp -> alwaysExternal
@@ -1766,6 +1769,7 @@ emitPrimOp cfg primop =
   TraceEventBinaryOp -> alwaysExternal
   TraceMarkerOp -> alwaysExternal
   SetThreadAllocationCounter -> alwaysExternal
+  SetThreadPriority -> alwaysExternal
   KeepAliveOp -> alwaysExternal
 
  where
@@ -72,6 +72,36 @@ code containing labels containing counters which then get bumped at runtime.
 There are currently only *static* ticky counters. Either we bump one of the
 static counters included in the RTS. Or we emit StgEntCounter structures in
 the object code and bump these.
+
+Note [Sampled ticky counters]
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+-ticky bumps counters at every entry and allocation, and every capability
+bumps the same counters, so a ticky program runs a good deal slower, and
+differently, from the optimised program we wanted to look at. -ticky also
+implies -debug, as only the debug RTS prints the ticky report.
+
+With -ticky-sample=N we generate the same ticky code, but each site (each
+use of ifTicky or ifTickyTag) only runs it one in every N times we get
+there, bumping the counters by N rather than 1, so that they estimate the
+real counts. The countdown is rTickyCountdown in the register table of the
+capability, so deciding whether to count costs a decrement of memory that
+no other capability touches:
+
+    left = BaseReg->rTickyCountdown - 1;
+    BaseReg->rTickyCountdown = left;
+    if (left <= 0) {
+        BaseReg->rTickyCountdown = N;
+        ... ticky code, adding N times as much ...
+    }
+
+The countdown is shared by all the sites, which is what makes it a sample:
+a site is counted when it's the Nth event on its capability since the last
+one we counted.
+
+-ticky-sample doesn't imply -debug, and works with the threaded RTS (the
+counters are then bumped racily, which only loses the odd sample). Any RTS
+with tracing can post the per-closure counters to the eventlog with
++RTS -lT; see requestTickyCounterSamples in rts/Ticky.c.
 -}
 
 module GHC.StgToCmm.Ticky (
@@ -691,13 +721,14 @@ tickyAllocHeap ::
 tickyAllocHeap genuine hp
   = ifTicky $
     do  { platform <- getPlatform
+        ; scale <- tickyScale
         ; ticky_ctr <- getTickyCtrLabel
         ; emit $ catAGraphs $
             -- only test hp from within the emit so that the monadic
             -- computation itself is not strict in hp (cf knot in
             -- GHC.StgToCmm.Monad.getHeapUsage)
           if hp == 0 then []
-          else let !bytes = platformWordSizeInBytes platform * hp in [
+          else let !bytes = platformWordSizeInBytes platform * hp * scale in [
             -- Bump the allocation total in the closure's StgEntCounter
             addToMem (rEP_StgEntCounter_allocs platform)
                      (CmmLit (cmmLabelOffB ticky_ctr (pc_OFFSET_StgEntCounter_allocs (platformConstants platform))))
@@ -710,7 +741,7 @@ tickyAllocHeap genuine hp
             if not genuine then mkNop
             else addToMemLbl (bWord platform)
                              (mkRtsCmmDataLabel (fsLit "ALLOC_HEAP_ctr"))
-                             1
+                             scale
             ]}
 
 
@@ -778,10 +809,37 @@ runIfFlag :: (StgToCmmConfig -> Bool) -> FCode () -> FCode ()
 runIfFlag f = whenM (f <$> getStgToCmmConfig)
 
 ifTicky :: FCode () -> FCode ()
-ifTicky = runIfFlag stgToCmmDoTicky
+ifTicky = runIfFlag stgToCmmDoTicky . sampleTicky
 
 ifTickyTag :: FCode () -> FCode ()
-ifTickyTag = runIfFlag stgToCmmTickyTag
+ifTickyTag = runIfFlag stgToCmmTickyTag . sampleTicky
+
+-- | Run ticky code, or with @-ticky-sample=N@, one in every N times we get
+-- here. See Note [Sampled ticky counters].
+sampleTicky :: FCode () -> FCode ()
+sampleTicky code = do
+  cfg <- getStgToCmmConfig
+  let n = stgToCmmTickySample cfg
+      platform = stgToCmmPlatform cfg
+      w = wordWidth platform
+      countdown = cmmOffset platform (baseExpr platform)
+                    (pc_OFFSET_StgRegTable_rTickyCountdown (platformConstants platform))
+  if n <= 1 then code else do
+    left <- newTemp (bWord platform)
+    emitAssign (CmmLocal left)
+      (CmmMachOp (MO_Sub w) [ CmmLoad countdown (bWord platform) NaturallyAligned
+                            , mkIntExpr platform 1 ])
+    emitStore countdown (CmmReg (CmmLocal left))
+    sample <- getCode $ do
+      emitStore countdown (mkIntExpr platform n)
+      code
+    emit =<< mkCmmIfThen' (CmmMachOp (MO_S_Le w) [ CmmReg (CmmLocal left)
+                                                 , zeroExpr platform ])
+                          sample (Just False)
+
+-- | How much a sampled counter goes up by for each event we count
+tickyScale :: FCode Int
+tickyScale = max 1 . stgToCmmTickySample <$> getStgToCmmConfig
 
 ifTickyAllocd :: FCode () -> FCode ()
 ifTickyAllocd = runIfFlag stgToCmmTickyAllocd
@@ -853,9 +911,14 @@ emitAddToMem lhs n = do
 emitAddToMemE :: CmmExpr -> CmmExpr -> FCode ()
 emitAddToMemE lhs n = do
   platform <- getPlatform
+  scale <- tickyScale
   val <- newTemp (bWord platform)
   emitAtomicRead MemOrderRelaxed val lhs
-  let val' = cmmOffsetExpr platform (CmmReg (CmmLocal val)) n
+  -- See Note [Sampled ticky counters]
+  let n' | scale == 1 = n
+         | otherwise  = CmmMachOp (MO_Mul (wordWidth platform))
+                                  [n, mkIntExpr platform scale]
+      val' = cmmOffsetExpr platform (CmmReg (CmmLocal val)) n'
   emitAtomicWrite MemOrderRelaxed lhs val'
 
 ------------------------------------------------------------------
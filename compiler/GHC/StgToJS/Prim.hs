@@ -929,6 +929,7 @@ genPrim prof bound ty op = case op of
   ReadTVarOp   -> \[r] [tv]   -> pure $ PrimInline $ r  |= app hdReadTVar   [tv]
   ReadTVarIOOp -> \[r] [tv]   -> pure $ PrimInline $ r  |= app hdReadTVarIO [tv]
   WriteTVarOp  -> \[] [tv,v]  -> pure $ PrimInline $ appS hdWriteTVar [tv,v]
+  SetTVarWakeLimitOp -> \[] [_tv,_n] -> pure $ PrimInline mempty -- a single thread runs at a time
 
 ------------------------------- Synchronized Mutable Variables ------------------
 
@@ -937,6 +938,9 @@ genPrim prof bound ty op = case op of
   TryTakeMVarOp -> \[r,v] [m]   -> pure $ PrimInline $ appT [r,v] hdTryTakeMVarStr [m]
   PutMVarOp     -> \[]    [m,v] -> pure $ PRPrimCall $ returnS (app hdPutMVarStr [m,v])
   TryPutMVarOp  -> \[r]   [m,v] -> pure $ PrimInline $ r |= app hdTryPutMVarStr [m,v]
+  -- a single thread runs at a time, so there is nothing to barge past
+  BargingTakeMVarOp -> \[_r] [m]   -> pure $ PRPrimCall $ returnS (app hdTakeMVarStr [m])
+  BargingPutMVarOp  -> \[]   [m,v] -> pure $ PRPrimCall $ returnS (app hdPutMVarStr [m,v])
   ReadMVarOp    -> \[_r]  [m]   -> pure $ PRPrimCall $ returnS (app hdReadMVarStr [m])
   TryReadMVarOp -> \[r,v] [m]   -> pure $ PrimInline $ mconcat
                                    [ v |= m .^ val
@@ -1173,6 +1177,7 @@ genPrim prof bound ty op = case op of
   WhereFromOp                       -> unhandledPrimop op -- should be easily implementable with o.f.n
 
   SetThreadAllocationCounter        -> unhandledPrimop op
+  SetThreadPriority                 -> unhandledPrimop op
 
 ------------------------------- Vector -----------------------------------------
 -- For now, vectors are unsupported on the JS backend. Simply put, they do not
@@ -41,7 +41,7 @@ import GHC.IO
 
 import GHC.Utils.Monad
 import Data.Word
-import GHC.Exts( Ptr(..), noDuplicate#, oneShot )
+import GHC.Exts( Ptr, noDuplicate#, oneShot )
 import Foreign.Storable
 import GHC.Utils.Monad.State.Strict as Strict
 
@@ -49,23 +49,6 @@ import GHC.Utils.Monad.State.Strict as Strict
 import GHC.Utils.Panic.Plain
 #endif
 
-#include "MachDeps.h"
-
-#if WORD_SIZE_IN_BITS != 64
-#define NO_FETCH_ADD
-#endif
-
-#if defined(NO_FETCH_ADD)
-import GHC.Exts ( atomicCasWord64Addr#, eqWord64#, readWord64OffAddr# )
-#else
-import GHC.Exts( fetchAddWordAddr#, word64ToWord# )
-#endif
-
-import GHC.Exts ( Addr#, State#, Word64#, RealWorld )
-import GHC.Int ( Int(..) )
-import GHC.Word( Word64(..) )
-import GHC.Exts( plusWord64#, int2Word#, wordToWord64# )
-
 {-
 ************************************************************************
 *                                                                      *
@@ -152,6 +135,33 @@ result. It was very brittle and required enabling -fno-state-hack globally. So
 it has been rewritten using lower level constructs to explicitly state what we
 want.
 
+Note [Unique blocks]
+~~~~~~~~~~~~~~~~~~~
+Every unique comes from the counter ghc_unique_counter64, which lives in the
+RTS so that several instances of the GHC library (a plugin's and the host's,
+say) share it (#19940). Taking each unique with its own atomic add on that
+counter made its cache line bounce between cores with -j, since every thread
+typechecking or simplifying a module wants uniques all the time.
+
+So genSym calls ghc_lib_genSym in cbits/genSym.c, and each OS thread instead
+takes a block of 1024 uniques from the counter with a single atomic add and
+hands them out itself:
+
+  * The counter still moves in steps of ghc_unique_inc, and a block taken
+    when it is n gives out n+inc, n+2*inc, ..., n+1024*inc, which are exactly
+    the uniques that 1024 calls of the old genSym would have given. On one
+    thread we get the very same sequence, so -dinitial-unique and
+    -dunique-increment behave as before.
+
+  * Blocks are disjoint, whichever thread or GHC instance takes them, so
+    uniques are still unique. They are no longer handed out in increasing
+    order across threads, but nothing relied on that.
+
+  * initUniqSupply bumps a generation number, so blocks taken before the
+    counter or the increment were set are thrown away rather than used up.
+
+The uniques left in a block when its thread finishes are simply never used.
+
 Note [Optimising use of unique supplies]
 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 When it comes to having a way to generate new Uniques
@@ -237,38 +247,12 @@ mkSplitUniqSupply c
         (# s4, MkSplitUniqSupply (tag .|. u) x y #)
         }}}}
 
-#if defined(NO_FETCH_ADD)
--- GHC currently does not provide this operation on 32-bit platforms,
--- hence the CAS-based implementation.
-fetchAddWord64Addr# :: Addr# -> Word64# -> State# RealWorld
-                    -> (# State# RealWorld, Word64# #)
-fetchAddWord64Addr# = go
-  where
-    go ptr inc s0 =
-      case readWord64OffAddr# ptr 0# s0 of
-        (# s1, n0 #) ->
-          case atomicCasWord64Addr# ptr n0 (n0 `plusWord64#` inc) s1 of
-            (# s2, res #)
-              | 1# <- res `eqWord64#` n0 -> (# s2, n0 #)
-              | otherwise -> go ptr inc s2
-#else
-fetchAddWord64Addr# :: Addr# -> Word64# -> State# RealWorld
-                    -> (# State# RealWorld, Word64# #)
-fetchAddWord64Addr# addr inc s0 =
-    case fetchAddWordAddr# addr (word64ToWord# inc) s0 of
-      (# s1, res #) -> (# s1, wordToWord64# res #)
-#endif
-
+-- | A new unique, from this thread's block of them.
+-- See Note [Unique blocks]
 genSym :: IO Word64
 genSym = do
     let !mask = (1 `unsafeShiftL` uNIQUE_BITS) - 1
-    let !(Ptr counter) = ghc_unique_counter64
-    I# inc# <- peek ghc_unique_inc
-    let !inc = wordToWord64# (int2Word# inc#)
-    u <- IO $ \s1 -> case fetchAddWord64Addr# counter inc s1 of
-            (# s2, val #) ->
-                let !u = W64# (val `plusWord64#` inc) .&. mask
-                in (# s2, u #)
+    u <- (.&. mask) <$> ghc_lib_genSym
 #if defined(DEBUG)
     -- Uh oh! We will overflow next time a unique is requested.
     -- (Note that if the increment isn't 1 we may miss this check)
@@ -276,6 +260,8 @@ genSym = do
 #endif
     return u
 
+foreign import ccall unsafe "ghc_lib_genSym"            ghc_lib_genSym            :: IO Word64
+foreign import ccall unsafe "ghc_lib_resetUniqueBlocks" ghc_lib_resetUniqueBlocks :: IO ()
 foreign import ccall unsafe "&ghc_unique_counter64" ghc_unique_counter64 :: Ptr Word64
 foreign import ccall unsafe "&ghc_unique_inc"       ghc_unique_inc       :: Ptr Int
 
@@ -283,6 +269,7 @@ initUniqSupply :: Word64 -> Int -> IO ()
 initUniqSupply counter inc = do
     poke ghc_unique_counter64 counter
     poke ghc_unique_inc       inc
+    ghc_lib_resetUniqueBlocks
 
 uniqFromTag :: Char -> IO Unique
 uniqFromTag !tag
@@ -24,3 +24,62 @@
 #if !defined(HAVE_UNIQUE64)
 HsWord64 ghc_unique_counter64 = 0;
 #endif
+
+// Handing out uniques: see Note [Unique blocks] in GHC.Types.Unique.Supply.
+//
+// Each OS thread takes UNIQUE_BLOCK_SIZE uniques at a time from the shared
+// counter, with one atomic add, and then hands them out itself. The block
+// remembers the increment it was taken with and the generation it belongs
+// to, which ghc_lib_resetUniqueBlocks bumps whenever the counter or the
+// increment is set, so that no thread carries on from a stale block.
+
+#define UNIQUE_BLOCK_SIZE 1024
+
+static HsWord64 unique_generation = 0;
+
+#if CC_SUPPORTS_TLS
+typedef struct {
+    HsWord64 next;       // the next unique to hand out
+    HsWord64 left;       // how many are left in the block
+    HsInt    inc;
+    HsWord64 generation;
+} UniqueBlock;
+
+static __thread UniqueBlock unique_block = { 0, 0, 0, 0 };
+#endif
+
+HsWord64 ghc_lib_genSym(void);
+void ghc_lib_resetUniqueBlocks(void);
+
+HsWord64
+ghc_lib_genSym(void)
+{
+    HsInt inc = ghc_unique_inc;
+#if CC_SUPPORTS_TLS
+    UniqueBlock *b = &unique_block;
+    HsWord64 gen = __atomic_load_n(&unique_generation, __ATOMIC_ACQUIRE);
+    if (b->left == 0 || b->inc != inc || b->generation != gen) {
+        HsWord64 old =
+            __atomic_fetch_add(&ghc_unique_counter64,
+                               (HsWord64)inc * UNIQUE_BLOCK_SIZE,
+                               __ATOMIC_RELAXED);
+        b->next = old + (HsWord64)inc;
+        b->left = UNIQUE_BLOCK_SIZE;
+        b->inc = inc;
+        b->generation = gen;
+    }
+    HsWord64 u = b->next;
+    b->next += (HsWord64)inc;
+    b->left--;
+    return u;
+#else
+    return __atomic_fetch_add(&ghc_unique_counter64, (HsWord64)inc,
+                              __ATOMIC_RELAXED) + (HsWord64)inc;
+#endif
+}
+
+void
+ghc_lib_resetUniqueBlocks(void)
+{
+    __atomic_fetch_add(&unique_generation, 1, __ATOMIC_RELEASE);
+}
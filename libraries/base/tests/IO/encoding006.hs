@@ -0,0 +1,114 @@
+import Control.Monad
+import Data.Bits
+import Data.Char
+import Data.List (unfoldr)
+import Data.Word (Word8)
+import Foreign.Ptr
+import Foreign.Marshal.Array
+import GHC.Foreign (peekCStringLen, withCStringLen)
+import GHC.IO.Encoding (utf8, mkTextEncoding)
+import System.IO
+
+-- The UTF-8 codec hands long stretches of its buffers to C (see Note
+-- [UTF-8 codec in C] in GHC.Internal.IO.Encoding.UTF8), which does runs of
+-- ASCII a block at a time. Check it against a plain Haskell model on text
+-- with long and short ASCII runs, multi-byte characters, invalid bytes and
+-- surrogates, through both GHC.Foreign and a Handle with small buffers.
+
+refEncode :: String -> [Word8]
+refEncode = concatMap enc
+  where
+    enc c
+      | n < 0x80    = [fromIntegral n]
+      | n < 0x800   = [0xc0 .|. hi 6, cont 0]
+      | isSurrogate = [fromIntegral (ord '?')]
+      | n < 0x10000 = [0xe0 .|. hi 12, cont 6, cont 0]
+      | otherwise   = [0xf0 .|. hi 18, cont 12, cont 6, cont 0]
+      where n = ord c
+            isSurrogate = n >= 0xd800 && n <= 0xdfff
+            hi s = fromIntegral (n `shiftR` s)
+            cont s = 0x80 .|. fromIntegral ((n `shiftR` s) .&. 0x3f)
+
+-- invalid bytes become U+FFFD, one each
+refDecode :: [Word8] -> String
+refDecode [] = []
+refDecode bs@(_:rest) = case char bs of
+  Just (c, bs') -> c : refDecode bs'
+  Nothing       -> '\xFFFD' : refDecode rest
+  where
+    char (b0:bs')
+      | b0 < 0x80 = Just (chr (fromIntegral b0), bs')
+    char (b0:b1:bs')
+      | b0 >= 0xc2 && b0 <= 0xdf, isCont b1
+      = Just (chr (bits b0 0x1f 6 + bits b1 0x3f 0), bs')
+    char (b0:b1:b2:bs')
+      | b0 >= 0xe0 && b0 <= 0xef, isCont b1, isCont b2
+      , let n = bits b0 0x0f 12 + bits b1 0x3f 6 + bits b2 0x3f 0
+      , n >= 0x800, n < 0xd800 || n > 0xdfff
+      = Just (chr n, bs')
+    char (b0:b1:b2:b3:bs')
+      | b0 >= 0xf0 && b0 <= 0xf4, isCont b1, isCont b2, isCont b3
+      , let n = bits b0 0x07 18 + bits b1 0x3f 12 + bits b2 0x3f 6 + bits b3 0x3f 0
+      , n >= 0x10000, n <= 0x10ffff
+      = Just (chr n, bs')
+    char _ = Nothing
+    isCont b = b .&. 0xc0 == 0x80
+    bits b m s = (fromIntegral b .&. m) `shiftL` s
+
+randoms :: Int -> [Int]
+randoms = drop 1 . iterate (\x -> (x * 1103515245 + 12345) `mod` 2147483648)
+
+-- pieces of text: long and short ASCII runs, and characters of each length
+text :: Int -> String
+text seed = concat (take 200 (unfoldr piece (randoms seed)))
+  where
+    piece (r:r':rs) = Just (pick (r `mod` 8) r', rs)
+    piece _ = Nothing
+    pick 0 r = replicate (r `mod` 70) 'a' ++ "\n"
+    pick 1 r = take (r `mod` 40) (cycle "INFO request served in 12ms ")
+    pick 2 r = [chr (0x80 + r `mod` 0x780)]
+    pick 3 r = [chr (0x800 + r `mod` 0xd000)]
+    pick 4 r = [chr (0x10000 + r `mod` 0x100000)]
+    pick 5 r = [chr (0xd800 + r `mod` 0x800)]           -- lone surrogate
+    pick 6 r = map chr [0x430 .. 0x430 + r `mod` 20]   -- Cyrillic
+    pick _ _ = " "
+
+-- valid text with stray bytes dropped in, each before an ASCII character so
+-- that it can't be part of a valid sequence
+corrupt :: Int -> [Word8] -> [Word8]
+corrupt seed = go (randoms seed)
+  where
+    go (r:rs) (b:bs)
+      | b < 0x80, r `mod` 37 == 0 = fromIntegral (0x80 + r `mod` 0x80) : b : go rs bs
+      | otherwise       = b : go rs bs
+    go _ bs = bs
+
+main :: IO ()
+main = do
+  translit <- mkTextEncoding "UTF-8//TRANSLIT"
+  forM_ [1 .. 40] $ \seed -> do
+    let s = text seed
+        bytes = refEncode s
+        bad = corrupt seed bytes
+    enc <- withCStringLen translit s $ \(p, n) -> peekArray n (castPtr p)
+    when (enc /= bytes) $ putStrLn ("encode " ++ show seed)
+    dec <- withArrayLen bad $ \n p -> peekCStringLen translit (castPtr p, n)
+    when (dec /= refDecode bad) $ putStrLn ("decode " ++ show seed)
+    let good = filter (\c -> ord c < 0xd800 || ord c > 0xdfff) s
+    dec' <- withArrayLen (refEncode good) $ \n p -> peekCStringLen utf8 (castPtr p, n)
+    when (dec' /= good) $ putStrLn ("strict decode " ++ show seed)
+
+  -- through a Handle, whose buffers split characters and ASCII runs
+  let s = filter (\c -> ord c < 0xd800 || ord c > 0xdfff) (concatMap text [1 .. 10])
+  forM_ [Just 7, Just 100, Nothing] $ \bufsize -> do
+    h <- openFile "encoding006.txt" WriteMode
+    hSetEncoding h utf8
+    hSetBuffering h (BlockBuffering bufsize)
+    hPutStr h s
+    hClose h
+    h' <- openFile "encoding006.txt" ReadMode
+    hSetEncoding h' utf8
+    hSetBuffering h' (BlockBuffering bufsize)
+    s' <- hGetContents h'
+    print (s' == s)
+    hClose h'
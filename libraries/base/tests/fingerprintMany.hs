@@ -0,0 +1,23 @@
+import Control.Monad
+import Foreign.Marshal.Alloc
+import Foreign.Marshal.Array
+import Foreign.Ptr
+import GHC.Internal.Fingerprint
+import Data.Word
+
+-- fingerprintDataMany must agree with fingerprintData whatever the lengths
+-- and however many buffers it is given at once.
+main :: IO ()
+main = do
+  let lens = [0..300] ++ [1000, 4096, 65537]
+      total = sum lens
+  allocaBytes total $ \base -> do
+    pokeArray base [ fromIntegral (i * 7 + i `div` 251) :: Word8
+                   | i <- [0 .. total - 1] ]
+    let offs = scanl (+) 0 lens
+        bufs = [ (base `plusPtr` o, l) | (o, l) <- zip offs lens ]
+    expected <- mapM (uncurry fingerprintData) bufs
+    forM_ [0, 1, 2, 3, 4, 5, 8, 9, 17, length bufs] $ \n -> do
+      got <- fingerprintDataMany (take n bufs)
+      print (got == take n expected)
+  print (fingerprintString "fingerprintMany \x1F600")
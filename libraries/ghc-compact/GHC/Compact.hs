@@ -1,7 +1,9 @@
 {-# LANGUAGE BangPatterns #-}
 {-# LANGUAGE CPP #-}
+{-# LANGUAGE GHCForeignImportPrim #-}
 {-# LANGUAGE MagicHash #-}
 {-# LANGUAGE UnboxedTuples #-}
+{-# LANGUAGE UnliftedFFITypes #-}
 {-# OPTIONS_GHC -Wno-redundant-constraints -Wno-name-shadowing #-}
 
 -----------------------------------------------------------------------------
@@ -66,6 +68,7 @@ module GHC.Compact (
   compactWithSharing,
   compactAdd,
   compactAddWithSharing,
+  compactMerge,
 
   -- * Inspecting a Compact
   getCompact,
@@ -75,13 +78,17 @@ module GHC.Compact (
 
   -- * Other utilities
   compactResize,
+  compactEnableDedup,
+  compactMakeImmortal,
 
   -- * Internal operations
   mkCompact,
   compactSized,
   ) where
 
+import Control.Concurrent (yield)
 import Control.Concurrent.MVar
+import Control.Exception (mask_)
 import GHC.Prim
 import GHC.Types
 
@@ -235,6 +242,38 @@ compactAddWithSharing (Compact compact# _ lock) a =
     case compactAddWithSharing# compact# a s of { (# s1, pk #) ->
     (# s1, Compact compact# pk lock #) }
 
+-- | Move the contents of the second 'Compact' into the first, without
+-- copying anything, and return a handle to the second's value in the
+-- merged region. /O(number of blocks in the second region)/
+--
+-- This lets you build a large region in parallel: compact its parts in
+-- separate threads, each into a region of its own, then merge them.
+--
+-- @
+--      do parts <- mapConcurrently 'compact' chunks
+--         r <- 'compact' ()
+--         mapM ('compactMerge' r) parts
+-- @
+--
+-- The second 'Compact' must not be used to add to its old region, nor to
+-- look at its size, afterwards: this would block, as if its region had
+-- been taken by another thread for good. Its value, and every other value
+-- that was in its region, stays valid, and now keeps the merged region
+-- alive. The regions must not be the same region.
+--
+compactMerge :: Compact a -> Compact b -> IO (Compact b)
+compactMerge (Compact compact# _ lock) (Compact other# b other_lock)
+  | lock == other_lock = error "compactMerge: can't merge a region into itself"
+  | otherwise = withMVar lock $ \_ -> mask_ $ do
+      takeMVar other_lock
+      let merge = IO $ \s -> case compactMerge# compact# other# s of
+                    (# s1, ok #) -> (# s1, isTrue# ok #)
+          loop = do
+            ok <- merge
+            if ok then return () else yield >> loop
+      loop
+      return (Compact compact# b lock)
+
 -- | Check if the second argument is inside the passed 'Compact'.
 --
 inCompact :: Compact b -> a -> IO Bool
@@ -267,3 +306,57 @@ compactResize (Compact oldBuffer _ lock) (W# new_size) =
   withMVar lock $ \_ -> IO $ \s ->
     case compactResize# oldBuffer new_size s of
       s' -> (# s', () #)
+
+-- | Make the compact region share equal data: from now on, constructors
+-- and byte arrays added to the region are not copied if an equal one has
+-- been added since this call, whether in the same or an earlier
+-- 'compactAdd'. This makes adding data that overlaps what is in the region
+-- already cheaper in time and space, at the cost of hashing what is added
+-- and of an index in the C heap as large as a hash table of the region's
+-- distinct closures.
+--
+-- Data added before the call isn't indexed, and the index isn't kept when
+-- the region is serialized.
+--
+compactEnableDedup :: Compact a -> IO ()
+compactEnableDedup (Compact buffer _ lock) =
+  withMVar lock $ \_ -> IO $ \s ->
+    case compactEnableDedup# buffer s of
+      s' -> (# s', () #)
+
+-- | Make the compact region immortal: the garbage collector stops
+-- tracking whether it is alive, so that however large it is it costs
+-- nothing at a collection. The region is never freed, even once nothing
+-- refers to it any more, so this is for data that the program keeps for
+-- the rest of its run.
+--
+-- Nothing can be added to the region afterwards: adding to it, resizing it,
+-- looking at its size or serializing it would block, as if its region had
+-- been taken by another thread for good (see 'compactMerge'). Its values
+-- can be used as before.
+--
+compactMakeImmortal :: Compact a -> IO ()
+compactMakeImmortal (Compact buffer _ lock) = mask_ $ do
+  takeMVar lock
+  let makeImmortal = IO $ \s -> case compactMakeImmortal# buffer s of
+                       (# s1, ok #) -> (# s1, isTrue# ok #)
+      loop = do
+        ok <- makeImmortal
+        if ok then return () else yield >> loop
+  loop
+
+-- | Merge the second compact region into the first. Returns 0 if they
+-- can't be merged right now (while a concurrent nonmoving collection
+-- owns one of them); try again later.
+foreign import prim "stg_compactMergezh"
+  compactMerge# :: Compact# -> Compact# -> State# RealWorld
+                -> (# State# RealWorld, Int# #)
+
+-- | Make the compact region immortal. Returns 0 if it can't be done right
+-- now (while a concurrent nonmoving collection owns it); try again later.
+foreign import prim "stg_compactMakeImmortalzh"
+  compactMakeImmortal# :: Compact# -> State# RealWorld
+                       -> (# State# RealWorld, Int# #)
+
+foreign import prim "stg_compactEnableDedupzh"
+  compactEnableDedup# :: Compact# -> State# RealWorld -> State# RealWorld
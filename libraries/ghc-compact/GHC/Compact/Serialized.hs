@@ -1,7 +1,9 @@
 {-# LANGUAGE BangPatterns #-}
 {-# LANGUAGE CPP #-}
+{-# LANGUAGE GHCForeignImportPrim #-}
 {-# LANGUAGE MagicHash #-}
 {-# LANGUAGE UnboxedTuples #-}
+{-# LANGUAGE UnliftedFFITypes #-}
 
 -----------------------------------------------------------------------------
 -- |
@@ -24,6 +26,8 @@ module GHC.Compact.Serialized(
   withSerializedCompact,
   importCompact,
   importCompactByteStrings,
+  writeCompactFile,
+  mapCompactFile,
 ) where
 
 import GHC.Prim
@@ -32,13 +36,22 @@ import GHC.Word (Word8)
 import GHC.IO (unIO)
 
 import GHC.Ptr (Ptr(..), plusPtr)
+import GHC.IO.FD (FD(..))
+import GHC.IO.Handle.FD (handleToFd)
 
 import Control.Concurrent
+import Control.Exception (IOException, catch)
+import Control.Monad (forM_, when)
 import qualified Data.ByteString as ByteString
 import Data.ByteString.Internal(toForeignPtr)
 import Data.IORef(newIORef, readIORef, writeIORef)
+import Data.Word (Word64)
 import Foreign.ForeignPtr(withForeignPtr)
-import Foreign.Marshal.Utils(copyBytes)
+import Foreign.Marshal.Alloc (allocaBytes)
+import Foreign.Marshal.Array (peekArray, pokeArray)
+import Foreign.Marshal.Utils(copyBytes, fillBytes)
+import Foreign.Ptr (ptrToWordPtr, wordPtrToPtr)
+import System.IO
 
 import GHC.Compact
 
@@ -200,3 +213,127 @@ importCompactByteStrings serialized stringList =
             copyBytes to (from `plusPtr` off) (fromIntegral size)
           writeIORef state rest
     importCompact serialized filler
+
+-- A compact file starts with a header of Word64s: 'compactFileMagic', the
+-- number of blocks, the address of the root and the address and size of
+-- each block. The header and each block are padded to a multiple of
+-- 'compactFileAlignment' bytes, so that the blocks can be mapped into
+-- memory at page boundaries.
+
+compactFileMagic :: Word64
+compactFileMagic = 0x474843434e463031 -- "GHCCNF01"
+
+-- | The RTS's block size.
+compactFileAlignment :: Int
+compactFileAlignment = 4096
+
+alignUp :: Integral a => a -> a
+alignUp n = (n + a - 1) `div` a * a
+  where a = fromIntegral compactFileAlignment
+
+-- | Write the 'Compact' to a file which 'mapCompactFile' can map back into
+-- memory.
+writeCompactFile :: FilePath -> Compact a -> IO ()
+writeCompactFile path c =
+  withSerializedCompact c $ \(SerializedCompact blocks root) ->
+  withBinaryFile path WriteMode $ \h ->
+  allocaBytes compactFileAlignment $ \zeros -> do
+    fillBytes zeros 0 compactFileAlignment
+    let pad n = hPutBuf h zeros (alignUp n - n)
+        header = compactFileMagic : fromIntegral (length blocks) : addr root
+               : concat [ [addr p, fromIntegral sz] | (p, sz) <- blocks ]
+        headerSize = 8 * length header
+    allocaBytes headerSize $ \buf -> do
+      pokeArray buf header
+      hPutBuf h buf headerSize
+    pad headerSize
+    forM_ blocks $ \(p, sz) -> do
+      hPutBuf h p (fromIntegral sz)
+      pad (fromIntegral sz)
+  where
+    addr :: Ptr () -> Word64
+    addr = fromIntegral . ptrToWordPtr
+
+-- | Import a 'Compact' written by 'writeCompactFile'. Where the platform
+-- allows it, the blocks of the region are not read but mapped from the
+-- file, copy-on-write: the import takes time proportional to the number
+-- of blocks rather than to their size, the data is only read from the file
+-- when it is used, and processes that map the same file share its pages
+-- in memory. The file can be closed or removed afterwards.
+--
+-- The pages stay shared only as long as the region is not written to,
+-- which importing does if the region can't be put where it was when the
+-- file was written and its pointers have to be adjusted.
+--
+-- Returns 'Nothing' if the file is not a compact file. Like
+-- 'importCompact', this must be used with the same binary that wrote the
+-- file.
+mapCompactFile :: FilePath -> IO (Maybe (Compact a))
+mapCompactFile path = withBinaryFile path ReadMode $ \h -> do
+  fileSize <- hFileSize h
+  header <- readCompactFileHeader h fileSize
+  case header of
+    Just (Ptr rootAddr, first:rest) -> do
+      I# fd <- handleFd h
+      let fillBlock p sz off = do
+            hSeek h AbsoluteSeek (toInteger off)
+            n <- hGetBuf h p (fromIntegral sz)
+            when (n /= fromIntegral sz) $
+              ioError (userError ("mapCompactFile: " ++ path ++ " is truncated"))
+
+          mapBlock :: Addr# -> (Word, Word) -> State# RealWorld
+                   -> (# State# RealWorld, Addr# #)
+          mapBlock previous (sz@(W# size), off@(W# offset)) s =
+            case compactMapBlock# size previous fd offset s of
+              (# s1, block, mapped #)
+                | isTrue# mapped -> (# s1, block #)
+                | otherwise -> case unIO (fillBlock (Ptr block) sz off) s1 of
+                    (# s2, () #) -> (# s2, block #)
+
+          go :: Addr# -> [(Word, Word)] -> State# RealWorld -> State# RealWorld
+          go _ [] s = s
+          go previous (b:bs) s = case mapBlock previous b s of
+            (# s1, block #) -> go block bs s1
+
+      IO $ \s0 -> case mapBlock nullAddr# first s0 of
+        (# s1, firstBlock #) -> case go firstBlock rest s1 of
+          s2 -> fixupPointers firstBlock rootAddr s2
+    _ -> return Nothing
+  where
+    -- where mapping isn't possible the handle may not have a file
+    -- descriptor (e.g. on Windows); then the blocks are always read
+    handleFd h = (fromIntegral . fdFD <$> handleToFd h)
+      `catch` \e -> const (return (-1)) (e :: IOException)
+
+-- | The root and the (size, offset) of each block, if the file is a
+-- compact file.
+readCompactFileHeader :: Handle -> Integer
+                      -> IO (Maybe (Ptr (), [(Word, Word)]))
+readCompactFileHeader h fileSize = allocaBytes 24 $ \buf -> do
+  n <- hGetBuf h buf 24
+  header <- peekArray 3 buf
+  case header of
+    [magic, count, root]
+      | n == 24, magic == compactFileMagic, count > 0
+      , toInteger count * 16 + 24 <= fileSize -> do
+        let blocksSize = fromIntegral count * 16
+        ws <- allocaBytes blocksSize $ \bbuf -> do
+          _ <- hGetBuf h bbuf blocksSize
+          peekArray (2 * fromIntegral count) bbuf :: IO [Word64]
+        let sizes = [ toInteger sz | (_, sz) <- pairs ws ]
+            offsets = scanl (+) (alignUp (24 + toInteger blocksSize))
+                                (map alignUp sizes)
+        return $
+          if last offsets > fileSize
+             || last offsets > toInteger (maxBound :: Word)
+          then Nothing
+          else Just ( wordPtrToPtr (fromIntegral (root :: Word64))
+                    , zip (map fromInteger sizes) (map fromInteger offsets) )
+    _ -> return Nothing
+  where
+    pairs (a:b:rest) = (a, b) : pairs rest
+    pairs _ = []
+
+foreign import prim "stg_compactMapBlockzh"
+  compactMapBlock# :: Word# -> Addr# -> Int# -> Word# -> State# RealWorld
+                   -> (# State# RealWorld, Addr#, Int# #)
@@ -0,0 +1,17 @@
+import Control.Monad
+import GHC.Compact
+import System.Mem
+
+main = do
+  c <- compact [1 .. 10000 :: Int]
+  compactMakeImmortal c
+  print =<< inCompact c (getCompact c)
+  forM_ [1 .. 3] $ \_ -> do
+    performMajorGC
+    print (sum (getCompact c))
+
+  -- Values in the region stay valid after the last reference to the
+  -- Compact itself is gone
+  let xs = getCompact c
+  performMajorGC
+  print (length xs)
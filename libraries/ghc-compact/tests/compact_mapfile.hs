@@ -0,0 +1,21 @@
+import GHC.Compact
+import GHC.Compact.Serialized
+import System.Mem
+
+main = do
+  let val = (["hello", "world"], [1 .. 20000 :: Int], Just (42 :: Integer))
+  c <- compact val
+  writeCompactFile "compact_mapfile.cnf" c
+  writeFile "compact_mapfile.txt" "not a compact"
+
+  Just c' <- mapCompactFile "compact_mapfile.cnf"
+  print (getCompact c' == val)
+  performMajorGC
+  print (getCompact c' == val)
+
+  c'' <- compactAdd c' (Just "more")
+  print (getCompact c'')
+  print =<< inCompact c' (getCompact c')
+
+  r <- mapCompactFile "compact_mapfile.txt" :: IO (Maybe (Compact ()))
+  print (fmap (const ()) r)
@@ -0,0 +1,23 @@
+import Control.Concurrent
+import Control.Monad
+import GHC.Compact
+import System.Mem
+
+main = do
+  parts <- forM [1..4] $ \i -> do
+    m <- newEmptyMVar
+    forkIO $ compact [i * 1000 .. i * 1000 + 999 :: Int] >>= putMVar m
+    return m
+  cs <- mapM takeMVar parts
+  sizes <- mapM compactSize cs
+
+  c <- compact ()
+  size <- compactSize c
+  merged <- mapM (compactMerge c) cs
+  print (map (sum . getCompact) merged)
+  print =<< mapM (inCompact c . getCompact) merged
+  size' <- compactSize c
+  print (size' == size + sum sizes)
+
+  performMajorGC
+  print (sum (map (sum . getCompact) merged))
@@ -8,6 +8,7 @@
 {-# LANGUAGE TypeFamilies #-}
 {-# LANGUAGE RankNTypes #-}
 {-# LANGUAGE UnliftedFFITypes #-}
+{-# LANGUAGE GHCForeignImportPrim #-}
 
 {-|
 Module      :  GHC.Exts.Heap
@@ -54,6 +55,8 @@ module GHC.Exts.Heap (
      -- * Closure inspection
     , getBoxedClosureData
     , allClosures
+    , WalkedClosure(..)
+    , walkClosures
 
     -- * Boxes
     , Box(..)
@@ -79,6 +82,7 @@ import Data.Bits
 import Foreign
 import GHC.Exts
 import GHC.Int
+import GHC.IO (IO(..))
 import GHC.Word
 
 #include "ghcconfig.h"
@@ -378,3 +382,57 @@ getClosureDataFromHeapRepPrim getConDesc decodeCCS itbl heapRep pts = do
 -- | Like 'getClosureData', but taking a 'Box', so it is easier to work with.
 getBoxedClosureData :: Box -> IO Closure
 getBoxedClosureData (Box a) = getClosureData a
+
+-- | A closure visited by 'walkClosures'.
+data WalkedClosure = WalkedClosure
+    { walkedBox       :: Box
+      -- ^ The closure itself
+    , walkedInfoTable :: Ptr StgInfoTable
+    , walkedType      :: ClosureType
+    , walkedSize      :: Int
+      -- ^ The size of the closure in words, header included
+    , walkedPointers  :: [Int]
+      -- ^ The closures it points to, as indices into the list returned by
+      -- 'walkClosures', or -1 for those that weren't reached within its
+      -- limit. The pointers of TSO and STACK closures aren't followed.
+    }
+
+foreign import prim "walkClosureszh" walkClosures#
+    :: Any -> Word# -> State# RealWorld
+    -> (# State# RealWorld, Array# Any, ByteArray# #)
+
+-- | Visit up to the given number of closures reachable from a value,
+-- breadth-first, the value itself first. Unlike decoding the closures one at a
+-- time with 'getBoxedClosureData', this takes a single call into the runtime
+-- however many closures there are, so it scales to tools that analyse large
+-- heaps. Each closure is visited once, so shared and cyclic structure shows up
+-- as repeated indices in 'walkedPointers'.
+--
+-- The same caveats as for 'getClosureData' apply: the walk sees the heap as
+-- it is at the moment, thunks and indirections included, and mutable
+-- closures that other threads are writing to may be seen half-updated. See
+-- Note [Walking the heap] in @cbits/HeapWalk.c@.
+walkClosures :: Int -> a -> IO [WalkedClosure]
+walkClosures maxClosures x = case max 0 maxClosures of
+    I# n -> IO $ \s -> case walkClosures# (unsafeCoerce# x) (int2Word# n) s of
+        (# s1, closures, layout #) -> (# s1, decodeWalk closures layout #)
+
+decodeWalk :: Array# Any -> ByteArray# -> [WalkedClosure]
+decodeWalk closures layout = go 0 0
+  where
+    n = I# (sizeofArray# closures)
+    word (I# i) = W# (indexWordArray# layout i)
+    go i@(I# i#) off
+        | i >= n = []
+        | otherwise =
+            let nPtrs = fromIntegral (word (off + 3))
+                box = case indexArray# closures i# of (# c #) -> Box c
+                walked = WalkedClosure
+                    { walkedBox       = box
+                    , walkedInfoTable = wordPtrToPtr (fromIntegral (word off))
+                    , walkedType      = toEnum (fromIntegral (word (off + 1)))
+                    , walkedSize      = fromIntegral (word (off + 2))
+                    , walkedPointers  =
+                        [ fromIntegral (word j) | j <- [off + 4 .. off + 3 + nPtrs] ]
+                    }
+            in walked : go (i + 1) (off + 4 + nPtrs)
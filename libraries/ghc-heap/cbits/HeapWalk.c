@@ -0,0 +1,208 @@
+#include "Rts.h"
+
+#include <stdlib.h>
+
+/* Note [Walking the heap]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   getClosureData decodes one closure per call to unpackClosure#, which copies
+   the closure and allocates an array of its pointers. A tool walking a large
+   structure that way makes a primop call, and several allocations, for every
+   closure in it.
+
+   walkClosures# instead visits up to a given number of the closures reachable
+   from a root, breadth-first, in one call. It returns them in an Array#, in
+   the order they were reached (the root first), along with a ByteArray#
+   describing each of them in turn, in words:
+
+     info table, closure type, size, number of pointers n,
+     then for each of the n pointers the index in the Array# of the closure
+     it points to, or -1 if that closure wasn't reached within the limit
+
+   Each closure is visited once, so sharing and cycles show up as repeated
+   indices. As getClosureData doesn't decode TSO and STACK closures, the walk
+   doesn't follow their pointers, which their threads may be changing.
+
+   Nothing is allocated on the heap until the walk is done, so the GC can't
+   move the closures while we look at them. As with unpackClosure#, though,
+   other capabilities may be mutating what we read, so a walk of mutable data
+   that is shared with running threads is only a best effort.
+
+   The visited closures are kept in an open-addressed hash set of their
+   indices, rather than the RTS's HashTable, which isn't available to
+   libraries.
+*/
+
+typedef struct {
+    StgWord n_closures;
+    StgWord closures_size;
+    StgClosure **closures;      // in the order they were reached
+
+    StgWord n_layout;
+    StgWord layout_size;
+    StgWord *layout;            // see Note [Walking the heap]
+
+    StgWord set_size;           // a power of two
+    StgWord *set;               // index + 1 into closures, or 0 if empty
+
+    StgWord ptrs_size;
+    StgClosure **ptrs;          // scratch space for collect_pointers
+} HeapWalk;
+
+static void *reallocWalk(void *p, StgWord *size, StgWord need, size_t elem)
+{
+    if (need <= *size) {
+        return p;
+    }
+    StgWord new_size = *size == 0 ? 64 : *size;
+    while (new_size < need) {
+        new_size *= 2;
+    }
+    p = realloc(p, new_size * elem);
+    if (p == NULL) {
+        barf("walkClosures: out of memory");
+    }
+    *size = new_size;
+    return p;
+}
+
+static StgWord hashClosure(StgClosure *c, StgWord mask)
+{
+    StgWord h = (StgWord)c >> 3;
+    h ^= h >> 17;
+    h *= 0x9E3779B1;
+    return (h ^ (h >> 15)) & mask;
+}
+
+static void growSet(HeapWalk *walk)
+{
+    StgWord size = walk->set_size == 0 ? 128 : walk->set_size * 2;
+    StgWord *set = calloc(size, sizeof(StgWord));
+    if (set == NULL) {
+        barf("walkClosures: out of memory");
+    }
+    for (StgWord i = 0; i < walk->n_closures; i++) {
+        StgWord h = hashClosure(walk->closures[i], size - 1);
+        while (set[h] != 0) {
+            h = (h + 1) & (size - 1);
+        }
+        set[h] = i + 1;
+    }
+    free(walk->set);
+    walk->set = set;
+    walk->set_size = size;
+}
+
+// The index of the closure in the walk, adding it if it's new and there's
+// room for it, or -1.
+static StgWord closureIndex(HeapWalk *walk, StgClosure *c, StgWord max_closures)
+{
+    StgWord mask = walk->set_size - 1;
+    StgWord h = hashClosure(c, mask);
+    while (walk->set[h] != 0) {
+        StgWord i = walk->set[h] - 1;
+        if (walk->closures[i] == c) {
+            return i;
+        }
+        h = (h + 1) & mask;
+    }
+
+    if (walk->n_closures >= max_closures) {
+        return (StgWord)-1;
+    }
+    StgWord i = walk->n_closures++;
+    walk->closures = reallocWalk(walk->closures, &walk->closures_size,
+                                 walk->n_closures, sizeof(StgClosure *));
+    walk->closures[i] = c;
+    walk->set[h] = i + 1;
+    if (walk->n_closures * 2 > walk->set_size) {
+        growSet(walk);
+    }
+    return i;
+}
+
+static void pushLayout(HeapWalk *walk, StgWord w)
+{
+    walk->layout = reallocWalk(walk->layout, &walk->layout_size,
+                               walk->n_layout + 1, sizeof(StgWord));
+    walk->layout[walk->n_layout++] = w;
+}
+
+// Walk up to max_closures closures from root, which must be untagged. The
+// result is freed by heapWalkFree.
+HeapWalk *heapWalk(StgClosure *root, StgWord max_closures)
+{
+    HeapWalk *walk = calloc(1, sizeof(HeapWalk));
+    if (walk == NULL) {
+        barf("walkClosures: out of memory");
+    }
+    growSet(walk);
+    if (max_closures == 0) {
+        return walk;
+    }
+    closureIndex(walk, root, max_closures);
+
+    for (StgWord next = 0; next < walk->n_closures; next++) {
+        StgClosure *c = walk->closures[next];
+        const StgInfoTable *info = get_itbl(c);
+        StgWord size = closure_sizeW(c);
+        StgWord n_ptrs = 0;
+
+        switch (info->type) {
+        case TSO:
+        case STACK:
+            break;
+        default:
+            walk->ptrs = reallocWalk(walk->ptrs, &walk->ptrs_size, size,
+                                     sizeof(StgClosure *));
+            n_ptrs = collect_pointers(c, walk->ptrs);
+        }
+
+        pushLayout(walk, (StgWord)info);
+        pushLayout(walk, info->type);
+        pushLayout(walk, size);
+        pushLayout(walk, n_ptrs);
+        for (StgWord i = 0; i < n_ptrs; i++) {
+            StgClosure *p = UNTAG_CLOSURE(walk->ptrs[i]);
+            pushLayout(walk, closureIndex(walk, p, max_closures));
+        }
+    }
+
+    return walk;
+}
+
+StgMutArrPtrs *heapWalkClosures(Capability *cap, HeapWalk *walk)
+{
+    StgWord n = walk->n_closures;
+    StgWord size = n + mutArrPtrsCardTableSize(n);
+    StgMutArrPtrs *arr =
+        (StgMutArrPtrs *)allocate(cap, sizeofW(StgMutArrPtrs) + size);
+    SET_HDR(arr, &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info, CCS_SYSTEM);
+    arr->ptrs = n;
+    arr->size = size;
+    for (StgWord i = 0; i < n; i++) {
+        arr->payload[i] = walk->closures[i];
+    }
+    return arr;
+}
+
+StgArrBytes *heapWalkLayout(Capability *cap, HeapWalk *walk)
+{
+    StgWord bytes = walk->n_layout * sizeof(StgWord);
+    StgArrBytes *arr =
+        (StgArrBytes *)allocate(cap, sizeofW(StgArrBytes) + walk->n_layout);
+    SET_HDR(arr, &stg_ARR_WORDS_info, CCS_SYSTEM);
+    arr->bytes = bytes;
+    for (StgWord i = 0; i < walk->n_layout; i++) {
+        arr->payload[i] = walk->layout[i];
+    }
+    return arr;
+}
+
+void heapWalkFree(HeapWalk *walk)
+{
+    free(walk->closures);
+    free(walk->layout);
+    free(walk->set);
+    free(walk->ptrs);
+    free(walk);
+}
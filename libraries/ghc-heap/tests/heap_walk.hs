@@ -0,0 +1,43 @@
+-- The simplifier changes the shapes of closures that we expect.
+{-# OPTIONS_GHC -O0 #-}
+
+import Control.Monad
+import GHC.Exts.Heap
+import System.Mem
+
+assert :: String -> Bool -> IO ()
+assert what ok = unless ok $ error ("heap_walk: " ++ what)
+
+main :: IO ()
+main = do
+    -- a fully evaluated list of distinct boxed Ints
+    let xs = map (* 3) [1 .. 100 :: Int]
+    sum xs `seq` return ()
+    -- short out the indirections left by evaluating it
+    performMajorGC
+
+    walked <- walkClosures 1000 xs
+    let conses = [ w | w <- walked, walkedType w == CONSTR_2_0 ]
+    assert "root first" (walkedType (head walked) == CONSTR_2_0)
+    assert "every cons reached" (length conses == 100)
+    assert "every pointer reached" (all (>= 0) (concatMap walkedPointers walked))
+    assert "indices in range"
+        (all (< length walked) (concatMap walkedPointers walked))
+    forM_ walked $ \w -> do
+        c <- getBoxedClosureData (walkedBox w)
+        assert "same info table" (tipe (info c) == walkedType w)
+        assert "same pointers" (length (allClosures c) == length (walkedPointers w))
+
+    -- each closure is visited once, however often it is shared
+    let ys = True : False : ys
+    length (take 4 ys) `seq` performMajorGC
+    cyclic <- walkClosures 1000 ys
+    assert "cycle visited once" (length cyclic < 10)
+    assert "cycle closed"
+        (or [ p <= i | (i, w) <- zip [0 ..] cyclic, p <- walkedPointers w ])
+
+    -- the limit cuts the walk short
+    limited <- walkClosures 10 xs
+    assert "limit" (length limited == 10)
+    assert "pointers past the limit" (-1 `elem` concatMap walkedPointers limited)
+    putStrLn "OK"
@@ -0,0 +1,19 @@
+/*
+ * The C half of GHC.Internal.Foreign.CallBatch, which makes a batch of C
+ * calls from a single safe foreign call. See Note [Batched safe calls]
+ * there.
+ */
+
+#include "HsFFI.h"
+
+typedef HsInt (*HsBatchFun)(void *arg);
+
+void hs_call_batch(HsInt n, HsBatchFun *funs, void **args, HsInt *results);
+
+void
+hs_call_batch(HsInt n, HsBatchFun *funs, void **args, HsInt *results)
+{
+  for (HsInt i = 0; i < n; i++) {
+    results[i] = funs[i](args[i]);
+  }
+}
@@ -0,0 +1,76 @@
+#include "cpuFeatures.h"
+
+// The features found by hs_detect_cpu_features, which runs the first time
+// anyone asks (perhaps more than once, if several threads ask at the same
+// time, but they all find the same answer).
+uint32_t hs_cpu_features = 0;
+
+#if defined(HS_CPU_DISPATCH)
+
+static void
+cpuid(uint32_t leaf, uint32_t subleaf, uint32_t r[4])
+{
+    __asm__ __volatile__ (
+        "cpuid"
+        : "=a" (r[0]), "=b" (r[1]), "=c" (r[2]), "=d" (r[3])
+        : "a" (leaf), "c" (subleaf)
+    );
+}
+
+uint32_t
+hs_detect_cpu_features(void)
+{
+    uint32_t features = HS_CPU_DETECTED;
+    uint32_t r[4];
+
+    cpuid(0, 0, r);
+    uint32_t max_leaf = r[0];
+    // "AuthenticAMD" and "HygonGenuine", in ebx, edx, ecx
+    int amd = (r[1] == 0x68747541 && r[3] == 0x69746e65 && r[2] == 0x444d4163)
+           || (r[1] == 0x6f677948 && r[3] == 0x6e65476e && r[2] == 0x656e6975);
+
+    cpuid(1, 0, r);
+    uint32_t family = (r[0] >> 8) & 0xf;
+    if (family == 0xf) {
+        family += (r[0] >> 20) & 0xff;
+    }
+    if (r[2] & (1u << 23)) {
+        features |= HS_CPU_POPCNT;
+    }
+
+    // AVX2 needs the OS to save the YMM registers: OSXSAVE, then XCR0
+    // must have both the SSE and AVX state bits.
+    int ymm = 0;
+    if ((r[2] & (1u << 27)) && (r[2] & (1u << 28))) {
+        uint32_t lo, hi;
+        __asm__ __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+        ymm = (lo & 6) == 6;
+    }
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, r);
+        if ((r[1] & (1u << 5)) && ymm) {
+            features |= HS_CPU_AVX2;
+        }
+        // AMD CPUs before Zen 3 (family 19h) implement PDEP and PEXT in
+        // microcode, taking hundreds of cycles for a dense mask: often slower
+        // than our loops.
+        if ((r[1] & (1u << 8)) && !(amd && family < 0x19)) {
+            features |= HS_CPU_BMI2;
+        }
+    }
+
+    __atomic_store_n(&hs_cpu_features, features, __ATOMIC_RELAXED);
+    return features;
+}
+
+#else
+
+uint32_t
+hs_detect_cpu_features(void)
+{
+    hs_cpu_features = HS_CPU_DETECTED;
+    return hs_cpu_features;
+}
+
+#endif
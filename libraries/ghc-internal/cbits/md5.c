@@ -17,18 +17,23 @@
 
 #include "HsFFI.h"
 #include "md5.h"
+#include "cpuFeatures.h"
 #include <string.h>
 
 void __hsbase_MD5Init(struct MD5Context *context);
 void __hsbase_MD5Update(struct MD5Context *context, uint8_t const *buf, int len);
 void __hsbase_MD5Final(uint8_t digest[16], struct MD5Context *context);
 void __hsbase_MD5Transform(uint32_t buf[4], uint32_t const in[16]);
+void __hsbase_MD5Many(uint8_t *digests, uint8_t const *const *bufs,
+                      HsInt const *lens, HsInt n);
 
 
 /*
  * Shuffle the bytes into little-endian order within words, as per the
- * MD5 spec.  Note: this code works regardless of the byte order.
+ * MD5 spec.  Note: this code works regardless of the byte order, but
+ * there is nothing to do on a little-endian machine.
  */
+#if defined(WORDS_BIGENDIAN)
 static void
 byteSwap(uint32_t *buf, unsigned words)
 {
@@ -40,6 +45,9 @@ byteSwap(uint32_t *buf, unsigned words)
     p += 4;
   } while (--words);
 }
+#else
+#define byteSwap(buf, words) ((void)(buf), (void)(words))
+#endif
 
 /*
  * Start MD5 accumulation.  Set bit count to 0 and buffer to mysterious
@@ -146,6 +154,79 @@ __hsbase_MD5Final(uint8_t digest[16], struct MD5Context *ctx)
 #define MD5STEP(f,w,x,y,z,in,s) \
    (w += f(x,y,z) + in, w = (w<<s | w>>(32-s)) + x)
 
+/*
+ * The 64 steps of MD5 on a, b, c and d, which may be words or, in
+ * __hsbase_MD5Many, vectors of words.
+ */
+#define MD5ROUNDS(a, b, c, d, in) \
+  MD5STEP(F1, a, b, c, d, in[0] + 0xd76aa478, 7); \
+  MD5STEP(F1, d, a, b, c, in[1] + 0xe8c7b756, 12); \
+  MD5STEP(F1, c, d, a, b, in[2] + 0x242070db, 17); \
+  MD5STEP(F1, b, c, d, a, in[3] + 0xc1bdceee, 22); \
+  MD5STEP(F1, a, b, c, d, in[4] + 0xf57c0faf, 7); \
+  MD5STEP(F1, d, a, b, c, in[5] + 0x4787c62a, 12); \
+  MD5STEP(F1, c, d, a, b, in[6] + 0xa8304613, 17); \
+  MD5STEP(F1, b, c, d, a, in[7] + 0xfd469501, 22); \
+  MD5STEP(F1, a, b, c, d, in[8] + 0x698098d8, 7); \
+  MD5STEP(F1, d, a, b, c, in[9] + 0x8b44f7af, 12); \
+  MD5STEP(F1, c, d, a, b, in[10] + 0xffff5bb1, 17); \
+  MD5STEP(F1, b, c, d, a, in[11] + 0x895cd7be, 22); \
+  MD5STEP(F1, a, b, c, d, in[12] + 0x6b901122, 7); \
+  MD5STEP(F1, d, a, b, c, in[13] + 0xfd987193, 12); \
+  MD5STEP(F1, c, d, a, b, in[14] + 0xa679438e, 17); \
+  MD5STEP(F1, b, c, d, a, in[15] + 0x49b40821, 22); \
+  \
+  MD5STEP(F2, a, b, c, d, in[1] + 0xf61e2562, 5); \
+  MD5STEP(F2, d, a, b, c, in[6] + 0xc040b340, 9); \
+  MD5STEP(F2, c, d, a, b, in[11] + 0x265e5a51, 14); \
+  MD5STEP(F2, b, c, d, a, in[0] + 0xe9b6c7aa, 20); \
+  MD5STEP(F2, a, b, c, d, in[5] + 0xd62f105d, 5); \
+  MD5STEP(F2, d, a, b, c, in[10] + 0x02441453, 9); \
+  MD5STEP(F2, c, d, a, b, in[15] + 0xd8a1e681, 14); \
+  MD5STEP(F2, b, c, d, a, in[4] + 0xe7d3fbc8, 20); \
+  MD5STEP(F2, a, b, c, d, in[9] + 0x21e1cde6, 5); \
+  MD5STEP(F2, d, a, b, c, in[14] + 0xc33707d6, 9); \
+  MD5STEP(F2, c, d, a, b, in[3] + 0xf4d50d87, 14); \
+  MD5STEP(F2, b, c, d, a, in[8] + 0x455a14ed, 20); \
+  MD5STEP(F2, a, b, c, d, in[13] + 0xa9e3e905, 5); \
+  MD5STEP(F2, d, a, b, c, in[2] + 0xfcefa3f8, 9); \
+  MD5STEP(F2, c, d, a, b, in[7] + 0x676f02d9, 14); \
+  MD5STEP(F2, b, c, d, a, in[12] + 0x8d2a4c8a, 20); \
+  \
+  MD5STEP(F3, a, b, c, d, in[5] + 0xfffa3942, 4); \
+  MD5STEP(F3, d, a, b, c, in[8] + 0x8771f681, 11); \
+  MD5STEP(F3, c, d, a, b, in[11] + 0x6d9d6122, 16); \
+  MD5STEP(F3, b, c, d, a, in[14] + 0xfde5380c, 23); \
+  MD5STEP(F3, a, b, c, d, in[1] + 0xa4beea44, 4); \
+  MD5STEP(F3, d, a, b, c, in[4] + 0x4bdecfa9, 11); \
+  MD5STEP(F3, c, d, a, b, in[7] + 0xf6bb4b60, 16); \
+  MD5STEP(F3, b, c, d, a, in[10] + 0xbebfbc70, 23); \
+  MD5STEP(F3, a, b, c, d, in[13] + 0x289b7ec6, 4); \
+  MD5STEP(F3, d, a, b, c, in[0] + 0xeaa127fa, 11); \
+  MD5STEP(F3, c, d, a, b, in[3] + 0xd4ef3085, 16); \
+  MD5STEP(F3, b, c, d, a, in[6] + 0x04881d05, 23); \
+  MD5STEP(F3, a, b, c, d, in[9] + 0xd9d4d039, 4); \
+  MD5STEP(F3, d, a, b, c, in[12] + 0xe6db99e5, 11); \
+  MD5STEP(F3, c, d, a, b, in[15] + 0x1fa27cf8, 16); \
+  MD5STEP(F3, b, c, d, a, in[2] + 0xc4ac5665, 23); \
+  \
+  MD5STEP(F4, a, b, c, d, in[0] + 0xf4292244, 6); \
+  MD5STEP(F4, d, a, b, c, in[7] + 0x432aff97, 10); \
+  MD5STEP(F4, c, d, a, b, in[14] + 0xab9423a7, 15); \
+  MD5STEP(F4, b, c, d, a, in[5] + 0xfc93a039, 21); \
+  MD5STEP(F4, a, b, c, d, in[12] + 0x655b59c3, 6); \
+  MD5STEP(F4, d, a, b, c, in[3] + 0x8f0ccc92, 10); \
+  MD5STEP(F4, c, d, a, b, in[10] + 0xffeff47d, 15); \
+  MD5STEP(F4, b, c, d, a, in[1] + 0x85845dd1, 21); \
+  MD5STEP(F4, a, b, c, d, in[8] + 0x6fa87e4f, 6); \
+  MD5STEP(F4, d, a, b, c, in[15] + 0xfe2ce6e0, 10); \
+  MD5STEP(F4, c, d, a, b, in[6] + 0xa3014314, 15); \
+  MD5STEP(F4, b, c, d, a, in[13] + 0x4e0811a1, 21); \
+  MD5STEP(F4, a, b, c, d, in[4] + 0xf7537e82, 6); \
+  MD5STEP(F4, d, a, b, c, in[11] + 0xbd3af235, 10); \
+  MD5STEP(F4, c, d, a, b, in[2] + 0x2ad7d2bb, 15); \
+  MD5STEP(F4, b, c, d, a, in[9] + 0xeb86d391, 21);
+
 /*
  * The core of the MD5 algorithm, this alters an existing MD5 hash to
  * reflect the addition of 16 longwords of new data.  MD5Update blocks
@@ -162,73 +243,7 @@ __hsbase_MD5Transform(uint32_t buf[4], uint32_t const in[16])
   c = buf[2];
   d = buf[3];
 
-  MD5STEP(F1, a, b, c, d, in[0] + 0xd76aa478, 7);
-  MD5STEP(F1, d, a, b, c, in[1] + 0xe8c7b756, 12);
-  MD5STEP(F1, c, d, a, b, in[2] + 0x242070db, 17);
-  MD5STEP(F1, b, c, d, a, in[3] + 0xc1bdceee, 22);
-  MD5STEP(F1, a, b, c, d, in[4] + 0xf57c0faf, 7);
-  MD5STEP(F1, d, a, b, c, in[5] + 0x4787c62a, 12);
-  MD5STEP(F1, c, d, a, b, in[6] + 0xa8304613, 17);
-  MD5STEP(F1, b, c, d, a, in[7] + 0xfd469501, 22);
-  MD5STEP(F1, a, b, c, d, in[8] + 0x698098d8, 7);
-  MD5STEP(F1, d, a, b, c, in[9] + 0x8b44f7af, 12);
-  MD5STEP(F1, c, d, a, b, in[10] + 0xffff5bb1, 17);
-  MD5STEP(F1, b, c, d, a, in[11] + 0x895cd7be, 22);
-  MD5STEP(F1, a, b, c, d, in[12] + 0x6b901122, 7);
-  MD5STEP(F1, d, a, b, c, in[13] + 0xfd987193, 12);
-  MD5STEP(F1, c, d, a, b, in[14] + 0xa679438e, 17);
-  MD5STEP(F1, b, c, d, a, in[15] + 0x49b40821, 22);
-
-  MD5STEP(F2, a, b, c, d, in[1] + 0xf61e2562, 5);
-  MD5STEP(F2, d, a, b, c, in[6] + 0xc040b340, 9);
-  MD5STEP(F2, c, d, a, b, in[11] + 0x265e5a51, 14);
-  MD5STEP(F2, b, c, d, a, in[0] + 0xe9b6c7aa, 20);
-  MD5STEP(F2, a, b, c, d, in[5] + 0xd62f105d, 5);
-  MD5STEP(F2, d, a, b, c, in[10] + 0x02441453, 9);
-  MD5STEP(F2, c, d, a, b, in[15] + 0xd8a1e681, 14);
-  MD5STEP(F2, b, c, d, a, in[4] + 0xe7d3fbc8, 20);
-  MD5STEP(F2, a, b, c, d, in[9] + 0x21e1cde6, 5);
-  MD5STEP(F2, d, a, b, c, in[14] + 0xc33707d6, 9);
-  MD5STEP(F2, c, d, a, b, in[3] + 0xf4d50d87, 14);
-  MD5STEP(F2, b, c, d, a, in[8] + 0x455a14ed, 20);
-  MD5STEP(F2, a, b, c, d, in[13] + 0xa9e3e905, 5);
-  MD5STEP(F2, d, a, b, c, in[2] + 0xfcefa3f8, 9);
-  MD5STEP(F2, c, d, a, b, in[7] + 0x676f02d9, 14);
-  MD5STEP(F2, b, c, d, a, in[12] + 0x8d2a4c8a, 20);
-
-  MD5STEP(F3, a, b, c, d, in[5] + 0xfffa3942, 4);
-  MD5STEP(F3, d, a, b, c, in[8] + 0x8771f681, 11);
-  MD5STEP(F3, c, d, a, b, in[11] + 0x6d9d6122, 16);
-  MD5STEP(F3, b, c, d, a, in[14] + 0xfde5380c, 23);
-  MD5STEP(F3, a, b, c, d, in[1] + 0xa4beea44, 4);
-  MD5STEP(F3, d, a, b, c, in[4] + 0x4bdecfa9, 11);
-  MD5STEP(F3, c, d, a, b, in[7] + 0xf6bb4b60, 16);
-  MD5STEP(F3, b, c, d, a, in[10] + 0xbebfbc70, 23);
-  MD5STEP(F3, a, b, c, d, in[13] + 0x289b7ec6, 4);
-  MD5STEP(F3, d, a, b, c, in[0] + 0xeaa127fa, 11);
-  MD5STEP(F3, c, d, a, b, in[3] + 0xd4ef3085, 16);
-  MD5STEP(F3, b, c, d, a, in[6] + 0x04881d05, 23);
-  MD5STEP(F3, a, b, c, d, in[9] + 0xd9d4d039, 4);
-  MD5STEP(F3, d, a, b, c, in[12] + 0xe6db99e5, 11);
-  MD5STEP(F3, c, d, a, b, in[15] + 0x1fa27cf8, 16);
-  MD5STEP(F3, b, c, d, a, in[2] + 0xc4ac5665, 23);
-
-  MD5STEP(F4, a, b, c, d, in[0] + 0xf4292244, 6);
-  MD5STEP(F4, d, a, b, c, in[7] + 0x432aff97, 10);
-  MD5STEP(F4, c, d, a, b, in[14] + 0xab9423a7, 15);
-  MD5STEP(F4, b, c, d, a, in[5] + 0xfc93a039, 21);
-  MD5STEP(F4, a, b, c, d, in[12] + 0x655b59c3, 6);
-  MD5STEP(F4, d, a, b, c, in[3] + 0x8f0ccc92, 10);
-  MD5STEP(F4, c, d, a, b, in[10] + 0xffeff47d, 15);
-  MD5STEP(F4, b, c, d, a, in[1] + 0x85845dd1, 21);
-  MD5STEP(F4, a, b, c, d, in[8] + 0x6fa87e4f, 6);
-  MD5STEP(F4, d, a, b, c, in[15] + 0xfe2ce6e0, 10);
-  MD5STEP(F4, c, d, a, b, in[6] + 0xa3014314, 15);
-  MD5STEP(F4, b, c, d, a, in[13] + 0x4e0811a1, 21);
-  MD5STEP(F4, a, b, c, d, in[4] + 0xf7537e82, 6);
-  MD5STEP(F4, d, a, b, c, in[11] + 0xbd3af235, 10);
-  MD5STEP(F4, c, d, a, b, in[2] + 0x2ad7d2bb, 15);
-  MD5STEP(F4, b, c, d, a, in[9] + 0xeb86d391, 21);
+  MD5ROUNDS(a, b, c, d, in);
 
   buf[0] += a;
   buf[1] += b;
@@ -236,3 +251,249 @@ __hsbase_MD5Transform(uint32_t buf[4], uint32_t const in[16])
   buf[3] += d;
 }
 
+
+/*
+ * Hashing several buffers at once
+ *
+ * MD5 is one long chain of dependent additions and rotations, so a
+ * single hash can't make use of SIMD instructions. But independent
+ * hashes can: __hsbase_MD5Many hashes the n buffers bufs[i] of lens[i]
+ * bytes, writing the digest of each to digests + 16 * i, by running the
+ * 64 steps of MD5ROUNDS on vectors of MD5_LANES words, one buffer in
+ * each lane. A lane that finishes its buffer starts on the next one, so
+ * buffers of different lengths keep every lane busy until the last few.
+ *
+ * The vectors are GCC's generic vector types, which the C compiler
+ * turns into SSE2 on x86-64 and NEON on AArch64, four lanes each. Where
+ * the CPU has AVX2, which we find out at runtime, we use eight.
+ * Elsewhere, and for a single buffer, we hash the buffers one at a time.
+ */
+
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON) || defined(__aarch64__))
+#define MD5_SIMD 1
+#if defined(HS_CPU_DISPATCH) && defined(__x86_64__) && (defined(__clang__) || __GNUC__ >= 6)
+#define MD5_AVX2 1
+#endif
+#endif
+
+#if defined(MD5_SIMD)
+
+#define MD5_MAX_LANES 8
+
+struct MD5Lane {
+  uint8_t const *p;         /* the rest of the buffer */
+  size_t left;              /* bytes of it */
+  uint64_t bits;            /* the length of the buffer in bits */
+  int length_block;         /* the length goes in a block of its own */
+  HsInt job;                /* the buffer we're hashing, or -1 */
+};
+
+/*
+ * Fill block with the next 16 words of the lane's buffer, padded as in
+ * MD5Final, and return whether it is the last block.
+ */
+static int
+md5NextBlock(struct MD5Lane *lane, uint32_t block[16])
+{
+  uint8_t *p = (uint8_t *)block;
+  size_t n;
+
+  if (lane->length_block) {
+    memset(p, 0, 56);
+    lane->length_block = 0;
+  } else if (lane->left >= 64) {
+    memcpy(p, lane->p, 64);
+    lane->p += 64;
+    lane->left -= 64;
+    byteSwap(block, 16);
+    return 0;
+  } else {
+    n = lane->left;
+    memcpy(p, lane->p, n);
+    p[n] = 0x80;
+    memset(p + n + 1, 0, 63 - n);
+    lane->left = 0;
+    if (n >= 56) {
+      /* Padding forces an extra block */
+      byteSwap(block, 16);
+      lane->length_block = 1;
+      return 0;
+    }
+  }
+  byteSwap(block, 14);
+  block[14] = (uint32_t)lane->bits;
+  block[15] = (uint32_t)(lane->bits >> 32);
+  return 1;
+}
+
+static void
+md5StartLane(struct MD5Lane *lane, uint32_t state[4][MD5_MAX_LANES], int l,
+             HsInt job, uint8_t const *buf, HsInt len)
+{
+  lane->p = buf;
+  lane->left = (size_t)len;
+  lane->bits = (uint64_t)len << 3;
+  lane->length_block = 0;
+  lane->job = job;
+  state[0][l] = 0x67452301;
+  state[1][l] = 0xefcdab89;
+  state[2][l] = 0x98badcfe;
+  state[3][l] = 0x10325476;
+}
+
+typedef uint32_t MD5Vec4 __attribute__((vector_size(16)));
+
+static void
+md5Transform4(uint32_t state[4][MD5_MAX_LANES], uint32_t in[16][MD5_MAX_LANES])
+{
+  MD5Vec4 a, b, c, d, a0, b0, c0, d0, x[16];
+  int i;
+
+  memcpy(&a, state[0], sizeof(a));
+  memcpy(&b, state[1], sizeof(b));
+  memcpy(&c, state[2], sizeof(c));
+  memcpy(&d, state[3], sizeof(d));
+  for (i = 0; i < 16; i++) {
+    memcpy(&x[i], in[i], sizeof(x[i]));
+  }
+  a0 = a; b0 = b; c0 = c; d0 = d;
+
+  MD5ROUNDS(a, b, c, d, x);
+
+  a += a0; b += b0; c += c0; d += d0;
+  memcpy(state[0], &a, sizeof(a));
+  memcpy(state[1], &b, sizeof(b));
+  memcpy(state[2], &c, sizeof(c));
+  memcpy(state[3], &d, sizeof(d));
+}
+
+#if defined(MD5_AVX2)
+typedef uint32_t MD5Vec8 __attribute__((vector_size(32)));
+
+__attribute__((target("avx2")))
+static void
+md5Transform8(uint32_t state[4][MD5_MAX_LANES], uint32_t in[16][MD5_MAX_LANES])
+{
+  MD5Vec8 a, b, c, d, a0, b0, c0, d0, x[16];
+  int i;
+
+  memcpy(&a, state[0], sizeof(a));
+  memcpy(&b, state[1], sizeof(b));
+  memcpy(&c, state[2], sizeof(c));
+  memcpy(&d, state[3], sizeof(d));
+  for (i = 0; i < 16; i++) {
+    memcpy(&x[i], in[i], sizeof(x[i]));
+  }
+  a0 = a; b0 = b; c0 = c; d0 = d;
+
+  MD5ROUNDS(a, b, c, d, x);
+
+  a += a0; b += b0; c += c0; d += d0;
+  memcpy(state[0], &a, sizeof(a));
+  memcpy(state[1], &b, sizeof(b));
+  memcpy(state[2], &c, sizeof(c));
+  memcpy(state[3], &d, sizeof(d));
+}
+#endif
+
+static void
+md5ManyLanes(uint8_t *digests, uint8_t const *const *bufs, HsInt const *lens,
+             HsInt n, int lanes,
+             void (*transform)(uint32_t [4][MD5_MAX_LANES],
+                               uint32_t [16][MD5_MAX_LANES]))
+{
+  struct MD5Lane lane[MD5_MAX_LANES];
+  uint32_t state[4][MD5_MAX_LANES];
+  uint32_t in[16][MD5_MAX_LANES];
+  uint32_t block[16];
+  int last[MD5_MAX_LANES];
+  HsInt next = 0;
+  int busy = 0;
+  int l, i;
+
+  memset(state, 0, sizeof(state));
+  memset(in, 0, sizeof(in));
+  for (l = 0; l < lanes; l++) {
+    if (next < n) {
+      md5StartLane(&lane[l], state, l, next, bufs[next], lens[next]);
+      next++;
+      busy++;
+    } else {
+      lane[l].job = -1;
+    }
+  }
+
+  while (busy > 0) {
+    for (l = 0; l < lanes; l++) {
+      if (lane[l].job < 0) {
+        continue;
+      }
+      last[l] = md5NextBlock(&lane[l], block);
+      for (i = 0; i < 16; i++) {
+        in[i][l] = block[i];
+      }
+    }
+
+    transform(state, in);
+
+    for (l = 0; l < lanes; l++) {
+      if (lane[l].job < 0 || !last[l]) {
+        continue;
+      }
+      for (i = 0; i < 4; i++) {
+        block[i] = state[i][l];
+      }
+      byteSwap(block, 4);
+      memcpy(digests + 16 * lane[l].job, block, 16);
+      if (next < n) {
+        md5StartLane(&lane[l], state, l, next, bufs[next], lens[next]);
+        next++;
+      } else {
+        lane[l].job = -1;
+        busy--;
+      }
+    }
+  }
+}
+
+#endif /* MD5_SIMD */
+
+static void
+md5One(uint8_t digest[16], uint8_t const *buf, HsInt len)
+{
+  struct MD5Context ctx;
+  int chunk;
+
+  __hsbase_MD5Init(&ctx);
+  while (len > 0) {
+    chunk = len > (1 << 30) ? (1 << 30) : (int)len;
+    __hsbase_MD5Update(&ctx, buf, chunk);
+    buf += chunk;
+    len -= chunk;
+  }
+  __hsbase_MD5Final(digest, &ctx);
+}
+
+void
+__hsbase_MD5Many(uint8_t *digests, uint8_t const *const *bufs,
+                 HsInt const *lens, HsInt n)
+{
+  HsInt i;
+
+#if defined(MD5_SIMD)
+  if (n > 1) {
+#if defined(MD5_AVX2)
+    if (n > 4 && hs_has_cpu_feature(HS_CPU_AVX2)) {
+      md5ManyLanes(digests, bufs, lens, n, 8, md5Transform8);
+      return;
+    }
+#endif
+    md5ManyLanes(digests, bufs, lens, n, 4, md5Transform4);
+    return;
+  }
+#endif
+
+  for (i = 0; i < n; i++) {
+    md5One(digests + 16 * i, bufs[i], lens[i]);
+  }
+}
@@ -1,9 +1,26 @@
 #include "Rts.h"
 #include "MachDeps.h"
+#include "cpuFeatures.h"
+
+#if defined(HS_CPU_DISPATCH) && defined(x86_64_HOST_ARCH)
+#include <immintrin.h>
+
+__attribute__((target("bmi2"))) static StgWord64
+pdep64_insn(StgWord64 src, StgWord64 mask)
+{
+  return _pdep_u64(src, mask);
+}
+#endif
 
 StgWord64
 hs_pdep64(StgWord64 src, StgWord64 mask)
 {
+#if defined(HS_CPU_DISPATCH) && defined(x86_64_HOST_ARCH)
+  if (hs_has_cpu_feature(HS_CPU_BMI2)) {
+    return pdep64_insn(src, mask);
+  }
+#endif
+
   uint64_t result = 0;
 
   while (1) {
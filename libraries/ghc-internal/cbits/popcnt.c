@@ -1,5 +1,6 @@
 #include "Rts.h"
 #include "MachDeps.h"
+#include "cpuFeatures.h"
 
 static const unsigned char popcount_tab[] =
 {
@@ -13,6 +14,22 @@ static const unsigned char popcount_tab[] =
     3,4,4,5,4,5,5,6,4,5,5,6,5,6,6,7,4,5,5,6,5,6,6,7,5,6,6,7,6,7,7,8,
 };
 
+#if defined(HS_CPU_DISPATCH)
+// With POPCNT these are one instruction; without it GCC would call
+// __popcountdi2 from libgcc, which is no better than our table.
+__attribute__((target("popcnt"))) static StgWord
+popcnt32_insn(StgWord32 x)
+{
+  return __builtin_popcount(x);
+}
+
+__attribute__((target("popcnt"))) static StgWord
+popcnt64_insn(StgWord64 x)
+{
+  return __builtin_popcountll(x);
+}
+#endif
+
 extern StgWord hs_popcnt8(StgWord x);
 StgWord
 hs_popcnt8(StgWord x)
@@ -32,6 +49,11 @@ extern StgWord hs_popcnt32(StgWord x);
 StgWord
 hs_popcnt32(StgWord x)
 {
+#if defined(HS_CPU_DISPATCH)
+  if (hs_has_cpu_feature(HS_CPU_POPCNT)) {
+    return popcnt32_insn(x);
+  }
+#endif
   return popcount_tab[(unsigned char)x] +
       popcount_tab[(unsigned char)(x >> 8)] +
       popcount_tab[(unsigned char)(x >> 16)] +
@@ -42,6 +64,11 @@ extern StgWord hs_popcnt64(StgWord64 x);
 StgWord
 hs_popcnt64(StgWord64 x)
 {
+#if defined(HS_CPU_DISPATCH)
+  if (hs_has_cpu_feature(HS_CPU_POPCNT)) {
+    return popcnt64_insn(x);
+  }
+#endif
   return popcount_tab[(unsigned char)x] +
       popcount_tab[(unsigned char)(x >> 8)] +
       popcount_tab[(unsigned char)(x >> 16)] +
@@ -58,6 +85,11 @@ extern StgWord hs_popcnt(StgWord x);
 StgWord
 hs_popcnt(StgWord x)
 {
+#if defined(HS_CPU_DISPATCH)
+  if (hs_has_cpu_feature(HS_CPU_POPCNT)) {
+    return popcnt32_insn(x);
+  }
+#endif
   return popcount_tab[(unsigned char)x] +
       popcount_tab[(unsigned char)(x >> 8)] +
       popcount_tab[(unsigned char)(x >> 16)] +
@@ -70,6 +102,11 @@ extern StgWord hs_popcnt(StgWord x);
 StgWord
 hs_popcnt(StgWord x)
 {
+#if defined(HS_CPU_DISPATCH)
+  if (hs_has_cpu_feature(HS_CPU_POPCNT)) {
+    return popcnt64_insn(x);
+  }
+#endif
   return popcount_tab[(unsigned char)x] +
       popcount_tab[(unsigned char)(x >> 8)] +
       popcount_tab[(unsigned char)(x >> 16)] +
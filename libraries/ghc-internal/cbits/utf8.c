@@ -0,0 +1,281 @@
+/*
+ * The bulk of the UTF-8 codec of the IO library: the utf8 TextEncoding
+ * in GHC.Internal.IO.Encoding.UTF8 hands each buffer to these first,
+ * then carries on from where they stopped with its own loop. See Note
+ * [UTF-8 codec in C] there.
+ *
+ * Both functions do as much as they can of the start of the input, and
+ * stop at anything they would need to report: a sequence that is invalid
+ * or cut off by the end of the input, a surrogate to encode, or an output
+ * buffer without room for the next character. Characters are 32 bits, as
+ * in the IO library's CharBuffers.
+ *
+ * Runs of ASCII, which is most of the text in most files whatever the
+ * language, go 16 characters at a time with SSE2 or NEON (8 elsewhere).
+ * Anything else goes a character at a time.
+ */
+
+#include "HsFFI.h"
+#include <stdint.h>
+#include <string.h>
+
+HsInt hs_utf8_decode(const uint8_t *in, HsInt inlen,
+                     uint32_t *out, HsInt outlen, HsInt *produced);
+HsInt hs_utf8_encode(const uint32_t *in, HsInt inlen,
+                     uint8_t *out, HsInt outlen, HsInt *produced);
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define ASCII_BLOCK 16
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define ASCII_BLOCK 16
+#else
+#define ASCII_BLOCK 8
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * Copy the run of ASCII at the start of in (at most n characters) to out,
+ * a block at a time while we can, and return its length. A block may be
+ * written in full even if the run ends inside it.
+ */
+
+static HsInt
+asciiDecode(const uint8_t *in, HsInt n, uint32_t *out)
+{
+  HsInt i = 0;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + ASCII_BLOCK <= n; i += ASCII_BLOCK) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128((__m128i *)(out + i),      _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)(out + i + 4),  _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *)(out + i + 8),  _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i *)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+    int mask = _mm_movemask_epi8(v);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__aarch64__)
+  for (; i + ASCII_BLOCK <= n; i += ASCII_BLOCK) {
+    uint8x16_t v = vld1q_u8(in + i);
+    if (vmaxvq_u8(v) >= 0x80) {
+      break;
+    }
+    uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+    uint16x8_t hi = vmovl_high_u8(v);
+    vst1q_u32(out + i,      vmovl_u16(vget_low_u16(lo)));
+    vst1q_u32(out + i + 4,  vmovl_high_u16(lo));
+    vst1q_u32(out + i + 8,  vmovl_u16(vget_low_u16(hi)));
+    vst1q_u32(out + i + 12, vmovl_high_u16(hi));
+  }
+#else
+  for (; i + ASCII_BLOCK <= n; i += ASCII_BLOCK) {
+    uint64_t w;
+    memcpy(&w, in + i, 8);
+    if (w & UINT64_C(0x8080808080808080)) {
+      break;
+    }
+    for (int j = 0; j < 8; j++) {
+      out[i + j] = in[i + j];
+    }
+  }
+#endif
+  for (; i < n && in[i] < 0x80; i++) {
+    out[i] = in[i];
+  }
+  return i;
+}
+
+static HsInt
+asciiEncode(const uint32_t *in, HsInt n, uint8_t *out)
+{
+  HsInt i = 0;
+#if defined(__SSE2__)
+  for (; i + ASCII_BLOCK <= n; i += ASCII_BLOCK) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 4));
+    __m128i c = _mm_loadu_si128((const __m128i *)(in + i + 8));
+    __m128i d = _mm_loadu_si128((const __m128i *)(in + i + 12));
+    __m128i ab = _mm_packs_epi32(a, b);
+    __m128i cd = _mm_packs_epi32(c, d);
+    __m128i v = _mm_packus_epi16(ab, cd);
+    _mm_storeu_si128((__m128i *)(out + i), v);
+    // characters are at most 0x10ffff, so they saturate to 0x80 or more
+    int mask = _mm_movemask_epi8(v);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__aarch64__)
+  for (; i + ASCII_BLOCK <= n; i += ASCII_BLOCK) {
+    uint32x4_t a = vld1q_u32(in + i);
+    uint32x4_t b = vld1q_u32(in + i + 4);
+    uint32x4_t c = vld1q_u32(in + i + 8);
+    uint32x4_t d = vld1q_u32(in + i + 12);
+    if (vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) >= 0x80) {
+      break;
+    }
+    uint16x8_t ab = vcombine_u16(vmovn_u32(a), vmovn_u32(b));
+    uint16x8_t cd = vcombine_u16(vmovn_u32(c), vmovn_u32(d));
+    vst1q_u8(out + i, vcombine_u8(vmovn_u16(ab), vmovn_u16(cd)));
+  }
+#else
+  for (; i + ASCII_BLOCK <= n; i += ASCII_BLOCK) {
+    uint32_t all = 0;
+    for (int j = 0; j < 8; j++) {
+      all |= in[i + j];
+    }
+    if (all >= 0x80) {
+      break;
+    }
+    for (int j = 0; j < 8; j++) {
+      out[i + j] = (uint8_t)in[i + j];
+    }
+  }
+#endif
+  for (; i < n && in[i] < 0x80; i++) {
+    out[i] = (uint8_t)in[i];
+  }
+  return i;
+}
+
+/*
+ * Decode UTF-8 from in to out, returning the number of bytes consumed and
+ * setting *produced to the number of characters written.
+ */
+
+HsInt
+hs_utf8_decode(const uint8_t *in, HsInt inlen,
+               uint32_t *out, HsInt outlen, HsInt *produced)
+{
+  HsInt i = 0, o = 0;
+
+  while (i < inlen && o < outlen) {
+    uint32_t c0 = in[i];
+
+    if (c0 < 0x80) {
+      out[o++] = c0;
+      i++;
+      // Go on a block at a time if the run looks long enough to fill one;
+      // in many languages runs of ASCII are mostly single spaces.
+      HsInt n = MIN(inlen - i, outlen - o);
+      if (n >= ASCII_BLOCK && in[i] < 0x80 && in[i + ASCII_BLOCK - 1] < 0x80) {
+        HsInt k = asciiDecode(in + i, n, out + o);
+        i += k;
+        o += k;
+      }
+    } else if (c0 >= 0xc2 && c0 <= 0xdf) {
+      if (inlen - i < 2) {
+        break;
+      }
+      uint32_t c1 = in[i + 1];
+      if ((c1 & 0xc0) != 0x80) {
+        break;
+      }
+      out[o++] = (c0 & 0x1f) << 6 | (c1 & 0x3f);
+      i += 2;
+    } else if (c0 >= 0xe0 && c0 <= 0xef) {
+      if (inlen - i < 3) {
+        break;
+      }
+      uint32_t c1 = in[i + 1], c2 = in[i + 2];
+      if ((c1 & 0xc0) != 0x80 || (c2 & 0xc0) != 0x80) {
+        break;
+      }
+      uint32_t c = (c0 & 0x0f) << 12 | (c1 & 0x3f) << 6 | (c2 & 0x3f);
+      // overlong, or a surrogate
+      if (c < 0x800 || (c >= 0xd800 && c <= 0xdfff)) {
+        break;
+      }
+      out[o++] = c;
+      i += 3;
+    } else if (c0 >= 0xf0 && c0 <= 0xf4) {
+      if (inlen - i < 4) {
+        break;
+      }
+      uint32_t c1 = in[i + 1], c2 = in[i + 2], c3 = in[i + 3];
+      if ((c1 & 0xc0) != 0x80 || (c2 & 0xc0) != 0x80 || (c3 & 0xc0) != 0x80) {
+        break;
+      }
+      uint32_t c = (c0 & 0x07) << 18 | (c1 & 0x3f) << 12
+                 | (c2 & 0x3f) << 6 | (c3 & 0x3f);
+      // overlong, or beyond Unicode
+      if (c < 0x10000 || c > 0x10ffff) {
+        break;
+      }
+      out[o++] = c;
+      i += 4;
+    } else {
+      break;
+    }
+  }
+
+  *produced = o;
+  return i;
+}
+
+/*
+ * Encode the characters in as UTF-8 in out, returning the number of
+ * characters consumed and setting *produced to the number of bytes
+ * written.
+ */
+
+HsInt
+hs_utf8_encode(const uint32_t *in, HsInt inlen,
+               uint8_t *out, HsInt outlen, HsInt *produced)
+{
+  HsInt i = 0, o = 0;
+
+  while (i < inlen && o < outlen) {
+    uint32_t c = in[i];
+
+    if (c < 0x80) {
+      out[o++] = (uint8_t)c;
+      i++;
+      // Go on a block at a time if the run looks long enough to fill one;
+      // in many languages runs of ASCII are mostly single spaces.
+      HsInt n = MIN(inlen - i, outlen - o);
+      if (n >= ASCII_BLOCK && in[i] < 0x80 && in[i + ASCII_BLOCK - 1] < 0x80) {
+        HsInt k = asciiEncode(in + i, n, out + o);
+        i += k;
+        o += k;
+      }
+    } else if (c < 0x800) {
+      if (outlen - o < 2) {
+        break;
+      }
+      out[o]     = (uint8_t)(0xc0 | c >> 6);
+      out[o + 1] = (uint8_t)(0x80 | (c & 0x3f));
+      o += 2;
+      i++;
+    } else if (c < 0x10000) {
+      if ((c >= 0xd800 && c <= 0xdfff) || outlen - o < 3) {
+        break;
+      }
+      out[o]     = (uint8_t)(0xe0 | c >> 12);
+      out[o + 1] = (uint8_t)(0x80 | (c >> 6 & 0x3f));
+      out[o + 2] = (uint8_t)(0x80 | (c & 0x3f));
+      o += 3;
+      i++;
+    } else {
+      if (outlen - o < 4) {
+        break;
+      }
+      out[o]     = (uint8_t)(0xf0 | c >> 18);
+      out[o + 1] = (uint8_t)(0x80 | (c >> 12 & 0x3f));
+      out[o + 2] = (uint8_t)(0x80 | (c >> 6 & 0x3f));
+      out[o + 3] = (uint8_t)(0x80 | (c & 0x3f));
+      o += 4;
+      i++;
+    }
+  }
+
+  *produced = o;
+  return i;
+}
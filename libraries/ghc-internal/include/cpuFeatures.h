@@ -0,0 +1,42 @@
+/* Optional instructions of the CPU we are running on */
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * The C fallbacks of primops like popCnt# and pdep#, and a few other
+ * cbits, are compiled for the baseline of the target (plain x86-64, say)
+ * since that is what distributed binaries must run on. Where the CPU has
+ * a better instruction they check for it here and call a version of
+ * themselves compiled for it with __attribute__((target(...))).
+ *
+ * We use CPUID ourselves rather than __builtin_cpu_supports, which needs
+ * __cpu_model from libgcc and so can't be resolved by the RTS linker.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HS_CPU_DISPATCH 1
+#endif
+
+#define HS_CPU_POPCNT   (1u << 0)
+#define HS_CPU_BMI2     (1u << 1)  /* and PDEP/PEXT aren't microcoded */
+#define HS_CPU_AVX2     (1u << 2)  /* and the OS saves the YMM registers */
+#define HS_CPU_DETECTED (1u << 31)
+
+extern uint32_t hs_cpu_features;
+uint32_t hs_detect_cpu_features(void);
+
+static inline int
+hs_has_cpu_feature(uint32_t feature)
+{
+#if defined(HS_CPU_DISPATCH)
+    uint32_t features = __atomic_load_n(&hs_cpu_features, __ATOMIC_RELAXED);
+    if (!(features & HS_CPU_DETECTED)) {
+        features = hs_detect_cpu_features();
+    }
+    return (features & feature) != 0;
+#else
+    (void)feature;
+    return 0;
+#endif
+}
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <stdint.h>
+#include "HsFFI.h"
 
 struct MD5Context {
     uint32_t buf[4];
@@ -13,3 +14,5 @@ void __hsbase_MD5Init(struct MD5Context *context);
 void __hsbase_MD5Update(struct MD5Context *context, uint8_t const *buf, int len);
 void __hsbase_MD5Final(uint8_t digest[16], struct MD5Context *context);
 void __hsbase_MD5Transform(uint32_t buf[4], uint32_t const in[16]);
+void __hsbase_MD5Many(uint8_t *digests, uint8_t const *const *bufs,
+                      HsInt const *lens, HsInt n);
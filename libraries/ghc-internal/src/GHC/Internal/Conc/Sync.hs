@@ -59,6 +59,8 @@ module GHC.Internal.Conc.Sync
         , getNumCapabilities
         , setNumCapabilities
         , getNumProcessors
+        , setCapabilityAffinity
+        , setCapabilityIsolated
 
         -- * Sparks
         , numSparks
@@ -76,6 +78,13 @@ module GHC.Internal.Conc.Sync
         , enableAllocationLimit
         , disableAllocationLimit
 
+        -- * Thread priorities
+        , setThreadPriority
+        , threadPriority
+
+        -- * Time slices
+        , setThreadTimeSlice
+
         -- * TVars
         , STM(..)
         , atomically
@@ -89,6 +98,7 @@ module GHC.Internal.Conc.Sync
         , readTVar
         , readTVarIO
         , writeTVar
+        , setTVarWakeLimit
         , unsafeIOToSTM
 
         -- * Miscellaneous
@@ -107,6 +117,7 @@ import GHC.Internal.Foreign.C.Types
 import GHC.Internal.Foreign.C.String
 import GHC.Internal.Foreign.Storable
 import GHC.Internal.Foreign.StablePtr
+import GHC.Internal.Foreign.Marshal.Array ( withArrayLen )
 
 import GHC.Internal.Base
 import {-# SOURCE #-} GHC.Internal.IO.Handle ( hFlush )
@@ -253,6 +264,35 @@ foreign import ccall unsafe "rts_enableThreadAllocationLimit"
 foreign import ccall unsafe "rts_disableThreadAllocationLimit"
   rts_disableThreadAllocationLimit :: ThreadId# -> IO ()
 
+-- | Set the scheduling priority of the current thread, from 0 (the
+-- default) to 3; values out of range are clamped. A capability runs its
+-- runnable threads of the highest priority first, so threads of lower
+-- priority only run while none of higher priority is runnable there. New
+-- threads start at priority 0.
+setThreadPriority :: Int -> IO ()
+setThreadPriority (I# p) = IO $ \s ->
+  case setThreadPriority# p s of s' -> (# s', () #)
+
+-- | The scheduling priority of a thread, see 'setThreadPriority'.
+threadPriority :: ThreadId -> IO Int
+threadPriority (ThreadId t) = fromIntegral <$> rts_getThreadPriority t
+
+foreign import ccall unsafe "rts_getThreadPriority"
+  rts_getThreadPriority :: ThreadId# -> IO Word
+
+-- | Set the time slice of the current thread, that is how long it may run
+-- before the scheduler switches to another runnable thread, in context
+-- switch intervals (@+RTS -C@). @0@ restores the default of one interval.
+-- A negative slice lets the thread run until it blocks or yields. The new
+-- slice applies from the next time the thread is scheduled.
+setThreadTimeSlice :: Int -> IO ()
+setThreadTimeSlice n = do
+  ThreadId t <- myThreadId
+  rts_setThreadTimeSlice t n
+
+foreign import ccall unsafe "rts_setThreadTimeSlice"
+  rts_setThreadTimeSlice :: ThreadId# -> Int -> IO ()
+
 {- |
 Creates a new thread to run the 'IO' computation passed as the
 first argument, and returns the 'ThreadId' of the newly created
@@ -395,6 +435,36 @@ getNumProcessors = fmap fromIntegral c_getNumberOfProcessors
 foreign import ccall unsafe "getNumberOfProcessors"
   c_getNumberOfProcessors :: IO Word32
 
+-- | Pin the OS threads that run Haskell code on the given capability to the
+-- given CPUs (numbered from 0), for example to dedicate cores to the threads
+-- placed there with 'forkOn'. An empty list returns them to the default
+-- placement. The threads move the next time they enter the scheduler. This
+-- has no effect in the non-threaded runtime, and on platforms without a way
+-- to set the CPU affinity of a thread.
+setCapabilityAffinity :: Int -> [Int] -> IO ()
+setCapabilityAffinity cap cpus = do
+  n <- getNumCapabilities
+  when (cap < 0 || cap >= n) $
+    failIO $ "setCapabilityAffinity: no capability " ++ show cap
+  withArrayLen (map fromIntegral cpus) $ \len p ->
+    c_setCapabilityAffinity (fromIntegral cap) p (fromIntegral len)
+
+foreign import ccall unsafe "rts_setCapabilityAffinity"
+  c_setCapabilityAffinity :: Word32 -> Ptr Word32 -> Word32 -> IO ()
+
+-- | Stop (with 'True') or let other capabilities give the given capability
+-- threads or sparks, so that it only runs the threads placed there with
+-- 'forkOn' and the bound threads that return to it.
+setCapabilityIsolated :: Int -> Bool -> IO ()
+setCapabilityIsolated cap isolated = do
+  n <- getNumCapabilities
+  when (cap < 0 || cap >= n) $
+    failIO $ "setCapabilityIsolated: no capability " ++ show cap
+  c_setCapabilityIsolated (fromIntegral cap) isolated
+
+foreign import ccall unsafe "rts_setCapabilityIsolated"
+  c_setCapabilityIsolated :: Word32 -> Bool -> IO ()
+
 -- | Returns the number of sparks currently in the local spark pool
 numSparks :: IO Int
 numSparks = IO $ \s -> case numSparks# s of (# s', n #) -> (# s', I# n #)
@@ -879,6 +949,19 @@ writeTVar (TVar tvar#) val = STM $ \s1# ->
     case writeTVar# tvar# val s1# of
          s2# -> (# s2#, () #)
 
+-- | Limit how many of the transactions blocked on a 'TVar' (by 'retry') are
+-- woken when a transaction that writes it commits; the limit 0, which new
+-- 'TVar's have, means all of them. Those that have waited longest are woken
+-- first.
+--
+-- This avoids waking a whole pool of workers for every job put on a work
+-- queue, but it is only safe if every woken transaction that can proceed
+-- writes the 'TVar' too, waking the next waiter in turn.
+setTVarWakeLimit :: TVar a -> Int -> IO ()
+setTVarWakeLimit (TVar tvar#) (I# n) = IO $ \s1# ->
+    case setTVarWakeLimit# tvar# n s1# of
+         s2# -> (# s2#, () #)
+
 -----------------------------------------------------------------------------
 -- MVar utilities
 -----------------------------------------------------------------------------
@@ -71,7 +71,8 @@ c. the decoder used by `unpackCStringUtf8#` in `ghc-internal:GHC.Internal.CStrin
 d. the codec used by the IO subsystem in `base:GHC.IO.Encoding.UTF8`; this is
    specialised at `Addr#` but, unlike the above, supports recovery in the presence
    of partial codepoints (since in IO contexts codepoints may be broken across
-   buffers)
+   buffers). Most of its work is done in C; see Note [UTF-8 codec in C] in
+   GHC.Internal.IO.Encoding.UTF8.
 
 e. the implementation provided by the `text` library
 
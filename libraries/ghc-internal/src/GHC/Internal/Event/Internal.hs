@@ -12,6 +12,7 @@ module GHC.Internal.Event.Internal
     , poll
     , modifyFd
     , modifyFdOnce
+    , modifyFdEdge
     , module GHC.Internal.Event.Internal.Types
     -- * Helpers
     , throwErrnoIfMinus1NoRetry
@@ -70,39 +71,64 @@ data Backend = forall a. Backend {
                          -> Event -- new events to watch
                          -> IO Bool
 
+    -- | Register interest in both reading and writing on a given file
+    -- descriptor, edge-triggered: the backend reports each transition to
+    -- readiness once, and keeps the registration until the file
+    -- descriptor is deleted with '_beModifyFd'.
+    --
+    -- Returns 'True' if the modification succeeded.
+    -- Returns 'False' if this backend does not support edge-triggered
+    -- notifications, or does not support event notifications on this
+    -- type of file.
+    --
+    -- If this function throws, the IO manager assumes that the registration
+    -- of the file descriptor failed, so the backend must not throw if the
+    -- registration was successful.
+    , _beModifyFdEdge :: a
+                      -> Fd    -- file descriptor
+                      -> IO Bool
+
     , _beDelete :: a -> IO ()
     }
 
 backend :: (a -> Maybe Timeout -> (Fd -> Event -> IO ()) -> IO Int)
         -> (a -> Fd -> Event -> Event -> IO Bool)
         -> (a -> Fd -> Event -> IO Bool)
+        -> (a -> Fd -> IO Bool)
         -> (a -> IO ())
         -> a
         -> Backend
-backend bPoll bModifyFd bModifyFdOnce bDelete state =
-  Backend state bPoll bModifyFd bModifyFdOnce bDelete
+backend bPoll bModifyFd bModifyFdOnce bModifyFdEdge bDelete state =
+  Backend state bPoll bModifyFd bModifyFdOnce bModifyFdEdge bDelete
 {-# INLINE backend #-}
 
 poll :: Backend -> Maybe Timeout -> (Fd -> Event -> IO ()) -> IO Int
-poll (Backend bState bPoll _ _ _) = bPoll bState
+poll (Backend bState bPoll _ _ _ _) = bPoll bState
 {-# INLINE poll #-}
 
 -- | Returns 'True' if the modification succeeded.
 -- Returns 'False' if this backend does not support
 -- event notifications on this type of file.
 modifyFd :: Backend -> Fd -> Event -> Event -> IO Bool
-modifyFd (Backend bState _ bModifyFd _ _) = bModifyFd bState
+modifyFd (Backend bState _ bModifyFd _ _ _) = bModifyFd bState
 {-# INLINE modifyFd #-}
 
 -- | Returns 'True' if the modification succeeded.
 -- Returns 'False' if this backend does not support
 -- event notifications on this type of file.
 modifyFdOnce :: Backend -> Fd -> Event -> IO Bool
-modifyFdOnce (Backend bState _ _ bModifyFdOnce _) = bModifyFdOnce bState
+modifyFdOnce (Backend bState _ _ bModifyFdOnce _ _) = bModifyFdOnce bState
 {-# INLINE modifyFdOnce #-}
 
+-- | Returns 'True' if the modification succeeded.
+-- Returns 'False' if this backend does not support edge-triggered
+-- event notifications, or not on this type of file.
+modifyFdEdge :: Backend -> Fd -> IO Bool
+modifyFdEdge (Backend bState _ _ _ bModifyFdEdge _) = bModifyFdEdge bState
+{-# INLINE modifyFdEdge #-}
+
 delete :: Backend -> IO ()
-delete (Backend bState _ _ _ bDelete) = bDelete bState
+delete (Backend bState _ _ _ _ bDelete) = bDelete bState
 {-# INLINE delete #-}
 
 -- | Throw an 'Prelude.IOError' corresponding to the current value of
@@ -15,6 +15,10 @@
 --
 -- If an fd has only one-shot registrations then we use one-shot
 -- polling if available. Otherwise we use multi-shot polling.
+--
+-- With @+RTS --io-manager-edge-triggered@, fds are instead registered
+-- with the backend once, edge-triggered, and stay registered until they
+-- are closed. See Note [Edge-triggered registrations].
 
 module GHC.Internal.Event.Manager
     ( -- * Types
@@ -66,12 +70,12 @@ import GHC.Internal.Data.Foldable (forM_)
 import GHC.Internal.Data.Functor (void)
 import GHC.Internal.Data.IORef (IORef, atomicModifyIORef', mkWeakIORef, newIORef, readIORef,
                    writeIORef)
-import GHC.Internal.Data.Maybe (maybe)
+import GHC.Internal.Data.Maybe (fromMaybe, isJust, maybe)
 import GHC.Internal.Data.OldList (partition)
 import GHC.Internal.Arr (Array, (!), listArray)
 import GHC.Internal.Base
 import GHC.Internal.Conc.Sync (yield)
-import GHC.Internal.List (filter, replicate)
+import GHC.Internal.List (filter, null, replicate)
 import GHC.Internal.Num (Num(..))
 import GHC.Internal.Real (fromIntegral)
 import GHC.Internal.Show (Show(..))
@@ -85,6 +89,15 @@ import GHC.Internal.System.Posix.Types (Fd)
 import qualified GHC.Internal.Event.IntTable as IT
 import qualified GHC.Internal.Event.Internal as I
 
+#if (defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)) && \
+    !(defined(darwin_HOST_OS) || defined(ios_HOST_OS))
+import GHC.Internal.Foreign.C.Types (CBool(..))
+import GHC.Internal.Foreign.Marshal.Utils (toBool)
+import GHC.Internal.Foreign.Storable (peek)
+import GHC.Internal.IO (unsafeDupablePerformIO)
+import GHC.Internal.Ptr (Ptr)
+#endif
+
 #if defined(HAVE_KQUEUE)
 import qualified GHC.Internal.Event.KQueue as KQueue
 #elif defined(HAVE_EPOLL)
@@ -128,6 +141,10 @@ data State = Created
 data EventManager = EventManager
     { emBackend      :: !Backend
     , emFds          :: {-# UNPACK #-} !(Array Int (MVar (IntTable [FdData])))
+      -- | The fds registered edge-triggered, with the events reported for
+      -- them that no registration has claimed yet. Each table is guarded
+      -- by the 'MVar' at the same index of 'emFds'.
+    , emEdges        :: {-# UNPACK #-} !(Array Int (IntTable Event))
     , emState        :: {-# UNPACK #-} !(IORef State)
     , emUniqueSource :: {-# UNPACK #-} !UniqueSource
     , emControl      :: {-# UNPACK #-} !Control
@@ -146,6 +163,11 @@ callbackTableVar :: EventManager -> Fd -> MVar (IntTable [FdData])
 callbackTableVar mgr fd = emFds mgr ! hashFd fd
 {-# INLINE callbackTableVar #-}
 
+-- | The caller must hold the 'callbackTableVar' of the fd.
+edgeTable :: EventManager -> Fd -> IntTable Event
+edgeTable mgr fd = emEdges mgr ! hashFd fd
+{-# INLINE edgeTable #-}
+
 haveOneShot :: Bool
 {-# INLINE haveOneShot #-}
 #if defined(darwin_HOST_OS) || defined(ios_HOST_OS)
@@ -155,6 +177,70 @@ haveOneShot = True
 #else
 haveOneShot = False
 #endif
+
+-- | Whether to register fds edge-triggered, as asked for with
+-- @+RTS --io-manager-edge-triggered@.
+useEdgeTriggered :: Bool
+#if defined(darwin_HOST_OS) || defined(ios_HOST_OS)
+useEdgeTriggered = False
+#elif defined(HAVE_EPOLL) || defined(HAVE_KQUEUE)
+useEdgeTriggered = toBool edgeTriggeredCBool
+
+{-# NOINLINE edgeTriggeredCBool #-}
+edgeTriggeredCBool :: CBool
+edgeTriggeredCBool = unsafeDupablePerformIO $ peek edgeTriggeredPtr
+
+foreign import ccall "&rts_IOManagerEdgeTriggered"
+  edgeTriggeredPtr :: Ptr CBool
+#else
+useEdgeTriggered = False
+#endif
+
+{-
+Note [Edge-triggered registrations]
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+By default every threadWaitRead or threadWaitWrite arms its fd in the
+backend with one-shot semantics, so a thread serving a socket makes an
+epoll_ctl (or kevent) call for each wait, on top of the read or write it
+waits for. For a long-lived socket these calls are pure overhead: the
+registration is the same each time.
+
+With +RTS --io-manager-edge-triggered the first wait on an fd instead
+registers it for both reading and writing, edge-triggered (EPOLLET, or
+EV_CLEAR for kqueue), and the registration then stays in place until the
+fd is closed. Later waits on the fd only touch the callback table, and
+the backend does not need re-arming after an event either, so a wait
+costs no system call of its own at all.
+
+An edge-triggered backend reports each transition to readiness only once,
+so we must not lose an event that arrives while no thread is waiting for
+it, e.g. the data a client sends while the server thread is still busy
+with its previous request. The emEdges table keeps, for each such fd, the
+events that were reported but claimed by no registration. A registration
+for a pending event is completed straight away, and consumes it. Both the
+poll loop and registerFd_ update emEdges with the callback table lock of
+the fd held, so an event is either claimed by a registration or recorded
+as pending, never both and never neither.
+
+A pending event can be stale: the waiter that consumes it may find that
+the data was read already, by the thread woken by the previous event. It
+then waits again. Callers must cope with spurious wakeups anyway, as an fd
+shared between several event managers may already cause them.
+
+There are two catches, which is why the mode is opt-in:
+
+ * A thread may only wait for an fd once it has seen that the fd is not
+   ready, e.g. because a read failed with EAGAIN. An fd that is writable
+   all along never becomes writable again, so a threadWaitWrite on it
+   without a prior failed write would never return.
+
+ * We rely on being told when an fd is closed: if an fd registered
+   edge-triggered is closed behind our back and its number is reused, we
+   would believe the new fd to be registered and wait for it forever. Every
+   fd waited on must be closed with closeFdWith.
+
+GHC's own Handles and the network package follow both rules already.
+-}
 ------------------------------------------------------------------------
 -- Creation
 
@@ -186,6 +272,8 @@ newWith :: Backend -> IO EventManager
 newWith be = do
   iofds <- fmap (listArray (0, callbackArraySize-1)) $
            replicateM callbackArraySize (newMVar =<< IT.new 8)
+  edges <- fmap (listArray (0, callbackArraySize-1)) $
+           replicateM callbackArraySize (IT.new 8)
   ctrl <- newControl False
   state <- newIORef Created
   us <- newSource
@@ -197,6 +285,7 @@ newWith be = do
   lockVar <- newMVar ()
   let mgr = EventManager { emBackend = be
                          , emFds = iofds
+                         , emEdges = edges
                          , emState = state
                          , emUniqueSource = us
                          , emControl = ctrl
@@ -325,46 +414,89 @@ registerFd_ mgr@(EventManager{..}) cb fd evs lt = do
       reg  = FdKey fd u
       el = I.eventLifetime evs lt
       !fdd = FdData reg el cb
-  (modify,ok) <- withMVar (callbackTableVar mgr fd) $ \tbl -> do
-    oldFdd <- IT.insertWith (++) fd' [fdd] tbl
-    let prevEvs :: EventLifetime
-        prevEvs = maybe mempty eventsOf oldFdd
-
-        el' :: EventLifetime
-        el' = prevEvs `mappend` el
-
-        -- Used for restoring the old state if registering the FD
-        -- in the backend failed, due to either
-        -- 1. that file type not being supported, or
-        -- 2. the backend throwing an exception
-        undoRegistration = IT.reset fd' oldFdd tbl
-    case I.elLifetime el' of
-      -- All registrations want one-shot semantics and this is supported
-      OneShot | haveOneShot -> do
-        ok <- I.modifyFdOnce emBackend fd (I.elEvent el')
-          `onException` undoRegistration
-        if ok
-          then return (False, True)
-          else undoRegistration >> return (False, False)
-
-      -- We don't want or don't support one-shot semantics
-      _ -> do
-        let modify = prevEvs /= el'
-        ok <- if modify
-              then let newEvs = I.elEvent el'
-                       oldEvs = I.elEvent prevEvs
-                   in I.modifyFd emBackend fd oldEvs newEvs
-                        `onException` undoRegistration
-              else return True
-        if ok
-          then return (modify, True)
-          else undoRegistration >> return (False, False)
+  (modify,ok,ready) <- withMVar (callbackTableVar mgr fd) $ \tbl -> do
+    edge <- if useEdgeTriggered
+              then registerEdge mgr tbl fdd
+              else return Nothing
+    case edge of
+      Just ready -> return (False, True, ready)
+      Nothing    -> fmap (\(modify, ok) -> (modify, ok, mempty)) $ do
+        oldFdd <- IT.insertWith (++) fd' [fdd] tbl
+        let prevEvs :: EventLifetime
+            prevEvs = maybe mempty eventsOf oldFdd
+
+            el' :: EventLifetime
+            el' = prevEvs `mappend` el
+
+            -- Used for restoring the old state if registering the FD
+            -- in the backend failed, due to either
+            -- 1. that file type not being supported, or
+            -- 2. the backend throwing an exception
+            undoRegistration = IT.reset fd' oldFdd tbl
+        case I.elLifetime el' of
+          -- All registrations want one-shot semantics and this is supported
+          OneShot | haveOneShot -> do
+            ok <- I.modifyFdOnce emBackend fd (I.elEvent el')
+              `onException` undoRegistration
+            if ok
+              then return (False, True)
+              else undoRegistration >> return (False, False)
+
+          -- We don't want or don't support one-shot semantics
+          _ -> do
+            let modify = prevEvs /= el'
+            ok <- if modify
+                  then let newEvs = I.elEvent el'
+                           oldEvs = I.elEvent prevEvs
+                       in I.modifyFd emBackend fd oldEvs newEvs
+                            `onException` undoRegistration
+                  else return True
+            if ok
+              then return (modify, True)
+              else undoRegistration >> return (False, False)
   -- this simulates behavior of old IO manager:
   -- i.e. just call the callback if the registration fails.
   when (not ok) (cb reg evs)
+  when (ready /= mempty) (cb reg ready)
   return (reg,modify)
 {-# INLINE registerFd_ #-}
 
+-- | Register an fd edge-triggered, or add a registration to an fd already
+-- registered so. See Note [Edge-triggered registrations]. Returns the
+-- pending events the registration claimed, or 'Nothing' if the fd was not
+-- and can't be registered edge-triggered. The caller must hold the
+-- callback table lock for the fd.
+registerEdge :: EventManager -> IntTable [FdData] -> FdData -> IO (Maybe Event)
+registerEdge mgr tbl fdd = do
+  armed <- IT.lookup fd' edges
+  case armed of
+    Just pending -> do
+      let ready = pending `evtsIn` I.elEvent el
+      when (ready /= mempty) $
+        IT.reset fd' (Just (pending `evtsNotIn` ready)) edges
+      -- a one-shot registration is over as soon as it is completed
+      unless (ready /= mempty && I.elLifetime el == OneShot) $
+        void $ IT.insertWith (++) fd' [fdd] tbl
+      return (Just ready)
+    Nothing -> do
+      -- an fd registered the usual way stays so until it's closed
+      others <- IT.lookup fd' tbl
+      if isJust others
+        then return Nothing
+        else do
+          ok <- I.modifyFdEdge (emBackend mgr) fd
+          if ok
+            then do
+              IT.reset fd' (Just mempty) edges
+              _ <- IT.insertWith (++) fd' [fdd] tbl
+              return (Just mempty)
+            else return Nothing
+  where
+    fd    = keyFd (fdKey fdd)
+    fd'   = fromIntegral fd
+    el    = fdEvents fdd
+    edges = edgeTable mgr fd
+
 -- | @registerFd mgr cb fd evs lt@ registers interest in the events @evs@
 -- on the file descriptor @fd@ for lifetime @lt@. @cb@ is called for
 -- each event that occurs.  Returns a cookie that can be handed to
@@ -413,7 +545,9 @@ unregisterFd_ mgr@(EventManager{..}) (FdKey fd u) =
           return (eventsOf prev, r)
     (oldEls, newEls) <- IT.updateWith dropReg fd' tbl >>=
                         maybe (return (mempty, mempty)) pairEvents
-    let modify = oldEls /= newEls
+    -- an fd registered edge-triggered stays registered until it's closed
+    edge <- isJust `fmap` IT.lookup fd' (edgeTable mgr fd)
+    let modify = oldEls /= newEls && not edge
     when modify $ failOnInvalidFile "unregisterFd_" fd $
       case I.elLifetime newEls of
         OneShot | I.elEvent newEls /= mempty, haveOneShot ->
@@ -433,12 +567,13 @@ unregisterFd mgr reg = do
 closeFd :: EventManager -> (Fd -> IO ()) -> Fd -> IO ()
 closeFd mgr close fd = do
   fds <- withMVar (callbackTableVar mgr fd) $ \tbl -> do
+    edge <- dropEdge mgr fd
     prev <- IT.delete (fromIntegral fd) tbl
     case prev of
       Nothing  -> close fd >> return []
       Just fds -> do
         let oldEls = eventsOf fds
-        when (I.elEvent oldEls /= mempty) $ do
+        when (not edge && I.elEvent oldEls /= mempty) $ do
           _ <- I.modifyFd (emBackend mgr) fd (I.elEvent oldEls) mempty
           wakeManager mgr
         close fd
@@ -454,18 +589,31 @@ closeFd_ :: EventManager
          -> Fd
          -> IO (IO ())
 closeFd_ mgr tbl fd = do
+  edge <- dropEdge mgr fd
   prev <- IT.delete (fromIntegral fd) tbl
   case prev of
     Nothing  -> return (return ())
     Just fds -> do
       let oldEls = eventsOf fds
-      when (oldEls /= mempty) $ do
+      when (not edge && oldEls /= mempty) $ do
         _ <- I.modifyFd (emBackend mgr) fd (I.elEvent oldEls) mempty
         wakeManager mgr
       return $
         forM_ fds $ \(FdData reg el cb) ->
           cb reg (I.elEvent el `mappend` evtClose)
 
+-- | Forget that an fd about to be closed is registered edge-triggered, if
+-- it is, and delete it from the backend. Returns whether it was. The
+-- caller must hold the callback table lock for the fd.
+dropEdge :: EventManager -> Fd -> IO Bool
+dropEdge mgr fd = do
+  armed <- IT.delete (fromIntegral fd) (edgeTable mgr fd)
+  case armed of
+    Nothing -> return False
+    Just _  -> do
+      _ <- I.modifyFd (emBackend mgr) fd (evtRead <> evtWrite) mempty
+      return True
+
 ------------------------------------------------------------------------
 -- Utilities
 
@@ -476,10 +624,36 @@ onFdEvent mgr fd evs
     handleControlEvent mgr fd evs
 
   | otherwise = do
-    fdds <- withMVar (callbackTableVar mgr fd) $ \tbl ->
-        IT.delete (fromIntegral fd) tbl >>= maybe (return []) (selectCallbacks tbl)
+    fdds <- withMVar (callbackTableVar mgr fd) $ \tbl -> do
+        armed <- IT.lookup (fromIntegral fd) (edgeTable mgr fd)
+        case armed of
+          Just pending -> selectEdgeCallbacks tbl pending
+          Nothing ->
+            IT.delete (fromIntegral fd) tbl >>= maybe (return []) (selectCallbacks tbl)
     forM_ fdds $ \(FdData reg _ cb) -> cb reg evs
   where
+    -- figure out which registrations have been triggered
+    matches :: FdData -> Bool
+    matches fd' = evs `I.eventIs` I.elEvent (fdEvents fd')
+
+    isMultishot :: FdData -> Bool
+    isMultishot fd' = I.elLifetime (fdEvents fd') == MultiShot
+
+    -- An fd registered edge-triggered needs no re-arming, but the events
+    -- no registration is waiting for must be kept for the registrations
+    -- to come. See Note [Edge-triggered registrations].
+    selectEdgeCallbacks :: IntTable [FdData] -> Event -> IO [FdData]
+    selectEdgeCallbacks tbl pending = do
+        fdds <- fromMaybe [] `fmap` IT.delete (fromIntegral fd) tbl
+        let (triggered, notTriggered) = partition matches fdds
+            saved = notTriggered ++ filter isMultishot triggered
+            unclaimed = evs `evtsNotIn` I.elEvent (eventsOf fdds)
+        unless (null saved) $
+          void $ IT.insertWith (\_ _ -> saved) (fromIntegral fd) saved tbl
+        when (unclaimed /= mempty) $
+          IT.reset (fromIntegral fd) (Just (pending <> unclaimed)) (edgeTable mgr fd)
+        return triggered
+
     -- Here we look through the list of registrations for the fd of interest
     -- and sort out which match the events that were triggered. We,
     --
@@ -489,14 +663,9 @@ onFdEvent mgr fd evs
     --   3. return a list containing the callbacks that should be invoked.
     selectCallbacks :: IntTable [FdData] -> [FdData] -> IO [FdData]
     selectCallbacks tbl fdds = do
-        let -- figure out which registrations have been triggered
-            matches :: FdData -> Bool
-            matches fd' = evs `I.eventIs` I.elEvent (fdEvents fd')
-            (triggered, notTriggered) = partition matches fdds
+        let (triggered, notTriggered) = partition matches fdds
 
             -- sort out which registrations we need to retain
-            isMultishot :: FdData -> Bool
-            isMultishot fd' = I.elLifetime (fdEvents fd') == MultiShot
             saved = notTriggered ++ filter isMultishot triggered
 
             savedEls = eventsOf saved
@@ -528,6 +697,16 @@ onFdEvent mgr fd evs
 
         return triggered
 
+-- | The read and write events of the first set that are in the second.
+evtsIn :: Event -> Event -> Event
+evtsIn a b = mconcat [ e | e <- [evtRead, evtWrite]
+                         , a `I.eventIs` e, b `I.eventIs` e ]
+
+-- | The read and write events of the first set that are not in the second.
+evtsNotIn :: Event -> Event -> Event
+evtsNotIn a b = mconcat [ e | e <- [evtRead, evtWrite]
+                            , a `I.eventIs` e, not (b `I.eventIs` e) ]
+
 nullToNothing :: [a] -> Maybe [a]
 nullToNothing []       = Nothing
 nullToNothing xs@(_:_) = Just xs
@@ -1,4 +1,5 @@
 {-# LANGUAGE CPP               #-}
+{-# LANGUAGE BangPatterns      #-}
 {-# LANGUAGE NoImplicitPrelude #-}
 {-# LANGUAGE Trustworthy       #-}
 
@@ -14,6 +15,7 @@
 module GHC.Internal.Fingerprint (
         Fingerprint(..), fingerprint0,
         fingerprintData,
+        fingerprintDataMany,
         fingerprintString,
         fingerprintFingerprints,
         getFileHash
@@ -22,6 +24,7 @@ module GHC.Internal.Fingerprint (
 import GHC.Internal.IO
 import GHC.Internal.Base
 import GHC.Internal.Bits
+import GHC.Internal.Data.Tuple (fst, snd)
 import GHC.Internal.Num
 import GHC.Internal.List
 import GHC.Internal.Real
@@ -59,17 +62,36 @@ fingerprintData buf len =
       c_MD5Final pdigest pctxt
       peek (castPtr pdigest :: Ptr Fingerprint)
 
+-- | Computes the fingerprints of several buffers at once. This gives the
+-- same results as 'fingerprintData' on each buffer in turn, but where the
+-- hardware allows it hashes several buffers side by side, which is much
+-- quicker when there are many small ones.
+--
+-- @since 9.1401.0
+fingerprintDataMany :: [(Ptr Word8, Int)] -> IO [Fingerprint]
+fingerprintDataMany bufs =
+  withArrayLen (map fst bufs) $ \n pbufs ->
+  withArray (map snd bufs) $ \plens ->
+  allocaArray n $ \pdigests -> do
+    c_MD5Many (castPtr pdigests) pbufs plens n
+    peekArray n pdigests
+
 fingerprintString :: String -> Fingerprint
 fingerprintString str = unsafeDupablePerformIO $
-  withArrayLen word8s $ \len p ->
-     fingerprintData p len
-    where word8s = concatMap f str
-          f c = let w32 :: Word32
-                    w32 = fromIntegral (ord c)
-                in [fromIntegral (w32 `shiftR` 24),
-                    fromIntegral (w32 `shiftR` 16),
-                    fromIntegral (w32 `shiftR` 8),
-                    fromIntegral w32]
+  allocaBytes len $ \p -> do
+    let -- each character as four big-endian bytes
+        go !_ [] = return ()
+        go i (c:cs) = do
+          let w32 :: Word32
+              w32 = fromIntegral (ord c)
+          pokeByteOff p i       (fromIntegral (w32 `shiftR` 24) :: Word8)
+          pokeByteOff p (i + 1) (fromIntegral (w32 `shiftR` 16) :: Word8)
+          pokeByteOff p (i + 2) (fromIntegral (w32 `shiftR` 8)  :: Word8)
+          pokeByteOff p (i + 3) (fromIntegral w32               :: Word8)
+          go (i + 4) cs
+    go 0 str
+    fingerprintData p len
+  where len = 4 * length str
 
 -- | Computes the hash of a given file.
 -- This function loops over the handle, running in constant memory.
@@ -114,3 +136,5 @@ foreign import ccall unsafe "__hsbase_MD5Update"
    c_MD5Update :: Ptr MD5Context -> Ptr Word8 -> CInt -> IO ()
 foreign import ccall unsafe "__hsbase_MD5Final"
    c_MD5Final  :: Ptr Word8 -> Ptr MD5Context -> IO ()
+foreign import ccall unsafe "__hsbase_MD5Many"
+   c_MD5Many   :: Ptr Word8 -> Ptr (Ptr Word8) -> Ptr Int -> Int -> IO ()
@@ -0,0 +1,80 @@
+{-# LANGUAGE NoImplicitPrelude #-}
+{-# LANGUAGE ExistentialQuantification #-}
+{-# LANGUAGE Trustworthy #-}
+
+-----------------------------------------------------------------------------
+-- |
+-- Module      :  GHC.Internal.Foreign.CallBatch
+-- Copyright   :  (c) GHC Developers
+-- License     :  BSD-style (see the file libraries/base/LICENSE)
+--
+-- Maintainer  :  ffi@haskell.org
+-- Stability   :  provisional
+-- Portability :  non-portable (GHC extensions)
+--
+-- Running many C calls for the price of one @safe@ foreign call.
+--
+-----------------------------------------------------------------------------
+
+module GHC.Internal.Foreign.CallBatch (
+    BatchCall(..),
+    callBatch,
+    callBatch_,
+) where
+
+import GHC.Internal.Base
+import GHC.Internal.Foreign.Marshal.Array ( allocaArray, peekArray, pokeArray )
+import GHC.Internal.List ( length, unzip )
+import GHC.Internal.Ptr
+
+-- Note [Batched safe calls]
+-- ~~~~~~~~~~~~~~~~~~~~~~~~~
+-- A safe foreign call releases the capability before the call and takes
+-- it back afterwards (suspendThread and resumeThread in rts/Schedule.c),
+-- so that other Haskell threads can run, and the GC can too, while the C
+-- code blocks. For a call that only takes a microsecond, as most calls of
+-- a database binding's inner loop do, that is much of the cost.
+--
+-- Nothing on the Haskell side can run between two calls without taking
+-- the capability back, so the calls of a batch are described up front as
+-- pairs of a function and its argument, and hs_call_batch (in
+-- cbits/callBatch.c) makes them all from inside a single safe call. The
+-- results come back in an array the size of the batch. All the calls are
+-- made in order from the same OS thread; for a bound thread that is its
+-- own OS thread, as for any other foreign call.
+
+-- | A call of a C function of the type @HsInt f(void *)@ with an argument,
+-- to be made by 'callBatch'. Functions of other types need a small C
+-- wrapper of this type.
+--
+-- @since 9.1401.0
+data BatchCall = forall a . BatchCall !(FunPtr (Ptr a -> IO Int)) !(Ptr a)
+
+-- | Make each call in order, returning their results, from a single @safe@
+-- foreign call: the capability is given up once for the whole batch
+-- rather than once for each call. See Note [Batched safe calls].
+--
+-- @since 9.1401.0
+callBatch :: [BatchCall] -> IO [Int]
+callBatch [] = return []
+callBatch calls =
+  allocaArray n $ \funs ->
+  allocaArray n $ \args ->
+  allocaArray n $ \results -> do
+    pokeArray funs fs
+    pokeArray args as
+    c_call_batch n funs args results
+    peekArray n results
+  where
+    n = length calls
+    (fs, as) = unzip [ (castFunPtr f, castPtr a) | BatchCall f a <- calls ]
+
+-- | Like 'callBatch', without the results.
+--
+-- @since 9.1401.0
+callBatch_ :: [BatchCall] -> IO ()
+callBatch_ calls = callBatch calls >> return ()
+
+foreign import ccall safe "hs_call_batch"
+  c_call_batch :: Int -> Ptr (FunPtr (Ptr () -> IO Int)) -> Ptr (Ptr ())
+               -> Ptr Int -> IO ()
@@ -1,9 +1,11 @@
 {-# LANGUAGE Trustworthy #-}
 {-# LANGUAGE NoImplicitPrelude
            , BangPatterns
+           , CPP
            , NondecreasingIndentation
            , MagicHash
            , UnboxedTuples
+           , UnliftedFFITypes
   #-}
 {-# OPTIONS_GHC -funbox-strict-fields #-}
 
@@ -40,6 +42,10 @@ import GHC.Internal.Num
 import GHC.Internal.IORef
 -- import GHC.Internal.IO
 import GHC.Internal.IO.Buffer
+#if !defined(javascript_HOST_ARCH)
+import GHC.Internal.ForeignPtr (unsafeWithForeignPtr)
+import GHC.Internal.Ptr
+#endif
 import GHC.Internal.IO.Encoding.Failure
 import GHC.Internal.IO.Encoding.Types
 import GHC.Internal.Word
@@ -221,7 +227,8 @@ utf8_decode
              !ro = output { bufR = ow }
          in (# st', why, ri, ro #)
    in
-   loop ir0 ow0 st
+   case utf8_decode_bulk iraw ir0 iw oraw ow0 os st of
+     (# st', ir, ow #) -> loop ir ow st'
 
 utf8_encode :: EncodeBuffer#
 utf8_encode
@@ -267,7 +274,72 @@ utf8_encode
                         !(# st5, () #) = unIO (writeWord8Buf oraw (ow+3) c4) st4
                     loop ir' (ow+4) st5
    in
-   loop ir0 ow0 st
+   case utf8_encode_bulk iraw ir0 iw oraw ow0 os st of
+     (# st', ir, ow #) -> loop ir ow st'
+
+{- Note [UTF-8 codec in C]
+~~~~~~~~~~~~~~~~~~~~~~~~~~
+Reading and writing text in a UTF-8 locale goes through utf8_decode and
+utf8_encode, so they bound how quickly a program can get through a log file
+with hGetLine, say. Going a character at a time through a Buffer is slow
+however we write it, so before their own loops they hand the buffer to
+hs_utf8_decode and hs_utf8_encode in cbits/utf8.c. These do as much as they
+can with SIMD for runs of ASCII and tight C for the rest, and stop at
+anything the Haskell loop would report: an invalid or incomplete sequence, a
+surrogate, or a full output buffer. The loop then carries on from there, so
+errors, recovery (see "GHC.Internal.IO.Encoding.Failure") and partial
+sequences at the end of a buffer (#3341) behave just as before.
+
+A buffer with less than bulkMin elements to go isn't worth the call, and
+nor is anything on the JavaScript backend, which has no C.
+-}
+
+utf8_decode_bulk :: RawBuffer Word8 -> Int -> Int -> RawCharBuffer -> Int -> Int
+                 -> State# RealWorld -> (# State# RealWorld, Int, Int #)
+utf8_encode_bulk :: RawCharBuffer -> Int -> Int -> RawBuffer Word8 -> Int -> Int
+                 -> State# RealWorld -> (# State# RealWorld, Int, Int #)
+#if defined(javascript_HOST_ARCH)
+utf8_decode_bulk _ ir _ _ ow _ st = (# st, ir, ow #)
+utf8_encode_bulk _ ir _ _ ow _ st = (# st, ir, ow #)
+#else
+utf8_decode_bulk iraw ir iw oraw ow os st0
+  | iw - ir < bulkMin || os - ow < bulkMin = (# st0, ir, ow #)
+  | otherwise =
+      case newByteArray# 8# st0 of
+        (# st1, produced #) ->
+          let !(# st2, consumed #) = unIO (
+                unsafeWithForeignPtr iraw $ \pin ->
+                unsafeWithForeignPtr oraw $ \pout ->
+                  c_utf8_decode (pin `plusPtr` ir) (iw - ir)
+                                (pout `plusPtr` (ow * charSize)) (os - ow)
+                                produced) st1
+          in case readIntArray# produced 0# st2 of
+               (# st3, n #) -> (# st3, ir + consumed, ow + I# n #)
+
+utf8_encode_bulk iraw ir iw oraw ow os st0
+  | iw - ir < bulkMin || os - ow < bulkMin = (# st0, ir, ow #)
+  | otherwise =
+      case newByteArray# 8# st0 of
+        (# st1, produced #) ->
+          let !(# st2, consumed #) = unIO (
+                unsafeWithForeignPtr iraw $ \pin ->
+                unsafeWithForeignPtr oraw $ \pout ->
+                  c_utf8_encode (pin `plusPtr` (ir * charSize)) (iw - ir)
+                                (pout `plusPtr` ow) (os - ow)
+                                produced) st1
+          in case readIntArray# produced 0# st2 of
+               (# st3, n #) -> (# st3, ir + consumed, ow + I# n #)
+
+bulkMin :: Int
+bulkMin = 16
+
+foreign import ccall unsafe "hs_utf8_decode"
+  c_utf8_decode :: Ptr Word8 -> Int -> Ptr CharBufElem -> Int
+                -> MutableByteArray# RealWorld -> IO Int
+foreign import ccall unsafe "hs_utf8_encode"
+  c_utf8_encode :: Ptr CharBufElem -> Int -> Ptr Word8 -> Int
+                -> MutableByteArray# RealWorld -> IO Int
+#endif
 
 -- -----------------------------------------------------------------------------
 -- UTF-8 primitives, lifted from Data.Text.Fusion.Utf8
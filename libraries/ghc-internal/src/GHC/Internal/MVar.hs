@@ -28,6 +28,8 @@ module GHC.Internal.MVar (
         , tryTakeMVar
         , tryPutMVar
         , tryReadMVar
+        , bargingTakeMVar
+        , bargingPutMVar
         , isEmptyMVar
         , addMVarFinalizer
 
@@ -172,6 +174,26 @@ tryReadMVar (MVar m) = IO $ \ s ->
         (# s', 0#, _ #) -> (# s', Nothing #)      -- MVar is empty
         (# s', _,  a #) -> (# s', Just a  #)      -- MVar is full
 
+-- |Like 'takeMVar', except that a thread blocked in 'putMVar' is not
+-- handed the 'MVar': if it is the only thread waiting, it is woken up to
+-- try its 'putMVar' again, and the 'MVar' is left empty.
+bargingTakeMVar :: MVar a -> IO a
+bargingTakeMVar (MVar mvar#) = IO $ \ s# -> bargingTakeMVar# mvar# s#
+
+-- |Like 'putMVar', except that a thread blocked in 'takeMVar' is not
+-- handed the value: if it is the only thread waiting, it is woken up to
+-- try its 'takeMVar' again, and the 'MVar' is left full.
+--
+-- When an @'MVar' ()@ is used as a lock, releasing it with
+-- 'bargingPutMVar' lets the current thread take it again straight away,
+-- rather than waiting for the thread it would have been handed to to run.
+-- This gives up the FIFO fairness of 'putMVar': the waiting thread may
+-- be overtaken any number of times.
+bargingPutMVar :: MVar a -> a -> IO ()
+bargingPutMVar (MVar mvar#) x = IO $ \ s# ->
+    case bargingPutMVar# mvar# x s# of
+        s2# -> (# s2#, () #)
+
 -- |Check whether a given 'MVar' is empty.
 --
 -- Notice that the boolean value returned  is just a snapshot of
@@ -38,6 +38,11 @@ module GHC.Internal.Prim.Ext
   , asyncRead#
   , asyncWrite#
   , asyncDoProc#
+#endif
+#if defined(linux_HOST_OS)
+  , uringRead#
+  , uringWrite#
+  , uringAccept#
 #endif
   ) where
 
@@ -81,6 +86,50 @@ foreign import prim "stg_asyncDoProczh" asyncDoProc#
 
 #endif
 
+#if defined(linux_HOST_OS)
+
+-- | Read up to the given number of bytes from the file descriptor (first arg)
+-- into the buffer, at the given file offset (or the current position if it is
+-- @-1@), with the I/O done by the io_uring I/O manager. Returns the number of
+-- bytes read, or a negative @errno@. Returns @-ENOSYS@ unless the program runs
+-- with @+RTS --io-manager=uring@.
+--
+-- The buffer must stay valid, and must not be moved, until the call returns:
+-- use pinned or malloc'd memory. If the calling thread is interrupted by an
+-- asynchronous exception the operation is cancelled, but the kernel may still
+-- write to the buffer until the cancellation completes.
+foreign import prim "stg_uringReadzh" uringRead#
+  :: Int#
+  -> Addr#
+  -> Int#
+  -> Int#
+  -> State# RealWorld
+  -> (# State# RealWorld, Int# #)
+
+-- | Write the given number of bytes from the buffer to the file descriptor,
+-- like 'uringRead#'. Returns the number of bytes written, or a negative
+-- @errno@.
+foreign import prim "stg_uringWritezh" uringWrite#
+  :: Int#
+  -> Addr#
+  -> Int#
+  -> Int#
+  -> State# RealWorld
+  -> (# State# RealWorld, Int# #)
+
+-- | Accept a connection on the listening socket (first arg), like
+-- @accept(2)@ with the given @sockaddr@ and @socklen_t@ pointers (which may
+-- be null), with the I/O done by the io_uring I/O manager. Returns the new
+-- file descriptor, or a negative @errno@, as for 'uringRead#'.
+foreign import prim "stg_uringAcceptzh" uringAccept#
+  :: Int#
+  -> Addr#
+  -> Addr#
+  -> State# RealWorld
+  -> (# State# RealWorld, Int# #)
+
+#endif
+
 ------------------------------------------------------------------------
 -- Misc
 ------------------------------------------------------------------------
@@ -16,9 +16,14 @@
 module GHC.Internal.Stack.CloneStack (
   StackSnapshot(..),
   StackEntry(..),
+  StackFrames(..),
   cloneMyStack,
   cloneThreadStack,
+  snapshotMyStack,
+  snapshotThreadStack,
+  stackFrames,
   decode,
+  decodeFrames,
   prettyStackEntry
   ) where
 
@@ -47,6 +52,16 @@ foreign import prim "stg_cloneMyStackzh" cloneMyStack# :: State# RealWorld -> (#
 
 foreign import prim "stg_sendCloneStackMessagezh" sendCloneStackMessage# :: ThreadId# -> StablePtr# PrimMVar -> State# RealWorld -> (# State# RealWorld, (# #) #)
 
+-- | The info table pointers of the return frames on a thread's stack, top of
+-- the stack first, as taken by 'snapshotMyStack' and 'snapshotThreadStack'.
+-- Unlike a 'StackSnapshot' this doesn't keep the stack, or the closures it
+-- refers to, alive. See Note [Stack Frame Snapshots].
+data StackFrames = StackFrames ByteArray#
+
+foreign import prim "stg_snapshotMyStackzh" snapshotMyStack# :: Word# -> State# RealWorld -> (# State# RealWorld, ByteArray# #)
+
+foreign import prim "stg_sendSnapshotStackMessagezh" sendSnapshotStackMessage# :: ThreadId# -> StablePtr# PrimMVar -> Word# -> State# RealWorld -> (# State# RealWorld, (# #) #)
+
 {-
 Note [Stack Cloning]
 ~~~~~~~~~~~~~~~~~~~~
@@ -185,6 +200,35 @@ The relevant notes are:
   - Note [Stacktraces from Info Table Provenance Entries (IPE based stack unwinding)]
 -}
 
+{-
+Note [Stack Frame Snapshots]
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+Cloning a stack copies every chunk of it (see Note [Stack Cloning]), and
+decoding the clone then walks it again for the info table pointers of its
+frames. A monitor that samples the stacks of all threads every second only
+wants the latter, and for just the top of each stack, so that copying is
+almost all of its cost.
+
+`snapshotMyStack#` and `sendSnapshotStackMessage#` instead walk the live stack
+in place, and copy the info table pointers of at most the requested number of
+return frames (RET_SMALL and RET_BIG, the ones that can have an IPE) into a
+`ByteArray#`, top of the stack first. The update, catch, underflow, ... frames
+of the RTS are skipped. That's all `snapshotStackFrames` in
+rts/CloneStack.c allocates, and it holds no pointers into the heap, so the GC
+never has to look into it either.
+
+The stack of another thread must not change while it's walked. In the
+threaded RTS the request rides on the clone message (`MessageCloneStack` with
+`snapshot` set), so the thread's capability walks it between running threads,
+just as it would clone it; the thread is only held up for as long as the walk
+takes. In the non-threaded RTS the other thread can't be running while we
+are, so its stack is walked right away. Either way the calling thread's own
+stack is taken with `snapshotMyStack#`, as its stack pointer is only saved
+into the stack object by the primop.
+
+`decodeFrames` looks up the IPEs of the frames as `decode` does.
+-}
+
 -- | Clone the stack of the executing thread
 --
 -- @since base-4.17.0.0
@@ -206,6 +250,49 @@ cloneThreadStack (ThreadId tid#) = do
   freeStablePtr boxedPtr
   takeMVar resultVar
 
+-- | Take the info table pointers of at most the given number of return frames
+-- at the top of the executing thread's stack, without cloning it. Decode them
+-- with 'decodeFrames'.
+snapshotMyStack :: Int -> IO StackFrames
+snapshotMyStack maxFrames = IO $ \s ->
+   case snapshotMyStack# (frameLimit maxFrames) s of
+     (# s1, frames #) -> (# s1, StackFrames frames #)
+
+-- | Take the info table pointers of at most the given number of return frames
+-- at the top of the stack of a thread identified by its 'ThreadId', without
+-- cloning it. The thread is paused only while its stack is walked.
+snapshotThreadStack :: ThreadId -> Int -> IO StackFrames
+snapshotThreadStack tid@(ThreadId tid#) maxFrames = do
+  me <- myThreadId
+  if tid == me
+    then snapshotMyStack maxFrames
+    else do
+      resultVar <- newEmptyMVar @StackFrames
+      boxedPtr@(StablePtr ptr) <- newStablePtrPrimMVar resultVar
+      IO $ \s -> case sendSnapshotStackMessage# tid# ptr (frameLimit maxFrames) s of
+        (# s', (# #) #) -> (# s', () #)
+      freeStablePtr boxedPtr
+      takeMVar resultVar
+
+frameLimit :: Int -> Word#
+frameLimit n = case max 0 n of I# n# -> int2Word# n#
+
+-- | The info table pointers in a 'StackFrames', top of the stack first.
+stackFrames :: StackFrames -> [Ptr StgInfoTable]
+stackFrames (StackFrames arr) = go 0
+  where
+    n = I# (sizeofByteArray# arr) `div` sizeOf (nullPtr :: Ptr ())
+    go i | i >= n = []
+         | otherwise = frameAt i : go (i + 1)
+    frameAt (I# i) = Ptr (indexAddrArray# arr i)
+
+-- | Decode a 'StackFrames' to a stack trace, top of the stack first, leaving
+-- out the frames without an 'InfoProvEnt' as 'decode' does.
+decodeFrames :: StackFrames -> IO [StackEntry]
+decodeFrames frames = catMaybes `fmap` mapM decodeFrame (stackFrames frames)
+  where
+    decodeFrame info = fmap toStackEntry `fmap` lookupIPE info
+
 -- | Representation for the source location where a return frame was pushed on the stack.
 -- This happens every time when a @case ... of@ scrutinee is evaluated.
 data StackEntry = StackEntry
@@ -16,6 +16,12 @@
    each block.  In the worst case, half of the allocated space is
    wasted.  This allocator is therefore best suited to situations in
    which most allocations are small.
+
+   Arenas come and go: the heap profiler makes one for every census, and
+   retainer profiling one for every retainer census. So the single blocks of
+   freed arenas are kept in a small cache for the next arena, rather than
+   going back to the block allocator, and an arena can be reset (emptied but
+   for its first block) and used again instead of being freed and made anew.
    -------------------------------------------------------------------------- */
 
 #include "rts/PosixSource.h"
@@ -32,8 +38,93 @@ struct _Arena {
 };
 
 // We like to keep track of how many blocks we've allocated for
-// Storage.c:memInventory().
-static long arena_blocks = 0;
+// Storage.c:memInventory(). Different threads may use their own arenas at
+// the same time (see Note [Parallel heap census] in ProfHeap.c).
+static StgWord arena_blocks = 0;
+
+// Single blocks of freed arenas, for the next ones; still counted in
+// arena_blocks. Arenas may be made and freed by several threads at once, so
+// the cache has a lock of its own, which is cheaper than the block
+// allocator's.
+#define ARENA_BLOCK_CACHE_SIZE 16
+
+static bdescr *arena_block_cache = NULL;
+static uint32_t n_arena_block_cache = 0;
+#if defined(THREADED_RTS)
+static Mutex arena_block_cache_lock;
+#endif
+
+void
+initArenas( void )
+{
+#if defined(THREADED_RTS)
+    initMutex(&arena_block_cache_lock);
+#endif
+}
+
+void
+exitArenas( void )
+{
+    bdescr *bd, *next;
+
+    for (bd = arena_block_cache; bd != NULL; bd = next) {
+        next = bd->link;
+        atomic_dec(&arena_blocks, 1);
+        freeGroup_lock(bd);
+    }
+    arena_block_cache = NULL;
+    n_arena_block_cache = 0;
+#if defined(THREADED_RTS)
+    closeMutex(&arena_block_cache_lock);
+#endif
+}
+
+static bdescr *
+arenaBlock( void )
+{
+    bdescr *bd;
+
+    ACQUIRE_LOCK(&arena_block_cache_lock);
+    bd = arena_block_cache;
+    if (bd != NULL) {
+        arena_block_cache = bd->link;
+        n_arena_block_cache--;
+    }
+    RELEASE_LOCK(&arena_block_cache_lock);
+
+    if (bd == NULL) {
+        bd = allocBlock_lock();
+        atomic_inc(&arena_blocks, 1);
+    }
+    return bd;
+}
+
+// Free the blocks of an arena from bd on, caching what we can.
+static void
+freeArenaBlocks( bdescr *bd )
+{
+    bdescr *next;
+
+    for (; bd != NULL; bd = next) {
+        next = bd->link;
+        if (bd->blocks == 1) {
+            ACQUIRE_LOCK(&arena_block_cache_lock);
+            if (n_arena_block_cache < ARENA_BLOCK_CACHE_SIZE) {
+                bd->link = arena_block_cache;
+                arena_block_cache = bd;
+                n_arena_block_cache++;
+                bd = NULL;
+            }
+            RELEASE_LOCK(&arena_block_cache_lock);
+            if (bd == NULL) {
+                continue;
+            }
+        }
+        ASSERT(RELAXED_LOAD(&arena_blocks) >= bd->blocks);
+        atomic_dec(&arena_blocks, bd->blocks);
+        freeGroup_lock(bd);
+    }
+}
 
 // Begin a new arena
 Arena *
@@ -42,11 +133,10 @@ newArena( void )
     Arena *arena;
 
     arena = stgMallocBytes(sizeof(Arena), "newArena");
-    arena->current = allocBlock_lock();
+    arena->current = arenaBlock();
     arena->current->link = NULL;
     arena->free = arena->current->start;
     arena->lim  = arena->current->start + BLOCK_SIZE_W;
-    arena_blocks++;
 
     return arena;
 }
@@ -81,8 +171,12 @@ arenaAlloc( Arena *arena, size_t size )
     } else {
         // allocate a fresh block...
         req_blocks =  (W_)BLOCK_ROUND_UP(size) / BLOCK_SIZE;
-        bd = allocGroup_lock(req_blocks);
-        arena_blocks += bd->blocks;
+        if (req_blocks == 1) {
+            bd = arenaBlock();
+        } else {
+            bd = allocGroup_lock(req_blocks);
+            atomic_inc(&arena_blocks, bd->blocks);
+        }
 
         bd->gen_no  = 0;
         bd->gen     = NULL;
@@ -101,21 +195,32 @@ arenaAlloc( Arena *arena, size_t size )
 void
 arenaFree( Arena *arena )
 {
-    bdescr *bd, *next;
+    freeArenaBlocks(arena->current);
+    stgFree(arena);
+}
 
-    for (bd = arena->current; bd != NULL; bd = next) {
-        next = bd->link;
-        arena_blocks -= bd->blocks;
-        ASSERT(arena_blocks >= 0);
-        freeGroup_lock(bd);
+// Empty an arena, keeping its first block
+void
+arenaReset( Arena *arena )
+{
+    bdescr *bd = arena->current;
+
+    // the first block is the one newArena allocated, at the end of the list
+    while (bd->link != NULL) {
+        bdescr *next = bd->link;
+        bd->link = NULL;
+        freeArenaBlocks(bd);
+        bd = next;
     }
-    stgFree(arena);
+    arena->current = bd;
+    arena->free = bd->start;
+    arena->lim  = bd->start + BLOCK_SIZE_W;
 }
 
 unsigned long
 arenaBlocks( void )
 {
-    return arena_blocks;
+    return RELAXED_LOAD(&arena_blocks);
 }
 
 #if defined(DEBUG)
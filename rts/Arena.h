@@ -18,6 +18,13 @@ void  * arenaAlloc ( Arena *, size_t );
 // Free an entire arena
 void arenaFree  ( Arena * );
 
+// Empty an arena to use it again, keeping its first block
+RTS_PRIVATE void arenaReset ( Arena * );
+
+// Set up and free the cache of arena blocks
+RTS_PRIVATE void initArenas ( void );
+RTS_PRIVATE void exitArenas ( void );
+
 // For internal use only:
 RTS_PRIVATE unsigned long arenaBlocks( void );
 
@@ -0,0 +1,120 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Growing and shrinking the number of enabled capabilities with the load
+ * (+RTS -Nauto-scale).
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Autoscaling capabilities]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With -Nauto-scale the RTS creates as many capabilities as the program may
+   use, the number of processors it can run on capped by the CPU quota of
+   its cgroup (so that a container limited to 2 CPUs on a 64-core machine
+   gets 2, not 64), and changes how many of them are enabled as the load
+   changes, using the same mechanism as setNumCapabilities: capabilities
+   beyond enabled_capabilities are marked disabled, their threads migrate
+   away and they take no part in GC.
+
+   The decision is taken after each GC, in scheduleDoGC, while no capability
+   runs Haskell code, so that flipping cap->disabled is as safe as it is in
+   setNumCapabilities. As there, the threads of a newly disabled capability
+   migrate away when it next runs the scheduler, and the bound ones at the
+   next GC. The load is the number of runnable threads and sparks on the
+   enabled capabilities:
+
+    * If there are more of them than enabled capabilities, we enable
+      enough capabilities to run them all, unless the last parallel GC's
+      work balance (see Note [Work Balance] in Stats.c) was below
+      AUTOSCALE_MIN_BALANCE: the GC can't make use of more threads, and
+      neither, most likely, can the program.
+
+    * If for AUTOSCALE_SHRINK_GCS GCs in a row fewer than half of the
+      enabled capabilities had work, or the work balance was poor with no
+      more runnable work than capabilities, we disable one capability.
+
+   Growing quickly and shrinking slowly keeps us from oscillating when the
+   load is bursty. The changes are traced with -Ds and shown as
+   CAP_ENABLE/CAP_DISABLE events in the eventlog.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "AutoScale.h"
+#include "Capability.h"
+#include "RtsUtils.h"
+#include "Stats.h"
+#include "Trace.h"
+
+#define AUTOSCALE_MIN_BALANCE 0.25
+#define AUTOSCALE_SHRINK_GCS 4
+
+// The number of capabilities to create for -Nauto-scale.
+uint32_t
+autoScaleMaxCapabilities (void)
+{
+    return getNumberOfUsableProcessors();
+}
+
+#if defined(THREADED_RTS)
+
+static uint32_t low_load_gcs = 0;
+
+/* Enable or disable capabilities as the load suggests. Called by
+ * scheduleDoGC after the GC, while no capability is running Haskell code.
+ */
+void
+autoScaleCapabilities (void)
+{
+    if (!RtsFlags.ParFlags.autoScale) {
+        return;
+    }
+
+    const uint32_t enabled = enabled_capabilities;
+    uint32_t runnable = 0;
+    uint32_t busy_caps = 0;
+    for (uint32_t i = 0; i < enabled; i++) {
+        Capability *cap = getCapability(i);
+        const uint32_t work = cap->n_run_queue + sparkPoolSizeCap(cap);
+        runnable += work;
+        busy_caps += work != 0;
+    }
+
+    const double balance = lastGcWorkBalance();
+    const bool poor_balance = balance >= 0 && balance < AUTOSCALE_MIN_BALANCE;
+
+    uint32_t target = enabled;
+    if (runnable > enabled && !poor_balance) {
+        target = stg_min(runnable, n_capabilities);
+        low_load_gcs = 0;
+    } else if (busy_caps < enabled / 2 || (poor_balance && runnable <= enabled)) {
+        if (++low_load_gcs >= AUTOSCALE_SHRINK_GCS && enabled > 1) {
+            target = enabled - 1;
+            low_load_gcs = 0;
+        }
+    } else {
+        low_load_gcs = 0;
+    }
+
+    if (target == enabled) {
+        return;
+    }
+
+    debugTrace(DEBUG_sched,
+               "autoscale: %d runnable threads and sparks, work balance %.2f: "
+               "%d -> %d capabilities", runnable, balance, enabled, target);
+
+    for (uint32_t n = target; n < enabled; n++) {
+        getCapability(n)->disabled = true;
+        traceCapDisable(getCapability(n));
+    }
+    for (uint32_t n = enabled; n < target; n++) {
+        getCapability(n)->disabled = false;
+        traceCapEnable(getCapability(n));
+    }
+    RELAXED_STORE(&enabled_capabilities, target);
+}
+
+#endif /* THREADED_RTS */
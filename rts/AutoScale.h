@@ -0,0 +1,20 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Growing and shrinking the number of enabled capabilities with the load
+ * (+RTS -Nauto-scale). See Note [Autoscaling capabilities] in AutoScale.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+uint32_t autoScaleMaxCapabilities (void);
+
+#if defined(THREADED_RTS)
+void autoScaleCapabilities (void);
+#endif
+
+#include "EndPrivate.h"
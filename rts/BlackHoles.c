@@ -0,0 +1,179 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Contention on blackholes, and adaptive eager blackholing.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Blackhole contention]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   When threads on several capabilities evaluate the same thunk, all but one
+   of them waste their time. With lazy blackholing a thunk is only marked as
+   under evaluation when its thread is paused, so until then other threads
+   can enter it too; threadPaused later finds that another thread
+   blackholed it first and suspends the duplicate work (see Note [suspend
+   duplicate work] in ThreadPaused.c). Once it is blackholed, threads that
+   enter it block in messageBlackHole until its owner updates it.
+
+   We count both, in cap->bh_duplicates and cap->bh_blocks (reported by
+   +RTS -s), and, where we can tell, which thunk it was. By then the thunk's
+   info table has been overwritten, but code compiled with -forig-thunk-info
+   (which -fadaptive-eager-blackholing implies) pushes a
+   stg_orig_thunk_info_frame recording it right behind each update frame.
+   threadPaused finds it next to the update frame it gives up on;
+   messageBlackHole looks for the update frame of the blackhole among the
+   top BH_OWNER_SCAN_FRAMES frames of the owner's stack. It can do so
+   because it runs on the owner's capability, where the owner isn't running.
+
+   noteBlackHoleContention keeps the info tables in a small table per
+   capability, cap->bh_contention, indexed by a hash of the info pointer.
+   As for TVars in Note [STM contention] in STM.c, an info table that wants
+   a slot taken by another decrements its count, and only takes the slot
+   once the count reaches zero, so the slots keep the info tables contended
+   for most often. At the start of each GC, while the eventlog records
+   scheduler events (-ls), reportBlackHoleContention posts a
+   BLACKHOLE_CONTENTION event for each with at least BH_HOT_MIN_CONTENTION
+   hits since the previous GC, and clears the table. With -finfo-table-map
+   the IPE events in the eventlog give their source locations.
+
+   Note [Adaptive eager blackholing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Eager blackholing (-feager-blackholing) closes the window in which other
+   threads can enter a thunk under evaluation, but costs a couple of stores
+   on every thunk entry, for the few thunks that are shared between threads.
+   With -fadaptive-eager-blackholing the code generator instead makes each
+   updatable thunk look up its info table in eager_blackhole_sites, a byte
+   table indexed by EAGER_BLACKHOLE_SITE(info), and only blackhole itself
+   eagerly (pushing a stg_bh_upd_frame rather than a stg_upd_frame) if the
+   byte is set. noteBlackHoleContention sets it once a thunk info table
+   reaches BH_EAGER_MIN_CONTENTION hits on a capability between two GCs.
+
+   Bytes are never cleared: a site that is contended for once is likely to
+   be again, and eagerly blackholing a thunk is never wrong. Two info tables
+   can share a byte, which just means that some thunks are blackholed
+   eagerly for no reason.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "BlackHoles.h"
+#include "Capability.h"
+#include "Trace.h"
+
+#define BH_HOT_MIN_CONTENTION 4
+#define BH_EAGER_MIN_CONTENTION 4
+#define BH_OWNER_SCAN_FRAMES 64
+
+StgWord8 eager_blackhole_sites[EAGER_BLACKHOLE_SITES];
+
+// The original info table of a thunk, from the stg_orig_thunk_info_frame
+// at frame (just behind its update frame), if there is one.
+const StgInfoTable *
+origThunkInfo (StgPtr frame, StgPtr stack_end)
+{
+    if (frame >= stack_end ||
+        ((StgClosure *)frame)->header.info != &stg_orig_thunk_info_frame_info) {
+        return NULL;
+    }
+    return ((StgOrigThunkInfoFrame *)frame)->info_ptr;
+}
+
+// The original info table of the thunk that owner is updating with the
+// blackhole bh. owner must not be running.
+const StgInfoTable *
+blackHoleThunkInfo (StgTSO *owner, StgClosure *bh)
+{
+    StgStack *stack = owner->stackobj;
+    StgPtr stack_end = stack->stack + stack->stack_size;
+    StgPtr p = stack->sp;
+
+    for (uint32_t n = 0; n < BH_OWNER_SCAN_FRAMES && p < stack_end; n++) {
+        const StgRetInfoTable *info = get_ret_itbl((StgClosure *)p);
+        switch (info->i.type) {
+        case UPDATE_FRAME:
+            if (((StgUpdateFrame *)p)->updatee == bh) {
+                return origThunkInfo(p + sizeofW(StgUpdateFrame), stack_end);
+            }
+            break;
+        case UNDERFLOW_FRAME:
+        case STOP_FRAME:
+            return NULL;
+        default:
+            break;
+        }
+        p += stack_frame_sizeW((StgClosure *)p);
+    }
+    return NULL;
+}
+
+void
+noteBlackHoleContention (Capability *cap, const StgInfoTable *info,
+                         bool blocked)
+{
+    if (blocked) {
+        cap->bh_blocks++;
+    } else {
+        cap->bh_duplicates++;
+    }
+    if (info == NULL) {
+        return;
+    }
+
+    BlackHoleContention *c =
+        &cap->bh_contention[((StgWord) info >> 3) % BH_CONTENTION_SLOTS];
+    if (c->info != info) {
+        if (c->hits != 0) {
+            c->hits--;
+            return;
+        }
+        c->info = info;
+        c->duplicates = 0;
+        c->blocks = 0;
+    }
+    c->hits++;
+    if (blocked) {
+        c->blocks++;
+    } else {
+        c->duplicates++;
+    }
+
+    // See Note [Adaptive eager blackholing]
+    if (c->hits == BH_EAGER_MIN_CONTENTION) {
+        StgWord8 *site = &eager_blackhole_sites[EAGER_BLACKHOLE_SITE(info)];
+        if (RELAXED_LOAD(site) == 0) {
+            debugTrace(DEBUG_sched, "eagerly blackholing thunks of %p", info);
+            RELAXED_STORE(site, 1);
+        }
+    }
+}
+
+void
+reportBlackHoleContention (Capability *cap)
+{
+    for (uint32_t i = 0; i < BH_CONTENTION_SLOTS; i++) {
+        BlackHoleContention *c = &cap->bh_contention[i];
+        if (c->hits >= BH_HOT_MIN_CONTENTION) {
+            traceEventBlackHoleContention(cap, (StgWord) c->info,
+                                          c->duplicates, c->blocks);
+        }
+        c->info = NULL;
+        c->hits = 0;
+        c->duplicates = 0;
+        c->blocks = 0;
+    }
+}
+
+// The number of eager_blackhole_sites that have been set, for +RTS -s
+uint32_t
+countEagerBlackHoleSites (void)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < EAGER_BLACKHOLE_SITES; i++) {
+        if (RELAXED_LOAD(&eager_blackhole_sites[i]) != 0) {
+            n++;
+        }
+    }
+    return n;
+}
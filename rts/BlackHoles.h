@@ -0,0 +1,35 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Contention on blackholes, and adaptive eager blackholing.
+ * See Note [Blackhole contention] in BlackHoles.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+#define BH_CONTENTION_SLOTS 32
+
+// A thunk info table that threads on a capability contended for
+typedef struct {
+    const StgInfoTable *info;
+    uint32_t hits;          // decremented by other info tables wanting the slot
+    uint32_t duplicates;    // evaluations suspended as duplicate work
+    uint32_t blocks;        // threads blocked on one of its blackholes
+} BlackHoleContention;
+
+const StgInfoTable *origThunkInfo (StgPtr frame, StgPtr stack_end);
+
+const StgInfoTable *blackHoleThunkInfo (StgTSO *owner, StgClosure *bh);
+
+void noteBlackHoleContention (Capability *cap, const StgInfoTable *info,
+                              bool blocked);
+
+void reportBlackHoleContention (Capability *cap);
+
+uint32_t countEagerBlackHoleSites (void);
+
+#include "EndPrivate.h"
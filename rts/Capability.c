@@ -31,6 +31,10 @@
 #include "sm/OSMem.h"
 #include "sm/BlockAlloc.h" // for countBlocks()
 #include "IOManager.h"
+#include "Timer.h"
+#if !defined(mingw32_HOST_OS)
+#include "posix/PreemptTimer.h"
+#endif
 
 #include <string.h>
 
@@ -93,6 +97,76 @@ globalWorkToDo (void)
 #endif
 
 #if defined(THREADED_RTS)
+/* Note [Spark pool growth and batched stealing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A divide-and-conquer program sparks far more than it has capabilities,
+   mostly on the capabilities that started the work. Two things used to
+   cost it:
+
+    * A spark that doesn't fit in its capability's pool (-e sparks) is
+      dropped, and counted as overflowed. With --max-spark-pool=<n> a full
+      pool doubles instead, up to <n> sparks (see newGrowableWSDeque).
+
+    * An idle capability stole one spark at a time, so a capability that
+      had just run out of work went looking through the other pools again
+      as soon as it had converted its spark. Now a successful steal also
+      moves up to half of the remaining sparks of the robbed capability,
+      and at most SPARK_STEAL_BATCH of them, into the thief's own pool
+      (stealSparkBatch), where it finds them next time. Each of them is
+      still taken with its own CAS; see stealHalfWSDeque. Other idle
+      capabilities can steal them from there in turn.
+
+   Moving a spark between pools doesn't change the spark counters, whose
+   invariant (see checkSparkCountInvariant) counts the sparks remaining in
+   all pools; the moves are counted in spark_stats.batch_steals and
+   batch_stolen and reported by +RTS -s.
+*/
+
+#define SPARK_STEAL_BATCH 32
+
+// Having stolen a spark from robbed, move more of its sparks to our pool.
+static void
+stealSparkBatch (Capability *cap, Capability *robbed)
+{
+  void *batch[SPARK_STEAL_BATCH];
+  const long room = cap->sparks->size - sparkPoolSize(cap->sparks);
+  uint32_t n;
+
+  if (room <= 0) {
+      return;
+  }
+  n = stealHalfWSDeque(robbed->sparks, batch,
+                       stg_min(room, SPARK_STEAL_BATCH));
+  for (uint32_t i = 0; i < n; i++) {
+      // Only we push to our pool, and we made sure there is room
+      bool pushed STG_UNUSED = pushWSDeque(cap->sparks, batch[i]);
+      ASSERT(pushed);
+  }
+  if (n > 0) {
+      cap->spark_stats.batch_steals++;
+      cap->spark_stats.batch_stolen += n;
+      debugTrace(DEBUG_sparks, "cap %d: moved %d more sparks from cap %d",
+                 cap->no, n, robbed->no);
+  }
+}
+
+/* Note [Spark stealing order]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   An idle capability looking for a spark to steal used to try the other
+   capabilities in order from capability 0, so the low-numbered ones were
+   robbed most, and a thief on one NUMA node was as likely to take a spark
+   from another node as from its own, and then evaluate it far from the
+   data it refers to.
+
+   findSpark now tries the capabilities on its own NUMA node (cap->node,
+   see capNoToNumaNode) before the others, and starts each round at a
+   pseudo-random capability (from xorshift32 on cap->steal_seed), so that thieves spread out over their victims. Only steals
+   on the same node take more sparks for later (see
+   Note [Spark pool growth and batched stealing]); a thief on another node
+   takes just the spark it runs. Without --numa there is one node, and the
+   order is just randomised.
+*/
+
 StgClosure *
 findSpark (Capability *cap)
 {
@@ -142,13 +216,23 @@ findSpark (Capability *cap)
                  "cap %d: Trying to steal work from other capabilities",
                  cap->no);
 
-      /* visit cap.s 0..n-1 in sequence until a theft succeeds. We could
-      start at a random place instead of 0 as well.  */
-      for ( i=0 ; i < getNumCapabilities() ; i++ ) {
-          robbed = getCapability(i);
+      /* visit the other caps until a theft succeeds, those on our NUMA
+         node first, each time from a random place; see
+         Note [Spark stealing order]. */
+      const uint32_t n = getNumCapabilities();
+      const uint32_t start = xorshift32(&cap->steal_seed) % n;
+      for ( i=0 ; i < 2 * n ; i++ ) {
+          const bool local_pass = i < n;
+          if (!local_pass && n_numa_nodes == 1) {
+              break;
+          }
+          robbed = getCapability((start + i) % n);
           if (cap == robbed)  // ourselves...
               continue;
 
+          if ((robbed->node == cap->node) != local_pass)
+              continue;
+
           if (emptySparkPoolCap(robbed)) // nothing to steal here
               continue;
 
@@ -167,6 +251,9 @@ findSpark (Capability *cap)
           if (spark != NULL) {
               cap->spark_stats.converted++;
               traceEventSparkSteal(cap, robbed->no);
+              if (local_pass) {
+                  stealSparkBatch(cap, robbed);
+              }
 
               return spark;
           }
@@ -269,12 +356,21 @@ initCapability (Capability *cap, uint32_t i)
     cap->running_task      = NULL; // indicates cap is free
     cap->spare_workers     = NULL;
     cap->n_spare_workers   = 0;
+    cap->spin_wakeups      = 0;
+    cap->parks             = 0;
+    cap->worker_reuses     = 0;
+    cap->affinity_cpus     = NULL;
+    cap->n_affinity_cpus   = 0;
+    cap->affinity_epoch    = 0;
+    cap->isolated          = false;
     cap->suspended_ccalls  = NULL;
     cap->n_suspended_ccalls = 0;
     cap->returning_tasks_hd = NULL;
     cap->returning_tasks_tl = NULL;
     cap->n_returning_tasks  = 0;
     cap->inbox              = (Message*)END_TSO_QUEUE;
+    cap->messages_sent      = NULL;
+    cap->messages_sent_size = 0;
     cap->putMVars           = NULL;
     cap->sparks             = allocSparkPool();
     cap->spark_stats.created    = 0;
@@ -283,8 +379,27 @@ initCapability (Capability *cap, uint32_t i)
     cap->spark_stats.converted  = 0;
     cap->spark_stats.gcd        = 0;
     cap->spark_stats.fizzled    = 0;
+    cap->spark_stats.batch_steals = 0;
+    cap->spark_stats.batch_stolen = 0;
+    cap->n_spare_spark_stacks = 0;
+    cap->steal_seed = i + 1;    // xorshift needs a non-zero seed
+    cap->spark_thread_label = NULL;
+    cap->spark_threads_created = 0;
+    cap->spark_threads_reused = 0;
+    cap->spark_prune_mark = 0;
+    cap->spark_prune_gen = 0;
+    cap->spark_prune_visited = 0;
+    cap->spark_prune_skipped = 0;
+    cap->spark_prune_time = 0;
+    cap->n_free_stable_ptrs = 0;
+    cap->stable_ptr_busy = 0;
 #endif
     cap->total_allocated        = 0;
+    cap->mutator_cpu            = 0;
+    cap->mutator_start_cpu      = 0;
+    cap->context_switches       = 0;
+    cap->gcs                    = 0;
+    cap->gc_cpu                 = 0;
 
     initCapabilityIOManager(cap); /* initialises cap->iomgr */
 
@@ -299,6 +414,7 @@ initCapability (Capability *cap, uint32_t i)
                                           RtsFlags.GcFlags.generations,
                                           "initCapability");
     cap->current_segments = NULL;
+    cap->nonmoving_size_profile = NULL;
 
 
     // At this point storage manager is not initialized yet, so this will be
@@ -315,11 +431,48 @@ initCapability (Capability *cap, uint32_t i)
     cap->free_trec_chunks = END_STM_CHUNK_LIST;
     cap->free_trec_headers = NO_TREC;
     cap->transaction_tokens = 0;
+    cap->stm_index = NULL;
+    memset(cap->stm_conflicts, 0, sizeof(cap->stm_conflicts));
+    cap->stm_aborts_in_a_row = 0;
+    cap->stm_backoff_seed = i + 1;
+    memset(cap->bh_contention, 0, sizeof(cap->bh_contention));
+    cap->bh_duplicates = 0;
+    cap->bh_blocks = 0;
+    cap->n_spare_stack_chunks = 0;
+    cap->stack_chunks_allocated = 0;
+    cap->stack_chunks_reused = 0;
+    cap->thread_pauses = 0;
+    cap->pause_frames_walked = 0;
+    cap->upd_frames_squeezed = 0;
+    cap->cafs_entered = 0;
+    cap->n_spare_thread_stacks = 0;
+    cap->threads_created = 0;
+    cap->thread_stacks_reused = 0;
+    cap->sched_events_seen = 0;
+    cap->spark_events_seen = 0;
+    cap->sched_run_sampled = true;
+    cap->sched_events_suppressed = 0;
+    cap->spark_events_suppressed = 0;
     cap->context_switch = 0;
+    cap->slice_ticks = 1;
+    cap->slice_deadline = TIME_MAX;
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+    cap->preempt_timer_fd = -1;
+#endif
     cap->interrupt = 0;
+    cap->mvar_blocks = 0;
+    cap->mvar_barges = 0;
+    cap->alloc_sample_left = RtsFlags.TraceFlags.tracing != TRACE_NONE
+        ? RtsFlags.TraceFlags.allocSampleBlocks : 0;
+    cap->alloc_sample_allocated = 0;
+    cap->stack_sample_requested = false;
+    cap->stack_samples = NULL;
+    cap->mid_alloc_block = NULL;
     cap->pinned_object_block = NULL;
+    cap->pinned_ephemeral_block = NULL;
     cap->pinned_object_blocks = NULL;
     cap->pinned_object_empty = NULL;
+    initBlockCache(&cap->block_cache, cap->node);
 
 #if defined(PROFILING)
     cap->r.rCCCS = CCS_SYSTEM;
@@ -331,6 +484,9 @@ initCapability (Capability *cap, uint32_t i)
     // don't want it set when not running a Haskell thread.
     cap->r.rCurrentTSO = NULL;
 
+    // See Note [Sampled ticky counters] in GHC.StgToCmm.Ticky
+    cap->r.rTickyCountdown = 0;
+
     traceCapCreate(cap);
     traceCapsetAssignCap(CAPSET_OSPROCESS_DEFAULT, i);
     traceCapsetAssignCap(CAPSET_CLOCKDOMAIN_DEFAULT, i);
@@ -488,6 +644,46 @@ void contextSwitchAllCapabilities(void)
     }
 }
 
+void contextSwitchExpiredSlices(void)
+{
+    Time now = 0;
+    if (RtsFlags.ConcFlags.perCapabilityTimers) {
+#if defined(HAVE_PREEMPT_TIMERS)
+        // The capabilities' own timers preempt them
+        return;
+#else
+        now = getProcessElapsedTime();
+#endif
+    }
+
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap = getCapability(i);
+        const uint32_t left = RELAXED_LOAD(&cap->slice_ticks);
+        if (left == TSO_SLICE_UNBOUNDED) {
+            continue;
+        }
+        // See Note [Tickless idling] in Timer.c
+        if (RtsFlags.MiscFlags.tickless && !RELAXED_LOAD(&cap->in_haskell)) {
+            continue;
+        }
+        // See Note [Per-capability preemption timers]
+        if (RtsFlags.ConcFlags.perCapabilityTimers) {
+            if (RELAXED_LOAD(&cap->in_haskell) &&
+                now >= RELAXED_LOAD(&cap->slice_deadline)) {
+                RELAXED_STORE(&cap->slice_deadline, TIME_MAX);
+                contextSwitchCapability(cap, true);
+            }
+            continue;
+        }
+        if (left > 1) {
+            RELAXED_STORE(&cap->slice_ticks, left - 1);
+            continue;
+        }
+        RELAXED_STORE(&cap->slice_ticks, 0);
+        contextSwitchCapability(cap, true);
+    }
+}
+
 void interruptAllCapabilities(void)
 {
     uint32_t i;
@@ -521,7 +717,7 @@ giveCapabilityToTask (Capability *cap USED_IF_DEBUG, Task *task)
                serialisableTaskId(task));
     ACQUIRE_LOCK(&task->lock);
     if (task->wakeup == false) {
-        task->wakeup = true;
+        RELAXED_STORE(&task->wakeup, true);
         // the wakeup flag is needed because signalCondition() doesn't
         // flag the condition if the thread is already running, but we want
         // it to be sticky.
@@ -557,11 +753,15 @@ releaseCapability_ (Capability* cap,
     ASSERT_RETURNING_TASKS(cap,task);
     ASSERT_LOCK_HELD(&cap->lock);
 
-    RELAXED_STORE(&cap->running_task, NULL);
+    // Once running_task is NULL the capability may be claimed without
+    // cap->lock (see Note [Claiming a free capability]), so where we can we
+    // choose who runs it next before freeing it; the tasks we wake up
+    // afterwards cope with having lost it.
 
     // Check to see whether a worker thread can be given
     // the go-ahead to return the result of an external call..
     if (cap->n_returning_tasks != 0) {
+        SEQ_CST_STORE(&cap->running_task, NULL);
         giveCapabilityToTask(cap,cap->returning_tasks_hd);
         // The Task pops itself from the queue (see waitForCapability())
         return;
@@ -579,6 +779,7 @@ releaseCapability_ (Capability* cap,
     PendingSync *sync = SEQ_CST_LOAD(&pending_sync);
     if (sync && (sync->type != SYNC_GC_PAR || sync->idle[cap->no])) {
         debugTrace(DEBUG_sched, "sync pending, freeing capability %d", cap->no);
+        SEQ_CST_STORE(&cap->running_task, NULL);
         return;
     }
 
@@ -591,6 +792,7 @@ releaseCapability_ (Capability* cap,
         // ThreadBlocked, but the thread may be back on the run queue
         // by now.
         task = peekRunQueue(cap)->bound->task;
+        SEQ_CST_STORE(&cap->running_task, NULL);
         giveCapabilityToTask(cap, task);
         return;
     }
@@ -603,13 +805,32 @@ releaseCapability_ (Capability* cap,
         if (getSchedState() < SCHED_SHUTTING_DOWN || !emptyRunQueue(cap)) {
             debugTrace(DEBUG_sched,
                        "starting new worker on capability %d", cap->no);
+            // The new worker gets the capability straight from us
             startWorkerTask(cap);
+            startSpareWorkerTasks(cap);
             return;
         }
     }
 
+#if defined(PROFILING)
+    cap->r.rCCCS = CCS_IDLE;
+#endif
+
+    // SEQ_CST, ordered before the emptyInbox check below; see
+    // Note [The capability inbox] in Messages.c.
+    SEQ_CST_STORE(&cap->running_task, NULL);
+
     // If we have an unbound thread on the run queue, or if there's
-    // anything else to do, give the Capability to a worker thread.
+    // anything else to do, give the Capability to a worker thread. The
+    // capability may have been claimed again by now, so the run queue and
+    // spark pool reads race with its new owner; see
+    // Note [Claiming a free capability].
+    TSAN_ANNOTATE_BENIGN_RACE(&cap->n_run_queue,
+                              "releaseCapability_ (cap->n_run_queue)");
+    TSAN_ANNOTATE_BENIGN_RACE(&cap->sparks->top,
+                              "releaseCapability_ (cap->sparks->top)");
+    TSAN_ANNOTATE_BENIGN_RACE(&cap->sparks->bottom,
+                              "releaseCapability_ (cap->sparks->bottom)");
     if (always_wakeup ||
         !emptyRunQueue(cap) || !emptyInbox(cap) ||
         (!cap->disabled && !emptySparkPoolCap(cap)) || globalWorkToDo()) {
@@ -620,11 +841,11 @@ releaseCapability_ (Capability* cap,
         }
     }
 
-#if defined(PROFILING)
-    cap->r.rCCCS = CCS_IDLE;
-#endif
     RELAXED_STORE(&last_free_capability[cap->node], cap);
     debugTrace(DEBUG_sched, "freeing capability %d", cap->no);
+
+    // See Note [Tickless idling] in Timer.c
+    timerIdle();
 }
 
 void
@@ -655,7 +876,7 @@ enqueueWorker (Capability* cap USED_IF_THREADS)
     ASSERT(!task->stopped);
     ASSERT(task->worker);
 
-    if (cap->n_spare_workers < MAX_SPARE_WORKERS)
+    if (cap->n_spare_workers < RtsFlags.ParFlags.maxSpareWorkers)
     {
         task->next = cap->spare_workers;
         cap->spare_workers = task;
@@ -704,6 +925,91 @@ enqueueWorker (Capability* cap USED_IF_THREADS)
  *
  */
 
+#if defined(THREADED_RTS)
+
+/* Note [Spinning before parking]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A Task waiting for a Capability sleeps on task->cond until another Task
+   hands it one (giveCapabilityToTask). Waking it costs a futex call and the
+   latency of the OS scheduler, tens of microseconds, which under light load
+   can be most of the time it takes to handle a request.
+
+   With --park-spin=<n> a Task first spins for up to n busy_wait_nop()s
+   watching task->wakeup, with exponential backoff between the checks so
+   as not to hammer the cache line, and only sleeps if it wasn't woken
+   meanwhile. The limit adapts to the program for each task: a wakeup while
+   spinning doubles it (up to n), a sleep after spinning halves it (down to
+   n/PARK_SPIN_MIN_FRACTION), so tasks whose waits are long mostly stop
+   spinning in vain. The wakeup is still taken under task->lock, so
+   spinning only decides whether we call waitCondition, not what happens
+   next.
+
+   Each capability counts the wakeups taken while spinning and the sleeps
+   of the Tasks waiting on it; the counts are posted as CAP_PARKING events
+   after each GC (with -ls) and reset.
+*/
+
+#define PARK_SPIN_MAX_BACKOFF 64
+#define PARK_SPIN_MIN_FRACTION 16
+
+// Spin for a while waiting to be woken up. Returns true if we were.
+static bool
+spinForWakeup (Task *task)
+{
+    const uint32_t budget = RtsFlags.ParFlags.parkSpin;
+    uint32_t spun = 0;
+    uint32_t backoff = 1;
+
+    if (budget == 0) {
+        return false;
+    }
+
+    while (spun < task->spin_limit) {
+        if (RELAXED_LOAD(&task->wakeup)) {
+            task->spin_limit = stg_min(task->spin_limit * 2, budget);
+            return true;
+        }
+        for (uint32_t i = 0; i < backoff; i++) {
+            busy_wait_nop();
+        }
+        spun += backoff;
+        backoff = stg_min(backoff * 2, PARK_SPIN_MAX_BACKOFF);
+    }
+
+    task->spin_limit = stg_max(task->spin_limit / 2,
+                               stg_max(budget / PARK_SPIN_MIN_FRACTION, 1));
+    return false;
+}
+
+void
+traceCapabilityParking (void)
+{
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap = getCapability(i);
+        const StgWord spin_wakeups = xchg(&cap->spin_wakeups, 0);
+        const StgWord parks = xchg(&cap->parks, 0);
+        if (spin_wakeups != 0 || parks != 0) {
+            traceEventCapParking(cap, spin_wakeups, parks);
+        }
+    }
+}
+
+// Wait until the Task has been woken up. Returns with task->lock held.
+static void
+parkTask (Task *task)
+{
+    const bool spun = spinForWakeup(task);
+    ACQUIRE_LOCK(&task->lock);
+    if (!task->wakeup) {
+        atomic_inc(&task->cap->parks, 1);
+        waitCondition(&task->cond, &task->lock);
+    } else if (spun) {
+        atomic_inc(&task->cap->spin_wakeups, 1);
+    }
+}
+
+#endif /* THREADED_RTS */
+
 /* ----------------------------------------------------------------------------
  * waitForWorkerCapability(task)
  *
@@ -713,14 +1019,13 @@ enqueueWorker (Capability* cap USED_IF_THREADS)
 
 #if defined(THREADED_RTS)
 
-static Capability * waitForWorkerCapability (Task *task)
+Capability * waitForWorkerCapability (Task *task)
 {
     Capability *cap;
 
     for (;;) {
-        ACQUIRE_LOCK(&task->lock);
+        parkTask(task);
         // task->lock held, cap->lock not held
-        if (!task->wakeup) waitCondition(&task->cond, &task->lock);
         // The happens-after matches the happens-before in
         // schedulePushWork, which does owns 'task' when it sets 'task->cap'.
         TSAN_ANNOTATE_HAPPENS_AFTER(&task->cap);
@@ -758,12 +1063,25 @@ static Capability * waitForWorkerCapability (Task *task)
                 RELEASE_LOCK(&cap->lock);
                 continue;
             }
+        }
+
+        if (!claimCapability(cap, task)) {
+            // claimed by a returning task; see
+            // Note [Claiming a free capability]
+            RELEASE_LOCK(&cap->lock);
+            continue;
+        }
+
+        if (task->incall->tso == NULL) {
             cap->spare_workers = task->next;
             task->next = NULL;
             cap->n_spare_workers--;
+            cap->worker_reuses++;
+            traceTaskReuse(task, cap);
+            // Keep the pool warm; see Note [Spare worker pool] in Task.c
+            startSpareWorkerTasks(cap);
         }
 
-        RELAXED_STORE(&cap->running_task, task);
         RELEASE_LOCK(&cap->lock);
         break;
     }
@@ -789,9 +1107,8 @@ static Capability * waitForReturnCapability (Task *task)
     Capability *cap;
 
     for (;;) {
-        ACQUIRE_LOCK(&task->lock);
+        parkTask(task);
         // task->lock held, cap->lock not held
-        if (!task->wakeup) waitCondition(&task->cond, &task->lock);
         cap = task->cap;
         task->wakeup = false;
         RELEASE_LOCK(&task->lock);
@@ -804,10 +1121,11 @@ static Capability * waitForReturnCapability (Task *task)
                 RELEASE_LOCK(&cap->lock);
                 continue;
             }
-            RELAXED_STORE(&cap->running_task, task);
-            popReturningTask(cap);
-            RELEASE_LOCK(&cap->lock);
-            break;
+            if (claimCapability(cap, task)) {
+                popReturningTask(cap);
+                RELEASE_LOCK(&cap->lock);
+                break;
+            }
         }
         RELEASE_LOCK(&cap->lock);
     }
@@ -888,6 +1206,41 @@ static Capability * find_capability_for_task(const Task * task)
  *
  * ------------------------------------------------------------------------- */
 
+/* Note [Claiming a free capability]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A bound thread making a safe foreign call releases its capability in
+   suspendThread and asks for it back in resumeThread. If nothing else
+   wanted the capability meanwhile it is still free, and taking cap->lock to
+   find that out is most of the cost of the round trip for programs making
+   millions of short safe calls. So waitForCapability first tries to claim
+   the capability it returns to with a single CAS of running_task from NULL
+   to the task, without the lock, as long as no other task is queued to
+   return to it (we mustn't jump the queue). Only if that fails does it take
+   the lock and join returning_tasks.
+
+   For this to be safe every claim of a free capability must be such a CAS,
+   even under cap->lock (claimCapability): two tasks can't both take it.
+
+   releaseCapability_ decides who runs the capability next while it still
+   owns it wherever it can: a returning task or the bound task of the next
+   thread is chosen before running_task is cleared, and a new worker gets
+   the capability straight from it. But on its last path it stores NULL
+   to running_task and only then reads emptyRunQueue(cap), emptyInbox(cap)
+   and emptySparkPoolCap(cap) to decide whether to wake a spare worker. That order is required: Note [The capability inbox] in
+   Messages.c relies on the store coming before the emptyInbox check, so
+   that a message sent to a capability that is going idle is never missed.
+   So by the time of those reads the capability may already be running
+   again. For the run queue and the spark pool that is a benign race: a
+   stale answer only means that we wake a spare worker for nothing, or
+   leave the work to the task that claimed the capability, which will find
+   it anyway. They are annotated as such for ThreadSanitizer.
+
+   The tasks woken up after the capability was freed may find it taken;
+   they (waitForWorkerCapability, waitForReturnCapability) already go back
+   to sleep in that case, and are woken again when the new owner releases
+   it.
+*/
+
 void waitForCapability (Capability **pCap, Task *task)
 {
 #if !defined(THREADED_RTS)
@@ -906,14 +1259,24 @@ void waitForCapability (Capability **pCap, Task *task)
         task->cap = cap;
     } else {
         ASSERT(task->cap == cap);
+
+        // See Note [Claiming a free capability]
+        // N.B. This is benign as we don't rely on the value for correctness
+        TSAN_ANNOTATE_BENIGN_RACE(&cap->n_returning_tasks,
+                                  "waitForCapability (cap->n_returning_tasks)");
+        if (RELAXED_LOAD(&cap->n_returning_tasks) == 0
+            && RELAXED_LOAD(&cap->running_task) == NULL
+            && claimCapability(cap, task)) {
+            debugTrace(DEBUG_sched, "claimed free capability %d", cap->no);
+            goto claimed;
+        }
     }
 
     debugTrace(DEBUG_sched, "returning; I want capability %d", cap->no);
 
     ACQUIRE_LOCK(&cap->lock);
-    if (!cap->running_task) {
+    if (claimCapability(cap, task)) {
         // It's free; just grab it
-        RELAXED_STORE(&cap->running_task, task);
         RELEASE_LOCK(&cap->lock);
     } else {
         newReturningTask(cap,task);
@@ -921,6 +1284,7 @@ void waitForCapability (Capability **pCap, Task *task)
         cap = waitForReturnCapability(task);
     }
 
+claimed:
 #if defined(PROFILING)
     cap->r.rCCCS = CCS_SYSTEM;
 #endif
@@ -933,6 +1297,50 @@ void waitForCapability (Capability **pCap, Task *task)
 #endif
 }
 
+/* Note [Stealing threads]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   Threads are normally balanced by pushing: schedulePushWork gives spare
+   threads to free capabilities, but only when the busy capability goes
+   round its scheduler loop, which a thread running without yielding may not
+   do until its next context switch. Meanwhile the free capabilities sleep.
+
+   With -qs a capability that goes idle with an empty run queue asks the
+   capability with the most runnable threads (at least two) to context
+   switch at its next heap check. That capability then enters the scheduler
+   and runs schedulePushWork, which finds the idle capability free and
+   shares its run queue with it. So migration still happens in
+   schedulePushWork, by the owner of the run queue: it respects bound
+   threads and TSO_LOCKED as before, and is reported by MIGRATE_THREAD
+   events. The run queues themselves, which are doubly linked and only
+   touched by their owner, stay as they are.
+*/
+
+#if defined(THREADED_RTS)
+// Ask the busiest other capability to come back to the scheduler and share
+// its run queue. Called by an idle capability that has just been released.
+static void
+requestThreadsFromBusiest (Capability *cap)
+{
+    Capability *victim = NULL;
+    uint32_t most = 1;
+
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap0 = getCapability(i);
+        const uint32_t n = RELAXED_LOAD(&cap0->n_run_queue);
+        if (cap0 != cap && !cap0->disabled && n > most) {
+            victim = cap0;
+            most = n;
+        }
+    }
+
+    if (victim != NULL) {
+        debugTrace(DEBUG_sched, "cap %d: idle, asking cap %d (%d threads) to share",
+                   cap->no, victim->no, most);
+        contextSwitchCapability(victim, true);
+    }
+}
+#endif
+
 /* ----------------------------------------------------------------------------
  * yieldCapability
  *
@@ -1022,6 +1430,13 @@ yieldCapability
 
     releaseCapability_(cap, false);
 
+    // See Note [Stealing threads]
+    if (RtsFlags.ParFlags.stealThreads && RtsFlags.ParFlags.migrate
+        && cap->running_task == NULL && emptyRunQueue(cap)
+        && !RELAXED_LOAD(&cap->isolated)) {
+        requestThreadsFromBusiest(cap);
+    }
+
     if (isWorker(task) || isBoundTask(task)) {
         RELEASE_LOCK(&cap->lock);
         cap = waitForWorkerCapability(task);
@@ -1099,8 +1514,7 @@ void
 prodCapability (Capability *cap, Task *task)
 {
     ACQUIRE_LOCK(&cap->lock);
-    if (!cap->running_task) {
-        cap->running_task = task;
+    if (claimCapability(cap, task)) {
         releaseCapability_(cap,true);
     }
     RELEASE_LOCK(&cap->lock);
@@ -1127,19 +1541,113 @@ tryGrabCapability (Capability *cap, Task *task)
 
     r = TRY_ACQUIRE_LOCK(&cap->lock);
     if (r != 0) return false;
-    if (cap->running_task != NULL) {
+    if (!claimCapability(cap, task)) {
         RELEASE_LOCK(&cap->lock);
         return false;
     }
     task->cap = cap;
-    RELAXED_STORE(&cap->running_task, task);
     RELEASE_LOCK(&cap->lock);
     return true;
 }
 
 
+/* Note [Capability affinity]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   rts_setCapabilityAffinity pins the worker threads of a capability to a
+   set of CPUs, for example to dedicate cores to the capabilities that run
+   a program's network threads, and rts_setCapabilityIsolated stops other
+   capabilities from giving a capability threads or sparks, so that only the
+   threads placed there with forkOn run on it and keep its caches warm.
+
+   A worker applies its capability's CPUs to itself, as only a thread can
+   reliably change its own affinity. Changing them bumps
+   cap->affinity_epoch; workers compare it with the epoch they last applied
+   (task->affinity_epoch) when they start and each time round the scheduler
+   loop, and repin themselves if it has changed. The CPUs are read under
+   cap->lock, and copied, since the caller may replace them at any time.
+   With no CPUs a capability's workers go back to the default placement:
+   that of -qa if given, or any CPU.
+
+   Isolation only concerns the balancing done on behalf of other
+   capabilities: schedulePushWork does not pick an isolated capability, an
+   isolated capability doesn't ask others for threads (see Note [Stealing
+   threads]) and doesn't look for sparks. Bound threads and threads created
+   with forkOn still go where they are asked to.
+*/
+
+void
+applyCapabilityAffinity (Capability *cap, Task *task)
+{
+    if (task->affinity_epoch == RELAXED_LOAD(&cap->affinity_epoch)) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&cap->lock);
+    const uint32_t n_cpus = cap->n_affinity_cpus;
+    uint32_t *cpus = NULL;
+    if (n_cpus > 0) {
+        cpus = stgMallocBytes(n_cpus * sizeof(uint32_t),
+                              "applyCapabilityAffinity");
+        memcpy(cpus, cap->affinity_cpus, n_cpus * sizeof(uint32_t));
+    }
+    task->affinity_epoch = cap->affinity_epoch;
+    RELEASE_LOCK(&cap->lock);
+
+    debugTrace(DEBUG_sched, "pinning worker of capability %d to %" FMT_Word32
+               " CPUs", cap->no, n_cpus);
+    if (n_cpus > 0) {
+        setThreadAffinityToCPUs(cpus, n_cpus);
+        stgFree(cpus);
+    } else if (RtsFlags.ParFlags.setAffinity) {
+        setThreadAffinity(cap->no, getNumCapabilities());
+    } else {
+        setThreadAffinityToCPUs(NULL, 0);
+    }
+}
+
 #endif /* THREADED_RTS */
 
+void
+rts_setCapabilityAffinity (uint32_t cap_no USED_IF_THREADS,
+                           const uint32_t *cpus USED_IF_THREADS,
+                           uint32_t n_cpus USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    if (cap_no >= getNumCapabilities()) {
+        return;
+    }
+    uint32_t *copy = NULL;
+    if (n_cpus > 0) {
+        copy = stgMallocBytes(n_cpus * sizeof(uint32_t),
+                              "rts_setCapabilityAffinity");
+        memcpy(copy, cpus, n_cpus * sizeof(uint32_t));
+    }
+
+    Capability *cap = getCapability(cap_no);
+    ACQUIRE_LOCK(&cap->lock);
+    uint32_t *old = cap->affinity_cpus;
+    cap->affinity_cpus = copy;
+    cap->n_affinity_cpus = n_cpus;
+    RELAXED_STORE(&cap->affinity_epoch, cap->affinity_epoch + 1);
+    RELEASE_LOCK(&cap->lock);
+
+    if (old != NULL) {
+        stgFree(old);
+    }
+#endif
+}
+
+void
+rts_setCapabilityIsolated (uint32_t cap_no USED_IF_THREADS,
+                           HsBool isolated USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    if (cap_no < getNumCapabilities()) {
+        RELAXED_STORE(&getCapability(cap_no)->isolated, isolated != 0);
+    }
+#endif
+}
+
 /* ----------------------------------------------------------------------------
  * shutdownCapability
  *
@@ -1177,13 +1685,12 @@ shutdownCapability (Capability *cap USED_IF_THREADS,
         debugTrace(DEBUG_sched,
                    "shutting down capability %d, attempt %d", cap->no, i);
         ACQUIRE_LOCK(&cap->lock);
-        if (cap->running_task) {
+        if (!claimCapability(cap, task)) {
             RELEASE_LOCK(&cap->lock);
             debugTrace(DEBUG_sched, "not owner, yielding");
             yieldThread();
             continue;
         }
-        cap->running_task = task;
 
         if (cap->spare_workers) {
             // Look for workers that have died without removing
@@ -1270,6 +1777,7 @@ shutdownCapabilities(Task *task, bool safe)
     for (i=0; i < getNumCapabilities(); i++) {
         ASSERT(task->incall->tso == NULL);
         shutdownCapability(getCapability(i), task, safe);
+        traceEventSampledEvents(getCapability(i));
     }
 #if defined(THREADED_RTS)
     ASSERT(checkSparkCountInvariant());
@@ -1284,8 +1792,21 @@ freeCapability (Capability *cap)
     if (cap->current_segments) {
         stgFree(cap->current_segments);
     }
+    if (cap->nonmoving_size_profile) {
+        stgFree(cap->nonmoving_size_profile);
+    }
+    stmFreeIndex(cap);
+    if (cap->stack_samples) {
+        stgFree(cap->stack_samples);
+    }
 #if defined(THREADED_RTS)
     freeSparkPool(cap->sparks);
+    if (cap->messages_sent) {
+        stgFree(cap->messages_sent);
+    }
+    if (cap->affinity_cpus) {
+        stgFree(cap->affinity_cpus);
+    }
 #endif
     traceCapsetRemoveCap(CAPSET_OSPROCESS_DEFAULT, cap->no);
     traceCapsetRemoveCap(CAPSET_CLOCKDOMAIN_DEFAULT, cap->no);
@@ -1338,16 +1859,33 @@ markCapability (evac_fn evac, void *user, Capability *cap,
         evac(user, (StgClosure **)(void *)&incall->suspended_tso);
     }
 
+    for (uint32_t i = 0; i < cap->n_spare_stack_chunks; i++) {
+        evac(user, (StgClosure **)(void *)&cap->spare_stack_chunks[i]);
+    }
+    for (uint32_t i = 0; i < cap->n_spare_thread_stacks; i++) {
+        evac(user, (StgClosure **)(void *)&cap->spare_thread_stacks[i]);
+    }
+
 #if defined(THREADED_RTS)
     if (!no_mark_sparks) {
         traverseSparkQueue (evac, user, cap);
     }
+
+    for (uint32_t i = 0; i < cap->n_spare_spark_stacks; i++) {
+        evac(user, (StgClosure **)(void *)&cap->spare_spark_stacks[i]);
+    }
+    if (cap->spark_thread_label != NULL) {
+        evac(user, (StgClosure **)(void *)&cap->spark_thread_label);
+    }
 #endif
 
     markCapabilityIOManager(evac, user, cap);
 
     // Free STM structures for this Capability
     stmPreGCHook(cap);
+
+    reportBlackHoleContention(cap);
+    traceEventSampledEvents(cap);
 }
 
 void
@@ -1362,7 +1900,7 @@ markCapabilities (evac_fn evac, void *user)
 #if defined(THREADED_RTS)
 bool checkSparkCountInvariant (void)
 {
-    SparkCounters sparks = { 0, 0, 0, 0, 0, 0 };
+    SparkCounters sparks = { 0, 0, 0, 0, 0, 0, 0, 0 };
     StgWord64 remaining = 0;
     uint32_t i;
 
@@ -23,7 +23,10 @@
 #include "sm/GC.h" // for evac_fn
 #include "Task.h"
 #include "Sparks.h"
+#include "STM.h"
+#include "BlackHoles.h"
 #include "sm/NonMovingMark.h" // for MarkQueue
+#include "sm/BlockAlloc.h" // for BlockCache
 
 #include "BeginPrivate.h"
 
@@ -31,6 +34,18 @@
 // anything else, so round it up to a cache line size:
 #define CAPABILITY_ALIGNMENT CACHELINE_SIZE
 
+// The number of empty stack chunks a Capability keeps for reuse; see
+// Note [Reusing stack chunks] in Threads.c.
+#define MAX_SPARE_STACK_CHUNKS 8
+
+// The number of stacks of finished threads a Capability keeps for new
+// threads; see Note [Reusing thread stacks] in Threads.c.
+#define MAX_SPARE_THREAD_STACKS 32
+
+// The number of free stable pointer table slots a Capability keeps; see
+// Note [Per-capability stable pointer free lists] in StablePtr.c.
+#define MAX_CAP_FREE_STABLE_PTRS 64
+
 /* A forward declaration of the per-capability data structures belonging to
  * the I/O manager. It is opaque and only passed by pointer, so the full
  * structure definition is not needed. The full definition can be found in
@@ -104,14 +119,29 @@ struct Capability_ {
     // Array of current segments for the non-moving collector.
     // Of length nonmoving_alloca_cnt.
     struct NonmovingSegment **current_segments;
+    // Allocations into the non-moving heap by size (in words), while the
+    // size classes are being profiled, otherwise NULL.
+    // See Note [Profiled size classes].
+    StgWord *nonmoving_size_profile;
+
+    // block in the nursery for allocate() to put mid-size objects into, with
+    // --segregate-alloc. See Note [Segregated allocation of mid-size objects]
+    bdescr *mid_alloc_block;
 
     // block for allocating pinned objects into
     bdescr *pinned_object_block;
+    // block for allocating small pinned objects into, with
+    // --pinned-ephemeral. See Note [Ephemeral pinned blocks] in Storage.c
+    bdescr *pinned_ephemeral_block;
     // full pinned object blocks allocated since the last GC
     bdescr *pinned_object_blocks;
     // empty pinned object blocks, to be allocated into
     bdescr *pinned_object_empty;
 
+    // small free block groups, to avoid taking the block allocator lock.
+    // See Note [Per-capability block cache] in BlockAlloc.c.
+    BlockCache block_cache;
+
     // per-capability weak pointer list associated with nursery (older
     // lists stored in generation object)
     StgWeak *weak_ptr_list_hd;
@@ -123,6 +153,20 @@ struct Capability_ {
     // Does not require lock to read or write.
     int context_switch;
 
+    // Context switch intervals left in the time slice of the running
+    // thread, or TSO_SLICE_UNBOUNDED. Set by the scheduler, counted down by
+    // the timer; see Note [Time slices] in Schedule.c.
+    uint32_t slice_ticks;
+
+    // When the time slice of the running thread ends, with
+    // --per-capability-timers. See Note [Per-capability preemption timers]
+    // in posix/PreemptTimer.c.
+    Time slice_deadline;
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+    // The timerfd that preempts the capability, or -1
+    int preempt_timer_fd;
+#endif
+
     // Interrupt flag.  Like the context_switch flag, this also
     // indicates that we should stop running Haskell code, but we do
     // *not* switch threads.  This is used to stop a Capability in
@@ -139,16 +183,65 @@ struct Capability_ {
     // See Note [allocation accounting] in Storage.c
     uint64_t total_allocated;
 
+    // For getRTSCapStats: CPU time of the Haskell code run on this cap (with
+    // +RTS -T) and when it last started running, the number of times a
+    // thread stopped running here, and the GCs this cap's GC thread worked
+    // in and their CPU time. Owned by this capability.
+    Time mutator_cpu;
+    Time mutator_start_cpu;
+    StgWord64 context_switches;
+    uint32_t gcs;
+    Time gc_cpu;
+
+    // Threads that blocked in takeMVar#, putMVar# or readMVar# on this cap,
+    // and waiters that a barging MVar operation woke up to try again rather
+    // than handing them the value; see Note [Barging MVar operations] in
+    // PrimOps.cmm. Owned by this capability.
+    StgWord mvar_blocks;
+    StgWord mvar_barges;
+
+    // Nursery blocks left to fill before the next allocation sample (0: we
+    // aren't sampling), and total_allocated at the last sample; see
+    // Note [Allocation sampling] in Trace.c. Owned by this capability.
+    StgWord alloc_sample_left;
+    uint64_t alloc_sample_allocated;
+
+    // Set by the timer when it wants a sample of the stack of the thread
+    // running on this capability, and the samples not yet posted; see
+    // Note [Stack sampling] in Trace.c.
+    bool stack_sample_requested;
+    struct StackSamples_ *stack_samples;
+
 #if defined(THREADED_RTS)
     // Worker Tasks waiting in the wings.  Singly-linked.
     Task *spare_workers;
     uint32_t n_spare_workers; // count of above
 
+    // The CPUs that this Capability's worker threads run on (none: the
+    // default placement), changed by rts_setCapabilityAffinity, which bumps
+    // affinity_epoch. Locks required: cap->lock.
+    uint32_t *affinity_cpus;
+    uint32_t n_affinity_cpus;
+    uint32_t affinity_epoch;
+
+    // An isolated Capability is given no threads or sparks by other
+    // Capabilities; see rts_setCapabilityIsolated.
+    bool isolated;
+
+    // Tasks woken up on this Capability while spinning, and tasks that went
+    // to sleep, since the last GC; see Note [Spinning before parking].
+    StgWord spin_wakeups;
+    StgWord parks;
+
+    // Spare workers that took this Capability, rather than a new worker
+    // being started. Locks required: cap->lock.
+    StgWord worker_reuses;
+
     // This lock protects:
-    //    running_task
+    //    running_task (except that a free Capability may be claimed without
+    //        it, see claimCapability)
     //    returning_tasks_{hd,tl}
     //    wakeup_queue
-    //    inbox
     //    putMVars
     Mutex lock;
 
@@ -162,9 +255,14 @@ struct Capability_ {
     uint32_t n_returning_tasks;
 
     // Messages, or END_TSO_QUEUE.
-    // Locks required: cap->lock
+    // Lock-free: see Note [The capability inbox] in Messages.c
     Message *inbox;
 
+    // The number of messages this capability has sent to each capability,
+    // indexed by its number; grown as needed. Owned by this capability.
+    StgWord *messages_sent;
+    uint32_t messages_sent_size;
+
     // putMVars are really messages, but they're allocated with malloc() so they
     // can't go on the inbox queue: the GC would get confused.
     struct PutMVar_ *putMVars;
@@ -173,6 +271,36 @@ struct Capability_ {
 
     // Stats on spark creation/conversion
     SparkCounters spark_stats;
+
+    // State of the generator findSpark picks its first victim with; see
+    // Note [Spark stealing order] in Capability.c.
+    uint32_t steal_seed;
+
+    // Stacks of finished spark threads, and the label of the spark threads;
+    // see Note [Reusing spark thread stacks] in Sparks.c.
+    StgStack *spare_spark_stacks[MAX_SPARE_SPARK_STACKS];
+    uint32_t n_spare_spark_stacks;
+    StgArrBytes *spark_thread_label;
+
+    // Spark threads created, and how many of them reused a stack
+    StgWord spark_threads_created;
+    StgWord spark_threads_reused;
+
+    // How far from the top of the pool the sparks were all in generation
+    // spark_prune_gen or older at the last GC, and the work done pruning
+    // the pool; see Note [Incremental spark pruning] in Sparks.c.
+    StgInt spark_prune_mark;
+    uint32_t spark_prune_gen;
+    StgWord spark_prune_visited;
+    StgWord spark_prune_skipped;
+    Time spark_prune_time;
+
+    // Free slots of the stable pointer table owned by this capability, and
+    // whether it is writing to the table without holding stable_ptr_mutex;
+    // see Note [Per-capability stable pointer free lists] in StablePtr.c.
+    StgWord free_stable_ptrs[MAX_CAP_FREE_STABLE_PTRS];
+    uint32_t n_free_stable_ptrs;
+    StgWord stable_ptr_busy;
 #endif
 
     // I/O manager data structures for this capability
@@ -183,6 +311,53 @@ struct Capability_ {
     StgTRecChunk *free_trec_chunks;
     StgTRecHeader *free_trec_headers;
     uint32_t transaction_tokens;
+
+    // Entries of big TRecs by TVar: see Note [TRec index] in STM.c
+    struct StmIndex_ *stm_index;
+
+    // Contention: see Note [STM contention] in STM.c
+    StmConflict stm_conflicts[STM_CONFLICT_SLOTS];
+    uint32_t stm_aborts_in_a_row;
+    uint32_t stm_backoff_seed;
+
+    // Contention on blackholes: see Note [Blackhole contention] in
+    // BlackHoles.c
+    BlackHoleContention bh_contention[BH_CONTENTION_SLOTS];
+    StgWord bh_duplicates;
+    StgWord bh_blocks;
+
+    // Empty stack chunks of the -kc size, and the chunks threadStackOverflow
+    // allocated and reused; see Note [Reusing stack chunks] in Threads.c.
+    StgStack *spare_stack_chunks[MAX_SPARE_STACK_CHUNKS];
+    uint32_t n_spare_stack_chunks;
+    StgWord stack_chunks_allocated;
+    StgWord stack_chunks_reused;
+
+    // Pauses, the frames threadPaused walked, and the update frames
+    // squeezed out; see Note [Walking only the new frames] in ThreadPaused.c.
+    StgWord thread_pauses;
+    StgWord pause_frames_walked;
+    StgWord upd_frames_squeezed;
+
+    // CAFs entered; see Note [Counting CAFs] in sm/Storage.c.
+    StgWord cafs_entered;
+
+    // Stacks of finished threads, and the threads created and how many of
+    // them reused a stack; see Note [Reusing thread stacks] in Threads.c.
+    StgStack *spare_thread_stacks[MAX_SPARE_THREAD_STACKS];
+    uint32_t n_spare_thread_stacks;
+    StgWord threads_created;
+    StgWord thread_stacks_reused;
+
+    // Sampling of the scheduler and spark events: the events seen since the
+    // last one posted, whether the thread running now was sampled, and the
+    // events not posted since the last SAMPLED_EVENTS event; see
+    // Note [Sampling events] in Trace.c.
+    uint32_t sched_events_seen;
+    uint32_t spark_events_seen;
+    bool sched_run_sampled;
+    StgWord64 sched_events_suppressed;
+    StgWord64 spark_events_suppressed;
 } // typedef Capability is defined in RtsAPI.h
   ATTRIBUTE_ALIGNED(CAPABILITY_ALIGNMENT)
 ;
@@ -344,6 +519,11 @@ EXTERN_INLINE void recordClosureMutated (Capability *cap, StgClosure *p);
 //
 bool yieldCapability (Capability** pCap, Task *task, bool gcAllowed);
 
+// Waits for a worker or bound Task to be given a Capability; a worker must
+// be on the Capability's spare_workers queue.
+//
+Capability *waitForWorkerCapability (Task *task);
+
 // Wakes up a worker thread on just one Capability, used when we
 // need to service some global event.
 //
@@ -358,6 +538,11 @@ void prodAllCapabilities (void);
 //
 bool tryGrabCapability (Capability *cap, Task *task);
 
+// Pin the current worker Task to the CPUs of its Capability, if they have
+// changed since it last did. See Note [Capability affinity].
+//
+void applyCapabilityAffinity (Capability *cap, Task *task);
+
 // Try to find a spark to run
 //
 StgClosure *findSpark (Capability *cap);
@@ -386,6 +571,15 @@ void shutdownCapabilities(Task *task, bool wait_foreign);
 // cause all capabilities to context switch as soon as possible.
 void contextSwitchAllCapabilities(void);
 
+// Called by the timer at each context switch interval: context switch the
+// capabilities whose running thread has used up its time slice.
+void contextSwitchExpiredSlices(void);
+
+#if defined(THREADED_RTS)
+// Post and reset the parking counts of each capability
+void traceCapabilityParking(void);
+#endif
+
 // if immediately is set then the capability will context-switch at the next
 // heap-check.  Otherwise it will context switch at the next failing heap-check.
 INLINE_HEADER void contextSwitchCapability(Capability *cap, bool immediately);
@@ -422,15 +616,24 @@ extern uint32_t numa_map[MAX_NUMA_NODES];
    Messages
    -------------------------------------------------------------------------- */
 
+// The MVars given to hs_try_putmvar, or to hs_try_putmvar_batch for the
+// same capability, to fill when the capability next looks at its inbox.
 typedef struct PutMVar_ {
-    StgStablePtr mvar;
     struct PutMVar_ *link;
+    uint32_t n_mvars;
+    StgStablePtr mvars[];
 } PutMVar;
 
 #if defined(THREADED_RTS)
 
 INLINE_HEADER bool emptyInbox(Capability *cap);
 
+// Take a free Capability, returning false if it isn't free. Free
+// Capabilities may be claimed without cap->lock, so this must be used even
+// when holding the lock; see Note [Claiming a free capability] in
+// Capability.c.
+INLINE_HEADER bool claimCapability(Capability *cap, Task *task);
+
 #endif // THREADED_RTS
 
 /* -----------------------------------------------------------------------------
@@ -516,10 +719,18 @@ INLINE_HEADER bool emptyInbox(Capability *cap)
     // This may race with writes to putMVars but this harmless for the
     // intended uses of this function.
     TSAN_ANNOTATE_BENIGN_RACE(&cap->putMVars, "emptyInbox(cap->putMVars)");
-    return (RELAXED_LOAD(&cap->inbox) == (Message*)END_TSO_QUEUE &&
+    // SEQ_CST, because releaseCapability_ relies on it; see
+    // Note [The capability inbox] in Messages.c.
+    return (SEQ_CST_LOAD(&cap->inbox) == (Message*)END_TSO_QUEUE &&
             RELAXED_LOAD(&cap->putMVars) == NULL);
 }
 
+INLINE_HEADER bool claimCapability(Capability *cap, Task *task)
+{
+    return cas((StgVolatilePtr)&cap->running_task, (StgWord)NULL,
+               (StgWord)task) == (StgWord)NULL;
+}
+
 #endif
 
 #include "EndPrivate.h"
@@ -18,6 +18,7 @@
 #include "sm/Storage.h"
 #include "sm/GCThread.h"
 #include "sm/HeapUtils.h"
+#include "GetTime.h"
 
 //
 // Note [Object unloading]
@@ -49,6 +50,17 @@
 // - After a major GC `checkUnload` unloads objects that are (1) explicitly
 //   asked for unloading (via `unloadObj`) and (2) are not marked during GC.
 //
+// - When no object is waiting to be unloaded (`n_unloaded_objects` is 0) there
+//   is nothing for `checkUnload` to do, so `prepareUnloadCheck` tells the GC
+//   not to mark object code at all. A long-running GHCi session or plugin host
+//   with many objects loaded otherwise pays for a binary search for every
+//   static object evacuated by every major GC.
+//
+// - Marking is done by all of the GC threads at once. `markObjectLive` only
+//   sets the mark bit of an object (with an atomic exchange, so that one
+//   thread goes on to mark its dependencies), without taking a lock;
+//   `checkUnload` then sorts `old_objects` into the marked and the unmarked.
+//
 // Note that, crucially, we don't unload an object code even if it's not
 // reachable from the heap, unless it's explicitly asked for unloading (via
 // `unloadObj`). This is a feature and not a bug! Two use cases:
@@ -66,9 +78,9 @@
 // unloading.
 //
 // Two other lists `objects` and `old_objects` are similar to large object lists
-// in GC. Before a major GC we move `objects` to `old_objects`, and move marked
-// objects back to `objects` during evacuation and when marking roots in
-// `checkUnload`. Any objects in `old_objects` after that is unloaded.
+// in GC. Before a major GC we move `objects` to `old_objects`, and after marking
+// the roots `checkUnload` moves marked objects back to `objects`. Any other
+// objects in `old_objects` are unloaded.
 //
 // TODO: We currently don't unload objects when non-moving GC is enabled. The
 // implementation would be similar to `nonmovingGcCafs`:
@@ -128,11 +140,10 @@ typedef struct {
 } OCSectionIndices;
 
 // List of currently live objects. Moved to `old_objects` before unload check.
-// Marked objects moved back to this list in `markObjectLive`. Remaining objects
-// are freed at the end of `checkUnload`.
+// Marked objects moved back to this list in `checkUnload`, which frees the
+// remaining objects.
 //
-// Double-linked list to be able to remove marked objects. List formed with
-// `next` and `prev` fields of `ObjectCode`.
+// Double-linked list, formed with `next` and `prev` fields of `ObjectCode`.
 //
 // Not static: used in Linker.c.
 ObjectCode *objects = NULL;
@@ -141,6 +152,11 @@ ObjectCode *objects = NULL;
 // back to `objects`. Remaining objects are freed.
 static ObjectCode *old_objects = NULL;
 
+// Whether prepareUnloadCheck started a check that checkUnload is to finish
+static bool unload_check_started = false;
+
+static UnloadCheckStats unload_check_stats;
+
 // Number of objects that we want to unload. When this value is 0 we skip static
 // object marking during GC and `checkUnload`.
 //
@@ -249,7 +265,7 @@ static void reserveOCSectionIndices(OCSectionIndices *s_indices, int len)
 
 // Insert object section indices of a single ObjectCode. Invalidates 'sorted'
 // state.
-void insertOCSectionIndices(ObjectCode *oc)
+void addOCSectionIndices(ObjectCode *oc)
 {
     // after we finish the section table will no longer be sorted.
     global_s_indices->sorted = false;
@@ -290,6 +306,13 @@ void insertOCSectionIndices(ObjectCode *oc)
 
         global_s_indices->n_sections = s_i;
     }
+}
+
+// Insert object section indices of a single ObjectCode, and add it to the
+// 'objects' list.
+void insertOCSectionIndices(ObjectCode *oc)
+{
+    addOCSectionIndices(oc);
 
     // Add object to 'objects' list
     if (objects != NULL) {
@@ -395,36 +418,13 @@ static ObjectCode *findOC(OCSectionIndices *s_indices, const void *addr) {
 static bool markObjectLive(void *data STG_UNUSED, StgWord key, const void *value STG_UNUSED) {
     ObjectCode *oc = (ObjectCode*)key;
 
-    // N.B. we may be called by the parallel GC and therefore this must be
-    // thread-safe. To avoid taking the linker_mutex in the fast path
-    // (when the object is already marked) we do an atomic exchange here and
-    // only take the lock in the case that the object is unmarked.
+    // N.B. we may be called by several GC threads at once. Whichever sets the
+    // mark bit marks the dependencies; checkUnload moves the object back to
+    // `objects`. See Note [Object unloading].
     if (xchg(&oc->mark, object_code_mark_bit) == object_code_mark_bit) {
         return true; // for hash table iteration
     }
 
-    ACQUIRE_LOCK(&linker_mutex);
-    // Remove from 'old_objects' list
-    if (oc->prev != NULL) {
-        // TODO(osa): Maybe 'prev' should be a pointer to the referencing
-        // *field* ? (instead of referencing *object*)
-        oc->prev->next = oc->next;
-    } else {
-        old_objects = oc->next;
-    }
-    if (oc->next != NULL) {
-        oc->next->prev = oc->prev;
-    }
-
-    // Add it to 'objects' list
-    oc->prev = NULL;
-    oc->next = objects;
-    if (objects != NULL) {
-        objects->prev = oc;
-    }
-    objects = oc;
-    RELEASE_LOCK(&linker_mutex);
-
     // Mark its dependencies
     iterHashTable(oc->dependencies, NULL, markObjectLive);
 
@@ -441,7 +441,9 @@ void markObjectCode(const void *addr)
     ASSERT(!HEAP_ALLOCED(addr));
 
     ObjectCode *oc = findOC(global_s_indices, addr);
-    if (oc != NULL) {
+    // Most static objects belong to an object that is marked already; don't
+    // contend for its cache line with the other GC threads
+    if (oc != NULL && RELAXED_LOAD(&oc->mark) != object_code_mark_bit) {
         // Mark the object code and its dependencies
         markObjectLive(NULL, (W_)oc, NULL);
     }
@@ -455,6 +457,16 @@ bool prepareUnloadCheck(void)
         return false;
     }
 
+    // Nothing to unload, see Note [Object unloading]. unloadObj may add
+    // to n_unloaded_objects while we GC; the object waits for the next major
+    // GC.
+    if (RELAXED_LOAD(&n_unloaded_objects) == 0) {
+        unload_check_stats.skipped++;
+        return false;
+    }
+
+    Time start = getProcessElapsedTime();
+
     removeRemovedOCSections(global_s_indices);
     sortOCSectionIndices(global_s_indices);
 
@@ -463,9 +475,27 @@ bool prepareUnloadCheck(void)
     object_code_mark_bit = ~object_code_mark_bit;
     old_objects = objects;
     objects = NULL;
+    unload_check_started = true;
+
+    unload_check_stats.checks++;
+    unload_check_stats.time += getProcessElapsedTime() - start;
     return true;
 }
 
+// Move an object from `old_objects` back to `objects`. A thread in a safe
+// foreign call may be loading objects as we do so.
+static void keepObject(ObjectCode *oc)
+{
+    ACQUIRE_LOCK(&linker_mutex);
+    oc->prev = NULL;
+    oc->next = objects;
+    if (objects != NULL) {
+        objects->prev = oc;
+    }
+    objects = oc;
+    RELEASE_LOCK(&linker_mutex);
+}
+
 void checkUnload(void)
 {
     // At this point we've marked all dynamically loaded static objects
@@ -473,7 +503,8 @@ void checkUnload(void)
     // code (loaded_objects). Mark the roots first, then unload any unmarked
     // objects.
 
-    if (tryToUnload()) {
+    if (unload_check_started) {
+        Time start = getProcessElapsedTime();
         OCSectionIndices *s_indices = global_s_indices;
         ASSERT(s_indices->sorted);
 
@@ -482,10 +513,15 @@ void checkUnload(void)
             markObjectLive(NULL, (W_)oc, NULL);
         }
 
-        // Free unmarked objects
+        // Move marked objects back to `objects`, free unmarked objects
         ObjectCode *next = NULL;
         for (ObjectCode *oc = old_objects; oc != NULL; oc = next) {
             next = oc->next;
+            if (oc->mark == object_code_mark_bit) {
+                keepObject(oc);
+                continue;
+            }
+
             ASSERT(oc->status == OBJECT_UNLOADED);
 
             // Symbols should be removed by unloadObj_.
@@ -499,15 +535,23 @@ void checkUnload(void)
                 removeOCSectionIndices(s_indices, oc);
                 freeObjectCode(oc);
                 n_unloaded_objects -= 1;
+                unload_check_stats.unloaded++;
             } else {
                 // If we don't have enough information to
                 // accurately determine the reachability of
                 // the object then hold onto it.
-                oc->next = objects;
-                objects = oc;
+                keepObject(oc);
             }
         }
+
+        unload_check_started = false;
+        unload_check_stats.time += getProcessElapsedTime() - start;
     }
 
     old_objects = NULL;
 }
+
+void getUnloadCheckStats(UnloadCheckStats *stats)
+{
+    *stats = unload_check_stats;
+}
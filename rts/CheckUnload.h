@@ -39,7 +39,21 @@ void markObjectCode(const void *addr);
 // Call after major GC to unload unused and unmarked object code
 void checkUnload(void);
 
+// Totals over the run, reported by +RTS -s
+typedef struct {
+    StgWord checks;    // major GCs that checked for code to unload
+    StgWord skipped;   // ... that didn't, as no object was to be unloaded
+    StgWord unloaded;  // objects freed
+    Time time;         // in prepareUnloadCheck and checkUnload
+} UnloadCheckStats;
+
+void getUnloadCheckStats(UnloadCheckStats *stats);
+
 // Call on loaded object code
 void insertOCSectionIndices(ObjectCode *oc);
 
+// Call when an object already in 'objects' gets its sections, i.e. when a
+// lazy archive member is loaded
+void addOCSectionIndices(ObjectCode *oc);
+
 #include "EndPrivate.h"
@@ -30,6 +30,7 @@ static StgWord getStackFrameCount(StgStack* stack);
 static StgWord getStackChunkClosureCount(StgStack* stack);
 static StgArrBytes* allocateByteArray(Capability *cap, StgWord bytes);
 static void copyPtrsToArray(StgArrBytes* arr, StgStack* stack);
+static StgWord copyReturnFrames(StgStack* stack, const StgInfoTable **result, StgWord max_frames);
 
 static StgStack* cloneStackChunk(Capability* capability, const StgStack* stack)
 {
@@ -74,33 +75,59 @@ StgStack* cloneStack(Capability* capability, const StgStack* stack)
   return top_stack;
 }
 
+// Puts the result of a clone or snapshot, lifted by applying the given
+// constructor, into the MVar that the requesting thread will take it from.
+static void putStackResult(Capability *cap, StgMVar *mvar,
+                           StgClosure *constructor, StgClosure *value)
+{
+  // Lift StackSnapshot# to StackSnapshot (or ByteArray# to StackFrames) by
+  // applying it's constructor. This is necessary because performTryPutMVar()
+  // puts the closure onto the stack for evaluation and stacks can not be
+  // evaluated (entered).
+  HaskellObj result = rts_apply(cap, constructor, (HaskellObj) value);
+
+  bool putMVarWasSuccessful = performTryPutMVar(cap, mvar, result);
+
+  if(!putMVarWasSuccessful) {
+    barf("Can't put stack cloning result into MVar.");
+  }
+}
+
 #if defined(THREADED_RTS)
 
-// ThreadId# in Haskell is a StgTSO* in RTS.
-void sendCloneStackMessage(StgTSO *tso, HsStablePtr mvar) {
+static void sendStackMessage(StgTSO *tso, HsStablePtr mvar, bool snapshot,
+                             StgWord max_frames) {
   Capability *srcCapability = rts_unsafeGetMyCapability();
 
   MessageCloneStack *msg;
   msg = (MessageCloneStack *)allocate(srcCapability, sizeofW(MessageCloneStack));
   msg->tso = tso;
   msg->result = (StgMVar*)deRefStablePtr(mvar);
+  msg->snapshot = snapshot;
+  msg->max_frames = max_frames;
   SET_HDR_RELEASE(msg, &stg_MSG_CLONE_STACK_info, CCS_SYSTEM);
 
   sendMessage(srcCapability, tso->cap, (Message *)msg);
 }
 
-void handleCloneStackMessage(MessageCloneStack *msg){
-  StgStack* newStackClosure = cloneStack(msg->tso->cap, msg->tso->stackobj);
-
-  // Lift StackSnapshot# to StackSnapshot by applying it's constructor.
-  // This is necessary because performTryPutMVar() puts the closure onto the
-  // stack for evaluation and stacks can not be evaluated (entered).
-  HaskellObj result = rts_apply(msg->tso->cap, StackSnapshot_constructor_closure, (HaskellObj) newStackClosure);
+// ThreadId# in Haskell is a StgTSO* in RTS.
+void sendCloneStackMessage(StgTSO *tso, HsStablePtr mvar) {
+  sendStackMessage(tso, mvar, false, 0);
+}
 
-  bool putMVarWasSuccessful = performTryPutMVar(msg->tso->cap, msg->result, result);
+void sendSnapshotStackMessage(StgTSO *tso, HsStablePtr mvar, StgWord max_frames) {
+  sendStackMessage(tso, mvar, true, max_frames);
+}
 
-  if(!putMVarWasSuccessful) {
-    barf("Can't put stack cloning result into MVar.");
+void handleCloneStackMessage(MessageCloneStack *msg){
+  Capability *cap = msg->tso->cap;
+
+  if (msg->snapshot) {
+    StgArrBytes* frames = snapshotStackFrames(cap, msg->tso->stackobj, msg->max_frames);
+    putStackResult(cap, msg->result, StackFrames_constructor_closure, (StgClosure *) frames);
+  } else {
+    StgStack* newStackClosure = cloneStack(cap, msg->tso->stackobj);
+    putStackResult(cap, msg->result, StackSnapshot_constructor_closure, (StgClosure *) newStackClosure);
   }
 }
 
@@ -111,8 +138,31 @@ void sendCloneStackMessage(StgTSO *tso STG_UNUSED, HsStablePtr mvar STG_UNUSED)
   barf("Sending CloneStackMessages is only available in threaded RTS!");
 }
 
+// With a single capability the other thread isn't running while we are, so
+// its stack can be walked right away. The caller snapshots its own stack with
+// snapshotMyStack# instead, as its stack pointer hasn't been saved.
+void sendSnapshotStackMessage(StgTSO *tso, HsStablePtr mvar, StgWord max_frames) {
+  Capability *cap = rts_unsafeGetMyCapability();
+  StgArrBytes* frames = snapshotStackFrames(cap, tso->stackobj, max_frames);
+  putStackResult(cap, (StgMVar*)deRefStablePtr(mvar), StackFrames_constructor_closure, (StgClosure *) frames);
+}
+
 #endif // end !defined(THREADED_RTS)
 
+// Creates a ByteArray# with the info table pointers of the first max_frames
+// return frames on the given stack, top of the stack first, walking the live
+// stack in place rather than cloning it first.
+// See Note [Stack Frame Snapshots] in GHC.Internal.Stack.CloneStack.
+StgArrBytes* snapshotStackFrames(Capability *cap, StgStack* stack, StgWord max_frames) {
+  StgWord frameCount = copyReturnFrames(stack, NULL, max_frames);
+
+  StgArrBytes* array = allocateByteArray(cap, sizeof(StgInfoTable*) * frameCount);
+
+  copyReturnFrames(stack, (const StgInfoTable **) array->payload, frameCount);
+
+  return array;
+}
+
 // Creates a MutableArray# (Haskell representation) that contains a
 // InfoProvEnt* for every stack frame on the given stack. Thus, the size of the
 // array is the count of stack frames.
@@ -203,3 +253,48 @@ static void copyPtrsToArray(StgArrBytes* arr, StgStack* stack) {
     }
   }
 }
+
+// Whether the frame was pushed by a case continuation of compiled code, as
+// opposed to the update, catch, underflow, ... frames of the RTS. Only the
+// former can have an IPE.
+static bool isReturnFrame(StgClosure *frame) {
+  switch (get_ret_itbl(frame)->i.type) {
+  case RET_SMALL:
+  case RET_BIG:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Writes the info table pointers of the first max_frames return frames on the
+// stack to result, if it isn't NULL, and returns how many there were.
+static StgWord copyReturnFrames(StgStack* stack, const StgInfoTable **result, StgWord max_frames) {
+  StgWord index = 0;
+  StgStack *last_stack = stack;
+  while (index < max_frames) {
+    StgPtr sp = last_stack->sp;
+    StgPtr spBottom = last_stack->stack + last_stack->stack_size;
+    for (; sp < spBottom && index < max_frames; sp += stack_frame_sizeW((StgClosure *)sp)) {
+      if (isReturnFrame((StgClosure *)sp)) {
+        if (result != NULL) {
+          result[index] = ((StgClosure *)sp)->header.info;
+        }
+        index++;
+      }
+    }
+
+    // check whether the stack ends in an underflow frame
+    StgUnderflowFrame *frame = (StgUnderflowFrame *) (last_stack->stack
+      + last_stack->stack_size - sizeofW(StgUnderflowFrame));
+    if (frame->info == &stg_stack_underflow_frame_d_info
+      ||frame->info == &stg_stack_underflow_frame_v16_info
+      ||frame->info == &stg_stack_underflow_frame_v32_info
+      ||frame->info == &stg_stack_underflow_frame_v64_info) {
+      last_stack = frame->next_chunk;
+    } else {
+      break;
+    }
+  }
+  return index;
+}
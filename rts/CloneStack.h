@@ -11,12 +11,19 @@
 extern StgClosure DLL_IMPORT_DATA_VARNAME(ghczminternal_GHCziInternalziStackziCloneStack_StackSnapshot_closure);
 #define StackSnapshot_constructor_closure DLL_IMPORT_DATA_REF(ghczminternal_GHCziInternalziStackziCloneStack_StackSnapshot_closure)
 
+extern StgClosure DLL_IMPORT_DATA_VARNAME(ghczminternal_GHCziInternalziStackziCloneStack_StackFrames_closure);
+#define StackFrames_constructor_closure DLL_IMPORT_DATA_REF(ghczminternal_GHCziInternalziStackziCloneStack_StackFrames_closure)
+
 StgStack* cloneStack(Capability* capability, const StgStack* stack);
 
 void sendCloneStackMessage(StgTSO *tso, HsStablePtr mvar);
 
 StgArrBytes* decodeClonedStack(Capability *cap, StgStack* stack);
 
+StgArrBytes* snapshotStackFrames(Capability *cap, StgStack* stack, StgWord max_frames);
+
+void sendSnapshotStackMessage(StgTSO *tso, HsStablePtr mvar, StgWord max_frames);
+
 #include "BeginPrivate.h"
 
 #if defined(THREADED_RTS)
@@ -53,7 +53,8 @@ of stack frames stored in the closure are pushed onto the current stack, and
 execution resumes by applying the argument to the continuation to a RealWorld
 token. This is a non-destructive operation---the caller is free to apply the
 continuation arbitrarily many times. This process is handled in Cmm, via
-`stg_CONTINUATION_apply` in ContinuationOps.cmm.
+`stg_CONTINUATION_apply` in ContinuationOps.cmm, or in C, via
+`restoreContinuation`, when the frames don't fit on the current stack chunk.
 
 For the most part, capture and restoration of continuations is surprisingly
 straightforward: the bulk of the work on each side of the process is just doing
@@ -67,6 +68,9 @@ the necessary copying. However, there are a few additional subtleties:
     properly updated across continuation captures and restores, see
     Note [Continuations and async exception masking] for details.
 
+  * Large continuations are restored over several stack chunks, see
+    Note [Restoring large continuations].
+
 Note [When capturing the continuation fails]
 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 How can continuation capture fail? There are three possible scenarios:
@@ -346,6 +350,45 @@ of checking eagerly for a pending async exception and raising it if one is
 available. So we do some tricky trampolining, and that frees us from having to
 worry about that in the continuation capture/restore logic as well. */
 
+/* Note [Restoring large continuations]
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+A continuation captured from a deep stack can hold many stack chunks' worth of
+frames. `stg_CONTINUATION_apply` used to restore it the only way Cmm can: with
+a stack check for the whole continuation. That check fails, and the thread goes
+back to the scheduler for threadStackOverflow, which grows the stack by one
+chunk at a time (doubling the chunk size only when the previous one was mostly
+empty), so a big continuation took several trips through the scheduler and
+ended up in one chunk of its own size, which is never reused.
+
+So when the frames don't fit on the current chunk, `stg_CONTINUATION_apply`
+calls `restoreContinuation` instead, which lays them out directly over new
+chunks of the usual -kc size, taken from the capability's spare chunks where it
+can (see Note [Reusing stack chunks] in Threads.c), linked by underflow frames
+just as threadStackOverflow would have linked them. The bottom of the
+continuation goes on the chunk the thread was running on if it fits there, and
+the top chunk keeps -kb words free for the thread to carry on with. It also
+fixes up the mask frame, which may now be on any of the chunks. If the frames
+would take the thread past its -K limit, it does nothing, and the stack check
+raises StackOverflow as before.
+
+It would be nicer still if capture and restore did not copy the frames at
+all, and simply moved whole chunks between the thread and the continuation.
+That doesn't work here:
+
+  * Continuations are multi-shot, and the thread writes to the stack it runs
+    on, so every restore needs its own copy of the frames. A restore could
+    copy lazily, a chunk at a time as the thread returns into it, but the
+    frames of a continuation don't know where the thread was when it was
+    restored, so the last chunk would not know where to return to.
+
+  * On capture, the chunks we pop are put back on the capability's spare
+    chunks by threadStackUnderflow, and other chunks move frames up from the
+    chunk below (threadStackUnderflowReturn), so they are not ours to keep.
+
+So capture and restore each copy the frames once, as before; what this saves
+is the stack checks, the scheduler round trips and the odd-sized chunks.
+*/
+
 static bool is_mask_frame_info(const StgInfoTable *info)
 {
   return info == &stg_unmaskAsyncExceptionszh_ret_info
@@ -353,6 +396,18 @@ static bool is_mask_frame_info(const StgInfoTable *info)
       || info == &stg_maskUninterruptiblezh_ret_info;
 }
 
+// The mask frame that puts the masking state back to what it is now.
+static const StgInfoTable *current_mask_frame_info(StgTSO *tso)
+{
+  if ((tso->flags & TSO_BLOCKEX) == 0) {
+    return &stg_unmaskAsyncExceptionszh_ret_info;
+  } else if ((tso->flags & TSO_INTERRUPTIBLE) == 0) {
+    return &stg_maskUninterruptiblezh_ret_info;
+  } else {
+    return &stg_maskAsyncExceptionszh_ret_info;
+  }
+}
+
 static StgStack *pop_stack_chunk(Capability *cap, StgTSO *tso)
 {
   StgStack *stack = tso->stackobj;
@@ -447,13 +502,7 @@ StgClosure *captureContinuationAndAbort(Capability *cap, StgTSO *tso, StgPromptT
     if (is_mask_frame_info(info_ptr)) {
       mask_frame_offset = total_words + chunk_words;
       if (apply_mask_frame == NULL) {
-        if ((tso->flags & TSO_BLOCKEX) == 0) {
-          apply_mask_frame = &stg_unmaskAsyncExceptionszh_ret_info;
-        } else if ((tso->flags & TSO_INTERRUPTIBLE) == 0) {
-          apply_mask_frame = &stg_maskUninterruptiblezh_ret_info;
-        } else {
-          apply_mask_frame = &stg_maskAsyncExceptionszh_ret_info;
-        }
+        apply_mask_frame = current_mask_frame_info(tso);
       }
     }
 
@@ -507,3 +556,109 @@ StgClosure *captureContinuationAndAbort(Capability *cap, StgTSO *tso, StgPromptT
 
   return TAG_CLOSURE(2, (StgClosure *)cont);
 }
+
+// see Note [Restoring large continuations]
+bool restoreContinuation(Capability *cap, StgTSO *tso, StgContinuation *cont)
+{
+  ASSERT(tso->cap == cap);
+
+  StgStack *stack = tso->stackobj;
+  const StgWord total_words = cont->stack_size;
+  const StgPtr cont_end = cont->stack + total_words;
+
+  // Leave it to the stack check to raise StackOverflow.
+  if (RtsFlags.GcFlags.maxStkSize > 0
+      && tso->tot_stack_size + total_words > RtsFlags.GcFlags.maxStkSize) {
+    return false;
+  }
+
+  IF_DEBUG(continuation,
+    debugBelch("restoreContinuation: restoring %" FMT_Word
+               " words of stack in chunks\n", total_words));
+
+  const W_ chunk_words = RtsFlags.GcFlags.stkChunkSize - sizeofW(StgStack)
+                         - sizeofW(StgUnderflowFrame);
+  // Leave the thread -kb words to run in at the top, as
+  // threadStackOverflow would.
+  W_ room = chunk_words > 2 * RtsFlags.GcFlags.stkChunkBufferSize
+            ? chunk_words - RtsFlags.GcFlags.stkChunkBufferSize
+            : chunk_words;
+
+  StgStack *top = NULL, *above = NULL;
+  StgPtr mask_frame = NULL;
+  StgPtr p = cont->stack;
+
+  dirty_STACK(cap, stack);
+
+  while (true) {
+    // Whatever is left goes on the chunk we were running on, if it fits.
+    if (cont_end - p <= stack->sp - stack_SpLim(stack)) {
+      break;
+    }
+
+    // Otherwise, take as many whole frames as fit in a new chunk. A frame
+    // bigger than a chunk gets a chunk of its own.
+    StgPtr seg = p;
+    while (p < cont_end) {
+      W_ size = stack_frame_sizeW((StgClosure *)p);
+      if (p > seg && (W_)(p + size - seg) > room) {
+        break;
+      }
+      p += size;
+    }
+    W_ seg_words = p - seg;
+
+    StgStack *chunk = newStackChunk(cap, tso,
+      stg_max(RtsFlags.GcFlags.stkChunkSize,
+              sizeofW(StgStack) + sizeofW(StgUnderflowFrame) + seg_words));
+    dirty_STACK(cap, chunk);
+    // The chunk below doesn't exist yet; we fill in next_chunk when it
+    // does. Nothing can GC in between.
+    pushUnderflowFrame(chunk, NULL);
+    chunk->sp -= seg_words;
+    memcpy(chunk->sp, seg, seg_words * sizeof(StgWord));
+
+    if (cont->apply_mask_frame != NULL
+        && cont->mask_frame_offset >= (StgWord)(seg - cont->stack)
+        && cont->mask_frame_offset < (StgWord)(p - cont->stack)) {
+      mask_frame = chunk->sp + (cont->mask_frame_offset - (seg - cont->stack));
+    }
+
+    if (above == NULL) {
+      top = chunk;
+    } else {
+      ((StgUnderflowFrame *)(above->stack + above->stack_size
+                             - sizeofW(StgUnderflowFrame)))->next_chunk = chunk;
+    }
+    above = chunk;
+    room = chunk_words;
+
+    if (p == cont_end) {
+      break;
+    }
+  }
+
+  // The bottom of the continuation, on the chunk we were running on.
+  W_ rest_words = cont_end - p;
+  stack->sp -= rest_words;
+  memcpy(stack->sp, p, rest_words * sizeof(StgWord));
+  if (cont->apply_mask_frame != NULL
+      && cont->mask_frame_offset >= (StgWord)(p - cont->stack)) {
+    mask_frame = stack->sp + (cont->mask_frame_offset - (p - cont->stack));
+  }
+
+  if (above != NULL) {
+    ((StgUnderflowFrame *)(above->stack + above->stack_size
+                           - sizeofW(StgUnderflowFrame)))->next_chunk = stack;
+    tso->stackobj = top;
+  }
+
+  // see Note [Continuations and async exception masking]
+  if (mask_frame != NULL) {
+    ((StgClosure *)mask_frame)->header.info = current_mask_frame_info(tso);
+  }
+
+  IF_DEBUG(sanity, checkTSO(tso));
+
+  return true;
+}
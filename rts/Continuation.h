@@ -11,5 +11,6 @@
 #include "BeginPrivate.h"
 
 StgClosure *captureContinuationAndAbort(Capability *cap, StgTSO *tso, StgPromptTag prompt_tag);
+bool restoreContinuation(Capability *cap, StgTSO *tso, StgContinuation *cont);
 
 #include "EndPrivate.h"
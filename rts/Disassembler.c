@@ -91,6 +91,12 @@ disInstr ( StgBCO *bco, int pc )
          debugBelch("STKCHECK %" FMT_Word "\n", (W_)stk_words_reqd );
          break;
      }
+      case bci_HEAPCHECK: {
+         W_ n_closures = BCO_GET_LARGE_ARG;
+         W_ n_payload  = BCO_GET_LARGE_ARG;
+         debugBelch("HEAPCHECK %" FMT_Word " closures, %" FMT_Word " words\n",
+                    n_closures, n_payload );
+         break; }
       case bci_PUSH_L: {
          W_ x1 = BCO_GET_LARGE_ARG;
          debugBelch("PUSH_L   %" FMT_Word "\n", x1 );
@@ -429,6 +435,28 @@ disInstr ( StgBCO *bco, int pc )
       case bci_ENTER:
          debugBelch("ENTER\n");
          break;
+      case bci_PUSH_L_ENTER: {
+         W_ x1 = BCO_GET_LARGE_ARG;
+         W_ ic = BCO_GET_LARGE_ARG;
+         debugBelch("PUSH_L_ENTER %" FMT_Word ", cache %p\n",
+                    x1, (void *) literals[ic] );
+         break; }
+      case bci_SLIDE_ENTER: {
+         W_ nwords = BCO_GET_LARGE_ARG;
+         W_ by     = BCO_GET_LARGE_ARG;
+         W_ ic     = BCO_GET_LARGE_ARG;
+         debugBelch("SLIDE_ENTER %" FMT_Word " down by %" FMT_Word
+                    ", cache %p\n", nwords, by, (void *) literals[ic] );
+         break; }
+      case bci_PUSH_L_SLIDE_ENTER: {
+         W_ x1     = BCO_GET_LARGE_ARG;
+         W_ nwords = BCO_GET_LARGE_ARG;
+         W_ by     = BCO_GET_LARGE_ARG;
+         W_ ic     = BCO_GET_LARGE_ARG;
+         debugBelch("PUSH_L_SLIDE_ENTER %" FMT_Word ", %" FMT_Word
+                    " down by %" FMT_Word ", cache %p\n",
+                    x1, nwords, by, (void *) literals[ic] );
+         break; }
 
       case bci_RETURN_P:
          debugBelch("RETURN_P\n" );
@@ -27,8 +27,11 @@ typedef struct {
 // Lock objects containing the number of active readers or writers.  The
 // second maps file descriptors or file handles to lock objects, so that we can
 // unlock by FD or HANDLE without needing to fstat() again.
-static HashTable *obj_hash;
-static HashTable *key_hash;
+//
+// Most programs never lock a file, so the tables are only allocated, under
+// file_lock_mutex, when the first file is locked.
+static HashTable *obj_hash = NULL;
+static HashTable *key_hash = NULL;
 
 #if defined(THREADED_RTS)
 static Mutex file_lock_mutex;
@@ -52,8 +55,6 @@ STATIC_INLINE int hashLock(const HashTable *table, StgWord w)
 void
 initFileLocking(void)
 {
-    obj_hash = allocHashTable();
-    key_hash  = allocHashTable(); /* ordinary word-based table */
 #if defined(THREADED_RTS)
     initMutex(&file_lock_mutex);
 #endif
@@ -68,8 +69,12 @@ freeLock(void *lock)
 void
 freeFileLocking(void)
 {
-    freeHashTable(obj_hash, freeLock);
-    freeHashTable(key_hash,  NULL);
+    if (obj_hash != NULL) {
+        freeHashTable(obj_hash, freeLock);
+        freeHashTable(key_hash,  NULL);
+        obj_hash = NULL;
+        key_hash = NULL;
+    }
 #if defined(THREADED_RTS)
     closeMutex(&file_lock_mutex);
 #endif
@@ -82,6 +87,11 @@ lockFile(StgWord64 id, StgWord64 dev, StgWord64 ino, int for_writing)
 
     ACQUIRE_LOCK(&file_lock_mutex);
 
+    if (obj_hash == NULL) {
+        obj_hash = allocHashTable();
+        key_hash  = allocHashTable(); /* ordinary word-based table */
+    }
+
     key.device = dev;
     key.inode  = ino;
 
@@ -119,7 +129,7 @@ unlockFile(StgWord64 id)
 
     ACQUIRE_LOCK(&file_lock_mutex);
 
-    lock = lookupHashTable(key_hash, id);
+    lock = key_hash == NULL ? NULL : lookupHashTable(key_hash, id);
     if (lock == NULL) {
         // errorBelch("unlockFile: key %d not found", key);
         // This is normal: we didn't know when calling unlockFile
@@ -11,6 +11,7 @@
 #include "BeginPrivate.h"
 
 void initializeTimer       (void);
+void initTscClock          (void);  // See Note [The TSC clock]
 
 Time getProcessCPUTime     (void);
 Time getCurrentThreadCPUTime (void);
@@ -6,6 +6,9 @@
  * Dynamically expanding linear hash tables, as described in
  * Per-\AAke Larson, ``Dynamic Hash Tables,'' CACM 31(4), April 1988,
  * pp. 446 -- 457.
+ *
+ * Tables made by allocOpenHashTable use open addressing instead, see
+ * Note [Open-addressed hash tables].
  * -------------------------------------------------------------------------- */
 
 #include "rts/PosixSource.h"
@@ -13,6 +16,7 @@
 
 #include "Hash.h"
 #include "RtsUtils.h"
+#include "Arena.h"
 
 /* This file needs to be compiled with vectorization enabled.  Unfortunately
    since we compile these things these days with cabal we can no longer
@@ -32,6 +36,12 @@
 
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define HSEGSIZE    1024    /* Size of a single hash table segment */
                             /* Also the minimum size of a hash table */
 #define HDIRSIZE    1024    /* Size of the segment directory */
@@ -39,6 +49,8 @@
 #define HLOAD       5       /* Maximum average load of a single hash bucket */
 
 #define HCHUNK      (1024 * sizeof(W_) / sizeof(HashList))
+/* Smaller chunks in an arena, so that they don't waste the arena's blocks */
+#define HCHUNK_ARENA (128 * sizeof(W_) / sizeof(HashList))
                             /* Number of HashList cells to allocate in one go */
 
 
@@ -53,18 +65,56 @@ typedef struct chunklist {
   struct chunklist *next;
 } HashListChunk;
 
+/* A slot of an open-addressed table */
+typedef struct {
+    StgWord key;
+    const void *data;
+} HashSlot;
+
 struct hashtable {
+    int kcount;             /* Number of keys */
+
+    /* Open-addressed tables, see Note [Open-addressed hash tables] */
+    bool open;
+    uint8_t *ctrl;          /* control bytes, capacity + HGROUP of them */
+    HashSlot *slots;        /* capacity of them */
+    StgWord capacity;       /* a power of 2, at least HGROUP */
+    StgWord growth_left;    /* empty slots we may fill before growing */
+
+    /* Linear hash tables */
     int split;              /* Next bucket to split when expanding */
     int max;                /* Max bucket of smaller table */
     int mask1;              /* Mask for doing the mod of h_1 (smaller table) */
     int mask2;              /* Mask for doing the mod of h_2 (larger table) */
-    int kcount;             /* Number of keys */
     int bcount;             /* Number of buckets */
     HashList **dir[HDIRSIZE];   /* Directory of segments */
     HashList *freeList;         /* free list of HashLists */
     HashListChunk *chunks;      /* list of HashListChunks so we can later free them */
+    Arena *arena;               /* if not NULL, HashLists come from here instead */
 };
 
+/* The bytes held by all hash tables, for getRTSMemoryUsage.  Tables are
+ * used from many threads at once, so this is updated atomically. */
+static StgWord hash_table_bytes = 0;
+
+STATIC_INLINE void
+countHashBytes(size_t n)
+{
+    RELAXED_ADD(&hash_table_bytes, (StgWord) n);
+}
+
+STATIC_INLINE void
+uncountHashBytes(size_t n)
+{
+    RELAXED_ADD(&hash_table_bytes, -(StgWord) n);
+}
+
+StgWord
+getHashTableBytes(void)
+{
+    return RELAXED_LOAD(&hash_table_bytes);
+}
+
 /* Create an identical structure, but is distinct on a type level,
  * for string hash table. Since it's a direct embedding of
  * a hashtable and not a reference, there shouldn't be
@@ -80,6 +130,15 @@ hashWord(const HashTable *table, StgWord key)
 {
     int bucket;
 
+    if (table->open) {
+        /* Fibonacci hashing; the high bits are the well-mixed ones */
+#if WORD_SIZE_IN_BITS == 64
+        return (int)((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+#else
+        return (int)(key * UINT32_C(0x9E3779B9));
+#endif
+    }
+
     /* Strip the boring zero bits */
     key >>= sizeof(StgWord);
 
@@ -97,11 +156,25 @@ int
 hashStr(const HashTable *table, StgWord w)
 {
     const char *key = (char*) w;
+    return hashBuffer(table, key, strlen(key), 1048583);
+}
+
+int
+hashBuffer(const HashTable *table, const void *buf, size_t len, StgWord seed)
+{
+#if WORD_SIZE_IN_BITS == 64
+    StgWord h = XXH3_64bits_withSeed (buf, len, seed);
+#else
+    StgWord h = XXH32 (buf, len, seed);
+#endif
+
+    if (table->open) {
 #if WORD_SIZE_IN_BITS == 64
-    StgWord h = XXH3_64bits_withSeed (key, strlen(key), 1048583);
+        return (int)(h ^ (h >> 32));
 #else
-    StgWord h = XXH32 (key, strlen(key), 1048583);
+        return (int)h;
 #endif
+    }
 
     /* Mod the size of the hash table (a power of 2) */
     int bucket = h & table->mask1;
@@ -127,6 +200,271 @@ compareStr(StgWord key1, StgWord key2)
 }
 
 
+/* -----------------------------------------------------------------------------
+ * Open-addressed hash tables
+ * -------------------------------------------------------------------------- */
+
+/* Note [Open-addressed hash tables]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A linear hash table finds an entry by following a chain of HashList cells,
+ * each a separate cache miss.  allocOpenHashTable makes a table that keeps
+ * its (key, data) pairs in a flat array of HashSlots instead, in the style of
+ * Abseil's "Swiss tables":
+ *
+ *  - Each slot has a control byte: HCTRL_EMPTY, HCTRL_DELETED (a tombstone
+ *    left by removal), or for a full slot the low 7 bits of its key's hash
+ *    ("h2").  The control bytes live in their own array, followed by a copy
+ *    of the first HGROUP of them so that a group can be loaded from any
+ *    position without wrapping.
+ *
+ *  - The rest of the hash ("h1") picks the position at which probing starts.
+ *    Probing loads a group of HGROUP control bytes and compares all of them
+ *    with h2 at once (with SSE2 on x86, NEON on AArch64, or with word-sized
+ *    bit tricks elsewhere), so only slots whose h2 matches have their keys
+ *    compared.  A group containing an empty slot ends the probe; otherwise
+ *    the next group is tried, at triangular offsets, which visits every group
+ *    of a table whose capacity is a power of 2.
+ *
+ *  - At most 7/8 of the slots are ever full or deleted (growth_left counts
+ *    down to that limit), so every probe ends.  When the limit is reached the
+ *    table is rebuilt, at twice the capacity unless tombstones rather than
+ *    entries filled it.
+ *
+ * The table is used through the same HashTable API as a linear table.  For
+ * open-addressed tables hashWord and hashBuffer return a well-mixed hash
+ * rather than a bucket number, so the HashFunctions of existing callers
+ * (which are written in terms of those two) work with either kind of table.
+ * Like a linear table, an open-addressed one keeps every entry inserted with
+ * an existing key; but where a linear table returns the most recent such
+ * entry from a lookup, an open-addressed one may return any of them.  Tables
+ * that never hold two entries with equal keys behave identically.
+ *
+ * The iteration order of mapHashTable and friends differs between the two
+ * kinds of table, and is unspecified for both.
+ */
+
+#define HCTRL_EMPTY   ((uint8_t)0x80)
+#define HCTRL_DELETED ((uint8_t)0xfe)
+/* A full slot's control byte is in 0..0x7f */
+#define HCTRL_IS_FULL(c) (((c) & 0x80) == 0)
+
+#if defined(__SSE2__)
+#define HGROUP       16  /* control bytes compared at once */
+#define HGROUP_SHIFT 0   /* log2 of the bits per slot in a GroupMask */
+typedef uint32_t GroupMask;
+#else
+#define HGROUP       8
+#define HGROUP_SHIFT 3
+typedef uint64_t GroupMask;
+#define HLSBS UINT64_C(0x0101010101010101)
+#define HMSBS UINT64_C(0x8080808080808080)
+#endif
+
+#define HOPEN_MIN_CAPACITY 16  /* at least HGROUP */
+
+STATIC_INLINE uint8_t
+openH2(int hash)
+{
+    return (uint8_t)hash & 0x7f;
+}
+
+STATIC_INLINE StgWord
+openH1(int hash)
+{
+    return (StgWord)(unsigned int)hash >> 7;
+}
+
+#if !defined(__SSE2__)
+STATIC_INLINE uint64_t
+groupLoad(const uint8_t *ctrl)
+{
+    uint64_t g;
+    memcpy(&g, ctrl, sizeof(g));
+#if defined(WORDS_BIGENDIAN)
+    // the first control byte must be the least significant one
+    g = __builtin_bswap64(g);
+#endif
+    return g;
+}
+#endif
+
+/* The slots of the group at ctrl whose control byte is h2 (the portable
+ * version may also report a slot just after a matching one, which the
+ * caller's key comparison rejects) */
+STATIC_INLINE GroupMask
+groupMatch(const uint8_t *ctrl, uint8_t h2)
+{
+#if defined(__SSE2__)
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (GroupMask)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)h2)));
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(WORDS_BIGENDIAN)
+    uint8x8_t eq = vceq_u8(vld1_u8(ctrl), vdup_n_u8(h2));
+    return vget_lane_u64(vreinterpret_u64_u8(eq), 0) & HMSBS;
+#else
+    uint64_t x = groupLoad(ctrl) ^ (HLSBS * h2);
+    return (x - HLSBS) & ~x & HMSBS;
+#endif
+}
+
+STATIC_INLINE GroupMask
+groupMatchEmpty(const uint8_t *ctrl)
+{
+#if defined(__SSE2__)
+    return groupMatch(ctrl, HCTRL_EMPTY);
+#else
+    // only HCTRL_EMPTY has bit 7 set and bit 1 clear
+    uint64_t g = groupLoad(ctrl);
+    return g & ~(g << 6) & HMSBS;
+#endif
+}
+
+STATIC_INLINE GroupMask
+groupMatchEmptyOrDeleted(const uint8_t *ctrl)
+{
+#if defined(__SSE2__)
+    return (GroupMask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    return groupLoad(ctrl) & HMSBS;
+#endif
+}
+
+/* The position within its group of the first slot in a non-empty mask */
+STATIC_INLINE StgWord
+groupFirst(GroupMask mask)
+{
+    return (StgWord)__builtin_ctzll(mask) >> HGROUP_SHIFT;
+}
+
+STATIC_INLINE void
+setOpenCtrl(HashTable *table, StgWord i, uint8_t c)
+{
+    table->ctrl[i] = c;
+    if (i < HGROUP) {
+        table->ctrl[table->capacity + i] = c;
+    }
+}
+
+#define OPEN_SLOTS_BYTES(capacity) \
+    ((capacity) * sizeof(HashSlot) + (capacity) + HGROUP)
+
+static void
+allocOpenSlots(HashTable *table, StgWord capacity)
+{
+    table->capacity = capacity;
+    table->slots = stgMallocBytes(OPEN_SLOTS_BYTES(capacity), "allocOpenSlots");
+    countHashBytes(OPEN_SLOTS_BYTES(capacity));
+    table->ctrl = (uint8_t *)(table->slots + capacity);
+    memset(table->ctrl, HCTRL_EMPTY, capacity + HGROUP);
+    table->growth_left = capacity - capacity / 8 - table->kcount;
+}
+
+/* The index of the slot holding key (and data, unless that is NULL), or
+ * table->capacity if there is none */
+STATIC_INLINE StgWord
+findOpenSlot(const HashTable *table, StgWord key, const void *data,
+             HashFunction f, CompareFunction cmp)
+{
+    const int hash = f(table, key);
+    const uint8_t h2 = openH2(hash);
+    const StgWord mask = table->capacity - 1;
+    StgWord pos = openH1(hash) & mask;
+
+    for (StgWord step = HGROUP; ; step += HGROUP) {
+        const uint8_t *group = table->ctrl + pos;
+        for (GroupMask m = groupMatch(group, h2); m != 0; m &= m - 1) {
+            const StgWord i = (pos + groupFirst(m)) & mask;
+            if (cmp(table->slots[i].key, key)
+                && (data == NULL || table->slots[i].data == data)) {
+                return i;
+            }
+        }
+        if (groupMatchEmpty(group) != 0) {
+            return table->capacity;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+/* The index of the first empty or deleted slot on hash's probe sequence */
+STATIC_INLINE StgWord
+findOpenFreeSlot(const HashTable *table, int hash)
+{
+    const StgWord mask = table->capacity - 1;
+    StgWord pos = openH1(hash) & mask;
+
+    for (StgWord step = HGROUP; ; step += HGROUP) {
+        GroupMask m = groupMatchEmptyOrDeleted(table->ctrl + pos);
+        if (m != 0) {
+            return (pos + groupFirst(m)) & mask;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+/* Rebuild the table without its tombstones, doubling its capacity unless
+ * that would leave it less than half full */
+static void
+resizeOpen(HashTable *table, HashFunction f)
+{
+    HashSlot *old_slots = table->slots;
+    uint8_t *old_ctrl = table->ctrl;
+    const StgWord old_capacity = table->capacity;
+    StgWord capacity = old_capacity;
+
+    if ((StgWord)table->kcount * 16 >= old_capacity * 7) {
+        capacity *= 2;
+    }
+    allocOpenSlots(table, capacity);
+
+    for (StgWord i = 0; i < old_capacity; i++) {
+        if (HCTRL_IS_FULL(old_ctrl[i])) {
+            const int hash = f(table, old_slots[i].key);
+            const StgWord j = findOpenFreeSlot(table, hash);
+            setOpenCtrl(table, j, openH2(hash));
+            table->slots[j] = old_slots[i];
+        }
+    }
+
+    stgFree(old_slots);
+    uncountHashBytes(OPEN_SLOTS_BYTES(old_capacity));
+}
+
+STATIC_INLINE void
+insertOpen(HashTable *table, StgWord key, const void *data, HashFunction f)
+{
+    const int hash = f(table, key);
+    StgWord i = findOpenFreeSlot(table, hash);
+
+    if (table->ctrl[i] == HCTRL_EMPTY) {
+        if (table->growth_left == 0) {
+            resizeOpen(table, f);
+            i = findOpenFreeSlot(table, hash);
+        }
+        table->growth_left--;
+    }
+
+    setOpenCtrl(table, i, openH2(hash));
+    table->slots[i].key = key;
+    table->slots[i].data = data;
+    table->kcount++;
+}
+
+STATIC_INLINE void *
+removeOpen(HashTable *table, StgWord key, const void *data,
+           HashFunction f, CompareFunction cmp)
+{
+    const StgWord i = findOpenSlot(table, key, data, f, cmp);
+
+    if (i == table->capacity) {
+        ASSERT(data == NULL);
+        return NULL;
+    }
+
+    setOpenCtrl(table, i, HCTRL_DELETED);
+    table->kcount--;
+    return (void *) table->slots[i].data;
+}
+
 /* -----------------------------------------------------------------------------
  * Allocate a new segment of the dynamically growing hash table.
  * -------------------------------------------------------------------------- */
@@ -136,6 +474,7 @@ allocSegment(HashTable *table, int segment)
 {
     table->dir[segment] = stgMallocBytes(HSEGSIZE * sizeof(HashList *),
                                          "allocSegment");
+    countHashBytes(HSEGSIZE * sizeof(HashList *));
 }
 
 
@@ -211,6 +550,11 @@ lookupHashTable_inlined(const HashTable *table, StgWord key,
 
     HashList *hl;
 
+    if (table->open) {
+        StgWord i = findOpenSlot(table, key, NULL, f, cmp);
+        return i == table->capacity ? NULL : (void *) table->slots[i].data;
+    }
+
     bucket = f(table, key);
     segment = bucket / HSEGSIZE;
     index = bucket % HSEGSIZE;
@@ -254,6 +598,14 @@ int keysHashTable(HashTable *table, StgWord keys[], int szKeys) {
     int k = 0;
     HashList *hl;
 
+    if (table->open) {
+        for (StgWord i = 0; i < table->capacity && k < szKeys; i++) {
+            if (HCTRL_IS_FULL(table->ctrl[i])) {
+                keys[k++] = table->slots[i].key;
+            }
+        }
+        return k;
+    }
 
     /* The last bucket with something in it is table->max + table->split - 1 */
     segment = (table->max + table->split - 1) / HSEGSIZE;
@@ -299,15 +651,26 @@ allocHashList (HashTable *table)
          *  2. Several HashLists. One of these will get returned. The rest are
          *     placed on the freeList.
          *
+         * A table in an arena takes its HashLists from the arena, and
+         * leaves them for the arena to free.
          */
-        HashListChunk *cl = stgMallocBytes(sizeof(HashListChunk) + HCHUNK * sizeof(HashList), "allocHashList");
-        HashList *hl = (HashList *) &cl[1];
-        cl->next = table->chunks;
-        table->chunks = cl;
+        HashList *hl;
+        size_t n;
+        if (table->arena != NULL) {
+            n = HCHUNK_ARENA;
+            hl = arenaAlloc(table->arena, n * sizeof(HashList));
+        } else {
+            n = HCHUNK;
+            HashListChunk *cl = stgMallocBytes(sizeof(HashListChunk) + n * sizeof(HashList), "allocHashList");
+            countHashBytes(sizeof(HashListChunk) + n * sizeof(HashList));
+            hl = (HashList *) &cl[1];
+            cl->next = table->chunks;
+            table->chunks = cl;
+        }
 
         table->freeList = hl + 1;
         HashList *p = table->freeList;
-        for (; p < hl + HCHUNK - 1; p++)
+        for (; p < hl + n - 1; p++)
             p->next = p + 1;
         p->next = NULL;
         return hl;
@@ -338,6 +701,11 @@ insertHashTable_inlined(HashTable *table, StgWord key,
     // overwrite entries in the hash table.
     // ASSERT(lookupHashTable(table, key) == NULL);
 
+    if (table->open) {
+        insertOpen(table, key, data, f);
+        return;
+    }
+
     /* When the average load gets too high, we expand the table */
     if (++table->kcount >= HLOAD * table->bcount)
         expand(table, f);
@@ -383,6 +751,10 @@ removeHashTable_inlined(HashTable *table, StgWord key, const void *data,
     HashList *hl;
     HashList *prev = NULL;
 
+    if (table->open) {
+        return removeOpen(table, key, data, f, cmp);
+    }
+
     bucket = f(table, key);
     segment = bucket / HSEGSIZE;
     index = bucket % HSEGSIZE;
@@ -434,6 +806,20 @@ removeStrHashTable(StrHashTable *table, const char * key, const void *data)
 void
 freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 {
+    if (table->open) {
+        if (freeDataFun) {
+            for (StgWord i = 0; i < table->capacity; i++) {
+                if (HCTRL_IS_FULL(table->ctrl[i])) {
+                    (*freeDataFun)((void *) table->slots[i].data);
+                }
+            }
+        }
+        uncountHashBytes(OPEN_SLOTS_BYTES(table->capacity) + sizeof(HashTable));
+        stgFree(table->slots);
+        stgFree(table);
+        return;
+    }
+
     /* The last bucket with something in it is table->max + table->split - 1 */
     long segment = (table->max + table->split - 1) / HSEGSIZE;
     long index = (table->max + table->split - 1) % HSEGSIZE;
@@ -451,6 +837,7 @@ freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
             }
         }
         stgFree(table->dir[segment]);
+        uncountHashBytes(HSEGSIZE * sizeof(HashList *));
         segment--;
         index = HSEGSIZE - 1;
     }
@@ -461,9 +848,11 @@ freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
         HashListChunk *old = cl;
         cl = cl->next;
         stgFree(old);
+        uncountHashBytes(sizeof(HashListChunk) + HCHUNK * sizeof(HashList));
     }
 
     stgFree(table);
+    uncountHashBytes(sizeof(HashTable));
 }
 
 /* -----------------------------------------------------------------------------
@@ -473,6 +862,15 @@ freeHashTable(HashTable *table, void (*freeDataFun)(void *) )
 void
 mapHashTable(HashTable *table, void *data, MapHashFn fn)
 {
+    if (table->open) {
+        for (StgWord i = 0; i < table->capacity; i++) {
+            if (HCTRL_IS_FULL(table->ctrl[i])) {
+                fn(data, table->slots[i].key, table->slots[i].data);
+            }
+        }
+        return;
+    }
+
     /* The last bucket with something in it is table->max + table->split - 1 */
     long segment = (table->max + table->split - 1) / HSEGSIZE;
     long index = (table->max + table->split - 1) % HSEGSIZE;
@@ -492,6 +890,15 @@ mapHashTable(HashTable *table, void *data, MapHashFn fn)
 void
 mapHashTableKeys(HashTable *table, void *data, MapHashFnKeys fn)
 {
+    if (table->open) {
+        for (StgWord i = 0; i < table->capacity; i++) {
+            if (HCTRL_IS_FULL(table->ctrl[i])) {
+                fn(data, &table->slots[i].key, table->slots[i].data);
+            }
+        }
+        return;
+    }
+
     /* The last bucket with something in it is table->max + table->split - 1 */
     long segment = (table->max + table->split - 1) / HSEGSIZE;
     long index = (table->max + table->split - 1) % HSEGSIZE;
@@ -511,6 +918,16 @@ mapHashTableKeys(HashTable *table, void *data, MapHashFnKeys fn)
 void
 iterHashTable(HashTable *table, void *data, IterHashFn fn)
 {
+    if (table->open) {
+        for (StgWord i = 0; i < table->capacity; i++) {
+            if (HCTRL_IS_FULL(table->ctrl[i])
+                && !fn(data, table->slots[i].key, table->slots[i].data)) {
+                return;
+            }
+        }
+        return;
+    }
+
     /* The last bucket with something in it is table->max + table->split - 1 */
     long segment = (table->max + table->split - 1) / HSEGSIZE;
     long index = (table->max + table->split - 1) % HSEGSIZE;
@@ -541,12 +958,14 @@ allocHashTable(void)
     HashList **hb;
 
     table = stgMallocBytes(sizeof(HashTable),"allocHashTable");
+    countHashBytes(sizeof(HashTable));
 
     allocSegment(table, 0);
 
     for (hb = table->dir[0]; hb < table->dir[0] + HSEGSIZE; hb++)
         *hb = NULL;
 
+    table->open = false;
     table->split = 0;
     table->max = HSEGSIZE;
     table->mask1 = HSEGSIZE - 1;
@@ -555,6 +974,40 @@ allocHashTable(void)
     table->bcount = HSEGSIZE;
     table->freeList = NULL;
     table->chunks = NULL;
+    table->arena = NULL;
+
+    return table;
+}
+
+/* -----------------------------------------------------------------------------
+ * A table whose HashLists are allocated in an arena, for tables that are
+ * filled and then thrown away with the arena, like those of a heap census.
+ * The table must be freed (with freeHashTable) before the arena is freed or
+ * reset.
+ * -------------------------------------------------------------------------- */
+
+HashTable *
+allocHashTableInArena(Arena *arena)
+{
+    HashTable *table = allocHashTable();
+    table->arena = arena;
+    return table;
+}
+
+/* -----------------------------------------------------------------------------
+ * See Note [Open-addressed hash tables].
+ * -------------------------------------------------------------------------- */
+
+HashTable *
+allocOpenHashTable(void)
+{
+    HashTable *table;
+
+    table = stgMallocBytes(sizeof(HashTable), "allocOpenHashTable");
+    countHashBytes(sizeof(HashTable));
+    table->kcount = 0;
+    table->open = true;
+    allocOpenSlots(table, HOPEN_MIN_CAPACITY);
 
     return table;
 }
@@ -564,6 +1017,425 @@ int keyCountHashTable (HashTable *table)
     return table->kcount;
 }
 
+/* -----------------------------------------------------------------------------
+ * Concurrent hash tables
+ * -------------------------------------------------------------------------- */
+
+/* Note [Concurrent hash tables]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Some tables are read far more often than they are written, by threads that
+ * should not have to queue behind one another or behind a writer, such as
+ * the linker's cache of resolved symbols (Linker.c).  A ConcHashTable can be
+ * read without taking any lock:
+ *
+ *  - Entries are ConcHashNodes chained from an array of buckets.  A writer
+ *    fills in a node before publishing it at the head of its chain with a
+ *    release store, and removes one by pointing its predecessor past it,
+ *    leaving the node's own link alone, so a reader following the chain with
+ *    acquire loads sees either the old chain or the new one.
+ *
+ *  - Writers take one of CONC_HASH_STRIPES locks, chosen by bucket, so
+ *    writers to different buckets don't contend either.  Growing the table
+ *    takes all of them, copies every node into a new bucket array and
+ *    publishes that; readers still walking the old one find the old copies.
+ *
+ *  - Removed nodes and replaced bucket arrays can't be freed while a reader
+ *    might still be looking at them.  Readers announce themselves by
+ *    bracketing their accesses with beginConcHashRead/endConcHashRead, which
+ *    count them in one of two sets of counters according to the parity of a
+ *    global epoch (spread over several cache lines by the reader's stack
+ *    address).  Writers hand what they unlink to retireConcHashData, and at
+ *    each GC the collecting thread advances the epoch and waits for the
+ *    count of the previous epoch to drain before freeing what had been
+ *    retired (concHashSafePoint).  A reader that sees the epoch change while
+ *    it announces itself tries again, so none can slip past the wait.
+ *    Readers hold no locks and never wait for the GC; they only delay the
+ *    collecting thread by as long as a lookup takes.
+ *
+ * The lookup functions bracket themselves, so a reader only needs to call
+ * beginConcHashRead itself when it goes on using a value it found after the
+ * lookup returns, and the writer that removes that value frees it with
+ * retireConcHashData (as Linker.c does with its cached symbols).
+ *
+ * Other structures that are read without a lock can use the same epochs to
+ * free what they replace (e.g. the IPE index in IPE.c).
+ *
+ * As in a linear table, inserting a key that is already present adds a new
+ * entry that lookups find first.
+ */
+
+#define CONC_HASH_STRIPES     16   /* writer locks per table */
+#define CONC_HASH_READERS     16   /* reader counters per epoch */
+#define CONC_HASH_MIN_BUCKETS 64
+#define CONC_HASH_LOAD        2    /* average chain length before growing */
+
+typedef struct ConcHashNode_ {
+    StgWord key;
+    StgWord hash;
+    const void *data;
+    struct ConcHashNode_ *next;
+} ConcHashNode;
+
+typedef struct {
+    StgWord n_buckets;      /* a power of 2 */
+    ConcHashNode *buckets[];
+} ConcHashBuckets;
+
+struct conchashtable {
+    ConcHashBuckets *buckets;   /* read with ACQUIRE_LOAD */
+    StgWord kcount;             /* updated with the stripe lock held */
+#if defined(THREADED_RTS)
+    Mutex locks[CONC_HASH_STRIPES];
+#endif
+};
+
+typedef struct ConcHashRetired_ {
+    struct ConcHashRetired_ *next;
+    void *p;
+    void (*freeFun)(void *);
+} ConcHashRetired;
+
+// Pushed to by retireConcHashData, emptied by concHashSafePoint
+static ConcHashRetired *conc_hash_retired = NULL;
+
+#if defined(THREADED_RTS)
+static StgWord conc_hash_epoch = 0;
+
+typedef struct {
+    StgWord n;
+} ATTRIBUTE_ALIGNED(CACHELINE_SIZE) ConcHashReaderCount;
+
+static ConcHashReaderCount conc_hash_readers[2][CONC_HASH_READERS];
+#endif
+
+StgWord
+beginConcHashRead(void)
+{
+#if defined(THREADED_RTS)
+    // Threads have distinct stacks; that is enough to spread them out
+    const StgWord stripe = ((StgWord)&stripe >> 12) % CONC_HASH_READERS;
+
+    while (true) {
+        const StgWord parity = SEQ_CST_LOAD(&conc_hash_epoch) & 1;
+        StgWord *n = &conc_hash_readers[parity][stripe].n;
+        atomic_inc((StgVolatilePtr)n, 1);
+        if ((SEQ_CST_LOAD(&conc_hash_epoch) & 1) == parity) {
+            return parity * CONC_HASH_READERS + stripe;
+        }
+        // concHashSafePoint may already have looked at our counter
+        atomic_dec((StgVolatilePtr)n, 1);
+    }
+#else
+    return 0;
+#endif
+}
+
+void
+endConcHashRead(StgWord token STG_UNUSED)
+{
+#if defined(THREADED_RTS)
+    atomic_dec((StgVolatilePtr)&conc_hash_readers[token / CONC_HASH_READERS]
+                                                 [token % CONC_HASH_READERS].n,
+               1);
+#endif
+}
+
+void
+retireConcHashData(void *p, void (*freeFun)(void *))
+{
+    ConcHashRetired *r = stgMallocBytes(sizeof(ConcHashRetired),
+                                        "retireConcHashData");
+    r->p = p;
+    r->freeFun = freeFun;
+    while (true) {
+        ConcHashRetired *old = RELAXED_LOAD(&conc_hash_retired);
+        r->next = old;
+        if (cas_ptr((volatile void **)&conc_hash_retired, old, r) == old) {
+            return;
+        }
+    }
+}
+
+void
+concHashSafePoint(void)
+{
+    ConcHashRetired *r = xchg_ptr((void **)&conc_hash_retired, NULL);
+    if (r == NULL) {
+        return;
+    }
+
+#if defined(THREADED_RTS)
+    // Everything on r was unlinked before we took it, so readers that start
+    // in the new epoch can't find it; wait for the ones that began earlier.
+    const StgWord parity = SEQ_CST_LOAD(&conc_hash_epoch) & 1;
+    SEQ_CST_STORE(&conc_hash_epoch, conc_hash_epoch + 1);
+    for (uint32_t i = 0; i < CONC_HASH_READERS; i++) {
+        while (SEQ_CST_LOAD(&conc_hash_readers[parity][i].n) != 0) {
+            yieldThread();
+        }
+    }
+#endif
+
+    while (r != NULL) {
+        ConcHashRetired *next = r->next;
+        r->freeFun(r->p);
+        stgFree(r);
+        r = next;
+    }
+}
+
+/* Spread the caller's hash over all of its bits, since the bucket is taken
+ * from the low ones */
+STATIC_INLINE StgWord
+concHashMix(StgWord hash)
+{
+#if WORD_SIZE_IN_BITS == 64
+    hash *= UINT64_C(0x9E3779B97F4A7C15);
+    return hash ^ (hash >> 32);
+#else
+    hash *= UINT32_C(0x9E3779B9);
+    return hash ^ (hash >> 16);
+#endif
+}
+
+static ConcHashBuckets *
+allocConcHashBuckets(StgWord n_buckets)
+{
+    ConcHashBuckets *b =
+        stgMallocBytes(sizeof(ConcHashBuckets) + n_buckets * sizeof(ConcHashNode *),
+                       "allocConcHashBuckets");
+    countHashBytes(sizeof(ConcHashBuckets) + n_buckets * sizeof(ConcHashNode *));
+    b->n_buckets = n_buckets;
+    memset(b->buckets, 0, n_buckets * sizeof(ConcHashNode *));
+    return b;
+}
+
+/* Free a bucket array and the nodes on its chains */
+static void
+freeConcHashBuckets(void *p)
+{
+    ConcHashBuckets *b = p;
+    for (StgWord i = 0; i < b->n_buckets; i++) {
+        ConcHashNode *next;
+        for (ConcHashNode *n = b->buckets[i]; n != NULL; n = next) {
+            next = n->next;
+            stgFree(n);
+            uncountHashBytes(sizeof(ConcHashNode));
+        }
+    }
+    uncountHashBytes(sizeof(ConcHashBuckets) + b->n_buckets * sizeof(ConcHashNode *));
+    stgFree(b);
+}
+
+ConcHashTable *
+allocConcHashTable(void)
+{
+    ConcHashTable *table = stgMallocBytes(sizeof(ConcHashTable),
+                                          "allocConcHashTable");
+    countHashBytes(sizeof(ConcHashTable));
+    table->buckets = allocConcHashBuckets(CONC_HASH_MIN_BUCKETS);
+    table->kcount = 0;
+#if defined(THREADED_RTS)
+    for (int i = 0; i < CONC_HASH_STRIPES; i++) {
+        initMutex(&table->locks[i]);
+    }
+#endif
+    return table;
+}
+
+/* There must be no readers or writers left */
+void
+freeConcHashTable(ConcHashTable *table, void (*freeDataFun)(void *))
+{
+    ConcHashBuckets *b = table->buckets;
+    if (freeDataFun) {
+        for (StgWord i = 0; i < b->n_buckets; i++) {
+            for (ConcHashNode *n = b->buckets[i]; n != NULL; n = n->next) {
+                freeDataFun((void *) n->data);
+            }
+        }
+    }
+    freeConcHashBuckets(b);
+#if defined(THREADED_RTS)
+    for (int i = 0; i < CONC_HASH_STRIPES; i++) {
+        closeMutex(&table->locks[i]);
+    }
+#endif
+    stgFree(table);
+    uncountHashBytes(sizeof(ConcHashTable));
+}
+
+void *
+lookupConcHashTable_(ConcHashTable *table, StgWord key, StgWord hash,
+                     CompareFunction cmp)
+{
+    const void *data = NULL;
+    const StgWord token = beginConcHashRead();
+
+    hash = concHashMix(hash);
+    ConcHashBuckets *b = ACQUIRE_LOAD(&table->buckets);
+    ConcHashNode *n = ACQUIRE_LOAD(&b->buckets[hash & (b->n_buckets - 1)]);
+    for (; n != NULL; n = ACQUIRE_LOAD(&n->next)) {
+        if (n->hash == hash && cmp(n->key, key)) {
+            data = n->data;
+            break;
+        }
+    }
+
+    endConcHashRead(token);
+    return (void *) data;
+}
+
+/* Lock the stripe of the current bucket array that hash falls in, returning
+ * the array */
+static ConcHashBuckets *
+lockConcHashBucket(ConcHashTable *table, StgWord hash,
+                   StgWord *stripe)
+{
+    while (true) {
+        ConcHashBuckets *b = ACQUIRE_LOAD(&table->buckets);
+        *stripe = (hash & (b->n_buckets - 1)) % CONC_HASH_STRIPES;
+        ACQUIRE_LOCK(&table->locks[*stripe]);
+        // the table may have grown meanwhile
+        if (RELAXED_LOAD(&table->buckets) == b) {
+            return b;
+        }
+        RELEASE_LOCK(&table->locks[*stripe]);
+    }
+}
+
+/* Double the number of buckets, copying the nodes so that readers of the
+ * old array are undisturbed */
+static void
+growConcHashTable(ConcHashTable *table)
+{
+    for (int i = 0; i < CONC_HASH_STRIPES; i++) {
+        ACQUIRE_LOCK(&table->locks[i]);
+    }
+
+    ConcHashBuckets *old = table->buckets;
+    if (table->kcount > CONC_HASH_LOAD * old->n_buckets) {
+        ConcHashBuckets *new = allocConcHashBuckets(old->n_buckets * 2);
+        const StgWord mask = new->n_buckets - 1;
+
+        for (StgWord i = 0; i < old->n_buckets; i++) {
+            // keep each chain in order, so that the newest of several entries
+            // with one key stays first
+            ConcHashNode **tails[2] = { NULL, NULL };
+            for (ConcHashNode *n = old->buckets[i]; n != NULL; n = n->next) {
+                ConcHashNode *copy = stgMallocBytes(sizeof(ConcHashNode),
+                                                    "growConcHashTable");
+                countHashBytes(sizeof(ConcHashNode));
+                const StgWord j = n->hash & mask;
+                const int half = j != i;
+                *copy = *n;
+                copy->next = NULL;
+                if (tails[half] == NULL) {
+                    new->buckets[j] = copy;
+                } else {
+                    *tails[half] = copy;
+                }
+                tails[half] = &copy->next;
+            }
+        }
+
+        RELEASE_STORE(&table->buckets, new);
+        retireConcHashData(old, freeConcHashBuckets);
+    }
+
+    for (int i = CONC_HASH_STRIPES - 1; i >= 0; i--) {
+        RELEASE_LOCK(&table->locks[i]);
+    }
+}
+
+void
+insertConcHashTable_(ConcHashTable *table, StgWord key, StgWord hash,
+                     const void *data)
+{
+    StgWord stripe;
+    bool grow;
+
+    hash = concHashMix(hash);
+
+    ConcHashNode *n = stgMallocBytes(sizeof(ConcHashNode), "insertConcHashTable");
+    countHashBytes(sizeof(ConcHashNode));
+    n->key = key;
+    n->hash = hash;
+    n->data = data;
+
+    ConcHashBuckets *b = lockConcHashBucket(table, hash, &stripe);
+    ConcHashNode **head = &b->buckets[hash & (b->n_buckets - 1)];
+    n->next = *head;
+    RELEASE_STORE(head, n);
+    grow = atomic_inc((StgVolatilePtr)&table->kcount, 1)
+             > CONC_HASH_LOAD * b->n_buckets;
+    RELEASE_LOCK(&table->locks[stripe]);
+
+    if (grow) {
+        growConcHashTable(table);
+    }
+}
+
+void *
+removeConcHashTable_(ConcHashTable *table, StgWord key, StgWord hash,
+                     CompareFunction cmp)
+{
+    StgWord stripe;
+    const void *data = NULL;
+
+    hash = concHashMix(hash);
+
+    ConcHashBuckets *b = lockConcHashBucket(table, hash, &stripe);
+    ConcHashNode **prev = &b->buckets[hash & (b->n_buckets - 1)];
+    for (ConcHashNode *n = *prev; n != NULL; prev = &n->next, n = n->next) {
+        if (n->hash == hash && cmp(n->key, key)) {
+            data = n->data;
+            RELEASE_STORE(prev, n->next);
+            atomic_dec((StgVolatilePtr)&table->kcount, 1);
+            retireConcHashData(n, stgFree);
+            uncountHashBytes(sizeof(ConcHashNode));
+            break;
+        }
+    }
+    RELEASE_LOCK(&table->locks[stripe]);
+
+    return (void *) data;
+}
+
+void *
+lookupConcHashTable(ConcHashTable *table, StgWord key)
+{
+    return lookupConcHashTable_(table, key, key, compareWord);
+}
+
+void
+insertConcHashTable(ConcHashTable *table, StgWord key, const void *data)
+{
+    insertConcHashTable_(table, key, key, data);
+}
+
+void *
+removeConcHashTable(ConcHashTable *table, StgWord key)
+{
+    return removeConcHashTable_(table, key, key, compareWord);
+}
+
+/* Entries inserted or removed while this runs may or may not be seen */
+void
+mapConcHashTable(ConcHashTable *table, void *data, MapHashFn fn)
+{
+    const StgWord token = beginConcHashRead();
+    ConcHashBuckets *b = ACQUIRE_LOAD(&table->buckets);
+
+    for (StgWord i = 0; i < b->n_buckets; i++) {
+        ConcHashNode *n = ACQUIRE_LOAD(&b->buckets[i]);
+        for (; n != NULL; n = ACQUIRE_LOAD(&n->next)) {
+            fn(data, n->key, n->data);
+        }
+    }
+
+    endConcHashRead(token);
+}
 
 #if defined(__GNUC__) || defined(__GNUG__)
 #if !defined(__clang__)
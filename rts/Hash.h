@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include "Arena.h"
+
 #include "BeginPrivate.h"
 
 typedef struct hashtable HashTable; /* abstract */
@@ -20,12 +22,21 @@ typedef struct strhashtable StrHashTable;
  * needs to.
  */
 HashTable * allocHashTable  ( void );
+// A table using open addressing rather than chaining, which is faster but
+// differs when several entries have equal keys; see
+// Note [Open-addressed hash tables] in Hash.c
+HashTable * allocOpenHashTable ( void );
+// A table whose entries are allocated in the given arena
+HashTable * allocHashTableInArena ( Arena *arena );
 void        insertHashTable ( HashTable *table, StgWord key, const void *data );
 void *      lookupHashTable ( const HashTable *table, StgWord key );
 void *      removeHashTable ( HashTable *table, StgWord key, const void *data );
 
 int keyCountHashTable (HashTable *table);
 
+// The bytes held by all the hash tables of the RTS, concurrent ones included
+StgWord getHashTableBytes (void);
+
 // Puts up to szKeys keys of the hash table into the given array. Returns the
 // actual amount of keys that have been retrieved.
 //
@@ -71,6 +82,8 @@ typedef int HashFunction(const HashTable *table, StgWord key);
 typedef int CompareFunction(StgWord key1, StgWord key2);
 int hashWord(const HashTable *table, StgWord key);
 int hashStr(const HashTable *table, StgWord w);
+// Hash len bytes of buf, for tables keyed by what their keys point to
+int hashBuffer(const HashTable *table, const void *buf, size_t len, StgWord seed);
 void        insertHashTable_ ( HashTable *table, StgWord key,
                                const void *data, HashFunction f );
 void *      lookupHashTable_ ( const HashTable *table, StgWord key,
@@ -111,4 +124,37 @@ INLINE_HEADER void insertHashSet ( HashSet *set, StgWord key )
     insertHashTable((HashTable*)set, key, NULL);
 }
 
+/*
+ * Concurrent hash tables, which can be read without locking while other
+ * threads insert and remove entries; see Note [Concurrent hash tables] in
+ * Hash.c.  The _ variants take the key's hash rather than a hash function.
+ */
+
+typedef struct conchashtable ConcHashTable;
+
+ConcHashTable * allocConcHashTable ( void );
+void            freeConcHashTable  ( ConcHashTable *table,
+                                     void (*freeDataFun)(void *) );
+void   insertConcHashTable ( ConcHashTable *table, StgWord key, const void *data );
+void * lookupConcHashTable ( ConcHashTable *table, StgWord key );
+void * removeConcHashTable ( ConcHashTable *table, StgWord key );
+void   insertConcHashTable_ ( ConcHashTable *table, StgWord key, StgWord hash,
+                              const void *data );
+void * lookupConcHashTable_ ( ConcHashTable *table, StgWord key, StgWord hash,
+                              CompareFunction cmp );
+void * removeConcHashTable_ ( ConcHashTable *table, StgWord key, StgWord hash,
+                              CompareFunction cmp );
+void   mapConcHashTable ( ConcHashTable *table, void *data, MapHashFn fn );
+
+// Bracket uses of a value found in a concurrent table that another thread
+// may remove and retire
+StgWord beginConcHashRead ( void );
+void    endConcHashRead   ( StgWord token );
+
+// Free p with freeFun once no reader can still be looking at it
+void retireConcHashData ( void *p, void (*freeFun)(void *) );
+
+// Called by the GC to free what has been retired
+void concHashSafePoint ( void );
+
 #include "EndPrivate.h"
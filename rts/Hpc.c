@@ -45,6 +45,26 @@ HpcModuleInfo *modules = 0;
 
 static char *tixFilename = NULL;
 
+// See Note [Dumping tix files]
+typedef struct {
+  HpcModuleInfo *mod;
+  StgWord64 sum;                // of its counts when we last wrote them
+  long offset;                  // of its counts in a binary .tix file
+} DumpedModule;
+
+static DumpedModule *dumped = NULL;     // as at the last dump, in list order
+static uint32_t n_dumped = 0;
+
+#if defined(THREADED_RTS)
+static Mutex hpc_dump_mutex;
+static Condition hpc_dump_cond;         // stopping
+static OSThreadId hpc_dump_thread;
+static bool hpc_dump_thread_running = false;
+static bool hpc_dump_stopping;
+
+static void startHpcDumpThread(void);
+#endif
+
 static void STG_NORETURN
 failure(char *msg) {
   debugTrace(DEBUG_hpc,"hpc failure: %s\n",msg);
@@ -104,11 +124,46 @@ static StgWord64 expectWord64(void) {
   return tmp;
 }
 
+// Take the counts of a module read from the .tix file
+static void
+addTixModule(HpcModuleInfo *tmpModule) {
+    const HpcModuleInfo *lookup;
+    unsigned int i;
+
+    lookup = lookupStrHashTable(moduleHash, tmpModule->modName);
+    if (lookup == NULL) {
+        debugTrace(DEBUG_hpc,"readTix: new HpcModuleInfo for %s",
+                   tmpModule->modName);
+        insertStrHashTable(moduleHash, tmpModule->modName, tmpModule);
+    } else {
+        ASSERT(lookup->tixArr != 0);
+        ASSERT(!strcmp(tmpModule->modName, lookup->modName));
+        debugTrace(DEBUG_hpc,"readTix: existing HpcModuleInfo for %s",
+                   tmpModule->modName);
+        if (tmpModule->hashNo != lookup->hashNo) {
+            fprintf(stderr,"in module '%s'\n",tmpModule->modName);
+            failure("module mismatch with .tix/.mix file hash number");
+            if (tixFilename != NULL) {
+                fprintf(stderr,"(perhaps remove %s ?)\n",tixFilename);
+            }
+            stg_exit(EXIT_FAILURE);
+        }
+        if (tmpModule->tickCount != lookup->tickCount) {
+            failure("inconsistent number of tick boxes");
+        }
+        for (i=0; i < tmpModule->tickCount; i++) {
+            lookup->tixArr[i] = tmpModule->tixArr[i];
+        }
+        stgFree(tmpModule->tixArr);
+        stgFree(tmpModule->modName);
+        stgFree(tmpModule);
+    }
+}
+
 static void
 readTix(void) {
   unsigned int i;
   HpcModuleInfo *tmpModule;
-  const HpcModuleInfo *lookup;
 
   ws();
   expect('T');
@@ -152,31 +207,7 @@ readTix(void) {
     expect(']');
     ws();
 
-    lookup = lookupStrHashTable(moduleHash, tmpModule->modName);
-    if (lookup == NULL) {
-        debugTrace(DEBUG_hpc,"readTix: new HpcModuleInfo for %s",
-                   tmpModule->modName);
-        insertStrHashTable(moduleHash, tmpModule->modName, tmpModule);
-    } else {
-        ASSERT(lookup->tixArr != 0);
-        ASSERT(!strcmp(tmpModule->modName, lookup->modName));
-        debugTrace(DEBUG_hpc,"readTix: existing HpcModuleInfo for %s",
-                   tmpModule->modName);
-        if (tmpModule->hashNo != lookup->hashNo) {
-            fprintf(stderr,"in module '%s'\n",tmpModule->modName);
-            failure("module mismatch with .tix/.mix file hash number");
-            if (tixFilename != NULL) {
-                fprintf(stderr,"(perhaps remove %s ?)\n",tixFilename);
-            }
-            stg_exit(EXIT_FAILURE);
-        }
-        for (i=0; i < tmpModule->tickCount; i++) {
-            lookup->tixArr[i] = tmpModule->tixArr[i];
-        }
-        stgFree(tmpModule->tixArr);
-        stgFree(tmpModule->modName);
-        stgFree(tmpModule);
-    }
+    addTixModule(tmpModule);
 
     if (tix_ch == ',') {
       expect(',');
@@ -187,6 +218,115 @@ readTix(void) {
   fclose(tixFile);
 }
 
+/* Note [Binary tix files]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   A coverage run of a large program has millions of tick boxes, and
+   printing them as decimal text at exit, and parsing them again with
+   --read-tix-file=yes, takes a while. With --tix-format=binary we write
+   instead
+
+     TixHeader                      magic, version, number of modules
+     for each module:
+       TixModuleHeader              name length, hash, tick boxes, flags
+       name                         padded with NULs to a multiple of 8 bytes
+       counts                       a StgWord64 for each tick box
+
+   in the byte order of the machine, with everything aligned to 8 bytes, so
+   that a tool can mmap() the file and use the counts in place. Coverage in
+   CI usually only asks whether each box was entered, so --tix-format=bits
+   writes instead of the counts a bitmap, of ceil(boxes / 64) StgWord64s,
+   box i being bit i % 64 of word i / 64, with TIX_BITS in the flags; read
+   back, a set bit counts as one entry. See also -fhpc-boolean, which makes
+   the ticks themselves cheaper when only this is wanted.
+
+   The RTS tells the formats apart by their first byte, so it reads either
+   with --read-tix-file=yes, whatever --tix-format says. The hpc tool only
+   reads the text format.
+*/
+
+#define TIX_MAGIC "GHC-TIX"             // with its NUL, 8 bytes
+#define TIX_VERSION 1
+#define TIX_BITS 1                      // TixModuleHeader.flags
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_modules;
+} TixHeader;
+
+typedef struct {
+    uint32_t name_len;                  // not counting the padding
+    uint32_t hash;
+    uint32_t tick_count;
+    uint32_t flags;
+} TixModuleHeader;
+
+#define TIX_PADDED(n) (((n) + 7) & ~(size_t)7)
+
+static void
+readBinary(void *buf, size_t size) {
+  if (fread(buf, 1, size, tixFile) != size) {
+    failure("unexpected end of binary .tix file");
+  }
+}
+
+static void
+readBinaryTix(void) {
+  TixHeader header;
+
+  // init_open has read the first byte already
+  ungetc(tix_ch, tixFile);
+  readBinary(&header, sizeof(header));
+  if (memcmp(header.magic, TIX_MAGIC, sizeof(header.magic)) != 0) {
+    failure("bad binary .tix file");
+  }
+  if (header.version != TIX_VERSION) {
+    failure("binary .tix file of another version or byte order");
+  }
+
+  for (uint32_t m = 0; m < header.n_modules; m++) {
+    TixModuleHeader mod;
+    readBinary(&mod, sizeof(mod));
+
+    HpcModuleInfo *tmpModule =
+        (HpcModuleInfo *)stgMallocBytes(sizeof(HpcModuleInfo),
+                                        "Hpc.readBinaryTix");
+    tmpModule->from_file = true;
+    tmpModule->hashNo = mod.hash;
+    tmpModule->tickCount = mod.tick_count;
+    tmpModule->modName = stgCallocBytes(TIX_PADDED(mod.name_len) + 1, 1,
+                                        "Hpc.readBinaryTix");
+    readBinary(tmpModule->modName, TIX_PADDED(mod.name_len));
+    tmpModule->tixArr = (StgWord64 *)stgCallocBytes(mod.tick_count,
+                                                    sizeof(StgWord64),
+                                                    "Hpc.readBinaryTix");
+    if (mod.flags & TIX_BITS) {
+      for (uint32_t i = 0; i < mod.tick_count; i += 64) {
+        StgWord64 bits;
+        readBinary(&bits, sizeof(bits));
+        for (uint32_t j = i; j < mod.tick_count && j < i + 64; j++) {
+          tmpModule->tixArr[j] = (bits >> (j - i)) & 1;
+        }
+      }
+    } else {
+      readBinary(tmpModule->tixArr, mod.tick_count * sizeof(StgWord64));
+    }
+
+    addTixModule(tmpModule);
+  }
+  fclose(tixFile);
+}
+
+// The formats differ in their first byte; see Note [Binary tix files]
+static void
+readAnyTix(void) {
+  if (tix_ch == TIX_MAGIC[0]) {
+    readBinaryTix();
+  } else {
+    readTix();
+  }
+}
+
 void
 startupHpc(void)
 {
@@ -236,16 +376,24 @@ startupHpc(void)
     sprintf(tixFilename, "%s.tix", prog_name);
   }
 
-  if ((RtsFlags.HpcFlags.readTixFile == HPC_YES_IMPLICIT) && init_open(__rts_fopen(tixFilename,"r"))) {
+  if ((RtsFlags.HpcFlags.readTixFile == HPC_YES_IMPLICIT) && init_open(__rts_fopen(tixFilename,"rb"))) {
     fprintf(stderr,"Deprecation warning:\n"
                    "I am reading in the existing tix file, and will add hpc info from this run to the existing data in that file.\n"
                    "GHC 9.14 will cease looking for an existing tix file by default.\n"
                    "If you positively want to add hpc info to the current tix file, use the RTS option --read-tix-file=yes.\n"
                    "More information can be found in the accepted GHC proposal 612.\n");
-    readTix();
-  } else if ((RtsFlags.HpcFlags.readTixFile == HPC_YES_EXPLICIT) && init_open(__rts_fopen(tixFilename,"r"))) {
-    readTix();
+    readAnyTix();
+  } else if ((RtsFlags.HpcFlags.readTixFile == HPC_YES_EXPLICIT) && init_open(__rts_fopen(tixFilename,"rb"))) {
+    readAnyTix();
   }
+
+#if defined(THREADED_RTS)
+  initMutex(&hpc_dump_mutex);
+  initCondition(&hpc_dump_cond);
+  if (RtsFlags.HpcFlags.tixInterval > 0 && RtsFlags.HpcFlags.writeTixFile) {
+    startHpcDumpThread();
+  }
+#endif
 }
 
 /*
@@ -290,7 +438,8 @@ hs_hpc_module(char *modName,
       }
       tmpModule->next = modules;
       tmpModule->from_file = false;
-      modules = tmpModule;
+      // a dump on the hpc_dump thread may be walking the list
+      RELEASE_STORE(&modules, tmpModule);
       insertStrHashTable(moduleHash, modName, tmpModule);
   }
   else
@@ -371,6 +520,276 @@ writeTix(FILE *f) {
   fclose(f);
 }
 
+static void
+writeBinary(FILE *f, const void *buf, size_t size) {
+  if (fwrite(buf, 1, size, f) != size) {
+    errorBelch("hpc: failed to write %s", tixFilename);
+  }
+}
+
+static const char padding[8] = { 0 };
+
+// The counts of a module in a binary .tix file
+static void
+writeBinaryCounts(FILE *f, HpcModuleInfo *tmpModule, bool bits) {
+  if (bits) {
+    for (uint32_t i = 0; i < tmpModule->tickCount; i += 64) {
+      StgWord64 word = 0;
+      for (uint32_t j = i; j < tmpModule->tickCount && j < i + 64; j++) {
+        if (tmpModule->tixArr && tmpModule->tixArr[j] != 0) {
+          word |= (StgWord64)1 << (j - i);
+        }
+      }
+      writeBinary(f, &word, sizeof(word));
+    }
+  } else if (tmpModule->tixArr) {
+    writeBinary(f, tmpModule->tixArr,
+                tmpModule->tickCount * sizeof(StgWord64));
+  } else {
+    for (uint32_t i = 0; i < tmpModule->tickCount; i++) {
+      writeBinary(f, padding, sizeof(StgWord64));
+    }
+  }
+}
+
+// See Note [Binary tix files]. Write the modules on the list from head, and
+// if offsets isn't NULL, set offsets[i] to where the counts of the i'th
+// start in the file.
+static void
+writeBinaryTix(FILE *f, HpcModuleInfo *head, bool bits, long *offsets) {
+  TixHeader header;
+  HpcModuleInfo *tmpModule;
+  uint32_t m;
+
+  if (f == 0) {
+    return;
+  }
+
+  memcpy(header.magic, TIX_MAGIC, sizeof(header.magic));
+  header.version = TIX_VERSION;
+  header.n_modules = 0;
+  for (tmpModule = head; tmpModule != 0; tmpModule = tmpModule->next) {
+    header.n_modules++;
+  }
+  writeBinary(f, &header, sizeof(header));
+
+  for (tmpModule = head, m = 0; tmpModule != 0;
+       tmpModule = tmpModule->next, m++) {
+    TixModuleHeader mod;
+    mod.name_len = strlen(tmpModule->modName);
+    mod.hash = tmpModule->hashNo;
+    mod.tick_count = tmpModule->tickCount;
+    mod.flags = bits ? TIX_BITS : 0;
+    writeBinary(f, &mod, sizeof(mod));
+    writeBinary(f, tmpModule->modName, mod.name_len);
+    writeBinary(f, padding, TIX_PADDED(mod.name_len) - mod.name_len);
+    if (offsets != NULL) {
+      offsets[m] = ftell(f);
+    }
+    writeBinaryCounts(f, tmpModule, bits);
+  }
+
+  fclose(f);
+}
+
+/* Note [Dumping tix files]
+   ~~~~~~~~~~~~~~~~~~~~~~~~
+   We normally write the .tix file only in exitHpc, so a service that is
+   killed, or never exits, leaves no coverage behind, and writing the counts
+   of a large program holds up its exit. So the .tix file can also be written
+   while the program runs:
+
+     - by hs_hpc_dump(), which the program may call, e.g. from a signal
+       handler or an admin endpoint;
+     - every --tix-interval seconds, by the hpc_dump thread, in the threaded
+       RTS.
+
+   exitHpc stops the hpc_dump thread and then dumps once more. The counts
+   keep changing while we write them, so a dump is only a snapshot; as they
+   only grow, a later dump is never behind an earlier one.
+
+   To save writing what's already in the file, dumpTix keeps, for each module
+   it wrote, the sum of its counts. A dump where no sum has changed writes
+   nothing. Otherwise, if the modules are the same as at the last dump (the
+   list only grows, when code is loaded with dlopen(), so it's enough to
+   count them), a binary .tix file is updated in place, by writing just the
+   counts of the modules whose sums changed at the offsets where they start.
+   Anything else (the text format, new modules, the first dump) rewrites the
+   whole file, into <file>.tmp which we then rename over the .tix file, so
+   that the .tix file is whole even if we are killed while writing it.
+
+   Dumps hold hpc_dump_mutex, and a forked child doesn't dump at all, as with
+   exitHpc.
+*/
+
+static bool
+isSubprocess(void) {
+#if defined(HAVE_GETPID)
+  return hpc_pid != getpid();
+#else
+  return false;
+#endif
+}
+
+static StgWord64
+moduleSum(const HpcModuleInfo *mod) {
+  StgWord64 sum = 0;
+  if (mod->tixArr != NULL) {
+    for (uint32_t i = 0; i < mod->tickCount; i++) {
+      sum += RELAXED_LOAD_ALWAYS(&mod->tixArr[i]);
+    }
+  }
+  return sum;
+}
+
+// Write the whole .tix file, and remember what we wrote
+static void
+dumpWholeTix(HpcModuleInfo *head, uint32_t n) {
+  HPC_TIX_FORMAT format = RtsFlags.HpcFlags.tixFormat;
+  long *offsets = stgCallocBytes(n, sizeof(long), "dumpWholeTix");
+  char *tmpFilename = stgMallocBytes(strlen(tixFilename) + 5, "dumpWholeTix");
+  sprintf(tmpFilename, "%s.tmp", tixFilename);
+
+  stgFree(dumped);
+  dumped = stgMallocBytes(n * sizeof(DumpedModule), "dumpWholeTix");
+  n_dumped = n;
+  uint32_t m = 0;
+  for (HpcModuleInfo *tmpModule = head; m < n; tmpModule = tmpModule->next) {
+    dumped[m].mod = tmpModule;
+    // before we write the counts, so that a change while we do shows next time
+    dumped[m].sum = moduleSum(tmpModule);
+    m++;
+  }
+
+  if (format == HPC_TIX_TEXT) {
+    writeTix(__rts_fopen(tmpFilename, "w+"));
+  } else {
+    writeBinaryTix(__rts_fopen(tmpFilename, "wb"), head,
+                   format == HPC_TIX_BITS, offsets);
+  }
+  for (m = 0; m < n; m++) {
+    dumped[m].offset = offsets[m];
+  }
+
+#if defined(mingw32_HOST_OS)
+  // MoveFileW won't replace the .tix file
+  __rts_remove(tixFilename);
+  if (__rts_rename(tmpFilename, tixFilename) != 0) {
+#else
+  if (rename(tmpFilename, tixFilename) != 0) {
+#endif
+    sysErrorBelch("hpc: failed to write %s", tixFilename);
+    // so the next dump tries again
+    stgFree(dumped);
+    dumped = NULL;
+    n_dumped = 0;
+  }
+
+  stgFree(tmpFilename);
+  stgFree(offsets);
+}
+
+// Write the .tix file, or just the counts in it that have changed; see
+// Note [Dumping tix files]. Called with hpc_dump_mutex held.
+static void
+dumpTix(void) {
+  HpcModuleInfo *head = ACQUIRE_LOAD(&modules);
+  uint32_t n = 0;
+  for (HpcModuleInfo *tmpModule = head; tmpModule != 0;
+       tmpModule = tmpModule->next) {
+    n++;
+  }
+
+  // new modules are added at the head of the list
+  if (dumped == NULL || n != n_dumped
+      || RtsFlags.HpcFlags.tixFormat == HPC_TIX_TEXT) {
+    bool changed = dumped == NULL || n != n_dumped;
+    for (uint32_t m = 0; !changed && m < n; m++) {
+      changed = moduleSum(dumped[m].mod) != dumped[m].sum;
+    }
+    if (changed) {
+      dumpWholeTix(head, n);
+    }
+    return;
+  }
+
+  FILE *f = NULL;
+  for (uint32_t m = 0; m < n; m++) {
+    StgWord64 sum = moduleSum(dumped[m].mod);
+    if (sum == dumped[m].sum) {
+      continue;
+    }
+    if (f == NULL) {
+      f = __rts_fopen(tixFilename, "r+b");
+      if (f == NULL) {
+        // it has gone; write it all again
+        dumpWholeTix(head, n);
+        return;
+      }
+    }
+    dumped[m].sum = sum;
+    if (fseek(f, dumped[m].offset, SEEK_SET) != 0) {
+      errorBelch("hpc: failed to write %s", tixFilename);
+      break;
+    }
+    writeBinaryCounts(f, dumped[m].mod,
+                      RtsFlags.HpcFlags.tixFormat == HPC_TIX_BITS);
+  }
+  if (f != NULL) {
+    fclose(f);
+  }
+}
+
+void
+hs_hpc_dump(void) {
+  if (hpc_inited == 0 || isSubprocess() || !RtsFlags.HpcFlags.writeTixFile) {
+    return;
+  }
+  ACQUIRE_LOCK(&hpc_dump_mutex);
+  dumpTix();
+  RELEASE_LOCK(&hpc_dump_mutex);
+}
+
+#if defined(THREADED_RTS)
+static void *
+hpcDumpThread(void *unused STG_UNUSED) {
+  ACQUIRE_LOCK(&hpc_dump_mutex);
+  while (!hpc_dump_stopping) {
+    if (!timedWaitCondition(&hpc_dump_cond, &hpc_dump_mutex,
+                            RtsFlags.HpcFlags.tixInterval)
+        && !hpc_dump_stopping) {
+      dumpTix();
+    }
+  }
+  RELEASE_LOCK(&hpc_dump_mutex);
+  return NULL;
+}
+
+static void
+startHpcDumpThread(void) {
+  hpc_dump_stopping = false;
+  if (createAttachedOSThread(&hpc_dump_thread, "ghc_hpc_dump",
+                             hpcDumpThread, NULL) != 0) {
+    sysErrorBelch("hpc: can't start the thread for --tix-interval");
+    return;
+  }
+  hpc_dump_thread_running = true;
+}
+
+static void
+stopHpcDumpThread(void) {
+  if (!hpc_dump_thread_running) {
+    return;
+  }
+  ACQUIRE_LOCK(&hpc_dump_mutex);
+  hpc_dump_stopping = true;
+  signalCondition(&hpc_dump_cond);
+  RELEASE_LOCK(&hpc_dump_mutex);
+  joinOSThread(hpc_dump_thread);
+  hpc_dump_thread_running = false;
+}
+#endif
+
 static void
 freeHpcModuleInfo (HpcModuleInfo *mod)
 {
@@ -396,18 +815,26 @@ exitHpc(void) {
   // Any sub-process from use of fork from inside Haskell will
   // not clobber the .tix file.
 
-#if defined(HAVE_GETPID)
-  bool is_subprocess = hpc_pid != getpid();
-#else
-  bool is_subprocess = false;
-#endif
+  bool is_subprocess = isSubprocess();
   if (!is_subprocess && RtsFlags.HpcFlags.writeTixFile) {
-    FILE *f = __rts_fopen(tixFilename,"w+");
-    writeTix(f);
+#if defined(THREADED_RTS)
+    stopHpcDumpThread();
+#endif
+    // See Note [Dumping tix files]
+    dumpTix();
   }
 
   freeStrHashTable(moduleHash, (void (*)(void *))freeHpcModuleInfo);
   moduleHash = NULL;
+  stgFree(dumped);
+  dumped = NULL;
+  n_dumped = 0;
+#if defined(THREADED_RTS)
+  if (!is_subprocess) {
+    closeCondition(&hpc_dump_cond);
+    closeMutex(&hpc_dump_mutex);
+  }
+#endif
 
   stgFree(tixFilename);
   tixFilename = NULL;
@@ -33,6 +33,22 @@
 #include "posix/Signals.h"
 #endif
 
+#if defined(IOMGR_ENABLED_URING)
+#include "Threads.h"
+#include "posix/Select.h"
+#include "posix/IOUring.h"
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+#include "posix/Select.h"
+#include "posix/EPoll.h"
+#endif
+
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
+#include "posix/TimerHeap.h"
+#endif
+
 #if defined(IOMGR_ENABLED_MIO_POSIX)
 #include "posix/Signals.h"
 #include "Prelude.h"
@@ -59,6 +75,7 @@
 #endif
 
 #include <string.h>
+#include <errno.h>
 
 
 /* We have lots of functions below with conditional implementations for
@@ -90,6 +107,13 @@ IOManagerType iomgr_type;
  * that uses the Windows native API HANDLEs, or one that uses Posix style fds.
  */
 bool rts_IOManagerIsWin32Native = false;
+#else
+/* Global var (not on Windows) that is exported to be shared with the mio
+ * event manager in the base library: whether it should keep the file
+ * descriptors it waits on registered edge-triggered. See the
+ * --io-manager-edge-triggered RTS flag.
+ */
+bool rts_IOManagerEdgeTriggered = false;
 #endif
 
 enum IOManagerAvailability
@@ -101,6 +125,26 @@ parseIOManagerFlag(const char *iomgrstr, IO_MANAGER_FLAG *flag)
         return IOManagerAvailable;
 #else
         return IOManagerUnavailable;
+#endif
+    }
+    else if (strcmp("uring", iomgrstr) == 0) {
+#if defined(IOMGR_ENABLED_URING)
+        *flag = IO_MNGR_FLAG_URING;
+        return IOManagerAvailable;
+#else
+        return IOManagerUnavailable;
+#endif
+    }
+    else if (strcmp("epoll", iomgrstr) == 0 ||
+             strcmp("kqueue", iomgrstr) == 0) {
+#if defined(IOMGR_ENABLED_EPOLL)
+        if (strcmp(IOMGR_EPOLL_NAME, iomgrstr) != 0) {
+            return IOManagerUnavailable;
+        }
+        *flag = IO_MNGR_FLAG_EPOLL;
+        return IOManagerAvailable;
+#else
+        return IOManagerUnavailable;
 #endif
     }
     else if (strcmp("mio", iomgrstr) == 0) {
@@ -177,7 +221,8 @@ parseIOManagerFlag(const char *iomgrstr, IO_MANAGER_FLAG *flag)
 
 /* Based on the I/O manager RTS flag, select an I/O manager to use.
  *
- * This fills in the iomgr_type and rts_IOManagerIsWin32Native globals.
+ * This fills in the iomgr_type, rts_IOManagerIsWin32Native and
+ * rts_IOManagerEdgeTriggered globals.
  * Must be called before the I/O manager is started.
  *
  * Called early in the RTS initialisation, after the RTS flags have been
@@ -200,7 +245,9 @@ void selectIOManager(void)
 #error No I/O default manager. See IOMGR_DEFAULT_THREADED_ flags
 #endif
 #else // !defined(THREADED_RTS)
-#if   defined(IOMGR_DEFAULT_NON_THREADED_SELECT)
+#if   defined(IOMGR_DEFAULT_NON_THREADED_EPOLL)
+            iomgr_type = IO_MANAGER_EPOLL;
+#elif defined(IOMGR_DEFAULT_NON_THREADED_SELECT)
             iomgr_type = IO_MANAGER_SELECT;
 #elif defined(IOMGR_DEFAULT_NON_THREADED_WINIO)
             iomgr_type = IO_MANAGER_WINIO;
@@ -218,6 +265,18 @@ void selectIOManager(void)
             break;
 #endif
 
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MNGR_FLAG_URING:
+            iomgr_type = IO_MANAGER_URING;
+            break;
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MNGR_FLAG_EPOLL:
+            iomgr_type = IO_MANAGER_EPOLL;
+            break;
+#endif
+
 #if defined(IOMGR_ENABLED_MIO_POSIX)
         case IO_MNGR_FLAG_MIO:
             iomgr_type = IO_MANAGER_MIO_POSIX;
@@ -246,6 +305,12 @@ void selectIOManager(void)
         default:
           barf("selectIOManager: %d", RtsFlags.MiscFlags.ioManager);
     }
+
+#if defined(IOMGR_ENABLED_MIO_POSIX)
+    if (iomgr_type == IO_MANAGER_MIO_POSIX) {
+        rts_IOManagerEdgeTriggered = RtsFlags.MiscFlags.ioManagerEdgeTriggered;
+    }
+#endif
 }
 
 
@@ -256,6 +321,14 @@ char * showIOManager(void)
         case IO_MANAGER_SELECT:
             return "select";
 #endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            return "uring";
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            return IOMGR_EPOLL_NAME;
+#endif
 #if defined(IOMGR_ENABLED_MIO_POSIX)
         case IO_MANAGER_MIO_POSIX:
             return "mio";
@@ -299,7 +372,21 @@ void initCapabilityIOManager(Capability *cap)
         case IO_MANAGER_SELECT:
             iomgr->blocked_queue_hd = END_TSO_QUEUE;
             iomgr->blocked_queue_tl = END_TSO_QUEUE;
-            iomgr->sleeping_queue   = END_TSO_QUEUE;
+            initTimerHeap(&iomgr->timers);
+            break;
+#endif
+
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            initTimerHeap(&iomgr->timers);
+            initURing(&iomgr->ring);
+            break;
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            initTimerHeap(&iomgr->timers);
+            initEPoll(&iomgr->epoll);
             break;
 #endif
 
@@ -331,8 +418,17 @@ void initIOManager(void)
 
     switch (iomgr_type) {
 
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
 #if defined(IOMGR_ENABLED_SELECT)
         case IO_MANAGER_SELECT:
+#endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
             /* Make the exception CAF a GC root. See initBuiltinGcRoots for
              * similar examples. We throw this exception if a thread tries to
              * wait on an invalid FD.
@@ -403,6 +499,22 @@ initIOManagerAfterFork(Capability **pcap)
              */
             ioManagerStartCap(pcap);
             break;
+#endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            /* The child shares the parent's rings, so it must not use them.
+             * It gets rings of its own. See Note [The io_uring I/O manager].
+             */
+            initURingAfterFork(&(*pcap)->iomgr->ring);
+            break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            /* The child shares the parent's epoll instance, so it must not
+             * use it. See Note [The epoll I/O manager].
+             */
+            initEPollAfterFork(&(*pcap)->iomgr->epoll);
+            break;
 #endif
         /* The IO_MANAGER_SELECT needs no initialisation */
 
@@ -469,6 +581,24 @@ void
 exitIOManager(bool wait_threads)
 {
     switch (iomgr_type) {
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                CapIOManager *iomgr = getCapability(i)->iomgr;
+                freeTimerHeap(&iomgr->timers);
+                exitURing(&iomgr->ring);
+            }
+            break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                CapIOManager *iomgr = getCapability(i)->iomgr;
+                freeTimerHeap(&iomgr->timers);
+                exitEPoll(&iomgr->epoll);
+            }
+            break;
+#endif
 #if defined(IOMGR_ENABLED_WINIO)
         case IO_MANAGER_WINIO:
             shutdownAsyncWinIO(wait_threads);
@@ -529,7 +659,27 @@ void markCapabilityIOManager(evac_fn evac, void *user, Capability *cap)
             CapIOManager *iomgr = cap->iomgr;
             evac(user, (StgClosure **)(void *)&iomgr->blocked_queue_hd);
             evac(user, (StgClosure **)(void *)&iomgr->blocked_queue_tl);
-            evac(user, (StgClosure **)(void *)&iomgr->sleeping_queue);
+            markTimerHeap(evac, user, &iomgr->timers);
+            break;
+        }
+#endif
+
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+        {
+            CapIOManager *iomgr = cap->iomgr;
+            markTimerHeap(evac, user, &iomgr->timers);
+            markURing(evac, user, &iomgr->ring);
+            break;
+        }
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+        {
+            CapIOManager *iomgr = cap->iomgr;
+            markTimerHeap(evac, user, &iomgr->timers);
+            markEPoll(evac, user, &iomgr->epoll);
             break;
         }
 #endif
@@ -555,8 +705,9 @@ void scavengeTSOIOManager(StgTSO *tso)
 
             /* case IO_MANAGER_SELECT:
              * BlockedOn{Read,Write} uses block_info.fd
-             * BlockedOnDelay        uses block_info.target
+             * BlockedOnDelay        uses block_info.timer
              * both of these are not GC pointers, so there is nothing to do.
+             * Likewise for IO_MANAGER_URING and IO_MANAGER_EPOLL.
              */
 
             /* case IO_MANAGER_WIN32_LEGACY:
@@ -600,7 +751,25 @@ bool anyPendingTimeoutsOrIO(Capability *cap)
         {
             CapIOManager *iomgr = cap->iomgr;
             return (iomgr->blocked_queue_hd != END_TSO_QUEUE)
-                || (iomgr->sleeping_queue   != END_TSO_QUEUE);
+                || !emptyTimerHeap(&iomgr->timers);
+        }
+#endif
+
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+        {
+            CapIOManager *iomgr = cap->iomgr;
+            return (iomgr->ring.n_waiting > 0)
+                || !emptyTimerHeap(&iomgr->timers);
+        }
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+        {
+            CapIOManager *iomgr = cap->iomgr;
+            return anyPendingEPoll(&iomgr->epoll)
+                || !emptyTimerHeap(&iomgr->timers);
         }
 #endif
 
@@ -661,6 +830,18 @@ void pollCompletedTimeoutsOrIO(Capability *cap)
           break;
 #endif
 
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+          awaitCompletedTimeoutsOrIOURing(cap, false);
+          break;
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+          awaitCompletedTimeoutsOrIOEPoll(cap, false);
+          break;
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY) || \
    (defined(IOMGR_ENABLED_WINIO) && !defined(THREADED_RTS))
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
@@ -688,6 +869,18 @@ void awaitCompletedTimeoutsOrIO(Capability *cap)
           break;
 #endif
 
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+          awaitCompletedTimeoutsOrIOURing(cap, true);
+          break;
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+          awaitCompletedTimeoutsOrIOEPoll(cap, true);
+          break;
+#endif
+
 #if defined(IOMGR_ENABLED_WIN32_LEGACY) || \
    (defined(IOMGR_ENABLED_WINIO) && !defined(THREADED_RTS))
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
@@ -725,6 +918,16 @@ void syncIOWaitReady(Capability   *cap,
             appendToIOBlockedQueue(cap, tso);
             break;
         }
+#endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            uringWaitReady(cap, tso, rw, fd);
+            break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            epollWaitReady(cap, tso, rw, fd);
+            break;
 #endif
         default:
             barf("waitRead# / waitWrite# not available for current I/O manager");
@@ -742,6 +945,16 @@ void syncIOCancel(Capability *cap, StgTSO *tso)
                                          &cap->iomgr->blocked_queue_tl, tso);
             break;
 #endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            uringCancel(cap, tso);
+            break;
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+            epollCancel(cap, tso);
+            break;
+#endif
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
         case IO_MANAGER_WIN32_LEGACY:
             removeThreadFromDeQueue(cap, &cap->iomgr->blocked_queue_hd,
@@ -755,9 +968,45 @@ void syncIOCancel(Capability *cap, StgTSO *tso)
 }
 
 
-#if defined(IOMGR_ENABLED_SELECT)
-static void insertIntoSleepingQueue(Capability *cap, StgTSO *tso, LowResTime target);
+HsInt syncIOTransfer(Capability   *cap,
+                     StgTSO       *tso,
+                     IOReadOrWrite rw,
+                     HsInt         fd,
+                     void         *buf,
+                     HsWord        len,
+                     HsInt         off)
+{
+    debugTrace(DEBUG_iomanager,
+               "thread %ld submitting %s of %lu bytes on fd %d",
+               (long) tso->id, rw == IORead ? "read" : "write",
+               (unsigned long) len, (int) fd);
+    ASSERT(tso->why_blocked == NotBlocked);
+    switch (iomgr_type) {
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            return uringTransfer(cap, tso, rw, fd, buf, len, off);
+#endif
+        default:
+            return -ENOSYS;
+    }
+}
+
+
+HsInt syncIOAccept(Capability *cap, StgTSO *tso,
+                   HsInt fd, void *addr, void *addrlen)
+{
+    debugTrace(DEBUG_iomanager, "thread %ld submitting accept on fd %d",
+               (long) tso->id, (int) fd);
+    ASSERT(tso->why_blocked == NotBlocked);
+    switch (iomgr_type) {
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+            return uringAccept(cap, tso, fd, addr, addrlen);
 #endif
+        default:
+            return -ENOSYS;
+    }
+}
 
 
 void syncDelay(Capability *cap, StgTSO *tso, HsInt us_delay)
@@ -765,15 +1014,20 @@ void syncDelay(Capability *cap, StgTSO *tso, HsInt us_delay)
     debugTrace(DEBUG_iomanager, "thread %ld waiting for %lld us", tso->id, us_delay);
     ASSERT(tso->why_blocked == NotBlocked);
     switch (iomgr_type) {
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
 #if defined(IOMGR_ENABLED_SELECT)
         case IO_MANAGER_SELECT:
-        {
-            LowResTime target = getDelayTarget(us_delay);
-            tso->block_info.target = target;
+#endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
+            insertTimer(&cap->iomgr->timers, tso, getDelayTarget(us_delay));
             RELEASE_STORE(&tso->why_blocked, BlockedOnDelay);
-            insertIntoSleepingQueue(cap, tso, target);
             break;
-        }
 #endif
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
         case IO_MANAGER_WIN32_LEGACY:
@@ -807,9 +1061,18 @@ void syncDelayCancel(Capability *cap, StgTSO *tso)
 {
     debugTrace(DEBUG_iomanager, "cancelling delay for thread %ld", (long) tso->id);
     switch (iomgr_type) {
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
 #if defined(IOMGR_ENABLED_SELECT)
         case IO_MANAGER_SELECT:
-            removeThreadFromQueue(cap, &cap->iomgr->sleeping_queue, tso);
+#endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
+            removeTimer(&cap->iomgr->timers, tso);
             break;
 #endif
         /* Note: no case for IO_MANAGER_WIN32_LEGACY despite it having a case
@@ -825,6 +1088,29 @@ void syncDelayCancel(Capability *cap, StgTSO *tso)
 }
 
 
+StgWord threadDelayTarget(Capability *cap, StgTSO *tso)
+{
+    switch (iomgr_type) {
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
+#if defined(IOMGR_ENABLED_SELECT)
+        case IO_MANAGER_SELECT:
+#endif
+#if defined(IOMGR_ENABLED_URING)
+        case IO_MANAGER_URING:
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+        case IO_MANAGER_EPOLL:
+#endif
+            return timerTarget(&cap->iomgr->timers, tso);
+#endif
+        default:
+            barf("threadDelayTarget not supported for I/O manager %d",
+                 iomgr_type);
+    }
+}
+
+
 #if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_WIN32_LEGACY)
 void appendToIOBlockedQueue(Capability *cap, StgTSO *tso)
 {
@@ -839,34 +1125,6 @@ void appendToIOBlockedQueue(Capability *cap, StgTSO *tso)
 }
 #endif
 
-#if defined(IOMGR_ENABLED_SELECT)
-/* Insert a thread into the queue of threads blocked on timers.
- *
- * This is used by the select() I/O manager implementation only.
- *
- * The sleeping queue is defined for other non-threaded I/O managers but not
- * used. This is a wart that should be excised.
- */
-// TODO: move to Select.c and rename
-static void insertIntoSleepingQueue(Capability *cap, StgTSO *tso, LowResTime target)
-{
-    CapIOManager *iomgr = cap->iomgr;
-    StgTSO *prev = NULL;
-    StgTSO *t = iomgr->sleeping_queue;
-    while (t != END_TSO_QUEUE && t->block_info.target < target) {
-        prev = t;
-        t = t->_link;
-    }
-
-    tso->_link = t;
-    if (prev == NULL) {
-        iomgr->sleeping_queue = tso;
-    } else {
-        setTSOLink(cap, prev, tso);
-    }
-}
-#endif
-
 /* Temporary compat helper function used in the Win32 I/O managers.
  * TODO: replace by consulting the iomgr_type global instead.
  */
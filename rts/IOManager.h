@@ -43,6 +43,21 @@
 #if defined(IOMGR_BUILD_SELECT) && !defined(THREADED_RTS)
     #define IOMGR_ENABLED_SELECT
 #endif
+#if defined(IOMGR_BUILD_URING) && !defined(THREADED_RTS)
+    #define IOMGR_ENABLED_URING
+#endif
+#if defined(IOMGR_BUILD_EPOLL) && !defined(THREADED_RTS)
+    #define IOMGR_ENABLED_EPOLL
+#endif
+
+/* The epoll I/O manager uses kqueue where there is no epoll, and goes by
+ * that name there.
+ */
+#if defined(HAVE_SYS_EPOLL_H)
+    #define IOMGR_EPOLL_NAME "epoll"
+#else
+    #define IOMGR_EPOLL_NAME "kqueue"
+#endif
 #if defined(IOMGR_BUILD_MIO) && defined(THREADED_RTS)
 /* For MIO, it is really two separate I/O manager implementations: one for
  * Windows and one for non-Windows. This is clear from both the C code on the
@@ -80,7 +95,9 @@
 #error No I/O default manager. See IOMGR_DEFAULT_THREADED_ flags
 #endif
 #else // !defined(THREADED_RTS)
-#if   defined(IOMGR_DEFAULT_NON_THREADED_SELECT)
+#if   defined(IOMGR_DEFAULT_NON_THREADED_EPOLL)
+    #define IOMGR_DEFAULT_STR IOMGR_EPOLL_NAME
+#elif defined(IOMGR_DEFAULT_NON_THREADED_SELECT)
     #define IOMGR_DEFAULT_STR "select"
 #elif defined(IOMGR_DEFAULT_NON_THREADED_WINIO)
     #define IOMGR_DEFAULT_STR "winio"
@@ -100,6 +117,16 @@
 #else
     #define IOMGR_ENABLED_STR_SELECT ""
 #endif
+#if defined(IOMGR_ENABLED_URING)
+    #define IOMGR_ENABLED_STR_URING " uring"
+#else
+    #define IOMGR_ENABLED_STR_URING ""
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+    #define IOMGR_ENABLED_STR_EPOLL " " IOMGR_EPOLL_NAME
+#else
+    #define IOMGR_ENABLED_STR_EPOLL ""
+#endif
 #if defined(IOMGR_ENABLED_MIO_POSIX) || defined(IOMGR_ENABLED_MIO_WIN32)
     #define IOMGR_ENABLED_STR_MIO " mio"
 #else
@@ -117,6 +144,8 @@
 #endif
 #define IOMGRS_ENABLED_STR \
           IOMGR_ENABLED_STR_SELECT \
+          IOMGR_ENABLED_STR_URING \
+          IOMGR_ENABLED_STR_EPOLL \
           IOMGR_ENABLED_STR_MIO \
           IOMGR_ENABLED_STR_WINIO \
           IOMGR_ENABLED_STR_WIN32_LEGACY
@@ -129,6 +158,12 @@ typedef enum {
 #if defined(IOMGR_ENABLED_SELECT)
     IO_MANAGER_SELECT,
 #endif
+#if defined(IOMGR_ENABLED_URING)
+    IO_MANAGER_URING,
+#endif
+#if defined(IOMGR_ENABLED_EPOLL)
+    IO_MANAGER_EPOLL,
+#endif
 #if defined(IOMGR_ENABLED_MIO_POSIX)
     IO_MANAGER_MIO_POSIX,
 #endif
@@ -152,6 +187,12 @@ extern IOManagerType iomgr_type;
  * that uses the Windows native API HANDLEs, or one that uses Posix style fds.
  */
 extern bool rts_IOManagerIsWin32Native;
+#else
+/* Global var (not on Windows) that is exported to be shared with the mio
+ * event manager in the base library: whether it should keep the file
+ * descriptors it waits on registered edge-triggered.
+ */
+extern bool rts_IOManagerEdgeTriggered;
 #endif
 
 
@@ -292,6 +333,27 @@ void syncDelay(Capability *cap, StgTSO *tso, HsInt us_delay);
 
 void syncDelayCancel(Capability *cap, StgTSO *tso);
 
+/* When a thread blocked in threadDelay is due to wake up, for debug output.
+ */
+StgWord threadDelayTarget(Capability *cap, StgTSO *tso);
+
+/* Asynchronous operations: the I/O manager does the I/O, rather than waiting
+ * for the fd to be ready for the thread to do it. The thread is suspended
+ * until the operation completes, with a stg_block_io_result frame on the
+ * stack in which the I/O manager stores the result: the count of bytes
+ * transferred, the accepted fd, or a negative errno.
+ *
+ * Return 0 if the thread is now suspended, or else (when the I/O manager
+ * does not support these operations) the negative errno to return at once.
+ *
+ * Used by the uringRead#, uringWrite# and uringAccept# primops.
+ */
+HsInt syncIOTransfer(Capability *cap, StgTSO *tso, IOReadOrWrite rw,
+                     HsInt fd, void *buf, HsWord len, HsInt off);
+
+HsInt syncIOAccept(Capability *cap, StgTSO *tso,
+                   HsInt fd, void *addr, void *addrlen);
+
 #if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_WIN32_LEGACY)
 /* Add a thread to the end of the queue of threads blocked on I/O.
  *
@@ -13,6 +13,9 @@
 #pragma once
 
 #include "IOManager.h"
+#include "posix/IOUring.h"
+#include "posix/EPoll.h"
+#include "posix/TimerHeap.h"
 
 #include "BeginPrivate.h"
 
@@ -31,9 +34,26 @@ struct _CapIOManager {
     /* Thread queue for threads blocked on I/O completion. */
     StgTSO *blocked_queue_hd;
     StgTSO *blocked_queue_tl;
+#endif
+
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
+    /* Heap of threads blocked on timeouts. See Note [The timer heap]. */
+    TimerHeap timers;
+#endif
 
-    /* Thread queue for threads blocked on timeouts. */
-    StgTSO *sleeping_queue;
+#if defined(IOMGR_ENABLED_URING)
+    /* The io_uring instance, and the threads waiting for operations
+     * submitted to it. See Note [The io_uring I/O manager].
+     */
+    URing ring;
+#endif
+
+#if defined(IOMGR_ENABLED_EPOLL)
+    /* The epoll (or kqueue) instance, and the threads waiting for it.
+     * See Note [The epoll I/O manager].
+     */
+    EPoll epoll;
 #endif
 
 #if defined(IOMGR_ENABLED_WIN32_LEGACY)
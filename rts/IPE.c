@@ -31,12 +31,9 @@
 /*
 Note [The Info Table Provenance Entry (IPE) Map]
 ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-IPEs are stored in a hash map from info table address (pointer) to IPE. This
-ensures cheap lookup and traversal.
-
-Unfortunately, inserting into the hash map is relatively expensive. To keep
-startup times low, there's a temporary data structure that is optimized for
-collecting IPE lists on registration.
+IPEs are found by info table address (pointer) through an index of the
+modules that registered them. To keep startup times low, there's a temporary
+data structure that is optimized for collecting IPE lists on registration.
 
 It's a singly linked list of IPE list buffers (IpeBufferListNode). These are
 emitted by the code generator, with generally one produced per module. Each
@@ -54,10 +51,39 @@ string table. This allows us to halve the size of the buffer entries on
 relocations, reducing linking cost. Moreover, the code generator takes care
 to deduplicate strings when generating the string table.
 
-Building the hash map is done lazily, i.e. on first lookup or traversal. For
-this all IPE lists of all IpeBufferListNode are traversed to insert all IPEs.
-This involves allocating a IpeMapEntry for each IPE entry, pointing to the
-entry's containing IpeBufferListNode and its index in that node.
+Building the index is done lazily, i.e. on first lookup or traversal, and
+costs little more than sorting each module's info tables; nothing is
+allocated per IPE:
+
+ - Each module (IpeBufferListNode) gets an IpeModule recording the lowest
+   and highest of its info tables and the order in which its entries would
+   be sorted by info table. The code generator usually emits the tables in
+   address order already, in which case no order is needed at all.
+
+ - The IpeIndex is an array of IpeModules sorted by their lowest table. A
+   lookup binary-searches it for the last module starting at or below the
+   info table, then the module itself. Modules' ranges needn't be disjoint
+   (e.g. with -split-sections the linker interleaves them), so each IpeModule
+   also records the highest table of any module up to and including it, and
+   the lookup walks back through the modules that might still cover the
+   address.
+
+ - If several entries are registered for one info table, a lookup finds the
+   last entry of the most recently indexed module.
+
+Registering more modules builds a new index from the old one and the pending
+list. The index is read without taking ipeIndexLock, so the old one is freed
+only once no lookup can still be using it, with the machinery of
+Note [Concurrent hash tables] in Hash.c.
+
+With --eager-ipe-index the index is built right after startup by a
+background thread, IPE_INDEX_CHUNK modules at a time, publishing a new index
+after each chunk. A lookup only waits if it misses while some modules are
+still unindexed, in which case it takes ipeIndexLock and indexes the rest
+itself; ipeUnindexedNodes tells it whether there are any, without locking.
+Decompressing the IPE data of a module (when it was compressed with zstd)
+happens when it is indexed, so this also takes decompression off the first
+lookup.
 
 When the user looks up an IPE entry, we convert it to the user-facing
 InfoProvEnt representation.
@@ -66,26 +92,66 @@ InfoProvEnt representation.
 
 typedef struct {
     IpeBufferListNode *node;
-    uint32_t idx;
-} IpeMapEntry;
+    const StgInfoTable *lo;     // lowest info table of node
+    const StgInfoTable *hi;     // highest info table of node
+    const StgInfoTable *reach;  // highest info table of this and earlier modules
+    uint32_t *order;            // node's entries sorted by info table, or NULL
+                                // if they already are
+    uint32_t seq;               // when the module was indexed
+} IpeModule;
+
+typedef struct {
+    uint32_t n_modules;
+    IpeModule modules[];        // sorted by lo, then newest first
+} IpeIndex;
 
 #if defined(THREADED_RTS)
-static Mutex ipeMapLock;
+static Mutex ipeIndexLock;
 #endif
-// Protected by ipeMapLock
-static HashTable *ipeMap = NULL;
+// Replaced with ipeIndexLock held, but read without it
+static IpeIndex *ipeIndex = NULL;
+// Protected by ipeIndexLock
+static uint32_t ipeModuleSeq = 0;
 
 // Accessed atomically
 static IpeBufferListNode *ipeBufferList = NULL;
 
+// Nodes taken off ipeBufferList but not yet indexed. Protected by
+// ipeIndexLock.
+static IpeBufferListNode *ipeUnindexed = NULL;
+
+// Nodes registered but not yet indexed, whichever list they are on.
+// Accessed atomically.
+static StgWord ipeUnindexedNodes = 0;
+
+// The bytes held by the index, with the orders of unsorted modules and the
+// decompressed tables of compressed ones. Updated with ipeIndexLock held,
+// but read without it.
+static StgWord ipeIndexBytes = 0;
+
+// Modules the background thread indexes at a time
+#define IPE_INDEX_CHUNK 256
+
 static void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode*);
-static void updateIpeMap(void);
+static void updateIpeIndex(void);
 
 #if defined(THREADED_RTS)
 
-void initIpe(void) { initMutex(&ipeMapLock); }
+static OSThreadId ipeIndexThread;
+static bool ipeIndexThreadRunning = false;
+// Accessed atomically
+static bool ipeIndexThreadStopping = false;
 
-void exitIpe(void) { closeMutex(&ipeMapLock); }
+void initIpe(void) { initMutex(&ipeIndexLock); }
+
+void exitIpe(void) {
+    if (ipeIndexThreadRunning) {
+        SEQ_CST_STORE(&ipeIndexThreadStopping, true);
+        joinOSThread(ipeIndexThread);
+        ipeIndexThreadRunning = false;
+    }
+    closeMutex(&ipeIndexLock);
+}
 
 #else
 
@@ -116,18 +182,70 @@ static InfoProvEnt ipeBufferEntryToIpe(const IpeBufferListNode *node, uint32_t i
     };
 }
 
+STATIC_INLINE const StgInfoTable *ipeModuleTable(const IpeModule *m, uint32_t k)
+{
+    return m->node->tables[m->order ? m->order[k] : k];
+}
 
-#if defined(TRACING)
-static void traceIPEFromHashTable(void *data STG_UNUSED, StgWord key STG_UNUSED,
-                                  const void *value) {
-    const IpeMapEntry *map_ent = (const IpeMapEntry *)value;
-    const InfoProvEnt ipe = ipeBufferEntryToIpe(map_ent->node, map_ent->idx);
-    traceIPE(&ipe);
+/* Find the last entry of m for info, returning its index in m->node or -1 */
+static int64_t lookupIpeModule(const IpeModule *m, const StgInfoTable *info)
+{
+    // find the first table above info
+    uint32_t lo = 0, hi = m->node->count;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if ((StgWord) ipeModuleTable(m, mid) <= (StgWord) info) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || ipeModuleTable(m, lo - 1) != info) {
+        return -1;
+    }
+    return m->order ? m->order[lo - 1] : lo - 1;
 }
 
-void dumpIPEToEventLog(void) {
-    // Dump pending entries
-    IpeBufferListNode *node = RELAXED_LOAD(&ipeBufferList);
+static bool lookupIpeIndex(const IpeIndex *index, const StgInfoTable *info,
+                           IpeBufferListNode **node, uint32_t *idx)
+{
+    // find the first module starting above info
+    uint32_t lo = 0, hi = index->n_modules;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if ((StgWord) index->modules[mid].lo <= (StgWord) info) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // then walk back through those that might cover it
+    const IpeModule *found = NULL;
+    for (uint32_t i = lo; i > 0; i--) {
+        const IpeModule *m = &index->modules[i - 1];
+        if ((StgWord) m->reach < (StgWord) info) {
+            break;
+        }
+        if ((StgWord) m->hi >= (StgWord) info
+            && (found == NULL || m->seq > found->seq)) {
+            const int64_t k = lookupIpeModule(m, info);
+            if (k >= 0) {
+                found = m;
+                *idx = (uint32_t) k;
+            }
+        }
+    }
+
+    if (found == NULL) {
+        return false;
+    }
+    *node = found->node;
+    return true;
+}
+
+#if defined(TRACING)
+static void traceIPEList(IpeBufferListNode *node) {
     while (node != NULL) {
         decompressIPEBufferListNodeIfCompressed(node);
 
@@ -137,13 +255,27 @@ void dumpIPEToEventLog(void) {
         }
         node = node->next;
     }
+}
+
+void dumpIPEToEventLog(void) {
+    // Keep the background thread from moving nodes between the lists
+    ACQUIRE_LOCK(&ipeIndexLock);
 
-    // Dump entries already in hashmap
-    ACQUIRE_LOCK(&ipeMapLock);
-    if (ipeMap != NULL) {
-        mapHashTable(ipeMap, NULL, &traceIPEFromHashTable);
+    // Dump pending entries
+    traceIPEList(RELAXED_LOAD(&ipeBufferList));
+    traceIPEList(ipeUnindexed);
+
+    // Dump entries already indexed
+    const IpeIndex *index = ipeIndex;
+    for (uint32_t i = 0; index != NULL && i < index->n_modules; i++) {
+        const IpeBufferListNode *node = index->modules[i].node;
+        for (uint32_t j = node->count; j > 0; j--) {
+            const InfoProvEnt ent = ipeBufferEntryToIpe(node, j - 1);
+            traceIPE(&ent);
+        }
     }
-    RELEASE_LOCK(&ipeMapLock);
+
+    RELEASE_LOCK(&ipeIndexLock);
 }
 
 
@@ -161,12 +293,14 @@ Note [The Info Table Provenance Entry (IPE) Map].
 Statically initialized IPE lists are registered at startup by a C constructor
 function generated by the compiler (CodeOutput.hs) in a *.c file for each
 module. Since this is called in a static initializer we cannot rely on
-ipeMapLock; we instead use atomic CAS operations to add to the list.
+ipeIndexLock; we instead use atomic CAS operations to add to the list.
 
 A performance test for IPE registration and lookup can be found here:
 https://gitlab.haskell.org/ghc/ghc/-/merge_requests/5724#note_370806
 */
 void registerInfoProvList(IpeBufferListNode *node) {
+    // Count the node before it can be taken off the list
+    atomic_inc((StgVolatilePtr) &ipeUnindexedNodes, 1);
     while (true) {
         IpeBufferListNode *old = RELAXED_LOAD(&ipeBufferList);
         node->next = old;
@@ -180,50 +314,201 @@ void formatClosureDescIpe(const InfoProvEnt *ipe_buf, char *str_buf) {
     snprintf(str_buf, CLOSURE_DESC_BUFFER_SIZE, "%u", ipe_buf->prov.closure_desc);
 }
 
+static bool searchIpeIndex(const StgInfoTable *info,
+                           IpeBufferListNode **node, uint32_t *idx) {
+    bool found = false;
+    // nodes outlive the index, so only the search needs protecting
+    const StgWord token = beginConcHashRead();
+    const IpeIndex *index = ACQUIRE_LOAD(&ipeIndex);
+    if (index != NULL) {
+        found = lookupIpeIndex(index, info, node, idx);
+    }
+    endConcHashRead(token);
+    return found;
+}
+
 bool lookupIPE(const StgInfoTable *info, InfoProvEnt *out) {
-    updateIpeMap();
-    IpeMapEntry *map_ent = (IpeMapEntry *) lookupHashTable(ipeMap, (StgWord)info);
-    if (map_ent) {
-        *out = ipeBufferEntryToIpe(map_ent->node, map_ent->idx);
-        return true;
-    } else {
-        return false;
+    IpeBufferListNode *node;
+    uint32_t idx;
+    bool found = searchIpeIndex(info, &node, &idx);
+
+    // Only a miss has to wait for the modules that aren't indexed yet
+    if (!found && SEQ_CST_LOAD(&ipeUnindexedNodes) != 0) {
+        updateIpeIndex();
+        found = searchIpeIndex(info, &node, &idx);
     }
+
+    if (found) {
+        *out = ipeBufferEntryToIpe(node, idx);
+    }
+    return found;
 }
 
-void updateIpeMap(void) {
-    // Check if there's any work at all. If not so, we can circumvent locking,
-    // which decreases performance.
-    IpeBufferListNode *pending = xchg_ptr((void **) &ipeBufferList, NULL);
-    if (ipeMap != NULL && pending == NULL) {
-        return;
+typedef struct {
+    const StgInfoTable *table;
+    uint32_t idx;
+} IpeSortEntry;
+
+static int compareIpeSortEntries(const void *a, const void *b) {
+    const IpeSortEntry *x = a, *y = b;
+    if (x->table != y->table) {
+        return (StgWord) x->table < (StgWord) y->table ? -1 : 1;
+    }
+    return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+static int compareIpeModules(const void *a, const void *b) {
+    const IpeModule *x = a, *y = b;
+    if (x->lo != y->lo) {
+        return (StgWord) x->lo < (StgWord) y->lo ? -1 : 1;
     }
+    return x->seq > y->seq ? -1 : x->seq < y->seq;
+}
 
-    ACQUIRE_LOCK(&ipeMapLock);
+static void indexIpeModule(IpeModule *m, IpeBufferListNode *node, uint32_t seq) {
+    const StgInfoTable **tables = node->tables;
+    const uint32_t count = node->count;
+    m->node = node;
+    m->order = NULL;
+    m->seq = seq;
 
-    if (ipeMap == NULL) {
-        ipeMap = allocHashTable();
+    bool sorted = true;
+    for (uint32_t i = 1; i < count && sorted; i++) {
+        sorted = (StgWord) tables[i - 1] <= (StgWord) tables[i];
     }
 
-    while (pending != NULL) {
-        IpeBufferListNode *node = pending;
+    if (!sorted) {
+        IpeSortEntry *ents = stgMallocBytes(count * sizeof(IpeSortEntry),
+                                            "indexIpeModule: ents");
+        for (uint32_t i = 0; i < count; i++) {
+            ents[i] = (IpeSortEntry) { .table = tables[i], .idx = i };
+        }
+        qsort(ents, count, sizeof(IpeSortEntry), compareIpeSortEntries);
+        m->order = stgMallocBytes(count * sizeof(uint32_t),
+                                  "indexIpeModule: order");
+        RELAXED_ADD(&ipeIndexBytes, count * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count; i++) {
+            m->order[i] = ents[i].idx;
+        }
+        stgFree(ents);
+    }
 
-        // Decompress if compressed
-        decompressIPEBufferListNodeIfCompressed(node);
+    m->lo = ipeModuleTable(m, 0);
+    m->hi = ipeModuleTable(m, count - 1);
+}
 
-        // Insert entries into ipeMap
-        IpeMapEntry *map_ents = stgMallocBytes(node->count * sizeof(IpeMapEntry), "updateIpeMap: ip_ents");
-        for (uint32_t i = 0; i < node->count; i++) {
-            const StgInfoTable *tbl = node->tables[i];
-            map_ents[i].node = node;
-            map_ents[i].idx = i;
-            insertHashTable(ipeMap, (StgWord) tbl, &map_ents[i]);
+/* Index up to max of the registered modules that aren't yet, returning
+ * whether there are more.  Called with ipeIndexLock held. */
+static bool indexIpeModules(uint32_t max) {
+    IpeBufferListNode *pending = xchg_ptr((void **) &ipeBufferList, NULL);
+    if (pending != NULL) {
+        IpeBufferListNode *last = pending;
+        while (last->next != NULL) {
+            last = last->next;
         }
+        last->next = ipeUnindexed;
+        ipeUnindexed = pending;
+    }
 
-        pending = node->next;
+    // Take the first max nodes off ipeUnindexed
+    pending = ipeUnindexed;
+    uint32_t n_taken = 0, n_pending = 0;
+    IpeBufferListNode *end = pending;
+    for (; end != NULL && n_taken < max; end = end->next) {
+        n_taken++;
+        n_pending += end->count > 0;
     }
+    ipeUnindexed = end;
+
+    IpeIndex *old = ipeIndex;
+    const uint32_t n_old = old ? old->n_modules : 0;
+
+    if (n_pending > 0) {
+        IpeIndex *index = stgMallocBytes(sizeof(IpeIndex)
+                                           + (n_old + n_pending) * sizeof(IpeModule),
+                                         "updateIpeIndex");
+        RELAXED_ADD(&ipeIndexBytes,
+                    sizeof(IpeIndex) + (n_old + n_pending) * sizeof(IpeModule));
+        if (old != NULL) {
+            memcpy(index->modules, old->modules, n_old * sizeof(IpeModule));
+        }
+
+        uint32_t n = n_old;
+        for (IpeBufferListNode *node = pending; node != end; node = node->next) {
+            if (node->count == 0) {
+                continue;
+            }
 
-    RELEASE_LOCK(&ipeMapLock);
+            // Decompress if compressed
+            decompressIPEBufferListNodeIfCompressed(node);
+
+            indexIpeModule(&index->modules[n++], node, ipeModuleSeq++);
+        }
+        index->n_modules = n;
+
+        qsort(index->modules, n, sizeof(IpeModule), compareIpeModules);
+        const StgInfoTable *reach = NULL;
+        for (uint32_t i = 0; i < n; i++) {
+            IpeModule *m = &index->modules[i];
+            if ((StgWord) m->hi > (StgWord) reach) {
+                reach = m->hi;
+            }
+            m->reach = reach;
+        }
+
+        RELEASE_STORE(&ipeIndex, index);
+        if (old != NULL) {
+            retireConcHashData(old, stgFree);
+            RELAXED_ADD(&ipeIndexBytes,
+                        -(StgWord) (sizeof(IpeIndex) + n_old * sizeof(IpeModule)));
+        }
+    }
+
+    // Only now may lookups that miss stop waiting for these nodes
+    atomic_dec((StgVolatilePtr) &ipeUnindexedNodes, n_taken);
+
+    return ipeUnindexed != NULL || RELAXED_LOAD(&ipeBufferList) != NULL;
+}
+
+void updateIpeIndex(void) {
+    // Check if there's any work at all. If not so, we can circumvent locking,
+    // which decreases performance.
+    if (SEQ_CST_LOAD(&ipeUnindexedNodes) == 0) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&ipeIndexLock);
+    while (indexIpeModules(UINT32_MAX)) {}
+    RELEASE_LOCK(&ipeIndexLock);
+}
+
+#if defined(THREADED_RTS)
+static void *ipeIndexThreadBody(void *arg STG_UNUSED) {
+    bool more = true;
+    while (more && !SEQ_CST_LOAD(&ipeIndexThreadStopping)) {
+        ACQUIRE_LOCK(&ipeIndexLock);
+        more = indexIpeModules(IPE_INDEX_CHUNK);
+        RELEASE_LOCK(&ipeIndexLock);
+    }
+    return NULL;
+}
+#endif
+
+/* Build the index now rather than on the first lookup, if --eager-ipe-index
+ * says so; see Note [The Info Table Provenance Entry (IPE) Map] */
+void startIpeIndexing(void) {
+    if (!RtsFlags.MiscFlags.eagerIpeIndex) {
+        return;
+    }
+#if defined(THREADED_RTS)
+    if (createAttachedOSThread(&ipeIndexThread, "ghc_ipe_index",
+                               ipeIndexThreadBody, NULL) == 0) {
+        ipeIndexThreadRunning = true;
+        return;
+    }
+    sysErrorBelch("can't start the IPE index thread; indexing now");
+#endif
+    updateIpeIndex();
 }
 
 /* Decompress the IPE data and strings table referenced by an IPE buffer list
@@ -247,7 +532,7 @@ void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode *node) {
         );
         char *decompressed_strings = stgMallocBytes(
             node->string_table_size,
-            "updateIpeMap: decompressed_strings"
+            "updateIpeIndex: decompressed_strings"
         );
         ZSTD_decompress(
             decompressed_strings,
@@ -256,6 +541,7 @@ void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode *node) {
             compressed_sz
         );
         node->string_table = (const char *) decompressed_strings;
+        RELAXED_ADD(&ipeIndexBytes, node->string_table_size);
 
         // Decompress the IPE data
         compressed_sz = ZSTD_findFrameCompressedSize(
@@ -264,7 +550,7 @@ void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode *node) {
         );
         void *decompressed_entries = stgMallocBytes(
             node->entries_size,
-            "updateIpeMap: decompressed_entries"
+            "updateIpeIndex: decompressed_entries"
         );
         ZSTD_decompress(
             decompressed_entries,
@@ -273,11 +559,17 @@ void decompressIPEBufferListNodeIfCompressed(IpeBufferListNode *node) {
             compressed_sz
         );
         node->entries = decompressed_entries;
+        RELAXED_ADD(&ipeIndexBytes, node->entries_size);
 #endif // HAVE_LIBZSTD == 0
 
     }
 }
 
+StgWord getIpeIndexBytes(void)
+{
+    return RELAXED_LOAD(&ipeIndexBytes);
+}
+
 #if defined(DEBUG)
 void printIPE(const StgInfoTable *info) {
     InfoProvEnt ipe;
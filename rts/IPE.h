@@ -16,5 +16,7 @@
 void dumpIPEToEventLog(void);
 void initIpe(void);
 void exitIpe(void);
+void startIpeIndexing(void);
+StgWord getIpeIndexBytes(void);
 
 #include "EndPrivate.h"
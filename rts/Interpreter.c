@@ -49,6 +49,7 @@ tag functions as tag inference currently doesn't rely on those being properly ta
 #include "Interpreter.h"
 #include "ThreadPaused.h"
 #include "Threads.h"
+#include "Hash.h"
 
 #include <string.h>     /* for memcpy */
 #if defined(HAVE_ERRNO_H)
@@ -73,6 +74,206 @@ tag functions as tag inference currently doesn't rely on those being properly ta
 
 /* #define INTERP_STATS */
 
+/* Note [Threaded interpreter dispatch]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   interpretBCO decodes the next instruction at nextInsn and jumps to its
+   code through the `switch` on the opcode. All instructions then share the
+   one indirect branch of the switch, which the CPU predicts poorly, as the
+   next opcode depends on the last one rather than on where we are in the
+   switch.
+
+   Where the C compiler supports computed goto (GCC and Clang), we instead
+   give the code of each instruction a label as well (INSTR), and jump
+   through a table of label addresses (dispatch_table). NEXT_INSN, which
+   ends each instruction, decodes the next one and jumps to its label
+   itself, so that each instruction has an indirect branch of its own,
+   which the CPU can predict from the instruction it ends. The switch stays
+   as it was, for other compilers and for the DEBUG and INTERP_STATS
+   builds, where nextInsn does more than decode the next instruction.
+
+   dispatch_table must have an entry for each INSTR of the switch; opcodes
+   without one go to the default case.
+*/
+
+/* Note [Bytecode superinstructions]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Every instruction costs a dispatch, however little work it does, and the
+   bytecode generator emits some short sequences of instructions a great
+   deal. A tail call, for instance, ends with
+
+       PUSH_L f; SLIDE n by; ENTER
+
+   and the evaluation of a local variable, the scrutinee of a case, say,
+   with PUSH_L x; ENTER. A superinstruction does the work of such a
+   sequence in one dispatch. We have
+
+       PUSH_L_ENTER o            = PUSH_L o; ENTER
+       SLIDE_ENTER n by          = SLIDE n by; ENTER
+       PUSH_L_SLIDE_ENTER o n by = PUSH_L o; SLIDE n by; ENTER
+
+   The peephole pass of GHC.StgToByteCode.mkProtoBCO selects them. Jumps
+   only ever go to the start of such a sequence (a LABEL would come between
+   the instructions otherwise, and then the peephole pass doesn't fuse
+   them), so fusing them doesn't change what any jump does.
+
+   To find out which other sequences are worth fusing, run a program that
+   spends its time in the interpreter with +RTS -Di on a DEBUG RTS: besides
+   tracing each instruction, the interpreter then counts the opcode pairs
+   and triples it executes, and interp_shutdown reports the most frequent
+   ones.
+*/
+
+/* Note [Interpreter inline caches]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The interpreter can't run compiled code itself: when it comes to a
+   closure of compiled code, a FUN it applies or a THUNK it evaluates, it
+   pushes the closure with stg_enter_info and returns to the scheduler,
+   which enters it. To get there it first examines the closure at eval,
+   then the frame on top of the stack at do_return_pointer, comparing its
+   info pointer with each of the stg_ap_* ones in turn, and then the closure
+   again at do_apply. When GHCi runs interpreted code on top of compiled
+   libraries, most of the calls that interpreted code makes go this way.
+
+   So each of the superinstructions that end in ENTER (see
+   Note [Bytecode superinstructions]) has an inline cache: a literal word,
+   initially 0, that the assembler allocates for it alone. When the slow
+   path above ends up handing a FUN or THUNK of compiled code to the
+   scheduler, it records the info pointer of the closure in the cache of the
+   instruction that entered it (ic). When the closure that the instruction
+   enters next time has the same info pointer, the instruction hands it to
+   the scheduler straight away.
+
+   This is always safe, even if the cached info pointer is out of date: the
+   compiled code we then run, stg_enter, can evaluate any closure, BCOs
+   included, and return it to any frame. The cache only ever holds the info
+   pointers of compiled FUNs and THUNKs, so it doesn't send closures that
+   the interpreter could run itself to the scheduler. The cache is a hint,
+   so capabilities write it without synchronisation.
+
+   The profiling interpreter does more than this with a FUN (see the FUN
+   case at eval), so it has no inline caches.
+*/
+
+#if !defined(PROFILING)
+#define INTERP_INLINE_CACHES
+#endif
+
+/* Note [Interpreter heap checks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Each instruction that builds a closure (ALLOC_AP, ALLOC_AP_NOUPD,
+   ALLOC_PAP and PACK) gets the memory for it from the nursery. allocate()
+   would check each time whether the object is a large one, whether the
+   current allocation block has room for it, and so on. Compiled code
+   instead does one heap check for all the closures that a basic block
+   builds, and then bumps Hp for each of them.
+
+   We do much the same: GHC.StgToByteCode.mkProtoBCO puts a
+
+       HEAPCHECK n_closures n_payload
+
+   before each straight-line run of instructions that builds more than one
+   closure (see bciStraightLine), where the run builds n_closures closures
+   with n_payload words of payload in all. HEAPCHECK asks reserveNursery()
+   for room for them in cap->r.rCurrentAlloc, taking a new block if need be,
+   and sets hp_reserved to how many words it reserved. The compiler doesn't
+   know how big the closure headers are, so HEAPCHECK bounds them with
+   INTERP_CLOSURE_OVERHEAD_W. The instructions that build the closures then
+   allocate from the reservation with allocateReserved(), which just bumps
+   the block's free pointer.
+
+   The reservation only holds as long as nothing else allocates from the
+   nursery, so we drop it (set hp_reserved to 0) at the start of each BCO,
+   after a foreign call, at a breakpoint, and whenever an allocation that
+   doesn't fit falls back to allocate(). Otherwise, within a BCO only the
+   instructions that build closures allocate, all through interpAllocate(),
+   so what is left of a reservation after its run is still good.
+*/
+
+// An upper bound on the words that a closure built by the interpreter takes,
+// besides its payload; see Note [Interpreter heap checks]
+#define INTERP_CLOSURE_OVERHEAD_W                                       \
+    stg_max(sizeofW(StgAP),                                             \
+            stg_max(sizeofW(StgPAP), sizeofW(StgHeader) + MIN_PAYLOAD_SIZE))
+
+// Allocate n words for a closure, from the words reserved by HEAPCHECK if
+// they are enough
+STATIC_INLINE StgPtr
+interpAllocate (Capability *cap, W_ *hp_reserved, W_ n)
+{
+    if (RTS_LIKELY(n <= *hp_reserved)) {
+        *hp_reserved -= n;
+        return allocateReserved(cap, n);
+    }
+    *hp_reserved = 0;
+    return allocate(cap, n);
+}
+
+#if defined(INTERP_INLINE_CACHES)
+// Whether closures with this info table are compiled code that an inline
+// cache may remember
+STATIC_INLINE bool icCacheable (const StgInfoTable *info)
+{
+    switch (info->type) {
+    case FUN:
+    case FUN_1_0:
+    case FUN_0_1:
+    case FUN_2_0:
+    case FUN_1_1:
+    case FUN_0_2:
+    case FUN_STATIC:
+    case THUNK:
+    case THUNK_1_0:
+    case THUNK_0_1:
+    case THUNK_2_0:
+    case THUNK_1_1:
+    case THUNK_0_2:
+    case THUNK_STATIC:
+    case THUNK_SELECTOR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// We are handing obj to the scheduler: remember it in the inline cache of
+// the instruction that entered it, if any
+#define IC_RECORD(obj)                                                  \
+    do {                                                                \
+        if (ic != NULL && icCacheable(get_itbl(obj))) {                 \
+            RELAXED_STORE(ic, (StgWord)(obj)->header.info);             \
+        }                                                               \
+    } while (0)
+
+#define IC_SET(o_ic) (ic = &BCO_LIT(o_ic))
+#else
+#define IC_RECORD(obj) /* nothing */
+#define IC_SET(o_ic) ((void)(o_ic))
+#endif
+
+#if defined(__GNUC__) && !defined(INTERP_NO_COMPUTED_GOTO)
+#define INTERP_COMPUTED_GOTO
+#endif
+
+#if defined(INTERP_COMPUTED_GOTO)
+#define INSTR(op) case op: lbl_##op
+#else
+#define INSTR(op) case op
+#endif
+
+#if defined(INTERP_COMPUTED_GOTO) && !defined(DEBUG) && !defined(INTERP_STATS)
+#define INTERP_THREADED_DISPATCH
+#endif
+
+#if defined(INTERP_THREADED_DISPATCH)
+#define NEXT_INSN                                       \
+    do {                                                \
+        bci = BCO_NEXT;                                 \
+        goto *dispatch_table[bci & 0xFF];               \
+    } while (0)
+#else
+#define NEXT_INSN goto nextInsn
+#endif
+
 
 /* Sp points to the lowest live word on the stack. */
 
@@ -171,15 +372,142 @@ tag functions as tag inference currently doesn't rely on those being properly ta
 #define SpW(n)       (*(StgWord*)(Sp_plusW(n)))
 #define SpB(n)       (*(StgWord*)(Sp_plusB(n)))
 
+/*
+ * a_1 ... a_n, b_1 ... b_by, k
+ *           =>
+ * a_1 ... a_n, k
+ */
+#define SLIDE_WORDS(n, by)                      \
+    do {                                        \
+        W_ i_ = (n);                            \
+        while (i_-- > 0) {                      \
+            SpW(i_+(by)) = SpW(i_);             \
+        }                                       \
+        Sp_addW(by);                            \
+        INTERP_TICK(it_slides);                 \
+    } while (0)
+
 STATIC_INLINE StgPtr
-allocate_NONUPD (Capability *cap, int n_words)
+allocate_NONUPD (Capability *cap, W_ *hp_reserved, int n_words)
 {
-    return allocate(cap, stg_max(sizeofW(StgHeader)+MIN_PAYLOAD_SIZE, n_words));
+    return interpAllocate(cap, hp_reserved,
+                          stg_max(sizeofW(StgHeader)+MIN_PAYLOAD_SIZE, n_words));
 }
 
 int rts_stop_next_breakpoint = 0;
 int rts_stop_on_exception = 0;
 
+#if defined(DEBUG)
+
+/* Opcode pair and triple frequencies, counted with -Di; see
+   Note [Bytecode superinstructions]. The pair a,b is counted under the key
+   a<<8|b and the triple a,b,c under a<<16|b<<8|c; there is no opcode 0, so
+   the keys of pairs and triples don't collide. */
+static HashTable *it_seqfreq = NULL;
+#if defined(THREADED_RTS)
+static Mutex it_seqfreq_mutex;
+#endif
+
+typedef struct {
+    StgWord key;
+    StgWord count;
+} SeqFreq;
+
+typedef struct {
+    SeqFreq *freqs;
+    uint32_t n_freqs;
+} SeqFreqs;
+
+static void interp_seq_startup ( void )
+{
+    if (RtsFlags.DebugFlags.interpreter) {
+        it_seqfreq = allocHashTable();
+#if defined(THREADED_RTS)
+        initMutex(&it_seqfreq_mutex);
+#endif
+    }
+}
+
+static void interp_seq_bump ( StgWord key )
+{
+    StgWord n = (StgWord)removeHashTable(it_seqfreq, key, NULL);
+    insertHashTable(it_seqfreq, key, (void*)(n + 1));
+}
+
+// Count the sequences that op3 ends, op1 and op2 being the opcodes before
+// it, or 0 at the start of a BCO.
+static void interp_seq_count ( StgWord op1, StgWord op2, StgWord op3 )
+{
+    if (it_seqfreq == NULL || op2 == 0) return;
+    ACQUIRE_LOCK(&it_seqfreq_mutex);
+    interp_seq_bump(op2 << 8 | op3);
+    if (op1 != 0) {
+        interp_seq_bump(op1 << 16 | op2 << 8 | op3);
+    }
+    RELEASE_LOCK(&it_seqfreq_mutex);
+}
+
+static void collectSeqFreq ( void *data, StgWord key, const void *value )
+{
+    SeqFreqs *seqs = data;
+    seqs->freqs[seqs->n_freqs].key = key;
+    seqs->freqs[seqs->n_freqs].count = (StgWord)value;
+    seqs->n_freqs++;
+}
+
+static int compareSeqFreqs ( const void *a, const void *b )
+{
+    const SeqFreq *fa = a, *fb = b;
+    if (fa->count != fb->count) return fa->count < fb->count ? 1 : -1;
+    return fa->key < fb->key ? -1 : fa->key > fb->key;
+}
+
+static void interp_seq_report ( void )
+{
+    uint32_t i, shown;
+    SeqFreqs seqs;
+
+    if (it_seqfreq == NULL) return;
+    seqs.freqs = stgMallocBytes(keyCountHashTable(it_seqfreq) * sizeof(SeqFreq),
+                                "interp_seq_report");
+    seqs.n_freqs = 0;
+    mapHashTable(it_seqfreq, &seqs, collectSeqFreq);
+    qsort(seqs.freqs, seqs.n_freqs, sizeof(SeqFreq), compareSeqFreqs);
+
+    debugBelch("most frequent opcode pairs:\n");
+    for (i = 0, shown = 0; i < seqs.n_freqs && shown < 20; i++) {
+        StgWord key = seqs.freqs[i].key;
+        if (key >> 16 != 0) continue;
+        debugBelch("  %2" FMT_Word " then %2" FMT_Word ": %" FMT_Word "\n",
+                   key >> 8, key & 0xFF, seqs.freqs[i].count);
+        shown++;
+    }
+    debugBelch("most frequent opcode triples:\n");
+    for (i = 0, shown = 0; i < seqs.n_freqs && shown < 20; i++) {
+        StgWord key = seqs.freqs[i].key;
+        if (key >> 16 == 0) continue;
+        debugBelch("  %2" FMT_Word " then %2" FMT_Word " then %2" FMT_Word
+                   ": %" FMT_Word "\n",
+                   key >> 16, (key >> 8) & 0xFF, key & 0xFF,
+                   seqs.freqs[i].count);
+        shown++;
+    }
+
+    stgFree(seqs.freqs);
+    freeHashTable(it_seqfreq, NULL);
+    it_seqfreq = NULL;
+#if defined(THREADED_RTS)
+    closeMutex(&it_seqfreq_mutex);
+#endif
+}
+
+#else // !DEBUG
+
+#define interp_seq_startup() /* nothing */
+#define interp_seq_report() /* nothing */
+
+#endif
+
 #if defined(INTERP_STATS)
 
 #define N_CODES 128
@@ -196,6 +524,7 @@ int it_retto_other;
 int it_slides;
 int it_insns;
 int it_BCO_entries;
+int it_ic_hits;
 
 int it_ofreq[N_CODES];
 int it_oofreq[N_CODES][N_CODES];
@@ -207,11 +536,12 @@ int it_lastopc;
 void interp_startup ( void )
 {
    int i, j;
+   interp_seq_startup();
    it_retto_BCO = it_retto_UPDATE = it_retto_other = 0;
    it_total_entries = it_total_unknown_entries = 0;
    for (i = 0; i < N_CLOSURE_TYPES; i++)
       it_unknown_entries[i] = 0;
-   it_slides = it_insns = it_BCO_entries = 0;
+   it_slides = it_insns = it_BCO_entries = it_ic_hits = 0;
    for (i = 0; i < N_CODES; i++) it_ofreq[i] = 0;
    for (i = 0; i < N_CODES; i++)
      for (j = 0; j < N_CODES; j++)
@@ -222,6 +552,7 @@ void interp_startup ( void )
 void interp_shutdown ( void )
 {
    int i, j, k, o_max, i_max, j_max;
+   interp_seq_report();
    debugBelch("%d constrs entered -> (%d BCO, %d UPD, %d ??? )\n",
                    it_retto_BCO + it_retto_UPDATE + it_retto_other,
                    it_retto_BCO, it_retto_UPDATE, it_retto_other );
@@ -234,8 +565,8 @@ void interp_shutdown ( void )
                         ((double)it_total_unknown_entries),
              it_unknown_entries[i]);
    }
-   debugBelch("%d insns, %d slides, %d BCO_entries\n",
-                   it_insns, it_slides, it_BCO_entries);
+   debugBelch("%d insns, %d slides, %d BCO_entries, %d inline cache hits\n",
+                   it_insns, it_slides, it_BCO_entries, it_ic_hits);
    for (i = 0; i < N_CODES; i++)
       debugBelch("opcode %2d got %d\n", i, it_ofreq[i] );
 
@@ -262,9 +593,11 @@ void interp_shutdown ( void )
 #else // !INTERP_STATS
 
 void interp_startup( void ){
+    interp_seq_startup();
 }
 
 void interp_shutdown( void ){
+    interp_seq_report();
 }
 
 #define INTERP_TICK(n) /* nothing */
@@ -343,6 +676,14 @@ interpretBCO (Capability* cap)
     register void *SpLim;  // local state -- stack lim pointer
     register StgClosure *tagged_obj = 0, *obj = NULL;
     uint32_t n, m;
+#if defined(INTERP_INLINE_CACHES)
+    // The inline cache of the instruction that entered the closure we are
+    // evaluating, if it has one; see Note [Interpreter inline caches]
+    StgWord *ic = NULL;
+#endif
+    // The words of the nursery reserved by the last HEAPCHECK; see
+    // Note [Interpreter heap checks]
+    W_ hp_reserved = 0;
 
     LOAD_THREAD_STATE();
 
@@ -575,6 +916,7 @@ eval_obj:
                  debugBelch("evaluating unknown closure -- yielding to sched\n");
                  printObj(obj);
             );
+        IC_RECORD(obj);
 #if defined(PROFILING)
         // restore the CCCS after evaluating the closure
         Sp_subW(2);
@@ -926,6 +1268,7 @@ do_apply:
         defer_apply_to_sched:
             IF_DEBUG(interpreter,
                      debugBelch("Cannot apply compiled function; yielding to scheduler\n"));
+            IC_RECORD(obj);
             Sp_subW(2);
             SpW(1) = (W_)tagged_obj;
             SpW(0) = (W_)&stg_enter_info;
@@ -1068,6 +1411,10 @@ run_BCO_fun:
     // scheduler again until the stack is in an orderly state).
 run_BCO:
     INTERP_TICK(it_BCO_entries);
+#if defined(INTERP_INLINE_CACHES)
+    ic = NULL;
+#endif
+    hp_reserved = 0;
     {
         register int       bciPtr = 0; /* instruction pointer */
         register StgWord16 bci;
@@ -1080,9 +1427,117 @@ run_BCO:
 
 #if defined(INTERP_STATS)
         it_lastopc = 0; /* no opcode */
+#endif
+#if defined(DEBUG)
+        // The two opcodes before the current one, for interp_seq_count
+        StgWord seq_op1 = 0, seq_op2 = 0;
+#endif
+
+#if defined(INTERP_COMPUTED_GOTO)
+        // See Note [Threaded interpreter dispatch]. The opcodes override
+        // the default entry.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+        static const void *const dispatch_table[256] = {
+            [0 ... 255] = &&lbl_default,
+            [bci_BRK_FUN] = &&lbl_bci_BRK_FUN,
+            [bci_STKCHECK] = &&lbl_bci_STKCHECK,
+            [bci_HEAPCHECK] = &&lbl_bci_HEAPCHECK,
+            [bci_PUSH_L] = &&lbl_bci_PUSH_L,
+            [bci_PUSH_LL] = &&lbl_bci_PUSH_LL,
+            [bci_PUSH_LLL] = &&lbl_bci_PUSH_LLL,
+            [bci_PUSH8] = &&lbl_bci_PUSH8,
+            [bci_PUSH16] = &&lbl_bci_PUSH16,
+            [bci_PUSH32] = &&lbl_bci_PUSH32,
+            [bci_PUSH8_W] = &&lbl_bci_PUSH8_W,
+            [bci_PUSH16_W] = &&lbl_bci_PUSH16_W,
+            [bci_PUSH32_W] = &&lbl_bci_PUSH32_W,
+            [bci_PUSH_G] = &&lbl_bci_PUSH_G,
+            [bci_PUSH_ALTS_P] = &&lbl_bci_PUSH_ALTS_P,
+            [bci_PUSH_ALTS_N] = &&lbl_bci_PUSH_ALTS_N,
+            [bci_PUSH_ALTS_F] = &&lbl_bci_PUSH_ALTS_F,
+            [bci_PUSH_ALTS_D] = &&lbl_bci_PUSH_ALTS_D,
+            [bci_PUSH_ALTS_L] = &&lbl_bci_PUSH_ALTS_L,
+            [bci_PUSH_ALTS_V] = &&lbl_bci_PUSH_ALTS_V,
+            [bci_PUSH_ALTS_T] = &&lbl_bci_PUSH_ALTS_T,
+            [bci_PUSH_APPLY_N] = &&lbl_bci_PUSH_APPLY_N,
+            [bci_PUSH_APPLY_V] = &&lbl_bci_PUSH_APPLY_V,
+            [bci_PUSH_APPLY_F] = &&lbl_bci_PUSH_APPLY_F,
+            [bci_PUSH_APPLY_D] = &&lbl_bci_PUSH_APPLY_D,
+            [bci_PUSH_APPLY_L] = &&lbl_bci_PUSH_APPLY_L,
+            [bci_PUSH_APPLY_P] = &&lbl_bci_PUSH_APPLY_P,
+            [bci_PUSH_APPLY_PP] = &&lbl_bci_PUSH_APPLY_PP,
+            [bci_PUSH_APPLY_PPP] = &&lbl_bci_PUSH_APPLY_PPP,
+            [bci_PUSH_APPLY_PPPP] = &&lbl_bci_PUSH_APPLY_PPPP,
+            [bci_PUSH_APPLY_PPPPP] = &&lbl_bci_PUSH_APPLY_PPPPP,
+            [bci_PUSH_APPLY_PPPPPP] = &&lbl_bci_PUSH_APPLY_PPPPPP,
+            [bci_PUSH_PAD8] = &&lbl_bci_PUSH_PAD8,
+            [bci_PUSH_PAD16] = &&lbl_bci_PUSH_PAD16,
+            [bci_PUSH_PAD32] = &&lbl_bci_PUSH_PAD32,
+            [bci_PUSH_UBX8] = &&lbl_bci_PUSH_UBX8,
+            [bci_PUSH_UBX16] = &&lbl_bci_PUSH_UBX16,
+            [bci_PUSH_UBX32] = &&lbl_bci_PUSH_UBX32,
+            [bci_PUSH_UBX] = &&lbl_bci_PUSH_UBX,
+            [bci_SLIDE] = &&lbl_bci_SLIDE,
+            [bci_ALLOC_AP] = &&lbl_bci_ALLOC_AP,
+            [bci_ALLOC_AP_NOUPD] = &&lbl_bci_ALLOC_AP_NOUPD,
+            [bci_ALLOC_PAP] = &&lbl_bci_ALLOC_PAP,
+            [bci_MKAP] = &&lbl_bci_MKAP,
+            [bci_MKPAP] = &&lbl_bci_MKPAP,
+            [bci_UNPACK] = &&lbl_bci_UNPACK,
+            [bci_PACK] = &&lbl_bci_PACK,
+            [bci_TESTLT_P] = &&lbl_bci_TESTLT_P,
+            [bci_TESTEQ_P] = &&lbl_bci_TESTEQ_P,
+            [bci_TESTLT_I] = &&lbl_bci_TESTLT_I,
+            [bci_TESTLT_I64] = &&lbl_bci_TESTLT_I64,
+            [bci_TESTLT_I32] = &&lbl_bci_TESTLT_I32,
+            [bci_TESTLT_I16] = &&lbl_bci_TESTLT_I16,
+            [bci_TESTLT_I8] = &&lbl_bci_TESTLT_I8,
+            [bci_TESTEQ_I] = &&lbl_bci_TESTEQ_I,
+            [bci_TESTEQ_I64] = &&lbl_bci_TESTEQ_I64,
+            [bci_TESTEQ_I32] = &&lbl_bci_TESTEQ_I32,
+            [bci_TESTEQ_I16] = &&lbl_bci_TESTEQ_I16,
+            [bci_TESTEQ_I8] = &&lbl_bci_TESTEQ_I8,
+            [bci_TESTLT_W] = &&lbl_bci_TESTLT_W,
+            [bci_TESTLT_W64] = &&lbl_bci_TESTLT_W64,
+            [bci_TESTLT_W32] = &&lbl_bci_TESTLT_W32,
+            [bci_TESTLT_W16] = &&lbl_bci_TESTLT_W16,
+            [bci_TESTLT_W8] = &&lbl_bci_TESTLT_W8,
+            [bci_TESTEQ_W] = &&lbl_bci_TESTEQ_W,
+            [bci_TESTEQ_W64] = &&lbl_bci_TESTEQ_W64,
+            [bci_TESTEQ_W32] = &&lbl_bci_TESTEQ_W32,
+            [bci_TESTEQ_W16] = &&lbl_bci_TESTEQ_W16,
+            [bci_TESTEQ_W8] = &&lbl_bci_TESTEQ_W8,
+            [bci_TESTLT_D] = &&lbl_bci_TESTLT_D,
+            [bci_TESTEQ_D] = &&lbl_bci_TESTEQ_D,
+            [bci_TESTLT_F] = &&lbl_bci_TESTLT_F,
+            [bci_TESTEQ_F] = &&lbl_bci_TESTEQ_F,
+            [bci_ENTER] = &&lbl_bci_ENTER,
+            [bci_PUSH_L_ENTER] = &&lbl_bci_PUSH_L_ENTER,
+            [bci_SLIDE_ENTER] = &&lbl_bci_SLIDE_ENTER,
+            [bci_PUSH_L_SLIDE_ENTER] = &&lbl_bci_PUSH_L_SLIDE_ENTER,
+            [bci_RETURN_P] = &&lbl_bci_RETURN_P,
+            [bci_RETURN_N] = &&lbl_bci_RETURN_N,
+            [bci_RETURN_F] = &&lbl_bci_RETURN_F,
+            [bci_RETURN_D] = &&lbl_bci_RETURN_D,
+            [bci_RETURN_L] = &&lbl_bci_RETURN_L,
+            [bci_RETURN_V] = &&lbl_bci_RETURN_V,
+            [bci_RETURN_T] = &&lbl_bci_RETURN_T,
+            [bci_BCO_NAME] = &&lbl_bci_BCO_NAME,
+            [bci_SWIZZLE] = &&lbl_bci_SWIZZLE,
+            [bci_PRIMCALL] = &&lbl_bci_PRIMCALL,
+            [bci_CCALL] = &&lbl_bci_CCALL,
+            [bci_JMP] = &&lbl_bci_JMP,
+            [bci_CASEFAIL] = &&lbl_bci_CASEFAIL,
+        };
+#pragma GCC diagnostic pop
 #endif
 
+    // With INTERP_THREADED_DISPATCH, NEXT_INSN dispatches by itself and
+    // nothing jumps here
+#if !defined(INTERP_THREADED_DISPATCH)
     nextInsn:
+#endif
         ASSERT(bciPtr < bcoSize);
         IF_DEBUG(interpreter,
                  //if (do_print_stack) {
@@ -1112,16 +1567,30 @@ run_BCO:
         it_lastopc = (int)instrs[bciPtr];
 #endif
 
+#if defined(DEBUG)
+        if (RtsFlags.DebugFlags.interpreter) {
+            StgWord op = instrs[bciPtr] & 0xFF;
+            interp_seq_count(seq_op1, seq_op2, op);
+            seq_op1 = seq_op2;
+            seq_op2 = op;
+        }
+#endif
+
         bci = BCO_NEXT;
     /* We use the high 8 bits for flags, only the highest of which is
      * currently allocated */
     ASSERT((bci & 0xFF00) == (bci & 0x8000));
 
+#if defined(INTERP_COMPUTED_GOTO)
+    goto *dispatch_table[bci & 0xFF];
+#endif
+
     switch (bci & 0xFF) {
 
         /* check for a breakpoint on the beginning of a let binding */
-        case bci_BRK_FUN:
+        INSTR(bci_BRK_FUN):
         {
+            hp_reserved = 0;
             int arg1_brk_array, arg2_tick_mod, arg3_info_mod, arg4_tick_index, arg5_info_index;
 #if defined(PROFILING)
             int arg6_cc;
@@ -1250,10 +1719,10 @@ run_BCO:
             cap->r.rCurrentTSO->flags &= ~TSO_STOPPED_ON_BREAKPOINT;
 
             // continue normal execution of the byte code instructions
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_STKCHECK: {
+        INSTR(bci_STKCHECK): {
             // Explicit stack check at the beginning of a function
             // *only* (stack checks in case alternatives are
             // propagated to the enclosing function).
@@ -1264,27 +1733,36 @@ run_BCO:
                 SpW(0) = (W_)&stg_apply_interp_info;
                 RETURN_TO_SCHEDULER(ThreadInterpret, StackOverflow);
             } else {
-                goto nextInsn;
+                NEXT_INSN;
             }
         }
 
-        case bci_PUSH_L: {
+        INSTR(bci_HEAPCHECK): {
+            // See Note [Interpreter heap checks]
+            W_ n_closures = BCO_GET_LARGE_ARG;
+            W_ n_payload  = BCO_GET_LARGE_ARG;
+            W_ n = n_payload + n_closures * INTERP_CLOSURE_OVERHEAD_W;
+            hp_reserved = reserveNursery(cap, n) ? n : 0;
+            NEXT_INSN;
+        }
+
+        INSTR(bci_PUSH_L): {
             W_ o1 = BCO_GET_LARGE_ARG;
             SpW(-1) = SpW(o1);
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_LL: {
+        INSTR(bci_PUSH_LL): {
             W_ o1 = BCO_GET_LARGE_ARG;
             W_ o2 = BCO_GET_LARGE_ARG;
             SpW(-1) = SpW(o1);
             SpW(-2) = SpW(o2);
             Sp_subW(2);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_LLL: {
+        INSTR(bci_PUSH_LLL): {
             W_ o1 = BCO_GET_LARGE_ARG;
             W_ o2 = BCO_GET_LARGE_ARG;
             W_ o3 = BCO_GET_LARGE_ARG;
@@ -1292,52 +1770,52 @@ run_BCO:
             SpW(-2) = SpW(o2);
             SpW(-3) = SpW(o3);
             Sp_subW(3);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH8: {
+        INSTR(bci_PUSH8): {
             W_ off = BCO_GET_LARGE_ARG;
             Sp_subB(1);
             *(StgWord8*)Sp = *(StgWord8*)(Sp_plusB(off+1));
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH16: {
+        INSTR(bci_PUSH16): {
             W_ off = BCO_GET_LARGE_ARG;
             Sp_subB(2);
             *(StgWord16*)Sp = *(StgWord16*)(Sp_plusB(off+2));
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH32: {
+        INSTR(bci_PUSH32): {
             W_ off = BCO_GET_LARGE_ARG;
             Sp_subB(4);
             *(StgWord32*)Sp = *(StgWord32*)(Sp_plusB(off+4));
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH8_W: {
+        INSTR(bci_PUSH8_W): {
             W_ off = BCO_GET_LARGE_ARG;
             *(StgWord8*)(Sp_minusW(1)) = *(StgWord8*)(Sp_plusB(off));
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH16_W: {
+        INSTR(bci_PUSH16_W): {
             W_ off = BCO_GET_LARGE_ARG;
             *(StgWord16*)(Sp_minusW(1)) = *(StgWord16*)(Sp_plusB(off));
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH32_W: {
+        INSTR(bci_PUSH32_W): {
             W_ off = BCO_GET_LARGE_ARG;
             *(StgWord32*)(Sp_minusW(1)) = *(StgWord32*)(Sp_plusB(off));
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_G: {
+        INSTR(bci_PUSH_G): {
             W_ o1 = BCO_GET_LARGE_ARG;
             StgClosure *tagged_obj = (StgClosure*) BCO_PTR(o1);
 
@@ -1376,10 +1854,10 @@ run_BCO:
 
             SpW(-1) = (W_) tagged_obj;
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_P: {
+        INSTR(bci_PUSH_ALTS_P): {
             W_ o_bco  = BCO_GET_LARGE_ARG;
             Sp_subW(2);
             SpW(1) = BCO_PTR(o_bco);
@@ -1389,10 +1867,10 @@ run_BCO:
             SpW(1) = (W_)cap->r.rCCCS;
             SpW(0) = (W_)&stg_restore_cccs_d_info;
 #endif
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_N: {
+        INSTR(bci_PUSH_ALTS_N): {
             W_ o_bco  = BCO_GET_LARGE_ARG;
             SpW(-2) = (W_)&stg_ctoi_R1n_info;
             SpW(-1) = BCO_PTR(o_bco);
@@ -1402,10 +1880,10 @@ run_BCO:
             SpW(1) = (W_)cap->r.rCCCS;
             SpW(0) = (W_)&stg_restore_cccs_d_info;
 #endif
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_F: {
+        INSTR(bci_PUSH_ALTS_F): {
             W_ o_bco  = BCO_GET_LARGE_ARG;
             SpW(-2) = (W_)&stg_ctoi_F1_info;
             SpW(-1) = BCO_PTR(o_bco);
@@ -1415,10 +1893,10 @@ run_BCO:
             SpW(1) = (W_)cap->r.rCCCS;
             SpW(0) = (W_)&stg_restore_cccs_d_info;
 #endif
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_D: {
+        INSTR(bci_PUSH_ALTS_D): {
             W_ o_bco  = BCO_GET_LARGE_ARG;
             SpW(-2) = (W_)&stg_ctoi_D1_info;
             SpW(-1) = BCO_PTR(o_bco);
@@ -1428,10 +1906,10 @@ run_BCO:
             SpW(1) = (W_)cap->r.rCCCS;
             SpW(0) = (W_)&stg_restore_cccs_d_info;
 #endif
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_L: {
+        INSTR(bci_PUSH_ALTS_L): {
             W_ o_bco  = BCO_GET_LARGE_ARG;
             SpW(-2) = (W_)&stg_ctoi_L1_info;
             SpW(-1) = BCO_PTR(o_bco);
@@ -1441,10 +1919,10 @@ run_BCO:
             SpW(1) = (W_)cap->r.rCCCS;
             SpW(0) = (W_)&stg_restore_cccs_d_info;
 #endif
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_V: {
+        INSTR(bci_PUSH_ALTS_V): {
             W_ o_bco  = BCO_GET_LARGE_ARG;
             SpW(-2) = (W_)&stg_ctoi_V_info;
             SpW(-1) = BCO_PTR(o_bco);
@@ -1454,10 +1932,10 @@ run_BCO:
             SpW(1) = (W_)cap->r.rCCCS;
             SpW(0) = (W_)&stg_restore_cccs_d_info;
 #endif
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_ALTS_T: {
+        INSTR(bci_PUSH_ALTS_T): {
             W_ o_bco = BCO_GET_LARGE_ARG;
             W_ tuple_info = (W_)BCO_LIT(BCO_GET_LARGE_ARG);
             W_ o_tuple_bco = BCO_GET_LARGE_ARG;
@@ -1548,83 +2026,83 @@ run_BCO:
 
             SpW(-4) = ctoi_t_offset;
             Sp_subW(4);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_APPLY_N:
+        INSTR(bci_PUSH_APPLY_N):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_n_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_V:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_V):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_v_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_F:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_F):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_f_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_D:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_D):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_d_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_L:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_L):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_l_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_P:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_P):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_p_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_PP:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_PP):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_pp_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_PPP:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_PPP):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_ppp_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_PPPP:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_PPPP):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_pppp_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_PPPPP:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_PPPPP):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_ppppp_info;
-            goto nextInsn;
-        case bci_PUSH_APPLY_PPPPPP:
+            NEXT_INSN;
+        INSTR(bci_PUSH_APPLY_PPPPPP):
             Sp_subW(1); SpW(0) = (W_)&stg_ap_pppppp_info;
-            goto nextInsn;
+            NEXT_INSN;
 
-        case bci_PUSH_PAD8: {
+        INSTR(bci_PUSH_PAD8): {
             Sp_subB(1);
             *(StgWord8*)Sp = 0;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_PAD16: {
+        INSTR(bci_PUSH_PAD16): {
             Sp_subB(2);
             *(StgWord16*)Sp = 0;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_PAD32: {
+        INSTR(bci_PUSH_PAD32): {
             Sp_subB(4);
             *(StgWord32*)Sp = 0;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_UBX8: {
+        INSTR(bci_PUSH_UBX8): {
             W_ o_lit = BCO_GET_LARGE_ARG;
             Sp_subB(1);
             *(StgWord8*)Sp = *(StgWord8*)(literals+o_lit);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_UBX16: {
+        INSTR(bci_PUSH_UBX16): {
             W_ o_lit = BCO_GET_LARGE_ARG;
             Sp_subB(2);
             *(StgWord16*)Sp = *(StgWord16*)(literals+o_lit);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_UBX32: {
+        INSTR(bci_PUSH_UBX32): {
             W_ o_lit = BCO_GET_LARGE_ARG;
             Sp_subB(4);
             *(StgWord32*)Sp = *(StgWord32*)(literals+o_lit);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PUSH_UBX: {
+        INSTR(bci_PUSH_UBX): {
             W_ i;
             W_ o_lits = BCO_GET_LARGE_ARG;
             W_ n_words = BCO_GET_LARGE_ARG;
@@ -1632,28 +2110,20 @@ run_BCO:
             for (i = 0; i < n_words; i++) {
                 SpW(i) = (W_)BCO_LIT(o_lits+i);
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_SLIDE: {
+        INSTR(bci_SLIDE): {
             W_ n  = BCO_GET_LARGE_ARG;
             W_ by = BCO_GET_LARGE_ARG;
-            /*
-             * a_1 ... a_n, b_1 ... b_by, k
-             *           =>
-             * a_1 ... a_n, k
-             */
-            while(n-- > 0) {
-                SpW(n+by) = SpW(n);
-            }
-            Sp_addW(by);
-            INTERP_TICK(it_slides);
-            goto nextInsn;
+            SLIDE_WORDS(n, by);
+            NEXT_INSN;
         }
 
-        case bci_ALLOC_AP: {
+        INSTR(bci_ALLOC_AP): {
             StgHalfWord n_payload = BCO_GET_LARGE_ARG;
-            StgAP *ap = (StgAP*)allocate(cap, AP_sizeW(n_payload));
+            StgAP *ap = (StgAP*)interpAllocate(cap, &hp_reserved,
+                                               AP_sizeW(n_payload));
             SpW(-1) = (W_)ap;
             ap->n_args = n_payload;
             ap->arity = 0;
@@ -1661,12 +2131,13 @@ run_BCO:
             // visible only from our stack
             SET_HDR(ap, &stg_AP_info, cap->r.rCCCS)
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_ALLOC_AP_NOUPD: {
+        INSTR(bci_ALLOC_AP_NOUPD): {
             StgHalfWord n_payload = BCO_GET_LARGE_ARG;
-            StgAP *ap = (StgAP*)allocate(cap, AP_sizeW(n_payload));
+            StgAP *ap = (StgAP*)interpAllocate(cap, &hp_reserved,
+                                               AP_sizeW(n_payload));
             SpW(-1) = (W_)ap;
             ap->n_args = n_payload;
             ap->arity = 0;
@@ -1674,14 +2145,15 @@ run_BCO:
             // visible only from our stack
             SET_HDR(ap, &stg_AP_NOUPD_info, cap->r.rCCCS)
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_ALLOC_PAP: {
+        INSTR(bci_ALLOC_PAP): {
             StgPAP* pap;
             StgHalfWord arity = BCO_GET_LARGE_ARG;
             StgHalfWord n_payload = BCO_GET_LARGE_ARG;
-            pap = (StgPAP*)allocate(cap, PAP_sizeW(n_payload));
+            pap = (StgPAP*)interpAllocate(cap, &hp_reserved,
+                                          PAP_sizeW(n_payload));
             SpW(-1) = (W_)pap;
             pap->n_args = n_payload;
             pap->arity = arity;
@@ -1689,10 +2161,10 @@ run_BCO:
             // visible only from our stack
             SET_HDR(pap, &stg_PAP_info, cap->r.rCCCS)
             Sp_subW(1);
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_MKAP: {
+        INSTR(bci_MKAP): {
             StgHalfWord i;
             W_ stkoff = BCO_GET_LARGE_ARG;
             StgHalfWord n_payload = BCO_GET_LARGE_ARG;
@@ -1713,10 +2185,10 @@ run_BCO:
                      debugBelch("\tBuilt ");
                      printObj((StgClosure*)ap);
                 );
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_MKPAP: {
+        INSTR(bci_MKPAP): {
             StgHalfWord i;
             W_ stkoff = BCO_GET_LARGE_ARG;
             StgHalfWord n_payload = BCO_GET_LARGE_ARG;
@@ -1740,10 +2212,10 @@ run_BCO:
                      debugBelch("\tBuilt ");
                      printObj((StgClosure*)pap);
                 );
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_UNPACK: {
+        INSTR(bci_UNPACK): {
             /* Unpack N ptr words from t.o.s constructor */
             W_ i;
             W_ n_words = BCO_GET_LARGE_ARG;
@@ -1752,17 +2224,17 @@ run_BCO:
             for (i = 0; i < n_words; i++) {
                 SpW(i) = (W_)con->payload[i];
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PACK: {
+        INSTR(bci_PACK): {
             W_ o_itbl         = BCO_GET_LARGE_ARG;
             W_ n_words        = BCO_GET_LARGE_ARG;
             StgConInfoTable* itbl = CON_INFO_PTR_TO_STRUCT((StgInfoTable *)BCO_LIT(o_itbl));
             W_ n_ptrs         = itbl->i.layout.payload.ptrs;
             W_ n_nptrs        = itbl->i.layout.payload.nptrs;
             W_ request        = CONSTR_sizeW( n_ptrs, n_nptrs );
-            StgClosure* con = (StgClosure*)allocate_NONUPD(cap,request);
+            StgClosure* con = (StgClosure*)allocate_NONUPD(cap,&hp_reserved,request);
             ASSERT(ip_HNF(&itbl->i)); // We don't have a CON flag, HNF is a good approximation
                                       // N.
             // N.B. we may have a nullary datacon with padding, in which case
@@ -1787,220 +2259,220 @@ run_BCO:
                      debugBelch("\tBuilt ");
                      printObj((StgClosure*)tagged_con);
                 );
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_P: {
+        INSTR(bci_TESTLT_P): {
             unsigned int discr  = BCO_NEXT;
             int failto = BCO_GET_LARGE_ARG;
             StgClosure* con = UNTAG_CLOSURE((StgClosure*)SpW(0));
             if (GET_TAG(con) >= discr) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_P: {
+        INSTR(bci_TESTEQ_P): {
             unsigned int discr  = BCO_NEXT;
             int failto = BCO_GET_LARGE_ARG;
             StgClosure* con = UNTAG_CLOSURE((StgClosure*)SpW(0));
             if (GET_TAG(con) != discr) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_I: {
+        INSTR(bci_TESTLT_I): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             I_ stackInt = (I_)SpW(0);
             if (stackInt >= (I_)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_I64: {
+        INSTR(bci_TESTLT_I64): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt64 stackInt = (*(StgInt64*)Sp);
             if (stackInt >= BCO_LITI64(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_I32: {
+        INSTR(bci_TESTLT_I32): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt32 stackInt = (*(StgInt32*)Sp);
             if (stackInt >= (StgInt32)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_I16: {
+        INSTR(bci_TESTLT_I16): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt16 stackInt = (*(StgInt16*)Sp);
             if (stackInt >= (StgInt16)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_I8: {
+        INSTR(bci_TESTLT_I8): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt8 stackInt = (*(StgInt8*)Sp);
             if (stackInt >= (StgInt8)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_I: {
+        INSTR(bci_TESTEQ_I): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             I_ stackInt = (I_)SpW(0);
             if (stackInt != (I_)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_I64: {
+        INSTR(bci_TESTEQ_I64): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt64 stackInt = (*(StgInt64*)Sp);
             if (stackInt != BCO_LITI64(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_I32: {
+        INSTR(bci_TESTEQ_I32): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt32 stackInt = (*(StgInt32*)Sp);
             if (stackInt != (StgInt32)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_I16: {
+        INSTR(bci_TESTEQ_I16): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt16 stackInt = (*(StgInt16*)Sp);
             if (stackInt != (StgInt16)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_I8: {
+        INSTR(bci_TESTEQ_I8): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgInt8 stackInt = (*(StgInt8*)Sp);
             if (stackInt != (StgInt8)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_W: {
+        INSTR(bci_TESTLT_W): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             W_ stackWord = (W_)SpW(0);
             if (stackWord >= (W_)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_W64: {
+        INSTR(bci_TESTLT_W64): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord64 stackWord = (*(StgWord64*)Sp);
             if (stackWord >= BCO_LITW64(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_W32: {
+        INSTR(bci_TESTLT_W32): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord32 stackWord = (*(StgWord32*)Sp);
             if (stackWord >= (StgWord32)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_W16: {
+        INSTR(bci_TESTLT_W16): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord16 stackWord = (*(StgWord16*)Sp);
             if (stackWord >= (StgWord16)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_W8: {
+        INSTR(bci_TESTLT_W8): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord8 stackWord = (*(StgWord8*)Sp);
             if (stackWord >= (StgWord8)BCO_LIT(discr))
                 bciPtr = failto;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_W: {
+        INSTR(bci_TESTEQ_W): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             W_ stackWord = (W_)SpW(0);
             if (stackWord != (W_)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_W64: {
+        INSTR(bci_TESTEQ_W64): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord64 stackWord = (*(StgWord64*)Sp);
             if (stackWord != BCO_LITW64(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_W32: {
+        INSTR(bci_TESTEQ_W32): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord32 stackWord = (*(StgWord32*)Sp);
             if (stackWord != (StgWord32)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_W16: {
+        INSTR(bci_TESTEQ_W16): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord16 stackWord = (*(StgWord16*)Sp);
             if (stackWord != (StgWord16)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_W8: {
+        INSTR(bci_TESTEQ_W8): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgWord8 stackWord = (*(StgWord8*)Sp);
             if (stackWord != (StgWord8)BCO_LIT(discr)) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_D: {
+        INSTR(bci_TESTLT_D): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgDouble stackDbl, discrDbl;
@@ -2009,10 +2481,10 @@ run_BCO:
             if (stackDbl >= discrDbl) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_D: {
+        INSTR(bci_TESTEQ_D): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgDouble stackDbl, discrDbl;
@@ -2021,10 +2493,10 @@ run_BCO:
             if (stackDbl != discrDbl) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTLT_F: {
+        INSTR(bci_TESTLT_F): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgFloat stackFlt, discrFlt;
@@ -2033,10 +2505,10 @@ run_BCO:
             if (stackFlt >= discrFlt) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_TESTEQ_F: {
+        INSTR(bci_TESTEQ_F): {
             int discr   = BCO_GET_LARGE_ARG;
             int failto  = BCO_GET_LARGE_ARG;
             StgFloat stackFlt, discrFlt;
@@ -2045,11 +2517,12 @@ run_BCO:
             if (stackFlt != discrFlt) {
                 bciPtr = failto;
             }
-            goto nextInsn;
+            NEXT_INSN;
         }
 
         // Control-flow ish things
-        case bci_ENTER:
+        INSTR(bci_ENTER):
+        do_enter:
             // Context-switch check.  We put it here to ensure that
             // the interpreter has done at least *some* work before
             // context switching: sometimes the scheduler can invoke
@@ -2059,58 +2532,100 @@ run_BCO:
                 Sp_subW(1); SpW(0) = (W_)&stg_enter_info;
                 RETURN_TO_SCHEDULER(ThreadInterpret, ThreadYielding);
             }
+#if defined(INTERP_INLINE_CACHES)
+            // See Note [Interpreter inline caches]
+            if (ic != NULL &&
+                (W_)UNTAG_CLOSURE((StgClosure *)SpW(0))->header.info
+                    == RELAXED_LOAD(ic)) {
+                INTERP_TICK(it_ic_hits);
+                Sp_subW(1); SpW(0) = (W_)&stg_enter_info;
+                RETURN_TO_SCHEDULER_NO_PAUSE(ThreadRunGHC, ThreadYielding);
+            }
+#endif
             goto eval;
 
-        case bci_RETURN_P:
+        // Superinstructions, see Note [Bytecode superinstructions], with
+        // inline caches, see Note [Interpreter inline caches]
+        INSTR(bci_PUSH_L_ENTER): {
+            W_ o1   = BCO_GET_LARGE_ARG;
+            W_ o_ic = BCO_GET_LARGE_ARG;
+            SpW(-1) = SpW(o1);
+            Sp_subW(1);
+            IC_SET(o_ic);
+            goto do_enter;
+        }
+
+        INSTR(bci_SLIDE_ENTER): {
+            W_ n    = BCO_GET_LARGE_ARG;
+            W_ by   = BCO_GET_LARGE_ARG;
+            W_ o_ic = BCO_GET_LARGE_ARG;
+            SLIDE_WORDS(n, by);
+            IC_SET(o_ic);
+            goto do_enter;
+        }
+
+        INSTR(bci_PUSH_L_SLIDE_ENTER): {
+            W_ o1   = BCO_GET_LARGE_ARG;
+            W_ n    = BCO_GET_LARGE_ARG;
+            W_ by   = BCO_GET_LARGE_ARG;
+            W_ o_ic = BCO_GET_LARGE_ARG;
+            SpW(-1) = SpW(o1);
+            Sp_subW(1);
+            SLIDE_WORDS(n, by);
+            IC_SET(o_ic);
+            goto do_enter;
+        }
+
+        INSTR(bci_RETURN_P):
             tagged_obj = (StgClosure *)SpW(0);
             Sp_addW(1);
             goto do_return_pointer;
 
-        case bci_RETURN_N:
+        INSTR(bci_RETURN_N):
             Sp_subW(1);
             SpW(0) = (W_)&stg_ret_n_info;
             goto do_return_nonpointer;
-        case bci_RETURN_F:
+        INSTR(bci_RETURN_F):
             Sp_subW(1);
             SpW(0) = (W_)&stg_ret_f_info;
             goto do_return_nonpointer;
-        case bci_RETURN_D:
+        INSTR(bci_RETURN_D):
             Sp_subW(1);
             SpW(0) = (W_)&stg_ret_d_info;
             goto do_return_nonpointer;
-        case bci_RETURN_L:
+        INSTR(bci_RETURN_L):
             Sp_subW(1);
             SpW(0) = (W_)&stg_ret_l_info;
             goto do_return_nonpointer;
-        case bci_RETURN_V:
+        INSTR(bci_RETURN_V):
             Sp_subW(1);
             SpW(0) = (W_)&stg_ret_v_info;
             goto do_return_nonpointer;
-        case bci_RETURN_T: {
+        INSTR(bci_RETURN_T): {
             /* tuple_info and tuple_bco must already be on the stack */
             Sp_subW(1);
             SpW(0) = (W_)&stg_ret_t_info;
             goto do_return_nonpointer;
         }
 
-        case bci_BCO_NAME:
+        INSTR(bci_BCO_NAME):
             bciPtr++;
-            goto nextInsn;
+            NEXT_INSN;
 
-        case bci_SWIZZLE: {
+        INSTR(bci_SWIZZLE): {
             W_ stkoff = BCO_GET_LARGE_ARG;
             StgInt n = BCO_GET_LARGE_ARG;
             (*(StgInt*)(Sp_plusW(stkoff))) += n;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_PRIMCALL: {
+        INSTR(bci_PRIMCALL): {
             Sp_subW(1);
             SpW(0) = (W_)&stg_primcall_info;
             RETURN_TO_SCHEDULER_NO_PAUSE(ThreadRunGHC, ThreadYielding);
         }
 
-        case bci_CCALL: {
+        INSTR(bci_CCALL): {
             void *tok;
             W_ stk_offset             = BCO_GET_LARGE_ARG;
             int o_itbl                = BCO_GET_LARGE_ARG;
@@ -2228,6 +2743,8 @@ run_BCO:
                 cap = (Capability *)((void *)((unsigned char*)resumeThread(tok) - STG_FIELD_OFFSET(Capability,r)));
                 LOAD_THREAD_STATE();
             }
+            // Other threads may have allocated in the meantime
+            hp_reserved = 0;
 
             if (SpW(0) != (W_)&stg_ret_p_info) {
                 // the stack is not how we left it.  This probably
@@ -2267,21 +2784,24 @@ run_BCO:
             memcpy(Sp, ret, sizeof(W_) * ret_size);
 #endif
 
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_JMP: {
+        INSTR(bci_JMP): {
             /* BCO_NEXT modifies bciPtr, so be conservative. */
             int nextpc = BCO_GET_LARGE_ARG;
             bciPtr     = nextpc;
-            goto nextInsn;
+            NEXT_INSN;
         }
 
-        case bci_CASEFAIL:
+        INSTR(bci_CASEFAIL):
             barf("interpretBCO: hit a CASEFAIL");
 
             // Errors
         default:
+#if defined(INTERP_COMPUTED_GOTO)
+        lbl_default:
+#endif
             barf("interpretBCO: unknown or unimplemented opcode %d",
                  (int)(bci & 0xFF));
 
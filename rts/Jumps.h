@@ -63,8 +63,8 @@ INFO_TABLE_RET (MK_FUN_NM(stg_stack_underflow_frame), UNDERFLOW_FRAME,
 
     SAVE_ARG_REGS;
     SAVE_THREAD_STATE();
-    (ret_off) = foreign "C" threadStackUnderflow(MyCapability() "ptr",
-                                                 CurrentTSO);
+    (ret_off) = foreign "C" threadStackUnderflowReturn(MyCapability() "ptr",
+                                                       CurrentTSO);
     LOAD_THREAD_STATE();
     RESTORE_ARG_REGS;
 
@@ -59,7 +59,7 @@ bool isInherentlyUsed( StgHalfWord closure_type )
  * header portion, so that the caller can find the next closure.
  * ----------------------------------------------------------------------- */
 STATIC_INLINE uint32_t
-processHeapClosureForDead( const StgClosure *c )
+processHeapClosureForDead( const StgClosure *c, uint32_t weight )
 {
     uint32_t size;
     const StgInfoTable *info;
@@ -133,7 +133,7 @@ processHeapClosureForDead( const StgClosure *c )
         // rate.
     case IND:
         // Found a dead closure: record its size
-        LDV_recordDead(c, size);
+        LDV_recordDeadWeighted(c, size, weight);
         return size;
 
         /*
@@ -163,6 +163,28 @@ processHeapClosureForDead( const StgClosure *c )
     }
 }
 
+/* --------------------------------------------------------------------------
+ * With --heap-census-sample=<n>, we only look for dead closures in 1 in n
+ * of the blocks of each list, from a random offset, see
+ * Note [Sampled biographical profiling] in ProfHeap.c.  Returns the offset
+ * for the next list, or 0 when we visit every block.
+ * ----------------------------------------------------------------------- */
+static uint32_t dead_seed = 0;
+
+static uint32_t
+deadSampleSkip( void )
+{
+    const uint32_t rate = RtsFlags.ProfFlags.censusSampleRate;
+
+    if (rate <= 1) {
+        return 0;
+    }
+    if (dead_seed == 0) {
+        dead_seed = (uint32_t)getMonotonicNSec() | 1;
+    }
+    return xorshift32(&dead_seed) % rate;
+}
+
 /* --------------------------------------------------------------------------
  * Calls processHeapClosureForDead() on every *dead* closures in the
  * heap blocks starting at bd.
@@ -170,17 +192,22 @@ processHeapClosureForDead( const StgClosure *c )
 static void
 processHeapForDead( bdescr *bd )
 {
+    const uint32_t rate = RtsFlags.ProfFlags.censusSampleRate;
+    uint32_t skip = deadSampleSkip();
+    StgWord index = 0;
     StgPtr p;
 
-    while (bd != NULL) {
+    for (; bd != NULL; bd = bd->link, index++) {
+        if (rate > 1 && index % rate != skip) {
+            continue;
+        }
         p = bd->start;
         while (p < bd->free) {
-            p += processHeapClosureForDead((StgClosure *)p);
+            p += processHeapClosureForDead((StgClosure *)p, rate);
             while (p < bd->free && !*p)   // skip slop
                 p++;
         }
         ASSERT(p == bd->free);
-        bd = bd->link;
     }
 }
 
@@ -191,12 +218,18 @@ processHeapForDead( bdescr *bd )
 static void
 processChainForDead( bdescr *bd )
 {
+    const uint32_t rate = RtsFlags.ProfFlags.censusSampleRate;
+    uint32_t skip = deadSampleSkip();
+    StgWord index = 0;
+
     // Any object still in the chain is dead!
-    while (bd != NULL) {
+    for (; bd != NULL; bd = bd->link, index++) {
+        if (rate > 1 && index % rate != skip) {
+            continue;
+        }
         if (!(bd->flags & BF_PINNED)) {
-            processHeapClosureForDead((StgClosure *)bd->start);
+            processHeapClosureForDead((StgClosure *)bd->start, rate);
         }
-        bd = bd->link;
     }
 }
 
@@ -8,6 +8,7 @@
 
 #include "Rts.h"
 #include "RtsUtils.h"
+#include "Hash.h"
 #include "Libdw.h"
 
 #if USE_LIBDW
@@ -126,8 +127,8 @@ LibdwSession *libdwInit(void) {
     return NULL;
 }
 
-int libdwLookupLocation(LibdwSession *session, Location *frame,
-                        StgPtr pc) {
+static int lookupLocation(LibdwSession *session, Location *frame,
+                          StgPtr pc) {
     Dwarf_Addr addr = (Dwarf_Addr) (uintptr_t) pc;
     // Find the module containing PC
     Dwfl_Module *mod = dwfl_addrmodule(session->dwfl, addr);
@@ -165,6 +166,206 @@ int libdwLookupLocation(LibdwSession *session, Location *frame,
     return 0;
 }
 
+/*
+ * Note [libdw location cache]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Looking up the location of an address means finding its module, symbol
+ * and line in libdw's DWARF indices, which takes microseconds even with a
+ * warm session (see Note [libdw session pool]). Programs that render many
+ * backtraces, e.g. because exceptions carrying DWARF backtraces are common,
+ * look up the same addresses over and over. So libdwLookupLocations first
+ * consults a cache of the last LOCATION_CACHE_SIZE addresses looked up. The
+ * cache is shared by all sessions and evicts the least recently used
+ * address. Addresses that were not found are cached too.
+ *
+ * The strings of a Location belong to the session that found it, and
+ * sessions are freed when the pool is flushed. So the cache keeps its own
+ * interned copies of the strings and hands those out. Callers may still be
+ * reading the strings of an entry that has since been evicted, so the
+ * copies are never freed; there are only as many as the program has
+ * objects, functions and source files. libdwPoolClear empties the cache,
+ * since the modules loaded have changed.
+ *
+ * The lock is not held while libdw is consulted, so sessions on different
+ * capabilities still look up addresses in parallel. A batch of addresses is
+ * looked up with two acquisitions of the lock, however many there are.
+ *
+ * The RTS's own backtraces on fatal errors and SIGQUIT don't use the cache:
+ * they use a private session and can't take locks.
+ *
+ * Most programs never look up a location, so the cache's entries and tables
+ * are only allocated, under the lock, when the first location is cached.
+ */
+
+#define LOCATION_CACHE_SIZE 4096
+
+typedef struct LocationCacheEntry_ {
+    StgPtr pc;
+    int ret;                                // as from lookupLocation
+    Location loc;                           // with interned strings
+    struct LocationCacheEntry_ *newer;
+    struct LocationCacheEntry_ *older;
+} LocationCacheEntry;
+
+#if defined(THREADED_RTS)
+static Mutex location_cache_lock;
+#endif
+static bool location_cache_ready = false;
+// Protected by location_cache_lock; NULL until the first location is cached
+static HashTable *location_cache = NULL;   // pc -> LocationCacheEntry
+static LocationCacheEntry *location_cache_entries = NULL;
+static uint32_t location_cache_used;
+static LocationCacheEntry *newest_location;
+static LocationCacheEntry *oldest_location;
+static StrHashTable *location_strings;
+
+void libdwInitLocationCache(void) {
+#if defined(THREADED_RTS)
+    initMutex(&location_cache_lock);
+#endif
+    location_cache_used = 0;
+    newest_location = oldest_location = NULL;
+    location_cache_ready = true;
+}
+
+// Called with location_cache_lock held
+static void allocLocationCache(void) {
+    location_cache_entries =
+        stgMallocBytes(LOCATION_CACHE_SIZE * sizeof(LocationCacheEntry),
+                       "allocLocationCache");
+    location_strings = allocStrHashTable();
+    location_cache = allocOpenHashTable();
+}
+
+void libdwClearLocationCache(void) {
+    if (!location_cache_ready) {
+        return;
+    }
+    ACQUIRE_LOCK(&location_cache_lock);
+    if (location_cache != NULL) {
+        freeHashTable(location_cache, NULL);
+        location_cache = allocOpenHashTable();
+    }
+    location_cache_used = 0;
+    newest_location = oldest_location = NULL;
+    RELEASE_LOCK(&location_cache_lock);
+}
+
+static const char *internLocationString(const char *s) {
+    if (s == NULL) {
+        return NULL;
+    }
+    char *interned = lookupStrHashTable(location_strings, s);
+    if (interned == NULL) {
+        interned = stgStrndup(s, strlen(s));
+        insertStrHashTable(location_strings, interned, interned);
+    }
+    return interned;
+}
+
+static void unlinkLocation(LocationCacheEntry *e) {
+    if (e->newer) e->newer->older = e->older; else newest_location = e->older;
+    if (e->older) e->older->newer = e->newer; else oldest_location = e->newer;
+}
+
+static void linkNewestLocation(LocationCacheEntry *e) {
+    e->newer = NULL;
+    e->older = newest_location;
+    if (newest_location) newest_location->newer = e; else oldest_location = e;
+    newest_location = e;
+}
+
+// Called with location_cache_lock held
+static void cacheLocation(StgPtr pc, int ret, Location *loc) {
+    if (location_cache == NULL) {
+        allocLocationCache();
+    }
+    LocationCacheEntry *e = lookupHashTable(location_cache, (StgWord) pc);
+    if (e == NULL) {
+        if (location_cache_used < LOCATION_CACHE_SIZE) {
+            e = &location_cache_entries[location_cache_used++];
+        } else {
+            e = oldest_location;
+            unlinkLocation(e);
+            removeHashTable(location_cache, (StgWord) e->pc, e);
+        }
+        e->pc = pc;
+        e->ret = ret;
+        if (ret == 0) {
+            e->loc = *loc;
+            e->loc.object_file = internLocationString(loc->object_file);
+            e->loc.function = internLocationString(loc->function);
+            e->loc.source_file = internLocationString(loc->source_file);
+        }
+        insertHashTable(location_cache, (StgWord) pc, e);
+        linkNewestLocation(e);
+    }
+    // hand out the cache's strings rather than the session's
+    if (ret == 0) {
+        *loc = e->loc;
+    }
+}
+
+void libdwLookupLocations(LibdwSession *session, Location *locs, int *rets,
+                          StgPtr *pcs, StgWord n) {
+    if (!location_cache_ready) {
+        for (StgWord i = 0; i < n; i++) {
+            rets[i] = lookupLocation(session, &locs[i], pcs[i]);
+        }
+        return;
+    }
+
+    // Take what we can from the cache...
+    StgWord *missed = NULL;
+    StgWord n_missed = 0;
+    ACQUIRE_LOCK(&location_cache_lock);
+    for (StgWord i = 0; i < n; i++) {
+        LocationCacheEntry *e = location_cache == NULL ? NULL
+            : lookupHashTable(location_cache, (StgWord) pcs[i]);
+        if (e != NULL) {
+            unlinkLocation(e);
+            linkNewestLocation(e);
+            rets[i] = e->ret;
+            if (e->ret == 0) {
+                locs[i] = e->loc;
+            }
+        } else {
+            if (missed == NULL) {
+                missed = stgMallocBytes((n - i) * sizeof(StgWord),
+                                        "libdwLookupLocations");
+            }
+            missed[n_missed++] = i;
+        }
+    }
+    RELEASE_LOCK(&location_cache_lock);
+
+    if (missed == NULL) {
+        return;
+    }
+
+    // ...ask libdw for the rest...
+    for (StgWord j = 0; j < n_missed; j++) {
+        const StgWord i = missed[j];
+        rets[i] = lookupLocation(session, &locs[i], pcs[i]);
+    }
+
+    // ...and remember them
+    ACQUIRE_LOCK(&location_cache_lock);
+    for (StgWord j = 0; j < n_missed; j++) {
+        const StgWord i = missed[j];
+        cacheLocation(pcs[i], rets[i], &locs[i]);
+    }
+    RELEASE_LOCK(&location_cache_lock);
+    stgFree(missed);
+}
+
+int libdwLookupLocation(LibdwSession *session, Location *frame,
+                        StgPtr pc) {
+    int ret;
+    libdwLookupLocations(session, frame, &ret, &pc, 1);
+    return ret;
+}
+
 int libdwForEachFrameOutwards(Backtrace *bt,
                               int (*cb)(StgPtr, void*),
                               void *user_data)
@@ -207,7 +408,8 @@ static int printFrame(StgPtr pc, void *cbdata)
 {
     struct PrintData *pd = (struct PrintData *) cbdata;
     Location loc;
-    libdwLookupLocation(pd->session, &loc, pc);
+    // See Note [libdw location cache] for why this avoids the cache
+    lookupLocation(pd->session, &loc, pc);
     fprintf(pd->file, "  %24p    %s ",
             (void*) pc, loc.function);
     if (loc.source_file)
@@ -439,4 +641,12 @@ int libdwLookupLocation(LibdwSession *session STG_UNUSED,
     return 1;
 }
 
+void libdwLookupLocations(LibdwSession *session STG_UNUSED,
+                          Location *locs STG_UNUSED, int *rets,
+                          StgPtr *pcs STG_UNUSED, StgWord n) {
+    for (StgWord i = 0; i < n; i++) {
+        rets[i] = 1;
+    }
+}
+
 #endif /* USE_LIBDW */
@@ -23,6 +23,11 @@ LibdwSession *libdwInit(void);
 /* Free a session */
 void libdwFree(LibdwSession *session);
 
+/* Set up and empty the cache of looked up locations; see
+ * Note [libdw location cache] in Libdw.c */
+void libdwInitLocationCache(void);
+void libdwClearLocationCache(void);
+
 // Traverse backtrace in order of outer-most to inner-most frame
 #define FOREACH_FRAME_INWARDS(pc, bt)                                 \
     BacktraceChunk *_chunk;                                           \
@@ -40,6 +40,7 @@ void libdwPoolInit(void) {
     pool = poolInit(pool_size, pool_size,
                     (alloc_thing_fn) libdwInit,
                     (free_thing_fn) libdwFree);
+    libdwInitLocationCache();
 }
 
 LibdwSession *libdwPoolTake(void) {
@@ -52,6 +53,7 @@ void libdwPoolRelease(LibdwSession *sess) {
 
 void libdwPoolClear(void) {
     poolFlush(pool);
+    libdwClearLocationCache();
 }
 
 #else /* !USE_LIBDW */
@@ -120,8 +120,9 @@ extern void iconv(void);
    update `$TOP/configure.ac` under heading `Does target have runtime
    linker support?`.
  */
-/* `symhash` is a Hash table mapping symbol names to RtsSymbolInfo.
-   This hashtable will contain information on all symbols
+/* `symhash` is a table mapping symbol names to RtsSymbolInfo, see
+   Note [Linker symbol table] in linker/SymbolTable.c.
+   This table will contain information on all symbols
    that we know of, however the .o they are in may not be loaded.
 
    Until the ObjectCode the symbol belongs to is actually
@@ -154,7 +155,10 @@ extern void iconv(void);
      described in `ghciInsertSymbolTable`.
 
      This phase will produce ObjectCode with status `OBJECT_LOADED` or `OBJECT_NEEDED`
-     depending on whether they are an archive member or not.
+     depending on whether they are an archive member or not. Archive members
+     may instead be left `OBJECT_LAZY`, known only by the archive's symbol
+     index, until one of their symbols is looked up; see
+     Note [Lazy archive members] in linker/LoadArchive.c.
 
    * During initialization we load ObjectCode, perform relocations, execute
      static constructors etc. This phase may trigger other ObjectCodes to
@@ -204,25 +208,74 @@ extern void iconv(void);
    2) The number of duplicate symbols, since now only symbols that are
       true duplicates will display the error.
  */
-StrHashTable *symhash;
+SymbolTable *symhash;
 
 #if defined(THREADED_RTS)
 /* This protects all the Linker's global state */
 Mutex linker_mutex;
 #endif
 
+/* Note [Resolved symbol cache]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   lookupSymbol is called from many threads at once (e.g. by GHCi when
+   evaluating in parallel, or by a program resolving foreign imports
+   dynamically), and most of those calls ask for symbols that are already
+   loaded.  Rather than have them all queue for linker_mutex, lookupSymbol
+   first consults `resolved_symbols`, a concurrent hash table (see
+   Note [Concurrent hash tables] in Hash.c) from symbol names to their
+   addresses, which it reads without taking the lock.
+
+   A symbol is only cached once its entry in `symhash` can no longer change
+   except by being removed: a normal-strength, non-hidden symbol that is
+   either built in or owned by an object that is OBJECT_READY.  None of the
+   rules in insertHashedSymbol replace such an entry.  ghciRemoveSymbolTable
+   drops the symbol from the cache when it removes it from `symhash`, and
+   retires the cache entry so that a concurrent reader can still copy the
+   address out of it.
+
+   `symhash` remains the authority: everything else still takes the lock and
+   goes there.
+*/
+typedef struct {
+    SymbolAddr *addr;
+    char name[];
+} ResolvedSymbol;
+
+static ConcHashTable *resolved_symbols;
+
+static int compareSymbolName(StgWord key1, StgWord key2)
+{
+    return strcmp((const char *) key1, (const char *) key2) == 0;
+}
+
 /* Generic wrapper function to try and resolve oc files */
 static int ocTryLoad( ObjectCode* oc );
+static int loadOcImage( ObjectCode* oc );
+#if defined(OBJFORMAT_ELF)
+static int loadLazyOc( ObjectCode* oc );
+#endif
 /* Run initializers */
 static int ocRunInit( ObjectCode* oc );
 static int runPendingInitializers (void);
+#if defined(OBJFORMAT_ELF) || defined(OBJFORMAT_MACHO)
+static void flushDlsymCache (void);
+#endif
 
-static void ghciRemoveSymbolTable(StrHashTable *table, const SymbolName* key,
+static void ghciRemoveSymbolTable(SymbolTable *table, const SymbolName* key,
     ObjectCode *owner)
 {
-    RtsSymbolInfo *pinfo = lookupStrHashTable(table, key);
+    StgWord hash = hashSymbolName(key);
+    RtsSymbolInfo *pinfo = lookupSymbolTable(table, key, hash);
     if (!pinfo || owner != pinfo->owner) return;
-    removeStrHashTable(table, key, NULL);
+    removeSymbolTable(table, key, hash);
+    if (table == symhash) {
+        ResolvedSymbol *cached =
+            removeConcHashTable_(resolved_symbols, (StgWord) key, hash,
+                                 compareSymbolName);
+        if (cached) {
+            retireConcHashData(cached, stgFree);
+        }
+    }
     if (isSymbolImport (owner, key))
       stgFree(pinfo->value);
 
@@ -261,16 +314,17 @@ symbolTypeString (SymType type)
  mostly because it's unsure how the weak symbols support should look.
  See #11223
  */
-int ghciInsertSymbolTable(
+static int insertHashedSymbol(
    pathchar* obj_name,
-   StrHashTable *table,
+   SymbolTable *table,
    const SymbolName* key,
+   StgWord hash,
    SymbolAddr* data,
    SymStrength strength,
    SymType type,
    ObjectCode *owner)
 {
-   RtsSymbolInfo *pinfo = lookupStrHashTable(table, key);
+   RtsSymbolInfo *pinfo = lookupSymbolTable(table, key, hash);
    if (!pinfo) /* new entry */
    {
       pinfo = stgMallocBytes(sizeof (*pinfo), "ghciInsertToSymbolTable");
@@ -278,7 +332,7 @@ int ghciInsertSymbolTable(
       pinfo->owner = owner;
       pinfo->strength = strength;
       pinfo->type = type;
-      insertStrHashTable(table, key, pinfo);
+      insertSymbolTable(table, key, hash, pinfo);
       return 1;
    }
    else if (pinfo->type ^ type)
@@ -399,16 +453,29 @@ int ghciInsertSymbolTable(
    return 0;
 }
 
+int ghciInsertSymbolTable(
+   pathchar* obj_name,
+   SymbolTable *table,
+   const SymbolName* key,
+   SymbolAddr* data,
+   SymStrength strength,
+   SymType type,
+   ObjectCode *owner)
+{
+   return insertHashedSymbol(obj_name, table, key, hashSymbolName(key),
+                             data, strength, type, owner);
+}
+
 /* -----------------------------------------------------------------------------
 * Looks up symbols into hash tables.
 *
 * Returns: 0 on failure and result is not set,
 *          nonzero on success and result set to nonzero pointer
 */
-HsBool ghciLookupSymbolInfo(StrHashTable *table,
+HsBool ghciLookupSymbolInfo(SymbolTable *table,
     const SymbolName* key, RtsSymbolInfo **result)
 {
-    RtsSymbolInfo *pinfo = lookupStrHashTable(table, key);
+    RtsSymbolInfo *pinfo = lookupSymbolTable(table, key, hashSymbolName(key));
     if (!pinfo) {
         *result = NULL;
         return HS_BOOL_FALSE;
@@ -469,7 +536,8 @@ initLinker_ (int retain_cafs)
     initMutex(&linker_mutex);
 #endif
 
-    symhash = allocStrHashTable();
+    symhash = allocSymbolTable();
+    resolved_symbols = allocConcHashTable();
 
     /* populate the symbol table with stuff from the RTS */
     IF_DEBUG(linker, debugBelch("populating linker symbol table with built-in RTS symbols\n"));
@@ -531,6 +599,10 @@ initLinker_ (int retain_cafs)
     }
 #   endif
 
+#if defined(OBJFORMAT_ELF)
+    initLinker_ELF();
+#endif
+
 #if defined(OBJFORMAT_PEi386)
     initLinker_PEi386();
 #endif
@@ -545,11 +617,18 @@ exitLinker( void ) {
    if (linker_init_done == 1) {
       regfree(&re_invalid);
       regfree(&re_realso);
+      ACQUIRE_LOCK(&linker_mutex);
+      flushDlsymCache();
+      RELEASE_LOCK(&linker_mutex);
    }
 #endif
    if (linker_init_done == 1) {
-       freeStrHashTable(symhash, free);
+       freeSymbolTable(symhash, free);
+       freeConcHashTable(resolved_symbols, stgFree);
        exitUnloadCheck();
+#if defined(OBJFORMAT_ELF)
+       exitLinker_ELF();
+#endif
    }
 #if defined(THREADED_RTS)
    closeMutex(&linker_mutex);
@@ -596,12 +675,47 @@ exitLinker( void ) {
   libraries don't populate the global symbol table.
 */
 
-static void *
-internal_dlsym(const char *symbol) {
-    void *v;
+/*
+  Note [Caching dlsym results]
+  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Every symbol that is not in `symhash` goes to internal_dlsym, which asks
+  the program and then each loaded shared object in turn.  A symbol that is
+  in none of them, such as a weak or optional reference that every object
+  of a package makes, costs one failed dlsym per shared object each time it
+  is looked up, and it is looked up again for every object that refers to
+  it.  With a few hundred shared objects loaded that is most of the time
+  spent resolving an object's relocations.
+
+  So internal_dlsym remembers its answer for each name in `dlsym_cache`,
+  misses (NULL) included.  The answer depends only on the set of loaded
+  shared objects, and, because of Note [RTLD_LOCAL], on the order in which
+  they were loaded: a newer object shadows an older one.  So rather than
+  work out which entries a change could affect, we drop the whole cache
+  whenever a shared object is loaded or unloaded (loadNativeObj,
+  unloadNativeObj), which is rare next to the lookups.
+
+  The cache is protected by linker_mutex, like the rest of internal_dlsym.
+*/
+typedef struct {
+    void *addr;
+    char name[];
+} DlsymCacheEntry;
 
-    // concurrent dl* calls may alter dlerror
+static StrHashTable *dlsym_cache = NULL;
+
+static void
+flushDlsymCache (void)
+{
     ASSERT_LOCK_HELD(&linker_mutex);
+    if (dlsym_cache != NULL) {
+        freeStrHashTable(dlsym_cache, stgFree);
+        dlsym_cache = NULL;
+    }
+}
+
+static void *
+internal_dlsym_uncached(const char *symbol) {
+    void *v;
 
     // clears dlerror
     dlerror();
@@ -661,6 +775,30 @@ internal_dlsym(const char *symbol) {
     // we failed to find the symbol
     return NULL;
 }
+
+static void *
+internal_dlsym(const char *symbol) {
+    // concurrent dl* calls may alter dlerror
+    ASSERT_LOCK_HELD(&linker_mutex);
+
+    // See Note [Caching dlsym results]
+    if (dlsym_cache == NULL) {
+        dlsym_cache = allocStrHashTable();
+    }
+    DlsymCacheEntry *e = lookupStrHashTable(dlsym_cache, symbol);
+    if (e != NULL) {
+        return e->addr;
+    }
+
+    void *v = internal_dlsym_uncached(symbol);
+
+    size_t len = strlen(symbol) + 1;
+    e = stgMallocBytes(sizeof(DlsymCacheEntry) + len, "internal_dlsym");
+    e->addr = v;
+    memcpy(e->name, symbol, len);
+    insertStrHashTable(dlsym_cache, e->name, e);
+    return v;
+}
 #  endif
 
 void *lookupSymbolInNativeObj(void *handle, const char *symbol_name)
@@ -826,6 +964,13 @@ SymbolAddr* lookupDependentSymbol (SymbolName* lbl, ObjectCode *dependent, SymTy
     if (dependent && strncmp(lbl, "_GLOBAL_OFFSET_TABLE_", 21) == 0) {
         return dependent->info->got_start;
     }
+
+    // See Note [Lazy archive members] in linker/LoadArchive.c
+    if (ghciLookupSymbolInfo(symhash, lbl, &pinfo)
+        && pinfo->owner && pinfo->owner->status == OBJECT_LAZY
+        && !loadLazyOc(pinfo->owner)) {
+        return NULL;
+    }
 #endif
 
     if (!ghciLookupSymbolInfo(symhash, lbl, &pinfo)) {
@@ -967,13 +1112,53 @@ printLoadedObjects(void) {
    }
 }
 
+/* Remember the address of a symbol that lookupSymbol has resolved, if it
+ * won't change; see Note [Resolved symbol cache] */
+static void cacheResolvedSymbol(const SymbolName *lbl, StgWord hash,
+                                SymbolAddr *addr)
+{
+    ASSERT_LOCK_HELD(&linker_mutex);
+    RtsSymbolInfo *pinfo = lookupSymbolTable(symhash, lbl, hash);
+    if (pinfo == NULL
+        || pinfo->value != addr
+        || pinfo->strength != STRENGTH_NORMAL
+        || (pinfo->type & SYM_TYPE_HIDDEN)
+        || (pinfo->owner && pinfo->owner->status != OBJECT_READY)
+        || lookupConcHashTable_(resolved_symbols, (StgWord) lbl, hash,
+                                compareSymbolName) != NULL) {
+        return;
+    }
+
+    size_t len = strlen(lbl) + 1;
+    ResolvedSymbol *ent = stgMallocBytes(sizeof(ResolvedSymbol) + len,
+                                         "cacheResolvedSymbol");
+    ent->addr = addr;
+    memcpy(ent->name, lbl, len);
+    insertConcHashTable_(resolved_symbols, (StgWord) ent->name, hash, ent);
+}
+
 SymbolAddr* lookupSymbol( SymbolName* lbl )
 {
+    const StgWord hash = hashSymbolName(lbl);
+
+    // Fast path: see Note [Resolved symbol cache]
+    const StgWord token = beginConcHashRead();
+    ResolvedSymbol *cached =
+        lookupConcHashTable_(resolved_symbols, (StgWord) lbl, hash,
+                             compareSymbolName);
+    SymbolAddr *r = cached ? cached->addr : NULL;
+    endConcHashRead(token);
+    if (r) {
+        return r;
+    }
+
     ACQUIRE_LOCK(&linker_mutex);
     // NULL for "don't add dependent". When adding a dependency we call
     // lookupDependentSymbol directly.
-    SymbolAddr* r = lookupDependentSymbol(lbl, NULL, NULL);
-    if (!r) {
+    r = lookupDependentSymbol(lbl, NULL, NULL);
+    if (r) {
+        cacheResolvedSymbol(lbl, hash, r);
+    } else {
         if (!RtsFlags.MiscFlags.linkerOptimistic) {
           errorBelch("^^ Could not load '%s', dependency unresolved. "
                      "See top entry above. You might consider using --optimistic-linking\n",
@@ -1099,7 +1284,10 @@ freePreloadObjectFile (ObjectCode *oc)
 #else
 
     if (RTS_LINKER_USE_MMAP && oc->imageMapped) {
-        munmapForLinker(oc->image, oc->fileSize, "freePreloadObjectFile");
+        // an archive member's image needn't start on a page boundary
+        void *start = (void *) roundDownToPage((StgWord) oc->image);
+        munmapForLinker(start, oc->image + oc->fileSize - (char *) start,
+                        "freePreloadObjectFile");
     }
     else {
         stgFree(oc->image);
@@ -1162,6 +1350,9 @@ void freeObjectCode (ObjectCode *oc)
     }
 
     if (oc->sections != NULL) {
+#if defined(OBJFORMAT_ELF)
+        ocFreeStubs_ELF(oc);
+#endif
         int i;
         for (i=0; i < oc->n_sections; i++) {
             if (oc->sections[i].start != NULL) {
@@ -1226,6 +1417,7 @@ void freeObjectCode (ObjectCode *oc)
 
     stgFree(oc->fileName);
     stgFree(oc->archiveMemberName);
+    stgFree(oc->lazyNames);
 
     freeHashSet(oc->dependencies);
 
@@ -1265,6 +1457,8 @@ mkOc( ObjectType type, pathchar *path, char *image, int imageSize,
    } else {
        oc->archiveMemberName = NULL;
    }
+   oc->archiveOffset = 0;
+   oc->lazyNames = NULL;
 
    if (oc->archiveMemberName == NULL) {
        oc->status = OBJECT_NEEDED;
@@ -1505,7 +1699,255 @@ HsInt loadObj (pathchar *path)
    return r;
 }
 
+/* Note [Parallel object loading]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Loading a program made of many objects into GHCi (or for Template
+   Haskell) used to spend a long time in Indexing and Initialization (see
+   Note [runtime-linker-phases]), one object after another. Where
+   LINKER_PARALLEL is defined, the bulk of both phases is now done on
+   several threads at once (forEachOc):
+
+   * loadArchive_ hands all the members of an archive to loadOcs, which
+     indexes them (loadOcImage: ocVerifyImage, ocAllocateExtras and
+     ocGetNames) in parallel. ocGetNames_ELF only records the symbols of
+     the object in oc->symbols; loadOcs then adds them to `symhash`
+     (ocInsertSymbols) one object at a time, in the order of the archive,
+     so that duplicate symbols are resolved just as before.
+
+   * resolveObjs_ looks up the symbols that each object needs
+     (ocResolveSymbols) one object at a time, as a lookup may load another
+     object. ocResolveSymbols_ELF looks up every symbol the relocations
+     refer to, keeping the result in ElfSymbol.target. Then it relocates the
+     objects in parallel (ocRelocate): a relocation only writes to its own
+     object, and finds its symbols in ElfSymbol.target.
+
+   PE/COFF objects are relocated in parallel too (where
+   LINKER_PARALLEL_RELOCATION is defined), but indexed one at a time, as
+   ocGetNames_PEi386 adds the symbols to `symhash` itself.
+   ocResolve_PEi386 keeps the symbols it looks up in
+   ObjectCodeFormatInfo.symbol_addrs for ocRelocate_PEi386.
+
+   The caller holds linker_mutex throughout; the threads of forEachOc never
+   take it. What they do share is the memory the objects are mapped into:
+   mmapForLinker and the m32 allocator's free page pool have locks of their
+   own for that.
+
+   Elsewhere, objects are loaded and resolved one at a time as before,
+   though ocGetNames_ELF leaves the symbols for loadOc to add to `symhash`
+   all the same.
+*/
+
+#if defined(LINKER_PARALLEL_RELOCATION)
+typedef struct {
+    ObjectCode **ocs;
+    int *ok;
+    uint32_t n;
+    StgWord next;
+    int (*fn)(ObjectCode *oc);
+} OcJob;
+
+static void *
+ocWorker (void *arg)
+{
+    OcJob *job = (OcJob *) arg;
+    for (;;) {
+        StgWord i = atomic_inc(&job->next, 1) - 1;
+        if (i >= job->n) {
+            break;
+        }
+        job->ok[i] = job->fn(job->ocs[i]);
+    }
+    return NULL;
+}
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Set ok[i] = fn(ocs[i]) for each object, on several threads if `parallel`
+ * and we can. See Note [Parallel object loading].
+ */
+static void
+forEachOc (ObjectCode **ocs, int *ok, uint32_t n, int (*fn)(ObjectCode *oc),
+           bool parallel)
+{
+#if defined(LINKER_PARALLEL_RELOCATION)
+    uint32_t n_threads = parallel ? stg_min(n, getNumberOfProcessors()) : 1;
+    if (n_threads > 1) {
+        OcJob job = { .ocs = ocs, .ok = ok, .n = n, .next = 0, .fn = fn };
+        OSThreadId *threads = stgMallocBytes(n_threads * sizeof(OSThreadId),
+                                             "forEachOc");
+        uint32_t started = 0;
+        while (started < n_threads - 1
+               && createOSThread(&threads[started], "ghc_linker",
+                                 ocWorker, &job) == 0) {
+            started++;
+        }
+        ocWorker(&job);
+        for (uint32_t i = 0; i < started; i++) {
+            joinOSThread(threads[i]);
+        }
+        stgFree(threads);
+        return;
+    }
+#else
+    (void) parallel;
+#endif
+    for (uint32_t i = 0; i < n; i++) {
+        ok[i] = fn(ocs[i]);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Add the symbols of an object to `symhash`, checking for duplicates.
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+static int ocInsertSymbols (ObjectCode* oc)
+{
+    /*  Check for duplicate symbols by looking into `symhash`.
+        Duplicate symbols are any symbols which exist
+        in different ObjectCodes that have both been loaded, or
+        are to be loaded by this call.
+
+        This call is intended to have no side-effects when a non-duplicate
+        symbol is re-inserted.
+
+        We set the Address to NULL since that is not used to distinguish
+        symbols. Duplicate symbols are distinguished by name and oc.
+    */
+    int x;
+    Symbol_t symbol;
+    reserveSymbolTable(symhash, oc->n_symbols);
+    for (x = 0; x < oc->n_symbols; x++) {
+        symbol = oc->symbols[x];
+        if (   symbol.name
+            && !insertHashedSymbol(oc->fileName, symhash, symbol.name,
+                                   symbol.hash, symbol.addr,
+                                   isSymbolWeak(oc, symbol.name),
+                                   symbol.type, oc)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 HsInt loadOc (ObjectCode* oc)
+{
+   if (!loadOcImage(oc)) {
+       return 0;
+   }
+
+#if defined(OBJFORMAT_ELF)
+   // ocGetNames_ELF leaves this to us, see Note [Parallel object loading]
+   if (!ocInsertSymbols(oc)) {
+       return 0;
+   }
+#endif
+   return 1;
+}
+
+/* -----------------------------------------------------------------------------
+ * Load the members of an archive, which loadArchive_ has read but not
+ * loaded, as loadOc does. See Note [Parallel object loading].
+ *
+ * Returns: 1 if ok, 0 on error, in which case all the objects are freed.
+ */
+HsInt loadOcs (ObjectCode** ocs, uint32_t n)
+{
+   int *ok = stgMallocBytes(n * sizeof(int), "loadOcs");
+   uint32_t i;
+
+#if defined(LINKER_PARALLEL)
+   forEachOc(ocs, ok, n, loadOcImage, true);
+#else
+   forEachOc(ocs, ok, n, loadOcImage, false);
+#endif
+
+   for (i = 0; i < n; i++) {
+       if (!ok[i]) {
+           break;
+       }
+#if defined(OBJFORMAT_ELF)
+       if (!ocInsertSymbols(ocs[i])) {
+           break;
+       }
+#endif
+       insertOCSectionIndices(ocs[i]); // also adds the object to `objects` list
+       ocs[i]->next_loaded_object = loaded_objects;
+       loaded_objects = ocs[i];
+   }
+   stgFree(ok);
+
+   if (i < n) {
+       // failed; free the objects we haven't loaded
+       for (; i < n; i++) {
+           removeOcSymbols(ocs[i]);
+           freeObjectCode(ocs[i]);
+       }
+       return 0;
+   }
+   return 1;
+}
+
+/* -----------------------------------------------------------------------------
+ * Add an archive member that loadArchive_ knows only by the archive's symbol
+ * index to `symhash` and to `objects`. This can't fail: the symbols go in
+ * weak and hidden, so they give way to any other definition.
+ * See Note [Lazy archive members] in linker/LoadArchive.c.
+ */
+void insertLazyOc (ObjectCode* oc)
+{
+   ASSERT(oc->status == OBJECT_LAZY);
+   reserveSymbolTable(symhash, oc->n_symbols);
+   for (int i = 0; i < oc->n_symbols; i++) {
+       insertHashedSymbol(oc->fileName, symhash, oc->symbols[i].name,
+                          oc->symbols[i].hash, NULL, STRENGTH_WEAK,
+                          oc->symbols[i].type, oc);
+   }
+   insertOCSectionIndices(oc); // also adds the object to `objects` list
+   oc->next_loaded_object = loaded_objects;
+   loaded_objects = oc;
+}
+
+/* -----------------------------------------------------------------------------
+ * Read and load a lazy archive member, the first time one of its symbols is
+ * looked up. Its own symbols replace the ones from the index.
+ * See Note [Lazy archive members] in linker/LoadArchive.c.
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+#if defined(OBJFORMAT_ELF)
+static int loadLazyOc (ObjectCode* oc)
+{
+   IF_DEBUG(linker, ocDebugBelch(oc, "loading lazy archive member\n"));
+
+   if (!readArchiveMember(oc)) {
+       return 0;
+   }
+   removeOcSymbols(oc);
+   stgFree(oc->lazyNames);
+   oc->lazyNames = NULL;
+
+   ocInit_ELF(oc);
+   oc->status = OBJECT_LOADED;
+   if (!loadOc(oc)) {
+       // leave it alone from now on; it goes when the archive is unloaded
+       removeOcSymbols(oc);
+       oc->status = OBJECT_DONT_RESOLVE;
+       return 0;
+   }
+   addOCSectionIndices(oc);
+   return 1;
+}
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Verify an object and build its symbol list (Indexing in
+ * Note [runtime-linker-phases]). On ELF, the symbols are left for the caller
+ * to add to `symhash`.
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+static int loadOcImage (ObjectCode* oc)
 {
    int r;
 
@@ -1593,44 +2035,22 @@ HsInt loadOc (ObjectCode* oc)
 }
 
 /* -----------------------------------------------------------------------------
-* try to load and initialize an ObjectCode into memory
-*
-* Returns: 1 if ok, 0 on error.
-*/
-int ocTryLoad (ObjectCode* oc) {
+ * Add the symbols of an object to `symhash` and look up the ones it needs,
+ * which may load other objects. See Note [Parallel object loading].
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+static int ocResolveSymbols (ObjectCode* oc)
+{
     int r;
 
-    if (oc->status != OBJECT_NEEDED) {
-        return 1;
-    }
-
-    /*  Check for duplicate symbols by looking into `symhash`.
-        Duplicate symbols are any symbols which exist
-        in different ObjectCodes that have both been loaded, or
-        are to be loaded by this call.
-
-        This call is intended to have no side-effects when a non-duplicate
-        symbol is re-inserted.
-
-        We set the Address to NULL since that is not used to distinguish
-        symbols. Duplicate symbols are distinguished by name and oc.
-    */
-    int x;
-    Symbol_t symbol;
-    for (x = 0; x < oc->n_symbols; x++) {
-        symbol = oc->symbols[x];
-        if (   symbol.name
-            && !ghciInsertSymbolTable(oc->fileName, symhash, symbol.name,
-                                      symbol.addr,
-                                      isSymbolWeak(oc, symbol.name),
-                                      symbol.type, oc)) {
-            return 0;
-        }
+    if (!ocInsertSymbols(oc)) {
+        return 0;
     }
 
     IF_DEBUG(linker, ocDebugBelch(oc, "resolving\n"));
 #   if defined(OBJFORMAT_ELF)
-    r = ocResolve_ELF ( oc );
+    r = ocResolveSymbols_ELF ( oc );
 #   elif defined(OBJFORMAT_PEi386)
     r = ocResolve_PEi386 ( oc );
 #   elif defined(OBJFORMAT_MACHO)
@@ -1640,8 +2060,29 @@ int ocTryLoad (ObjectCode* oc) {
 #   endif
     if (!r) {
         IF_DEBUG(linker, ocDebugBelch(oc, "resolution failed\n"));
-        return r;
     }
+    return r;
+}
+
+/* -----------------------------------------------------------------------------
+ * Relocate an object once ocResolveSymbols has looked up its symbols, and
+ * protect its memory. This only touches the object itself.
+ *
+ * Returns: 1 if ok, 0 on error.
+ */
+static int ocRelocate (ObjectCode* oc)
+{
+#if defined(OBJFORMAT_ELF)
+    if (!ocRelocate_ELF ( oc )) {
+        IF_DEBUG(linker, ocDebugBelch(oc, "resolution failed\n"));
+        return 0;
+    }
+#elif defined(OBJFORMAT_PEi386)
+    if (!ocRelocate_PEi386 ( oc )) {
+        IF_DEBUG(linker, ocDebugBelch(oc, "resolution failed\n"));
+        return 0;
+    }
+#endif
 
     IF_DEBUG(linker, ocDebugBelch(oc, "protecting mappings\n"));
 #if defined(NEED_SYMBOL_EXTRAS)
@@ -1661,6 +2102,19 @@ int ocTryLoad (ObjectCode* oc) {
     return 1;
 }
 
+/* -----------------------------------------------------------------------------
+* try to load and initialize an ObjectCode into memory
+*
+* Returns: 1 if ok, 0 on error.
+*/
+int ocTryLoad (ObjectCode* oc) {
+    if (oc->status != OBJECT_NEEDED) {
+        return 1;
+    }
+
+    return ocResolveSymbols(oc) && ocRelocate(oc);
+}
+
 // run init/init_array/ctors/mod_init_func
 int ocRunInit(ObjectCode *oc)
 {
@@ -1719,14 +2173,47 @@ static HsInt resolveObjs_ (void)
 {
     IF_DEBUG(linker, debugBelch("resolveObjs: start\n"));
 
+    // Look up the symbols of each object in turn, then relocate them all at
+    // once. See Note [Parallel object loading].
+    uint32_t n = 0, size = 64;
+    ObjectCode **ocs = stgMallocBytes(size * sizeof(ObjectCode *),
+                                      "resolveObjs_");
+    ObjectCode *failed = NULL;
+
     for (ObjectCode *oc = objects; oc; oc = oc->next) {
-        int r = ocTryLoad(oc);
-        if (!r) {
-            errorBelch("Could not load Object Code %" PATH_FMT ".\n", OC_INFORMATIVE_FILENAME(oc));
-            IF_DEBUG(linker, printLoadedObjects());
-            fflush(stderr);
-            return r;
+        if (oc->status != OBJECT_NEEDED) {
+            continue;
+        }
+        if (!ocResolveSymbols(oc)) {
+            failed = oc;
+            break;
+        }
+        if (n == size) {
+            size *= 2;
+            ocs = stgReallocBytes(ocs, size * sizeof(ObjectCode *),
+                                  "resolveObjs_");
+        }
+        ocs[n++] = oc;
+    }
+
+    if (failed == NULL) {
+        int *ok = stgMallocBytes(n * sizeof(int), "resolveObjs_");
+        forEachOc(ocs, ok, n, ocRelocate, true);
+        for (uint32_t i = 0; i < n; i++) {
+            if (!ok[i]) {
+                failed = ocs[i];
+                break;
+            }
         }
+        stgFree(ok);
+    }
+    stgFree(ocs);
+
+    if (failed != NULL) {
+        errorBelch("Could not load Object Code %" PATH_FMT ".\n", OC_INFORMATIVE_FILENAME(failed));
+        IF_DEBUG(linker, printLoadedObjects());
+        fflush(stderr);
+        return 0;
     }
 
     if (!runPendingInitializers()) {
@@ -1912,6 +2399,8 @@ void * loadNativeObj (pathchar *path, char **errmsg)
    ACQUIRE_LOCK(&linker_mutex);
 
 #if defined(OBJFORMAT_ELF) || defined(OBJFORMAT_MACHO)
+   // See Note [Caching dlsym results]
+   flushDlsymCache();
    void *r = loadNativeObj_POSIX(path, errmsg);
 #elif defined(OBJFORMAT_PEi386)
    void *r = NULL;
@@ -1974,6 +2463,10 @@ static HsInt unloadNativeObj_(void *handle)
 
 HsInt unloadNativeObj(void *handle) {
   ACQUIRE_LOCK(&linker_mutex);
+#if defined(OBJFORMAT_ELF) || defined(OBJFORMAT_MACHO)
+  // See Note [Caching dlsym results]
+  flushDlsymCache();
+#endif
   HsInt r = unloadNativeObj_(handle);
   RELEASE_LOCK(&linker_mutex);
   return r;
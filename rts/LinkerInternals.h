@@ -12,6 +12,7 @@
 #include "RtsSymbols.h"
 #include "Hash.h"
 #include "linker/M32Alloc.h"
+#include "linker/SymbolTable.h"
 
 #if RTS_LINKER_USE_MMAP
 #include <sys/mman.h>
@@ -72,6 +73,7 @@ typedef struct _Symbol
     SymbolName *name;
     SymbolAddr *addr;
     SymType type;
+    StgWord hash; /* hashSymbolName(name), see Note [Linker symbol table] */
 } Symbol_t;
 
 typedef struct NativeCodeRange_ {
@@ -253,6 +255,15 @@ struct _ObjectCode {
      */
     pathchar*      archiveMemberName;
 
+    /* For an archive member: where the member starts in the archive, which
+     * is where the image starts in fileName if the image is mapped (see
+     * Note [Mapping archive members] in linker/LoadArchive.c). For an
+     * OBJECT_LAZY member, also the names from the archive's symbol index
+     * that `symbols` points to (see Note [Lazy archive members]).
+     */
+    long           archiveOffset;
+    char*          lazyNames;
+
     /* An array containing ptrs to all the symbol names copied from
        this object into the global symbol hash table.  This is so that
        we know which parts of the latter mapping to nuke when this
@@ -268,7 +279,8 @@ struct _ObjectCode {
      */
     struct ObjectCodeFormatInfo* info;
 
-    /* non-zero if the object file was mmap'd, otherwise malloc'd */
+    /* non-zero if the object file was mmap'd, otherwise malloc'd. The
+       mapping starts at the page that image is in. */
     int        imageMapped;
 
     /* record by how much image has been deliberately misaligned
@@ -442,12 +454,12 @@ void addSection (Section *s, SectionKind kind, SectionAlloc alloc,
                  void* start, StgWord size, StgWord mapped_offset,
                  void* mapped_start, StgWord mapped_size);
 
-HsBool ghciLookupSymbolInfo(StrHashTable *table,
+HsBool ghciLookupSymbolInfo(SymbolTable *table,
                             const SymbolName* key, RtsSymbolInfo **result);
 
 int ghciInsertSymbolTable(
     pathchar* obj_name,
-    StrHashTable *table,
+    SymbolTable *table,
     const SymbolName* key,
     SymbolAddr* data,
     SymStrength weak,
@@ -462,7 +474,7 @@ SymbolAddr* lookupDependentSymbol (SymbolName* lbl, ObjectCode *dependent, SymTy
  * which in this case holds the module id and the symbol offset. */
 StgInt64 lookupTlsgdSymbol(const char *, unsigned long, ObjectCode *);
 
-extern StrHashTable *symhash;
+extern SymbolTable *symhash;
 
 pathchar*
 resolveSymbolAddr (pathchar* buffer, int size,
@@ -493,10 +505,30 @@ HsInt loadArchive_ (pathchar *path);
 #define USE_CONTIGUOUS_MMAP 0
 #endif
 
+/* Load and relocate several objects at once, see Note [Parallel object
+ * loading] in Linker.c. Not on aarch64 and riscv64, whose relocation code
+ * looks up symbols as it goes, nor on FreeBSD/x86_64, which looks up TLSGD
+ * symbols as it relocates. */
+#if defined(THREADED_RTS) && defined(OBJFORMAT_ELF) \
+    && !defined(aarch64_HOST_ARCH) && !defined(riscv64_HOST_ARCH) \
+    && !(defined(x86_64_HOST_ARCH) && defined(freebsd_HOST_OS))
+#define LINKER_PARALLEL 1
+#endif
+
+/* Relocate several objects at once. PE/COFF objects are relocated, though
+ * not indexed, in parallel as well. */
+#if defined(LINKER_PARALLEL) \
+    || (defined(THREADED_RTS) && defined(OBJFORMAT_PEi386))
+#define LINKER_PARALLEL_RELOCATION 1
+#endif
+
 HsInt isAlreadyLoaded( pathchar *path );
 OStatus getObjectLoadStatus_ (pathchar *path);
 ObjectCode *lookupObjectByPath(pathchar *path);
 HsInt loadOc( ObjectCode* oc );
+HsInt loadOcs( ObjectCode** ocs, uint32_t n );
+void insertLazyOc( ObjectCode* oc );
+bool readArchiveMember( ObjectCode* oc );
 ObjectCode* mkOc( ObjectType type, pathchar *path, char *image, int imageSize,
                   bool mapped, pathchar *archiveMemberName,
                   int misalignment
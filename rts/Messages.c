@@ -9,11 +9,13 @@
 #include "Rts.h"
 #include "RtsFlags.h"
 #include "Messages.h"
+#include "BlackHoles.h"
 #include "Trace.h"
 #include "Capability.h"
 #include "Schedule.h"
 #include "Threads.h"
 #include "RaiseAsync.h"
+#include "RtsUtils.h"
 #include "sm/Storage.h"
 #include "CloneStack.h"
 
@@ -21,12 +23,56 @@
    Send a message to another Capability
    ------------------------------------------------------------------------- */
 
+/* Note [The capability inbox]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Messages to a capability go on its inbox, a lock-free stack with many
+   producers (sendMessage, on any capability) and one consumer (the
+   capability itself, in scheduleProcessInbox). A sender pushes its message
+   with a CAS on cap->inbox; the owner takes the whole stack at once by
+   exchanging it with END_TSO_QUEUE, and then runs the messages without
+   further synchronisation. As only whole stacks are ever removed there is
+   no ABA problem. The CAS and the exchange are full barriers, so the owner
+   sees the message's fields written before it was pushed (see Note [Heap
+   memory barriers] in SMP.h).
+
+   cap->lock is still needed to wake an idle capability, and we must not
+   lose a message to a capability that goes idle just as we push it. The
+   sender pushes and then reads cap->running_task; releaseCapability_ sets
+   cap->running_task to NULL and then checks emptyInbox, both SEQ_CST, so at
+   least one of the two sees the other's write: either the sender sees the
+   capability free, and takes its lock to give it to a worker, or the
+   releasing task sees the message, and wakes a worker itself. If the
+   capability is running the sender only needs to interrupt it, without the
+   lock.
+
+   The putMVars list (messages from outside the RTS, see hs_try_putmvar)
+   stays under cap->lock.
+
+   Every capability counts the messages it sends to each capability
+   (cap->messages_sent, by the receiver's number), and the busiest pair is
+   reported by +RTS -s, to spot threads that keep talking across
+   capabilities.
+*/
+
 #if defined(THREADED_RTS)
 
-void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
+static void countMessage(Capability *from_cap, Capability *to_cap)
 {
-    ACQUIRE_LOCK(&to_cap->lock);
+    if (to_cap->no >= from_cap->messages_sent_size) {
+        const uint32_t size = stg_max(getNumCapabilities(), to_cap->no + 1);
+        from_cap->messages_sent =
+            stgReallocBytes(from_cap->messages_sent, size * sizeof(StgWord),
+                            "countMessage");
+        for (uint32_t i = from_cap->messages_sent_size; i < size; i++) {
+            from_cap->messages_sent[i] = 0;
+        }
+        from_cap->messages_sent_size = size;
+    }
+    from_cap->messages_sent[to_cap->no]++;
+}
 
+void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
+{
 #if defined(DEBUG)
     {
         const StgInfoTable *i = msg->header.info;
@@ -41,19 +87,29 @@ void sendMessage(Capability *from_cap, Capability *to_cap, Message *msg)
     }
 #endif
 
-    msg->link = to_cap->inbox;
-    RELAXED_STORE(&to_cap->inbox, msg);
-
     recordClosureMutated(from_cap,(StgClosure*)msg);
+    countMessage(from_cap, to_cap);
+
+    // See Note [The capability inbox]
+    Message *old;
+    do {
+        old = RELAXED_LOAD(&to_cap->inbox);
+        msg->link = old;
+    } while (cas((StgVolatilePtr)&to_cap->inbox, (StgWord)old, (StgWord)msg)
+             != (StgWord)old);
+
+    if (SEQ_CST_LOAD(&to_cap->running_task) != NULL) {
+        interruptCapability(to_cap);
+        return;
+    }
 
-    if (to_cap->running_task == NULL) {
-        to_cap->running_task = myTask();
+    ACQUIRE_LOCK(&to_cap->lock);
+    if (claimCapability(to_cap, myTask())) {
             // precond for releaseCapability_()
         releaseCapability_(to_cap,false);
     } else {
         interruptCapability(to_cap);
     }
-
     RELEASE_LOCK(&to_cap->lock);
 }
 
@@ -145,6 +201,18 @@ loop:
 
 #endif
 
+// Count msg->tso blocking on bh, owned by owner, which is on this
+// Capability. See Note [Blackhole contention] in BlackHoles.c.
+static void noteBlackHoleBlock(Capability *cap, StgTSO *owner, StgTSO *tso,
+                               StgClosure *bh)
+{
+    // If owner is the thread that blocks, it is the one running, and its
+    // stack pointer isn't saved.
+    noteBlackHoleContention(cap,
+                            owner == tso ? NULL : blackHoleThunkInfo(owner, bh),
+                            true);
+}
+
 /* ----------------------------------------------------------------------------
    Handle a MSG_BLACKHOLE message
 
@@ -262,6 +330,7 @@ uint32_t messageBlackHole(Capability *cap, MessageBlackHole *msg)
         debugTraceCap(DEBUG_sched, cap, "thread %" FMT_StgThreadID " blocked on"
                       " thread %" FMT_StgThreadID, msg->tso->id, owner->id);
 
+        noteBlackHoleBlock(cap, owner, msg->tso, bh);
         return 1; // blocked
     }
     else if (info == &stg_BLOCKING_QUEUE_CLEAN_info ||
@@ -312,6 +381,7 @@ uint32_t messageBlackHole(Capability *cap, MessageBlackHole *msg)
             promoteInRunQueue(cap, owner);
         }
 
+        noteBlackHoleBlock(cap, owner, msg->tso, bh);
         return 1; // blocked
     }
 
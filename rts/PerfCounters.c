@@ -0,0 +1,307 @@
+/* ---------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2025
+ *
+ * Hardware performance counters of the mutator and the GC (--perf-counters)
+ *
+ * --------------------------------------------------------------------------*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+#include "RtsUtils.h"
+#include "PerfCounters.h"
+#include "Trace.h"
+
+#if USE_PERF_COUNTERS
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Note [Hardware performance counters]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Whether a slow GC is bound by memory latency, and how much the layout and
+ * prefetching of the heap help with that, shows in the cache and TLB misses
+ * of the GC rather than its time. With +RTS --perf-counters, each OS thread
+ * of the RTS counts, with Linux perf_event, the cycles, instructions,
+ * last-level cache misses and data TLB misses (both of reads) it spends in
+ * each phase:
+ *
+ *   - PERF_MUTATOR: running Haskell code, between stat_startMutator and
+ *     stat_endMutator (so not in safe foreign calls);
+ *   - PERF_GC_COPY: a GC thread's part of a copying collection, between
+ *     stat_startGC or stat_startGCWorker and stat_endGCWorker;
+ *   - PERF_NONMOVING_MARK and PERF_NONMOVING_SWEEP: the mark and sweep of the
+ *     nonmoving collector, on its own thread and its mark helpers.
+ *
+ * A thread opens its counters, as one perf_event group so that they are
+ * read together, the first time it enters a phase. Reading the group takes
+ * one read() system call, so bracketing a phase costs two; that's nothing
+ * next to a GC, but adds up for the mutator of a program that switches
+ * threads very often. The counters only count user-space events, so they
+ * work with the default perf_event_paranoid setting of 2.
+ *
+ * Each thread adds up its counts per phase in its PerfThread, which it
+ * alone writes to; getPerfCounts sums them over all threads, racily. The
+ * PerfThreads stay on the list after their threads exit (perfThreadDone
+ * just closes the counters), so their counts aren't lost.
+ *
+ * +RTS -s shows the totals. With the eventlog's GC class, the end of each GC
+ * and nonmoving phase on a thread posts a PERF_COUNTERS event with its
+ * counts, and the start of a GC posts those of the thread's mutator since
+ * its previous GC.
+ *
+ * Counters that the CPU or a virtual machine doesn't provide are left out,
+ * and show as "n/a"; if there are none, initPerfCounters turns the flag off
+ * with a warning.
+ */
+
+typedef struct PerfThread_ {
+    uint32_t id;
+    int leader;                         // the group's fd, or -1
+    int fds[PERF_COUNTERS];             // -1 if not open
+    int slot[PERF_COUNTERS];            // position in the group's read()
+    uint32_t depth[PERF_PHASES];        // brackets we're in
+    PerfCounts start[PERF_PHASES];
+    PerfCounts totals[PERF_PHASES];
+    PerfCounts posted_mutator;          // mutator totals already posted
+    struct PerfThread_ *link;
+} PerfThread;
+
+static __thread PerfThread *perf_thread = NULL;
+
+static PerfThread *perf_threads = NULL;
+static uint32_t n_perf_threads = 0;
+#if defined(THREADED_RTS)
+static Mutex perf_mutex;
+#endif
+
+static bool perf_available[PERF_COUNTERS];
+
+static void perfEventAttr (PerfCounter c, struct perf_event_attr *attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    switch (c) {
+    case PERF_CYCLES:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_LLC_MISSES:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_LL
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_DTLB_MISSES:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_DTLB
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        barf("perfEventAttr: bad counter %d", c);
+    }
+}
+
+// Open the counters on the calling thread, those in want[] only
+static void openCounters (PerfThread *t, const bool want[PERF_COUNTERS])
+{
+    int n = 0;
+    t->leader = -1;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        t->fds[c] = -1;
+        t->slot[c] = -1;
+        if (!want[c]) {
+            continue;
+        }
+        struct perf_event_attr attr;
+        perfEventAttr(c, &attr);
+        if (t->leader == -1) {
+            attr.read_format = PERF_FORMAT_GROUP;
+        }
+        int fd = syscall(SYS_perf_event_open, &attr, 0 /* this thread */,
+                         -1 /* any CPU */, t->leader, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (t->leader == -1) {
+            t->leader = fd;
+        }
+        t->fds[c] = fd;
+        t->slot[c] = n++;
+    }
+}
+
+static void closeCounters (PerfThread *t)
+{
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        if (t->fds[c] >= 0) {
+            close(t->fds[c]);
+            t->fds[c] = -1;
+        }
+    }
+    t->leader = -1;
+}
+
+static bool readCounters (PerfThread *t, PerfCounts *counts)
+{
+    uint64_t buf[1 + PERF_COUNTERS];
+    if (t->leader < 0) {
+        return false;
+    }
+    ssize_t r = read(t->leader, buf, sizeof(buf));
+    if (r < (ssize_t) sizeof(uint64_t)) {
+        return false;
+    }
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        int s = t->slot[c];
+        counts->counts[c] = s >= 0 && (uint64_t) s < buf[0] ? buf[1 + s] : 0;
+    }
+    return true;
+}
+
+static PerfThread *myPerfThread (void)
+{
+    PerfThread *t = perf_thread;
+    if (t != NULL) {
+        return t;
+    }
+    t = stgCallocBytes(1, sizeof(PerfThread), "myPerfThread");
+    openCounters(t, perf_available);
+    ACQUIRE_LOCK(&perf_mutex);
+    t->id = n_perf_threads++;
+    t->link = perf_threads;
+    perf_threads = t;
+    RELEASE_LOCK(&perf_mutex);
+    perf_thread = t;
+    return t;
+}
+
+void initPerfCounters (void)
+{
+#if defined(THREADED_RTS)
+    initMutex(&perf_mutex);
+#endif
+
+    // Find out which counters we have by opening them all on this thread
+    const bool all[PERF_COUNTERS] = { true, true, true, true };
+    PerfThread t;
+    openCounters(&t, all);
+    bool any = false;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        perf_available[c] = t.fds[c] >= 0;
+        any = any || perf_available[c];
+    }
+    closeCounters(&t);
+
+    if (!any) {
+        errorBelch("warning: --perf-counters: hardware performance counters "
+                   "are not available (see perf_event_paranoid)");
+        RtsFlags.MiscFlags.perfCounters = false;
+    }
+}
+
+void exitPerfCounters (void)
+{
+    // Any thread still about won't count, or touch its PerfThread, again
+    RtsFlags.MiscFlags.perfCounters = false;
+
+    ACQUIRE_LOCK(&perf_mutex);
+    for (PerfThread *t = perf_threads, *next; t != NULL; t = next) {
+        next = t->link;
+        closeCounters(t);
+        stgFree(t);
+    }
+    perf_threads = NULL;
+    RELEASE_LOCK(&perf_mutex);
+    perf_thread = NULL;
+#if defined(THREADED_RTS)
+    closeMutex(&perf_mutex);
+#endif
+}
+
+void perfThreadDone (void)
+{
+    if (!RtsFlags.MiscFlags.perfCounters || perf_thread == NULL) {
+        return;
+    }
+    ACQUIRE_LOCK(&perf_mutex);
+    closeCounters(perf_thread);
+    RELEASE_LOCK(&perf_mutex);
+    perf_thread = NULL;
+}
+
+// The mutator's counts since the last time we posted them
+static void postMutatorCounts (PerfThread *t)
+{
+    PerfCounts delta;
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        delta.counts[c] = t->totals[PERF_MUTATOR].counts[c]
+            - t->posted_mutator.counts[c];
+    }
+    t->posted_mutator = t->totals[PERF_MUTATOR];
+    traceEventPerfCounters(PERF_MUTATOR, t->id, delta.counts);
+}
+
+void perfPhaseStart_ (PerfPhase phase)
+{
+    PerfThread *t = myPerfThread();
+    if (t->depth[phase]++ > 0) {
+        return;
+    }
+    if (phase == PERF_GC_COPY) {
+        postMutatorCounts(t);
+    }
+    if (!readCounters(t, &t->start[phase])) {
+        t->depth[phase] = 0;
+    }
+}
+
+void perfPhaseEnd_ (PerfPhase phase)
+{
+    PerfThread *t = perf_thread;
+    if (t == NULL || t->depth[phase] == 0 || --t->depth[phase] > 0) {
+        return;
+    }
+    PerfCounts now, delta;
+    if (!readCounters(t, &now)) {
+        return;
+    }
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        delta.counts[c] = now.counts[c] - t->start[phase].counts[c];
+        RELAXED_STORE(&t->totals[phase].counts[c],
+                      t->totals[phase].counts[c] + delta.counts[c]);
+    }
+    if (phase != PERF_MUTATOR) {
+        traceEventPerfCounters(phase, t->id, delta.counts);
+    }
+}
+
+void getPerfCounts (PerfPhase phase, PerfCounts *counts)
+{
+    memset(counts, 0, sizeof(*counts));
+    ACQUIRE_LOCK(&perf_mutex);
+    for (PerfThread *t = perf_threads; t != NULL; t = t->link) {
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            counts->counts[c] += RELAXED_LOAD(&t->totals[phase].counts[c]);
+        }
+    }
+    RELEASE_LOCK(&perf_mutex);
+}
+
+bool perfCounterAvailable (PerfCounter counter)
+{
+    return perf_available[counter];
+}
+
+#endif /* USE_PERF_COUNTERS */
@@ -0,0 +1,96 @@
+/* ---------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2025
+ *
+ * Hardware performance counters of the mutator and the GC (--perf-counters)
+ *
+ * --------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+#if defined(linux_HOST_OS)
+#define USE_PERF_COUNTERS 1
+#else
+#define USE_PERF_COUNTERS 0
+#endif
+
+// What the OS threads of the RTS are doing; see Note [Hardware performance
+// counters] in PerfCounters.c
+typedef enum {
+    PERF_MUTATOR,
+    PERF_GC_COPY,
+    PERF_NONMOVING_MARK,
+    PERF_NONMOVING_SWEEP,
+    PERF_PHASES
+} PerfPhase;
+
+// The counters, in this order in PerfCounts and the PERF_COUNTERS event
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_COUNTERS
+} PerfCounter;
+
+typedef struct {
+    uint64_t counts[PERF_COUNTERS];
+} PerfCounts;
+
+#if USE_PERF_COUNTERS
+
+// Check that the counters can be used, turning off --perf-counters with a
+// warning if they can't
+void initPerfCounters(void);
+void exitPerfCounters(void);
+
+// Bracket a phase on the calling OS thread, with --perf-counters. Brackets
+// of the same phase may nest, the inner ones counting for nothing.
+void perfPhaseStart_(PerfPhase phase);
+void perfPhaseEnd_(PerfPhase phase);
+
+INLINE_HEADER void perfPhaseStart(PerfPhase phase)
+{
+    if (RTS_UNLIKELY(RtsFlags.MiscFlags.perfCounters)) {
+        perfPhaseStart_(phase);
+    }
+}
+
+INLINE_HEADER void perfPhaseEnd(PerfPhase phase)
+{
+    if (RTS_UNLIKELY(RtsFlags.MiscFlags.perfCounters)) {
+        perfPhaseEnd_(phase);
+    }
+}
+
+// Called when an OS thread of the RTS exits, to close its counters
+void perfThreadDone(void);
+
+// The counts of a phase summed over all threads, and which of the counters
+// could be opened
+void getPerfCounts(PerfPhase phase, PerfCounts *counts);
+bool perfCounterAvailable(PerfCounter counter);
+
+#else
+
+INLINE_HEADER void initPerfCounters(void) {}
+INLINE_HEADER void exitPerfCounters(void) {}
+INLINE_HEADER void perfPhaseStart(PerfPhase phase STG_UNUSED) {}
+INLINE_HEADER void perfPhaseEnd(PerfPhase phase STG_UNUSED) {}
+INLINE_HEADER void perfThreadDone(void) {}
+INLINE_HEADER void getPerfCounts(PerfPhase phase STG_UNUSED, PerfCounts *counts)
+{
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        counts->counts[i] = 0;
+    }
+}
+INLINE_HEADER bool perfCounterAvailable(PerfCounter counter STG_UNUSED)
+{
+    return false;
+}
+
+#endif /* USE_PERF_COUNTERS */
+
+#include "EndPrivate.h"
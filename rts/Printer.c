@@ -823,6 +823,8 @@ void printLargeAndPinnedObjects(void)
 
         debugBelch("Capability %d: Current pinned object block: %p\n",
                    cap_idx, (void*)cap->pinned_object_block);
+        debugBelch("Capability %d: Current ephemeral pinned block: %p\n",
+                   cap_idx, (void*)cap->pinned_ephemeral_block);
         for (bdescr *bd = cap->pinned_object_blocks; bd; bd = bd->link) {
             debugBelch("%p\n", (void*)bd);
         }
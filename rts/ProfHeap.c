@@ -22,10 +22,29 @@
 #include "Arena.h"
 #include "Printer.h"
 #include "Trace.h"
+#include "sm/GC.h"
 #include "sm/GCThread.h"
+#include "sm/CNF.h"
+#include "sm/Storage.h"
 
 #include <fs_rts.h>
 #include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#if defined(HAVE_SYS_TYPES_H)
+#include <sys/types.h>
+#endif
+#if defined(HAVE_SYS_WAIT_H)
+#include <sys/wait.h>
+#endif
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+
+#if !defined(mingw32_HOST_OS) && !defined(wasm32_HOST_ARCH)
+#define FORKED_CENSUS_SUPPORTED
+#endif
 
 #if defined(darwin_HOST_OS)
 #include <xlocale.h>
@@ -172,13 +191,97 @@ initLDVCtr( counter *ctr )
 static Census *censuses = NULL;
 static uint32_t n_censuses = 0;
 
+// xorshift32 state, never 0. See Note [Sampled heap census]
+static uint32_t census_seed = 1;
+
+// See Note [Delta-encoded heap profile]
+static HashTable *delta_posted = NULL;
+static HashTable *delta_next = NULL;
+
 #if defined(PROFILING)
 static void aggregateCensusInfo( void );
 #endif
 
 static void dumpCensus( Census *census );
+static double sampledResidError( Census *census, counter *ctr );
+static void freeCensusSources( void );
+static void resetCensusDelta( void );
+static void waitCensusChild( void );
 
 static bool closureSatisfiesConstraints( const StgClosure* p );
+#if defined(PROFILING)
+static bool closureSatisfiesOwnConstraints( const StgClosure* p );
+static bool itblSatisfiesConstraints( const StgInfoTable *info );
+#endif
+
+/* Note [Interned closure descriptions]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * The description (-hd) and type (-hy) of a closure are strings that its
+ * info table points to (GET_PROF_DESC, GET_PROF_TYPE). Each module has
+ * strings of its own, so the same description or type is found at many
+ * addresses, and a census that used those as bands would count it in many
+ * bands, which would all be written to the .hp file under the same name.
+ * And the -hd and -hy selectors (closureSatisfiesConstraints()) compare
+ * these strings against their list of names for every closure.
+ *
+ * So closureIdentity() interns descriptions and types by their contents in
+ * descr_strings, and the band of a closure is the address of the interned
+ * copy. And as all of this depends on the info table alone, each Census
+ * keeps in census->itbls what heapProfObject() found for the closures of
+ * each info table: ITBL_DESELECTED if the -hd and -hy selectors rule them
+ * out, their counter in the census if the census is by -hd or -hy, and
+ * ITBL_SELECTED otherwise. The first closure of each info table in a
+ * census does the string work, and the others a single lookup, keyed by
+ * the info table, as the lookup of their counter was before.
+ *
+ * The table belongs to the census rather than to the run, so that the
+ * threads of a parallel census (Note [Parallel heap census]) or of one
+ * taken during GC (Note [Heap census during GC]) each have their own, and
+ * so that an info table that the linker unloads can't leave a stale entry
+ * behind. descr_strings is shared, under descr_mutex, but only the first
+ * closure of each info table in a census looks at it. The selectors that
+ * depend on the closure itself (the cost-centre stack, era and retainer
+ * selectors) are still checked for each closure, by
+ * closureSatisfiesOwnConstraints().
+ */
+
+#if defined(PROFILING)
+static StrHashTable *descr_strings = NULL;
+#if defined(THREADED_RTS)
+static Mutex descr_mutex;
+#endif
+
+// The values of census->itbls that aren't counters
+static counter itbl_deselected, itbl_selected;
+#define ITBL_DESELECTED (&itbl_deselected)
+#define ITBL_SELECTED   (&itbl_selected)
+
+// Are the closures of an info table all alike for this profile?
+static bool
+useItblCache( void )
+{
+    return RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_DESCR
+        || RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_TYPE
+        || RtsFlags.ProfFlags.descrSelector != NULL
+        || RtsFlags.ProfFlags.typeSelector != NULL;
+}
+
+static const char *
+internDescr( const char *str )
+{
+    char *s;
+
+    ACQUIRE_LOCK(&descr_mutex);
+    s = lookupStrHashTable(descr_strings, str);
+    if (s == NULL) {
+        s = stgMallocBytes(strlen(str) + 1, "internDescr");
+        strcpy(s, str);
+        insertStrHashTable(descr_strings, s, s);
+    }
+    RELEASE_LOCK(&descr_mutex);
+    return s;
+}
+#endif
 
 /* ----------------------------------------------------------------------------
  * Find the "closure identity", which is a unique pointer representing
@@ -196,14 +299,15 @@ closureIdentity( const StgClosure *p )
     case HEAP_BY_MOD:
         return p->header.prof.ccs->cc->module;
     case HEAP_BY_DESCR:
-        return GET_PROF_DESC(get_itbl(p));
+        // See Note [Interned closure descriptions]
+        return internDescr(GET_PROF_DESC(get_itbl(p)));
     case HEAP_BY_ERA:
         // Static objects should have user_era = 0
         // MP: If user_era == 0 then closureIdentity returns the NULL pointer, and
         // the closure is not counted to the census
         return (void *)p->header.prof.hp.era;
     case HEAP_BY_TYPE:
-        return GET_PROF_TYPE(get_itbl(p));
+        return internDescr(GET_PROF_TYPE(get_itbl(p)));
     case HEAP_BY_RETAINER:
         // AFAIK, the only closures in the heap which might not have a
         // valid retainer set are DEAD_WEAK closures.
@@ -252,9 +356,13 @@ closureIdentity( const StgClosure *p )
 // LDV_recordDead() may be called from elsewhere in the runtime system. E.g.,
 // when a thunk is replaced by an indirection object.
 
+//
+// A closure found dead by a sampled LdvCensusForDead() stands for weight
+// closures, see Note [Sampled biographical profiling].
+
 #if defined(PROFILING)
 void
-LDV_recordDead( const StgClosure *c, uint32_t size )
+LDV_recordDeadWeighted( const StgClosure *c, uint32_t size, uint32_t weight )
 {
     const void *id;
     uint32_t t;
@@ -269,9 +377,10 @@ LDV_recordDead( const StgClosure *c, uint32_t size )
             t = (LDVW((c)) & LDV_CREATE_MASK) >> LDV_SHIFT;
             if (t < era) {
                 if (RtsFlags.ProfFlags.bioSelector == NULL) {
-                    censuses[t].void_total   += size;
-                    censuses[era].void_total -= size;
-                    ASSERT(censuses[t].void_total <= censuses[t].not_used);
+                    censuses[t].void_total   += (ssize_t)size * weight;
+                    censuses[era].void_total -= (ssize_t)size * weight;
+                    ASSERT(RtsFlags.ProfFlags.censusSampleRate > 1 ||
+                           censuses[t].void_total <= censuses[t].not_used);
                 } else {
                     id = closureIdentity(c);
                     ctr = lookupHashTable(censuses[t].hash, (StgWord)id);
@@ -295,8 +404,8 @@ LDV_recordDead( const StgClosure *c, uint32_t size )
             t = LDVW((c)) & LDV_LAST_MASK;
             if (t + 1 < era) {
                 if (RtsFlags.ProfFlags.bioSelector == NULL) {
-                    censuses[t+1].drag_total += size;
-                    censuses[era].drag_total -= size;
+                    censuses[t+1].drag_total += (ssize_t)size * weight;
+                    censuses[era].drag_total -= (ssize_t)size * weight;
                 } else {
                     const void *id;
                     id = closureIdentity(c);
@@ -318,6 +427,12 @@ LDV_recordDead( const StgClosure *c, uint32_t size )
         }
     }
 }
+
+void
+LDV_recordDead( const StgClosure *c, uint32_t size )
+{
+    LDV_recordDeadWeighted(c, size, 1);
+}
 #endif
 
 /* --------------------------------------------------------------------------
@@ -329,30 +444,50 @@ initEra(Census *census)
 {
     // N.B. When not LDV profiling we reinitialise the same Census over
     // and over again. Consequently, we need to ensure that we free the
-    // resources from the previous census.
+    // resources from the previous census, but we keep its arena, emptied,
+    // for the counters and hash table entries of this one.
     if (census->hash) {
         freeHashTable(census->hash, NULL);
     }
+    if (census->itbls) {
+        freeHashTable(census->itbls, NULL);
+    }
     if (census->arena) {
-        arenaFree(census->arena);
+        arenaReset(census->arena);
+    } else {
+        census->arena = newArena();
     }
 
-    census->hash  = allocHashTable();
+    census->hash  = allocHashTableInArena(census->arena);
     census->ctrs  = NULL;
-    census->arena = newArena();
+#if defined(PROFILING)
+    census->itbls = useItblCache() ? allocHashTableInArena(census->arena)
+                                   : NULL;
+#else
+    census->itbls = NULL;
+#endif
 
     census->not_used   = 0;
     census->used       = 0;
     census->prim       = 0;
     census->void_total = 0;
     census->drag_total = 0;
+
+    census->sampled_blocks = 0;
+    census->block_ctrs = NULL;
+
+    memset(census->size_objects, 0, sizeof(census->size_objects));
+    memset(census->size_words, 0, sizeof(census->size_words));
 }
 
 STATIC_INLINE void
 freeEra(Census *census)
 {
-    arenaFree(census->arena);
     freeHashTable(census->hash, NULL);
+    if (census->itbls) {
+        freeHashTable(census->itbls, NULL);
+    }
+    arenaFree(census->arena);
 }
 
 /* --------------------------------------------------------------------------
@@ -427,6 +562,11 @@ printSample(bool beginSample, StgDouble sampleValue)
 void freeHeapProfiling (void)
 {
     free_prof_locale();
+    freeCensusSources();
+    if (delta_posted != NULL) {
+        freeHashTable(delta_posted, NULL);
+        delta_posted = NULL;
+    }
 }
 
 /* --------------------------------------------------------------------------
@@ -488,7 +628,56 @@ initHeapProfiling(void)
         stg_exit(EXIT_FAILURE);
     }
 #endif
+    // See Note [Sampled biographical profiling]
+    if (RtsFlags.ProfFlags.censusSampleRate > 1
+        && RtsFlags.ProfFlags.bioSelector != NULL) {
+        errorBelch("--heap-census-sample cannot be used with a -hb<bio> "
+                   "restriction");
+        stg_exit(EXIT_FAILURE);
+    }
+    // See Note [Heap census during GC]
+    if (RtsFlags.ProfFlags.censusDuringGc
+        && (doingLDVProfiling() || RtsFlags.ProfFlags.bioSelector != NULL
+            || doingRetainerProfiling()
+            || RtsFlags.ProfFlags.retainerSelector != NULL)) {
+        errorBelch("--heap-census-during-gc cannot be used with -hb or -hr");
+        stg_exit(EXIT_FAILURE);
+    }
+#endif
+    if (RtsFlags.ProfFlags.censusDuringGc
+        && RtsFlags.ProfFlags.censusSampleRate > 1) {
+        errorBelch("--heap-census-during-gc cannot be used with "
+                   "--heap-census-sample");
+        stg_exit(EXIT_FAILURE);
+    }
+    // See Note [Forked heap census]
+    if (RtsFlags.ProfFlags.censusFork) {
+#if !defined(FORKED_CENSUS_SUPPORTED)
+        errorBelch("--heap-census-fork is not supported on this platform");
+        stg_exit(EXIT_FAILURE);
 #endif
+        if (RtsFlags.ProfFlags.censusDuringGc
+            || RtsFlags.ProfFlags.censusDelta
+#if defined(PROFILING)
+            || doingLDVProfiling() || doingRetainerProfiling()
+#endif
+            ) {
+            errorBelch("--heap-census-fork cannot be used with -hb, -hr, "
+                       "--heap-census-during-gc or --heap-prof-delta");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+    // See Note [Delta-encoded heap profile]
+    if (RtsFlags.ProfFlags.censusDelta) {
+        if (RtsFlags.ProfFlags.doHeapProfile != HEAP_BY_INFO_TABLE) {
+            errorBelch("--heap-prof-delta can only be used with -hi");
+            stg_exit(EXIT_FAILURE);
+        }
+        resetCensusDelta();
+        traceInitEvent(resetCensusDelta);
+    }
+
+    census_seed = (uint32_t)getMonotonicNSec() | 1;
 
 #if defined(PROFILING)
     if (doingErasProfiling()){
@@ -514,12 +703,21 @@ initHeapProfiling(void)
     // max_era = 2^LDV_SHIFT
     max_era = 1 << LDV_SHIFT;
 
+#if defined(PROFILING)
+    // See Note [Interned closure descriptions]
+    descr_strings = allocStrHashTable();
+#if defined(THREADED_RTS)
+    initMutex(&descr_mutex);
+#endif
+#endif
+
     censuses = stgMallocBytes(sizeof(Census) * n_censuses, "initHeapProfiling");
 
     // Ensure that arena and hash are NULL since otherwise initEra will attempt to free them.
     for (unsigned int i=0; i < n_censuses; i++) {
         censuses[i].arena = NULL;
         censuses[i].hash = NULL;
+        censuses[i].itbls = NULL;
     }
     initEra( &censuses[era] );
 
@@ -567,6 +765,9 @@ endHeapProfiling(void)
         return;
     }
 
+    // the last forked census must be in the file before the final sample
+    waitCensusChild();
+
     set_prof_locale();
 
 #if defined(PROFILING)
@@ -596,6 +797,14 @@ endHeapProfiling(void)
 
     stgFree(censuses);
 
+#if defined(PROFILING)
+    freeStrHashTable(descr_strings, stgFree);
+    descr_strings = NULL;
+#if defined(THREADED_RTS)
+    closeMutex(&descr_mutex);
+#endif
+#endif
+
     RTSStats stats;
     getRTSStats(&stats);
     Time mut_time = stats.mutator_cpu_ns;
@@ -699,6 +908,36 @@ closureSatisfiesConstraints( const StgClosure* p )
     (void)p;   /* keep gcc -Wall happy */
     return true;
 #else
+   return closureSatisfiesOwnConstraints(p)
+       && itblSatisfiesConstraints(get_itbl(p));
+#endif /* PROFILING */
+}
+
+#if defined(PROFILING)
+// The selectors that depend on the info table alone, see
+// Note [Interned closure descriptions]
+static bool
+itblSatisfiesConstraints( const StgInfoTable *info )
+{
+   bool b;
+
+   if (RtsFlags.ProfFlags.descrSelector) {
+       b = strMatchesSelector( GET_PROF_DESC(info),
+                               RtsFlags.ProfFlags.descrSelector );
+       if (!b) return false;
+   }
+   if (RtsFlags.ProfFlags.typeSelector) {
+       b = strMatchesSelector( GET_PROF_TYPE(info),
+                               RtsFlags.ProfFlags.typeSelector );
+       if (!b) return false;
+   }
+   return true;
+}
+
+// The selectors that depend on the closure itself
+static bool
+closureSatisfiesOwnConstraints( const StgClosure* p )
+{
    bool b;
 
    // The CCS has a selected field to indicate whether this closure is
@@ -708,16 +947,6 @@ closureSatisfiesConstraints( const StgClosure* p )
        return false;
    }
 
-   if (RtsFlags.ProfFlags.descrSelector) {
-       b = strMatchesSelector( (GET_PROF_DESC(get_itbl((StgClosure *)p))),
-                                 RtsFlags.ProfFlags.descrSelector );
-       if (!b) return false;
-   }
-   if (RtsFlags.ProfFlags.typeSelector) {
-       b = strMatchesSelector( (GET_PROF_TYPE(get_itbl((StgClosure *)p))),
-                                RtsFlags.ProfFlags.typeSelector );
-       if (!b) return false;
-   }
    if (RtsFlags.ProfFlags.eraSelector) {
       return (p->header.prof.hp.era == RtsFlags.ProfFlags.eraSelector);
    }
@@ -741,9 +970,35 @@ closureSatisfiesConstraints( const StgClosure* p )
        return false;
    }
    return true;
-#endif /* PROFILING */
 }
 
+// What the closures of p's info table count towards in census, see
+// Note [Interned closure descriptions]
+static counter *
+lookupItbl( Census *census, const StgClosure *p )
+{
+    const StgInfoTable *info = get_itbl(p);
+    counter *ctr = lookupHashTable(census->itbls, (StgWord)info);
+
+    if (ctr == NULL) {
+        if (!itblSatisfiesConstraints(info)) {
+            ctr = ITBL_DESELECTED;
+        } else if (RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_DESCR
+                   || RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_TYPE) {
+            const void *identity = closureIdentity(p);
+            ctr = lookupHashTable(census->hash, (StgWord)identity);
+            if (ctr == NULL) {
+                ctr = heapInsertNewCounter(census, (StgWord)identity);
+            }
+        } else {
+            ctr = ITBL_SELECTED;
+        }
+        insertHashTable(census->itbls, (StgWord)info, ctr);
+    }
+    return ctr;
+}
+#endif /* PROFILING */
+
 /* -----------------------------------------------------------------------------
  * Aggregate the heap census info for biographical profiling
  * -------------------------------------------------------------------------- */
@@ -772,6 +1027,8 @@ aggregateCensusInfo( void )
         // To get the count of live words that are void at each
         // census, just propagate the void_total count forwards:
 
+        const uint32_t rate = RtsFlags.ProfFlags.censusSampleRate;
+
         void_total = 0;
         drag_total = 0;
         for (t = 1; t < era; t++) { // note: start at 1, not 0
@@ -780,6 +1037,17 @@ aggregateCensusInfo( void )
             censuses[t].void_total = void_total;
             censuses[t].drag_total = drag_total;
 
+            if (rate > 1) {
+                // See Note [Sampled biographical profiling]
+                censuses[t].not_used *= rate;
+                censuses[t].used     *= rate;
+                censuses[t].prim     *= rate;
+                censuses[t].void_total = stg_min(stg_max(0, void_total),
+                                                 censuses[t].not_used);
+                censuses[t].drag_total = stg_min(stg_max(0, drag_total),
+                                                 censuses[t].used);
+            }
+
             ASSERT( censuses[t].void_total <= censuses[t].not_used );
             // should be true because: void_total is the count of
             // live words that are void at this census, which *must*
@@ -799,7 +1067,7 @@ aggregateCensusInfo( void )
     // aggregate the counters forwards.
 
     arena = newArena();
-    acc = allocHashTable();
+    acc = allocHashTableInArena(arena);
     ctrs = NULL;
 
     for (t = 1; t < era; t++) {
@@ -853,6 +1121,106 @@ aggregateCensusInfo( void )
 }
 #endif
 
+/* Note [Delta-encoded heap profile]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A census of a large program by info table (-hi) has tens of thousands of
+ * bands, and most of them barely change from one census to the next. With
+ * --heap-prof-delta[=<size>], rather than a HEAP_PROF_SAMPLE_STRING event
+ * per band, each census posts HEAP_PROF_SAMPLE_DELTA events listing only the
+ * bands whose residency changed by more than <size> bytes since the
+ * residency last posted for them, as (info table, residency) pairs of
+ * words. A band that has gone is posted with a residency of 0. A consumer
+ * keeps the last residency of each band, which is its residency until the
+ * band is posted again, so its view of a census is never off by more than
+ * <size> bytes per band.
+ *
+ * delta_posted maps each band to the residency last posted for it. While
+ * dumpCensus posts a census, censusDeltaBand() builds delta_next, the same
+ * map after the census, and endCensusDelta() posts the bands missing from
+ * the census before swapping the two. Neither map holds a residency of 0,
+ * as lookupHashTable can't tell it from a missing band.
+ *
+ * A consumer that joins after the start (e.g. through --eventlog-socket)
+ * or the eventlog of a forked child needs every band once: the init event
+ * resetCensusDelta() makes the next census post all of them.
+ *
+ * The .hp file is still written in full.
+ */
+
+#define CENSUS_DELTA_CHUNK 1024  // bands per HEAP_PROF_SAMPLE_DELTA event
+
+static StgWord64 delta_bands[2 * CENSUS_DELTA_CHUNK];
+static uint32_t n_delta_bands = 0;
+static bool delta_reset = false;
+
+static void
+resetCensusDelta( void )
+{
+    RELAXED_STORE(&delta_reset, true);
+}
+
+static void
+postCensusDelta( void )
+{
+    if (n_delta_bands > 0) {
+        traceHeapProfSampleDelta(0, n_delta_bands, delta_bands);
+        n_delta_bands = 0;
+    }
+}
+
+static void
+addCensusDelta( StgWord identity, StgWord64 resid )
+{
+    delta_bands[2 * n_delta_bands] = identity;
+    delta_bands[2 * n_delta_bands + 1] = resid;
+    if (++n_delta_bands == CENSUS_DELTA_CHUNK) {
+        postCensusDelta();
+    }
+}
+
+static void
+censusDeltaBand( const void *identity, StgWord resid )
+{
+    StgWord last = 0;
+
+    if (delta_next == NULL) {
+        delta_next = allocHashTable();
+    }
+    if (delta_posted != NULL) {
+        last = (StgWord)lookupHashTable(delta_posted, (StgWord)identity);
+    }
+    const StgWord diff = resid > last ? resid - last : last - resid;
+    if (last == 0 || diff > RtsFlags.ProfFlags.censusDeltaThreshold) {
+        addCensusDelta((StgWord)identity, resid);
+        last = resid;
+    }
+    insertHashTable(delta_next, (StgWord)identity, (void *)last);
+}
+
+static void
+postVanishedBand( void *data STG_UNUSED, StgWord identity,
+                  const void *value STG_UNUSED )
+{
+    if (lookupHashTable(delta_next, identity) == NULL) {
+        addCensusDelta(identity, 0);
+    }
+}
+
+static void
+endCensusDelta( void )
+{
+    if (delta_next == NULL) {
+        delta_next = allocHashTable();
+    }
+    if (delta_posted != NULL) {
+        mapHashTable(delta_posted, NULL, postVanishedBand);
+        freeHashTable(delta_posted, NULL);
+    }
+    postCensusDelta();
+    delta_posted = delta_next;
+    delta_next = NULL;
+}
+
 /* -----------------------------------------------------------------------------
  * Print out the results of a heap census.
  * -------------------------------------------------------------------------- */
@@ -873,6 +1241,16 @@ dumpCensus( Census *census )
       traceHeapProfSampleBegin(era);
     }
 
+    // See Note [Delta-encoded heap profile]
+    const bool delta = RtsFlags.ProfFlags.censusDelta;
+    if (delta && RELAXED_LOAD(&delta_reset)) {
+        RELAXED_STORE(&delta_reset, false);
+        if (delta_posted != NULL) {
+            freeHashTable(delta_posted, NULL);
+            delta_posted = NULL;
+        }
+    }
+
 
 
 #if defined(PROFILING)
@@ -931,7 +1309,8 @@ dumpCensus( Census *census )
         } else
 #endif
         {
-            count = ctr->c.resid;
+            // See Note [Sampled heap census]
+            count = ctr->c.resid * RtsFlags.ProfFlags.censusSampleRate;
         }
 
         ASSERT( count >= 0 );
@@ -946,6 +1325,10 @@ dumpCensus( Census *census )
             break;
         case HEAP_BY_INFO_TABLE:
             fprintf(hp_file, "%p", ctr->identity);
+            if (delta) {
+                censusDeltaBand(ctr->identity, count * sizeof(W_));
+                break;
+            }
             char str[100];
             sprintf(str, "%p", ctr->identity);
             traceHeapProfSampleString(0, str, count * sizeof(W_));
@@ -1000,8 +1383,23 @@ dumpCensus( Census *census )
         }
 
         fprintf(hp_file, "\t%" FMT_Word "\n", (W_)count * sizeof(W_));
+
+        // See Note [Sampled heap census]; there is no event for a
+        // retainer set, nor for a band of a delta-encoded census
+        if (RtsFlags.ProfFlags.censusSampleRate > 1 && !delta
+            && RtsFlags.ProfFlags.doHeapProfile != HEAP_BY_RETAINER) {
+            traceHeapProfSampleError(0,
+                (StgWord)(sampledResidError(census, ctr) * sizeof(W_)));
+        }
+    }
+
+    if (delta) {
+        endCensusDelta();
     }
 
+    traceHeapProfSizeHistogram(0, CENSUS_SIZE_BUCKETS,
+                               census->size_objects, census->size_words,
+                               RtsFlags.ProfFlags.censusSampleRate);
     traceHeapProfSampleEnd(era);
     printSample(false, census->time);
 
@@ -1011,17 +1409,137 @@ dumpCensus( Census *census )
 inline counter*
 heapInsertNewCounter(Census *census, StgWord identity)
 {
-    counter *ctr = arenaAlloc(census->arena, sizeof(counter));
+    // A census counted during GC has no arena, see
+    // Note [Heap census during GC]
+    counter *ctr = census->arena != NULL
+        ? arenaAlloc(census->arena, sizeof(counter))
+        : stgMallocBytes(sizeof(counter), "heapInsertNewCounter");
 
     initLDVCtr(ctr);
     insertHashTable( census->hash, identity, ctr );
     ctr->identity = (void*)identity;
     ctr->next = census->ctrs;
     census->ctrs = ctr;
+    ctr->block_resid = 0;
+    ctr->resid_sq = 0;
+    ctr->block_next = NULL;
 
     return ctr;
 }
 
+/* Note [Sampled heap census]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Even when parallel (Note [Parallel heap census]), a census costs time in
+ * proportion to the size of the heap. With --heap-census-sample=<n>, a
+ * census visits only 1 in n of the blocks of each CensusSource, which is a
+ * block list of a single generation (or the nonmoving heap): the k'th item
+ * of a source is visited when k % n is the source's skip, a random offset
+ * chosen afresh for each source at each census. This is systematic sampling
+ * stratified by generation and by block list, and each visited block stands
+ * for n blocks, so dumpCensus() reports n times the residency counted.
+ *
+ * To tell how far off that estimate may be, each counter also keeps the sum
+ * of the squares of its residency in each visited block: sampleResid()
+ * adds to counter.block_resid while a block is visited, and
+ * endSampledBlock() adds its square into counter.resid_sq. Treating the m
+ * visited blocks as a simple random sample of the N = n*m blocks, the
+ * variance of a band's estimate T is
+ *
+ *     Var(T) = N^2 (1 - 1/n) s^2 / m
+ *
+ * with s^2 the variance of the band's residency per visited block. A
+ * stratified sample usually does better than a simple random one, so this
+ * tends to err on the safe side. A sampled census posts a HEAP_PROF_SAMPLE_ERROR event,
+ * the half-width of the 95% confidence interval of the estimate, after the
+ * event of each band.
+ *
+ * A biographical profile (-hb) can be sampled too, see
+ * Note [Sampled biographical profiling].
+ */
+
+/* Note [Sampled biographical profiling]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A biographical profile (-hb) costs more than a census: on top of the
+ * census, LdvCensusForDead() visits every closure that dies, at every GC,
+ * to find out how long it was void or dragging. With
+ * --heap-census-sample=<n>, both are sampled by block. The census visits 1
+ * in n blocks as in Note [Sampled heap census], and the dead closures are
+ * only looked for in 1 in n of the blocks that each GC frees, again from a
+ * random offset in each block list, each one counting for n closures
+ * (LDV_recordDeadWeighted()). A block is picked irrespective of the ages
+ * and states of the closures in it, so each sample is an unbiased estimate
+ * of its totals, and aggregateCensusInfo() scales the census totals by n
+ * to match the void and drag totals, which are already scaled.
+ *
+ * The state of each closure is still kept in the LDV word of its
+ * profiling header, which the code generator fills in for every closure
+ * of a profiled program whether or not we sample.
+ *
+ * The estimates don't have to agree with each other: the void words
+ * estimated for a census can exceed the unused words estimated for it.
+ * aggregateCensusInfo() clamps void (resp. drag) between 0 and the unused
+ * (resp. used) words, so the bands stay non-negative. A -hb<bio>
+ * restriction aggregates counters by identity, which a sample may not have
+ * seen at the census a closure was created in, so it can't be sampled.
+ */
+
+STATIC_INLINE void
+sampleResid(Census *census, counter *ctr, ssize_t real_size)
+{
+    if (RtsFlags.ProfFlags.censusSampleRate > 1) {
+        if (ctr->block_resid == 0) {
+            ctr->block_next = census->block_ctrs;
+            census->block_ctrs = ctr;
+        }
+        ctr->block_resid += real_size;
+    }
+}
+
+static void
+endSampledBlock(Census *census)
+{
+    counter *ctr, *next;
+
+    for (ctr = census->block_ctrs; ctr != NULL; ctr = next) {
+        next = ctr->block_next;
+        ctr->resid_sq += (double)ctr->block_resid * (double)ctr->block_resid;
+        ctr->block_resid = 0;
+        ctr->block_next = NULL;
+    }
+    census->block_ctrs = NULL;
+    census->sampled_blocks++;
+}
+
+// The half-width of the 95% confidence interval of the estimate
+// rate * ctr->c.resid, in words. See Note [Sampled heap census].
+static double
+sampledResidError(Census *census, counter *ctr)
+{
+    const double rate = RtsFlags.ProfFlags.censusSampleRate;
+    const double m = census->sampled_blocks;
+
+    if (m < 2) {
+        return 0;
+    }
+    double mean = ctr->c.resid / m;
+    double s2 = (ctr->resid_sq - m * mean * mean) / (m - 1);
+    if (s2 < 0) {
+        s2 = 0;
+    }
+    return 1.96 * rate * sqrt(m * (1 - 1 / rate) * s2);
+}
+
+static void
+countClosureSize(Census *census, size_t size)
+{
+    uint32_t b = size > 1 ? 63 - __builtin_clzll((StgWord64)size) : 0;
+    if (b >= CENSUS_SIZE_BUCKETS) {
+        b = CENSUS_SIZE_BUCKETS - 1;
+    }
+    census->size_objects[b]++;
+    census->size_words[b] += size;
+}
+
 static void heapProfObject(Census *census, StgClosure *p, size_t size,
                            bool prim
 #if !defined(PROFILING)
@@ -1031,66 +1549,70 @@ static void heapProfObject(Census *census, StgClosure *p, size_t size,
 {
     const void *identity;
     size_t real_size;
-    counter *ctr;
-
-            identity = NULL;
+    counter *ctr = NULL;
 
 #if defined(PROFILING)
-            // subtract the profiling overhead
-            real_size = size - sizeofW(StgProfHeader);
+    // subtract the profiling overhead
+    real_size = size - sizeofW(StgProfHeader);
+
+    // See Note [Interned closure descriptions]
+    if (census->itbls != NULL) {
+        if (!closureSatisfiesOwnConstraints(p)) {
+            return;
+        }
+        ctr = lookupItbl(census, p);
+        if (ctr == ITBL_DESELECTED) {
+            return;
+        } else if (ctr == ITBL_SELECTED) {
+            ctr = NULL;
+        }
+    } else
 #else
-            real_size = size;
+    real_size = size;
 #endif
+    if (!closureSatisfiesConstraints((StgClosure*)p)) {
+        return;
+    }
 
-            if (closureSatisfiesConstraints((StgClosure*)p)) {
+    countClosureSize(census, real_size);
 #if defined(PROFILING)
-                if (RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_LDV) {
-                    if (prim)
-                        census->prim += real_size;
-                    else if ((LDVW(p) & LDV_STATE_MASK) == LDV_STATE_CREATE)
-                        census->not_used += real_size;
-                    else
-                        census->used += real_size;
-                } else
+    if (RtsFlags.ProfFlags.doHeapProfile == HEAP_BY_LDV) {
+        if (prim)
+            census->prim += real_size;
+        else if ((LDVW(p) & LDV_STATE_MASK) == LDV_STATE_CREATE)
+            census->not_used += real_size;
+        else
+            census->used += real_size;
+        return;
+    }
 #endif
-                {
-                    identity = closureIdentity((StgClosure *)p);
 
-                    if (identity != NULL) {
-                        ctr = lookupHashTable(census->hash, (StgWord)identity);
-                        if (ctr != NULL) {
-#if defined(PROFILING)
-                            if (RtsFlags.ProfFlags.bioSelector != NULL) {
-                                if (prim)
-                                    ctr->c.ldv.prim += real_size;
-                                else if ((LDVW(p) & LDV_STATE_MASK) == LDV_STATE_CREATE)
-                                    ctr->c.ldv.not_used += real_size;
-                                else
-                                    ctr->c.ldv.used += real_size;
-                            } else
-#endif
-                            {
-                                ctr->c.resid += real_size;
-                            }
-                        } else {
-                            ctr = heapInsertNewCounter(census, (StgWord)identity);
+    if (ctr == NULL) {
+        identity = closureIdentity((StgClosure *)p);
+        if (identity == NULL) {
+            return;
+        }
+        ctr = lookupHashTable(census->hash, (StgWord)identity);
+        if (ctr == NULL) {
+            // a new counter starts from 0
+            ctr = heapInsertNewCounter(census, (StgWord)identity);
+        }
+    }
+
 #if defined(PROFILING)
-                            if (RtsFlags.ProfFlags.bioSelector != NULL) {
-                                if (prim)
-                                    ctr->c.ldv.prim = real_size;
-                                else if ((LDVW(p) & LDV_STATE_MASK) == LDV_STATE_CREATE)
-                                    ctr->c.ldv.not_used = real_size;
-                                else
-                                    ctr->c.ldv.used = real_size;
-                            } else
+    if (RtsFlags.ProfFlags.bioSelector != NULL) {
+        if (prim)
+            ctr->c.ldv.prim += real_size;
+        else if ((LDVW(p) & LDV_STATE_MASK) == LDV_STATE_CREATE)
+            ctr->c.ldv.not_used += real_size;
+        else
+            ctr->c.ldv.used += real_size;
+    } else
 #endif
-                            {
-                                ctr->c.resid = real_size;
-                            }
-                        }
-                    }
-                }
-            }
+    {
+        ctr->c.resid += real_size;
+        sampleResid(census, ctr, real_size);
+    }
 }
 
 // Compact objects require special handling code because they
@@ -1101,14 +1623,12 @@ static void heapProfObject(Census *census, StgClosure *p, size_t size,
 //
 // See Note [Compact Normal Forms] for details.
 static void
-heapCensusCompactList(Census *census, bdescr *bd)
+heapCensusCompactBlock(Census *census, bdescr *bd)
 {
-    for (; bd != NULL; bd = bd->link) {
-        StgCompactNFDataBlock *block = (StgCompactNFDataBlock*)bd->start;
-        StgCompactNFData *str = block->owner;
-        heapProfObject(census, (StgClosure*)str,
-                       compact_nfdata_full_sizeW(str), true);
-    }
+    StgCompactNFDataBlock *block = (StgCompactNFDataBlock*)bd->start;
+    StgCompactNFData *str = block->owner;
+    heapProfObject(census, (StgClosure*)str,
+                   compact_nfdata_full_sizeW(str), true);
 }
 
 /*
@@ -1378,51 +1898,534 @@ heapCensusSegment (Census* census, struct NonmovingSegment* seg )
  * is running.
  */
 
+/* -----------------------------------------------------------------------------
+ * Code to perform a heap census.
+ * -------------------------------------------------------------------------- */
 static void
-heapCensusSegmentList (Census* census, struct NonmovingSegment* seg )
+heapCensusChainBlock( Census *census, bdescr *bd )
 {
-  for (; seg; seg = seg->link) {
-    heapCensusSegment(census, seg);
-  }
+    // When we shrink a large ARR_WORDS, we do not adjust the free pointer
+    // of the associated block descriptor, thus introducing slop at the end
+    // of the object.  This slop remains after GC, violating the assumption
+    // of the loop below that all slop has been eliminated (#11627).
+    // The slop isn't always zeroed (e.g. in non-profiling mode, cf
+    // OVERWRITING_CLOSURE_OFS).
+    // Consequently, we handle large ARR_WORDS objects as a special case.
+    if (bd->flags & BF_LARGE) {
+        StgPtr p = bd->start;
+        // There may be some initial zeros due to object alignment.
+        while (p < bd->free && !*p) p++;
+        if (get_itbl((StgClosure *)p)->type == ARR_WORDS) {
+            size_t size = arr_words_sizeW((StgArrBytes *)p);
+            bool prim = true;
+            heapProfObject(census, (StgClosure *)p, size, prim);
+            return;
+        }
+    }
+
+    heapCensusBlock(census, bd);
 }
 
-/* -----------------------------------------------------------------------------
- * Code to perform a heap census.
- * -------------------------------------------------------------------------- */
+/* Note [Parallel heap census]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A census walks every block of the heap, which on a large heap takes long
+ * enough to dominate the pause. heapCensus() runs at the end of
+ * GarbageCollect(), while the GC threads are waiting to be released, so
+ * when the GC was parallel it borrows them with runGcTask() (see
+ * Note [Running tasks on exited GC threads] in GC.c).
+ *
+ * The parts of the heap to visit are first listed as CensusSources: block
+ * chains, lists of compact regions and of nonmoving segments, and single
+ * nonmoving segments. The threads then claim up to CENSUS_CHUNK items
+ * (blocks or segments) at a time from the sources, in order, under
+ * census_work_mutex, without building an array of every block.
+ *
+ * Each thread counts what it finds into a Census of its own, with its own
+ * hash table and arena, so heapProfObject() needs no synchronisation. The
+ * counting itself only reads the heap (and the retainer sets, which
+ * retainerProfile() computed beforehand). When all the threads are done,
+ * mergeCensus() adds the partial censuses into censuses[era]. The result is
+ * the same as that of a sequential census, apart from the order of the
+ * counters in the census, which dumpCensus() doesn't depend on.
+ */
+
+// Blocks or segments claimed by a census thread at a time.
+#define CENSUS_CHUNK 64
+
+typedef enum {
+    CENSUS_CHAIN,           // bdescr list: heapCensusChainBlock
+    CENSUS_COMPACT_LIST,    // bdescr list: compact regions
+    CENSUS_SEGMENT_LIST,    // nonmoving segment list
+} CensusSourceKind;
+
+typedef struct {
+    CensusSourceKind kind;
+    void *first;
+    StgWord n;              // items to visit; CENSUS_ALL for the whole list
+    StgWord skip;           // see Note [Sampled heap census]
+} CensusSource;
+
+#define CENSUS_ALL ((StgWord)-1)
+
+static CensusSource *census_sources = NULL;
+static uint32_t n_census_sources = 0;
+static uint32_t census_sources_size = 0;
+
 static void
-heapCensusChain( Census *census, bdescr *bd )
+addCensusSource( CensusSourceKind kind, void *first, StgWord n )
 {
-    for (; bd != NULL; bd = bd->link) {
-        // When we shrink a large ARR_WORDS, we do not adjust the free pointer
-        // of the associated block descriptor, thus introducing slop at the end
-        // of the object.  This slop remains after GC, violating the assumption
-        // of the loop below that all slop has been eliminated (#11627).
-        // The slop isn't always zeroed (e.g. in non-profiling mode, cf
-        // OVERWRITING_CLOSURE_OFS).
-        // Consequently, we handle large ARR_WORDS objects as a special case.
-        if (bd->flags & BF_LARGE) {
-            StgPtr p = bd->start;
-            // There may be some initial zeros due to object alignment.
-            while (p < bd->free && !*p) p++;
-            if (get_itbl((StgClosure *)p)->type == ARR_WORDS) {
-                size_t size = arr_words_sizeW((StgArrBytes *)p);
-                bool prim = true;
-                heapProfObject(census, (StgClosure *)p, size, prim);
-                continue;
+    if (first == NULL) return;
+    if (n_census_sources == census_sources_size) {
+        census_sources_size = stg_max(2 * census_sources_size, 32);
+        census_sources = stgReallocBytes(census_sources,
+                                         census_sources_size * sizeof(CensusSource),
+                                         "addCensusSource");
+    }
+    const uint32_t rate = RtsFlags.ProfFlags.censusSampleRate;
+    census_sources[n_census_sources++] = (CensusSource) {
+        .kind = kind, .first = first, .n = n,
+        .skip = rate > 1 ? xorshift32(&census_seed) % rate : 0
+    };
+}
+
+static void
+freeCensusSources( void )
+{
+    stgFree(census_sources);
+    census_sources = NULL;
+    n_census_sources = census_sources_size = 0;
+}
+
+static void *
+censusItemLink( CensusSourceKind kind, void *item )
+{
+    if (kind == CENSUS_SEGMENT_LIST) {
+        return ((struct NonmovingSegment *)item)->link;
+    } else {
+        return ((bdescr *)item)->link;
+    }
+}
+
+// Visit up to n items of a source, starting at item, the index'th item of
+// the source.
+static void
+heapCensusItems( Census *census, CensusSource *src,
+                 void *item, StgWord index, StgWord n )
+{
+    const uint32_t rate = RtsFlags.ProfFlags.censusSampleRate;
+
+    for (; item != NULL && n > 0;
+         item = censusItemLink(src->kind, item), index++, n--) {
+        if (rate > 1 && index % rate != src->skip) {
+            continue;
+        }
+        switch (src->kind) {
+        case CENSUS_CHAIN:
+            heapCensusChainBlock(census, (bdescr *)item);
+            break;
+        case CENSUS_COMPACT_LIST:
+            heapCensusCompactBlock(census, (bdescr *)item);
+            break;
+        case CENSUS_SEGMENT_LIST:
+            heapCensusSegment(census, (struct NonmovingSegment *)item);
+            break;
+        }
+        if (rate > 1) {
+            endSampledBlock(census);
+        }
+    }
+}
+
+// List the parts of the heap a census visits, in the order it visits them.
+static void
+collectCensusSources( void )
+{
+    uint32_t g, n;
+    gen_workspace *ws;
+
+    n_census_sources = 0;
+
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        addCensusSource(CENSUS_CHAIN, generations[g].blocks, CENSUS_ALL);
+        // Are we interested in large objects?  might be
+        // confusing to include the stack in a heap profile.
+        addCensusSource(CENSUS_CHAIN, generations[g].large_objects, CENSUS_ALL);
+        addCensusSource(CENSUS_COMPACT_LIST, generations[g].compact_objects,
+                        CENSUS_ALL);
+
+        for (n = 0; n < getNumCapabilities(); n++) {
+            ws = &gc_threads[n]->gens[g];
+            addCensusSource(CENSUS_CHAIN, ws->todo_bd, CENSUS_ALL);
+            addCensusSource(CENSUS_CHAIN, ws->part_list, CENSUS_ALL);
+            addCensusSource(CENSUS_CHAIN, ws->scavd_list, CENSUS_ALL);
+        }
+    }
+
+    if (RtsFlags.GcFlags.useNonmoving) {
+      for (unsigned int i = 0; i < nonmoving_alloca_cnt; i++) {
+        addCensusSource(CENSUS_SEGMENT_LIST,
+                        nonmovingHeap.allocators[i].filled, CENSUS_ALL);
+        addCensusSource(CENSUS_SEGMENT_LIST,
+                        nonmovingHeap.allocators[i].saved_filled, CENSUS_ALL);
+        addCensusSource(CENSUS_SEGMENT_LIST,
+                        nonmovingHeap.allocators[i].active, CENSUS_ALL);
+
+        addCensusSource(CENSUS_CHAIN, nonmoving_large_objects, CENSUS_ALL);
+        addCensusSource(CENSUS_COMPACT_LIST, nonmoving_compact_objects,
+                        CENSUS_ALL);
+
+        // segments living on capabilities
+        for (unsigned int j = 0; j < getNumCapabilities(); j++) {
+          Capability* cap = getCapability(j);
+          addCensusSource(CENSUS_SEGMENT_LIST, cap->current_segments[i], 1);
+        }
+      }
+    }
+
+    addCensusSource(CENSUS_COMPACT_LIST, immortal_compact_objects, CENSUS_ALL);
+}
+
+// Add the counts of a partial census to census.
+static void
+mergeCensus( Census *census, Census *part )
+{
+    census->prim     += part->prim;
+    census->not_used += part->not_used;
+    census->used     += part->used;
+    census->sampled_blocks += part->sampled_blocks;
+
+    for (uint32_t b = 0; b < CENSUS_SIZE_BUCKETS; b++) {
+        census->size_objects[b] += part->size_objects[b];
+        census->size_words[b]   += part->size_words[b];
+    }
+
+    for (counter *c = part->ctrs; c != NULL; c = c->next) {
+        counter *ctr = lookupHashTable(census->hash, (StgWord)c->identity);
+        if (ctr == NULL) {
+            ctr = heapInsertNewCounter(census, (StgWord)c->identity);
+        }
+#if defined(PROFILING)
+        if (RtsFlags.ProfFlags.bioSelector != NULL) {
+            ctr->c.ldv.prim     += c->c.ldv.prim;
+            ctr->c.ldv.not_used += c->c.ldv.not_used;
+            ctr->c.ldv.used     += c->c.ldv.used;
+        } else
+#endif
+        {
+            ctr->c.resid += c->c.resid;
+            ctr->resid_sq += c->resid_sq;
+        }
+    }
+}
+
+#if defined(THREADED_RTS)
+
+static Mutex census_work_mutex;
+
+// All protected by census_work_mutex
+static uint32_t census_next_source;
+static void *census_next_item;      // in census_sources[census_next_source]
+static StgWord census_next_index;   // index of census_next_item
+static StgWord census_items_left;   // in census_sources[census_next_source]
+
+static Census *census_parts = NULL; // one per census thread
+static StgWord census_parts_used;   // claimed with atomic_inc()
+
+// Claim the next items to visit. Returns false when there are none left.
+static bool
+claimCensusItems( CensusSource **source, void **first, StgWord *index,
+                  StgWord *n )
+{
+    bool found = false;
+
+    ACQUIRE_LOCK(&census_work_mutex);
+    while (census_next_source < n_census_sources) {
+        CensusSource *src = &census_sources[census_next_source];
+        if (census_next_item != NULL && census_items_left > 0) {
+            *source = src;
+            *first = census_next_item;
+            *index = census_next_index;
+            *n = 0;
+            while (census_next_item != NULL && census_items_left > 0
+                   && *n < CENSUS_CHUNK) {
+                census_next_item = censusItemLink(src->kind, census_next_item);
+                census_next_index++;
+                census_items_left--;
+                (*n)++;
+            }
+            found = true;
+            break;
+        }
+        census_next_source++;
+        if (census_next_source < n_census_sources) {
+            census_next_item = census_sources[census_next_source].first;
+            census_next_index = 0;
+            census_items_left = census_sources[census_next_source].n;
+        }
+    }
+    RELEASE_LOCK(&census_work_mutex);
+    return found;
+}
+
+static void
+heapCensusTask( void )
+{
+    Census *part = &census_parts[atomic_inc(&census_parts_used, 1) - 1];
+    CensusSource *src;
+    void *first;
+    StgWord index, n;
+
+    initEra(part);
+    while (claimCensusItems(&src, &first, &index, &n)) {
+        heapCensusItems(part, src, first, index, n);
+    }
+}
+
+// See Note [Parallel heap census]
+static void
+heapCensusParallel( Census *census )
+{
+    uint32_t i;
+
+    census_parts = stgCallocBytes(getNumCapabilities(), sizeof(Census),
+                                  "heapCensusParallel");
+    census_parts_used = 0;
+    initMutex(&census_work_mutex);
+    census_next_source = 0;
+    census_next_item = n_census_sources > 0 ? census_sources[0].first : NULL;
+    census_next_index = 0;
+    census_items_left = n_census_sources > 0 ? census_sources[0].n : 0;
+
+    runGcTask(heapCensusTask);
+
+    for (i = 0; i < census_parts_used; i++) {
+        mergeCensus(census, &census_parts[i]);
+        freeEra(&census_parts[i]);
+    }
+    closeMutex(&census_work_mutex);
+    stgFree(census_parts);
+    census_parts = NULL;
+}
+
+#endif /* THREADED_RTS */
+
+/* Note [Heap census during GC]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A census follows the major GC that precedes it, and then walks the whole
+ * heap again. But a copying major GC already visits every live object: it
+ * copies it to to-space, and then scavenges it there, exactly once. With
+ * --heap-census-during-gc, GarbageCollect() calls startGcCensus(), which
+ * gives every GC thread a Census of its own (gc_thread.census), and
+ * scavenge_block() and scavenge_large() count each object they scavenge
+ * into it with censusScavengedObject(). heapCensus() then only has to merge
+ * the censuses of the GC threads (as in Note [Parallel heap census]).
+ *
+ * Some live objects are never scavenged, though:
+ *
+ *  - the objects in blocks of pinned objects and compact regions, which
+ *    can't point to the heap and are kept as they are (see
+ *    evacuate_large()). finishGcCensus() counts these itself, as
+ *    heapCensus() would: there are few of these blocks;
+ *
+ *  - the objects of a generation that is marked rather than copied, as
+ *    with the compacting collector (oldest_gen->mark), or that belong to
+ *    the nonmoving heap. GarbageCollect() doesn't start a census then, and
+ *    heapCensus() walks the heap as usual.
+ *
+ * Counting happens while the GC holds sm_mutex, so the censuses of the GC
+ * threads don't use an Arena (which allocates blocks with allocGroup_lock)
+ * but malloc their counters.
+ *
+ * The retainer sets (-hr) are only computed after the GC, and
+ * biographical profiling (-hb) needs the state of the LDV words after it,
+ * so neither can be counted during GC.
+ */
+
+static Census *gc_census_parts = NULL;     // one per GC thread
+
+void
+startGcCensus( void )
+{
+    uint32_t i, n = getNumCapabilities();
+
+    gc_census_parts = stgCallocBytes(n, sizeof(Census), "startGcCensus");
+    for (i = 0; i < n; i++) {
+        gc_census_parts[i].hash = allocHashTable();
+#if defined(PROFILING)
+        if (useItblCache()) {
+            gc_census_parts[i].itbls = allocHashTable();
+        }
+#endif
+        gc_threads[i]->census = &gc_census_parts[i];
+    }
+}
+
+void
+censusScavengedObject( Census *census, StgClosure *p, size_t size )
+{
+    heapProfObject(census, p, size, false);
+}
+
+static void
+finishGcCensus( Census *census )
+{
+    uint32_t i, g;
+    bdescr *bd;
+    counter *c, *next;
+
+    for (i = 0; i < getNumCapabilities(); i++) {
+        Census *part = &gc_census_parts[i];
+        mergeCensus(census, part);
+        for (c = part->ctrs; c != NULL; c = next) {
+            next = c->next;
+            stgFree(c);
+        }
+        freeHashTable(part->hash, NULL);
+        if (part->itbls) {
+            freeHashTable(part->itbls, NULL);
+        }
+        gc_threads[i]->census = NULL;
+    }
+    stgFree(gc_census_parts);
+    gc_census_parts = NULL;
+
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        for (bd = generations[g].large_objects; bd != NULL; bd = bd->link) {
+            if (bd->flags & BF_PINNED) {
+                heapCensusChainBlock(census, bd);
             }
         }
+        for (bd = generations[g].compact_objects; bd != NULL; bd = bd->link) {
+            heapCensusCompactBlock(census, bd);
+        }
+    }
+    for (bd = immortal_compact_objects; bd != NULL; bd = bd->link) {
+        heapCensusCompactBlock(census, bd);
+    }
+}
+
+/* Note [Forked heap census]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A census walks the whole heap while every capability waits, so with a
+ * big heap each sample is a long pause, however cheap the census is made
+ * (Note [Sampled heap census], Note [Heap census during GC]). With
+ * --heap-census-fork, heapCensus() instead fork()s once the GC is done,
+ * and leaves the walk to the child: the child has a copy-on-write image of
+ * the heap as it was at the end of the GC, walks it, writes the sample to
+ * the .hp file and exits with _exit(). The parent only pays for the fork
+ * itself, which copies the page tables of the process rather than the
+ * heap, and for the pages the mutator writes to while the child is
+ * running, which the kernel then copies.
+ *
+ * The child is a process with a single thread, so:
+ *
+ *  - It counts serially, as the GC threads of Note [Parallel heap census]
+ *    are not there.
+ *
+ *  - Any lock that another thread held at the fork stays held forever in
+ *    the child. The census allocates its counters from an Arena, and so
+ *    takes sm_mutex; the parent takes sm_mutex around the fork, as
+ *    forkProcess() does, and the child initialises it again. The other
+ *    locks the child takes are malloc's, which the C library takes care of
+ *    across fork().
+ *
+ *  - It must not touch the eventlog, whose buffers are flushed by the
+ *    parent (perhaps from a writer thread that the child doesn't have),
+ *    so it turns the eventlog off before posting anything. The samples
+ *    of a forked census are in the .hp file only.
+ *
+ * Samples must reach the .hp file in order, and the parent and the child
+ * share the file's offset, so there is at most one child at a time: the
+ * parent flushes hp_file and waits for the last child before it forks the
+ * next one, and endHeapProfiling() waits for the last child before it
+ * writes the final sample. If the heap is so big that a census takes
+ * longer than the interval between samples, the parent does end up
+ * waiting at the next census, and censuses are taken less often than -i
+ * asks, but no sample is lost.
+ *
+ * Any state that a census leaves behind it is lost with the child, so
+ * everything that has to be kept from one census to the next is done by
+ * the parent before the fork: collectCensusSources(), which draws the
+ * blocks to sample from census_seed, and nextEra(). Profiles that keep
+ * more than that are not supported: biographical profiling (-hb) keeps
+ * every census until the end of the run, retainer profiling (-hr) keeps
+ * the retainer sets in the closures' headers, and --heap-prof-delta keeps
+ * the bands it last posted. --heap-census-during-gc has nothing left to
+ * walk after the GC.
+ *
+ * If fork() fails, the census is taken in-process as usual.
+ */
+
+#if defined(FORKED_CENSUS_SUPPORTED)
+static pid_t census_child = 0;
+#endif
+
+static void
+waitCensusChild( void )
+{
+#if defined(FORKED_CENSUS_SUPPORTED)
+    int status;
+
+    if (census_child == 0) {
+        return;
+    }
+    // ECHILD if the program has reaped it already, or if we are a child of
+    // forkProcess(): either way there is nothing to wait for.
+    while (waitpid(census_child, &status, 0) == -1 && errno == EINTR) {}
+    census_child = 0;
+#endif
+}
+
+// Take the census of the sources collectCensusSources() found in a child
+// process, returning false if it couldn't be forked.
+static bool
+forkCensus( Census *census STG_UNUSED )
+{
+#if defined(FORKED_CENSUS_SUPPORTED)
+    uint32_t i;
+    pid_t pid;
+
+    waitCensusChild();
+    fflush(hp_file);
+
+    ACQUIRE_SM_LOCK;
+    pid = fork();
+    if (pid != 0) {
+        RELEASE_SM_LOCK;
+        if (pid == -1) {
+            sysErrorBelch("heap census: fork failed, taking the census "
+                          "in-process");
+            return false;
+        }
+        census_child = pid;
+        return true;
+    }
 
-        heapCensusBlock(census, bd);
+    // the child
+#if defined(THREADED_RTS)
+    initMutex(&sm_mutex);
+#endif
+#if defined(TRACING)
+    eventlog_enabled = false;
+#endif
+    for (i = 0; i < n_census_sources; i++) {
+        heapCensusItems(census, &census_sources[i],
+                        census_sources[i].first, 0, census_sources[i].n);
     }
+    dumpCensus(census);
+    fflush(hp_file);
+    _exit(0);
+#else
+    return false;
+#endif
 }
 
 // Time is process CPU time of beginning of current GC and is used as
 // the mutator CPU time reported as the census timestamp.
 void heapCensus (Time t)
 {
-  uint32_t g, n;
+  uint32_t i;
   Census *census;
-  gen_workspace *ws;
 
   census = &censuses[era];
   census->time  = TimeToSecondsDbl(t);
@@ -1432,7 +2435,10 @@ void heapCensus (Time t)
   // calculate retainer sets if necessary
 #if defined(PROFILING)
   if (doingRetainerProfiling()) {
-      retainerProfile();
+      if (!retainerProfile()) {
+          // not finished yet, see Note [Incremental retainer profiling]
+          return;
+      }
   }
 #endif
 
@@ -1441,37 +2447,29 @@ void heapCensus (Time t)
 #endif
 
   // Traverse the heap, collecting the census info
-  for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
-      heapCensusChain( census, generations[g].blocks );
-      // Are we interested in large objects?  might be
-      // confusing to include the stack in a heap profile.
-      heapCensusChain( census, generations[g].large_objects );
-      heapCensusCompactList ( census, generations[g].compact_objects );
-
-      for (n = 0; n < getNumCapabilities(); n++) {
-          ws = &gc_threads[n]->gens[g];
-          heapCensusChain(census, ws->todo_bd);
-          heapCensusChain(census, ws->part_list);
-          heapCensusChain(census, ws->scavd_list);
+  if (gc_census_parts != NULL) {
+      finishGcCensus(census);
+  } else {
+      collectCensusSources();
+      // See Note [Forked heap census]
+      if (RtsFlags.ProfFlags.censusFork && forkCensus(census)) {
+          nextEra();
+#if defined(PROFILING)
+          stat_endHeapCensus();
+#endif
+          return;
       }
-  }
-
-  if (RtsFlags.GcFlags.useNonmoving) {
-    for (unsigned int i = 0; i < nonmoving_alloca_cnt; i++) {
-      heapCensusSegmentList(census, nonmovingHeap.allocators[i].filled);
-      heapCensusSegmentList(census, nonmovingHeap.allocators[i].saved_filled);
-      heapCensusSegmentList(census, nonmovingHeap.allocators[i].active);
-
-      heapCensusChain(census, nonmoving_large_objects);
-      heapCensusCompactList(census, nonmoving_compact_objects);
-
-      // segments living on capabilities
-      for (unsigned int j = 0; j < getNumCapabilities(); j++) {
-        Capability* cap = getCapability(j);
-        heapCensusSegment(census, cap->current_segments[i]);
+#if defined(THREADED_RTS)
+      if (isParallelGc()) {
+          heapCensusParallel(census);
+      } else
+#endif
+      {
+          for (i = 0; i < n_census_sources; i++) {
+              heapCensusItems(census, &census_sources[i],
+                              census_sources[i].first, 0, census_sources[i].n);
+          }
       }
-    }
-
   }
 
   // dump out the census info
@@ -1486,15 +2484,17 @@ void heapCensus (Time t)
 
 
   // free our storage, unless we're keeping all the census info for
-  // future restriction by biography.
+  // future restriction by biography. Without LDV profiling, nextEra()
+  // reuses this census, and initEra() frees what it needs to then and
+  // keeps the arena.
 #if defined(PROFILING)
-  if (RtsFlags.ProfFlags.bioSelector == NULL)
-#endif
-  {
+  if (doingLDVProfiling() && RtsFlags.ProfFlags.bioSelector == NULL) {
       freeEra(census);
       census->hash = NULL;
+      census->itbls = NULL;
       census->arena = NULL;
   }
+#endif
 
   // we're into the next time period now
   nextEra();
@@ -10,10 +10,20 @@
 
 #include "BeginPrivate.h"
 
+struct _Census;
+
 void        heapCensus         (Time t);
+void        startGcCensus      (void);
+void        censusScavengedObject (struct _Census *census,
+                                   StgClosure *p, size_t size);
 void        initHeapProfiling  (void);
 void        endHeapProfiling   (void);
 void        freeHeapProfiling  (void);
 bool        strMatchesSelector (const char* str, const char* sel);
 
+#if defined(PROFILING)
+void        LDV_recordDeadWeighted (const StgClosure *c, uint32_t size,
+                                    uint32_t weight);
+#endif
+
 #include "EndPrivate.h"
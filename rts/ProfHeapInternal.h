@@ -35,9 +35,17 @@ typedef struct _counter {
         } ldv;
     } c;
     struct _counter *next;
+
+    // For a sampled census, see Note [Sampled heap census]
+    ssize_t block_resid;            // resid in the block being visited
+    double  resid_sq;               // sum of the squares of block_resid
+    struct _counter *block_next;    // in Census.block_ctrs
 } counter;
 
-typedef struct {
+// Closures by size: bucket i counts those of 2^i to 2^(i+1)-1 words.
+#define CENSUS_SIZE_BUCKETS 24
+
+typedef struct _Census {
     double      time;    // the time in MUT time when the census is made
     StgWord64   rtime;   // The eventlog time the census was made. This is used
                          // for the LDV profiling events because they are all
@@ -47,12 +55,25 @@ typedef struct {
     counter   * ctrs;
     Arena     * arena;
 
+    // What heapProfObject() found for the closures of each info table, see
+    // Note [Interned closure descriptions]
+    HashTable * itbls;
+
     // for LDV profiling, when just displaying by LDV
     ssize_t    prim;
     ssize_t    not_used;
     ssize_t    used;
     ssize_t    void_total;
     ssize_t    drag_total;
+
+    // For a sampled census, see Note [Sampled heap census]
+    StgWord    sampled_blocks;      // blocks visited
+    counter  * block_ctrs;          // counters with a block_resid
+
+    // The closures counted by the census by size, for the
+    // HEAP_PROF_SIZE_HISTOGRAM event
+    StgWord64  size_objects[CENSUS_SIZE_BUCKETS];
+    StgWord64  size_words[CENSUS_SIZE_BUCKETS];
 } Census;
 
 void initLDVCtr(counter *ctr);
@@ -119,8 +119,8 @@ static  CostCentreStack * checkLoop       ( CostCentreStack *ccs,
 static  void              sortCCSTree     ( CostCentreStack *ccs );
 static  CostCentreStack * pruneCCSTree    ( CostCentreStack *ccs );
 static  CostCentreStack * actualPush      ( CostCentreStack *, CostCentre * );
-static  CostCentreStack * isInIndexTable  ( IndexTable *, CostCentre * );
-static  IndexTable *      addToIndexTable ( IndexTable *, CostCentreStack *,
+static  IndexTable *      findInIndexTable( CostCentreStack *, CostCentre * );
+static  void              addToIndexTable ( CostCentreStack *, CostCentreStack *,
                                             CostCentre *, bool );
 static  void              ccsSetSelected  ( CostCentreStack *ccs );
 static  void              aggregateCCCosts( CostCentreStack *ccs );
@@ -541,52 +541,50 @@ pushCostCentre (CostCentreStack *ccs, CostCentre *cc)
         if (ccs->cc == cc) {
             return ccs;
         } else {
-            // check if we've already memoized this stack
-            IndexTable *ixtable = ccs->indexTable;
-            CostCentreStack *temp_ccs = isInIndexTable(ixtable,cc);
+            // check if we've already memoized this stack, see
+            // Note [Cost-centre stack push]
+            IndexTable *it = ACQUIRE_LOAD(&ccs->lastPush);
+            if (it != NULL && it->cc == cc) {
+                return it->ccs;
+            }
+            it = findInIndexTable(ccs,cc);
+            if (it != NULL) {
+                RELEASE_STORE(&ccs->lastPush, it);
+                return it->ccs;
+            }
 
-            if (temp_ccs != EMPTY_STACK) {
-                return temp_ccs;
-            } else {
+            // not in the IndexTable, now we take the lock:
+            ACQUIRE_LOCK(&ccs_mutex);
+
+            // someone may have added it while we did not hold the lock,
+            // so we must check it again:
+            it = findInIndexTable(ccs,cc);
+            if (it != NULL) {
+                RELEASE_LOCK(&ccs_mutex);
+                return it->ccs;
+            }
 
-                // not in the IndexTable, now we take the lock:
-                ACQUIRE_LOCK(&ccs_mutex);
-
-                if (ccs->indexTable != ixtable)
-                {
-                    // someone modified ccs->indexTable while
-                    // we did not hold the lock, so we must
-                    // check it again:
-                    temp_ccs = isInIndexTable(ixtable,cc);
-                    if (temp_ccs != EMPTY_STACK)
-                    {
-                        RELEASE_LOCK(&ccs_mutex);
-                        return temp_ccs;
-                    }
-                }
-                temp_ccs = checkLoop(ccs,cc);
-                if (temp_ccs != NULL) {
-                    // This CC is already in the stack somewhere.
-                    // This could be recursion, or just calling
-                    // another function with the same CC.
-                    // A number of policies are possible at this
-                    // point, we implement two here:
-                    //   - truncate the stack to the previous instance
-                    //     of this CC
-                    //   - ignore this push, return the same stack.
-                    //
-                    CostCentreStack *new_ccs;
+            CostCentreStack *temp_ccs = checkLoop(ccs,cc);
+            if (temp_ccs != NULL) {
+                // This CC is already in the stack somewhere.
+                // This could be recursion, or just calling
+                // another function with the same CC.
+                // A number of policies are possible at this
+                // point, we implement two here:
+                //   - truncate the stack to the previous instance
+                //     of this CC
+                //   - ignore this push, return the same stack.
+                //
+                CostCentreStack *new_ccs;
 #if defined(RECURSION_TRUNCATES)
-                    new_ccs = temp_ccs;
+                new_ccs = temp_ccs;
 #else // defined(RECURSION_DROPS)
-                    new_ccs = ccs;
+                new_ccs = ccs;
 #endif
-                    ccs->indexTable = addToIndexTable (ccs->indexTable,
-                                                       new_ccs, cc, true);
-                    ret = new_ccs;
-                } else {
-                    ret = actualPush (ccs,cc);
-                }
+                addToIndexTable(ccs, new_ccs, cc, true);
+                ret = new_ccs;
+            } else {
+                ret = actualPush (ccs,cc);
             }
         }
     }
@@ -628,6 +626,8 @@ actualPush_ (CostCentreStack *ccs, CostCentre *cc, CostCentreStack *new_ccs)
     new_ccs->depth = ccs->depth + 1;
 
     new_ccs->indexTable = EMPTY_TABLE;
+    new_ccs->lastPush = NULL;
+    new_ccs->indexHash = NULL;
 
     /* Initialise the various _scc_ counters to zero
      */
@@ -645,32 +645,117 @@ actualPush_ (CostCentreStack *ccs, CostCentre *cc, CostCentreStack *new_ccs)
     ccsSetSelected(new_ccs);
 
     /* update the memoization table for the parent stack */
-    ccs->indexTable = addToIndexTable(ccs->indexTable, new_ccs, cc,
-                                      false/*not a back edge*/);
+    addToIndexTable(ccs, new_ccs, cc, false/*not a back edge*/);
 
     /* return a pointer to the new stack */
     return new_ccs;
 }
 
 
-static CostCentreStack *
-isInIndexTable(IndexTable *it, CostCentre *cc)
+/* Note [Cost-centre stack push]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   pushCostCentre runs whenever we enter an SCC or call a function with a
+   different CCS, so finding the result of a push we have done before must
+   be cheap. The results live in the indexTable of the CCS pushed onto, a
+   list which we used to scan at every push. A CCS with hundreds of
+   children, as programs that instantiate lots of code under one cost
+   centre have, then made every push onto it hundreds of comparisons.
+   Now:
+
+    * Each CCS remembers the entry that its most recent push found
+      (lastPush). Pushes tend to repeat, e.g. a loop calls the same
+      function over and over, so this usually answers without a search.
+
+    * Once the list has more than INDEX_HASH_THRESHOLD entries, the CCS
+      also indexes it by CC in an open-addressing hash table (indexHash),
+      which we search instead of the list. The table is at most half full,
+      and is replaced by one twice the size when it would be fuller.
+
+   A push that finds nothing takes ccs_mutex, looks again, and adds an
+   entry. Lookups don't take the lock, so anything they can reach must be
+   complete before it is published: an entry is initialised before a
+   release store puts it at the head of the list or in a hash table slot,
+   and a new hash table is filled before a release store installs it. An
+   old hash table is not freed until prof_arena is, as a lookup may still
+   be searching it. A lookup that misses an entry being added just takes
+   the slow path.
+
+   The list remains the set of children that the profiling reports walk
+   (and, at the end of the run, prune and sort).
+*/
+
+#define INDEX_HASH_THRESHOLD 8
+
+typedef struct IndexHash_ {
+    uint32_t size;              // a power of two
+    uint32_t n;                 // entries in slots[]
+    IndexTable *slots[];
+} IndexHash;
+
+STATIC_INLINE uint32_t
+hashCC (const IndexHash *h, const CostCentre *cc)
 {
-    while (it!=EMPTY_TABLE)
-    {
-        if (it->cc == cc)
-            return it->ccs;
-        else
-            it = it->next;
+    return (uint32_t)(((StgWord)cc >> 3) * 2654435761u) & (h->size - 1);
+}
+
+static IndexTable *
+findInIndexTable(CostCentreStack *ccs, CostCentre *cc)
+{
+    IndexHash *h = ACQUIRE_LOAD(&ccs->indexHash);
+
+    if (h != NULL) {
+        for (uint32_t i = hashCC(h, cc); ; i = (i + 1) & (h->size - 1)) {
+            IndexTable *it = ACQUIRE_LOAD(&h->slots[i]);
+            if (it == NULL || it->cc == cc) {
+                return it;
+            }
+        }
     }
 
-    /* otherwise we never found it so return EMPTY_TABLE */
-    return EMPTY_TABLE;
+    for (IndexTable *it = ACQUIRE_LOAD(&ccs->indexTable);
+         it != EMPTY_TABLE; it = it->next) {
+        if (it->cc == cc) {
+            return it;
+        }
+    }
+
+    /* otherwise we never found it */
+    return NULL;
 }
 
+// Call with ccs_mutex held.
+static void
+insertIndexHash (IndexHash *h, IndexTable *it)
+{
+    uint32_t i = hashCC(h, it->cc);
 
-static IndexTable *
-addToIndexTable (IndexTable *it, CostCentreStack *new_ccs,
+    while (h->slots[i] != NULL) {
+        i = (i + 1) & (h->size - 1);
+    }
+    RELEASE_STORE(&h->slots[i], it);
+    h->n++;
+}
+
+// Index all the children of ccs in a new hash table of the given size.
+// Call with ccs_mutex held.
+static void
+indexChildren (CostCentreStack *ccs, uint32_t size)
+{
+    IndexHash *h = arenaAlloc(prof_arena,
+                              sizeof(IndexHash) + size * sizeof(IndexTable *));
+    h->size = size;
+    h->n = 0;
+    memset(h->slots, 0, size * sizeof(IndexTable *));
+
+    for (IndexTable *it = ccs->indexTable; it != EMPTY_TABLE; it = it->next) {
+        insertIndexHash(h, it);
+    }
+    RELEASE_STORE(&ccs->indexHash, h);
+}
+
+// Record that pushing cc onto ccs gives new_ccs. Call with ccs_mutex held.
+static void
+addToIndexTable (CostCentreStack *ccs, CostCentreStack *new_ccs,
                  CostCentre *cc, bool back_edge)
 {
     IndexTable *new_it;
@@ -679,9 +764,28 @@ addToIndexTable (IndexTable *it, CostCentreStack *new_ccs,
 
     new_it->cc = cc;
     new_it->ccs = new_ccs;
-    new_it->next = it;
+    new_it->next = ccs->indexTable;
     new_it->back_edge = back_edge;
-    return new_it;
+    RELEASE_STORE(&ccs->indexTable, new_it);
+
+    IndexHash *h = ccs->indexHash;
+    if (h != NULL) {
+        if (2 * (h->n + 1) <= h->size) {
+            insertIndexHash(h, new_it);
+        } else {
+            indexChildren(ccs, 2 * h->size);
+        }
+    } else {
+        uint32_t n = 0;
+        for (IndexTable *it = new_it; it != EMPTY_TABLE; it = it->next) {
+            n++;
+        }
+        if (n > INDEX_HASH_THRESHOLD) {
+            indexChildren(ccs, 4 * INDEX_HASH_THRESHOLD);
+        }
+    }
+
+    RELEASE_STORE(&ccs->lastPush, new_it);
 }
 
 /* -----------------------------------------------------------------------------
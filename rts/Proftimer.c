@@ -31,7 +31,7 @@ at all, once it is enabled, the `do_heap_prof_ticks` flag controls whether the
 counter is currently counting down. This is paused, for example, in Schedule.c. */
 
 // Sampling of Ticky-Ticky profiler to eventlog
-#if defined(TICKY_TICKY) && defined(TRACING)
+#if defined(TRACING)
 static int ticks_to_ticky_sample = 0;
 bool performTickySample = false;
 #endif
@@ -131,7 +131,7 @@ handleProfTick(void)
     }
 #endif
 
-#if defined(TICKY_TICKY) && defined(TRACING)
+#if defined(TRACING)
     if (RtsFlags.TraceFlags.ticky) {
         ticks_to_ticky_sample--;
         if (ticks_to_ticky_sample <= 0) {
@@ -725,6 +725,114 @@ removeFromQueues(Capability *cap, StgTSO *tso)
   appendToRunQueue(cap, tso);
 }
 
+/* Note [Freezing the stack lazily]
+~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+When raiseAsync crosses an UNDERFLOW_FRAME it has to keep the
+computation on the chunk it is leaving, in case an update frame further
+down captures it in an AP_STACK (see the comment on raiseAsync). The
+obvious way to do that is to copy the chunk into an AP_STACK_NOUPD
+right away and carry on with that as the current closure. But most of
+the time nothing wants it: the walk ends at a CATCH_FRAME (e.g. the one
+of `timeout`) or a STOP_FRAME, which throws away everything above it.
+A thread killed deep in a recursion that builds no thunks would copy
+its entire stack into the heap, only for the copy to be garbage.
+
+So when there is no stop_here, we leave the chunks we cross as they are
+and remember the first of them (pending, and pending_sp, the slot of
+the current closure in it). The chunks stay on the TSO's stack, which
+is still consistent: we only write below the sp of the chunks, where
+the current closure of each one goes. Then
+
+  * at an UPDATE_FRAME, freezePendingChunks builds the AP_STACK_NOUPDs
+    the eager walk would have built, and the update frame captures the
+    last of them as before;
+
+  * at a frame that discards the stack above it (CATCH_FRAME,
+    STOP_FRAME, ATOMICALLY_FRAME), we just pop the pending chunks.
+
+Either way the chunks are then popped, as threadStackUnderflow would
+have done. Like the eager walk this is linear in the depth of the
+stack, but a walk that finds no update frame below the deepest chunk
+boundary now allocates nothing for the chunks.
+
+Similarly, if the thunk of an update frame was already updated, by
+another thread that evaluated it too, we do not need to save its
+computation at all: the value is there. We drop everything above the
+update frame (and the pending chunks) and continue with the updatee as
+the current closure.
+*/
+
+// The chunks from pending up to, but not including, stack are empty now;
+// take them off the TSO's stack. See Note [Freezing the stack lazily].
+static void
+popPendingChunks (Capability *cap, StgTSO *tso,
+                  StgStack *pending, StgStack *stack)
+{
+    while (pending != stack) {
+        StgUnderflowFrame *uf = (StgUnderflowFrame *)
+            (pending->stack + pending->stack_size - sizeofW(StgUnderflowFrame));
+        StgStack *next = uf->next_chunk;
+
+        pending->sp = pending->stack + pending->stack_size;
+        tso->tot_stack_size -= pending->stack_size;
+        pending = next;
+    }
+
+    tso->stackobj = stack;
+    dirty_STACK(cap, stack);
+}
+
+// Build the AP_STACK_NOUPDs for the chunks from pending up to, but not
+// including, stack, and return the last one: the current closure of
+// stack. See Note [Freezing the stack lazily].
+static StgClosure *
+freezePendingChunks (Capability *cap, StgStack *pending, StgPtr pending_sp,
+                     StgStack *stack)
+{
+    StgClosure *cur = (StgClosure *)pending_sp[0];
+    StgPtr sp = pending_sp + 1;
+
+    while (pending != stack) {
+        StgUnderflowFrame *uf = (StgUnderflowFrame *)
+            (pending->stack + pending->stack_size - sizeofW(StgUnderflowFrame));
+        uint32_t words = (StgPtr)uf - sp;
+        StgAP_STACK *ap = (StgAP_STACK *)allocate(cap, AP_STACK_sizeW(words));
+
+        ap->size = words;
+        ap->fun  = cur;
+        memcpy(ap->payload, sp, words * sizeof(W_));
+
+        SET_HDR(ap,&stg_AP_STACK_NOUPD_info,pending->header.prof.ccs);
+        TICK_ALLOC_SE_THK(AP_STACK_sizeW(words),0);
+
+        cur = (StgClosure *)ap;
+        pending = uf->next_chunk;
+        sp = pending->sp;
+    }
+
+    return cur;
+}
+
+// Has the thunk of an update frame been updated with its value already?
+// This can happen if another thread evaluated it too.
+static bool
+isUpdatedThunk (StgClosure *updatee)
+{
+    const StgInfoTable *info = ACQUIRE_LOAD(&updatee->header.info);
+    if (info != &stg_BLACKHOLE_info) {
+        return false;
+    }
+
+    // See messageBlackHole: the indirectee of a BLACKHOLE that is still
+    // under evaluation is its owner, or the queue of threads blocked on it.
+    StgClosure *p = UNTAG_CLOSURE(ACQUIRE_LOAD(&((StgInd*)updatee)->indirectee));
+    info = RELAXED_LOAD(&p->header.info);
+    return info != &stg_TSO_info
+        && info != &stg_IND_info
+        && info != &stg_BLOCKING_QUEUE_CLEAN_info
+        && info != &stg_BLOCKING_QUEUE_DIRTY_info;
+}
+
 /* -----------------------------------------------------------------------------
  * raiseAsync()
  *
@@ -751,6 +859,10 @@ removeFromQueues(Capability *cap, StgTSO *tso)
  * exactly as it did when we killed the TSO and we can continue
  * execution by entering the closure on top of the stack.
  *
+ * The chunks of a stack we walk through are only copied into the heap
+ * if an update frame further down needs them; see
+ * Note [Freezing the stack lazily].
+ *
  * We can also kill a thread entirely - this happens if either (a) the
  * exception passed to raiseAsync is NULL, or (b) there's no
  * CATCH_FRAME on the stack.  In either case, we strip the entire
@@ -772,6 +884,10 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
     StgClosure *updatee;
     uint32_t i;
     StgStack *stack;
+    // the chunks we walked through but haven't frozen or popped yet;
+    // see Note [Freezing the stack lazily]
+    StgStack *pending = NULL;
+    StgPtr pending_sp = NULL;
 
     debugTraceCap(DEBUG_sched, cap,
                   "raising exception in thread %" FMT_StgThreadID ".", tso->id);
@@ -852,6 +968,27 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
             StgAP_STACK * ap;
             uint32_t words;
 
+            if (stop_here == NULL &&
+                isUpdatedThunk(((StgUpdateFrame *)frame)->updatee)) {
+                // Nothing to save: the value is there already.
+                if (pending != NULL) {
+                    popPendingChunks(cap, tso, pending, stack);
+                    pending = NULL;
+                }
+                sp = frame + sizeofW(StgUpdateFrame) - 1;
+                sp[0] = (W_)((StgUpdateFrame *)frame)->updatee;
+                frame = sp + 1;
+                continue;
+            }
+
+            if (pending != NULL) {
+                StgClosure *cur =
+                    freezePendingChunks(cap, pending, pending_sp, stack);
+                popPendingChunks(cap, tso, pending, stack);
+                pending = NULL;
+                sp[0] = (W_)cur;
+            }
+
             // First build an AP_STACK consisting of the stack chunk above the
             // current update frame, with the top word on the stack as the
             // fun field.
@@ -906,6 +1043,20 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
             StgAP_STACK * ap;
             uint32_t words;
 
+            if (stop_here == NULL) {
+                // Don't copy this chunk until we know it's needed;
+                // see Note [Freezing the stack lazily].
+                if (pending == NULL) {
+                    pending = stack;
+                    pending_sp = sp;
+                }
+                stack = ((StgUnderflowFrame *)frame)->next_chunk;
+                sp = stack->sp - 1;
+                sp[0] = (W_)&stg_dummy_ret_closure;
+                frame = sp + 1;
+                continue;
+            }
+
             // First build an AP_STACK consisting of the stack chunk above the
             // current update frame, with the top word on the stack as the
             // fun field.
@@ -937,6 +1088,10 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
         case STOP_FRAME:
         {
             // We've stripped the entire stack, the thread is now dead.
+            if (pending != NULL) {
+                popPendingChunks(cap, tso, pending, stack);
+                pending = NULL;
+            }
             tso->what_next = ThreadKilled;
             stack->sp = frame + sizeofW(StgStopFrame);
             goto done;
@@ -951,6 +1106,11 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
 
             StgClosure *handler = ((StgCatchFrame *)frame)->handler;
 
+            if (pending != NULL) {
+                popPendingChunks(cap, tso, pending, stack);
+                pending = NULL;
+            }
+
             // Throw away the stack from Sp up to and including the CATCH_FRAME.
             sp = frame + stack_frame_sizeW((StgClosure *)frame);
 
@@ -979,6 +1139,12 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
         }
 
         case ATOMICALLY_FRAME:
+            // Either way, the stack above this frame is thrown away.
+            if (pending != NULL) {
+                popPendingChunks(cap, tso, pending, stack);
+                pending = NULL;
+            }
+
             if (stop_at_atomically) {
                 ASSERT(tso->trec->enclosing_trec == NO_TREC);
                 stmCondemnTransaction(cap, tso -> trec);
@@ -1082,6 +1248,7 @@ raiseAsync(Capability *cap, StgTSO *tso, StgClosure *exception,
     }
 
 done:
+    ASSERT(pending == NULL);
     IF_DEBUG(sanity, checkTSO(tso));
 
     // wake it up
@@ -20,6 +20,7 @@
 #include "StablePtr.h" /* markStablePtrTable */
 #include "StableName.h" /* rememberOldStableNameAddresses */
 #include "sm/Storage.h"
+#include "sm/GC.h" /* isParallelGc */
 
 /* Note [What is a retainer?]
    ~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -62,9 +63,21 @@ information about the retainers is still applicable.
 
 static uint32_t retainerGeneration;  // generation
 
-static uint32_t numObjectVisited;    // total number of objects visited
-static uint32_t timesAnyObjectVisited;  // number of times any objects are
-                                        // visited
+static StgWord numObjectVisited;    // total number of objects visited
+static StgWord timesAnyObjectVisited;  // number of times any objects are
+                                       // visited
+
+#if defined(THREADED_RTS)
+// protects the retainer set table in a parallel traversal
+static Mutex rs_lock;
+#endif
+
+// See Note [Incremental retainer profiling]
+static bool rp_in_progress = false;  // a traversal is spread over censuses
+static uint32_t rp_roots_done;       // roots traversed by earlier slices
+static uint32_t rp_roots_seen;       // roots met so far in this slice
+static Time rp_deadline;             // when this slice should stop
+static bool rp_out_of_time;
 
 /* -----------------------------------------------------------------------------
  * Retainer stack - header
@@ -93,6 +106,9 @@ initRetainerProfiling( void )
 {
     initializeAllRetainerSet();
     retainerGeneration = 0;
+#if defined(THREADED_RTS)
+    initMutex(&rs_lock);
+#endif
 }
 
 /* -----------------------------------------------------------------------------
@@ -102,6 +118,10 @@ void
 endRetainerProfiling( void )
 {
     outputAllRetainerSet(prof_file);
+    closeAllRetainerSet();
+#if defined(THREADED_RTS)
+    closeMutex(&rs_lock);
+#endif
 }
 
 /* -----------------------------------------------------------------------------
@@ -348,6 +368,63 @@ retainVisitClosure( StgClosure *c, const StgClosure *cp, const stackData data, c
     return 1; // do process children
 }
 
+#if defined(THREADED_RTS)
+/**
+ *  retainVisitClosure for a parallel traversal, which may visit a closure on
+ *  several threads at once (see Note [Parallel heap traversal] in
+ *  TraverseHeap.c). We only ever replace the retainer set of *c by one with
+ *  r added to it, with a CAS on its header; a header left over from an
+ *  earlier traversal counts as the empty set.
+ *
+ *  Unlike retainVisitClosure we don't give *c the retainer set of *cp on the
+ *  first visit. Every retainer of *cp still reaches *c, as *cp is visited
+ *  again for each of them.
+ */
+static bool
+retainVisitClosurePar( StgClosure *c, const StgClosure *cp, const stackData data, const bool first_visit, stackAccum *acc, stackData *out_data )
+{
+    (void) cp;
+    (void) first_visit;
+    (void) acc;
+
+    const StgWord flip = g_retainerTraverseState.flip;
+    retainer r = data.c_child_r;
+    RetainerSet *rs, *new_rs;
+    StgWord old, seen;
+
+    atomic_inc(&timesAnyObjectVisited, 1);
+
+    old = ACQUIRE_LOAD(&c->header.prof.hp.trav);
+    for (;;) {
+        rs = (old & 1) == flip ? (RetainerSet *)(old & ~(StgWord)1) : NULL;
+        if (rs != NULL && isMember(r, rs))
+            return 0;          // no need to process children
+
+        ACQUIRE_LOCK(&rs_lock);
+        new_rs = rs == NULL ? singleton(r) : addElement(r, rs);
+        RELEASE_LOCK(&rs_lock);
+
+        seen = cas((StgVolatilePtr)&c->header.prof.hp.trav, old,
+                   (StgWord)new_rs | flip);
+        if (seen == old)
+            break;
+        old = seen;
+    }
+
+    if (rs == NULL) {
+        // This is the first visit to *c.
+        atomic_inc(&numObjectVisited, 1);
+        out_data->c_child_r = isRetainer(c) ? getRetainerFrom(c) : r;
+    } else {
+        if (isRetainer(c))
+            return 0;          // no need to process children
+        out_data->c_child_r = r;
+    }
+
+    return 1; // do process children
+}
+#endif
+
 /**
  *  Push every object reachable from *tl onto the traversal work stack.
  */
@@ -373,18 +450,89 @@ retainRoot(void *user, StgClosure **tl)
     // case we ignore it for the purposes of retainer profiling.
 }
 
+/* Note [Incremental retainer profiling]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Computing the retainer sets of the whole heap can take much longer than
+   the major GC that precedes it, which makes -hr unusable on a program
+   that has to stay responsive. With --retainer-profile-budget=<secs> we
+   spread the traversal over several censuses instead, spending about
+   <secs> on it at each.
+
+   Each census then runs a slice of the traversal. A slice goes through
+   the roots in the usual order, skips the ones that earlier slices of the
+   same traversal have done (rp_roots_done), and traverses everything
+   reachable from each of the others in turn, until it runs out of time.
+   The work stack is therefore empty between slices, and the only state
+   that has to survive a GC is in the closures' headers: the retainer sets
+   and the flip bit (see Note [Profiling heap traversal visited bit] in
+   TraverseHeap.c), which the GC copies along with the closures. Static
+   closures keep theirs too, as resetStaticObjectForProfiling only resets
+   the ones that aren't valid for the current flip.
+
+   heapCensus skips the census until the slice that finishes the traversal,
+   so each census in the profile still comes from one complete set of
+   retainer sets. They are approximate though, in two ways:
+
+    * The mutator runs between slices. A closure it allocates, or links to
+      from a closure that was already traversed, is only given a retainer
+      set if it is reachable from a root that a later slice traverses;
+      otherwise the census counts it as having no retainers. Similarly a
+      closure keeps the retainers it had when it was traversed, even if the
+      mutator has since dropped them.
+
+    * The set of roots may change between slices, e.g. when threads finish,
+      so counting roots may skip a root or traverse one twice. Traversing a
+      root twice does no harm.
+
+   The budget is soft: we only look at the clock between roots, so a slice
+   can overrun by the time it takes to traverse everything reachable from
+   one root, which can be most of the heap. Every slice traverses at least
+   one root, so a traversal always finishes. */
+
+/**
+ *  Traverse everything reachable from *tl, unless an earlier slice of this
+ *  traversal has done so or this slice is out of time. See
+ *  Note [Incremental retainer profiling].
+ */
+static void
+retainRootSlice(void *user, StgClosure **tl)
+{
+    traverseState *ts = (traverseState*) user;
+
+    if (rp_out_of_time || rp_roots_seen++ < rp_roots_done) {
+        return;
+    }
+
+    retainRoot(user, tl);
+    traverseWorkStack(ts, &retainVisitClosure);
+    rp_roots_done++;
+
+    if (getProcessElapsedTime() >= rp_deadline) {
+        rp_out_of_time = true;
+    }
+}
+
 /* -----------------------------------------------------------------------------
- *  Compute the retainer set for each of the objects in the heap.
+ *  Compute the retainer set for each of the objects in the heap, or for the
+ *  part of it that this slice has time for. Returns true when that finishes
+ *  the traversal.
  * -------------------------------------------------------------------------- */
-static void
+static bool
 computeRetainerSet( traverseState *ts )
 {
     StgWeak *weak;
     uint32_t g, n;
+    evac_fn root = retainRoot;
+
+    if (RtsFlags.ProfFlags.retainerProfileBudget > 0) {
+        root = retainRootSlice;
+        rp_roots_seen = 0;
+        rp_out_of_time = false;
+        rp_deadline = getProcessElapsedTime()
+                      + RtsFlags.ProfFlags.retainerProfileBudget;
+    }
 
-    traverseInvalidateClosureData(ts);
-
-    markCapabilities(retainRoot, (void*)ts); // for scheduler roots
+    markCapabilities(root, (void*)ts); // for scheduler roots
 
     // This function is called after a major GC, when key, value, and finalizer
     // all are guaranteed to be valid, or reachable.
@@ -400,53 +548,85 @@ computeRetainerSet( traverseState *ts )
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
         for (weak = generations[g].weak_ptr_list; weak != NULL; weak = weak->link) {
             // retainRoot((StgClosure *)weak);
-            retainRoot((void*)ts, (StgClosure **)&weak);
+            root((void*)ts, (StgClosure **)&weak);
         }
     }
 
     // Consider roots from the stable ptr table.
-    markStablePtrTable(retainRoot, (void*)ts);
+    markStablePtrTable(root, (void*)ts);
     // Remember old stable name addresses.
     rememberOldStableNameAddresses ();
 
-    traverseWorkStack(ts, &retainVisitClosure);
+#if defined(THREADED_RTS)
+    // After a parallel GC, traverse with the GC threads. The slices of an
+    // incremental traversal have done the work already.
+    if (root == retainRoot && isParallelGc()) {
+        traverseWorkStackParallel(ts, &retainVisitClosurePar);
+    } else
+#endif
+    {
+        traverseWorkStack(ts, &retainVisitClosure);
+    }
+
+    return !rp_out_of_time;
 }
 
 /* -----------------------------------------------------------------------------
  * Perform retainer profiling.
  * N is the oldest generation being profiled, where the generations are
  * numbered starting at 0.
+ * Returns false if the retainer sets aren't complete yet, which only happens
+ * with --retainer-profile-budget, see Note [Incremental retainer profiling].
  * Invariants:
  * Note:
  *   This function should be called only immediately after major garbage
  *   collection.
  * ------------------------------------------------------------------------- */
-void
+bool
 retainerProfile(void)
 {
   stat_startRP();
 
-  numObjectVisited = 0;
-  timesAnyObjectVisited = 0;
-
-  /*
-    We initialize the traverse stack each time the retainer profiling is
-    performed (because the traverse stack size varies on each retainer profiling
-    and this operation is not costly anyhow). However, we just refresh the
-    retainer sets.
-   */
-  initializeTraverseStack(&g_retainerTraverseState);
-  initializeAllRetainerSet();
-  computeRetainerSet(&g_retainerTraverseState);
+  if (!rp_in_progress) {
+      numObjectVisited = 0;
+      timesAnyObjectVisited = 0;
+
+      /*
+        We initialize the traverse stack each time the retainer profiling is
+        performed (because the traverse stack size varies on each retainer
+        profiling and this operation is not costly anyhow). The retainer sets
+        are kept from one retainer profiling to the next, see
+        Note [Retainer set table] in RetainerSet.c.
+       */
+      initializeTraverseStack(&g_retainerTraverseState);
+      traverseInvalidateClosureData(&g_retainerTraverseState);
+      rp_roots_done = 0;
+      rp_out_of_time = false;
+      rp_in_progress = true;
+  }
+
+  if (!computeRetainerSet(&g_retainerTraverseState)) {
+      // keep the (empty) traverse stack for the next slice
+      stat_pauseRP();
+      return false;
+  }
+  rp_in_progress = false;
 
   // post-processing
   closeTraverseStack(&g_retainerTraverseState);
   retainerGeneration++;
 
+  uint32_t numSets;
+  W_ setBytes;
+  retainerSetStats(&numSets, &setBytes);
+
   stat_endRP(
     retainerGeneration - 1,   // retainerGeneration has just been incremented!
     getTraverseStackMaxSize(&g_retainerTraverseState),
-    (double)timesAnyObjectVisited / numObjectVisited);
+    (double)timesAnyObjectVisited / numObjectVisited,
+    numSets, setBytes);
+
+  return true;
 }
 
 #endif /* PROFILING */
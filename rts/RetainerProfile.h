@@ -18,7 +18,7 @@
 
 void initRetainerProfiling ( void );
 void endRetainerProfiling  ( void );
-void retainerProfile       ( void );
+bool retainerProfile       ( void );
 
 bool isRetainerSetValid( const StgClosure *c );
 RetainerSet* retainerSetOf( const StgClosure *c );
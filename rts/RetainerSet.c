@@ -21,11 +21,34 @@
 
 #include <string.h>
 
-#define HASH_TABLE_SIZE 255
-#define hash(hk)  (hk % HASH_TABLE_SIZE)
-static RetainerSet *hashTable[HASH_TABLE_SIZE];
+/* Note [Retainer set table]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~
+   The retainer sets are hash-consed: there is only one copy of each, so
+   that they can be compared by address, and a closure's retainer set is
+   just a pointer to it (see RetainerProfile.c).
+
+   The sets live for the whole run, rather than being thrown away before
+   each retainer profile. A program has many fewer distinct retainer sets
+   than the number of times it finds them, so this bounds the memory they
+   take by the number of distinct sets, where we used to start a fresh
+   arena for every census (and never free the old one). It also means a
+   set keeps its id from one census to the next, so a band "(5)..." in the
+   .hp file means the same set throughout, and the list of sets at the end
+   of the .prof file covers all of them.
+
+   The hash table starts at HASH_TABLE_INIT_SIZE buckets and doubles
+   whenever there are more sets than buckets, so that the chains stay
+   short however many sets there are.
+*/
+
+#define HASH_TABLE_INIT_SIZE 256
+#define hash(hk)  ((hk) & (hashTableSize - 1))
+static RetainerSet **hashTable = NULL;
+static uint32_t hashTableSize;  // a power of two
+static uint32_t numSets;        // number of retainer sets in hashTable
 
 static Arena *arena;            // arena in which we store retainer sets
+static W_ setBytes;             // bytes of retainer sets in the arena
 
 static int nextId;              // id of next retainer set
 
@@ -58,18 +81,23 @@ sizeofRetainerSet( int elems )
 }
 
 /* -----------------------------------------------------------------------------
- * Creates the first pool and initializes hashTable[].
- * Frees all pools if any.
+ * Creates the pool and initializes hashTable[], unless that has been done
+ * already. See Note [Retainer set table].
  * -------------------------------------------------------------------------- */
 void
 initializeAllRetainerSet(void)
 {
-    int i;
+    if (hashTable != NULL) {
+        return;
+    }
 
     arena = newArena();
+    setBytes = 0;
 
-    for (i = 0; i < HASH_TABLE_SIZE; i++)
-        hashTable[i] = NULL;
+    hashTableSize = HASH_TABLE_INIT_SIZE;
+    hashTable = stgCallocBytes(hashTableSize, sizeof(RetainerSet *),
+                               "initializeAllRetainerSet");
+    numSets = 0;
     nextId = 2;   // Initial value must be positive, 2 is MANY.
 }
 
@@ -80,6 +108,64 @@ void
 closeAllRetainerSet(void)
 {
     arenaFree(arena);
+    stgFree(hashTable);
+    hashTable = NULL;
+}
+
+/* -----------------------------------------------------------------------------
+ * Doubles the size of hashTable[].
+ * -------------------------------------------------------------------------- */
+static void
+growHashTable(void)
+{
+    uint32_t i, oldSize = hashTableSize;
+    RetainerSet **old = hashTable, *rs, *next;
+
+    hashTableSize *= 2;
+    hashTable = stgCallocBytes(hashTableSize, sizeof(RetainerSet *),
+                               "growHashTable");
+    for (i = 0; i < oldSize; i++) {
+        for (rs = old[i]; rs != NULL; rs = next) {
+            next = rs->link;
+            rs->link = hashTable[hash(rs->hashKey)];
+            hashTable[hash(rs->hashKey)] = rs;
+        }
+    }
+    stgFree(old);
+}
+
+/* -----------------------------------------------------------------------------
+ * Allocates a retainer set of the given size, and puts it in hashTable[].
+ * -------------------------------------------------------------------------- */
+static RetainerSet *
+newRetainerSet(uint32_t num, StgWord hk)
+{
+    RetainerSet *rs;
+
+    if (numSets >= hashTableSize) {
+        growHashTable();
+    }
+
+    rs = arenaAlloc( arena, sizeofRetainerSet(num) );
+    setBytes += sizeofRetainerSet(num);
+    numSets++;
+
+    rs->num = num;
+    rs->hashKey = hk;
+    rs->id = nextId++;
+
+    // The new retainer set is placed at the head of the linked list.
+    rs->link = hashTable[hash(hk)];
+    hashTable[hash(hk)] = rs;
+
+    return rs;
+}
+
+void
+retainerSetStats(uint32_t *num_sets, W_ *bytes)
+{
+    *num_sets = numSets;
+    *bytes = setBytes + hashTableSize * sizeof(RetainerSet *);
 }
 
 /* -----------------------------------------------------------------------------
@@ -96,16 +182,9 @@ singleton(retainer r)
         if (rs->num == 1 &&  rs->element[0] == r) return rs;    // found it
 
     // create it
-    rs = arenaAlloc( arena, sizeofRetainerSet(1) );
-    rs->num = 1;
-    rs->hashKey = hk;
-    rs->link = hashTable[hash(hk)];
-    rs->id = nextId++;
+    rs = newRetainerSet(1, hk);
     rs->element[0] = r;
 
-    // The new retainer set is placed at the head of the linked list.
-    hashTable[hash(hk)] = rs;
-
     return rs;
 }
 
@@ -149,8 +228,8 @@ addElement(retainer r, RetainerSet *rs)
     for (nrs = hashTable[hash(hk)]; nrs != NULL; nrs = nrs->link) {
         // test *rs and *nrs for equality
 
-        // check their size
-        if (rs->num + 1 != nrs->num) continue;
+        // check their hash keys and sizes
+        if (hk != nrs->hashKey || rs->num + 1 != nrs->num) continue;
 
         // compare the first nl retainers and find the first non-matching one.
         for (i = 0; i < nl; i++)
@@ -172,11 +251,7 @@ addElement(retainer r, RetainerSet *rs)
     }
 
     // create a new retainer set
-    nrs = arenaAlloc( arena, sizeofRetainerSet(rs->num + 1) );
-    nrs->num = rs->num + 1;
-    nrs->hashKey = hk;
-    nrs->link = hashTable[hash(hk)];
-    nrs->id = nextId++;
+    nrs = newRetainerSet(rs->num + 1, hk);
     for (i = 0; i < nl; i++) {              // copy the first nl retainers
         nrs->element[i] = rs->element[i];
     }
@@ -185,8 +260,6 @@ addElement(retainer r, RetainerSet *rs)
         nrs->element[i + 1] = rs->element[i];
     }
 
-    hashTable[hash(hk)] = nrs;
-
     // debugBelch("%p\n", nrs);
     return nrs;
 }
@@ -246,17 +319,27 @@ printRetainerSetShort(FILE *f, RetainerSet *rs, W_ total_size, uint32_t max_leng
  * of the run, so the user can find out for a given retainer set ID
  * the full contents of that set.
  * -------------------------------------------------------------------------- */
+// Orders retainer sets by their (negative) ids, descending, i.e. by their
+// true ids, ascending.
+static int
+cmpRetainerSetId(const void *a, const void *b)
+{
+    int x = (*(RetainerSet *const *)a)->id;
+    int y = (*(RetainerSet *const *)b)->id;
+    return (x < y) - (x > y);
+}
+
 void
 outputAllRetainerSet(FILE *prof_file)
 {
     uint32_t i, j;
     uint32_t numSet;
-    RetainerSet *rs, **rsArray, *tmp;
+    RetainerSet *rs, **rsArray;
 
     // find out the number of retainer sets which have had a non-zero cost at
     // least once during retainer profiling
     numSet = 0;
-    for (i = 0; i < HASH_TABLE_SIZE; i++)
+    for (i = 0; i < hashTableSize; i++)
         for (rs = hashTable[i]; rs != NULL; rs = rs->link) {
             if (rs->id < 0)
                 numSet++;
@@ -271,7 +354,7 @@ outputAllRetainerSet(FILE *prof_file)
 
     // prepare for sorting
     j = 0;
-    for (i = 0; i < HASH_TABLE_SIZE; i++)
+    for (i = 0; i < hashTableSize; i++)
         for (rs = hashTable[i]; rs != NULL; rs = rs->link) {
             if (rs->id < 0) {
                 rsArray[j] = rs;
@@ -282,16 +365,7 @@ outputAllRetainerSet(FILE *prof_file)
     ASSERT(j == numSet);
 
     // sort rsArray[] according to the id of each retainer set
-    for (i = numSet - 1; i > 0; i--) {
-        for (j = 0; j <= i - 1; j++) {
-            // if (-(rsArray[j]->id) < -(rsArray[j + 1]->id))
-            if (rsArray[j]->id < rsArray[j + 1]->id) {
-                tmp = rsArray[j];
-                rsArray[j] = rsArray[j + 1];
-                rsArray[j + 1] = tmp;
-            }
-        }
-    }
+    qsort(rsArray, numSet, sizeof(RetainerSet *), cmpRetainerSetId);
 
     fprintf(prof_file, "\nRetainer sets created during profiling:\n");
     for (i = 0;i < numSet; i++) {
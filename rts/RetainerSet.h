@@ -53,7 +53,7 @@ typedef struct _RetainerSet {
 } RetainerSet;
 
 
-// Creates the first pool and initializes a hash table. Frees all pools if any.
+// Creates the pool and initializes the hash table, once per run.
 void initializeAllRetainerSet(void);
 
 // Frees all pools.
@@ -127,6 +127,9 @@ void outputRetainerSet(FILE *, uint32_t *, uint32_t *);
 // Print all retainer sets at the exit of the program.
 void outputAllRetainerSet(FILE *);
 
+// The number of retainer sets, and the bytes they and the hash table take.
+void retainerSetStats(uint32_t *num_sets, W_ *bytes);
+
 // Hashing functions
 /*
   Invariants:
@@ -140,8 +143,34 @@ void outputAllRetainerSet(FILE *);
     hashKeySingleton() and hashKeyAddElement(). The hash key for a set
     must be unique regardless of the order its elements are inserted,
     i.e., the hashing function must be additive(?).
+
+  The key of a set is the sum of hashRetainer() over its elements. Summing
+  the addresses themselves, as we used to, makes {a,d} and {b,c} collide
+  whenever a+d == b+c, which is common as cost-centre stacks are allocated
+  at regular strides; mixing each address first avoids that.
 */
-#define hashKeySingleton(r)       ((StgWord)(r))
+INLINE_HEADER StgWord
+hashRetainer(retainer r)
+{
+    StgWord h = (StgWord)r;
+    // The finaliser of MurmurHash3
+#if SIZEOF_VOID_P == 8
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+#else
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+#endif
+    return h;
+}
+
+#define hashKeySingleton(r)       (hashRetainer((r)))
 #define hashKeyAddElement(r, s)   (hashKeySingleton((r)) + (s)->hashKey)
 
 #include "EndPrivate.h"
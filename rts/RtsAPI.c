@@ -22,6 +22,8 @@
 #include "Weak.h"
 #include "sm/NonMoving.h"
 
+#include <string.h>
+
 /* ----------------------------------------------------------------------------
    Building Haskell objects from C datatypes.
    ------------------------------------------------------------------------- */
@@ -494,6 +496,54 @@ void rts_inCall (/* inout */ Capability **cap,
     scheduleWaitThread(tso,ret,cap);
 }
 
+/*
+ * rts_evalIOArgs() evaluates (p a1 ... an), which must have type (IO a),
+ * forcing the action's result to WHNF before returning, like
+ * rts_evalIO(). It is meant for C code that calls a small Haskell
+ * function over and over: rather than building the application with
+ * rts_apply(), it pushes the arguments straight onto the new thread's
+ * stack, in the stg_ap_pv/ppv/pppv frames that call a function of the
+ * right arity at once, and the thread starts on a stack left by a
+ * finished thread if there is one (see Note [Reusing thread stacks]).
+ */
+void rts_evalIOArgs (/* inout */ Capability **cap,
+                     /* in    */ HaskellObj p,
+                     /* in    */ uint32_t n_args,
+                     /* in    */ HaskellObj *args,
+                     /* out */   HaskellObj *ret)
+{
+    static const StgInfoTable *const ap_v_frames[] =
+        { &stg_ap_v_info, &stg_ap_pv_info, &stg_ap_ppv_info, &stg_ap_pppv_info };
+    StgTSO *tso;
+    W_ stack_size;
+    uint32_t i, j, k;
+
+    // Room for the frames: at most two words per argument
+    stack_size = stg_max((W_)RtsFlags.GcFlags.initialStkSize,
+                         sizeofW(StgTSO) + sizeofW(StgStack)
+                         + RESERVED_STACK_WORDS + 16 + 2 * n_args);
+    tso = createThread(*cap, stack_size);
+    pushClosure(tso, (W_)&stg_forceIO_info);
+
+    // The last 1-3 arguments go in a frame that also applies the State#
+    // token, the others in stg_ap_ppp frames in front of it.
+    k = n_args == 0 ? 0 : (n_args - 1) % 3 + 1;
+    for (j = k; j > 0; j--) {
+        pushClosure(tso, (W_)args[n_args - k + j - 1]);
+    }
+    pushClosure(tso, (W_)ap_v_frames[k]);
+    for (i = n_args - k; i > 0; i -= 3) {
+        pushClosure(tso, (W_)args[i - 1]);
+        pushClosure(tso, (W_)args[i - 2]);
+        pushClosure(tso, (W_)args[i - 3]);
+        pushClosure(tso, (W_)&stg_ap_ppp_info);
+    }
+
+    pushClosure(tso, (W_)p);
+    pushClosure(tso, (W_)&stg_enter_info);
+    scheduleWaitThread(tso,ret,cap);
+}
+
 /*
  * rts_evalStableIOMain() is suitable for calling main Haskell thread
  * stored in (StablePtr (IO a)) it calls rts_evalStableIO but wraps
@@ -919,6 +969,59 @@ void rts_done (void)
     freeMyTask();
 }
 
+static uint32_t putMVarCapability (Task *task, int capability,
+                                   uint32_t n_capabilities)
+{
+    if (capability < 0) {
+        capability = task->preferred_capability;
+        if (capability < 0) {
+            capability = 0;
+        }
+    }
+    return capability % n_capabilities;
+}
+
+// Fill the n MVars on cap now if it is free, or else leave them on its
+// putMVars list, for it to fill when it next looks at its inbox.
+static void tryPutMVarsOn (Task *task USED_IF_THREADS, Capability *cap,
+                           uint32_t n, StgStablePtr *mvars)
+{
+#if !defined(THREADED_RTS)
+
+    performTryPutMVars(cap, n, mvars);
+
+#else
+
+    Capability *task_old_cap;
+
+    ACQUIRE_LOCK(&cap->lock);
+    // If the capability is free, we can perform the tryPutMVars immediately
+    if (claimCapability(cap, task)) {
+        task_old_cap = task->cap;
+        task->cap = cap;
+        RELEASE_LOCK(&cap->lock);
+
+        performTryPutMVars(cap, n, mvars);
+
+        // Wake up the capability, which will start running the threads that
+        // we just awoke (if there were any).
+        releaseCapability(cap);
+        task->cap = task_old_cap;
+    } else {
+        PutMVar *p = stgMallocBytes(sizeof(PutMVar) + n * sizeof(StgStablePtr),
+                                    "hs_try_putmvar");
+        // We cannot deref the StablePtrs if we don't have a capability,
+        // so we have to store them and deref them later.
+        p->n_mvars = n;
+        memcpy(p->mvars, mvars, n * sizeof(StgStablePtr));
+        p->link = cap->putMVars;
+        cap->putMVars = p;
+        RELEASE_LOCK(&cap->lock);
+    }
+
+#endif
+}
+
 /* -----------------------------------------------------------------------------
    tryPutMVar from outside Haskell
 
@@ -951,48 +1054,66 @@ void hs_try_putmvar (/* in */ int capability,
 {
     Task *task = getMyTask();
     Capability *cap;
-    Capability *task_old_cap USED_IF_THREADS;
 
-    if (capability < 0) {
-        capability = task->preferred_capability;
-        if (capability < 0) {
-            capability = 0;
-        }
-    }
-    cap = getCapability(capability % enabled_capabilities);
+    cap = getCapability(putMVarCapability(task, capability,
+                                          enabled_capabilities));
+    tryPutMVarsOn(task, cap, 1, &mvar);
+}
 
-#if !defined(THREADED_RTS)
+/* -----------------------------------------------------------------------------
+   Many tryPutMVars from outside Haskell
 
-    performTryPutMVar(cap, (StgMVar*)deRefStablePtr(mvar), Unit_closure);
-    freeStablePtr(mvar);
+   The C call
 
-#else
+      hs_try_putmvar_batch(n, caps, mvars)
 
-    ACQUIRE_LOCK(&cap->lock);
-    // If the capability is free, we can perform the tryPutMVar immediately
-    if (cap->running_task == NULL) {
-        cap->running_task = task;
-        task_old_cap = task->cap;
-        task->cap = cap;
-        RELEASE_LOCK(&cap->lock);
+   is equivalent to
 
-        performTryPutMVar(cap, (StgMVar*)deRefStablePtr(mvar), Unit_closure);
+      for (i = 0; i < n; i++) hs_try_putmvar(caps[i], mvars[i]);
 
-        freeStablePtr(mvar);
+   (with -1 for every capability if caps is NULL), but the MVars for each
+   capability are filled together: the capability is claimed, or else sent
+   a message, once for all of them, and woken once. That matters to C
+   libraries that complete thousands of requests a millisecond.
+   -------------------------------------------------------------------------- */
 
-        // Wake up the capability, which will start running the thread that we
-        // just awoke (if there was one).
-        releaseCapability(cap);
-        task->cap = task_old_cap;
-    } else {
-        PutMVar *p = stgMallocBytes(sizeof(PutMVar),"hs_try_putmvar");
-        // We cannot deref the StablePtr if we don't have a capability,
-        // so we have to store it and deref it later.
-        p->mvar = mvar;
-        p->link = cap->putMVars;
-        cap->putMVars = p;
-        RELEASE_LOCK(&cap->lock);
+void hs_try_putmvar_batch (/* in */ int n,
+                           /* in */ const int *capabilities,
+                           /* in */ HsStablePtr *mvars)
+{
+    Task *task = getMyTask();
+    uint32_t n_caps = enabled_capabilities;
+    uint32_t *ends;
+    StgStablePtr *sorted;
+    uint32_t c, i;
+
+    if (n <= 0) {
+        return;
     }
 
-#endif
+    // Sort the MVars by capability, a counting sort: afterwards those for
+    // capability c are sorted[ends[c-1] .. ends[c]-1] (from 0 for c == 0).
+    ends = stgCallocBytes(n_caps + 1, sizeof(uint32_t), "hs_try_putmvar_batch");
+    sorted = stgMallocBytes(n * sizeof(StgStablePtr), "hs_try_putmvar_batch");
+    for (i = 0; i < (uint32_t)n; i++) {
+        c = putMVarCapability(task, capabilities ? capabilities[i] : -1, n_caps);
+        ends[c + 1]++;
+    }
+    for (c = 0; c < n_caps; c++) {
+        ends[c + 1] += ends[c];
+    }
+    for (i = 0; i < (uint32_t)n; i++) {
+        c = putMVarCapability(task, capabilities ? capabilities[i] : -1, n_caps);
+        sorted[ends[c]++] = mvars[i];
+    }
+
+    for (c = 0; c < n_caps; c++) {
+        uint32_t start = c == 0 ? 0 : ends[c - 1];
+        if (ends[c] > start) {
+            tryPutMVarsOn(task, getCapability(c), ends[c] - start, &sorted[start]);
+        }
+    }
+
+    stgFree(sorted);
+    stgFree(ends);
 }
@@ -14,9 +14,11 @@
 #include "Profiling.h"
 #include "RtsFlags.h"
 #include "sm/OSMem.h"
+#include "sm/NonMovingMark.h" // MARK_PREFETCH_QUEUE_MAX_DEPTH
 #include "hooks/Hooks.h"
 #include "Capability.h"
 #include "IOManager.h"
+#include "AutoScale.h"
 
 #if defined(HAVE_CTYPE_H)
 #include <ctype.h>
@@ -100,6 +102,8 @@ static void initStatsFile (FILE *f);
 static int  openStatsFile (
     char *filename, const char *FILENAME_FMT, FILE **file_ret);
 
+static int  openStatsStream (const char *dest);
+
 static StgWord64 decodeSize (
     const char *flag, uint32_t offset, StgWord64 min, StgWord64 max);
 
@@ -117,7 +121,6 @@ static bool read_heap_profiling_flag(const char *arg);
 #endif
 
 #if defined(TRACING)
-static void read_trace_flags(const char *arg);
 #endif
 
 static void errorUsage (void) STG_NORETURN;
@@ -148,6 +151,9 @@ void initRtsFlagsDefaults(void)
 
     RtsFlags.GcFlags.statsFile          = NULL;
     RtsFlags.GcFlags.giveStats          = NO_GC_STATS;
+    RtsFlags.GcFlags.statsStreamFile    = NULL;
+    RtsFlags.GcFlags.statsStreamInterval = 0;
+    RtsFlags.GcFlags.statsStreamTicks   = 0;
 
     RtsFlags.GcFlags.maxStkSize         = maxStkSize / sizeof(W_);
     RtsFlags.GcFlags.initialStkSize     = 1024 / sizeof(W_);
@@ -158,6 +164,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.minAllocAreaSize   = (4 * 1024 * 1024)       / BLOCK_SIZE;
     RtsFlags.GcFlags.largeAllocLim      = 0; /* defaults to minAllocAreasize */
     RtsFlags.GcFlags.nurseryChunkSize   = 0;
+    RtsFlags.GcFlags.blockCacheSize     = 0;    /* disabled */
     RtsFlags.GcFlags.minOldGenSize      = (1024 * 1024)       / BLOCK_SIZE; /* -O default */
     RtsFlags.GcFlags.maxHeapSize        = 0;    /* off by default */
     RtsFlags.GcFlags.heapLimitGrace     = (1024 * 1024);
@@ -165,9 +172,17 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.heapSizeSuggestionAuto = false;
     RtsFlags.GcFlags.pcFreeHeap         = 3;    /* 3% */
     RtsFlags.GcFlags.oldGenFactor       = 2;
+    RtsFlags.GcFlags.oldGenFactorAuto   = false;
+    RtsFlags.GcFlags.gcCpuTarget        = 0.1;
     RtsFlags.GcFlags.returnDecayFactor  = 4;
     RtsFlags.GcFlags.useNonmoving       = false;
     RtsFlags.GcFlags.nonmovingDenseAllocatorCount = 16;
+    RtsFlags.GcFlags.nonmovingMarkThreads = 1;
+    RtsFlags.GcFlags.nonmovingSweepThreads = 1;
+    RtsFlags.GcFlags.nonmovingPrefetchDepth = 5;
+    RtsFlags.GcFlags.nonmovingPrefetchAuto = false;
+    RtsFlags.GcFlags.nonmovingProfileSizeClasses = false;
+    RtsFlags.GcFlags.nonmovingEvacuateInterval = 0;
     RtsFlags.GcFlags.generations        = 2;
     RtsFlags.GcFlags.squeezeUpdFrames   = true;
     RtsFlags.GcFlags.compact            = false;
@@ -181,11 +196,28 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.doIdleGC           = false;
 #endif
     RtsFlags.GcFlags.heapBase           = 0;   /* means don't care */
+    RtsFlags.GcFlags.hugePages          = false;
+    RtsFlags.GcFlags.backgroundDecommit = false;
+    RtsFlags.GcFlags.scavengePrefetch   = false;
+    RtsFlags.GcFlags.pretenureThreshold = 0;
+    RtsFlags.GcFlags.selectorDepth      = 16;
+    RtsFlags.GcFlags.selectorBudget     = 0;
+    RtsFlags.GcFlags.segregateAllocWords = 0;
+    RtsFlags.GcFlags.pinnedEphemeralWords = 0;
+    RtsFlags.GcFlags.softHeapLimit      = 0; /* turned off */
+    RtsFlags.GcFlags.softHeapLimitGcCpu = 0.5;
+    RtsFlags.GcFlags.pinnedLiveness     = false;
+    RtsFlags.GcFlags.sortMutLists       = false;
+    RtsFlags.GcFlags.sortStaticObjects  = false;
+    RtsFlags.GcFlags.hierarchicalCopying = false;
+    RtsFlags.GcFlags.idleGCWorkBudget   = 0; /* turned off */
+    RtsFlags.GcFlags.finalizerBatch     = 0; /* turned off */
     RtsFlags.GcFlags.allocLimitGrace    = (100*1024) / BLOCK_SIZE;
     RtsFlags.GcFlags.numa               = false;
     RtsFlags.GcFlags.numaMask           = 1;
     RtsFlags.GcFlags.ringBell           = false;
     RtsFlags.GcFlags.longGCSync         = 0; /* detection turned off */
+    RtsFlags.GcFlags.minorPauseTarget   = 0; /* turned off */
 
     // 1 TBytes
     RtsFlags.GcFlags.addressSpaceSize   = (StgWord64)1 << 40;
@@ -211,6 +243,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.DebugFlags.numa            = false;
     RtsFlags.DebugFlags.compact         = false;
     RtsFlags.DebugFlags.continuation    = false;
+    RtsFlags.DebugFlags.sanitySampleRate = 1;
 
 #if defined(PROFILING)
     RtsFlags.CcFlags.doCostCentres      = COST_CENTRES_NONE;
@@ -222,10 +255,16 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ProfFlags.startHeapProfileAtStartup = true;
     RtsFlags.ProfFlags.startTimeProfileAtStartup = true;
     RtsFlags.ProfFlags.incrementUserEra = false;
+    RtsFlags.ProfFlags.censusSampleRate = 1;
+    RtsFlags.ProfFlags.censusDuringGc = false;
+    RtsFlags.ProfFlags.censusFork = false;
+    RtsFlags.ProfFlags.censusDelta = false;
+    RtsFlags.ProfFlags.censusDeltaThreshold = 0;
 
 #if defined(PROFILING)
     RtsFlags.ProfFlags.showCCSOnException = false;
     RtsFlags.ProfFlags.maxRetainerSetSize = 8;
+    RtsFlags.ProfFlags.retainerProfileBudget = 0;
     RtsFlags.ProfFlags.ccsLength          = 25;
     RtsFlags.ProfFlags.modSelector        = NULL;
     RtsFlags.ProfFlags.descrSelector      = NULL;
@@ -250,6 +289,15 @@ void initRtsFlagsDefaults(void)
     RtsFlags.TraceFlags.trace_output  = NULL;
     RtsFlags.TraceFlags.eventlogFlushTime = 0;
     RtsFlags.TraceFlags.nullWriter = false;
+    RtsFlags.TraceFlags.writerThread = false;
+    RtsFlags.TraceFlags.schedSampleRate = 1;
+    RtsFlags.TraceFlags.sparksSampleRate = 1;
+    RtsFlags.TraceFlags.eventlogSocket = NULL;
+    RtsFlags.TraceFlags.compact = false;
+    RtsFlags.TraceFlags.allocSampleBlocks = 0;
+    RtsFlags.TraceFlags.stackSampleTime = 0;
+    RtsFlags.TraceFlags.stackSampleTicks = 0;
+    RtsFlags.TraceFlags.toggleClasses = NULL;
 #endif
 
 // See Note [No timer on wasm32]
@@ -260,6 +308,8 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.tickInterval     = DEFAULT_TICK_INTERVAL;
 #endif
     RtsFlags.ConcFlags.ctxtSwitchTime   = USToTime(20000); // 20ms
+    RtsFlags.ConcFlags.adaptiveTimeSlices = false;
+    RtsFlags.ConcFlags.perCapabilityTimers = false;
 
     RtsFlags.MiscFlags.install_signal_handlers = true;
     RtsFlags.MiscFlags.install_seh_handlers    = true;
@@ -268,10 +318,18 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.machineReadable         = false;
     RtsFlags.MiscFlags.disableDelayedOsMemoryReturn = false;
     RtsFlags.MiscFlags.internalCounters        = false;
+    RtsFlags.MiscFlags.perfCounters            = false;
+    RtsFlags.MiscFlags.startupTimes            = false;
+    RtsFlags.MiscFlags.tscClock                = false;
+    RtsFlags.MiscFlags.eagerIpeIndex           = false;
+    RtsFlags.MiscFlags.tickless                = false;
     RtsFlags.MiscFlags.linkerAlwaysPic         = DEFAULT_LINKER_ALWAYS_PIC;
     RtsFlags.MiscFlags.linkerOptimistic        = false;
     RtsFlags.MiscFlags.linkerMemBase           = 0;
+    RtsFlags.MiscFlags.linkerCache             = NULL;
+    RtsFlags.MiscFlags.linkerCodeArena         = 0;
     RtsFlags.MiscFlags.ioManager               = IO_MNGR_FLAG_AUTO;
+    RtsFlags.MiscFlags.ioManagerEdgeTriggered  = false;
 #if defined(THREADED_RTS) && defined(mingw32_HOST_OS)
     RtsFlags.MiscFlags.numIoWorkerThreads      = getNumberOfProcessors();
 #else
@@ -281,17 +339,26 @@ void initRtsFlagsDefaults(void)
 #if defined(THREADED_RTS)
     RtsFlags.ParFlags.nCapabilities     = 1;
     RtsFlags.ParFlags.migrate           = true;
+    RtsFlags.ParFlags.stealThreads      = false;
+    RtsFlags.ParFlags.parkSpin          = 0;
+    RtsFlags.ParFlags.minSpareWorkers   = 0;
+    RtsFlags.ParFlags.maxSpareWorkers   = MAX_SPARE_WORKERS;
+    RtsFlags.ParFlags.autoScale         = false;
     RtsFlags.ParFlags.parGcEnabled      = 1;
     RtsFlags.ParFlags.parGcGen          = 0;
     RtsFlags.ParFlags.parGcLoadBalancingEnabled = true;
     RtsFlags.ParFlags.parGcLoadBalancingGen = ~0u; /* auto, based on -A */
     RtsFlags.ParFlags.parGcNoSyncWithIdle   = 0;
     RtsFlags.ParFlags.parGcThreads      = 0; /* defaults to -N */
+    RtsFlags.ParFlags.parGcThreadsAuto  = false;
+    RtsFlags.ParFlags.parGcThreadsAutoWork = 1024 * 1024;
+    RtsFlags.ParFlags.parCompact        = false;
     RtsFlags.ParFlags.setAffinity       = 0;
 #endif
 
 #if defined(THREADED_RTS)
     RtsFlags.ParFlags.maxLocalSparks    = 4096;
+    RtsFlags.ParFlags.maxSparkPoolSize  = 0;
 #endif /* THREADED_RTS */
 
 #if defined(TICKY_TICKY)
@@ -300,6 +367,8 @@ void initRtsFlagsDefaults(void)
 #endif
     RtsFlags.HpcFlags.readTixFile        = HPC_YES_IMPLICIT;
     RtsFlags.HpcFlags.writeTixFile       = true;
+    RtsFlags.HpcFlags.tixFormat          = HPC_TIX_TEXT;
+    RtsFlags.HpcFlags.tixInterval        = 0;
 }
 
 static const char *
@@ -322,6 +391,20 @@ usage_text[] = {
 "  --nonmoving-gc",
 "            Selects the non-moving mark-and-sweep garbage collector to",
 "            manage the oldest generation.",
+"  --nonmoving-evacuate=<n>",
+"            Makes every <n>th non-moving collection synchronous and moves",
+"            the live objects out of the sparsest segments (default: 0, never)",
+"  --nonmoving-mark-threads=<n>",
+"            Marks the non-moving heap with <n> threads (default: 1)",
+"  --nonmoving-prefetch-depth=<n>|auto",
+"            Prefetches <n> (0 to 16, default: 5) mark queue entries ahead when",
+"            marking the non-moving heap, or picks the best depth by measuring",
+"            mark throughput during the first collections",
+"  --nonmoving-profile-size-classes",
+"            Profiles the sizes of the objects promoted to the non-moving",
+"            heap and adds allocator size classes where they save slop",
+"  --nonmoving-sweep-threads=<n>",
+"            Sweeps the non-moving heap with <n> threads (default: 1)",
 "  --copying-gc",
 "            Selects the copying garbage collector to manage all generations.",
 "",
@@ -343,14 +426,68 @@ usage_text[] = {
 "            memory controlled by this factor (higher is slower). Setting the factor",
 "            to 0 means memory is not returned.",
 "            (default 4.0)",
+"  -Fauto[=<n>] Adjust the -F factor after each major collection to keep the",
+"            time spent in GC near <n> percent of the total CPU time",
+"            (default: 10)",
 "  -n<size>  Allocation area chunk size (0 = disabled, default: 0)",
+"  --background-decommit",
+"            Return memory to the OS from a background thread rather than",
+"            during GC (threaded RTS only)",
+"  --block-cache-size=<size>",
+"            Size of the per-capability cache of free blocks, used to avoid",
+"            contention on the block allocator (0 = disabled, default: 0)",
+"  --scavenge-prefetch",
+"            Prefetch the objects that the GC is about to evacuate",
+"  --minor-pause-target=<ms>",
+"            Resize the allocation area after each minor GC to keep minor",
+"            GC pauses under <ms> milliseconds (default: off)",
+"  --pretenure[=<n>]",
+"            Promote objects straight to the oldest generation when objects",
+"            with the same info table survive <n> more GCs on average once",
+"            out of the nursery (default: off, <n> defaults to 1)",
+"  --segregate-alloc=<size>",
+"            Allocate objects of at least <size> bytes, but smaller than a",
+"            large object, apart from smaller objects (default: off)",
+"  --pinned-ephemeral=<size>",
+"            Allocate pinned objects smaller than <size> bytes into their",
+"            own pinned blocks (default: off)",
+"  --pinned-liveness",
+"            Measure the live data in each pinned block during GC, reported",
+"            in the eventlog with -lg",
+"  --sort-mut-lists",
+"            Sort the remembered set by address before the GC scans it",
+"  --sort-static-objects",
+"            Sort the static objects by address before the GC scans them",
+"  --hierarchical-copying",
+"            Copy objects in roughly depth-first order during GC, keeping",
+"            linked structures together",
+"  --idle-gc-work-budget=<ms>",
+"            Leave freeing dead large objects and returning memory to the OS",
+"            to idle capabilities, <ms> milliseconds at a time (default: off)",
+"  --selector-depth=<n>",
+"            Evaluate selector thunks nested up to <n> deep during GC",
+"            (default: 16)",
+"  --selector-budget=<n>",
+"            Evaluate at most <n> selector thunks per GC thread in each GC",
+"            (default: 0, unlimited)",
+"  --finalizer-batch=<n>",
+"            Run the Haskell finalizers found by a GC in batches of <n> on",
+"            all capabilities, and C finalizers on a separate OS thread",
+"            (default: 0, off)",
 "  -O<size>  Sets the minimum size of the old generation (default 1M)",
 "  -M<size>  Sets the maximum heap size (default unlimited)  e.g.: -M256k -M1G",
+"  --soft-heap-limit=<size>",
+"            Collect the old generation more often as the heap approaches",
+"            <size>, rather than failing like -M (default: off)",
+"  --soft-heap-limit-gc=<n>",
+"            Let the soft heap limit raise the time spent in GC to at most",
+"            <n> percent of the total CPU time (default: 50)",
 "  -H<size>  Sets the minimum heap size (default 0M)   e.g.: -H24m  -H1G",
 "  -xb<addr> Sets the address from which a suitable start for the heap memory",
 "            will be searched from. This is useful if the default address",
 "            clashes with some third-party library.",
 "  -xn       Use the non-moving collector for the old generation.",
+"  -xH       Back the heap with transparent huge pages, where supported.",
 "  -m<n>     Minimum % of heap which must be available (default 3%)",
 "  -G<n>     Number of generations (default: 2)",
 "  -c<n>     Use in-place compaction instead of copying in the oldest generation",
@@ -368,6 +505,16 @@ usage_text[] = {
 "  -t[<file>] One-line GC statistics (if <file> omitted, uses stderr)",
 "  -s[<file>] Summary  GC statistics (if <file> omitted, uses stderr)",
 "  -S[<file>] Detailed GC statistics (if <file> omitted, uses stderr)",
+"  --stats-stream=<file>",
+"             Write a line of JSON statistics to <file> (or to file",
+"             descriptor <n> if <file> is fd:<n>) after each major GC",
+"  --stats-stream-interval=<secs>",
+"             Write the --stats-stream records every <secs> seconds instead",
+#if defined(linux_HOST_OS)
+"  --perf-counters",
+"             Count cycles, instructions, cache and TLB misses of the mutator",
+"             and the GC with hardware counters, for -s and the eventlog",
+#endif
 "",
 "",
 "  -Z         Don't squeeze out update frames on context switch",
@@ -403,6 +550,9 @@ usage_text[] = {
 "    -he<era>...  closures with specified era",
 "",
 "  -R<size>       Set the maximum retainer set size (default: 8)",
+"  --retainer-profile-budget=<secs>",
+"                 Spread each retainer profile over several censuses,",
+"                 spending at most about <secs> on it at each",
 "",
 "  -L<chars>      Maximum length of a cost-centre stack in a heap profile",
 "                 (default: 25)",
@@ -423,7 +573,19 @@ usage_text[] = {
 "  --no-automatic-heap-samples",
 "           Do not start the heap profile interval timer on start-up,",
 "           Rather, the application will be responsible for triggering",
-"           heap profiler samples."
+"           heap profiler samples.",
+"  --heap-census-sample=<n>",
+"           Estimate each heap profile sample from 1 in <n> of the heap's",
+"           blocks (default: 1, all of them)",
+"  --heap-census-during-gc",
+"           Count each heap profile sample while the major GC before it",
+"           scavenges the heap, rather than walking the heap afterwards",
+"  --heap-census-fork",
+"           Take each heap profile sample in a forked child process, while",
+"           the program carries on",
+"  --heap-prof-delta[=<size>]",
+"           With -hi, post only the bands that changed by more than <size>",
+"           bytes since they were last posted to the eventlog (default: 0)"
 
 #if defined(TRACING)
 "",
@@ -439,9 +601,7 @@ usage_text[] = {
 "                p    par spark events (sampled)",
 "                f    par spark events (full detail)",
 "                u    user events (emitted from Haskell code)",
-#if defined(TICKY_TICKY)
 "                T    ticky-ticky counter samples",
-#endif
 "                a    all event classes above",
 #  if defined(DEBUG)
 "                t    add time stamps (only useful with -v)",
@@ -450,6 +610,34 @@ usage_text[] = {
 "             the initial enabled event classes are 'sgpu'",
 " --eventlog-flush-interval=<secs>",
 "             Periodically flush the eventlog at the specified interval.",
+#  if defined(THREADED_RTS)
+" --eventlog-writer-thread",
+"             Write the eventlog from a thread of its own, so that",
+"             capabilities don't wait for the output",
+#  endif
+#  if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+" --eventlog-socket=<path>",
+"             Serve the eventlog (-l) to a consumer connecting to the Unix",
+"             socket <path>, dropping events if it can't keep up",
+#  endif
+" --eventlog-compact",
+"             Write the eventlog in the compact format, with varint",
+"             delta timestamps",
+" --eventlog-sample-sched=<n>",
+"             Post only 1 in <n> of the thread run/stop events (default: 1)",
+" --eventlog-sample-sparks=<n>",
+"             Post only 1 in <n> of the spark events (default: 1)",
+#  if !defined(mingw32_HOST_OS)
+" --eventlog-toggle-classes=<flags>",
+"             On SIGUSR2, switch between the trace classes of -l and",
+"             <flags> (as for -l)",
+#  endif
+" --eventlog-alloc-sample=<n>",
+"             Post the code allocating each time a capability has filled",
+"             <n> nursery blocks (default: 0, off)",
+" --eventlog-stack-sample=<secs>",
+"             Post the stack of each running thread every <secs>",
+"             seconds (default: 0, off)",
 #endif
 
 "",
@@ -460,6 +648,10 @@ usage_text[] = {
 "  -C<secs>  Context-switch interval in seconds.",
 "            0 or no argument means switch as often as possible.",
 "            Default: 0.02 sec.",
+"  --adaptive-time-slices",
+"            Lengthen the time slices of threads that allocate little",
+"  --per-capability-timers",
+"            End each capability's time slices on a timer of its own",
 "  -V<secs>  Master tick interval in seconds (0 == disable timer).",
 "            This sets the resolution for -C and the heap profile timer -i,",
 "            and is the frequency of time profile samples.",
@@ -468,6 +660,9 @@ usage_text[] = {
 #else
 "            Default: 0.01 sec.",
 #endif
+"  --tickless",
+"            Stop the tick as soon as the program is idle, rather than",
+"            after the idle GC (see -I)",
 "",
 #if defined(DEBUG)
 "  -Ds  DEBUG: scheduler",
@@ -491,6 +686,9 @@ usage_text[] = {
 "  -DC  DEBUG: compact",
 "  -Dk  DEBUG: continuation",
 "  -Do  DEBUG: iomanager",
+"  --sanity-sample=<n>",
+"        Make -DS check the closures of 1 in <n> blocks of the heap,",
+"        chosen at random at each GC (implies -DS; default: 1, all of them)",
 "",
 "     NOTE: DEBUG events are sent to stderr by default; add -l to create a",
 "     binary event log file instead.",
@@ -500,14 +698,29 @@ usage_text[] = {
 "  -N[<n>]    Use <n> processors (default: 1, -N alone determines",
 "             the number of processors to use automatically)",
 "  -maxN[<n>] Use up to <n> processors automatically",
+"  -Nauto-scale",
+"             Use between 1 and the number of processors (or the cgroup CPU",
+"             quota), changing the number with the load",
 "  -qg[<n>]   Use parallel GC only for generations >= <n>",
 "             (default: 0, -qg alone turns off parallel GC)",
 "  -qb[<n>]   Use load-balancing in the parallel GC only for generations >= <n>",
 "             (default: 1 for -A < 32M, 0 otherwise;",
 "              -qb alone turns off load-balancing)",
 "  -qn<n>     Use <n> threads for parallel GC (defaults to value of -N)",
+"  -qnauto[=<size>]",
+"             Choose the number of threads for each parallel GC, up to -qn,",
+"             one for each <size> bytes of estimated work (default: 1m)",
 "  -qa        Use the OS to set thread affinity (experimental)",
+"  -qc        Use the parallel GC threads for compaction (see -c)",
 "  -qm        Don't automatically migrate threads between CPUs",
+"  -qs        Idle CPUs ask busy ones to share their threads",
+"  --park-spin=<n>",
+"             Spin for up to <n> iterations waiting for a capability before",
+"             sleeping (default: 0)",
+"  --min-spare-workers=<n>",
+"             Keep at least <n> idle worker threads per capability (default: 0)",
+"  --max-spare-workers=<n>",
+"             Keep at most <n> idle worker threads per capability (default: 6)",
 "  -qi<n>     If a processor has been idle for the last <n> GCs, do not",
 "             wake it up for a non-load-balancing parallel GC.",
 "             (0 disables,  default: 0)",
@@ -538,6 +751,14 @@ usage_text[] = {
 "             The I/O manager to use.",
 "             Options available: auto" IOMGRS_ENABLED_STR
               " (default: " IOMGR_DEFAULT_STR ")",
+#if !defined(mingw32_HOST_OS)
+"  --io-manager-edge-triggered",
+"             Keep the file descriptors the mio I/O manager waits on",
+"             registered edge-triggered, rather than re-arming them for",
+"             every wait. Threads may only wait once a read or write has",
+"             failed with EAGAIN, and descriptors must be closed with",
+"             closeFdWith.",
+#endif
 #if defined(THREADED_RTS)
 #if defined(mingw32_HOST_OS)
 "  --io-manager-threads=<num>",
@@ -545,6 +766,8 @@ usage_text[] = {
 "             handle completion events. (default: num cores)",
 #endif
 "  -e<n>      Maximum number of outstanding local sparks (default: 4096)",
+"  --max-spark-pool=<n>",
+"             Let a full spark pool grow up to <n> sparks (default: the -e size)",
 #endif
 #if defined(x86_64_HOST_ARCH)
 #if !DEFAULT_LINKER_ALWAYS_PIC
@@ -555,6 +778,20 @@ usage_text[] = {
 "  -xm        Base address to mmap memory in the GHCi linker",
 "             (hex; must be <80000000)",
 #endif
+"  --linker-cache=<dir>",
+"             Keep the objects the GHCi linker relocates in <dir>, to",
+"             relocate them faster the next time they are loaded (ELF only)",
+"  --linker-code-arena=<size>",
+"             Load code into an arena of <size> bytes, in huge pages where",
+"             the OS has them",
+"  --eager-ipe-index",
+"             Index the info table provenance entries at startup, on a",
+"             background thread in the threaded RTS, rather than on first use",
+"  --startup-times",
+"             Print how long each phase of the RTS's startup took",
+"  --tsc-clock",
+"             Time the eventlog, the stats and the scheduler with the",
+"             CPU's time stamp counter, where it is invariant",
 "  -xq        The allocation limit given to a thread after it receives",
 "             an AllocationLimitExceeded exception. (default: 100k)",
 "",
@@ -576,6 +813,15 @@ usage_text[] = {
 "             Whether to write <program>.tix at the end of execution.",
 "             (default: yes)",
 "",
+"  --tix-format=<text|binary|bits>",
+"             Write <program>.tix as text, in binary, or in binary with",
+"             only whether each tick box was entered. (default: text)",
+#if defined(THREADED_RTS)
+"  --tix-interval=<secs>",
+"             Also write <program>.tix every <secs> seconds while running,",
+"             if the counts have changed. (default: 0, only at exit)",
+#endif
+"",
 "RTS options may also be specified using the GHCRTS environment variable.",
 "",
 "Other RTS options may be available for programs compiled a different way.",
@@ -1005,16 +1251,130 @@ error = true;
                        OPTION_UNSAFE;
                        RtsFlags.MiscFlags.linkerOptimistic = true;
                   }
+                  else if (!strncmp("linker-cache=",
+                               &rts_argv[arg][2], 13)) {
+                      OPTION_UNSAFE;
+                      if (strlen(&rts_argv[arg][15]) == 0) {
+                          errorBelch("--linker-cache expects a directory");
+                          error = true;
+                      } else {
+                          RtsFlags.MiscFlags.linkerCache =
+                              strdup(&rts_argv[arg][15]);
+                      }
+                  }
+                  else if (!strncmp("linker-code-arena=",
+                               &rts_argv[arg][2], 18)) {
+                      OPTION_UNSAFE;
+                      RtsFlags.MiscFlags.linkerCodeArena =
+                          decodeSize(rts_argv[arg], 20, 0, HS_WORD_MAX);
+                  }
                   else if (strequal("null-eventlog-writer",
                                &rts_argv[arg][2])) {
                       OPTION_UNSAFE;
                       RtsFlags.TraceFlags.nullWriter = true;
                   }
+                  else if (strequal("eventlog-writer-thread",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.TraceFlags.writerThread = true;
+                  }
+                  else if (!strncmp("eventlog-socket=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          if (strlen(&rts_argv[arg][18]) == 0) {
+                              errorBelch("--eventlog-socket expects a path");
+                              error = true;
+                          } else {
+                              RtsFlags.TraceFlags.eventlogSocket =
+                                  strdup(&rts_argv[arg][18]);
+                          }
+                      );
+                  }
+                  else if (strequal("eventlog-compact",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.compact = true;
+                      );
+                  }
+                  else if (!strncmp("eventlog-sample-sched=",
+                               &rts_argv[arg][2], 22)) {
+                      OPTION_SAFE;
+                      int32_t n = strtol(rts_argv[arg]+24, (char **) NULL, 10);
+                      if (n <= 0) {
+                          errorBelch("bad value for --eventlog-sample-sched");
+                          error = true;
+                      } else {
+                          RtsFlags.TraceFlags.schedSampleRate = n;
+                      }
+                  }
+                  else if (!strncmp("eventlog-sample-sparks=",
+                               &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      int32_t n = strtol(rts_argv[arg]+25, (char **) NULL, 10);
+                      if (n <= 0) {
+                          errorBelch("bad value for --eventlog-sample-sparks");
+                          error = true;
+                      } else {
+                          RtsFlags.TraceFlags.sparksSampleRate = n;
+                      }
+                  }
+                  else if (!strncmp("eventlog-toggle-classes=",
+                               &rts_argv[arg][2], 24)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.toggleClasses =
+                              strdup(&rts_argv[arg][26]);
+                      );
+                  }
+                  else if (!strncmp("eventlog-alloc-sample=",
+                               &rts_argv[arg][2], 22)) {
+                      OPTION_SAFE;
+                      int32_t n = strtol(rts_argv[arg]+24, (char **) NULL, 10);
+                      if (n < 0) {
+                          errorBelch("bad value for --eventlog-alloc-sample");
+                          error = true;
+                      } else {
+                          RtsFlags.TraceFlags.allocSampleBlocks = n;
+                      }
+                  }
+                  else if (!strncmp("eventlog-stack-sample=",
+                               &rts_argv[arg][2], 22)) {
+                      OPTION_SAFE;
+                      double secs = atof(rts_argv[arg]+24);
+                      if (secs < 0) {
+                          errorBelch("bad value for --eventlog-stack-sample");
+                          error = true;
+                      } else {
+                          RtsFlags.TraceFlags.stackSampleTime =
+                              fsecondsToTime(secs);
+                      }
+                  }
                   else if (strequal("machine-readable",
                                &rts_argv[arg][2])) {
                       OPTION_UNSAFE;
                       RtsFlags.MiscFlags.machineReadable = true;
                   }
+                  else if (!strncmp("stats-stream=",
+                               &rts_argv[arg][2], 13)) {
+                      OPTION_UNSAFE;
+                      if (openStatsStream(rts_argv[arg]+15) != 0) {
+                          error = true;
+                      }
+                  }
+                  else if (!strncmp("stats-stream-interval=",
+                               &rts_argv[arg][2], 22)) {
+                      OPTION_SAFE;
+                      double intervalSeconds = parseDouble(rts_argv[arg]+24, &error);
+                      if (error || intervalSeconds < 0) {
+                          errorBelch("bad value for --stats-stream-interval");
+                          error = true;
+                      } else {
+                          RtsFlags.GcFlags.statsStreamInterval =
+                              fsecondsToTime(intervalSeconds);
+                      }
+                  }
                   else if (strequal("disable-delayed-os-memory-return",
                                &rts_argv[arg][2])) {
                       OPTION_UNSAFE;
@@ -1025,6 +1385,36 @@ error = true;
                       OPTION_SAFE;
                       RtsFlags.MiscFlags.internalCounters = true;
                   }
+                  else if (strequal("perf-counters",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.perfCounters = true;
+                  }
+                  else if (strequal("startup-times",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.startupTimes = true;
+                  }
+                  else if (strequal("tsc-clock",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.tscClock = true;
+                  }
+                  else if (strequal("eager-ipe-index",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.eagerIpeIndex = true;
+                  }
+                  else if (strequal("tickless",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.tickless = true;
+                  }
+                  else if (strequal("io-manager-edge-triggered",
+                                    &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.ioManagerEdgeTriggered = true;
+                  }
                   else if (!strncmp("io-manager=",
                                &rts_argv[arg][2], 11)) {
                       OPTION_UNSAFE;
@@ -1080,6 +1470,261 @@ error = true;
                         RtsFlags.GcFlags.nonmovingDenseAllocatorCount = threshold;
                       }
                   }
+                  else if (!strncmp("nonmoving-evacuate=",
+                               &rts_argv[arg][2], 19)) {
+                      OPTION_SAFE;
+                      int32_t interval = strtol(rts_argv[arg]+21, (char **) NULL, 10);
+                      if (interval < 0) {
+                        errorBelch("bad value for --nonmoving-evacuate");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.nonmovingEvacuateInterval = interval;
+                      }
+                  }
+                  else if (!strncmp("nonmoving-mark-threads=",
+                               &rts_argv[arg][2], 23)) {
+                      OPTION_SAFE;
+                      int32_t threads = strtol(rts_argv[arg]+25, (char **) NULL, 10);
+                      if (threads < 1) {
+                        errorBelch("bad value for --nonmoving-mark-threads");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.nonmovingMarkThreads = threads;
+                      }
+                  }
+                  else if (strequal("nonmoving-prefetch-depth=auto",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.nonmovingPrefetchAuto = true;
+                  }
+                  else if (!strncmp("nonmoving-prefetch-depth=",
+                               &rts_argv[arg][2], 25)) {
+                      OPTION_SAFE;
+                      int32_t depth = strtol(rts_argv[arg]+27, (char **) NULL, 10);
+                      if (depth < 0 || depth > MARK_PREFETCH_QUEUE_MAX_DEPTH) {
+                        errorBelch("bad value for --nonmoving-prefetch-depth "
+                                   "(expected 0 to %d or auto)",
+                                   MARK_PREFETCH_QUEUE_MAX_DEPTH);
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.nonmovingPrefetchDepth = depth;
+                        RtsFlags.GcFlags.nonmovingPrefetchAuto = false;
+                      }
+                  }
+                  else if (strequal("nonmoving-profile-size-classes",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.nonmovingProfileSizeClasses = true;
+                  }
+                  else if (!strncmp("nonmoving-sweep-threads=",
+                               &rts_argv[arg][2], 24)) {
+                      OPTION_SAFE;
+                      int32_t threads = strtol(rts_argv[arg]+26, (char **) NULL, 10);
+                      if (threads < 1) {
+                        errorBelch("bad value for --nonmoving-sweep-threads");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.nonmovingSweepThreads = threads;
+                      }
+                  }
+                  else if (strequal("background-decommit",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.backgroundDecommit = true;
+                  }
+                  else if (strequal("scavenge-prefetch",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.scavengePrefetch = true;
+                  }
+                  else if (strequal("pretenure",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.pretenureThreshold = 1;
+                  }
+                  else if (!strncmp("pretenure=",
+                               &rts_argv[arg][2], 10)) {
+                      OPTION_SAFE;
+                      double threshold = atof(rts_argv[arg]+12);
+                      if (threshold <= 0) {
+                          bad_option(rts_argv[arg]);
+                      }
+                      RtsFlags.GcFlags.pretenureThreshold = threshold;
+                  }
+                  else if (!strncmp("segregate-alloc=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+                      StgWord64 size = decodeSize(rts_argv[arg], 18,
+                                                  sizeof(W_),
+                                                  LARGE_OBJECT_THRESHOLD);
+                      RtsFlags.GcFlags.segregateAllocWords = size / sizeof(W_);
+                  }
+                  else if (!strncmp("pinned-ephemeral=",
+                               &rts_argv[arg][2], 17)) {
+                      OPTION_SAFE;
+                      StgWord64 size = decodeSize(rts_argv[arg], 19,
+                                                  sizeof(W_),
+                                                  LARGE_OBJECT_THRESHOLD);
+                      RtsFlags.GcFlags.pinnedEphemeralWords = size / sizeof(W_);
+                  }
+                  else if (strequal("pinned-liveness",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.pinnedLiveness = true;
+                  }
+                  else if (strequal("sort-mut-lists",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.sortMutLists = true;
+                  }
+                  else if (strequal("sort-static-objects",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.sortStaticObjects = true;
+                  }
+                  else if (strequal("hierarchical-copying",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.hierarchicalCopying = true;
+                  }
+                  else if (!strncmp("idle-gc-work-budget=",
+                               &rts_argv[arg][2], 20)) {
+                      OPTION_SAFE;
+                      double ms = atof(rts_argv[arg]+22);
+                      if (ms <= 0) {
+                          bad_option(rts_argv[arg]);
+                      }
+                      RtsFlags.GcFlags.idleGCWorkBudget =
+                          fsecondsToTime(ms / 1000);
+                  }
+                  else if (!strncmp("park-spin=",
+                               &rts_argv[arg][2], 10)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                          int32_t spin = strtol(rts_argv[arg]+12, (char **) NULL, 10);
+                          if (spin < 0) {
+                              errorBelch("bad value for --park-spin");
+                              error = true;
+                          } else {
+                              RtsFlags.ParFlags.parkSpin = spin;
+                          }
+                      )
+                  }
+                  else if (!strncmp("max-spark-pool=",
+                               &rts_argv[arg][2], 15)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                          int32_t n = strtol(rts_argv[arg]+17, (char **) NULL, 10);
+                          if (n <= 0) {
+                              errorBelch("bad value for --max-spark-pool");
+                              error = true;
+                          } else {
+                              RtsFlags.ParFlags.maxSparkPoolSize = n;
+                          }
+                      )
+                  }
+                  else if (!strncmp("min-spare-workers=",
+                               &rts_argv[arg][2], 18)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                          int32_t n = strtol(rts_argv[arg]+20, (char **) NULL, 10);
+                          if (n < 0) {
+                              errorBelch("bad value for --min-spare-workers");
+                              error = true;
+                          } else {
+                              RtsFlags.ParFlags.minSpareWorkers = n;
+                          }
+                      )
+                  }
+                  else if (!strncmp("max-spare-workers=",
+                               &rts_argv[arg][2], 18)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                          int32_t n = strtol(rts_argv[arg]+20, (char **) NULL, 10);
+                          if (n < 0) {
+                              errorBelch("bad value for --max-spare-workers");
+                              error = true;
+                          } else {
+                              RtsFlags.ParFlags.maxSpareWorkers = n;
+                          }
+                      )
+                  }
+                  else if (strequal("adaptive-time-slices",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ConcFlags.adaptiveTimeSlices = true;
+                  }
+                  else if (strequal("per-capability-timers",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ConcFlags.perCapabilityTimers = true;
+                  }
+                  else if (!strncmp("selector-depth=",
+                               &rts_argv[arg][2], 15)) {
+                      OPTION_SAFE;
+                      int32_t depth = strtol(rts_argv[arg]+17, (char **) NULL, 10);
+                      if (depth < 0) {
+                        errorBelch("bad value for --selector-depth");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.selectorDepth = depth;
+                      }
+                  }
+                  else if (!strncmp("selector-budget=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+                      long budget = strtol(rts_argv[arg]+18, (char **) NULL, 10);
+                      if (budget < 0) {
+                        errorBelch("bad value for --selector-budget");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.selectorBudget = budget;
+                      }
+                  }
+                  else if (!strncmp("finalizer-batch=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+                      long batch = strtol(rts_argv[arg]+18, (char **) NULL, 10);
+                      if (batch < 0 || batch > HS_INT32_MAX) {
+                        errorBelch("bad value for --finalizer-batch");
+                        error = true;
+                      } else {
+                        RtsFlags.GcFlags.finalizerBatch = batch;
+                      }
+                  }
+                  else if (!strncmp("soft-heap-limit=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.softHeapLimit =
+                          decodeSize(rts_argv[arg], 18, BLOCK_SIZE,
+                                     HS_WORD_MAX) / BLOCK_SIZE;
+                  }
+                  else if (!strncmp("soft-heap-limit-gc=",
+                               &rts_argv[arg][2], 19)) {
+                      OPTION_UNSAFE;
+                      double pc = atof(rts_argv[arg]+21);
+                      if (pc <= 0 || pc >= 100) {
+                          bad_option(rts_argv[arg]);
+                      }
+                      RtsFlags.GcFlags.softHeapLimitGcCpu = pc / 100;
+                  }
+                  else if (!strncmp("minor-pause-target=",
+                               &rts_argv[arg][2], 19)) {
+                      OPTION_SAFE;
+                      double ms = atof(rts_argv[arg]+21);
+                      if (ms <= 0) {
+                          bad_option(rts_argv[arg]);
+                      }
+                      RtsFlags.GcFlags.minorPauseTarget =
+                          fsecondsToTime(ms / 1000);
+                  }
+                  else if (!strncmp("block-cache-size=",
+                               &rts_argv[arg][2], 17)) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.blockCacheSize
+                          = decodeSize(rts_argv[arg], 19, 0, HS_INT_MAX)
+                               / BLOCK_SIZE;
+                  }
                   else if (strequal("read-tix-file=yes",
                               &rts_argv[arg][2])) {
                        OPTION_UNSAFE;
@@ -1100,6 +1745,36 @@ error = true;
                        OPTION_UNSAFE;
                        RtsFlags.HpcFlags.writeTixFile = false;
                   }
+                  else if (strequal("tix-format=text",
+                              &rts_argv[arg][2])) {
+                       OPTION_UNSAFE;
+                       RtsFlags.HpcFlags.tixFormat = HPC_TIX_TEXT;
+                  }
+                  else if (strequal("tix-format=binary",
+                              &rts_argv[arg][2])) {
+                       OPTION_UNSAFE;
+                       RtsFlags.HpcFlags.tixFormat = HPC_TIX_BINARY;
+                  }
+                  else if (strequal("tix-format=bits",
+                              &rts_argv[arg][2])) {
+                       OPTION_UNSAFE;
+                       RtsFlags.HpcFlags.tixFormat = HPC_TIX_BITS;
+                  }
+                  else if (!strncmp("tix-interval=",
+                               &rts_argv[arg][2], 13)) {
+                      OPTION_UNSAFE;
+                      THREADED_BUILD_ONLY(
+                          double intervalSeconds =
+                              parseDouble(rts_argv[arg]+15, &error);
+                          if (error || intervalSeconds < 0) {
+                              errorBelch("bad value for --tix-interval");
+                              error = true;
+                          } else {
+                              RtsFlags.HpcFlags.tixInterval =
+                                  fsecondsToTime(intervalSeconds);
+                          }
+                      )
+                  }
 #if defined(THREADED_RTS)
 #if defined(mingw32_HOST_OS)
                   else if (!strncmp("io-manager-threads",
@@ -1182,6 +1857,20 @@ error = true;
                           n_numa_nodes = nNodes;
                       }
                   }
+#endif
+#if defined(DEBUG)
+                  else if (!strncmp("sanity-sample=",
+                               &rts_argv[arg][2], 14)) {
+                      OPTION_SAFE;
+                      int32_t n = strtol(rts_argv[arg]+16, (char **) NULL, 10);
+                      if (n <= 0) {
+                          errorBelch("bad value for --sanity-sample");
+                          error = true;
+                      } else {
+                          RtsFlags.DebugFlags.sanity = true;
+                          RtsFlags.DebugFlags.sanitySampleRate = n;
+                      }
+                  }
 #endif
                   else if (!strncmp("long-gc-sync=", &rts_argv[arg][2], 13)) {
                       OPTION_SAFE;
@@ -1199,6 +1888,57 @@ error = true;
                       RtsFlags.ProfFlags.startHeapProfileAtStartup = false;
                       break;
                   }
+                  else if (strequal("heap-census-during-gc",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ProfFlags.censusDuringGc = true;
+                      break;
+                  }
+                  else if (strequal("heap-census-fork",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ProfFlags.censusFork = true;
+                      break;
+                  }
+                  else if (strequal("heap-prof-delta",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.ProfFlags.censusDelta = true;
+                      break;
+                  }
+                  else if (!strncmp("heap-prof-delta=",
+                               &rts_argv[arg][2], 16)) {
+                      OPTION_SAFE;
+                      RtsFlags.ProfFlags.censusDelta = true;
+                      RtsFlags.ProfFlags.censusDeltaThreshold =
+                          decodeSize(rts_argv[arg], 18, 0, HS_INT_MAX);
+                      break;
+                  }
+                  else if (!strncmp("retainer-profile-budget=",
+                               &rts_argv[arg][2], 24)) {
+                      OPTION_SAFE;
+                      double secs = atof(rts_argv[arg]+26);
+                      if (secs < 0) {
+                          errorBelch("bad value for --retainer-profile-budget");
+                          error = true;
+                      } else {
+                          RtsFlags.ProfFlags.retainerProfileBudget =
+                              fsecondsToTime(secs);
+                      }
+                      break;
+                  }
+                  else if (!strncmp("heap-census-sample=",
+                               &rts_argv[arg][2], 19)) {
+                      OPTION_SAFE;
+                      int32_t n = strtol(rts_argv[arg]+21, (char **) NULL, 10);
+                      if (n <= 0) {
+                          errorBelch("bad value for --heap-census-sample");
+                          error = true;
+                      } else {
+                          RtsFlags.ProfFlags.censusSampleRate = n;
+                      }
+                      break;
+                  }
                   else if (strequal("no-automatic-time-samples",
                                &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -1269,6 +2009,20 @@ error = true;
                   if (RtsFlags.GcFlags.returnDecayFactor < 0)
                     bad_option( rts_argv[arg] );
                   break;
+                case 'a':
+                  if (strncmp(rts_argv[arg]+2, "auto", 4) != 0) {
+                    bad_option( rts_argv[arg] );
+                  }
+                  RtsFlags.GcFlags.oldGenFactorAuto = true;
+                  if (rts_argv[arg][6] == '=') {
+                    double pc = atof(rts_argv[arg]+7);
+                    if (pc <= 0 || pc >= 100)
+                      bad_option( rts_argv[arg] );
+                    RtsFlags.GcFlags.gcCpuTarget = pc / 100;
+                  } else if (rts_argv[arg][6] != '\0') {
+                    bad_option( rts_argv[arg] );
+                  }
+                  break;
                 default:
                   RtsFlags.GcFlags.oldGenFactor = atof(rts_argv[arg]+2);
 
@@ -1338,7 +2092,7 @@ error = true;
                   OPTION_SAFE;
                   THREADED_BUILD_ONLY(
                     int nCapabilities;
-                    int proc = (int)getNumberOfProcessors();
+                    int proc = (int)getNumberOfUsableProcessors();
 
                     nCapabilities = strtol(rts_argv[arg]+5, (char **) NULL, 10);
                     if (nCapabilities > proc) { nCapabilities = proc; }
@@ -1612,7 +2366,10 @@ error = true;
                 OPTION_SAFE;
                 THREADED_BUILD_ONLY(
                 if (rts_argv[arg][2] == '\0') {
-                    RtsFlags.ParFlags.nCapabilities = getNumberOfProcessors();
+                    RtsFlags.ParFlags.nCapabilities = getNumberOfUsableProcessors();
+                } else if (strequal("Nauto-scale", &rts_argv[arg][1])) {
+                    RtsFlags.ParFlags.nCapabilities = autoScaleMaxCapabilities();
+                    RtsFlags.ParFlags.autoScale = true;
                 } else {
                     int nCapabilities;
                     OPTION_SAFE; /* but see extra checks below... */
@@ -1682,6 +2439,17 @@ error = true;
                         break;
                     case 'n': {
                         int threads;
+                        if (strncmp(rts_argv[arg]+3, "auto", 4) == 0) {
+                            RtsFlags.ParFlags.parGcThreadsAuto = true;
+                            if (rts_argv[arg][7] == '=') {
+                                RtsFlags.ParFlags.parGcThreadsAutoWork =
+                                    decodeSize(rts_argv[arg], 8, sizeof(W_),
+                                               HS_WORD_MAX);
+                            } else if (rts_argv[arg][7] != '\0') {
+                                bad_option( rts_argv[arg] );
+                            }
+                            break;
+                        }
                         threads = strtol(rts_argv[arg]+3, (char **) NULL, 10);
                         if (threads <= 0) {
                             errorBelch("-qn must be 1 or greater");
@@ -1694,9 +2462,15 @@ error = true;
                     case 'a':
                         RtsFlags.ParFlags.setAffinity = true;
                         break;
+                    case 'c':
+                        RtsFlags.ParFlags.parCompact = true;
+                        break;
                     case 'm':
                         RtsFlags.ParFlags.migrate = false;
                         break;
+                    case 's':
+                        RtsFlags.ParFlags.stealThreads = true;
+                        break;
                     case 'w':
                         // -qw was removed; accepted for backwards compat
                         break;
@@ -1831,6 +2605,12 @@ error = true;
                     unchecked_arg_start++;
                     break;
 
+                case 'H':
+                    OPTION_UNSAFE;
+                    RtsFlags.GcFlags.hugePages = true;
+                    unchecked_arg_start++;
+                    break;
+
                 case 'c': /* Debugging tool: show current cost centre on
                            an exception */
                     OPTION_SAFE;
@@ -1963,6 +2743,19 @@ static void normaliseRtsOpts (void)
         RtsFlags.ProfFlags.heapProfileIntervalTicks = 0;
     }
 
+    if (RtsFlags.GcFlags.statsStreamFile != NULL) {
+        // the records need the times that -T keeps
+        if (RtsFlags.GcFlags.giveStats == NO_GC_STATS) {
+            RtsFlags.GcFlags.giveStats = COLLECT_GC_STATS;
+        }
+        if (RtsFlags.GcFlags.statsStreamInterval > 0
+            && RtsFlags.MiscFlags.tickInterval != 0) {
+            RtsFlags.GcFlags.statsStreamTicks =
+                stg_max(1, RtsFlags.GcFlags.statsStreamInterval /
+                           RtsFlags.MiscFlags.tickInterval);
+        }
+    }
+
     if (RtsFlags.TraceFlags.eventlogFlushTime > 0 && RtsFlags.MiscFlags.tickInterval != 0) {
         RtsFlags.TraceFlags.eventlogFlushTicks =
             RtsFlags.TraceFlags.eventlogFlushTime /
@@ -1971,6 +2764,14 @@ static void normaliseRtsOpts (void)
         RtsFlags.TraceFlags.eventlogFlushTicks = 0;
     }
 
+    if (RtsFlags.TraceFlags.stackSampleTime > 0 && RtsFlags.MiscFlags.tickInterval != 0) {
+        RtsFlags.TraceFlags.stackSampleTicks =
+            stg_max(1, RtsFlags.TraceFlags.stackSampleTime /
+                       RtsFlags.MiscFlags.tickInterval);
+    } else {
+        RtsFlags.TraceFlags.stackSampleTicks = 0;
+    }
+
     if (RtsFlags.GcFlags.stkChunkBufferSize >
         RtsFlags.GcFlags.stkChunkSize / 2) {
         errorBelch("stack chunk buffer size (-kb) must be less than 50%%\n"
@@ -2015,6 +2816,15 @@ static void normaliseRtsOpts (void)
         }
     }
 
+#if defined(THREADED_RTS)
+    if (RtsFlags.ParFlags.minSpareWorkers > RtsFlags.ParFlags.maxSpareWorkers) {
+        errorBelch("--min-spare-workers is larger than --max-spare-workers\n"
+                   "Setting --max-spare-workers to %d",
+                   RtsFlags.ParFlags.minSpareWorkers);
+        RtsFlags.ParFlags.maxSpareWorkers = RtsFlags.ParFlags.minSpareWorkers;
+    }
+#endif
+
     // We can't generate dumps without signal handlers
     if (RtsFlags.MiscFlags.generate_dump_file) {
         RtsFlags.MiscFlags.install_seh_handlers = true;
@@ -2110,6 +2920,38 @@ openStatsFile (char *filename,           // filename, or NULL
     return 0;
 }
 
+/* -----------------------------------------------------------------------------
+ * openStatsStream: open the destination of --stats-stream, a file or, given
+ * fd:<n>, an open file descriptor.
+ * -------------------------------------------------------------------------- */
+
+static int
+openStatsStream (const char *dest)
+{
+    FILE *f;
+
+    if (!strncmp(dest, "fd:", 3)) {
+        char *end;
+        long fd = strtol(dest + 3, &end, 10);
+        if (end == dest + 3 || *end != '\0' || fd < 0) {
+            errorBelch("bad file descriptor for --stats-stream: %s", dest);
+            return -1;
+        }
+        f = fdopen((int)fd, "w");
+    } else {
+        f = __rts_fopen(dest, "w");
+    }
+    if (f == NULL) {
+        errorBelch("Can't open stats stream %s", dest);
+        return -1;
+    }
+    if (RtsFlags.GcFlags.statsStreamFile != NULL) {
+        fclose(RtsFlags.GcFlags.statsStreamFile);
+    }
+    RtsFlags.GcFlags.statsStreamFile = f;
+    return 0;
+}
+
 /* -----------------------------------------------------------------------------
  * initStatsFile: write a line to the file containing the program name
  * and the arguments it was invoked with.
@@ -2468,10 +3310,14 @@ static bool read_heap_profiling_flag(const char *arg)
 #endif
 
 #if defined(TRACING)
-static void read_trace_flags(const char *arg)
+/* Set the trace classes from the flags of -l (or -v). Returns false if they
+ * aren't valid. Also used by rts_setTraceFlags.
+ */
+bool read_trace_flags(const char *arg)
 {
     const char *c;
     bool enabled = true;
+    bool ok = true;
     /* Syntax for tracing flags currently looks like:
      *
      *   -l    To turn on eventlog tracing with default trace classes
@@ -2545,19 +3391,19 @@ static void read_trace_flags(const char *arg)
             enabled = true;
             break;
         case 'T':
-#if defined(TICKY_TICKY)
+            // Code compiled with -ticky-sample can post its counters
+            // without the ticky RTS; see Note [Sampled ticky counters] in
+            // GHC.StgToCmm.Ticky
             RtsFlags.TraceFlags.ticky     = enabled;
             enabled = true;
             break;
-#else
-            errorBelch("Program not compiled with ticky-ticky support");
-            break;
-#endif
         default:
             errorBelch("unknown trace option: %c",*c);
+            ok = false;
             break;
         }
     }
+    return ok;
 }
 #endif
 
@@ -24,6 +24,10 @@ void initRtsFlagsDefaults (void);
 void setupRtsFlags        (int *argc, char *argv[], RtsConfig rtsConfig);
 void freeRtsArgs          (void);
 
+#if defined(TRACING)
+bool read_trace_flags     (const char *arg);
+#endif
+
 /* These prototypes may also be defined by ClosureMacros.h. We don't want to
  * define them twice (#24918).
  */
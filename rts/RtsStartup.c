@@ -32,6 +32,7 @@
 #include "StablePtr.h"
 #include "StaticPtrTable.h"
 #include "Hash.h"
+#include "Arena.h"
 #include "Profiling.h"
 #include "IPE.h"
 #include "ProfHeap.h"
@@ -41,6 +42,7 @@
 #include "LinkerInternals.h"
 #include "LibdwPool.h"
 #include "sm/CNF.h"
+#include "sm/LoanedBytes.h"
 #include "TopHandler.h"
 #include "CheckVectorSupport.h"
 
@@ -178,6 +180,57 @@ hs_restoreConsoleCP (void)
    Starting up the RTS
    -------------------------------------------------------------------------- */
 
+/* Note [Startup time]
+   ~~~~~~~~~~~~~~~~~~~
+   A command-line tool run thousands of times in a build pays for hs_init
+   each time, so it should only set up what every program needs. Subsystems
+   that most programs never use are set up on first use instead: the runtime
+   linker (initLinker, called by GHCi and the plugins that load code), HPC
+   (which does nothing unless modules were registered with hs_hpc_module),
+   the tables of locked files (on the first lockFile) and the libdw location
+   cache (on the first lookup). What's left here is mostly mutexes and the
+   allocation of the heap and the capabilities; large per-capability arrays,
+   such as the spark pools, are malloc()ed without being touched, so they cost
+   no page faults until they are used.
+
+   To see where the time goes, +RTS --startup-times prints how long each
+   phase of hs_init_ghc took, from the monotonic clock, to stderr. The phases
+   before the flags are parsed are timed too, so we always record the times:
+   reading the clock a dozen times costs next to nothing.
+*/
+
+#define MAX_STARTUP_PHASES 24
+
+static StgWord64 startup_begin_ns;
+static uint32_t n_startup_phases = 0;
+static struct {
+    const char *name;
+    StgWord64 end_ns;
+} startup_phases[MAX_STARTUP_PHASES];
+
+// Record the end of a phase of hs_init_ghc; see Note [Startup time]
+static void startupPhaseDone(const char *name)
+{
+    if (n_startup_phases < MAX_STARTUP_PHASES) {
+        startup_phases[n_startup_phases].name = name;
+        startup_phases[n_startup_phases].end_ns = getMonotonicNSec();
+        n_startup_phases++;
+    }
+}
+
+static void reportStartupTimes(void)
+{
+    StgWord64 prev = startup_begin_ns;
+    debugBelch("RTS startup times:\n");
+    for (uint32_t i = 0; i < n_startup_phases; i++) {
+        debugBelch("  %-24s %10.1f us\n", startup_phases[i].name,
+                   (double)(startup_phases[i].end_ns - prev) / 1000.0);
+        prev = startup_phases[i].end_ns;
+    }
+    debugBelch("  %-24s %10.1f us\n", "total",
+               (double)(prev - startup_begin_ns) / 1000.0);
+}
+
 static void initBuiltinGcRoots(void)
 {
     /* Add some GC roots for things in the base package that the RTS
@@ -272,6 +325,7 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
 
     /* Initialize system timer before starting to collect stats */
     initializeTimer();
+    startup_begin_ns = getMonotonicNSec();
 
     /* Next we do is grab the start time...just in case we're
      * collecting timing statistics.
@@ -332,6 +386,14 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
 #endif /* DEBUG */
     }
 
+    /* Switch the elapsed clock to the TSC, if asked to, while we are still
+     * the only thread. See Note [The TSC clock]. */
+    if (RtsFlags.MiscFlags.tscClock) {
+        initTscClock();
+    }
+
+    startupPhaseDone("flags");
+
     /* Based on the RTS flags, decide which I/O manager to use. */
     selectIOManager();
 
@@ -361,6 +423,8 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     /* Initialise libdw session pool */
     libdwPoolInit();
 
+    startupPhaseDone("stats and tracing");
+
     /* Start the "ticker" and profiling timer but don't start until the
      * scheduler is up. However, the ticker itself needs to be initialized
      * before the scheduler to ensure that the ticker mutex is initialized as
@@ -372,6 +436,7 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
      * initStorage()).
      */
     initScheduler();
+    startupPhaseDone("scheduler");
 
     /* Trace some basic information about the process */
     traceInitEvent(traceWallClockTime);
@@ -380,6 +445,8 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
 
     /* initialize the storage manager */
     initStorage();
+    startupPhaseDone("storage");
+    initLoanedBytes();
 
     /* initialise the stable pointer table */
     initStablePtrTable();
@@ -387,6 +454,14 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     /* initialise the stable name table */
     initStableNameTable();
 
+    /* initialise the cache of arena blocks */
+    initArenas();
+
+#if defined(THREADED_RTS)
+    /* start the thread running C finalizers, with --finalizer-batch */
+    startFinalizerThread();
+#endif
+
     /* create StablePtrs for builtin GC roots*/
     initBuiltinGcRoots();
 
@@ -395,6 +470,7 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
      * image
      * */
     processForeignExports();
+    startupPhaseDone("stable tables");
 
     /* initialize the top-level handler system */
     initTopHandler();
@@ -411,9 +487,11 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
     initIpe();
     traceInitEvent(dumpIPEToEventLog);
     initHeapProfiling();
+    startupPhaseDone("profiling and IPE");
 
     /* start the virtual timer 'subsystem'. */
     startTimer();
+    startupPhaseDone("timer");
 
 #if defined(RTS_USER_SIGNALS)
     if (RtsFlags.MiscFlags.install_signal_handlers) {
@@ -425,13 +503,22 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
 #endif
 
     initIOManager();
+    startupPhaseDone("signals and I/O manager");
 
     x86_init_fpu();
 
     startupHpc();
 
+    /* Start indexing IPEs if asked to */
+    startIpeIndexing();
+    startupPhaseDone("HPC and IPE indexing");
+
     /* Record initialization times */
     stat_endInit();
+
+    if (RtsFlags.MiscFlags.startupTimes) {
+        reportStartupTimes();
+    }
 }
 
 // Compatibility interface
@@ -494,6 +581,11 @@ hs_exit_(bool wait_foreign)
      * collection if it's running */
     exitScheduler(wait_foreign);
 
+#if defined(THREADED_RTS)
+    /* run the C finalizers of dead weak pointers still queued */
+    stopFinalizerThread();
+#endif
+
     /* run C finalizers for all active weak pointers */
     for (i = 0; i < getNumCapabilities(); i++) {
         runAllCFinalizers(getCapability(i)->weak_ptr_list_hd);
@@ -523,7 +615,7 @@ hs_exit_(bool wait_foreign)
      * We do this at the end of execution since tickers are registered in the
      * course of program execution.
      */
-#if defined(TICKY_TICKY) && defined(TRACING)
+#if defined(TRACING)
     if (RtsFlags.TraceFlags.ticky) {
         emitTickyCounterDefs();
     }
@@ -551,6 +643,9 @@ hs_exit_(bool wait_foreign)
     // also outputs the stats (+RTS -s) info.
     exitStorage();
 
+    // hand back whatever memory C code still has on loan
+    exitLoanedBytes();
+
     /* flush and clean up capabilities' eventlog buffers before cleaning up
      * scheduler */
     finishCapEventLogging();
@@ -624,6 +719,9 @@ hs_exit_(bool wait_foreign)
     /* tear down statistics subsystem */
     stat_exit();
 
+    /* free the cache of arena blocks */
+    exitArenas();
+
     // Finally, free all our storage.  However, we only free the heap
     // memory if we have waited for foreign calls to complete;
     // otherwise a foreign call in progress may still be referencing
@@ -23,6 +23,10 @@
 #include "posix/Signals.h"
 #endif
 
+#if !defined(mingw32_HOST_OS)
+#include "IOManager.h"
+#endif
+
 #if defined(mingw32_HOST_OS)
 #include <sys/stat.h>
 #include <io.h>
@@ -62,6 +66,7 @@ extern char **environ;
       SymE_HasProto(backtraceFree)              \
       SymE_HasProto(libdwGetBacktrace)          \
       SymE_HasProto(libdwLookupLocation)        \
+      SymE_HasProto(libdwLookupLocations)       \
       SymE_HasProto(libdwPoolTake)              \
       SymE_HasProto(libdwPoolRelease)           \
       SymE_HasProto(libdwPoolClear)
@@ -74,6 +79,7 @@ extern char **environ;
       SymI_HasProto(signal_handlers)            \
       SymI_HasProto(stg_sig_install)            \
       SymI_HasProto(rtsTimerSignal)             \
+      SymI_HasProto(rts_IOManagerEdgeTriggered) \
       SymI_NeedsDataProto(nocldstop)
 #endif
 
@@ -81,6 +87,15 @@ extern char **environ;
 #define RTS_POSIX_ONLY_SYMBOLS
 #endif
 
+#if defined(linux_HOST_OS)
+#define RTS_LINUX_ONLY_SYMBOLS                  \
+      SymI_HasProto(stg_uringReadzh)            \
+      SymI_HasProto(stg_uringWritezh)           \
+      SymI_HasProto(stg_uringAcceptzh)
+#else
+#define RTS_LINUX_ONLY_SYMBOLS
+#endif
+
 #if defined(mingw32_HOST_OS)
 #define RTS_POSIX_ONLY_SYMBOLS  /**/
 
@@ -516,6 +531,8 @@ extern char **environ;
       SymI_HasDataProto(stg_atomicallyzh)                                   \
       SymI_HasProto(barf)                                               \
       SymI_HasProto(flushEventLog)                                      \
+      SymI_HasProto(setEventLogSampleRate)                              \
+      SymI_HasProto(rts_setTraceFlags)                                  \
       SymI_HasProto(deRefStablePtr)                                     \
       SymI_HasProto(debugBelch)                                         \
       SymI_HasProto(errorBelch)                                         \
@@ -531,11 +548,15 @@ extern char **environ;
       SymI_HasDataProto(stg_compactAddzh)                                   \
       SymI_HasDataProto(stg_compactNewzh)                                   \
       SymI_HasDataProto(stg_compactResizzezh)                               \
+      SymI_HasDataProto(stg_compactMergezh)                                 \
+      SymI_HasDataProto(stg_compactEnableDedupzh)                           \
+      SymI_HasDataProto(stg_compactMakeImmortalzh)                          \
       SymI_HasDataProto(stg_compactContainszh)                              \
       SymI_HasDataProto(stg_compactContainsAnyzh)                           \
       SymI_HasDataProto(stg_compactGetFirstBlockzh)                         \
       SymI_HasDataProto(stg_compactGetNextBlockzh)                          \
       SymI_HasDataProto(stg_compactAllocateBlockzh)                         \
+      SymI_HasDataProto(stg_compactMapBlockzh)                              \
       SymI_HasDataProto(stg_compactFixupPointerszh)                         \
       SymI_HasDataProto(stg_compactSizzezh)                                 \
       SymI_HasProto(closure_flags)                                      \
@@ -566,6 +587,10 @@ extern char **environ;
       SymI_HasProto(getOrSetLibHSghcFastStringTable)                    \
       SymI_HasProto(getRTSStats)                                        \
       SymI_HasProto(getRTSStatsEnabled)                                 \
+      SymI_HasProto(getRTSCapStats)                                     \
+      SymI_HasProto(getRTSGenStats)                                     \
+      SymI_HasProto(getRTSMemoryUsage)                                  \
+      SymI_HasProto(getRTSHistogramPercentile)                          \
       SymI_HasProto(getOrSetLibHSghcGlobalHasPprDebug)                  \
       SymI_HasProto(getOrSetLibHSghcGlobalHasNoDebugOutput)             \
       SymI_HasProto(getOrSetLibHSghcGlobalHasNoStateHack)               \
@@ -595,8 +620,10 @@ extern char **environ;
       SymI_HasProto(hs_free_fun_ptr)                                    \
       SymI_HasProto(hs_hpc_rootModule)                                  \
       SymI_HasProto(hs_hpc_module)                                      \
+      SymI_HasProto(hs_hpc_dump)                                        \
       SymI_HasProto(hs_thread_done)                                     \
       SymI_HasProto(hs_try_putmvar)                                     \
+      SymI_HasProto(hs_try_putmvar_batch)                               \
       SymI_HasProto(defaultRtsConfig)                                   \
       SymI_HasProto(initLinker)                                         \
       SymI_HasProto(initLinker_)                                        \
@@ -687,12 +714,17 @@ extern char **environ;
       SymI_HasProto(resumeThread)                                       \
       SymI_HasProto(setNumCapabilities)                                 \
       SymI_HasProto(getNumberOfProcessors)                              \
+      SymI_HasProto(getNumberOfUsableProcessors)                        \
+      SymI_HasProto(getCPUQuota)                                        \
       SymI_HasProto(resolveObjs)                                        \
       SymI_HasDataProto(stg_retryzh)                                        \
       SymI_HasProto(rts_apply)                                          \
       SymI_HasProto(rts_checkSchedStatus)                               \
       SymI_HasProto(rts_eval)                                           \
       SymI_HasProto(rts_evalIO)                                         \
+      SymI_HasProto(rts_evalIOArgs)                                     \
+      SymI_HasProto(rts_loanByteArray)                                  \
+      SymI_HasProto(rts_loanHeaderSize)                                 \
       SymI_HasProto(rts_evalLazyIO)                                     \
       SymI_HasProto(rts_evalStableIOMain)                               \
       SymI_HasProto(rts_evalStableIO)                                   \
@@ -744,7 +776,11 @@ extern char **environ;
       SymI_HasProto(rts_isDebugged)                                     \
       SymI_HasProto(rts_isTracing)                                      \
       SymI_HasProto(rts_setInCallCapability)                            \
+      SymI_HasProto(rts_setCapabilityAffinity)                          \
+      SymI_HasProto(rts_setCapabilityIsolated)                          \
       SymI_HasProto(rts_enableThreadAllocationLimit)                    \
+      SymI_HasProto(rts_getThreadPriority)                              \
+      SymI_HasProto(rts_setThreadTimeSlice)                             \
       SymI_HasProto(rts_disableThreadAllocationLimit)                   \
       SymI_HasProto(rts_setMainThread)                                  \
       SymI_HasProto(setProgArgv)                                        \
@@ -767,6 +803,7 @@ extern char **environ;
       SymI_HasDataProto(stg_TVAR_DIRTY_info)                                \
       SymI_HasDataProto(stg_IND_STATIC_info)                                \
       SymI_HasDataProto(stg_ARR_WORDS_info)                                 \
+      SymI_HasDataProto(stg_LOANED_ARR_WORDS_info)                          \
       SymI_HasDataProto(stg_MUT_ARR_PTRS_DIRTY_info)                        \
       SymI_HasDataProto(stg_MUT_ARR_PTRS_FROZEN_CLEAN_info)                 \
       SymI_HasDataProto(stg_MUT_ARR_PTRS_FROZEN_DIRTY_info)                 \
@@ -872,11 +909,14 @@ extern char **environ;
       SymI_HasDataProto(stg_upd_frame_info)                                 \
       SymI_HasDataProto(stg_bh_upd_frame_info)                              \
       SymI_HasDataProto(stg_orig_thunk_info_frame_info)                     \
+      SymI_NeedsDataProto(eager_blackhole_sites)                            \
       SymI_HasProto(suspendThread)                                          \
       SymI_HasDataProto(stg_takeMVarzh)                                     \
       SymI_HasDataProto(stg_readMVarzh)                                     \
       SymI_HasDataProto(stg_threadStatuszh)                                 \
       SymI_HasDataProto(stg_tryPutMVarzh)                                   \
+      SymI_HasDataProto(stg_bargingTakeMVarzh)                              \
+      SymI_HasDataProto(stg_bargingPutMVarzh)                               \
       SymI_HasDataProto(stg_tryTakeMVarzh)                                  \
       SymI_HasDataProto(stg_tryReadMVarzh)                                  \
       SymI_HasDataProto(stg_unmaskAsyncExceptionszh)                        \
@@ -916,6 +956,8 @@ extern char **environ;
       SymI_HasDataProto(stg_traceBinaryEventzh)                             \
       SymI_HasDataProto(stg_getThreadAllocationCounterzh)                   \
       SymI_HasDataProto(stg_setThreadAllocationCounterzh)                   \
+      SymI_HasDataProto(stg_setThreadPriorityzh)                            \
+      SymI_HasDataProto(stg_setTVarWakeLimitzh)                             \
       SymI_HasProto(getMonotonicNSec)                                   \
       SymI_HasProto(lockFile)                                           \
       SymI_HasProto(unlockFile)                                         \
@@ -944,6 +986,8 @@ extern char **environ;
       SymI_HasProto(sendCloneStackMessage)                              \
       SymI_HasProto(cloneStack)                                         \
       SymI_HasProto(decodeClonedStack)                                  \
+      SymI_HasProto(snapshotStackFrames)                                \
+      SymI_HasProto(sendSnapshotStackMessage)                           \
       SymI_HasProto(stg_newPromptTagzh)                                 \
       SymI_HasProto(stg_promptzh)                                       \
       SymI_HasProto(stg_control0zh)                                     \
@@ -1041,6 +1085,7 @@ extern char **environ;
 RTS_SYMBOLS
 RTS_RET_SYMBOLS
 RTS_POSIX_ONLY_SYMBOLS
+RTS_LINUX_ONLY_SYMBOLS
 RTS_MINGW_ONLY_SYMBOLS
 RTS_DARWIN_ONLY_SYMBOLS
 RTS_OPENBSD_ONLY_SYMBOLS
@@ -1085,6 +1130,7 @@ RtsSymbolVal rtsSyms[] = {
       RTS_SYMBOLS
       RTS_RET_SYMBOLS
       RTS_POSIX_ONLY_SYMBOLS
+      RTS_LINUX_ONLY_SYMBOLS
       RTS_MINGW_ONLY_SYMBOLS
       RTS_DARWIN_ONLY_SYMBOLS
       RTS_OPENBSD_ONLY_SYMBOLS
@@ -65,4 +65,16 @@ void checkFPUStack(void);
 // Drop the given extension from a filepath.
 void dropExtension(char *path, const char *extension);
 
+// A cheap xorshift pseudo-random number generator, for spreading out work
+// or delays; the state must start non-zero.
+INLINE_HEADER uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
 #include "EndPrivate.h"
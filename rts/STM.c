@@ -258,6 +258,120 @@ static StgBool cond_lock_tvar(Capability *cap,
 }
 #endif
 
+/*......................................................................
+
+Note [STM clock]
+~~~~~~~~~~~~~~~~
+Following TL2 ("Transactional Locking II", Dice, Shalev and Shavit, 2006) we
+keep a global version clock, stm_clock, which every top-level commit that
+updates TVars increments once it has locked them, and before it checks its
+read set. Each TRec records the clock when it starts (read_version), and
+committing stores the new clock in num_updates of the TVars it writes.
+
+If the clock is still at read_version when a transaction commits, no
+commit has written to a TVar since the transaction started. (One that
+locked a TVar before we started holds the lock until it has written the
+TVar, and we wait for the lock when we read it.) So every TVar we read
+still holds the value we saw, and:
+
+  * a read-only transaction commits without looking at its entries at
+    all, and
+
+  * a transaction with updates, having locked the TVars it updates, can
+    skip checking the ones it only read if incrementing the clock took it
+    from read_version to read_version + 1.
+
+Otherwise we validate entry by entry as before; see Note [STM Validation].
+(We assume that the clock, a word, doesn't wrap around all the way to
+read_version while a transaction runs.)
+Long-running transactions are also validated in flight, every time their
+thread returns to the scheduler. validate_trec_optimistic remembers the
+clock at the last validation that succeeded (validated_version) and
+doesn't look at the entries again until the clock has moved.
+
+A TRec only knows cheaply whether it has no update entries if we say so
+when entries are created: has_updates is set by any write into the TRec,
+even one that writes back the value the TVar held.
+*/
+
+static volatile StgWord stm_clock = 0;
+
+/*......................................................................
+
+Note [STM contention]
+~~~~~~~~~~~~~~~~~~~~~
+When many transactions update the same TVar most of them fail to commit and
+run again, and with several capabilities they can go on failing each other.
+Two things help to find and avoid this.
+
+While the eventlog records scheduler events (-ls), note_conflict records the
+TVar that each failed validation tripped over, in a small table per
+capability, cap->stm_conflicts, indexed by a hash of the TVar's address.
+When a slot is taken by another TVar its count is decremented instead, and
+the new TVar only takes the slot once the count reaches zero, so the slots
+keep the TVars that fail transactions most often. At the start of each GC,
+while the addresses still mean something, stmPreGCHook posts an
+STM_HOT_TVAR event for each TVar that failed at least
+STM_HOT_TVAR_MIN_ABORTS transactions on the capability, and clears the
+table.
+
+When a commit fails, the thread runs the transaction again straight away.
+After the second failure in a row on a capability, stm_backoff first spins
+for a random number of iterations below a limit that doubles with each
+further failure, up to 2^STM_BACKOFF_MAX_SHIFT, so that transactions
+competing for a TVar stop failing each other in lock-step. A commit that
+succeeds resets the count.
+*/
+
+#define STM_HOT_TVAR_MIN_ABORTS 4
+#define STM_BACKOFF_MAX_SHIFT 8
+
+static void note_conflict(Capability *cap, StgTVar *s) {
+  if (RTS_LIKELY(!TRACE_sched)) {
+    return;
+  }
+  StmConflict *c =
+    &cap->stm_conflicts[((StgWord) s >> 4) % STM_CONFLICT_SLOTS];
+  if (c->tvar == s) {
+    c->aborts++;
+  } else if (c->aborts == 0) {
+    c->tvar = s;
+    c->aborts = 1;
+  } else {
+    c->aborts--;
+  }
+}
+
+static void reportHotTVars(Capability *cap) {
+  for (uint32_t i = 0; i < STM_CONFLICT_SLOTS; i++) {
+    StmConflict *c = &cap->stm_conflicts[i];
+    if (c->aborts >= STM_HOT_TVAR_MIN_ABORTS) {
+      traceEventStmHotTVar(cap, (StgWord) c->tvar, c->aborts);
+    }
+    c->tvar = NULL;
+    c->aborts = 0;
+  }
+}
+
+#if defined(THREADED_RTS)
+static void stm_backoff(Capability *cap) {
+  uint32_t n = ++cap->stm_aborts_in_a_row;
+  if (n < 2) {
+    return;
+  }
+  uint32_t limit = 1 << stg_min(n - 1, STM_BACKOFF_MAX_SHIFT);
+  uint32_t spins = xorshift32(&cap->stm_backoff_seed) % limit;
+  TRACE("cap %d : %d failed commits, backing off for %d", cap->no, n, spins);
+  for (uint32_t i = 0; i < spins; i++) {
+    busy_wait_nop();
+  }
+}
+#else
+static void stm_backoff(Capability *cap STG_UNUSED) {
+  // Nobody to back off from
+}
+#endif
+
 /*......................................................................*/
 
 // Helper functions for thread blocking and unblocking
@@ -294,9 +408,34 @@ static void unpark_tso(Capability *cap, StgTSO *tso) {
     tryWakeupThread(cap,tso);
 }
 
+/*......................................................................
+
+Note [TVar wake limits]
+~~~~~~~~~~~~~~~~~~~~~~~
+A commit that writes a TVar wakes every transaction blocked on it, so that
+each can run again and see whether it can now make progress. When many
+workers `retry` on the TVar of a work queue that is a waste: a new job
+wakes all of them, one takes it and the others go back to sleep, having
+rerun their transactions for nothing.
+
+setTVarWakeLimit# sets the wake_limit of a TVar. If it isn't 0 a commit
+wakes at most that many of the waiters, those that have waited longest
+(the end of the watch queue) first. A waiter that has been woken but hasn't
+run yet is still on the watch queue and isn't counted, unless it belongs
+to another capability, which we can only ask to wake it up, in which case
+a later commit may choose it again before it runs.
+
+This only works if every woken transaction that finds something to do
+also writes the TVar, which then wakes the next waiter: if a job queue
+were written once with two jobs, the second would otherwise sit there
+until the next push. That is true of the usual queues of jobs.
+*/
+
 static void unpark_waiters_on(Capability *cap, StgTVar *s) {
   StgTVarWatchQueue *q;
   StgTVarWatchQueue *trail;
+  StgWord limit = RELAXED_LOAD(&s->wake_limit);
+  StgWord woken = 0;
   TRACE("unpark_waiters_on tvar=%p", s);
   // unblock TSOs in reverse order, to be a bit fairer (#2319)
   for (q = ACQUIRE_LOAD(&s->first_watch_queue_entry), trail = q;
@@ -308,7 +447,18 @@ static void unpark_waiters_on(Capability *cap, StgTVar *s) {
   for (;
        q != END_STM_WATCH_QUEUE;
        q = q -> prev_queue_entry) {
-      unpark_tso(cap, (StgTSO *)(q -> closure));
+      StgTSO *tso = (StgTSO *)(q -> closure);
+      if (limit != 0) {
+        // See Note [TVar wake limits]
+        if (ACQUIRE_LOAD(&tso -> why_blocked) != BlockedOnSTM) {
+          continue;
+        }
+        if (woken == limit) {
+          break;
+        }
+        woken++;
+      }
+      unpark_tso(cap, tso);
   }
 }
 
@@ -421,6 +571,15 @@ static StgTRecHeader *alloc_stg_trec_header(Capability *cap,
       result -> state = enclosing_trec -> state;
     }
   }
+
+  // See Note [STM clock]
+  result -> read_version = ACQUIRE_LOAD(&stm_clock);
+  result -> validated_version = result -> read_version;
+  result -> has_updates = false;
+
+  // See Note [TRec index]
+  result -> index_serial = 0;
+  result -> index_cap = 0;
   return result;
 }
 
@@ -439,6 +598,177 @@ static void free_stg_trec_header(Capability *cap,
 #endif
 }
 
+/*......................................................................
+
+Note [TRec index]
+~~~~~~~~~~~~~~~~~
+Every readTVar and writeTVar looks for an existing entry for the TVar in
+the TRec, and in those of the enclosing transactions, so with only a linear
+search through the chunks a transaction touching n TVars takes O(n^2).
+
+So once a TRec outgrows its first chunk, its entries are indexed by TVar in
+a hash table of the capability, cap->stm_index, an open-addressing table of
+(TRec, serial, TVar, entry) slots. Small TRecs are still searched
+linearly.
+
+ * The index holds the addresses of heap objects, which a GC moves, so
+   stmPreGCHook empties it, and any TRec indexed before then counts as not
+   indexed. The TRec is indexed again on its next lookup.
+
+ * Each indexing of a TRec gets a new serial (index_serial in the TRec) and
+   records the capability (index_cap). Slots only match a TRec with the same
+   serial, so slots left by a TRec that has been freed and reused, or
+   indexed again, are never found; they are dropped when the table grows.
+
+ * New entries are added to the index as get_new_entry creates them; a TRec
+   that gets an entry on another capability, because its thread migrated,
+   is no longer indexed (index_serial = 0), so the index of a capability
+   never misses an entry of a TRec it claims to index.
+
+The TRec, TVar and entry pointers stay valid until the next GC, which is as long
+as the index keeps them.
+*/
+
+#define STM_INDEX_MIN_SIZE 256
+
+typedef struct {
+  StgTRecHeader *trec;
+  StgWord serial;
+  StgTVar *tvar;
+  TRecEntry *entry;
+} StmIndexSlot;
+
+typedef struct StmIndex_ {
+  StgWord size;           // a power of 2
+  StgWord used;           // slots, including those no longer matched
+  StgWord min_serial;     // older serials were indexed before the last GC
+  StmIndexSlot *slots;
+} StmIndex;
+
+static volatile StgWord stm_index_serials = 0;
+
+static StgWord index_hash(StgTRecHeader *trec, StgTVar *tvar) {
+  StgWord h = ((StgWord) tvar >> 3) ^ ((StgWord) trec << 5);
+  h *= 0x9e3779b1;
+  return h ^ (h >> 15);
+}
+
+static StmIndex *new_index(StgWord size) {
+  StmIndex *ix = stgMallocBytes(sizeof(StmIndex), "new_index");
+  ix->size = size;
+  ix->used = 0;
+  ix->min_serial = RELAXED_LOAD(&stm_index_serials) + 1;
+  ix->slots = stgCallocBytes(size, sizeof(StmIndexSlot), "new_index");
+  return ix;
+}
+
+void stmFreeIndex(Capability *cap) {
+  if (cap->stm_index != NULL) {
+    stgFree(cap->stm_index->slots);
+    stgFree(cap->stm_index);
+    cap->stm_index = NULL;
+  }
+}
+
+static bool trec_is_indexed(Capability *cap, StgTRecHeader *trec) {
+  StmIndex *ix = cap->stm_index;
+  return ix != NULL
+    && trec->index_serial >= ix->min_serial
+    && trec->index_cap == cap->no;
+}
+
+static void index_put(StmIndex *ix, StgTRecHeader *trec, StgWord serial,
+                      StgTVar *tvar, TRecEntry *entry) {
+  StgWord i = index_hash(trec, tvar) & (ix->size - 1);
+  while (ix->slots[i].trec != NULL) {
+    i = (i + 1) & (ix->size - 1);
+  }
+  ix->slots[i].trec = trec;
+  ix->slots[i].serial = serial;
+  ix->slots[i].tvar = tvar;
+  ix->slots[i].entry = entry;
+  ix->used++;
+}
+
+// Double the table, dropping the slots that no longer match their TRec
+static void grow_index(Capability *cap) {
+  StmIndex *old = cap->stm_index;
+  StmIndex *ix = new_index(old->size * 2);
+  ix->min_serial = old->min_serial;
+  for (StgWord i = 0; i < old->size; i++) {
+    StmIndexSlot *slot = &old->slots[i];
+    if (slot->trec != NULL && slot->trec->index_serial == slot->serial
+        && trec_is_indexed(cap, slot->trec)) {
+      index_put(ix, slot->trec, slot->serial, slot->tvar, slot->entry);
+    }
+  }
+  stgFree(old->slots);
+  stgFree(old);
+  cap->stm_index = ix;
+}
+
+static void index_entry(Capability *cap, StgTRecHeader *trec, TRecEntry *e) {
+  if ((cap->stm_index->used + 1) * 2 > cap->stm_index->size) {
+    grow_index(cap);
+  }
+  index_put(cap->stm_index, trec, trec->index_serial, e->tvar, e);
+}
+
+static void index_trec(Capability *cap, StgTRecHeader *trec) {
+  if (cap->stm_index == NULL) {
+    cap->stm_index = new_index(STM_INDEX_MIN_SIZE);
+  }
+  trec->index_serial = atomic_inc(&stm_index_serials, 1);
+  trec->index_cap = cap->no;
+  TRACE("%p : indexing, serial %" FMT_Word, trec, trec->index_serial);
+  FOR_EACH_ENTRY(trec, e, {
+    index_entry(cap, trec, e);
+  });
+}
+
+static TRecEntry *index_lookup(StmIndex *ix, StgTRecHeader *trec,
+                               StgTVar *tvar) {
+  StgWord i = index_hash(trec, tvar) & (ix->size - 1);
+  while (ix->slots[i].trec != NULL) {
+    StmIndexSlot *slot = &ix->slots[i];
+    if (slot->trec == trec && slot->tvar == tvar
+        && slot->serial == trec->index_serial) {
+      return slot->entry;
+    }
+    i = (i + 1) & (ix->size - 1);
+  }
+  return NULL;
+}
+
+static void clear_index(Capability *cap) {
+  StmIndex *ix = cap->stm_index;
+  if (ix != NULL) {
+    memset(ix->slots, 0, ix->size * sizeof(StmIndexSlot));
+    ix->used = 0;
+    ix->min_serial = RELAXED_LOAD(&stm_index_serials) + 1;
+  }
+}
+
+// The entry for tvar in trec (but not the enclosing TRecs), if any
+static TRecEntry *find_entry_in(Capability *cap, StgTRecHeader *trec,
+                                StgTVar *tvar) {
+  if (trec -> current_chunk -> prev_chunk != END_STM_CHUNK_LIST) {
+    if (!trec_is_indexed(cap, trec)) {
+      index_trec(cap, trec);
+    }
+    return index_lookup(cap->stm_index, trec, tvar);
+  }
+
+  TRecEntry *result = NULL;
+  FOR_EACH_ENTRY(trec, e, {
+    if (e -> tvar == tvar) {
+      result = e;
+      BREAK_FOR_EACH;
+    }
+  });
+  return result;
+}
+
 /*......................................................................*/
 
 // Helper functions for managing waiting lists
@@ -516,7 +846,8 @@ static void remove_watch_queue_entries_for_trec(Capability *cap,
 /*......................................................................*/
 
 static TRecEntry *get_new_entry(Capability *cap,
-                                StgTRecHeader *t) {
+                                StgTRecHeader *t,
+                                StgTVar *tvar) {
   TRecEntry *result;
   StgTRecChunk *c;
   int i;
@@ -538,6 +869,16 @@ static TRecEntry *get_new_entry(Capability *cap,
     t -> current_chunk = nc;
     result = &(nc -> entries[0]);
   }
+  result -> tvar = tvar;
+
+  // See Note [TRec index]
+  if (t -> index_serial != 0) {
+    if (trec_is_indexed(cap, t)) {
+      index_entry(cap, t, result);
+    } else {
+      t -> index_serial = 0;
+    }
+  }
 
   return result;
 }
@@ -551,28 +892,20 @@ static void merge_update_into(Capability *cap,
                               StgClosure *new_value)
 {
   // Look for an entry in this trec
-  bool found = false;
-  FOR_EACH_ENTRY(t, e, {
-    StgTVar *s;
-    s = e -> tvar;
-    if (s == tvar) {
-      found = true;
-      if (e -> expected_value != expected_value) {
-        // Must abort if the two entries start from different values
-        TRACE("%p : update entries inconsistent at %p (%p vs %p)",
-              t, tvar, e -> expected_value, expected_value);
-        t -> state = TREC_CONDEMNED;
-      }
-      e -> new_value = new_value;
-      BREAK_FOR_EACH;
+  t -> has_updates = true;
+  TRecEntry *e = find_entry_in(cap, t, tvar);
+  if (e != NULL) {
+    if (e -> expected_value != expected_value) {
+      // Must abort if the two entries start from different values
+      TRACE("%p : update entries inconsistent at %p (%p vs %p)",
+            t, tvar, e -> expected_value, expected_value);
+      t -> state = TREC_CONDEMNED;
     }
-  });
-
-  if (!found) {
+    e -> new_value = new_value;
+  } else {
     // No entry so far in this trec
     TRecEntry *ne;
-    ne = get_new_entry(cap, t);
-    ne -> tvar = tvar;
+    ne = get_new_entry(cap, t, tvar);
     ne -> expected_value = expected_value;
     ne -> new_value = new_value;
   }
@@ -611,25 +944,22 @@ static void merge_read_into(Capability *cap,
   //
   for (t = trec; !found && t != NO_TREC; t = t -> enclosing_trec)
   {
-    FOR_EACH_ENTRY(t, e, {
-      if (e -> tvar == tvar) {
-        found = true;
-        if (e -> expected_value != expected_value) {
-            // Must abort if the two entries start from different values
-            TRACE("%p : read entries inconsistent at %p (%p vs %p)",
-                  t, tvar, e -> expected_value, expected_value);
-            t -> state = TREC_CONDEMNED;
-        }
-        BREAK_FOR_EACH;
+    TRecEntry *e = find_entry_in(cap, t, tvar);
+    if (e != NULL) {
+      found = true;
+      if (e -> expected_value != expected_value) {
+          // Must abort if the two entries start from different values
+          TRACE("%p : read entries inconsistent at %p (%p vs %p)",
+                t, tvar, e -> expected_value, expected_value);
+          t -> state = TREC_CONDEMNED;
       }
-    });
+    }
   }
 
   if (!found) {
     // No entry found
     TRecEntry *ne;
-    ne = get_new_entry(cap, trec);
-    ne -> tvar = tvar;
+    ne = get_new_entry(cap, trec, tvar);
     ne -> expected_value = expected_value;
     ne -> new_value = expected_value;
   }
@@ -700,6 +1030,15 @@ StgBool validate_trec_optimistic (Capability *cap, StgTRecHeader *trec) {
          (trec -> state == TREC_WAITING) ||
          (trec -> state == TREC_CONDEMNED));
   result = !((trec -> state) == TREC_CONDEMNED);
+
+  // Nothing has been committed since the last time we looked; see
+  // Note [STM clock]
+  const StgWord now = ACQUIRE_LOAD(&stm_clock);
+  if (result && now == trec -> validated_version) {
+    TRACE("%p : validate_trec_optimistic, clock unchanged", trec);
+    return true;
+  }
+
   if (result) {
     FOR_EACH_ENTRY(trec, e, {
       StgTVar *s;
@@ -709,18 +1048,62 @@ StgBool validate_trec_optimistic (Capability *cap, StgTRecHeader *trec) {
           //If the trec is locked we optimistically assume our trec will still be valid after it's unlocked.
          (GET_INFO(UNTAG_CLOSURE(current)) != &stg_TREC_HEADER_info))
       {   TRACE("%p : failed optimistic validate %p", trec, s);
+          note_conflict(cap, s);
           result = false;
           BREAK_FOR_EACH;
       }
     });
   }
 
+  if (result) {
+    trec -> validated_version = now;
+  }
 
   TRACE("%p : validate_trec_optimistic, result: %d", trec, result);
   return result;
 }
 
 
+// snapshot_read_only : check that the TVars that trec read but didn't
+// update hold the expected values, recording the num_updates of each for
+// check_read_only.
+
+static StgBool snapshot_read_only(Capability *cap STG_UNUSED,
+                                  StgTRecHeader *trec STG_UNUSED) {
+  StgBool result = true;
+
+  ASSERT(config_use_read_phase);
+  IF_STM_FG_LOCKS({
+    FOR_EACH_ENTRY(trec, e, {
+      StgTVar *s;
+      s = e -> tvar;
+      if (entry_is_read_only(e)) {
+        TRACE("%p : will need to check %p", trec, s);
+        // The memory ordering here must ensure that we have two distinct
+        // reads to current_value, with the read from num_updates between
+        // them.
+        if (ACQUIRE_LOAD(&s->current_value) != e -> expected_value) {
+          TRACE("%p : doesn't match", trec);
+          note_conflict(cap, s);
+          result = false;
+          BREAK_FOR_EACH;
+        }
+        e->num_updates = SEQ_CST_LOAD(&s->num_updates);
+        if (ACQUIRE_LOAD(&s->current_value) != e -> expected_value) {
+          TRACE("%p : doesn't match (race)", trec);
+          note_conflict(cap, s);
+          result = false;
+          BREAK_FOR_EACH;
+        } else {
+          TRACE("%p : need to check version %ld", trec, e -> num_updates);
+        }
+      }
+    });
+  });
+
+  return result;
+}
+
 // validate_and_acquire_ownership : this performs the twin functions
 // of checking that the TVars referred to by entries in trec hold the
 // expected values and:
@@ -733,11 +1116,18 @@ StgBool validate_trec_optimistic (Capability *cap, StgTRecHeader *trec) {
 //     stashed in the TRec entries and are then checked in check_read_only
 //     to ensure that an atomic snapshot of all of these locations has been
 //     seen.
+//
+// At a top-level commit (commit_version != NULL) the STM clock is
+// incremented in between, once all the updated TVars are locked, and the
+// new clock is returned in *commit_version.  If no other transaction has
+// committed since trec started, the non-updated TVars needn't be looked
+// at; see Note [STM clock].
 
 static StgBool validate_and_acquire_ownership (Capability *cap,
                                                StgTRecHeader *trec,
                                                int acquire_all,
-                                               int retain_ownership) {
+                                               int retain_ownership,
+                                               StgWord *commit_version) {
   StgBool result;
   TRACE("cap %d, trec %p : validate_and_acquire_ownership, all: %d, retrain: %d",
          cap->no, trec, acquire_all, retain_ownership);
@@ -759,34 +1149,27 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
         TRACE("%p : trying to acquire %p", trec, s);
         if (!cond_lock_tvar(cap, trec, s, e -> expected_value)) {
           TRACE("%p : failed to acquire %p", trec, s);
+          note_conflict(cap, s);
           result = false;
           BREAK_FOR_EACH;
         }
-      } else {
-        ASSERT(config_use_read_phase);
-        IF_STM_FG_LOCKS({
-          TRACE("%p : will need to check %p", trec, s);
-          // The memory ordering here must ensure that we have two distinct
-          // reads to current_value, with the read from num_updates between
-          // them.
-          if (ACQUIRE_LOAD(&s->current_value) != e -> expected_value) {
-            TRACE("%p : doesn't match", trec);
-            result = false;
-            BREAK_FOR_EACH;
-          }
-          e->num_updates = SEQ_CST_LOAD(&s->num_updates);
-          if (ACQUIRE_LOAD(&s->current_value) != e -> expected_value) {
-            TRACE("%p : doesn't match (race)", trec);
-            result = false;
-            BREAK_FOR_EACH;
-          } else {
-            TRACE("%p : need to check version %ld", trec, e -> num_updates);
-          }
-        });
       }
     });
   }
 
+  bool check_reads = !acquire_all;
+  if (result && commit_version != NULL) {
+    *commit_version = atomic_inc(&stm_clock, 1);
+    if (*commit_version == trec -> read_version + 1) {
+      TRACE("%p : no commits since the start, not checking reads", trec);
+      check_reads = false;
+    }
+  }
+
+  if (result && check_reads) {
+    result = snapshot_read_only(cap, trec);
+  }
+
   if ((!result) || (!retain_ownership)) {
       revert_ownership(cap, trec, acquire_all);
   }
@@ -806,7 +1189,8 @@ static StgBool validate_and_acquire_ownership (Capability *cap,
 // Keir Fraser's PhD dissertation "Practical lock-free programming" discuss
 // this kind of algorithm.
 
-static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
+static StgBool check_read_only(Capability *cap STG_UNUSED,
+                               StgTRecHeader *trec STG_UNUSED) {
   StgBool result = true;
 
   ASSERT(config_use_read_phase);
@@ -828,6 +1212,7 @@ static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
         if (current_value != e->expected_value ||
             num_updates != e->num_updates) {
           TRACE("%p : mismatch", trec);
+          note_conflict(cap, s);
           result = false;
           BREAK_FOR_EACH;
         }
@@ -843,6 +1228,8 @@ static StgBool check_read_only(StgTRecHeader *trec STG_UNUSED) {
 
 void stmPreGCHook (Capability *cap) {
   TRACE("stmPreGCHook");
+  reportHotTVars(cap);
+  clear_index(cap);
   cap->free_tvar_watch_queues = END_STM_WATCH_QUEUE;
   cap->free_trec_chunks = END_STM_CHUNK_LIST;
   cap->free_trec_headers = NO_TREC;
@@ -1173,7 +1560,7 @@ StgBool stmValidateNestOfTransactions(Capability *cap, StgTRecHeader *trec, StgB
 
     } else {
       // TODO: I don't think there is a need to lock all tvars here.
-      result &= validate_and_acquire_ownership(cap, t, true, false);
+      result &= validate_and_acquire_ownership(cap, t, true, false, NULL);
     }
     t = t -> enclosing_trec;
   }
@@ -1187,22 +1574,18 @@ StgBool stmValidateNestOfTransactions(Capability *cap, StgTRecHeader *trec, StgB
 }
 /*......................................................................*/
 
-static TRecEntry *get_entry_for(StgTRecHeader *trec, StgTVar *tvar, StgTRecHeader **in) {
+static TRecEntry *get_entry_for(Capability *cap, StgTRecHeader *trec,
+                                StgTVar *tvar, StgTRecHeader **in) {
   TRecEntry *result = NULL;
 
   TRACE("%p : get_entry_for TVar %p", trec, tvar);
   ASSERT(trec != NO_TREC);
 
   do {
-    FOR_EACH_ENTRY(trec, e, {
-      if (e -> tvar == tvar) {
-        result = e;
-        if (in != NULL) {
-          *in = trec;
-        }
-        BREAK_FOR_EACH;
-      }
-    });
+    result = find_entry_in(cap, trec, tvar);
+    if (result != NULL && in != NULL) {
+      *in = trec;
+    }
     trec = trec -> enclosing_trec;
   } while (result == NULL && trec != NO_TREC);
 
@@ -1221,19 +1604,32 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) ||
          (trec -> state == TREC_CONDEMNED));
 
+  // A read-only transaction is valid if nothing has been committed since it
+  // started; see Note [STM clock].
+  if (!trec -> has_updates && trec -> state == TREC_ACTIVE && !shake()
+      && ACQUIRE_LOAD(&stm_clock) == trec -> read_version) {
+    TRACE("%p : read-only, no commits since the start", trec);
+    free_stg_trec_header(cap, trec);
+    cap -> stm_aborts_in_a_row = 0;
+    return true;
+  }
+
   // Use a read-phase (i.e. don't lock TVars we've read but not updated) if
   // the configuration lets us use a read phase.
 
-  bool result = validate_and_acquire_ownership(cap, trec, (!config_use_read_phase), true);
+  StgWord commit_version = 0;
+  bool result = validate_and_acquire_ownership(cap, trec, (!config_use_read_phase),
+                                               true, &commit_version);
   if (result) {
     // We now know that all the updated locations hold their expected values.
     ASSERT(trec -> state == TREC_ACTIVE);
 
-    if (config_use_read_phase) {
+    if (config_use_read_phase
+        && commit_version != trec -> read_version + 1) {
       StgInt64 max_commits_at_end;
       StgInt64 max_concurrent_commits;
       TRACE("%p : doing read check", trec);
-      result = check_read_only(trec);
+      result = check_read_only(cap, trec);
       TRACE("%p : read-check %s", trec, result ? "succeeded" : "failed");
 
       max_commits_at_end = getMaxCommits();
@@ -1262,8 +1658,8 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
           TRACE("%p : writing %p to %p, waking waiters", trec, e -> new_value, s);
           unpark_waiters_on(cap,s);
           IF_STM_FG_LOCKS({
-            // We have locked the TVar therefore nonatomic addition is sufficient
-            NONATOMIC_ADD(&s->num_updates, 1);
+            // We have locked the TVar therefore a relaxed store is sufficient
+            RELAXED_STORE(&s->num_updates, (StgInt) commit_version);
           });
           unlock_tvar(cap, trec, s, e -> new_value, true);
         }
@@ -1276,6 +1672,13 @@ StgBool stmCommitTransaction(Capability *cap, StgTRecHeader *trec) {
 
   free_stg_trec_header(cap, trec);
 
+  // See Note [STM contention]
+  if (result) {
+    cap -> stm_aborts_in_a_row = 0;
+  } else {
+    stm_backoff(cap);
+  }
+
   TRACE("%p : stmCommitTransaction()=%d", trec, result);
 
   return result;
@@ -1290,13 +1693,13 @@ StgBool stmCommitNestedTransaction(Capability *cap, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) || (trec -> state == TREC_CONDEMNED));
 
   et = trec -> enclosing_trec;
-  bool result = validate_and_acquire_ownership(cap, trec, (!config_use_read_phase), true);
+  bool result = validate_and_acquire_ownership(cap, trec, (!config_use_read_phase), true, NULL);
   if (result) {
     // We now know that all the updated locations hold their expected values.
 
     if (config_use_read_phase) {
       TRACE("%p : doing read check", trec);
-      result = check_read_only(trec);
+      result = check_read_only(cap, trec);
     }
     if (result) {
       // We now know that all of the read-only locations held their expected values
@@ -1337,7 +1740,7 @@ StgBool stmWait(Capability *cap, StgTSO *tso, StgTRecHeader *trec) {
   ASSERT((trec -> state == TREC_ACTIVE) ||
          (trec -> state == TREC_CONDEMNED));
 
-  bool result = validate_and_acquire_ownership(cap, trec, true, true);
+  bool result = validate_and_acquire_ownership(cap, trec, true, true, NULL);
   if (result) {
     // The transaction is valid so far so we can actually start waiting.
     // (Otherwise the transaction was not valid and the thread will have to
@@ -1383,7 +1786,7 @@ StgBool stmReWait(Capability *cap, StgTSO *tso) {
   ASSERT((trec -> state == TREC_WAITING) ||
          (trec -> state == TREC_CONDEMNED));
 
-  bool result = validate_and_acquire_ownership(cap, trec, true, true);
+  bool result = validate_and_acquire_ownership(cap, trec, true, true, NULL);
   TRACE("%p : validation %s", trec, result ? "succeeded" : "failed");
   if (result) {
     // The transaction remains valid -- do nothing because it is already on
@@ -1434,7 +1837,7 @@ StgClosure *stmReadTVar(Capability *cap,
   ASSERT(trec -> state == TREC_ACTIVE ||
          trec -> state == TREC_CONDEMNED);
 
-  entry = get_entry_for(trec, tvar, &entry_in);
+  entry = get_entry_for(cap, trec, tvar, &entry_in);
 
   if (entry != NULL) {
     if (entry_in == trec) {
@@ -1442,8 +1845,7 @@ StgClosure *stmReadTVar(Capability *cap,
       result = entry -> new_value;
     } else {
       // Entry found in another trec
-      TRecEntry *new_entry = get_new_entry(cap, trec);
-      new_entry -> tvar = tvar;
+      TRecEntry *new_entry = get_new_entry(cap, trec, tvar);
       new_entry -> expected_value = entry -> expected_value;
       new_entry -> new_value = entry -> new_value;
       result = new_entry -> new_value;
@@ -1451,8 +1853,7 @@ StgClosure *stmReadTVar(Capability *cap,
   } else {
     // No entry found
     StgClosure *current_value = read_current_value(trec, tvar);
-    TRecEntry *new_entry = get_new_entry(cap, trec);
-    new_entry -> tvar = tvar;
+    TRecEntry *new_entry = get_new_entry(cap, trec, tvar);
     new_entry -> expected_value = current_value;
     new_entry -> new_value = current_value;
     result = current_value;
@@ -1476,7 +1877,9 @@ void stmWriteTVar(Capability *cap,
   ASSERT(trec -> state == TREC_ACTIVE ||
          trec -> state == TREC_CONDEMNED);
 
-  entry = get_entry_for(trec, tvar, &entry_in);
+  trec -> has_updates = true;
+
+  entry = get_entry_for(cap, trec, tvar, &entry_in);
 
   if (entry != NULL) {
     if (entry_in == trec) {
@@ -1487,16 +1890,14 @@ void stmWriteTVar(Capability *cap,
       entry -> new_value = new_value;
     } else {
       // Entry found in another trec
-      TRecEntry *new_entry = get_new_entry(cap, trec);
-      new_entry -> tvar = tvar;
+      TRecEntry *new_entry = get_new_entry(cap, trec, tvar);
       new_entry -> expected_value = entry -> expected_value;
       new_entry -> new_value = new_value;
     }
   } else {
     // No entry found
     StgClosure *current_value = read_current_value(trec, tvar);
-    TRecEntry *new_entry = get_new_entry(cap, trec);
-    new_entry -> tvar = tvar;
+    TRecEntry *new_entry = get_new_entry(cap, trec, tvar);
     new_entry -> expected_value = current_value;
     new_entry -> new_value = new_value;
   }
@@ -46,6 +46,9 @@
 
 void stmPreGCHook(Capability *cap);
 
+/* Free the index of the capability's transaction records */
+void stmFreeIndex(Capability *cap);
+
 /*----------------------------------------------------------------------
 
    Transaction context management
@@ -196,6 +199,22 @@ void stmWriteTVar(Capability *cap,
                   StgTVar *tvar,
                   StgClosure *new_value);
 
+/*----------------------------------------------------------------------
+
+   Contention
+   ----------
+
+   The TVars that transactions on a capability failed on, and how often;
+   see Note [STM contention] in STM.c.
+*/
+
+#define STM_CONFLICT_SLOTS 32
+
+typedef struct {
+    StgTVar *tvar;
+    uint32_t aborts;
+} StmConflict;
+
 /*----------------------------------------------------------------------*/
 
 /* NULLs */
@@ -30,11 +30,14 @@
 #include "sm/GCThread.h"
 #include "Sparks.h"
 #include "Capability.h"
+#include "AutoScale.h"
 #include "Task.h"
 #include "IOManager.h"
 #if defined(mingw32_HOST_OS)
 #include "win32/MIOManager.h"
 #include "win32/AsyncWinIO.h"
+#else
+#include "posix/PreemptTimer.h"
 #endif
 #include "Trace.h"
 #include "RaiseAsync.h"
@@ -151,6 +154,9 @@ static void scheduleActivateSpark(Capability *cap);
 #endif
 static void schedulePostRunThread(Capability *cap, StgTSO *t);
 static bool scheduleHandleHeapOverflow( Capability *cap, StgTSO *t );
+static void startTimeSlice(Capability *cap, StgTSO *t);
+static void adaptTimeSlice(Capability *cap, StgTSO *t,
+                           StgThreadReturnCode ret, StgInt64 allocated);
 static bool scheduleHandleYield( Capability *cap, StgTSO *t,
                                  uint32_t prev_what_next );
 static void scheduleHandleThreadBlocked( StgTSO *t );
@@ -192,6 +198,7 @@ schedule (Capability *initialCapability, Task *task)
   StgThreadReturnCode ret;
   uint32_t prev_what_next;
   bool ready_to_gc;
+  StgInt64 alloc_before;
 
   cap = initialCapability;
   t = NULL;
@@ -285,8 +292,23 @@ schedule (Capability *initialCapability, Task *task)
         barf("sched_state: %" FMT_Word, sched_state);
     }
 
+#if defined(THREADED_RTS)
+    // See Note [Update remembered set handshake] in NonMovingMark.c
+    if (RTS_UNLIKELY(RELAXED_LOAD(&nonmoving_handshake_epoch)
+                     != cap->upd_rem_set.handshake_epoch)) {
+        nonmovingAnswerHandshake(cap);
+    }
+#endif
+
     scheduleFindWork(&cap);
 
+#if defined(THREADED_RTS)
+    // See Note [Capability affinity] in Capability.c
+    if (task->worker) {
+        applyCapabilityAffinity(cap, task);
+    }
+#endif
+
     /* work pushing, currently relevant only for THREADED_RTS:
        (pushes threads, wakes up idle capabilities for stealing) */
     schedulePushWork(cap,task);
@@ -399,6 +421,9 @@ schedule (Capability *initialCapability, Task *task)
     }
 #endif
 
+    startTimeSlice(cap, t);
+    alloc_before = PK_Int64((W_*)&(t->alloc_limit));
+
     /* context switches are initiated by the timer signal, unless
      * the user specified "context switch as often as possible", with
      * +RTS -C0
@@ -437,6 +462,7 @@ run_thread:
 
     cap->in_haskell = true;
     RELAXED_STORE(&cap->idle, false);
+    stat_startMutator(cap);
 
     dirty_TSO(cap,t);
     dirty_STACK(cap,t->stackobj);
@@ -499,6 +525,8 @@ run_thread:
     }
 
     cap->in_haskell = false;
+    stat_endMutator(cap);
+    cap->context_switches++;
 
     // The TSO might have moved, eg. if it re-entered the RTS and a GC
     // happened.  So find the new location:
@@ -534,6 +562,14 @@ run_thread:
         }
     }
 
+    // See Note [Stack sampling] in Trace.c
+    if (RTS_UNLIKELY(RELAXED_LOAD(&cap->stack_sample_requested))) {
+        RELAXED_STORE(&cap->stack_sample_requested, false);
+        if (ret != ThreadFinished) {
+            sampleThreadStack(cap, t);
+        }
+    }
+
     ASSERT_FULL_CAPABILITY_INVARIANTS(cap,task);
     ASSERT(t->cap == cap);
 
@@ -547,6 +583,11 @@ run_thread:
 
     schedulePostRunThread(cap,t);
 
+    if (RtsFlags.ConcFlags.adaptiveTimeSlices) {
+        adaptTimeSlice(cap, t, ret,
+                       alloc_before - PK_Int64((W_*)&(t->alloc_limit)));
+    }
+
     ready_to_gc = false;
 
     switch (ret) {
@@ -754,7 +795,8 @@ schedulePushWork(Capability *cap USED_IF_THREADS,
          n_free_caps < n_wanted_caps && i != cap->no;
          i = (i + 1) % getNumCapabilities()) {
         Capability *cap0 = getCapability(i);
-        if (cap != cap0 && !cap0->disabled && tryGrabCapability(cap0,task)) {
+        if (cap != cap0 && !cap0->disabled && !RELAXED_LOAD(&cap0->isolated)
+            && tryGrabCapability(cap0,task)) {
             if (!emptyRunQueue(cap0)
                 || RELAXED_LOAD(&cap0->n_returning_tasks) != 0
                 || !emptyInbox(cap0)) {
@@ -924,12 +966,12 @@ scheduleCheckBlockedThreads(Capability *cap USED_IF_NOT_THREADS)
      * TODO: this test anyPendingTimeoutsOrIO does not have a proper
      * implementation the WinIO I/O manager!
      *
-     * The select() I/O manager uses the sleeping_queue and the blocked_queue,
+     * The select() I/O manager uses the timer heap and the blocked_queue,
      * and the test checks both. The legacy win32 I/O manager only consults
      * the blocked_queue, but then it puts threads waiting on delay# on the
      * blocked_queue too, so that's ok.
      *
-     * The WinIO I/O manager does not use either the sleeping_queue or the
+     * The WinIO I/O manager does not use either the timer heap or the
      * blocked_queue, but it's implementation of anyPendingTimeoutsOrIO still
      * checks both! Since both queues will _always_ be empty then it will
      * _always_ return false and so awaitCompletedTimeoutsOrIO will _never_ be
@@ -940,7 +982,8 @@ scheduleCheckBlockedThreads(Capability *cap USED_IF_NOT_THREADS)
     if (anyPendingTimeoutsOrIO(cap))
     {
         if (emptyRunQueue(cap)) {
-            // block and wait
+            // block and wait; see Note [Tickless idling] in Timer.c
+            timerIdle();
             awaitCompletedTimeoutsOrIO(cap);
         } else {
             // poll but do not wait
@@ -1036,27 +1079,25 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
             cap = *pcap;
         }
 
-        // don't use a blocking acquire; if the lock is held by
-        // another thread then just carry on.  This seems to avoid
-        // getting stuck in a message ping-pong situation with other
-        // processors.  We'll check the inbox again later anyway.
-        //
-        // We should really use a more efficient queue data structure
-        // here.  The trickiness is that we must ensure a Capability
-        // never goes idle if the inbox is non-empty, which is why we
-        // use cap->lock (cap->lock is released as the last thing
-        // before going idle; see Capability.c:releaseCapability()).
-        //
-        // See Note [Heap memory barriers], section "Barriers on messages"
-        r = TRY_ACQUIRE_LOCK(&cap->lock);
-        if (r != 0) return;
-
-        m = cap->inbox;
-        p = cap->putMVars;
-        cap->inbox = (Message*)END_TSO_QUEUE;
-        cap->putMVars = NULL;
-
-        RELEASE_LOCK(&cap->lock);
+        // See Note [The capability inbox] in Messages.c
+        m = (Message*)xchg((StgPtr)&cap->inbox, (StgWord)END_TSO_QUEUE);
+
+        // The putMVars are still under cap->lock. Don't use a blocking
+        // acquire; if the lock is held by another thread then just carry
+        // on. We'll check again later anyway, and a Capability never goes
+        // idle with putMVars pending, since cap->lock is released as the
+        // last thing before going idle (see Capability.c:releaseCapability()).
+        p = NULL;
+        if (RELAXED_LOAD(&cap->putMVars) != NULL) {
+            r = TRY_ACQUIRE_LOCK(&cap->lock);
+            if (r == 0) {
+                p = cap->putMVars;
+                cap->putMVars = NULL;
+                RELEASE_LOCK(&cap->lock);
+            } else if (m == (Message*)END_TSO_QUEUE) {
+                return;
+            }
+        }
 
         while (m != (Message*)END_TSO_QUEUE) {
             next = m->link;
@@ -1066,9 +1107,7 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
 
         while (p != NULL) {
             pnext = p->link;
-            performTryPutMVar(cap, (StgMVar*)deRefStablePtr(p->mvar),
-                              Unit_closure);
-            freeStablePtr(p->mvar);
+            performTryPutMVars(cap, p->n_mvars, p->mvars);
             stgFree(p);
             p = pnext;
         }
@@ -1085,7 +1124,8 @@ scheduleProcessInbox (Capability **pcap USED_IF_THREADS)
 static void
 scheduleActivateSpark(Capability *cap)
 {
-    if (anySparks() && !cap->disabled)
+    // See Note [Capability affinity] in Capability.c
+    if (anySparks() && !cap->disabled && !RELAXED_LOAD(&cap->isolated))
     {
         createSparkThread(cap);
         debugTrace(DEBUG_sched, "creating a spark thread");
@@ -1187,7 +1227,7 @@ scheduleHandleHeapOverflow( Capability *cap, StgTSO *t )
                                                // nursery has only one
                                                // block.
 
-            bd = allocGroupOnNode_lock(cap->node,blocks);
+            bd = allocGroupCached_lock(&cap->block_cache, blocks);
             cap->r.rNursery->n_blocks += blocks;
 
             // link the new group after CurrentNursery
@@ -1229,6 +1269,92 @@ scheduleHandleHeapOverflow( Capability *cap, StgTSO *t )
     /* actual GC is done at the end of the while loop in schedule() */
 }
 
+/* -----------------------------------------------------------------------------
+ * Time slices
+ * -------------------------------------------------------------------------- */
+
+/* Note [Time slices]
+   ~~~~~~~~~~~~~~~~~~
+   The timer asks for a context switch every -C interval (see handle_tick in
+   Timer.c). By default each running thread is switched out at the first
+   one, so every thread gets the same slice. A thread can ask for a longer
+   one, in -C intervals, with rts_setThreadTimeSlice (setThreadTimeSlice in
+   GHC.Conc.Sync), or to run until it blocks or yields, with
+   TSO_SLICE_UNBOUNDED. This saves context switches in pools of CPU-bound
+   workers, at the price of the latency of the other threads on their
+   capability.
+
+   When the scheduler starts running a thread it sets cap->slice_ticks to
+   the thread's slice, and at each -C interval contextSwitchExpiredSlices
+   counts it down, context switching the capability once it reaches zero, as
+   contextSwitchAllCapabilities does at every interval. Threads that block,
+   yield or need a GC leave early as usual, and the next thread starts a
+   new slice. Only the timer's context switches are affected: a GC sync or
+   an interrupt still stops the thread straight away. With -C0 the
+   scheduler switches threads whenever another one is runnable, and slices
+   have no effect.
+
+   With --adaptive-time-slices, threads that don't set a slice learn one
+   (tso->adapted_slice). A thread that is switched out at the end of its
+   slice having allocated less than the allocation area (-A) is doing
+   little but computing: the switch costs it its cache for nothing, and it
+   isn't about to need a GC anyway, so its slice is doubled, up to
+   ADAPTIVE_SLICE_MAX intervals. A thread that allocated more has its slice
+   halved, down to one interval, as it reaches its own switch points (heap
+   overflows) soon enough.
+*/
+
+#define ADAPTIVE_SLICE_MAX 8
+
+static void
+startTimeSlice (Capability *cap, StgTSO *t)
+{
+    uint32_t slice = RELAXED_LOAD(&t->slice);
+    if (slice == 0) {
+        slice = RtsFlags.ConcFlags.adaptiveTimeSlices ? t->adapted_slice : 1;
+    }
+    RELAXED_STORE(&cap->slice_ticks, slice);
+
+    // See Note [Per-capability preemption timers] in posix/PreemptTimer.c
+    if (RtsFlags.ConcFlags.perCapabilityTimers
+        && RtsFlags.ConcFlags.ctxtSwitchTime > 0) {
+        if (slice == TSO_SLICE_UNBOUNDED) {
+            RELAXED_STORE(&cap->slice_deadline, TIME_MAX);
+            return;
+        }
+        const Time length = slice * RtsFlags.ConcFlags.ctxtSwitchTime;
+        RELAXED_STORE(&cap->slice_deadline, getProcessElapsedTime() + length);
+#if defined(HAVE_PREEMPT_TIMERS)
+        armPreemptTimer(cap, length);
+#endif
+    }
+}
+
+static void
+adaptTimeSlice (Capability *cap, StgTSO *t, StgThreadReturnCode ret,
+                StgInt64 allocated)
+{
+    // Only threads switched out at the end of their slice
+    if (ret != ThreadYielding || RELAXED_LOAD(&cap->slice_ticks) != 0
+        || RELAXED_LOAD(&t->slice) != 0) {
+        return;
+    }
+
+    const StgInt64 nursery_bytes =
+        (StgInt64) RtsFlags.GcFlags.minAllocAreaSize * BLOCK_SIZE;
+    StgWord16 slice = t->adapted_slice;
+    if (allocated < nursery_bytes) {
+        slice = stg_min(slice * 2, ADAPTIVE_SLICE_MAX);
+    } else {
+        slice = stg_max(slice / 2, 1);
+    }
+    if (slice != t->adapted_slice) {
+        debugTrace(DEBUG_sched, "thread %" FMT_StgThreadID ": time slice %d -> %d",
+                   t->id, t->adapted_slice, slice);
+        t->adapted_slice = slice;
+    }
+}
+
 /* -----------------------------------------------------------------------------
  * Handle a thread that returned to the scheduler with ThreadYielding
  * -------------------------------------------------------------------------- */
@@ -1320,6 +1446,13 @@ scheduleHandleThreadFinished (Capability *cap, Task *task, StgTSO *t)
     // blocked mode (see #2910).
     awakenBlockedExceptionQueue (cap, t);
 
+#if defined(THREADED_RTS)
+    if (!t->bound) {
+        saveSparkThreadStack(cap, t);
+    }
+#endif
+    saveThreadStack(cap, t);
+
       //
       // Check whether the thread that just completed was a bound
       // thread, and if so return with the result.
@@ -1600,6 +1733,34 @@ void releaseAllCapabilities(uint32_t n, Capability *keep_cap, Task *task)
  * Perform a garbage collection if necessary
  * -------------------------------------------------------------------------- */
 
+/* Note [No capability-local minor collections]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Every GC, even a minor one triggered by a single capability running out
+ * of nursery, stops all capabilities. It is tempting to let a capability
+ * collect its own nursery alone when nothing else points into it, as
+ * local-heap collectors do, but the information needed to know that is not
+ * available:
+ *
+ *  - The write barrier only fires for objects in the old generation (see
+ *    the dirty_* functions in sm/Storage.c and recordMutableCap). A pointer
+ *    from one nursery into another, e.g. a thread on capability B filling an
+ *    MVar or IORef that was allocated on capability A, goes unrecorded, and
+ *    the mut_lists only ever describe old-to-young pointers.
+ *
+ *  - Threads migrate between capabilities and take their stacks, which
+ *    point into the old capability's nursery, with them; sparks, messages
+ *    and the global run queues likewise hand young objects to other
+ *    capabilities without any barrier.
+ *
+ * So a per-capability "escaped" bit would have to be maintained by a write
+ * barrier on *every* pointer store to a nursery object, and by every path
+ * that passes objects between capabilities, which costs the mutator far more
+ * than the synchronisation saves in the common case. Programs that suffer
+ * from the sync can instead give the nursery more room (-A, or -n so that
+ * busy capabilities can take nursery chunks from the idle ones), leave idle
+ * capabilities out of the GC (-qn, -qi) or use --minor-pause-target.
+ */
+
 // N.B. See Note [Deadlock detection under the nonmoving collector] for rationale
 // behind deadlock_detect argument.
 static void
@@ -1619,6 +1780,7 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
     uint32_t need_idle;
     uint32_t n_gc_threads;
     uint32_t n_idle_caps = 0, n_failed_trygrab_idles = 0;
+    W_ gc_work = 0;
     StgTSO *tso;
     bool *idle_cap;
       // idle_cap is an array (allocated later) of size n_capabilities, where
@@ -1670,19 +1832,32 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
         .task = task
     };
 
+    // See Note [Adaptive GC thread count] in sm/GC.c
+    if (RtsFlags.ParFlags.parGcThreadsAuto && gc_type == SYNC_GC_PAR) {
+        gc_work = estimateGCWork(collect_gen);
+    }
+
     {
         SyncType prev_sync = 0;
         bool was_syncing;
         do {
-            // If -qn is not set and we have more capabilities than cores, set
-            // the number of GC threads to #cores.  We do this here rather than
-            // in normaliseRtsOpts() because here it will work if the program
+            // If -qn is not set and we have more capabilities than cores we
+            // can use (see getNumberOfUsableProcessors), set the number of GC
+            // threads to #cores.  We do this here rather than in
+            // normaliseRtsOpts() because here it will work if the program
             // calls setNumCapabilities.
             //
             n_gc_threads = RtsFlags.ParFlags.parGcThreads;
             if (n_gc_threads == 0 &&
-                enabled_capabilities > getNumberOfProcessors()) {
-                n_gc_threads = getNumberOfProcessors();
+                enabled_capabilities > getNumberOfUsableProcessors()) {
+                n_gc_threads = getNumberOfUsableProcessors();
+            }
+
+            if (RtsFlags.ParFlags.parGcThreadsAuto && gc_type == SYNC_GC_PAR) {
+                n_gc_threads = gcThreadsForWork(gc_work,
+                                                n_gc_threads > 0
+                                                ? n_gc_threads
+                                                : enabled_capabilities);
             }
 
             // This calculation must be inside the loop because
@@ -1768,6 +1943,11 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
         traceEventRequestSeqGc(cap);
     } else {
         traceEventRequestParGc(cap);
+        if (RtsFlags.ParFlags.parGcThreadsAuto) {
+            traceEventGcParThreads(cap, collect_gen,
+                                   stg_min(n_gc_threads, enabled_capabilities),
+                                   gc_work * sizeof(W_));
+        }
     }
 
     if (gc_type == SYNC_GC_SEQ) {
@@ -1922,6 +2102,14 @@ delete_threads_and_gc:
     }
 
     traceSparkCounters(cap);
+    // We hold all the capabilities, see Note [Stack sampling] in Trace.c
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        flushStackSamples(getCapability(i));
+    }
+#if defined(THREADED_RTS)
+    traceCapabilityParking();
+    autoScaleCapabilities();
+#endif
 
     switch (getRecentActivity()) {
     case ACTIVITY_INACTIVE:
@@ -2097,6 +2285,9 @@ forkProcess(HsStablePtr *entry
     ACQUIRE_LOCK(&all_tasks_mutex);
 #endif
 
+    // See Note [Background decommit] in MBlock.c
+    lockDecommitQueue();
+
     stopTimer(); // See #4074
 
 #if defined(TRACING)
@@ -2109,6 +2300,7 @@ forkProcess(HsStablePtr *entry
 
         startTimer(); // #4074
 
+        unlockDecommitQueue();
         RELEASE_LOCK(&sched_mutex);
         RELEASE_LOCK(&sm_mutex);
         RELEASE_LOCK(&stable_ptr_mutex);
@@ -2150,6 +2342,9 @@ forkProcess(HsStablePtr *entry
         initMutex(&all_tasks_mutex);
 #endif
 
+        unlockDecommitQueue();
+        resetDecommitQueue();
+
 #if defined(TRACING)
         resetTracing();
 #endif
@@ -2229,6 +2424,11 @@ forkProcess(HsStablePtr *entry
         // like startup event, capabilities, process info etc
         traceTaskCreate(task, cap);
 
+#if defined(THREADED_RTS)
+        // after discardTasksExcept(), which would free the new thread's Task
+        restartFinalizerThreadAfterFork();
+#endif
+
         initIOManagerAfterFork(&cap);
 
         // start timer after the IOManager is initialized
@@ -2529,6 +2729,8 @@ suspendThread (StgRegTable *reg, bool interruptible)
   // Otherwise allocate() will write to invalid memory.
   cap->r.rCurrentTSO = NULL;
 
+  stat_endMutator(cap);
+
   ACQUIRE_LOCK(&cap->lock);
 
   suspendTask(cap,task);
@@ -2597,6 +2799,7 @@ resumeThread (void *task_)
 
     cap->r.rCurrentTSO = tso;
     cap->in_haskell = true;
+    stat_startMutator(cap);
     errno = saved_errno;
 #if defined(mingw32_HOST_OS)
     SetLastError(saved_winerror);
@@ -2790,6 +2993,17 @@ initScheduler(void)
    */
   startWorkerTasks(1, n_capabilities);
 
+#if defined(THREADED_RTS)
+  // and the idle workers of --min-spare-workers; see
+  // Note [Spare worker pool] in Task.c.
+  for (uint32_t i = 0; i < n_capabilities; i++) {
+      Capability *cap = getCapability(i);
+      ACQUIRE_LOCK(&cap->lock);
+      startSpareWorkerTasks(cap);
+      RELEASE_LOCK(&cap->lock);
+  }
+#endif
+
   RELEASE_LOCK(&sched_mutex);
 
 }
@@ -2964,6 +3178,51 @@ deleteThread_(StgTSO *tso)
  * Run queue manipulation
  */
 
+/* Note [Thread priorities]
+   ~~~~~~~~~~~~~~~~~~~~~~~~
+   Every thread has a priority, tso->priority, from 0 (the default) to
+   TSO_MAX_PRIORITY, which it sets for itself with setThreadPriority#. The
+   run queue of each capability is kept ordered by priority, highest first,
+   and in the usual order (round robin) among threads of equal priority, so
+   the scheduler always picks a runnable thread of the highest priority
+   present. The scheduling is strict: threads of lower priority only run
+   while no thread of higher priority is runnable on the capability.
+
+   appendToRunQueue puts a thread after the last one of its priority or
+   higher, pushOnRunQueue before the first one of its priority or lower.
+   When no one sets a priority both are the usual O(1) operations; only
+   queueing a thread ahead of threads of lower priority walks the queue.
+   Removing a thread keeps the others in order, so the rest of the scheduler
+   (schedulePushWork, removeFromRunQueue, ...) needs no changes. A thread
+   only changes its own priority, while it runs and so isn't on a run queue.
+   A thread whose priority rises doesn't preempt the running thread: it is
+   picked at the next context switch.
+*/
+
+// Put tso in the run queue before next (at the end if next is
+// END_TSO_QUEUE).
+static void
+insertIntoRunQueue (Capability *cap, StgTSO *tso, StgTSO *next)
+{
+    StgTSO *prev = next == END_TSO_QUEUE ? cap->run_queue_tl
+                                         : next->block_info.prev;
+
+    setTSOLink(cap, tso, next);
+    tso->block_info.prev = END_TSO_QUEUE;
+    if (prev == END_TSO_QUEUE) {
+        cap->run_queue_hd = tso;
+    } else {
+        setTSOLink(cap, prev, tso);
+        setTSOPrev(cap, tso, prev);
+    }
+    if (next == END_TSO_QUEUE) {
+        cap->run_queue_tl = tso;
+    } else {
+        setTSOPrev(cap, next, tso);
+    }
+    cap->n_run_queue++;
+}
+
 void
 appendToRunQueue (Capability *cap, StgTSO *tso)
 {
@@ -2971,6 +3230,14 @@ appendToRunQueue (Capability *cap, StgTSO *tso)
     if (cap->run_queue_hd == END_TSO_QUEUE) {
         cap->run_queue_hd = tso;
         tso->block_info.prev = END_TSO_QUEUE;
+    } else if (RTS_UNLIKELY(tso->priority > cap->run_queue_tl->priority)) {
+        // See Note [Thread priorities]
+        StgTSO *t = cap->run_queue_hd;
+        while (t->priority >= tso->priority) {
+            t = t->_link;
+        }
+        insertIntoRunQueue(cap, tso, t);
+        return;
     } else {
         setTSOLink(cap, cap->run_queue_tl, tso);
         setTSOPrev(cap, tso, cap->run_queue_tl);
@@ -2982,6 +3249,16 @@ appendToRunQueue (Capability *cap, StgTSO *tso)
 void
 pushOnRunQueue (Capability *cap, StgTSO *tso)
 {
+    if (RTS_UNLIKELY(cap->run_queue_hd != END_TSO_QUEUE
+                     && cap->run_queue_hd->priority > tso->priority)) {
+        // See Note [Thread priorities]
+        StgTSO *t = cap->run_queue_hd;
+        while (t != END_TSO_QUEUE && t->priority > tso->priority) {
+            t = t->_link;
+        }
+        insertIntoRunQueue(cap, tso, t);
+        return;
+    }
     setTSOLink(cap, tso, cap->run_queue_hd);
     tso->block_info.prev = END_TSO_QUEUE;
     if (cap->run_queue_hd != END_TSO_QUEUE) {
@@ -128,6 +128,18 @@ setRecentActivity(enum RecentActivity new_value)
     return (enum RecentActivity) old;
 }
 
+/* Set the recent activity flag to new_value if it is old_value. Returns
+ * whether it did.
+ */
+INLINE_HEADER bool
+casRecentActivity(enum RecentActivity old_value, enum RecentActivity new_value)
+{
+    StgWord old = (StgWord) old_value;
+    return __atomic_compare_exchange_n((StgPtr) &recent_activity, &old,
+                                       (StgWord) new_value, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
 INLINE_HEADER enum RecentActivity
 getRecentActivity(void)
 {
@@ -15,6 +15,9 @@
 #include "Prelude.h"
 #include "Sparks.h"
 #include "ThreadLabels.h"
+#include "Threads.h"
+#include "GetTime.h"
+#include "sm/GC.h"
 #include "sm/NonMovingMark.h"
 #include "rts/storage/HeapAlloc.h"
 
@@ -23,7 +26,9 @@
 SparkPool *
 allocSparkPool( void )
 {
-    return newWSDeque(RtsFlags.ParFlags.maxLocalSparks);
+    // See Note [Spark pool growth and batched stealing] in Capability.c
+    return newGrowableWSDeque(RtsFlags.ParFlags.maxLocalSparks,
+                              RtsFlags.ParFlags.maxSparkPoolSize);
 }
 
 void
@@ -32,6 +37,32 @@ freeSparkPool (SparkPool *pool)
     freeWSDeque(pool);
 }
 
+/* Note [Reusing spark thread stacks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A spark thread runs runSparks, which evaluates sparks from the pool in a
+   loop until it is empty, and then finishes. When sparks are fine-grained
+   and the pool keeps running dry, the scheduler creates a new spark thread
+   each time, allocating a new TSO, stack and label.
+
+   We can't reuse the TSO of a finished spark thread: its ThreadId may have
+   escaped (through myThreadId or listThreads), and throwTo, threadStatus
+   or a weak pointer would then act on the new thread. But nothing else
+   refers to its stack, which is most of the allocation (1k bytes by
+   default, see -ki). So when a spark thread finishes
+   (saveSparkThreadStack) we give its TSO a minimal stack holding just its
+   dead thread frame (takeThreadStack), and keep its old stack in
+   cap->spare_spark_stacks, up to MAX_SPARE_SPARK_STACKS of them, for
+   createSparkThread to start the next spark thread on. The stacks are roots of the capability (see
+   markCapability) and may be old, so they are dirtied before reuse, as is
+   the TSO we take the stack from. The spark threads of a capability also
+   share one label, which tells saveSparkThreadStack which threads are spark
+   threads: a thread that has been relabelled keeps its stack.
+
+   The spark threads created, and how many of them reused a stack, are
+   reported by +RTS -s. Other threads reuse stacks in the same way; see
+   Note [Reusing thread stacks] in Threads.c.
+*/
+
 /* -----------------------------------------------------------------------------
  *
  * Turn a spark into a real thread
@@ -43,14 +74,50 @@ createSparkThread (Capability *cap)
 {
     StgTSO *tso;
 
-    tso = createIOThread (cap, RtsFlags.GcFlags.initialStkSize,
-                          (StgClosure *)runSparks_closure);
-    setThreadLabel(cap, tso, "spark evaluator");
+    if (cap->n_spare_spark_stacks > 0) {
+        StgStack *stack =
+            cap->spare_spark_stacks[--cap->n_spare_spark_stacks];
+        tso = createThreadOnStack(cap, stack);
+        // as createIOThread does
+        stack->sp -= 3;
+        stack->sp[2] = (W_)&stg_ap_v_info;
+        stack->sp[1] = (W_)runSparks_closure;
+        stack->sp[0] = (W_)&stg_enter_info;
+        cap->spark_threads_reused++;
+    } else {
+        tso = createIOThread (cap, RtsFlags.GcFlags.initialStkSize,
+                              (StgClosure *)runSparks_closure);
+    }
+    cap->spark_threads_created++;
+
+    if (cap->spark_thread_label == NULL) {
+        setThreadLabel(cap, tso, "spark evaluator");
+        cap->spark_thread_label = tso->label;
+    } else {
+        labelThread(cap, tso, cap->spark_thread_label);
+    }
     traceEventCreateSparkThread(cap, tso->id);
 
     appendToRunQueue(cap,tso);
 }
 
+/* Called when an unbound thread has finished; see
+ * Note [Reusing spark thread stacks].
+ */
+void
+saveSparkThreadStack (Capability *cap, StgTSO *tso)
+{
+    if (tso->what_next != ThreadComplete
+        || tso->label == NULL
+        || tso->label != cap->spark_thread_label
+        || cap->n_spare_spark_stacks >= MAX_SPARE_SPARK_STACKS) {
+        return;
+    }
+
+    cap->spare_spark_stacks[cap->n_spare_spark_stacks++] =
+        takeThreadStack(cap, tso);
+}
+
 /* --------------------------------------------------------------------------
  * newSpark: create a new spark, as a result of calling "par"
  * Called directly from STG.
@@ -107,21 +174,53 @@ require a GC barrier but that seems to high a price to pay.
 */
 
 
+/* Note [Incremental spark pruning]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Looking at every spark in every pool at every GC costs milliseconds once
+   the pools hold hundreds of thousands of sparks, even though a minor GC
+   can't have done anything to most of them: a spark whose closure lives in
+   an older generation than the ones collected has neither moved nor died.
+
+   So after pruning, the capability remembers how far from the top of its
+   pool (the oldest end) the sparks all point into generation 1 or older, or
+   to static closures (spark_prune_mark), and the youngest generation among
+   them (spark_prune_gen). Sparks are only pushed at the bottom, and only
+   taken from the top (findSpark steals even from its own pool), so until
+   the next GC those sparks stay at the top of the pool, and as generations
+   only ever increase when a closure is evacuated, their closures stay in
+   spark_prune_gen or older, whether or not that GC prunes them. If the GC
+   doesn't collect spark_prune_gen, pruneSparkQueue only looks at the
+   sparks below the mark.
+
+   That leaves sparks that have fizzled since in the pool until a GC of
+   their generation, but findSpark discards fizzled sparks when it takes
+   them anyway. A nonmoving mark may have found that sparks in the
+   nonmoving heap died, so pruning after one looks at the whole pool.
+
+   The +RTS -s output counts the sparks looked at and skipped, and the time
+   taken, in the SPARK PRUNING line.
+*/
+
 /* --------------------------------------------------------------------------
  * Remove all sparks from the spark queues which should not spark any
  * more.  Called after GC. We assume exclusive access to the structure
- * and replace  all sparks in the queue, see explanation below. At exit,
- * the spark pool only contains sparkable closures.
+ * and compact the sparks in the queue, see explanation below. At exit,
+ * the spark pool only contains sparkable closures, apart from the old
+ * ones we skipped (see Note [Incremental spark pruning]).
  * -------------------------------------------------------------------------- */
 
 void
 pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
 {
     SparkPool *pool;
-    StgClosurePtr spark, tmp, *elements;
+    StgClosurePtr spark, tmp, keep, *elements;
     uint32_t pruned_sparks; // stats only
-    StgInt botInd,oldBotInd,currInd; // indices in array (always < size)
+    StgInt from, currInd, botInd; // indices, not yet modulo the size
+    StgInt mark, offset;
+    uint32_t keep_gen, mark_gen;
+    bool old_sparks;
     const StgInfoTable *info;
+    const Time start = getCurrentThreadCPUTime();
 
     pruned_sparks = 0;
 
@@ -136,8 +235,12 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
     // Take this opportunity to reset top/bottom modulo the size of
     // the array, to avoid overflow.  This is only possible because no
     // stealing is happening during GC.
-    pool->bottom  -= pool->top & ~pool->moduloSize;
-    pool->top     &= pool->moduloSize;
+    offset = pool->top & ~pool->moduloSize;
+    pool->bottom -= offset;
+    pool->top    -= offset;
+
+    // Nor can anybody still be reading the arrays the pool has outgrown.
+    freeRetiredWSDeque(pool);
 
     debugTrace(DEBUG_sparks,
                "markSparkQueue: current spark queue len=%ld; (hd=%ld; tl=%ld)",
@@ -145,54 +248,47 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
 
     ASSERT_WSDEQUE_INVARIANTS(pool);
 
+    // Skip the old sparks if their generations haven't been collected; see
+    // Note [Incremental spark pruning]. Some of them may have been stolen.
+    mark = stg_max(cap->spark_prune_mark - offset, pool->top);
+    mark = stg_min(mark, pool->bottom);
+    if (nonmovingMarkFinished || mark == pool->top
+        || cap->spark_prune_gen <= N) {
+        mark = pool->top;
+        mark_gen = RtsFlags.GcFlags.generations;
+    } else {
+        mark_gen = cap->spark_prune_gen;
+    }
+
     elements = (StgClosurePtr *)pool->elements;
 
-    /* We have exclusive access to the structure here, so we can reset
-       bottom and top counters, and prune invalid sparks. Contents are
-       copied in-place if they are valuable, otherwise discarded. The
-       routine uses "real" indices t and b, starts by computing them
-       as the modulus size of top and bottom,
-
-       Copying:
-
-       At the beginning, the pool structure can look like this:
-       ( bottom % size >= top % size , no wrap-around)
-                  t          b
-       ___________***********_________________
-
-       or like this ( bottom % size < top % size, wrap-around )
-                  b         t
-       ***********__________******************
-       As we need to remove useless sparks anyway, we make one pass
-       between t and b, moving valuable content to b and subsequent
-       cells (wrapping around when the size is reached).
-
-                     b      t
-       ***********OOO_______XX_X__X?**********
-                     ^____move?____/
-
-       After this movement, botInd becomes the new bottom, and old
-       bottom becomes the new top index, both as indices in the array
-       size range.
-    */
-    // starting here
-    currInd = (pool->top) & (pool->moduloSize); // mod
+    /* We have exclusive access to the structure here, so we can prune
+       invalid sparks. We make one pass from the first spark we don't skip
+       (currInd) to bottom, moving the valuable ones up to botInd and
+       subsequent cells, so that they stay in order:
 
-    // copies of evacuated closures go to space from botInd on
-    // we keep oldBotInd to know when to stop
-    oldBotInd = botInd = (pool->bottom) & (pool->moduloSize); // mod
+                  t    currInd   b
+       ___________SSSSXX_X__X?___________
+                      ^
+                    botInd
 
-    // on entry to loop, we are within the bounds
-    ASSERT( currInd < pool->size && botInd  < pool->size );
+       Both indices are taken modulo the size only to access the array, so
+       the sparks may wrap around from the end of the array to its start.
+       After this movement, botInd becomes the new bottom.
+    */
+    from = currInd = botInd = mark;
+
+    // Are all the sparks kept so far, from the top, in generation 1 or
+    // older?
+    old_sparks = true;
 
-    while (currInd != oldBotInd ) {
-      /* must use != here, wrap-around at size
-         subtle: loop not entered if queue empty
-       */
+    for (; currInd < pool->bottom; currInd++) {
 
-      /* check element at currInd. if valuable, evacuate and move to
-         botInd, otherwise move on */
-      spark = elements[currInd];
+      /* check element at currInd. if valuable, move it to botInd,
+         otherwise move on */
+      spark = elements[currInd & pool->moduloSize];
+      keep = NULL;
+      keep_gen = 0;
 
       // We have to be careful here: in the parallel GC, another
       // thread might evacuate this closure while we're looking at it,
@@ -213,8 +309,8 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
               tmp = (StgClosure*)UN_FORWARDING_PTR(info);
               /* if valuable work: shift inside the pool */
               if (closure_SHOULD_SPARK(tmp)) {
-                  elements[botInd] = tmp; // keep entry (new address)
-                  botInd++;
+                  keep = tmp; // keep entry (new address)
+                  keep_gen = Bdescr((P_) tmp)->gen_no;
               } else {
                   pruned_sparks++; // discard spark
                   cap->spark_stats.fizzled++;
@@ -242,8 +338,8 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
 
               if (is_alive) {
                   if (closure_SHOULD_SPARK(spark)) {
-                      elements[botInd] = spark; // keep entry (new address)
-                      botInd++;
+                      keep = spark; // keep entry
+                      keep_gen = spark_bd->gen_no;
                   } else {
                       pruned_sparks++; // discard spark
                       cap->spark_stats.fizzled++;
@@ -259,8 +355,8 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
                   // We can't tell whether a THUNK_STATIC is garbage or not.
                   // See also Note [STATIC_LINK fields]
                   // isAlive() also ignores static closures (see GCAux.c)
-                  elements[botInd] = spark; // keep entry (new address)
-                  botInd++;
+                  keep = spark; // keep entry
+                  keep_gen = RtsFlags.GcFlags.generations;
               } else {
                   pruned_sparks++; // discard spark
                   cap->spark_stats.fizzled++;
@@ -269,23 +365,31 @@ pruneSparkQueue (bool nonmovingMarkFinished, Capability *cap)
           }
       }
 
-      currInd++;
-
-      // in the loop, we may reach the bounds, and instantly wrap around
-      ASSERT( currInd <= pool->size && botInd <= pool->size );
-      if ( currInd == pool->size ) { currInd = 0; }
-      if ( botInd == pool->size )  { botInd = 0;  }
+      if (keep != NULL) {
+          elements[botInd & pool->moduloSize] = keep;
+          botInd++;
+          if (old_sparks && keep_gen > 0) {
+              mark = botInd;
+              mark_gen = stg_min(mark_gen, keep_gen);
+          } else {
+              old_sparks = false;
+          }
+      }
 
-    } // while-loop over spark pool elements
+    } // for-loop over spark pool elements
 
-    ASSERT(currInd == oldBotInd);
+    ASSERT(botInd <= currInd);
 
-    pool->top = oldBotInd; // where we started writing
+    pool->bottom = botInd; // first free place we did not use
 
-    pool->bottom = (oldBotInd <= botInd) ? botInd : (botInd + pool->size);
-    // first free place we did not use (corrected by wraparound)
+    cap->spark_prune_mark = mark;
+    cap->spark_prune_gen = mark_gen;
+    cap->spark_prune_visited += currInd - from;
+    cap->spark_prune_skipped += from - pool->top;
+    cap->spark_prune_time += getCurrentThreadCPUTime() - start;
 
-    debugTrace(DEBUG_sparks, "pruned %d sparks", pruned_sparks);
+    debugTrace(DEBUG_sparks, "pruned %d sparks, skipped %ld old ones",
+               pruned_sparks, (long) (from - pool->top));
 
     debugTrace(DEBUG_sparks,
                "new spark queue len=%ld; (hd=%ld; tl=%ld)",
@@ -22,10 +22,15 @@ typedef struct {
     StgWord converted;
     StgWord gcd;
     StgWord fizzled;
+    StgWord batch_steals;   // steals that took more sparks for later ...
+    StgWord batch_stolen;   // ... and those sparks
 } SparkCounters;
 
 #if defined(THREADED_RTS)
 
+// See Note [Reusing spark thread stacks] in Sparks.c
+#define MAX_SPARE_SPARK_STACKS 4
+
 typedef WSDeque SparkPool;
 
 // Initialisation
@@ -44,6 +49,7 @@ INLINE_HEADER bool         fizzledSpark  (StgClosure *);
 
 void         freeSparkPool     (SparkPool *pool);
 void         createSparkThread (Capability *cap);
+void         saveSparkThreadStack (Capability *cap, StgTSO *tso);
 void         traverseSparkQueue(evac_fn evac, void *user, Capability *cap);
 void         pruneSparkQueue   (bool nonmovingMarkFinished, Capability *cap);
 
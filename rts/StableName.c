@@ -12,10 +12,10 @@
 #include "Rts.h"
 #include "RtsAPI.h"
 
-#include "Hash.h"
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StableName.h"
+#include "GetTime.h"
 
 #include <string.h>
 
@@ -36,7 +36,59 @@ static void enlargeStableNameTable(void);
  * stable name.
  */
 
-static HashTable *addrToStableHash = NULL;
+/* Note [Stable name address table]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * The map from objects to stable names is a flat open-addressed table of
+ * (address, stable name) pairs with linear probing, rather than a Hash.c
+ * table, so that every GC can update it quickly and in parallel:
+ *
+ *  - The table has a power of two number of slots, at least twice the size
+ *    of the stable name table, so it is never more than half full of live
+ *    entries.  It grows with the stable name table.
+ *
+ *  - A slot is SN_HASH_EMPTY, SN_HASH_DELETED (a tombstone; no object is at
+ *    an odd address) or in use.  Removing an entry leaves a tombstone, so as
+ *    not to break the probe sequences of the entries after it.
+ *
+ *  - After a minor GC, updateStableNameTable removes the entries of the
+ *    stable names whose objects moved and then inserts their new addresses.
+ *    After a major GC, or when the tombstones would fill the table, it clears
+ *    the table and inserts every live stable name.  Each round divides the
+ *    stable name table into chunks of SN_UPDATE_CHUNK entries that the GC
+ *    threads claim with an atomic counter, using runGcTask (see Note [Running
+ *    tasks on exited GC threads] in GC.c).  A removal only touches the slot
+ *    of its own entry, and the parallel insertions claim empty slots with a
+ *    CAS, so neither needs a lock.  The rounds are separated by runGcTask's
+ *    barrier.
+ *
+ * An entry is removed by matching both the address and the stable name, as
+ * an object can have several stable names: an object with a stable name can
+ * be updated with an indirection to another object that has one, and after
+ * the next GC both stable names point to the latter.
+ */
+
+typedef struct {
+    StgWord addr;   // the object, SN_HASH_EMPTY or SN_HASH_DELETED
+    StgWord sn;     // its index in stable_name_table
+} snHashEntry;
+
+#define SN_HASH_EMPTY   0
+#define SN_HASH_DELETED 1
+
+static snHashEntry *sn_hash = NULL;
+static uint32_t sn_hash_log2 = 0;
+// slots that aren't SN_HASH_EMPTY, tombstones included
+static StgWord sn_hash_used = 0;
+
+#define SN_HASH_SIZE (((StgWord)1) << sn_hash_log2)
+
+#define SN_UPDATE_CHUNK 4096
+
+// Stable names currently in use, and the most there have been
+static StgWord n_stable_names = 0;
+static StgWord max_stable_names = 0;
+
+static StableNameStats stable_name_stats;
 
 void
 stableNameLock(void)
@@ -68,6 +120,117 @@ initSnEntryFreeList(snEntry *table, uint32_t n, snEntry *free)
   stable_name_free = table;
 }
 
+/* -----------------------------------------------------------------------------
+ * The address table, see Note [Stable name address table]
+ * -------------------------------------------------------------------------- */
+
+STATIC_INLINE StgWord
+snHashStart(StgWord addr)
+{
+    // Fibonacci hashing: the top bits of the product are the well-mixed ones
+    return (StgWord)((((uint64_t)addr >> 3) * UINT64_C(0x9e3779b97f4a7c15))
+                     >> (64 - sn_hash_log2));
+}
+
+// Allocate an empty table for SNT_size stable names
+static void
+allocSnHash(void)
+{
+    sn_hash_log2 = 1;
+    while (SN_HASH_SIZE < 2 * (StgWord)SNT_size) {
+        sn_hash_log2++;
+    }
+    sn_hash = stgCallocBytes(SN_HASH_SIZE, sizeof(snHashEntry),
+                             "allocSnHash");
+    sn_hash_used = 0;
+}
+
+static StgWord
+lookupSnHash(StgWord addr)
+{
+    const StgWord mask = SN_HASH_SIZE - 1;
+    for (StgWord i = snHashStart(addr); ; i = (i + 1) & mask) {
+        snHashEntry *e = &sn_hash[i];
+        if (e->addr == addr) {
+            return e->sn;
+        }
+        if (e->addr == SN_HASH_EMPTY) {
+            return 0;
+        }
+    }
+}
+
+// Insert an entry, reusing a tombstone if possible. Not thread-safe.
+static void
+insertSnHash(StgWord addr, StgWord sn)
+{
+    const StgWord mask = SN_HASH_SIZE - 1;
+    snHashEntry *tomb = NULL;
+    StgWord i;
+    for (i = snHashStart(addr); sn_hash[i].addr != SN_HASH_EMPTY;
+         i = (i + 1) & mask) {
+        if (tomb == NULL && sn_hash[i].addr == SN_HASH_DELETED) {
+            tomb = &sn_hash[i];
+        }
+    }
+    if (tomb == NULL) {
+        tomb = &sn_hash[i];
+        sn_hash_used++;
+    }
+    tomb->addr = addr;
+    tomb->sn = sn;
+}
+
+// Insert an entry into an empty slot. Safe to call from several GC threads
+// at once; returns the number of slots it used up.
+static StgWord
+insertSnHashPar(StgWord addr, StgWord sn)
+{
+    const StgWord mask = SN_HASH_SIZE - 1;
+    for (StgWord i = snHashStart(addr); ; i = (i + 1) & mask) {
+        snHashEntry *e = &sn_hash[i];
+        if (RELAXED_LOAD(&e->addr) == SN_HASH_EMPTY &&
+            cas((StgVolatilePtr)&e->addr, SN_HASH_EMPTY, addr) == SN_HASH_EMPTY) {
+            e->sn = sn;
+            return 1;
+        }
+    }
+}
+
+// Remove the entry mapping addr to sn, if there is one. Safe to call from
+// several GC threads at once for different stable names.
+static void
+removeSnHash(StgWord addr, StgWord sn)
+{
+    const StgWord mask = SN_HASH_SIZE - 1;
+    for (StgWord i = snHashStart(addr); ; i = (i + 1) & mask) {
+        snHashEntry *e = &sn_hash[i];
+        StgWord a = RELAXED_LOAD(&e->addr);
+        if (a == addr && e->sn == sn) {
+            RELAXED_STORE(&e->addr, SN_HASH_DELETED);
+            return;
+        }
+        if (a == SN_HASH_EMPTY) {
+            return;
+        }
+    }
+}
+
+// Move the entries to a table big enough for SNT_size stable names
+static void
+growSnHash(void)
+{
+    snHashEntry *old = sn_hash;
+    const StgWord old_size = SN_HASH_SIZE;
+    allocSnHash();
+    for (StgWord i = 0; i < old_size; i++) {
+        if (old[i].addr != SN_HASH_EMPTY && old[i].addr != SN_HASH_DELETED) {
+            insertSnHash(old[i].addr, old[i].sn);
+        }
+    }
+    stgFree(old);
+}
+
 void
 initStableNameTable(void)
 {
@@ -80,7 +243,7 @@ initStableNameTable(void)
      * return NULL if an entry isn't found in the hash table.
      */
     initSnEntryFreeList(stable_name_table + 1,INIT_SNT_SIZE-1,NULL);
-    addrToStableHash = allocHashTable();
+    allocSnHash();
 
 #if defined(THREADED_RTS)
     initMutex(&stable_name_mutex);
@@ -114,9 +277,12 @@ enlargeStableNameTable(void)
 void
 exitStableNameTable(void)
 {
-    if (addrToStableHash)
-        freeHashTable(addrToStableHash, NULL);
-    addrToStableHash = NULL;
+    if (sn_hash)
+        stgFree(sn_hash);
+    sn_hash = NULL;
+    sn_hash_log2 = 0;
+    sn_hash_used = 0;
+    n_stable_names = 0;
 
     if (stable_name_table)
         stgFree(stable_name_table);
@@ -132,7 +298,13 @@ void
 freeSnEntry(snEntry *sn)
 {
   ASSERT(sn->sn_obj == NULL);
-  removeHashTable(addrToStableHash, (W_)sn->old, NULL);
+  StgWord i = sn - stable_name_table;
+  removeSnHash((W_)sn->old, i);
+  if (sn->addr != sn->old && sn->addr != NULL) {
+    // freed outside the GC, after the object moved
+    removeSnHash((W_)sn->addr, i);
+  }
+  n_stable_names--;
   sn->addr = (P_)stable_name_free;
   stable_name_free = sn;
 }
@@ -181,6 +353,7 @@ lookupStableName (StgPtr p)
 
   if (stable_name_free == NULL) {
     enlargeStableNameTable();
+    growSnHash();
   }
 
   /* removing indirections increases the likelihood
@@ -191,7 +364,7 @@ lookupStableName (StgPtr p)
   // register the untagged pointer.  This just makes things simpler.
   p = (StgPtr)UNTAG_CLOSURE((StgClosure*)p);
 
-  StgWord sn = (StgWord)lookupHashTable(addrToStableHash,(W_)p);
+  StgWord sn = lookupSnHash((W_)p);
 
   if (sn != 0) {
     ASSERT(stable_name_table[sn].addr == p);
@@ -207,7 +380,11 @@ lookupStableName (StgPtr p)
   /* debugTrace(DEBUG_stable, "new stable name %d at %p\n",sn,p); */
 
   /* add the new stable name to the hash table */
-  insertHashTable(addrToStableHash, (W_)p, (void *)sn);
+  insertSnHash((W_)p, sn);
+  n_stable_names++;
+  if (n_stable_names > max_stable_names) {
+    max_stable_names = n_stable_names;
+  }
 
   stableNameUnlock();
 
@@ -298,35 +475,127 @@ gcStableNameTable( void )
  * The boolean argument 'full' indicates that a major collection is
  * being done, so we might as well throw away the hash table and build
  * a new one.  For a minor collection, we just re-hash the elements
- * that changed.
+ * that changed.  See Note [Stable name address table].
  * -------------------------------------------------------------------------- */
 
-void
-updateStableNameTable(bool full)
+// The next chunk of the stable name table to update, and the number of
+// stable names that moved
+static StgWord sn_update_next;
+static StgWord sn_update_moved;
+
+STATIC_INLINE bool
+claimSnUpdateChunk(StgWord *from, StgWord *to)
+{
+    *from = atomic_inc((StgVolatilePtr)&sn_update_next, SN_UPDATE_CHUNK)
+              - SN_UPDATE_CHUNK;
+    if (*from >= SNT_size) {
+        return false;
+    }
+    *to = stg_min(*from + SN_UPDATE_CHUNK, SNT_size);
+    return true;
+}
+
+static void
+removeMovedStableNames(void)
+{
+    StgWord from, to, moved = 0;
+    while (claimSnUpdateChunk(&from, &to)) {
+        FOR_EACH_STABLE_NAME_IN(
+            p, from, to, {
+                if (p->addr != p->old) {
+                    removeSnHash((W_)p->old, p - stable_name_table);
+                    moved++;
+                }
+            });
+    }
+    atomic_inc((StgVolatilePtr)&sn_update_moved, moved);
+}
+
+static void
+insertMovedStableNames(void)
 {
-    if (full && addrToStableHash != NULL && 0 != keyCountHashTable(addrToStableHash)) {
-        freeHashTable(addrToStableHash,NULL);
-        addrToStableHash = allocHashTable();
+    StgWord from, to, used = 0;
+    while (claimSnUpdateChunk(&from, &to)) {
+        FOR_EACH_STABLE_NAME_IN(
+            p, from, to, {
+                /* Movement happened: */
+                if (p->addr != p->old && p->addr != NULL) {
+                    used += insertSnHashPar((W_)p->addr, p - stable_name_table);
+                }
+            });
     }
+    atomic_inc((StgVolatilePtr)&sn_hash_used, used);
+}
 
-    if(full) {
-        FOR_EACH_STABLE_NAME(
-            p, {
+static void
+insertAllStableNames(void)
+{
+    StgWord from, to, used = 0;
+    while (claimSnUpdateChunk(&from, &to)) {
+        FOR_EACH_STABLE_NAME_IN(
+            p, from, to, {
                 if (p->addr != NULL) {
                     // Target still alive, Re-hash this stable name
-                    insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
+                    used += insertSnHashPar((W_)p->addr, p - stable_name_table);
                 }
             });
+    }
+    atomic_inc((StgVolatilePtr)&sn_hash_used, used);
+}
+
+static void
+runSnUpdate(void (*task)(void))
+{
+    sn_update_next = 1;
+    // not worth waking up the other GC threads for a small table
+    if (SNT_size > SN_UPDATE_CHUNK) {
+        runGcTask(task);
     } else {
-        FOR_EACH_STABLE_NAME(
-            p, {
-                if (p->addr != p->old) {
-                    removeHashTable(addrToStableHash, (W_)p->old, NULL);
-                    /* Movement happened: */
-                    if (p->addr != NULL) {
-                        insertHashTable(addrToStableHash, (W_)p->addr, (void *)(p - stable_name_table));
-                    }
-                }
-            });
+        task();
+    }
+}
+
+void
+updateStableNameTable(bool full)
+{
+    // As in gcStableNameTable, lest we race with the nonmoving collector
+    stableNameLock();
+    if (n_stable_names == 0 && sn_hash_used == 0) {
+        stableNameUnlock();
+        return;
+    }
+
+    Time start = getProcessElapsedTime();
+
+    if (!full) {
+        sn_update_moved = 0;
+        runSnUpdate(removeMovedStableNames);
+        // Rebuild the table rather than let the tombstones fill it up
+        full = (sn_hash_used + sn_update_moved) > SN_HASH_SIZE / 4 * 3;
+        if (!full) {
+            runSnUpdate(insertMovedStableNames);
+        }
+    }
+
+    if (full) {
+        memset(sn_hash, 0, SN_HASH_SIZE * sizeof(snHashEntry));
+        sn_hash_used = 0;
+        runSnUpdate(insertAllStableNames);
+        stable_name_stats.rebuilds++;
     }
+
+    stable_name_stats.updates++;
+    stable_name_stats.time += getProcessElapsedTime() - start;
+    stableNameUnlock();
+}
+
+void
+getStableNameStats(StableNameStats *stats)
+{
+    *stats = stable_name_stats;
+    stats->max_stable_names = max_stable_names;
+    stats->table_size = SNT_size;
+    stats->hash_size = sn_hash == NULL ? 0 : SN_HASH_SIZE;
+    stats->bytes = stats->table_size * sizeof(snEntry)
+                 + stats->hash_size * sizeof(snHashEntry);
 }
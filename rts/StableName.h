@@ -21,16 +21,34 @@ void    threadStableNameTable ( evac_fn evac, void *user );
 void    gcStableNameTable     ( void );
 void    updateStableNameTable ( bool full );
 
+typedef struct {
+    StgWord max_stable_names; // the most stable names in use at once
+    StgWord table_size;       // entries in the stable name table
+    StgWord hash_size;        // slots in the address table
+    StgWord updates;          // GCs that updated the address table
+    StgWord rebuilds;         // ... of which rebuilt it
+    Time time;                // in updateStableNameTable
+    StgWord bytes;            // held by the two tables
+} StableNameStats;
+
+void    getStableNameStats    ( StableNameStats *stats );
+
 void    stableNameLock            ( void );
 void    stableNameUnlock          ( void );
 
 extern unsigned int SNT_size;
 
 #define FOR_EACH_STABLE_NAME(p, CODE)                                   \
+    FOR_EACH_STABLE_NAME_IN(p, 1, SNT_size, CODE)
+
+// As FOR_EACH_STABLE_NAME, but only over the entries with indices in
+// [from, to) (from must be at least 1).
+#define FOR_EACH_STABLE_NAME_IN(p, from, to, CODE)                      \
     do {                                                                \
         snEntry *p;                                                     \
         snEntry *__end_ptr = &stable_name_table[SNT_size];              \
-        for (p = stable_name_table + 1; p < __end_ptr; p++) {           \
+        snEntry *__to_ptr = &stable_name_table[to];                     \
+        for (p = stable_name_table + (from); p < __to_ptr; p++) {       \
             /* Internal pointers are free slots.  */                    \
             /* If p->addr == NULL, it's a */                            \
             /* stable name where the object has been GC'd, but the */   \
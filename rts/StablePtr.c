@@ -16,6 +16,8 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StablePtr.h"
+#include "Capability.h"
+#include "Task.h"
 
 #include <string.h>
 
@@ -128,6 +130,14 @@ static uint32_t n_old_SPTs = 0;
 
 #if defined(THREADED_RTS)
 Mutex stable_ptr_mutex;
+
+// Set while enlargeStablePtrTable is copying the table; see Note
+// [Per-capability stable pointer free lists].
+static StgWord stable_ptr_enlarging = 0;
+
+// The number of slots a capability moves between its free list and the
+// global one at a time
+#define STABLE_PTR_CHUNK (MAX_CAP_FREE_STABLE_PTRS / 2)
 #endif
 
 static void enlargeStablePtrTable(void);
@@ -193,6 +203,17 @@ enlargeStablePtrTable(void)
     uint32_t old_SPT_size = SPT_size;
     spEntry *new_stable_ptr_table;
 
+#if defined(THREADED_RTS)
+    // Wait for the capabilities writing to the table without the lock; see
+    // Note [Per-capability stable pointer free lists].
+    SEQ_CST_STORE(&stable_ptr_enlarging, 1);
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        while (SEQ_CST_LOAD(&getCapability(i)->stable_ptr_busy)) {
+            busy_wait_nop();
+        }
+    }
+#endif
+
     // 2nd and subsequent times
     SPT_size *= 2;
 
@@ -215,6 +236,10 @@ enlargeStablePtrTable(void)
      */
     RELEASE_STORE(&stable_ptr_table, new_stable_ptr_table);
 
+#if defined(THREADED_RTS)
+    RELEASE_STORE(&stable_ptr_enlarging, 0);
+#endif
+
     // add the new entries to the free list
     initSpEntryFreeList(stable_ptr_table + old_SPT_size, old_SPT_size);
 }
@@ -234,6 +259,44 @@ enlargeStablePtrTable(void)
  * than that required to hold the current version.
  */
 
+/* Note [Per-capability stable pointer free lists]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Programs making many FFI callbacks create and free StablePtrs at a high
+ * rate from every capability, and taking stable_ptr_mutex for each one makes
+ * it the most contended lock in the RTS.  So in the threaded RTS each
+ * Capability keeps up to MAX_CAP_FREE_STABLE_PTRS free slots of the table
+ * (cap->free_stable_ptrs), and getStablePtr and freeStablePtr called by the
+ * Task holding a capability use those without taking the lock:
+ *
+ *  - getStablePtr pops a slot from the capability's list; when the list is
+ *    empty it first takes STABLE_PTR_CHUNK slots from the global free list
+ *    (enlarging the table if need be) under the lock.
+ *
+ *  - freeStablePtr pushes the slot onto the capability's list; when the list
+ *    is full it first returns STABLE_PTR_CHUNK slots to the global free list
+ *    under the lock.
+ *
+ * A slot on a capability's list has addr == NULL, so the GC ignores it, and it
+ * isn't linked to anything that could go stale when the table is enlarged.
+ * Calls from threads not holding a capability (e.g. hs_free_stable_ptr from a
+ * foreign thread) use the global free list under the lock as before.
+ *
+ * Writing a slot without the lock would race with enlargeStablePtrTable
+ * copying the table: the write could land in the old table after the copy
+ * and be lost.  So a capability sets cap->stable_ptr_busy while it writes,
+ * and enlargeStablePtrTable (which holds the lock) sets stable_ptr_enlarging
+ * and waits until no capability is busy before copying.  The two flags are
+ * set and tested with sequentially consistent accesses (Dekker style), so
+ * either the enlarging thread sees the capability busy and waits, or the
+ * capability sees stable_ptr_enlarging and takes the lock instead, by which
+ * time the new table is in place.  A busy capability never blocks, so the
+ * wait is short.
+ *
+ * Slots on the list of a capability that is disabled by setNumCapabilities
+ * stay there until it is enabled again; there are at most
+ * MAX_CAP_FREE_STABLE_PTRS of them per capability.
+ */
+
 
 /* -----------------------------------------------------------------------------
  * Freeing entries and tables
@@ -266,6 +329,15 @@ exitStablePtrTable(void)
 #endif
 }
 
+// The bytes held by the table, and by the old tables that the next GC
+// will free: each of those is half the size of the one that replaced it.
+StgWord
+stablePtrTableBytes(void)
+{
+    StgWord old = SPT_size - (SPT_size >> n_old_SPTs);
+    return (SPT_size + old) * sizeof(spEntry);
+}
+
 STATIC_INLINE void
 freeSpEntry(spEntry *sp)
 {
@@ -290,9 +362,97 @@ freeStablePtrUnsafe(StgStablePtr sp)
     freeSpEntry(&stable_ptr_table[spw]);
 }
 
+#if defined(THREADED_RTS)
+// The capability the calling Task holds, or NULL if it doesn't hold one
+STATIC_INLINE Capability *
+stablePtrCapability(void)
+{
+    Task *task = myTask();
+    if (task == NULL || task->cap == NULL) {
+        return NULL;
+    }
+    if (RELAXED_LOAD(&task->cap->running_task) != task) {
+        return NULL;
+    }
+    return task->cap;
+}
+
+// Start writing to the table without holding the lock. Returns false if the
+// table is being enlarged, in which case we must take the lock instead. See
+// Note [Per-capability stable pointer free lists].
+STATIC_INLINE bool
+beginStablePtrWrite(Capability *cap)
+{
+    SEQ_CST_STORE(&cap->stable_ptr_busy, 1);
+    if (SEQ_CST_LOAD(&stable_ptr_enlarging)) {
+        RELEASE_STORE(&cap->stable_ptr_busy, 0);
+        return false;
+    }
+    return true;
+}
+
+STATIC_INLINE void
+endStablePtrWrite(Capability *cap)
+{
+    RELEASE_STORE(&cap->stable_ptr_busy, 0);
+}
+
+// Take a chunk of free slots from the global free list
+static void
+refillCapabilityStablePtrs(Capability *cap)
+{
+    stablePtrLock();
+
+    if (!stable_ptr_free)
+        enlargeStablePtrTable();
+
+    while (stable_ptr_free && cap->n_free_stable_ptrs < STABLE_PTR_CHUNK) {
+        spEntry *free = stable_ptr_free;
+        stable_ptr_free = (spEntry*)(free->addr);
+        RELAXED_STORE(&free->addr, NULL);
+        cap->free_stable_ptrs[cap->n_free_stable_ptrs++] =
+            free - stable_ptr_table;
+    }
+
+    stablePtrUnlock();
+}
+
+// Return a chunk of free slots to the global free list
+static void
+flushCapabilityStablePtrs(Capability *cap)
+{
+    stablePtrLock();
+
+    while (cap->n_free_stable_ptrs > MAX_CAP_FREE_STABLE_PTRS - STABLE_PTR_CHUNK) {
+        StgWord spw = cap->free_stable_ptrs[--cap->n_free_stable_ptrs];
+        freeSpEntry(&stable_ptr_table[spw]);
+    }
+
+    stablePtrUnlock();
+}
+#endif
+
 void
 freeStablePtr(StgStablePtr sp)
 {
+#if defined(THREADED_RTS)
+    // see Note [Per-capability stable pointer free lists]
+    Capability *cap = stablePtrCapability();
+    if (cap != NULL && sp != NULL) {
+        if (cap->n_free_stable_ptrs == MAX_CAP_FREE_STABLE_PTRS) {
+            flushCapabilityStablePtrs(cap);
+        }
+        if (beginStablePtrWrite(cap)) {
+            // see Note [NULL StgStablePtr]
+            StgWord spw = (StgWord)sp - 1;
+            RELAXED_STORE(&ACQUIRE_LOAD(&stable_ptr_table)[spw].addr, NULL);
+            endStablePtrWrite(cap);
+            cap->free_stable_ptrs[cap->n_free_stable_ptrs++] = spw;
+            return;
+        }
+    }
+#endif
+
     stablePtrLock();
 
     freeStablePtrUnsafe(sp);
@@ -307,6 +467,24 @@ freeStablePtr(StgStablePtr sp)
 StgStablePtr
 getStablePtr(StgPtr p)
 {
+#if defined(THREADED_RTS)
+  // see Note [Per-capability stable pointer free lists]
+  Capability *cap = stablePtrCapability();
+  if (cap != NULL) {
+      if (cap->n_free_stable_ptrs == 0) {
+          refillCapabilityStablePtrs(cap);
+      }
+      if (beginStablePtrWrite(cap)) {
+          StgWord sp = cap->free_stable_ptrs[--cap->n_free_stable_ptrs];
+          // release store to pair with acquire load in deRefStablePtr
+          RELEASE_STORE(&ACQUIRE_LOAD(&stable_ptr_table)[sp].addr, p);
+          endStablePtrWrite(cap);
+          // see Note [NULL StgStablePtr]
+          return (StgStablePtr)(sp + 1);
+      }
+  }
+#endif
+
   stablePtrLock();
 
   if (!stable_ptr_free)
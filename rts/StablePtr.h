@@ -35,6 +35,8 @@ void    markStablePtrTable    ( evac_fn evac, void *user );
 
 void    threadStablePtrTable  ( evac_fn evac, void *user );
 
+StgWord stablePtrTableBytes   ( void );
+
 void    stablePtrLock         ( void );
 void    stablePtrUnlock       ( void );
 
@@ -14,12 +14,55 @@
 #include "Hash.h"
 #include "StablePtr.h"
 
+#include <stdlib.h>
+
 static HashTable * spt = NULL;
 
 #if defined(THREADED_RTS)
 static Mutex spt_lock;
 #endif
 
+/* Note [Looking up static pointers without the lock]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Programs that send static pointers between processes look one up on every
+   remote call, often from many threads, while entries are only inserted and
+   removed when an object is loaded or unloaded. So the hash table, which is
+   kept under spt_lock, is only for inserting, removing and listing the keys;
+   hs_spt_lookup uses spt_index instead, an immutable array of the keys and
+   their stable pointers sorted by key, and searches it without taking the
+   lock.
+
+   Inserting or removing an entry sets spt_index to NULL, and the next lookup
+   builds a new one under the lock; so a load, which inserts an entry for
+   every static pointer of the object, builds the index once, not once per
+   entry. An index that has been replaced may still be in use by a lookup, so
+   it goes on spt_old_indexes, which is freed by exitStaticPtrTable: there is
+   one for each batch of loads and unloads that is followed by a lookup.
+
+   The stable pointer of a removed entry is freed straight away (keeping it
+   would keep the unloaded object alive). A lookup racing with the removal
+   may find it in the old index and read the stable pointer table after it
+   was freed, so after reading it the lookup checks that spt_index hasn't
+   changed, and tries again if it has. hs_spt_remove publishes the change to
+   spt_index before freeing the stable pointer, and deRefStablePtr's read of
+   the table is an acquire load, so if the lookup saw the free it also sees
+   the new spt_index.
+*/
+
+typedef struct {
+  StgWord64 key[2];
+  StgStablePtr sp;
+} SptIndexEntry;
+
+typedef struct SptIndex_ {
+  uint32_t n_entries;
+  struct SptIndex_ *next_old;
+  SptIndexEntry entries[];
+} SptIndex;
+
+static SptIndex *spt_index = NULL;
+static SptIndex *spt_old_indexes = NULL;
+
 /// Hash function for the SPT.
 STATIC_INLINE int hashFingerprint(const HashTable *table, StgWord key) {
   const StgWord64* ptr = (StgWord64*) key;
@@ -34,6 +77,56 @@ STATIC_INLINE int compareFingerprint(StgWord a, StgWord b) {
   return *ptra == *ptrb && *(ptra + 1) == *(ptrb + 1);
 }
 
+// Drop the index after a change to the table. Called with spt_lock held.
+static void invalidateSptIndex(void) {
+  SptIndex *idx = spt_index;
+  if (idx != NULL) {
+    RELEASE_STORE(&spt_index, NULL);
+    idx->next_old = spt_old_indexes;
+    spt_old_indexes = idx;
+  }
+}
+
+static void addSptIndexEntry(void *data, StgWord key, const void *value) {
+  SptIndex *idx = (SptIndex *)data;
+  SptIndexEntry *e = &idx->entries[idx->n_entries++];
+  e->key[0] = ((StgWord64 *)key)[0];
+  e->key[1] = ((StgWord64 *)key)[1];
+  e->sp = *(const StgStablePtr *)value;
+}
+
+static int compareSptIndexEntries(const void *a, const void *b) {
+  const SptIndexEntry *ea = (const SptIndexEntry *)a;
+  const SptIndexEntry *eb = (const SptIndexEntry *)b;
+  if (ea->key[0] != eb->key[0]) {
+    return ea->key[0] < eb->key[0] ? -1 : 1;
+  }
+  if (ea->key[1] != eb->key[1]) {
+    return ea->key[1] < eb->key[1] ? -1 : 1;
+  }
+  return 0;
+}
+
+// see Note [Looking up static pointers without the lock]
+static SptIndex *buildSptIndex(void) {
+  ACQUIRE_LOCK(&spt_lock);
+  SptIndex *idx = spt_index;
+  if (idx == NULL) {
+    const int n = keyCountHashTable(spt);
+    idx = stgMallocBytes(sizeof(SptIndex) + n * sizeof(SptIndexEntry),
+                         "buildSptIndex");
+    idx->n_entries = 0;
+    idx->next_old = NULL;
+    mapHashTable(spt, idx, addSptIndexEntry);
+    ASSERT(idx->n_entries == (uint32_t)n);
+    qsort(idx->entries, idx->n_entries, sizeof(SptIndexEntry),
+          compareSptIndexEntries);
+    RELEASE_STORE(&spt_index, idx);
+  }
+  RELEASE_LOCK(&spt_lock);
+  return idx;
+}
+
 void hs_spt_insert_stableptr(StgWord64 key[2], StgStablePtr *entry) {
   // hs_spt_insert is called from constructor functions, so
   // the SPT needs to be initialized here.
@@ -46,6 +139,7 @@ void hs_spt_insert_stableptr(StgWord64 key[2], StgStablePtr *entry) {
 
   ACQUIRE_LOCK(&spt_lock);
   insertHashTable_(spt, (StgWord)key, entry, hashFingerprint);
+  invalidateSptIndex();
   RELEASE_LOCK(&spt_lock);
 }
 
@@ -70,23 +164,46 @@ void hs_spt_remove(StgWord64 key[2]) {
      ACQUIRE_LOCK(&spt_lock);
      StgStablePtr* entry = removeHashTable_(spt, (StgWord)key, NULL,
         hashFingerprint, compareFingerprint);
+     if (entry)
+       invalidateSptIndex();
      RELEASE_LOCK(&spt_lock);
 
-     if (entry)
+     if (entry) {
+       // see Note [Looking up static pointers without the lock]
+       RELEASE_FENCE();
        freeSptEntry(entry);
+     }
    }
 }
 
+// see Note [Looking up static pointers without the lock]
 StgPtr hs_spt_lookup(StgWord64 key[2]) {
-  if (spt) {
-    ACQUIRE_LOCK(&spt_lock);
-    const StgStablePtr * entry = lookupHashTable_(spt, (StgWord)key,
-        hashFingerprint, compareFingerprint);
-    const StgPtr ret = entry ? deRefStablePtr(*entry) : NULL;
-    RELEASE_LOCK(&spt_lock);
-    return ret;
-  } else
+  if (spt == NULL)
     return NULL;
+
+  while (true) {
+    SptIndex *idx = ACQUIRE_LOAD(&spt_index);
+    if (idx == NULL)
+      idx = buildSptIndex();
+
+    StgPtr ret = NULL;
+    uint32_t lo = 0, hi = idx->n_entries;
+    while (lo < hi) {
+      const uint32_t mid = lo + (hi - lo) / 2;
+      const SptIndexEntry *e = &idx->entries[mid];
+      if (e->key[0] < key[0] || (e->key[0] == key[0] && e->key[1] < key[1])) {
+        lo = mid + 1;
+      } else if (e->key[0] == key[0] && e->key[1] == key[1]) {
+        ret = deRefStablePtr(e->sp);
+        break;
+      } else {
+        hi = mid;
+      }
+    }
+
+    if (RELAXED_LOAD(&spt_index) == idx)
+      return ret;
+  }
 }
 
 int hs_spt_keys(StgPtr keys[], int szKeys) {
@@ -107,6 +224,14 @@ void exitStaticPtrTable(void) {
   if (spt) {
     freeHashTable(spt, freeSptEntry);
     spt = NULL;
+    if (spt_index != NULL)
+      stgFree(spt_index);
+    spt_index = NULL;
+    while (spt_old_indexes != NULL) {
+      SptIndex *next = spt_old_indexes->next_old;
+      stgFree(spt_old_indexes);
+      spt_old_indexes = next;
+    }
 #if defined(THREADED_RTS)
     closeMutex(&spt_lock);
 #endif
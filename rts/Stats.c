@@ -21,14 +21,39 @@
 
 // for spin/yield counters
 #include "sm/GC.h"
+#include "sm/MarkWeak.h"
+#include "sm/NonMoving.h"
+#include "sm/NonMovingMark.h" // nonmoving_mark_prefetch_depth
+#include "sm/NonMovingSizeClasses.h"
+#include "sm/NonMovingCensus.h"
 #include "ThreadPaused.h"
 #include "Messages.h"
+#include "BlackHoles.h"
+#include "linker/M32Alloc.h"
+#include "linker/MMap.h"
+#include "CheckUnload.h"
+#include "Weak.h"
+#include "StableName.h"
+#include "StablePtr.h"
+#include "Hash.h"
+#include "IPE.h"
+#if defined(TRACING)
+#include "eventlog/EventLog.h"
+#endif
+#if defined(mingw32_HOST_OS)
+#include "win32/AsyncWinIO.h"
+#if !defined(THREADED_RTS)
+#include "win32/MIOManager.h"
+#endif
+#endif
 
 #include <string.h> // for memset
 
 #if defined(THREADED_RTS)
 // Protects all statistics below
 Mutex stats_mutex;
+// protects the --stats-stream file; see Note [Streaming statistics]
+static Mutex stats_stream_mutex;
 #endif
 
 static Time
@@ -65,6 +90,25 @@ static RTSStats stats;
 
 static W_ GC_end_faults = 0;
 
+// Peak, sampled after each major GC, of the free space in partially used
+// megablocks (see n_free_list_blocks).  Memory here can be reused for small
+// groups but not for anything of a megablock or more.
+static uint64_t max_partial_mblock_free_bytes = 0;
+
+// Remembered set scanning of mutable arrays, see scavenge_cards() in Scav.c
+static uint64_t rs_array_elems_total = 0;
+static uint64_t rs_scanned_elems_total = 0;
+static uint64_t rs_scanned_cards_total = 0;
+static uint64_t rs_entries_total = 0;
+static uint64_t rs_duplicates_total = 0;
+static Time rs_scan_time_total = 0;
+static uint64_t selectors_eliminated_total = 0;
+static uint64_t selectors_deferred_total = 0;
+static uint64_t copy_races_total = 0;
+static uint64_t copy_race_words_total = 0;
+static uint64_t static_scavenged_total = 0;
+static Time static_scan_time_total = 0;
+
 static Time *GC_coll_cpu = NULL;
 static Time *GC_coll_elapsed = NULL;
 static Time *GC_coll_max_pause = NULL;
@@ -73,6 +117,8 @@ static int statsPrintf( char *s, ... ) STG_PRINTF_ATTR(1, 2);
 static void statsFlush( void );
 static void statsClose( void );
 
+static void writeStatsStream (const char *reason, bool census);
+
 /* -----------------------------------------------------------------------------
    Current elapsed time
    ------------------------------------------------------------------------- */
@@ -82,6 +128,79 @@ Time stat_getElapsedTime(void)
     return getProcessElapsedTime() - start_init_elapsed;
 }
 
+/* -----------------------------------------------------------------------------
+   Histograms of pause times
+
+   Note [Pause histograms]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   The total and maximum pause times shown by +RTS -s say little about the
+   pauses a service sees most of the time, so RTSStats also keeps the
+   distribution of the elapsed time of minor and of major GCs, of the
+   synchronisation before each GC, and of the post-mark pauses of the nonmoving
+   collector, from which getRTSHistogramPercentile gives p50, p99 and so on.
+
+   The histograms are log-linear, in the manner of HdrHistogram: a duration d
+   of at least 2^s ns (s = RTS_HIST_SUB_BITS), whose highest set bit is bit e,
+   goes in one of 2^s buckets for the range [2^e, 2^(e+1)), chosen by its s
+   bits after the highest; shorter ones get a bucket each. Every bucket is
+   thus at most 1/2^s of the values in it wide, a 6% error for s = 4, in a
+   fixed 4.7kB per histogram, and recording a pause is a few instructions.
+   They are updated under stats_mutex, with the times they record, so only
+   when those are measured (+RTS -T or -s).
+   -------------------------------------------------------------------------- */
+
+static uint32_t histBucket (Time t)
+{
+    if (t < ((Time)1 << RTS_HIST_SUB_BITS)) {
+        return t < 0 ? 0 : (uint32_t)t;
+    }
+    if (t >= ((Time)1 << RTS_HIST_MAX_BITS)) {
+        return RTS_HIST_BUCKETS - 1;
+    }
+    uint32_t e = 63 - __builtin_clzll((uint64_t)t);
+    uint32_t sub = (uint32_t)(t >> (e - RTS_HIST_SUB_BITS));
+    return ((e - RTS_HIST_SUB_BITS + 1) << RTS_HIST_SUB_BITS)
+        + sub - (1 << RTS_HIST_SUB_BITS);
+}
+
+// The largest duration that goes in the bucket
+static Time histBucketEnd (uint32_t b)
+{
+    if (b < (1 << RTS_HIST_SUB_BITS)) {
+        return b;
+    }
+    uint32_t e = (b >> RTS_HIST_SUB_BITS) - 1 + RTS_HIST_SUB_BITS;
+    Time sub = (b & ((1 << RTS_HIST_SUB_BITS) - 1)) + (1 << RTS_HIST_SUB_BITS);
+    return ((sub + 1) << (e - RTS_HIST_SUB_BITS)) - 1;
+}
+
+static void histRecord (RTSHistogram *hist, Time t)
+{
+    hist->count++;
+    hist->buckets[histBucket(t)]++;
+}
+
+Time getRTSHistogramPercentile (const RTSHistogram *hist, double fraction)
+{
+    if (hist->count == 0) {
+        return 0;
+    }
+    // the rank of the duration we want, rounded up, counting from 1
+    double want = fraction * (double)hist->count;
+    uint64_t rank = (uint64_t)want;
+    if ((double)rank < want || rank == 0) {
+        rank++;
+    }
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < RTS_HIST_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank) {
+            return histBucketEnd(b);
+        }
+    }
+    return histBucketEnd(RTS_HIST_BUCKETS - 1);
+}
+
 /* ---------------------------------------------------------------------------
    Measure the current MUT time, for profiling
    ------------------------------------------------------------------------ */
@@ -108,6 +227,7 @@ initStats0(void)
 {
 #if defined(THREADED_RTS)
     initMutex(&stats_mutex);
+    initMutex(&stats_stream_mutex);
 #endif
 
     start_init_cpu    = 0;
@@ -139,6 +259,19 @@ initStats0(void)
 #endif
 
     GC_end_faults = 0;
+    max_partial_mblock_free_bytes = 0;
+    rs_array_elems_total = 0;
+    rs_scanned_elems_total = 0;
+    rs_scanned_cards_total = 0;
+    rs_entries_total = 0;
+    rs_duplicates_total = 0;
+    rs_scan_time_total = 0;
+    selectors_eliminated_total = 0;
+    selectors_deferred_total = 0;
+    copy_races_total = 0;
+    copy_race_words_total = 0;
+    static_scavenged_total = 0;
+    static_scan_time_total = 0;
 
     stats = (RTSStats) {
         .gcs = 0,
@@ -219,6 +352,10 @@ initStats1 (void)
             sizeof(Time)*RtsFlags.GcFlags.generations,
             "initStats");
     initGenerationStats();
+
+    if (RtsFlags.MiscFlags.perfCounters) {
+        initPerfCounters();
+    }
 }
 
 void
@@ -275,6 +412,24 @@ stat_startExit(void)
     RELEASE_LOCK(&stats_mutex);
 }
 
+/* -----------------------------------------------------------------------------
+   The CPU time used by the whole process, by all collections and by major
+   collections alone, as of the end of the last GC. Concurrent marking counts
+   as major collection time. Used by the -Fauto sizing policy, see
+   Note [Adaptive generation sizing] in GC.c.
+   -------------------------------------------------------------------------- */
+
+void
+stat_getGCCpuTimes (Time *cpu, Time *gc_cpu, Time *major_gc_cpu)
+{
+    ACQUIRE_LOCK(&stats_mutex);
+    *cpu = stats.cpu_ns;
+    *gc_cpu = stats.gc_cpu_ns + stats.nonmoving_gc_cpu_ns;
+    *major_gc_cpu = GC_coll_cpu[RtsFlags.GcFlags.generations-1]
+                    + stats.nonmoving_gc_cpu_ns;
+    RELEASE_LOCK(&stats_mutex);
+}
+
 /* -----------------------------------------------------------------------------
    Nonmoving (concurrent) collector statistics
 
@@ -341,6 +496,7 @@ stat_endNonmovingGcSync (void)
     stats.nonmoving_gc_sync_max_elapsed_ns =
       stg_max(stats.gc.nonmoving_gc_sync_elapsed_ns,
               stats.nonmoving_gc_sync_max_elapsed_ns);
+    histRecord(&stats.nonmoving_sync_hist, stats.gc.nonmoving_gc_sync_elapsed_ns);
     Time sync_elapsed = stats.gc.nonmoving_gc_sync_elapsed_ns;
     RELEASE_LOCK(&stats_mutex);
 
@@ -395,26 +551,62 @@ stat_endNonmovingGcSync (void)
 void
 stat_startGCWorker (Capability *cap STG_UNUSED, gc_thread *gct)
 {
+    perfPhaseStart(PERF_GC_COPY);
+
     bool stats_enabled =
         RtsFlags.GcFlags.giveStats != NO_GC_STATS ||
         rtsConfig.gcDoneHook != NULL;
 
-    if (stats_enabled || RtsFlags.ProfFlags.doHeapProfile) {
+    if (stats_enabled || RtsFlags.ProfFlags.doHeapProfile
+        || RtsFlags.GcFlags.oldGenFactorAuto) {
         gct->gc_start_cpu = getCurrentThreadCPUTime();
     }
 }
 
 void
-stat_endGCWorker (Capability *cap STG_UNUSED, gc_thread *gct)
+stat_endGCWorker (Capability *cap, gc_thread *gct)
 {
     bool stats_enabled =
         RtsFlags.GcFlags.giveStats != NO_GC_STATS ||
         rtsConfig.gcDoneHook != NULL;
 
-    if (stats_enabled || RtsFlags.ProfFlags.doHeapProfile) {
+    if (stats_enabled || RtsFlags.ProfFlags.doHeapProfile
+        || RtsFlags.GcFlags.oldGenFactorAuto) {
         gct->gc_end_cpu = getCurrentThreadCPUTime();
         ASSERT(gct->gc_end_cpu >= gct->gc_start_cpu);
+        cap->gc_cpu += gct->gc_end_cpu - gct->gc_start_cpu;
     }
+    // See Note [Per-capability and per-generation stats]
+    cap->gcs++;
+
+    perfPhaseEnd(PERF_GC_COPY);
+}
+
+/* -----------------------------------------------------------------------------
+   Mutator time of each capability
+
+   See Note [Per-capability and per-generation stats]
+   -------------------------------------------------------------------------- */
+
+void
+stat_startMutator (Capability *cap)
+{
+    perfPhaseStart(PERF_MUTATOR);
+    if (RtsFlags.GcFlags.giveStats != NO_GC_STATS) {
+        cap->mutator_start_cpu = getCurrentThreadCPUTime();
+    }
+}
+
+void
+stat_endMutator (Capability *cap)
+{
+    if (RtsFlags.GcFlags.giveStats != NO_GC_STATS) {
+        Time now = getCurrentThreadCPUTime();
+        if (now > cap->mutator_start_cpu) {
+            cap->mutator_cpu += now - cap->mutator_start_cpu;
+        }
+    }
+    perfPhaseEnd(PERF_MUTATOR);
 }
 
 void
@@ -424,11 +616,14 @@ stat_startGC (Capability *cap, gc_thread *gct)
         debugBelch("\007");
     }
 
+    perfPhaseStart(PERF_GC_COPY);
+
     bool stats_enabled =
         RtsFlags.GcFlags.giveStats != NO_GC_STATS ||
         rtsConfig.gcDoneHook != NULL;
 
-    if (stats_enabled || RtsFlags.ProfFlags.doHeapProfile) {
+    if (stats_enabled || RtsFlags.ProfFlags.doHeapProfile
+        || RtsFlags.GcFlags.oldGenFactorAuto) {
         gct->gc_start_cpu = getCurrentThreadCPUTime();
     }
 
@@ -458,7 +653,12 @@ void
 stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ slop,
             uint32_t gen, uint32_t par_n_threads, gc_thread **gc_threads,
             W_ par_max_copied, W_ par_balanced_copied, W_ any_work,
-            W_ scav_find_work, W_ max_n_todo_overflow)
+            W_ scav_find_work, W_ max_n_todo_overflow,
+            W_ rs_array_elems, W_ rs_scanned_elems, W_ rs_scanned_cards,
+            W_ rs_entries, W_ rs_duplicates, Time rs_scan_time,
+            W_ selectors_eliminated, W_ selectors_deferred,
+            W_ copy_races, W_ copy_race_words,
+            W_ static_scavenged, Time static_scan_time)
 {
     ACQUIRE_LOCK(&stats_mutex);
 
@@ -492,7 +692,8 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
         rtsConfig.gcDoneHook != NULL;
 
     if (stats_enabled
-      || RtsFlags.ProfFlags.doHeapProfile) // heap profiling needs GC_tot_time
+      || RtsFlags.ProfFlags.doHeapProfile // heap profiling needs GC_tot_time
+      || RtsFlags.GcFlags.oldGenFactorAuto) // so does -Fauto
     {
         // We only update the times when stats are explicitly enabled since
         // getProcessTimes (e.g. requiring a system call) can be expensive on
@@ -521,6 +722,12 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
             gct->gc_end_cpu = 0;
             gct->gc_start_cpu = 0;
         }
+
+        // See Note [Pause histograms]
+        histRecord(gen == RtsFlags.GcFlags.generations-1
+                     ? &stats.major_pause_hist : &stats.minor_pause_hist,
+                   stats.gc.elapsed_ns);
+        histRecord(&stats.sync_hist, stats.gc.sync_elapsed_ns);
     }
     // -------------------------------------------------
     // Update the cumulative stats
@@ -549,6 +756,19 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
     stats.gc_cpu_ns += stats.gc.cpu_ns;
     stats.gc_elapsed_ns += stats.gc.elapsed_ns;
 
+    rs_array_elems_total += rs_array_elems;
+    rs_scanned_elems_total += rs_scanned_elems;
+    rs_scanned_cards_total += rs_scanned_cards;
+    rs_entries_total += rs_entries;
+    rs_duplicates_total += rs_duplicates;
+    rs_scan_time_total += rs_scan_time;
+    selectors_eliminated_total += selectors_eliminated;
+    selectors_deferred_total += selectors_deferred;
+    copy_races_total += copy_races;
+    copy_race_words_total += copy_race_words;
+    static_scavenged_total += static_scavenged;
+    static_scan_time_total += static_scan_time;
+
     if (gen == RtsFlags.GcFlags.generations-1) { // major GC?
         stats.major_gcs++;
         if (stats.gc.live_bytes > stats.max_live_bytes) {
@@ -563,6 +783,10 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
         if (stats.gc.slop_bytes > stats.max_slop_bytes) {
             stats.max_slop_bytes = stats.gc.slop_bytes;
         }
+        uint64_t partial_free_bytes = (uint64_t)n_free_list_blocks * BLOCK_SIZE;
+        if (partial_free_bytes > max_partial_mblock_free_bytes) {
+            max_partial_mblock_free_bytes = partial_free_bytes;
+        }
         stats.cumulative_live_bytes += stats.gc.live_bytes;
     }
 
@@ -642,6 +866,13 @@ stat_endGC (Capability *cap, gc_thread *initiating_gct, W_ live, W_ copied, W_ s
                            n_alloc_blocks * BLOCK_SIZE);
     }
     RELEASE_LOCK(&stats_mutex);
+
+    // See Note [Streaming statistics]
+    if (RtsFlags.GcFlags.statsStreamFile != NULL
+        && RtsFlags.GcFlags.statsStreamTicks == 0
+        && gen == RtsFlags.GcFlags.generations-1) {
+        writeStatsStream("major-gc", false);
+    }
 }
 
 /* -----------------------------------------------------------------------------
@@ -661,6 +892,25 @@ stat_startRP(void)
 }
 #endif /* PROFILING */
 
+/* -----------------------------------------------------------------------------
+   Called at the end of each slice of an incremental Retainer Profiling but
+   the last, see Note [Incremental retainer profiling]
+   -------------------------------------------------------------------------- */
+
+#if defined(PROFILING)
+void
+stat_pauseRP(void)
+{
+    Time user, elapsed;
+    getProcessTimes( &user, &elapsed );
+
+    ACQUIRE_LOCK(&stats_mutex);
+    RP_tot_time += user - RP_start_time;
+    RPe_tot_time += elapsed - RPe_start_time;
+    RELEASE_LOCK(&stats_mutex);
+}
+#endif /* PROFILING */
+
 /* -----------------------------------------------------------------------------
    Called at the end of each Retainer Profiling
    -------------------------------------------------------------------------- */
@@ -670,7 +920,9 @@ void
 stat_endRP(
   uint32_t retainerGeneration,
   int maxStackSize,
-  double averageNumVisit)
+  double averageNumVisit,
+  uint32_t numRetainerSets,
+  W_ retainerSetBytes)
 {
     Time user, elapsed;
     getProcessTimes( &user, &elapsed );
@@ -686,6 +938,8 @@ stat_endRP(
     fprintf(prof_file, "\tMax auxiliary stack size = %u\n", maxStackSize);
     fprintf(prof_file, "\tAverage number of visits per object = %f\n",
             averageNumVisit);
+    fprintf(prof_file, "\tRetainer sets = %u, using %" FMT_Word " bytes\n",
+            numRetainerSets, retainerSetBytes);
 }
 #endif /* PROFILING */
 
@@ -809,6 +1063,15 @@ static void init_RTSSummaryStats(RTSSummaryStats* sum)
     memset(sum->gc_summary_stats, 0, sizeof_gc_summary_stats);
 }
 
+static void summarisePauses(PauseSummaryStats *sum, const RTSHistogram *hist)
+{
+    sum->count = hist->count;
+    sum->p50_ns = getRTSHistogramPercentile(hist, 0.5);
+    sum->p90_ns = getRTSHistogramPercentile(hist, 0.9);
+    sum->p99_ns = getRTSHistogramPercentile(hist, 0.99);
+    sum->p999_ns = getRTSHistogramPercentile(hist, 0.999);
+}
+
 static void free_RTSSummaryStats(RTSSummaryStats * sum)
 {
     stgFree(sum->gc_summary_stats);
@@ -816,6 +1079,100 @@ static void free_RTSSummaryStats(RTSSummaryStats * sum)
 }
 
 // Must hold stats_mutex.
+#if defined(mingw32_HOST_OS)
+/* One line per histogram: the number of values below each power of two,
+   leaving out the empty buckets.  */
+static void printWinIOHistogram(const char *title, const char *unit,
+                                const uint64_t *hist)
+{
+    statsPrintf("    %-11s", title);
+    for (uint32_t i = 0; i < WINIO_HIST_BUCKETS; i++) {
+        if (hist[i] == 0) {
+            continue;
+        }
+        if (i == WINIO_HIST_BUCKETS - 1) {
+            statsPrintf(" >=%" FMT_Word64 "%s: %" FMT_Word64,
+                        (uint64_t)1 << (i - 1), unit, hist[i]);
+        } else {
+            statsPrintf(" <%" FMT_Word64 "%s: %" FMT_Word64,
+                        (uint64_t)1 << i, unit, hist[i]);
+        }
+    }
+    statsPrintf("\n");
+}
+#endif
+
+static void printPauses(const char *what, const PauseSummaryStats *pauses)
+{
+    statsPrintf("  %-24s %12" FMT_Word64 "    %6.4fs    %6.4fs    %6.4fs    %6.4fs\n",
+                what, pauses->count,
+                TimeToSecondsDbl(pauses->p50_ns),
+                TimeToSecondsDbl(pauses->p90_ns),
+                TimeToSecondsDbl(pauses->p99_ns),
+                TimeToSecondsDbl(pauses->p999_ns));
+}
+
+static void printMemoryUsage(const char *what, uint64_t bytes)
+{
+    if (bytes > 0) {
+        statsPrintf("    %-28s %12.1f KiB\n", what, bytes / 1024.0);
+    }
+}
+
+static const char *perf_phase_names[PERF_PHASES] = {
+    [PERF_MUTATOR]         = "mutator",
+    [PERF_GC_COPY]         = "gc_copy",
+    [PERF_NONMOVING_MARK]  = "nonmoving_mark",
+    [PERF_NONMOVING_SWEEP] = "nonmoving_sweep",
+};
+
+static const char *perf_counter_names[PERF_COUNTERS] = {
+    [PERF_CYCLES]       = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_LLC_MISSES]   = "llc_misses",
+    [PERF_DTLB_MISSES]  = "dtlb_misses",
+};
+
+static void printPerfCount(const RTSSummaryStats *sum, const PerfCounts *counts,
+                           PerfCounter c)
+{
+    if (sum->perf_available[c]) {
+        statsPrintf(" %15" FMT_Word64, counts->counts[c]);
+    } else {
+        statsPrintf(" %15s", "n/a");
+    }
+}
+
+// See Note [Hardware performance counters] in PerfCounters.c
+static void printPerfCounters(const RTSSummaryStats *sum)
+{
+    statsPrintf("  PERF COUNTERS            cycles    instructions    IPC"
+                "      LLC misses     dTLB misses\n");
+    for (int p = 0; p < PERF_PHASES; p++) {
+        if ((p == PERF_NONMOVING_MARK || p == PERF_NONMOVING_SWEEP)
+            && !RtsFlags.GcFlags.useNonmoving) {
+            continue;
+        }
+        const PerfCounts *counts = &sum->perf[p];
+        statsPrintf("  %-15s", perf_phase_names[p]);
+        printPerfCount(sum, counts, PERF_CYCLES);
+        printPerfCount(sum, counts, PERF_INSTRUCTIONS);
+        if (sum->perf_available[PERF_CYCLES]
+            && sum->perf_available[PERF_INSTRUCTIONS]
+            && counts->counts[PERF_CYCLES] > 0) {
+            statsPrintf(" %6.2f",
+                        (double) counts->counts[PERF_INSTRUCTIONS]
+                        / (double) counts->counts[PERF_CYCLES]);
+        } else {
+            statsPrintf(" %6s", "n/a");
+        }
+        printPerfCount(sum, counts, PERF_LLC_MISSES);
+        printPerfCount(sum, counts, PERF_DTLB_MISSES);
+        statsPrintf("\n");
+    }
+    statsPrintf("\n");
+}
+
 static void report_summary(const RTSSummaryStats* sum)
 {
     // We should do no calculation, other than unit changes and formatting, and
@@ -841,10 +1198,21 @@ static void report_summary(const RTSSummaryStats* sum)
     statsPrintf("%16s bytes maximum slop\n", temp);
 
     statsPrintf("%16" FMT_Word64 " MiB total memory in use (%"
-                FMT_Word64 " MiB lost due to fragmentation)\n\n",
+                FMT_Word64 " MiB lost due to fragmentation)\n",
                 stats.max_mem_in_use_bytes  / (1024 * 1024),
                 sum->fragmentation_bytes / (1024 * 1024));
 
+#if defined(wasm32_HOST_ARCH)
+    // Linear memory never shrinks, so its size is its high-water mark.
+    // It includes the C heap and stack as well as our megablocks.
+    statsPrintf("%16" FMT_Word64 " MiB linear memory\n",
+                (StgWord64)__builtin_wasm_memory_size(0) * 65536 / (1024 * 1024));
+#endif
+
+    showStgWord64(sum->partial_mblock_free_bytes, temp, true/*commas*/);
+    statsPrintf("%16s bytes maximum free in partially used megablocks\n\n",
+                temp);
+
     /* Print garbage collections in each gen */
     statsPrintf("                                     Tot time (elapsed)  Avg pause  Max pause\n");
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
@@ -880,8 +1248,252 @@ static void report_summary(const RTSSummaryStats* sum)
                     TimeToSecondsDbl(stats.nonmoving_gc_max_elapsed_ns));
     }
 
+    /* Print the distributions of pause times; see Note [Pause histograms] */
+    statsPrintf("\n                                 Pauses        p50        p90"
+                "        p99      p99.9\n");
+    printPauses("Minor GC", &sum->minor_pauses);
+    printPauses("Major GC", &sum->major_pauses);
+    printPauses("GC sync", &sum->sync_pauses);
+    if (RtsFlags.GcFlags.useNonmoving) {
+        printPauses("Nonmoving sync", &sum->nonmoving_sync_pauses);
+    }
+
     statsPrintf("\n");
 
+    if (sum->perf_counters) {
+        printPerfCounters(sum);
+    }
+
+    {
+        // See Note [RTS memory by subsystem]
+        RTSMemoryUsage mem;
+        getRTSMemoryUsage(&mem);
+        statsPrintf("  RTS MEMORY AT EXIT:\n");
+        printMemoryUsage("block allocator", mem.block_allocator_bytes);
+        printMemoryUsage("  of which free", mem.block_free_bytes);
+        printMemoryUsage("nonmoving segments", mem.nonmoving_segment_bytes);
+        printMemoryUsage("  of which free", mem.nonmoving_free_segment_bytes);
+        printMemoryUsage("mark queues", mem.mark_queue_bytes);
+        printMemoryUsage("eventlog buffers", mem.eventlog_buffer_bytes);
+        printMemoryUsage("linker", mem.linker_bytes);
+        printMemoryUsage("stable pointer table", mem.stable_ptr_table_bytes);
+        printMemoryUsage("stable name table", mem.stable_name_table_bytes);
+        printMemoryUsage("info table provenance", mem.ipe_bytes);
+        printMemoryUsage("hash tables", mem.hash_table_bytes);
+        statsPrintf("\n");
+    }
+
+    if (RtsFlags.GcFlags.blockCacheSize > 0) {
+        statsPrintf("  BLOCK CACHE: %" FMT_Word64 " hits, %" FMT_Word64
+                    " misses\n\n",
+                    sum->block_cache_hits, sum->block_cache_misses);
+    }
+
+    if (RtsFlags.GcFlags.useNonmoving) {
+        // See Note [Mark prefetch depth]
+        statsPrintf("  MARK PREFETCH DEPTH: %" FMT_Word32 "%s\n\n",
+                    sum->nonmoving_prefetch_depth,
+                    !RtsFlags.GcFlags.nonmovingPrefetchAuto ? ""
+                    : nonmovingMarkPrefetchTuning() ? " (still tuning)"
+                    : " (auto-tuned)");
+
+        // See Note [Profiled size classes]
+        if (RtsFlags.GcFlags.nonmovingProfileSizeClasses) {
+            const uint64_t before = sum->nonmoving_profiled_slop_before;
+            const uint64_t after = sum->nonmoving_profiled_slop_after;
+            if (nonmovingSizeClassesProfiling()) {
+                statsPrintf("  SIZE CLASSES: still profiling\n\n");
+            } else {
+                statsPrintf("  SIZE CLASSES: %" FMT_Word32 " added, slop %"
+                            FMT_Word64 " -> %" FMT_Word64 " bytes on %"
+                            FMT_Word64 " profiled allocations (%.1f%% saved)\n\n",
+                            sum->nonmoving_size_classes_added, before, after,
+                            sum->nonmoving_profiled_allocs,
+                            before == 0 ? 0 : 100.0 * (before - after) / before);
+            }
+        }
+
+        // See Note [Update remembered set handshake]
+        if (sum->nonmoving_handshakes > 0) {
+            const uint64_t answers = sum->nonmoving_handshake_answers;
+            statsPrintf("  UPD REM SET HANDSHAKES: %" FMT_Word32 " handshakes, %"
+                        FMT_Word64 " stragglers, latency %.3fms avg, %.3fms max\n\n",
+                        sum->nonmoving_handshakes,
+                        sum->nonmoving_handshake_stragglers,
+                        answers == 0 ? 0 :
+                          TimeToSecondsDbl(sum->nonmoving_handshake_total_latency_ns)
+                            * 1000 / answers,
+                        TimeToSecondsDbl(sum->nonmoving_handshake_max_latency_ns)
+                          * 1000);
+        }
+    }
+
+    if (sum->rs_array_elems > 0) {
+        statsPrintf("  REMEMBERED SET: %" FMT_Word64 " of %" FMT_Word64
+                    " mutable array elements scanned (%" FMT_Word64
+                    " cards)\n\n",
+                    sum->rs_scanned_elems, sum->rs_array_elems,
+                    sum->rs_scanned_cards);
+    }
+
+    if (sum->rs_entries > 0) {
+        statsPrintf("  MUTABLE LISTS: %" FMT_Word64 " entries scanned in %.3fs"
+                    " (%" FMT_Word64 " duplicates dropped)\n\n",
+                    sum->rs_entries, TimeToSecondsDbl(sum->rs_scan_time_ns),
+                    sum->rs_duplicates);
+    }
+
+    if (sum->selectors_eliminated > 0 || sum->selectors_deferred > 0) {
+        statsPrintf("  SELECTOR THUNKS: %" FMT_Word64 " eliminated, %"
+                    FMT_Word64 " left by the depth or budget limit\n\n",
+                    sum->selectors_eliminated, sum->selectors_deferred);
+    }
+
+    if (sum->copy_races > 0) {
+        // See Note [Racing to copy an object] in sm/Evac.c
+        statsPrintf("  COPY RACES: %" FMT_Word64 " objects copied by two GC"
+                    " threads at once (%" FMT_Word64 " bytes of copies"
+                    " left behind)\n\n",
+                    sum->copy_races, sum->copy_race_bytes);
+    }
+
+    if (sum->cafs_entered > 0 || sum->static_scavenged > 0) {
+        // See Note [Counting CAFs] in sm/Storage.c
+        statsPrintf("  CAFS: %" FMT_Word64 " entered; %" FMT_Word64
+                    " static objects scavenged by major GCs in %.3fs\n\n",
+                    sum->cafs_entered, sum->static_scavenged,
+                    TimeToSecondsDbl(sum->static_scan_time_ns));
+    }
+
+    if (sum->mvar_blocks > 0 || sum->mvar_barges > 0) {
+        // See Note [Barging MVar operations] in PrimOps.cmm
+        statsPrintf("  MVARS: %" FMT_Word64 " blocking waits (%" FMT_Word64
+                    " on cap %" FMT_Word32 "), %" FMT_Word64
+                    " waiters woken to retry\n\n",
+                    sum->mvar_blocks, sum->mvar_blocks_busiest,
+                    sum->mvar_blocks_busiest_cap, sum->mvar_barges);
+    }
+
+    if (sum->bh_duplicates > 0 || sum->bh_blocks > 0) {
+        // See Note [Blackhole contention] in BlackHoles.c
+        statsPrintf("  BLACKHOLES: %" FMT_Word64 " duplicate evaluations"
+                    " suspended, %" FMT_Word64 " blocking waits, %"
+                    FMT_Word32 " sites blackholed eagerly\n\n",
+                    sum->bh_duplicates, sum->bh_blocks, sum->bh_eager_sites);
+    }
+
+    if (sum->threads_created > 0) {
+        // See Note [Reusing thread stacks] in Threads.c
+        statsPrintf("  THREADS: %" FMT_Word64 " created (%" FMT_Word64
+                    " on reused stacks)\n\n",
+                    sum->threads_created, sum->thread_stacks_reused);
+    }
+
+    if (sum->stack_chunks_allocated > 0 || sum->stack_chunks_reused > 0) {
+        // See Note [Reusing stack chunks] in Threads.c
+        statsPrintf("  STACK CHUNKS: %" FMT_Word64 " allocated, %" FMT_Word64
+                    " reused\n\n",
+                    sum->stack_chunks_allocated, sum->stack_chunks_reused);
+    }
+
+    if (sum->thread_pauses > 0) {
+        // See Note [Walking only the new frames] in ThreadPaused.c
+        statsPrintf("  PAUSES: %" FMT_Word64 " (%.1f stack frames walked"
+                    " per pause), %" FMT_Word64 " update frames squeezed\n\n",
+                    sum->thread_pauses,
+                    (double)sum->pause_frames_walked / sum->thread_pauses,
+                    sum->upd_frames_squeezed);
+    }
+
+    {
+        // See Note [M32 Allocator] in linker/M32Alloc.c
+        M32Stats m32;
+        m32_get_stats(&m32);
+        if (m32.small_pages > 0 || m32.large > 0) {
+            statsPrintf("  LINKER M32: %" FMT_Word " small pages (%.1f%% used),"
+                        " %" FMT_Word " large allocations, %" FMT_Word
+                        " mprotect calls\n\n",
+                        m32.small_pages,
+                        m32.small_bytes == 0 ? 0 :
+                          100.0 * m32.small_used / m32.small_bytes,
+                        m32.large, m32.mprotects);
+        }
+    }
+
+    {
+        // See Note [Object unloading] in CheckUnload.c
+        UnloadCheckStats unload;
+        getUnloadCheckStats(&unload);
+        if (unload.checks > 0 || unload.skipped > 0) {
+            statsPrintf("  OBJECT UNLOADING: %" FMT_Word " checks (%" FMT_Word
+                        " skipped), %" FMT_Word " objects unloaded, %.3fs\n\n",
+                        unload.checks, unload.skipped, unload.unloaded,
+                        TimeToSecondsDbl(unload.time));
+        }
+    }
+
+    {
+        // See Note [Indexing weak pointers by key block] in sm/MarkWeak.c
+        WeakPtrStats wp;
+        getWeakPtrStats(&wp);
+        if (wp.key_checks > 0) {
+            statsPrintf("  WEAK POINTERS: %" FMT_Word " rounds, %" FMT_Word
+                        " key checks (%" FMT_Word " weaks indexed), %.3fs"
+                        " (%.3fs tidying)\n\n",
+                        wp.rounds, wp.key_checks, wp.indexed,
+                        TimeToSecondsDbl(wp.time),
+                        TimeToSecondsDbl(wp.tidy_time));
+        }
+    }
+
+    {
+        // See Note [Stable name address table] in StableName.c
+        StableNameStats sn;
+        getStableNameStats(&sn);
+        if (sn.max_stable_names > 0) {
+            statsPrintf("  STABLE NAMES: %" FMT_Word " at most (table of %"
+                        FMT_Word ", %" FMT_Word " hash slots), %" FMT_Word
+                        " GC updates (%" FMT_Word " rebuilds) in %.3fs\n\n",
+                        sn.max_stable_names, sn.table_size, sn.hash_size,
+                        sn.updates, sn.rebuilds, TimeToSecondsDbl(sn.time));
+        }
+    }
+
+#if defined(TRACING)
+    {
+        // See Note [Eventlog writer thread] in eventlog/EventLog.c
+        StgWord written, late, dropped;
+        getEventLogWriterStats(&written, &late, &dropped);
+        if (written > 0 || dropped > 0) {
+            statsPrintf("  EVENTLOG: %" FMT_Word " buffers written (%" FMT_Word
+                        " late, %" FMT_Word " dropped)\n\n",
+                        written, late, dropped);
+        }
+#if defined(EVENTLOG_SOCKET)
+        // See Note [Eventlog socket] in eventlog/EventLogSocket.c
+        if (RtsFlags.TraceFlags.eventlogSocket != NULL) {
+            statsPrintf("  EVENTLOG SOCKET: %" FMT_Word " writes dropped\n\n",
+                        eventLogSocketDropped());
+        }
+#endif
+    }
+#endif
+
+#if defined(mingw32_HOST_OS)
+    {
+        // See Note [WinIO completion batching] in win32/AsyncWinIO.c
+        AsyncWinIOStats winio;
+        getAsyncWinIOStats(&winio);
+        if (winio.batches > 0) {
+            statsPrintf("  WINIO: %" FMT_Word64 " completions in %" FMT_Word64
+                        " batches\n", winio.completions, winio.batches);
+            printWinIOHistogram("batch size", "", winio.batch_sizes);
+            printWinIOHistogram("latency", "us", winio.latencies);
+            statsPrintf("\n");
+        }
+    }
+#endif
+
 #if defined(THREADED_RTS)
     if (RtsFlags.ParFlags.parGcEnabled && sum->work_balance > 0) {
         // See Note [Work Balance]
@@ -891,9 +1503,10 @@ static void report_summary(const RTSSummaryStats* sum)
     }
 
     statsPrintf("  TASKS: %d "
-                "(%d bound, %d peak workers (%d total), using -N%d)\n\n",
+                "(%d bound, %d peak workers (%d total, %" FMT_Word64
+                " reused), using -N%d)\n\n",
                 taskCount, sum->bound_task_count,
-                peakWorkerCount, workerCount,
+                peakWorkerCount, workerCount, sum->worker_reuses,
                 getNumCapabilities());
 
     statsPrintf("  SPARKS: %" FMT_Word64
@@ -903,6 +1516,36 @@ static void report_summary(const RTSSummaryStats* sum)
                 sum->sparks.converted, sum->sparks.overflowed,
                 sum->sparks.dud, sum->sparks.gcd,
                 sum->sparks.fizzled);
+
+    if (sum->sparks.batch_steals > 0) {
+        // See Note [Spark pool growth and batched stealing] in Capability.c
+        statsPrintf("  SPARK BATCHES: %" FMT_Word " sparks stolen in %"
+                    FMT_Word " batches\n\n",
+                    sum->sparks.batch_stolen, sum->sparks.batch_steals);
+    }
+
+    if (sum->spark_threads_created > 0) {
+        // See Note [Reusing spark thread stacks] in Sparks.c
+        statsPrintf("  SPARK THREADS: %" FMT_Word64 " (%" FMT_Word64
+                    " on reused stacks)\n\n",
+                    sum->spark_threads_created, sum->spark_threads_reused);
+    }
+
+    if (sum->spark_prune_visited + sum->spark_prune_skipped > 0) {
+        // See Note [Incremental spark pruning] in Sparks.c
+        statsPrintf("  SPARK PRUNING: %.3fs (%" FMT_Word64 " sparks looked at, %"
+                    FMT_Word64 " old ones skipped)\n\n",
+                    TimeToSecondsDbl(sum->spark_prune_cpu_ns),
+                    sum->spark_prune_visited, sum->spark_prune_skipped);
+    }
+
+    if (sum->messages_sent > 0) {
+        statsPrintf("  MESSAGES: %" FMT_Word64 " between capabilities"
+                    " (busiest: cap %" FMT_Word32 " -> cap %" FMT_Word32
+                    ", %" FMT_Word64 ")\n\n",
+                    sum->messages_sent, sum->messages_busiest_from,
+                    sum->messages_busiest_to, sum->messages_busiest);
+    }
 #endif
 
     statsPrintf("  INIT    time  %7.3fs  (%7.3fs elapsed)\n",
@@ -1034,6 +1677,20 @@ static void report_summary(const RTSSummaryStats* sum)
     }
 }
 
+static void reportPausesMachineReadable (const char *what,
+                                         const PauseSummaryStats *pauses)
+{
+    statsPrintf(" ,(\"%s_pauses\", \"%" FMT_Word64 "\")\n", what, pauses->count);
+    statsPrintf(" ,(\"%s_pause_p50_seconds\", \"%f\")\n", what,
+                TimeToSecondsDbl(pauses->p50_ns));
+    statsPrintf(" ,(\"%s_pause_p90_seconds\", \"%f\")\n", what,
+                TimeToSecondsDbl(pauses->p90_ns));
+    statsPrintf(" ,(\"%s_pause_p99_seconds\", \"%f\")\n", what,
+                TimeToSecondsDbl(pauses->p99_ns));
+    statsPrintf(" ,(\"%s_pause_p999_seconds\", \"%f\")\n", what,
+                TimeToSecondsDbl(pauses->p999_ns));
+}
+
 static void report_machine_readable (const RTSSummaryStats * sum)
 {
     // We should do no calculation, other than unit changes and formatting, and
@@ -1102,6 +1759,10 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("max_slop_bytes", FMT_Word64, stats.max_slop_bytes);
     // This duplicates, except for unit, peak_megabytes_allocated above
     MR_STAT("max_mem_in_use_bytes", FMT_Word64, stats.max_mem_in_use_bytes);
+#if defined(wasm32_HOST_ARCH)
+    MR_STAT("linear_memory_bytes", FMT_Word64,
+            (StgWord64)__builtin_wasm_memory_size(0) * 65536);
+#endif
     MR_STAT("cumulative_live_bytes", FMT_Word64, stats.cumulative_live_bytes);
     MR_STAT("copied_bytes", FMT_Word64, stats.copied_bytes);
     MR_STAT("par_copied_bytes", FMT_Word64, stats.par_copied_bytes);
@@ -1116,7 +1777,118 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("gc_wall_percent", "f", sum->gc_cpu_percent);
 #endif
     MR_STAT("fragmentation_bytes", FMT_Word64, sum->fragmentation_bytes);
+    MR_STAT("partial_mblock_free_bytes", FMT_Word64,
+            sum->partial_mblock_free_bytes);
+    if (RtsFlags.GcFlags.blockCacheSize > 0) {
+        MR_STAT("block_cache_hits", FMT_Word64, sum->block_cache_hits);
+        MR_STAT("block_cache_misses", FMT_Word64, sum->block_cache_misses);
+    }
     // average_bytes_used is done above
+    MR_STAT("rs_array_elems", FMT_Word64, sum->rs_array_elems);
+    MR_STAT("rs_scanned_elems", FMT_Word64, sum->rs_scanned_elems);
+    MR_STAT("rs_scanned_cards", FMT_Word64, sum->rs_scanned_cards);
+    MR_STAT("rs_entries", FMT_Word64, sum->rs_entries);
+    MR_STAT("rs_duplicates", FMT_Word64, sum->rs_duplicates);
+    MR_STAT("rs_scan_wall_seconds", "f",
+            TimeToSecondsDbl(sum->rs_scan_time_ns));
+    MR_STAT("selectors_eliminated", FMT_Word64, sum->selectors_eliminated);
+    MR_STAT("selectors_deferred", FMT_Word64, sum->selectors_deferred);
+    MR_STAT("copy_races", FMT_Word64, sum->copy_races);
+    MR_STAT("copy_race_bytes", FMT_Word64, sum->copy_race_bytes);
+    MR_STAT("cafs_entered", FMT_Word64, sum->cafs_entered);
+    MR_STAT("static_scavenged", FMT_Word64, sum->static_scavenged);
+    MR_STAT("static_scan_wall_seconds", "f",
+            TimeToSecondsDbl(sum->static_scan_time_ns));
+    MR_STAT("mvar_blocks", FMT_Word64, sum->mvar_blocks);
+    MR_STAT("mvar_barges", FMT_Word64, sum->mvar_barges);
+    MR_STAT("bh_duplicates", FMT_Word64, sum->bh_duplicates);
+    MR_STAT("bh_blocks", FMT_Word64, sum->bh_blocks);
+    MR_STAT("stack_chunks_allocated", FMT_Word64, sum->stack_chunks_allocated);
+    MR_STAT("stack_chunks_reused", FMT_Word64, sum->stack_chunks_reused);
+    MR_STAT("thread_pauses", FMT_Word64, sum->thread_pauses);
+    MR_STAT("pause_frames_walked", FMT_Word64, sum->pause_frames_walked);
+    MR_STAT("upd_frames_squeezed", FMT_Word64, sum->upd_frames_squeezed);
+    MR_STAT("threads_created", FMT_Word64, sum->threads_created);
+    MR_STAT("thread_stacks_reused", FMT_Word64, sum->thread_stacks_reused);
+    {
+        M32Stats m32;
+        m32_get_stats(&m32);
+        MR_STAT("m32_small_pages", FMT_Word, m32.small_pages);
+        MR_STAT("m32_small_bytes_used", FMT_Word, m32.small_used);
+        MR_STAT("m32_large_allocations", FMT_Word, m32.large);
+        MR_STAT("m32_mprotects", FMT_Word, m32.mprotects);
+    }
+    {
+        UnloadCheckStats unload;
+        getUnloadCheckStats(&unload);
+        MR_STAT("unload_checks", FMT_Word, unload.checks);
+        MR_STAT("unload_checks_skipped", FMT_Word, unload.skipped);
+        MR_STAT("unload_objects_unloaded", FMT_Word, unload.unloaded);
+        MR_STAT("unload_check_wall_seconds", "f",
+                TimeToSecondsDbl(unload.time));
+    }
+    {
+        WeakPtrStats wp;
+        getWeakPtrStats(&wp);
+        MR_STAT("weak_rounds", FMT_Word, wp.rounds);
+        MR_STAT("weak_key_checks", FMT_Word, wp.key_checks);
+        MR_STAT("weak_indexed", FMT_Word, wp.indexed);
+        MR_STAT("weak_wall_seconds", "f", TimeToSecondsDbl(wp.time));
+        MR_STAT("weak_tidy_wall_seconds", "f", TimeToSecondsDbl(wp.tidy_time));
+    }
+    {
+        StableNameStats sn;
+        getStableNameStats(&sn);
+        MR_STAT("stable_names_max", FMT_Word, sn.max_stable_names);
+        MR_STAT("stable_name_table_size", FMT_Word, sn.table_size);
+        MR_STAT("stable_name_hash_slots", FMT_Word, sn.hash_size);
+        MR_STAT("stable_name_updates", FMT_Word, sn.updates);
+        MR_STAT("stable_name_rebuilds", FMT_Word, sn.rebuilds);
+        MR_STAT("stable_name_update_wall_seconds", "f",
+                TimeToSecondsDbl(sn.time));
+    }
+    {
+        RTSMemoryUsage mem;
+        getRTSMemoryUsage(&mem);
+        MR_STAT("mem_block_allocator_bytes", FMT_Word64,
+                mem.block_allocator_bytes);
+        MR_STAT("mem_block_free_bytes", FMT_Word64, mem.block_free_bytes);
+        MR_STAT("mem_nonmoving_segment_bytes", FMT_Word64,
+                mem.nonmoving_segment_bytes);
+        MR_STAT("mem_nonmoving_free_segment_bytes", FMT_Word64,
+                mem.nonmoving_free_segment_bytes);
+        MR_STAT("mem_mark_queue_bytes", FMT_Word64, mem.mark_queue_bytes);
+        MR_STAT("mem_eventlog_buffer_bytes", FMT_Word64,
+                mem.eventlog_buffer_bytes);
+        MR_STAT("mem_linker_bytes", FMT_Word64, mem.linker_bytes);
+        MR_STAT("mem_stable_ptr_table_bytes", FMT_Word64,
+                mem.stable_ptr_table_bytes);
+        MR_STAT("mem_stable_name_table_bytes", FMT_Word64,
+                mem.stable_name_table_bytes);
+        MR_STAT("mem_ipe_bytes", FMT_Word64, mem.ipe_bytes);
+        MR_STAT("mem_hash_table_bytes", FMT_Word64, mem.hash_table_bytes);
+    }
+#if defined(TRACING)
+    {
+        StgWord written, late, dropped;
+        getEventLogWriterStats(&written, &late, &dropped);
+        MR_STAT("eventlog_bufs_written", FMT_Word, written);
+        MR_STAT("eventlog_bufs_late", FMT_Word, late);
+        MR_STAT("eventlog_bufs_dropped", FMT_Word, dropped);
+#if defined(EVENTLOG_SOCKET)
+        MR_STAT("eventlog_socket_writes_dropped", FMT_Word,
+                eventLogSocketDropped());
+#endif
+    }
+#endif
+#if defined(mingw32_HOST_OS)
+    {
+        AsyncWinIOStats winio;
+        getAsyncWinIOStats(&winio);
+        MR_STAT("winio_completions", FMT_Word64, winio.completions);
+        MR_STAT("winio_batches", FMT_Word64, winio.batches);
+    }
+#endif
     MR_STAT("alloc_rate", FMT_Word64, sum->alloc_rate);
     MR_STAT("productivity_cpu_percent", "f", sum->productivity_cpu_percent);
     MR_STAT("productivity_wall_percent", "f",
@@ -1132,6 +1904,14 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("sparks_dud ", FMT_Word, sum->sparks.dud);
     MR_STAT("sparks_gcd", FMT_Word, sum->sparks.gcd);
     MR_STAT("sparks_fizzled", FMT_Word, sum->sparks.fizzled);
+    MR_STAT("sparks_batch_steals", FMT_Word, sum->sparks.batch_steals);
+    MR_STAT("sparks_batch_stolen", FMT_Word, sum->sparks.batch_stolen);
+    MR_STAT("spark_threads_created", FMT_Word64, sum->spark_threads_created);
+    MR_STAT("spark_threads_reused", FMT_Word64, sum->spark_threads_reused);
+    MR_STAT("spark_prune_visited", FMT_Word64, sum->spark_prune_visited);
+    MR_STAT("spark_prune_skipped", FMT_Word64, sum->spark_prune_skipped);
+    MR_STAT("spark_prune_cpu_seconds", "f",
+            TimeToSecondsDbl(sum->spark_prune_cpu_ns));
     MR_STAT("work_balance", "f", sum->work_balance);
 
     // next, globals (other than internal counters)
@@ -1139,6 +1919,7 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("task_count", FMT_Word32, taskCount);
     MR_STAT("peak_worker_count", FMT_Word32, peakWorkerCount);
     MR_STAT("worker_count", FMT_Word32, workerCount);
+    MR_STAT("worker_reuses", FMT_Word64, sum->worker_reuses);
 
     // next, internal counters
 #if defined(PROF_SPIN)
@@ -1185,6 +1966,28 @@ static void report_machine_readable (const RTSSummaryStats * sum)
         MR_STAT_GEN(g, "sync_yield", FMT_Word64, gc_sum->sync_yield);
 #endif
     }
+    // pause time percentiles, e.g. minor_pause_p99_seconds
+    reportPausesMachineReadable("minor", &sum->minor_pauses);
+    reportPausesMachineReadable("major", &sum->major_pauses);
+    reportPausesMachineReadable("sync", &sum->sync_pauses);
+    if (RtsFlags.GcFlags.useNonmoving) {
+        reportPausesMachineReadable("nonmoving_sync",
+                                    &sum->nonmoving_sync_pauses);
+    }
+
+    // hardware performance counters, e.g. perf_gc_copy_llc_misses
+    if (sum->perf_counters) {
+        for (int p = 0; p < PERF_PHASES; p++) {
+            for (int c = 0; c < PERF_COUNTERS; c++) {
+                if (sum->perf_available[c]) {
+                    statsPrintf(" ,(\"perf_%s_%s\", \"%" FMT_Word64 "\")\n",
+                                perf_phase_names[p], perf_counter_names[c],
+                                sum->perf[p].counts[c]);
+                }
+            }
+        }
+    }
+
     // non-moving collector statistics
     if (RtsFlags.GcFlags.useNonmoving) {
         const int n_major_colls = sum->gc_summary_stats[RtsFlags.GcFlags.generations-1].collections;
@@ -1203,6 +2006,19 @@ static void report_machine_readable (const RTSSummaryStats * sum)
                 TimeToSecondsDbl(stats.nonmoving_gc_max_elapsed_ns));
         MR_STAT("nonmoving_concurrent_avg_pause_seconds", "f",
                 TimeToSecondsDbl(stats.nonmoving_gc_elapsed_ns) / n_major_colls);
+        MR_STAT("nonmoving_mark_prefetch_depth", FMT_Word32,
+                sum->nonmoving_prefetch_depth);
+        MR_STAT("nonmoving_size_classes_added", FMT_Word32,
+                sum->nonmoving_size_classes_added);
+        MR_STAT("nonmoving_profiled_slop_before_bytes", FMT_Word64,
+                sum->nonmoving_profiled_slop_before);
+        MR_STAT("nonmoving_profiled_slop_after_bytes", FMT_Word64,
+                sum->nonmoving_profiled_slop_after);
+        MR_STAT("nonmoving_handshakes", FMT_Word32, sum->nonmoving_handshakes);
+        MR_STAT("nonmoving_handshake_stragglers", FMT_Word64,
+                sum->nonmoving_handshake_stragglers);
+        MR_STAT("nonmoving_handshake_max_latency_seconds", "f",
+                TimeToSecondsDbl(sum->nonmoving_handshake_max_latency_ns));
     }
 
 
@@ -1359,6 +2175,31 @@ stat_exitReport (void)
                   getCapability(i)->spark_stats.converted;
                 sum.sparks.gcd       += getCapability(i)->spark_stats.gcd;
                 sum.sparks.fizzled   += getCapability(i)->spark_stats.fizzled;
+                sum.sparks.batch_steals +=
+                  getCapability(i)->spark_stats.batch_steals;
+                sum.sparks.batch_stolen +=
+                  getCapability(i)->spark_stats.batch_stolen;
+                sum.spark_threads_created +=
+                  getCapability(i)->spark_threads_created;
+                sum.spark_threads_reused +=
+                  getCapability(i)->spark_threads_reused;
+                sum.spark_prune_visited +=
+                  getCapability(i)->spark_prune_visited;
+                sum.spark_prune_skipped +=
+                  getCapability(i)->spark_prune_skipped;
+                sum.spark_prune_cpu_ns +=
+                  getCapability(i)->spark_prune_time;
+
+                const Capability *cap = getCapability(i);
+                sum.worker_reuses += cap->worker_reuses;
+                for (uint32_t j = 0; j < cap->messages_sent_size; j++) {
+                    sum.messages_sent += cap->messages_sent[j];
+                    if (cap->messages_sent[j] > sum.messages_busiest) {
+                        sum.messages_busiest = cap->messages_sent[j];
+                        sum.messages_busiest_from = i;
+                        sum.messages_busiest_to = j;
+                    }
+                }
             }
 
             sum.sparks_count = sum.sparks.created
@@ -1389,6 +2230,69 @@ stat_exitReport (void)
                          - hw_alloc_blocks * BLOCK_SIZE_W)
                 * (uint64_t)sizeof(W_);
 
+            sum.partial_mblock_free_bytes = max_partial_mblock_free_bytes;
+
+            sum.rs_array_elems = rs_array_elems_total;
+            sum.rs_scanned_elems = rs_scanned_elems_total;
+            sum.rs_scanned_cards = rs_scanned_cards_total;
+            sum.rs_entries = rs_entries_total;
+            sum.rs_duplicates = rs_duplicates_total;
+            sum.rs_scan_time_ns = rs_scan_time_total;
+            sum.selectors_eliminated = selectors_eliminated_total;
+            sum.selectors_deferred = selectors_deferred_total;
+            sum.copy_races = copy_races_total;
+            sum.copy_race_bytes = copy_race_words_total * sizeof(W_);
+            sum.static_scavenged = static_scavenged_total;
+            sum.static_scan_time_ns = static_scan_time_total;
+
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                const Capability *cap = getCapability(i);
+                sum.mvar_blocks += cap->mvar_blocks;
+                sum.mvar_barges += cap->mvar_barges;
+                sum.bh_duplicates += cap->bh_duplicates;
+                sum.bh_blocks += cap->bh_blocks;
+                sum.stack_chunks_allocated += cap->stack_chunks_allocated;
+                sum.stack_chunks_reused += cap->stack_chunks_reused;
+                sum.cafs_entered += cap->cafs_entered;
+                sum.thread_pauses += cap->thread_pauses;
+                sum.pause_frames_walked += cap->pause_frames_walked;
+                sum.upd_frames_squeezed += cap->upd_frames_squeezed;
+                sum.threads_created += cap->threads_created;
+                sum.thread_stacks_reused += cap->thread_stacks_reused;
+                if (cap->mvar_blocks > sum.mvar_blocks_busiest) {
+                    sum.mvar_blocks_busiest = cap->mvar_blocks;
+                    sum.mvar_blocks_busiest_cap = i;
+                }
+            }
+            sum.bh_eager_sites = countEagerBlackHoleSites();
+
+            sum.nonmoving_prefetch_depth = nonmoving_mark_prefetch_depth;
+            sum.nonmoving_size_classes_added = nonmoving_size_class_stats.added;
+            sum.nonmoving_profiled_allocs =
+                nonmoving_size_class_stats.profiled_allocs;
+            sum.nonmoving_profiled_slop_before =
+                nonmoving_size_class_stats.slop_before;
+            sum.nonmoving_profiled_slop_after =
+                nonmoving_size_class_stats.slop_after;
+#if defined(THREADED_RTS)
+            sum.nonmoving_handshakes = nonmoving_handshake_stats.handshakes;
+            sum.nonmoving_handshake_answers = nonmoving_handshake_stats.answers;
+            sum.nonmoving_handshake_stragglers =
+                nonmoving_handshake_stats.stragglers;
+            sum.nonmoving_handshake_total_latency_ns =
+                nonmoving_handshake_stats.total_latency;
+            sum.nonmoving_handshake_max_latency_ns =
+                nonmoving_handshake_stats.max_latency;
+#endif
+
+            sum.block_cache_hits = 0;
+            sum.block_cache_misses = 0;
+            for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+                const BlockCache *cache = &getCapability(i)->block_cache;
+                sum.block_cache_hits += cache->hits;
+                sum.block_cache_misses += cache->misses;
+            }
+
             sum.average_bytes_used = stats.major_gcs == 0 ? 0 :
                  stats.cumulative_live_bytes/stats.major_gcs,
 
@@ -1415,6 +2319,22 @@ stat_exitReport (void)
 
             WARN(sum.productivity_elapsed_percent >= 0);
 
+            summarisePauses(&sum.minor_pauses, &stats.minor_pause_hist);
+            summarisePauses(&sum.major_pauses, &stats.major_pause_hist);
+            summarisePauses(&sum.sync_pauses, &stats.sync_hist);
+            summarisePauses(&sum.nonmoving_sync_pauses,
+                            &stats.nonmoving_sync_hist);
+
+            sum.perf_counters = RtsFlags.MiscFlags.perfCounters;
+            if (sum.perf_counters) {
+                for (int c = 0; c < PERF_COUNTERS; c++) {
+                    sum.perf_available[c] = perfCounterAvailable(c);
+                }
+                for (int p = 0; p < PERF_PHASES; p++) {
+                    getPerfCounts(p, &sum.perf[p]);
+                }
+            }
+
             for(uint32_t g = 0; g < RtsFlags.GcFlags.generations; ++g) {
                 const generation* gen = &generations[g];
                 GenerationSummaryStats* gen_stats = &sum.gc_summary_stats[g];
@@ -1471,11 +2391,154 @@ stat_exitReport (void)
 
 void stat_exit(void)
 {
+    if (RtsFlags.GcFlags.statsStreamFile != NULL) {
+        writeStatsStream("exit", false);
+        ACQUIRE_LOCK(&stats_stream_mutex);
+        fclose(RtsFlags.GcFlags.statsStreamFile);
+        RtsFlags.GcFlags.statsStreamFile = NULL;
+        RELEASE_LOCK(&stats_stream_mutex);
+    }
+    if (RtsFlags.MiscFlags.perfCounters) {
+        exitPerfCounters();
+    }
 #if defined(THREADED_RTS)
         closeMutex(&stats_mutex);
+        closeMutex(&stats_stream_mutex);
 #endif
 }
 
+/* -----------------------------------------------------------------------------
+   Streaming statistics
+
+   Note [Streaming statistics]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   +RTS -s and -t --machine-readable only report at exit. For a long-running
+   service, +RTS --stats-stream=<file> instead writes a line of JSON to <file>
+   after each major GC, or with --stats-stream-interval=<secs> every <secs>
+   seconds, from the ticker. Each record is one object, e.g.
+
+     {"reason":"major-gc","elapsed_ns":..,"gcs":..,"allocated_bytes":..,..}
+
+   holding the counters of getRTSStats under their names there, the current
+   heap size, the live and copied bytes of the last GC, and the p50 and p99
+   pause times (see Note [Pause histograms]). The reason is "major-gc",
+   "timer", "nonmoving-census" or "exit", the last written by stat_exit.
+
+   With the nonmoving collector, a "nonmoving-census" record is also written
+   after each sweep, adding the census of each nonmoving allocator, as
+   +RTS -Dn shows it: the active and filled segments and the live blocks. We
+   take it there, on the nonmoving collector's thread, as taking it from the
+   ticker would walk the segment lists while the sweep is changing them.
+
+   Getting the numbers takes a stats_mutex and the process times, much as
+   getRTSStats does, so a record every second costs little, far less than
+   the eventlog. The writers (the GC leader, the ticker and the nonmoving
+   collector) take stats_stream_mutex, so lines are never interleaved, and
+   each line is flushed as it is written. The ticker stops when the RTS is
+   idle with --tickless, so timer records stop then too.
+*/
+
+// Built under stats_stream_mutex, as RTSStats is too big for the ticker's
+// stack on some platforms
+static RTSStats stream_stats;
+
+#define STREAM_FIELD(name, fmt, value) \
+    fprintf(f, ",\"" name "\":%" fmt, value)
+
+static void writeStatsStream (const char *reason, bool census)
+{
+    ACQUIRE_LOCK(&stats_stream_mutex);
+    FILE *f = RtsFlags.GcFlags.statsStreamFile;
+    if (f == NULL) {
+        RELEASE_LOCK(&stats_stream_mutex);
+        return;
+    }
+
+    RTSStats *s = &stream_stats;
+    getRTSStats(s);
+
+    fprintf(f, "{\"reason\":\"%s\"", reason);
+    STREAM_FIELD("elapsed_ns", FMT_Int64, s->elapsed_ns);
+    STREAM_FIELD("cpu_ns", FMT_Int64, s->cpu_ns);
+    STREAM_FIELD("mutator_cpu_ns", FMT_Int64, s->mutator_cpu_ns);
+    STREAM_FIELD("mutator_elapsed_ns", FMT_Int64, s->mutator_elapsed_ns);
+    STREAM_FIELD("gc_cpu_ns", FMT_Int64, s->gc_cpu_ns);
+    STREAM_FIELD("gc_elapsed_ns", FMT_Int64, s->gc_elapsed_ns);
+    STREAM_FIELD("gcs", FMT_Word32, s->gcs);
+    STREAM_FIELD("major_gcs", FMT_Word32, s->major_gcs);
+    STREAM_FIELD("allocated_bytes", FMT_Word64,
+                 (StgWord64)calcTotalAllocated() * sizeof(W_));
+    STREAM_FIELD("copied_bytes", FMT_Word64, s->copied_bytes);
+    STREAM_FIELD("max_live_bytes", FMT_Word64, s->max_live_bytes);
+    STREAM_FIELD("max_mem_in_use_bytes", FMT_Word64, s->max_mem_in_use_bytes);
+    STREAM_FIELD("mem_in_use_bytes", FMT_Word64,
+                 (StgWord64)RELAXED_LOAD(&mblocks_allocated) * MBLOCK_SIZE);
+    STREAM_FIELD("blocks_in_use_bytes", FMT_Word64,
+                 (StgWord64)RELAXED_LOAD(&n_alloc_blocks) * BLOCK_SIZE);
+    STREAM_FIELD("gc_gen", FMT_Word32, s->gc.gen);
+    STREAM_FIELD("gc_live_bytes", FMT_Word64, s->gc.live_bytes);
+    STREAM_FIELD("gc_copied_bytes", FMT_Word64, s->gc.copied_bytes);
+    STREAM_FIELD("gc_large_objects_bytes", FMT_Word64,
+                 s->gc.large_objects_bytes);
+    STREAM_FIELD("gc_compact_bytes", FMT_Word64, s->gc.compact_bytes);
+    STREAM_FIELD("gc_slop_bytes", FMT_Word64, s->gc.slop_bytes);
+    STREAM_FIELD("gc_block_fragmentation_bytes", FMT_Word64,
+                 s->gc.block_fragmentation_bytes);
+    STREAM_FIELD("gc_elapsed_ns", FMT_Int64, s->gc.elapsed_ns);
+    STREAM_FIELD("minor_pause_p50_ns", FMT_Int64,
+                 getRTSHistogramPercentile(&s->minor_pause_hist, 0.5));
+    STREAM_FIELD("minor_pause_p99_ns", FMT_Int64,
+                 getRTSHistogramPercentile(&s->minor_pause_hist, 0.99));
+    STREAM_FIELD("major_pause_p50_ns", FMT_Int64,
+                 getRTSHistogramPercentile(&s->major_pause_hist, 0.5));
+    STREAM_FIELD("major_pause_p99_ns", FMT_Int64,
+                 getRTSHistogramPercentile(&s->major_pause_hist, 0.99));
+    if (RtsFlags.GcFlags.useNonmoving) {
+        STREAM_FIELD("nonmoving_gc_cpu_ns", FMT_Int64, s->nonmoving_gc_cpu_ns);
+        STREAM_FIELD("nonmoving_gc_elapsed_ns", FMT_Int64,
+                     s->nonmoving_gc_elapsed_ns);
+        STREAM_FIELD("nonmoving_gc_sync_elapsed_ns", FMT_Int64,
+                     s->nonmoving_gc_sync_elapsed_ns);
+        STREAM_FIELD("nonmoving_gc_sync_max_elapsed_ns", FMT_Int64,
+                     s->nonmoving_gc_sync_max_elapsed_ns);
+    }
+
+    if (census) {
+        fprintf(f, ",\"nonmoving_census\":[");
+        for (int i = 0; i < nonmoving_alloca_cnt; i++) {
+            struct NonmovingAllocCensus c = nonmovingAllocatorCensus(i);
+            fprintf(f, "%s{\"block_size\":%" FMT_Word32
+                       ",\"active_segs\":%" FMT_Word32
+                       ",\"filled_segs\":%" FMT_Word32
+                       ",\"live_blocks\":%" FMT_Word32 "}",
+                    i == 0 ? "" : ",",
+                    (uint32_t)nonmovingHeap.allocators[i].block_size,
+                    c.n_active_segs, c.n_filled_segs, c.n_live_blocks);
+        }
+        fprintf(f, "]");
+    }
+
+    fprintf(f, "}\n");
+    fflush(f);
+    RELEASE_LOCK(&stats_stream_mutex);
+}
+
+#undef STREAM_FIELD
+
+// Called by the ticker every --stats-stream-interval
+void stat_tickStatsStream (void)
+{
+    writeStatsStream("timer", false);
+}
+
+// Called by the nonmoving collector after sweeping
+void stat_nonmovingCensusStatsStream (void)
+{
+    if (RtsFlags.GcFlags.statsStreamFile != NULL) {
+        writeStatsStream("nonmoving-census", true);
+    }
+}
+
 /* Note [Work Balance]
 ~~~~~~~~~~~~~~~~~~~~~~
 Work balance is a measure of how evenly the work done during parallel garbage
@@ -1652,12 +2715,17 @@ statDescribeGens(void)
       for (i = 0; i < getNumCapabilities(); i++) {
           mut += countOccupied(getCapability(i)->mut_lists[g]);
 
-          // Add the pinned object block.
+          // Add the pinned object blocks.
           bd = getCapability(i)->pinned_object_block;
           if (bd != NULL) {
               gen_live   += bd->free - bd->start;
               gen_blocks += bd->blocks;
           }
+          bd = getCapability(i)->pinned_ephemeral_block;
+          if (bd != NULL) {
+              gen_live   += bd->free - bd->start;
+              gen_blocks += bd->blocks;
+          }
 
           gen_live   += gcThreadLiveWords(i,g);
           gen_blocks += gcThreadLiveBlocks(i,g);
@@ -1693,6 +2761,20 @@ uint64_t getAllocations( void )
     return n;
 }
 
+// The work balance of the last GC, from 0 to 1 (see Note [Work Balance]), or
+// a negative number if it wasn't a parallel GC.
+double lastGcWorkBalance( void )
+{
+    double balance = -1;
+    ACQUIRE_LOCK(&stats_mutex);
+    if (stats.gc.threads > 1 && stats.gc.copied_bytes > 0) {
+        balance = (double) stats.gc.par_balanced_copied_bytes
+                / stats.gc.copied_bytes;
+    }
+    RELEASE_LOCK(&stats_mutex);
+    return balance;
+}
+
 int getRTSStatsEnabled( void )
 {
     return RtsFlags.GcFlags.giveStats != NO_GC_STATS;
@@ -1715,8 +2797,199 @@ void getRTSStats( RTSStats *s )
         stats.nonmoving_gc_cpu_ns;
     s->mutator_elapsed_ns = current_elapsed - end_init_elapsed -
         stats.gc_elapsed_ns;
+
+    // Racy reads of the block allocator's counters are fine here
+    for (uint32_t n = 0; n < MAX_NUMA_NODES; n++) {
+        s->numa_allocated_blocks[n] = RELAXED_LOAD(&n_total_alloc_blocks_by_node[n]);
+        s->numa_stolen_blocks[n] = RELAXED_LOAD(&n_stolen_blocks_by_node[n]);
+    }
+
+    s->cpu_quota = getCPUQuota();
+    s->usable_processors = getNumberOfUsableProcessors();
+
+    // See Note [Batched finalizers] in Weak.c
+    getFinalizerStats(&s->c_finalizers_pending, &s->c_finalizers_run,
+                      &s->hs_finalizers_scheduled, &s->finalizer_threads);
+
+    // See Note [Soft heap limit] in GC.c
+    {
+        bool pacing;
+        double min_factor, gc_cpu;
+        getSoftHeapLimitStats(&pacing, &min_factor, &gc_cpu);
+        s->soft_heap_limit_bytes =
+            (uint64_t)RtsFlags.GcFlags.softHeapLimit * BLOCK_SIZE;
+        s->soft_limit_pacing = pacing;
+        s->soft_limit_min_factor_permille = (uint32_t)(min_factor * 1000);
+        s->soft_limit_gc_cpu_permille = (uint32_t)(gc_cpu * 1000);
+    }
+
+#if defined(mingw32_HOST_OS) && !defined(THREADED_RTS)
+    // See Note [Retiring idle MIO workers] in win32/MIOManager.c
+    getMIOManagerStats(&s->io_queue_depth, &s->io_workers,
+                       &s->io_workers_idle);
+#else
+    s->io_queue_depth = s->io_workers = s->io_workers_idle = 0;
+#endif
 }
 
+/* Note [Per-capability and per-generation stats]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   getRTSStats sums over the whole process. A monitor that wants to see an
+   imbalance between capabilities, or which generation the GC spends its time
+   copying into, can poll getRTSCapStats and getRTSGenStats instead (or as
+   well). Both only read counters that are kept up to date anyway, without
+   stopping the world, so they are cheap enough to call every second. The
+   reads race with the capabilities and the GC updating them, so a snapshot
+   may be slightly inconsistent, as with numa_allocated_blocks.
+
+   Per capability:
+
+    - allocated_bytes is cap->total_allocated, as summed up for getRTSStats.
+    - mutator_cpu_ns is the CPU time of the OS threads while they ran Haskell
+      code on the capability: schedule() brackets each run of a thread with
+      stat_startMutator and stat_endMutator, as do suspendThread and
+      resumeThread around a safe foreign call, so the time spent in the call
+      is left out. That costs two reads of the thread's CPU clock per run, so
+      it is only done with +RTS -T (or -s), the same as for getRTSStats.
+    - context_switches counts the returns to the scheduler.
+    - gcs and gc_cpu_ns count the GCs in which the capability's GC thread
+      worked, from stat_endGCWorker, which both the leader and the workers
+      call.
+
+   Per generation, collections, cpu_ns, elapsed_ns and max_pause_ns are those
+   shown by +RTS -s, for the GCs in which it was the oldest generation
+   collected. live_bytes is genLiveWords, and copied_bytes the data that GCs
+   have copied into the generation: each GC thread counts the words of the
+   blocks it fills in gct->gen_copied, which GarbageCollect adds up into
+   generation.copied.
+*/
+
+static void getCapStats (Capability *cap, RTSCapStats *s)
+{
+    s->allocated_bytes = RELAXED_LOAD(&cap->total_allocated) * sizeof(W_);
+    s->mutator_cpu_ns = RELAXED_LOAD(&cap->mutator_cpu);
+    s->context_switches = RELAXED_LOAD(&cap->context_switches);
+    s->gcs = RELAXED_LOAD(&cap->gcs);
+    s->gc_cpu_ns = RELAXED_LOAD(&cap->gc_cpu);
+#if defined(THREADED_RTS)
+    s->sparks_created = RELAXED_LOAD(&cap->spark_stats.created);
+    s->sparks_dud = RELAXED_LOAD(&cap->spark_stats.dud);
+    s->sparks_overflowed = RELAXED_LOAD(&cap->spark_stats.overflowed);
+    s->sparks_converted = RELAXED_LOAD(&cap->spark_stats.converted);
+    s->sparks_gcd = RELAXED_LOAD(&cap->spark_stats.gcd);
+    s->sparks_fizzled = RELAXED_LOAD(&cap->spark_stats.fizzled);
+#else
+    s->sparks_created = 0;
+    s->sparks_dud = 0;
+    s->sparks_overflowed = 0;
+    s->sparks_converted = 0;
+    s->sparks_gcd = 0;
+    s->sparks_fizzled = 0;
+#endif
+}
+
+uint32_t getRTSCapStats (RTSCapStats caps[], uint32_t n)
+{
+    uint32_t n_caps = getNumCapabilities();
+    for (uint32_t i = 0; i < n && i < n_caps; i++) {
+        getCapStats(getCapability(i), &caps[i]);
+    }
+    return n_caps;
+}
+
+uint32_t getRTSGenStats (RTSGenStats gens[], uint32_t n)
+{
+    uint32_t n_gens = RtsFlags.GcFlags.generations;
+
+    ACQUIRE_LOCK(&stats_mutex);
+    for (uint32_t g = 0; g < n && g < n_gens; g++) {
+        generation *gen = &generations[g];
+        RTSGenStats *s = &gens[g];
+        s->collections = RELAXED_LOAD(&gen->collections);
+        s->par_collections = RELAXED_LOAD(&gen->par_collections);
+        s->live_bytes = genLiveWords(gen) * sizeof(W_);
+        s->copied_bytes = RELAXED_LOAD(&gen->copied) * sizeof(W_);
+        s->cpu_ns = GC_coll_cpu[g];
+        s->elapsed_ns = GC_coll_elapsed[g];
+        s->max_pause_ns = GC_coll_max_pause[g];
+    }
+    RELEASE_LOCK(&stats_mutex);
+    return n_gens;
+}
+
+/* Note [RTS memory by subsystem]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   When a program's resident set is much bigger than its heap, +RTS -s
+   and getRTSStats say how big the heap is, but not where the rest went.
+   getRTSMemoryUsage (and the RTS MEMORY section of +RTS -s) breaks down
+   the memory that the RTS itself holds:
+
+    - the block allocator's megablocks (mblocks_allocated), and those of
+      their blocks that are free, as for block_fragmentation_bytes;
+    - the nonmoving heap's segments, free or not (nonmovingHeap.n_segments
+      and n_free), and the blocks of its mark queues and update remembered
+      sets (nonmovingMarkQueueBlocks). These are all block allocator
+      memory too, so they are part of block_allocator_bytes;
+    - the event buffers of the capabilities and tasks, with their spares
+      (getEventLogBufferBytes);
+    - what the linker has mapped: object images, sections, GOTs and the m32
+      allocator's pages (getLinkerMappedBytes);
+    - the stable pointer and stable name tables;
+    - the index of info table provenance entries, including the tables it
+      decompressed (getIpeIndexBytes);
+    - all hash tables made with Hash.c (getHashTableBytes).
+
+   Everything not computed from sizes the subsystem keeps anyway is a
+   counter updated where the memory is allocated and freed, with a relaxed
+   atomic add, which costs nothing measurable next to the allocation. The
+   counters are read without stopping the world, so a snapshot may be
+   slightly inconsistent, as with getRTSCapStats.
+
+   Two things are not here:
+
+    - Stacks and STM transaction records are heap objects, so they are in
+      the heap's figures already; a -hT heap profile breaks the heap down by
+      closure type (STACK, TREC_CHUNK, ...).
+    - Other memory from stgMallocBytes isn't attributed to the call sites
+      (the tags) that asked for it: that would need a header on every
+      allocation, to find its size and tag again in stgFree, costing memory
+      and time on every allocation of the RTS. The subsystems above are
+      those whose memory grows with what the program does.
+*/
+void getRTSMemoryUsage (RTSMemoryUsage *usage)
+{
+    usage->block_allocator_bytes = (uint64_t)mblocks_allocated * MBLOCK_SIZE;
+    usage->block_free_bytes =
+        (uint64_t)(mblocks_allocated * BLOCKS_PER_MBLOCK
+                   - RELAXED_LOAD(&n_alloc_blocks)) * BLOCK_SIZE;
+
+    usage->nonmoving_segment_bytes =
+        (uint64_t)RELAXED_LOAD(&nonmovingHeap.n_segments) * NONMOVING_SEGMENT_SIZE;
+    usage->nonmoving_free_segment_bytes =
+        (uint64_t)RELAXED_LOAD(&nonmovingHeap.n_free) * NONMOVING_SEGMENT_SIZE;
+    usage->mark_queue_bytes =
+        (uint64_t)nonmovingMarkQueueBlocks() * BLOCK_SIZE;
+
+#if defined(TRACING)
+    usage->eventlog_buffer_bytes = getEventLogBufferBytes();
+#else
+    usage->eventlog_buffer_bytes = 0;
+#endif
+    usage->linker_bytes = getLinkerMappedBytes();
+
+    usage->stable_ptr_table_bytes = stablePtrTableBytes();
+    StableNameStats sn;
+    getStableNameStats(&sn);
+    usage->stable_name_table_bytes = sn.bytes;
+
+    usage->ipe_bytes = getIpeIndexBytes();
+    usage->hash_table_bytes = getHashTableBytes();
+}
+
+GHC_STATIC_ASSERT(sizeof(((RTSStats*)0)->numa_allocated_blocks)
+                  == MAX_NUMA_NODES * sizeof(uint64_t),
+                  "RTSStats.numa_allocated_blocks must have MAX_NUMA_NODES entries");
+
 /* -----------------------------------------------------------------------------
    Dumping stuff in the stats file, or via the debug message interface
    -------------------------------------------------------------------------- */
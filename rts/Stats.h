@@ -11,6 +11,7 @@
 #include "GetTime.h"
 #include "sm/GC.h"
 #include "Sparks.h"
+#include "PerfCounters.h"
 
 #include "BeginPrivate.h"
 
@@ -27,16 +28,31 @@ void      stat_endGC  (Capability *cap, struct gc_thread_ *initiating_gct, W_ li
                        W_ copied, W_ slop, uint32_t gen,
                        uint32_t n_gc_threads, struct gc_thread_ **gc_threads,
                        W_ par_max_copied, W_ par_balanced_copied,
-                       W_ any_work, W_ scav_find_work, W_ max_n_todo_overflow);
+                       W_ any_work, W_ scav_find_work, W_ max_n_todo_overflow,
+                       W_ rs_array_elems, W_ rs_scanned_elems,
+                       W_ rs_scanned_cards, W_ rs_entries,
+                       W_ rs_duplicates, Time rs_scan_time,
+                       W_ selectors_eliminated, W_ selectors_deferred,
+                       W_ copy_races, W_ copy_race_words,
+                       W_ static_scavenged, Time static_scan_time);
+
+// Account for the Haskell code run on a capability, see getRTSCapStats
+void      stat_startMutator(Capability *cap);
+void      stat_endMutator(Capability *cap);
 
 void      stat_startNonmovingGcSync(void);
 void      stat_endNonmovingGcSync(void);
 void      stat_startNonmovingGc (void);
 void      stat_endNonmovingGc (void);
 
+// Write --stats-stream records, see Note [Streaming statistics] in Stats.c
+void      stat_tickStatsStream(void);
+void      stat_nonmovingCensusStatsStream(void);
+
 #if defined(PROFILING)
 void      stat_startRP(void);
-void      stat_endRP(uint32_t, int, double);
+void      stat_pauseRP(void);
+void      stat_endRP(uint32_t, int, double, uint32_t, W_);
 #endif /* PROFILING */
 
 #if defined(PROFILING) || defined(DEBUG)
@@ -51,6 +67,8 @@ void      stat_exitReport(void);
 void      stat_exit(void);
 void      stat_workerStop(void);
 
+double    lastGcWorkBalance(void);
+
 void      initStats0(void);
 void      initStats1(void);
 void      resetChildProcessStats(void);
@@ -59,6 +77,7 @@ void      statDescribeGens( void );
 
 Time      stat_getElapsedGCTime(void);
 Time      stat_getElapsedTime(void);
+void      stat_getGCCpuTimes(Time *cpu, Time *gc_cpu, Time *major_gc_cpu);
 
 typedef struct GenerationSummaryStats_ {
     uint32_t collections;
@@ -73,6 +92,16 @@ typedef struct GenerationSummaryStats_ {
 #endif
 } GenerationSummaryStats;
 
+// Percentiles of one of the histograms of RTSStats; see
+// Note [Pause histograms] in Stats.c
+typedef struct PauseSummaryStats_ {
+    uint64_t count;
+    Time p50_ns;
+    Time p90_ns;
+    Time p99_ns;
+    Time p999_ns;
+} PauseSummaryStats;
+
 typedef struct RTSSummaryStats_ {
     // These profiling times could potentially be in RTSStats. However, I'm not
     // confident enough to do this now, since there is some logic depending on
@@ -88,19 +117,89 @@ typedef struct RTSSummaryStats_ {
 
 #if defined(THREADED_RTS)
     uint32_t bound_task_count;
+    uint64_t worker_reuses;     // see Note [Spare worker pool] in Task.c
     uint64_t sparks_count;
     SparkCounters sparks;
+    uint64_t spark_threads_created;
+    uint64_t spark_threads_reused;
+    // see Note [Incremental spark pruning] in Sparks.c
+    uint64_t spark_prune_visited;
+    uint64_t spark_prune_skipped;
+    Time spark_prune_cpu_ns;
     double work_balance;
+    // see Note [The capability inbox] in Messages.c
+    uint64_t messages_sent;
+    uint64_t messages_busiest;  // between the busiest pair of capabilities
+    uint32_t messages_busiest_from;
+    uint32_t messages_busiest_to;
 #else // THREADED_RTS
     double gc_cpu_percent;
     double gc_elapsed_percent;
 #endif
     uint64_t fragmentation_bytes;
+    uint64_t partial_mblock_free_bytes; // peak over major GCs
+    uint64_t block_cache_hits;
+    uint64_t block_cache_misses;
+    uint64_t rs_array_elems;   // mutable array elements on the mut lists
+    uint64_t rs_scanned_elems; // ... of which scanned by minor GCs
+    uint64_t rs_scanned_cards;
+    uint64_t rs_entries;       // mut list entries scanned
+    uint64_t rs_duplicates;    // ... and dropped, see Note [Sorting the remembered set]
+    Time rs_scan_time_ns;
+    uint64_t selectors_eliminated; // see Note [Selector optimisation depth limit]
+    uint64_t selectors_deferred;
+    uint64_t copy_races;       // see Note [Racing to copy an object] in Evac.c
+    uint64_t copy_race_bytes;  // ... of copies left in to-space
+    // see Note [Counting CAFs] in sm/Storage.c
+    uint64_t cafs_entered;
+    uint64_t static_scavenged;
+    Time static_scan_time_ns;
+    // see Note [Barging MVar operations] in PrimOps.cmm
+    uint64_t mvar_blocks;
+    uint64_t mvar_blocks_busiest; // on the capability with the most
+    uint32_t mvar_blocks_busiest_cap;
+    uint64_t mvar_barges;
+    // see Note [Blackhole contention] in BlackHoles.c
+    uint64_t bh_duplicates;
+    uint64_t bh_blocks;
+    // see Note [Reusing stack chunks] in Threads.c
+    uint64_t stack_chunks_allocated;
+    uint64_t stack_chunks_reused;
+    // see Note [Walking only the new frames] in ThreadPaused.c
+    uint64_t thread_pauses;
+    uint64_t pause_frames_walked;
+    uint64_t upd_frames_squeezed;
+    // see Note [Reusing thread stacks] in Threads.c
+    uint64_t threads_created;
+    uint64_t thread_stacks_reused;
+    uint32_t bh_eager_sites;
+    uint32_t nonmoving_prefetch_depth; // see Note [Mark prefetch depth]
+    // see Note [Profiled size classes]
+    uint32_t nonmoving_size_classes_added;
+    uint64_t nonmoving_profiled_allocs;
+    uint64_t nonmoving_profiled_slop_before;
+    uint64_t nonmoving_profiled_slop_after;
+    // see Note [Update remembered set handshake]
+    uint32_t nonmoving_handshakes;
+    uint64_t nonmoving_handshake_answers;
+    uint64_t nonmoving_handshake_stragglers;
+    Time nonmoving_handshake_total_latency_ns;
+    Time nonmoving_handshake_max_latency_ns;
     uint64_t average_bytes_used; // This is not shown in the '+RTS -s' report
     uint64_t alloc_rate;
     double productivity_cpu_percent;
     double productivity_elapsed_percent;
 
+    PauseSummaryStats minor_pauses;
+    PauseSummaryStats major_pauses;
+    PauseSummaryStats sync_pauses;
+    PauseSummaryStats nonmoving_sync_pauses;
+
+    // See Note [Hardware performance counters] in PerfCounters.c
+    bool perf_counters;
+    bool perf_available[PERF_COUNTERS];
+    PerfCounts perf[PERF_PHASES];
+
     // one for each generation, 0 first
     GenerationSummaryStats* gc_summary_stats;
 } RTSSummaryStats;
@@ -15,9 +15,11 @@
 #include "Task.h"
 #include "Capability.h"
 #include "Stats.h"
+#include "PerfCounters.h"
 #include "Schedule.h"
 #include "Hash.h"
 #include "Trace.h"
+#include "eventlog/EventLog.h"
 
 #include <string.h>
 
@@ -172,6 +174,7 @@ void freeMyTask (void)
 
     freeTask(task);
     setMyTask(NULL);
+    perfThreadDone();
 }
 
 static void
@@ -186,6 +189,7 @@ freeTask (Task *task)
 #if defined(THREADED_RTS)
     closeCondition(&task->cond);
     closeMutex(&task->lock);
+    freeTaskEventsBuf(task);
 #endif
 
     for (incall = task->incall; incall != NULL; incall = next) {
@@ -223,6 +227,9 @@ newTask (bool worker)
     initMutex(&task->lock);
     task->id = 0;
     task->wakeup = false;
+    task->spin_limit = RtsFlags.ParFlags.parkSpin;
+    task->affinity_epoch = 0;
+    task->events_buf = NULL;
     task->node = 0;
 #endif
 
@@ -408,6 +415,7 @@ workerTaskStop (Task *task)
     RELEASE_LOCK(&all_tasks_mutex);
 
     traceTaskDelete(task);
+    perfThreadDone();
 
     freeTask(task);
 }
@@ -416,25 +424,58 @@ workerTaskStop (Task *task)
 
 #if defined(THREADED_RTS)
 
-static void* OSThreadProcAttr
-workerStart(Task *task)
+/* Note [Spare worker pool]
+   ~~~~~~~~~~~~~~~~~~~~~~~~
+   When a Haskell thread makes a safe foreign call its Capability is handed
+   to a spare worker (cap->spare_workers), or to a new worker if there is
+   none. Each call that blocks while all the spare workers are busy thus
+   creates an OS thread, and a burst of blocking calls stalls the
+   Capability on thread creation, which can take milliseconds. Workers that
+   give up a Capability go back on the queue until it holds
+   --max-spare-workers of them (MAX_SPARE_WORKERS by default), and exit
+   otherwise.
+
+   With --min-spare-workers=<n> we keep at least <n> idle workers per
+   Capability, started ahead of need by startSpareWorkerTasks: at startup,
+   when a spare worker leaves the queue to take the Capability, and when
+   releaseCapability_ finds the queue empty. A worker started this way goes
+   straight onto the queue and waits there to be given the Capability
+   (spareWorkerStart); unlike startWorkerTask we keep the Capability. The
+   creation thus happens before the pool runs dry, rather than while a
+   Capability is waiting for it.
+
+   Each time a spare worker takes the Capability we count it
+   (cap->worker_reuses, reported by +RTS -s) and emit TASK_REUSE, so that
+   together with TASK_CREATE the eventlog shows how the pool is used.
+*/
+
+// Set up the new worker's OS thread, before it uses cap.
+static void
+workerThreadInit(Task *task, Capability *cap)
 {
-    Capability *cap;
-
-    // See startWorkerTask().
-    ACQUIRE_LOCK(&task->lock);
-    cap = task->cap;
-    RELEASE_LOCK(&task->lock);
-
     if (RtsFlags.ParFlags.setAffinity) {
         setThreadAffinity(cap->no, n_capabilities);
     }
     if (RtsFlags.GcFlags.numa && !RtsFlags.DebugFlags.numa) {
         setThreadNode(numa_map[task->node]);
     }
+    applyCapabilityAffinity(cap, task);
 
     // set the thread-local pointer to the Task:
     setMyTask(task);
+}
+
+static void* OSThreadProcAttr
+workerStart(Task *task)
+{
+    Capability *cap;
+
+    // See startWorkerTask().
+    ACQUIRE_LOCK(&task->lock);
+    cap = task->cap;
+    RELEASE_LOCK(&task->lock);
+
+    workerThreadInit(task, cap);
 
     newInCall(task);
 
@@ -446,33 +487,33 @@ workerStart(Task *task)
     return NULL;
 }
 
-/* N.B. must take all_tasks_mutex */
-void
-startWorkerTask (Capability *cap)
+static void* OSThreadProcAttr
+spareWorkerStart(Task *task)
 {
-  int r;
-  OSThreadId tid;
-  Task *task;
+    Capability *cap;
 
-  // A worker always gets a fresh Task structure.
-  task = newTask(true);
-  task->stopped = false;
+    // See startSpareWorkerTasks().
+    ACQUIRE_LOCK(&task->lock);
+    cap = task->cap;
+    RELEASE_LOCK(&task->lock);
 
-  // The lock here is to synchronise with taskStart(), to make sure
-  // that we have finished setting up the Task structure before the
-  // worker thread reads it.
-  ACQUIRE_LOCK(&task->lock);
+    workerThreadInit(task, cap);
 
-  // We don't emit a task creation event here, but in workerStart,
-  // where the kernel thread id is known.
-  task->cap = cap;
-  task->node = cap->node;
+    traceTaskCreate(task, cap);
 
-  // Give the capability directly to the worker; we can't let anyone
-  // else get in, because the new worker Task has nowhere to go to
-  // sleep so that it could be woken up again.
-  ASSERT_LOCK_HELD(&cap->lock);
-  RELAXED_STORE(&cap->running_task, task);
+    // We are on cap->spare_workers, waiting like any other spare worker.
+    cap = waitForWorkerCapability(task);
+
+    scheduleWorker(cap,task);
+
+    return NULL;
+}
+
+static void
+createWorkerThread (Task *task, OSThreadProc *start)
+{
+  int r;
+  OSThreadId tid;
 
   // Set the name of the worker thread to the original process name followed by
   // ":w", but only if we're on Linux where the program_invocation_short_name
@@ -493,7 +534,7 @@ startWorkerTask (Capability *cap)
 #else
   char * worker_name = "ghc_worker";
 #endif
-  r = createOSThread(&tid, worker_name, (OSThreadProc*)workerStart, task);
+  r = createOSThread(&tid, worker_name, start, task);
   if (r != 0) {
     sysErrorBelch("failed to create OS thread");
     stg_exit(EXIT_FAILURE);
@@ -502,11 +543,74 @@ startWorkerTask (Capability *cap)
   debugTrace(DEBUG_sched, "new worker task (taskCount: %d)", taskCount);
 
   task->id = tid;
+}
+
+/* N.B. must take all_tasks_mutex */
+void
+startWorkerTask (Capability *cap)
+{
+  Task *task;
+
+  // A worker always gets a fresh Task structure.
+  task = newTask(true);
+  task->stopped = false;
+
+  // The lock here is to synchronise with taskStart(), to make sure
+  // that we have finished setting up the Task structure before the
+  // worker thread reads it.
+  ACQUIRE_LOCK(&task->lock);
+
+  // We don't emit a task creation event here, but in workerStart,
+  // where the kernel thread id is known.
+  task->cap = cap;
+  task->node = cap->node;
+
+  // Give the capability directly to the worker; we can't let anyone
+  // else get in, because the new worker Task has nowhere to go to
+  // sleep so that it could be woken up again.
+  ASSERT_LOCK_HELD(&cap->lock);
+  RELAXED_STORE(&cap->running_task, task);
+
+  createWorkerThread(task, (OSThreadProc*)workerStart);
 
   // ok, finished with the Task struct.
   RELEASE_LOCK(&task->lock);
 }
 
+/* N.B. must take all_tasks_mutex */
+void
+startSpareWorkerTasks (Capability *cap)
+{
+  ASSERT_LOCK_HELD(&cap->lock);
+
+  // Workers started during shutdown would only exit again.
+  if (getSchedState() != SCHED_RUNNING) {
+      return;
+  }
+
+  while (cap->n_spare_workers < RtsFlags.ParFlags.minSpareWorkers) {
+      Task *task = newTask(true);
+      task->stopped = false;
+
+      // As in startWorkerTask, the new thread waits for task->lock
+      ACQUIRE_LOCK(&task->lock);
+      task->cap = cap;
+      task->node = cap->node;
+
+      // The worker may be given the Capability as soon as it is on the
+      // queue, which looks at its InCall, so we set that up here rather
+      // than in the new thread.
+      newInCall(task);
+      task->next = cap->spare_workers;
+      cap->spare_workers = task;
+      cap->n_spare_workers++;
+
+      createWorkerThread(task, (OSThreadProc*)spareWorkerStart);
+
+      RELEASE_LOCK(&task->lock);
+  }
+}
+
 void
 interruptWorkerTask (Task *task)
 {
@@ -126,6 +126,18 @@ typedef struct Task_ {
     // that signalling a condition variable doesn't do anything if the
     // thread is already running, but we want it to be sticky.
     bool wakeup;
+
+    // How long (in busy_wait_nop()s) to spin for a wakeup before sleeping
+    // on task->cond; see Note [Spinning before parking] in Capability.c.
+    uint32_t spin_limit;
+
+    // The cap->affinity_epoch of the CPU pinning this worker last applied;
+    // see Note [Capability affinity] in Capability.c.
+    uint32_t affinity_epoch;
+
+    // The events this task posted that aren't tied to a capability, or
+    // NULL; see Note [Task event buffers] in eventlog/EventLog.c.
+    struct TaskEventsBuf_ *events_buf;
 #endif
 
     // If the task owns a Capability, task->cap points to it.  (occasionally a
@@ -247,6 +259,13 @@ INLINE_HEADER Task *myTask (void);
 //
 void startWorkerTask (Capability *cap);
 
+// Start idle workers on the Capability until it has
+// RtsFlags.ParFlags.minSpareWorkers of them.  Unlike startWorkerTask,
+// this doesn't give the Capability away.
+// Requires: cap->lock.
+//
+void startSpareWorkerTasks (Capability *cap);
+
 // Interrupts a worker task that is performing an FFI call.  The thread
 // should not be destroyed.
 //
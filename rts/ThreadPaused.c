@@ -10,6 +10,7 @@
 #include "Rts.h"
 
 #include "ThreadPaused.h"
+#include "BlackHoles.h"
 #include "sm/Storage.h"
 #include "Updates.h"
 #include "RaiseAsync.h"
@@ -73,6 +74,7 @@ updateAdjacentFrames (Capability *cap, StgTSO *tso, StgUpdateFrame *upd,
 
     gap->gap_size = count * sizeofW(StgUpdateFrame);
     gap->next_gap = next;
+    cap->upd_frames_squeezed += count;
 
     return gap;
 }
@@ -189,6 +191,33 @@ stackSqueeze(Capability *cap, StgTSO *tso, StgPtr bottom)
  * here.  We also take the opportunity to do stack squeezing if it's
  * turned on.
  * -------------------------------------------------------------------------- */
+
+/* Note [Walking only the new frames]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   threadPaused is called every time a thread stops running, so on a deep
+   stack it must not walk every frame each time. It doesn't: the walk stops
+   at the first update frame it has marked before (stg_marked_upd_frame, see
+   "Lazy blackholing" in Updates.h), since everything below that frame was
+   there at the last pause and has been dealt with. The marked frame is a
+   watermark that moves with the stack: if the thread returns through it,
+   the frames pushed since are unmarked and get walked next time. Stack
+   squeezing only looks at the frames walked, so it is incremental too.
+
+   The walk also stops at the end of the current stack chunk; the chunks
+   below were walked before the thread overflowed into this one, and when
+   it underflows back into them their update frames are still marked.
+
+   What isn't bounded by the watermark is a run of frames with no update
+   frame in it, which are walked again on each pause. There is no way to
+   tell whether such frames have been popped and pushed again since the
+   last pause without a mark on them, and only update frames have a marked
+   variant, but the walk still stops at the end of the chunk, so it is at
+   most a chunk (-kc) of frames.
+
+   +RTS -s reports the pauses, the frames walked per pause, and the update
+   frames squeezed out, so a program for which the walk is expensive shows
+   up there.
+*/
 void
 threadPaused(Capability *cap, StgTSO *tso)
 {
@@ -202,6 +231,7 @@ threadPaused(Capability *cap, StgTSO *tso)
     uint32_t words_to_squeeze = 0;
     uint32_t weight           = 0;
     uint32_t weight_pending   = 0;
+    StgWord frames_walked     = 0;
     bool prev_was_update_frame = false;
     StgWord heuristic_says_squeeze;
 
@@ -224,12 +254,14 @@ threadPaused(Capability *cap, StgTSO *tso)
     // memory barriers are needed here.
     while ((P_)frame < stack_end) {
         info = get_ret_itbl(frame);
+        frames_walked++;
 
         switch (info->i.type) {
 
         case UPDATE_FRAME:
 
             // If we've already marked this frame, then stop here.
+            // See Note [Walking only the new frames].
             frame_info = ACQUIRE_LOAD(&frame->header.info);
             if (frame_info == (StgInfoTable *)&stg_marked_upd_frame_info) {
                 if (prev_was_update_frame) {
@@ -294,6 +326,12 @@ threadPaused(Capability *cap, StgTSO *tso)
                            "suspending duplicate work: %ld words of stack",
                            (long)((StgPtr)frame - tso->stackobj->sp));
 
+                // See Note [Blackhole contention] in BlackHoles.c
+                noteBlackHoleContention(cap,
+                    origThunkInfo((StgPtr)frame + sizeofW(StgUpdateFrame),
+                                  stack_end),
+                    false);
+
                 // If this closure is already an indirection, then
                 // suspend the computation up to this point.
                 // NB. check raiseAsync() to see what happens when
@@ -386,6 +424,9 @@ threadPaused(Capability *cap, StgTSO *tso)
     }
 
 end:
+    cap->thread_pauses++;
+    cap->pause_frames_walked += frames_walked;
+
     // Should we squeeze or not?  Arbitrary heuristic: we squeeze if
     // the number of words we have to shift down is less than the
     // number of stack words we squeeze away by doing so.
@@ -23,6 +23,8 @@
 #include "RaiseAsync.h"
 #include "Prelude.h"
 #include "Printer.h"
+#include "IOManager.h"
+#include "StablePtr.h"
 #include "sm/Sanity.h"
 #include "sm/Storage.h"
 
@@ -45,6 +47,65 @@ static StgThreadID next_thread_id = 1;
  */
 #define MIN_STACK_WORDS (RESERVED_STACK_WORDS + sizeofW(StgStopFrame) + 3)
 
+/* Note [Reusing thread stacks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A program that forks a thread per request creates and finishes threads
+   at a high rate, and most of what forkIO allocates is the stack of the
+   new thread (1k bytes by default, see -ki), not its TSO.
+
+   We can't recycle the TSO of a finished thread: its ThreadId may have
+   escaped, and we can't tell whether it has without a GC (forkIO hands it
+   to the parent, at the very least). But, as for spark threads (see
+   Note [Reusing spark thread stacks] in Sparks.c), nothing but the TSO
+   refers to the stack. So when a thread finishes (saveThreadStack),
+   takeThreadStack gives its TSO a minimal stack holding just its dead
+   thread frame, and we keep its old stack in cap->spare_thread_stacks, up
+   to MAX_SPARE_THREAD_STACKS of them. The next createThread asking for a
+   stack of the same size starts the new thread on one of those rather than
+   allocating.
+
+   That includes bound threads, which every call into Haskell from C (a
+   foreign export, rts_evalIO and friends) runs in: the result the caller
+   wants is in the dead thread frame, which the TSO keeps. So a C program
+   calling a Haskell function over and over doesn't allocate a stack each
+   time either.
+
+   Only stacks of the -ki size are kept: those are what forkIO and calls
+   from C ask for, and a finished thread that grew its stack ends on its
+   first chunk, which has a different size if it was replaced (see
+   threadStackOverflow). The stacks are roots of the capability (see
+   markCapability) and may be old, so createThreadOnStack dirties them
+   before reuse.
+
+   The threads created, and how many of them reused a stack, are reported
+   by +RTS -s.
+*/
+
+/* The size of the stack, without its header, that createThread gives a
+ * thread of the given size (which includes the TSO and STACK headers).
+ */
+static W_
+threadStackWords (W_ size)
+{
+    /* catch ridiculously small stack sizes */
+    if (size < MIN_STACK_WORDS + sizeofW(StgStack) + sizeofW(StgTSO)) {
+        size = MIN_STACK_WORDS + sizeofW(StgStack) + sizeofW(StgTSO);
+    }
+
+    /* The size argument we are given includes all the per-thread
+     * overheads:
+     *
+     *    - The TSO structure
+     *    - The STACK header
+     *
+     * This is so that we can use a nice round power of 2 for the
+     * default stack size (e.g. 1k), and if we're allocating lots of
+     * threads back-to-back they'll fit nicely in a block.  It's a bit
+     * of a benchmark hack, but it doesn't do any harm.
+     */
+    return round_to_mblocks(size - sizeofW(StgTSO)) - sizeofW(StgStack);
+}
+
 /* ---------------------------------------------------------------------------
    Create a new thread.
 
@@ -59,37 +120,47 @@ static StgThreadID next_thread_id = 1;
 StgTSO *
 createThread(Capability *cap, W_ size)
 {
-    StgTSO *tso;
     StgStack *stack;
-    uint32_t stack_size;
+    W_ stack_words;
 
     /* sched_mutex is *not* required */
 
-    /* catch ridiculously small stack sizes */
-    if (size < MIN_STACK_WORDS + sizeofW(StgStack) + sizeofW(StgTSO)) {
-        size = MIN_STACK_WORDS + sizeofW(StgStack) + sizeofW(StgTSO);
+    stack_words = threadStackWords(size);
+
+    if (cap->n_spare_thread_stacks > 0
+        && cap->spare_thread_stacks[cap->n_spare_thread_stacks - 1]
+               ->stack_size == stack_words) {
+        // See Note [Reusing thread stacks]
+        stack = cap->spare_thread_stacks[--cap->n_spare_thread_stacks];
+        cap->thread_stacks_reused++;
+        return createThreadOnStack(cap, stack);
     }
 
-    /* The size argument we are given includes all the per-thread
-     * overheads:
-     *
-     *    - The TSO structure
-     *    - The STACK header
-     *
-     * This is so that we can use a nice round power of 2 for the
-     * default stack size (e.g. 1k), and if we're allocating lots of
-     * threads back-to-back they'll fit nicely in a block.  It's a bit
-     * of a benchmark hack, but it doesn't do any harm.
-     */
-    stack_size = round_to_mblocks(size - sizeofW(StgTSO));
-    stack = (StgStack *)allocate(cap, stack_size);
-    TICK_ALLOC_STACK(stack_size);
+    stack = (StgStack *)allocate(cap, stack_words + sizeofW(StgStack));
+    TICK_ALLOC_STACK(stack_words + sizeofW(StgStack));
     SET_HDR(stack, &stg_STACK_info, cap->r.rCCCS);
-    stack->stack_size   = stack_size - sizeofW(StgStack);
+    stack->stack_size   = stack_words;
     stack->sp           = stack->stack + stack->stack_size;
     stack->dirty        = STACK_DIRTY;
     stack->marking      = 0;
 
+    return createThreadOnStack(cap, stack);
+}
+
+/* Create a new thread on the given stack, which is either new or the stack
+ * of a finished thread (see Note [Reusing thread stacks]), and is made
+ * empty.
+ */
+StgTSO *
+createThreadOnStack(Capability *cap, StgStack *stack)
+{
+    StgTSO *tso;
+
+    if (stack->sp != stack->stack + stack->stack_size) {
+        dirty_STACK(cap, stack);
+        stack->sp = stack->stack + stack->stack_size;
+    }
+
     tso = (StgTSO *)allocate(cap, sizeofW(StgTSO));
     TICK_ALLOC_TSO(sizeofW(StgTSO));
     SET_HDR(tso, &stg_TSO_info, CCS_SYSTEM);
@@ -110,12 +181,17 @@ createThread(Capability *cap, W_ size)
 
     tso->stackobj       = stack;
     tso->tot_stack_size = stack->stack_size;
+    tso->priority       = 0;
+    tso->slice          = 0;
+    tso->adapted_slice  = 1;
 
     ASSIGN_Int64((W_*)&(tso->alloc_limit), 0);
 
     tso->trec = NO_TREC;
     tso->label = NULL;
 
+    cap->threads_created++;
+
 #if defined(PROFILING)
     tso->prof.cccs = CCS_MAIN;
 #endif
@@ -141,6 +217,52 @@ createThread(Capability *cap, W_ size)
     return tso;
 }
 
+/* Give a finished thread a minimal stack holding just its dead thread
+ * frame, and return its old stack for reuse; see Note [Reusing thread stacks].
+ */
+StgStack *
+takeThreadStack (Capability *cap, StgTSO *tso)
+{
+    StgStack *stack, *dead;
+
+    ASSERT(tso->what_next == ThreadComplete);
+    stack = tso->stackobj;
+    ASSERT(((StgClosure *)stack->sp)->header.info == &stg_dead_thread_info);
+
+    dead = (StgStack *)allocate(cap, sizeofW(StgStack)
+                                     + sizeofW(StgDeadThreadFrame));
+    TICK_ALLOC_STACK(sizeofW(StgStack) + sizeofW(StgDeadThreadFrame));
+    SET_HDR(dead, &stg_STACK_info, CCS_SYSTEM);
+    dead->stack_size = sizeofW(StgDeadThreadFrame);
+    dead->sp         = dead->stack;
+    dead->dirty      = STACK_DIRTY;
+    dead->marking    = 0;
+    memcpy(dead->sp, stack->sp, sizeof(StgDeadThreadFrame));
+
+    dirty_TSO(cap, tso);
+    tso->stackobj       = dead;
+    tso->tot_stack_size = dead->stack_size;
+
+    return stack;
+}
+
+/* Called when a thread has finished; see
+ * Note [Reusing thread stacks].
+ */
+void
+saveThreadStack (Capability *cap, StgTSO *tso)
+{
+    if (tso->what_next != ThreadComplete
+        || cap->n_spare_thread_stacks >= MAX_SPARE_THREAD_STACKS
+        || tso->stackobj->stack_size
+               != threadStackWords(RtsFlags.GcFlags.initialStkSize)) {
+        return;
+    }
+
+    cap->spare_thread_stacks[cap->n_spare_thread_stacks++] =
+        takeThreadStack(cap, tso);
+}
+
 /* ---------------------------------------------------------------------------
  * Equality on Thread ids.
  *
@@ -199,6 +321,28 @@ void rts_disableThreadAllocationLimit(StgPtr tso)
     ((StgTSO *)tso)->flags &= ~TSO_ALLOC_LIMIT;
 }
 
+StgWord rts_getThreadPriority(StgPtr tso)
+{
+    return RELAXED_LOAD(&((StgTSO *)tso)->priority);
+}
+
+/* ---------------------------------------------------------------------------
+ * Setting the thread's time slice, see Note [Time slices] in Schedule.c
+ * ------------------------------------------------------------------------ */
+
+void rts_setThreadTimeSlice(StgPtr tso, HsInt slice)
+{
+    StgWord16 s;
+    if (slice < 0) {
+        s = TSO_SLICE_UNBOUNDED;
+    } else if (slice >= TSO_SLICE_UNBOUNDED) {
+        s = TSO_SLICE_UNBOUNDED - 1;
+    } else {
+        s = (StgWord16) slice;
+    }
+    RELAXED_STORE(&((StgTSO *)tso)->slice, s);
+}
+
 /* -----------------------------------------------------------------------------
    Remove a thread from a queue.
    Fails fatally if the TSO is not on the queue.
@@ -531,6 +675,121 @@ isThreadBound(StgTSO* tso USED_IF_THREADS)
   return false;
 }
 
+/* Note [Reusing stack chunks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A thread whose stack depth goes up and down across the boundary between
+   two stack chunks, e.g. a deep recursive parser, overflows its chunk,
+   returns to the underflow frame, and overflows again, over and over.
+   Each overflow used to allocate a fresh -kc chunk (32k by default), and
+   each underflow left the old one to the GC.
+
+   Two things stop this:
+
+   * Every capability keeps up to MAX_SPARE_STACK_CHUNKS empty chunks of
+     the -kc size in cap->spare_stack_chunks. threadStackUnderflow puts the
+     chunk it leaves there, and threadStackOverflow takes a chunk from
+     there, if there is one, rather than allocating. The chunks are roots
+     of the capability (see markCapability), and may be old, so they are
+     dirtied before reuse; as with Note [Reusing spark thread stacks],
+     nothing but the cache refers to them once the thread has left them.
+     A reused chunk is not charged to the thread's allocation.
+
+   * When a thread returns to the underflow frame of its chunk and the
+     chunk below has less than -kb free, the thread would overflow into a
+     new chunk as soon as it went deeper again. So threadStackUnderflowReturn
+     moves up to -kb words of frames from the chunk below into the current
+     chunk instead, and the thread stays where it is. threadStackOverflow
+     does the same with the frames it copies to the new chunk, so a thread
+     now has to move about -kb words in one direction before it changes
+     chunks. Moving frames up leaves the chunk below with more room, so
+     the next return to the underflow frame usually switches chunks as
+     before: unwinding a deep stack copies little more than it used to.
+
+   The chunks allocated and reused by threadStackOverflow are reported by
+   +RTS -s.
+*/
+
+/* -----------------------------------------------------------------------------
+   Stack chunks
+
+   newStackChunk gives the thread a new, empty chunk of chunk_size words
+   (header included), taking one from the capability's spare chunks if it
+   is of the usual size. The chunk is counted in tso->tot_stack_size, but
+   the caller has to link it in. pushUnderflowFrame pushes the frame that
+   returns from a chunk to the one below it.
+   -------------------------------------------------------------------------- */
+
+StgStack *
+newStackChunk (Capability *cap, StgTSO *tso, W_ chunk_size)
+{
+    StgStack *new_stack;
+
+    debugTraceCap(DEBUG_sched, cap,
+                  "allocating new stack chunk of size %d bytes",
+                  chunk_size * sizeof(W_));
+
+    if (chunk_size == RtsFlags.GcFlags.stkChunkSize
+        && cap->n_spare_stack_chunks > 0)
+    {
+        // See Note [Reusing stack chunks]
+        new_stack = cap->spare_stack_chunks[--cap->n_spare_stack_chunks];
+        ASSERT(new_stack->stack_size == chunk_size - sizeofW(StgStack));
+        ASSERT(new_stack->sp == new_stack->stack + new_stack->stack_size);
+        dirty_STACK(cap, new_stack);
+        cap->stack_chunks_reused++;
+    }
+    else
+    {
+        // Charge the current thread for allocating stack.  Stack usage is
+        // non-deterministic, because the chunk boundaries might vary from
+        // run to run, but accounting for this is better than not
+        // accounting for it, since a deep recursion will otherwise not be
+        // subject to allocation limits.
+        cap->r.rCurrentTSO = tso;
+        new_stack = (StgStack*) allocate(cap, chunk_size);
+        cap->r.rCurrentTSO = NULL;
+
+        SET_HDR(new_stack, &stg_STACK_info, tso->stackobj->header.prof.ccs);
+        TICK_ALLOC_STACK(chunk_size);
+
+        new_stack->dirty = 0; // begin clean, the caller marks it dirty
+        new_stack->marking = 0;
+        new_stack->stack_size = chunk_size - sizeofW(StgStack);
+        new_stack->sp = new_stack->stack + new_stack->stack_size;
+        cap->stack_chunks_allocated++;
+    }
+
+    tso->tot_stack_size += new_stack->stack_size;
+
+    return new_stack;
+}
+
+void
+pushUnderflowFrame (StgStack *stack, StgStack *next)
+{
+    StgUnderflowFrame *frame;
+
+    stack->sp -= sizeofW(StgUnderflowFrame);
+    frame = (StgUnderflowFrame*)stack->sp;
+
+    // See Note [realArgRegsCover] in GHC.Cmm.CallConv.
+    switch (vectorSupportGlobalVar) {
+      case 3:
+        frame->info = &stg_stack_underflow_frame_v64_info;
+        break;
+      case 2:
+        frame->info = &stg_stack_underflow_frame_v32_info;
+        break;
+      case 1:
+        frame->info = &stg_stack_underflow_frame_v16_info;
+        break;
+      default:
+        frame->info = &stg_stack_underflow_frame_d_info;
+        break;
+    }
+    frame->next_chunk = next;
+}
+
 /* -----------------------------------------------------------------------------
    Stack overflow
 
@@ -544,7 +803,6 @@ void
 threadStackOverflow (Capability *cap, StgTSO *tso)
 {
     StgStack *new_stack, *old_stack;
-    StgUnderflowFrame *frame;
     W_ chunk_size;
 
     IF_DEBUG(sanity,checkTSO(tso));
@@ -623,28 +881,7 @@ threadStackOverflow (Capability *cap, StgTSO *tso)
         chunk_size = RtsFlags.GcFlags.stkChunkSize;
     }
 
-    debugTraceCap(DEBUG_sched, cap,
-                  "allocating new stack chunk of size %d bytes",
-                  chunk_size * sizeof(W_));
-
-    // Charge the current thread for allocating stack.  Stack usage is
-    // non-deterministic, because the chunk boundaries might vary from
-    // run to run, but accounting for this is better than not
-    // accounting for it, since a deep recursion will otherwise not be
-    // subject to allocation limits.
-    cap->r.rCurrentTSO = tso;
-    new_stack = (StgStack*) allocate(cap, chunk_size);
-    cap->r.rCurrentTSO = NULL;
-
-    SET_HDR(new_stack, &stg_STACK_info, old_stack->header.prof.ccs);
-    TICK_ALLOC_STACK(chunk_size);
-
-    new_stack->dirty = 0; // begin clean, we'll mark it dirty below
-    new_stack->marking = 0;
-    new_stack->stack_size = chunk_size - sizeofW(StgStack);
-    new_stack->sp = new_stack->stack + new_stack->stack_size;
-
-    tso->tot_stack_size += new_stack->stack_size;
+    new_stack = newStackChunk(cap, tso, chunk_size);
 
     {
         StgWord *sp;
@@ -690,25 +927,7 @@ threadStackOverflow (Capability *cap, StgTSO *tso)
             //
         } else {
 
-            new_stack->sp -= sizeofW(StgUnderflowFrame);
-            frame = (StgUnderflowFrame*)new_stack->sp;
-
-            // See Note [realArgRegsCover] in GHC.Cmm.CallConv.
-            switch (vectorSupportGlobalVar) {
-              case 3:
-                frame->info = &stg_stack_underflow_frame_v64_info;
-                break;
-              case 2:
-                frame->info = &stg_stack_underflow_frame_v32_info;
-                break;
-              case 1:
-                frame->info = &stg_stack_underflow_frame_v16_info;
-                break;
-              default:
-                frame->info = &stg_stack_underflow_frame_d_info;
-                break;
-            }
-            frame->next_chunk  = old_stack;
+            pushUnderflowFrame(new_stack, old_stack);
         }
 
         // copy the stack chunk between tso->sp and sp to
@@ -782,6 +1001,14 @@ threadStackUnderflow (Capability *cap, StgTSO *tso)
     // restore the stack parameters, and update tot_stack_size
     tso->tot_stack_size -= old_stack->stack_size;
 
+    // keep the old stack for the next overflow, if it's of the usual size;
+    // see Note [Reusing stack chunks]
+    if (old_stack->stack_size
+            == RtsFlags.GcFlags.stkChunkSize - sizeofW(StgStack)
+        && cap->n_spare_stack_chunks < MAX_SPARE_STACK_CHUNKS) {
+        cap->spare_stack_chunks[cap->n_spare_stack_chunks++] = old_stack;
+    }
+
     // we're about to run it, better mark it dirty.
     //
     // N.B. the nonmoving collector may mark the stack, meaning that sp must
@@ -792,6 +1019,77 @@ threadStackUnderflow (Capability *cap, StgTSO *tso)
     return retvals;
 }
 
+/* ---------------------------------------------------------------------------
+   Stack underflow - returning to the stg_stack_underflow_info frame
+
+   Like threadStackUnderflow, but if the chunk below is nearly full, move
+   some of its frames into the current chunk rather than switching chunks;
+   see Note [Reusing stack chunks]. The stack walkers that pop chunks
+   (raiseAsync and friends) use threadStackUnderflow, which always switches.
+   ------------------------------------------------------------------------ */
+
+W_ // returns offset to the return address
+threadStackUnderflowReturn (Capability *cap, StgTSO *tso)
+{
+    StgStack *stack, *next;
+    StgUnderflowFrame *frame;
+    StgPtr sp, next_end;
+    W_ retvals, chunk_words, size;
+
+    stack = tso->stackobj;
+    frame = (StgUnderflowFrame*)(stack->stack + stack->stack_size
+                                 - sizeofW(StgUnderflowFrame));
+    next = (StgStack*)frame->next_chunk;
+    next_end = next->stack + next->stack_size;
+    retvals = (P_)frame - stack->sp;
+
+    if ((W_)(next->sp - next->stack) >= RtsFlags.GcFlags.stkChunkBufferSize) {
+        return threadStackUnderflow(cap, tso);
+    }
+
+    // Take whole frames from the top of the next chunk, up to -kb words,
+    // but never its last frame: that is its STOP_FRAME or UNDERFLOW_FRAME.
+    for (sp = next->sp;
+         sp < next->sp + RtsFlags.GcFlags.stkChunkBufferSize; )
+    {
+        size = stack_frame_sizeW((StgClosure*)sp);
+        if (sp + size >= next_end
+            || sp + size > next->sp + RtsFlags.GcFlags.stkChunkBufferSize
+            || (W_)(sp + size - next->sp) + retvals
+                   > (W_)((P_)frame - stack->stack)) {
+            break;
+        }
+        sp += size;
+    }
+    chunk_words = sp - next->sp;
+
+    if (chunk_words == 0) {
+        return threadStackUnderflow(cap, tso);
+    }
+
+    debugTraceCap(DEBUG_sched, cap,
+                  "stack underflow: moving %" FMT_Word " words of frames up",
+                  chunk_words);
+
+    // we're about to change both chunks
+    dirty_STACK(cap, stack);
+    dirty_STACK(cap, next);
+
+    memmove(/* dest */ (P_)frame - chunk_words - retvals,
+            /* src  */ stack->sp,
+            /* size */ retvals * sizeof(W_));
+    memcpy(/* dest */ (P_)frame - chunk_words,
+           /* src  */ next->sp,
+           /* size */ chunk_words * sizeof(W_));
+
+    next->sp += chunk_words;
+    stack->sp = (P_)frame - chunk_words - retvals;
+
+    IF_DEBUG(sanity,checkTSO(tso));
+
+    return retvals;
+}
+
 /* ----------------------------------------------------------------------------
    Implementation of tryPutMVar#
 
@@ -879,6 +1177,24 @@ loop:
     return true;
 }
 
+/* ----------------------------------------------------------------------------
+   Fill the MVars behind StablePtrs with (), as tryPutMVar does, then free the
+   StablePtrs. These are the puts of hs_try_putmvar and hs_try_putmvar_batch.
+   ------------------------------------------------------------------------- */
+
+void performTryPutMVars(Capability *cap, uint32_t n, StgStablePtr *mvars)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        performTryPutMVar(cap, (StgMVar*)deRefStablePtr(mvars[i]), Unit_closure);
+    }
+
+    stablePtrLock();
+    for (uint32_t i = 0; i < n; i++) {
+        freeStablePtrUnsafe(mvars[i]);
+    }
+    stablePtrUnlock();
+}
+
 StgMutArrPtrs *listThreads(Capability *cap)
 {
     ACQUIRE_LOCK(&sched_mutex);
@@ -939,7 +1255,8 @@ printThreadBlockage(StgTSO *tso)
     debugBelch("is blocked on write to fd %d", (int)(tso->block_info.fd));
     break;
   case BlockedOnDelay:
-    debugBelch("is blocked until %ld", (long)(tso->block_info.target));
+    debugBelch("is blocked until %ld",
+               (long)threadDelayTarget(tso->cap, tso));
     break;
 #endif
     break;
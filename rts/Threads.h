@@ -12,6 +12,10 @@
 
 #define END_BLOCKED_EXCEPTIONS_QUEUE ((MessageThrowTo*)END_TSO_QUEUE)
 
+StgTSO * createThreadOnStack (Capability *cap, StgStack *stack);
+StgStack * takeThreadStack (Capability *cap, StgTSO *tso);
+void saveThreadStack (Capability *cap, StgTSO *tso);
+
 StgTSO * unblockOne (Capability *cap, StgTSO *tso);
 StgTSO * unblockOne_ (Capability *cap, StgTSO *tso, bool allow_migrate);
 
@@ -37,10 +41,14 @@ bool removeThreadFromDeQueue   (Capability *cap, StgTSO **head, StgTSO **tail, S
 StgBool isThreadBound (StgTSO* tso);
 
 // Overflow/underflow
+StgStack * newStackChunk (Capability *cap, StgTSO *tso, W_ chunk_size);
+void pushUnderflowFrame   (StgStack *stack, StgStack *next);
 void threadStackOverflow  (Capability *cap, StgTSO *tso);
 W_   threadStackUnderflow (Capability *cap, StgTSO *tso);
+W_   threadStackUnderflowReturn (Capability *cap, StgTSO *tso);
 
 bool performTryPutMVar(Capability *cap, StgMVar *mvar, StgClosure *value);
+void performTryPutMVars(Capability *cap, uint32_t n, StgStablePtr *mvars);
 
 #if defined(DEBUG)
 void printThreadBlockage (StgTSO *tso);
@@ -10,6 +10,7 @@
 #include "rts/PosixSource.h"
 #include "Rts.h"
 
+#include "Ticky.h"
 #include "eventlog/EventLog.h"
 
 /* Catch-all top-level counter struct.  Allocations from CAFs will go
@@ -31,8 +32,6 @@ StgEntCounter *ticky_entry_ctrs = NULL; /* root of list of them */
  */
 #if defined(TICKY_TICKY)
 
-#include "Ticky.h"
-
 /* -----------------------------------------------------------------------------
    Print out all the counters
    -------------------------------------------------------------------------- */
@@ -403,6 +402,12 @@ printRegisteredCounterInfo (FILE *tf)
     }
 }
 
+#endif /* TICKY_TICKY */
+
+/* Code compiled with -ticky-sample registers and bumps its counters with
+ * any RTS, so the eventlog ticky samples don't need TICKY_TICKY; see
+ * Note [Sampled ticky counters] in GHC.StgToCmm.Ticky.
+ */
 void emitTickyCounterDefs(void)
 {
 #if defined(TRACING)
@@ -417,11 +422,9 @@ void emitTickyCounterSamples(void)
 #endif
 }
 
-#endif /* TICKY_TICKY */
-
 void requestTickyCounterSamples(void)
 {
-#if defined(TICKY_TICKY) && defined(TRACING)
+#if defined(TRACING)
     if (RtsFlags.TraceFlags.ticky) {
         emitTickyCounterSamples();
     }
@@ -22,9 +22,14 @@
 #include "Proftimer.h"
 #include "Schedule.h"
 #include "Ticker.h"
+#include "Trace.h"
 #include "Capability.h"
 #include "RtsSignals.h"
+#include "Stats.h"
 #include "rts/EventLogWriter.h"
+#if !defined(mingw32_HOST_OS)
+#include "posix/PreemptTimer.h"
+#endif
 
 // See Note [No timer on wasm32]
 #if !defined(wasm32_HOST_ARCH)
@@ -46,6 +51,12 @@ static int ticks_to_ctxt_switch = 0;
 /* ticks left before next next forced eventlog flush */
 static int ticks_to_eventlog_flush = 0;
 
+/* ticks left before the next stack sample, see Note [Stack sampling] */
+static int ticks_to_stack_sample = 0;
+
+/* ticks left before the next --stats-stream record */
+static int ticks_to_stats_stream = 0;
+
 
 /*
  Note [GC During Idle Time]
@@ -92,6 +103,36 @@ static int ticks_to_eventlog_flush = 0;
  See issue #11134 for additional detail.
 */
 
+/*
+ Note [Tickless idling]
+ ~~~~~~~~~~~~~~~~~~~~~~
+ Normally the ticker keeps ticking for a while after the RTS goes idle: the
+ ticks move recent_activity from ACTIVITY_YES through ACTIVITY_MAYBE_NO, and
+ only then (after the idle GC, if -I is on) do we stop the timer. A process
+ that wakes up every few hundred milliseconds to do a little work thus ticks
+ all the time, which adds up on a host running hundreds of mostly idle
+ processes.
+
+ With +RTS --tickless, a capability that runs out of work calls timerIdle(),
+ and if no capability is running Haskell code or has a thread to run, we
+ stop the timer straight away, setting ACTIVITY_DONE_GC so that the
+ scheduler starts it again when it next runs a thread (see schedule()). We
+ still tick while an idle GC is owed (with -I), since the ticks time it, and
+ when profiling, since the ticks take the samples; -I0 gives a process that
+ doesn't tick at all while idle. Also, the ticks then only count down the
+ time slices of capabilities that are running Haskell code (see
+ contextSwitchExpiredSlices), so a thread starting on a capability that was
+ idle gets its whole slice.
+
+ Deciding that the RTS is idle races with a capability starting to run a
+ thread: that capability sets in_haskell and then exchanges recent_activity,
+ while we set recent_activity and then look at in_haskell. Whichever goes
+ second sees the other: either we see in_haskell and put recent_activity
+ back, or the capability sees ACTIVITY_DONE_GC and starts the timer again.
+ If we can't put it back, the capability has seen it, and we stop the timer
+ to match its startTimer().
+*/
+
 /* - countdown for minimum idle time before we start a GC (set by -I) */
 static int idle_ticks_to_gc = 0;
 
@@ -115,7 +156,7 @@ handle_tick(int unused STG_UNUSED)
       ticks_to_ctxt_switch--;
       if (ticks_to_ctxt_switch <= 0) {
           ticks_to_ctxt_switch = RtsFlags.ConcFlags.ctxtSwitchTicks;
-          contextSwitchAllCapabilities(); /* schedule a context switch */
+          contextSwitchExpiredSlices(); /* schedule a context switch */
       }
   }
 
@@ -128,6 +169,28 @@ handle_tick(int unused STG_UNUSED)
       }
   }
 
+  if (eventLogStatus() == EVENTLOG_RUNNING
+      && RtsFlags.TraceFlags.stackSampleTicks > 0) {
+      ticks_to_stack_sample--;
+      if (ticks_to_stack_sample <= 0) {
+          ticks_to_stack_sample = RtsFlags.TraceFlags.stackSampleTicks;
+          requestStackSamples();
+      }
+  }
+
+  if (RtsFlags.GcFlags.statsStreamTicks > 0) {
+      ticks_to_stats_stream--;
+      if (ticks_to_stats_stream <= 0) {
+          ticks_to_stats_stream = RtsFlags.GcFlags.statsStreamTicks;
+          stat_tickStatsStream();
+      }
+  }
+
+  // See Note [Changing trace classes] in Trace.c
+  if (RELAXED_LOAD_ALWAYS(&trace_toggle_requested)) {
+      toggleTraceClasses();
+  }
+
   /*
    * If we've been inactive for idleGCDelayTime (set by +RTS
    * -I), tell the scheduler to wake up and do a GC, to check
@@ -176,6 +239,52 @@ handle_tick(int unused STG_UNUSED)
   }
 }
 
+#if defined(HAVE_PREEMPTION) && !defined(PROFILING)
+static bool
+allCapabilitiesIdle(void)
+{
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap = getCapability(i);
+        if (RELAXED_LOAD(&cap->in_haskell) ||
+            RELAXED_LOAD(&cap->n_run_queue) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+/*
+ * Function: timerIdle()
+ *
+ * Called by the scheduler when a capability has nothing to run. With
+ * --tickless, stop the timer if the whole RTS is idle.
+ * See Note [Tickless idling].
+ */
+void
+timerIdle(void)
+{
+#if defined(HAVE_PREEMPTION) && !defined(PROFILING)
+    if (!RtsFlags.MiscFlags.tickless || RtsFlags.GcFlags.doIdleGC
+        || RtsFlags.MiscFlags.tickInterval == 0 || !allCapabilitiesIdle()) {
+        return;
+    }
+
+    enum RecentActivity prev = getRecentActivity();
+    if (prev != ACTIVITY_YES && prev != ACTIVITY_MAYBE_NO) {
+        return;
+    }
+    if (!casRecentActivity(prev, ACTIVITY_DONE_GC)) {
+        return;
+    }
+    if (!allCapabilitiesIdle() &&
+        casRecentActivity(ACTIVITY_DONE_GC, ACTIVITY_YES)) {
+        return;
+    }
+    stopTimer();
+#endif
+}
+
 void
 initTimer(void)
 {
@@ -186,6 +295,12 @@ initTimer(void)
     }
     SEQ_CST_STORE_ALWAYS(&timer_disabled, 1);
 #endif
+#if defined(HAVE_PREEMPT_TIMERS)
+    if (RtsFlags.ConcFlags.perCapabilityTimers
+        && RtsFlags.ConcFlags.ctxtSwitchTime > 0) {
+        initPreemptTimers();
+    }
+#endif
 }
 
 void
@@ -220,4 +335,10 @@ exitTimer (bool wait)
         exitTicker(wait);
     }
 #endif
+#if defined(HAVE_PREEMPT_TIMERS)
+    if (RtsFlags.ConcFlags.perCapabilityTimers
+        && RtsFlags.ConcFlags.ctxtSwitchTime > 0) {
+        exitPreemptTimers(wait);
+    }
+#endif
 }
@@ -23,7 +23,9 @@
 #include "Printer.h"
 #include "RtsFlags.h"
 #include "ThreadLabels.h"
+#include "RtsUtils.h"
 
+#include <string.h>
 #if defined(HAVE_UNISTD_H)
 #include <unistd.h>
 #endif
@@ -39,8 +41,14 @@ uint8_t TRACE_cap;
 
 #if defined(THREADED_RTS)
 static Mutex trace_utx;
+static Mutex trace_classes_mutex;
 #endif
 
+// See Note [Changing trace classes]
+volatile StgWord trace_toggle_requested = 0;
+static bool trace_toggled = false;
+static TRACE_FLAGS trace_untoggled;
+
 #if defined(DEBUG)
 static void traceCap_stderr(Capability *cap, char *msg, ...);
 #endif
@@ -89,10 +97,26 @@ static void updateTraceFlagCache (void)
         TRACE_user;
 }
 
+// Is the eventlog to be written to a file with a .zst name?
+static bool compressedEventLogOutput (void)
+{
+    const char *out = RtsFlags.TraceFlags.trace_output;
+    size_t len;
+
+    if (RtsFlags.TraceFlags.tracing != TRACE_EVENTLOG
+        || RtsFlags.TraceFlags.nullWriter
+        || out == NULL) {
+        return false;
+    }
+    len = strlen(out);
+    return len >= 4 && strcmp(out + len - 4, ".zst") == 0;
+}
+
 void initTracing (void)
 {
 #if defined(THREADED_RTS)
     initMutex(&trace_utx);
+    initMutex(&trace_classes_mutex);
 #endif
 
     updateTraceFlagCache();
@@ -101,6 +125,33 @@ void initTracing (void)
         RtsFlags.GcFlags.giveStats = COLLECT_GC_STATS;
     }
 
+    const EventLogWriter *writer = rtsConfig.eventlog_writer;
+    if (writer == &FileEventLogWriter && compressedEventLogOutput()) {
+        // See Note [Compressed eventlog] in eventlog/EventLogWriter.c
+#if HAVE_LIBZSTD == 1
+        writer = &ZstdEventLogWriter;
+#if defined(THREADED_RTS)
+        RtsFlags.TraceFlags.writerThread = true;
+#endif
+#else
+        errorBelch("-ol%s: this RTS was built without zstd, so it can't "
+                   "compress the eventlog", RtsFlags.TraceFlags.trace_output);
+        stg_exit(EXIT_FAILURE);
+#endif
+    }
+
+    if (writer == &FileEventLogWriter
+        && RtsFlags.TraceFlags.eventlogSocket != NULL) {
+        // See Note [Eventlog socket] in eventlog/EventLogSocket.c
+#if defined(EVENTLOG_SOCKET)
+        writer = &SocketEventLogWriter;
+#else
+        errorBelch("--eventlog-socket needs the threaded RTS, on a system "
+                   "with Unix domain sockets");
+        stg_exit(EXIT_FAILURE);
+#endif
+    }
+
     /* Note: we can have any of the TRACE_* flags turned on even when
        eventlog_enabled is off. In the DEBUG way we may be tracing to stderr.
      */
@@ -111,8 +162,8 @@ void initTracing (void)
         startEventLogging(&NullEventLogWriter);
     }
     else if (RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG
-            && rtsConfig.eventlog_writer != NULL) {
-        startEventLogging(rtsConfig.eventlog_writer);
+            && writer != NULL) {
+        startEventLogging(writer);
     }
 }
 
@@ -150,6 +201,110 @@ void tracingAddCapabilities (uint32_t from, uint32_t to)
     }
 }
 
+/* Note [Changing trace classes]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The trace classes (-ls, -lg, ...) can be changed while the program runs,
+   so that heavy classes can be turned on while investigating a problem and
+   off again afterwards, without restarting the program:
+
+    * rts_setTraceFlags(flags) sets them as -l<flags> would;
+
+    * with +RTS --eventlog-toggle-classes=<flags>, each SIGUSR2 switches
+      between the classes of -l and those of -l<flags>. The handler only
+      sets trace_toggle_requested; the timer's next tick (handle_tick) does
+      the work, as it does for --eventlog-flush-interval.
+
+   Either way we update the TRACE_* flags, post a TRACE_CLASSES event with
+   the classes now enabled, and flush the eventlog, so that a consumer
+   promptly sees the events of the old classes and the point where they
+   changed. Threads posting events read the TRACE_* flags without
+   synchronisation, so a few events of a class may be posted just after
+   it is turned off, or missed just after it is turned on.
+*/
+
+static void setTraceClasses (const TRACE_FLAGS *from)
+{
+    RtsFlags.TraceFlags.scheduler      = from->scheduler;
+    RtsFlags.TraceFlags.gc             = from->gc;
+    RtsFlags.TraceFlags.nonmoving_gc   = from->nonmoving_gc;
+    RtsFlags.TraceFlags.sparks_sampled = from->sparks_sampled;
+    RtsFlags.TraceFlags.sparks_full    = from->sparks_full;
+    RtsFlags.TraceFlags.ticky          = from->ticky;
+    RtsFlags.TraceFlags.user           = from->user;
+}
+
+// The trace classes enabled now, as -l flags
+static void showTraceClasses (char *buf)
+{
+    if (RtsFlags.TraceFlags.scheduler)      { *buf++ = 's'; }
+    if (RtsFlags.TraceFlags.gc)             { *buf++ = 'g'; }
+    if (RtsFlags.TraceFlags.nonmoving_gc)   { *buf++ = 'n'; }
+    if (RtsFlags.TraceFlags.sparks_sampled) { *buf++ = 'p'; }
+    if (RtsFlags.TraceFlags.sparks_full)    { *buf++ = 'f'; }
+    if (RtsFlags.TraceFlags.ticky)          { *buf++ = 'T'; }
+    if (RtsFlags.TraceFlags.user)           { *buf++ = 'u'; }
+    *buf = '\0';
+}
+
+// Call with trace_classes_mutex held
+static void traceClassesChanged (void)
+{
+    char classes[16];
+
+    updateTraceFlagCache();
+    showTraceClasses(classes);
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        debugBelch("trace classes: %s\n", classes);
+    } else
+#endif
+    {
+        postEventTraceClasses(classes);
+    }
+    flushTrace();
+}
+
+bool rts_setTraceFlags (const char *flags)
+{
+    TRACE_FLAGS saved;
+
+    ACQUIRE_LOCK(&trace_classes_mutex);
+    saved = RtsFlags.TraceFlags;
+    if (!read_trace_flags(flags)) {
+        setTraceClasses(&saved);
+        RELEASE_LOCK(&trace_classes_mutex);
+        return false;
+    }
+    traceClassesChanged();
+    RELEASE_LOCK(&trace_classes_mutex);
+    return true;
+}
+
+// See Note [Changing trace classes]
+void toggleTraceClasses (void)
+{
+    RELAXED_STORE(&trace_toggle_requested, 0);
+    if (RtsFlags.TraceFlags.toggleClasses == NULL) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&trace_classes_mutex);
+    if (trace_toggled) {
+        setTraceClasses(&trace_untoggled);
+        trace_toggled = false;
+    } else {
+        trace_untoggled = RtsFlags.TraceFlags;
+        if (!read_trace_flags(RtsFlags.TraceFlags.toggleClasses)) {
+            setTraceClasses(&trace_untoggled);
+            RELEASE_LOCK(&trace_classes_mutex);
+            return;
+        }
+        trace_toggled = true;
+    }
+    traceClassesChanged();
+    RELEASE_LOCK(&trace_classes_mutex);
+}
+
 /* ---------------------------------------------------------------------------
    Emitting trace messages/events
  --------------------------------------------------------------------------- */
@@ -252,9 +407,70 @@ static void traceSchedEvent_stderr (Capability *cap, EventTypeNum tag,
 }
 #endif
 
+/* Note [Sampling events]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   A capability switching threads often posts a RUN_THREAD and a STOP_THREAD
+   event per switch, and a program using par posts a spark event for every
+   spark; with -ls or -lf these can make up most of the eventlog and most of
+   the cost of tracing. --eventlog-sample-sched=<n> and
+   --eventlog-sample-sparks=<n> (or setEventLogSampleRate, at any time) make
+   each capability post only one in <n> of them:
+
+    * A RUN_THREAD event and the STOP_THREAD event that follows it are sampled
+      together, so that the eventlog still says what the capability was doing
+      between them: at RUN_THREAD we decide whether to sample the run and
+      remember the answer in cap->sched_run_sampled, which STOP_THREAD obeys.
+      Other scheduler events (CREATE_THREAD, MIGRATE_THREAD, THREAD_WAKEUP,
+      ...) are never sampled, as tools use them to follow threads around.
+
+    * Spark events are sampled one in <n> regardless of their kind.
+
+   We count the events we don't post, and each capability posts a
+   SAMPLED_EVENTS event with the count for each class at the start of each
+   collection and at shutdown, if it is non-zero. Along with the rate, this
+   lets tools scale the events they see back up. We sample every n-th event
+   rather than at random: it is cheaper, and the events we sample are
+   frequent and regular enough for the difference not to matter.
+*/
+
+static bool sampleRunThread (Capability *cap, EventTypeNum tag)
+{
+    if (tag == EVENT_RUN_THREAD) {
+        uint32_t rate = RELAXED_LOAD(&RtsFlags.TraceFlags.schedSampleRate);
+        if (rate > 1 && ++cap->sched_events_seen < rate) {
+            cap->sched_run_sampled = false;
+        } else {
+            cap->sched_events_seen = 0;
+            cap->sched_run_sampled = true;
+        }
+    } else if (tag != EVENT_STOP_THREAD) {
+        return true;
+    }
+
+    if (!cap->sched_run_sampled) {
+        cap->sched_events_suppressed++;
+    }
+    return cap->sched_run_sampled;
+}
+
+static bool sampleSparkEvent (Capability *cap)
+{
+    uint32_t rate = RELAXED_LOAD(&RtsFlags.TraceFlags.sparksSampleRate);
+    if (rate > 1 && ++cap->spark_events_seen < rate) {
+        cap->spark_events_suppressed++;
+        return false;
+    }
+    cap->spark_events_seen = 0;
+    return true;
+}
+
 void traceSchedEvent_ (Capability *cap, EventTypeNum tag,
                        StgTSO *tso, StgWord info1, StgWord info2)
 {
+    if (!sampleRunThread(cap, tag)) {
+        return;
+    }
+
 #if defined(DEBUG)
     if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
         traceSchedEvent_stderr(cap, tag, tso, info1, info2);
@@ -406,6 +622,437 @@ void traceEventMemReturn_ (Capability *cap,
     }
 }
 
+void traceEventGcWorkSteals_ (Capability *cap,
+                              uint32_t    gc_cap,
+                              uint32_t    stolen_blocks,
+                              uint32_t    failed_steals)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "GC thread on cap %u stole %u blocks (%u failed attempts)"
+                       , gc_cap, stolen_blocks, failed_steals);
+    } else
+#endif
+    {
+        postEventGcWorkSteals(cap, gc_cap, stolen_blocks, failed_steals);
+    }
+}
+
+void traceEventGcParThreads_ (Capability *cap,
+                              uint32_t    gen,
+                              uint32_t    threads,
+                              W_          work_bytes)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "GC of generation %u: %u threads for %" FMT_Word
+                        " bytes of work", gen, threads, work_bytes);
+    } else
+#endif
+    {
+        postEventGcParThreads(cap, gen, threads, work_bytes);
+    }
+}
+
+void traceEventGcThreadStats_ (Capability *cap,
+                               uint32_t    gc_cap,
+                               Time        copy_start,
+                               Time        copy_end,
+                               Time        idle,
+                               W_          copied_bytes)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "GC thread on cap %u copied %" FMT_Word
+                        " bytes in %" FMT_Word64 "us, %" FMT_Word64 "us idle"
+                       , gc_cap, copied_bytes
+                       , TimeToUS(copy_end - copy_start), TimeToUS(idle));
+    } else
+#endif
+    {
+        postEventGcThreadStats(cap, gc_cap, TimeToNS(copy_start),
+                               TimeToNS(copy_end), TimeToNS(idle),
+                               copied_bytes);
+    }
+}
+
+void traceEventGcGenResize_ (CapsetID    heap_capset,
+                             uint32_t    gen,
+                             W_          max_blocks,
+                             uint32_t    survival,
+                             uint32_t    promotion,
+                             uint32_t    factor,
+                             uint32_t    gc_cpu)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* reported by debugTrace(DEBUG_gc) in resizeGenerations instead */
+    } else
+#endif
+    {
+        postEventGcGenResize(heap_capset, gen, max_blocks,
+                             survival, promotion, factor, gc_cpu);
+    }
+}
+
+void traceEventPinnedFragmentation_ (CapsetID    heap_capset,
+                                     uint32_t    blocks,
+                                     uint32_t    sparse_blocks,
+                                     W_          used_bytes,
+                                     W_          live_bytes)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* reported by debugTrace(DEBUG_gc) in pinnedLivenessEndGC instead */
+    } else
+#endif
+    {
+        postEventPinnedFragmentation(heap_capset, blocks, sparse_blocks,
+                                     used_bytes, live_bytes);
+    }
+}
+
+void traceEventGcGenShape_ (CapsetID    heap_capset,
+                            uint32_t    gen,
+                            W_          live_bytes,
+                            W_          large_bytes,
+                            W_          mut_list_entries)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        ACQUIRE_LOCK(&trace_utx);
+        tracePreface();
+        debugBelch("gen %" FMT_Word32 ": %" FMT_Word " bytes live, %"
+                   FMT_Word " in large objects, %" FMT_Word
+                   " mut_list entries\n", gen, live_bytes, large_bytes,
+                   mut_list_entries);
+        RELEASE_LOCK(&trace_utx);
+    } else
+#endif
+    {
+        postEventGcGenShape(heap_capset, (uint16_t)gen, live_bytes,
+                            large_bytes, mut_list_entries);
+    }
+}
+
+void traceEventCapParking_ (Capability *cap,
+                            W_          spin_wakeups,
+                            W_          parks)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "%" FMT_Word " wakeups while spinning, %"
+                        FMT_Word " parks", spin_wakeups, parks);
+    } else
+#endif
+    {
+        postEventCapParking(cap->no, spin_wakeups, parks);
+    }
+}
+
+void traceEventStmHotTVar_ (Capability *cap,
+                            StgWord     tvar,
+                            uint32_t    aborts)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "TVar %p failed %" FMT_Word32 " transactions",
+                        (void *) tvar, aborts);
+    } else
+#endif
+    {
+        postEventStmHotTVar(cap->no, tvar, aborts);
+    }
+}
+
+void traceEventBlackHoleContention_ (Capability *cap,
+                                     StgWord     info,
+                                     uint32_t    duplicates,
+                                     uint32_t    blocks)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "thunks of %p: %" FMT_Word32 " duplicated, %"
+                        FMT_Word32 " blocked on", (void *) info,
+                        duplicates, blocks);
+    } else
+#endif
+    {
+        postEventBlackHoleContention(cap->no, info, duplicates, blocks);
+    }
+}
+
+static void traceSampledEvents (Capability *cap, StgWord8 cls,
+                                uint32_t rate, StgWord64 suppressed)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "%" FMT_Word64 " %s events not traced "
+                        "(1 in %" FMT_Word32 " traced)", suppressed,
+                        cls == SAMPLED_EVENTS_SCHED ? "scheduler" : "spark",
+                        rate);
+    } else
+#endif
+    {
+        postEventSampledEvents(cap->no, cls, rate, suppressed);
+    }
+}
+
+// See Note [Sampling events]
+void traceEventSampledEvents_ (Capability *cap)
+{
+    if (cap->sched_events_suppressed != 0) {
+        traceSampledEvents(cap, SAMPLED_EVENTS_SCHED,
+                           RELAXED_LOAD(&RtsFlags.TraceFlags.schedSampleRate),
+                           cap->sched_events_suppressed);
+        cap->sched_events_suppressed = 0;
+    }
+    if (cap->spark_events_suppressed != 0) {
+        traceSampledEvents(cap, SAMPLED_EVENTS_SPARKS,
+                           RELAXED_LOAD(&RtsFlags.TraceFlags.sparksSampleRate),
+                           cap->spark_events_suppressed);
+        cap->spark_events_suppressed = 0;
+    }
+}
+
+void traceEventPerfCounters_ (StgWord8         phase,
+                              uint32_t         thread,
+                              const StgWord64 *counts)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* the totals are reported by +RTS -s instead */
+    } else
+#endif
+    {
+        postEventPerfCounters(phase, thread, counts);
+    }
+}
+
+/* Note [Allocation sampling]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Ticky and the heap profiler say which code allocates, but they need their
+   own builds and cost too much to leave on in production. With
+   --eventlog-alloc-sample=<n>, a capability instead posts an ALLOC_SAMPLE
+   event each time its threads have filled <n> nursery blocks, naming the
+   code that was allocating and how many bytes the capability allocated
+   since its previous sample. Code that allocates more is sampled more
+   often, so counting the samples gives a statistical allocation profile,
+   in any build.
+
+   We take the sample where a thread fills a nursery block and moves on to
+   the next one, in stg_gc_noregs (HeapStackCheck.cmm). That counts down
+   cap->alloc_sample_left and calls traceAllocSample when it gets to 1,
+   which costs a load and a test per nursery block when we aren't sampling.
+   Allocations by the RTS on a thread's behalf (allocate(), for arrays and
+   the like) use nursery blocks too, but aren't sampled themselves; they
+   count towards the bytes of the next sample.
+
+   The allocating code is the continuation on top of the stack, the code
+   whose heap check failed. The RTS may have pushed frames of its own on
+   top (stg_gc_fun, stg_enter, the continuations of stg_gc_unpt_r1 and
+   friends), so allocatingCode looks through the first few frames for one
+   whose info table has an IPE (see -finfo-table-map), taking the function
+   of a stg_gc_fun frame and the closure of a stg_enter frame. Without IPE
+   information we post the first frame's info table. Tools map the info
+   table to a source location using the IPE events.
+*/
+
+#define ALLOC_SAMPLE_MAX_FRAMES 8
+
+// The code that the stack frame at sp belongs to: the function of a
+// stg_gc_fun frame, the closure of a stg_enter frame, and otherwise the
+// frame's own info table.
+static const StgInfoTable *frameCode (StgPtr sp)
+{
+    StgClosure *frame = (StgClosure *) sp;
+
+    if (frame->header.info == &stg_enter_info) {
+        return UNTAG_CLOSURE((StgClosure *) sp[1])->header.info;
+    } else if (get_ret_itbl(frame)->i.type == RET_FUN) {
+        return UNTAG_CLOSURE(((StgRetFun *) frame)->fun)->header.info;
+    } else {
+        return frame->header.info;
+    }
+}
+
+static const StgInfoTable *allocatingCode (StgPtr sp)
+{
+    const StgInfoTable *first = NULL;
+    InfoProvEnt ipe;
+
+    for (int n = 0; n < ALLOC_SAMPLE_MAX_FRAMES; n++) {
+        StgClosure *frame = (StgClosure *) sp;
+        const StgRetInfoTable *ret = get_ret_itbl(frame);
+
+        if (ret->i.type == STOP_FRAME || ret->i.type == UNDERFLOW_FRAME) {
+            break;
+        }
+
+        const StgInfoTable *info = frameCode(sp);
+        if (lookupIPE(info, &ipe)) {
+            return info;
+        }
+        if (first == NULL) {
+            first = info;
+        }
+        sp += stack_frame_sizeW(frame);
+    }
+    return first;
+}
+
+void traceAllocSample (Capability *cap, StgTSO *tso, StgPtr sp)
+{
+    const StgInfoTable *info = allocatingCode(sp);
+    StgWord64 bytes =
+        (cap->total_allocated - cap->alloc_sample_allocated) * sizeof(W_);
+
+    cap->alloc_sample_left = RtsFlags.TraceFlags.allocSampleBlocks;
+    cap->alloc_sample_allocated = cap->total_allocated;
+
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        traceCap_stderr(cap, "thread %" FMT_StgThreadID " allocating in %p "
+                        "(%" FMT_Word64 " bytes allocated)",
+                        tso->id, (void *) info, bytes);
+    } else
+#endif
+    {
+        postEventAllocSample(cap, tso->id, (StgWord) info, bytes);
+    }
+}
+
+/* Note [Stack sampling]
+   ~~~~~~~~~~~~~~~~~~~~~
+   The time profiler of -p needs a profiling build, whose cost-centre
+   instrumentation changes how the program is optimised. With
+   --eventlog-stack-sample=<secs>, any build can instead sample the stacks
+   of the threads that are running every <secs>, into STACK_SAMPLE events.
+   Code that runs for longer is on the stacks of more samples, so counting
+   them gives a statistical time profile.
+
+   We can only read the stack of a thread while it is stopped, so at each
+   sampling tick the timer calls requestStackSamples, which sets
+   cap->stack_sample_requested on each capability running Haskell code and
+   stops it like a context switch does (stopCapability), at the thread's
+   next heap check. When the thread returns to the scheduler, schedule()
+   calls sampleThreadStack, which copies the code of the top
+   STACK_SAMPLE_DEPTH frames (see frameCode) into the capability's buffer of
+   samples, along with the thread and the time. The thread then carries on
+   unless its time slice is up. A thread that doesn't allocate doesn't stop,
+   and isn't sampled, just as it isn't preempted.
+
+   Looking up the IPE of each frame is much more expensive than copying it,
+   so we leave it until we post the samples: when the buffer is full, and
+   for every capability after each GC, when the capabilities are stopped
+   anyway. flushStackSamples then keeps the frames whose info tables have
+   an IPE (see -finfo-table-map), the ones a tool can map to a source
+   location with the IPE events, dropping the RTS's own update and catch
+   frames and the like. If no frame of a sample has an IPE, e.g. in a
+   program built without -finfo-table-map, the sample keeps all its frames.
+*/
+
+#define STACK_SAMPLE_DEPTH 32
+#define STACK_SAMPLE_BUFFER 64
+
+typedef struct {
+    StgThreadID thread;
+    StgWord64 time;             // nanoseconds, as the event timestamps
+    uint16_t n_frames;
+    const StgInfoTable *frames[STACK_SAMPLE_DEPTH];
+} StackSample;
+
+typedef struct StackSamples_ {
+    uint32_t n_samples;
+    StackSample samples[STACK_SAMPLE_BUFFER];
+} StackSamples;
+
+void requestStackSamples (void)
+{
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap = getCapability(i);
+        if (RELAXED_LOAD(&cap->in_haskell)) {
+            RELAXED_STORE(&cap->stack_sample_requested, true);
+            stopCapability(cap);
+        }
+    }
+}
+
+void sampleThreadStack (Capability *cap, StgTSO *tso)
+{
+    StackSamples *buf = cap->stack_samples;
+
+    if (buf == NULL) {
+        buf = stgMallocBytes(sizeof(StackSamples), "sampleThreadStack");
+        buf->n_samples = 0;
+        cap->stack_samples = buf;
+    } else if (buf->n_samples == STACK_SAMPLE_BUFFER) {
+        flushStackSamples(cap);
+    }
+
+    StackSample *sample = &buf->samples[buf->n_samples++];
+    StgStack *stack = tso->stackobj;
+    StgPtr sp = stack->sp;
+    uint16_t n = 0;
+
+    while (n < STACK_SAMPLE_DEPTH) {
+        StgClosure *frame = (StgClosure *) sp;
+        StgHalfWord type = get_ret_itbl(frame)->i.type;
+
+        if (type == STOP_FRAME) {
+            break;
+        } else if (type == UNDERFLOW_FRAME) {
+            stack = ((StgUnderflowFrame *) frame)->next_chunk;
+            sp = stack->sp;
+            continue;
+        }
+        sample->frames[n++] = frameCode(sp);
+        sp += stack_frame_sizeW(frame);
+    }
+
+    sample->thread = tso->id;
+    sample->time = TimeToNS(stat_getElapsedTime());
+    sample->n_frames = n;
+}
+
+void flushStackSamples (Capability *cap)
+{
+    StackSamples *buf = cap->stack_samples;
+    InfoProvEnt ipe;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < buf->n_samples; i++) {
+        StackSample *sample = &buf->samples[i];
+        uint16_t n = 0;
+
+        for (uint16_t j = 0; j < sample->n_frames; j++) {
+            if (lookupIPE(sample->frames[j], &ipe)) {
+                sample->frames[n++] = sample->frames[j];
+            }
+        }
+        if (n == 0) {
+            n = sample->n_frames;
+        }
+
+#if defined(DEBUG)
+        if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+            traceCap_stderr(cap, "thread %" FMT_StgThreadID " sampled in %p "
+                            "(%" FMT_Word32 " frames)", sample->thread,
+                            n > 0 ? (void *) sample->frames[0] : NULL,
+                            (uint32_t) n);
+        } else
+#endif
+        {
+            postEventStackSample(cap, sample->thread, sample->time, n,
+                                 sample->frames);
+        }
+    }
+    buf->n_samples = 0;
+}
+
 void traceCapEvent_ (Capability   *cap,
                      EventTypeNum  tag)
 {
@@ -572,6 +1219,10 @@ static void traceSparkEvent_stderr (Capability *cap, EventTypeNum tag,
 
 void traceSparkEvent_ (Capability *cap, EventTypeNum tag, StgWord info1)
 {
+    if (!sampleSparkEvent(cap)) {
+        return;
+    }
+
 #if defined(DEBUG)
     if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
         traceSparkEvent_stderr(cap, tag, info1);
@@ -633,6 +1284,21 @@ void traceTaskMigrate_ (Task       *task,
     }
 }
 
+void traceTaskReuse_ (Task       *task,
+                      Capability *cap)
+{
+#if defined(DEBUG)
+    if (RtsFlags.TraceFlags.tracing == TRACE_STDERR) {
+        /* We currently don't do debug tracing of tasks but we must
+           test for TRACE_STDERR because of the !eventlog_enabled case. */
+    } else
+#endif
+    {
+        EventTaskId taskid = serialisableTaskId(task);
+        postTaskReuseEvent(taskid, cap->no);
+    }
+}
+
 void traceTaskDelete_ (Task *task)
 {
 #if defined(DEBUG)
@@ -682,6 +1348,30 @@ void traceHeapProfSampleString(StgWord8 profile_id,
     }
 }
 
+void traceHeapProfSampleError(StgWord8 profile_id, StgWord error)
+{
+    if (eventlog_enabled) {
+        postHeapProfSampleError(profile_id, error);
+    }
+}
+
+void traceHeapProfSizeHistogram(StgWord8 profile_id, uint32_t n,
+                                const StgWord64 *objects,
+                                const StgWord64 *words, uint32_t scale)
+{
+    if (eventlog_enabled) {
+        postHeapProfSizeHistogram(profile_id, n, objects, words, scale);
+    }
+}
+
+void traceHeapProfSampleDelta(StgWord8 profile_id,
+                              uint32_t n, const StgWord64 *bands)
+{
+    if (eventlog_enabled) {
+        postHeapProfSampleDelta(profile_id, n, bands);
+    }
+}
+
 void traceIPE(const InfoProvEnt *ipe)
 {
 #if defined(DEBUG)
@@ -892,6 +1582,14 @@ void traceConcMarkEnd(StgWord32 marked_obj_count)
         postConcMarkEnd(marked_obj_count);
 }
 
+void traceConcMarkWorkerEnd(uint32_t worker, StgWord32 marked_obj_count,
+                            Time busy_time, Time idle_time)
+{
+    if (eventlog_enabled)
+        postConcMarkWorkerEnd(worker, marked_obj_count,
+                              TimeToNS(busy_time), TimeToNS(idle_time));
+}
+
 void traceConcSyncBegin(void)
 {
     if (eventlog_enabled)
@@ -922,6 +1620,12 @@ void traceConcUpdRemSetFlush(Capability *cap)
         postConcUpdRemSetFlush(cap);
 }
 
+void traceConcUpdRemSetHandshake(Capability *cap, Time latency)
+{
+    if (eventlog_enabled)
+        postConcUpdRemSetHandshake(cap, TimeToNS(latency));
+}
+
 void traceNonmovingHeapCensus(uint16_t blk_size,
                               const struct NonmovingAllocCensus *census)
 {
@@ -81,6 +81,9 @@ extern uint8_t TRACE_spark_full;
 extern uint8_t TRACE_cap;
 /* extern uint8_t TRACE_user; */  // only used in Trace.c
 
+// Set by the SIGUSR2 handler, see Note [Changing trace classes] in Trace.c
+extern volatile StgWord trace_toggle_requested;
+
 // -----------------------------------------------------------------------------
 // Posting events
 //
@@ -171,6 +174,73 @@ void traceEventMemReturn_  (Capability *cap,
                           uint32_t    needed_mblocks,
                           uint32_t    returned_mblocks );
 
+void traceEventGcWorkSteals_ (Capability *cap,
+                              uint32_t    gc_cap,
+                              uint32_t    stolen_blocks,
+                              uint32_t    failed_steals);
+
+void traceEventGcParThreads_ (Capability *cap,
+                              uint32_t    gen,
+                              uint32_t    threads,
+                              W_          work_bytes);
+
+void traceEventGcThreadStats_ (Capability *cap,
+                               uint32_t    gc_cap,
+                               Time        copy_start,
+                               Time        copy_end,
+                               Time        idle,
+                               W_          copied_bytes);
+
+void traceEventGcGenResize_ (CapsetID    heap_capset,
+                             uint32_t    gen,
+                             W_          max_blocks,
+                             uint32_t    survival,
+                             uint32_t    promotion,
+                             uint32_t    factor,
+                             uint32_t    gc_cpu);
+
+void traceEventPinnedFragmentation_ (CapsetID    heap_capset,
+                                     uint32_t    blocks,
+                                     uint32_t    sparse_blocks,
+                                     W_          used_bytes,
+                                     W_          live_bytes);
+
+void traceEventGcGenShape_ (CapsetID    heap_capset,
+                            uint32_t    gen,
+                            W_          live_bytes,
+                            W_          large_bytes,
+                            W_          mut_list_entries);
+
+void traceEventCapParking_ (Capability *cap,
+                            W_          spin_wakeups,
+                            W_          parks);
+
+void traceEventStmHotTVar_ (Capability *cap,
+                            StgWord     tvar,
+                            uint32_t    aborts);
+
+void traceEventBlackHoleContention_ (Capability *cap,
+                                     StgWord     info,
+                                     uint32_t    duplicates,
+                                     uint32_t    blocks);
+
+void traceEventSampledEvents_ (Capability *cap);
+
+void traceEventPerfCounters_ (StgWord8         phase,
+                              uint32_t         thread,
+                              const StgWord64 *counts);
+
+// Called by the timer, see Note [Changing trace classes]
+void toggleTraceClasses (void);
+
+// Called from stg_gc_noregs, see Note [Allocation sampling] in Trace.c
+void traceAllocSample (Capability *cap, StgTSO *tso, StgPtr sp);
+
+// See Note [Stack sampling] in Trace.c
+void requestStackSamples (void);
+void sampleThreadStack (Capability *cap, StgTSO *tso);
+void flushStackSamples (Capability *cap);
+
 /*
  * Record a spark event
  */
@@ -301,6 +371,9 @@ void traceTaskMigrate_ (Task       *task,
                         Capability *cap,
                         Capability *new_cap);
 
+void traceTaskReuse_ (Task       *task,
+                      Capability *cap);
+
 void traceTaskDelete_ (Task       *task);
 
 void traceHeapProfBegin(StgWord8 profile_id);
@@ -309,6 +382,12 @@ void traceHeapBioProfSampleBegin(StgInt era, StgWord64 time);
 void traceHeapProfSampleEnd(StgInt era);
 void traceHeapProfSampleString(StgWord8 profile_id,
                                const char *label, StgWord residency);
+void traceHeapProfSampleError(StgWord8 profile_id, StgWord error);
+void traceHeapProfSampleDelta(StgWord8 profile_id,
+                              uint32_t n, const StgWord64 *bands);
+void traceHeapProfSizeHistogram(StgWord8 profile_id, uint32_t n,
+                                const StgWord64 *objects,
+                                const StgWord64 *words, uint32_t scale);
 #if defined(PROFILING)
 void traceHeapProfCostCentre(StgWord32 ccID,
                              const char *label,
@@ -325,11 +404,14 @@ void traceProfBegin(void);
 
 void traceConcMarkBegin(void);
 void traceConcMarkEnd(StgWord32 marked_obj_count);
+void traceConcMarkWorkerEnd(uint32_t worker, StgWord32 marked_obj_count,
+                            Time busy_time, Time idle_time);
 void traceConcSyncBegin(void);
 void traceConcSyncEnd(void);
 void traceConcSweepBegin(void);
 void traceConcSweepEnd(void);
 void traceConcUpdRemSetFlush(Capability *cap);
+void traceConcUpdRemSetHandshake(Capability *cap, Time latency);
 void traceNonmovingHeapCensus(uint16_t blk_size,
                               const struct NonmovingAllocCensus *census);
 void traceNonmovingPrunedSegments(uint32_t pruned_segments, uint32_t free_segments);
@@ -349,6 +431,24 @@ void flushTrace(void);
                            par_n_threads, par_max_copied, \
                            par_tot_copied, par_balanced_copied) /* nothing */
 #define traceEventMemReturn_(cap, current, needed, returned) /* nothing */
+#define traceEventGcWorkSteals_(cap, gc_cap, stolen, failed) /* nothing */
+#define traceEventGcParThreads_(cap, gen, threads, work_bytes) /* nothing */
+#define traceEventGcThreadStats_(cap, gc_cap, copy_start, copy_end, idle, \
+                                 copied_bytes) /* nothing */
+#define traceEventGcGenResize_(heap_capset, gen, max_blocks, survival, \
+                               promotion, factor, gc_cpu) /* nothing */
+#define traceEventPinnedFragmentation_(heap_capset, blocks, sparse_blocks, \
+                                       used_bytes, live_bytes) /* nothing */
+#define traceEventGcGenShape_(heap_capset, gen, live_bytes, large_bytes, \
+                             mut_list_entries) /* nothing */
+#define traceEventCapParking_(cap, spin_wakeups, parks) /* nothing */
+#define traceEventStmHotTVar_(cap, tvar, aborts) /* nothing */
+#define traceEventBlackHoleContention_(cap, info, duplicates, blocks) /* nothing */
+#define traceEventSampledEvents_(cap) /* nothing */
+#define traceEventPerfCounters_(phase, thread, counts) /* nothing */
+#define requestStackSamples() /* nothing */
+#define sampleThreadStack(cap, tso) /* nothing */
+#define flushStackSamples(cap) /* nothing */
 #define traceHeapEvent(cap, tag, heap_capset, info1) /* nothing */
 #define traceEventHeapInfo_(heap_capset, gens, \
                             maxHeapSize, allocAreaSize, \
@@ -368,6 +468,7 @@ void flushTrace(void);
 #define traceSparkCounters_(cap, counters, remaining) /* nothing */
 #define traceTaskCreate_(taskID, cap) /* nothing */
 #define traceTaskMigrate_(taskID, cap, new_cap) /* nothing */
+#define traceTaskReuse_(taskID, cap) /* nothing */
 #define traceTaskDelete_(taskID) /* nothing */
 #define traceHeapProfBegin(profile_id) /* nothing */
 #define traceHeapProfCostCentre(ccID, label, module, srcloc, is_caf) /* nothing */
@@ -377,14 +478,19 @@ void flushTrace(void);
 #define traceHeapProfSampleEnd(era) /* nothing */
 #define traceHeapProfSampleCostCentre(profile_id, stack, residency) /* nothing */
 #define traceHeapProfSampleString(profile_id, label, residency) /* nothing */
+#define traceHeapProfSampleError(profile_id, error) /* nothing */
+#define traceHeapProfSampleDelta(profile_id, n, bands) /* nothing */
+#define traceHeapProfSizeHistogram(profile_id, n, objects, words, scale) /* nothing */
 
 #define traceConcMarkBegin() /* nothing */
 #define traceConcMarkEnd(marked_obj_count) /* nothing */
+#define traceConcMarkWorkerEnd(worker, marked_obj_count, busy_time, idle_time) /* nothing */
 #define traceConcSyncBegin() /* nothing */
 #define traceConcSyncEnd() /* nothing */
 #define traceConcSweepBegin() /* nothing */
 #define traceConcSweepEnd() /* nothing */
 #define traceConcUpdRemSetFlush(cap) /* nothing */
+#define traceConcUpdRemSetHandshake(cap, latency) /* nothing */
 #define traceNonmovingHeapCensus(blk_size, census) /* nothing */
 
 #define flushTrace() /* nothing */
@@ -771,6 +877,121 @@ INLINE_HEADER void traceEventMemReturn(Capability *cap            STG_UNUSED,
     dtraceEventMemReturn(current_mblocks, needed_mblocks, returned_mblocks);
 }
 
+INLINE_HEADER void traceEventGcWorkSteals(Capability *cap          STG_UNUSED,
+                                          uint32_t    gc_cap        STG_UNUSED,
+                                          uint32_t    stolen_blocks STG_UNUSED,
+                                          uint32_t    failed_steals STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventGcWorkSteals_(cap, gc_cap, stolen_blocks, failed_steals);
+    }
+}
+
+INLINE_HEADER void traceEventGcParThreads(Capability *cap        STG_UNUSED,
+                                          uint32_t    gen        STG_UNUSED,
+                                          uint32_t    threads    STG_UNUSED,
+                                          W_          work_bytes STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventGcParThreads_(cap, gen, threads, work_bytes);
+    }
+}
+
+INLINE_HEADER void traceEventGcThreadStats(Capability *cap          STG_UNUSED,
+                                           uint32_t    gc_cap       STG_UNUSED,
+                                           Time        copy_start   STG_UNUSED,
+                                           Time        copy_end     STG_UNUSED,
+                                           Time        idle         STG_UNUSED,
+                                           W_          copied_bytes STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventGcThreadStats_(cap, gc_cap, copy_start, copy_end, idle,
+                                 copied_bytes);
+    }
+}
+
+INLINE_HEADER void traceEventGcGenResize(CapsetID    heap_capset STG_UNUSED,
+                                         uint32_t    gen         STG_UNUSED,
+                                         W_          max_blocks  STG_UNUSED,
+                                         uint32_t    survival    STG_UNUSED,
+                                         uint32_t    promotion   STG_UNUSED,
+                                         uint32_t    factor      STG_UNUSED,
+                                         uint32_t    gc_cpu      STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventGcGenResize_(heap_capset, gen, max_blocks,
+                               survival, promotion, factor, gc_cpu);
+    }
+}
+
+INLINE_HEADER void traceEventPinnedFragmentation(CapsetID heap_capset   STG_UNUSED,
+                                                 uint32_t blocks        STG_UNUSED,
+                                                 uint32_t sparse_blocks STG_UNUSED,
+                                                 W_       used_bytes    STG_UNUSED,
+                                                 W_       live_bytes    STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventPinnedFragmentation_(heap_capset, blocks, sparse_blocks,
+                                       used_bytes, live_bytes);
+    }
+}
+
+INLINE_HEADER void traceEventGcGenShape(CapsetID heap_capset      STG_UNUSED,
+                                        uint32_t gen              STG_UNUSED,
+                                        W_       live_bytes       STG_UNUSED,
+                                        W_       large_bytes      STG_UNUSED,
+                                        W_       mut_list_entries STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventGcGenShape_(heap_capset, gen, live_bytes, large_bytes,
+                              mut_list_entries);
+    }
+}
+
+INLINE_HEADER void traceEventCapParking(Capability *cap          STG_UNUSED,
+                                        W_          spin_wakeups STG_UNUSED,
+                                        W_          parks        STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceEventCapParking_(cap, spin_wakeups, parks);
+    }
+}
+
+INLINE_HEADER void traceEventStmHotTVar(Capability *cap    STG_UNUSED,
+                                        StgWord     tvar   STG_UNUSED,
+                                        uint32_t    aborts STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceEventStmHotTVar_(cap, tvar, aborts);
+    }
+}
+
+INLINE_HEADER void traceEventBlackHoleContention(Capability *cap        STG_UNUSED,
+                                                 StgWord     info       STG_UNUSED,
+                                                 uint32_t    duplicates STG_UNUSED,
+                                                 uint32_t    blocks     STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceEventBlackHoleContention_(cap, info, duplicates, blocks);
+    }
+}
+
+INLINE_HEADER void traceEventSampledEvents(Capability *cap STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_sched || TRACE_spark_full)) {
+        traceEventSampledEvents_(cap);
+    }
+}
+
+INLINE_HEADER void traceEventPerfCounters(StgWord8         phase  STG_UNUSED,
+                                          uint32_t         thread STG_UNUSED,
+                                          const StgWord64 *counts STG_UNUSED)
+{
+    if (RTS_UNLIKELY(TRACE_gc)) {
+        traceEventPerfCounters_(phase, thread, counts);
+    }
+}
+
 INLINE_HEADER void traceEventHeapInfo(CapsetID    heap_capset   STG_UNUSED,
                                       uint32_t  gens          STG_UNUSED,
                                       W_        maxHeapSize   STG_UNUSED,
@@ -961,6 +1182,16 @@ INLINE_HEADER void traceTaskMigrate(Task       *task    STG_UNUSED,
                                                 (EventCapNo)new_cap->no);
 }
 
+INLINE_HEADER void traceTaskReuse(Task       *task STG_UNUSED,
+                                  Capability *cap  STG_UNUSED)
+{
+    ASSERT(task->cap == cap);
+    // A spare worker task takes the cap.
+    if (RTS_UNLIKELY(TRACE_sched)) {
+        traceTaskReuse_(task, cap);
+    }
+}
+
 INLINE_HEADER void traceTaskDelete(Task *task STG_UNUSED)
 {
     ASSERT(task->cap != NULL);
@@ -12,12 +12,29 @@
 #include "rts/PosixSource.h"
 #include "Rts.h"
 #include "sm/Storage.h"
+#include "sm/GC.h"
+#include "RtsUtils.h"
+#include "Hash.h"
 #include <string.h>
 
 #include "TraverseHeap.h"
 
 const stackData nullStackData;
 
+#if defined(THREADED_RTS)
+static bool traverseSetVisited(struct traversePar_ *par, StgClosure *c);
+static bool traverseShareWork(traverseState *ts, StgClosure *c,
+                              StgClosure *cp, stackData data);
+#endif
+
+// The work-stacks of the workers of a parallel traversal allocate their
+// blocks concurrently, see Note [Parallel heap traversal].
+STATIC_INLINE bdescr *
+allocStackBlocks( traverseState *ts, W_ n )
+{
+    return ts->par != NULL ? allocGroup_lock(n) : allocGroup(n);
+}
+
 StgWord getTravData(const StgClosure *c)
 {
     const StgWord hp_hdr = c->header.prof.hp.trav;
@@ -94,7 +111,7 @@ initializeTraverseStack( traverseState *ts )
         freeChain(ts->firstStack);
     }
 
-    ts->firstStack = allocGroup(BLOCKS_IN_STACK);
+    ts->firstStack = allocStackBlocks(ts, BLOCKS_IN_STACK);
     ts->firstStack->link = NULL;
     ts->firstStack->u.back = NULL;
 
@@ -113,7 +130,11 @@ initializeTraverseStack( traverseState *ts )
 void
 closeTraverseStack( traverseState *ts )
 {
-    freeChain(ts->firstStack);
+    if (ts->par != NULL) {
+        freeChain_lock(ts->firstStack);
+    } else {
+        freeChain(ts->firstStack);
+    }
     ts->firstStack = NULL;
 }
 
@@ -236,7 +257,7 @@ pushStackElement(traverseState *ts, const stackElement se)
         ts->currentStack->free = (StgPtr)ts->stackTop;
 
         if (ts->currentStack->link == NULL) {
-            nbd = allocGroup(BLOCKS_IN_STACK);
+            nbd = allocStackBlocks(ts, BLOCKS_IN_STACK);
             nbd->link = NULL;
             nbd->u.back = ts->currentStack;
             ts->currentStack->link = nbd;
@@ -1134,6 +1155,13 @@ loop:
         return;
     }
 
+#if defined(THREADED_RTS)
+    // See Note [Parallel heap traversal]
+    if (ts->par != NULL && traverseShareWork(ts, c, cp, data)) {
+        goto loop;
+    }
+#endif
+
 inner_loop:
     c = UNTAG_CLOSURE(c);
 
@@ -1207,8 +1235,17 @@ inner_loop:
 
     stackAccum accum = {};
 
-    // If this is the first visit to c, initialize its data.
-    bool first_visit = traverseMaybeInitClosureData(ts, c);
+    // If this is the first visit to c, initialize its data. A parallel
+    // traversal leaves the closure alone, see Note [Parallel heap traversal].
+    bool first_visit;
+#if defined(THREADED_RTS)
+    if (ts->par != NULL) {
+        first_visit = traverseSetVisited(ts->par, c);
+    } else
+#endif
+    {
+        first_visit = traverseMaybeInitClosureData(ts, c);
+    }
     bool traverse_children = first_visit;
     if(visit_cb)
         traverse_children = visit_cb(c, cp, data, first_visit,
@@ -1343,6 +1380,358 @@ inner_loop:
     goto inner_loop;
 }
 
+#if defined(THREADED_RTS)
+
+/* Note [Parallel heap traversal]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   traverseWorkStackParallel does what traverseWorkStack does, but with the
+   GC threads, which have nothing to do between the end of a GC and the
+   release of the mutator (see Note [Running tasks on exited GC threads] in
+   GC.c). The roots pushed on the traverseState it is given are the work to
+   begin with. It differs from traverseWorkStack in a few ways:
+
+    * Each worker traverses with a traverseState of its own, and so a
+      work-stack of its own. A worker with nothing to do claims the next of
+      the roots (traversePar.roots), or when there are none left steals
+      work from the others.
+
+    * While some workers are idle, a worker moves the closures it pops off
+      its work-stack into its share (traverseShare), up to
+      TRAVERSE_SHARE_SIZE of them, rather than visiting them itself. Idle
+      workers steal from the shares. A closure moves with its parent and
+      its data, but not with its stack element, so there is no return_cb
+      in a parallel traversal.
+
+    * Whether a closure has been visited before (first_visit) comes from a
+      bitmap with a bit for each word of the heap, rather than from the
+      flip bit in the closure's header: several workers may reach a closure
+      at once, and exactly one of them must see first_visit. The bitmap is
+      made of one piece per megablock, which we find in an open-addressed
+      table (traversePar.visited) and allocate when a closure in the
+      megablock is first visited. Static closures, which aren't in any
+      megablock of the heap, go in a hash table under a lock instead.
+
+      The engine hence never writes the closures' headers. That is left to
+      the visitor, which must cope with being called on the same closure
+      by several workers at once; see retainVisitClosurePar in
+      RetainerProfile.c.
+
+    * The workers allocate their work-stacks with the SM lock, which the GC
+      no longer holds by then.
+
+   The traversal is over when no worker is busy, no roots are left and the
+   shares are empty: only a busy worker can put work in a share. Without
+   other GC threads to run on (the non-threaded RTS, a sequential GC)
+   traverseWorkStackParallel just calls traverseWorkStack.
+*/
+
+#define TRAVERSE_SHARE_SIZE 32
+
+typedef struct {
+    StgClosure *c, *cp;
+    stackData data;
+} traverseShareElem;
+
+typedef struct traverseShare_ {
+    Mutex lock;
+    uint32_t n;
+    traverseShareElem elems[TRAVERSE_SHARE_SIZE];
+} traverseShare;
+
+typedef struct {
+    StgWord mblock;     // 0 if free
+    StgWord *bits;      // NULL until allocated by whoever took the slot
+} traverseVisitedMBlock;
+
+struct traversePar_ {
+    visitClosure_cb visit_cb;
+    StgWord flip;
+
+    traverseShareElem *roots;
+    StgWord n_roots;
+    StgWord next_root;
+
+    traverseShare *shares;      // one per worker
+    uint32_t n_shares;
+    StgWord n_workers;          // workers that have started
+    StgWord n_busy;             // workers with work
+    StgWord n_idle;             // workers looking for work
+
+    traverseVisitedMBlock *visited;
+    StgWord visited_mask;
+
+    // protects static_visited and max_stack_size
+    Mutex lock;
+    HashTable *static_visited;
+    int max_stack_size;
+};
+
+// The traversal traverseTask takes part in
+static struct traversePar_ *the_par = NULL;
+
+/**
+ * Mark a closure as visited in a parallel traversal, returns true if it
+ * wasn't visited already.
+ */
+static bool
+traverseSetVisited(struct traversePar_ *par, StgClosure *c)
+{
+    if (!HEAP_ALLOCED(c)) {
+        bool first;
+        ACQUIRE_LOCK(&par->lock);
+        first = lookupHashTable(par->static_visited, (StgWord)c) == NULL;
+        if (first) {
+            insertHashTable(par->static_visited, (StgWord)c, (void *)1);
+        }
+        RELEASE_LOCK(&par->lock);
+        return first;
+    }
+
+    const StgWord mblock = (StgWord)c & ~MBLOCK_MASK;
+    StgWord i = (mblock >> MBLOCK_SHIFT) & par->visited_mask;
+    StgWord *bits;
+
+    for (;;) {
+        traverseVisitedMBlock *slot = &par->visited[i];
+        StgWord old = cas((StgVolatilePtr)&slot->mblock, 0, mblock);
+        if (old == 0) {
+            bits = stgCallocBytes(MBLOCK_SIZE / sizeof(W_) / BITS_IN(W_),
+                                  sizeof(W_), "traverseSetVisited");
+            RELEASE_STORE(&slot->bits, bits);
+            break;
+        } else if (old == mblock) {
+            while ((bits = ACQUIRE_LOAD(&slot->bits)) == NULL) {
+                busy_wait_nop();
+            }
+            break;
+        }
+        i = (i + 1) & par->visited_mask;
+    }
+
+    const StgWord w = ((StgWord)c & MBLOCK_MASK) / sizeof(W_);
+    const StgWord bit = (StgWord)1 << (w % BITS_IN(W_));
+    return (__atomic_fetch_or(&bits[w / BITS_IN(W_)], bit, __ATOMIC_RELAXED)
+            & bit) == 0;
+}
+
+/**
+ * Move a closure just popped off the work-stack to the worker's share if
+ * there are idle workers to steal it, returns true if it did.
+ */
+static bool
+traverseShareWork(traverseState *ts, StgClosure *c, StgClosure *cp,
+                  stackData data)
+{
+    struct traversePar_ *par = ts->par;
+    traverseShare *share = ts->share;
+    bool shared = false;
+
+    if (RELAXED_LOAD(&par->n_idle) == 0
+        || RELAXED_LOAD(&share->n) == TRAVERSE_SHARE_SIZE) {
+        return false;
+    }
+
+    ACQUIRE_LOCK(&share->lock);
+    if (share->n < TRAVERSE_SHARE_SIZE) {
+        share->elems[share->n] = (traverseShareElem){ c, cp, data };
+        share->n++;
+        shared = true;
+    }
+    RELEASE_LOCK(&share->lock);
+    return shared;
+}
+
+/**
+ * Is there work for an idle worker to take?
+ */
+static bool
+traverseWorkAvailable(struct traversePar_ *par)
+{
+    if (RELAXED_LOAD(&par->next_root) < par->n_roots) {
+        return true;
+    }
+    for (uint32_t i = 0; i < par->n_shares; i++) {
+        if (RELAXED_LOAD(&par->shares[i].n) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Claim a root, or steal half of a share, and push it on the worker's
+ * work-stack. Returns false if there was nothing to take.
+ */
+static bool
+traverseTakeWork(traverseState *ts)
+{
+    struct traversePar_ *par = ts->par;
+
+    StgWord r = atomic_inc(&par->next_root, 1) - 1;
+    if (r < par->n_roots) {
+        traverseShareElem *e = &par->roots[r];
+        traversePushRoot(ts, e->c, e->cp, e->data);
+        return true;
+    }
+
+    for (uint32_t i = 0; i < par->n_shares; i++) {
+        traverseShare *share = &par->shares[i];
+        if (RELAXED_LOAD(&share->n) == 0) {
+            continue;
+        }
+        ACQUIRE_LOCK(&share->lock);
+        uint32_t n = (share->n + 1) / 2;
+        for (uint32_t j = 0; j < n; j++) {
+            share->n--;
+            traverseShareElem *e = &share->elems[share->n];
+            traversePushRoot(ts, e->c, e->cp, e->data);
+        }
+        RELEASE_LOCK(&share->lock);
+        if (n > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Wait for work, returns false when the traversal is over. A worker that
+ * gets work is counted as busy until it has done it.
+ */
+static bool
+traverseFindWork(traverseState *ts)
+{
+    struct traversePar_ *par = ts->par;
+
+    atomic_inc(&par->n_idle, 1);
+    for (;;) {
+        if (traverseWorkAvailable(par)) {
+            atomic_inc(&par->n_busy, 1);
+            if (traverseTakeWork(ts)) {
+                atomic_dec(&par->n_idle, 1);
+                return true;
+            }
+            atomic_dec(&par->n_busy, 1);
+        } else if (SEQ_CST_LOAD(&par->n_busy) == 0
+                   && !traverseWorkAvailable(par)) {
+            // Nobody is left to make more work. Whoever took what there
+            // was since we looked is busy with it, and will finish it.
+            atomic_dec(&par->n_idle, 1);
+            return false;
+        }
+        busy_wait_nop();
+    }
+}
+
+static void
+traverseTask(void)
+{
+    struct traversePar_ *par = the_par;
+    traverseState ts = { .flip = par->flip, .par = par };
+    StgWord me = atomic_inc(&par->n_workers, 1) - 1;
+
+    ASSERT(me < par->n_shares);
+    ts.share = &par->shares[me];
+    initializeTraverseStack(&ts);
+
+    while (traverseFindWork(&ts)) {
+        traverseWorkStack(&ts, par->visit_cb);
+        atomic_dec(&par->n_busy, 1);
+    }
+
+    ACQUIRE_LOCK(&par->lock);
+    par->max_stack_size = stg_max(par->max_stack_size, ts.maxStackSize);
+    RELEASE_LOCK(&par->lock);
+    closeTraverseStack(&ts);
+}
+
+#endif /* THREADED_RTS */
+
+/**
+ * Like traverseWorkStack, but traverse with all the GC threads after a
+ * parallel GC. 'ts' must not have a return_cb. When the traversal is over
+ * the work-stack of 'ts' is empty. See Note [Parallel heap traversal].
+ */
+void
+traverseWorkStackParallel(traverseState *ts, visitClosure_cb visit_cb)
+{
+#if defined(THREADED_RTS)
+    if (!isParallelGc()) {
+        traverseWorkStack(ts, visit_cb);
+        return;
+    }
+
+    ASSERT(ts->return_cb == NULL);
+    ASSERT(ts->par == NULL);
+
+    struct traversePar_ par = { .visit_cb = visit_cb, .flip = ts->flip };
+    StgClosure *c, *cp;
+    stackData data;
+    stackElement *sep;
+
+    // Take the roots off the work-stack, for the workers to claim
+    StgWord roots_size = 64;
+    par.roots = stgMallocBytes(roots_size * sizeof(traverseShareElem),
+                               "traverseWorkStackParallel");
+    for (;;) {
+        traversePop(ts, &c, &cp, &data, &sep);
+        if (c == NULL) {
+            break;
+        }
+        if (par.n_roots == roots_size) {
+            roots_size *= 2;
+            par.roots = stgReallocBytes(par.roots,
+                                        roots_size * sizeof(traverseShareElem),
+                                        "traverseWorkStackParallel");
+        }
+        par.roots[par.n_roots++] = (traverseShareElem){ c, cp, data };
+    }
+
+    par.n_shares = getNumCapabilities();
+    par.shares = stgCallocBytes(par.n_shares, sizeof(traverseShare),
+                                "traverseWorkStackParallel");
+    for (uint32_t i = 0; i < par.n_shares; i++) {
+        initMutex(&par.shares[i].lock);
+    }
+
+    // At least twice as many slots as there are megablocks, so probing
+    // stays short
+    StgWord n_visited = 1;
+    while (n_visited < 2 * (StgWord)mblocks_allocated) {
+        n_visited *= 2;
+    }
+    par.visited = stgCallocBytes(n_visited, sizeof(traverseVisitedMBlock),
+                                 "traverseWorkStackParallel");
+    par.visited_mask = n_visited - 1;
+
+    initMutex(&par.lock);
+    par.static_visited = allocHashTable();
+    par.max_stack_size = ts->maxStackSize;
+
+    the_par = &par;
+    runGcTask(traverseTask);
+    the_par = NULL;
+
+    ts->maxStackSize = par.max_stack_size;
+
+    for (StgWord i = 0; i < n_visited; i++) {
+        if (par.visited[i].bits != NULL) {
+            stgFree(par.visited[i].bits);
+        }
+    }
+    stgFree(par.visited);
+    freeHashTable(par.static_visited, NULL);
+    closeMutex(&par.lock);
+    for (uint32_t i = 0; i < par.n_shares; i++) {
+        closeMutex(&par.shares[i].lock);
+    }
+    stgFree(par.shares);
+    stgFree(par.roots);
+#else
+    traverseWorkStack(ts, visit_cb);
+#endif
+}
+
 /**
  * This function flips the 'flip' bit and hence every closure's profiling data
  * will be reset to zero upon visiting. See Note [Profiling heap traversal
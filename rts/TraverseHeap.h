@@ -196,6 +196,14 @@ typedef struct traverseState_ {
      */
     void (*return_cb)(StgClosure *c, const stackAccum acc,
                       StgClosure *c_parent, stackAccum *acc_parent);
+
+    /**
+     * The parallel traversal this is the work-stack of a worker of, or NULL,
+     * and the worker's share of work for others to steal.
+     * See Note [Parallel heap traversal].
+     */
+    struct traversePar_ *par;
+    struct traverseShare_ *share;
 } traverseState;
 
 /**
@@ -209,6 +217,10 @@ typedef struct traverseState_ {
  * Returning 'false' will instruct the heap traversal code to skip processing
  * this closure's children. If you don't need to traverse any closure more than
  * once you can simply return 'first_visit'.
+ *
+ * In a parallel traversal (traverseWorkStackParallel) the closure's profiling
+ * data is not initialized, and the callback may be called on the same closure
+ * by several threads at once. See Note [Parallel heap traversal].
  */
 typedef bool (*visitClosure_cb) (
     StgClosure *c,
@@ -223,6 +235,7 @@ void setTravData(const traverseState *ts, StgClosure *c, StgWord w);
 bool isTravDataValid(const traverseState *ts, const StgClosure *c);
 
 void traverseWorkStack(traverseState *ts, visitClosure_cb visit_cb);
+void traverseWorkStackParallel(traverseState *ts, visitClosure_cb visit_cb);
 void traversePushRoot(traverseState *ts, StgClosure *c, StgClosure *cp, stackData data);
 void traversePushClosure(traverseState *ts, StgClosure *c, StgClosure *cp, stackElement *sep, stackData data);
 bool traverseMaybeInitClosureData(const traverseState* ts, StgClosure *c);
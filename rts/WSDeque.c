@@ -40,6 +40,19 @@
  *
  * Both popWSDeque and stealWSDeque also return NULL when the queue is empty.
  *
+ * A deque created by newGrowableWSDeque doubles its array when a push finds
+ * it full, up to its max_size, as in Chase and Lev's paper: the owner copies
+ * the elements into the new array and publishes it, and thieves read the
+ * array after bottom, so that they see the array any element they may take
+ * was pushed into. A thief may still be reading an old array, whose elements
+ * are still valid (its CAS of top fails otherwise), so the old arrays are only
+ * freed by freeRetiredWSDeque, when nobody is stealing.
+ *
+ * stealHalfWSDeque takes its elements with one CAS each, like stealWSDeque_.
+ * Taking a range of them with a single CAS of top would not be safe: popWSDeque
+ * only uses the CAS for the last element, so it could pop from the bottom of
+ * the range while the thief is taking it.
+ *
  * Testing: see testsuite/tests/rts/testwsdeque.c.  If
  * there's anything wrong with the deque implementation, this test
  * will probably catch it.
@@ -83,8 +96,21 @@ roundUp2(StgWord val)
     return rounded;
 }
 
+static WSDequeArray *
+newWSDequeArray (StgWord realsize)
+{
+    WSDequeArray *a;
+
+    a = stgMallocBytes(sizeof(WSDequeArray)
+                       + realsize * sizeof(StgClosurePtr), /* dataspace */
+                       "newWSDeque:data space");
+    a->moduloSize = realsize - 1;
+    a->retired = NULL;
+    return a;
+}
+
 WSDeque *
-newWSDeque (uint32_t size)
+newGrowableWSDeque (uint32_t size, uint32_t max_size)
 {
     StgWord realsize;
     WSDeque *q;
@@ -93,10 +119,11 @@ newWSDeque (uint32_t size)
 
     q = (WSDeque*) stgMallocBytes(sizeof(WSDeque),   /* admin fields */
                                   "newWSDeque");
-    q->elements = stgMallocBytes(realsize * sizeof(StgClosurePtr), /* dataspace */
-                                 "newWSDeque:data space");
+    q->array = newWSDequeArray(realsize);
+    q->elements = q->array->elements;
     q->size = realsize;  /* power of 2 */
     q->moduloSize = realsize - 1; /* n % size == n & moduloSize  */
+    q->max_size = max_size > size ? roundUp2(max_size) : realsize;
 
     q->top=0;
     RELEASE_STORE(&q->bottom, 0); /* read by writer, updated each time top is read */
@@ -105,14 +132,33 @@ newWSDeque (uint32_t size)
     return q;
 }
 
+WSDeque *
+newWSDeque (uint32_t size)
+{
+    return newGrowableWSDeque(size, size);
+}
+
 /* -----------------------------------------------------------------------------
  * freeWSDeque
  * -------------------------------------------------------------------------- */
 
+void
+freeRetiredWSDeque (WSDeque *q)
+{
+    WSDequeArray *a, *next;
+
+    for (a = q->array->retired; a != NULL; a = next) {
+        next = a->retired;
+        stgFree(a);
+    }
+    q->array->retired = NULL;
+}
+
 void
 freeWSDeque (WSDeque *q)
 {
-    stgFree(q->elements);
+    freeRetiredWSDeque(q);
+    stgFree(q->array);
     stgFree(q);
 }
 
@@ -173,7 +219,9 @@ stealWSDeque_ (WSDeque *q)
     void *result = NULL;
     if (t < b) {
         /* Non-empty queue */
-        result = RELAXED_LOAD(&q->elements[t % q->size]);
+        // Read after bottom; see the growing deques above.
+        WSDequeArray *a = ACQUIRE_LOAD(&q->array);
+        result = RELAXED_LOAD(&a->elements[t & a->moduloSize]);
         if (!cas_top(q, t, t+1)) {
             return NULL;
         }
@@ -193,10 +241,46 @@ stealWSDeque (WSDeque *q)
     return stolen;
 }
 
+uint32_t
+stealHalfWSDeque (WSDeque *q, void **elems, uint32_t max)
+{
+    StgInt half = (dequeElements(q) + 1) / 2;
+    uint32_t n = 0;
+
+    while (n < max && (StgInt) n < half) {
+        void *stolen = stealWSDeque_(q);
+        if (stolen == NULL) {
+            break;
+        }
+        elems[n++] = stolen;
+    }
+    return n;
+}
+
 /* -----------------------------------------------------------------------------
  * pushWSQueue
  * -------------------------------------------------------------------------- */
 
+/* Double the size of a full deque. Must only be called by owner. */
+static void
+growWSDeque (WSDeque *q, StgInt t, StgInt b)
+{
+    WSDequeArray *old = q->array;
+    WSDequeArray *new = newWSDequeArray(q->size * 2);
+
+    // Thieves may take elements meanwhile; copying them too is harmless.
+    for (StgInt i = t; i < b; i++) {
+        new->elements[i & new->moduloSize] =
+            RELAXED_LOAD(&old->elements[i & old->moduloSize]);
+    }
+    new->retired = old;
+
+    q->elements = new->elements;
+    q->size = new->moduloSize + 1;
+    q->moduloSize = new->moduloSize;
+    RELEASE_STORE(&q->array, new);
+}
+
 /* Enqueue an element. Must only be called by owner. Returns true if element was
  * pushed, false if queue is full
  */
@@ -208,8 +292,10 @@ pushWSDeque (WSDeque* q, void * elem)
 
     if ( b - t > q->size - 1 ) {
         /* Full queue */
-        /* We don't implement resizing, just say we didn't push anything. */
-        return false;
+        if (q->size >= q->max_size) {
+            return false;
+        }
+        growWSDeque(q, t, b);
     }
 
     RELAXED_STORE(&q->elements[b & q->moduloSize], elem);
@@ -8,12 +8,23 @@
 
 #pragma once
 
+// An elements array together with its size, as seen by thieves, which
+// mustn't mix up the size of one array with another when the deque grows.
+typedef struct WSDequeArray_ {
+    StgWord moduloSize;
+    struct WSDequeArray_ *retired; /* arrays replaced before this one */
+    void *elements[];
+} WSDequeArray;
+
 typedef struct WSDeque_ {
     // Size of elements array. Used for modulo calculation: we round up
     // to powers of 2 and use the dyadic log (modulo == bitwise &)
     StgInt size;
     StgWord moduloSize; /* bitmask for modulo */
 
+    // The deque doubles in size when full, up to max_size elements.
+    StgInt max_size;
+
     // top, index where multiple readers steal() (protected by a cas)
     StgInt top;
 
@@ -24,9 +35,15 @@ typedef struct WSDeque_ {
     // both top and bottom are continuously incremented, and used as
     // an index modulo the current array size.
 
-    // The elements array
+    // The elements array (array->elements), and its size above, for the
+    // owner.
     void ** elements;
 
+    // The current array, for thieves. When the deque grows the arrays it
+    // replaces are kept, as thieves may still be reading them, until
+    // freeRetiredWSDeque().
+    WSDequeArray *array;
+
     //  Please note: the dataspace cannot follow the admin fields
     //  immediately, as it should be possible to enlarge it without
     //  disposing the old one automatically (as realloc would)!
@@ -55,20 +72,27 @@ typedef struct WSDeque_ {
  *
  * A WSDeque has an *owner* thread.  The owner can perform any operation;
  * other threads are only allowed to call stealWSDeque_(),
- * stealWSDeque(), looksEmptyWSDeque(), and dequeElements().
+ * stealWSDeque(), stealHalfWSDeque(), looksEmptyWSDeque(), and
+ * dequeElements().
  *
  * -------------------------------------------------------------------------- */
 
 // Allocation, deallocation
 WSDeque * newWSDeque  (uint32_t size);
+WSDeque * newGrowableWSDeque (uint32_t size, uint32_t max_size);
 void      freeWSDeque (WSDeque *q);
 
+// Frees the arrays the deque has outgrown.  Only safe when nobody is
+// stealing from the deque (e.g. during GC).
+void      freeRetiredWSDeque (WSDeque *q);
+
 // (owner-only) Take an element from the "write" end of the pool.  Can be called
 // by the pool owner only.
 void* popWSDeque (WSDeque *q);
 
-// (owner-only) Push onto the "write" end of the pool.  Return true if the push
-// succeeded, or false if the deque is full.
+// (owner-only) Push onto the "write" end of the pool, growing it if it is full
+// and smaller than its max_size.  Return true if the push succeeded, or false
+// if the deque is full.
 bool pushWSDeque (WSDeque *q, void *elem);
 
 // (owner-only) Removes all elements from the deque.
@@ -83,6 +107,11 @@ void * stealWSDeque_ (WSDeque *q);
 // NULL if the pool is empty.
 void * stealWSDeque (WSDeque *q);
 
+// Removes up to half of the elements of the deque, and no more than max, from
+// the "read" end into elems. Returns the number removed, which can be 0 if the
+// pool is empty or there was a collision with another thief.
+uint32_t stealHalfWSDeque (WSDeque *q, void **elems, uint32_t max);
+
 // "guesses" whether a deque is empty. Can return false negatives in
 // presence of concurrent steal() calls, and false positives in
 // presence of a concurrent pushBottom().
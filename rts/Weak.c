@@ -24,10 +24,24 @@ static StgWeak *finalizer_list = NULL;
 // Count of the above list.
 static uint32_t n_finalizers = 0;
 
-void
-runCFinalizers(StgCFinalizerList *list)
+// C finalizers of dead weak pointers scheduled to run, and run so far, and
+// the Haskell finalizers handed to threads and the threads, for getRTSStats
+static StgWord c_finalizers_scheduled = 0;
+static StgWord c_finalizers_run = 0;
+static StgWord hs_finalizers_scheduled = 0;
+static StgWord finalizer_threads = 0;
+
+#if defined(THREADED_RTS)
+static bool finalizerThreadRunning(void);
+static void queueCFinalizers(StgWeak *list, uint32_t n);
+#endif
+
+// Run a list of C finalizers, returning how many there were
+static uint32_t
+runCFinalizerList(StgCFinalizerList *list)
 {
     StgCFinalizerList *head;
+    uint32_t n = 0;
     for (head = list;
         (StgClosure *)head != &stg_NO_FINALIZER_closure;
         head = (StgCFinalizerList *)head->link)
@@ -36,7 +50,27 @@ runCFinalizers(StgCFinalizerList *list)
             ((void (*)(void *, void *))head->fptr)(head->eptr, head->ptr);
         else
             ((void (*)(void *))head->fptr)(head->ptr);
+        n++;
     }
+    return n;
+}
+
+void
+runCFinalizers(StgCFinalizerList *list)
+{
+    runCFinalizerList(list);
+}
+
+// The number of C finalizers on a list
+static uint32_t
+countCFinalizers(StgCFinalizerList *list)
+{
+    uint32_t n = 0;
+    for (; (StgClosure *)list != &stg_NO_FINALIZER_closure;
+         list = (StgCFinalizerList *)list->link) {
+        n++;
+    }
+    return n;
 }
 
 void
@@ -84,34 +118,89 @@ runAllCFinalizers(StgWeak *list)
  * Pre-condition: sched_mutex _not_ held.
  */
 
-void
-scheduleFinalizers(Capability *cap, StgWeak *list)
+// Start a thread running the Haskell finalizers of the first n weak pointers
+// with one, starting at *w, and advance *w past them
+static void
+scheduleFinalizerBatch(Capability *cap, StgWeak **w, uint32_t n)
 {
-    StgWeak *w;
     StgTSO *t;
     StgMutArrPtrs *arr;
     StgWord size;
-    uint32_t n, i;
+    uint32_t i;
+
+    size = n + mutArrPtrsCardTableSize(n);
+    arr = (StgMutArrPtrs *)allocate(cap, sizeofW(StgMutArrPtrs) + size);
+    TICK_ALLOC_PRIM(sizeofW(StgMutArrPtrs), n, 0);
+    // No write barrier needed here; this array is only going to referred to by this core.
+    SET_HDR(arr, &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info, CCS_SYSTEM);
+    arr->ptrs = n;
+    arr->size = size;
+
+    i = 0;
+    for (; i < n; *w = (*w)->link) {
+        if ((*w)->finalizer != &stg_NO_FINALIZER_closure) {
+            arr->payload[i] = (*w)->finalizer;
+            i++;
+        }
+    }
+    // set all the cards to 1
+    for (i = n; i < size; i++) {
+        arr->payload[i] = (StgClosure *)(W_)(-1);
+    }
+
+    t = createIOThread(cap,
+                       RtsFlags.GcFlags.initialStkSize,
+                       rts_apply(cap,
+                           rts_apply(cap,
+                               (StgClosure *)runFinalizerBatch_closure,
+                               rts_mkInt(cap,n)),
+                           (StgClosure *)arr)
+        );
+
+    scheduleThread(cap,t);
+
+    RELAXED_ADD(&hs_finalizers_scheduled, n);
+    RELAXED_ADD(&finalizer_threads, 1);
+}
+
+/*
+ * scheduleFinalizers() is called on the list of weak pointers found
+ * to be dead after a garbage collection.  It overwrites each object
+ * with DEAD_WEAK, and creates a new thread to run the pending finalizers.
+ *
+ * This function is called just after GC.  The weak pointers on the
+ * argument list are those whose keys were found to be not reachable,
+ * however the value and finalizer fields have by now been marked live.
+ * The weak pointer object itself may not be alive - i.e. we may be
+ * looking at either an object in from-space or one in to-space.  It
+ * doesn't really matter either way.
+ *
+ * With --finalizer-batch=<n>, the Haskell finalizers are split into batches
+ * of n, each run by its own thread, and the C finalizers are run by the
+ * finalizer thread; see Note [Batched finalizers].
+ *
+ * Pre-condition: sched_mutex _not_ held.  The caller holds all the
+ * capabilities.
+ */
+
+void
+scheduleFinalizers(Capability *cap, StgWeak *list)
+{
+    StgWeak *w;
+    uint32_t n, i, n_c;
 
     // n_finalizers is not necessarily zero under non-moving collection
     // because non-moving collector does not wait for the list to be consumed
     // (by doIdleGcWork()) before appending the list with more finalizers.
     ASSERT(RtsFlags.GcFlags.useNonmoving || SEQ_CST_LOAD(&n_finalizers) == 0);
 
-    // Append finalizer_list with the new list. TODO: Perhaps cache tail of the
-    // list for faster append. NOTE: We can't append `list` here! Otherwise we
-    // end up traversing already visited weaks in the loops below.
-    StgWeak **tl = &finalizer_list;
-    while (*tl) {
-        tl = &(*tl)->link;
-    }
-    SEQ_CST_STORE(tl, list);
-
     // Traverse the list and
     //  * count the number of Haskell finalizers
+    //  * count the number of C finalizers
     //  * overwrite all the weak pointers with DEAD_WEAK
     n = 0;
     i = 0;
+    n_c = 0;
     for (w = list; w; w = w->link) {
         // Better not be a DEAD_WEAK at this stage; the garbage
         // collector removes DEAD_WEAKs from the weak pointer list.
@@ -121,6 +210,8 @@ scheduleFinalizers(Capability *cap, StgWeak *list)
             n++;
         }
 
+        n_c += countCFinalizers((StgCFinalizerList *)w->cfinalizers);
+
         // Remember the length of the list, for runSomeFinalizers() below
         i++;
 
@@ -140,45 +231,248 @@ scheduleFinalizers(Capability *cap, StgWeak *list)
         SET_HDR(w, &stg_DEAD_WEAK_info, w->header.prof.ccs);
     }
 
-    SEQ_CST_ADD(&n_finalizers, i);
+    RELAXED_ADD(&c_finalizers_scheduled, n_c);
+
+#if defined(THREADED_RTS)
+    if (n_c > 0 && finalizerThreadRunning()) {
+        // See Note [Batched finalizers]
+        queueCFinalizers(list, n_c);
+    } else
+#endif
+    if (n_c > 0) {
+        // Append finalizer_list with the new list. TODO: Perhaps cache tail
+        // of the list for faster append.
+        StgWeak **tl = &finalizer_list;
+        while (*tl) {
+            tl = &(*tl)->link;
+        }
+        SEQ_CST_STORE(tl, list);
+        SEQ_CST_ADD(&n_finalizers, i);
+    }
 
     // No Haskell finalizers to run?
     if (n == 0) return;
 
     debugTrace(DEBUG_weak, "weak: batching %d finalizers", n);
 
-    size = n + mutArrPtrsCardTableSize(n);
-    arr = (StgMutArrPtrs *)allocate(cap, sizeofW(StgMutArrPtrs) + size);
-    TICK_ALLOC_PRIM(sizeofW(StgMutArrPtrs), n, 0);
-    // No write barrier needed here; this array is only going to referred to by this core.
-    SET_HDR(arr, &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info, CCS_SYSTEM);
-    arr->ptrs = n;
-    arr->size = size;
+    const uint32_t batch = RtsFlags.GcFlags.finalizerBatch;
+    if (batch == 0 || n <= batch) {
+        w = list;
+        scheduleFinalizerBatch(cap, &w, n);
+        return;
+    }
 
-    n = 0;
-    for (w = list; w; w = w->link) {
-        if (w->finalizer != &stg_NO_FINALIZER_closure) {
-            arr->payload[n] = w->finalizer;
-            n++;
+    // See Note [Batched finalizers]
+    const uint32_t n_caps = RELAXED_LOAD(&enabled_capabilities);
+    uint32_t c = cap->no;
+    w = list;
+    for (uint32_t left = n; left > 0; ) {
+        const uint32_t k = stg_min(left, batch);
+        scheduleFinalizerBatch(getCapability(c % n_caps), &w, k);
+        left -= k;
+        c++;
+    }
+}
+
+/* Note [Batched finalizers]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~
+ * By default the Haskell finalizers of the weak pointers found dead by a GC
+ * are all run one after another by a single thread, and their C finalizers
+ * (those of ForeignPtrs made with Foreign.ForeignPtr.newForeignPtr) by
+ * whichever capability is idle (see "Incrementally running C finalizers"
+ * below).  When tens of thousands of ForeignPtrs die at once, a busy program
+ * gets through them slowly and the memory they hold isn't freed.
+ *
+ * With --finalizer-batch=<n>:
+ *
+ *  - scheduleFinalizers splits the Haskell finalizers into batches of n and
+ *    starts a thread for each, on the enabled capabilities in turn starting
+ *    with the one that did the GC.  It can put them on other capabilities
+ *    because its callers hold all of them.
+ *
+ *  - In the threaded RTS, the C finalizers are copied out of the heap, so
+ *    that they can be run without a capability and regardless of the GC,
+ *    and queued for the finalizer thread, an OS thread that runs them as
+ *    they arrive.  Its Task has running_finalizers set, so rts_lock refuses
+ *    C finalizers that call back into Haskell, as on a capability.  The
+ *    queue is a lock-free stack, newest first, like the eventlog writer's.
+ *
+ * getRTSStats reports the C finalizers scheduled but not yet run, in either
+ * mode, and the Haskell finalizers and threads started.
+ */
+
+#if defined(THREADED_RTS)
+typedef struct {
+    void (*fptr)(void);
+    void *ptr;
+    void *eptr;
+    StgWord flag;
+} CFinalizer;
+
+typedef struct CFinalizerBatch_ {
+    struct CFinalizerBatch_ *link;
+    uint32_t n;
+    CFinalizer fins[];
+} CFinalizerBatch;
+
+static bool finalizer_thread_running = false;
+static bool finalizer_thread_stopping;
+static OSThreadId finalizer_thread;
+static Mutex finalizer_mutex;
+static Condition finalizer_cond;    // batches were queued, or stopping
+
+// Batches waiting for the finalizer thread, newest first
+static CFinalizerBatch *c_finalizer_batches = NULL;
+
+static bool
+finalizerThreadRunning(void)
+{
+    return RELAXED_LOAD(&finalizer_thread_running);
+}
+
+// Copy the n C finalizers of the weak pointers on the list to a batch for
+// the finalizer thread
+static void
+queueCFinalizers(StgWeak *list, uint32_t n)
+{
+    CFinalizerBatch *b =
+        stgMallocBytes(sizeof(CFinalizerBatch) + n * sizeof(CFinalizer),
+                       "queueCFinalizers");
+    b->n = n;
+    uint32_t i = 0;
+    for (StgWeak *w = list; w; w = w->link) {
+        StgCFinalizerList *head;
+        for (head = (StgCFinalizerList *)w->cfinalizers;
+             (StgClosure *)head != &stg_NO_FINALIZER_closure;
+             head = (StgCFinalizerList *)head->link) {
+            b->fins[i].fptr = head->fptr;
+            b->fins[i].ptr = head->ptr;
+            b->fins[i].eptr = head->eptr;
+            b->fins[i].flag = head->flag;
+            i++;
         }
     }
-    // set all the cards to 1
-    for (i = n; i < size; i++) {
-        arr->payload[i] = (StgClosure *)(W_)(-1);
+    ASSERT(i == n);
+
+    while (true) {
+        CFinalizerBatch *old = ACQUIRE_LOAD(&c_finalizer_batches);
+        b->link = old;
+        if (cas((StgVolatilePtr)&c_finalizer_batches,
+                (StgWord)old, (StgWord)b) == (StgWord)old) {
+            break;
+        }
     }
 
-    t = createIOThread(cap,
-                       RtsFlags.GcFlags.initialStkSize,
-                       rts_apply(cap,
-                           rts_apply(cap,
-                               (StgClosure *)runFinalizerBatch_closure,
-                               rts_mkInt(cap,n)),
-                           (StgClosure *)arr)
-        );
+    ACQUIRE_LOCK(&finalizer_mutex);
+    signalCondition(&finalizer_cond);
+    RELEASE_LOCK(&finalizer_mutex);
+}
 
-    scheduleThread(cap,t);
+static void *
+finalizerThread (void *unused STG_UNUSED)
+{
+    Task *task = getMyTask();
+    task->running_finalizers = true;
+
+    ACQUIRE_LOCK(&finalizer_mutex);
+    for (;;) {
+        CFinalizerBatch *b, *next, *todo = NULL;
+
+        b = (CFinalizerBatch *)xchg((StgPtr)&c_finalizer_batches, (StgWord)NULL);
+        if (b == NULL) {
+            if (finalizer_thread_stopping) {
+                break;
+            }
+            waitCondition(&finalizer_cond, &finalizer_mutex);
+            continue;
+        }
+        RELEASE_LOCK(&finalizer_mutex);
+
+        // c_finalizer_batches is newest first
+        for (; b != NULL; b = next) {
+            next = b->link;
+            b->link = todo;
+            todo = b;
+        }
+
+        for (b = todo; b != NULL; b = next) {
+            next = b->link;
+            for (uint32_t i = 0; i < b->n; i++) {
+                CFinalizer *f = &b->fins[i];
+                if (f->flag)
+                    ((void (*)(void *, void *))f->fptr)(f->eptr, f->ptr);
+                else
+                    ((void (*)(void *))f->fptr)(f->ptr);
+            }
+            atomic_inc((StgVolatilePtr)&c_finalizers_run, b->n);
+            stgFree(b);
+        }
+
+        ACQUIRE_LOCK(&finalizer_mutex);
+    }
+    RELEASE_LOCK(&finalizer_mutex);
+
+    task->running_finalizers = false;
+    freeMyTask();
+    return NULL;
+}
+
+void
+startFinalizerThread (void)
+{
+    if (RtsFlags.GcFlags.finalizerBatch == 0 || finalizer_thread_running) {
+        return;
+    }
+
+    initMutex(&finalizer_mutex);
+    initCondition(&finalizer_cond);
+    finalizer_thread_stopping = false;
+
+    if (createOSThread(&finalizer_thread, "ghc_finalizer",
+                       finalizerThread, NULL) != 0) {
+        sysErrorBelch("can't start the finalizer thread;"
+                      " running C finalizers on idle capabilities");
+        closeCondition(&finalizer_cond);
+        closeMutex(&finalizer_mutex);
+        return;
+    }
+    RELEASE_STORE(&finalizer_thread_running, true);
 }
 
+// Run the queued C finalizers and stop the finalizer thread
+void
+stopFinalizerThread (void)
+{
+    if (!RELAXED_LOAD(&finalizer_thread_running)) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&finalizer_mutex);
+    finalizer_thread_stopping = true;
+    signalCondition(&finalizer_cond);
+    RELEASE_LOCK(&finalizer_mutex);
+
+    joinOSThread(finalizer_thread);
+    RELAXED_STORE(&finalizer_thread_running, false);
+
+    closeCondition(&finalizer_cond);
+    closeMutex(&finalizer_mutex);
+}
+
+// In the child of forkProcess, where the finalizer thread is gone: start
+// another to run what the parent had queued, as the idle capabilities would
+// run the parent's finalizer_list.
+void
+restartFinalizerThreadAfterFork (void)
+{
+    if (!RELAXED_LOAD(&finalizer_thread_running)) {
+        return;
+    }
+    RELAXED_STORE(&finalizer_thread_running, false);
+    startFinalizerThread();
+}
+#endif
+
 /* -----------------------------------------------------------------------------
    Incrementally running C finalizers
 
@@ -244,12 +538,14 @@ bool runSomeFinalizers(bool all)
 
     StgWeak *w = finalizer_list;
     int32_t count = 0;
+    StgWord ran = 0;
     while (w != NULL) {
-        runCFinalizers((StgCFinalizerList *)w->cfinalizers);
+        ran += runCFinalizerList((StgCFinalizerList *)w->cfinalizers);
         w = w->link;
         ++count;
         if (!all && count >= finalizer_chunk) break;
     }
+    atomic_inc((StgVolatilePtr)&c_finalizers_run, ran);
 
     RELAXED_STORE(&finalizer_list, w);
     SEQ_CST_ADD(&n_finalizers, -count);
@@ -263,3 +559,14 @@ bool runSomeFinalizers(bool all)
     RELEASE_STORE(&finalizer_lock, 0);
     return ret;
 }
+
+void
+getFinalizerStats (uint64_t *c_pending, uint64_t *c_run,
+                   uint64_t *hs_scheduled, uint64_t *threads)
+{
+    const StgWord run = RELAXED_LOAD(&c_finalizers_run);
+    *c_pending = RELAXED_LOAD(&c_finalizers_scheduled) - run;
+    *c_run = run;
+    *hs_scheduled = RELAXED_LOAD(&hs_finalizers_scheduled);
+    *threads = RELAXED_LOAD(&finalizer_threads);
+}
@@ -21,4 +21,14 @@ void scheduleFinalizers(Capability *cap, StgWeak *w);
 void markWeakList(void);
 bool runSomeFinalizers(bool all);
 
+#if defined(THREADED_RTS)
+// See Note [Batched finalizers] in Weak.c
+void startFinalizerThread(void);
+void stopFinalizerThread(void);
+void restartFinalizerThreadAfterFork(void);
+#endif
+
+void getFinalizerStats(uint64_t *c_pending, uint64_t *c_run,
+                       uint64_t *hs_scheduled, uint64_t *threads);
+
 #include "EndPrivate.h"
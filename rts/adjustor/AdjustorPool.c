@@ -3,6 +3,8 @@
 
 #include "sm/OSMem.h"
 #include "RtsUtils.h"
+#include "Capability.h"
+#include "Task.h"
 #include "linker/MMap.h"
 #include "AdjustorPool.h"
 
@@ -88,6 +90,38 @@
  *                        │                  │
  *                        └──────────────────┘
  *
+ * Each chunk's slot_bitmap is an array of words, so that finding the next free
+ * slot looks at a word of slots at a time rather than a bit at a time.
+ */
+
+/*
+ * Note [Per-capability adjustor caches]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A program that creates "wrapper" FunPtrs for short-lived callbacks, say one
+ * per request on many threads, calls alloc_adjustor and free_adjustor at a
+ * high rate from every capability, and they would all contend for the pool's
+ * lock. So in the threaded RTS each pool keeps, for each capability, a cache
+ * of up to MAX_CAP_FREE_ADJUSTORS free adjustors (pool->caches[cap->no]),
+ * which the Task holding the capability uses without taking the lock:
+ *
+ *  - alloc_adjustor pops an adjustor from the cache; when the cache is empty
+ *    it first takes ADJUSTOR_CHUNK adjustors from the pool under the lock.
+ *
+ *  - free_adjustor pushes the adjustor onto the cache; when the cache is full
+ *    it first returns ADJUSTOR_CHUNK adjustors to the pool under the lock.
+ *
+ * An adjustor in a cache is still marked as allocated in its chunk's
+ * slot_bitmap, so no other capability can take it, and its context is
+ * zeroed, as for a free slot. Only the Task holding a capability touches that
+ * capability's cache, just as with its free list of stable pointers (see Note
+ * [Per-capability stable pointer free lists] in StablePtr.c), which
+ * freeHaskellFunPtr also uses. Calls from threads not holding a capability
+ * (e.g. hs_free_fun_ptr from a foreign thread) use the pool under the lock as
+ * before.
+ *
+ * Adjustors in the cache of a capability that is disabled by
+ * setNumCapabilities stay there until it is enabled again; there are at most
+ * MAX_CAP_FREE_ADJUSTORS of them per capability and pool.
  */
 
 // Round up the N to the nearest multiple of s
@@ -97,6 +131,7 @@
 struct AdjustorExecPage;
 struct AdjustorChunk;
 struct AdjustorPool;
+struct AdjustorCache;
 
 static struct AdjustorChunk *alloc_adjustor_chunk(struct AdjustorPool *owner);
 
@@ -122,9 +157,24 @@ struct AdjustorPool {
     struct AdjustorChunk *free_list;
 #if defined(THREADED_RTS)
     Mutex lock;
+    struct AdjustorCache *caches[MAX_N_CAPABILITIES];
+      /* each capability's cache of free adjustors, allocated when it first
+       * uses the pool; see Note [Per-capability adjustor caches] */
 #endif
 };
 
+#if defined(THREADED_RTS)
+// The number of free adjustors a capability caches for each pool, and how
+// many it moves between its cache and the pool at a time
+#define MAX_CAP_FREE_ADJUSTORS 32
+#define ADJUSTOR_CHUNK (MAX_CAP_FREE_ADJUSTORS / 2)
+
+struct AdjustorCache {
+    uint32_t n_free;
+    void *free[MAX_CAP_FREE_ADJUSTORS];
+};
+#endif
+
 struct AdjustorChunk {
     size_t first_free;
       /* index of the first free adjustor slot.
@@ -141,7 +191,7 @@ struct AdjustorChunk {
     void *contexts;
       /* an context for each adjustor slot. This points to the contexts
        * array which lives after slot_bitmap */
-    uint8_t slot_bitmap[];
+    StgWord slot_bitmap[];
       /* a bit for each adjustor slot; bit is set if the slot is allocated */
 };
 
@@ -163,15 +213,26 @@ new_adjustor_pool(
     pool->free_list = NULL;
 #if defined(THREADED_RTS)
     initMutex(&pool->lock);
+    for (uint32_t i = 0; i < MAX_N_CAPABILITIES; i++) {
+        pool->caches[i] = NULL;
+    }
 #endif
     return pool;
 }
 
+#define BITMAP_WORD_BITS (8 * sizeof(StgWord))
+
+#if SIZEOF_VOID_P == SIZEOF_LONG
+#define CTZW(n) (__builtin_ctzl(n))
+#else
+#define CTZW(n) (__builtin_ctzll(n))
+#endif
+
 static void
-bitmap_set(uint8_t *bitmap, size_t idx, bool value)
+bitmap_set(StgWord *bitmap, size_t idx, bool value)
 {
-    size_t word_n = idx / 8;
-    uint8_t bit = 1 << (idx % 8);
+    size_t word_n = idx / BITMAP_WORD_BITS;
+    StgWord bit = (StgWord) 1 << (idx % BITMAP_WORD_BITS);
     if (value) {
         bitmap[word_n] |= bit;
     } else {
@@ -181,24 +242,33 @@ bitmap_set(uint8_t *bitmap, size_t idx, bool value)
 
 // N.B. this is unused in non-DEBUG compilers
 static bool STG_UNUSED
-bitmap_get(uint8_t *bitmap, size_t idx)
+bitmap_get(StgWord *bitmap, size_t idx)
 {
-    size_t word_n = idx / 8;
-    uint8_t bit = 1 << (idx % 8);
+    size_t word_n = idx / BITMAP_WORD_BITS;
+    StgWord bit = (StgWord) 1 << (idx % BITMAP_WORD_BITS);
     return bitmap[word_n] & bit;
 }
 
-/* Return the index of the first unset bit of the given bitmap or
- * length_in_bits if all bits are set. */
+/* Return the index of the first unset bit of the given bitmap at or after
+ * start_idx, or length_in_bits if all of those bits are set. */
 static size_t
-bitmap_first_unset(uint8_t *bitmap, size_t length_in_bits, size_t start_idx)
+bitmap_first_unset(StgWord *bitmap, size_t length_in_bits, size_t start_idx)
 {
-    for (size_t i = start_idx; i < length_in_bits; i ++) {
-        if (bitmap_get(bitmap, i) == 0) {
-            return i;
+    if (start_idx >= length_in_bits) {
+        return length_in_bits;
+    }
+    size_t word_n = start_idx / BITMAP_WORD_BITS;
+    // the free slots of the first word, ignoring those before start_idx
+    StgWord free = ~bitmap[word_n] & ((StgWord) -1 << (start_idx % BITMAP_WORD_BITS));
+    while (free == 0) {
+        word_n++;
+        if (word_n * BITMAP_WORD_BITS >= length_in_bits) {
+            return length_in_bits;
         }
+        free = ~bitmap[word_n];
     }
-    return length_in_bits;
+    size_t idx = word_n * BITMAP_WORD_BITS + CTZW(free);
+    return idx < length_in_bits ? idx : length_in_bits;
 }
 
 static void *
@@ -208,13 +278,34 @@ get_context(struct AdjustorChunk *chunk, size_t slot_idx)
     return contexts + chunk->owner->context_size * slot_idx;
 }
 
-void *
-alloc_adjustor(struct AdjustorPool *pool, void *context)
+static struct AdjustorChunk *
+adjustor_chunk(void *adjustor)
+{
+    uintptr_t exec_page_mask = ~(getPageSize() - 1ULL);
+    struct AdjustorExecPage *exec_page = (struct AdjustorExecPage *) ((uintptr_t) adjustor & exec_page_mask);
+    if (exec_page->magic != ADJUSTOR_EXEC_PAGE_MAGIC) {
+        barf("free_adjustor was passed an invalid adjustor");
+    }
+    return exec_page->owner;
+}
+
+static size_t
+adjustor_slot(struct AdjustorChunk *chunk, void *adjustor)
+{
+    size_t slot_off = (uint8_t *) adjustor - chunk->exec_page->adjustor_code;
+    // ensure that the slot is aligned as we would expect.
+    ASSERT(slot_off % chunk->owner->adjustor_code_size == 0);
+    return slot_off / chunk->owner->adjustor_code_size;
+}
+
+/* Take a free slot from the pool, marking it as allocated. Must hold
+ * pool->lock. */
+static void *
+take_adjustor(struct AdjustorPool *pool)
 {
     size_t slot_idx;
     struct AdjustorChunk *chunk;
 
-    ACQUIRE_LOCK(&pool->lock);
     // allocate a new chunk if free_list is empty.
     if (pool->free_list == NULL) {
         pool->free_list = alloc_adjustor_chunk(pool);
@@ -224,7 +315,7 @@ alloc_adjustor(struct AdjustorPool *pool, void *context)
     slot_idx = chunk->first_free;
     ASSERT(slot_idx < pool->chunk_slots);
     ASSERT(bitmap_get(chunk->slot_bitmap, slot_idx) == 0);
-    bitmap_set(chunk->slot_bitmap, slot_idx, 1);
+    bitmap_set(chunk->slot_bitmap, slot_idx, true);
 
     // advance first_free
     chunk->first_free = bitmap_first_unset(chunk->slot_bitmap, pool->chunk_slots, slot_idx+1);
@@ -235,37 +326,16 @@ alloc_adjustor(struct AdjustorPool *pool, void *context)
         chunk->free_list_next = NULL;
     }
 
-    // update next_free and update bitmap
-    ASSERT(bitmap_get(chunk->slot_bitmap, slot_idx));
-    bitmap_set(chunk->slot_bitmap, slot_idx, true);
-
-    // fill in the context
-    memcpy(get_context(chunk, slot_idx), context, pool->context_size);
-    void *adjustor = &chunk->exec_page->adjustor_code[pool->adjustor_code_size * slot_idx];
-    RELEASE_LOCK(&pool->lock);
-
-    return adjustor;
+    return &chunk->exec_page->adjustor_code[pool->adjustor_code_size * slot_idx];
 }
 
-/* Free an adjustor previously allocated with alloc_adjustor, returning its
- * context
- */
-void
-free_adjustor(void *adjustor, void *context) {
-    uintptr_t exec_page_mask = ~(getPageSize() - 1ULL);
-    struct AdjustorExecPage *exec_page = (struct AdjustorExecPage *) ((uintptr_t) adjustor & exec_page_mask);
-    if (exec_page->magic != ADJUSTOR_EXEC_PAGE_MAGIC) {
-        barf("free_adjustor was passed an invalid adjustor");
-    }
-    struct AdjustorChunk *chunk = exec_page->owner;
-    struct AdjustorPool *pool = chunk->owner;
-
-    size_t slot_off = (uint8_t *) adjustor - exec_page->adjustor_code;
-    size_t slot_idx = slot_off / pool->adjustor_code_size;
-    // ensure that the slot is aligned as we would expect.
-    ASSERT(slot_off % pool->adjustor_code_size == 0);
-
-    ACQUIRE_LOCK(&pool->lock);
+/* Return a slot, whose context has been cleared, to the pool. Must hold
+ * pool->lock. */
+static void
+return_adjustor(struct AdjustorPool *pool, void *adjustor)
+{
+    struct AdjustorChunk *chunk = adjustor_chunk(adjustor);
+    size_t slot_idx = adjustor_slot(chunk, adjustor);
 
     // ensure that the slot is in fact allocated.
     ASSERT(bitmap_get(chunk->slot_bitmap, slot_idx));
@@ -281,10 +351,93 @@ free_adjustor(void *adjustor, void *context) {
     if (chunk->first_free > slot_idx) {
         chunk->first_free = slot_idx;
     }
+}
+
+#if defined(THREADED_RTS)
+/* The calling Task's cache of free adjustors of the given pool, or NULL if it
+ * doesn't hold a capability. See Note [Per-capability adjustor caches]. */
+static struct AdjustorCache *
+my_adjustor_cache(struct AdjustorPool *pool)
+{
+    Task *task = myTask();
+    if (task == NULL || task->cap == NULL) {
+        return NULL;
+    }
+    Capability *cap = task->cap;
+    if (RELAXED_LOAD(&cap->running_task) != task) {
+        return NULL;
+    }
+    struct AdjustorCache *cache = pool->caches[cap->no];
+    if (cache == NULL) {
+        cache = stgMallocBytes(sizeof(struct AdjustorCache), "my_adjustor_cache");
+        cache->n_free = 0;
+        pool->caches[cap->no] = cache;
+    }
+    return cache;
+}
+#endif
+
+void *
+alloc_adjustor(struct AdjustorPool *pool, void *context)
+{
+    void *adjustor;
+
+#if defined(THREADED_RTS)
+    struct AdjustorCache *cache = my_adjustor_cache(pool);
+    if (cache != NULL) {
+        if (cache->n_free == 0) {
+            ACQUIRE_LOCK(&pool->lock);
+            while (cache->n_free < ADJUSTOR_CHUNK) {
+                cache->free[cache->n_free++] = take_adjustor(pool);
+            }
+            RELEASE_LOCK(&pool->lock);
+        }
+        adjustor = cache->free[--cache->n_free];
+    } else
+#endif
+    {
+        ACQUIRE_LOCK(&pool->lock);
+        adjustor = take_adjustor(pool);
+        RELEASE_LOCK(&pool->lock);
+    }
 
+    // fill in the context; the slot is ours alone now
+    struct AdjustorChunk *chunk = adjustor_chunk(adjustor);
+    memcpy(get_context(chunk, adjustor_slot(chunk, adjustor)), context, pool->context_size);
+
+    return adjustor;
+}
+
+/* Free an adjustor previously allocated with alloc_adjustor, returning its
+ * context
+ */
+void
+free_adjustor(void *adjustor, void *context) {
+    struct AdjustorChunk *chunk = adjustor_chunk(adjustor);
+    struct AdjustorPool *pool = chunk->owner;
+    size_t slot_idx = adjustor_slot(chunk, adjustor);
+
+    // the slot is still ours until we give it back below
     memcpy(context, get_context(chunk, slot_idx), pool->context_size);
     memset(get_context(chunk, slot_idx), 0, pool->context_size);
 
+#if defined(THREADED_RTS)
+    struct AdjustorCache *cache = my_adjustor_cache(pool);
+    if (cache != NULL) {
+        if (cache->n_free == MAX_CAP_FREE_ADJUSTORS) {
+            ACQUIRE_LOCK(&pool->lock);
+            while (cache->n_free > MAX_CAP_FREE_ADJUSTORS - ADJUSTOR_CHUNK) {
+                return_adjustor(pool, cache->free[--cache->n_free]);
+            }
+            RELEASE_LOCK(&pool->lock);
+        }
+        cache->free[cache->n_free++] = adjustor;
+        return;
+    }
+#endif
+
+    ACQUIRE_LOCK(&pool->lock);
+    return_adjustor(pool, adjustor);
     RELEASE_LOCK(&pool->lock);
 }
 
@@ -300,13 +453,13 @@ alloc_adjustor_chunk(struct AdjustorPool *owner) {
     adj_page->magic = ADJUSTOR_EXEC_PAGE_MAGIC;
 
     // N.B. pad bitmap to ensure that .contexts is aligned.
-    size_t bitmap_sz = ROUND_UP(owner->chunk_slots, 8*sizeof(void*)) / 8;
+    size_t bitmap_sz = ROUND_UP(owner->chunk_slots, BITMAP_WORD_BITS) / 8;
     size_t contexts_sz = owner->context_size * owner->chunk_slots;
     size_t alloc_sz = sizeof(struct AdjustorChunk) + bitmap_sz + contexts_sz;
     struct AdjustorChunk *chunk = stgMallocBytes(alloc_sz, "allocAdjustorChunk");
     chunk->owner = owner;
     chunk->first_free = 0;
-    chunk->contexts = (struct AdjustorContext *) (chunk->slot_bitmap + bitmap_sz);
+    chunk->contexts = (struct AdjustorContext *) ((uint8_t *) chunk->slot_bitmap + bitmap_sz);
     chunk->free_list_next = NULL;
     chunk->exec_page = adj_page;
     chunk->exec_page->owner = chunk;
@@ -42,7 +42,8 @@ bool eventlog_enabled; // protected by state_change_mutex to ensure
  *
  * Additionally, there is a single global event buffer (`eventBuf`), which is
  * used for various administrative things (e.g. posting the header) and in
- * cases where we want to post events yet don't hold a capability.
+ * cases where we want to post events yet don't hold a capability, unless the
+ * Task posting them has a buffer of its own; see Note [Task event buffers].
  *
  * Whether or not events are posted is determined by the global flag
  * eventlog_enabled.  Naturally, starting and stopping of logging are a bit
@@ -89,12 +90,110 @@ bool eventlog_enabled; // protected by state_change_mutex to ensure
  * flushLocalEventsBuf in traceCapDisable.
  *
  *
+ * Note [Eventlog writer thread]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Normally printAndClearEventBuf calls the EventLogWriter on the capability
+ * whose buffer filled up, so a slow disk (or a slow consumer of the
+ * eventlog) stalls the Haskell threads of that capability. With
+ * +RTS --eventlog-writer-thread (threaded RTS only) the writing is done by
+ * a dedicated OS thread instead:
+ *
+ *  - Every EventsBuf has a second buffer of the same size, its spare.
+ *    printAndClearEventBuf (queueEventsBuf) puts the full buffer in
+ *    eb->full, carries on with the spare, and pushes the EventsBuf onto
+ *    full_bufs. That is a lock-free stack: the writer only ever takes the
+ *    whole stack with an xchg, so pushing with cas has no ABA problem. The
+ *    writer reverses what it takes, so that the buffers of each EventsBuf
+ *    are written in the order they were filled.
+ *
+ *  - Having written eb->full, the writer hands it back to eb->spare. If a
+ *    buffer fills up before its previous one has been written, the output
+ *    can't keep up: the capability waits for its spare (on spare_cond),
+ *    and we count the buffer as late. We don't drop events to avoid
+ *    waiting; buffers are only dropped if the EventLogWriter fails to
+ *    write them, as before.
+ *
+ *  - The pusher that makes full_bufs non-empty wakes the writer, taking
+ *    writer_mutex to do so. The writer looks at full_bufs with
+ *    writer_mutex held before waiting, so the wakeup can't be lost.
+ *
+ *  - Anything that needs the events to have been written, or the buffers
+ *    to stay put, waits until the writer has caught up
+ *    (drainEventLogWriterThread): flushing the EventLogWriter, stopping
+ *    it, and changing or freeing the capabilities' buffers, all of which
+ *    happen when no capability is posting events. bufs_queued is
+ *    incremented before a buffer is pushed, so bufs_written can't
+ *    overtake it.
+ *
+ * The buffers written, late and dropped are reported by +RTS -s.
+ *
+ * Note [Task event buffers]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Many events aren't tied to a capability: task events, the events of the
+ * nonmoving collector's mark thread, heap profile samples, events posted
+ * during GC on behalf of other capabilities, debug messages, and so on.
+ * These used to all go through eventBuf, so every thread posting them
+ * contended on eventBufMutex. In the threaded RTS each Task now posts them
+ * to a buffer of its own (task->events_buf, see acquireEventsBuf), created
+ * the first time it posts one:
+ *
+ *  - The buffer has a lock, but only the flushes below take it besides its
+ *    owner, so it is almost never contended.
+ *
+ *  - The buffers are on the task_bufs list, so that flushEventLog,
+ *    flushAllCapsEventsBufs and endEventLogging can flush them. When a Task
+ *    is freed, it writes out its buffer and frees it (freeTaskEventsBuf).
+ *    A buffer is only written out when it fills up, or at one of these
+ *    flushes, just like the capabilities' buffers.
+ *
+ *  - Their blocks are written with capno -1, like those of eventBuf, so a
+ *    consumer sees several interleaved streams of events not tied to a
+ *    capability, which need merging by timestamp like the capabilities'
+ *    streams do.
+ *
+ *  - Threads that aren't Tasks (and the non-threaded RTS) still use
+ *    eventBuf, as do the events describing the program rather than
+ *    what it is doing (the header, capsets, cost centres, IPE ...), which
+ *    are posted rarely and some of which must come before the rest.
+ *
+ *  - forkProcess flushes them all before forking (flushAllCapsEventsBufs)
+ *    and the child discards them (restartEventLogging): they belong to
+ *    Tasks that don't exist in the child.
+ *
+ * The buffers are smaller than those of the capabilities, TASK_EVENT_LOG_SIZE,
+ * as there may be many Tasks, but large enough for any event.
+ *
  * Note [Maximum event length]
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * The maximum length of an eventlog event is determined by the maximum event
  * buffer size, EVENT_LOG_SIZE. We must ensure that no variable-length event
  * exceeds this limit. For this reason we impose maximum length limits on
  * fields which may have unbounded values.
+ *
+ * Note [Adaptive event buffers]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * The capabilities' buffers start at EVENT_LOG_SIZE, but how fast they fill
+ * up varies a lot: a capability running many short-lived threads with -ls
+ * can fill its buffer many times a second, while an idle one never does.
+ * So each time a capability's buffer is written (printAndClearEventBuf),
+ * adaptEventsBuf may resize it:
+ *
+ *  - a buffer that was at least 3/4 full, and last filled up less than
+ *    EVENT_LOG_GROW_INTERVAL ago, doubles in size, up to EVENT_LOG_MAX_SIZE,
+ *    so that busy capabilities write fewer, larger buffers;
+ *
+ *  - a buffer that hasn't filled up for EVENT_LOG_SHRINK_INTERVAL, and is
+ *    either full now or less than 1/8 full (when flushed), halves in size,
+ *    down to EVENT_LOG_MIN_SIZE, giving back the memory of quiet ones.
+ *
+ * The buffer is empty at that point, so resizing it is just a matter of
+ * allocating a new one. Each resize posts an EVENTLOG_BUF_STATS event with
+ * the new size and the number of times the buffer was written, as does each
+ * capability at shutdown.
+ *
+ * With the writer thread (Note [Eventlog writer thread]) the buffer we have
+ * just filled is still in use, and its spare must stay the same size as it,
+ * so we don't resize then; we still count the flushes.
  */
 
 static const EventLogWriter *event_log_writer = NULL;
@@ -106,6 +205,17 @@ static eventlog_init_func_t *eventlog_header_funcs = NULL;
 // See Note [Maximum event length]
 #define EVENT_LOG_SIZE 2 * (1024 * 1024) // 2MB
 
+// See Note [Adaptive event buffers]; EVENT_LOG_MIN_SIZE must hold
+// EVENT_PAYLOAD_SIZE_MAX bytes of payload
+#define EVENT_LOG_MIN_SIZE (256 * 1024)
+#define EVENT_LOG_MAX_SIZE (16 * 1024 * 1024)
+#define EVENT_LOG_GROW_INTERVAL MSToTime(100)
+#define EVENT_LOG_SHRINK_INTERVAL SecondsToTime(10)
+
+// See Note [Task event buffers]; must hold EVENT_PAYLOAD_SIZE_MAX bytes
+// of payload
+#define TASK_EVENT_LOG_SIZE (128 * 1024)
+
 static int flushCount = 0;
 
 // Struct for record keeping of buffer to store event types and events.
@@ -115,8 +225,23 @@ typedef struct _EventsBuf {
   StgInt8 *begin;
   StgInt8 *pos;
   StgInt8 *marker;
+  StgInt8 *marker_fields; // the block marker's size and end time
   StgWord64 size;
   EventCapNo capno; // which capability this buffer belongs to, or -1
+  // See Note [Compact eventlog format]
+  StgInt8 *event_payload; // payload of the last event, if its length is unset
+  StgWord64 last_ts;      // timestamp of the last event in the block
+  // See Note [Adaptive event buffers]
+  StgWord64 flushes;      // times the buffer was written ...
+  StgWord64 full_flushes; // ... of which because it filled up
+  Time filled_at;         // when it last filled up
+#if defined(THREADED_RTS)
+  // See Note [Eventlog writer thread]
+  StgInt8 *spare;   // the other buffer, or NULL while it is being written
+  StgInt8 *full;    // the buffer queued for the writer thread ...
+  StgWord64 full_size; // ... and the size of its contents
+  struct _EventsBuf *next_full;
+#endif
 } EventsBuf;
 
 static EventsBuf *capEventBuf; // one EventsBuf for each Capability
@@ -126,6 +251,23 @@ static EventsBuf eventBuf; // an EventsBuf not associated with any Capability
 static Mutex eventBufMutex; // protected by this mutex
 #endif
 
+#if defined(THREADED_RTS)
+// The EventsBuf of a Task; see Note [Task event buffers]
+typedef struct TaskEventsBuf_ {
+    EventsBuf eb;  // must be first
+    Mutex lock;
+    Task *task;
+    struct TaskEventsBuf_ *prev, *next;
+} TaskEventsBuf;
+
+static TaskEventsBuf *task_bufs = NULL; // protected by task_bufs_mutex
+static Mutex task_bufs_mutex;
+
+static void discardTaskEventsBufs(void);
+#endif
+
+static void flushTaskEventsBufs(void);
+
 // Event type
 typedef struct _EventType {
   EventTypeNum etNum;  // Event Type number.
@@ -135,9 +277,37 @@ typedef struct _EventType {
 
 #include "rts/EventTypes.h"
 
+// See Note [Eventlog writer thread]
+#if defined(THREADED_RTS)
+static bool writer_thread_running = false;
+static bool writer_thread_stopping;
+static OSThreadId writer_thread;
+static Mutex writer_mutex;
+static Condition writer_cond;       // full_bufs is non-empty, or stopping
+static Condition spare_cond;        // the writer has written some buffers
+static EventsBuf *full_bufs = NULL; // pushed lock-free, newest first
+static StgWord bufs_queued;
+static StgWord bufs_written;        // protected by writer_mutex
+
+static void startEventLogWriterThread(void);
+static void stopEventLogWriterThread(void);
+static void drainEventLogWriterThread(void);
+#endif
+
+// Buffers written out, buffers that filled up before the writer thread
+// had written the previous one, and buffers the EventLogWriter failed to
+// write. Updated atomically.
+static StgWord eventlog_bufs_written = 0;
+static StgWord eventlog_bufs_late = 0;
+static StgWord eventlog_bufs_dropped = 0;
+
+// The bytes of all the event buffers and their spares. Updated atomically.
+static StgWord eventlog_buf_bytes = 0;
+
 static void initEventsBuf(EventsBuf* eb, StgWord64 size, EventCapNo capno);
 static void resetEventsBuf(EventsBuf* eb);
 static void printAndClearEventBuf (EventsBuf *eventsBuf);
+static void postEventsBufStats(EventsBuf *eb);
 
 static void postEventType(EventsBuf *eb, EventType *et);
 
@@ -198,20 +368,115 @@ static inline void postStringLen(EventsBuf *eb, const char *buf, StgWord len)
     eb->pos++;
 }
 
+/* Note [Compact eventlog format]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   In the default format (version 0) every event starts with a Word16 type
+   and a Word64 timestamp, more than half of a small event like RUN_THREAD.
+   With +RTS --eventlog-compact we write version 1 instead, which the header
+   announces with EVENT_HEADER_VERSION. In it, an event is
+
+     - its type, as a varint (unsigned LEB128);
+     - its timestamp, as a zigzag-encoded varint: the difference from the
+       timestamp of the previous event in the same block. The block
+       marker's is the difference from 0, so each block starts from an
+       absolute time and can be decoded without the blocks before it;
+     - the length of its payload, as a varint, so that readers can skip
+       events they don't know;
+     - its payload, as in version 0, except that thread ids and capability
+       numbers are varints, and variable-length events don't repeat their
+       Word16 payload size.
+
+   The size and end time of the block marker stay fixed-width, since
+   closeBlockMarker fills them in after the fact.
+
+   We don't know the length of the payload when we post the header, so
+   postEventTime reserves one byte for it and remembers where the payload
+   starts (EventsBuf.event_payload). Posting the next event, or closing the
+   block, fills it in (finishEvent), moving the payload along in the rare
+   case that it is 128 bytes or more and its length needs more than one
+   byte. The room checks allow COMPACT_EVENT_SLACK bytes for an event
+   (and the payload length of the previous one) being larger in this
+   encoding than in version 0.
+*/
+
+#define COMPACT_EVENT_SLACK 16
+
+static bool compact_format = false;
+
+static inline void postVarint(EventsBuf *eb, StgWord64 i)
+{
+    while (i >= 0x80) {
+        postWord8(eb, (StgWord8)(i | 0x80));
+        i >>= 7;
+    }
+    postWord8(eb, (StgWord8)i);
+}
+
+// Fill in the payload length of the last event, see
+// Note [Compact eventlog format]
+static void finishEvent(EventsBuf *eb)
+{
+    StgInt8 *payload = eb->event_payload;
+    if (payload == NULL) {
+        return;
+    }
+
+    StgInt8 *end = eb->pos;
+    StgWord len = end - payload;
+    uint32_t extra = len < 0x80 ? 0 : len < 0x4000 ? 1 : 2;
+    if (extra > 0) {
+        memmove(payload + extra, payload, len);
+    }
+    eb->pos = payload - 1;
+    postVarint(eb, len);
+    eb->pos = end + extra;
+    eb->event_payload = NULL;
+}
+
 static inline StgWord64 time_ns(void)
 { return TimeToNS(stat_getElapsedTime()); }
 
 static inline void postEventTypeNum(EventsBuf *eb, EventTypeNum etNum)
-{ postWord16(eb, etNum); }
+{
+    if (compact_format) {
+        finishEvent(eb);
+        postVarint(eb, etNum);
+    } else {
+        postWord16(eb, etNum);
+    }
+}
 
-static inline void postTimestamp(EventsBuf *eb)
-{ postWord64(eb, time_ns()); }
+// The timestamp in an event header
+static inline void postEventTime(EventsBuf *eb, EventTimestamp ts)
+{
+    if (compact_format) {
+        StgInt64 delta = (StgInt64)(ts - eb->last_ts);
+        postVarint(eb, ((StgWord64)delta << 1) ^ (StgWord64)(delta >> 63));
+        eb->last_ts = ts;
+        postWord8(eb, 0); // the payload length, see finishEvent
+        eb->event_payload = eb->pos;
+    } else {
+        postWord64(eb, ts);
+    }
+}
 
 static inline void postThreadID(EventsBuf *eb, EventThreadID id)
-{ postWord32(eb,id); }
+{
+    if (compact_format) {
+        postVarint(eb, id);
+    } else {
+        postWord32(eb, id);
+    }
+}
 
 static inline void postCapNo(EventsBuf *eb, EventCapNo no)
-{ postWord16(eb,no); }
+{
+    if (compact_format) {
+        postVarint(eb, no);
+    } else {
+        postWord16(eb, no);
+    }
+}
 
 static inline void postCapsetID(EventsBuf *eb, EventCapsetID id)
 { postWord32(eb,id); }
@@ -229,12 +494,17 @@ static inline void postTaskId(EventsBuf *eb, EventTaskId tUniq)
 { postWord64(eb, tUniq); }
 
 static inline void postPayloadSize(EventsBuf *eb, EventPayloadSize size)
-{ postWord16(eb,size); }
+{
+    // the compact format has the length of every event already
+    if (!compact_format) {
+        postWord16(eb, size);
+    }
+}
 
 static inline void postEventHeader(EventsBuf *eb, EventTypeNum type)
 {
     postEventTypeNum(eb, type);
-    postTimestamp(eb);
+    postEventTime(eb, time_ns());
 }
 
 static inline void postInt8(EventsBuf *eb, StgInt8 i)
@@ -268,6 +538,9 @@ writeEventLog(void *eventlog, size_t eventlog_size)
 static void
 stopEventLogWriter(void)
 {
+#if defined(THREADED_RTS)
+    stopEventLogWriterThread();
+#endif
     if (event_log_writer != NULL &&
             event_log_writer->stopEventLogWriter != NULL) {
         event_log_writer->stopEventLogWriter();
@@ -277,6 +550,9 @@ stopEventLogWriter(void)
 static void
 flushEventLogWriter(void)
 {
+#if defined(THREADED_RTS)
+    drainEventLogWriterThread();
+#endif
     if (event_log_writer != NULL &&
             event_log_writer->flushEventLog != NULL) {
         event_log_writer->flushEventLog();
@@ -293,6 +569,12 @@ postHeaderEvents(void)
     // Write in buffer: the header begin marker.
     postInt32(&eventBuf, EVENT_HEADER_BEGIN);
 
+    // Version 0 has no version, so that old readers can still read it.
+    if (compact_format) {
+        postInt32(&eventBuf, EVENT_HEADER_VERSION);
+        postWord32(&eventBuf, EVENTLOG_FORMAT_VERSION_COMPACT);
+    }
+
     // Mark beginning of event types in the header.
     postInt32(&eventBuf, EVENT_HET_BEGIN);
 
@@ -341,6 +623,26 @@ static void repostInitEvents(void){
     return;
 }
 
+// Post the initialisation events again and write them out, for a consumer
+// that joined after the eventlog started; see Note [Eventlog socket] in
+// EventLogSocket.c. Returns false, having done nothing, if the eventlog is
+// being started or stopped.
+bool
+repostEventLogInitEvents(void)
+{
+    if (TRY_ACQUIRE_LOCK(&state_change_mutex) != 0) {
+        return false;
+    }
+    if (eventlog_enabled) {
+        repostInitEvents();
+        ACQUIRE_LOCK(&eventBufMutex);
+        printAndClearEventBuf(&eventBuf);
+        RELEASE_LOCK(&eventBufMutex);
+    }
+    RELEASE_LOCK(&state_change_mutex);
+    return true;
+}
+
 // Clear the eventlog_header_funcs list and free the memory
 void resetInitEvents(void){
     eventlog_init_func_t * tmp;
@@ -381,11 +683,13 @@ initEventLogging(void)
      * Use a single buffer to store the header with event types, then flush
      * the buffer so all buffers are empty for writing events.
      */
+    compact_format = RtsFlags.TraceFlags.compact;
     moreCapEventBufs(0, get_n_capabilities());
 
     initEventsBuf(&eventBuf, EVENT_LOG_SIZE, (EventCapNo)(-1));
 #if defined(THREADED_RTS)
     initMutex(&eventBufMutex);
+    initMutex(&task_bufs_mutex);
     initMutex(&state_change_mutex);
 #endif
 }
@@ -418,6 +722,10 @@ startEventLogging_(void)
 
     RELEASE_LOCK(&eventBufMutex);
 
+#if defined(THREADED_RTS)
+    startEventLogWriterThread();
+#endif
+
     return true;
 }
 
@@ -447,6 +755,14 @@ startEventLogging(const EventLogWriter *ev_writer)
 void
 restartEventLogging(void)
 {
+#if defined(THREADED_RTS)
+    // The parent's writer thread isn't in the child; the parent waited for
+    // it to write everything before forking (flushAllCapsEventsBufs).
+    writer_thread_running = false;
+    // The Tasks these belong to are about to be discarded, and the parent
+    // wrote out their events before forking.
+    discardTaskEventsBufs();
+#endif
     freeEventLoggingBuffer();
     stopEventLogWriter();
     initEventLogging();  // allocate new per-capability buffers
@@ -465,10 +781,27 @@ finishCapEventLogging(void)
         // N.B. at this point we hold all capabilities.
         for (uint32_t c = 0; c < getNumCapabilities(); ++c) {
             if (capEventBuf[c].begin != NULL) {
+                // See Note [Adaptive event buffers]
+                postEventsBufStats(&capEventBuf[c]);
                 printAndClearEventBuf(&capEventBuf[c]);
+            }
+        }
+#if defined(THREADED_RTS)
+        drainEventLogWriterThread();
+#endif
+        for (uint32_t c = 0; c < getNumCapabilities(); ++c) {
+            if (capEventBuf[c].begin != NULL) {
                 stgFree(capEventBuf[c].begin);
                 capEventBuf[c].begin = NULL;
+                RELAXED_ADD(&eventlog_buf_bytes, -(StgWord) capEventBuf[c].size);
+            }
+#if defined(THREADED_RTS)
+            if (capEventBuf[c].spare != NULL) {
+                stgFree(capEventBuf[c].spare);
+                capEventBuf[c].spare = NULL;
+                RELAXED_ADD(&eventlog_buf_bytes, -(StgWord) capEventBuf[c].size);
             }
+#endif
         }
     }
 }
@@ -490,6 +823,9 @@ endEventLogging(void)
     // finishCapEventLogging and the capabilities have already been freed.
     if (getSchedState() != SCHED_SHUTTING_DOWN) {
         flushEventLog(NULL);
+    } else {
+        // See Note [Task event buffers]
+        flushTaskEventsBufs();
     }
 
     ACQUIRE_LOCK(&eventBufMutex);
@@ -512,6 +848,11 @@ endEventLogging(void)
 void
 moreCapEventBufs (uint32_t from, uint32_t to)
 {
+#if defined(THREADED_RTS)
+    // the writer thread may be looking at the buffers we're about to move
+    drainEventLogWriterThread();
+#endif
+
     if (from > 0) {
         capEventBuf = stgReallocBytes(capEventBuf, to * sizeof(EventsBuf),
                                       "moreCapEventBufs");
@@ -543,6 +884,141 @@ freeEventLoggingBuffer(void)
     }
 }
 
+#if defined(THREADED_RTS)
+static TaskEventsBuf *
+newTaskEventsBuf (Task *task)
+{
+    TaskEventsBuf *tb = stgMallocBytes(sizeof(TaskEventsBuf),
+                                       "newTaskEventsBuf");
+    initEventsBuf(&tb->eb, TASK_EVENT_LOG_SIZE, (EventCapNo)(-1));
+    initMutex(&tb->lock);
+    tb->task = task;
+
+    ACQUIRE_LOCK(&task_bufs_mutex);
+    tb->prev = NULL;
+    tb->next = task_bufs;
+    if (task_bufs != NULL) {
+        task_bufs->prev = tb;
+    }
+    task_bufs = tb;
+    RELEASE_LOCK(&task_bufs_mutex);
+
+    task->events_buf = tb;
+    return tb;
+}
+
+static void
+freeTaskEventsBuf_ (TaskEventsBuf *tb)
+{
+    stgFree(tb->eb.begin);
+    RELAXED_ADD(&eventlog_buf_bytes, -(StgWord) tb->eb.size);
+    if (tb->eb.spare != NULL) {
+        stgFree(tb->eb.spare);
+        RELAXED_ADD(&eventlog_buf_bytes, -(StgWord) tb->eb.size);
+    }
+    tb->task->events_buf = NULL;
+    stgFree(tb);
+}
+
+// Called by freeTask: write out the events the Task posted, and free its
+// buffer.
+void
+freeTaskEventsBuf (Task *task)
+{
+    TaskEventsBuf *tb = task->events_buf;
+    if (tb == NULL) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&task_bufs_mutex);
+    if (tb->prev) {
+        tb->prev->next = tb->next;
+    } else {
+        task_bufs = tb->next;
+    }
+    if (tb->next) {
+        tb->next->prev = tb->prev;
+    }
+    RELEASE_LOCK(&task_bufs_mutex);
+
+    if (RELAXED_LOAD(&eventlog_enabled)) {
+        printAndClearEventBuf(&tb->eb);
+    }
+
+    // The writer thread may still be writing the buffer we just queued, or
+    // an earlier one.
+    if (RELAXED_LOAD(&writer_thread_running)) {
+        ACQUIRE_LOCK(&writer_mutex);
+        while (ACQUIRE_LOAD(&tb->eb.spare) == NULL) {
+            waitCondition(&spare_cond, &writer_mutex);
+        }
+        RELEASE_LOCK(&writer_mutex);
+    }
+
+    closeMutex(&tb->lock);
+    freeTaskEventsBuf_(tb);
+}
+
+static void
+discardTaskEventsBufs (void)
+{
+    TaskEventsBuf *tb, *next;
+    for (tb = task_bufs; tb != NULL; tb = next) {
+        next = tb->next;
+        freeTaskEventsBuf_(tb);
+    }
+    task_bufs = NULL;
+}
+#endif
+
+static void
+flushTaskEventsBufs (void)
+{
+#if defined(THREADED_RTS)
+    ACQUIRE_LOCK(&task_bufs_mutex);
+    for (TaskEventsBuf *tb = task_bufs; tb != NULL; tb = tb->next) {
+        ACQUIRE_LOCK(&tb->lock);
+        printAndClearEventBuf(&tb->eb);
+        RELEASE_LOCK(&tb->lock);
+    }
+    RELEASE_LOCK(&task_bufs_mutex);
+#endif
+}
+
+/*
+ * The buffer for an event not tied to a capability, locked: the calling
+ * Task's own, or eventBuf. See Note [Task event buffers].
+ */
+static EventsBuf *
+acquireEventsBuf (void)
+{
+#if defined(THREADED_RTS)
+    Task *task = myTask();
+    if (task != NULL) {
+        TaskEventsBuf *tb = task->events_buf;
+        if (tb == NULL) {
+            tb = newTaskEventsBuf(task);
+        }
+        ACQUIRE_LOCK(&tb->lock);
+        return &tb->eb;
+    }
+#endif
+    ACQUIRE_LOCK(&eventBufMutex);
+    return &eventBuf;
+}
+
+static void
+releaseEventsBuf (EventsBuf *eb USED_IF_THREADS)
+{
+#if defined(THREADED_RTS)
+    if (eb != &eventBuf) {
+        RELEASE_LOCK(&((TaskEventsBuf *) eb)->lock);
+        return;
+    }
+#endif
+    RELEASE_LOCK(&eventBufMutex);
+}
+
 void
 freeEventLogging(void)
 {
@@ -758,6 +1234,29 @@ void postCapsetStrEvent (EventTypeNum tag,
     RELEASE_LOCK(&eventBufMutex);
 }
 
+void postEventTraceClasses (const char *classes)
+{
+    int size = strlen(classes) + 1;
+
+    ACQUIRE_LOCK(&eventBufMutex);
+
+    if (!hasRoomForVariableEvent(&eventBuf, size)){
+        printAndClearEventBuf(&eventBuf);
+
+        if (!hasRoomForVariableEvent(&eventBuf, size)){
+            errorBelch("Event size exceeds buffer size, bail out");
+            RELEASE_LOCK(&eventBufMutex);
+            return;
+        }
+    }
+
+    postEventHeader(&eventBuf, EVENT_TRACE_CLASSES);
+    postPayloadSize(&eventBuf, size);
+    postStringLen(&eventBuf, classes, size - 1);
+
+    RELEASE_LOCK(&eventBufMutex);
+}
+
 void postCapsetVecEvent (EventTypeNum tag,
                          EventCapsetID capset,
                          int argc,
@@ -836,7 +1335,7 @@ void postWallClockTime (EventCapsetID capset)
        timestamp, so we go one level lower so we can write out the
        timestamp we already generated above. */
     postEventTypeNum(&eventBuf, EVENT_WALL_CLOCK_TIME);
-    postWord64(&eventBuf, ts);
+    postEventTime(&eventBuf, ts);
 
     /* EVENT_WALL_CLOCK_TIME (capset, unix_epoch_seconds, nanoseconds) */
     postCapsetID(&eventBuf, capset);
@@ -945,57 +1444,309 @@ void postEventMemReturn  (Capability    *cap,
     postWord32(eb, returned_mblocks);
 }
 
+void postEventGcWorkSteals (Capability *cap,
+                            EventCapNo  gc_cap,
+                            uint32_t    stolen_blocks,
+                            uint32_t    failed_steals)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_GC_WORK_STEALS);
+
+    postEventHeader(eb, EVENT_GC_WORK_STEALS);
+    postCapNo(eb, gc_cap);
+    postWord32(eb, stolen_blocks);
+    postWord32(eb, failed_steals);
+}
+
+void postEventGcParThreads (Capability *cap,
+                            uint32_t    gen,
+                            uint32_t    threads,
+                            StgWord64   work_bytes)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_GC_PAR_THREADS);
+
+    postEventHeader(eb, EVENT_GC_PAR_THREADS);
+    postCapNo(eb, cap->no);
+    postWord16(eb, gen);
+    postWord16(eb, threads);
+    postWord64(eb, work_bytes);
+}
+
+void postEventAllocSample (Capability   *cap,
+                           EventThreadID thread,
+                           StgWord       info,
+                           StgWord64     bytes)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_ALLOC_SAMPLE);
+
+    postEventHeader(eb, EVENT_ALLOC_SAMPLE);
+    postCapNo(eb, cap->no);
+    postThreadID(eb, thread);
+    postWord64(eb, info);
+    postWord64(eb, bytes);
+}
+
+void postEventStackSample (Capability          *cap,
+                           EventThreadID        thread,
+                           StgWord64            time,
+                           uint16_t             n_frames,
+                           const StgInfoTable **frames)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    StgWord len = sizeof(EventCapNo) + sizeof(EventThreadID) + 8 + 2
+                  + n_frames * 8;
+
+    CHECK(!ensureRoomForVariableEvent(eb, len));
+    postEventHeader(eb, EVENT_STACK_SAMPLE);
+    postPayloadSize(eb, len);
+    postCapNo(eb, cap->no);
+    postThreadID(eb, thread);
+    postWord64(eb, time);
+    postWord16(eb, n_frames);
+    for (uint16_t i = 0; i < n_frames; i++) {
+        postWord64(eb, (StgWord) frames[i]);
+    }
+}
+
+void postEventGcThreadStats (Capability *cap,
+                             EventCapNo  gc_cap,
+                             StgWord64   copy_start,
+                             StgWord64   copy_end,
+                             StgWord64   idle,
+                             StgWord64   copied_bytes)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_GC_THREAD_STATS);
+
+    postEventHeader(eb, EVENT_GC_THREAD_STATS);
+    postCapNo(eb, gc_cap);
+    postWord64(eb, copy_start);
+    postWord64(eb, copy_end);
+    postWord64(eb, idle);
+    postWord64(eb, copied_bytes);
+}
+
+void postEventGcGenResize (EventCapsetID heap_capset,
+                           uint32_t      gen,
+                           W_            max_blocks,
+                           uint32_t      survival,
+                           uint32_t      promotion,
+                           uint32_t      factor,
+                           uint32_t      gc_cpu)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_GC_GEN_RESIZE);
+
+    postEventHeader(eb, EVENT_GC_GEN_RESIZE);
+    /* EVENT_GC_GEN_RESIZE (heap_capset, generation, max_blocks,
+                            survival, promotion, factor, gc_cpu) */
+    postCapsetID(eb, heap_capset);
+    postWord16(eb, gen);
+    postWord64(eb, max_blocks);
+    postWord32(eb, survival);
+    postWord32(eb, promotion);
+    postWord32(eb, factor);
+    postWord32(eb, gc_cpu);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventPinnedFragmentation (EventCapsetID heap_capset,
+                                   uint32_t      blocks,
+                                   uint32_t      sparse_blocks,
+                                   W_            used_bytes,
+                                   W_            live_bytes)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_PINNED_FRAGMENTATION);
+
+    postEventHeader(eb, EVENT_PINNED_FRAGMENTATION);
+    /* EVENT_PINNED_FRAGMENTATION (heap_capset, blocks, sparse_blocks,
+                                   used_bytes, live_bytes) */
+    postCapsetID(eb, heap_capset);
+    postWord32(eb, blocks);
+    postWord32(eb, sparse_blocks);
+    postWord64(eb, used_bytes);
+    postWord64(eb, live_bytes);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventGcGenShape (EventCapsetID heap_capset,
+                          uint16_t      gen,
+                          W_            live_bytes,
+                          W_            large_bytes,
+                          W_            mut_list_entries)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_GC_GEN_SHAPE);
+
+    postEventHeader(eb, EVENT_GC_GEN_SHAPE);
+    /* EVENT_GC_GEN_SHAPE (heap_capset, gen, live_bytes, large_bytes,
+                           mut_list_entries) */
+    postCapsetID(eb, heap_capset);
+    postWord16(eb, gen);
+    postWord64(eb, live_bytes);
+    postWord64(eb, large_bytes);
+    postWord64(eb, mut_list_entries);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventCapParking (EventCapNo capno,
+                          W_         spin_wakeups,
+                          W_         parks)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_CAP_PARKING);
+
+    postEventHeader(eb, EVENT_CAP_PARKING);
+    /* EVENT_CAP_PARKING (capno, spin_wakeups, parks) */
+    postCapNo(eb, capno);
+    postWord64(eb, spin_wakeups);
+    postWord64(eb, parks);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventStmHotTVar (EventCapNo capno,
+                          StgWord    tvar,
+                          uint32_t   aborts)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_STM_HOT_TVAR);
+
+    postEventHeader(eb, EVENT_STM_HOT_TVAR);
+    /* EVENT_STM_HOT_TVAR (capno, tvar, aborts) */
+    postCapNo(eb, capno);
+    postWord64(eb, tvar);
+    postWord32(eb, aborts);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventBlackHoleContention (EventCapNo capno,
+                                   StgWord    info,
+                                   uint32_t   duplicates,
+                                   uint32_t   blocks)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_BLACKHOLE_CONTENTION);
+
+    postEventHeader(eb, EVENT_BLACKHOLE_CONTENTION);
+    /* EVENT_BLACKHOLE_CONTENTION (capno, info, duplicates, blocks) */
+    postCapNo(eb, capno);
+    postWord64(eb, info);
+    postWord32(eb, duplicates);
+    postWord32(eb, blocks);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventSampledEvents (EventCapNo capno,
+                             StgWord8   cls,
+                             uint32_t   rate,
+                             StgWord64  suppressed)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_SAMPLED_EVENTS);
+
+    postEventHeader(eb, EVENT_SAMPLED_EVENTS);
+    /* EVENT_SAMPLED_EVENTS (capno, class, rate, suppressed) */
+    postCapNo(eb, capno);
+    postWord8(eb, cls);
+    postWord32(eb, rate);
+    postWord64(eb, suppressed);
+
+    releaseEventsBuf(eb);
+}
+
+void postEventPerfCounters (StgWord8         phase,
+                            uint32_t         thread,
+                            const StgWord64 *counts)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_PERF_COUNTERS);
+
+    postEventHeader(eb, EVENT_PERF_COUNTERS);
+    /* EVENT_PERF_COUNTERS (phase, thread, cycles, instructions,
+                            llc_misses, dtlb_misses) */
+    postWord8(eb, phase);
+    postWord32(eb, thread);
+    for (int i = 0; i < 4; i++) {
+        postWord64(eb, counts[i]);
+    }
+
+    releaseEventsBuf(eb);
+}
+
 void postTaskCreateEvent (EventTaskId taskId,
                           EventCapNo capno,
                           EventKernelThreadId tid)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_TASK_CREATE);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_TASK_CREATE);
 
-    postEventHeader(&eventBuf, EVENT_TASK_CREATE);
+    postEventHeader(eb, EVENT_TASK_CREATE);
     /* EVENT_TASK_CREATE (taskID, cap, tid) */
-    postTaskId(&eventBuf, taskId);
-    postCapNo(&eventBuf, capno);
-    postKernelThreadId(&eventBuf, tid);
+    postTaskId(eb, taskId);
+    postCapNo(eb, capno);
+    postKernelThreadId(eb, tid);
 
-    RELEASE_LOCK(&eventBufMutex);
+    releaseEventsBuf(eb);
 }
 
 void postTaskMigrateEvent (EventTaskId taskId,
                            EventCapNo capno,
                            EventCapNo new_capno)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_TASK_MIGRATE);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_TASK_MIGRATE);
 
-    postEventHeader(&eventBuf, EVENT_TASK_MIGRATE);
+    postEventHeader(eb, EVENT_TASK_MIGRATE);
     /* EVENT_TASK_MIGRATE (taskID, cap, new_cap) */
-    postTaskId(&eventBuf, taskId);
-    postCapNo(&eventBuf, capno);
-    postCapNo(&eventBuf, new_capno);
+    postTaskId(eb, taskId);
+    postCapNo(eb, capno);
+    postCapNo(eb, new_capno);
 
-    RELEASE_LOCK(&eventBufMutex);
+    releaseEventsBuf(eb);
+}
+
+void postTaskReuseEvent (EventTaskId taskId,
+                         EventCapNo capno)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_TASK_REUSE);
+
+    postEventHeader(eb, EVENT_TASK_REUSE);
+    /* EVENT_TASK_REUSE (taskID, cap) */
+    postTaskId(eb, taskId);
+    postCapNo(eb, capno);
+
+    releaseEventsBuf(eb);
 }
 
 void postTaskDeleteEvent (EventTaskId taskId)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_TASK_DELETE);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_TASK_DELETE);
 
-    postEventHeader(&eventBuf, EVENT_TASK_DELETE);
+    postEventHeader(eb, EVENT_TASK_DELETE);
     /* EVENT_TASK_DELETE (taskID) */
-    postTaskId(&eventBuf, taskId);
+    postTaskId(eb, taskId);
 
-    RELEASE_LOCK(&eventBufMutex);
+    releaseEventsBuf(eb);
 }
 
 void
 postEventNoCap (EventTypeNum tag)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, tag);
-    postEventHeader(&eventBuf, tag);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, tag);
+    postEventHeader(eb, tag);
+    releaseEventsBuf(eb);
 }
 
 void
@@ -1016,7 +1767,7 @@ postEventAtTimestamp (Capability *cap, EventTimestamp ts, EventTypeNum tag)
        timestamp, so we go one level lower so we can write out
        the timestamp we received as an argument. */
     postEventTypeNum(eb, tag);
-    postWord64(eb, ts);
+    postEventTime(eb, ts);
 }
 
 #define BUF 512
@@ -1039,9 +1790,9 @@ void postLogMsg(EventsBuf *eb, EventTypeNum type, char *msg, va_list ap)
 
 void postMsg(char *msg, va_list ap)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    postLogMsg(&eventBuf, EVENT_LOG_MSG, msg, ap);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    postLogMsg(eb, EVENT_LOG_MSG, msg, ap);
+    releaseEventsBuf(eb);
 }
 
 void postCapMsg(Capability *cap, char *msg, va_list ap)
@@ -1133,47 +1884,72 @@ void postConcUpdRemSetFlush(Capability *cap)
     postCapNo(eb, cap->no);
 }
 
+void postConcUpdRemSetHandshake(Capability *cap, StgWord64 latency)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    ensureRoomForEvent(eb, EVENT_CONC_UPD_REM_SET_HANDSHAKE);
+    postEventHeader(eb, EVENT_CONC_UPD_REM_SET_HANDSHAKE);
+    postCapNo(eb, cap->no);
+    postWord64(eb, latency);
+}
+
 void postConcMarkEnd(StgWord32 marked_obj_count)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_CONC_MARK_END);
-    postEventHeader(&eventBuf, EVENT_CONC_MARK_END);
-    postWord32(&eventBuf, marked_obj_count);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_CONC_MARK_END);
+    postEventHeader(eb, EVENT_CONC_MARK_END);
+    postWord32(eb, marked_obj_count);
+    releaseEventsBuf(eb);
+}
+
+void postConcMarkWorkerEnd(StgWord16 worker, StgWord32 marked_obj_count,
+                           StgWord64 busy_time, StgWord64 idle_time)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_CONC_MARK_WORKER_END);
+    postEventHeader(eb, EVENT_CONC_MARK_WORKER_END);
+    postWord16(eb, worker);
+    postWord32(eb, marked_obj_count);
+    postWord64(eb, busy_time);
+    postWord64(eb, idle_time);
+    releaseEventsBuf(eb);
 }
 
 void postNonmovingHeapCensus(uint16_t blk_size,
                              const struct NonmovingAllocCensus *census)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    postEventHeader(&eventBuf, EVENT_NONMOVING_HEAP_CENSUS);
-    postWord16(&eventBuf, blk_size);
-    postWord32(&eventBuf, census->n_active_segs);
-    postWord32(&eventBuf, census->n_filled_segs);
-    postWord32(&eventBuf, census->n_live_blocks);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    postEventHeader(eb, EVENT_NONMOVING_HEAP_CENSUS);
+    postWord16(eb, blk_size);
+    postWord32(eb, census->n_active_segs);
+    postWord32(eb, census->n_filled_segs);
+    postWord32(eb, census->n_live_blocks);
+    releaseEventsBuf(eb);
 }
 
 void postNonmovingPrunedSegments(uint32_t pruned_segments, uint32_t free_segments)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    postEventHeader(&eventBuf, EVENT_NONMOVING_PRUNED_SEGMENTS);
-    postWord32(&eventBuf, pruned_segments);
-    postWord32(&eventBuf, free_segments);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    postEventHeader(eb, EVENT_NONMOVING_PRUNED_SEGMENTS);
+    postWord32(eb, pruned_segments);
+    postWord32(eb, free_segments);
+    releaseEventsBuf(eb);
 }
 
 void closeBlockMarker (EventsBuf *ebuf)
 {
+    if (compact_format) {
+        finishEvent(ebuf);
+    }
+
     if (ebuf->marker)
     {
         // (type:16, time:64, size:32, end_time:64)
 
         StgInt8* save_pos = ebuf->pos;
-        ebuf->pos = ebuf->marker + sizeof(EventTypeNum) +
-                    sizeof(EventTimestamp);
+        ebuf->pos = ebuf->marker_fields;
         postWord32(ebuf, save_pos - ebuf->marker);
-        postTimestamp(ebuf);
+        postWord64(ebuf, time_ns());
         ebuf->pos = save_pos;
         ebuf->marker = NULL;
     }
@@ -1187,7 +1963,11 @@ void postBlockMarker (EventsBuf *eb)
     closeBlockMarker(eb);
 
     eb->marker = eb->pos;
+    // the block starts from an absolute time, see
+    // Note [Compact eventlog format]
+    eb->last_ts = 0;
     postEventHeader(eb, EVENT_BLOCK_MARKER);
+    eb->marker_fields = eb->pos;
     postWord32(eb,0); // these get filled in later by closeBlockMarker();
     postWord64(eb,0);
     postCapNo(eb, eb->capno);
@@ -1259,47 +2039,94 @@ void postHeapProfBegin(StgWord8 profile_id)
 
 void postHeapProfSampleBegin(StgInt era)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_HEAP_PROF_SAMPLE_BEGIN);
-    postEventHeader(&eventBuf, EVENT_HEAP_PROF_SAMPLE_BEGIN);
-    postWord64(&eventBuf, era);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_HEAP_PROF_SAMPLE_BEGIN);
+    postEventHeader(eb, EVENT_HEAP_PROF_SAMPLE_BEGIN);
+    postWord64(eb, era);
+    releaseEventsBuf(eb);
 }
 
 
 void postHeapBioProfSampleBegin(StgInt era, StgWord64 time)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_HEAP_BIO_PROF_SAMPLE_BEGIN);
-    postEventHeader(&eventBuf, EVENT_HEAP_BIO_PROF_SAMPLE_BEGIN);
-    postWord64(&eventBuf, era);
-    postWord64(&eventBuf, time);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_HEAP_BIO_PROF_SAMPLE_BEGIN);
+    postEventHeader(eb, EVENT_HEAP_BIO_PROF_SAMPLE_BEGIN);
+    postWord64(eb, era);
+    postWord64(eb, time);
+    releaseEventsBuf(eb);
+}
+
+void postHeapProfSampleError(StgWord8 profile_id, StgWord64 error)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_HEAP_PROF_SAMPLE_ERROR);
+    postEventHeader(eb, EVENT_HEAP_PROF_SAMPLE_ERROR);
+    postWord8(eb, profile_id);
+    postWord64(eb, error);
+    releaseEventsBuf(eb);
 }
 
 void postHeapProfSampleEnd(StgInt era)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_HEAP_PROF_SAMPLE_END);
-    postEventHeader(&eventBuf, EVENT_HEAP_PROF_SAMPLE_END);
-    postWord64(&eventBuf, era);
-    RELEASE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_HEAP_PROF_SAMPLE_END);
+    postEventHeader(eb, EVENT_HEAP_PROF_SAMPLE_END);
+    postWord64(eb, era);
+    releaseEventsBuf(eb);
 }
 
 void postHeapProfSampleString(StgWord8 profile_id,
                               const char *label,
                               StgWord64 residency)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
     StgWord label_len = strlen(label);
     StgWord len = 1+8+label_len+1;
-    CHECK(!ensureRoomForVariableEvent(&eventBuf, len));
-    postEventHeader(&eventBuf, EVENT_HEAP_PROF_SAMPLE_STRING);
-    postPayloadSize(&eventBuf, len);
-    postWord8(&eventBuf, profile_id);
-    postWord64(&eventBuf, residency);
-    postStringLen(&eventBuf, label, label_len);
-    RELEASE_LOCK(&eventBufMutex);
+    CHECK(!ensureRoomForVariableEvent(eb, len));
+    postEventHeader(eb, EVENT_HEAP_PROF_SAMPLE_STRING);
+    postPayloadSize(eb, len);
+    postWord8(eb, profile_id);
+    postWord64(eb, residency);
+    postStringLen(eb, label, label_len);
+    releaseEventsBuf(eb);
+}
+
+void postHeapProfSampleDelta(StgWord8 profile_id,
+                             uint32_t n,
+                             const StgWord64 *bands)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    StgWord len = 1+4+n*16;
+    CHECK(!ensureRoomForVariableEvent(eb, len));
+    postEventHeader(eb, EVENT_HEAP_PROF_SAMPLE_DELTA);
+    postPayloadSize(eb, len);
+    postWord8(eb, profile_id);
+    postWord32(eb, n);
+    for (uint32_t i = 0; i < 2*n; i++) {
+        postWord64(eb, bands[i]);
+    }
+    releaseEventsBuf(eb);
+}
+
+void postHeapProfSizeHistogram(StgWord8 profile_id,
+                               uint32_t n,
+                               const StgWord64 *objects,
+                               const StgWord64 *words,
+                               uint32_t scale)
+{
+    EventsBuf *eb = acquireEventsBuf();
+    StgWord len = 1+4+n*16;
+    CHECK(!ensureRoomForVariableEvent(eb, len));
+    postEventHeader(eb, EVENT_HEAP_PROF_SIZE_HISTOGRAM);
+    postPayloadSize(eb, len);
+    postWord8(eb, profile_id);
+    postWord32(eb, n);
+    for (uint32_t i = 0; i < n; i++) {
+        postWord64(eb, objects[i] * scale);
+        postWord64(eb, words[i] * scale * sizeof(W_));
+    }
+    releaseEventsBuf(eb);
 }
 
 #if defined(PROFILING)
@@ -1329,7 +2156,7 @@ void postHeapProfSampleCostCentre(StgWord8 profile_id,
                                   CostCentreStack *stack,
                                   StgWord64 residency)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
     StgWord depth = 0;
     CostCentreStack *ccs;
     for (ccs = stack; ccs != NULL && ccs != CCS_MAIN; ccs = ccs->prevStack)
@@ -1337,17 +2164,17 @@ void postHeapProfSampleCostCentre(StgWord8 profile_id,
     if (depth > 0xff) depth = 0xff;
 
     StgWord len = 1+8+1+depth*4;
-    CHECK(!ensureRoomForVariableEvent(&eventBuf, len));
-    postEventHeader(&eventBuf, EVENT_HEAP_PROF_SAMPLE_COST_CENTRE);
-    postPayloadSize(&eventBuf, len);
-    postWord8(&eventBuf, profile_id);
-    postWord64(&eventBuf, residency);
-    postWord8(&eventBuf, depth);
+    CHECK(!ensureRoomForVariableEvent(eb, len));
+    postEventHeader(eb, EVENT_HEAP_PROF_SAMPLE_COST_CENTRE);
+    postPayloadSize(eb, len);
+    postWord8(eb, profile_id);
+    postWord64(eb, residency);
+    postWord8(eb, depth);
     for (ccs = stack;
          depth>0 && ccs != NULL && ccs != CCS_MAIN;
          ccs = ccs->prevStack, depth--)
-        postWord32(&eventBuf, ccs->cc->ccID);
-    RELEASE_LOCK(&eventBufMutex);
+        postWord32(eb, ccs->cc->ccID);
+    releaseEventsBuf(eb);
 }
 
 
@@ -1355,7 +2182,7 @@ void postProfSampleCostCentre(Capability *cap,
                               CostCentreStack *stack,
                               StgWord64 tick)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
+    EventsBuf *eb = acquireEventsBuf();
     StgWord depth = 0;
     CostCentreStack *ccs;
     for (ccs = stack; ccs != NULL && ccs != CCS_MAIN; ccs = ccs->prevStack)
@@ -1363,17 +2190,17 @@ void postProfSampleCostCentre(Capability *cap,
     if (depth > 0xff) depth = 0xff;
 
     StgWord len = 4+8+1+depth*4;
-    CHECK(!ensureRoomForVariableEvent(&eventBuf, len));
-    postEventHeader(&eventBuf, EVENT_PROF_SAMPLE_COST_CENTRE);
-    postPayloadSize(&eventBuf, len);
-    postWord32(&eventBuf, cap->no);
-    postWord64(&eventBuf, tick);
-    postWord8(&eventBuf, depth);
+    CHECK(!ensureRoomForVariableEvent(eb, len));
+    postEventHeader(eb, EVENT_PROF_SAMPLE_COST_CENTRE);
+    postPayloadSize(eb, len);
+    postWord32(eb, cap->no);
+    postWord64(eb, tick);
+    postWord8(eb, depth);
     for (ccs = stack;
          depth>0 && ccs != NULL && ccs != CCS_MAIN;
          ccs = ccs->prevStack, depth--)
-        postWord32(&eventBuf, ccs->cc->ccID);
-    RELEASE_LOCK(&eventBufMutex);
+        postWord32(eb, ccs->cc->ccID);
+    releaseEventsBuf(eb);
 }
 
 // This event is output at the start of profiling so the tick interval can
@@ -1389,7 +2216,6 @@ void postProfBegin(void)
 }
 #endif /* PROFILING */
 
-#if defined(TICKY_TICKY)
 static void postTickyCounterDef(EventsBuf *eb, StgEntCounter *p)
 {
     StgWord arg_kinds_len = strlen(p->arg_kinds);
@@ -1439,15 +2265,15 @@ static void postTickyCounterSample(EventsBuf *eb, StgEntCounter *p)
 
 void postTickyCounterSamples(StgEntCounter *counters)
 {
-    ACQUIRE_LOCK(&eventBufMutex);
-    ensureRoomForEvent(&eventBuf, EVENT_TICKY_COUNTER_SAMPLE);
-    postEventHeader(&eventBuf, EVENT_TICKY_COUNTER_BEGIN_SAMPLE);
+    EventsBuf *eb = acquireEventsBuf();
+    ensureRoomForEvent(eb, EVENT_TICKY_COUNTER_SAMPLE);
+    postEventHeader(eb, EVENT_TICKY_COUNTER_BEGIN_SAMPLE);
     for (StgEntCounter *p = counters; p != NULL; p = p->link) {
-        postTickyCounterSample(&eventBuf, p);
+        postTickyCounterSample(eb, p);
     }
-    RELEASE_LOCK(&eventBufMutex);
+    releaseEventsBuf(eb);
 }
-#endif /* TICKY_TICKY */
+
 void postIPE(const InfoProvEnt *ipe)
 {
     char closure_desc_buf[CLOSURE_DESC_BUFFER_SIZE] = {};
@@ -1488,6 +2314,211 @@ void postIPE(const InfoProvEnt *ipe)
     RELEASE_LOCK(&eventBufMutex);
 }
 
+#if defined(THREADED_RTS)
+/* Hand a full buffer to the writer thread and carry on with the spare;
+ * see Note [Eventlog writer thread].
+ */
+static void
+queueEventsBuf (EventsBuf *ebuf, size_t size)
+{
+    StgInt8 *spare = ACQUIRE_LOAD(&ebuf->spare);
+    EventsBuf *head;
+
+    if (spare == NULL) {
+        // our previous buffer hasn't been written yet
+        atomic_inc(&eventlog_bufs_late, 1);
+        ACQUIRE_LOCK(&writer_mutex);
+        while ((spare = ACQUIRE_LOAD(&ebuf->spare)) == NULL) {
+            waitCondition(&spare_cond, &writer_mutex);
+        }
+        RELEASE_LOCK(&writer_mutex);
+    }
+
+    ebuf->full = ebuf->begin;
+    ebuf->full_size = size;
+    ebuf->spare = NULL;
+    ebuf->begin = spare;
+    resetEventsBuf(ebuf);
+
+    atomic_inc(&bufs_queued, 1);
+    do {
+        head = ACQUIRE_LOAD(&full_bufs);
+        ebuf->next_full = head;
+    } while ((EventsBuf *)cas((StgVolatilePtr)&full_bufs,
+                              (StgWord)head, (StgWord)ebuf) != head);
+
+    if (head == NULL) {
+        ACQUIRE_LOCK(&writer_mutex);
+        signalCondition(&writer_cond);
+        RELEASE_LOCK(&writer_mutex);
+    }
+}
+
+static void *
+eventLogWriterThread (void *unused STG_UNUSED)
+{
+    ACQUIRE_LOCK(&writer_mutex);
+    for (;;) {
+        EventsBuf *eb, *next, *todo = NULL;
+        StgWord n = 0;
+
+        eb = (EventsBuf *)xchg((StgPtr)&full_bufs, (StgWord)NULL);
+        if (eb == NULL) {
+            if (writer_thread_stopping) {
+                break;
+            }
+            waitCondition(&writer_cond, &writer_mutex);
+            continue;
+        }
+        RELEASE_LOCK(&writer_mutex);
+
+        // full_bufs is newest first
+        for (; eb != NULL; eb = next) {
+            next = eb->next_full;
+            eb->next_full = todo;
+            todo = eb;
+        }
+
+        for (eb = todo; eb != NULL; eb = next) {
+            // once we give the buffer back, the capability may queue eb
+            // again
+            StgInt8 *buf = eb->full;
+            next = eb->next_full;
+            if (writeEventLog(buf, eb->full_size)) {
+                atomic_inc(&eventlog_bufs_written, 1);
+            } else {
+                atomic_inc(&eventlog_bufs_dropped, 1);
+            }
+            RELEASE_STORE(&eb->spare, buf);
+            n++;
+        }
+
+        ACQUIRE_LOCK(&writer_mutex);
+        bufs_written += n;
+        broadcastCondition(&spare_cond);
+    }
+    RELEASE_LOCK(&writer_mutex);
+    return NULL;
+}
+
+static void
+startEventLogWriterThread (void)
+{
+    if (!RtsFlags.TraceFlags.writerThread || writer_thread_running) {
+        return;
+    }
+
+    initMutex(&writer_mutex);
+    initCondition(&writer_cond);
+    initCondition(&spare_cond);
+    writer_thread_stopping = false;
+    full_bufs = NULL;
+    bufs_queued = 0;
+    bufs_written = 0;
+
+    if (createOSThread(&writer_thread, "ghc_eventlog",
+                       eventLogWriterThread, NULL) != 0) {
+        sysErrorBelch("can't start the eventlog writer thread;"
+                      " writing the eventlog synchronously");
+        return;
+    }
+    RELEASE_STORE(&writer_thread_running, true);
+}
+
+// Wait until the writer thread has written everything queued so far.
+static void
+drainEventLogWriterThread (void)
+{
+    if (!RELAXED_LOAD(&writer_thread_running)) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&writer_mutex);
+    while (bufs_written != ACQUIRE_LOAD(&bufs_queued)) {
+        waitCondition(&spare_cond, &writer_mutex);
+    }
+    RELEASE_LOCK(&writer_mutex);
+}
+
+static void
+stopEventLogWriterThread (void)
+{
+    if (!RELAXED_LOAD(&writer_thread_running)) {
+        return;
+    }
+
+    drainEventLogWriterThread();
+
+    ACQUIRE_LOCK(&writer_mutex);
+    writer_thread_stopping = true;
+    signalCondition(&writer_cond);
+    RELEASE_LOCK(&writer_mutex);
+
+    joinOSThread(writer_thread);
+    RELAXED_STORE(&writer_thread_running, false);
+
+    closeCondition(&spare_cond);
+    closeCondition(&writer_cond);
+    closeMutex(&writer_mutex);
+}
+#endif
+
+void getEventLogWriterStats (StgWord *written, StgWord *late, StgWord *dropped)
+{
+    *written = RELAXED_LOAD(&eventlog_bufs_written);
+    *late = RELAXED_LOAD(&eventlog_bufs_late);
+    *dropped = RELAXED_LOAD(&eventlog_bufs_dropped);
+}
+
+StgWord getEventLogBufferBytes (void)
+{
+    return RELAXED_LOAD(&eventlog_buf_bytes);
+}
+
+static void postEventsBufStats (EventsBuf *eb)
+{
+    ensureRoomForEvent(eb, EVENT_EVENTLOG_BUF_STATS);
+
+    postEventHeader(eb, EVENT_EVENTLOG_BUF_STATS);
+    postCapNo(eb, eb->capno);
+    postWord64(eb, eb->size);
+    postWord64(eb, eb->flushes);
+    postWord64(eb, eb->full_flushes);
+}
+
+// Called with the empty buffer of a capability, after writing used bytes of
+// it. Returns true if it resized the buffer. See
+// Note [Adaptive event buffers].
+static bool adaptEventsBuf (EventsBuf *eb, size_t used, bool can_resize)
+{
+    Time now = stat_getElapsedTime();
+    Time since_filled = now - eb->filled_at;
+    bool full = used >= eb->size - eb->size / 4;
+    StgWord64 new_size = eb->size;
+
+    eb->flushes++;
+    if (full) {
+        eb->full_flushes++;
+        eb->filled_at = now;
+        if (since_filled < EVENT_LOG_GROW_INTERVAL) {
+            new_size = stg_min(eb->size * 2, EVENT_LOG_MAX_SIZE);
+        }
+    }
+    if (since_filled > EVENT_LOG_SHRINK_INTERVAL
+        && (full || used < eb->size / 8)) {
+        new_size = stg_max(eb->size / 2, EVENT_LOG_MIN_SIZE);
+    }
+
+    if (!can_resize || new_size == eb->size) {
+        return false;
+    }
+    stgFree(eb->begin);
+    eb->begin = eb->pos = stgMallocBytes(new_size, "adaptEventsBuf");
+    RELAXED_ADD(&eventlog_buf_bytes, new_size - eb->size);
+    eb->size = new_size;
+    return true;
+}
+
 void printAndClearEventBuf (EventsBuf *ebuf)
 {
     closeBlockMarker(ebuf);
@@ -1495,19 +2526,40 @@ void printAndClearEventBuf (EventsBuf *ebuf)
     if (ebuf->begin != NULL && ebuf->pos != ebuf->begin)
     {
         size_t elog_size = ebuf->pos - ebuf->begin;
+        bool cap_buf = ebuf->capno != (EventCapNo)(-1);
+
+#if defined(THREADED_RTS)
+        if (RELAXED_LOAD(&writer_thread_running)) {
+            // See Note [Eventlog writer thread]
+            queueEventsBuf(ebuf, elog_size);
+            flushCount++;
+            if (cap_buf) {
+                adaptEventsBuf(ebuf, elog_size, false);
+            }
+            postBlockMarker(ebuf);
+            return;
+        }
+#endif
+
         if (!writeEventLog(ebuf->begin, elog_size)) {
             debugBelch(
                     "printAndClearEventLog: could not flush event log\n"
                 );
+            atomic_inc(&eventlog_bufs_dropped, 1);
             resetEventsBuf(ebuf);
             flushEventLogWriter();
             return;
         }
 
+        atomic_inc(&eventlog_bufs_written, 1);
         resetEventsBuf(ebuf);
         flushCount++;
 
+        bool resized = cap_buf && adaptEventsBuf(ebuf, elog_size, true);
         postBlockMarker(ebuf);
+        if (resized) {
+            postEventsBufStats(ebuf);
+        }
     }
 }
 
@@ -1515,8 +2567,25 @@ void initEventsBuf(EventsBuf* eb, StgWord64 size, EventCapNo capno)
 {
     eb->begin = eb->pos = stgMallocBytes(size, "initEventsBuf");
     eb->size = size;
+    RELAXED_ADD(&eventlog_buf_bytes, size);
     eb->marker = NULL;
+    eb->event_payload = NULL;
+    eb->last_ts = 0;
+    eb->flushes = 0;
+    eb->full_flushes = 0;
+    eb->filled_at = 0;
     eb->capno = capno;
+#if defined(THREADED_RTS)
+    eb->spare = RtsFlags.TraceFlags.writerThread
+        ? stgMallocBytes(size, "initEventsBuf")
+        : NULL;
+    if (eb->spare != NULL) {
+        RELAXED_ADD(&eventlog_buf_bytes, size);
+    }
+    eb->full = NULL;
+    eb->full_size = 0;
+    eb->next_full = NULL;
+#endif
     postBlockMarker(eb);
 }
 
@@ -1524,12 +2593,17 @@ void resetEventsBuf(EventsBuf* eb)
 {
     eb->pos = eb->begin;
     eb->marker = NULL;
+    eb->event_payload = NULL;
+    eb->last_ts = 0;
 }
 
 STG_WARN_UNUSED_RESULT
 StgBool hasRoomForEvent(EventsBuf *eb, EventTypeNum eNum)
 {
   uint32_t size = sizeof(EventTypeNum) + sizeof(EventTimestamp) + eventTypes[eNum].size;
+  if (compact_format) {
+      size += COMPACT_EVENT_SLACK;
+  }
 
   if (eb->pos + size > eb->begin + eb->size) {
       return 0; // Not enough space.
@@ -1543,6 +2617,9 @@ StgBool hasRoomForVariableEvent(EventsBuf *eb, StgWord payload_bytes)
 {
   StgWord size = sizeof(EventTypeNum) + sizeof(EventTimestamp) +
       sizeof(EventPayloadSize) + payload_bytes;
+  if (compact_format) {
+      size += COMPACT_EVENT_SLACK;
+  }
 
   if (eb->pos + size > eb->begin + eb->size) {
       return 0; // Not enough space.
@@ -1577,7 +2654,8 @@ int ensureRoomForVariableEvent(EventsBuf *eb, StgWord size)
 void postEventType(EventsBuf *eb, EventType *et)
 {
     postInt32(eb, EVENT_ET_BEGIN);
-    postEventTypeNum(eb, et->etNum);
+    // the header is the same in every format
+    postWord16(eb, et->etNum);
     postWord16(eb, (StgWord16)et->size);
     const int desclen = strlen(et->desc);
     postWord32(eb, desclen);
@@ -1605,6 +2683,7 @@ void flushAllCapsEventsBufs(void)
     ACQUIRE_LOCK(&eventBufMutex);
     printAndClearEventBuf(&eventBuf);
     RELEASE_LOCK(&eventBufMutex);
+    flushTaskEventsBufs();
 
     for (unsigned int i=0; i < getNumCapabilities(); i++) {
         flushLocalEventsBuf(getCapability(i));
@@ -1633,6 +2712,23 @@ void flushEventLog(Capability **cap USED_IF_THREADS)
     flushEventLogWriter();
 }
 
+void setEventLogSampleRate(enum EventLogSampleClass cls, uint32_t n)
+{
+    if (n == 0) {
+        n = 1;
+    }
+    switch (cls) {
+    case EVENTLOG_SAMPLE_SCHED:
+        RELAXED_STORE(&RtsFlags.TraceFlags.schedSampleRate, n);
+        break;
+    case EVENTLOG_SAMPLE_SPARKS:
+        RELAXED_STORE(&RtsFlags.TraceFlags.sparksSampleRate, n);
+        break;
+    default:
+        errorBelch("setEventLogSampleRate: unknown event class %d", cls);
+    }
+}
+
 #else
 
 enum EventLogStatus eventLogStatus(void)
@@ -1648,4 +2744,7 @@ void endEventLogging(void) {}
 
 void flushEventLog(Capability **cap STG_UNUSED) {}
 
+void setEventLogSampleRate(enum EventLogSampleClass cls STG_UNUSED,
+                           uint32_t n STG_UNUSED) {}
+
 #endif /* TRACING */
@@ -19,16 +19,38 @@
 
 extern bool eventlog_enabled;
 
+#if HAVE_LIBZSTD == 1
+// See Note [Compressed eventlog] in EventLogWriter.c
+extern const EventLogWriter ZstdEventLogWriter;
+#endif
+
+#if defined(THREADED_RTS) && !defined(mingw32_HOST_OS)
+// See Note [Eventlog socket] in EventLogSocket.c
+#define EVENTLOG_SOCKET 1
+extern const EventLogWriter SocketEventLogWriter;
+StgWord eventLogSocketDropped(void);
+#endif
+
 void initEventLogging(void);
+bool repostEventLogInitEvents(void);
 void restartEventLogging(void);
 void finishCapEventLogging(void);
 void freeEventLogging(void);
+#if defined(THREADED_RTS)
+void freeTaskEventsBuf(Task *task);
+#endif
 void abortEventLogging(void); // #4512 - after fork child needs to abort
 void moreCapEventBufs (uint32_t from, uint32_t to);
 void flushLocalEventsBuf(Capability *cap);
 void flushAllCapsEventsBufs(void);
 void flushAllEventsBufs(Capability *cap);
 
+// See Note [Eventlog writer thread] in EventLog.c
+void getEventLogWriterStats(StgWord *written, StgWord *late, StgWord *dropped);
+
+// The bytes held by the event buffers of the capabilities and tasks
+StgWord getEventLogBufferBytes(void);
+
 typedef void (*EventlogInitPost)(void);
 
 // Events which are emitted during program start-up should be wrapped with
@@ -153,6 +175,78 @@ void postEventMemReturn (Capability *cap,
                          uint32_t returned_mblocks
                         );
 
+void postEventGcWorkSteals (Capability *cap,
+                            EventCapNo  gc_cap,
+                            uint32_t    stolen_blocks,
+                            uint32_t    failed_steals);
+
+void postEventGcParThreads (Capability *cap,
+                            uint32_t    gen,
+                            uint32_t    threads,
+                            StgWord64   work_bytes);
+
+void postEventTraceClasses (const char *classes);
+
+void postEventAllocSample (Capability   *cap,
+                           EventThreadID thread,
+                           StgWord       info,
+                           StgWord64     bytes);
+
+void postEventStackSample (Capability          *cap,
+                           EventThreadID        thread,
+                           StgWord64            time,
+                           uint16_t             n_frames,
+                           const StgInfoTable **frames);
+
+void postEventGcThreadStats (Capability *cap,
+                             EventCapNo  gc_cap,
+                             StgWord64   copy_start,
+                             StgWord64   copy_end,
+                             StgWord64   idle,
+                             StgWord64   copied_bytes);
+
+void postEventGcGenResize (EventCapsetID heap_capset,
+                           uint32_t      gen,
+                           W_            max_blocks,
+                           uint32_t      survival,
+                           uint32_t      promotion,
+                           uint32_t      factor,
+                           uint32_t      gc_cpu);
+
+void postEventPinnedFragmentation (EventCapsetID heap_capset,
+                                   uint32_t      blocks,
+                                   uint32_t      sparse_blocks,
+                                   W_            used_bytes,
+                                   W_            live_bytes);
+
+void postEventGcGenShape (EventCapsetID heap_capset,
+                          uint16_t      gen,
+                          W_            live_bytes,
+                          W_            large_bytes,
+                          W_            mut_list_entries);
+
+void postEventCapParking (EventCapNo capno,
+                          W_         spin_wakeups,
+                          W_         parks);
+
+void postEventStmHotTVar (EventCapNo capno,
+                          StgWord    tvar,
+                          uint32_t   aborts);
+
+void postEventBlackHoleContention (EventCapNo capno,
+                                   StgWord    info,
+                                   uint32_t   duplicates,
+                                   uint32_t   blocks);
+
+void postEventSampledEvents (EventCapNo capno,
+                             StgWord8   cls,
+                             uint32_t   rate,
+                             StgWord64  suppressed);
+
+void postEventPerfCounters (StgWord8         phase,
+                            uint32_t         thread,
+                            const StgWord64 *counts);
+
 void postTaskCreateEvent (EventTaskId taskId,
                           EventCapNo cap,
                           EventKernelThreadId tid);
@@ -161,6 +255,9 @@ void postTaskMigrateEvent (EventTaskId taskId,
                            EventCapNo capno,
                            EventCapNo new_capno);
 
+void postTaskReuseEvent (EventTaskId taskId,
+                         EventCapNo capno);
+
 void postTaskDeleteEvent (EventTaskId taskId);
 
 void postHeapProfBegin(StgWord8 profile_id);
@@ -168,11 +265,25 @@ void postHeapProfBegin(StgWord8 profile_id);
 void postHeapProfSampleBegin(StgInt era);
 void postHeapBioProfSampleBegin(StgInt era, StgWord64 time_ns);
 void postHeapProfSampleEnd(StgInt era);
+void postHeapProfSampleError(StgWord8 profile_id, StgWord64 error);
 
 void postHeapProfSampleString(StgWord8 profile_id,
                               const char *label,
                               StgWord64 residency);
 
+// bands holds n (identity, residency) pairs
+void postHeapProfSampleDelta(StgWord8 profile_id,
+                             uint32_t n,
+                             const StgWord64 *bands);
+
+// objects and words are the counts and total sizes of the closures in each
+// of the n buckets, sampled 1 in scale
+void postHeapProfSizeHistogram(StgWord8 profile_id,
+                               uint32_t n,
+                               const StgWord64 *objects,
+                               const StgWord64 *words,
+                               uint32_t scale);
+
 #if defined(PROFILING)
 void postHeapProfCostCentre(StgWord32 ccID,
                             const char *label,
@@ -193,20 +304,23 @@ void postProfBegin(void);
 void postIPE(const InfoProvEnt *ipe);
 
 void postConcUpdRemSetFlush(Capability *cap);
+void postConcUpdRemSetHandshake(Capability *cap, StgWord64 latency);
 void postConcMarkEnd(StgWord32 marked_obj_count);
+void postConcMarkWorkerEnd(StgWord16 worker, StgWord32 marked_obj_count,
+                           StgWord64 busy_time, StgWord64 idle_time);
 void postNonmovingHeapCensus(uint16_t blk_size,
                              const struct NonmovingAllocCensus *census);
 void postNonmovingPrunedSegments(uint32_t pruned_segments, uint32_t free_segments);
 
-#if defined(TICKY_TICKY)
 void postTickyCounterDefs(StgEntCounter *p);
 void postTickyCounterSamples(StgEntCounter *p);
-#endif /* TICKY_TICKY */
 
 #else /* !TRACING */
 
 INLINE_HEADER void finishCapEventLogging(void) {}
 
+INLINE_HEADER void freeTaskEventsBuf(Task *task STG_UNUSED) {}
+
 INLINE_HEADER void flushLocalEventsBuf(Capability *cap STG_UNUSED)
 { /* nothing */ }
 
@@ -0,0 +1,380 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2026
+ *
+ * Serving the eventlog on a Unix domain socket.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#if defined(TRACING)
+
+#include "RtsUtils.h"
+#include "EventLog.h"
+
+#if defined(EVENTLOG_SOCKET)
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Note [Eventlog socket]
+   ~~~~~~~~~~~~~~~~~~~~~~
+   With +RTS -l --eventlog-socket=<path>, SocketEventLogWriter serves the
+   eventlog to a consumer (ghc-events, a monitoring agent, ...) that connects
+   to the Unix domain socket <path>, rather than writing it to a file. This
+   lets a long-running program be watched while it runs.
+
+   A slow consumer must never hold up the program, so writeEventLog only
+   copies what it is given into a ring buffer of EVENTLOG_SOCKET_RING_SIZE
+   bytes, and a thread of our own (socketSender) sends the contents of the
+   ring to the consumer. If the ring doesn't have room for a write, we drop
+   the whole write and count it (+RTS -s reports the count). That leaves a
+   stream the consumer can still parse: apart from the header, every write
+   is a whole EventsBuf, made of complete blocks (see printAndClearEventBuf).
+   The consumer just sees a gap in the events.
+
+   Only one consumer is served at a time; others wait to be accepted until
+   it disconnects. While nobody is connected, writes are discarded.
+
+   The first write is the eventlog header, which a consumer needs before
+   anything else. We keep a copy of it. When a consumer connects, we put
+   the header in the ring, ahead of anything written after that. We then
+   have the RTS post the initialisation events again
+   (repostEventLogInitEvents): the capsets, the heap, the program's
+   arguments and so on, which were posted when the eventlog started and
+   which the consumer would otherwise never see.
+
+   The socket is non-blocking, and socketSender polls it, so that it
+   notices when the writer is stopped. When stopping, it sends what is
+   left in the ring, including the end of the eventlog, unless the consumer
+   makes no progress for EVENTLOG_SOCKET_STOP_TIMEOUT.
+
+   After forkProcess the child serves its eventlog on <path>.<pid>, like
+   the file writer, and leaves the parent's socket alone.
+
+   The writes themselves only happen when an event buffer fills up or the
+   eventlog is flushed, so use --eventlog-flush-interval to bound how far
+   behind the consumer can be.
+*/
+
+#define EVENTLOG_SOCKET_RING_SIZE (16 * 1024 * 1024)
+
+// milliseconds
+#define EVENTLOG_SOCKET_POLL_INTERVAL 100
+#define EVENTLOG_SOCKET_STOP_TIMEOUT 1000
+
+#if defined(MSG_NOSIGNAL)
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static char *socket_path = NULL;
+static int listen_fd = -1;
+static int client_fd = -1;      // only touched by socketSender
+static pid_t socket_pid = -1;   // the process that owns socket_path
+
+static OSThreadId sender_thread;
+static bool sender_running = false;
+
+// All of these are protected by ring_mutex
+static Mutex ring_mutex;
+static Condition ring_cond;     // something in the ring, or stopping
+static StgWord8 *ring = NULL;
+static size_t ring_start;       // where the next byte to send is
+static size_t ring_len;         // how many bytes there are to send
+static bool connected = false;  // writes go to the ring
+static bool stopping;
+static void *header = NULL;
+static size_t header_size;
+static StgWord writes_dropped = 0;
+
+// Append to the ring, which must have room. Call with ring_mutex held.
+static void
+ringAppend (const void *src, size_t size)
+{
+    size_t end = (ring_start + ring_len) % EVENTLOG_SOCKET_RING_SIZE;
+    size_t first = stg_min(size, EVENTLOG_SOCKET_RING_SIZE - end);
+
+    memcpy(ring + end, src, first);
+    memcpy(ring, (const StgWord8 *)src + first, size - first);
+    ring_len += size;
+    signalCondition(&ring_cond);
+}
+
+static bool
+senderStopping (void)
+{
+    bool s;
+    ACQUIRE_LOCK(&ring_mutex);
+    s = stopping;
+    RELEASE_LOCK(&ring_mutex);
+    return s;
+}
+
+static void
+acceptConsumer (void)
+{
+    struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+    if (poll(&pfd, 1, EVENTLOG_SOCKET_POLL_INTERVAL) <= 0) {
+        return;
+    }
+
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#if defined(SO_NOSIGPIPE)
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    client_fd = fd;
+
+    ACQUIRE_LOCK(&ring_mutex);
+    ring_start = 0;
+    ring_len = 0;
+    if (header != NULL) {
+        ringAppend(header, header_size);
+    }
+    connected = true;
+    RELEASE_LOCK(&ring_mutex);
+
+    // The RTS may be starting or stopping the eventlog; in the first case
+    // it posts the initialisation events itself.
+    while (!repostEventLogInitEvents() && !senderStopping()) {
+        usleep(10000);
+    }
+}
+
+static void
+dropConsumer (void)
+{
+    ACQUIRE_LOCK(&ring_mutex);
+    connected = false;
+    ring_len = 0;
+    RELEASE_LOCK(&ring_mutex);
+
+    close(client_fd);
+    client_fd = -1;
+}
+
+static void *
+socketSender (void *unused STG_UNUSED)
+{
+    int idle = 0;   // milliseconds without progress while stopping
+
+    for (;;) {
+        if (client_fd < 0) {
+            if (senderStopping()) {
+                break;
+            }
+            acceptConsumer();
+            continue;
+        }
+
+        ACQUIRE_LOCK(&ring_mutex);
+        while (ring_len == 0 && !stopping) {
+            waitCondition(&ring_cond, &ring_mutex);
+        }
+        if (ring_len == 0) {
+            RELEASE_LOCK(&ring_mutex);
+            break;
+        }
+        // Writers only append, so this part of the ring stays put while we
+        // send it without the lock.
+        StgWord8 *src = ring + ring_start;
+        size_t len = stg_min(ring_len, EVENTLOG_SOCKET_RING_SIZE - ring_start);
+        bool stop = stopping;
+        RELEASE_LOCK(&ring_mutex);
+
+        struct pollfd pfd = { .fd = client_fd, .events = POLLOUT };
+        if (poll(&pfd, 1, EVENTLOG_SOCKET_POLL_INTERVAL) == 0) {
+            if (stop) {
+                idle += EVENTLOG_SOCKET_POLL_INTERVAL;
+                if (idle >= EVENTLOG_SOCKET_STOP_TIMEOUT) {
+                    dropConsumer();
+                    break;
+                }
+            }
+            continue;
+        }
+
+        ssize_t n = send(client_fd, src, len, SEND_FLAGS);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;
+            }
+            // the consumer went away
+            dropConsumer();
+            continue;
+        }
+        idle = 0;
+
+        ACQUIRE_LOCK(&ring_mutex);
+        ring_start = (ring_start + n) % EVENTLOG_SOCKET_RING_SIZE;
+        ring_len -= n;
+        RELEASE_LOCK(&ring_mutex);
+    }
+
+    if (client_fd >= 0) {
+        close(client_fd);
+        client_fd = -1;
+    }
+    return NULL;
+}
+
+static void
+initEventLogSocketWriter (void)
+{
+    const char *path = RtsFlags.TraceFlags.eventlogSocket;
+    struct sockaddr_un addr;
+
+    // A child of forkProcess, see stopEventLogSocketWriter
+    if (socket_pid != -1 && socket_pid != getpid()) {
+        socket_path = stgMallocBytes(strlen(path) + 12, "initEventLogSocketWriter");
+        sprintf(socket_path, "%s.%d", path, (int) getpid());
+    } else {
+        socket_path = stgMallocBytes(strlen(path) + 1, "initEventLogSocketWriter");
+        strcpy(socket_path, path);
+    }
+    socket_pid = getpid();
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        errorBelch("--eventlog-socket: path too long: %s", socket_path);
+        stg_exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        sysErrorBelch("--eventlog-socket: socket");
+        stg_exit(EXIT_FAILURE);
+    }
+    // a socket left behind by an earlier run
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+        || listen(listen_fd, 1) != 0) {
+        sysErrorBelch("--eventlog-socket: can't listen on %s", socket_path);
+        stg_exit(EXIT_FAILURE);
+    }
+
+    initMutex(&ring_mutex);
+    initCondition(&ring_cond);
+    ring = stgMallocBytes(EVENTLOG_SOCKET_RING_SIZE, "initEventLogSocketWriter");
+    ring_start = 0;
+    ring_len = 0;
+    connected = false;
+    stopping = false;
+    if (header != NULL) {
+        stgFree(header);
+        header = NULL;
+    }
+
+    if (createOSThread(&sender_thread, "ghc_eventlog_socket",
+                       socketSender, NULL) != 0) {
+        sysErrorBelch("--eventlog-socket: can't start the sender thread");
+        stg_exit(EXIT_FAILURE);
+    }
+    sender_running = true;
+}
+
+static bool
+writeEventLogSocket (void *eventlog, size_t eventlog_size)
+{
+    ACQUIRE_LOCK(&ring_mutex);
+    if (header == NULL) {
+        // See Note [Eventlog socket]: the first write is the header
+        header = stgMallocBytes(eventlog_size, "writeEventLogSocket");
+        memcpy(header, eventlog, eventlog_size);
+        header_size = eventlog_size;
+    }
+    else if (connected) {
+        if (EVENTLOG_SOCKET_RING_SIZE - ring_len < eventlog_size) {
+            writes_dropped++;
+        } else {
+            ringAppend(eventlog, eventlog_size);
+        }
+    }
+    RELEASE_LOCK(&ring_mutex);
+    return true;
+}
+
+static void
+flushEventLogSocket (void)
+{
+    // socketSender sends whatever is written as soon as it can
+}
+
+static void
+stopEventLogSocketWriter (void)
+{
+    if (!sender_running) {
+        return;
+    }
+
+    // A child of forkProcess, from restartEventLogging: the socket and the
+    // sender thread belong to the parent, and the child doesn't have the
+    // thread. Just close our copies of the descriptors.
+    if (socket_pid != getpid()) {
+        close(listen_fd);
+        if (client_fd >= 0) {
+            close(client_fd);
+        }
+        listen_fd = client_fd = -1;
+        sender_running = false;
+        stgFree(socket_path);
+        socket_path = NULL;
+        return;
+    }
+
+    ACQUIRE_LOCK(&ring_mutex);
+    stopping = true;
+    signalCondition(&ring_cond);
+    RELEASE_LOCK(&ring_mutex);
+
+    joinOSThread(sender_thread);
+    sender_running = false;
+
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+    stgFree(socket_path);
+    socket_path = NULL;
+
+    closeCondition(&ring_cond);
+    closeMutex(&ring_mutex);
+    stgFree(ring);
+    ring = NULL;
+    if (header != NULL) {
+        stgFree(header);
+        header = NULL;
+    }
+}
+
+StgWord
+eventLogSocketDropped (void)
+{
+    return RELAXED_LOAD(&writes_dropped);
+}
+
+const EventLogWriter SocketEventLogWriter = {
+    .initEventLogWriter = initEventLogSocketWriter,
+    .writeEventLog = writeEventLogSocket,
+    .flushEventLog = flushEventLogSocket,
+    .stopEventLogWriter = stopEventLogSocketWriter
+};
+
+#endif /* EVENTLOG_SOCKET */
+
+#endif /* TRACING */
@@ -21,6 +21,9 @@
 #if defined(HAVE_UNISTD_H)
 #include <unistd.h>
 #endif
+#if HAVE_LIBZSTD == 1
+#include <zstd.h>
+#endif
 
 // PID of the process that writes to event_log_filename (#4512)
 static pid_t event_log_pid = -1;
@@ -151,6 +154,111 @@ stopEventLogFileWriter(void)
 #endif
 }
 
+#if HAVE_LIBZSTD == 1
+/* Note [Compressed eventlog]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   When the eventlog is written to a file whose name ends in .zst (see
+   initTracing), ZstdEventLogWriter compresses it with zstd, as one
+   streaming frame, so that `zstd -d` or `zstdcat` give the plain eventlog.
+   The RTS links libzstd anyway when it is built with it, for compressed
+   IPE data.
+
+   Compressing a full 2MB event buffer takes much longer than writing it,
+   so initTracing also turns on the eventlog writer thread (see
+   Note [Eventlog writer thread] in EventLog.c), which keeps the
+   compression off the capabilities in the threaded RTS.
+
+   Unlike FileEventLogWriter we don't flush after every write, which would
+   end a zstd block each time; flushEventLog (e.g. from
+   --eventlog-flush-interval or hs_flush) flushes the compressor and the
+   file.
+*/
+
+static ZSTD_CCtx *zstd_cctx = NULL;
+static void *zstd_out = NULL;
+static size_t zstd_out_size;
+
+static void
+initEventLogZstdWriter(void)
+{
+    initEventLogFileWriter();
+
+    zstd_cctx = ZSTD_createCCtx();
+    if (zstd_cctx == NULL) {
+        errorBelch("initEventLogZstdWriter: can't create a zstd context");
+        stg_exit(EXIT_FAILURE);
+    }
+    zstd_out_size = ZSTD_CStreamOutSize();
+    zstd_out = stgMallocBytes(zstd_out_size, "initEventLogZstdWriter");
+}
+
+// Compress what we're given, and write out what the compressor produces,
+// until it has taken all of the input and, when flushing or ending the
+// frame, produced all of its output. Call with the event log lock held.
+static bool
+zstdWrite(const void *src, size_t size, ZSTD_EndDirective mode)
+{
+    ZSTD_inBuffer in = { src, size, 0 };
+    bool finished;
+
+    do {
+        ZSTD_outBuffer out = { zstd_out, zstd_out_size, 0 };
+        size_t remaining = ZSTD_compressStream2(zstd_cctx, &out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            errorBelch("eventlog: zstd: %s", ZSTD_getErrorName(remaining));
+            return false;
+        }
+        if (out.pos > 0
+            && fwrite(zstd_out, 1, out.pos, event_log_file) != out.pos) {
+            return false;
+        }
+        finished = mode == ZSTD_e_continue
+            ? in.pos == in.size
+            : remaining == 0;
+    } while (!finished);
+
+    return true;
+}
+
+static bool
+writeEventLogZstd(void *eventlog, size_t eventlog_size)
+{
+    bool ok;
+
+    acquire_event_log_lock();
+    ok = zstd_cctx != NULL && zstdWrite(eventlog, eventlog_size, ZSTD_e_continue);
+    release_event_log_lock();
+    return ok;
+}
+
+static void
+flushEventLogZstd(void)
+{
+    acquire_event_log_lock();
+    if (zstd_cctx != NULL) {
+        zstdWrite(NULL, 0, ZSTD_e_flush);
+        fflush(event_log_file);
+    }
+    release_event_log_lock();
+}
+
+static void
+stopEventLogZstdWriter(void)
+{
+    acquire_event_log_lock();
+    if (zstd_cctx != NULL) {
+        zstdWrite(NULL, 0, ZSTD_e_end);
+        ZSTD_freeCCtx(zstd_cctx);
+        zstd_cctx = NULL;
+        stgFree(zstd_out);
+        zstd_out = NULL;
+    }
+    release_event_log_lock();
+
+    stopEventLogFileWriter();
+}
+#endif /* HAVE_LIBZSTD == 1 */
+
 static void
 initEventLogFileWriterNoop(void) {}
 
@@ -172,6 +280,15 @@ const EventLogWriter FileEventLogWriter = {
     .stopEventLogWriter = stopEventLogFileWriter
 };
 
+#if HAVE_LIBZSTD == 1
+const EventLogWriter ZstdEventLogWriter = {
+    .initEventLogWriter = initEventLogZstdWriter,
+    .writeEventLog = writeEventLogZstd,
+    .flushEventLog = flushEventLogZstd,
+    .stopEventLogWriter = stopEventLogZstdWriter
+};
+#endif
+
 const EventLogWriter NullEventLogWriter = {
     .initEventLogWriter = initEventLogFileWriterNoop,
     .writeEventLog = writeEventLogFileNoop,
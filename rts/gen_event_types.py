@@ -138,6 +138,65 @@ event_types = [
     EventType(210, 'TICKY_COUNTER_DEF',            VariableLength,        'Ticky-ticky entry counter definition'),
     EventType(211, 'TICKY_COUNTER_SAMPLE',         4*[Word64],            'Ticky-ticky entry counter sample'),
     EventType(212, 'TICKY_COUNTER_BEGIN_SAMPLE',   [],                    'Ticky-ticky entry counter begin sample'),
+
+    # GC work stealing
+    EventType(213, 'GC_WORK_STEALS',               [CapNo, Word32, Word32], 'GC work stealing statistics'),
+
+    # Adaptive generation sizing (-Fauto)
+    EventType(214, 'GC_GEN_RESIZE',                [CapsetId, Word16, Word64] + 4*[Word32], 'Generation resized by -Fauto'),
+
+    # Parallel non-moving mark
+    EventType(215, 'CONC_MARK_WORKER_END',         [Word16, Word32, Word64, Word64], 'Concurrent mark worker statistics'),
+
+    # Update remembered set handshake
+    EventType(216, 'CONC_UPD_REM_SET_HANDSHAKE',   [CapNo, Word64],       'Update remembered set flushed for a handshake'),
+
+    # Pinned block liveness (--pinned-liveness)
+    EventType(217, 'PINNED_FRAGMENTATION',         [CapsetId, Word32, Word32, Word64, Word64], 'Pinned block fragmentation after GC'),
+
+    # Capability parking (--park-spin)
+    EventType(218, 'CAP_PARKING',                  [CapNo, Word64, Word64], 'Wakeups while spinning and parks of tasks waiting for a capability'),
+
+    # Spare worker pool (--min-spare-workers)
+    EventType(219, 'TASK_REUSE',                   [TaskId, CapNo],       'Spare worker task takes a capability'),
+
+    # STM contention
+    EventType(220, 'STM_HOT_TVAR',                 [CapNo, Word64, Word32], 'TVar that transactions on a capability failed on'),
+
+    # Blackhole contention
+    EventType(221, 'BLACKHOLE_CONTENTION',         [CapNo, Word64, Word32, Word32], 'Thunk info table that threads on a capability contended for'),
+
+    # Event sampling (--eventlog-sample-sched, --eventlog-sample-sparks)
+    EventType(222, 'SAMPLED_EVENTS',               [CapNo, Word8, Word32, Word64], 'Events of a class a capability did not post'),
+
+    # Parallel GC load balance
+    EventType(223, 'GC_THREAD_STATS',              [CapNo] + 4*[Word64], 'Work and idle time of a GC thread'),
+
+    # Allocation sampling (--eventlog-alloc-sample)
+    EventType(224, 'ALLOC_SAMPLE',                 [CapNo, ThreadId, Word64, Word64], 'Code allocating when a capability filled nursery blocks'),
+
+    # Trace classes changed at runtime (rts_setTraceFlags)
+    EventType(225, 'TRACE_CLASSES',                VariableLength,        'Trace classes changed'),
+
+    # Adaptive event buffers
+    EventType(226, 'EVENTLOG_BUF_STATS',           [CapNo] + 3*[Word64],  'Size and flushes of the event buffer of a capability'),
+    EventType(227, 'HEAP_PROF_SAMPLE_ERROR',       [Word8, Word64],       'Error bound of a sampled heap profile sample'),
+
+    # Stack sampling (--eventlog-stack-sample)
+    EventType(228, 'STACK_SAMPLE',                 VariableLength,        'Stack of a thread sampled while running'),
+
+    # Delta-encoded heap profile samples (--heap-prof-delta)
+    EventType(229, 'HEAP_PROF_SAMPLE_DELTA',       VariableLength,        'Heap profile bands that changed since the last census'),
+
+    # Hardware performance counters (--perf-counters)
+    EventType(230, 'PERF_COUNTERS',                [Word8, Word32] + 4*[Word64], 'Hardware performance counts of a phase on an OS thread'),
+
+    # Heap shape, for utils/gc-replay
+    EventType(231, 'GC_GEN_SHAPE',                 [CapsetId, Word16] + 3*[Word64], 'Live data and mutable list of a generation after GC'),
+    EventType(232, 'HEAP_PROF_SIZE_HISTOGRAM',     VariableLength,        'Closures counted by a heap census by size'),
+
+    # Adaptive GC thread count (-qnauto)
+    EventType(233, 'GC_PAR_THREADS',               [CapNo, Word16, Word16, Word64], 'GC threads chosen for a parallel collection'),
 ]
 
 def check_events() -> Dict[int, EventType]:
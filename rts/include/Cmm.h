@@ -880,6 +880,11 @@
   W_ dst_elems_p, dst_p, src_p, bytes;                            \
                                                                   \
     if ((n) != 0) {                                               \
+        IF_NONMOVING_WRITE_BARRIER_ENABLED {                      \
+            call stg_copyArray_barrier(SIZEOF_StgMutArrPtrs,      \
+                                       dst, dst_off, n);          \
+        }                                                         \
+                                                                  \
         SET_HDR(dst, stg_MUT_ARR_PTRS_DIRTY_info, CCCS);          \
                                                                   \
         dst_elems_p = (dst) + SIZEOF_StgMutArrPtrs;               \
@@ -889,7 +894,7 @@
                                                                   \
         prim %memcpy(dst_p, src_p, bytes, SIZEOF_W);              \
                                                                   \
-        setCards(dst, dst_off, n);                                \
+        setCardsIfOld(dst, dst_off, n);                           \
     }                                                             \
                                                                   \
     return ();
@@ -898,6 +903,11 @@
   W_ dst_elems_p, dst_p, src_p, bytes;                            \
                                                                   \
     if ((n) != 0) {                                               \
+        IF_NONMOVING_WRITE_BARRIER_ENABLED {                      \
+            call stg_copyArray_barrier(SIZEOF_StgMutArrPtrs,      \
+                                       dst, dst_off, n);          \
+        }                                                         \
+                                                                  \
         SET_HDR(dst, stg_MUT_ARR_PTRS_DIRTY_info, CCCS);          \
                                                                   \
         dst_elems_p = (dst) + SIZEOF_StgMutArrPtrs;               \
@@ -911,7 +921,7 @@
             prim %memcpy(dst_p, src_p, bytes, SIZEOF_W);          \
         }                                                         \
                                                                   \
-        setCards(dst, dst_off, n);                                \
+        setCardsIfOld(dst, dst_off, n);                           \
     }                                                             \
                                                                   \
     return ();
@@ -923,6 +933,16 @@
 #define setCards(arr, dst_off, n)                                \
   setCardsValue(arr, dst_off, n, 1)
 
+/*
+ * Like setCards, but only if arr is outside generation 0. The cards are
+ * only read for an array on a mutable list, and one in generation 0 is
+ * scavenged in full (and its cards rewritten) at every GC.
+ */
+#define setCardsIfOld(arr, dst_off, n)                           \
+    if (TO_W_(bdescr_gen_no(Bdescr(arr))) != 0) {                \
+        setCards(arr, dst_off, n);                               \
+    }
+
 /*
  * Set the cards in the array pointed to by arr for an
  * update to n elements, starting at element dst_off to value (0 to indicate
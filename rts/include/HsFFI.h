@@ -138,6 +138,7 @@ extern int hs_spt_keys(StgPtr keys[], int szKeys);
 extern int hs_spt_key_count (void);
 
 extern void hs_try_putmvar (int capability, HsStablePtr sp);
+extern void hs_try_putmvar_batch (int n, const int *capabilities, HsStablePtr *sps);
 
 /* -------------------------------------------------------------------------- */
 
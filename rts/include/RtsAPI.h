@@ -184,6 +184,28 @@ typedef struct GCDetails_ {
   Time nonmoving_gc_elapsed_ns;
 } GCDetails;
 
+//
+// A histogram of durations in nanoseconds, with fixed-size log-linear
+// buckets: each power of two is split into 2^RTS_HIST_SUB_BITS buckets, so a
+// value is known to within about 6%. Durations of 2^RTS_HIST_MAX_BITS ns
+// (about 18 minutes) and more share the last bucket. See Note [Pause
+// histograms] in Stats.c.
+//
+#define RTS_HIST_SUB_BITS 4
+#define RTS_HIST_MAX_BITS 40
+#define RTS_HIST_BUCKETS \
+  ((RTS_HIST_MAX_BITS - RTS_HIST_SUB_BITS + 1) << RTS_HIST_SUB_BITS)
+
+typedef struct _RTSHistogram {
+    // Number of durations recorded
+  uint64_t count;
+  uint64_t buckets[RTS_HIST_BUCKETS];
+} RTSHistogram;
+
+// The duration below which the given fraction (e.g. 0.99) of those in the
+// histogram fall, rounded up to the end of its bucket, or 0 if it's empty
+Time getRTSHistogramPercentile (const RTSHistogram *hist, double fraction);
+
 //
 // Stats about the RTS currently, and since the start of execution
 //
@@ -276,11 +298,152 @@ typedef struct _RTSStats {
   Time nonmoving_gc_elapsed_ns;
     // The maximum time elapsed during any nonmoving GC cycle.
   Time nonmoving_gc_max_elapsed_ns;
+
+  // ----------------------------------
+  // NUMA (only meaningful with --numa)
+
+    // Total number of blocks allocated in memory belonging to each logical
+    // NUMA node. Indexed by logical node, up to MAX_NUMA_NODES.
+  uint64_t numa_allocated_blocks[16];
+    // Total number of blocks allocated on behalf of each logical NUMA node
+    // that had to be taken from another node's free memory.
+  uint64_t numa_stolen_blocks[16];
+
+  // ----------------------------------
+  // Processors
+
+    // The CPU quota of the process's cgroup, in CPUs rounded up, or 0 if
+    // there is none
+  uint32_t cpu_quota;
+    // The number of processors the program may run on, capped by cpu_quota.
+    // This is what -N without a number uses.
+  uint32_t usable_processors;
+
+  // ----------------------------------
+  // Finalizers
+
+    // C finalizers of dead weak pointers that have not run yet
+  uint64_t c_finalizers_pending;
+    // C finalizers of dead weak pointers that have run
+  uint64_t c_finalizers_run;
+    // Haskell finalizers handed to finalizer threads, and those threads
+  uint64_t hs_finalizers_scheduled;
+  uint64_t finalizer_threads;
+
+  // ----------------------------------
+  // Soft heap limit (--soft-heap-limit)
+
+    // The limit, or 0 if there is none
+  uint64_t soft_heap_limit_bytes;
+    // 1 if the last major GC made the generations smaller for the limit
+  uint32_t soft_limit_pacing;
+    // The least factor, in thousandths, by which the old generation may
+    // now grow before the next major GC, however close to the limit
+  uint32_t soft_limit_min_factor_permille;
+    // The fraction of CPU time, in thousandths, spent in GC between the
+    // last two major GCs
+  uint32_t soft_limit_gc_cpu_permille;
+
+  // ----------------------------------
+  // Worker threads of the MIO manager of the non-threaded RTS on Windows
+  // (all 0 elsewhere)
+
+    // Blocking I/O requests waiting for a worker to take them
+  uint32_t io_queue_depth;
+    // The worker threads, and how many of them are idle
+  uint32_t io_workers;
+  uint32_t io_workers_idle;
+
+  // ----------------------------------
+  // Distributions of pause times, kept with +RTS -T (or -s)
+
+    // Elapsed time of each minor and each major GC
+  RTSHistogram minor_pause_hist;
+  RTSHistogram major_pause_hist;
+    // Time spent synchronising the capabilities before each GC
+  RTSHistogram sync_hist;
+    // Elapsed time of each post-mark pause of the concurrent nonmoving GC
+  RTSHistogram nonmoving_sync_hist;
 } RTSStats;
 
 void getRTSStats (RTSStats *s);
 int getRTSStatsEnabled (void);
 
+// Statistics about one capability, from getRTSCapStats. The times are only
+// kept with +RTS -T; see Note [Per-capability and per-generation stats] in
+// Stats.c
+typedef struct _RTSCapStats {
+  // Total bytes allocated by Haskell code on this capability
+  uint64_t allocated_bytes;
+  // CPU time spent running Haskell code on this capability
+  Time mutator_cpu_ns;
+  // Number of times a Haskell thread has returned to the scheduler
+  uint64_t context_switches;
+  // Number of GCs this capability's GC thread took part in, and its CPU time
+  // in them
+  uint32_t gcs;
+  Time gc_cpu_ns;
+  // Spark statistics, as in +RTS -s; all 0 in the non-threaded RTS
+  uint64_t sparks_created;
+  uint64_t sparks_dud;
+  uint64_t sparks_overflowed;
+  uint64_t sparks_converted;
+  uint64_t sparks_gcd;
+  uint64_t sparks_fizzled;
+} RTSCapStats;
+
+// Statistics about one generation, from getRTSGenStats
+typedef struct _RTSGenStats {
+  // Number of GCs in which this was the oldest generation collected, and
+  // how many of those were parallel
+  uint32_t collections;
+  uint32_t par_collections;
+  // Live data in the generation now
+  uint64_t live_bytes;
+  // Total bytes copied into this generation by all GCs
+  uint64_t copied_bytes;
+  // Time spent in those GCs
+  Time cpu_ns;
+  Time elapsed_ns;
+  Time max_pause_ns;
+} RTSGenStats;
+
+// Fill in the statistics of the first n capabilities (generations), and
+// return the number of capabilities (generations), which may be more than n.
+// These don't stop the world, so may be called often.
+uint32_t getRTSCapStats (RTSCapStats caps[], uint32_t n);
+uint32_t getRTSGenStats (RTSGenStats gens[], uint32_t n);
+
+// The memory held by each subsystem of the RTS now, from getRTSMemoryUsage.
+// See Note [RTS memory by subsystem] in Stats.c
+typedef struct _RTSMemoryUsage {
+  // Megablocks the block allocator has from the OS, and the part of them
+  // on its free lists
+  uint64_t block_allocator_bytes;
+  uint64_t block_free_bytes;
+  // Segments of the nonmoving heap, and the part of them on its free list
+  uint64_t nonmoving_segment_bytes;
+  uint64_t nonmoving_free_segment_bytes;
+  // Blocks of the nonmoving collector's mark queues and update remembered
+  // sets
+  uint64_t mark_queue_bytes;
+  // Event buffers of the capabilities and tasks
+  uint64_t eventlog_buffer_bytes;
+  // Memory the linker has mapped: object images, sections, m32 pages
+  uint64_t linker_bytes;
+  // The stable pointer and stable name tables
+  uint64_t stable_ptr_table_bytes;
+  uint64_t stable_name_table_bytes;
+  // The index of info table provenance entries
+  uint64_t ipe_bytes;
+  // All the hash tables of the RTS
+  uint64_t hash_table_bytes;
+} RTSMemoryUsage;
+
+// Fill in the memory held by each subsystem. Like getRTSCapStats, this
+// doesn't stop the world, and is cheap enough to call often.
+void getRTSMemoryUsage (RTSMemoryUsage *usage);
+
 // Returns the total number of bytes allocated since the start of the program.
 // TODO: can we remove this?
 uint64_t getAllocations (void);
@@ -441,6 +604,15 @@ void rts_setInCallCapability (int preferred_capability, int affinity);
 // of numa nodes.
 void rts_pinThreadToNumaNode (int node);
 
+// Pin the worker OS threads of Capability cap to the given CPUs, or with
+// n_cpus == 0 return them to the default placement. The workers move the next
+// time they enter the scheduler. Has no effect in the non-threaded RTS.
+void rts_setCapabilityAffinity (uint32_t cap, const uint32_t *cpus,
+                                uint32_t n_cpus);
+
+// Stop (or let) other Capabilities give Capability cap threads or sparks.
+void rts_setCapabilityIsolated (uint32_t cap, HsBool isolated);
+
 /* ----------------------------------------------------------------------------
    Building Haskell objects from C datatypes.
    ------------------------------------------------------------------------- */
@@ -465,6 +637,27 @@ HaskellObj   rts_mkString     ( Capability *, char    *s );
 
 HaskellObj   rts_apply        ( Capability *, HaskellObj, HaskellObj );
 
+/* ----------------------------------------------------------------------------
+   Lending memory to Haskell
+
+   rts_loanByteArray() makes a ByteArray# of the n_bytes at bytes, which the
+   caller owns, without copying them. bytes must be word-aligned, and the
+   rts_loanHeaderSize() bytes just before it must be writable and left to
+   the RTS (the bytes themselves may be read-only). Haskell code must not
+   write to the array. Once the ByteArray# is found unreachable by a major
+   GC, or when the RTS shuts down, release(bytes, env) is called, after
+   which the memory is the caller's again. release runs during GC, so it
+   mustn't call into Haskell or the RTS API.
+
+   Like any other HaskellObj, the result must be used (passed to Haskell,
+   or put in a StablePtr) before the next call that may GC.
+   ------------------------------------------------------------------------- */
+typedef void (*LoanReleaseFn)(void *bytes, void *env);
+
+HsWord       rts_loanHeaderSize ( void );
+HaskellObj   rts_loanByteArray  ( Capability *, void *bytes, HsWord n_bytes,
+                                  LoanReleaseFn release, void *env );
+
 /* ----------------------------------------------------------------------------
    Deconstructing Haskell objects
    ------------------------------------------------------------------------- */
@@ -514,6 +707,14 @@ void rts_evalIO (/* inout */ Capability **,
                  /* in    */ HaskellObj p,
                  /* out */   HaskellObj *ret);
 
+// Like rts_evalIO() on (p args[0] ... args[n_args-1]), but without
+// building the application on the heap.
+void rts_evalIOArgs (/* inout */ Capability **,
+                     /* in    */ HaskellObj p,
+                     /* in    */ uint32_t n_args,
+                     /* in    */ HaskellObj *args,
+                     /* out */   HaskellObj *ret);
+
 void rts_evalStableIOMain (/* inout */ Capability **,
                            /* in    */ HsStablePtr s,
                            /* out */   HsStablePtr *ret);
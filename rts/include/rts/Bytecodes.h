@@ -114,6 +114,15 @@
 
 #define bci_BCO_NAME                    88
 
+/* Superinstructions, each doing the work of a common sequence of the
+   instructions above; see Note [Bytecode superinstructions] in
+   rts/Interpreter.c */
+#define bci_PUSH_L_ENTER                89
+#define bci_SLIDE_ENTER                 90
+#define bci_PUSH_L_SLIDE_ENTER          91
+
+#define bci_HEAPCHECK                   92
+
 /* If you need to go past 255 then you will run into the flags */
 
 /* If you need to go below 0x0100 then you will run into the instructions */
@@ -56,6 +56,15 @@
 #define MAX_SPEC_FUN_SIZE      2
 #define MAX_SPEC_CONSTR_SIZE   2
 
+/* The table of thunk info tables to blackhole eagerly, consulted by code
+ * compiled with -fadaptive-eager-blackholing: see Note [Adaptive eager
+ * blackholing] in rts/BlackHoles.c. The code generator computes the same
+ * index as EAGER_BLACKHOLE_SITE.
+ */
+#define EAGER_BLACKHOLE_SITES  4096
+#define EAGER_BLACKHOLE_SITE(info) \
+    (((StgWord)(info) >> 3) & (EAGER_BLACKHOLE_SITES - 1))
+
 /* Range of built-in table of static small int-like and char-like closures.
  *
  *   NB. This corresponds with the number of actual INTLIKE/CHARLIKE
@@ -328,6 +337,18 @@
  */
 #define TSO_ALLOC_LIMIT 256
 
+/*
+ * The highest value of tso->priority; see Note [Thread priorities] in
+ * Schedule.c.
+ */
+#define TSO_MAX_PRIORITY 3
+
+/*
+ * A tso->slice of TSO_SLICE_UNBOUNDED lets the thread run until it blocks
+ * or yields; see Note [Time slices] in Schedule.c.
+ */
+#define TSO_SLICE_UNBOUNDED 0xffff
+
 /*
  * The number of times we spin in a spin lock before yielding (see
  * #3758).  To tune this value, use the benchmark in #3758: run the
@@ -340,8 +361,8 @@
 /* -----------------------------------------------------------------------------
    Spare workers per Capability in the threaded RTS
 
-   No more than MAX_SPARE_WORKERS will be kept in the thread pool
-   associated with each Capability.
+   By default no more than MAX_SPARE_WORKERS will be kept in the thread pool
+   associated with each Capability; see --max-spare-workers.
    -------------------------------------------------------------------------- */
 
 #define MAX_SPARE_WORKERS 6
@@ -44,6 +44,19 @@
 #define EVENT_DATA_BEGIN      0x64617462 /* 'd' 'a' 't' 'b' */
 #define EVENT_DATA_END        0xffff
 
+/*
+ * The format version, written as a Word32 after EVENT_HEADER_VERSION, right
+ * after the header begin marker. An eventlog without EVENT_HEADER_VERSION
+ * has version 0: every event has a Word16 type and a Word64 timestamp.
+ * Version 1 is the compact format (+RTS --eventlog-compact), in which
+ * events have varint types, delta timestamps and lengths, see the
+ * "Eventlog encodings" section of the User's Guide.
+ */
+#define EVENT_HEADER_VERSION  0x68647276 /* 'h' 'd' 'r' 'v' */
+
+#define EVENTLOG_FORMAT_VERSION_DEFAULT 0
+#define EVENTLOG_FORMAT_VERSION_COMPACT 1
+
 /*
  * Markers for begin/end of the list of Event Types in the Header.
  * Header, Event Type, Begin = hetb
@@ -66,7 +79,7 @@
  * The highest event code +1 that ghc itself emits. Note that some event
  * ranges higher than this are reserved but not currently emitted by ghc.
  */
-#define NUM_GHC_EVENT_TAGS        213
+#define NUM_GHC_EVENT_TAGS        233
 
 #if 0  /* DEPRECATED EVENTS: */
 /* we don't actually need to record the thread, it's implicit */
@@ -114,6 +127,12 @@
 #define CAPSET_TYPE_OSPROCESS   2  /* caps belong to the same OS process */
 #define CAPSET_TYPE_CLOCKDOMAIN 3  /* caps share a local clock/time      */
 
+/*
+ * Event classes for EVENT_SAMPLED_EVENTS and setEventLogSampleRate()
+ */
+#define SAMPLED_EVENTS_SCHED    0  /* RUN_THREAD and STOP_THREAD         */
+#define SAMPLED_EVENTS_SPARKS   1  /* SPARK_* (-lf)                      */
+
 /*
  * Heap profile breakdown types. See EVENT_HEAP_PROF_BEGIN.
  */
@@ -78,3 +78,30 @@ void endEventLogging(void);
  * Flush the eventlog. cap can be NULL if one is not held.
  */
 void flushEventLog(Capability **cap);
+
+/*
+ * Classes of events the runtime can sample, see setEventLogSampleRate. The
+ * values are those of the class field of the SAMPLED_EVENTS event.
+ */
+enum EventLogSampleClass {
+  /* RUN_THREAD and STOP_THREAD events (-ls) */
+  EVENTLOG_SAMPLE_SCHED = 0,
+  /* spark events (-lf) */
+  EVENTLOG_SAMPLE_SPARKS = 1,
+};
+
+/*
+ * Post only one in n of the events of the given class, or all of them if n
+ * is 0 or 1. This sets --eventlog-sample-sched or --eventlog-sample-sparks,
+ * and can be called at any time.
+ */
+void setEventLogSampleRate(enum EventLogSampleClass cls, uint32_t n);
+
+/*
+ * Change the trace classes, as if the program had been started with
+ * +RTS -l<flags> (so "-as" means only scheduler events, for instance).
+ * Flushes the eventlog and posts a TRACE_CLASSES event. Returns false,
+ * changing nothing, if the flags aren't valid. Must not be called while
+ * holding a capability (from Haskell, use a safe foreign call).
+ */
+bool rts_setTraceFlags(const char *flags);
@@ -37,24 +37,41 @@ typedef struct _GC_FLAGS {
 #define SUMMARY_GC_STATS 3
 #define VERBOSE_GC_STATS 4
 
+    FILE   *statsStreamFile;     /* --stats-stream, or NULL */
+    Time    statsStreamInterval; /* 0: a record after each major GC */
+    int     statsStreamTicks;
+
     uint32_t     maxStkSize;         /* in *words* */
     uint32_t     initialStkSize;     /* in *words* */
     uint32_t     stkChunkSize;       /* in *words* */
     uint32_t     stkChunkBufferSize; /* in *words* */
 
     uint32_t     maxHeapSize;        /* in *blocks* */
+    uint32_t     softHeapLimit;      /* in *blocks*, 0 = off; see Note [Soft
+                                        heap limit] in GC.c */
+    double       softHeapLimitGcCpu; /* the most GC CPU time, as a fraction,
+                                        the soft limit may cost */
     uint32_t     minAllocAreaSize;   /* in *blocks* */
     uint32_t     largeAllocLim;      /* in *blocks* */
     uint32_t     nurseryChunkSize;   /* in *blocks* */
+    uint32_t     blockCacheSize;     /* in *blocks* */
     uint32_t     minOldGenSize;      /* in *blocks* */
     uint32_t     heapSizeSuggestion; /* in *blocks* */
     bool heapSizeSuggestionAuto;
     double  oldGenFactor;
+    bool    oldGenFactorAuto;   /* -Fauto: adapt oldGenFactor at runtime */
+    double  gcCpuTarget;        /* -Fauto: target fraction of CPU time in GC */
     double  returnDecayFactor;
     double  pcFreeHeap;
 
     bool         useNonmoving; // default = false
     uint16_t     nonmovingDenseAllocatorCount; // Amount of dense nonmoving allocators. See Note [Allocator sizes]
+    uint32_t     nonmovingMarkThreads;  // Threads marking the nonmoving heap, including the mark thread
+    uint32_t     nonmovingSweepThreads; // Threads sweeping the nonmoving heap, including the mark thread
+    uint32_t     nonmovingPrefetchDepth; // See Note [Mark prefetch depth]
+    bool         nonmovingPrefetchAuto;
+    bool         nonmovingProfileSizeClasses; // See Note [Profiled size classes]
+    uint32_t     nonmovingEvacuateInterval; // See Note [Nonmoving evacuation]
     uint32_t     generations;
     bool squeezeUpdFrames;
 
@@ -70,8 +87,25 @@ typedef struct _GC_FLAGS {
     bool doIdleGC;
 
     Time    longGCSync;         /* units: TIME_RESOLUTION */
+    Time    minorPauseTarget;   /* units: TIME_RESOLUTION, 0 = off */
 
     StgWord heapBase;           /* address to ask the OS for memory */
+    bool hugePages;             /* back the heap with huge pages (-xH) */
+    bool backgroundDecommit;    /* return memory to the OS from a
+                                 * separate thread */
+    bool scavengePrefetch;      /* prefetch ahead while scavenging */
+    double pretenureThreshold;  /* --pretenure; 0 = off */
+    uint32_t selectorDepth;     /* --selector-depth */
+    StgWord selectorBudget;     /* --selector-budget; 0 = unlimited */
+    StgWord segregateAllocWords; /* --segregate-alloc, in words; 0 = off */
+    StgWord pinnedEphemeralWords; /* --pinned-ephemeral, in words; 0 = off */
+    bool pinnedLiveness;        /* --pinned-liveness */
+    bool sortMutLists;          /* --sort-mut-lists */
+    bool sortStaticObjects;     /* --sort-static-objects */
+    bool hierarchicalCopying;   /* --hierarchical-copying */
+    Time idleGCWorkBudget;      /* --idle-gc-work-budget; units:
+                                 * TIME_RESOLUTION, 0 = off */
+    uint32_t finalizerBatch;    /* --finalizer-batch; 0 = off */
 
     StgWord allocLimitGrace;    /* units: *blocks*
                                  * After an AllocationLimitExceeded
@@ -118,6 +152,7 @@ typedef struct _DEBUG_FLAGS {
     bool compact;        /* 'C' */
     bool continuation;   /* 'k' */
     bool iomanager;      /* 'o' */
+    uint32_t sanitySampleRate; /* --sanity-sample: check 1 in this many blocks */
 } DEBUG_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -154,11 +189,17 @@ typedef struct _PROFILING_FLAGS {
     bool        startHeapProfileAtStartup; /* true if we start profiling from program startup */
     bool        startTimeProfileAtStartup; /* true if we start profiling from program startup */
     bool        incrementUserEra;
+    uint32_t    censusSampleRate; /* visit 1 in this many blocks in a census */
+    bool        censusDuringGc;   /* count the census while the GC scavenges */
+    bool        censusFork;       /* take each census in a forked child */
+    bool        censusDelta;      /* post only the bands that changed */
+    StgWord64   censusDeltaThreshold; /* by more than this many bytes */
 
 
     bool        showCCSOnException;
 
     uint32_t    maxRetainerSetSize;
+    Time        retainerProfileBudget; /* -hr work per census (0: unbounded) */
 
     uint32_t    ccsLength;
 
@@ -192,12 +233,26 @@ typedef struct _TRACE_FLAGS {
     int eventlogFlushTicks;
     char *trace_output;  /* output filename for eventlog */
     bool nullWriter; /* use null writer instead of file writer */
+    bool writerThread; /* write the eventlog from a thread of its own */
+    uint32_t schedSampleRate;  /* post 1 in n thread run/stop events */
+    uint32_t sparksSampleRate; /* post 1 in n spark events */
+    char *eventlogSocket; /* serve the eventlog on this Unix socket */
+    bool compact;         /* write the compact eventlog format */
+    uint32_t allocSampleBlocks; /* sample allocation every n nursery blocks */
+    Time stackSampleTime; /* time between stack samples (or 0 if disabled) */
+    int stackSampleTicks; /* derived */
+    char *toggleClasses;  /* trace classes to switch to on SIGUSR2 */
 } TRACE_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _CONCURRENT_FLAGS {
     Time ctxtSwitchTime;         /* units: TIME_RESOLUTION */
     int ctxtSwitchTicks;         /* derived */
+    bool adaptiveTimeSlices;     /* lengthen the slices of threads that
+                                    allocate little */
+    bool perCapabilityTimers;    /* time each capability's slices on its
+                                    own, see Note [Per-capability preemption
+                                    timers] */
 } CONCURRENT_FLAGS;
 
 /*
@@ -249,11 +304,15 @@ typedef enum _IO_MANAGER_FLAG {
     IO_MNGR_FLAG_MIO,             /* cross-platform,   threaded RTS only */
     IO_MNGR_FLAG_WINIO,           /* Windows only                        */
     IO_MNGR_FLAG_WIN32_LEGACY,    /* Windows only, non-threaded RTS only */
+    IO_MNGR_FLAG_URING,           /* Linux only,   non-threaded RTS only */
+    IO_MNGR_FLAG_EPOLL,           /* epoll or kqueue, non-threaded RTS only */
   } IO_MANAGER_FLAG;
 
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _MISC_FLAGS {
     Time    tickInterval;        /* units: TIME_RESOLUTION */
+    bool    tickless;            /* stop ticking as soon as the RTS is idle,
+                                    see Note [Tickless idling] */
     bool install_signal_handlers;
     bool install_seh_handlers;
     bool generate_dump_file;
@@ -266,11 +325,20 @@ typedef struct _MISC_FLAGS {
                                           tasks in the future, we'd respect it
                                           there as well. */
     bool internalCounters;       /* See Note [Internal Counters Stats] */
+    bool perfCounters;           /* --perf-counters */
+    bool startupTimes;           /* --startup-times */
+    bool tscClock;               /* --tsc-clock, see Note [The TSC clock] */
+    bool eagerIpeIndex;          /* --eager-ipe-index */
     bool linkerAlwaysPic;        /* Assume the object code is always PIC */
     bool linkerOptimistic;       /* Should the runtime linker optimistically continue */
     StgWord linkerMemBase;       /* address to ask the OS for memory
                                   * for the linker, NULL ==> off */
+    char *linkerCache;           /* directory to cache relocated objects in,
+                                  * NULL ==> off */
+    StgWord linkerCodeArena;     /* size of the arena to load code into,
+                                  * 0 ==> off */
     IO_MANAGER_FLAG ioManager;   /* The I/O manager to use.  */
+    bool ioManagerEdgeTriggered; /* mio: keep fds registered edge-triggered */
     uint32_t numIoWorkerThreads; /* Number of I/O worker threads to use.  */
 } MISC_FLAGS;
 
@@ -278,7 +346,16 @@ typedef struct _MISC_FLAGS {
 typedef struct _PAR_FLAGS {
   uint32_t       nCapabilities;  /* number of threads to run simultaneously */
   bool           migrate;        /* migrate threads between capabilities */
+  bool           stealThreads;   /* idle capabilities ask busy ones for threads */
+  uint32_t       parkSpin;       /* spin this long before sleeping for a
+                                    capability (busy_wait_nop()s) */
+  uint32_t       minSpareWorkers; /* keep at least this many idle workers
+                                     per capability */
+  uint32_t       maxSpareWorkers; /* and at most this many */
+  bool           autoScale;      /* -Nauto-scale */
   uint32_t       maxLocalSparks;
+  uint32_t       maxSparkPoolSize; /* spark pools grow up to this many sparks
+                                      (0: no more than maxLocalSparks) */
   bool           parGcEnabled;   /* enable parallel GC */
   uint32_t       parGcGen;       /* do parallel GC in this generation
                                   * and higher only */
@@ -300,6 +377,17 @@ typedef struct _PAR_FLAGS {
                                  /* Use this many threads for parallel
                                   * GC (default: use all nNodes). */
 
+  bool           parGcThreadsAuto;
+                                 /* -qnauto: choose the number of GC threads
+                                  * for each GC, up to parGcThreads; see
+                                  * Note [Adaptive GC thread count] */
+  StgWord        parGcThreadsAutoWork;
+                                 /* -qnauto=<size>: bytes of estimated GC
+                                  * work for each GC thread */
+
+  bool           parCompact;     /* use the GC threads for the compacting
+                                  * collector too (-qc) */
+
   bool           setAffinity;    /* force thread affinity with CPUs */
 } PAR_FLAGS;
 
@@ -317,12 +405,23 @@ typedef enum _HPC_READ_FILE {
     HPC_YES_EXPLICIT = 2  /* The user has specified --read-tix-file=yes */
   } HPC_READ_FILE;
 
+/* The format of the .tix file we write (--tix-format); see
+ * Note [Binary tix files] in Hpc.c */
+typedef enum _HPC_TIX_FORMAT {
+    HPC_TIX_TEXT = 0,     /* The text format that the hpc tool reads */
+    HPC_TIX_BINARY = 1,   /* Binary, with the count of each tick box */
+    HPC_TIX_BITS = 2      /* Binary, with one bit for each tick box */
+  } HPC_TIX_FORMAT;
+
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _HPC_FLAGS {
   bool           writeTixFile;   /* Whether the RTS should write a tix
                                     file at the end of execution */
   HPC_READ_FILE  readTixFile;    /* Whether the RTS should read a tix
                                     file at the beginning of execution */
+  HPC_TIX_FORMAT tixFormat;      /* The format of the tix file we write */
+  Time           tixInterval;    /* --tix-interval: how often to write the
+                                    tix file while running, or 0 */
 } HPC_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -30,5 +30,9 @@ void hs_hpc_module (char *modName,
 
 HpcModuleInfo * hs_hpc_rootModule (void);
 
+// Write the .tix file now, as far as the counts have changed since the last
+// time; see Note [Dumping tix files] in Hpc.c
+void hs_hpc_dump (void);
+
 void startupHpc(void);
 void exitHpc(void);
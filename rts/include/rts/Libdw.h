@@ -93,5 +93,10 @@ Backtrace *libdwGetBacktrace(LibdwSession *session);
  * Returns 0 if successful, 1 if address could not be found. */
 int libdwLookupLocation(LibdwSession *session, Location *loc, StgPtr pc);
 
+/* Lookup Location information for n addresses at once, setting rets[i] as
+ * libdwLookupLocation would return it for pcs[i]. */
+void libdwLookupLocations(LibdwSession *session, Location *locs, int *rets,
+                          StgPtr *pcs, StgWord n);
+
 /* Pretty-print a backtrace to the given FILE */
 void libdwPrintBacktrace(LibdwSession *session, FILE *file, Backtrace *bt);
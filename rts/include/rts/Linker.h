@@ -55,6 +55,8 @@ typedef enum {
     OBJECT_READY,
     OBJECT_UNLOADED,
     OBJECT_DONT_RESOLVE,
+    OBJECT_LAZY,          /* An archive member we only know by the archive's
+                             symbol index, not yet read */
     OBJECT_NOT_LOADED     /* The object was either never loaded or has been
                              fully unloaded */
 } OStatus;
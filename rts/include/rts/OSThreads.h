@@ -226,6 +226,7 @@ void  freeThreadLocalKey (ThreadLocalKey *key);
 
 // Processors and affinity
 void setThreadAffinity (uint32_t n, uint32_t m);
+void setThreadAffinityToCPUs (const uint32_t *cpus, uint32_t n_cpus);
 void setThreadNode (uint32_t node);
 void releaseThreadNode (void);
 #endif // !CMINUSMINUS
@@ -263,6 +264,17 @@ void freeThreadingResources(void);
 //
 uint32_t getNumberOfProcessors (void);
 
+//
+// Returns the CPU quota of the process's cgroup, in CPUs rounded up, or 0
+// if there is none
+//
+uint32_t getCPUQuota (void);
+
+//
+// Returns the number of processors we may run on, capped by the CPU quota
+//
+uint32_t getNumberOfUsableProcessors (void);
+
 //
 // Support for getting at the kernel thread Id for tracing/profiling.
 //
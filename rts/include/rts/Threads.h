@@ -52,6 +52,8 @@ int         cmp_thread                       (StgPtr tso1, StgPtr tso2);
 StgThreadID rts_getThreadId                  (StgPtr tso);
 void        rts_enableThreadAllocationLimit  (StgPtr tso);
 void        rts_disableThreadAllocationLimit (StgPtr tso);
+StgWord     rts_getThreadPriority            (StgPtr tso);
+void        rts_setThreadTimeSlice           (StgPtr tso, HsInt slice);
 
 // Forward declarations, defined in Closures.h
 struct _StgMutArrPtrs;
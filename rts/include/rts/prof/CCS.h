@@ -71,6 +71,10 @@ typedef struct CostCentreStack_ {
 
     StgWord    inherited_ticks; // sum of time_ticks over all children
                                 // (calculated at the end)
+
+    struct IndexTable_ *lastPush;  // the entry of indexTable that the most
+                                   // recent push onto this CCS found
+    struct IndexHash_  *indexHash; // indexTable by CC, once it is long
 } CostCentreStack;
 
 
@@ -106,7 +110,8 @@ void startProfTimer     ( void );
 // IndexTable is the list of children of a CCS. (Alternatively it is a
 // cache of the results of pushing onto a CCS, so that the second and
 // subsequent times we push a certain CC on a CCS we get the same
-// result).
+// result). A CCS with many children also indexes them by CC in a hash
+// table, see Note [Cost-centre stack push] in Profiling.c.
 
 typedef struct IndexTable_ {
     // Just a linked list of (cc, ccs) pairs, where the `ccs` is the result of
@@ -209,7 +214,9 @@ extern CostCentre * RTS_VAR(CC_LIST);               // registered CC list
             .time_ticks          = 0,                    \
             .mem_alloc           = 0,                    \
             .inherited_ticks     = 0,                    \
-            .inherited_alloc     = 0                     \
+            .inherited_alloc     = 0,                    \
+            .lastPush            = NULL,                 \
+            .indexHash           = NULL                  \
        }};
 
 /* -----------------------------------------------------------------------------
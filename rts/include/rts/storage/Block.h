@@ -162,6 +162,9 @@ typedef struct bdescr_ {
 /* Block is to be marked, not copied. Also used for marked large objects in
  * non-moving heap. */
 #define BF_MARKED    8
+/* Block holds the keys of weak pointers awaiting their evacuation (see
+ * Note [Indexing weak pointers by key block] in MarkWeak.c) */
+#define BF_WEAK_KEYS 16
 /* Block is executable */
 #define BF_EXEC      32
 /* Block contains only a small amount of live data */
@@ -178,6 +181,15 @@ typedef struct bdescr_ {
  * onto nonmoving_large_objects. The mark phase ignores objects which aren't
  * so-flagged */
 #define BF_NONMOVING_SWEEPING 2048
+/* A non-moving segment whose live objects the mark is evacuating (see
+ * Note [Nonmoving evacuation] in NonMovingEvac.c) */
+#define BF_NONMOVING_EVACUATING 4096
+/* The first block of a compact block group whose memory maps a file (see
+ * Note [Mapping compact regions from files] in CNF.c) */
+#define BF_COMPACT_MAPPED 8192
+/* The first block of a compact region that is never collected (see
+ * Note [Immortal compact regions] in CNF.c) */
+#define BF_COMPACT_IMMORTAL 16384
 /* Maximum flag value (do not define anything higher than this!) */
 #define BF_FLAG_MAX  (1 << 15)
 
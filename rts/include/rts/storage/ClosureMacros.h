@@ -615,12 +615,12 @@ zeroSlop (StgClosure *p,
         // immutable one.
         known_mutable ? zero_slop_mutable : zero_slop_immutable;
 
-    if(!zero_slop)
+    if(!zero_slop || offset >= size)
         return;
 
-    for (uint32_t i = offset; i < size; i++) {
-        ((StgWord *)p)[i] = 0;
-    }
+    // The slop of a shrunk array can be large; memset zeroes it a vector at
+    // a time, and with non-temporal stores when it is very large.
+    __builtin_memset((StgWord *)p + offset, 0, (size - offset) * sizeof(StgWord));
 }
 
 // N.B. the stg_* variants of the utilities below are only for calling from
@@ -508,7 +508,10 @@ typedef struct {
   StgHeader                  header;
   StgClosure                *current_value MUT_FIELD; /* accessed via atomics */
   StgTVarWatchQueue         *first_watch_queue_entry MUT_FIELD; /* accessed via atomics */
-  StgInt                     num_updates; /* accessed via atomics */
+  StgInt                     num_updates; /* accessed via atomics; the STM
+                                             clock at the last commit */
+  StgWord                    wake_limit;  /* waiters to wake per commit,
+                                             0 for all; see setTVarWakeLimit# */
 } StgTVar;
 
 /* new_value == expected_value for read-only accesses */
@@ -548,6 +551,12 @@ struct StgTRecHeader_ {
   struct StgTRecHeader_     *enclosing_trec;
   StgTRecChunk              *current_chunk MUT_FIELD;
   TRecState                  state;
+  StgWord                    read_version;      /* STM clock at the start */
+  StgWord                    validated_version; /* ... at the last in-flight
+                                                   validation */
+  StgWord                    has_updates;       /* may have an update entry */
+  StgWord                    index_serial;      /* entries indexed as ... */
+  StgWord                    index_cap;         /* ... by this capability */
 };
 
 /* A stack frame delimiting an STM transaction */
@@ -609,6 +618,8 @@ typedef struct MessageCloneStack_ {
     Message   *link;
     StgMVar   *result;
     StgTSO    *tso;
+    StgWord    snapshot;    // take a StackFrames rather than clone the stack
+    StgWord    max_frames;  // when snapshot, the most return frames to take
 } MessageCloneStack;
 
 
@@ -664,6 +675,10 @@ typedef struct StgCompactNFData_ {
     struct hashtable *hash;
       // the hash table for the current compaction, or NULL if
       // there's no (sharing-preserved) compaction in progress.
+    struct hashtable *dedup;
+      // the index of the structurally distinct closures in the compact, or
+      // NULL if we aren't deduplicating. See Note [Compact deduplication]
+      // in CNF.c
     StgClosure *result;
       // Used temporarily to store the result of compaction.  Doesn't need to be
       // a GC root.
@@ -72,10 +72,12 @@ typedef struct nursery_ {
 //    reflect that)
 //
 //  - the blocks *before* cap->rCurrentNursery have been used.  Except
-//    for rCurrentAlloc.
+//    for rCurrentAlloc and mid_alloc_block.
 //
 //  - cap->r.rCurrentAlloc is either NULL, or it points to a block in
-//    the nursery *before* cap->r.rCurrentNursery.
+//    the nursery *before* cap->r.rCurrentNursery.  So does
+//    cap->mid_alloc_block (see Note [Segregated allocation of mid-size
+//    objects] in Storage.c).
 //
 // See also Note [allocation accounting] to understand how total
 // memory allocation is tracked.
@@ -127,6 +129,18 @@ typedef struct generation_ {
     uint32_t collections;
     uint32_t par_collections;
     uint32_t failed_promotions;         // Currently unused
+    uint64_t copied;                    // words copied into this gen by all GCs
+
+    // survival statistics for the -Fauto sizing policy, see
+    // Note [Adaptive generation sizing] in rts/sm/GC.c
+    memcount last_live_words;           // live words after the last collection
+    uint64_t last_alloc_words;          // total allocation at the last collection
+    double   survival_rate;             // smoothed fraction of words surviving
+    double   promotion_rate;            // smoothed words promoted per word allocated
+
+    // for -qnauto, see Note [Adaptive GC thread count] in rts/sm/GC.c
+    memcount mut_list_words;            // words in the mutable lists after
+                                        // the last GC
 
     // ------------------------------------
     // Fields below are used during GC only
@@ -134,8 +148,8 @@ typedef struct generation_ {
 #if defined(THREADED_RTS)
     char pad[128];                      // make sure the following is
                                         // on a separate cache line.
-    SpinLock     sync;                  // lock for large_objects
-                                        //    and scavenged_large_objects
+    SpinLock     sync;                  // lock for scavenged_large_objects
+                                        //    and the compact lists
 #endif
 
     int          mark;                  // mark (not copy)? (old gen only)
@@ -148,14 +162,21 @@ typedef struct generation_ {
     memcount     n_old_blocks;         // number of blocks in from-space
     memcount     live_estimate;         // for sweeping: estimate of live data
 
-    bdescr *     scavenged_large_objects;  // live large objs after GC (d-link)
+    bdescr *     scavenged_large_objects;  // live large objs after GC (s-link
+                                           // during GC, d-link after)
     memcount     n_scavenged_large_blocks; // size (not count) of above
 
+    bdescr *     old_large_objects;     // last large obj being collected,
+                                        // linked back through u.back; see
+                                        // Note [Large objects during GC]
+
     bdescr *     live_compact_objects;  // live compact objs after GC (d-link)
     memcount     n_live_compact_blocks; // size (not count) of above
 
     bdescr *     bitmap;                // bitmap for compacting collection
 
+    memcount     live_words_before_gc;  // for -Fauto: live words at GC start
+
     StgTSO *     old_threads;
     StgWeak *    old_weak_ptr_list;
 } generation;
@@ -23,5 +23,9 @@ extern void freeMBlocks(void *addr, uint32_t n);
 extern void releaseFreeMemory(void);
 extern void freeAllMBlocks(void);
 
+extern void lockDecommitQueue(void);
+extern void unlockDecommitQueue(void);
+extern void resetDecommitQueue(void);
+
 extern void *getFirstMBlock(void **state);
 extern void *getNextMBlock(void **state, void *mblock);
@@ -58,11 +58,10 @@ typedef union {
   StgAsyncIOResult *async_result;
 #endif
 #if !defined(THREADED_RTS)
-  StgWord target;
-    // Only for the non-threaded RTS: the target time for a thread
-    // blocked in threadDelay, in units of 1ms.  This is a
-    // compromise: we don't want to take up much space in the TSO.  If
-    // you want better resolution for threadDelay, use -threaded.
+  StgWord timer;
+    // Only for the non-threaded RTS: the position of a thread blocked
+    // in threadDelay in the timer heap of its capability, which holds
+    // its target time.
 #endif
 } StgTSOBlockInfo;
 
@@ -183,6 +182,22 @@ typedef struct StgTSO_ {
      */
     StgWord32  tot_stack_size;
 
+    /*
+     * Runnable threads of higher priority are scheduled first, from 0 (the
+     * default) to TSO_MAX_PRIORITY. See Note [Thread priorities] in
+     * Schedule.c.
+     */
+    StgWord32  priority;
+
+    /*
+     * The thread's time slice, in context switch intervals (-C): 0 for the
+     * default, TSO_SLICE_UNBOUNDED to run until it blocks or yields. The
+     * slice learnt with --adaptive-time-slices is kept in adapted_slice.
+     * See Note [Time slices] in Schedule.c.
+     */
+    StgWord16  slice;
+    StgWord16  adapted_slice;
+
 #if defined(TICKY_TICKY)
     /* TICKY-specific stuff would go here. */
 #endif
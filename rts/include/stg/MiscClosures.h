@@ -193,6 +193,7 @@ RTS_ENTRY(stg_TSO);
 RTS_ENTRY(stg_STACK);
 RTS_ENTRY(stg_RUBBISH_ENTRY);
 RTS_ENTRY(stg_ARR_WORDS);
+RTS_ENTRY(stg_LOANED_ARR_WORDS);
 RTS_ENTRY(stg_MUT_ARR_WORDS);
 RTS_ENTRY(stg_MUT_ARR_PTRS_CLEAN);
 RTS_ENTRY(stg_MUT_ARR_PTRS_DIRTY);
@@ -433,6 +434,10 @@ RTS_RET(stg_block_async);
 RTS_FUN_DECL(stg_block_async_void);
 RTS_RET(stg_block_async_void);
 #endif
+#if defined(linux_HOST_OS)
+RTS_FUN_DECL(stg_block_io_result);
+RTS_RET(stg_block_io_result);
+#endif
 RTS_FUN_DECL(stg_block_stmwait);
 RTS_FUN_DECL(stg_block_throwto);
 RTS_RET(stg_block_throwto);
@@ -508,6 +513,8 @@ RTS_FUN_DECL(stg_putMVarzh);
 RTS_FUN_DECL(stg_readMVarzh);
 RTS_FUN_DECL(stg_tryTakeMVarzh);
 RTS_FUN_DECL(stg_tryPutMVarzh);
+RTS_FUN_DECL(stg_bargingTakeMVarzh);
+RTS_FUN_DECL(stg_bargingPutMVarzh);
 RTS_FUN_DECL(stg_tryReadMVarzh);
 
 RTS_FUN_DECL(stg_waitReadzh);
@@ -518,6 +525,11 @@ RTS_FUN_DECL(stg_asyncReadzh);
 RTS_FUN_DECL(stg_asyncWritezh);
 RTS_FUN_DECL(stg_asyncDoProczh);
 #endif
+#if defined(linux_HOST_OS)
+RTS_FUN_DECL(stg_uringReadzh);
+RTS_FUN_DECL(stg_uringWritezh);
+RTS_FUN_DECL(stg_uringAcceptzh);
+#endif
 
 RTS_FUN_DECL(stg_catchzh);
 RTS_FUN_DECL(stg_raisezh);
@@ -542,6 +554,9 @@ RTS_FUN_DECL(stg_compactAddzh);
 RTS_FUN_DECL(stg_compactAddWithSharingzh);
 RTS_FUN_DECL(stg_compactNewzh);
 RTS_FUN_DECL(stg_compactAppendzh);
+RTS_FUN_DECL(stg_compactMergezh);
+RTS_FUN_DECL(stg_compactEnableDedupzh);
+RTS_FUN_DECL(stg_compactMakeImmortalzh);
 RTS_FUN_DECL(stg_compactResizzezh);
 RTS_FUN_DECL(stg_compactGetRootzh);
 RTS_FUN_DECL(stg_compactContainszh);
@@ -549,6 +564,7 @@ RTS_FUN_DECL(stg_compactContainsAnyzh);
 RTS_FUN_DECL(stg_compactGetFirstBlockzh);
 RTS_FUN_DECL(stg_compactGetNextBlockzh);
 RTS_FUN_DECL(stg_compactAllocateBlockzh);
+RTS_FUN_DECL(stg_compactMapBlockzh);
 RTS_FUN_DECL(stg_compactFixupPointerszh);
 RTS_FUN_DECL(stg_compactSizzezh);
 
@@ -588,6 +604,7 @@ RTS_FUN_DECL(stg_newTVarzh);
 RTS_FUN_DECL(stg_readTVarzh);
 RTS_FUN_DECL(stg_readTVarIOzh);
 RTS_FUN_DECL(stg_writeTVarzh);
+RTS_FUN_DECL(stg_setTVarWakeLimitzh);
 
 RTS_FUN_DECL(stg_unpackClosurezh);
 RTS_FUN_DECL(stg_closureSizzezh);
@@ -605,6 +622,7 @@ RTS_FUN_DECL(stg_traceBinaryEventzh);
 RTS_FUN_DECL(stg_traceMarkerzh);
 RTS_FUN_DECL(stg_getThreadAllocationCounterzh);
 RTS_FUN_DECL(stg_setThreadAllocationCounterzh);
+RTS_FUN_DECL(stg_setThreadPriorityzh);
 
 RTS_FUN_DECL(stg_castWord64ToDoublezh);
 RTS_FUN_DECL(stg_castDoubleToWord64zh);
@@ -626,6 +644,9 @@ extern StgWord RTS_VAR(blocked_queue_hd), RTS_VAR(blocked_queue_tl);
 extern StgWord RTS_VAR(sleeping_queue);
 extern StgWord RTS_VAR(sched_mutex);
 
+// BlackHoles.c
+extern StgWord8 eager_blackhole_sites[];
+
 // Apply.cmm
 // canned bitmap for each arg type
 extern const StgWord stg_arg_bitmaps[];
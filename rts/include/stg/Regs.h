@@ -110,6 +110,8 @@ typedef struct {
   struct bdescr_ *     rCurrentAlloc;   /* for allocation using allocate() */
   StgWord         rHpAlloc;     /* number of *bytes* being allocated in heap */
   StgWord         rRet;  /* holds the return code of the thread */
+  StgInt          rTickyCountdown; /* events until code compiled with
+                                      -ticky-sample counts the next */
 } StgRegTable;
 
 #if IN_STG_CODE
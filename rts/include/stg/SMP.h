@@ -356,21 +356,17 @@ EXTERN_INLINE void busy_wait_nop(void);
  * Barriers on Messages
  * --------------------
  * The RTS uses the Message mechanism to convey information between capabilities.
- * To send a message (see Messages.c:sendMessage) the sender must first take
- * the `lock` of the recipient capability. The Message can then be linked
- * onto the recipient's `inbox` list and release the lock (implying a release
- * barrier).
- *
- * To process its inbox (see Schedule.c:scheduleProcessInbox) the recipient must
- * take the capability lock before examining the inbox. This implies an acquire
- * barrier, ensuring that the messages in the inbox are visible.
- *
- * Under the above story there is no need for accesses to `inbox` to be
- * atomic at all as all accesses are under the capability lock. However, there
- * is a slight wrinkle here:
- * Capability.h:emptyInbox wants to test whether `inbox` is empty without
- * holding the capability lock. Consequently, accesses to `inbox` must be
- * atomic, although may use the relaxed ordering.
+ * To send a message (see Messages.c:sendMessage) the sender pushes it onto the
+ * recipient's `inbox`, a lock-free stack, with a CAS. The CAS is a full
+ * barrier, so the fields of the Message are visible before the Message is.
+ *
+ * To process its inbox (see Schedule.c:scheduleProcessInbox) the recipient
+ * takes the whole stack with an atomic exchange, which implies an acquire
+ * barrier, ensuring that the messages it took are visible.
+ *
+ * Capability.h:emptyInbox tests whether `inbox` is empty with a SEQ_CST load,
+ * as it must not miss a message pushed just as the capability goes idle; see
+ * Note [The capability inbox] in Messages.c.
  *
  * Barriers during GC
  * ------------------
@@ -106,6 +106,7 @@
 #endif
 
 #include "elf_got.h"
+#include "elf_cache.h"
 
 #if defined(arm_HOST_ARCH) || defined(aarch64_HOST_ARCH) || defined (riscv64_HOST_ARCH)
 #  define NEED_GOT
@@ -296,6 +297,9 @@ ocInit_ELF(ObjectCode * oc)
                  */
                 symTab->symbols[j].addr  = NULL;
                 symTab->symbols[j].got_addr = NULL;
+                symTab->symbols[j].target = NULL;
+                symTab->symbols[j].target_known = false;
+                symTab->symbols[j].target_changed = false;
             }
 
             /* append the ElfSymbolTable */
@@ -310,6 +314,40 @@ ocInit_ELF(ObjectCode * oc)
     }
 }
 
+void
+initLinker_ELF(void)
+{
+#if defined(SHARED_STUBS)
+    initSharedStubs();
+#endif
+}
+
+void
+exitLinker_ELF(void)
+{
+#if defined(SHARED_STUBS)
+    exitSharedStubs();
+#endif
+}
+
+/* Free the stubs of an object's sections, before the sections themselves. */
+void
+ocFreeStubs_ELF(ObjectCode * oc)
+{
+#if defined(NEED_PLT)
+#if defined(SHARED_STUBS)
+    unshareStubs(oc);
+#endif
+    for(int i = 0; i < oc->n_sections; i++) {
+        if(oc->sections[i].info != NULL) {
+            freeStubs(&oc->sections[i]);
+        }
+    }
+#else
+    (void) oc;
+#endif
+}
+
 void
 ocDeinit_ELF(ObjectCode * oc)
 {
@@ -673,7 +711,7 @@ static SectionKind getSectionKind_ELF( Elf_Shdr *hdr, int *is_bss )
 #if !defined(NEED_PLT)
 
 static void *
-mapObjectFileSection (int fd, Elf_Word offset, Elf_Word size,
+mapObjectFileSection (int fd, StgWord offset, Elf_Word size,
                       void **mapped_start, StgWord *mapped_size,
                       StgWord *mapped_offset)
 {
@@ -902,8 +940,9 @@ ocGetNames_ELF ( ObjectCode* oc )
               memcpy(start, oc->image + offset, size);
               alloc = SECTION_M32;
           } else {
-              start = mapObjectFileSection(fd, offset, size,
-                                           &mapped_start, &mapped_size,
+              // see Note [Mapping archive members] in LoadArchive.c
+              start = mapObjectFileSection(fd, oc->archiveOffset + offset,
+                                           size, &mapped_start, &mapped_size,
                                            &mapped_offset);
               if (start == NULL) goto fail;
               alloc = SECTION_MMAP;
@@ -948,9 +987,10 @@ ocGetNames_ELF ( ObjectCode* oc )
 
       oc->symbols = stgCallocBytes(oc->n_symbols, sizeof(Symbol_t),
                                    "ocGetNames_ELF(oc->symbols)");
-      // Note calloc: if we fail partway through initializing symbols, we need
-      // to undo the additions to the symbol table so far. We know which ones
-      // have been added by whether the entry is NULL or not.
+      // Note calloc: the entries we fill in are the ones that loadOc adds
+      // to the symbol table; we don't touch the symbol table here, so that
+      // objects can be loaded in parallel. See Note [Parallel object
+      // loading] in Linker.c.
 
       unsigned curSymbol = 0;
 
@@ -1085,14 +1125,10 @@ ocGetNames_ELF ( ObjectCode* oc )
                        if (isWeak == HS_BOOL_TRUE) {
                            setWeakSymbol(oc, nm);
                        }
-                       if (!ghciInsertSymbolTable(oc->fileName, symhash,
-                                                  nm, symbol->addr, isWeak, sym_type, oc)
-                           ) {
-                           goto fail;
-                       }
                        oc->symbols[curSymbol].name = nm;
                        oc->symbols[curSymbol].addr = symbol->addr;
                        oc->symbols[curSymbol].type = sym_type;
+                       oc->symbols[curSymbol].hash = hashSymbolName(nm);
                        curSymbol++;
                    }
                } else {
@@ -1138,6 +1174,62 @@ end:
 // elf_reloc_riscv64.{h,c}
 #if !defined(aarch64_HOST_ARCH) && !defined(riscv64_HOST_ARCH)
 
+static ElfSymbolTable *
+findElfSymbolTable ( ObjectCode* oc, int symtab_shndx )
+{
+   for(ElfSymbolTable * st = oc->info->symbolTables;
+       st != NULL; st = st->next) {
+       if((int)st->index == symtab_shndx) {
+           return st;
+       }
+   }
+   return NULL;
+}
+
+/* Look up the non-local symbols that the relocations of section shnum refer
+   to, for do_Elf_Rel_relocations and do_Elf_Rela_relocations to find in
+   ElfSymbol.target. Looking them up may load other objects, so this is done
+   in order, under the linker lock, whereas the relocations themselves may be
+   done in parallel; see Note [Parallel object loading] in Linker.c. A symbol
+   we don't find is reported by the relocation that needs it. */
+static void
+lookupRelocationTargets ( ObjectCode* oc, char* ehdrC,
+                          Elf_Shdr* shdr, int shnum )
+{
+   const bool rela = shdr[shnum].sh_type == SHT_RELA;
+   int symtab_shndx = shdr[shnum].sh_link;
+   int target_shndx = shdr[shnum].sh_info;
+   size_t nent = shdr[shnum].sh_size
+                 / (rela ? sizeof(Elf_Rela) : sizeof(Elf_Rel));
+
+   /* Skip sections that we're not interested in. */
+   if (oc->sections[target_shndx].kind == SECTIONKIND_OTHER) {
+       return;
+   }
+
+   ElfSymbolTable *stab = findElfSymbolTable(oc, symtab_shndx);
+   CHECK(stab != NULL);
+
+   for (size_t j = 0; j < nent; j++) {
+       Elf_Addr info = rela
+           ? ((Elf_Rela*) (ehdrC + shdr[shnum].sh_offset))[j].r_info
+           : ((Elf_Rel*) (ehdrC + shdr[shnum].sh_offset))[j].r_info;
+       if (!info) {
+           continue;
+       }
+       ElfSymbol *symbol = &stab->symbols[ELF_R_SYM(info)];
+       if (symbol->target_known
+           || ELF_ST_BIND(symbol->elf_sym->st_info) == STB_LOCAL
+           || (rela && ELF_R_TYPE(info) == COMPAT_R_X86_64_TLSGD)
+           || (!rela && strncmp(symbol->name, "_GLOBAL_OFFSET_TABLE_", 21) == 0)) {
+           continue;
+       }
+       symbol->target = lookupDependentSymbol(
+           rela && symbol->elf_sym->st_name == 0 ? "" : symbol->name, oc, NULL);
+       symbol->target_known = true;
+   }
+}
+
 /* Do ELF relocations which lack an explicit addend.  All x86-linux
    and arm-linux relocations appear to be of this form. */
 static int
@@ -1153,14 +1245,7 @@ do_Elf_Rel_relocations ( ObjectCode* oc, char* ehdrC,
    int target_shndx = shdr[shnum].sh_info;
    int symtab_shndx = shdr[shnum].sh_link;
 
-   ElfSymbolTable *stab = NULL;
-   for(ElfSymbolTable * st = oc->info->symbolTables;
-       st != NULL; st = st->next) {
-       if((int)st->index == symtab_shndx) {
-           stab = st;
-           break;
-       }
-   }
+   ElfSymbolTable *stab = findElfSymbolTable(oc, symtab_shndx);
    CHECK(stab != NULL);
 
    targ  = (Elf_Word*)oc->sections[target_shndx].start;
@@ -1221,7 +1306,9 @@ do_Elf_Rel_relocations ( ObjectCode* oc, char* ehdrC,
            if (ELF_ST_BIND(symbol->elf_sym->st_info) == STB_LOCAL || strncmp(symbol->name, "_GLOBAL_OFFSET_TABLE_", 21) == 0) {
                S = (Elf_Addr)symbol->addr;
            } else {
-               S_tmp = lookupDependentSymbol( symbol->name, oc, NULL );
+               /* looked up by lookupRelocationTargets */
+               ASSERT(symbol->target_known);
+               S_tmp = symbol->target;
                S = (Elf_Addr)S_tmp;
            }
            if (!S) {
@@ -1567,7 +1654,7 @@ do_Elf_Rel_relocations ( ObjectCode* oc, char* ehdrC,
 /* Do ELF relocations for which explicit addends are supplied. */
 static int
 do_Elf_Rela_relocations ( ObjectCode* oc, char* ehdrC,
-                          Elf_Shdr* shdr, int shnum )
+                          Elf_Shdr* shdr, int shnum, bool only_changed )
 {
    int j;
    SymbolName* symbol = NULL;
@@ -1588,6 +1675,8 @@ do_Elf_Rela_relocations ( ObjectCode* oc, char* ehdrC,
 
    stab  = (Elf_Sym*) (ehdrC + shdr[ symtab_shndx ].sh_offset);
    strtab= (char*)    (ehdrC + shdr[ strtab_shndx ].sh_offset);
+   ElfSymbolTable *symTab = findElfSymbolTable(oc, symtab_shndx);
+   CHECK(symTab != NULL);
 
    IF_DEBUG(linker_verbose,debugBelch( "relocations for section %d using symtab %d\n",
                           target_shndx, symtab_shndx ));
@@ -1615,6 +1704,12 @@ do_Elf_Rela_relocations ( ObjectCode* oc, char* ehdrC,
       Elf_Sword delta;
 #     endif
 
+      /* The cache has done the rest, see Note [ELF relocation cache] */
+      if (only_changed
+          && !(info && symTab->symbols[ELF_R_SYM(info)].target_changed)) {
+         continue;
+      }
+
       IF_DEBUG(linker_verbose,debugBelch( "Rel entry %3d is raw(%6p %6p %6p)   ",
                              j, (void*)offset, (void*)info,
                                 (void*)A ));
@@ -1669,9 +1764,11 @@ do_Elf_Rela_relocations ( ObjectCode* oc, char* ehdrC,
             S = (Elf_Addr)oc->sections[secno].start
                 + stab[ELF_R_SYM(info)].st_value;
          } else {
-            /* If not local, look up the name in our global table. */
+            /* If not local, lookupRelocationTargets has looked up the name
+             * in our global table. */
             symbol = strtab + sym.st_name;
-            S_tmp = lookupDependentSymbol( symbol, oc, NULL );
+            ASSERT(symTab->symbols[ELF_R_SYM(info)].target_known);
+            S_tmp = symTab->symbols[ELF_R_SYM(info)].target;
             S = (Elf_Addr)S_tmp;
          }
          if (!S) {
@@ -1935,8 +2032,10 @@ ocMprotect_Elf( ObjectCode *oc )
     return true;
 }
 
+/* Look up the symbols the object refers to, which may load other objects.
+   See Note [Parallel object loading] in Linker.c. */
 int
-ocResolve_ELF ( ObjectCode* oc )
+ocResolveSymbols_ELF ( ObjectCode* oc )
 {
    char*     ehdrC = (char*)(oc->image);
    Elf_Ehdr* ehdr  = (Elf_Ehdr*) ehdrC;
@@ -1991,6 +2090,33 @@ ocResolve_ELF ( ObjectCode* oc )
 
     if(fillGot( oc ))
         return 0;
+
+#if !defined(aarch64_HOST_ARCH) && !defined(riscv64_HOST_ARCH)
+    for (Elf_Word i = 0; i < shnum; i++) {
+        if (shdr[i].sh_type == SHT_REL || shdr[i].sh_type == SHT_RELA) {
+            lookupRelocationTargets ( oc, ehdrC, shdr, i );
+        }
+    }
+#else
+    /* silence warnings */
+    (void) shnum;
+    (void) shdr;
+#endif
+
+    return 1;
+}
+
+/* Relocate the object, once ocResolveSymbols_ELF has looked up the symbols
+   it refers to. This only touches the object itself, so several objects may
+   be relocated at once. */
+int
+ocRelocate_ELF ( ObjectCode* oc )
+{
+   char*     ehdrC = (char*)(oc->image);
+   Elf_Ehdr* ehdr  = (Elf_Ehdr*) ehdrC;
+   Elf_Shdr* shdr  = (Elf_Shdr*) (ehdrC + ehdr->e_shoff);
+   const Elf_Word shnum = elf_shnum(ehdr);
+
     /* silence warnings */
     (void) shnum;
     (void) shdr;
@@ -1999,7 +2125,16 @@ ocResolve_ELF ( ObjectCode* oc )
     /* use new relocation design */
     if(relocateObjectCode( oc ))
         return 0;
+    /* See Note [Shared stubs] in elf_plt.c */
+    shareStubs( oc );
 #else
+    /* See Note [ELF relocation cache] in elf_cache.c */
+    bool changed = true;
+    bool cached = false;
+#if defined(ELF_RELOC_CACHE)
+    cached = loadElfCache( oc, &changed );
+#endif
+
     /* Process the relocation sections. */
     for (Elf_Word i = 0; i < shnum; i++) {
         if (shdr[i].sh_type == SHT_REL) {
@@ -2009,11 +2144,20 @@ ocResolve_ELF ( ObjectCode* oc )
         }
         else
         if (shdr[i].sh_type == SHT_RELA) {
-          bool ok = do_Elf_Rela_relocations ( oc, ehdrC, shdr, i );
+          bool ok = do_Elf_Rela_relocations ( oc, ehdrC, shdr, i, cached );
           if (!ok)
               return ok;
         }
     }
+
+#if defined(ELF_RELOC_CACHE)
+    if (changed) {
+        storeElfCache( oc );
+    }
+#else
+    (void) cached;
+    (void) changed;
+#endif
 #endif
 
 #if defined(powerpc_HOST_ARCH)
@@ -8,9 +8,13 @@
 
 void ocInit_ELF          ( ObjectCode* oc );
 void ocDeinit_ELF        ( ObjectCode* oc );
+void ocFreeStubs_ELF     ( ObjectCode* oc );
+void initLinker_ELF      ( void );
+void exitLinker_ELF      ( void );
 int ocVerifyImage_ELF    ( ObjectCode* oc );
 int ocGetNames_ELF       ( ObjectCode* oc );
-int ocResolve_ELF        ( ObjectCode* oc );
+int ocResolveSymbols_ELF ( ObjectCode* oc );
+int ocRelocate_ELF       ( ObjectCode* oc );
 int ocRunInit_ELF        ( ObjectCode* oc );
 int ocRunFini_ELF        ( ObjectCode* oc );
 int ocAllocateExtras_ELF ( ObjectCode *oc );
@@ -82,6 +82,11 @@ typedef struct _ElfSymbol {
     SymbolAddr * addr;  /* the final resting place of the symbol */
     void * got_addr;    /* address of the got slot for this symbol, if any */
     Elf_Sym * elf_sym;  /* the elf symbol entry */
+    SymbolAddr * target; /* what relocations against the symbol refer to,
+                          * see Note [Parallel object loading] in Linker.c */
+    bool target_known;   /* whether target has been looked up */
+    bool target_changed; /* whether target differs from the relocation
+                          * cache's, see Note [ELF relocation cache] */
 } ElfSymbol;
 
 typedef struct _ElfSymbolTable {
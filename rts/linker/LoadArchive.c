@@ -5,7 +5,7 @@
 #include "sm/OSMem.h"
 #include "RtsUtils.h"
 #include "LinkerInternals.h"
-#include "CheckUnload.h" // loaded_objects, insertOCSectionIndices
+#include "CheckUnload.h"
 #include "linker/M32Alloc.h"
 #include "linker/MMap.h"
 
@@ -23,6 +23,8 @@
 
 #include <string.h>
 #include <stddef.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <fs_rts.h>
 
@@ -224,13 +226,6 @@ lookupGNUArchiveIndex(int gnuFileIndexSize, char **fileName_,
         fileName[FileNameSize] = '\0';
         *thisFileNameSize = FileNameSize;
     }
-    /* Skip 32-bit symbol table ("/" + 15 blank characters)
-       and  64-bit symbol table ("/SYM64/" + 9 blank characters) */
-    else if (0 == strncmp(fileName + 1, "               ", 15) ||
-             0 == strncmp(fileName + 1, "SYM64/         ", 15)) {
-        fileName[0] = '\0';
-        *thisFileNameSize = 0;
-    }
     else {
         errorBelch("loadArchive: invalid GNU-variant filename `%.16s' "
                    "while reading filename from `%" PATH_FMT "'",
@@ -241,6 +236,237 @@ lookupGNUArchiveIndex(int gnuFileIndexSize, char **fileName_,
     return true;
 }
 
+/* Note [Lazy archive members]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Most members of a large archive are never needed. Loading one, even
+   without resolving it (see Note [runtime-linker-phases] in Linker.c), means
+   reading it into memory and verifying and indexing it, which for the
+   dependency closure of a big program costs GHCi a lot of time and memory.
+   So on ELF, when the archive has a GNU symbol index (the member called "/",
+   or "/SYM64/" for 64-bit offsets), we go by that instead.
+
+   The index gives, for each global symbol that the members define, the
+   offset of the header of the member that defines it. For each object
+   member the index mentions, mkLazyOc makes an ObjectCode with status
+   OBJECT_LAZY and no image, recording where the member is (archiveOffset
+   and fileSize), whose symbols are the names from the index (kept in
+   lazyNames). insertLazyOc adds them to `symhash` as weak, hidden symbols,
+   which give way to any other definition (see ghciInsertSymbolTable), and
+   puts the object on `objects`, so that it is unloaded with the rest of the
+   archive.
+
+   When lookupDependentSymbol finds a symbol owned by an OBJECT_LAZY object,
+   loadLazyOc reads the member from the archive and loads it like any other
+   archive member, its own symbols replacing those from the index. The
+   lookup then goes on as usual: loadSymbol resolves the member.
+
+   Members the index doesn't mention, thin archives, and archives without an
+   index are loaded as they always were.
+*/
+
+typedef struct {
+    long offset;        // of the header of the member defining the symbol
+    char *name;
+} SymbolIndexEntry;
+
+static int
+compareSymbolIndexEntries (const void *a, const void *b)
+{
+    long x = ((const SymbolIndexEntry *) a)->offset;
+    long y = ((const SymbolIndexEntry *) b)->offset;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static uint64_t
+readBigEndian (const unsigned char *p, int width)
+{
+    uint64_t r = 0;
+    for (int i = 0; i < width; i++) {
+        r = (r << 8) | p[i];
+    }
+    return r;
+}
+
+/**
+ * Parse a GNU-variant symbol index, whose counts and offsets are width bytes
+ * wide, into a table sorted by member offset. The names in the table point
+ * into symIndex.
+ * @return the number of entries, or -1 if the index is malformed.
+ */
+static int
+readSymbolIndex (char *symIndex, int symIndexSize, int width,
+                 SymbolIndexEntry **entries_)
+{
+    const unsigned char *p = (const unsigned char *) symIndex;
+    if (symIndexSize < width) {
+        return -1;
+    }
+    uint64_t n = readBigEndian(p, width);
+    if (n == 0 || n > (uint64_t)(symIndexSize / width - 1)) {
+        return -1;
+    }
+
+    SymbolIndexEntry *entries = stgMallocBytes(n * sizeof(SymbolIndexEntry),
+                                               "readSymbolIndex");
+    char *name = symIndex + width * (n + 1);
+    char *end = symIndex + symIndexSize;
+    for (uint64_t i = 0; i < n; i++) {
+        char *nul = memchr(name, '\0', end - name);
+        if (nul == NULL) {
+            stgFree(entries);
+            return -1;
+        }
+        entries[i].offset = readBigEndian(p + width * (i + 1), width);
+        entries[i].name = name;
+        name = nul + 1;
+    }
+    qsort(entries, n, sizeof(SymbolIndexEntry), compareSymbolIndexEntries);
+
+    *entries_ = entries;
+    return n;
+}
+
+/**
+ * Make an OBJECT_LAZY ObjectCode for the member whose header is at
+ * headerOffset and whose contents are size bytes at offset, if the symbol
+ * index mentions it. See Note [Lazy archive members].
+ * @return the ObjectCode, or NULL if the index doesn't mention the member.
+ */
+static ObjectCode *
+mkLazyOc (pathchar *path, pathchar *archiveMemberName,
+          long headerOffset, long offset, int size,
+          SymbolIndexEntry *entries, int n_entries)
+{
+    int lo = 0, hi = n_entries;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (entries[mid].offset < headerOffset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    int n = 0;
+    size_t namesSize = 0;
+    while (lo + n < n_entries && entries[lo + n].offset == headerOffset) {
+        namesSize += strlen(entries[lo + n].name) + 1;
+        n++;
+    }
+    if (n == 0) {
+        return NULL;
+    }
+
+    ObjectCode *oc = mkOc(STATIC_OBJECT, path, NULL, size, false,
+                          archiveMemberName, 0);
+    oc->status = OBJECT_LAZY;
+    oc->archiveOffset = offset;
+    oc->lazyNames = stgMallocBytes(namesSize, "mkLazyOc(names)");
+    oc->symbols = stgMallocBytes(n * sizeof(Symbol_t), "mkLazyOc(symbols)");
+    oc->n_symbols = n;
+
+    char *name = oc->lazyNames;
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(entries[lo + i].name) + 1;
+        memcpy(name, entries[lo + i].name, len);
+        oc->symbols[i].name = name;
+        oc->symbols[i].addr = NULL;
+        // we won't know the type until we read the member
+        oc->symbols[i].type = SYM_TYPE_CODE | SYM_TYPE_HIDDEN;
+        oc->symbols[i].hash = hashSymbolName(name);
+        name += len;
+    }
+    return oc;
+}
+
+/* Note [Mapping archive members]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   We used to read each object member of an archive into a malloc'd image,
+   from which ocGetNames_ELF then copies the sections. For archives of
+   hundreds of megabytes that means reading all of it and, until the
+   images are freed with the objects, holding it in memory twice over.
+
+   Where the linker uses mmap, loadArchive_ instead maps the member
+   straight from the archive (mapArchiveMember), private and so
+   copy-on-write: only the pages that we write to are copied, and the rest
+   are shared with the page cache. The mapping starts at the page the
+   member starts in, as the member needn't be page aligned, and
+   freePreloadObjectFile unmaps from there. oc->archiveOffset records
+   where the member starts, so that ocGetNames_ELF can map the large
+   sections of a mapped image from the archive too, just as it does for a
+   standalone object file (see mapObjectFileSection).
+
+   Members of thin archives live in files of their own, and are read as
+   before.
+*/
+
+#if defined(OBJFORMAT_ELF) && RTS_LINKER_USE_MMAP
+/**
+ * Map `size` bytes of the archive open on `fd`, from `offset`, copy-on-write.
+ * Returns NULL if we can't, in which case the caller should read them.
+ */
+static char *
+mapArchiveMember (int fd, long offset, int size)
+{
+    // mmapForLinker takes an int offset
+    if (offset < 0 || offset > INT_MAX) {
+        return NULL;
+    }
+    long pageOffset = roundDownToPage(offset);
+    char *p = mmapForLinker(offset - pageOffset + size, MEM_READ_WRITE,
+                            MAP_PRIVATE, fd, pageOffset);
+    if (p == NULL) {
+        return NULL;
+    }
+    return p + (offset - pageOffset);
+}
+#endif
+
+/**
+ * Read the contents of an OBJECT_LAZY archive member into oc->image.
+ * See Note [Lazy archive members].
+ */
+bool readArchiveMember (ObjectCode *oc)
+{
+    FILE *f = pathopen(oc->fileName, WSTR("rb"));
+    if (f == NULL) {
+        errorBelch("loadArchive: can't read `%" PATH_FMT "'", oc->fileName);
+        return false;
+    }
+#if defined(OBJFORMAT_ELF) && RTS_LINKER_USE_MMAP
+    // See Note [Mapping archive members]
+    oc->image = mapArchiveMember(fileno(f), oc->archiveOffset, oc->fileSize);
+    if (oc->image != NULL) {
+        oc->imageMapped = true;
+        fclose(f);
+        return true;
+    }
+#endif
+    char *image = stgMallocBytes(oc->fileSize, "readArchiveMember(image)");
+    if (fseek(f, oc->archiveOffset, SEEK_SET) != 0
+        || fread(image, 1, oc->fileSize, f) != (size_t) oc->fileSize) {
+        errorBelch("loadArchive: error whilst reading `%" PATH_FMT "'",
+                   OC_INFORMATIVE_FILENAME(oc));
+        fclose(f);
+        stgFree(image);
+        return false;
+    }
+    fclose(f);
+    oc->image = image;
+    return true;
+}
+
+static void
+pushOc (ObjectCode ***ocs, uint32_t *n, uint32_t *size, ObjectCode *oc)
+{
+    if (*n == *size) {
+        *size = *size == 0 ? 16 : *size * 2;
+        *ocs = stgReallocBytes(*ocs, *size * sizeof(ObjectCode *),
+                               "loadArchive(members)");
+    }
+    (*ocs)[(*n)++] = oc;
+}
+
 HsInt loadArchive_ (pathchar *path)
 {
     char *image = NULL;
@@ -253,10 +479,25 @@ HsInt loadArchive_ (pathchar *path)
     char *fileName;
     size_t fileNameSize;
     int isObject, isGnuIndex, isThin, isImportLib;
+    int symIndexWidth;
+    long memberOffset;
     char tmp[20];
     char *gnuFileIndex;
     int gnuFileIndexSize;
     int misalignment = 0;
+    bool mapped = false;
+    // The members we have read, for loadOcs to load all at once.
+    // See Note [Parallel object loading] in Linker.c.
+    ObjectCode **members = NULL;
+    uint32_t n_members = 0, members_size = 0;
+    // The members we know only by the symbol index.
+    // See Note [Lazy archive members].
+    bool useSymIndex = false;
+    char *symIndex = NULL;
+    SymbolIndexEntry *symIndexEntries = NULL;
+    int n_symIndexEntries = 0;
+    ObjectCode **lazy_members = NULL;
+    uint32_t n_lazy_members = 0, lazy_members_size = 0;
 
     DEBUG_LOG("start\n");
     DEBUG_LOG("Loading archive `%" PATH_FMT "'\n", path);
@@ -329,10 +570,14 @@ HsInt loadArchive_ (pathchar *path)
         if (!success)
             goto fail;
     }
+#if defined(OBJFORMAT_ELF)
+    useSymIndex = !isThin;
+#endif
     DEBUG_LOG("loading archive contents\n");
 
     while (1) {
-        DEBUG_LOG("reading at %ld\n", ftell(f));
+        memberOffset = ftell(f);
+        DEBUG_LOG("reading at %ld\n", memberOffset);
         n = fread ( fileName, 1, 16, f );
         if (n != 16) {
             if (feof(f)) {
@@ -380,6 +625,7 @@ HsInt loadArchive_ (pathchar *path)
                  path, ftell(f), tmp[0], tmp[1]);
 
         isGnuIndex = 0;
+        symIndexWidth = 0;
         /* Check for BSD-variant large filenames */
         if (0 == strncmp(fileName, "#1/", 3)) {
             size_t n = 0;
@@ -421,6 +667,14 @@ HsInt loadArchive_ (pathchar *path)
             thisFileNameSize = 0;
             isGnuIndex = 1;
         }
+        /* Check for the 32-bit GNU symbol index ("/" + 15 blank characters)
+           and the 64-bit one ("/SYM64/" + 9 blank characters) */
+        else if (0 == strncmp(fileName, "/               ", 16) ||
+                 0 == strncmp(fileName, "/SYM64/         ", 16)) {
+            symIndexWidth = fileName[1] == 'S' ? 8 : 4;
+            fileName[0] = '\0';
+            thisFileNameSize = 0;
+        }
         /* Check for a file in the GNU file index */
         else if (fileName[0] == '/') {
             if (!lookupGNUArchiveIndex(gnuFileIndexSize, &fileName,
@@ -488,8 +742,36 @@ HsInt loadArchive_ (pathchar *path)
         if (isObject) {
             pathchar *archiveMemberName;
 
+            int size = pathprintf(NULL, 0, WSTR("%" PATH_FMT "(#%d:%.*s)"),
+                                  path, memberIdx, (int)thisFileNameSize, fileName);
+            // I don't understand why this extra +1 is needed here; pathprintf
+            // should have given us the correct length but in practice it seems
+            // to be one byte short on Win32.
+            archiveMemberName = stgMallocBytes((size+1+1) * sizeof(pathchar), "loadArchive(file)");
+            pathprintf(archiveMemberName, size+1, WSTR("%" PATH_FMT "(#%d:%.*s)"),
+                       path, memberIdx, (int)thisFileNameSize, fileName);
+
+            ObjectCode *lazy_oc = NULL;
+            if (n_symIndexEntries > 0) {
+                lazy_oc = mkLazyOc(path, archiveMemberName, memberOffset,
+                                   ftell(f), memberSize,
+                                   symIndexEntries, n_symIndexEntries);
+            }
+            if (lazy_oc != NULL) {
+                DEBUG_LOG("Member is an object file...loading lazily...\n");
+                stgFree(archiveMemberName);
+                pushOc(&lazy_members, &n_lazy_members, &lazy_members_size,
+                       lazy_oc);
+                n = fseek(f, memberSize, SEEK_CUR);
+                if (n != 0)
+                    FAIL("error whilst seeking by %d in `%" PATH_FMT "'",
+                         memberSize, path);
+                goto next;
+            }
+
             DEBUG_LOG("Member is an object file...loading...\n");
 
+            long imageOffset = ftell(f);
 #if defined(darwin_HOST_OS) || defined(ios_HOST_OS)
             if (RTS_LINKER_USE_MMAP)
                 image = mmapAnonForLinker(memberSize);
@@ -502,7 +784,17 @@ HsInt loadArchive_ (pathchar *path)
             }
 
 #else // not darwin
-            image = stgMallocBytes(memberSize, "loadArchive(image)");
+            image = NULL;
+#if defined(OBJFORMAT_ELF) && RTS_LINKER_USE_MMAP
+            // See Note [Mapping archive members]
+            if (!isThin) {
+                image = mapArchiveMember(fileno(f), imageOffset, memberSize);
+            }
+#endif
+            mapped = image != NULL;
+            if (!mapped) {
+                image = stgMallocBytes(memberSize, "loadArchive(image)");
+            }
 #endif
             if (isThin) {
                 if (!readThinArchiveMember(n, memberSize, path,
@@ -510,6 +802,13 @@ HsInt loadArchive_ (pathchar *path)
                     goto fail;
                 }
             }
+            else if (mapped)
+            {
+                n = fseek(f, memberSize, SEEK_CUR);
+                if (n != 0)
+                    FAIL("error whilst seeking by %d in `%" PATH_FMT "'",
+                         memberSize, path);
+            }
             else
             {
                 n = fread ( image, 1, memberSize, f );
@@ -518,17 +817,11 @@ HsInt loadArchive_ (pathchar *path)
                 }
             }
 
-            int size = pathprintf(NULL, 0, WSTR("%" PATH_FMT "(#%d:%.*s)"),
-                                  path, memberIdx, (int)thisFileNameSize, fileName);
-            // I don't understand why this extra +1 is needed here; pathprintf
-            // should have given us the correct length but in practice it seems
-            // to be one byte short on Win32.
-            archiveMemberName = stgMallocBytes((size+1+1) * sizeof(pathchar), "loadArchive(file)");
-            pathprintf(archiveMemberName, size+1, WSTR("%" PATH_FMT "(#%d:%.*s)"),
-                       path, memberIdx, (int)thisFileNameSize, fileName);
-
-            ObjectCode *oc = mkOc(STATIC_OBJECT, path, image, memberSize, false, archiveMemberName,
+            ObjectCode *oc = mkOc(STATIC_OBJECT, path, image, memberSize, mapped, archiveMemberName,
                                   misalignment);
+            if (!isThin) {
+                oc->archiveOffset = imageOffset;
+            }
 #if defined(OBJFORMAT_MACHO)
             ocInit_MachO( oc );
 #endif
@@ -538,14 +831,21 @@ HsInt loadArchive_ (pathchar *path)
 
             stgFree(archiveMemberName);
 
-            if (0 == loadOc(oc)) {
-                stgFree(fileName);
-                fclose(f);
-                return 0;
-            } else {
-                insertOCSectionIndices(oc); // also adds the object to `objects` list
-                oc->next_loaded_object = loaded_objects;
-                loaded_objects = oc;
+            pushOc(&members, &n_members, &members_size, oc);
+        }
+        else if (symIndexWidth != 0 && useSymIndex && symIndex == NULL) {
+            DEBUG_LOG("Found GNU-variant symbol index\n");
+            symIndex = stgMallocBytes(memberSize, "loadArchive(symIndex)");
+            n = fread ( symIndex, 1, memberSize, f );
+            if (n != memberSize) {
+                FAIL("error whilst reading `%" PATH_FMT "'", path);
+            }
+            n_symIndexEntries = readSymbolIndex(symIndex, memberSize,
+                                                symIndexWidth,
+                                                &symIndexEntries);
+            if (n_symIndexEntries < 0) {
+                DEBUG_LOG("ignoring malformed symbol index\n");
+                n_symIndexEntries = 0;
             }
         }
         else if (isGnuIndex) {
@@ -593,6 +893,7 @@ while reading filename from `%" PATH_FMT "'", path);
             }
         }
 
+    next:
         /* .ar files are 2-byte aligned */
         if (!(isThin && thisFileNameSize > 0) && memberSize % 2) {
             DEBUG_LOG("trying to read one pad byte\n");
@@ -611,13 +912,35 @@ while reading filename from `%" PATH_FMT "'", path);
         memberIdx ++;
         DEBUG_LOG("reached end of archive loading while loop\n");
     }
-    retcode = 1;
+    retcode = loadOcs(members, n_members);
+    n_members = 0;
+    if (retcode) {
+        for (uint32_t i = 0; i < n_lazy_members; i++) {
+            insertLazyOc(lazy_members[i]);
+        }
+        n_lazy_members = 0;
+    }
 fail:
     if (f != NULL)
         fclose(f);
 
     if (fileName != NULL)
         stgFree(fileName);
+    // members we didn't get to load
+    for (uint32_t i = 0; i < n_members; i++) {
+        freeObjectCode(members[i]);
+    }
+    if (members != NULL)
+        stgFree(members);
+    for (uint32_t i = 0; i < n_lazy_members; i++) {
+        freeObjectCode(lazy_members[i]);
+    }
+    if (lazy_members != NULL)
+        stgFree(lazy_members);
+    if (symIndexEntries != NULL)
+        stgFree(symIndexEntries);
+    if (symIndex != NULL)
+        stgFree(symIndex);
     if (gnuFileIndex != NULL) {
 #if RTS_LINKER_USE_MMAP
         munmapForLinker(gnuFileIndex, gnuFileIndexSize + 1, "loadArchive_");
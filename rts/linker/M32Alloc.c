@@ -78,6 +78,7 @@ The allocator manages two kinds of allocations:
 
  * small allocations, which are allocated into a set of "nursery" pages
    (recorded in m32_allocator_t.pages; the size of the set is <= M32_MAX_PAGES)
+   segregated by size class (see below)
 
  * large allocations are those larger than a page and are mapped directly
 
@@ -93,10 +94,16 @@ life-cycle it is in:
       of a nursery page, or greater in the case of a page arising from a large
       allocation)
 
-Allocation (in the case of a small request) consists of walking the nursery to
-find a page that will accommodate the request. If none exists then we allocate a
-new nursery page (flushing an existing one to the filled list if the nursery is
-full).
+The nursery is split into M32_SIZE_CLASSES classes of M32_PAGES_PER_CLASS
+pages each, by the size of the request (m32_size_class). Allocation (in the case
+of a small request) consists of walking the nursery pages of the request's class
+to find a page that will accommodate it, and then those of the other classes.
+If none exists then we allocate a new nursery page in the request's class
+(flushing the most filled one of the class to the filled list if the class is
+full). Loading a large program makes tens of thousands of small allocations
+(symbol extras, GOT entries, .rodata.cstN sections, ...) alongside section-sized
+ones; keeping them to pages of their own means a page is rarely flushed with a
+large hole left by a request that didn't fit, and bounds the walk.
 
 The allocator maintains two linked lists of filled pages, both linked together
 with m32_page_t.link:
@@ -112,7 +119,12 @@ m32_allocator_flush does two things:
 
  * it protects the pages in m32_allocator_t.unprotected_list (and formerly in
    the nursery) and moves them
-   to protected_list.
+   to protected_list. Pages from the same chunk of the free page pool are often
+   adjacent, so we sort them by address and protect each run of adjacent pages
+   with a single call to mprotect.
+
+m32_get_stats reports how well the small-allocation pages were filled, for
++RTS -s.
 
 For large objects, the remaining space at the end of the last page is left
 unused by the allocator. It can be used with care as it will be freed with the
@@ -128,6 +140,10 @@ m32_page_t.free_page.next. When run out of free pages we allocate a chunk of
 M32_MAP_PAGES to both avoid fragmenting our address space and amortize the
 runtime cost of the mapping.
 
+With +RTS --linker-code-arena, executable pages come from the code arena
+(mmapCodeForLinker) and go back to a free page pool of their own, so that the
+arena only holds code. See Note [Linker code arena] in MMap.c.
+
 The allocator is *not* thread-safe.
 
 */
@@ -146,6 +162,9 @@ The allocator is *not* thread-safe.
 
 /* How many open pages each allocator will keep around? */
 #define M32_MAX_PAGES 32
+/* How many classes of small allocations, with how many open pages each? */
+#define M32_SIZE_CLASSES 4
+#define M32_PAGES_PER_CLASS (M32_MAX_PAGES / M32_SIZE_CLASSES)
 /* How many pages should we map at once when re-filling the free page pool? */
 #define M32_MAP_PAGES 32
 /* Upper bound on the number of pages to keep in the free page pool */
@@ -269,13 +288,34 @@ struct m32_allocator_t {
 };
 
 /**
- * Global free page pool
+ * Global free page pools
  *
- * We keep a small pool of free pages around to avoid fragmentation.
+ * We keep a small pool of free pages around to avoid fragmentation. Pages
+ * in the code arena have a pool of their own, so that they are only used for
+ * code (see Note [Linker code arena] in MMap.c).
  */
-struct m32_page_t *m32_free_page_pool = NULL;
-/** Number of pages in free page pool */
-unsigned int m32_free_page_pool_size = 0;
+#define M32_POOL_OTHER 0
+#define M32_POOL_CODE  1
+struct m32_page_t *m32_free_page_pool[2] = { NULL, NULL };
+/** Number of pages in each free page pool */
+unsigned int m32_free_page_pool_size[2] = { 0, 0 };
+
+/** Updated atomically, as several objects may be loaded at once */
+static M32Stats m32_stats;
+
+#if defined(THREADED_RTS)
+/** Protects the free page pool, as several objects may be loaded at once.
+ * See Note [Parallel object loading] in Linker.c. */
+static Mutex m32_pool_mutex;
+#endif
+
+void
+m32_init(void)
+{
+#if defined(THREADED_RTS)
+  initMutex(&m32_pool_mutex);
+#endif
+}
 
 /**
  * Free a filled page or, if possible, place it in the free page pool.
@@ -292,20 +332,27 @@ m32_release_page(struct m32_page_t *page)
 
   // Break the page, which may be a large multi-page allocation, into
   // individual pages for the page pool
-  while (sz > 0) {
-    if (m32_free_page_pool_size < M32_MAX_FREE_PAGE_POOL_SIZE) {
-      mprotectForLinker(page, pgsz, MEM_READ_WRITE);
-      IF_DEBUG(sanity, memset(page, 0xaa, pgsz));
-      SET_PAGE_TYPE(page, FREE_PAGE);
-      page->free_page.next = m32_free_page_pool;
-      m32_free_page_pool = page;
-      m32_free_page_pool_size ++;
-    } else {
-      break;
-    }
+  const int pool = inCodeArena(page) ? M32_POOL_CODE : M32_POOL_OTHER;
+  ACQUIRE_LOCK(&m32_pool_mutex);
+  ssize_t pooled = 0;
+  while (pooled < sz
+         && m32_free_page_pool_size[pool] + pooled / pgsz < M32_MAX_FREE_PAGE_POOL_SIZE) {
+    pooled += pgsz;
+  }
+  if (pooled > 0) {
+    mprotectForLinker(page, pooled, MEM_READ_WRITE);
+  }
+  while (pooled > 0) {
+    IF_DEBUG(sanity, memset(page, 0xaa, pgsz));
+    SET_PAGE_TYPE(page, FREE_PAGE);
+    page->free_page.next = m32_free_page_pool[pool];
+    m32_free_page_pool[pool] = page;
+    m32_free_page_pool_size[pool] ++;
     page = (struct m32_page_t *) ((uint8_t *) page + pgsz);
     sz -= pgsz;
+    pooled -= pgsz;
   }
+  RELEASE_LOCK(&m32_pool_mutex);
 
   // The free page pool is full, release the rest back to the system
   if (sz > 0) {
@@ -318,16 +365,21 @@ m32_release_page(struct m32_page_t *page)
  * made regarding the state of the m32_page_t fields.
  */
 static struct m32_page_t *
-m32_alloc_page(void)
+m32_alloc_page(bool executable)
 {
-  if (m32_free_page_pool_size == 0) {
+  const int pool =
+    executable && RtsFlags.MiscFlags.linkerCodeArena != 0
+      ? M32_POOL_CODE : M32_POOL_OTHER;
+  ACQUIRE_LOCK(&m32_pool_mutex);
+  if (m32_free_page_pool_size[pool] == 0) {
     /*
      * Free page pool is empty; refill it with a new batch of M32_MAP_PAGES
      * pages.
      */
     const size_t pgsz = getPageSize();
     const size_t map_sz = pgsz * M32_MAP_PAGES;
-    uint8_t *chunk = mmapAnonForLinker(map_sz);
+    uint8_t *chunk = pool == M32_POOL_CODE
+      ? mmapCodeForLinker(map_sz) : mmapAnonForLinker(map_sz);
     if (! is_okay_address(chunk + map_sz)) {
       reportMemoryMap();
       barf("m32_alloc_page: failed to allocate pages within 4GB of program text (got %p)", chunk);
@@ -341,15 +393,16 @@ m32_alloc_page(void)
       page->free_page.next = GET_PAGE(i+1);
     }
 
-    GET_PAGE(M32_MAP_PAGES-1)->free_page.next = m32_free_page_pool;
-    m32_free_page_pool = (struct m32_page_t *) chunk;
-    m32_free_page_pool_size += M32_MAP_PAGES;
+    GET_PAGE(M32_MAP_PAGES-1)->free_page.next = m32_free_page_pool[pool];
+    m32_free_page_pool[pool] = (struct m32_page_t *) chunk;
+    m32_free_page_pool_size[pool] += M32_MAP_PAGES;
 #undef GET_PAGE
   }
 
-  struct m32_page_t *page = m32_free_page_pool;
-  m32_free_page_pool = page->free_page.next;
-  m32_free_page_pool_size --;
+  struct m32_page_t *page = m32_free_page_pool[pool];
+  m32_free_page_pool[pool] = page->free_page.next;
+  m32_free_page_pool_size[pool] --;
+  RELEASE_LOCK(&m32_pool_mutex);
   ASSERT_PAGE_TYPE(page, FREE_PAGE);
   return page;
 }
@@ -414,6 +467,32 @@ m32_allocator_push_filled_list(struct m32_page_t **head, struct m32_page_t *page
   *head = page;
 }
 
+/**
+ * Move a nursery page that has been filled (as far as it will be) to the
+ * unprotected list.
+ */
+static void
+m32_allocator_retire_page(m32_allocator *alloc, struct m32_page_t *page)
+{
+  ASSERT_PAGE_TYPE(page, NURSERY_PAGE);
+  const size_t pgsz = getPageSize();
+  const size_t used = page->current_size;
+  atomic_inc(&m32_stats.small_pages, 1);
+  atomic_inc(&m32_stats.small_bytes, pgsz);
+  atomic_inc(&m32_stats.small_used, used);
+  SET_PAGE_TYPE(page, FILLED_PAGE);
+  page->filled_page.size = pgsz;
+  m32_allocator_push_filled_list(&alloc->unprotected_list, page);
+}
+
+static int
+m32_compare_pages(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) *(struct m32_page_t * const *) a;
+  uintptr_t y = (uintptr_t) *(struct m32_page_t * const *) b;
+  return x < y ? -1 : x > y;
+}
+
 /**
  * Release the allocator's reference to pages on the "filling" list. This
  * should be called when it is believed that no more allocations will be needed
@@ -436,26 +515,80 @@ m32_allocator_flush(m32_allocator *alloc) {
        m32_release_page(alloc->pages[i]);
      } else {
        // the page contains data, move it to the unprotected list
-       SET_PAGE_TYPE(alloc->pages[i], FILLED_PAGE);
-       m32_allocator_push_filled_list(&alloc->unprotected_list, alloc->pages[i]);
+       m32_allocator_retire_page(alloc, alloc->pages[i]);
      }
      alloc->pages[i] = NULL;
    }
 
    // Write-protect pages if this is an executable-page allocator.
-   if (alloc->executable) {
+   if (alloc->executable && alloc->unprotected_list != NULL) {
+     const size_t pgsz = getPageSize();
+     size_t n = 0;
+     for (struct m32_page_t *page = alloc->unprotected_list; page != NULL;
+          page = m32_filled_page_get_next(page)) {
+       n++;
+     }
+     struct m32_page_t **pages =
+       stgMallocBytes(n * sizeof(struct m32_page_t *), "m32_allocator_flush");
+     n = 0;
      struct m32_page_t *page = alloc->unprotected_list;
      while (page != NULL) {
        ASSERT_PAGE_TYPE(page, FILLED_PAGE);
        struct m32_page_t *next = m32_filled_page_get_next(page);
        m32_allocator_push_filled_list(&alloc->protected_list, page);
-       mprotectForLinker(page, page->filled_page.size, MEM_READ_EXECUTE);
+       pages[n++] = page;
        page = next;
      }
      alloc->unprotected_list = NULL;
+
+     // Protect each run of adjacent pages at once
+     qsort(pages, n, sizeof(struct m32_page_t *), m32_compare_pages);
+     StgWord calls = 0;
+     for (size_t i = 0; i < n; ) {
+       uint8_t *start = (uint8_t *) pages[i];
+       uint8_t *end = start + ROUND_UP((size_t) pages[i]->filled_page.size, pgsz);
+       for (i++; i < n && (uint8_t *) pages[i] == end; i++) {
+         end += ROUND_UP((size_t) pages[i]->filled_page.size, pgsz);
+       }
+       mprotectForLinker(start, end - start, MEM_READ_EXECUTE);
+       calls++;
+     }
+     stgFree(pages);
+     atomic_inc(&m32_stats.mprotects, calls);
    }
 }
 
+/**
+ * The class of the nursery pages that a small allocation goes in.
+ * See Note [M32 Allocator].
+ */
+static int
+m32_size_class(size_t size)
+{
+   if (size <= 64) {
+      return 0;
+   } else if (size <= 256) {
+      return 1;
+   } else if (size <= 1024) {
+      return 2;
+   } else {
+      return 3;
+   }
+}
+
+/**
+ * Report the totals in m32_stats.
+ */
+void
+m32_get_stats(M32Stats *stats)
+{
+   stats->small_pages = RELAXED_LOAD(&m32_stats.small_pages);
+   stats->small_bytes = RELAXED_LOAD(&m32_stats.small_bytes);
+   stats->small_used = RELAXED_LOAD(&m32_stats.small_used);
+   stats->large = RELAXED_LOAD(&m32_stats.large);
+   stats->mprotects = RELAXED_LOAD(&m32_stats.mprotects);
+}
+
 /**
  * Return true if the allocation request should be considered "large".
  */
@@ -490,7 +623,8 @@ m32_alloc(struct m32_allocator_t *alloc, size_t size, size_t alignment)
       size_t alsize = ROUND_UP(sizeof(struct m32_page_t), alignment);
       // TODO: lower-bound allocation size to allocation granularity and return
       // remainder to free pool.
-      struct m32_page_t *page = mmapAnonForLinker(alsize+size);
+      struct m32_page_t *page = alloc->executable
+        ? mmapCodeForLinker(alsize+size) : mmapAnonForLinker(alsize+size);
       if (page == NULL) {
           sysErrorBelch("m32_alloc: Failed to map pages for %zd bytes", size);
           return NULL;
@@ -501,6 +635,7 @@ m32_alloc(struct m32_allocator_t *alloc, size_t size, size_t alignment)
       }
       SET_PAGE_TYPE(page, FILLED_PAGE);
       page->filled_page.size = alsize + size;
+      atomic_inc(&m32_stats.large, 1);
       m32_allocator_push_filled_list(&alloc->unprotected_list, (struct m32_page_t *) page);
       uint8_t *res = (uint8_t *) page + alsize;
       m32_report_allocation(alloc, res, size);
@@ -508,14 +643,20 @@ m32_alloc(struct m32_allocator_t *alloc, size_t size, size_t alignment)
    }
 
    // small object
-   // Try to find a page that can contain it
+   // Try to find a page that can contain it, starting with the pages of its
+   // size class
+   const int cls = m32_size_class(size);
    int empty = -1;
    int most_filled = -1;
-   int i;
-   for (i=0; i<M32_MAX_PAGES; i++) {
+   for (int k=0; k<M32_MAX_PAGES; k++) {
+      const int i = (cls * M32_PAGES_PER_CLASS + k) % M32_MAX_PAGES;
+      const bool own_class = k < M32_PAGES_PER_CLASS;
+
       // empty page
       if (alloc->pages[i] == NULL) {
-         empty = empty == -1 ? i : empty;
+         if (own_class && empty == -1) {
+            empty = i;
+         }
          continue;
       }
 
@@ -530,24 +671,25 @@ m32_alloc(struct m32_allocator_t *alloc, size_t size, size_t alignment)
          return addr;
       }
 
-      // is this the most filled page we've seen so far?
-      if (most_filled == -1
-       || alloc->pages[most_filled]->current_size < alloc->pages[i]->current_size)
+      // is this the most filled page of the class we've seen so far?
+      if (own_class
+          && (most_filled == -1
+              || alloc->pages[most_filled]->current_size
+                   < alloc->pages[i]->current_size))
       {
          most_filled = i;
       }
    }
 
-   // If we haven't found an empty page, flush the most filled one
+   // If the class has no empty page, flush its most filled one
    if (empty == -1) {
-      SET_PAGE_TYPE(alloc->pages[most_filled], FILLED_PAGE);
-      m32_allocator_push_filled_list(&alloc->unprotected_list, alloc->pages[most_filled]);
+      m32_allocator_retire_page(alloc, alloc->pages[most_filled]);
       alloc->pages[most_filled] = NULL;
       empty = most_filled;
    }
 
    // Allocate a new page
-   struct m32_page_t *page = m32_alloc_page();
+   struct m32_page_t *page = m32_alloc_page(alloc->executable);
    if (page == NULL) {
       return NULL;
    }
@@ -591,4 +733,11 @@ m32_alloc(m32_allocator *alloc STG_UNUSED,
     barf("%s: RTS_LINKER_USE_MMAP is %d", __func__, RTS_LINKER_USE_MMAP);
 }
 
+// Unlike the others this one is called regardless, by +RTS -s
+void
+m32_get_stats(M32Stats *stats)
+{
+    memset(stats, 0, sizeof(M32Stats));
+}
+
 #endif
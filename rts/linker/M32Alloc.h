@@ -27,6 +27,8 @@
 struct m32_allocator_t;
 typedef struct m32_allocator_t m32_allocator;
 
+void m32_init(void);
+
 m32_allocator *m32_allocator_new(bool executable) M32_NO_RETURN;
 
 void m32_allocator_free(m32_allocator *alloc) M32_NO_RETURN;
@@ -35,4 +37,15 @@ void m32_allocator_flush(m32_allocator *alloc) M32_NO_RETURN;
 
 void * m32_alloc(m32_allocator *alloc, size_t size, size_t alignment) M32_NO_RETURN;
 
+/* Totals over the run, reported by +RTS -s */
+typedef struct {
+    StgWord small_pages;  // pages filled with small allocations
+    StgWord small_bytes;  // bytes those pages have room for
+    StgWord small_used;   // of which used, including padding
+    StgWord large;        // allocations of their own pages
+    StgWord mprotects;    // calls to mprotect by m32_allocator_flush
+} M32Stats;
+
+void m32_get_stats(M32Stats *stats);
+
 #include "EndPrivate.h"
@@ -2,6 +2,8 @@
 
 #include "sm/OSMem.h"
 #include "linker/MMap.h"
+#include "linker/M32Alloc.h"
+#include "RtsUtils.h"
 #include "Trace.h"
 #include "ReportMemoryMap.h"
 
@@ -40,11 +42,33 @@
 
 void *mmap_32bit_base = LINKER_LOAD_BASE;
 
+#if defined(THREADED_RTS)
+// Protects the region mmapForLinker maps in, as several objects may be
+// loaded at once. See Note [Parallel object loading] in Linker.c.
+static Mutex linker_mmap_mutex;
+#endif
+
+// The bytes mapped for the linker and not yet unmapped, the m32
+// allocator's pages and the code arena's allocations included. Updated
+// atomically.
+static StgWord linker_mapped_bytes = 0;
+
+StgWord getLinkerMappedBytes(void)
+{
+    return RELAXED_LOAD(&linker_mapped_bytes);
+}
+
 void initLinkerMMap(void) {
     if (RtsFlags.MiscFlags.linkerMemBase != 0) {
         // User-override for mmap_32bit_base
         mmap_32bit_base = (void*)RtsFlags.MiscFlags.linkerMemBase;
     }
+#if defined(THREADED_RTS)
+    initMutex(&linker_mmap_mutex);
+#endif
+#if defined(NEED_M32)
+    m32_init();
+#endif
 }
 
 static const char *memoryAccessDescription(MemoryAccess mode)
@@ -210,7 +234,11 @@ memoryAccessToProt(MemoryAccess access)
 void *
 mmapAnon (size_t bytes)
 {
-  return VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  void *result = VirtualAlloc(NULL, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  if (result != NULL) {
+      RELAXED_ADD(&linker_mapped_bytes, bytes);
+  }
+  return result;
 }
 
 //
@@ -223,11 +251,30 @@ mmapAnonForLinker (size_t bytes)
   /* For linking purposes we want to load code within a 4GB range from the
      load address of the application.  As such we need to find a location to
      allocate at.   */
+  ACQUIRE_LOCK(&linker_mmap_mutex);
   void* region = allocateLocalBytes (bytes, &size);
-  if (region == NULL) {
-      return NULL;
+  void* result = NULL;
+  if (region != NULL) {
+      result = VirtualAlloc(region, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
   }
-  return VirtualAlloc(region, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  RELEASE_LOCK(&linker_mmap_mutex);
+  if (result != NULL) {
+      RELAXED_ADD(&linker_mapped_bytes, bytes);
+  }
+  return result;
+}
+
+void *
+mmapCodeForLinker (size_t bytes)
+{
+    // See Note [Linker code arena]; there is no arena on Windows
+    return mmapAnonForLinker(bytes);
+}
+
+bool
+inCodeArena (void *p STG_UNUSED)
+{
+    return false;
 }
 
 void
@@ -236,6 +283,8 @@ munmapForLinker (void *addr, size_t bytes, const char *caller)
   if (VirtualFree(addr, 0, MEM_RELEASE) == 0) {
     sysErrorBelch("munmapForLinker: %s: Failed to unmap %zd bytes at %p",
                   caller, bytes, addr);
+  } else {
+    RELAXED_ADD(&linker_mapped_bytes, -(StgWord) bytes);
   }
 }
 
@@ -390,6 +439,7 @@ mmapForLinker (size_t bytes, MemoryAccess access, uint32_t flags, int fd, int of
     struct MemoryRegion *region;
 
     IF_DEBUG(linker_verbose, debugBelch("mmapForLinker: start\n"));
+    ACQUIRE_LOCK(&linker_mmap_mutex);
     if (RtsFlags.MiscFlags.linkerAlwaysPic) {
         /* make no attempt at mapping low memory if we are assuming PIC */
         region = NULL;
@@ -409,6 +459,10 @@ mmapForLinker (size_t bytes, MemoryAccess access, uint32_t flags, int fd, int of
     else {
         result = mmapAnywhere(bytes, access, flags, fd, offset);
     }
+    RELEASE_LOCK(&linker_mmap_mutex);
+    if (result != NULL) {
+        RELAXED_ADD(&linker_mapped_bytes, bytes);
+    }
     IF_DEBUG(linker_verbose,
              debugBelch("mmapForLinker: mapped %zd bytes starting at %p\n",
                         bytes, result));
@@ -423,7 +477,12 @@ mmapForLinker (size_t bytes, MemoryAccess access, uint32_t flags, int fd, int of
 void *
 mmapAnon (size_t bytes)
 {
-    return mmapAnywhere(bytes, MEM_READ_WRITE_THEN_READ_EXECUTE, MAP_ANONYMOUS, -1, 0);
+    void *result = mmapAnywhere(bytes, MEM_READ_WRITE_THEN_READ_EXECUTE,
+                                MAP_ANONYMOUS, -1, 0);
+    if (result != NULL) {
+        RELAXED_ADD(&linker_mapped_bytes, roundUpToPage(bytes));
+    }
+    return result;
 }
 
 /*
@@ -435,12 +494,204 @@ mmapAnonForLinker (size_t bytes)
     return mmapForLinker (bytes, MEM_READ_WRITE_THEN_READ_EXECUTE, MAP_ANONYMOUS, -1, 0);
 }
 
+/* Note [Linker code arena]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~
+ * mmapAnonForLinker puts each mapping wherever mmapInRegion finds room, so
+ * the code of the objects we load ends up scattered over many small pages
+ * among everything else the process maps. A program that runs loaded code
+ * for a long time (a server hosting plugins, say) then spends a good deal
+ * on iTLB misses.
+ *
+ * With +RTS --linker-code-arena=<size>, the first time the linker needs
+ * memory for code (mmapCodeForLinker, which the m32 allocator uses for
+ * executable pages) we reserve an arena of <size> bytes, rounded up to
+ * CODE_ARENA_ALIGN (2MB, the size of a huge page on x86-64 and AArch64),
+ * at an address aligned to CODE_ARENA_ALIGN, in the region the linker maps
+ * into. Where the OS has transparent huge pages we ask for them with
+ * madvise(MADV_HUGEPAGE). Code is then allocated contiguously from the
+ * arena, first fit, and only code: the m32 allocator keeps the pages of the
+ * arena in a free page pool of their own.
+ *
+ * munmapForLinker gives memory in the arena back to it, rather than to the
+ * OS, so that later code can use it; the pages themselves are dropped with
+ * MADV_DONTNEED. When the arena is full we fall back to mmapAnonForLinker.
+ *
+ * Changing the protection of part of a huge page (see
+ * Note [Memory protection in the linker]) splits it; once all of the code
+ * in a 2MB stretch is read-only and executable, the kernel may merge its
+ * pages back into a huge page.
+ *
+ * The arena is protected by linker_mmap_mutex.
+ */
+
+#define CODE_ARENA_ALIGN (2 * 1024 * 1024)
+#define ROUND_UP_ARENA(x) (((x) + CODE_ARENA_ALIGN - 1) & ~((uintptr_t) CODE_ARENA_ALIGN - 1))
+
+typedef struct CodeArenaExtent_ {
+    uint8_t *start;
+    size_t size;
+    struct CodeArenaExtent_ *next;
+} CodeArenaExtent;
+
+static uint8_t *code_arena = NULL;
+static size_t code_arena_size = 0;
+static bool code_arena_failed = false;
+static CodeArenaExtent *code_arena_free = NULL;   // sorted by address
+
+// Call with linker_mmap_mutex held
+static void
+initCodeArena (void)
+{
+    size_t size = ROUND_UP_ARENA(RtsFlags.MiscFlags.linkerCodeArena);
+    uint8_t *p;
+
+    // Map enough to align the arena, and unmap the rest
+    if (RtsFlags.MiscFlags.linkerAlwaysPic) {
+        p = mmapAnywhere(size + CODE_ARENA_ALIGN, MEM_READ_WRITE,
+                         MAP_ANONYMOUS, -1, 0);
+    } else {
+        struct MemoryRegion *region = nearImage();
+        uint32_t flags = MAP_ANONYMOUS;
+        if (region->end <= (void *) 0xffffffff) {
+            flags |= TRY_MAP_32BIT;
+        }
+        p = mmapInRegion(region, size + CODE_ARENA_ALIGN, MEM_READ_WRITE,
+                         flags, -1, 0);
+    }
+    if (p == NULL) {
+        errorBelch("--linker-code-arena: can't reserve %zu bytes", size);
+        code_arena_failed = true;
+        return;
+    }
+    uint8_t *start = (uint8_t *) ROUND_UP_ARENA((uintptr_t) p);
+    if (start > p) {
+        munmap(p, start - p);
+    }
+    if (p + CODE_ARENA_ALIGN > start) {
+        munmap(start + size, p + CODE_ARENA_ALIGN - start);
+    }
+
+#if defined(MADV_HUGEPAGE)
+    if (madvise(start, size, MADV_HUGEPAGE) != 0) {
+        IF_DEBUG(linker, debugBelch("initCodeArena: no huge pages\n"));
+    }
+#endif
+
+    code_arena = start;
+    code_arena_size = size;
+    code_arena_free = stgMallocBytes(sizeof(CodeArenaExtent), "initCodeArena");
+    code_arena_free->start = start;
+    code_arena_free->size = size;
+    code_arena_free->next = NULL;
+    IF_DEBUG(linker, debugBelch("initCodeArena: %zu bytes at %p\n", size, start));
+}
+
+// Call with linker_mmap_mutex held
+static void *
+allocCodeArena (size_t bytes)
+{
+    for (CodeArenaExtent **e = &code_arena_free; *e != NULL; e = &(*e)->next) {
+        if ((*e)->size >= bytes) {
+            void *p = (*e)->start;
+            (*e)->start += bytes;
+            (*e)->size -= bytes;
+            if ((*e)->size == 0) {
+                CodeArenaExtent *empty = *e;
+                *e = empty->next;
+                stgFree(empty);
+            }
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Call with linker_mmap_mutex held
+static void
+freeCodeArena (uint8_t *p, size_t bytes)
+{
+    mprotect(p, bytes, PROT_READ | PROT_WRITE);
+#if defined(MADV_DONTNEED)
+    madvise(p, bytes, MADV_DONTNEED);
+#endif
+
+    CodeArenaExtent **e = &code_arena_free;
+    while (*e != NULL && (*e)->start + (*e)->size < p) {
+        e = &(*e)->next;
+    }
+    if (*e != NULL && (*e)->start + (*e)->size == p) {
+        // Extend the extent before p, and merge it with the one after
+        (*e)->size += bytes;
+        CodeArenaExtent *next = (*e)->next;
+        if (next != NULL && (*e)->start + (*e)->size == next->start) {
+            (*e)->size += next->size;
+            (*e)->next = next->next;
+            stgFree(next);
+        }
+    } else if (*e != NULL && p + bytes == (*e)->start) {
+        (*e)->start = p;
+        (*e)->size += bytes;
+    } else {
+        CodeArenaExtent *ext = stgMallocBytes(sizeof(CodeArenaExtent),
+                                              "freeCodeArena");
+        ext->start = p;
+        ext->size = bytes;
+        ext->next = *e;
+        *e = ext;
+    }
+}
+
+bool
+inCodeArena (void *p)
+{
+    // code_arena is only set once
+    return code_arena != NULL
+        && (uint8_t *) p >= code_arena
+        && (uint8_t *) p < code_arena + code_arena_size;
+}
+
+/*
+ * Map read/write pages for code, in the code arena if there is one.
+ * See Note [Linker code arena]. Returns NULL on failure.
+ */
+void *
+mmapCodeForLinker (size_t bytes)
+{
+    if (RtsFlags.MiscFlags.linkerCodeArena == 0) {
+        return mmapAnonForLinker(bytes);
+    }
+
+    bytes = roundUpToPage(bytes);
+    ACQUIRE_LOCK(&linker_mmap_mutex);
+    if (code_arena == NULL && !code_arena_failed) {
+        initCodeArena();
+    }
+    void *result = allocCodeArena(bytes);
+    RELEASE_LOCK(&linker_mmap_mutex);
+
+    if (result == NULL) {
+        // The arena is full
+        return mmapAnonForLinker(bytes);
+    }
+    RELAXED_ADD(&linker_mapped_bytes, bytes);
+    return result;
+}
+
 void munmapForLinker (void *addr, size_t bytes, const char *caller)
 {
+    if (inCodeArena(addr)) {
+        ACQUIRE_LOCK(&linker_mmap_mutex);
+        freeCodeArena(addr, roundUpToPage(bytes));
+        RELEASE_LOCK(&linker_mmap_mutex);
+        RELAXED_ADD(&linker_mapped_bytes, -(StgWord) roundUpToPage(bytes));
+        return;
+    }
     int r = munmap(addr, bytes);
     if (r == -1) {
         // Should we abort here?
         sysErrorBelch("munmap: %s", caller);
+    } else {
+        RELAXED_ADD(&linker_mapped_bytes, -(StgWord) roundUpToPage(bytes));
     }
 }
 
@@ -71,12 +71,22 @@ void *mmapAnon(size_t bytes);
 // placing the mapping within 4GB of the executable image.
 void *mmapAnonForLinker (size_t bytes);
 
+// Map read/write anonymous memory for code, like mmapAnonForLinker, but in
+// the code arena if there is one. See Note [Linker code arena] in MMap.c.
+void *mmapCodeForLinker (size_t bytes);
+
+// Is the address in the code arena?
+bool inCodeArena (void *p);
+
 // Change protection of previous mapping memory.
 void mprotectForLinker(void *start, size_t len, MemoryAccess mode);
 
 // Release a mapping.
 void munmapForLinker (void *addr, size_t bytes, const char *caller);
 
+// The bytes mapped by the functions above and not yet released
+StgWord getLinkerMappedBytes (void);
+
 #if !defined(mingw32_HOST_OS)
 // Map a file.
 //
@@ -1403,6 +1403,7 @@ ocGetNames_MachO(ObjectCode* oc)
                             oc->symbols[curSymbol].name = nm;
                             oc->symbols[curSymbol].addr = addr;
                             oc->symbols[curSymbol].type = sym_type;
+                            oc->symbols[curSymbol].hash = hashSymbolName(nm);
                             curSymbol++;
                     }
                 }
@@ -1443,6 +1444,7 @@ ocGetNames_MachO(ObjectCode* oc)
                                        (void*)commonCounter, HS_BOOL_FALSE, sym_type, oc);
                 oc->symbols[curSymbol].name = nm;
                 oc->symbols[curSymbol].addr = oc->info->macho_symbols[i].addr;
+                oc->symbols[curSymbol].hash = hashSymbolName(nm);
                 curSymbol++;
 
                 commonCounter += sz;
@@ -400,6 +400,9 @@ static void releaseOcInfo(
     ObjectCode* oc);
 
 static SymbolAddr *lookupSymbolInDLLs ( const SymbolName* lbl, ObjectCode *dependent );
+static SymbolAddr *lookupSymbolInOpenedDLL ( const SymbolName* lbl,
+    HINSTANCE instance, OpenedDLL* o_dll, pathchar* dll_name,
+    ObjectCode *dependent );
 
 const Alignments pe_alignments[] = {
   { IMAGE_SCN_ALIGN_1BYTES   , 1   },
@@ -453,6 +456,78 @@ void exitLinker_PEi386(void)
 /* A list thereof. */
 static OpenedDLL* opened_dlls = NULL;
 
+/* Note [DLL export index]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   A symbol that no object defines is looked for in each DLL we know of in
+   turn (lookupSymbolInDLLs). With GetProcAddress, that is a binary search
+   of the export names of every DLL, taking the loader lock each time, and a
+   large program has tens of thousands of such symbols, most of them in the
+   last DLLs we look at, if any; this used to make loading much slower on
+   Windows than elsewhere.
+
+   So when we add a DLL (addDLLHandle), indexExports reads its export
+   directory once, and keeps a hash table from the name of each export to
+   its address in OpenedDLL.exports. lookupExport then finds a symbol in a
+   DLL with a single lookup in that table.
+
+   An export whose address lies within the export directory itself is a
+   forwarder, naming the export of another DLL ("NTDLL.RtlAllocateHeap");
+   we leave those to GetProcAddress, which knows how to load that DLL.
+   DLLs are never unloaded, so the names and addresses stay valid.
+*/
+
+static void indexExports(OpenedDLL* o_dll)
+{
+    BYTE *base = (BYTE *) o_dll->instance;
+    PIMAGE_NT_HEADERS header =
+        (PIMAGE_NT_HEADERS)(base + ((PIMAGE_DOS_HEADER)base)->e_lfanew);
+    IMAGE_DATA_DIRECTORY *dir =
+        &header->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+
+    o_dll->exports = NULL;
+    o_dll->export_dir_start = base + dir->VirtualAddress;
+    o_dll->export_dir_end = base + dir->VirtualAddress + dir->Size;
+    if (dir->Size == 0) {
+        return;
+    }
+
+    PIMAGE_EXPORT_DIRECTORY exports =
+        (PIMAGE_EXPORT_DIRECTORY)(base + dir->VirtualAddress);
+    DWORD *names = (DWORD *)(base + exports->AddressOfNames);
+    WORD *ordinals = (WORD *)(base + exports->AddressOfNameOrdinals);
+    DWORD *functions = (DWORD *)(base + exports->AddressOfFunctions);
+
+    o_dll->exports = allocStrHashTable();
+    for (DWORD i = 0; i < exports->NumberOfNames; i++) {
+        if (ordinals[i] >= exports->NumberOfFunctions) {
+            continue;
+        }
+        insertStrHashTable(o_dll->exports, (const char *)(base + names[i]),
+                           base + functions[ordinals[i]]);
+    }
+    IF_DEBUG(linker, debugBelch("indexExports: %" PATH_FMT ": %lu exports\n",
+                                o_dll->name, exports->NumberOfNames));
+}
+
+/* Find an export of a DLL by name, see Note [DLL export index]. o_dll is
+   the DLL's entry in opened_dlls, or NULL if it has none. */
+static SymbolAddr* lookupExport(OpenedDLL* o_dll, HINSTANCE instance,
+                                const char* lbl)
+{
+    if (o_dll == NULL) {
+        return GetProcAddress(instance, lbl);
+    }
+    if (o_dll->exports == NULL) {
+        return NULL;
+    }
+    uint8_t *addr = lookupStrHashTable(o_dll->exports, lbl);
+    if (addr >= o_dll->export_dir_start && addr < o_dll->export_dir_end) {
+        // A forwarder
+        return GetProcAddress(instance, lbl);
+    }
+    return addr;
+}
+
 /* Adds a DLL instance to the list of DLLs in which to search for symbols. */
 static void addDLLHandle(pathchar* dll_name, HINSTANCE instance) {
 
@@ -471,6 +546,7 @@ static void addDLLHandle(pathchar* dll_name, HINSTANCE instance) {
     o_dll->instance = instance;
     o_dll->next     = opened_dlls;
     opened_dlls     = o_dll;
+    indexExports(o_dll);
 
     /* Now discover the dependencies of dll_name that were
        just loaded in our process space. The reason is we have access to them
@@ -548,6 +624,8 @@ void freePreloadObjectFile_PEi386(ObjectCode *oc)
         if (oc->info->ch_info) {
            stgFree (oc->info->ch_info);
         }
+        stgFree (oc->info->symbol_addrs);
+        stgFree (oc->info->symbol_types);
         stgFree (oc->info);
         oc->info = NULL;
     }
@@ -562,6 +640,8 @@ static void releaseOcInfo(ObjectCode* oc) {
         freeInitFiniList(oc->info->fini);
         stgFree (oc->info->ch_info);
         stgFree (oc->info->symbols);
+        stgFree (oc->info->symbol_addrs);
+        stgFree (oc->info->symbol_types);
         stgFree (oc->info->str_tab);
         stgFree (oc->info);
         oc->info = NULL;
@@ -1135,19 +1215,26 @@ lookupSymbolInDLLs ( const SymbolName* lbl, ObjectCode *dependent )
     SymbolAddr* res;
 
     for (o_dll = opened_dlls; o_dll != NULL; o_dll = o_dll->next)
-        if ((res = lookupSymbolInDLL_PEi386(lbl, o_dll->instance, o_dll->name, dependent)))
+        if ((res = lookupSymbolInOpenedDLL(lbl, o_dll->instance, o_dll, o_dll->name, dependent)))
             return res;
     return NULL;
 }
 
 SymbolAddr*
-lookupSymbolInDLL_PEi386 ( const SymbolName* lbl, HINSTANCE instance, pathchar* dll_name STG_UNUSED, ObjectCode *dependent)
+lookupSymbolInDLL_PEi386 ( const SymbolName* lbl, HINSTANCE instance, pathchar* dll_name, ObjectCode *dependent)
+{
+    return lookupSymbolInOpenedDLL(lbl, instance, findLoadedDll(instance),
+                                   dll_name, dependent);
+}
+
+static SymbolAddr*
+lookupSymbolInOpenedDLL ( const SymbolName* lbl, HINSTANCE instance, OpenedDLL* o_dll, pathchar* dll_name STG_UNUSED, ObjectCode *dependent)
 {
     SymbolAddr* sym;
 
     /* debugBelch("look in %ls for %s\n", dll_name, lbl); */
 
-    sym = GetProcAddress(instance, lbl);
+    sym = lookupExport(o_dll, instance, lbl);
     if (sym != NULL) {
         /*debugBelch("found %s in %ls\n", lbl, dll_name);*/
         return sym;
@@ -1162,8 +1249,7 @@ lookupSymbolInDLL_PEi386 ( const SymbolName* lbl, HINSTANCE instance, pathchar*
          the same semantics as in __imp_foo = GetProcAddress(..., "foo")
      */
     if (sym == NULL && strncmp (lbl, "__imp_", 6) == 0) {
-        sym = GetProcAddress(instance,
-                             lbl + 6);
+        sym = lookupExport(o_dll, instance, lbl + 6);
         if (sym != NULL) {
             SymbolAddr** indirect = m32_alloc(dependent->rw_m32, sizeof(SymbolAddr*), 8);
             if (indirect == NULL) {
@@ -1177,12 +1263,6 @@ lookupSymbolInDLL_PEi386 ( const SymbolName* lbl, HINSTANCE instance, pathchar*
            }
     }
 
-    sym = GetProcAddress(instance, lbl);
-    if (sym != NULL) {
-        /*debugBelch("found %s in %s\n", lbl,dll_name);*/
-        return sym;
-       }
-
     return NULL;
 }
 
@@ -1915,6 +1995,7 @@ ocGetNames_PEi386 ( ObjectCode* oc )
          oc->symbols[i].name = sname;
          oc->symbols[i].addr = addr;
          oc->symbols[i].type = type;
+         oc->symbols[i].hash = hashSymbolName(sname);
          if (isWeak) {
              setWeakSymbol(oc, sname);
          }
@@ -1974,8 +2055,58 @@ void ocProtectExtras(ObjectCode* oc STG_UNUSED) { }
 
 #endif /* x86_64_HOST_ARCH */
 
+/* Look up the external symbols the relocations of an object refer to, one
+   object at a time as a lookup may load another object. ocRelocate_PEi386
+   then does the relocations, in parallel with other objects (see
+   Note [Parallel object loading] in Linker.c). */
 bool
 ocResolve_PEi386 ( ObjectCode* oc )
+{
+   uint8_t symbol[1000];
+
+   /* Such libraries have been partially freed and can't be resolved.  */
+   if (oc->status == OBJECT_DONT_RESOLVE)
+     return 1;
+
+   COFF_HEADER_INFO *info = oc->info->ch_info;
+   oc->info->symbol_addrs =
+      stgCallocBytes(info->numberOfSymbols, sizeof(SymbolAddr*),
+                     "ocResolve_PEi386(symbol_addrs)");
+   oc->info->symbol_types =
+      stgCallocBytes(info->numberOfSymbols, sizeof(SymType),
+                     "ocResolve_PEi386(symbol_types)");
+
+   for (unsigned int i = 0; i < info->numberOfSections; i++) {
+      Section section = oc->sections[i];
+
+      if (section.kind == SECTIONKIND_DEBUG)
+         continue;
+
+      for (uint32_t j = 0; j < section.info->noRelocs; j++) {
+         uint64_t symIndex = section.info->relocs[j].SymbolTableIndex;
+         COFF_symbol* sym = &oc->info->symbols[symIndex];
+
+         if (getSymStorageClass (info, sym) == IMAGE_SYM_CLASS_STATIC
+             || oc->info->symbol_addrs[symIndex] != NULL)
+            continue;
+
+         copyName ( getSymShortName (info, sym), oc, symbol,
+                    sizeof(symbol)-1 );
+         SymbolAddr *S = lookupDependentSymbol( (char*)symbol, oc,
+                                                &oc->info->symbol_types[symIndex] );
+         if (S == NULL) {
+            errorBelch(" | %" PATH_FMT ": unknown symbol `%s'", oc->fileName, symbol);
+            releaseOcInfo (oc);
+            return false;
+         }
+         oc->info->symbol_addrs[symIndex] = S;
+      }
+   }
+   return true;
+}
+
+bool
+ocRelocate_PEi386 ( ObjectCode* oc )
 {
    uint64_t    A;
    size_t      S;
@@ -2020,7 +2151,7 @@ ocResolve_PEi386 ( ObjectCode* oc )
          uint64_t symIndex = reloc->SymbolTableIndex;
          sym = &oc->info->symbols[symIndex];
 
-         SymType sym_type;
+         SymType sym_type = SYM_TYPE_CODE;
 
          IF_DEBUG(linker_verbose,
                   debugBelch(
@@ -2049,14 +2180,9 @@ ocResolve_PEi386 ( ObjectCode* oc )
             S = ((size_t)(section.start))
               + ((size_t)(getSymValue (info, sym)));
          } else {
-            copyName ( getSymShortName (info, sym), oc, symbol,
-                       sizeof(symbol)-1 );
-            S = (size_t) lookupDependentSymbol( (char*)symbol, oc, &sym_type );
-            if ((void*)S == NULL) {
-                errorBelch(" | %" PATH_FMT ": unknown symbol `%s'", oc->fileName, symbol);
-                releaseOcInfo (oc);
-                return false;
-            }
+            // Looked up by ocResolve_PEi386
+            S = (size_t) oc->info->symbol_addrs[symIndex];
+            sym_type = oc->info->symbol_types[symIndex];
          }
          IF_DEBUG(linker_verbose, debugBelch("S=%zx\n", S));
 
@@ -2172,6 +2298,10 @@ ocResolve_PEi386 ( ObjectCode* oc )
    oc->info->ch_info = NULL;
    stgFree(oc->info->symbols);
    oc->info->symbols = NULL;
+   stgFree(oc->info->symbol_addrs);
+   oc->info->symbol_addrs = NULL;
+   stgFree(oc->info->symbol_types);
+   oc->info->symbol_types = NULL;
 
    IF_DEBUG(linker, debugBelch("completed %" PATH_FMT "\n", oc->fileName));
    return true;
@@ -2316,7 +2446,8 @@ SymbolAddr *lookupSymbol_PEi386(SymbolName *lbl, ObjectCode *dependent, SymType
             IF_DEBUG(linker,
                debugBelch("indexing import %s => %s using dll instance %p\n",
                    lbl, (char*)pinfo->value, dllInstance));
-            pinfo->value = GetProcAddress((HMODULE)dllInstance, lbl);
+            pinfo->value = lookupExport(findLoadedDll(dllInstance),
+                                        dllInstance, lbl);
             clearImportSymbol (pinfo->owner, lbl);
             return pinfo->value;
         } else {
@@ -55,6 +55,7 @@ HsPtr addLibrarySearchPath_PEi386( pathchar* dll_path );
 bool removeLibrarySearchPath_PEi386( HsPtr dll_path_index );
 
 bool ocResolve_PEi386     ( ObjectCode* oc );
+bool ocRelocate_PEi386    ( ObjectCode* oc );
 bool ocRunInit_PEi386     ( ObjectCode *oc );
 bool ocRunFini_PEi386     ( ObjectCode *oc );
 bool ocGetNames_PEi386    ( ObjectCode* oc );
@@ -130,6 +131,11 @@ struct _OpenedDLL {
     pathchar*          name;
     struct _OpenedDLL* next;
     HINSTANCE instance;
+    /* The exports of the DLL by name, see Note [DLL export index]. NULL if
+       it has no export directory. */
+    StrHashTable*      exports;
+    uint8_t*           export_dir_start;
+    uint8_t*           export_dir_end;
 } OpenedDLL;
 
 /* Some alignment information.  */
@@ -23,8 +23,12 @@ struct ObjectCodeFormatInfo {
     struct InitFiniList* fini; // Freed by ocRunFini_PEi386
     Section* pdata;
     Section* xdata;
-    COFF_HEADER_INFO* ch_info; // Freed by ocResolve_PEi386
-    COFF_symbol* symbols;      // Freed by ocResolve_PEi386
+    COFF_HEADER_INFO* ch_info; // Freed by ocRelocate_PEi386
+    COFF_symbol* symbols;      // Freed by ocRelocate_PEi386
+    // The addresses and types of the external symbols the relocations refer
+    // to, by symbol index; set by ocResolve_PEi386, freed by ocRelocate_PEi386
+    SymbolAddr** symbol_addrs;
+    SymType* symbol_types;
     char* str_tab;
  };
 
@@ -86,7 +86,9 @@ int ocAllocateExtras(ObjectCode* oc, int count, int first, int bssSize)
       if (new) {
           memcpy(new, oc->image, oc->fileSize);
           if (oc->imageMapped) {
-              munmapForLinker(oc->image, n, "ocAllocateExtras");
+              void *start = (void *) roundDownToPage((StgWord) oc->image);
+              munmapForLinker(start, oc->image + oc->fileSize - (char *) start,
+                              "ocAllocateExtras");
           }
           oc->image = new;
           oc->imageMapped = true;
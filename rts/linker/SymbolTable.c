@@ -0,0 +1,293 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2026
+ *
+ * The runtime linker's symbol table
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "Rts.h"
+#include "RtsUtils.h"
+#include "linker/SymbolTable.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+#include <string.h>
+
+/* Note [Linker symbol table]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   `symhash`, which maps the name of every symbol the runtime linker knows
+   to its RtsSymbolInfo, easily has millions of entries when GHCi loads a
+   large program, and is looked up for every relocation against a global
+   symbol. It used to be a StrHashTable (Hash.c), which chains entries in
+   separately allocated cells and hashes the key afresh on every access.
+   This table is instead an open-addressed one in the style of Abseil's
+   "Swiss tables":
+
+   * The entries are in one array, along with the full hash of each key, so
+     growing the table never rehashes a string.
+
+   * Alongside is an array of control bytes, one per entry: CTRL_EMPTY,
+     CTRL_DELETED, or, for a full entry, the low 7 bits of its hash (H2).
+     A lookup starts at the slot given by the rest of the hash (H1) and
+     looks at a group of GROUP_WIDTH control bytes at once, finding the
+     bytes equal to H2 with a few word operations, so that it compares
+     the keys of few entries other than the one it is looking for. It goes
+     on to further groups, in triangular steps, until it finds the key or a
+     group with an empty slot.
+
+   * The first GROUP_WIDTH control bytes are repeated after the last, so
+     that a group starting near the end of the array can be read in one go.
+
+   * Removing an entry leaves CTRL_DELETED, so as not to cut probe sequences
+     short. We keep at least one slot in eight empty, counting deleted slots
+     as full, and purge deleted slots when we would otherwise grow.
+
+   Every operation takes the hash of the key, from hashSymbolName, so that
+   callers that know the hash needn't compute it again. ocGetNames_ELF
+   hashes the names of an object's symbols, in Symbol_t.hash, when it runs
+   on several threads (see Note [Parallel object loading] in Linker.c), and
+   ocInsertSymbols reserves room for all of them before inserting them.
+*/
+
+#define GROUP_WIDTH 8
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+
+#define LSBS UINT64_C(0x0101010101010101)
+#define MSBS UINT64_C(0x8080808080808080)
+
+#define MIN_CAPACITY 64
+
+#define NOT_FOUND ((size_t) -1)
+
+typedef struct {
+    const SymbolName *key;
+    StgWord hash;
+    void *data;
+} SymbolTableEntry;
+
+struct SymbolTable_ {
+    uint8_t *ctrl;              // capacity + GROUP_WIDTH control bytes
+    SymbolTableEntry *entries;  // capacity entries
+    size_t capacity;            // a power of 2
+    size_t size;                // full entries
+    size_t growth_left;         // empty slots we may fill before growing
+};
+
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((uint8_t) ((hash) & 0x7f))
+
+StgWord
+hashSymbolName (const SymbolName *name)
+{
+#if WORD_SIZE_IN_BITS == 64
+    return XXH3_64bits(name, strlen(name));
+#else
+    return XXH32(name, strlen(name), 0);
+#endif
+}
+
+/* The group of control bytes starting at ctrl, with ctrl[i] in bits 8i to
+   8i+7. */
+static inline uint64_t
+loadGroup (const uint8_t *ctrl)
+{
+    uint64_t g;
+    memcpy(&g, ctrl, sizeof(g));
+#if defined(WORDS_BIGENDIAN)
+    g = __builtin_bswap64(g);
+#endif
+    return g;
+}
+
+/* Bits 8i+7 set for the bytes of g equal to h2. This may also report a byte
+   just above one that matches, which the comparison of keys then rejects. */
+static inline uint64_t
+matchH2 (uint64_t g, uint8_t h2)
+{
+    uint64_t x = g ^ (LSBS * h2);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+static inline uint64_t
+matchEmpty (uint64_t g)
+{
+    return g & ~(g << 6) & MSBS;
+}
+
+static inline uint64_t
+matchEmptyOrDeleted (uint64_t g)
+{
+    return g & ~(g << 7) & MSBS;
+}
+
+static inline size_t
+firstMatch (uint64_t m)
+{
+    return __builtin_ctzll(m) / 8;
+}
+
+static inline void
+setCtrl (SymbolTable *table, size_t i, uint8_t c)
+{
+    table->ctrl[i] = c;
+    if (i < GROUP_WIDTH) {
+        table->ctrl[table->capacity + i] = c;
+    }
+}
+
+/* The slot a new entry with the given hash goes in */
+static size_t
+findInsertSlot (const SymbolTable *table, StgWord hash)
+{
+    size_t mask = table->capacity - 1;
+    size_t pos = H1(hash) & mask;
+    for (size_t step = GROUP_WIDTH; ; step += GROUP_WIDTH) {
+        uint64_t m = matchEmptyOrDeleted(loadGroup(table->ctrl + pos));
+        if (m != 0) {
+            return (pos + firstMatch(m)) & mask;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+/* The slot of the entry for key, or NOT_FOUND */
+static size_t
+findSlot (const SymbolTable *table, const SymbolName *key, StgWord hash)
+{
+    size_t mask = table->capacity - 1;
+    size_t pos = H1(hash) & mask;
+    for (size_t step = GROUP_WIDTH; ; step += GROUP_WIDTH) {
+        uint64_t g = loadGroup(table->ctrl + pos);
+        for (uint64_t m = matchH2(g, H2(hash)); m != 0; m &= m - 1) {
+            size_t i = (pos + firstMatch(m)) & mask;
+            const SymbolTableEntry *e = &table->entries[i];
+            if (e->hash == hash && strcmp(e->key, key) == 0) {
+                return i;
+            }
+        }
+        if (matchEmpty(g) != 0) {
+            return NOT_FOUND;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+static void
+initSymbolTable (SymbolTable *table, size_t capacity)
+{
+    table->ctrl = stgMallocBytes(capacity + GROUP_WIDTH, "initSymbolTable");
+    memset(table->ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+    table->entries = stgMallocBytes(capacity * sizeof(SymbolTableEntry),
+                                    "initSymbolTable");
+    table->capacity = capacity;
+    table->size = 0;
+    table->growth_left = capacity - capacity / 8;
+}
+
+/* Move the entries to a table of the given capacity, dropping deleted
+   slots */
+static void
+resizeSymbolTable (SymbolTable *table, size_t capacity)
+{
+    uint8_t *old_ctrl = table->ctrl;
+    SymbolTableEntry *old_entries = table->entries;
+    size_t old_capacity = table->capacity;
+    size_t size = table->size;
+
+    initSymbolTable(table, capacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+        if ((old_ctrl[i] & CTRL_EMPTY) == 0) {
+            size_t j = findInsertSlot(table, old_entries[i].hash);
+            setCtrl(table, j, H2(old_entries[i].hash));
+            table->entries[j] = old_entries[i];
+        }
+    }
+    table->size = size;
+    table->growth_left -= size;
+
+    stgFree(old_ctrl);
+    stgFree(old_entries);
+}
+
+SymbolTable *
+allocSymbolTable (void)
+{
+    SymbolTable *table = stgMallocBytes(sizeof(SymbolTable), "allocSymbolTable");
+    initSymbolTable(table, MIN_CAPACITY);
+    return table;
+}
+
+void
+freeSymbolTable (SymbolTable *table, void (*freeDataFun)(void *))
+{
+    if (freeDataFun != NULL) {
+        for (size_t i = 0; i < table->capacity; i++) {
+            if ((table->ctrl[i] & CTRL_EMPTY) == 0) {
+                freeDataFun(table->entries[i].data);
+            }
+        }
+    }
+    stgFree(table->ctrl);
+    stgFree(table->entries);
+    stgFree(table);
+}
+
+void
+reserveSymbolTable (SymbolTable *table, size_t n)
+{
+    if (n <= table->growth_left) {
+        return;
+    }
+    size_t capacity = table->capacity;
+    while (capacity - capacity / 8 < table->size + n) {
+        capacity *= 2;
+    }
+    resizeSymbolTable(table, capacity);
+}
+
+void *
+lookupSymbolTable (const SymbolTable *table, const SymbolName *key, StgWord hash)
+{
+    size_t i = findSlot(table, key, hash);
+    return i == NOT_FOUND ? NULL : table->entries[i].data;
+}
+
+void
+insertSymbolTable (SymbolTable *table, const SymbolName *key, StgWord hash,
+                   void *data)
+{
+    ASSERT(findSlot(table, key, hash) == NOT_FOUND);
+
+    size_t i = findInsertSlot(table, hash);
+    if (table->growth_left == 0 && table->ctrl[i] == CTRL_EMPTY) {
+        // Full, or full of deleted slots
+        size_t capacity = table->capacity;
+        if (table->size + 1 > (capacity - capacity / 8) / 2) {
+            capacity *= 2;
+        }
+        resizeSymbolTable(table, capacity);
+        i = findInsertSlot(table, hash);
+    }
+
+    if (table->ctrl[i] == CTRL_EMPTY) {
+        table->growth_left--;
+    }
+    setCtrl(table, i, H2(hash));
+    table->entries[i] = (SymbolTableEntry) { .key = key, .hash = hash, .data = data };
+    table->size++;
+}
+
+void *
+removeSymbolTable (SymbolTable *table, const SymbolName *key, StgWord hash)
+{
+    size_t i = findSlot(table, key, hash);
+    if (i == NOT_FOUND) {
+        return NULL;
+    }
+    setCtrl(table, i, CTRL_DELETED);
+    table->size--;
+    return table->entries[i].data;
+}
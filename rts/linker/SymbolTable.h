@@ -0,0 +1,40 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2026
+ *
+ * The runtime linker's symbol table
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "RtsSymbols.h"
+
+#include "BeginPrivate.h"
+
+/* A table mapping symbol names to values, see Note [Linker symbol table].
+ * The keys aren't copied: they must live as long as their entries. Each
+ * operation takes the hash of the key, from hashSymbolName, so that it can
+ * be computed ahead of time.
+ */
+typedef struct SymbolTable_ SymbolTable;
+
+StgWord       hashSymbolName     ( const SymbolName *name );
+
+SymbolTable * allocSymbolTable   ( void );
+void          freeSymbolTable    ( SymbolTable *table,
+                                   void (*freeDataFun)(void *) );
+
+// Make room for n more entries, before inserting many at once
+void          reserveSymbolTable ( SymbolTable *table, size_t n );
+
+void *        lookupSymbolTable  ( const SymbolTable *table,
+                                   const SymbolName *key, StgWord hash );
+// The key must not be in the table already
+void          insertSymbolTable  ( SymbolTable *table,
+                                   const SymbolName *key, StgWord hash,
+                                   void *data );
+void *        removeSymbolTable  ( SymbolTable *table,
+                                   const SymbolName *key, StgWord hash );
+
+#include "EndPrivate.h"
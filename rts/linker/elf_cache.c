@@ -0,0 +1,288 @@
+#include "Rts.h"
+#include "RtsUtils.h"
+#include "RtsFlags.h"
+#include "elf_cache.h"
+
+#if defined(ELF_RELOC_CACHE)
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Note [ELF relocation cache]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   GHCi and Template Haskell load the same library objects in session after
+   session, and relocate them the same way each time. With
+   +RTS --linker-cache=<dir>, once ocRelocate_ELF has relocated an object,
+   storeElfCache writes to <dir> the contents of the sections the relocations
+   wrote to and of the object's symbol extras, in a file named by a hash of
+   the object's image and the GHC version. With them it writes what the
+   result depends on: where each section is, where the symbol extras are,
+   and where each of the object's non-local symbols resolved to.
+
+   When the same object is loaded again and its sections land at the same
+   addresses, which they often do, as the linker asks for memory in the
+   same places when it loads the same objects in the same order,
+   loadElfCache copies the relocated contents from the file, and
+   ocRelocate_ELF only redoes the relocations against symbols that now
+   resolve somewhere else (ElfSymbol.target_changed), e.g. to a shared
+   library that was mapped elsewhere. If the sections are elsewhere, we
+   relocate as usual and replace the file.
+
+   This is only right for relocations with an explicit addend (SHT_RELA),
+   whose result depends on nothing but the addend, the place and the
+   symbol. The addend of an SHT_REL relocation is at the place, where the
+   cached contents have overwritten it, so objects with SHT_REL relocations
+   (on i386 and arm) aren't cached.
+
+   We still read, verify and index the object, and look up the symbols it
+   refers to: the linker needs those for the symbol table and to know the
+   addresses the cached contents depend on. It's the relocation itself that
+   the cache saves.
+
+   The file is written under another name and renamed into place, so that
+   sessions running at the same time never see half of one.
+*/
+
+#define ELF_CACHE_MAGIC "GHCRELC1"
+
+typedef struct {
+    char magic[8];
+    StgWord64 image_size;
+    StgWord64 n_sections;
+    StgWord64 n_symbols;        // in all the symbol tables
+    StgWord64 symbol_extras;    // address
+    StgWord64 n_symbol_extras;
+    // then, for each section, its start and size; for each symbol, its
+    // target; the contents of each relocated section; and the contents of
+    // the symbol extras
+} ElfCacheHeader;
+
+/* Which of the sections of oc relocations write to, or NULL if oc can't be
+   cached. */
+static bool *
+relocatedSections (ObjectCode *oc)
+{
+    // oc->sections corresponds to the sections of the object
+    Elf_Shdr *shdr = oc->info->sectionHeader;
+    bool *relocated = stgCallocBytes(oc->n_sections, sizeof(bool),
+                                     "relocatedSections");
+
+    for (int i = 0; i < oc->n_sections; i++) {
+        if (shdr[i].sh_type == SHT_REL) {
+            stgFree(relocated);
+            return NULL;
+        }
+        if (shdr[i].sh_type == SHT_RELA) {
+            Section *s = &oc->sections[shdr[i].sh_info];
+            relocated[shdr[i].sh_info] =
+                s->kind != SECTIONKIND_OTHER && s->start != NULL && s->size > 0;
+        }
+    }
+    return relocated;
+}
+
+static size_t
+countSymbols (ObjectCode *oc)
+{
+    size_t n = 0;
+    for (ElfSymbolTable *st = oc->info->symbolTables; st != NULL; st = st->next) {
+        n += st->n_symbols;
+    }
+    return n;
+}
+
+static StgWord64
+symbolTarget (ElfSymbol *symbol)
+{
+    if (ELF_ST_BIND(symbol->elf_sym->st_info) == STB_LOCAL
+        || !symbol->target_known) {
+        return 0;
+    }
+    return (StgWord64) (W_) symbol->target;
+}
+
+static void
+initHeader (ObjectCode *oc, ElfCacheHeader *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, ELF_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->image_size = oc->fileSize;
+    hdr->n_sections = oc->n_sections;
+    hdr->n_symbols = countSymbols(oc);
+#if defined(NEED_SYMBOL_EXTRAS)
+    hdr->symbol_extras = (StgWord64) (W_) oc->symbol_extras;
+    hdr->n_symbol_extras = oc->n_symbol_extras;
+#endif
+}
+
+static char *
+cachePath (ObjectCode *oc)
+{
+    const char *dir = RtsFlags.MiscFlags.linkerCache;
+    StgWord64 seed = XXH3_64bits(ProjectVersion, strlen(ProjectVersion));
+    StgWord64 key = XXH3_64bits_withSeed(oc->image, oc->fileSize, seed);
+    size_t len = strlen(dir) + 32;
+    char *path = stgMallocBytes(len, "cachePath");
+    snprintf(path, len, "%s/%016" FMT_HexWord64 ".rel", dir, key);
+    return path;
+}
+
+/* Fill in the relocated sections of oc from the cache, if the cache has
+   them for the addresses oc is at. Sets ElfSymbol.target_changed for the
+   symbols whose relocations must still be done, and *changed if there are
+   any. See Note [ELF relocation cache]. */
+bool
+loadElfCache (ObjectCode *oc, bool *changed)
+{
+    if (RtsFlags.MiscFlags.linkerCache == NULL) {
+        return false;
+    }
+    bool *relocated = relocatedSections(oc);
+    if (relocated == NULL) {
+        return false;
+    }
+
+    bool ok = false;
+    char *path = cachePath(oc);
+    StgWord64 *addrs = NULL;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        goto end;
+    }
+
+    ElfCacheHeader expected, hdr;
+    initHeader(oc, &expected);
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+        || memcmp(&hdr, &expected, sizeof(hdr)) != 0) {
+        goto end;
+    }
+
+    size_t n_addrs = 2 * hdr.n_sections + hdr.n_symbols;
+    addrs = stgMallocBytes(n_addrs * sizeof(StgWord64), "loadElfCache");
+    if (fread(addrs, sizeof(StgWord64), n_addrs, f) != n_addrs) {
+        goto end;
+    }
+    for (int i = 0; i < oc->n_sections; i++) {
+        if (addrs[2*i] != (StgWord64) (W_) oc->sections[i].start
+            || addrs[2*i+1] != oc->sections[i].size) {
+            goto end;
+        }
+    }
+
+    // The layout is the same; a short read from here leaves the sections
+    // as they would be relocated, apart from the relocations, which the
+    // caller then does in full.
+    for (int i = 0; i < oc->n_sections; i++) {
+        if (relocated[i]
+            && fread(oc->sections[i].start, 1, oc->sections[i].size, f)
+               != oc->sections[i].size) {
+            goto end;
+        }
+    }
+#if defined(NEED_SYMBOL_EXTRAS)
+    if (fread(oc->symbol_extras, sizeof(SymbolExtra), oc->n_symbol_extras, f)
+        != oc->n_symbol_extras) {
+        goto end;
+    }
+#endif
+
+    *changed = false;
+    StgWord64 *target = addrs + 2 * hdr.n_sections;
+    for (ElfSymbolTable *st = oc->info->symbolTables; st != NULL; st = st->next) {
+        for (size_t j = 0; j < st->n_symbols; j++, target++) {
+            ElfSymbol *symbol = &st->symbols[j];
+            symbol->target_changed = symbolTarget(symbol) != *target;
+            *changed |= symbol->target_changed;
+        }
+    }
+    ok = true;
+    IF_DEBUG(linker, debugBelch("loadElfCache: %s from %s\n",
+                                *changed ? "partly relocated" : "relocated",
+                                path));
+
+end:
+    if (f != NULL) {
+        fclose(f);
+    }
+    if (addrs != NULL) {
+        stgFree(addrs);
+    }
+    stgFree(path);
+    stgFree(relocated);
+    return ok;
+}
+
+/* Save the relocated sections of oc in the cache.
+   See Note [ELF relocation cache]. */
+void
+storeElfCache (ObjectCode *oc)
+{
+    const char *dir = RtsFlags.MiscFlags.linkerCache;
+    if (dir == NULL) {
+        return;
+    }
+    bool *relocated = relocatedSections(oc);
+    if (relocated == NULL) {
+        return;
+    }
+
+    char *path = cachePath(oc);
+    size_t len = strlen(path) + 48;
+    char *tmp = stgMallocBytes(len, "storeElfCache");
+    snprintf(tmp, len, "%s.%d.%p", path, (int) getpid(), (void *) oc);
+
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        IF_DEBUG(linker, debugBelch("storeElfCache: can't create %s\n", dir));
+        goto end;
+    }
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        IF_DEBUG(linker, debugBelch("storeElfCache: can't create %s\n", tmp));
+        goto end;
+    }
+
+    ElfCacheHeader hdr;
+    initHeader(oc, &hdr);
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    for (int i = 0; ok && i < oc->n_sections; i++) {
+        StgWord64 s[2] = { (StgWord64) (W_) oc->sections[i].start,
+                           oc->sections[i].size };
+        ok = fwrite(s, sizeof(StgWord64), 2, f) == 2;
+    }
+    for (ElfSymbolTable *st = oc->info->symbolTables;
+         ok && st != NULL; st = st->next) {
+        for (size_t j = 0; ok && j < st->n_symbols; j++) {
+            StgWord64 target = symbolTarget(&st->symbols[j]);
+            ok = fwrite(&target, sizeof(StgWord64), 1, f) == 1;
+        }
+    }
+    for (int i = 0; ok && i < oc->n_sections; i++) {
+        if (relocated[i]) {
+            ok = fwrite(oc->sections[i].start, 1, oc->sections[i].size, f)
+                 == oc->sections[i].size;
+        }
+    }
+#if defined(NEED_SYMBOL_EXTRAS)
+    ok = ok && fwrite(oc->symbol_extras, sizeof(SymbolExtra),
+                      oc->n_symbol_extras, f) == oc->n_symbol_extras;
+#endif
+
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+        IF_DEBUG(linker, debugBelch("storeElfCache: can't write %s\n", path));
+        unlink(tmp);
+    }
+
+end:
+    stgFree(tmp);
+    stgFree(path);
+    stgFree(relocated);
+}
+
+#endif /* ELF_RELOC_CACHE */
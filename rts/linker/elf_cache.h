@@ -0,0 +1,20 @@
+#pragma once
+
+#include "LinkerInternals.h"
+
+#include <stdbool.h>
+#include <linker/ElfTypes.h>
+
+#if defined(OBJFORMAT_ELF) \
+    && !defined(aarch64_HOST_ARCH) && !defined(riscv64_HOST_ARCH) \
+    && !(defined(x86_64_HOST_ARCH) && defined(freebsd_HOST_OS))
+#define ELF_RELOC_CACHE 1
+
+#include "BeginPrivate.h"
+
+bool loadElfCache(ObjectCode * oc, bool * changed);
+void storeElfCache(ObjectCode * oc);
+
+#include "EndPrivate.h"
+
+#endif
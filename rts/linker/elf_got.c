@@ -88,7 +88,7 @@ fillGot(ObjectCode * oc) {
 
                 /* no type are undefined symbols */
                 // Note STT_SECTION symbols should have their address
-                // set prior to the fillGot call in ocResolve_ELF.
+                // set prior to the fillGot call in ocResolveSymbols_ELF.
                 if(   STT_NOTYPE == ELF_ST_TYPE(symbol->elf_sym->st_info)
                    || STB_WEAK   == ELF_ST_BIND(symbol->elf_sym->st_info)) {
                     if(0x0 == symbol->addr) {
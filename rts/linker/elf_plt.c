@@ -1,5 +1,8 @@
 #include "Rts.h"
 #include "elf_plt.h"
+#include "Hash.h"
+#include "RtsUtils.h"
+#include "util.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -15,21 +18,52 @@
 #define needStubForRel  ADD_SUFFIX(needStubForRel)
 #define needStubForRela ADD_SUFFIX(needStubForRela)
 
+static int
+compareStubKeys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* A stub is made for each target (and flags) a section calls, not for each
+ * relocation, so reserve space for the distinct (symbol, relocation type)
+ * pairs that may need one: the symbol determines the target, the type the
+ * flags. */
 unsigned
 numberOfStubsForSection( ObjectCode *oc, unsigned sectionIndex) {
-    unsigned n = 0;
+    size_t n = 0, size = 0;
+    uint64_t *keys = NULL;
+
+    for(ElfRelocationTable *t = oc->info->relTable; t != NULL; t = t->next)
+        if(t->targetSectionIndex == sectionIndex)
+            size += t->n_relocations;
+    for(ElfRelocationATable *t = oc->info->relaTable; t != NULL; t = t->next)
+        if(t->targetSectionIndex == sectionIndex)
+            size += t->n_relocations;
+    if(size == 0)
+        return 0;
+    keys = stgMallocBytes(size * sizeof(uint64_t), "numberOfStubsForSection");
+
     for(ElfRelocationTable *t = oc->info->relTable; t != NULL; t = t->next)
         if(t->targetSectionIndex == sectionIndex)
             for(size_t i=0; i < t->n_relocations; i++)
                 if(needStubForRel(&t->relocations[i]))
-                    n += 1;
+                    keys[n++] = (uint64_t)ELF_R_SYM(t->relocations[i].r_info) << 32
+                              | ELF_R_TYPE(t->relocations[i].r_info);
 
     for(ElfRelocationATable *t = oc->info->relaTable; t != NULL; t = t->next)
         if(t->targetSectionIndex == sectionIndex)
             for(size_t i=0; i < t->n_relocations; i++)
                 if(needStubForRela(&t->relocations[i]))
-                    n += 1;
-    return n;
+                    keys[n++] = (uint64_t)ELF_R_SYM(t->relocations[i].r_info) << 32
+                              | ELF_R_TYPE(t->relocations[i].r_info);
+
+    qsort(keys, n, sizeof(uint64_t), compareStubKeys);
+    unsigned distinct = 0;
+    for(size_t i=0; i < n; i++)
+        if(i == 0 || keys[i] != keys[i-1])
+            distinct += 1;
+    stgFree(keys);
+    return distinct;
 }
 
 bool
@@ -79,17 +113,165 @@ makeStub(Section * section,
 
 void
 freeStubs(Section * section) {
-    if(section->info->nstubs == 0)
-        return;
-    Stub * last = section->info->stubs;
-    while(last->next != NULL) {
-        Stub * t = last;
-        last = last->next;
+    Stub * s = section->info->stubs;
+    while(s != NULL) {
+        Stub * t = s;
+        s = s->next;
         free(t);
     }
     section->info->stubs = NULL;
     section->info->nstubs = 0;
 }
 
+#if defined(SHARED_STUBS)
+
+/* Note [Shared stubs]
+   ~~~~~~~~~~~~~~~~~~~
+   On AArch64 a call that can't reach its target goes through a stub, and on
+   RISC-V every call does (see makeStubAarch64, makeStubRISCV64). Each
+   section has room for its own stubs, right after its code, so that they
+   are in reach of the calls; see ocGetNames_ELF. When many objects call
+   the same functions (the RTS, base, ...), each of them used to make its
+   own stub for each such function.
+
+   A stub only depends on its target (and, on RISC-V, the GOT slot it loads
+   the target from, which lives as long as the object that owns it). So once
+   an object is relocated, shareStubs adds its stubs to `shared_stubs`, a
+   table from target to the stubs for it, and a later object that needs a
+   stub for the same target uses one of those if it is in reach of the call
+   (findSharedStub), rather than making its own. The object making use of a
+   stub then depends on the object it is in, like it does on the objects it
+   finds symbols in, so the stub stays around for as long as it is used (see
+   Note [Object unloading] in CheckUnload.c). We don't hand out the stubs of
+   objects that have been unloaded, and freeObjectCode takes an object's
+   stubs out of the table (unshareStubs) before it frees them.
+
+   The stubs stay in the sections of the objects that made them, rather than
+   in a region of their own: code is mapped read-only once relocated (see
+   m32_allocator_flush), so a region that other objects run code from
+   couldn't take any more stubs. Each section still reserves room for a stub
+   per distinct target, as it can't know in advance which stubs it will find
+   in reach.
+
+   Objects are relocated in parallel (see Note [Parallel object loading] in
+   Linker.c) and may be freed by the GC (checkUnload), so the table has a
+   lock of its own. Objects relocated at the same time may or may not find
+   each other's stubs; either way they are in place before any of the
+   objects is run.
+*/
+
+typedef struct SharedStub_ {
+    void *addr;
+    uint8_t flags;
+    ObjectCode *owner;
+    struct SharedStub_ *next;
+} SharedStub;
+
+/* target -> SharedStub, see Note [Shared stubs] */
+static HashTable *shared_stubs = NULL;
+
+#if defined(THREADED_RTS)
+static Mutex shared_stubs_mutex;
+#endif
+
+void
+initSharedStubs(void) {
+    shared_stubs = allocHashTable();
+#if defined(THREADED_RTS)
+    initMutex(&shared_stubs_mutex);
+#endif
+}
+
+static void
+freeSharedStubChain(void *p) {
+    SharedStub *s = p;
+    while(s != NULL) {
+        SharedStub *t = s;
+        s = s->next;
+        stgFree(t);
+    }
+}
+
+void
+exitSharedStubs(void) {
+    freeHashTable(shared_stubs, freeSharedStubChain);
+    shared_stubs = NULL;
+#if defined(THREADED_RTS)
+    closeMutex(&shared_stubs_mutex);
+#endif
+}
+
+/* Find a stub another object made for *addr (with the given flags) that is
+ * within a `bits`-bit signed offset of P, and make oc depend on its owner. */
+bool
+findSharedStub(ObjectCode *oc, void* * addr, uint8_t flags,
+               uintptr_t P, uint32_t bits) {
+    ObjectCode *owner = NULL;
+
+    ACQUIRE_LOCK(&shared_stubs_mutex);
+    for(SharedStub *s = lookupHashTable(shared_stubs, (StgWord)*addr);
+        s != NULL; s = s->next) {
+        if(   s->flags == flags
+           && s->owner->status != OBJECT_UNLOADED
+           && isInt64(bits, (int64_t)((uintptr_t)s->addr - P))) {
+            *addr = s->addr;
+            owner = s->owner;
+            break;
+        }
+    }
+    RELEASE_LOCK(&shared_stubs_mutex);
+
+    if(owner == NULL)
+        return EXIT_FAILURE;
+    // oc->dependencies is only touched by the thread relocating oc
+    insertHashSet(oc->dependencies, (W_)owner);
+    return EXIT_SUCCESS;
+}
+
+void
+shareStubs(ObjectCode *oc) {
+    ACQUIRE_LOCK(&shared_stubs_mutex);
+    for(int i = 0; i < oc->n_sections; i++) {
+        if(oc->sections[i].info == NULL)
+            continue;
+        for(Stub *s = oc->sections[i].info->stubs; s != NULL; s = s->next) {
+            SharedStub *shared = stgMallocBytes(sizeof(SharedStub), "shareStubs");
+            shared->addr = s->addr;
+            shared->flags = s->flags;
+            shared->owner = oc;
+            shared->next = removeHashTable(shared_stubs, (StgWord)s->target, NULL);
+            insertHashTable(shared_stubs, (StgWord)s->target, shared);
+        }
+    }
+    RELEASE_LOCK(&shared_stubs_mutex);
+}
+
+void
+unshareStubs(ObjectCode *oc) {
+    ACQUIRE_LOCK(&shared_stubs_mutex);
+    for(int i = 0; i < oc->n_sections; i++) {
+        if(oc->sections[i].info == NULL)
+            continue;
+        for(Stub *s = oc->sections[i].info->stubs; s != NULL; s = s->next) {
+            SharedStub *chain = removeHashTable(shared_stubs, (StgWord)s->target, NULL);
+            SharedStub **link = &chain;
+            while(*link != NULL) {
+                if((*link)->owner == oc) {
+                    SharedStub *t = *link;
+                    *link = t->next;
+                    stgFree(t);
+                } else {
+                    link = &(*link)->next;
+                }
+            }
+            if(chain != NULL)
+                insertHashTable(shared_stubs, (StgWord)s->target, chain);
+        }
+    }
+    RELEASE_LOCK(&shared_stubs_mutex);
+}
+
+#endif // SHARED_STUBS
+
 #endif // OBJECTFORMAT_ELF
 #endif // arm/aarch64_HOST_ARCH
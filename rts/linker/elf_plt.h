@@ -41,6 +41,18 @@ bool makeStub(Section * section, void* * addr, void* got_addr, uint8_t flags);
 
 void freeStubs(Section * section);
 
+#if defined(aarch64_HOST_ARCH) || defined(riscv64_HOST_ARCH)
+/* See Note [Shared stubs] in elf_plt.c */
+#define SHARED_STUBS
+
+void initSharedStubs(void);
+void exitSharedStubs(void);
+bool findSharedStub(ObjectCode *oc, void* * addr, uint8_t flags,
+                    uintptr_t P, uint32_t bits);
+void shareStubs(ObjectCode *oc);
+void unshareStubs(ObjectCode *oc);
+#endif
+
 #endif // OBJECTFORMAT_ELF
 
 #endif // arm/aarch64_HOST_ARCH/riscv64_HOST_ARCH
@@ -176,6 +176,7 @@ encodeAddendAarch64(Section * section, Elf_Rel * rel, int64_t addend) {
 
 /**
  * Compute the *new* addend for a relocation, given a pre-existing addend.
+ * @param oc      The object being relocated.
  * @param section The section the relocation is in.
  * @param rel     The Relocation struct.
  * @param symbol  The target symbol.
@@ -183,7 +184,7 @@ encodeAddendAarch64(Section * section, Elf_Rel * rel, int64_t addend) {
  * @return The new computed addend.
  */
 static int64_t
-computeAddend(Section * section, Elf_Rel * rel,
+computeAddend(ObjectCode * oc, Section * section, Elf_Rel * rel,
               ElfSymbol * symbol, int64_t addend) {
 
     /* Position where something is relocated */
@@ -237,8 +238,10 @@ computeAddend(Section * section, Elf_Rel * rel,
                 // executing instruction.
 
                 /* need a stub */
-                /* check if we already have that stub */
-                if(findStub(section, (void**)&S, 0)) {
+                /* check if we already have that stub, or another object
+                 * has one in reach. See Note [Shared stubs] */
+                if(findStub(section, (void**)&S, 0)
+                   && findSharedStub(oc, (void**)&S, 0, P - A, 26+2)) {
                     /* did not find it. Crete a new stub. */
                     if(makeStub(section, (void**)&S, NULL, 0)) {
                         abort(/* could not find or make stub */);
@@ -307,7 +310,7 @@ relocateObjectCodeAarch64(ObjectCode * oc) {
             /* decode implicit addend */
             int64_t addend = decodeAddendAarch64(targetSection, rel);
 
-            addend = computeAddend(targetSection, rel, symbol, addend);
+            addend = computeAddend(oc, targetSection, rel, symbol, addend);
             encodeAddendAarch64(targetSection, rel, addend);
         }
     }
@@ -338,7 +341,7 @@ relocateObjectCodeAarch64(ObjectCode * oc) {
             /* take explicit addend */
             int64_t addend = rel->r_addend;
 
-            addend = computeAddend(targetSection, (Elf_Rel*)rel,
+            addend = computeAddend(oc, targetSection, (Elf_Rel*)rel,
                                    symbol, addend);
             encodeAddendAarch64(targetSection, (Elf_Rel*)rel, addend);
         }
@@ -539,7 +539,10 @@ int32_t computeAddend(ElfRelocationATable * relaTab, unsigned relNo, Elf_Rel *re
       GOT_Target = (addr_t) FAKE_GOT_S;
     }
 
-    if (findStub(section, (void **)&S, 0)) {
+    // AUIPC+JALR reach +-2GiB, less the rounding of the upper 20 bits; see
+    // Note [Shared stubs]
+    if (findStub(section, (void **)&S, 0) &&
+        findSharedStub(oc, (void **)&S, 0, P - A, 31)) {
       /* did not find it. Crete a new stub. */
       if (makeStub(section, (void **)&S, (void *)GOT_Target, 0)) {
         abort(/* could not find or make stub */);
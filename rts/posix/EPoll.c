@@ -0,0 +1,620 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * An I/O manager for the non-threaded RTS using epoll (Linux) or kqueue (the
+ * BSDs and Darwin).
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [The epoll I/O manager]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The select() I/O manager rebuilds its fd_sets from the whole queue of
+   blocked threads every time the scheduler looks for I/O, so each look
+   costs time linear in the number of waiting threads, and it cannot watch
+   descriptors above FD_SETSIZE at all. That is no good for a
+   single-threaded server with tens of thousands of connections.
+
+   The epoll I/O manager (+RTS --io-manager=epoll, or kqueue on the BSDs and
+   Darwin, where it uses kqueue) is the default for the non-threaded RTS
+   where it is available. It keeps, for each capability:
+
+    * an epoll (or kqueue) instance, in which each descriptor is registered
+      at most once and stays registered, and a table indexed by descriptor
+      of the threads waiting to read from and to write to it. Registrations
+      are one-shot (EPOLLONESHOT, EV_ONESHOT), so the kernel reports a
+      descriptor once and then leaves it alone until we re-arm it, which we
+      only do while threads are waiting for it. We remember which events
+      are armed, so a thread that waits for an event that is already armed
+      costs no system call at all; otherwise it costs one epoll_ctl(). With
+      kqueue the changes are batched into the next kevent() call.
+
+      A thread that stops waiting (because it received an exception) is
+      just taken off its list: the kernel may report the descriptor once
+      more, and we then find no thread to wake and don't re-arm it.
+
+    * a heap of the threads in threadDelay, shared with the select() and
+      io_uring I/O managers (see Note [The timer heap]). The earliest
+      target gives the timeout of epoll_wait() (or kevent()).
+
+   Regular files can't be watched with epoll (epoll_ctl() fails with EPERM)
+   and some devices can't be watched with kqueue. Threads waiting for those,
+   and for descriptors the kernel calls bad, go on the fallback list, which
+   we check with poll() on every round, waiting for at most
+   EPOLL_FALLBACK_INTERVAL while it is not empty. A bad descriptor shows up
+   as POLLNVAL, and we throw blockedOnBadFD to the thread, as select() does.
+
+   The epoll instance is shared with the child of forkProcess, so the child
+   makes one of its own (initEPollAfterFork), once the threads waiting in
+   the parent's instance have been deleted. A kqueue is not inherited.
+
+   As with select(), a descriptor that is closed while threads wait for it
+   is not reported: the kernel forgets closed descriptors. (Waiting on a
+   descriptor another thread may close is a bug in any case; the threaded
+   RTS's I/O manager has closeFdWith for that.)
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "IOManagerInternals.h"
+
+#if defined(IOMGR_ENABLED_EPOLL)
+
+#include "Capability.h"
+#include "Prelude.h"
+#include "RaiseAsync.h"
+#include "RtsUtils.h"
+#include "Schedule.h"
+#include "Select.h"
+#include "Signals.h"
+#include "TimerHeap.h"
+#include "EPoll.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#define EPOLL_READ               1
+#define EPOLL_WRITE              2
+
+#define EPOLL_MIN_EVENTS         1024
+#define EPOLL_FALLBACK_INTERVAL  MSToTime(10)
+
+#if defined(HAVE_SYS_EPOLL_H)
+typedef struct epoll_event EPollEvent;
+#else
+typedef struct kevent EPollEvent;
+#endif
+
+static int
+newPollFd (void)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fd < 0) {
+        sysErrorBelch("epoll_create1");
+        stg_exit(EXIT_FAILURE);
+    }
+#else
+    int fd = kqueue();
+    if (fd < 0) {
+        sysErrorBelch("kqueue");
+        stg_exit(EXIT_FAILURE);
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+    return fd;
+}
+
+void
+initEPoll (EPoll *ep)
+{
+    ep->fd          = newPollFd();
+    ep->fds         = NULL;
+    ep->n_fds       = 0;
+    ep->n_waiting   = 0;
+    ep->fallback    = END_TSO_QUEUE;
+#if !defined(HAVE_SYS_EPOLL_H)
+    ep->changes      = NULL;
+    ep->n_changes    = 0;
+    ep->changes_size = 0;
+#endif
+    ep->events_size = EPOLL_MIN_EVENTS;
+    ep->events      = stgMallocBytes(EPOLL_MIN_EVENTS * sizeof(EPollEvent),
+                                     "initEPoll");
+}
+
+static void
+freeEPoll (EPoll *ep)
+{
+    stgFree(ep->fds);
+#if !defined(HAVE_SYS_EPOLL_H)
+    stgFree(ep->changes);
+#endif
+    stgFree(ep->events);
+}
+
+void
+exitEPoll (EPoll *ep)
+{
+    close(ep->fd);
+    freeEPoll(ep);
+}
+
+/* See Note [The epoll I/O manager]. */
+void
+initEPollAfterFork (EPoll *ep)
+{
+    ASSERT(ep->n_waiting == 0);
+#if defined(HAVE_SYS_EPOLL_H)
+    close(ep->fd);
+#endif
+    freeEPoll(ep);
+    initEPoll(ep);
+}
+
+void
+markEPoll (evac_fn evac, void *user, EPoll *ep)
+{
+    if (ep->n_waiting > 0) {
+        for (uint32_t i = 0; i < ep->n_fds; i++) {
+            EPollFd *f = &ep->fds[i];
+            if (f->readers != END_TSO_QUEUE) {
+                evac(user, (StgClosure **)(void *)&f->readers);
+            }
+            if (f->writers != END_TSO_QUEUE) {
+                evac(user, (StgClosure **)(void *)&f->writers);
+            }
+        }
+    }
+    evac(user, (StgClosure **)(void *)&ep->fallback);
+}
+
+bool
+anyPendingEPoll (EPoll *ep)
+{
+    return ep->n_waiting > 0
+        || ep->fallback != END_TSO_QUEUE;
+}
+
+/* -----------------------------------------------------------------------------
+   Waiting for descriptors
+   -------------------------------------------------------------------------- */
+
+static EPollFd *
+lookupFd (EPoll *ep, int fd)
+{
+    if ((uint32_t) fd >= ep->n_fds) {
+        uint32_t old = ep->n_fds;
+        uint32_t new = old == 0 ? 64 : old;
+        while (new <= (uint32_t) fd) {
+            new *= 2;
+        }
+        ep->fds = stgReallocBytes(ep->fds, new * sizeof(EPollFd), "lookupFd");
+        for (uint32_t i = old; i < new; i++) {
+            ep->fds[i].readers = END_TSO_QUEUE;
+            ep->fds[i].writers = END_TSO_QUEUE;
+            ep->fds[i].armed   = 0;
+        }
+        ep->n_fds = new;
+    }
+    return &ep->fds[fd];
+}
+
+static uint8_t
+wantedEvents (EPollFd *f)
+{
+    return (f->readers != END_TSO_QUEUE ? EPOLL_READ  : 0)
+         | (f->writers != END_TSO_QUEUE ? EPOLL_WRITE : 0);
+}
+
+#if defined(HAVE_SYS_EPOLL_H)
+
+/* Arm the descriptor for the given events, and only those. Returns false if
+ * epoll can't watch it.
+ */
+static bool
+armFd (EPoll *ep, int fd, uint8_t events)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLONESHOT
+               | (events & EPOLL_READ  ? EPOLLIN  : 0)
+               | (events & EPOLL_WRITE ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+
+    if (epoll_ctl(ep->fd, EPOLL_CTL_MOD, fd, &ev) == 0 ||
+        (errno == ENOENT && epoll_ctl(ep->fd, EPOLL_CTL_ADD, fd, &ev) == 0)) {
+        ep->fds[fd].armed = events;
+        return true;
+    }
+    switch (errno) {
+    case EPERM:   // a regular file, or a directory
+    case EBADF:
+        return false;
+    default:
+        sysErrorBelch("epoll_ctl");
+        stg_exit(EXIT_FAILURE);
+    }
+}
+
+#else
+
+static void
+queueChange (EPoll *ep, int fd, int16_t filter)
+{
+    if (ep->n_changes == ep->changes_size) {
+        ep->changes_size = ep->changes_size == 0 ? 64 : ep->changes_size * 2;
+        ep->changes = stgReallocBytes(ep->changes,
+                                      ep->changes_size * sizeof(struct kevent),
+                                      "queueChange");
+    }
+    EV_SET(&ep->changes[ep->n_changes], fd, filter,
+           EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    ep->n_changes++;
+}
+
+/* Queue the changes to arm the descriptor for the given events. kevent()
+ * reports any errors with them as events.
+ */
+static bool
+armFd (EPoll *ep, int fd, uint8_t events)
+{
+    EPollFd *f = &ep->fds[fd];
+    if ((events & EPOLL_READ) && !(f->armed & EPOLL_READ)) {
+        queueChange(ep, fd, EVFILT_READ);
+    }
+    if ((events & EPOLL_WRITE) && !(f->armed & EPOLL_WRITE)) {
+        queueChange(ep, fd, EVFILT_WRITE);
+    }
+    f->armed |= events;
+    return true;
+}
+
+#endif
+
+static void
+blockOn (Capability *cap, StgTSO *tso, StgTSO **queue, IOReadOrWrite rw,
+         HsInt fd)
+{
+    setTSOLink(cap, tso, *queue);
+    *queue = tso;
+    tso->block_info.fd = fd;
+    RELEASE_STORE(&tso->why_blocked, rw == IORead ? BlockedOnRead
+                                                  : BlockedOnWrite);
+}
+
+void
+epollWaitReady (Capability *cap, StgTSO *tso, IOReadOrWrite rw, HsInt fd)
+{
+    EPoll *ep = &cap->iomgr->epoll;
+    uint8_t event = rw == IORead ? EPOLL_READ : EPOLL_WRITE;
+
+    if (fd < 0 || fd > INT_MAX) {
+        // poll() will find it bad
+        blockOn(cap, tso, &ep->fallback, rw, fd);
+        return;
+    }
+
+    EPollFd *f = lookupFd(ep, (int) fd);
+    if (!(f->armed & event) && !armFd(ep, (int) fd, wantedEvents(f) | event)) {
+        blockOn(cap, tso, &ep->fallback, rw, fd);
+        return;
+    }
+    blockOn(cap, tso, rw == IORead ? &f->readers : &f->writers, rw, fd);
+    ep->n_waiting++;
+}
+
+static bool
+removeFromList (Capability *cap, StgTSO **queue, StgTSO *tso)
+{
+    StgTSO *prev = NULL;
+    for (StgTSO *t = *queue; t != END_TSO_QUEUE; prev = t, t = t->_link) {
+        if (t == tso) {
+            if (prev == NULL) {
+                *queue = t->_link;
+            } else {
+                setTSOLink(cap, prev, t->_link);
+            }
+            t->_link = END_TSO_QUEUE;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The thread stops waiting. See Note [The epoll I/O manager]. */
+void
+epollCancel (Capability *cap, StgTSO *tso)
+{
+    EPoll *ep = &cap->iomgr->epoll;
+    HsInt fd = tso->block_info.fd;
+
+    if (fd >= 0 && fd < (HsInt) ep->n_fds) {
+        EPollFd *f = &ep->fds[fd];
+        StgTSO **queue = tso->why_blocked == BlockedOnRead ? &f->readers
+                                                           : &f->writers;
+        if (removeFromList(cap, queue, tso)) {
+            ep->n_waiting--;
+            return;
+        }
+    }
+    if (!removeFromList(cap, &ep->fallback, tso)) {
+        barf("epollCancel: thread %" FMT_StgThreadID " not waiting", tso->id);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Waking threads
+   -------------------------------------------------------------------------- */
+
+static void
+wakeThread (Capability *cap, StgTSO *tso)
+{
+    IF_DEBUG(scheduler,
+        debugBelch("Waking up blocked thread %" FMT_StgThreadID "\n", tso->id));
+    tso->why_blocked = NotBlocked;
+    tso->_link = END_TSO_QUEUE;
+    appendToRunQueue(cap, tso);
+}
+
+static void
+wakeList (Capability *cap, EPoll *ep, StgTSO **queue)
+{
+    StgTSO *tso = *queue;
+    *queue = END_TSO_QUEUE;
+    while (tso != END_TSO_QUEUE) {
+        StgTSO *next = tso->_link;
+        wakeThread(cap, tso);
+        ep->n_waiting--;
+        tso = next;
+    }
+}
+
+/* Move the threads on a list to the fallback list. */
+static void
+fallBack (Capability *cap, EPoll *ep, StgTSO **queue)
+{
+    StgTSO *tso = *queue;
+    *queue = END_TSO_QUEUE;
+    while (tso != END_TSO_QUEUE) {
+        StgTSO *next = tso->_link;
+        setTSOLink(cap, tso, ep->fallback);
+        ep->fallback = tso;
+        ep->n_waiting--;
+        tso = next;
+    }
+}
+
+/* The kernel reported events on the descriptor, and has disarmed them. */
+static void
+fdReady (Capability *cap, EPoll *ep, int fd, uint8_t ready)
+{
+    if ((uint32_t) fd >= ep->n_fds) {
+        return;
+    }
+    EPollFd *f = &ep->fds[fd];
+#if defined(HAVE_SYS_EPOLL_H)
+    f->armed = 0;   // one-shot: the whole registration is disarmed
+#else
+    f->armed &= ~ready;
+#endif
+    if (ready & EPOLL_READ) {
+        wakeList(cap, ep, &f->readers);
+    }
+    if (ready & EPOLL_WRITE) {
+        wakeList(cap, ep, &f->writers);
+    }
+
+    // re-arm for the threads still waiting
+    uint8_t events = wantedEvents(f);
+    if ((events & ~f->armed) && !armFd(ep, fd, events)) {
+        fallBack(cap, ep, &f->readers);
+        fallBack(cap, ep, &f->writers);
+    }
+}
+
+/* Check the threads on the fallback list with poll(). */
+static bool
+pollFallback (Capability *cap, EPoll *ep)
+{
+    uint32_t n = 0;
+    for (StgTSO *t = ep->fallback; t != END_TSO_QUEUE; t = t->_link) {
+        n++;
+    }
+    if (n == 0) {
+        return false;
+    }
+
+    struct pollfd *pfds = stgMallocBytes(n * sizeof(struct pollfd),
+                                         "pollFallback");
+    uint32_t i = 0;
+    for (StgTSO *t = ep->fallback; t != END_TSO_QUEUE; t = t->_link, i++) {
+        HsInt fd = t->block_info.fd;
+        pfds[i].fd      = fd < 0 || fd > INT_MAX ? -1 : (int) fd;
+        pfds[i].events  = t->why_blocked == BlockedOnRead ? POLLIN : POLLOUT;
+        pfds[i].revents = 0;
+    }
+    while (poll(pfds, n, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            sysErrorBelch("poll");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+
+    bool woken = false;
+    StgTSO *t = ep->fallback;
+    StgTSO *prev = NULL;
+    ep->fallback = END_TSO_QUEUE;
+    for (i = 0; t != END_TSO_QUEUE; i++) {
+        StgTSO *next = t->_link;
+        if (pfds[i].fd < 0 || (pfds[i].revents & POLLNVAL)) {
+            // Don't let the thread wait for ever on a bad fd (#4934)
+            IF_DEBUG(scheduler,
+                debugBelch("Killing blocked thread %" FMT_StgThreadID
+                           " on bad fd=%i\n", t->id, pfds[i].fd));
+            t->_link = END_TSO_QUEUE;
+            raiseAsync(cap, t, (StgClosure *)blockedOnBadFD_closure,
+                       false, NULL);
+            woken = true;
+        } else if (pfds[i].revents != 0) {
+            wakeThread(cap, t);
+            woken = true;
+        } else {
+            // keep it, in order
+            if (prev == NULL) {
+                ep->fallback = t;
+            } else {
+                setTSOLink(cap, prev, t);
+            }
+            prev = t;
+        }
+        t = next;
+    }
+    if (prev != NULL) {
+        prev->_link = END_TSO_QUEUE;
+    }
+    stgFree(pfds);
+    return woken;
+}
+
+/* Ask the kernel for events, waiting for at most timeout (or for ever if it
+ * is negative), and wake the threads waiting for them. Returns false if we
+ * were interrupted by a signal.
+ */
+static bool
+waitEvents (Capability *cap, EPoll *ep, Time timeout)
+{
+    int n;
+
+#if defined(HAVE_SYS_EPOLL_H)
+    int ms = timeout < 0 ? -1
+           : timeout >= MSToTime(INT_MAX) ? INT_MAX
+           : (int) TimeToMS(timeout + MSToTime(1) - 1);   // round up
+    n = epoll_wait(ep->fd, ep->events, (int) ep->events_size, ms);
+#else
+    // Room for an error for each change, and some events
+    if (ep->events_size < ep->n_changes + EPOLL_MIN_EVENTS) {
+        ep->events_size = ep->n_changes + EPOLL_MIN_EVENTS;
+        stgFree(ep->events);
+        ep->events = stgMallocBytes(ep->events_size * sizeof(EPollEvent),
+                                    "waitEvents");
+    }
+    struct timespec ts, *pts = NULL;
+    if (timeout >= 0) {
+        // kevent() may reject long timeouts: wait for at most 31 days, as
+        // select() does, and then go round again
+        timeout = stg_min(timeout, SecondsToTime(2678400));
+        ts.tv_sec  = TimeToSeconds(timeout);
+        ts.tv_nsec = TimeToNS(timeout) % 1000000000;
+        pts = &ts;
+    }
+    n = kevent(ep->fd, ep->changes, (int) ep->n_changes,
+               ep->events, (int) ep->events_size, pts);
+    // The changes are made even if we are interrupted while waiting
+    if (n >= 0 || errno == EINTR) {
+        ep->n_changes = 0;
+    }
+#endif
+
+    if (n < 0) {
+        if (errno == EINTR) {
+            return false;
+        }
+#if defined(HAVE_SYS_EPOLL_H)
+        sysErrorBelch("epoll_wait");
+#else
+        sysErrorBelch("kevent");
+#endif
+        stg_exit(EXIT_FAILURE);
+    }
+
+    EPollEvent *events = ep->events;
+    for (int i = 0; i < n; i++) {
+#if defined(HAVE_SYS_EPOLL_H)
+        uint32_t e = events[i].events;
+        uint8_t ready = 0;
+        if (e & (EPOLLIN  | EPOLLERR | EPOLLHUP)) ready |= EPOLL_READ;
+        if (e & (EPOLLOUT | EPOLLERR | EPOLLHUP)) ready |= EPOLL_WRITE;
+        fdReady(cap, ep, events[i].data.fd, ready);
+#else
+        int fd = (int) events[i].ident;
+        uint8_t event = events[i].filter == EVFILT_READ ? EPOLL_READ
+                                                        : EPOLL_WRITE;
+        if (events[i].flags & EV_ERROR) {
+            // kqueue can't watch the descriptor: leave it to poll()
+            if ((uint32_t) fd < ep->n_fds) {
+                EPollFd *f = &ep->fds[fd];
+                f->armed &= ~event;
+                fallBack(cap, ep, event == EPOLL_READ ? &f->readers
+                                                      : &f->writers);
+            }
+        } else {
+            fdReady(cap, ep, fd, event);
+        }
+#endif
+    }
+    return true;
+}
+
+void
+awaitCompletedTimeoutsOrIOEPoll (Capability *cap, bool wait)
+{
+    CapIOManager *iomgr = cap->iomgr;
+    EPoll *ep = &iomgr->epoll;
+
+    do {
+        LowResTime now = getLowResTimeOfDay();
+        bool woken = wakeUpSleepingThreads(cap, now);
+        woken |= pollFallback(cap, ep);
+
+        Time timeout;
+        if (!wait || woken) {
+            timeout = 0;
+        } else {
+            timeout = -1;
+            if (!emptyTimerHeap(&iomgr->timers)) {
+                timeout = LowResTimeToTime(nextTimerTarget(&iomgr->timers) - now);
+            }
+            if (ep->fallback != END_TSO_QUEUE &&
+                (timeout < 0 || timeout > EPOLL_FALLBACK_INTERVAL)) {
+                timeout = EPOLL_FALLBACK_INTERVAL;
+            }
+        }
+
+        bool pending = ep->n_waiting > 0;
+#if !defined(HAVE_SYS_EPOLL_H)
+        pending = pending || ep->n_changes > 0;
+#endif
+        if ((pending || timeout != 0) && !waitEvents(cap, ep, timeout)) {
+            /* We got a signal; could be one of ours.  If so, we need
+             * to start up the signal handler straight away, otherwise
+             * we could block for a long time before the signal is
+             * serviced.
+             */
+#if defined(RTS_USER_SIGNALS)
+            if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
+                startSignalHandlers(cap);
+                return;
+            }
+#endif
+            if (getSchedState() >= SCHED_INTERRUPTING) {
+                return;
+            }
+        }
+    } while (wait && getSchedState() == SCHED_RUNNING && emptyRunQueue(cap));
+}
+
+#endif /* IOMGR_ENABLED_EPOLL */
@@ -0,0 +1,66 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Prototypes for functions in EPoll.c
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "IOManager.h"
+
+#include "BeginPrivate.h"
+
+#if defined(IOMGR_ENABLED_EPOLL)
+
+#if !defined(HAVE_SYS_EPOLL_H)
+struct kevent;
+#endif
+
+/* The threads waiting for a file descriptor. */
+typedef struct {
+    StgTSO   *readers;   // linked by _link
+    StgTSO   *writers;   // linked by _link
+    uint8_t   armed;     // EPOLL_READ/EPOLL_WRITE: events the kernel will report
+} EPollFd;
+
+/* The epoll (or kqueue) instance of a capability, and the threads waiting
+ * for it.
+ */
+typedef struct {
+    int         fd;           // the epoll or kqueue descriptor
+
+    EPollFd    *fds;          // indexed by file descriptor
+    uint32_t    n_fds;
+    uint32_t    n_waiting;    // threads on the readers/writers lists
+
+    // threads waiting for descriptors the kernel won't watch for us,
+    // e.g. regular files, which we check with poll()
+    StgTSO     *fallback;
+
+#if !defined(HAVE_SYS_EPOLL_H)
+    // kqueue: registrations not yet passed to kevent()
+    struct kevent *changes;
+    uint32_t    n_changes;
+    uint32_t    changes_size;
+#endif
+
+    void       *events;       // buffer for the events the kernel reports
+    uint32_t    events_size;
+} EPoll;
+
+void initEPoll (EPoll *ep);
+void exitEPoll (EPoll *ep);
+void initEPollAfterFork (EPoll *ep);
+void markEPoll (evac_fn evac, void *user, EPoll *ep);
+bool anyPendingEPoll (EPoll *ep);
+
+void epollWaitReady (Capability *cap, StgTSO *tso, IOReadOrWrite rw, HsInt fd);
+void epollCancel (Capability *cap, StgTSO *tso);
+
+void awaitCompletedTimeoutsOrIOEPoll (Capability *cap, bool wait);
+
+#endif /* IOMGR_ENABLED_EPOLL */
+
+#include "EndPrivate.h"
@@ -36,6 +36,10 @@
 #include <sys/time.h>
 #endif
 
+#if defined(x86_64_HOST_ARCH) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#endif
+
 #if defined(HAVE_GETTIMEOFDAY) && defined(HAVE_GETRUSAGE)
 // we'll implement getProcessCPUTime() and getProcessElapsedTime()
 // separately, using getrusage() and gettimeofday() respectively
@@ -143,8 +147,119 @@ Time getProcessCPUTime(void)
     }
 }
 
+/* -----------------------------------------------------------------------------
+   The TSC clock
+
+   Note [The TSC clock]
+   ~~~~~~~~~~~~~~~~~~~~
+   Everything the RTS times on the elapsed clock goes through
+   getMonotonicNSec: the eventlog's timestamps, the GC's start and end times
+   in the stats, the scheduler's time slices. clock_gettime is cheap where
+   the kernel answers it from the vDSO, as Linux does for CLOCK_MONOTONIC,
+   but it is still a call into the vDSO, a retry loop around the kernel's
+   sequence count and a conversion, for each of what can be millions of
+   events a second with +RTS -l.
+
+   On x86-64 the clock the vDSO reads is usually the TSC itself, so with
+   +RTS --tsc-clock we read it directly: one rdtsc, a multiply and a shift.
+   That is only right if the TSC ticks at a constant rate on every core,
+   whatever the core's frequency or power state, which CPUID reports as an
+   invariant TSC (leaf 0x80000007, EDX bit 8); without it we keep
+   clock_gettime and say so.
+
+   initTscClock, called once the flags are parsed and before there is any
+   other thread, calibrates the TSC against CLOCK_MONOTONIC by reading both
+   across a few milliseconds, and lines the two up: the TSC clock gives
+   CLOCK_MONOTONIC's time at calibration, and runs at the rate measured
+   from there, so the times taken before the flags were parsed (the start
+   of the RTS in the stats) still make sense against the ones taken after.
+   It doesn't follow the adjustments NTP makes to CLOCK_MONOTONIC's rate
+   afterwards, so over a long run the two clocks drift apart by a few parts
+   per million; that is fine for the stats and the eventlog, which only
+   compare times within the run, but it is why the TSC clock is not the
+   default.
+
+   The conversion is ns = tsc_base_ns + ((tsc - tsc_base) * tsc_mult) >> 32,
+   in 128 bits so that it doesn't overflow however long the program runs.
+   -------------------------------------------------------------------------- */
+
+#if defined(x86_64_HOST_ARCH) && defined(HAVE_CLOCK_GETTIME) \
+    && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_TSC_CLOCK 1
+
+static bool tsc_clock = false;
+static uint64_t tsc_base;
+static uint64_t tsc_base_ns;
+static uint64_t tsc_mult;
+
+// Calibrate over this long
+#define TSC_CALIBRATION_NS 5000000
+
+static bool haveInvariantTsc(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx)
+        || eax < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1 << 8)) != 0;
+}
+
+static inline StgWord64 getTscNSec(void)
+{
+    uint64_t ticks = __builtin_ia32_rdtsc() - tsc_base;
+    return tsc_base_ns
+        + (uint64_t)(((unsigned __int128)ticks * tsc_mult) >> 32);
+}
+#endif
+
+void initTscClock(void)
+{
+#if defined(HAVE_TSC_CLOCK)
+    if (!haveInvariantTsc()) {
+        errorBelch("warning: --tsc-clock: this CPU has no invariant TSC, "
+                   "using clock_gettime");
+        return;
+    }
+
+    // Take the TSC right after CLOCK_MONOTONIC changes, at both ends, so
+    // that each pair is read as close together as we can manage.
+    uint64_t ns0 = getClockTime(CLOCK_ID), ns1, tsc0, tsc1;
+    do {
+        tsc0 = __builtin_ia32_rdtsc();
+        ns1 = getClockTime(CLOCK_ID);
+    } while (ns1 == ns0);
+    ns0 = ns1;
+    do {
+        tsc1 = __builtin_ia32_rdtsc();
+        ns1 = getClockTime(CLOCK_ID);
+    } while (ns1 - ns0 < TSC_CALIBRATION_NS);
+
+    if (tsc1 <= tsc0) {
+        errorBelch("warning: --tsc-clock: the TSC isn't counting, "
+                   "using clock_gettime");
+        return;
+    }
+    tsc_mult = (uint64_t)(((unsigned __int128)(ns1 - ns0) << 32)
+                          / (tsc1 - tsc0));
+    tsc_base = tsc1;
+    tsc_base_ns = ns1;
+    tsc_clock = true;
+#else
+    errorBelch("warning: --tsc-clock is not supported on this platform, "
+               "using the system clock");
+#endif
+}
+
 StgWord64 getMonotonicNSec(void)
 {
+#if defined(HAVE_TSC_CLOCK)
+    if (tsc_clock) {
+        return getTscNSec();
+    }
+#endif
+
 #if defined(HAVE_CLOCK_GETTIME)
     return getClockTime(CLOCK_ID);
 
@@ -181,6 +296,12 @@ void getProcessTimes(Time *user, Time *elapsed)
 
 // we'll use the old times() API.
 
+void initTscClock(void)
+{
+    errorBelch("warning: --tsc-clock is not supported on this platform, "
+               "using the system clock");
+}
+
 Time getProcessCPUTime(void)
 {
     Time user, elapsed;
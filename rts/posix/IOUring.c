@@ -0,0 +1,557 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * An I/O manager for the non-threaded RTS on Linux, using io_uring.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [The io_uring I/O manager]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The select() I/O manager (posix/Select.c) is readiness based: a thread
+   that finds a file descriptor not ready blocks in waitRead#/waitWrite#,
+   the scheduler calls select() with all the descriptors threads wait for,
+   and the woken threads then make the read or write system call
+   themselves. Each of those costs a system call, and select() itself costs
+   time linear in the number of waiting threads.
+
+   The uring I/O manager (+RTS --io-manager=uring) instead keeps an io_uring
+   instance for the capability, in its CapIOManager. A thread that blocks
+   writes a submission queue entry (SQE) into the ring shared with the kernel
+   and is parked in a slot of ring->slots, whose index is the user_data of
+   the SQE. Writing the SQE is just a store to memory: SQEs are handed to the
+   kernel in batches by a single io_uring_enter call, and completions (CQEs)
+   are read back from the completion ring without any system call at all.
+   So a program with thousands of threads doing socket I/O makes a handful
+   of system calls per round of the scheduler rather than one per operation.
+
+   There are two kinds of operation:
+
+    * URING_WAIT_READY: waitRead#/waitWrite#, submitted as IORING_OP_POLL_ADD.
+      This keeps the existing I/O code in base working unchanged. The
+      thread is woken when the CQE arrives, and makes the system call.
+
+    * URING_TRANSFER: the uringRead#, uringWrite# and uringAccept# primops,
+      submitted as IORING_OP_READ, IORING_OP_WRITE and IORING_OP_ACCEPT.
+      These are completion based: the kernel does the I/O, and the CQE
+      carries its result (a count, a new descriptor, or -errno). The primop
+      blocks with a stg_block_io_result frame on top of the stack, and we
+      store the result in that frame before waking the thread, which then
+      returns it; much as we hand values to threads blocked on MVars.
+
+   The scheduler calls awaitCompletedTimeoutsOrIOURing through
+   pollCompletedTimeoutsOrIO after every thread it runs while other threads
+   are runnable, and through awaitCompletedTimeoutsOrIO when it has nothing
+   to run. Polling reaps the completion ring, but only submits queued SQEs
+   once URING_SUBMIT_BATCH have accumulated or the oldest has waited
+   URING_SUBMIT_DELAY, so that the SQEs of many threads go in one call.
+   Waiting submits everything and waits for a completion in the same
+   io_uring_enter call, with the sleeping queue of threadDelay (shared with
+   the select() I/O manager) giving the timeout.
+
+   If a thread waiting for an operation receives an exception, uringCancel
+   forgets the thread and asks for the operation to be cancelled, with an
+   IORING_OP_ASYNC_CANCEL naming its slot. The slot is only freed once both
+   the operation and the cancellation have completed, lest the cancellation
+   hit the next operation to use the slot. Writing the cancellation SQE is
+   deferred to the next round of the scheduler, so that uringCancel never
+   writes the shared rings: it is called in the child of forkProcess, which
+   shares the ring memory with its parent until initURingAfterFork gives it
+   a ring of its own. The operation may still complete, and for a transfer
+   that means the kernel may still read or write the buffer: a buffer passed
+   to uringRead# or uringWrite# must stay valid until the operation
+   completes even if the thread is interrupted.
+
+   The ring is set up with URING_ENTRIES entries; a full submission queue is
+   submitted straight away. The number of operations in flight is not
+   limited: the slot table grows as needed, and the kernel does not drop
+   completions that do not fit in the completion ring (IORING_FEAT_NODROP);
+   we flush them when it tells us they overflowed. We need Linux 5.11 or
+   later, for the timeout argument of io_uring_enter (IORING_FEAT_EXT_ARG).
+*/
+
+/* Not rts/PosixSource.h: we need syscall(2) and MAP_POPULATE. */
+#include "Rts.h"
+
+#include "IOManagerInternals.h"
+
+#if defined(IOMGR_ENABLED_URING)
+
+#include "Capability.h"
+#include "Prelude.h"
+#include "RaiseAsync.h"
+#include "RtsUtils.h"
+#include "Schedule.h"
+#include "Select.h"
+#include "Signals.h"
+#include "TimerHeap.h"
+#include "IOUring.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES       4096
+#define URING_SUBMIT_BATCH  64
+#define URING_SUBMIT_DELAY  USToTime(50)
+
+#define URING_NO_SLOT       ((uint32_t)-1)
+#define URING_CANCEL_BIT    ((uint64_t)1 << 63)  // in the user_data of cancellations
+
+#define URING_WAIT_READY    0
+#define URING_TRANSFER      1
+
+static int
+uringEnter (URing *ring, uint32_t to_submit, uint32_t min_complete,
+            uint32_t flags, struct io_uring_getevents_arg *arg)
+{
+    if (arg != NULL) {
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    return (int) syscall(__NR_io_uring_enter, ring->fd, to_submit,
+                         min_complete, flags, arg,
+                         arg != NULL ? sizeof(*arg) : 0);
+}
+
+void
+initURing (URing *ring)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) {
+        sysErrorBelch("io_uring_setup");
+        errorBelch("the uring I/O manager is not available on this system");
+        stg_exit(EXIT_FAILURE);
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(p.features & IORING_FEAT_NODROP) ||
+        !(p.features & IORING_FEAT_EXT_ARG)) {
+        errorBelch("the uring I/O manager needs Linux 5.11 or later");
+        stg_exit(EXIT_FAILURE);
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_mem = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->ring_mem == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        sysErrorBelch("initURing: mmap");
+        stg_exit(EXIT_FAILURE);
+    }
+
+    char *mem = ring->ring_mem;
+    ring->fd         = fd;
+    ring->sq_head    = (uint32_t *) (mem + p.sq_off.head);
+    ring->sq_tail    = (uint32_t *) (mem + p.sq_off.tail);
+    ring->sq_flags   = (uint32_t *) (mem + p.sq_off.flags);
+    ring->sq_array   = (uint32_t *) (mem + p.sq_off.array);
+    ring->sq_mask    = *(uint32_t *) (mem + p.sq_off.ring_mask);
+    ring->sq_entries = p.sq_entries;
+    ring->sq_queued  = 0;
+    ring->cq_head    = (uint32_t *) (mem + p.cq_off.head);
+    ring->cq_tail    = (uint32_t *) (mem + p.cq_off.tail);
+    ring->cq_mask    = *(uint32_t *) (mem + p.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe *) (mem + p.cq_off.cqes);
+
+    // SQE i always goes in entry i of the submission queue
+    for (uint32_t i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+
+    ring->slots     = NULL;
+    ring->n_slots   = 0;
+    ring->free_slot = URING_NO_SLOT;
+    ring->n_waiting = 0;
+    ring->n_cancel  = 0;
+}
+
+static void
+unmapURing (URing *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    munmap(ring->ring_mem, ring->ring_size);
+    close(ring->fd);
+}
+
+void
+exitURing (URing *ring)
+{
+    unmapURing(ring);
+    stgFree(ring->slots);
+    ring->slots = NULL;
+}
+
+/* The child of forkProcess shares the ring with its parent, and must not
+ * touch it: the operations in flight are the parent's. By now the threads
+ * waiting for them have been deleted, so we drop the slots, and start
+ * afresh with a ring of our own.
+ */
+void
+initURingAfterFork (URing *ring)
+{
+    unmapURing(ring);
+    stgFree(ring->slots);
+    initURing(ring);
+}
+
+void
+markURing (evac_fn evac, void *user, URing *ring)
+{
+    for (uint32_t i = 0; i < ring->n_slots; i++) {
+        if (ring->slots[i].tso != NULL) {
+            evac(user, (StgClosure **)(void *)&ring->slots[i].tso);
+        }
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Slots
+   -------------------------------------------------------------------------- */
+
+static uint32_t
+allocSlot (URing *ring, StgTSO *tso, uint8_t kind)
+{
+    if (ring->free_slot == URING_NO_SLOT) {
+        uint32_t old = ring->n_slots;
+        uint32_t new = old == 0 ? URING_ENTRIES : old * 2;
+        ring->slots = stgReallocBytes(ring->slots, new * sizeof(URingSlot),
+                                      "allocSlot");
+        for (uint32_t i = old; i < new; i++) {
+            ring->slots[i].tso  = NULL;
+            ring->slots[i].next = i + 1 < new ? i + 1 : URING_NO_SLOT;
+        }
+        ring->n_slots = new;
+        ring->free_slot = old;
+    }
+    uint32_t i = ring->free_slot;
+    URingSlot *slot = &ring->slots[i];
+    ring->free_slot = slot->next;
+    slot->tso    = tso;
+    slot->kind   = kind;
+    slot->cancel = false;
+    slot->cqes   = 1;
+    ring->n_waiting++;
+    return i;
+}
+
+/* One of the CQEs for the slot has arrived. */
+static void
+releaseSlot (URing *ring, uint32_t i)
+{
+    URingSlot *slot = &ring->slots[i];
+    ASSERT(slot->tso == NULL && slot->cqes > 0);
+    if (--slot->cqes > 0) {
+        return;
+    }
+    if (slot->cancel) {
+        // the operation completed before we got round to cancelling it
+        slot->cancel = false;
+        ring->n_cancel--;
+    }
+    slot->next = ring->free_slot;
+    ring->free_slot = i;
+}
+
+/* -----------------------------------------------------------------------------
+   Submission
+   -------------------------------------------------------------------------- */
+
+/* Hand the queued SQEs to the kernel, and optionally wait for a completion
+ * (or the timeout in arg, or a signal) at the same time.
+ */
+static void
+submit (URing *ring, uint32_t min_complete,
+        struct io_uring_getevents_arg *arg)
+{
+    uint32_t flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    if (ring->sq_queued == 0 && min_complete == 0) {
+        return;
+    }
+
+    int r = uringEnter(ring, ring->sq_queued, min_complete, flags, arg);
+    if (r < 0) {
+        switch (errno) {
+        case EINTR:
+        case ETIME:
+            // a signal arrived, or the timeout expired, before anything
+            // was submitted or completed
+            return;
+        case EAGAIN:
+        case EBUSY:
+            // the kernel is short of memory for the SQEs, or completions
+            // it could not post are piling up: try again after we've
+            // reaped some
+            return;
+        default:
+            sysErrorBelch("io_uring_enter");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+    ring->sq_queued -= stg_min((uint32_t) r, ring->sq_queued);
+}
+
+static bool reap (Capability *cap, URing *ring);
+
+static struct io_uring_sqe *
+getSQE (Capability *cap, URing *ring)
+{
+    uint32_t tail = *ring->sq_tail;
+    while (tail - ACQUIRE_LOAD_ALWAYS(ring->sq_head) >= ring->sq_entries) {
+        // the submission queue is full
+        uint32_t queued = ring->sq_queued;
+        submit(ring, 0, NULL);
+        if (ring->sq_queued == queued) {
+            reap(cap, ring);
+        }
+    }
+    if (ring->sq_queued == 0) {
+        ring->sq_queued_at = getProcessElapsedTime();
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void
+queueSQE (URing *ring)
+{
+    RELEASE_STORE_ALWAYS(ring->sq_tail, *ring->sq_tail + 1);
+    ring->sq_queued++;
+}
+
+static void
+queueCancellations (Capability *cap, URing *ring)
+{
+    for (uint32_t i = 0; ring->n_cancel > 0 && i < ring->n_slots; i++) {
+        URingSlot *slot = &ring->slots[i];
+        if (slot->cancel) {
+            slot->cancel = false;
+            slot->cqes++;
+            ring->n_cancel--;
+            struct io_uring_sqe *sqe = getSQE(cap, ring);
+            sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+            sqe->fd        = -1;
+            sqe->addr      = i;
+            sqe->user_data = i | URING_CANCEL_BIT;
+            queueSQE(ring);
+        }
+    }
+}
+
+static void
+blockOn (StgTSO *tso, IOReadOrWrite rw, HsInt fd)
+{
+    tso->block_info.fd = fd;
+    RELEASE_STORE(&tso->why_blocked, rw == IORead ? BlockedOnRead
+                                                  : BlockedOnWrite);
+}
+
+void
+uringWaitReady (Capability *cap, StgTSO *tso, IOReadOrWrite rw, HsInt fd)
+{
+    URing *ring = &cap->iomgr->ring;
+    struct io_uring_sqe *sqe = getSQE(cap, ring);
+    sqe->opcode      = IORING_OP_POLL_ADD;
+    sqe->fd          = (int32_t) fd;
+    sqe->poll32_events = rw == IORead ? POLLIN : POLLOUT;
+    sqe->user_data   = allocSlot(ring, tso, URING_WAIT_READY);
+    queueSQE(ring);
+    blockOn(tso, rw, fd);
+}
+
+HsInt
+uringTransfer (Capability *cap, StgTSO *tso, IOReadOrWrite rw,
+               HsInt fd, void *buf, HsWord len, HsInt off)
+{
+    URing *ring = &cap->iomgr->ring;
+    struct io_uring_sqe *sqe = getSQE(cap, ring);
+    sqe->opcode    = rw == IORead ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd        = (int32_t) fd;
+    sqe->addr      = (uint64_t) (uintptr_t) buf;
+    sqe->len       = (uint32_t) (len > UINT32_MAX ? UINT32_MAX : len);
+    sqe->off       = (uint64_t) (int64_t) off;
+    sqe->user_data = allocSlot(ring, tso, URING_TRANSFER);
+    queueSQE(ring);
+    blockOn(tso, rw, fd);
+    return 0;
+}
+
+HsInt
+uringAccept (Capability *cap, StgTSO *tso,
+             HsInt fd, void *addr, void *addrlen)
+{
+    URing *ring = &cap->iomgr->ring;
+    struct io_uring_sqe *sqe = getSQE(cap, ring);
+    sqe->opcode    = IORING_OP_ACCEPT;
+    sqe->fd        = (int32_t) fd;
+    sqe->addr      = (uint64_t) (uintptr_t) addr;
+    sqe->addr2     = (uint64_t) (uintptr_t) addrlen;
+    sqe->user_data = allocSlot(ring, tso, URING_TRANSFER);
+    queueSQE(ring);
+    blockOn(tso, IORead, fd);
+    return 0;
+}
+
+/* The thread stops waiting, typically because it received an exception.
+ * See Note [The io_uring I/O manager].
+ */
+void
+uringCancel (Capability *cap, StgTSO *tso)
+{
+    URing *ring = &cap->iomgr->ring;
+    for (uint32_t i = 0; i < ring->n_slots; i++) {
+        URingSlot *slot = &ring->slots[i];
+        if (slot->tso == tso) {
+            slot->tso = NULL;
+            slot->cancel = true;
+            ring->n_waiting--;
+            ring->n_cancel++;
+            return;
+        }
+    }
+    barf("uringCancel: thread %" FMT_StgThreadID " not waiting", tso->id);
+}
+
+/* -----------------------------------------------------------------------------
+   Completion
+   -------------------------------------------------------------------------- */
+
+static void
+complete (Capability *cap, URing *ring, uint64_t user_data, int32_t res)
+{
+    uint32_t i = (uint32_t) (user_data & ~URING_CANCEL_BIT);
+    ASSERT(i < ring->n_slots);
+    URingSlot *slot = &ring->slots[i];
+    StgTSO *tso = slot->tso;
+    uint8_t kind = slot->kind;
+
+    if (user_data & URING_CANCEL_BIT || tso == NULL) {
+        // a cancellation, or an operation the thread stopped waiting for:
+        // see uringCancel
+        releaseSlot(ring, i);
+        return;
+    }
+
+    slot->tso = NULL;
+    ring->n_waiting--;
+    releaseSlot(ring, i);
+
+    if (kind == URING_WAIT_READY && res == -EBADF) {
+        // Don't let the thread wait for ever on a bad fd (#4934)
+        IF_DEBUG(scheduler,
+            debugBelch("Killing blocked thread %" FMT_StgThreadID
+                       " on bad fd=%i\n", tso->id, (int) tso->block_info.fd));
+        raiseAsync(cap, tso, (StgClosure *)blockedOnBadFD_closure, false, NULL);
+        return;
+    }
+
+    if (kind == URING_TRANSFER) {
+        StgStack *stack = tso->stackobj;
+        ASSERT(stack->sp[0] == (StgWord)&stg_block_io_result_info);
+        stack->sp[1] = (StgWord) (StgInt) res;
+    }
+
+    IF_DEBUG(scheduler,
+        debugBelch("Waking up blocked thread %" FMT_StgThreadID "\n", tso->id));
+    tso->why_blocked = NotBlocked;
+    tso->_link = END_TSO_QUEUE;
+    appendToRunQueue(cap, tso);
+}
+
+/* Process the CQEs in the completion ring. Returns whether any thread was
+ * woken.
+ */
+static bool
+reap (Capability *cap, URing *ring)
+{
+    bool woken = false;
+
+    if (ACQUIRE_LOAD_ALWAYS(ring->sq_flags) & IORING_SQ_CQ_OVERFLOW) {
+        // the kernel is holding completions that did not fit: have them
+        // posted
+        uringEnter(ring, 0, 0, IORING_ENTER_GETEVENTS, NULL);
+    }
+
+    uint32_t head = *ring->cq_head;
+    uint32_t tail = ACQUIRE_LOAD_ALWAYS(ring->cq_tail);
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        uint32_t waiting = ring->n_waiting;
+        complete(cap, ring, cqe->user_data, cqe->res);
+        woken |= ring->n_waiting < waiting;
+    }
+    RELEASE_STORE_ALWAYS(ring->cq_head, head);
+    return woken;
+}
+
+void
+awaitCompletedTimeoutsOrIOURing (Capability *cap, bool wait)
+{
+    CapIOManager *iomgr = cap->iomgr;
+    URing *ring = &iomgr->ring;
+
+    queueCancellations(cap, ring);
+
+    if (!wait) {
+        if (ring->sq_queued >= URING_SUBMIT_BATCH ||
+            (ring->sq_queued > 0 &&
+             getProcessElapsedTime() - ring->sq_queued_at >= URING_SUBMIT_DELAY)) {
+            submit(ring, 0, NULL);
+        }
+        wakeUpSleepingThreads(cap, getLowResTimeOfDay());
+        reap(cap, ring);
+        return;
+    }
+
+    do {
+        LowResTime now = getLowResTimeOfDay();
+        bool woken = wakeUpSleepingThreads(cap, now);
+        woken |= reap(cap, ring);
+        if (woken) {
+            submit(ring, 0, NULL);
+            return;
+        }
+
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (!emptyTimerHeap(&iomgr->timers)) {
+            Time t = LowResTimeToTime(nextTimerTarget(&iomgr->timers) - now);
+            ts.tv_sec  = TimeToSeconds(t);
+            ts.tv_nsec = TimeToNS(t) % 1000000000;
+            arg.ts = (uint64_t) (uintptr_t) &ts;
+        }
+
+        submit(ring, 1, arg.ts != 0 ? &arg : NULL);
+
+        /* We may have got a signal; could be one of ours.  If so, we need
+         * to start up the signal handler straight away, otherwise we could
+         * block for a long time before the signal is serviced. We can't
+         * rely on io_uring_enter failing with EINTR: it doesn't if it
+         * submitted anything.
+         */
+#if defined(RTS_USER_SIGNALS)
+        if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
+            startSignalHandlers(cap);
+            return;
+        }
+#endif
+        if (getSchedState() >= SCHED_INTERRUPTING) {
+            return;
+        }
+    } while (getSchedState() == SCHED_RUNNING && emptyRunQueue(cap));
+}
+
+#endif /* IOMGR_ENABLED_URING */
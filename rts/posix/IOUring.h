@@ -0,0 +1,79 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Prototypes for functions in IOUring.c
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "IOManager.h"
+
+#include "BeginPrivate.h"
+
+#if defined(IOMGR_ENABLED_URING)
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/* A thread waiting for an operation it submitted to the ring. The index of
+ * the slot is the user_data of the SQE, and so of its CQE.
+ */
+typedef struct {
+    StgTSO   *tso;      // NULL if free, or if the thread stopped waiting
+    uint32_t  next;     // the next free slot, if free
+    uint8_t   kind;     // URING_WAIT_READY or URING_TRANSFER
+    uint8_t   cqes;     // CQEs still to come for the slot
+    bool      cancel;   // cancel the operation at the next submission
+} URingSlot;
+
+/* The submission and completion rings of a capability, shared with the
+ * kernel, and the threads waiting for operations submitted to them.
+ */
+typedef struct {
+    int fd;
+
+    // The submission queue. We write SQEs at the tail, the kernel consumes
+    // them from the head.
+    uint32_t *sq_head, *sq_tail, *sq_flags, *sq_array;
+    uint32_t  sq_mask, sq_entries;
+    struct io_uring_sqe *sqes;
+    uint32_t  sq_queued;     // SQEs written but not yet submitted
+    Time      sq_queued_at;  // when the oldest of them was written
+
+    // The completion queue. The kernel writes CQEs at the tail, we consume
+    // them from the head.
+    uint32_t *cq_head, *cq_tail;
+    uint32_t  cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void     *ring_mem;
+    size_t    ring_size;
+    size_t    sqes_size;
+
+    // Operations in flight, indexed by user_data
+    URingSlot *slots;
+    uint32_t   n_slots;
+    uint32_t   free_slot;
+    uint32_t   n_waiting;    // slots with a thread waiting
+    uint32_t   n_cancel;     // slots with cancel set
+} URing;
+
+void initURing (URing *ring);
+void exitURing (URing *ring);
+void initURingAfterFork (URing *ring);
+void markURing (evac_fn evac, void *user, URing *ring);
+
+void uringWaitReady (Capability *cap, StgTSO *tso, IOReadOrWrite rw, HsInt fd);
+HsInt uringTransfer (Capability *cap, StgTSO *tso, IOReadOrWrite rw,
+                     HsInt fd, void *buf, HsWord len, HsInt off);
+HsInt uringAccept (Capability *cap, StgTSO *tso,
+                   HsInt fd, void *addr, void *addrlen);
+void uringCancel (Capability *cap, StgTSO *tso);
+
+void awaitCompletedTimeoutsOrIOURing (Capability *cap, bool wait);
+
+#endif /* IOMGR_ENABLED_URING */
+
+#include "EndPrivate.h"
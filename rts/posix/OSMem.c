@@ -24,6 +24,9 @@
 #if defined(HAVE_SYS_MMAN_H)
 #include <sys/mman.h>
 #endif
+#if defined(HAVE_SYS_STAT_H)
+#include <sys/stat.h>
+#endif
 #if defined(HAVE_STRING_H)
 #include <string.h>
 #endif
@@ -382,6 +385,34 @@ void osBindMBlocksToNode(
 }
 
 
+bool osMapFileMemory(void *at, W_ size, int fd, StgWord64 offset)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+        || (StgWord64) st.st_size < offset + size) {
+        return false;
+    }
+
+    void *r = mmap(at, roundUpToPage(size), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED, fd, (off_t) offset);
+    if (r == MAP_FAILED) {
+        // A failed MAP_FIXED mapping may have taken the old one away
+        osUnmapFileMemory(at, size);
+        return false;
+    }
+    return true;
+}
+
+void osUnmapFileMemory(void *at, W_ size)
+{
+    void *r = mmap(at, roundUpToPage(size), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED | MAP_ANON, -1, 0);
+    if (r == MAP_FAILED) {
+        sysErrorBelch("unable to remap %" FMT_Word " bytes at %p", size, at);
+        stg_exit(EXIT_FAILURE);
+    }
+}
+
 void osFreeMBlocks(void *addr, uint32_t n)
 {
     munmap(addr, n * MBLOCK_SIZE);
@@ -419,6 +450,34 @@ size_t getPageSize (void)
     return pageSize;
 }
 
+#if defined(USE_LARGE_ADDRESS_SPACE)
+W_ osHugePageSize (void)
+{
+#if defined(MADV_HUGEPAGE)
+    static W_ hugePageSize = 0;
+
+    if (hugePageSize == 0) {
+        hugePageSize = 2 * 1024 * 1024;
+# if defined(linux_HOST_OS)
+        FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+        if (f != NULL) {
+            unsigned long size;
+            if (fscanf(f, "%lu", &size) == 1 && size > 0
+                && (size & (size - 1)) == 0) {
+                hugePageSize = size;
+            }
+            fclose(f);
+        }
+# endif
+    }
+
+    return hugePageSize;
+#else
+    return 0;
+#endif
+}
+#endif
+
 /* Returns 0 if physical memory size cannot be identified */
 StgWord64 getPhysicalMemorySize (void)
 {
@@ -457,37 +516,41 @@ StgWord64 getPhysicalMemorySize (void)
 
 #if defined(USE_LARGE_ADDRESS_SPACE)
 
+// With -xH we align the heap on a 1GB boundary, so that it can be backed by
+// 2MB and 1GB pages alike. Reserving the extra address space costs nothing,
+// as we release the slop straight away.
+#define HUGE_PAGE_HEAP_ALIGN ((W_)1 << 30)
+
 static void *
 osTryReserveHeapMemory (W_ len, void *hint)
 {
     void *base, *top;
     void *start, *end;
+    W_ align = MBLOCK_SIZE;
 
     ASSERT((len & ~MBLOCK_MASK) == len);
 
-    /* We try to allocate len + MBLOCK_SIZE,
-       because we need memory which is MBLOCK_SIZE aligned,
+    if (RtsFlags.GcFlags.hugePages && osHugePageSize() != 0) {
+        align = stg_max(HUGE_PAGE_HEAP_ALIGN, osHugePageSize());
+    }
+
+    /* We try to allocate len + align,
+       because we need memory which is aligned,
        and then we discard what we don't need */
 
-    base = my_mmap(hint, len + MBLOCK_SIZE, MEM_RESERVE);
+    base = my_mmap(hint, len + align, MEM_RESERVE);
     if (base == NULL)
         return NULL;
 
-    top = (void*)((W_)base + len + MBLOCK_SIZE);
-
-    if (((W_)base & MBLOCK_MASK) != 0) {
-        start = MBLOCK_ROUND_UP(base);
-        end = MBLOCK_ROUND_DOWN(top);
-        ASSERT(((W_)end - (W_)start) == len);
+    top = (void*)((W_)base + len + align);
+    start = (void*)roundUpToAlign((W_)base, align);
+    end = (void*)((W_)start + len);
 
-        if (munmap(base, (W_)start-(W_)base) < 0) {
-            sysErrorBelch("unable to release slop before heap");
-        }
-        if (munmap(end, (W_)top-(W_)end) < 0) {
-            sysErrorBelch("unable to release slop after heap");
-        }
-    } else {
-        start = base;
+    if (start != base && munmap(base, (W_)start-(W_)base) < 0) {
+        sysErrorBelch("unable to release slop before heap");
+    }
+    if (end != top && munmap(end, (W_)top-(W_)end) < 0) {
+        sysErrorBelch("unable to release slop after heap");
     }
 
     return start;
@@ -634,6 +697,17 @@ void osCommitMemory(void *at, W_ size)
         errorBelch("Exiting. The system might be out of memory.");
         stg_exit(EXIT_FAILURE);
     }
+
+#if defined(MADV_HUGEPAGE)
+    if (RtsFlags.GcFlags.hugePages) {
+        static bool warned = false;
+        if (madvise(at, size, MADV_HUGEPAGE) < 0 && !warned) {
+            // e.g. EINVAL if the kernel was built without THP support
+            sysErrorBelch("warning: unable to use transparent huge pages");
+            warned = true;
+        }
+    }
+#endif
 }
 
 /* Note [MADV_FREE and MADV_DONTNEED]
@@ -738,6 +812,19 @@ uint32_t osNumaNodes(void)
 #endif
 }
 
+uint32_t osNumaDistance(uint32_t from, uint32_t to)
+{
+#if HAVE_LIBNUMA
+    // numa_distance reads /sys/devices/system/node/node<n>/distance, and
+    // returns 0 if the distance could not be determined.
+    int d = numa_distance(from, to);
+    if (d > 0) {
+        return d;
+    }
+#endif
+    return from == to ? 10 : 20;
+}
+
 uint64_t osNumaMask(void)
 {
 #if HAVE_LIBNUMA
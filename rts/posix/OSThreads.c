@@ -429,6 +429,69 @@ uint32_t getNumberOfProcessors (void)
 
 #endif /* defined(THREADED_RTS) */
 
+static int32_t cpu_quota_cache = -1;
+
+// Get the CPU quota of our cgroup, in CPUs rounded up, or 0 if there is none.
+// A container sees its own cgroup at the root of /sys/fs/cgroup, in the
+// cgroup v2 (unified) hierarchy or the v1 cpu controller. CPU sets need no
+// special treatment: they restrict our affinity mask, which
+// getNumberOfProcessors already counts.
+uint32_t
+getCPUQuota (void)
+{
+    int32_t quota = RELAXED_LOAD(&cpu_quota_cache);
+    if (quota < 0) {
+        quota = 0;
+#if defined(linux_HOST_OS)
+        long long q = -1, period = -1;
+
+        // cgroup v2: "<quota> <period>", or "max <period>"
+        FILE *f = fopen("/sys/fs/cgroup/cpu.max", "r");
+        if (f != NULL) {
+            if (fscanf(f, "%lld %lld", &q, &period) != 2) {
+                q = -1;
+            }
+            fclose(f);
+        } else {
+            // cgroup v1, where -1 means no quota
+            f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+            if (f != NULL) {
+                if (fscanf(f, "%lld", &q) != 1) {
+                    q = -1;
+                }
+                fclose(f);
+            }
+            f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+            if (f != NULL) {
+                if (fscanf(f, "%lld", &period) != 1) {
+                    period = -1;
+                }
+                fclose(f);
+            }
+        }
+
+        if (q > 0 && period > 0) {
+            quota = (int32_t) stg_max((q + period - 1) / period, 1);
+        }
+#endif
+        RELAXED_STORE(&cpu_quota_cache, quota);
+    }
+    return (uint32_t) quota;
+}
+
+// The number of CPUs we can make use of: the processors we may run on,
+// capped by our CPU quota. This is the default for -N.
+uint32_t
+getNumberOfUsableProcessors (void)
+{
+    uint32_t n = getNumberOfProcessors();
+    const uint32_t quota = getCPUQuota();
+    if (quota != 0 && quota < n) {
+        n = quota;
+    }
+    return n;
+}
+
 #if defined(HAVE_SCHED_H) && defined(HAVE_SCHED_SETAFFINITY)
 // Schedules the thread to run on CPU n of m.  m may be less than the
 // number of physical CPUs, in which case, the thread will be allowed
@@ -448,6 +511,28 @@ setThreadAffinity (uint32_t n, uint32_t m)
     sched_setaffinity(0, sizeof(cpu_set_t), &cs);
 }
 
+// Lets the thread run on the given CPUs only, or on any CPU if n_cpus is 0.
+void
+setThreadAffinityToCPUs (const uint32_t *cpus, uint32_t n_cpus)
+{
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    if (n_cpus == 0) {
+        // CPUs outside our cpuset are ignored
+        for (uint32_t i = 0; i < CPU_SETSIZE; i++) {
+            CPU_SET(i, &cs);
+        }
+    }
+    for (uint32_t i = 0; i < n_cpus; i++) {
+        if (cpus[i] < CPU_SETSIZE) {
+            CPU_SET(cpus[i], &cs);
+        }
+    }
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cs) != 0) {
+        sysErrorBelch("setThreadAffinityToCPUs");
+    }
+}
+
 #elif defined(darwin_HOST_OS) && defined(THREAD_AFFINITY_POLICY)
 // Schedules the current thread in the affinity set identified by tag n.
 void
@@ -462,6 +547,20 @@ setThreadAffinity (uint32_t n, uint32_t m STG_UNUSED)
                       THREAD_AFFINITY_POLICY_COUNT);
 }
 
+// Darwin has no way to pin a thread to particular CPUs; threads with the
+// same affinity tag are kept together, so we use the first CPU as the tag.
+void
+setThreadAffinityToCPUs (const uint32_t *cpus, uint32_t n_cpus)
+{
+    thread_affinity_policy_data_t policy;
+
+    policy.affinity_tag = n_cpus > 0 ? cpus[0] + 1 : THREAD_AFFINITY_TAG_NULL;
+    thread_policy_set(mach_thread_self(),
+                      THREAD_AFFINITY_POLICY,
+                      (thread_policy_t) &policy,
+                      THREAD_AFFINITY_POLICY_COUNT);
+}
+
 #elif defined(HAVE_SYS_CPUSET_H) /* FreeBSD 7.1+ */
 void
 setThreadAffinity(uint32_t n, uint32_t m)
@@ -480,12 +579,35 @@ setThreadAffinity(uint32_t n, uint32_t m)
                            -1, sizeof(cpuset_t), &cs);
 }
 
+void
+setThreadAffinityToCPUs (const uint32_t *cpus, uint32_t n_cpus)
+{
+        cpuset_t cs;
+
+        CPU_ZERO(&cs);
+        if (n_cpus == 0) {
+                CPU_FILL(&cs);
+        }
+        for (uint32_t i = 0; i < n_cpus; i++)
+                if (cpus[i] < CPU_SETSIZE)
+                        CPU_SET(cpus[i], &cs);
+
+        cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID,
+                           -1, sizeof(cpuset_t), &cs);
+}
+
 #else
 void
 setThreadAffinity (uint32_t n STG_UNUSED,
                    uint32_t m STG_UNUSED)
 {
 }
+
+void
+setThreadAffinityToCPUs (const uint32_t *cpus STG_UNUSED,
+                         uint32_t n_cpus STG_UNUSED)
+{
+}
 #endif
 
 #if HAVE_LIBNUMA
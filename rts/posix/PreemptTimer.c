@@ -0,0 +1,212 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Per-capability preemption timers, for +RTS --per-capability-timers.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Per-capability preemption timers]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Normally the ticker preempts threads: at every tick, handle_tick counts
+   down the time slice of the thread running on each capability (see Note
+   [Time slices] in Schedule.c) and context switches the capabilities whose
+   slice ran out. A slice thus ends on a tick, not when it has lasted its
+   length, and the ticks of all the capabilities come from the one ticker
+   thread at the same moment.
+
+   With +RTS --per-capability-timers, the scheduler instead records when the
+   slice of the thread it starts should end (cap->slice_deadline), and the
+   capability is preempted when that time comes, and no other capability
+   is:
+
+    * In the threaded RTS on Linux, each capability has a timerfd of its own
+      (cap->preempt_timer_fd), which the scheduler arms for the length of
+      the slice whenever it starts one, with a single timerfd_settime() call
+      that also disarms the timer of the previous slice. One thread waits
+      for all of these timers with epoll, and when the timer of a
+      capability fires, it context switches that capability if it is still
+      running Haskell code and its slice has indeed ended (a thread that
+      started a new slice since will have re-armed the timer, but its
+      expiry may already have been queued).
+
+    * Elsewhere, the ticker compares the deadlines of the capabilities with
+      the time at each tick (contextSwitchExpiredSlices), so slices are still
+      only as precise as the ticks, but each is measured from when it
+      started.
+
+   A capability gets its timerfd the first time it starts a slice, so
+   setNumCapabilities needs nothing special. After forkProcess the child
+   has none of the parent's threads, so initPreemptTimers, called from
+   initTimer, closes the timerfds it inherited and starts a new thread.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "PreemptTimer.h"
+
+#if defined(HAVE_PREEMPT_TIMERS)
+
+#include "Capability.h"
+#include "RtsUtils.h"
+#include "Clock.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define PREEMPT_EXIT_KEY  UINT32_MAX
+
+static int epoll_fd = -1;
+static int exit_pipe[2] = { -1, -1 };
+static OSThreadId thread;
+
+static void *
+preemptThread (void *unused STG_UNUSED)
+{
+    struct epoll_event events[64];
+
+    for (;;) {
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        if (n < 0) {
+            if (errno != EINTR) {
+                sysErrorBelch("preemption timers: epoll_wait");
+                stg_exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            uint32_t no = events[i].data.u32;
+            if (no == PREEMPT_EXIT_KEY) {
+                return NULL;
+            }
+            Capability *cap = getCapability(no);
+            uint64_t expirations;
+            if (read(cap->preempt_timer_fd, &expirations,
+                     sizeof(expirations)) < 0) {
+                // EAGAIN: re-armed since epoll_wait returned
+                continue;
+            }
+            // The timer is on the clock of getProcessElapsedTime, and was
+            // armed after the deadline was set, so if the deadline hasn't
+            // passed, a new slice started since the timer fired.
+            if (RELAXED_LOAD(&cap->in_haskell) &&
+                getProcessElapsedTime() >= RELAXED_LOAD(&cap->slice_deadline)) {
+                contextSwitchCapability(cap, true);
+            }
+        }
+    }
+}
+
+void
+initPreemptTimers (void)
+{
+    // In the child of forkProcess these are the parent's; the thread that
+    // waited for them is gone.
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        close(exit_pipe[0]);
+        close(exit_pipe[1]);
+        for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+            Capability *cap = getCapability(i);
+            if (cap->preempt_timer_fd >= 0) {
+                close(cap->preempt_timer_fd);
+                cap->preempt_timer_fd = -1;
+            }
+        }
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        sysErrorBelch("preemption timers: epoll_create1");
+        stg_exit(EXIT_FAILURE);
+    }
+    if (pipe(exit_pipe) < 0) {
+        sysErrorBelch("preemption timers: pipe");
+        stg_exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = { .events = EPOLLIN,
+                              .data = { .u32 = PREEMPT_EXIT_KEY } };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, exit_pipe[0], &ev) < 0) {
+        sysErrorBelch("preemption timers: epoll_ctl");
+        stg_exit(EXIT_FAILURE);
+    }
+
+    // Block signals in the thread, as the ticker does
+    sigset_t mask, omask;
+    sigfillset(&mask);
+    int sigret = pthread_sigmask(SIG_SETMASK, &mask, &omask);
+    int ret = createAttachedOSThread(&thread, "ghc_preempt", preemptThread,
+                                     NULL);
+    if (sigret == 0) {
+        pthread_sigmask(SIG_SETMASK, &omask, NULL);
+    }
+    if (ret != 0) {
+        barf("preemption timers: failed to spawn thread: %s", strerror(errno));
+    }
+}
+
+void
+exitPreemptTimers (bool wait)
+{
+    char c = 0;
+    if (write(exit_pipe[1], &c, 1) != 1) {
+        sysErrorBelch("preemption timers: write");
+    }
+    if (wait) {
+        if (pthread_join(thread, NULL)) {
+            sysErrorBelch("preemption timers: failed to join: %s",
+                          strerror(errno));
+        }
+    } else {
+        pthread_detach(thread);
+    }
+}
+
+/* Only the task that owns the capability arms its timer, so no lock is
+ * needed to create it.
+ */
+static int
+newTimerFd (Capability *cap)
+{
+    int fd = timerfd_create(CLOCK_ID, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        sysErrorBelch("preemption timers: timerfd_create");
+        stg_exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = { .events = EPOLLIN,
+                              .data = { .u32 = cap->no } };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        sysErrorBelch("preemption timers: epoll_ctl");
+        stg_exit(EXIT_FAILURE);
+    }
+    cap->preempt_timer_fd = fd;
+    return fd;
+}
+
+/* Arm the timer of the capability to fire after the given slice,
+ * replacing the previous slice's. See Note [Per-capability preemption
+ * timers].
+ */
+void
+armPreemptTimer (Capability *cap, Time slice)
+{
+    int fd = cap->preempt_timer_fd;
+    if (fd < 0) {
+        fd = newTimerFd(cap);
+    }
+    struct itimerspec it;
+    memset(&it, 0, sizeof(it));
+    it.it_value.tv_sec  = TimeToSeconds(slice);
+    it.it_value.tv_nsec = TimeToNS(slice) % 1000000000;
+    if (timerfd_settime(fd, 0, &it, NULL) < 0) {
+        sysErrorBelch("preemption timers: timerfd_settime");
+        stg_exit(EXIT_FAILURE);
+    }
+}
+
+#endif /* HAVE_PREEMPT_TIMERS */
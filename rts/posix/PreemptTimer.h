@@ -0,0 +1,24 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Prototypes for functions in PreemptTimer.c
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+#if defined(THREADED_RTS) && defined(HAVE_SYS_TIMERFD_H) && \
+    defined(HAVE_SYS_EPOLL_H)
+
+#define HAVE_PREEMPT_TIMERS 1
+
+void initPreemptTimers (void);
+void exitPreemptTimers (bool wait);
+void armPreemptTimer (Capability *cap, Time slice);
+
+#endif
+
+#include "EndPrivate.h"
@@ -20,6 +20,7 @@
 #include "Capability.h"
 #include "Select.h"
 #include "IOManagerInternals.h"
+#include "TimerHeap.h"
 #include "Stats.h"
 #include "GetTime.h"
 
@@ -36,29 +37,16 @@
 
 #include "Clock.h"
 
-#if defined(IOMGR_ENABLED_SELECT)
-
-// The target time for a threadDelay is stored in a one-word quantity
-// in the TSO (tso->block_info.target).  On a 32-bit machine we
-// therefore can't afford to use nanosecond resolution because it
-// would overflow too quickly, so instead we use millisecond
-// resolution.
-
-#if SIZEOF_VOID_P == 4
-#define LowResTimeToTime(t)          (USToTime((t) * 1000))
-#define TimeToLowResTimeRoundDown(t) ((LowResTime)(TimeToUS(t) / 1000))
-#define TimeToLowResTimeRoundUp(t)   ((TimeToUS(t) + 1000-1) / 1000)
-#else
-#define LowResTimeToTime(t) (t)
-#define TimeToLowResTimeRoundDown(t) (t)
-#define TimeToLowResTimeRoundUp(t)   (t)
-#endif
+/* Timers, used by the select(), io_uring and epoll I/O managers.
+ */
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
 
 /*
  * Return the time since the program started, in LowResTime,
  * rounded down.
  */
-static LowResTime getLowResTimeOfDay(void)
+LowResTime getLowResTimeOfDay(void)
 {
     return TimeToLowResTimeRoundDown(getProcessElapsedTime());
 }
@@ -82,38 +70,9 @@ LowResTime getDelayTarget (HsInt us)
     }
 }
 
-/* There's a clever trick here to avoid problems when the time wraps
- * around.  Since our maximum delay is smaller than 31 bits of ticks
- * (it's actually 31 bits of microseconds), we can safely check
- * whether a timer has expired even if our timer will wrap around
- * before the target is reached, using the following formula:
- *
- *        (int)((uint)current_time - (uint)target_time) < 0
- *
- * if this is true, then our time has expired.
- * (idea due to Andy Gill).
- */
-static bool wakeUpSleepingThreads (Capability *cap, LowResTime now)
-{
-    CapIOManager *iomgr = cap->iomgr;
-    StgTSO *tso;
-    bool flag = false;
+#endif
 
-    while (iomgr->sleeping_queue != END_TSO_QUEUE) {
-        tso = iomgr->sleeping_queue;
-        if (((long)now - (long)tso->block_info.target) < 0) {
-            break;
-        }
-        iomgr->sleeping_queue = tso->_link;
-        RELAXED_STORE(&tso->why_blocked, NotBlocked);
-        tso->_link = END_TSO_QUEUE;
-        IF_DEBUG(scheduler, debugBelch("Waking up sleeping thread %"
-                                       FMT_StgThreadID "\n", tso->id));
-        pushOnRunQueue(cap,tso);
-        flag = true;
-    }
-    return flag;
-}
+#if defined(IOMGR_ENABLED_SELECT)
 
 static void STG_NORETURN
 fdOutOfRange (int fd)
@@ -301,7 +260,7 @@ awaitCompletedTimeoutsOrIOSelect(Capability *cap, bool wait)
           tv.tv_sec  = 0;
           tv.tv_usec = 0;
           ptv = &tv;
-      } else if (iomgr->sleeping_queue != END_TSO_QUEUE) {
+      } else if (!emptyTimerHeap(&iomgr->timers)) {
           /* SUSv2 allows implementations to have an implementation defined
            * maximum timeout for select(2). The standard requires
            * implementations to silently truncate values exceeding this maximum
@@ -321,7 +280,7 @@ awaitCompletedTimeoutsOrIOSelect(Capability *cap, bool wait)
           const time_t max_seconds = 2678400; // 31 * 24 * 60 * 60
 
           Time min = LowResTimeToTime(
-                       iomgr->sleeping_queue->block_info.target - now
+                       nextTimerTarget(&iomgr->timers) - now
                      );
           tv.tv_sec  = TimeToSeconds(min);
           if (tv.tv_sec < max_seconds) {
@@ -13,8 +13,26 @@
 // An absolute time value in units of 10ms.
 typedef StgWord LowResTime;
 
+// The target time for a threadDelay is stored in a one-word quantity
+// in the timer heap (see TimerHeap.h).  On a 32-bit machine we
+// therefore can't afford to use nanosecond resolution because it
+// would overflow too quickly, so instead we use millisecond
+// resolution.
+
+#if SIZEOF_VOID_P == 4
+#define LowResTimeToTime(t)          (USToTime((t) * 1000))
+#define TimeToLowResTimeRoundDown(t) ((LowResTime)(TimeToUS(t) / 1000))
+#define TimeToLowResTimeRoundUp(t)   ((TimeToUS(t) + 1000-1) / 1000)
+#else
+#define LowResTimeToTime(t) (t)
+#define TimeToLowResTimeRoundDown(t) (t)
+#define TimeToLowResTimeRoundUp(t)   (t)
+#endif
+
 LowResTime getDelayTarget (HsInt us);
 
+LowResTime getLowResTimeOfDay (void);
+
 void awaitCompletedTimeoutsOrIOSelect(Capability *cap, bool wait);
 
 #include "EndPrivate.h"
@@ -17,6 +17,7 @@
 #include "Prelude.h"
 #include "Ticker.h"
 #include "ThreadLabels.h"
+#include "Trace.h"
 #include "Libdw.h"
 
 /* TODO: eliminate this include. This file should be about signals, not be
@@ -559,6 +560,19 @@ backtrace_handler(int sig STG_UNUSED)
 #endif
 }
 
+/* -----------------------------------------------------------------------------
+ * SIGUSR2 handler, with --eventlog-toggle-classes.
+ *
+ * Switch the trace classes, see Note [Changing trace classes] in Trace.c.
+ * -------------------------------------------------------------------------- */
+#if defined(TRACING)
+static void
+trace_toggle_handler(int sig STG_UNUSED)
+{
+    trace_toggle_requested = 1;
+}
+#endif
+
 /* -----------------------------------------------------------------------------
  * An empty signal handler, currently used for SIGPIPE
  * -------------------------------------------------------------------------- */
@@ -746,6 +760,17 @@ initDefaultHandlers(void)
         sysErrorBelch("warning: failed to install SIGQUIT handler");
     }
 
+#if defined(TRACING)
+    if (RtsFlags.TraceFlags.toggleClasses != NULL) {
+        action.sa_handler = trace_toggle_handler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        if (sigaction(SIGUSR2, &action, &oact) != 0) {
+            sysErrorBelch("warning: failed to install SIGUSR2 handler");
+        }
+    }
+#endif
+
     set_sigtstp_action(true);
 }
 
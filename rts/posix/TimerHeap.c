@@ -0,0 +1,211 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * The threads in threadDelay, for the I/O managers of the non-threaded RTS.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [The timer heap]
+   ~~~~~~~~~~~~~~~~~~~~~
+   The select(), io_uring and epoll I/O managers keep the threads of a
+   capability that are in threadDelay (and so in System.Timeout.timeout) in
+   a TimerHeap: a 4-ary min-heap of (target time, thread), in which each
+   thread records its position in block_info.timer. It used to be a list
+   sorted on the target time, so that a server with N connections, each
+   with a timeout, paid O(N) for every threadDelay.
+
+   With the heap:
+
+    * inserting a timer takes time logarithmic in the number of timers at
+      worst, but a new timer goes at the end of the array and is only moved
+      up past the timers due after it. Timeouts are mostly of the same few
+      lengths, so a new one is usually due after all the others, or nearly
+      so, and inserting it costs one comparison or a few.
+
+    * cancelling a timer (the thread received an exception, e.g. the
+      timeout went off first) finds it through block_info.timer, moves the
+      last timer into its place and sifts that one up or down, so it takes
+      time logarithmic in the number of timers.
+
+    * the earliest timer is timers[0]; it gives the I/O manager the
+      timeout of its next wait, and waking the threads whose timers have
+      expired takes time logarithmic in the number of timers for each.
+
+   We use a heap rather than a hierarchical timer wheel: a wheel has to
+   cover targets from a millisecond to years away, and so needs several
+   levels and cascades timers from one level to the next, whereas the heap
+   is one array, is exact, and cancelling costs only O(log n) moves in
+   the same array. Each node has four children rather than two, which
+   halves the depth, and the four children of a node are adjacent, so
+   sifting down touches one or two cache lines per level.
+
+   Targets wrap around; we compare them as wakeUpSleepingThreads always
+   has, see BEFORE below.
+
+   The heap holds pointers to TSOs, so the GC evacuates them
+   (markTimerHeap), but it never reorders the heap: the targets do not
+   change.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "IOManagerInternals.h"
+
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
+
+#include "Capability.h"
+#include "RtsUtils.h"
+#include "Schedule.h"
+#include "TimerHeap.h"
+
+#define TIMER_HEAP_ARITY     4
+#define TIMER_HEAP_MIN_SIZE  64
+
+#define PARENT(i)       (((i) - 1) / TIMER_HEAP_ARITY)
+#define FIRST_CHILD(i)  (TIMER_HEAP_ARITY * (i) + 1)
+
+/* There's a clever trick here to avoid problems when the time wraps
+ * around.  Since our maximum delay is smaller than 31 bits of ticks
+ * (it's actually 31 bits of microseconds), we can safely check
+ * whether a timer has expired even if our timer will wrap around
+ * before the target is reached, using the following formula:
+ *
+ *        (int)((uint)current_time - (uint)target_time) < 0
+ *
+ * if this is true, then our time has expired.
+ * (idea due to Andy Gill).
+ */
+#define BEFORE(a,b) (((long)(a) - (long)(b)) < 0)
+
+void
+initTimerHeap (TimerHeap *heap)
+{
+    heap->timers   = NULL;
+    heap->n_timers = 0;
+    heap->size     = 0;
+}
+
+void
+freeTimerHeap (TimerHeap *heap)
+{
+    stgFree(heap->timers);
+    initTimerHeap(heap);
+}
+
+void
+markTimerHeap (evac_fn evac, void *user, TimerHeap *heap)
+{
+    for (uint32_t i = 0; i < heap->n_timers; i++) {
+        evac(user, (StgClosure **)(void *)&heap->timers[i].tso);
+    }
+}
+
+static void
+setTimer (TimerHeap *heap, uint32_t i, Timer t)
+{
+    heap->timers[i] = t;
+    t.tso->block_info.timer = i;
+}
+
+static void
+siftUp (TimerHeap *heap, uint32_t i, Timer t)
+{
+    while (i > 0) {
+        uint32_t parent = PARENT(i);
+        if (!BEFORE(t.target, heap->timers[parent].target)) {
+            break;
+        }
+        setTimer(heap, i, heap->timers[parent]);
+        i = parent;
+    }
+    setTimer(heap, i, t);
+}
+
+static void
+siftDown (TimerHeap *heap, uint32_t i, Timer t)
+{
+    for (;;) {
+        uint32_t first = FIRST_CHILD(i);
+        if (first >= heap->n_timers) {
+            break;
+        }
+        uint32_t last = first + TIMER_HEAP_ARITY;
+        if (last > heap->n_timers) {
+            last = heap->n_timers;
+        }
+        uint32_t child = first;
+        for (uint32_t c = first + 1; c < last; c++) {
+            if (BEFORE(heap->timers[c].target, heap->timers[child].target)) {
+                child = c;
+            }
+        }
+        if (!BEFORE(heap->timers[child].target, t.target)) {
+            break;
+        }
+        setTimer(heap, i, heap->timers[child]);
+        i = child;
+    }
+    setTimer(heap, i, t);
+}
+
+void
+insertTimer (TimerHeap *heap, StgTSO *tso, LowResTime target)
+{
+    if (heap->n_timers == heap->size) {
+        heap->size = heap->size == 0 ? TIMER_HEAP_MIN_SIZE : heap->size * 2;
+        heap->timers = stgReallocBytes(heap->timers,
+                                       heap->size * sizeof(Timer),
+                                       "insertTimer");
+    }
+    Timer t = { .target = target, .tso = tso };
+    siftUp(heap, heap->n_timers++, t);
+}
+
+static void
+removeTimerAt (TimerHeap *heap, uint32_t i)
+{
+    heap->n_timers--;
+    if (i < heap->n_timers) {
+        Timer last = heap->timers[heap->n_timers];
+        if (i > 0 && BEFORE(last.target, heap->timers[PARENT(i)].target)) {
+            siftUp(heap, i, last);
+        } else {
+            siftDown(heap, i, last);
+        }
+    }
+}
+
+void
+removeTimer (TimerHeap *heap, StgTSO *tso)
+{
+    uint32_t i = tso->block_info.timer;
+    ASSERT(i < heap->n_timers && heap->timers[i].tso == tso);
+    removeTimerAt(heap, i);
+}
+
+/* Wake the threads whose timers have expired by now. Returns whether there
+ * were any.
+ */
+bool
+wakeUpSleepingThreads (Capability *cap, LowResTime now)
+{
+    TimerHeap *heap = &cap->iomgr->timers;
+    bool flag = false;
+
+    while (heap->n_timers > 0 && !BEFORE(now, heap->timers[0].target)) {
+        StgTSO *tso = heap->timers[0].tso;
+        removeTimerAt(heap, 0);
+        RELAXED_STORE(&tso->why_blocked, NotBlocked);
+        tso->_link = END_TSO_QUEUE;
+        IF_DEBUG(scheduler, debugBelch("Waking up sleeping thread %"
+                                       FMT_StgThreadID "\n", tso->id));
+        pushOnRunQueue(cap,tso);
+        flag = true;
+    }
+    return flag;
+}
+
+#endif
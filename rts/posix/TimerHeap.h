@@ -0,0 +1,63 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Prototypes for functions in TimerHeap.c
+ *
+ * -------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "IOManager.h"
+#include "Select.h"  // LowResTime
+
+#include "BeginPrivate.h"
+
+#if defined(IOMGR_ENABLED_SELECT) || defined(IOMGR_ENABLED_URING) || \
+    defined(IOMGR_ENABLED_EPOLL)
+
+/* A thread in threadDelay. */
+typedef struct {
+    LowResTime  target;
+    StgTSO     *tso;
+} Timer;
+
+/* The threads in threadDelay on a capability, a 4-ary heap ordered on the
+ * target time. The position of a thread is in its block_info.timer.
+ * See Note [The timer heap].
+ */
+typedef struct {
+    Timer      *timers;
+    uint32_t    n_timers;
+    uint32_t    size;
+} TimerHeap;
+
+void initTimerHeap (TimerHeap *heap);
+void freeTimerHeap (TimerHeap *heap);
+void markTimerHeap (evac_fn evac, void *user, TimerHeap *heap);
+
+void insertTimer (TimerHeap *heap, StgTSO *tso, LowResTime target);
+void removeTimer (TimerHeap *heap, StgTSO *tso);
+
+bool wakeUpSleepingThreads (Capability *cap, LowResTime now);
+
+INLINE_HEADER bool emptyTimerHeap (TimerHeap *heap)
+{
+    return heap->n_timers == 0;
+}
+
+/* The target of a thread in the heap. */
+INLINE_HEADER LowResTime timerTarget (TimerHeap *heap, StgTSO *tso)
+{
+    return heap->timers[tso->block_info.timer].target;
+}
+
+/* The earliest target; the heap must not be empty. */
+INLINE_HEADER LowResTime nextTimerTarget (TimerHeap *heap)
+{
+    return heap->timers[0].target;
+}
+
+#endif
+
+#include "EndPrivate.h"
@@ -22,6 +22,7 @@
 #include "RtsUtils.h"
 #include "BlockAlloc.h"
 #include "OSMem.h"
+#include "Capability.h"
 
 #include <string.h>
 
@@ -171,6 +172,14 @@ static void  initMBlock(void *mblock, uint32_t node);
 static bdescr *free_list[MAX_NUMA_NODES][NUM_FREE_LISTS];
 static bdescr *free_mblock_list[MAX_NUMA_NODES];
 
+// Bit i of free_list_nonempty[node] is set iff free_list[node][i] is
+// non-empty.  See Note [Free list bitmap].
+static StgWord free_list_nonempty[MAX_NUMA_NODES];
+
+// Total number of blocks on free_list[], i.e. free blocks in partially
+// used megablocks.  Reported as a fragmentation measure by +RTS -s.
+W_ n_free_list_blocks;
+
 // For avoiding quadratic runtime performance when freeing a large number of
 // mblocks during a single GC run, free will be deferred to a separate free list
 // that foregoes sorting and coalecense. As the final step in a GC run we can
@@ -184,6 +193,14 @@ W_ hw_alloc_blocks;  // high-water allocated blocks
 
 W_ n_alloc_blocks_by_node[MAX_NUMA_NODES];
 
+// Cumulative counts, reported by getRTSStats(). See Note [NUMA block stealing]
+W_ n_total_alloc_blocks_by_node[MAX_NUMA_NODES];
+W_ n_stolen_blocks_by_node[MAX_NUMA_NODES];
+
+// numa_steal_order[n] lists the other logical nodes in order of increasing
+// distance from n.  Computed lazily by init_numa_steal_order().
+static uint32_t numa_steal_order[MAX_NUMA_NODES][MAX_NUMA_NODES];
+static bool numa_steal_order_ready = false;
 
 static bdescr* splitDeferredList(bdescr* head);
 static void sortDeferredList(bdescr** head);
@@ -200,8 +217,13 @@ void initBlockAllocator(void)
             free_list[node][i] = NULL;
         }
         free_mblock_list[node] = NULL;
+        free_list_nonempty[node] = 0;
         n_alloc_blocks_by_node[node] = 0;
+        n_total_alloc_blocks_by_node[node] = 0;
+        n_stolen_blocks_by_node[node] = 0;
     }
+    n_free_list_blocks = 0;
+    numa_steal_order_ready = false;
     n_alloc_blocks = 0;
     hw_alloc_blocks = 0;
 }
@@ -215,6 +237,7 @@ void recordAllocatedBlocks(uint32_t node, uint32_t n)
 {
     n_alloc_blocks += n;
     n_alloc_blocks_by_node[node] += n;
+    n_total_alloc_blocks_by_node[node] += n;
     if (n > 0 && n_alloc_blocks > hw_alloc_blocks) {
         hw_alloc_blocks = n_alloc_blocks;
     }
@@ -265,8 +288,10 @@ initGroup(bdescr *head)
 
 #if SIZEOF_VOID_P == SIZEOF_LONG
 #define CLZW(n) (__builtin_clzl(n))
+#define CTZW(n) (__builtin_ctzl(n))
 #else
 #define CLZW(n) (__builtin_clzll(n))
+#define CTZW(n) (__builtin_ctzll(n))
 #endif
 
 // log base 2 (floor), needs to support up to (2^NUM_FREE_LISTS)-1
@@ -308,6 +333,60 @@ log_2_ceil(W_ n)
 #endif
 }
 
+/* Note [Free list bitmap]
+   ~~~~~~~~~~~~~~~~~~~~~~~~
+   Finding a free group of at least n blocks used to mean walking up the
+   free_list[] buckets from log_2_ceil(n) until we found a non-empty one.
+   With many empty buckets, and with NUMA stealing probing the lists of
+   every other node as well, that scan shows up on allocation-heavy
+   programs.
+
+   Instead we keep, for each node, a bitmap of the non-empty buckets,
+   maintained by free_list_push() and free_list_remove().  The smallest
+   bucket that can satisfy a request is then found with a single
+   count-trailing-zeros on the bitmap, masked to the buckets at or above
+   the one we want (find_free_list()).  Every bucket is a segregated
+   size class, so that bucket's head is a good fit without further search.
+
+   The invariant (bit set <=> list non-empty) is checked by
+   checkFreeListSanity().
+
+   free_mblock_list[] is deliberately left as an address-ordered list: the
+   ordering is what makes coalescing and returnMemoryToOS() cheap, and
+   it rarely holds more than a handful of groups.
+*/
+
+STATIC_INLINE void
+free_list_push (uint32_t node, StgWord ln, bdescr *bd)
+{
+    dbl_link_onto(bd, &free_list[node][ln]);
+    free_list_nonempty[node] |= (StgWord)1 << ln;
+    n_free_list_blocks += bd->blocks;
+}
+
+STATIC_INLINE void
+free_list_remove (uint32_t node, StgWord ln, bdescr *bd)
+{
+    dbl_link_remove(bd, &free_list[node][ln]);
+    if (free_list[node][ln] == NULL) {
+        free_list_nonempty[node] &= ~((StgWord)1 << ln);
+    }
+    n_free_list_blocks -= bd->blocks;
+}
+
+// Returns the smallest non-empty free list on `node` at or above ln, or
+// NUM_FREE_LISTS if there is none.
+STATIC_INLINE StgWord
+find_free_list (uint32_t node, StgWord ln)
+{
+    StgWord mask;
+
+    if (ln >= NUM_FREE_LISTS) return NUM_FREE_LISTS;
+    mask = free_list_nonempty[node] & ~(((StgWord)1 << ln) - 1);
+    if (mask == 0) return NUM_FREE_LISTS;
+    return CTZW(mask);
+}
+
 STATIC_INLINE void
 free_list_insert (uint32_t node, bdescr *bd)
 {
@@ -316,7 +395,7 @@ free_list_insert (uint32_t node, bdescr *bd)
     ASSERT(bd->blocks < BLOCKS_PER_MBLOCK);
     ln = log_2(bd->blocks);
 
-    dbl_link_onto(bd, &free_list[node][ln]);
+    free_list_push(node, ln, bd);
 }
 
 // After splitting a group, the last block of each group must have a
@@ -343,13 +422,13 @@ split_free_block (bdescr *bd, uint32_t node, W_ n, uint32_t ln /* log_2_ceil(n)
     bdescr *fg; // free group
 
     ASSERT(bd->blocks > n);
-    dbl_link_remove(bd, &free_list[node][ln]);
+    free_list_remove(node, ln, bd);
     fg = bd + bd->blocks - n; // take n blocks off the end
     fg->blocks = n;
     bd->blocks -= n;
     setup_tail(bd);
     ln = log_2(bd->blocks);
-    dbl_link_onto(bd, &free_list[node][ln]);
+    free_list_push(node, ln, bd);
     return fg;
 }
 
@@ -475,6 +554,55 @@ alloc_mega_group_from_free_list (bdescr** free_list_head, StgWord n, bdescr** be
     return NULL;
 }
 
+#if defined(wasm32_HOST_ARCH)
+/* Note [Growing the heap on wasm]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Linear memory never shrinks (see Note [Megablock allocator on wasm]), so
+   every megablock we ever sbrk() stays with us until the page is closed,
+   and a long-running program had better reuse what it has before growing.
+   Free megablocks already go back on free_mblock_list, but a request for a
+   group bigger than any free one (a large object, or a nursery) used to get
+   a fresh group from the top of memory, however much free space there was
+   right below it.
+
+   Megablocks are a single 64KiB wasm page, and free_mblock_list is sorted
+   by address and coalesced, so when its last group ends at the top of
+   linear memory we grow memory only by what is missing and hand out that
+   group together with the new pages. Nobody else can call sbrk() in
+   between, since there is only the one thread.
+*/
+static bdescr *
+extend_top_mega_group (uint32_t node, StgWord mblocks)
+{
+    bdescr *bd, *prev = NULL, *last_prev = NULL, *last = NULL;
+
+    for (bd = free_mblock_list[node]; bd != NULL; prev = bd, bd = bd->link) {
+        last_prev = prev;
+        last = bd;
+    }
+    if (last == NULL) {
+        return NULL;
+    }
+
+    StgWord last_mblocks = BLOCKS_TO_MBLOCKS(last->blocks);
+    StgWord8 *end = (StgWord8*)MBLOCK_ROUND_DOWN(last) + last_mblocks * MBLOCK_SIZE;
+    if (last_mblocks >= mblocks || end != osMBlocksEnd()) {
+        return NULL;
+    }
+
+    StgWord8 *more = getMBlocks(mblocks - last_mblocks);
+    ASSERT(more == end);
+    (void)more;
+
+    if (last_prev) {
+        last_prev->link = NULL;
+    } else {
+        free_mblock_list[node] = NULL;
+    }
+    return last;
+}
+#endif
+
 /* Only initializes the start pointers on the first megablock and the
  * blocks field of the first bdescr; callers are responsible for calling
  * initGroup afterwards.
@@ -522,6 +650,13 @@ alloc_mega_group (uint32_t node, StgWord mblocks)
         best->blocks = MBLOCK_GROUP_BLOCKS(best_mblocks - mblocks);
         initMBlock(MBLOCK_ROUND_DOWN(bd), node);
     }
+#if defined(wasm32_HOST_ARCH)
+    // See Note [Growing the heap on wasm]
+    else if ((bd = extend_top_mega_group(node, mblocks)) != NULL)
+    {
+        // grown in place; the new size is set below
+    }
+#endif
     else
     {
         void *mblock;
@@ -537,8 +672,69 @@ alloc_mega_group (uint32_t node, StgWord mblocks)
     return bd;
 }
 
-bdescr *
-allocGroupOnNode (uint32_t node, W_ n)
+/* Note [NUMA block stealing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With --numa each node has its own free lists.  When a request can't be
+   satisfied from the requesting node's free list, rather than growing the
+   heap with a fresh megablock we first look for a suitable free group on
+   the other nodes, nearest first according to the distance matrix
+   reported by the OS (osNumaDistance()).  Only if every node's free list is
+   dry do we allocate a fresh megablock on the requesting node.
+
+   allocLargeChunkOnNode() never steals: it is used for nurseries and GC
+   to-space blocks, for which node-local placement matters most, so these
+   always come from the local free list or from fresh megablocks bound to
+   the node with osBindMBlocksToNode().
+
+   A stolen group keeps the node of the memory it lives in (bd->node), so it
+   is returned to its home free list when freed.  The number of blocks
+   allocated on, and stolen by, each node is exposed by getRTSStats().
+*/
+
+static void
+init_numa_steal_order (void)
+{
+    for (uint32_t n = 0; n < n_numa_nodes; n++) {
+        uint32_t k = 0;
+        for (uint32_t m = 0; m < n_numa_nodes; m++) {
+            if (m == n) continue;
+            // insertion sort by distance; ties keep node order
+            uint32_t d = osNumaDistance(numa_map[n], numa_map[m]);
+            uint32_t i = k++;
+            while (i > 0 && osNumaDistance(numa_map[n],
+                                           numa_map[numa_steal_order[n][i-1]]) > d) {
+                numa_steal_order[n][i] = numa_steal_order[n][i-1];
+                i--;
+            }
+            numa_steal_order[n][i] = m;
+        }
+    }
+    numa_steal_order_ready = true;
+}
+
+// Find the nearest node to `node` with a free group of at least n blocks.
+// Returns `node` if there is none, otherwise sets *ln to the free list to
+// take the group from.
+static uint32_t
+find_steal_victim (uint32_t node, W_ n, StgWord *ln)
+{
+    if (!numa_steal_order_ready) {
+        init_numa_steal_order();
+    }
+
+    for (uint32_t i = 0; i + 1 < n_numa_nodes; i++) {
+        uint32_t victim = numa_steal_order[node][i];
+        StgWord l = find_free_list(victim, log_2_ceil(n));
+        if (l < NUM_FREE_LISTS) {
+            *ln = l;
+            return victim;
+        }
+    }
+    return node;
+}
+
+static bdescr *
+alloc_group_on_node (uint32_t node, W_ n, bool steal)
 {
     bdescr *bd, *rem;
     StgWord ln;
@@ -561,14 +757,19 @@ allocGroupOnNode (uint32_t node, W_ n)
         goto finish;
     }
 
-    recordAllocatedBlocks(node, n);
+    ln = find_free_list(node, log_2_ceil(n));
 
-    ln = log_2_ceil(n);
-
-    while (ln < NUM_FREE_LISTS && free_list[node][ln] == NULL) {
-        ln++;
+    // See Note [NUMA block stealing]
+    if (steal && ln == NUM_FREE_LISTS && n_numa_nodes > 1) {
+        uint32_t victim = find_steal_victim(node, n, &ln);
+        if (victim != node) {
+            n_stolen_blocks_by_node[node] += n;
+            node = victim;
+        }
     }
 
+    recordAllocatedBlocks(node, n);
+
     if (ln == NUM_FREE_LISTS) {
 #if 0  /* useful for debugging fragmentation */
         if ((W_)mblocks_allocated * BLOCKS_PER_MBLOCK * BLOCK_SIZE_W
@@ -594,7 +795,7 @@ allocGroupOnNode (uint32_t node, W_ n)
 
     if (bd->blocks == n)                // exactly the right size!
     {
-        dbl_link_remove(bd, &free_list[node][ln]);
+        free_list_remove(node, ln, bd);
         initGroup(bd);
     }
     else if (bd->blocks >  n)            // block too big...
@@ -614,6 +815,12 @@ finish:
     return bd;
 }
 
+bdescr *
+allocGroupOnNode (uint32_t node, W_ n)
+{
+    return alloc_group_on_node(node, n, true);
+}
+
 // Allocate `n` blocks aligned to `n` blocks, e.g. when n = 8, the blocks will
 // be aligned at `8 * BLOCK_SIZE`. For a group with `n` blocks this can be used
 // for easily accessing the beginning of the group from a location p in the
@@ -757,24 +964,24 @@ bdescr* allocLargeChunkOnNode (uint32_t node, W_ min, W_ max)
     bdescr *bd;
     StgWord ln, lnmax;
 
+    // We never steal memory from other nodes here: the callers are
+    // allocating nurseries and GC to-space, which must stay local.
+    // See Note [NUMA block stealing].
     if (min >= BLOCKS_PER_MBLOCK) {
-        return allocGroupOnNode(node,max);
+        return alloc_group_on_node(node, max, false);
     }
 
-    ln = log_2_ceil(min);
+    ln = find_free_list(node, log_2_ceil(min));
     lnmax = log_2_ceil(max);
 
-    while (ln < NUM_FREE_LISTS && ln < lnmax && free_list[node][ln] == NULL) {
-        ln++;
-    }
-    if (ln == NUM_FREE_LISTS || ln == lnmax) {
-        return allocGroupOnNode(node,max);
+    if (ln == NUM_FREE_LISTS || ln >= lnmax) {
+        return alloc_group_on_node(node, max, false);
     }
     bd = free_list[node][ln];
 
     if (bd->blocks <= max)              // exactly the right size!
     {
-        dbl_link_remove(bd, &free_list[node][ln]);
+        free_list_remove(node, ln, bd);
         initGroup(bd);
     }
     else   // block too big...
@@ -796,6 +1003,110 @@ bdescr* allocLargeChunk (W_ min, W_ max)
     return allocLargeChunkOnNode(nodeWithLeastBlocks(), min, max);
 }
 
+/* Note [Extending a block group in place]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   extendGroup(bd, n) grows the allocated group bd to at least n blocks
+   without moving it, if the memory just after it is free, and returns
+   false otherwise.  It is used to grow large byte arrays in place (see
+   growLargeByteArray() in Storage.c).
+
+   A group of less than a megablock can only grow within its megablock:
+   the group after it must be free (bd->free == -1, as in the coalescing
+   of freeGroup()) and big enough.  We take what we need from the front
+   of it and put the rest back on the free list.
+
+   A megagroup can grow into the free megagroup that starts where it ends,
+   if free_mblock_list has one.  We take what we need from the front of
+   it, as alloc_mega_group() takes from the back, and initialise the first
+   megablock of what is left.  Groups on deferred_free_mblock_list are not
+   considered: they are only there during a GC.
+
+   We don't try to grow past the end of the memory we have from the OS:
+   on most platforms the next megablocks we get from getMBlocks() needn't
+   be the ones after the group, and there is no way to ask for those.
+*/
+bool
+extendGroup (bdescr *bd, W_ n)
+{
+    uint32_t node = bd->node;
+    W_ extra;
+
+    ASSERT(bd->free != (P_)-1);
+
+    if (n <= bd->blocks) {
+        return true;
+    }
+
+    if (bd->blocks < BLOCKS_PER_MBLOCK) {
+        bdescr *next = bd + bd->blocks;
+        extra = n - bd->blocks;
+
+        // See Note [Data races in freeGroup].
+        TSAN_ANNOTATE_BENIGN_RACE(&next->free, "extendGroup");
+        if (next > LAST_BDESCR(MBLOCK_ROUND_DOWN(bd))
+            || RELAXED_LOAD(&next->free) != (P_)-1
+            || next->blocks < extra) {
+            return false;
+        }
+
+        free_list_remove(node, log_2(next->blocks), next);
+        if (next->blocks > extra) {
+            bdescr *rest = next + extra;
+            rest->blocks = next->blocks - extra;
+            rest->free = (P_)-1;
+            rest->gen = NULL;
+            rest->gen_no = 0;
+            setup_tail(rest);
+            free_list_insert(node, rest);
+        }
+        // next is in the middle of bd now
+        next->free = 0;
+        next->blocks = 0;
+        next->link = bd;
+
+        bd->blocks = n;
+        setup_tail(bd);
+        recordAllocatedBlocks(node, extra);
+    } else {
+        StgWord mblocks = BLOCKS_TO_MBLOCKS(bd->blocks);
+        StgWord want = BLOCKS_TO_MBLOCKS(n);
+        StgWord8 *end = (StgWord8*)MBLOCK_ROUND_DOWN(bd) + mblocks * MBLOCK_SIZE;
+        bdescr *q, *prev = NULL;
+
+        extra = want - mblocks;
+
+        for (q = free_mblock_list[node]; q != NULL; prev = q, q = q->link) {
+            if ((StgWord8*)MBLOCK_ROUND_DOWN(q) >= end) break;
+        }
+        if (q == NULL || (StgWord8*)MBLOCK_ROUND_DOWN(q) != end
+            || BLOCKS_TO_MBLOCKS(q->blocks) < extra) {
+            return false;
+        }
+
+        bdescr *rest = q->link;
+        if (BLOCKS_TO_MBLOCKS(q->blocks) > extra) {
+            StgWord8 *mblock = end + extra * MBLOCK_SIZE;
+            initMBlock(mblock, node);
+            rest = FIRST_BDESCR(mblock);
+            rest->blocks =
+                MBLOCK_GROUP_BLOCKS(BLOCKS_TO_MBLOCKS(q->blocks) - extra);
+            rest->free = (P_)-1;
+            rest->link = q->link;
+        }
+        if (prev) {
+            prev->link = rest;
+        } else {
+            free_mblock_list[node] = rest;
+        }
+
+        bd->blocks = MBLOCK_GROUP_BLOCKS(want);
+        recordAllocatedBlocks(node, extra * BLOCKS_PER_MBLOCK);
+    }
+
+    IF_DEBUG(sanity, checkFreeListSanity());
+    return true;
+}
+
 bdescr *
 allocGroup_lock(W_ n)
 {
@@ -1029,7 +1340,7 @@ freeGroup(bdescr *p)
       {
           p->blocks += next->blocks;
           ln = log_2(next->blocks);
-          dbl_link_remove(next, &free_list[node][ln]);
+          free_list_remove(node, ln, next);
           if (p->blocks == BLOCKS_PER_MBLOCK)
           {
               free_mega_group(p);
@@ -1051,7 +1362,7 @@ freeGroup(bdescr *p)
       if (RELAXED_LOAD(&prev->free) == (P_)-1)
       {
           ln = log_2(prev->blocks);
-          dbl_link_remove(prev, &free_list[node][ln]);
+          free_list_remove(node, ln, prev);
           prev->blocks += p->blocks;
           if (prev->blocks >= BLOCKS_PER_MBLOCK)
           {
@@ -1095,6 +1406,215 @@ freeChain_lock(bdescr *bd)
     RELEASE_SM_LOCK;
 }
 
+/* -----------------------------------------------------------------------------
+   Per-capability block cache
+   -------------------------------------------------------------------------- */
+
+/* Note [Per-capability block cache]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Every allocation or free that goes to the block allocator has to take a
+   lock: sm_mutex for the mutator, or gc_alloc_block_sync during GC.  With
+   many capabilities this lock becomes contended, both for large-object
+   allocation in the mutator and for todo-block acquisition in parallel GC.
+
+   To avoid this, each Capability has a BlockCache: a small stash of block
+   groups of at most BLOCK_CACHE_MAX_GROUP blocks, organised into log2
+   buckets in the same way as free_list[].  The cache is only ever touched
+   by the owner of the Capability, or during GC by the gc_thread attached
+   to it (gct->cap), so blockCacheAlloc() and blockCacheFree() need no
+   synchronisation.
+
+   When the cache misses we take the lock and call blockCacheRefill(),
+   which allocates the requested group and tops the cache up to half its
+   capacity in one go, using allocLargeChunkOnNode() so that the batch
+   comes from a single contiguous chunk where possible.  When a free would
+   overflow the cache, we take the lock, free the group, and drain the
+   cache back down to half its capacity.
+
+   Groups in the cache still count as allocated as far as n_alloc_blocks
+   is concerned, so they are never coalesced with their neighbours.  They
+   are handed back to the global allocator by flushBlockCaches() at each
+   major GC, before we decide how much memory to return to the OS, and
+   they are accounted for separately by memInventory() in DEBUG builds.
+
+   The cache is disabled (capacity 0) unless --block-cache-size is given.
+*/
+
+void
+initBlockCache (BlockCache *cache, uint32_t node)
+{
+    for (uint32_t i = 0; i < BLOCK_CACHE_BUCKETS; i++) {
+        cache->groups[i] = NULL;
+    }
+    cache->n_blocks = 0;
+    cache->capacity = RtsFlags.GcFlags.blockCacheSize;
+    cache->node = node;
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+STATIC_INLINE void
+block_cache_insert (BlockCache *cache, bdescr *bd)
+{
+    uint32_t ln = log_2(bd->blocks);
+    bd->link = cache->groups[ln];
+    cache->groups[ln] = bd;
+    cache->n_blocks += bd->blocks;
+}
+
+bdescr *
+blockCacheAlloc (BlockCache *cache, W_ n)
+{
+    bdescr *bd;
+    uint32_t ln;
+
+    if (cache->capacity == 0) {
+        return NULL;
+    }
+
+    if (n > BLOCK_CACHE_MAX_GROUP) {
+        cache->misses++;
+        return NULL;
+    }
+
+    ln = log_2_ceil(n);
+    while (ln < BLOCK_CACHE_BUCKETS && cache->groups[ln] == NULL) {
+        ln++;
+    }
+
+    if (ln == BLOCK_CACHE_BUCKETS) {
+        cache->misses++;
+        return NULL;
+    }
+
+    bd = cache->groups[ln];
+    cache->groups[ln] = bd->link;
+    cache->n_blocks -= bd->blocks;
+
+    if (bd->blocks > n) {
+        // take n blocks off the end, and put the rest back
+        bdescr *rem = bd;
+        bd = rem + rem->blocks - n;
+        bd->blocks = n;
+        bd->start = rem->start + (rem->blocks - n) * BLOCK_SIZE_W;
+        rem->blocks -= n;
+        setup_tail(rem);
+        block_cache_insert(cache, rem);
+    }
+
+    initGroup(bd);
+    cache->hits++;
+
+    IF_DEBUG(zero_on_gc, memset(bd->start, 0xaa, bd->blocks * BLOCK_SIZE));
+    return bd;
+}
+
+bool
+blockCacheFree (BlockCache *cache, bdescr *bd)
+{
+    ASSERT(RELAXED_LOAD(&bd->free) != (P_)-1);
+
+    if (bd->blocks > BLOCK_CACHE_MAX_GROUP
+        || bd->node != cache->node
+        || cache->n_blocks + bd->blocks > cache->capacity) {
+        return false;
+    }
+
+#if defined(BLOCK_ALLOC_DEBUG)
+    for (uint32_t i=0; i < bd->blocks; i++) {
+        bd[i].flags = 0;
+    }
+#endif
+
+    // The group must not look free (free == -1), otherwise freeGroup()
+    // would try to coalesce a neighbour with it.
+    RELAXED_STORE(&bd->free, bd->start);
+    RELAXED_STORE(&bd->gen, NULL);
+    RELAXED_STORE(&bd->gen_no, 0);
+    IF_DEBUG(zero_on_gc, memset(bd->start, 0xaa, (W_)bd->blocks * BLOCK_SIZE));
+
+    block_cache_insert(cache, bd);
+    return true;
+}
+
+bdescr *
+blockCacheRefill (BlockCache *cache, W_ n)
+{
+    bdescr *bd, *chunk;
+    W_ want;
+
+    bd = allocGroupOnNode(cache->node, n);
+
+    if (cache->n_blocks >= cache->capacity / 2) {
+        return bd;
+    }
+
+    // Top the cache up with a single chunk, carved into groups of at most
+    // BLOCK_CACHE_MAX_GROUP blocks.  We stay below a megablock so that
+    // every block in the chunk has a valid bdescr.
+    want = stg_min(cache->capacity / 2 - cache->n_blocks, BLOCKS_PER_MBLOCK / 2);
+    chunk = allocLargeChunkOnNode(cache->node, 1, want);
+
+    while (chunk != NULL) {
+        W_ left = chunk->blocks;
+        bdescr *next = NULL;
+
+        if (left > BLOCK_CACHE_MAX_GROUP) {
+            next = chunk + BLOCK_CACHE_MAX_GROUP;
+            next->blocks = left - BLOCK_CACHE_MAX_GROUP;
+            next->start = chunk->start + BLOCK_CACHE_MAX_GROUP * BLOCK_SIZE_W;
+            chunk->blocks = BLOCK_CACHE_MAX_GROUP;
+            setup_tail(next);
+        }
+        setup_tail(chunk);
+        chunk->free = chunk->start;
+        chunk->gen = NULL;
+        chunk->gen_no = 0;
+        block_cache_insert(cache, chunk);
+        chunk = next;
+    }
+
+    return bd;
+}
+
+void
+blockCacheDrain (BlockCache *cache, W_ keep)
+{
+    // drain the largest groups first, they are the most useful to the
+    // global allocator
+    for (int i = BLOCK_CACHE_BUCKETS - 1; i >= 0; i--) {
+        while (cache->n_blocks > keep && cache->groups[i] != NULL) {
+            bdescr *bd = cache->groups[i];
+            cache->groups[i] = bd->link;
+            cache->n_blocks -= bd->blocks;
+            freeGroup(bd);
+        }
+    }
+}
+
+bdescr *
+allocGroupCached_lock (BlockCache *cache, W_ n)
+{
+    bdescr *bd = blockCacheAlloc(cache, n);
+    if (bd == NULL) {
+        ACQUIRE_SM_LOCK;
+        bd = blockCacheRefill(cache, n);
+        RELEASE_SM_LOCK;
+    }
+    return bd;
+}
+
+// Return the contents of every Capability's cache to the global
+// allocator.  Must be called with the storage manager lock held, and with
+// all capabilities stopped (i.e. during GC).
+void
+flushBlockCaches (void)
+{
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        blockCacheDrain(&getCapability(i)->block_cache, 0);
+    }
+}
+
 static void
 initMBlock(void *mblock, uint32_t node)
 {
@@ -1325,6 +1845,7 @@ checkFreeListSanity(void)
     bdescr *bd, *prev;
     StgWord ln, min;
     uint32_t node;
+    W_ free_list_blocks = 0;
 
     for (node = 0; node < n_numa_nodes; node++) {
         min = 1;
@@ -1332,6 +1853,10 @@ checkFreeListSanity(void)
             IF_DEBUG(block_alloc,
                      debugBelch("free block list [%" FMT_Word "]:\n", ln));
 
+            // See Note [Free list bitmap]
+            ASSERT((free_list[node][ln] != NULL) ==
+                   ((free_list_nonempty[node] & ((StgWord)1 << ln)) != 0));
+
             prev = NULL;
             for (bd = free_list[node][ln]; bd != NULL; prev = bd, bd = bd->link)
             {
@@ -1343,6 +1868,7 @@ checkFreeListSanity(void)
                 ASSERT(bd->blocks >= min && bd->blocks <= (min*2 - 1));
                 ASSERT(bd->link != bd); // catch easy loops
                 ASSERT(bd->node == node);
+                free_list_blocks += bd->blocks;
 
                 check_tail(bd);
 
@@ -1391,6 +1917,8 @@ checkFreeListSanity(void)
             }
         }
     }
+
+    ASSERT(free_list_blocks == n_free_list_blocks);
 }
 
 W_ /* BLOCKS */
@@ -13,9 +13,47 @@
 bdescr *allocLargeChunk (W_ min, W_ max);
 bdescr *allocLargeChunkOnNode (uint32_t node, W_ min, W_ max);
 
+// Grow an allocated group to at least n blocks without moving it, if the
+// blocks after it are free. Must be called with the SM lock held. See
+// Note [Extending a block group in place] in BlockAlloc.c.
+bool extendGroup (bdescr *bd, W_ n);
+
 void deferMBlockFreeing(void);
 void commitMBlockFreeing(void);
 
+/* Per-capability block cache ---------------------------------------------- */
+
+// See Note [Per-capability block cache] in BlockAlloc.c.
+
+// Bucket i holds groups of 2^i to 2^(i+1)-1 blocks, as in free_list[].
+#define BLOCK_CACHE_BUCKETS   4
+#define BLOCK_CACHE_MAX_GROUP ((1 << BLOCK_CACHE_BUCKETS) - 1)
+
+typedef struct BlockCache_ {
+    bdescr   *groups[BLOCK_CACHE_BUCKETS]; // linked through bd->link
+    W_        n_blocks;                    // blocks currently cached
+    W_        capacity;                    // in blocks; 0 => disabled
+    uint32_t  node;
+    uint64_t  hits;
+    uint64_t  misses;
+} BlockCache;
+
+void    initBlockCache   (BlockCache *cache, uint32_t node);
+
+// These two do not take any lock, and must only be called by the owner of
+// the cache.
+bdescr *blockCacheAlloc  (BlockCache *cache, W_ n);
+bool    blockCacheFree   (BlockCache *cache, bdescr *bd);
+
+// These must be called with the block allocator lock held (sm_mutex, or
+// gc_alloc_block_sync during GC).
+bdescr *blockCacheRefill (BlockCache *cache, W_ n);
+void    blockCacheDrain  (BlockCache *cache, W_ keep);
+
+bdescr *allocGroupCached_lock (BlockCache *cache, W_ n);
+
+void    flushBlockCaches (void);
+
 /* Debugging  -------------------------------------------------------------- */
 
 extern W_ countBlocks       (bdescr *bd);
@@ -32,6 +70,13 @@ void reportUnmarkedBlocks (void);
 extern W_ n_alloc_blocks;   // currently allocated blocks
 extern W_ hw_alloc_blocks;  // high-water allocated blocks
 
+// cumulative, per logical NUMA node; see Note [NUMA block stealing]
+extern W_ n_total_alloc_blocks_by_node[MAX_NUMA_NODES];
+extern W_ n_stolen_blocks_by_node[MAX_NUMA_NODES];
+
+// Free blocks in partially used megablocks (all nodes)
+extern W_ n_free_list_blocks;
+
 RTS_PRIVATE void clear_free_list(void);
 
 #include "EndPrivate.h"
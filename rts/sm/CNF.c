@@ -22,7 +22,10 @@
 #include "Hash.h"
 #include "rts/storage/HeapAlloc.h"
 #include "BlockAlloc.h"
+#include "sm/OSMem.h"
 #include "Trace.h"
+#include "NonMoving.h"
+#include "NonMovingMark.h"
 #include "sm/ShouldCompact.h"
 
 #include <string.h>
@@ -221,6 +224,7 @@ compactAllocateBlockInternal(Capability            *cap,
         break;
 
     case ALLOCATE_APPEND:
+        ASSERT(!(Bdescr((P_)first)->flags & BF_COMPACT_IMMORTAL));
         g->n_compact_blocks += block->blocks;
         if (g == g0)
             g->n_new_large_words += aligned_size / sizeof(StgWord);
@@ -273,6 +277,10 @@ compactFree(StgCompactNFData *str)
 
     block = compactGetFirstBlock(str);
 
+    if (str->dedup != NULL) {
+        freeHashTable(str->dedup, NULL);
+    }
+
     for ( ; block; block = next) {
         next = block->next;
         bd = Bdescr((StgPtr)block);
@@ -280,6 +288,10 @@ compactFree(StgCompactNFData *str)
             // When using the non-moving collector we leave compact object
             // evacuated to the oldset gen as BF_EVACUATED to avoid evacuating
             // objects in the non-moving heap.
+        if (bd->flags & BF_COMPACT_MAPPED) {
+            osUnmapFileMemory(bd->start, bd->blocks * BLOCK_SIZE);
+            bd->flags &= ~BF_COMPACT_MAPPED;
+        }
         freeGroup(bd);
     }
 }
@@ -381,6 +393,7 @@ compactNew (Capability *cap, StgWord size)
     self->nursery = block;
     self->last = block;
     self->hash = NULL;
+    self->dedup = NULL;
     self->link = NULL;
 
     block->owner = self;
@@ -440,6 +453,355 @@ compactResize (Capability *cap, StgCompactNFData *str, StgWord new_size)
     compactAppendBlock(cap, str, aligned_size);
 }
 
+/* Note [Compact deduplication]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Compacting a value copies it, even where an equal value is in the compact
+   already; sharing is at best preserved within one compactAddWithSharing,
+   through a hash table keyed by the addresses of the original closures and
+   thrown away afterwards. A compact on which compactEnableDedup has been
+   called keeps an index (the dedup field) of the constructors and byte
+   arrays copied into it since, keyed by their contents, so that a closure
+   equal to one in the index is not copied again: hash-consing.
+
+   Contents are compared literally, info pointer and payload words (bytes
+   for ARR_WORDS), so two constructors are equal only if their fields point
+   to the same closures; that is enough because the fields have been
+   deduplicated before. Byte arrays are looked up before they are copied.
+   A constructor can't be: stg_compactAddWorkerzh allocates it before
+   copying its fields, so compactDedup looks up the finished copy, and if
+   an equal closure is in the index already returns that one for the
+   parent's field to point to. If the copy was the last allocation in the
+   compact it is given back, and as the closures under a duplicate are
+   duplicates too, and were given back first, a duplicate structure usually
+   costs no space at all. (Not while compacting with sharing, as the hash
+   table may refer to the copy.) Also, the worker can't tail-call itself for
+   the last field of a constructor then, so compacting a long list takes a
+   deep stack.
+
+   The index refers only to closures in the compact, which don't move, so
+   the GC doesn't need to know about it. It goes with the compact, and isn't
+   serialized: an imported compact doesn't deduplicate.
+*/
+
+STATIC_INLINE const void *
+dedup_payload (const StgClosure *p, const StgInfoTable *info)
+{
+    if (info->type == ARR_WORDS) {
+        return ((const StgArrBytes *)p)->payload;
+    }
+    return p->payload;
+}
+
+STATIC_INLINE StgWord
+dedup_payload_bytes (const StgClosure *p, const StgInfoTable *info)
+{
+    if (info->type == ARR_WORDS) {
+        return ((const StgArrBytes *)p)->bytes;
+    }
+    return (info->layout.payload.ptrs + info->layout.payload.nptrs)
+        * sizeof(StgWord);
+}
+
+static int
+hash_dedup (const HashTable *table, StgWord key)
+{
+    const StgClosure *p = (const StgClosure *)key;
+    const StgInfoTable *info = get_itbl(p);
+    return hashBuffer(table, dedup_payload(p, info),
+                      dedup_payload_bytes(p, info), (StgWord)p->header.info);
+}
+
+static int
+compare_dedup (StgWord key1, StgWord key2)
+{
+    const StgClosure *p = (const StgClosure *)key1;
+    const StgClosure *q = (const StgClosure *)key2;
+    if (p->header.info != q->header.info) {
+        return 0;
+    }
+    const StgInfoTable *info = get_itbl(p);
+    const StgWord n = dedup_payload_bytes(p, info);
+    return n == dedup_payload_bytes(q, info)
+        && memcmp(dedup_payload(p, info), dedup_payload(q, info), n) == 0;
+}
+
+void
+compactEnableDedup (StgCompactNFData *str)
+{
+    if (str->dedup == NULL) {
+        str->dedup = allocHashTable();
+    }
+}
+
+// The closure in the compact equal to p, or NULL
+StgClosure *
+compactDedupLookup (StgCompactNFData *str, StgClosure *p)
+{
+    return lookupHashTable_(str->dedup, (StgWord)p, hash_dedup, compare_dedup);
+}
+
+// Add to, just copied into the compact, to the index
+void
+compactDedupInsert (StgCompactNFData *str, StgClosure *to)
+{
+    insertHashTable_(str->dedup, (StgWord)to, to, hash_dedup);
+}
+
+// The closure to use instead of to, the sizeW words just copied into the
+// compact. See Note [Compact deduplication].
+StgClosure *
+compactDedup (StgCompactNFData *str, StgClosure *to, StgWord sizeW)
+{
+    StgClosure *c = compactDedupLookup(str, to);
+    if (c == NULL) {
+        compactDedupInsert(str, to);
+        return to;
+    }
+    if (str->hash == NULL && str->hp == (P_)to + sizeW) {
+        str->hp = (P_)to;
+    }
+    return c;
+}
+
+static void
+merge_dedup (void *data, StgWord key, const void *value)
+{
+    StgCompactNFData *str = data;
+    if (compactDedupLookup(str, (StgClosure *)key) == NULL) {
+        insertHashTable_(str->dedup, key, value, hash_dedup);
+    }
+}
+
+/* Note [Incremental compaction]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Copying a structure into a compact allocates in the compact rather than
+   in the nursery, so a thread compacting a large structure never reaches a
+   heap check that would let it be descheduled: other threads on its
+   capability wait, and so does every other capability when a GC needs to
+   sync. stg_compactAddWorkerzh therefore checks the capability's
+   context_switch and interrupt flags each time it is entered, and yields if
+   either is set. The copy resumes where it stopped: all of its state is on
+   the stack, and the destination pointers it holds point into the compact,
+   which doesn't move (see Note [compactAddWorker result]). Others can't
+   add to the same compact meanwhile as GHC.Compact holds the compact's lock
+   for the whole of compactAdd.
+
+   Large regions can also be built in parallel: each thread compacts its
+   part into a region of its own, and compactMerge then moves the blocks of
+   one region onto another without copying anything. The merged region's
+   blocks are chained through StgCompactNFDataBlock.next as usual, each
+   with its owner set to the surviving StgCompactNFData; the absorbed
+   StgCompactNFData stays behind at the start of its old first block as
+   an inert object, so that pointers to it and to the closures copied into
+   its region remain valid and keep the merged region alive.
+
+   Only the first block of a region is on a compact_objects list and is
+   looked at by the GC (see evacuate_compact), so merging moves the
+   absorbed region's first block off its list. The merged region takes
+   the older of the two places, lest objects in an older generation that
+   refer to the absorbed region become references to a younger region that
+   the GC doesn't know about. The RTS moves compacts around these lists
+   only during GC, which can't happen while we hold a capability, except
+   that the concurrent nonmoving mark and sweep work on
+   nonmoving_compact_objects, so we refuse to merge regions in the nonmoving
+   heap while a concurrent collection is running.
+*/
+
+// The list a compact region's first block is on, and the count of the
+// blocks on it. Regions in the oldest generation are only moved to the
+// nonmoving heap's list when a nonmoving collection starts, although they
+// are flagged BF_NONMOVING as soon as they are promoted.
+static bdescr **
+compact_list (bdescr *bd, memcount **n_blocks)
+{
+    if (RtsFlags.GcFlags.useNonmoving && bd->gen == oldest_gen) {
+        for (bdescr *p = oldest_gen->compact_objects; p != NULL; p = p->link) {
+            if (p == bd) {
+                *n_blocks = &oldest_gen->n_compact_blocks;
+                return &oldest_gen->compact_objects;
+            }
+        }
+        *n_blocks = &n_nonmoving_compact_blocks;
+        return &nonmoving_compact_objects;
+    }
+    *n_blocks = &bd->gen->n_compact_blocks;
+    return &bd->gen->compact_objects;
+}
+
+// How old is the place of a compact region, for compactMerge?
+static uint32_t
+compact_age (bdescr *bd, bdescr **list)
+{
+    return 2 * bd->gen_no + (list == &nonmoving_compact_objects);
+}
+
+//
+// Move the blocks of other onto str, as the last blocks of its chain,
+// leaving other empty. Returns false, without touching either region, if
+// they can't be merged right now. See Note [Incremental compaction].
+//
+bool
+compactMerge (Capability *cap STG_UNUSED,
+              StgCompactNFData *str,
+              StgCompactNFData *other)
+{
+    bdescr *str_bd, *other_bd, **str_list, **other_list;
+    memcount *str_n_blocks, *other_n_blocks;
+    StgCompactNFDataBlock *block;
+
+    ASSERT(str != other);
+    ASSERT(str->hash == NULL && other->hash == NULL);
+
+    str_bd = Bdescr((P_)str);
+    other_bd = Bdescr((P_)other);
+    ASSERT(!((str_bd->flags | other_bd->flags) & BF_COMPACT_IMMORTAL));
+
+    if (RtsFlags.GcFlags.useNonmoving
+        && ((str_bd->flags | other_bd->flags) & BF_NONMOVING)
+        && nonmovingConcurrentMarkIsRunning()) {
+        return false;
+    }
+
+    // other's nursery block may be behind on how full it is
+    Bdescr((P_)other->nursery)->free = other->hp;
+
+    ACQUIRE_SM_LOCK;
+    str_list = compact_list(str_bd, &str_n_blocks);
+    other_list = compact_list(other_bd, &other_n_blocks);
+
+    dbl_link_remove(other_bd, other_list);
+    *other_n_blocks -= other->totalW / BLOCK_SIZE_W;
+
+    if (compact_age(other_bd, other_list) > compact_age(str_bd, str_list)) {
+        dbl_link_remove(str_bd, str_list);
+        *str_n_blocks -= str->totalW / BLOCK_SIZE_W;
+        str_bd->flags = (other_bd->flags & ~BF_COMPACT_MAPPED)
+            | (str_bd->flags & BF_COMPACT_MAPPED);
+        initBdescr(str_bd, other_bd->gen, &generations[other_bd->dest_no]);
+        dbl_link_onto(str_bd, other_list);
+        str_list = other_list;
+        str_n_blocks = other_n_blocks;
+        *str_n_blocks += str->totalW / BLOCK_SIZE_W;
+    }
+    *str_n_blocks += other->totalW / BLOCK_SIZE_W;
+    RELEASE_SM_LOCK;
+
+    // other's first block is now like any later block of str
+    other_bd->flags = BF_COMPACT | (other_bd->flags & BF_COMPACT_MAPPED);
+    other_bd->link = NULL;
+    for (block = compactGetFirstBlock(other); block; block = block->next) {
+        block->owner = str;
+    }
+
+    ASSERT(str->last->next == NULL);
+    str->last->next = compactGetFirstBlock(other);
+    str->last = other->last;
+    str->totalW += other->totalW;
+
+    // The closures other's index refers to are str's now
+    if (other->dedup != NULL) {
+        if (str->dedup != NULL) {
+            mapHashTable(other->dedup, str, merge_dedup);
+        }
+        freeHashTable(other->dedup, NULL);
+        other->dedup = NULL;
+    }
+
+    other->nursery = NULL;
+    other->last = NULL;
+    other->hp = NULL;
+    other->hpLim = NULL;
+    other->totalW = 0;
+
+    debugTrace(DEBUG_compact, "compactMerge: %p into %p", other, str);
+
+    return true;
+}
+
+/* Note [Immortal compact regions]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The GC never traverses the data in a compact region, but it still has
+   to find out whether each region is alive: every collection of a
+   region's generation moves the region's first block from compact_objects
+   to live_compact_objects when something refers to it, and frees the
+   regions left behind; the nonmoving collector does the same with
+   nonmoving_compact_objects, and a sanity check walks every block of
+   every region. A program that keeps a large, fixed data set in compacts
+   for the whole of its run pays for this at every major GC, to learn
+   nothing.
+
+   compactMakeImmortal takes a region out of the generations altogether:
+   its first block moves to immortal_compact_objects, flagged
+   BF_COMPACT_IMMORTAL, and its blocks are counted in
+   n_immortal_compact_blocks. The GC never looks at that list.
+   evacuate_compact returns as soon as it sees the flag, without setting
+   failed_to_evac, as the region lives at least as long as anything that
+   refers to it; the nonmoving mark ignores the region as it isn't in the
+   snapshot (it isn't flagged BF_NONMOVING_SWEEPING), and isAlive and
+   nonmovingIsAlive consider it alive. An immortal region is never freed,
+   even if nothing refers to it any more, and its size is accounted in O(1)
+   in calcTotalCompactW and memInventory. Only the heap census and
+   findMemoryLeak, which must see every block, still walk the list.
+
+   Nothing may be added to an immortal region: appending blocks would
+   require it to be on a generation's list, and a compaction that
+   preserves sharing keeps a hash table of heap pointers in the region
+   (see Note [Compact Normal Forms]) which the GC updates only when it
+   evacuates the region. GHC.Compact therefore takes the region's lock for
+   good, as compactMerge does. Also like compactMerge, we refuse to move a
+   region off nonmoving_compact_objects while a concurrent mark is running.
+*/
+
+bdescr *immortal_compact_objects = NULL;
+memcount n_immortal_compact_blocks = 0;
+
+//
+// Make str immortal. Returns false if it can't be done right now. See Note
+// [Immortal compact regions].
+//
+bool
+compactMakeImmortal (Capability *cap STG_UNUSED, StgCompactNFData *str)
+{
+    bdescr *bd, **list;
+    memcount *n_blocks;
+
+    ASSERT(str->hash == NULL);
+
+    bd = Bdescr((P_)str);
+    if (bd->flags & BF_COMPACT_IMMORTAL) {
+        return true;
+    }
+
+    if (RtsFlags.GcFlags.useNonmoving
+        && (bd->flags & BF_NONMOVING)
+        && nonmovingConcurrentMarkIsRunning()) {
+        return false;
+    }
+
+    // The nursery block may be behind on how full it is
+    Bdescr((P_)str->nursery)->free = str->hp;
+
+    ACQUIRE_SM_LOCK;
+    list = compact_list(bd, &n_blocks);
+    dbl_link_remove(bd, list);
+    *n_blocks -= str->totalW / BLOCK_SIZE_W;
+    dbl_link_onto(bd, &immortal_compact_objects);
+    n_immortal_compact_blocks += str->totalW / BLOCK_SIZE_W;
+    RELEASE_SM_LOCK;
+
+    // Under the nonmoving collector an object in the oldest generation
+    // must look like it is in the nonmoving heap (see nonmovingIsAlive).
+    bd->flags = BF_COMPACT | BF_COMPACT_IMMORTAL
+        | (bd->flags & BF_COMPACT_MAPPED)
+        | (RtsFlags.GcFlags.useNonmoving ? BF_NONMOVING : 0);
+    initBdescr(bd, oldest_gen, oldest_gen);
+
+    debugTrace(DEBUG_compact, "compactMakeImmortal: %p (%" FMT_Word " words)",
+               str, (W_) str->totalW);
+
+    return true;
+}
+
 STATIC_INLINE bool
 has_room_for  (bdescr *bd, StgWord sizeW)
 {
@@ -604,6 +966,62 @@ compactAllocateBlock(Capability            *cap,
     return block;
 }
 
+/* Note [Mapping compact regions from files]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   GHC.Compact.Serialized.writeCompactFile stores a compact region in a file
+   with each block at an offset that is a multiple of BLOCK_SIZE, and
+   mapCompactFile imports it with compactMapBlock, which allocates each block
+   as compactAllocateBlock does and then replaces the block's memory with a
+   private mapping of the file (osMapFileMemory). Only the pages that are
+   written to are copied, so importing a large region costs little more than
+   allocating its block descriptors, and processes that map the same file
+   share its unmodified pages through the page cache.
+
+   Nothing is shared if the region's pointers have to be fixed up, as
+   that writes to nearly every page: the file's blocks must be mapped at the
+   addresses they had when it was written. The rest of the import writes to
+   a few places only, the StgCompactNFData in the first block and the block
+   headers, and avoids writing the values that are already there (as they
+   are when the blocks didn't move).
+
+   The mapping can't be used if the page size is larger than BLOCK_SIZE,
+   or if the file can't be mapped (e.g. on Windows); compactMapBlock then
+   leaves the block to be filled by the caller, like compactAllocateBlock.
+   Mapped blocks are flagged BF_COMPACT_MAPPED, which tells the caller
+   whether it has to fill the block, and compactFree to give the block back
+   its ordinary memory before returning it to the block allocator.
+*/
+
+StgCompactNFDataBlock *
+compactMapBlock(Capability            *cap,
+                StgWord                size,
+                StgCompactNFDataBlock *previous,
+                StgWord                fd,
+                StgWord                offset)
+{
+    StgCompactNFDataBlock *block;
+    bdescr *bd;
+
+    // See compactAllocateBlock
+    block = compactAllocateBlockInternal(cap, BLOCK_ROUND_UP(size), NULL,
+                                         previous != NULL ? ALLOCATE_IMPORT_APPEND : ALLOCATE_IMPORT_NEW);
+
+    bd = Bdescr((P_)block);
+    if (getPageSize() <= BLOCK_SIZE
+        && offset % getPageSize() == 0
+        && osMapFileMemory(bd->start, size, (int)fd, offset)) {
+        bd->flags |= BF_COMPACT_MAPPED;
+    }
+
+    // See Note [Mapping compact regions from files]
+    if (previous != NULL && previous->next != block)
+        previous->next = block;
+
+    bd->free = (P_)((W_)bd->start + size);
+
+    return block;
+}
+
 //
 // shouldCompact(c,p): returns:
 //    SHOULDCOMPACT_IN_CNF if the object is in c
@@ -986,8 +1404,8 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
 
         case COMPACT_NFDATA:
             if (p == (bd->start + sizeofW(StgCompactNFDataBlock))) {
-                // Ignore the COMPACT_NFDATA header
-                // (it will be fixed up later)
+                // Ignore the COMPACT_NFDATA header (it will be fixed up
+                // later, or was left behind by compactMerge)
                 p += sizeofW(StgCompactNFData);
                 break;
             }
@@ -1092,7 +1510,10 @@ fixup_late(StgCompactNFData *str, StgCompactNFDataBlock *block)
     nursery = block;
     totalW = 0;
     do {
-        block->self = block;
+        // Don't write what is already there, so that the pages of mapped
+        // blocks stay shared; see Note [Mapping compact regions from files]
+        if (block->self != block)
+            block->self = block;
 
         bd = Bdescr((P_)block);
         totalW += bd->blocks * BLOCK_SIZE_W;
@@ -1100,7 +1521,8 @@ fixup_late(StgCompactNFData *str, StgCompactNFDataBlock *block)
         if (block->owner != NULL) {
             if (bd->free != bd->start)
                 nursery = block;
-            block->owner = str;
+            if (block->owner != str)
+                block->owner = str;
         }
 
         block = block->next;
@@ -1112,6 +1534,9 @@ fixup_late(StgCompactNFData *str, StgCompactNFDataBlock *block)
     str->hpLim = bd->start + bd->blocks * BLOCK_SIZE_W;
 
     str->totalW = totalW;
+
+    // See Note [Compact deduplication]
+    str->dedup = NULL;
 }
 
 static StgClosure *
@@ -20,8 +20,19 @@ StgCompactNFData *compactNew   (Capability      *cap,
 void              compactResize(Capability       *cap,
                                 StgCompactNFData *str,
                                 StgWord           new_size);
+bool              compactMerge (Capability       *cap,
+                                StgCompactNFData *str,
+                                StgCompactNFData *other);
+bool              compactMakeImmortal(Capability       *cap,
+                                      StgCompactNFData *str);
 void              compactFree  (StgCompactNFData *str);
 void              compactMarkKnown(StgCompactNFData *str);
+void              compactEnableDedup(StgCompactNFData *str);
+StgClosure       *compactDedupLookup(StgCompactNFData *str, StgClosure *p);
+void              compactDedupInsert(StgCompactNFData *str, StgClosure *to);
+StgClosure       *compactDedup (StgCompactNFData *str,
+                                StgClosure       *to,
+                                StgWord           sizeW);
 StgWord           compactContains(StgCompactNFData *str,
                                   StgPtr            what);
 StgWord           countCompactBlocks(bdescr *outer);
@@ -30,9 +41,19 @@ StgWord           countCompactBlocks(bdescr *outer);
 StgWord           countAllocdCompactBlocks(bdescr *outer);
 #endif
 
+// The compact regions that the GC never looks at; see
+// Note [Immortal compact regions] in CNF.c.
+extern bdescr *immortal_compact_objects;
+extern memcount n_immortal_compact_blocks;
+
 StgCompactNFDataBlock *compactAllocateBlock(Capability            *cap,
                                             StgWord                size,
                                             StgCompactNFDataBlock *previous);
+StgCompactNFDataBlock *compactMapBlock     (Capability            *cap,
+                                            StgWord                size,
+                                            StgCompactNFDataBlock *previous,
+                                            StgWord                fd,
+                                            StgWord                offset);
 StgPtr                 compactFixupPointers(StgCompactNFData      *str,
                                             StgClosure            *root);
 
@@ -71,6 +71,9 @@
 static /* STATIC_INLINE */ P_
 thread_obj (const StgInfoTable *info, P_ p);
 
+// Set while several GC threads may be threading pointers at once.
+// See Note [Parallel compaction].
+static bool compact_par = false;
 
 STATIC_INLINE W_
 UNTAG_PTR(W_ p)
@@ -143,9 +146,22 @@ thread (StgClosure **p)
 
         if (bd->flags & BF_MARKED)
         {
-            W_ iptr = *q;
-            *p = (StgClosure *)iptr;
-            *q = (W_)p + 1 + (q0_tagged ? 1 : 0);
+            W_ new = (W_)p + 1 + (q0_tagged ? 1 : 0);
+            if (compact_par) {
+                // Push p onto q's chain; other threads may be pushing
+                // their fields onto the same chain.
+                W_ iptr = ACQUIRE_LOAD(q);
+                for (;;) {
+                    *p = (StgClosure *)iptr;
+                    W_ old = cas((StgVolatilePtr)q, iptr, new);
+                    if (old == iptr) break;
+                    iptr = old;
+                }
+            } else {
+                W_ iptr = *q;
+                *p = (StgClosure *)iptr;
+                *q = new;
+            }
         }
     }
 }
@@ -199,7 +215,9 @@ loop:
 STATIC_INLINE StgInfoTable*
 get_threaded_info( P_ p )
 {
-    W_ q = (W_)GET_INFO(UNTAG_CLOSURE((StgClosure *)p));
+    // The acquire pairs with the cas() in thread(). See Note [Parallel
+    // compaction].
+    W_ q = ACQUIRE_LOAD((P_)UNTAG_CLOSURE((StgClosure *)p));
 
 loop:
     switch (GET_PTR_TAG(q))
@@ -554,13 +572,11 @@ update_fwd_cnf( bdescr *bd )
 }
 
 static void
-update_fwd_large( bdescr *bd )
+update_fwd_large_obj( bdescr *bd )
 {
-  for (; bd != NULL; bd = bd->link) {
-
     // nothing to do in a pinned block; it might not even have an object
     // at the beginning.
-    if (bd->flags & BF_PINNED) continue;
+    if (bd->flags & BF_PINNED) return;
 
     P_ p = bd->start;
     const StgInfoTable *info = get_itbl((StgClosure *)p);
@@ -569,13 +585,13 @@ update_fwd_large( bdescr *bd )
 
     case ARR_WORDS:
       // nothing to follow
-      continue;
+      return;
 
     // See Note [Black holes in large objects] in Evac.c for why.
     case BLACKHOLE:
       {
         thread_obj(info, p);
-        continue;
+        return;
       }
 
     case MUT_ARR_PTRS_CLEAN:
@@ -590,7 +606,7 @@ update_fwd_large( bdescr *bd )
           for (p = (P_)a->payload; p < (P_)&a->payload[a->ptrs]; p++) {
               thread((StgClosure **)p);
           }
-          continue;
+          return;
       }
 
     case SMALL_MUT_ARR_PTRS_CLEAN:
@@ -603,23 +619,23 @@ update_fwd_large( bdescr *bd )
           for (p = (P_)a->payload; p < (P_)&a->payload[a->ptrs]; p++) {
               thread((StgClosure **)p);
           }
-          continue;
+          return;
       }
 
     case STACK:
     {
         StgStack *stack = (StgStack*)p;
         thread_stack(stack->sp, stack->stack + stack->stack_size);
-        continue;
+        return;
     }
 
     case AP_STACK:
         thread_AP_STACK((StgAP_STACK *)p);
-        continue;
+        return;
 
     case PAP:
         thread_PAP((StgPAP *)p);
-        continue;
+        return;
 
     case TREC_CHUNK:
     {
@@ -631,17 +647,24 @@ update_fwd_large( bdescr *bd )
           thread(&e->expected_value);
           thread(&e->new_value);
         }
-        continue;
+        return;
     }
 
     case CONTINUATION:
         thread_continuation((StgContinuation *)p);
-        continue;
+        return;
 
     default:
       barf("update_fwd_large: unknown/strange object  %d", (int)(info->type));
     }
-  }
+}
+
+static void
+update_fwd_large( bdescr *bd )
+{
+    for (; bd != NULL; bd = bd->link) {
+        update_fwd_large_obj(bd);
+    }
 }
 
 // ToDo: too big to inline
@@ -833,6 +856,19 @@ thread_obj (const StgInfoTable *info, P_ p)
     }
 }
 
+static void
+update_fwd_block( bdescr *bd )
+{
+    P_ p = bd->start;
+
+    // linearly scan the objects in this block
+    while (p < bd->free) {
+        ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
+        const StgInfoTable *info = get_itbl((StgClosure *)p);
+        p = thread_obj(info, p);
+    }
+}
+
 static void
 update_fwd( bdescr *blocks )
 {
@@ -840,26 +876,22 @@ update_fwd( bdescr *blocks )
 
     // cycle through all the blocks in the step
     for (; bd != NULL; bd = bd->link) {
-        P_ p = bd->start;
-
-        // linearly scan the objects in this block
-        while (p < bd->free) {
-            ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
-            const StgInfoTable *info = get_itbl((StgClosure *)p);
-            p = thread_obj(info, p);
-        }
+        update_fwd_block(bd);
     }
 }
 
+// Thread the fields of the marked objects in the first n_blocks blocks of
+// `blocks`, and unthread the forward pointers to them, assigning
+// destinations from the start of `blocks`.
 static void
-update_fwd_compact( bdescr *blocks )
+update_fwd_compact( bdescr *blocks, W_ n_blocks )
 {
     bdescr *bd = blocks;
     bdescr *free_bd = blocks;
     P_ free = free_bd->start;
 
     // cycle through all the blocks in the step
-    for (; bd != NULL; bd = bd->link) {
+    for (; bd != NULL && n_blocks > 0; bd = bd->link, n_blocks--) {
         P_ p = bd->start;
 
         while (p < bd->free ) {
@@ -986,6 +1018,318 @@ update_bkwd_compact( generation *gen )
     return free_blocks;
 }
 
+/* -----------------------------------------------------------------------------
+   Parallel compaction
+
+   Note [Parallel compaction]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With -qc, and when the GC is running in parallel, compact() uses the
+   GC threads (see Note [Running tasks on exited GC threads] in GC.c) for
+   two of its three heap passes:
+
+    * Threading the fields of objects outside the compacted area (the
+      to-space blocks of every generation and the large objects).  These
+      objects never move, and their own headers are never threaded (only
+      objects in BF_MARKED blocks are), so the blocks are independent and
+      are handed out to the threads one by one.  Two threads may however
+      thread fields pointing to the same object, so thread() pushes onto
+      the object's chain with a cas() while compact_par is set.  Nothing
+      is unthreaded during this pass, so a chain only ever grows at its
+      head, and get_threaded_info() can walk it concurrently.
+
+    * Sliding.  The compacted area (oldest_gen->old_blocks) is cut into
+      segments of at least COMPACT_SEGMENT_MIN_BLOCKS blocks, and each
+      segment is compacted into itself, rather than the whole area into its
+      start.  update_bkwd_compact() is then split in two: first every
+      segment unthreads the backward pointers to its objects, then, after a
+      barrier, every segment moves its objects.  Unthreading writes into
+      fields that may belong to another segment, which is why no object may
+      move until every chain has been unthreaded.  The price is up to one
+      partly filled block per segment.
+
+   The pass over the compacted area itself (update_fwd_compact) stays
+   sequential, apart from restarting the destination at each segment:
+   there, unthreading an object's forward chain would race with other
+   threads still walking or extending it.
+   -------------------------------------------------------------------------- */
+
+#define COMPACT_SEGMENT_MIN_BLOCKS 256
+
+// Blocks are handed out to update_fwd_task() this many at a time.
+#define COMPACT_FWD_CHUNK 16
+
+typedef struct {
+    bdescr *first;      // first block of the segment in old_blocks
+    bdescr *last;       // last block of the segment
+    W_ n_blocks;
+    bdescr *free_bd;    // last block in use after sliding
+    W_ n_used;          // number of blocks in use after sliding
+} CompactSegment;
+
+static bdescr **fwd_blocks;     // blocks to pass to update_fwd_block()
+static W_ n_fwd_blocks;
+static bdescr **fwd_large;      // blocks to pass to update_fwd_large_obj()
+static W_ n_fwd_large;
+static CompactSegment *segments;
+static W_ n_segments;
+
+// work counters, claimed with atomic_inc()
+static StgWord fwd_blocks_next;
+static StgWord fwd_large_next;
+static StgWord segments_next;
+
+static W_
+count_chain( bdescr *bd )
+{
+    W_ n = 0;
+    for (; bd != NULL; bd = bd->link) n++;
+    return n;
+}
+
+static bdescr **
+push_chain( bdescr **to, bdescr *bd )
+{
+    for (; bd != NULL; bd = bd->link) *to++ = bd;
+    return to;
+}
+
+static void
+init_fwd_work( void )
+{
+    W_ n_blocks = 0, n_large = 0;
+
+    for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        n_blocks += count_chain(generations[g].blocks);
+        for (W_ n = 0; n < getNumCapabilities(); n++) {
+            n_blocks += count_chain(gc_threads[n]->gens[g].todo_bd);
+            n_blocks += count_chain(gc_threads[n]->gens[g].part_list);
+        }
+        n_large += count_chain(generations[g].scavenged_large_objects);
+    }
+
+    fwd_blocks = stgMallocBytes(stg_max(n_blocks, 1) * sizeof(bdescr *),
+                                "init_fwd_work");
+    fwd_large = stgMallocBytes(stg_max(n_large, 1) * sizeof(bdescr *),
+                               "init_fwd_work");
+
+    bdescr **b = fwd_blocks, **l = fwd_large;
+    for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        b = push_chain(b, generations[g].blocks);
+        for (W_ n = 0; n < getNumCapabilities(); n++) {
+            b = push_chain(b, gc_threads[n]->gens[g].todo_bd);
+            b = push_chain(b, gc_threads[n]->gens[g].part_list);
+        }
+        l = push_chain(l, generations[g].scavenged_large_objects);
+    }
+    n_fwd_blocks = n_blocks;
+    n_fwd_large = n_large;
+    fwd_blocks_next = 0;
+    fwd_large_next = 0;
+}
+
+static void
+update_fwd_task( void )
+{
+    for (;;) {
+        W_ i = atomic_inc(&fwd_blocks_next, COMPACT_FWD_CHUNK)
+                   - COMPACT_FWD_CHUNK;
+        if (i >= n_fwd_blocks) break;
+        W_ end = stg_min(i + COMPACT_FWD_CHUNK, n_fwd_blocks);
+        for (; i < end; i++) {
+            update_fwd_block(fwd_blocks[i]);
+        }
+    }
+    for (;;) {
+        W_ i = atomic_inc(&fwd_large_next, 1) - 1;
+        if (i >= n_fwd_large) break;
+        update_fwd_large_obj(fwd_large[i]);
+    }
+}
+
+static void
+init_segments( generation *gen )
+{
+    W_ n_blocks = count_chain(gen->old_blocks);
+    W_ n_segs = stg_min(n_blocks / COMPACT_SEGMENT_MIN_BLOCKS,
+                        4 * getNumCapabilities());
+    if (n_segs == 0) n_segs = 1;
+    W_ seg_blocks = (n_blocks + n_segs - 1) / n_segs;
+
+    segments = stgMallocBytes(n_segs * sizeof(CompactSegment),
+                              "init_segments");
+    bdescr *bd = gen->old_blocks;
+    W_ i = 0;
+    while (bd != NULL) {
+        CompactSegment *seg = &segments[i++];
+        seg->first = bd;
+        seg->n_blocks = 0;
+        while (bd != NULL && seg->n_blocks < seg_blocks) {
+            seg->last = bd;
+            seg->n_blocks++;
+            bd = bd->link;
+        }
+        seg->free_bd = NULL;
+        seg->n_used = 0;
+    }
+    ASSERT(i <= n_segs);
+    n_segments = i;
+}
+
+// First half of update_bkwd_compact() for one segment: unthread the
+// backward pointers to each live object, without moving anything.
+static void
+unthread_segment( CompactSegment *seg )
+{
+    bdescr *free_bd = seg->first;
+    P_ free = free_bd->start;
+    bdescr *bd = seg->first;
+
+    for (W_ n = seg->n_blocks; n > 0; bd = bd->link, n--) {
+        P_ p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+
+            if (p >= bd->free) {
+                break;
+            }
+
+            if (is_marked(p+1,bd)) {
+                free_bd = free_bd->link;
+                free = free_bd->start;
+            }
+
+            StgInfoTable *iptr = get_threaded_info(p);
+            StgWord iptr_tag = get_iptr_tag(iptr);
+            unthread(p, (W_)free, iptr_tag);
+            ASSERT(LOOKS_LIKE_INFO_PTR((W_)((StgClosure *)p)->header.info));
+            W_ size = closure_sizeW((StgClosure *)p);
+
+            free += size;
+            p += size;
+        }
+    }
+}
+
+// Second half of update_bkwd_compact() for one segment: slide the live
+// objects down to the start of the segment.
+static void
+slide_segment( CompactSegment *seg )
+{
+    bdescr *free_bd = seg->first;
+    P_ free = free_bd->start;
+    W_ free_blocks = 1;
+    bdescr *bd = seg->first;
+
+    for (W_ n = seg->n_blocks; n > 0; bd = bd->link, n--) {
+        P_ p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+
+            if (p >= bd->free) {
+                break;
+            }
+
+            if (is_marked(p+1,bd)) {
+                free_bd->free = free;
+
+                IF_DEBUG(zero_on_gc, {
+                    memset(free_bd->free, 0xaa,
+                           BLOCK_SIZE - ((W_)(free_bd->free - free_bd->start) * sizeof(W_)));
+                });
+
+                free_bd = free_bd->link;
+                free = free_bd->start;
+                free_blocks++;
+            }
+
+            const StgInfoTable *info = get_itbl((StgClosure *)p);
+            W_ size = closure_sizeW_((StgClosure *)p,info);
+
+            if (free != p) {
+                move(free,p,size);
+            }
+
+            // relocate TSOs
+            if (info->type == STACK) {
+                move_STACK((StgStack *)p, (StgStack *)free);
+            }
+
+            free += size;
+            p += size;
+        }
+    }
+
+    free_bd->free = free;
+
+    IF_DEBUG(zero_on_gc, {
+        W_ block_size_bytes = free_bd->blocks * BLOCK_SIZE;
+        W_ block_in_use_bytes = (free_bd->free - free_bd->start) * sizeof(W_);
+        W_ block_free_bytes = block_size_bytes - block_in_use_bytes;
+        memset(free_bd->free, 0xaa, block_free_bytes);
+    });
+
+    seg->free_bd = free_bd;
+    seg->n_used = free_blocks;
+}
+
+static void
+unthread_segments_task( void )
+{
+    for (;;) {
+        W_ i = atomic_inc(&segments_next, 1) - 1;
+        if (i >= n_segments) break;
+        unthread_segment(&segments[i]);
+    }
+}
+
+static void
+slide_segments_task( void )
+{
+    for (;;) {
+        W_ i = atomic_inc(&segments_next, 1) - 1;
+        if (i >= n_segments) break;
+        slide_segment(&segments[i]);
+    }
+}
+
+// The parallel equivalent of update_bkwd_compact() for the segments set up
+// by init_segments(): returns the number of blocks left in old_blocks.
+static W_
+update_bkwd_compact_par( void )
+{
+    segments_next = 0;
+    runGcTask(unthread_segments_task);
+    segments_next = 0;
+    runGcTask(slide_segments_task);
+
+    // Link the used part of each segment to the next segment, and free the
+    // rest.
+    W_ blocks = 0;
+    for (W_ i = 0; i < n_segments; i++) {
+        CompactSegment *seg = &segments[i];
+        bdescr *next = i + 1 < n_segments ? segments[i+1].first : NULL;
+        if (seg->free_bd != seg->last) {
+            bdescr *unused = seg->free_bd->link;
+            seg->last->link = NULL;
+            freeChain(unused);
+        }
+        seg->free_bd->link = next;
+        blocks += seg->n_used;
+    }
+
+    stgFree(segments);
+    segments = NULL;
+    return blocks;
+}
+
 void
 compact(StgClosure *static_objects,
         StgWeak **dead_weak_ptr_list,
@@ -1047,7 +1391,40 @@ compact(StgClosure *static_objects,
     // the CAF list (used by GHCi)
     markCAFs((evac_fn)thread_root, NULL);
 
+    compact_par = RtsFlags.ParFlags.parCompact && isParallelGc()
+        && oldest_gen->old_blocks != NULL;
+
     // 2. update forward ptrs
+    if (compact_par) {
+        // See Note [Parallel compaction]
+        debugTrace(DEBUG_gc, "update_fwd: parallel");
+        init_fwd_work();
+        runGcTask(update_fwd_task);
+        stgFree(fwd_blocks);
+        stgFree(fwd_large);
+        compact_par = false;
+
+        for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
+            update_fwd_cnf(generations[g].live_compact_objects);
+        }
+
+        init_segments(oldest_gen);
+        debugTrace(DEBUG_gc, "update_fwd:  %d (compact, %d segments)",
+                   oldest_gen->no, (int)n_segments);
+        for (W_ i = 0; i < n_segments; i++) {
+            update_fwd_compact(segments[i].first, segments[i].n_blocks);
+        }
+
+        W_ blocks = update_bkwd_compact_par();
+        debugTrace(DEBUG_gc,
+                   "update_bkwd: %d (parallel compact, old: %d blocks, now %d blocks)",
+                   oldest_gen->no, oldest_gen->n_old_blocks, blocks);
+        oldest_gen->n_old_blocks = blocks;
+
+        rehash_CNFs();
+        return;
+    }
+
     for (W_ g = 0; g < RtsFlags.GcFlags.generations; g++) {
         generation *gen = &generations[g];
         debugTrace(DEBUG_gc, "update_fwd:  %d", g);
@@ -1061,7 +1438,7 @@ compact(StgClosure *static_objects,
         update_fwd_cnf(gen->live_compact_objects);
         if (g == RtsFlags.GcFlags.generations-1 && gen->old_blocks != NULL) {
             debugTrace(DEBUG_gc, "update_fwd:  %d (compact)", g);
-            update_fwd_compact(gen->old_blocks);
+            update_fwd_compact(gen->old_blocks, ~(W_)0);
         }
     }
 
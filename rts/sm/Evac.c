@@ -32,7 +32,11 @@
 #include "CNF.h"
 #include "Scav.h"
 #include "NonMovingAllocate.h"
+#include "Pretenure.h"
+#include "PinnedLiveness.h"
+#include "LoanedBytes.h"
 #include "CheckUnload.h" // n_unloaded_objects and markObjectCode
+#include "MarkWeak.h"
 
 #if defined(THREADED_RTS) && !defined(PARALLEL_GC)
 #define evacuate(p) evacuate1(p)
@@ -47,20 +51,33 @@
 
 /* Note [Selector optimisation depth limit]
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
- * MAX_THUNK_SELECTOR_DEPTH is used to avoid long recursion of
- * eval_thunk_selector due to nested selector thunks. Note that this *only*
- * counts nested selector thunks, e.g. `fst (fst (... (fst x)))`. The collector
- * will traverse interleaved selector-constructor pairs without limit, e.g.
+ * eval_thunk_selector evaluates nested selector thunks, e.g.
+ * `fst (fst (... (fst x)))`, without recursing: when the selectee of a
+ * selector thunk is itself a selector thunk it saves its state in a
+ * SelectorFrame on the GC thread's selector_frames and starts on the
+ * selectee, and resumes the outer selector once the inner one is done. The
+ * frames are allocated when the GC thread is, so the nesting is limited to
+ * --selector-depth (16 by default); deeper selectors are left as they are,
+ * to be evaluated by a later GC or by the program. This *only* counts nested
+ * selector thunks. The collector will traverse interleaved
+ * selector-constructor pairs without limit, e.g.
  *
  *     a = (fst b, _)
  *     b = (fst c, _)
  *     c = (fst d, _)
  *     d = (x, _)
  *
+ * Long chains like this one, typical of lazy state monads, can make a GC
+ * spend much of its time in eval_thunk_selector. With --selector-budget=<n>
+ * each GC thread evaluates at most about <n> selector thunks per GC and
+ * evacuates the others as ordinary thunks once its budget is spent.
+ *
+ * The selector thunks that were updated with their value, and those left
+ * because of the depth or budget limit, are counted in gc_thread and
+ * reported by +RTS -s.
  */
-#define MAX_THUNK_SELECTOR_DEPTH 16
 
-static void eval_thunk_selector (StgClosure **q, StgSelector *p, bool);
+static void eval_thunk_selector (StgClosure **q, StgSelector *p, bool evac);
 ATTR_NOINLINE static void evacuate_large(StgPtr p);
 
 /* -----------------------------------------------------------------------------
@@ -71,6 +88,7 @@ static StgPtr
 alloc_in_nonmoving_heap (uint32_t size)
 {
     gct->copied += size;
+    gct->gen_copied[oldest_gen->no] += size;
     StgPtr to = nonmovingAllocateGC(gct->cap, size);
 
     // See Note [Scavenging the non-moving heap] in NonMovingScav.c.
@@ -173,6 +191,33 @@ alloc_for_copy (uint32_t size, uint32_t gen_no)
     return alloc_in_moving_heap(size, gen_no);
 }
 
+/* -----------------------------------------------------------------------------
+   Pretenuring: count the copy of an object with the given info table out of
+   bd, and return the generation to copy it to. See Note [Pretenuring] in
+   Pretenure.c.
+   -------------------------------------------------------------------------- */
+
+STATIC_INLINE uint32_t
+pretenure_dest (const StgInfoTable *info, bdescr *bd, uint32_t gen_no)
+{
+    const StgWord i = pretenureHash(info);
+    PretenureSample *s = &gct->pretenure_samples[i];
+
+    if (s->info == info || s->info == NULL) {
+        s->info = info;
+        if (bd->gen_no == 0) {
+            s->young++;
+        } else {
+            s->old++;
+        }
+    }
+
+    if (bd->gen_no == 0 && pretenured_infos[i] == info) {
+        return oldest_gen->no;
+    }
+    return gen_no;
+}
+
 /* -----------------------------------------------------------------------------
    The evacuate() code
    -------------------------------------------------------------------------- */
@@ -222,6 +267,51 @@ alloc_for_copy (uint32_t size, uint32_t gen_no)
  *
  */
 
+/* Note [Racing to copy an object]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Two GC threads can find the same object at the same time; an object
+ * reachable from many places (a shared constructor, say) often is. We
+ * don't lock the object while we copy it, as only one thread at a time
+ * could then copy it and the others would have to spin until it had
+ * finished. Instead each thread copies it to its own to-space and then
+ * tries to install a forwarding pointer to its copy with a CAS on the
+ * header (copy_tag); the thread whose CAS fails takes the winner's
+ * copy, by evacuating the object again, and its own copy is wasted.
+ * (Immutable objects whose copies can't be told apart don't even need
+ * the CAS, see copy_tag_nolock.)
+ *
+ * The loser has allocated nothing since its copy, so unless the copy went
+ * to the nonmoving heap it is the last thing in the loser's todo block:
+ * unalloc_for_copy gives the space back, and the copy never becomes part
+ * of the heap. Otherwise the copy stays in to-space, unreachable, until
+ * the next GC. +RTS -s reports how many copies were lost
+ * (gct->copy_races) and the size of those left behind.
+ *
+ * Selector thunks under evaluation (eval_thunk_selector) and stacks
+ * (copyPart) are still claimed by WHITEHOLEing them: a stack's copy is
+ * finished after it is claimed, and a stack has a single TSO pointing
+ * to it, so nobody waits for it in practice.
+ */
+
+#if defined(PARALLEL_GC)
+/* Give back the space of a copy of size words at to, the last thing this
+ * GC thread allocated, if it is still at the end of a todo block; see
+ * Note [Racing to copy an object]. Returns whether it could.
+ */
+STATIC_INLINE bool
+unalloc_for_copy (StgPtr to, uint32_t size)
+{
+    for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        gen_workspace *ws = &gct->gens[g];
+        if (ws->todo_free == to + size && ws->todo_bd->start <= to) {
+            ws->todo_free = to;
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
 /* size is in words
 
    We want to *always* inline this as often the size of the closure is static,
@@ -252,19 +342,24 @@ copy_tag(StgClosure **p, const StgInfoTable *info,
         const StgInfoTable *new_info;
         new_info = (const StgInfoTable *)cas((StgPtr)&src->header.info, (W_)info, MK_FORWARDING_PTR(to));
         if (new_info != info) {
-#if defined(PROFILING)
             // We copied this object at the same time as another
-            // thread.  We'll evacuate the object again and the copy
-            // we just made will be discarded at the next GC, but we
-            // may have copied it after the other thread called
-            // SET_EVACUAEE_FOR_LDV(), which would confuse the LDV
-            // profiler when it encounters this closure in
-            // processHeapClosureForDead.  So we reset the LDVW field
-            // here.
-            if (doingLDVProfiling()){
-              LDVW(to) = 0;
-            }
+            // thread, which won. See Note [Racing to copy an object].
+            gct->copy_races++;
+            if (!unalloc_for_copy(to, size)) {
+                gct->copy_race_words += size;
+#if defined(PROFILING)
+                // We'll evacuate the object again and the copy we just
+                // made will be discarded at the next GC, but we may have
+                // copied it after the other thread called
+                // SET_EVACUAEE_FOR_LDV(), which would confuse the LDV
+                // profiler when it encounters this closure in
+                // processHeapClosureForDead.  So we reset the LDVW field
+                // here.
+                if (doingLDVProfiling()){
+                  LDVW(to) = 0;
+                }
 #endif
+            }
             return evacuate(p); // does the failed_to_evac stuff
         } else {
             // This doesn't need to have RELEASE ordering since we are guaranteed
@@ -388,9 +483,11 @@ copy(StgClosure **p, const StgInfoTable *info,
 /* -----------------------------------------------------------------------------
    Evacuate a large object
 
-   This just consists of removing the object from the (doubly-linked)
-   gen->large_objects list, and linking it on to the (singly-linked)
-   gct->todo_large_objects list, from where it will be scavenged later.
+   This just consists of claiming the object by setting BF_EVACUATED,
+   and linking it on to the (singly-linked) gct->todo_large_objects
+   list, from where it will be scavenged later.  The object stays where
+   it is on the generation's list of large objects being collected; see
+   Note [Large objects during GC] in GC.c.
 
    Convention: bd->flags has BF_EVACUATED set for a large object
    that has been evacuated, or unset otherwise.
@@ -400,17 +497,24 @@ ATTR_NOINLINE static void
 evacuate_large(StgPtr p)
 {
   bdescr *bd;
-  generation *gen, *new_gen;
+  generation *new_gen;
   uint32_t gen_no, new_gen_no;
   gen_workspace *ws;
 
   bd = Bdescr(p);
-  gen = RELAXED_LOAD(&bd->gen);
   gen_no = RELAXED_LOAD(&bd->gen_no);
-  ACQUIRE_SPIN_LOCK(&gen->sync);
+  ASSERT(!(RELAXED_LOAD(&bd->flags) & BF_NONMOVING));
+
+  // See Note [Pinned block liveness] in PinnedLiveness.c.  The block
+  // must be added before anyone can see it evacuated, as that is when
+  // evacuate() starts marking objects in it.
+  if (RTS_UNLIKELY(pinned_liveness != NULL)
+      && (RELAXED_LOAD(&bd->flags) & (BF_PINNED | BF_EVACUATED)) == BF_PINNED) {
+      pinnedLivenessAddBlock(bd);
+  }
 
-  // already evacuated?
-  if (RELAXED_LOAD(&bd->flags) & BF_EVACUATED) {
+  // already evacuated?  If not, it's ours now.
+  if (__atomic_fetch_or(&bd->flags, BF_EVACUATED, __ATOMIC_ACQ_REL) & BF_EVACUATED) {
     /* Don't forget to set the gct->failed_to_evac flag if we didn't get
      * the desired destination (see comments in evacuate()).
      */
@@ -418,13 +522,9 @@ evacuate_large(StgPtr p)
         gct->failed_to_evac = true;
         TICK_GC_FAILED_PROMOTION();
     }
-    RELEASE_SPIN_LOCK(&gen->sync);
     return;
   }
 
-  // remove from large_object list
-  dbl_link_remove(bd, &gen->large_objects);
-
   /* link it on to the evacuated large object list of the destination gen
    */
   new_gen_no = bd->dest_no;
@@ -443,7 +543,6 @@ evacuate_large(StgPtr p)
   ws = &gct->gens[new_gen_no];
   new_gen = &generations[new_gen_no];
 
-  __atomic_fetch_or(&bd->flags, BF_EVACUATED, __ATOMIC_ACQ_REL);
   if (RTS_UNLIKELY(RtsFlags.GcFlags.useNonmoving && new_gen == oldest_gen)) {
       __atomic_fetch_or(&bd->flags, BF_NONMOVING, __ATOMIC_ACQ_REL);
 
@@ -457,20 +556,14 @@ evacuate_large(StgPtr p)
   // If this is a block of pinned or compact objects, we don't have to scan
   // these objects, because they aren't allowed to contain any outgoing
   // pointers.  For these blocks, we skip the scavenge stage and put
-  // them straight on the scavenged_large_objects list.
+  // them straight on the scavenged large objects list.
   if (RELAXED_LOAD(&bd->flags) & BF_PINNED) {
       ASSERT(get_itbl((StgClosure *)p)->type == ARR_WORDS);
-
-      if (new_gen != gen) { ACQUIRE_SPIN_LOCK(&new_gen->sync); }
-      dbl_link_onto(bd, &new_gen->scavenged_large_objects);
-      new_gen->n_scavenged_large_blocks += bd->blocks;
-      if (new_gen != gen) { RELEASE_SPIN_LOCK(&new_gen->sync); }
+      push_scavd_large_object(ws, bd);
   } else {
       bd->link = ws->todo_large_objects;
       ws->todo_large_objects = bd;
   }
-
-  RELEASE_SPIN_LOCK(&gen->sync);
 }
 
 /* ----------------------------------------------------------------------------
@@ -539,6 +632,12 @@ evacuate_compact (StgPtr p)
     bd = Bdescr((StgPtr)str);
     gen_no = bd->gen_no;
 
+    // An immortal compact outlives everything that refers to it, so there
+    // is nothing to do. See Note [Immortal compact regions] in CNF.c.
+    if (RELAXED_LOAD(&bd->flags) & BF_COMPACT_IMMORTAL) {
+        return;
+    }
+
     if (RELAXED_LOAD(&bd->flags) & BF_NONMOVING) {
         // We may have evacuated the block to the nonmoving generation. If so
         // we need to make sure it is added to the mark queue since the only
@@ -746,6 +845,11 @@ loop:
            */
           return;
 
+      case ARR_WORDS:
+          // See Note [Loaned byte arrays] in LoanedBytes.c
+          markLoanedBytes(q);
+          return;
+
       default:
           barf("evacuate(static): strange closure type %d", (int)(info->type));
       }
@@ -754,7 +858,19 @@ loop:
   bd = Bdescr((P_)q);
 
   uint16_t flags = RELAXED_LOAD(&bd->flags);
-  if ((flags & (BF_LARGE | BF_MARKED | BF_EVACUATED | BF_COMPACT | BF_NONMOVING)) != 0) {
+  if ((flags & (BF_LARGE | BF_MARKED | BF_EVACUATED | BF_COMPACT | BF_NONMOVING
+                | BF_WEAK_KEYS)) != 0) {
+      // The block holds keys of weak pointers that are still unreachable;
+      // tell the weak pointer code to look at them again.  Such blocks are
+      // otherwise ordinary from-space blocks, so copy the object as usual.
+      // See Note [Indexing weak pointers by key block] in MarkWeak.c.
+      if (flags & BF_WEAK_KEYS) {
+          ASSERT((flags & (BF_LARGE | BF_MARKED | BF_EVACUATED
+                           | BF_COMPACT | BF_NONMOVING)) == 0);
+          noteWeakKeyBlock(bd);
+          goto copy_object;
+      }
+
       // Pointer to non-moving heap. Non-moving heap is collected using
       // mark-sweep so this object should be marked and then retained in sweep.
       if (RTS_UNLIKELY(RELAXED_LOAD(&bd->flags) & BF_NONMOVING)) {
@@ -780,6 +896,9 @@ loop:
               gct->failed_to_evac = true;
               TICK_GC_FAILED_PROMOTION();
           }
+          if (RTS_UNLIKELY(pinned_liveness != NULL) && flags & BF_PINNED) {
+              pinnedLivenessMark(bd, q);
+          }
           return;
       }
 
@@ -796,6 +915,9 @@ loop:
        */
       if (flags & BF_LARGE) {
           evacuate_large((P_)q);
+          if (RTS_UNLIKELY(pinned_liveness != NULL) && flags & BF_PINNED) {
+              pinnedLivenessMark(bd, q);
+          }
           return;
       }
 
@@ -809,6 +931,7 @@ loop:
       return;
   }
 
+copy_object:
   gen_no = bd->dest_no;
 
   info = ACQUIRE_LOAD(&q->header.info);
@@ -844,6 +967,11 @@ loop:
       return;
   }
 
+  if (RTS_UNLIKELY(RtsFlags.GcFlags.pretenureThreshold > 0)
+      && info != &stg_WHITEHOLE_info) {
+      gen_no = pretenure_dest(info, bd, gen_no);
+  }
+
   switch (INFO_PTR_TO_STRUCT(info)->type) {
 
   case WHITEHOLE:
@@ -977,6 +1105,16 @@ loop:
       return;
 
   case THUNK_SELECTOR:
+      if (RTS_UNLIKELY(gct->selector_budget == 0)) {
+          // See Note [Selector optimisation depth limit]
+          gct->selectors_deferred++;
+          copy(p,info,q,THUNK_SELECTOR_sizeW(),gen_no);
+          if (isNonmovingClosure(*p)) {
+              // See Note [Non-moving GC: Marking evacuated objects].
+              markQueuePushClosureGC(&gct->cap->upd_rem_set.queue, *p);
+          }
+          return;
+      }
       eval_thunk_selector(p, (StgSelector *)q, true);
       return;
 
@@ -1216,6 +1354,7 @@ unchain_thunk_selectors(StgSelector *p, StgClosure *val)
         } else {
             RELAXED_STORE(&((StgInd *)p)->indirectee, val);
             SET_INFO_RELEASE((StgClosure *)p, &stg_IND_info);
+            gct->selectors_eliminated++;
         }
 
 #if defined(PROFILING)
@@ -1238,10 +1377,14 @@ unchain_thunk_selectors(StgSelector *p, StgClosure *val)
    If the THUNK_SELECTOR could not be evaluated (its selectee is still a THUNK,
    for example), then the THUNK_SELECTOR itself will be evacuated depending on
    the evac parameter.
+
+   Nested selector thunks are evaluated with an explicit stack, see
+   Note [Selector optimisation depth limit]. Every exit from the evaluation
+   of a selector goes to `done`, which resumes the enclosing one if any.
    -------------------------------------------------------------------------- */
 
 static void
-eval_thunk_selector (StgClosure **const q, StgSelector *p, bool evac)
+eval_thunk_selector (StgClosure **q, StgSelector *p, bool evac)
                  // NB. for legacy reasons, p & q are swapped around :(
 {
     uint32_t field;
@@ -1250,6 +1393,8 @@ eval_thunk_selector (StgClosure **const q, StgSelector *p, bool evac)
     StgClosure *selectee;
     StgSelector *prev_thunk_selector;
     bdescr *bd;
+    SelectorFrame *const frames = gct->selector_frames;
+    uint32_t depth = 0;
 
     prev_thunk_selector = NULL;
     // this is a chain of THUNK_SELECTORs that we are going to update
@@ -1285,7 +1430,7 @@ selector_chain:
                 gct->failed_to_evac = true;
                 TICK_GC_FAILED_PROMOTION();
             }
-            return;
+            goto done;
         }
         // we don't update THUNK_SELECTORS in the compacted
         // generation, because compaction does not remove the INDs
@@ -1298,7 +1443,7 @@ selector_chain:
             *q = (StgClosure *)p;
             if (evac) evacuate(q);
             unchain_thunk_selectors(prev_thunk_selector, (StgClosure *)p);
-            return;
+            goto done;
         }
     }
 
@@ -1341,7 +1486,7 @@ selector_chain:
             }
             if (evac) evacuate(q);
             unchain_thunk_selectors(prev_thunk_selector, (StgClosure *)p);
-            return;
+            goto done;
         }
     }
 #else
@@ -1352,6 +1497,10 @@ selector_chain:
 
     field = INFO_PTR_TO_STRUCT((StgInfoTable *)info_ptr)->layout.selector_offset;
 
+    if (gct->selector_budget > 0) {
+        gct->selector_budget--;
+    }
+
     // The selectee might be a constructor closure,
     // so we untag the pointer.
     selectee = UNTAG_CLOSURE(p->selectee);
@@ -1465,7 +1614,7 @@ selector_loop:
                   markQueuePushClosureGC(&gct->cap->upd_rem_set.queue, (StgClosure*) *q);
               }
 
-              return;
+              goto done;
           }
 
       case IND:
@@ -1503,12 +1652,12 @@ selector_loop:
 
       case THUNK_SELECTOR:
       {
-          StgClosure *val;
-
-          // recursively evaluate this selector.  We don't want to
-          // recurse indefinitely, so we impose a depth bound.
+          // evaluate this selector first, unless we are too deep or
+          // out of budget.
           // See Note [Selector optimisation depth limit].
-          if (gct->thunk_selector_depth >= MAX_THUNK_SELECTOR_DEPTH) {
+          if (depth >= RtsFlags.GcFlags.selectorDepth
+              || gct->selector_budget == 0) {
+              gct->selectors_deferred++;
               if (isNonmovingClosure((StgClosure *) p)) {
                   // See Note [Non-moving GC: Marking evacuated objects].
                   markQueuePushClosureGC(&gct->cap->upd_rem_set.queue, (StgClosure*) p);
@@ -1516,19 +1665,24 @@ selector_loop:
               goto bale_out;
           }
 
-          gct->thunk_selector_depth++;
-          // false says "don't evacuate the result".  It will,
+          frames[depth++] = (SelectorFrame) {
+              .p = p,
+              .info_ptr = info_ptr,
+              .field = field,
+              .evac = evac,
+              .bd = bd,
+              .q = q,
+              .prev_thunk_selector = prev_thunk_selector,
+              .selectee = selectee,
+          };
+          // evac = false says "don't evacuate the result".  It will,
           // however, update any THUNK_SELECTORs that are evaluated
           // along the way.
-          eval_thunk_selector(&val, (StgSelector*)selectee, false);
-          gct->thunk_selector_depth--;
-
-          // did we actually manage to evaluate it?
-          if (val == selectee) goto bale_out;
-
-          // Of course this pointer might be tagged...
-          selectee = UNTAG_CLOSURE(val);
-          goto selector_loop;
+          q = &frames[depth-1].val;
+          p = (StgSelector*)selectee;
+          evac = false;
+          prev_thunk_selector = NULL;
+          goto selector_chain;
       }
 
       case AP:
@@ -1564,4 +1718,26 @@ bale_out:
         markQueuePushClosureGC(&gct->cap->upd_rem_set.queue, *q);
     }
     unchain_thunk_selectors(prev_thunk_selector, *q);
+
+done:
+    if (depth > 0) {
+        // The selectee of the selector in the innermost frame has been
+        // evaluated as far as it goes; carry on with that selector.
+        SelectorFrame *f = &frames[--depth];
+        StgClosure *val = f->val;
+        p = f->p;
+        info_ptr = f->info_ptr;
+        field = f->field;
+        evac = f->evac;
+        bd = f->bd;
+        q = f->q;
+        prev_thunk_selector = f->prev_thunk_selector;
+
+        // did we actually manage to evaluate it?
+        if (val == f->selectee) goto bale_out;
+
+        // Of course this pointer might be tagged...
+        selectee = UNTAG_CLOSURE(val);
+        goto selector_loop;
+    }
 }
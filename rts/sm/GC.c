@@ -27,6 +27,10 @@
 #include "MarkWeak.h"
 #include "Sparks.h"
 #include "Sweep.h"
+#include "Pretenure.h"
+#include "PinnedLiveness.h"
+#include "LoanedBytes.h"
+#include "IdleWork.h"
 
 #include "Arena.h"
 #include "Storage.h"
@@ -51,6 +55,7 @@
 #include "StablePtr.h"
 #include "CheckUnload.h"
 #include "CNF.h"
+#include "Hash.h"
 #include "RtsFlags.h"
 #include "NonMoving.h"
 #include "Ticky.h"
@@ -120,6 +125,29 @@ bool unload_mark_needed;
 /* Data used for allocation area sizing.
  */
 static W_ g0_pcnt_kept = 30; // percentage of g0 live at last minor GC
+static W_ pause_nursery_blocks = 0; // nursery size chosen by
+                                   // --minor-pause-target, 0 = not yet chosen
+static double g0_survival = 0.3;   // for -qnauto: smoothed fraction of the
+                                   // nursery copied by minor GCs
+
+/* Data used by the -Fauto policy, see Note [Adaptive generation sizing].
+ */
+static double fauto_factor = 0;        // current -F factor, 0 before the first
+                                       // major GC
+static double fauto_gc_cpu = 0;        // GC CPU fraction measured last time
+static Time fauto_last_cpu = 0;
+static Time fauto_last_gc_cpu = 0;
+static Time fauto_last_major_gc_cpu = 0;
+
+/* Data used by the soft heap limit, see Note [Soft heap limit].
+ */
+static bool soft_pacing = false;       // the last major GC shrank the
+                                       // generations for the soft limit
+static double soft_min_factor = 0;     // the least the old generation may
+                                       // grow by, 0 before the first major GC
+static double soft_gc_cpu = 0;         // GC CPU fraction measured last time
+static Time soft_last_cpu = 0;
+static Time soft_last_gc_cpu = 0;
 
 static int consec_idle_gcs = 0;
 
@@ -152,6 +180,11 @@ static StgInt n_gc_exited = 0;
 static Condition gc_exit_arrived_cv;
 static Condition gc_exit_leave_now_cv;
 
+// See Note [Running tasks on exited GC threads]
+static void (*gc_exit_task)(void) = NULL;
+static StgWord gc_exit_task_seq = 0;
+static StgInt n_gc_exit_task_running = 0;
+
 #else // THREADED_RTS
 // Must match the alignment of gen_workspace.
 StgWord8 the_gc_thread[sizeof(gc_thread) + 64 * sizeof(gen_workspace)]
@@ -219,14 +252,19 @@ static void prepare_collected_gen   (generation *gen);
 static void prepare_uncollected_gen (generation *gen);
 static void init_gc_thread          (gc_thread *t);
 static void resize_nursery          (void);
+static W_   pause_target_nursery_blocks (void);
 static void scavenge_until_all_done (void);
 static StgWord inc_running          (void);
 static StgWord dec_running          (void);
 static void wakeup_gc_threads       (uint32_t me, bool idle_cap[]);
 static void shutdown_gc_threads     (uint32_t me, bool idle_cap[]);
 static void collect_gct_blocks      (void);
+static void collect_dead_large_objects (generation *gen);
+static void count_gen_copied        (const gc_thread *t);
 static void collect_pinned_object_blocks (void);
 static void heapOverflow            (void);
+static void record_live_before_gc   (void);
+static void update_gen_survival     (void);
 
 #if defined(DEBUG)
 static void gcCAFs                  (void);
@@ -287,6 +325,13 @@ GarbageCollect (struct GcConfig config,
   generation *gen;
   StgWord live_blocks, live_words, par_max_copied, par_balanced_copied,
       any_work, scav_find_work, max_n_todo_overflow;
+  StgWord rs_array_elems, rs_scanned_elems, rs_scanned_cards;
+  StgWord rs_entries, rs_duplicates;
+  Time rs_scan_time;
+  StgWord selectors_eliminated, selectors_deferred;
+  StgWord copy_races, copy_race_words;
+  StgWord static_scavenged;
+  Time static_scan_time;
 #if defined(THREADED_RTS)
   gc_thread *saved_gct;
   bool gc_sparks_all_caps;
@@ -314,6 +359,10 @@ GarbageCollect (struct GcConfig config,
 
   ACQUIRE_SM_LOCK;
 
+  // Any memory left to return from the last major GC is for this GC to
+  // decide about again. See Note [Idle GC work] in IdleWork.c.
+  idleCancelMemoryReturn();
+
 #if defined(RTS_USER_SIGNALS)
   if (RtsFlags.MiscFlags.install_signal_handlers) {
     // block signals
@@ -455,12 +504,20 @@ GarbageCollect (struct GcConfig config,
   collectFreshWeakPtrs();
 
   // check sanity *before* GC
-  IF_DEBUG(sanity, checkSanity(false /* before GC */, major_gc));
+  IF_DEBUG(sanity, checkSanity(false /* before GC */, major_gc, false));
 
   // gather blocks allocated using allocatePinned() from each capability
   // and put them on the g0->large_object list.
   collect_pinned_object_blocks();
 
+  if (RtsFlags.GcFlags.pinnedLiveness) {
+      pinnedLivenessStartGC();
+  }
+
+  if (RtsFlags.GcFlags.oldGenFactorAuto) {
+      record_live_before_gc();
+  }
+
   // Initialise all the generations that we're collecting.
   for (g = 0; g <= N; g++) {
       prepare_collected_gen(&generations[g]);
@@ -473,6 +530,12 @@ GarbageCollect (struct GcConfig config,
   // Prepare this gc_thread
   init_gc_thread(gct);
 
+  // See Note [Heap census during GC] in ProfHeap.c
+  if (config.do_heap_census && RtsFlags.ProfFlags.censusDuringGc
+      && major_gc && !oldest_gen->mark && !RtsFlags.GcFlags.useNonmoving) {
+      startGcCensus();
+  }
+
   /* Allocate a mark stack if we're doing a major collection.
    */
   if (major_gc && oldest_gen->mark) {
@@ -564,11 +627,13 @@ GarbageCollect (struct GcConfig config,
   gc_sparks_all_caps = !work_stealing || !is_par_gc();
 #endif
   work_stealing = false;
+  Time weak_start = stat_getElapsedTime();
   while (traverseWeakPtrList(&dead_weak_ptr_list, &resurrected_threads))
   {
       inc_running();
       scavenge_until_all_done();
   }
+  weakPtrFixpointDone(stat_getElapsedTime() - weak_start);
 
 
   // Now see which stable names are still alive.
@@ -589,6 +654,13 @@ GarbageCollect (struct GcConfig config,
   }
 #endif
 
+  // What's left of the large objects we collected is dead; put it back on
+  // gen->large_objects, where LdvCensusForDead and the code below look for
+  // it. See Note [Large objects during GC].
+  for (g = 0; g <= N; g++) {
+      collect_dead_large_objects(&generations[g]);
+  }
+
 #if defined(PROFILING)
   // We call processHeapClosureForDead() on every closure destroyed during
   // the current garbage collection, so we invoke LdvCensusForDead().
@@ -618,6 +690,18 @@ GarbageCollect (struct GcConfig config,
   any_work = 0;
   scav_find_work = 0;
   max_n_todo_overflow = 0;
+  rs_array_elems = 0;
+  rs_scanned_elems = 0;
+  rs_scanned_cards = 0;
+  rs_entries = 0;
+  rs_duplicates = 0;
+  rs_scan_time = 0;
+  selectors_eliminated = 0;
+  selectors_deferred = 0;
+  copy_races = 0;
+  copy_race_words = 0;
+  static_scavenged = 0;
+  static_scan_time = 0;
   {
       uint32_t i;
       uint64_t par_balanced_copied_acc = 0;
@@ -644,10 +728,37 @@ GarbageCollect (struct GcConfig config,
                          RELAXED_LOAD(&thread->any_work));
               debugTrace(DEBUG_gc,"   scav_find_work %ld",
                          RELAXED_LOAD(&thread->scav_find_work));
+              debugTrace(DEBUG_gc,"   stolen_blocks    %ld",
+                         RELAXED_LOAD(&thread->stolen_blocks));
+
+              traceEventGcWorkSteals(gct->cap, thread->cap->no,
+                                     RELAXED_LOAD(&thread->stolen_blocks),
+                                     RELAXED_LOAD(&thread->failed_steals));
+              traceEventGcThreadStats(gct->cap, thread->cap->no,
+                                      RELAXED_LOAD(&thread->copy_start),
+                                      RELAXED_LOAD(&thread->copy_end),
+                                      RELAXED_LOAD(&thread->idle_time),
+                                      RELAXED_LOAD(&thread->copied) * sizeof(W_));
 
               any_work += RELAXED_LOAD(&thread->any_work);
               scav_find_work += RELAXED_LOAD(&thread->scav_find_work);
               max_n_todo_overflow = stg_max(RELAXED_LOAD(&thread->max_n_todo_overflow), max_n_todo_overflow);
+              rs_array_elems += RELAXED_LOAD(&thread->rs_array_elems);
+              rs_scanned_elems += RELAXED_LOAD(&thread->rs_scanned_elems);
+              rs_scanned_cards += RELAXED_LOAD(&thread->rs_scanned_cards);
+              rs_entries += RELAXED_LOAD(&thread->rs_entries);
+              rs_duplicates += RELAXED_LOAD(&thread->rs_duplicates);
+              rs_scan_time += RELAXED_LOAD(&thread->rs_scan_time);
+              selectors_eliminated += RELAXED_LOAD(&thread->selectors_eliminated);
+              selectors_deferred += RELAXED_LOAD(&thread->selectors_deferred);
+              copy_races += RELAXED_LOAD(&thread->copy_races);
+              copy_race_words += RELAXED_LOAD(&thread->copy_race_words);
+              static_scavenged += RELAXED_LOAD(&thread->static_scavenged);
+              static_scan_time += RELAXED_LOAD(&thread->static_scan_time);
+              if (thread->pretenure_samples) {
+                  pretenureMergeSamples(thread->pretenure_samples);
+              }
+              count_gen_copied(thread);
 
               par_max_copied = stg_max(RELAXED_LOAD(&thread->copied), par_max_copied);
               par_balanced_copied_acc +=
@@ -660,10 +771,33 @@ GarbageCollect (struct GcConfig config,
               other_active_threads;
       } else {
           copied += gct->copied;
+          count_gen_copied(gct);
           any_work += gct->any_work;
           scav_find_work += gct->scav_find_work;
           max_n_todo_overflow += gct->max_n_todo_overflow;
+          rs_array_elems += gct->rs_array_elems;
+          rs_scanned_elems += gct->rs_scanned_elems;
+          rs_scanned_cards += gct->rs_scanned_cards;
+          rs_entries += gct->rs_entries;
+          rs_duplicates += gct->rs_duplicates;
+          rs_scan_time += gct->rs_scan_time;
+          selectors_eliminated += gct->selectors_eliminated;
+          selectors_deferred += gct->selectors_deferred;
+          copy_races += gct->copy_races;
+          copy_race_words += gct->copy_race_words;
+          static_scavenged += gct->static_scavenged;
+          static_scan_time += gct->static_scan_time;
+          if (gct->pretenure_samples) {
+              pretenureMergeSamples(gct->pretenure_samples);
+          }
       }
+      if (RtsFlags.GcFlags.pretenureThreshold > 0) {
+          pretenureUpdate(major_gc);
+      }
+  }
+
+  if (pinned_liveness != NULL) {
+      pinnedLivenessEndGC();
   }
 
   // Run through all the generations and tidy up.
@@ -685,12 +819,13 @@ GarbageCollect (struct GcConfig config,
 
     // Count the mutable list as bytes "copied" for the purposes of
     // stats.  Every mutable list is copied during every GC.
+    W_ mut_list_size = 0;
     if (g > 0) {
-        W_ mut_list_size = 0;
         for (n = 0; n < getNumCapabilities(); n++) {
             mut_list_size += countOccupied(getCapability(n)->mut_lists[g]);
         }
         copied +=  mut_list_size;
+        generations[g].mut_list_words = mut_list_size;
 
 #if defined(DEBUG)
         debugTrace(DEBUG_gc,
@@ -774,14 +909,26 @@ GarbageCollect (struct GcConfig config,
         gen->n_old_blocks = 0;
 
         /* LARGE OBJECTS.  The current live large objects are chained on
-         * scavenged_large, having been moved during garbage
-         * collection from large_objects.  Any objects left on the
-         * large_objects list are therefore dead, so we free them here.
+         * scavenged_large, having been evacuated during garbage
+         * collection.  The objects left on the large_objects list by
+         * collect_dead_large_objects() are dead, so we free them here,
+         * or leave them for idle time (see Note [Idle GC work]).
          */
-        freeChain(gen->large_objects);
+        if (idleWorkEnabled()) {
+            idleDeferLargeObjects(gen->large_objects);
+        } else {
+            freeChain(gen->large_objects);
+        }
+        // scavenged_large_objects is only singly linked during GC
         gen->large_objects  = gen->scavenged_large_objects;
         gen->n_large_blocks = gen->n_scavenged_large_blocks;
-        gen->n_large_words  = countOccupied(gen->large_objects);
+        gen->n_large_words  = 0;
+        prev = NULL;
+        for (bd = gen->large_objects; bd != NULL; bd = bd->link) {
+            bd->u.back = prev;
+            gen->n_large_words += bd->free - bd->start;
+            prev = bd;
+        }
         gen->n_new_large_words = 0;
 
         /* COMPACT_NFDATA. The currently live compacts are chained
@@ -836,16 +983,40 @@ GarbageCollect (struct GcConfig config,
     gen->n_live_compact_blocks = 0;
 
     // Count "live" data
-    live_words  += genLiveWords(gen);
+    W_ gen_live_words = genLiveWords(gen);
     live_blocks += genLiveBlocks(gen);
 
     // add in the partial blocks in the gen_workspaces
     for (uint32_t i = 0; i < getNumCapabilities(); i++) {
-        live_words  += gcThreadLiveWords(i, gen->no);
-        live_blocks += gcThreadLiveBlocks(i, gen->no);
+        gen_live_words += gcThreadLiveWords(i, gen->no);
+        live_blocks    += gcThreadLiveBlocks(i, gen->no);
     }
+    live_words += gen_live_words;
+
+    traceEventGcGenShape(CAPSET_HEAP_DEFAULT, g,
+                         gen_live_words * sizeof(W_),
+                         gen->n_large_words * sizeof(W_),
+                         mut_list_size);
   } // for all generations
 
+  if (RtsFlags.GcFlags.oldGenFactorAuto) {
+      update_gen_survival();
+  }
+
+  // See Note [Adaptive GC thread count]
+  if (N == 0) {
+      W_ mut_list_words = 0;
+      for (g = 1; g < RtsFlags.GcFlags.generations; g++) {
+          mut_list_words += generations[g].mut_list_words;
+      }
+      const W_ nursery_words = countNurseryBlocks() * BLOCK_SIZE_W;
+      if (nursery_words > 0 && (W_)copied >= mut_list_words) {
+          const double sample =
+              stg_min((double)(copied - mut_list_words) / nursery_words, 1.0);
+          g0_survival += 0.5 * (sample - g0_survival);
+      }
+  }
+
   // Flush the update remembered sets. See Note [Eager update remembered set
   // flushing] in NonMovingMark.c
   if (RtsFlags.GcFlags.useNonmoving) {
@@ -958,6 +1129,16 @@ GarbageCollect (struct GcConfig config,
       checkUnload();
   }
 
+  // Hand back the loaned byte arrays this major GC didn't find. See Note
+  // [Loaned byte arrays] in LoanedBytes.c.
+  if (major_gc && !RtsFlags.GcFlags.useNonmoving) {
+      sweepLoanedBytes();
+  }
+
+  // Free what concurrent hash tables have retired; see
+  // Note [Concurrent hash tables] in Hash.c
+  concHashSafePoint();
+
   // Start any pending finalizers.  Must be after
   // updateStableTables() and stableUnlock() (see #4221).
   RELEASE_SM_LOCK;
@@ -969,7 +1150,8 @@ GarbageCollect (struct GcConfig config,
   // closures, which will cause problems with THREADED where we don't
   // fill slop. If we are using the nonmoving collector then we can't claim to
   // be *after* the major GC; it's now running concurrently.
-  IF_DEBUG(sanity, checkSanity(true /* after GC */, major_gc && !RtsFlags.GcFlags.useNonmoving));
+  IF_DEBUG(sanity, checkSanity(true /* after GC */, major_gc && !RtsFlags.GcFlags.useNonmoving,
+                               true /* the GC threads are waiting */));
 
   // If a heap census is due, we need to do it before
   // resurrectThreads(), for the same reason as checkSanity above:
@@ -982,7 +1164,7 @@ GarbageCollect (struct GcConfig config,
       ACQUIRE_SM_LOCK;
   }
 
-#if defined(TICKY_TICKY)
+#if defined(TRACING)
   // Post ticky counter sample.
   // We do this at the end of execution since tickers are registered in the
   // course of program execution.
@@ -997,6 +1179,13 @@ GarbageCollect (struct GcConfig config,
   resurrectThreads(resurrected_threads);
   ACQUIRE_SM_LOCK;
 
+  // Hand the per-capability block caches back to the global allocator on a
+  // major GC, so that their blocks can be coalesced and possibly returned to
+  // the OS below.
+  if (major_gc) {
+      flushBlockCaches();
+  }
+
   // Finally free the deferred mblocks by sorting the deferred free list and
   // merging it into the actual sorted free list. This needs to happen here so
   // that the `returnMemoryToOS` call down below can successfully free memory.
@@ -1102,7 +1291,12 @@ GarbageCollect (struct GcConfig config,
 
       uint32_t returned = 0;
       if (got > need) {
-          returned = returnMemoryToOS(got - need);
+          if (idleWorkEnabled() && RtsFlags.GcFlags.maxHeapSize == 0) {
+              // See Note [Idle GC work] in IdleWork.c
+              idleDeferMemoryReturn(need);
+          } else {
+              returned = returnMemoryToOS(got - need);
+          }
       }
       traceEventMemReturn(cap, got, need, returned);
 
@@ -1140,7 +1334,12 @@ GarbageCollect (struct GcConfig config,
              live_blocks * BLOCK_SIZE_W - live_words /* slop */,
              N, n_gc_threads, gc_threads,
              par_max_copied, par_balanced_copied,
-             any_work, scav_find_work, max_n_todo_overflow);
+             any_work, scav_find_work, max_n_todo_overflow,
+             rs_array_elems, rs_scanned_elems, rs_scanned_cards,
+             rs_entries, rs_duplicates, rs_scan_time,
+             selectors_eliminated, selectors_deferred,
+             copy_races, copy_race_words,
+             static_scavenged, static_scan_time);
 
 #if defined(RTS_USER_SIGNALS)
   if (RtsFlags.MiscFlags.install_signal_handlers) {
@@ -1185,6 +1384,26 @@ new_gc_thread (uint32_t n, gc_thread *t)
     t->thread_index = n;
     t->free_blocks = NULL;
     t->gc_count = 0;
+    t->pretenure_samples = NULL;
+    if (RtsFlags.GcFlags.pretenureThreshold > 0) {
+        t->pretenure_samples = allocPretenureSamples();
+    }
+    t->census = NULL;
+    t->weak_key_blocks = NULL;
+    t->n_weak_key_blocks = 0;
+    t->weak_key_blocks_size = 0;
+    t->selector_frames = NULL;
+    if (RtsFlags.GcFlags.selectorDepth > 0) {
+        t->selector_frames =
+            stgMallocBytes(RtsFlags.GcFlags.selectorDepth * sizeof(SelectorFrame),
+                           "new_gc_thread");
+    }
+    t->gen_copied =
+        stgMallocBytes(RtsFlags.GcFlags.generations * sizeof(W_),
+                       "new_gc_thread");
+    t->scavd_large =
+        stgMallocBytes(RtsFlags.GcFlags.generations * sizeof(scavd_large_list),
+                       "new_gc_thread");
 
     init_gc_thread(t);
 
@@ -1217,6 +1436,10 @@ new_gc_thread (uint32_t n, gc_thread *t)
         ws->todo_large_objects = NULL;
         ws->todo_seg = END_NONMOVING_TODO_LIST;
 
+        t->scavd_large[g].objects = NULL;
+        t->scavd_large[g].last = NULL;
+        t->scavd_large[g].n_blocks = 0;
+
         ws->part_list = NULL;
         ws->n_part_blocks = 0;
         ws->n_part_words = 0;
@@ -1279,6 +1502,17 @@ freeGcThreads (void)
             {
                 freeWSDeque(gc_threads[i]->gens[g].todo_q);
             }
+            if (gc_threads[i]->pretenure_samples) {
+                stgFree(gc_threads[i]->pretenure_samples);
+            }
+            if (gc_threads[i]->selector_frames) {
+                stgFree(gc_threads[i]->selector_frames);
+            }
+            if (gc_threads[i]->weak_key_blocks) {
+                stgFree(gc_threads[i]->weak_key_blocks);
+            }
+            stgFree(gc_threads[i]->gen_copied);
+            stgFree(gc_threads[i]->scavd_large);
             stgFreeAligned (gc_threads[i]);
         }
         closeCondition(&gc_running_cv);
@@ -1295,6 +1529,17 @@ freeGcThreads (void)
         {
             freeWSDeque(gc_threads[0]->gens[g].todo_q);
         }
+        if (gc_threads[0]->pretenure_samples) {
+            stgFree(gc_threads[0]->pretenure_samples);
+        }
+        if (gc_threads[0]->selector_frames) {
+            stgFree(gc_threads[0]->selector_frames);
+        }
+        if (gc_threads[0]->weak_key_blocks) {
+            stgFree(gc_threads[0]->weak_key_blocks);
+        }
+        stgFree(gc_threads[0]->gen_copied);
+        stgFree(gc_threads[0]->scavd_large);
         stgFree (gc_threads);
 #endif
         gc_threads = NULL;
@@ -1398,6 +1643,7 @@ scavenge_until_all_done (void)
         // work can come from and we are finished
 #if defined(THREADED_RTS)
         if(is_par_gc() && work_stealing && r != 0) {
+            Time idle_start = stat_getElapsedTime();
             NONATOMIC_ADD(&gct->any_work, 1);
             ACQUIRE_LOCK(&gc_running_mutex);
             // this is SEQ_CST because I haven't considered if it could be
@@ -1415,6 +1661,7 @@ scavenge_until_all_done (void)
             //  - a worker thread just pushed a block to it's todo_q
             // so we loop back, looking for more work.
             RELEASE_LOCK(&gc_running_mutex);
+            gct->idle_time += stat_getElapsedTime() - idle_start;
             if (r != 0) {
                 inc_running();
                 traceEventGcWork(gct->cap);
@@ -1425,6 +1672,7 @@ scavenge_until_all_done (void)
         break; // for(;;) loop
     }
 
+    gct->copy_end = stat_getElapsedTime();
     traceEventGcDone(gct->cap);
 }
 
@@ -1482,8 +1730,19 @@ gcWorkerThread (Capability *cap)
     SEQ_CST_STORE(&gct->wakeup, GC_THREAD_WAITING_TO_CONTINUE);
     SEQ_CST_ADD(&n_gc_exited, 1);
     signalCondition(&gc_exit_arrived_cv);
+    StgWord task_seq = gc_exit_task_seq;
     while(SEQ_CST_LOAD(&n_gc_exited) != 0) {
         waitCondition(&gc_exit_leave_now_cv, &gc_exit_mutex);
+        // See Note [Running tasks on exited GC threads]
+        if (gc_exit_task_seq != task_seq) {
+            void (*task)(void) = gc_exit_task;
+            task_seq = gc_exit_task_seq;
+            RELEASE_LOCK(&gc_exit_mutex);
+            task();
+            ACQUIRE_LOCK(&gc_exit_mutex);
+            n_gc_exit_task_running--;
+            signalCondition(&gc_exit_arrived_cv);
+        }
     }
     RELEASE_LOCK(&gc_exit_mutex);
 
@@ -1617,6 +1876,58 @@ shutdown_gc_threads (uint32_t me USED_IF_THREADS USED_IF_DEBUG,
 #endif // THREADED_RTS
 }
 
+/* Note [Running tasks on exited GC threads]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Once shutdown_gc_threads() has returned, the GC worker threads sit in
+   gcWorkerThread() waiting on gc_exit_leave_now_cv until releaseGCThreads()
+   lets them go. Phases that run after scavenging, such as the compacting
+   collector (see Note [Parallel compaction] in Compact.c), can borrow them
+   in the meantime with runGcTask(task): every waiting worker and the leader
+   run task() once, and runGcTask() returns when they have all finished, so
+   each call is also a barrier.
+
+   The task must divide the work among its callers itself (e.g. with an
+   atomic counter); it is run by however many threads are not idle, which
+   may be just the leader. A task must not evacuate or allocate from
+   gct->ws.
+*/
+void
+runGcTask (void (*task)(void))
+{
+#if defined(THREADED_RTS)
+    const bool par = is_par_gc();
+    if (par) {
+        ACQUIRE_LOCK(&gc_exit_mutex);
+        ASSERT(n_gc_exit_task_running == 0);
+        gc_exit_task = task;
+        n_gc_exit_task_running = SEQ_CST_LOAD(&n_gc_exited);
+        gc_exit_task_seq++;
+        broadcastCondition(&gc_exit_leave_now_cv);
+        RELEASE_LOCK(&gc_exit_mutex);
+    }
+#endif
+
+    task();
+
+#if defined(THREADED_RTS)
+    if (par) {
+        ACQUIRE_LOCK(&gc_exit_mutex);
+        while (n_gc_exit_task_running != 0) {
+            waitCondition(&gc_exit_arrived_cv, &gc_exit_mutex);
+        }
+        gc_exit_task = NULL;
+        RELEASE_LOCK(&gc_exit_mutex);
+    }
+#endif
+}
+
+// Are other GC threads available to runGcTask()?
+bool
+isParallelGc (void)
+{
+    return is_par_gc();
+}
+
 #if defined(THREADED_RTS)
 void
 releaseGCThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
@@ -1748,9 +2059,23 @@ prepare_collected_gen (generation *gen)
         bd->flags &= ~BF_EVACUATED;
     }
 
-    // mark the large objects as from-space
-    for (bd = gen->large_objects; bd; bd = bd->link) {
-        bd->flags &= ~BF_EVACUATED;
+    // mark the large objects as from-space, and take them off
+    // gen->large_objects, leaving them linked back through u.back from
+    // gen->old_large_objects (except for the nonmoving heap's, which we
+    // never evacuate). See Note [Large objects during GC].
+    if (!(RtsFlags.GcFlags.useNonmoving && g == oldest_gen->no)) {
+        bdescr *prev = NULL;
+        for (bd = gen->large_objects; bd; bd = bd->link) {
+            bd->flags &= ~BF_EVACUATED;
+            bd->u.back = prev;
+            prev = bd;
+        }
+        gen->old_large_objects = prev;
+        gen->large_objects = NULL;
+    } else {
+        for (bd = gen->large_objects; bd; bd = bd->link) {
+            bd->flags &= ~BF_EVACUATED;
+        }
     }
 
     // mark the compact objects as from-space
@@ -1865,6 +2190,103 @@ collect_gct_blocks (void)
 
             RELEASE_SPIN_LOCK(&ws->gen->sync);
         }
+
+        // See Note [Large objects during GC]
+        scavd_large_list *l = &gct->scavd_large[g];
+        if (l->objects != NULL) {
+            ACQUIRE_SPIN_LOCK(&ws->gen->sync);
+
+            ASSERT(countBlocks(l->objects) == l->n_blocks);
+            l->last->link = ws->gen->scavenged_large_objects;
+            ws->gen->scavenged_large_objects = l->objects;
+            ws->gen->n_scavenged_large_blocks += l->n_blocks;
+
+            RELEASE_SPIN_LOCK(&ws->gen->sync);
+
+            l->objects = NULL;
+            l->last = NULL;
+            l->n_blocks = 0;
+        }
+    }
+}
+
+/* Note [Large objects during GC]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   We evacuate a large object by relinking it rather than copying it (see
+   evacuate_large). evacuate_large used to take it off gen->large_objects
+   and put it on the destination's scavenged_large_objects, holding
+   gen->sync for both. With millions of medium-sized arrays, every GC thread
+   takes that spin lock for each one, and it was hot in parallel GCs. Now
+   no lock is taken per object:
+
+     * A GC thread claims an object by setting BF_EVACUATED with an atomic
+       fetch-or; the thread that sets it owns the object, the others see it
+       as already evacuated. The object stays where it is on the list of
+       large objects of the generation being collected: unlinking it from a
+       doubly linked list shared by all the GC threads is what needed the
+       lock.
+
+     * Once scavenged (pinned blocks need no scavenging), the object goes
+       on a list of its GC thread, one per generation
+       (gct->scavd_large[gen->no]; not in the gen_workspace, which must
+       stay 16 words). collect_gct_blocks() moves each list to
+       gen->scavenged_large_objects, under gen->sync, once per GC thread
+       rather than once per object. scavenged_large_objects is only singly
+       linked until the end of the GC.
+
+   This reuses bd->link of the objects we evacuate, so the list we are
+   collecting can't be walked forwards any more. prepare_collected_gen
+   therefore moves it off gen->large_objects, makes sure its u.back links
+   are right, and keeps its last object in gen->old_large_objects; nothing
+   touches u.back of a large object during GC. When the GC has evacuated
+   everything, collect_dead_large_objects() walks the list backwards, and
+   puts every object without BF_EVACUATED on gen->large_objects, which
+   then holds the dead objects, as it always did at that point, for
+   LdvCensusForDead and for freeing. The live objects go back on
+   gen->large_objects, doubly linked again, in the loop over the
+   generations at the end of GarbageCollect.
+
+   Compact regions are few and still take gen->sync (evacuate_compact);
+   the nonmoving heap's large objects are never evacuated, and stay on
+   oldest_gen->large_objects.
+*/
+
+/* -----------------------------------------------------------------------------
+   Find the large objects of a collected generation that we didn't evacuate,
+   and put them on gen->large_objects (singly linked), to be freed at the end
+   of the GC. See Note [Large objects during GC].
+   -------------------------------------------------------------------------- */
+
+static void
+collect_dead_large_objects (generation *gen)
+{
+    bdescr *bd, *prev;
+
+    // the nonmoving heap's large objects stayed where they were
+    if (RtsFlags.GcFlags.useNonmoving && gen == oldest_gen) {
+        return;
+    }
+
+    ASSERT(gen->large_objects == NULL);
+    for (bd = gen->old_large_objects; bd != NULL; bd = prev) {
+        prev = bd->u.back;
+        if (!(bd->flags & BF_EVACUATED)) {
+            bd->link = gen->large_objects;
+            gen->large_objects = bd;
+        }
+    }
+    gen->old_large_objects = NULL;
+}
+
+/* -----------------------------------------------------------------------------
+   Add up how much a GC thread copied into each generation, for getRTSGenStats.
+   -------------------------------------------------------------------------- */
+
+static void
+count_gen_copied (const gc_thread *t)
+{
+    for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        generations[g].copied += RELAXED_LOAD(&t->gen_copied[g]);
     }
 }
 
@@ -1929,16 +2351,38 @@ init_gc_thread (gc_thread *t)
     t->static_objects = END_OF_STATIC_OBJECT_LIST;
     t->scavenged_static_objects = END_OF_STATIC_OBJECT_LIST;
     t->scan_bd = NULL;
+    t->scan_nested = false;
     t->mut_lists = t->cap->mut_lists;
     t->evac_gen_no = 0;
     t->failed_to_evac = false;
     t->eager_promotion = true;
-    t->thunk_selector_depth = 0;
+    t->selector_budget = RtsFlags.GcFlags.selectorBudget > 0
+        ? RtsFlags.GcFlags.selectorBudget : (W_)-1;
     t->copied = 0;
+    for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        t->gen_copied[g] = 0;
+    }
     t->scanned = 0;
     t->any_work = 0;
     t->scav_find_work = 0;
     t->max_n_todo_overflow = 0;
+    t->stolen_blocks = 0;
+    t->failed_steals = 0;
+    t->rs_array_elems = 0;
+    t->rs_scanned_elems = 0;
+    t->rs_scanned_cards = 0;
+    t->rs_entries = 0;
+    t->rs_duplicates = 0;
+    t->rs_scan_time = 0;
+    t->selectors_eliminated = 0;
+    t->selectors_deferred = 0;
+    t->copy_races = 0;
+    t->copy_race_words = 0;
+    t->static_scavenged = 0;
+    t->static_scan_time = 0;
+    t->copy_start = stat_getElapsedTime();
+    t->copy_end = t->copy_start;
+    t->idle_time = 0;
 }
 
 /* -----------------------------------------------------------------------------
@@ -1964,6 +2408,309 @@ mark_root(void *user USED_IF_THREADS, StgClosure **root)
     SET_GCT(saved_gct);
 }
 
+/* Note [Adaptive GC thread count]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A parallel GC wakes up every GC thread (-qn of them, see Note
+   [n_gc_threads]) and has them synchronise at the start, while scanning the
+   roots, and at the end. For a minor GC that copies a few hundred kilobytes
+   that costs more than the extra threads save, while a major GC of a big
+   heap keeps all of them busy.
+
+   With -qnauto, scheduleDoGC asks estimateGCWork how much work the
+   collection it is about to start has, and gcThreadsForWork how many threads
+   that is worth, and keeps the rest idle in
+   the same way as -qn does, through the idle_cap array, so that GarbageCollect
+   counts them in n_gc_idle_threads. The work is estimated before the
+   mutators have stopped, so from what was known at the end of the previous
+   GC:
+
+     - the nursery, times the fraction of it the minor GCs have been copying
+       (g0_survival, smoothed over the last few minor GCs);
+     - the live data of the older generations being collected
+       (genLiveCopiedWords, so not the nonmoving heap, which is marked
+       concurrently);
+     - the mutable lists of the generations not collected, as they were
+       after the previous GC (gen->mut_list_words).
+
+   Each thread gets -qnauto=<size> bytes of it (1MB by default), and there
+   are between 1 and -qn threads. With one thread the GC is not parallel at
+   all (is_par_gc). The choice is posted to the eventlog as a GC_PAR_THREADS
+   event.
+*/
+
+// The estimated work for a GC of generations 0..collect_gen, in words.
+W_
+estimateGCWork (uint32_t collect_gen)
+{
+    W_ words = (W_)(g0_survival * countNurseryBlocks() * BLOCK_SIZE_W);
+
+    for (uint32_t g = 1; g <= collect_gen; g++) {
+        words += genLiveCopiedWords(&generations[g]);
+    }
+    for (uint32_t g = collect_gen + 1; g < RtsFlags.GcFlags.generations; g++) {
+        words += generations[g].mut_list_words;
+    }
+    return words;
+}
+
+// The number of GC threads the given words of work are worth, at most
+// max_threads. See Note [Adaptive GC thread count].
+uint32_t
+gcThreadsForWork (W_ work, uint32_t max_threads)
+{
+    const W_ per_thread =
+        stg_max(RtsFlags.ParFlags.parGcThreadsAutoWork / sizeof(W_), 1);
+    const W_ threads = work / per_thread + 1;
+    return (uint32_t)stg_min(threads, (W_)max_threads);
+}
+
+/* Note [Adaptive generation sizing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With -Fauto the factor F by which the old generation may grow before it is
+   collected again is not fixed by -F, but adjusted after every major GC to
+   keep the fraction of CPU time spent in GC near a target (-Fauto=<pct>, 10%
+   by default). -F, if given as well, is the starting point.
+
+   Raising F cannot make minor collections any cheaper; it only spaces out the
+   major ones. A major GC costs time proportional to the live data L, and
+   happens once the old generation has grown by (F-1)*L words, so the fraction
+   of time spent in major GC is roughly proportional to 1/(F-1). After each
+   major GC we measure the fractions of CPU time spent in major and in minor
+   collections since the previous major GC (stat_getGCCpuTimes), give major GC
+   whatever the minor collections leave of the target (but at least a tenth
+   of it), and scale F-1 by the ratio of the measured fraction to that budget.
+   To keep the controller from oscillating we only take half of that step,
+   never more than doubling or halving F-1, and F itself stays within
+   [FAUTO_MIN_FACTOR, FAUTO_MAX_FACTOR]. The maximum heap size (-M) bounds
+   the result just as it does a fixed -F.
+
+   For the intermediate generations (-G3 and up) GarbageCollect also keeps a
+   smoothed survival rate for each generation, the fraction of its words that
+   survived the last GCs for which it was the oldest generation collected,
+   and a promotion rate, the number of words promoted into it per word
+   allocated. A generation whose contents mostly survive gains little from
+   being large, as the data ends up promoted anyway, so it is given a smaller
+   share of the old generation's size, down to a quarter of it. The oldest
+   generation's survival rate counts data promoted into it by the same major
+   GC as surviving, so it over-estimates somewhat; it is reported, not used.
+
+   Every decision is posted to the eventlog as a GC_GEN_RESIZE event, one for
+   each generation above 0.
+*/
+
+#define FAUTO_MIN_FACTOR 1.25
+#define FAUTO_MAX_FACTOR 8.0
+#define FAUTO_SMOOTHING  0.5    // weight of the newest survival sample
+
+static double
+fauto_smooth (double rate, double sample, bool first)
+{
+    return first ? sample : rate + FAUTO_SMOOTHING * (sample - rate);
+}
+
+// The live words of a generation, including the GC threads' partial blocks.
+static W_
+gen_total_live_words (generation *gen)
+{
+    W_ words = genLiveWords(gen);
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        words += gcThreadLiveWords(i, gen->no);
+    }
+    return words;
+}
+
+// Called before any generation is prepared for collection: remember how much
+// was live in the generations that update_gen_survival will look at.
+static void
+record_live_before_gc (void)
+{
+    const uint32_t last = stg_min(N + 1, RtsFlags.GcFlags.generations - 1);
+
+    for (uint32_t g = 1; g <= last; g++) {
+        generations[g].live_words_before_gc =
+            gen_total_live_words(&generations[g]);
+    }
+}
+
+// Called once the collected generations have been tidied up.
+static void
+update_gen_survival (void)
+{
+    const uint64_t alloc = calcTotalAllocated();
+
+    for (uint32_t g = 1; g <= N; g++) {
+        generation *gen = &generations[g];
+
+        // The nonmoving collector hasn't marked the oldest generation yet.
+        if (RtsFlags.GcFlags.useNonmoving && gen == oldest_gen) {
+            continue;
+        }
+
+        const W_ before = gen->live_words_before_gc;
+        const W_ after = gen_total_live_words(gen);
+        const bool first = gen->last_alloc_words == 0;
+
+        // Whatever the generation held beyond what survived its last
+        // collection was promoted into it since.
+        if (alloc > gen->last_alloc_words) {
+            const double promoted = before - stg_min(before, gen->last_live_words);
+            gen->promotion_rate =
+                fauto_smooth(gen->promotion_rate,
+                             promoted / (alloc - gen->last_alloc_words), first);
+        }
+
+        // The survivors of the oldest generation collected end up in the
+        // next generation, or stay put if there is none.
+        if (g == N && before > 0) {
+            W_ survived;
+            if (gen == oldest_gen) {
+                survived = after;
+            } else {
+                generation *to = &generations[g+1];
+                W_ to_after = gen_total_live_words(to);
+                survived = to_after - stg_min(to_after, to->live_words_before_gc);
+            }
+            gen->survival_rate =
+                fauto_smooth(gen->survival_rate,
+                             stg_min((double)survived / before, 1.0), first);
+        }
+
+        gen->last_live_words = after;
+        gen->last_alloc_words = alloc;
+    }
+}
+
+// Returns the -F factor to use for this major GC.
+static double
+adapt_old_gen_factor (void)
+{
+    const double target = RtsFlags.GcFlags.gcCpuTarget;
+    Time cpu, gc_cpu, major_gc_cpu;
+
+    stat_getGCCpuTimes(&cpu, &gc_cpu, &major_gc_cpu);
+
+    if (fauto_factor == 0) {
+        fauto_factor = stg_min(stg_max(RtsFlags.GcFlags.oldGenFactor,
+                                       FAUTO_MIN_FACTOR),
+                               FAUTO_MAX_FACTOR);
+    } else if (cpu > fauto_last_cpu) {
+        const double interval = cpu - fauto_last_cpu;
+        const double major = (major_gc_cpu - fauto_last_major_gc_cpu) / interval;
+        const double minor =
+            stg_max((gc_cpu - fauto_last_gc_cpu) / interval - major, 0.0);
+        const double budget = stg_max(target - minor, target / 10);
+        const double step = stg_min(stg_max((1 + major / budget) / 2, 0.5), 2.0);
+
+        fauto_factor = stg_min(stg_max(1 + (fauto_factor - 1) * step,
+                                       FAUTO_MIN_FACTOR),
+                               FAUTO_MAX_FACTOR);
+        fauto_gc_cpu = major + minor;
+    }
+
+    fauto_last_cpu = cpu;
+    fauto_last_gc_cpu = gc_cpu;
+    fauto_last_major_gc_cpu = major_gc_cpu;
+    return fauto_factor;
+}
+
+/* Note [Soft heap limit]
+   ~~~~~~~~~~~~~~~~~~~~~~
+   -M is a hard limit: once the live data doesn't fit in it, the program dies
+   with heapOverflow. --soft-heap-limit=<size> is a target instead, for
+   programs in a container that would rather spend more time in GC than be
+   killed for going over its memory limit.
+
+   After each major GC, resizeGenerations works out the size the generations
+   would be given if the soft limit were given to -M, with the same formula,
+   and if that is less than the size -F (or -Fauto) asks for, uses it. So as
+   the live data approaches the limit the old generation is allowed to grow
+   less and less before the next major GC, which comes sooner; with the
+   nonmoving collector, the next mark starts sooner.
+
+   The sooner the next major GC, the more time is spent in GC, and as the live
+   data gets close to the limit that would grow without bound. So the old
+   generation is always allowed to grow by a factor soft_min_factor of the
+   live data, however close to the limit that takes us, and past it if need
+   be. soft_min_factor is adjusted after every major GC, by measuring the
+   fraction of the CPU time since the previous one that went to GC: while the
+   soft limit is shrinking the generations and the fraction is over
+   --soft-heap-limit-gc (50% by default), soft_min_factor - 1 doubles, and
+   while the fraction is under half of that, it halves, within
+   [SOFT_LIMIT_MIN_FACTOR, SOFT_LIMIT_MAX_FACTOR]. So a program whose live
+   data outgrows the limit degrades to spending about that fraction of its
+   time in GC, using more memory than the limit, rather than failing.
+
+   -M, if given as well, still applies after the soft limit.
+
+   getRTSStats reports the limit, whether the last major GC paced the heap
+   for it, soft_min_factor and the GC CPU fraction measured.
+*/
+
+#define SOFT_LIMIT_MIN_FACTOR 1.05
+#define SOFT_LIMIT_MAX_FACTOR 2.0
+
+// Returns the size to give the generations under the soft heap limit, given
+// the size the -F factor would give them and the live data in the oldest
+// generation.
+static W_
+soft_limit_gen_size (W_ size, W_ live)
+{
+    const W_ soft = RtsFlags.GcFlags.softHeapLimit;
+    const W_ gens = RtsFlags.GcFlags.generations;
+    const double max_gc_cpu = RtsFlags.GcFlags.softHeapLimitGcCpu;
+    Time cpu, gc_cpu, major_gc_cpu;
+
+    stat_getGCCpuTimes(&cpu, &gc_cpu, &major_gc_cpu);
+
+    if (soft_min_factor == 0) {
+        soft_min_factor = SOFT_LIMIT_MIN_FACTOR;
+    } else if (cpu > soft_last_cpu) {
+        soft_gc_cpu = (double)(gc_cpu - soft_last_gc_cpu) / (cpu - soft_last_cpu);
+        if (soft_pacing && soft_gc_cpu > max_gc_cpu) {
+            soft_min_factor = stg_min(1 + (soft_min_factor - 1) * 2,
+                                      SOFT_LIMIT_MAX_FACTOR);
+        } else if (soft_gc_cpu < max_gc_cpu / 2) {
+            soft_min_factor = stg_max(1 + (soft_min_factor - 1) / 2,
+                                      SOFT_LIMIT_MIN_FACTOR);
+        }
+    }
+    soft_last_cpu = cpu;
+    soft_last_gc_cpu = gc_cpu;
+
+    // The size -M<soft> would give the generations; see resizeGenerations
+    const W_ min_alloc = stg_max((RtsFlags.GcFlags.pcFreeHeap * soft) / 200,
+                                 RtsFlags.GcFlags.minAllocAreaSize
+                                 * (W_)getNumCapabilities());
+    W_ soft_size = 0;
+    if (soft > min_alloc) {
+        if (oldest_gen->compact || RtsFlags.GcFlags.useNonmoving) {
+            soft_size = (soft - min_alloc) / ((gens - 1) * 2 - 1);
+        } else {
+            soft_size = (soft - min_alloc) / ((gens - 1) * 2);
+        }
+    }
+
+    const W_ min_size = stg_max((W_)(live * soft_min_factor),
+                                (W_)RtsFlags.GcFlags.minOldGenSize);
+    const W_ new_size = stg_min(size, stg_max(soft_size, min_size));
+
+    soft_pacing = new_size < size;
+    debugTrace(DEBUG_gc,
+               "soft heap limit: size %" FMT_Word " -> %" FMT_Word
+               ", min factor %.2f, gc cpu %.3f",
+               size, new_size, soft_min_factor, soft_gc_cpu);
+    return new_size;
+}
+
+// For getRTSStats; racy, but these are only ever replaced as a whole.
+void
+getSoftHeapLimitStats (bool *pacing, double *min_factor, double *gc_cpu)
+{
+    *pacing = soft_pacing;
+    *min_factor = soft_min_factor;
+    *gc_cpu = soft_gc_cpu;
+}
+
 /* ----------------------------------------------------------------------------
    Reset the sizes of the older generations when we do a major
    collection.
@@ -1980,6 +2727,8 @@ resizeGenerations (void)
     W_ live, size, min_alloc, words;
     const W_ max  = RtsFlags.GcFlags.maxHeapSize;
     const W_ gens = RtsFlags.GcFlags.generations;
+    const double factor = RtsFlags.GcFlags.oldGenFactorAuto
+        ? adapt_old_gen_factor() : RtsFlags.GcFlags.oldGenFactor;
 
     // live in the oldest generations
     if (oldest_gen->live_estimate != 0) {
@@ -1992,8 +2741,7 @@ resizeGenerations (void)
         oldest_gen->n_compact_blocks;
 
     // default max size for all generations except zero
-    size = stg_max(live * RtsFlags.GcFlags.oldGenFactor,
-                   RtsFlags.GcFlags.minOldGenSize);
+    size = stg_max(live * factor, RtsFlags.GcFlags.minOldGenSize);
 
     if (RtsFlags.GcFlags.heapSizeSuggestionAuto) {
         if (max > 0) {
@@ -2029,6 +2777,11 @@ resizeGenerations (void)
         oldest_gen->mark = 1;
     }
 
+    // See Note [Soft heap limit]
+    if (RtsFlags.GcFlags.softHeapLimit != 0) {
+        size = soft_limit_gen_size(size, live);
+    }
+
     // if we're going to go over the maximum heap size, reduce the
     // size of the generations accordingly.  The calculation is
     // different if compaction is turned on, because we don't need
@@ -2068,6 +2821,32 @@ resizeGenerations (void)
     for (g = 0; g < gens; g++) {
         generations[g].max_blocks = size;
     }
+
+    // See Note [Adaptive generation sizing]
+    if (RtsFlags.GcFlags.oldGenFactorAuto) {
+        for (g = 1; g < gens; g++) {
+            generation *gen = &generations[g];
+            if (gen != oldest_gen && gen->last_alloc_words != 0) {
+                const double share =
+                    stg_min(stg_max(2 * (1 - gen->survival_rate), 0.25), 1.0);
+                gen->max_blocks =
+                    stg_min(stg_max((W_)(size * share),
+                                    (W_)RtsFlags.GcFlags.minOldGenSize),
+                            size);
+            }
+
+            debugTrace(DEBUG_gc,
+                       "-Fauto: gen %u: max_blocks %" FMT_Word
+                       ", survival %.3f, promotion %.3f, factor %.2f, gc cpu %.3f",
+                       g, (W_)gen->max_blocks, gen->survival_rate,
+                       gen->promotion_rate, factor, fauto_gc_cpu);
+            traceEventGcGenResize(CAPSET_HEAP_DEFAULT, g, gen->max_blocks,
+                                  (uint32_t)(gen->survival_rate * 1000),
+                                  (uint32_t)(gen->promotion_rate * 1000),
+                                  (uint32_t)(factor * 1000),
+                                  (uint32_t)(fauto_gc_cpu * 1000));
+        }
+    }
 }
 
 /* -----------------------------------------------------------------------------
@@ -2135,7 +2914,11 @@ resize_nursery (void)
          * If the user has given us a suggested heap size, adjust our
          * allocation area to make best use of the memory available.
          */
-        if (RtsFlags.GcFlags.heapSizeSuggestion)
+        if (RtsFlags.GcFlags.minorPauseTarget)
+        {
+            resizeNurseries(pause_target_nursery_blocks());
+        }
+        else if (RtsFlags.GcFlags.heapSizeSuggestion)
         {
             long blocks;
             StgWord needed;
@@ -2188,6 +2971,60 @@ resize_nursery (void)
     }
 }
 
+/* -----------------------------------------------------------------------------
+   Size the nursery to keep minor GC pauses under --minor-pause-target.
+
+   The time a minor GC takes is dominated by copying the live part of the
+   nursery, so for a stable survival rate it grows in proportion to the
+   nursery size. After each minor GC we therefore scale the nursery by the
+   ratio of the target to the pause we just measured, aiming 10% below the
+   target to leave some headroom. Pauses between half the target and the
+   target itself leave the size alone, so that the nursery doesn't change at
+   every GC, and a single step never more than halves or doubles it. The -A
+   size is the upper limit: we only ever make the nursery smaller than
+   usual. Major GCs, whose pause is dominated by the old generation, keep
+   the current size.
+
+   With -n the number of nursery chunks is fixed, so we resize the chunks.
+   -------------------------------------------------------------------------- */
+
+#define PAUSE_MIN_NURSERY_BLOCKS 16   // per capability
+
+static W_
+pause_target_nursery_blocks (void)
+{
+    const W_ n_caps = getNumCapabilities();
+    const W_ max_blocks = RtsFlags.GcFlags.minAllocAreaSize * n_caps;
+    const W_ min_blocks =
+        stg_min(stg_max(PAUSE_MIN_NURSERY_BLOCKS * n_caps, (W_)n_nurseries),
+                max_blocks);
+
+    if (pause_nursery_blocks == 0) {
+        pause_nursery_blocks = max_blocks;
+    }
+
+    if (N == 0) {
+        const Time target = RtsFlags.GcFlags.minorPauseTarget;
+        const Time pause = getProcessElapsedTime() - gct->gc_start_elapsed;
+
+        if (pause > target || pause < target / 2) {
+            double scale = pause > 0 ? 0.9 * target / pause : 2.0;
+            scale = stg_min(stg_max(scale, 0.5), 2.0);
+            pause_nursery_blocks =
+                stg_min(stg_max((W_)(pause_nursery_blocks * scale), min_blocks),
+                        max_blocks);
+
+            debugTrace(DEBUG_gc,
+                       "minor GC pause %" FMT_Word64 "us (target %" FMT_Word64
+                       "us): nursery now %" FMT_Word " blocks",
+                       (StgWord64)TimeToUS(pause), (StgWord64)TimeToUS(target),
+                       pause_nursery_blocks);
+        }
+    }
+
+    return pause_nursery_blocks;
+}
+
 /* -----------------------------------------------------------------------------
    Sanity code for CAF garbage collection.
 
@@ -2257,7 +3094,12 @@ void gcCAFs(void)
 
 bool doIdleGCWork(Capability *cap STG_UNUSED, bool all)
 {
-    return runSomeFinalizers(all);
+    bool more = runSomeFinalizers(all);
+    if (idleWorkEnabled()) {
+        // See Note [Idle GC work] in IdleWork.c
+        more = idleWorkRun(all) || more;
+    }
+    return more;
 }
 
 
@@ -44,6 +44,11 @@ void         markCAFs     ( evac_fn evac, void *user );
 
 bool doIdleGCWork(Capability *cap, bool all);
 
+void getSoftHeapLimitStats (bool *pacing, double *min_factor, double *gc_cpu);
+
+W_       estimateGCWork         (uint32_t collect_gen);
+uint32_t gcThreadsForWork       (W_ work, uint32_t max_threads);
+
 extern uint32_t N;
 extern bool major_gc;
 /* See Note [Deadlock detection under the nonmoving collector]. */
@@ -88,6 +93,9 @@ void freeGcThreads (void);
 
 void resizeGenerations (void);
 
+void runGcTask (void (*task)(void));
+bool isParallelGc (void);
+
 #if defined(THREADED_RTS)
 void notifyTodoBlock (void);
 void waitForGcThreads (Capability *cap, bool idle_cap[]);
@@ -14,6 +14,7 @@
 #include "CheckUnload.h"
 #include "Storage.h"
 #include "Compact.h"
+#include "CNF.h"
 #include "Task.h"
 #include "Capability.h"
 #include "Trace.h"
@@ -74,6 +75,12 @@ isAlive(StgClosure *p)
         return p;
     }
 
+    // immortal compacts are never collected
+    if ((bd->flags & BF_COMPACT)
+        && (Bdescr((P_)objectGetCompact(q))->flags & BF_COMPACT_IMMORTAL)) {
+        return p;
+    }
+
     // large objects use the evacuated flag
     if (bd->flags & BF_LARGE) {
         return NULL;
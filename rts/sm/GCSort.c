@@ -0,0 +1,168 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Sorting the mutable lists and the static object list by address before the
+ * GC scans them.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Sorting the remembered set]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The mutable lists of the old generations (the remembered set) record
+   objects in the order the mutator first wrote to them, which has nothing
+   to do with where they are in the heap. A minor GC that scans a large
+   remembered set in that order jumps between unrelated blocks of the old
+   generations, and pays a cache (and often TLB) miss for most entries.
+
+   With --sort-mut-lists, scavenge_capability_mut_lists first sorts each
+   saved mutable list by address (sortMutList), so that the objects of a
+   block, and the blocks of a megablock, are scanned together and in order;
+   since block descriptors sit in the same order at the start of each
+   megablock, sorting by address also sorts by block descriptor. We use an
+   LSD radix sort, 8 bits at a time, of the address offsets from the lowest
+   entry, which takes a few passes over the entries whatever their order.
+   An object on the list twice ends up next to its other entry, and we drop
+   the duplicate. Each GC thread sorts the lists of the capabilities it
+   scavenges, so the sorting is as parallel as the scan.
+
+   With --sort-static-objects, scavenge_static similarly sorts the static
+   objects found so far before scavenging them (sortStaticObjects), by
+   relinking the list. All entries on the list carry the current static_flag
+   in the low bits of their links (see Note [STATIC_LINK fields] in
+   Storage.h), and so do they after relinking, so the list stays valid for
+   the other GC threads, which only ever look at those bits of an object's
+   link.
+
+   The time each GC thread spends in scavenge_capability_mut_lists, sorting
+   included, is reported by +RTS -s, so that the effect can be measured.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "GCSort.h"
+#include "RtsUtils.h"
+#include "Storage.h"
+
+#include <string.h>
+
+#define RADIX_BITS 8
+#define RADIX (1 << RADIX_BITS)
+
+// Sort the n words of a in place, using tmp (of n words) as scratch space.
+static void radix_sort(StgWord *a, StgWord *tmp, W_ n)
+{
+    StgWord min = a[0], max = a[0];
+    for (W_ i = 1; i < n; i++) {
+        min = stg_min(min, a[i]);
+        max = stg_max(max, a[i]);
+    }
+    const StgWord range = max - min;
+
+    StgWord *from = a, *to = tmp;
+    for (unsigned int shift = 0;
+         shift < BITS_IN(StgWord) && (range >> shift) != 0;
+         shift += RADIX_BITS) {
+        W_ offset[RADIX] = { 0 };
+        for (W_ i = 0; i < n; i++) {
+            offset[((from[i] - min) >> shift) & (RADIX - 1)]++;
+        }
+        W_ total = 0;
+        for (unsigned int d = 0; d < RADIX; d++) {
+            const W_ count = offset[d];
+            offset[d] = total;
+            total += count;
+        }
+        for (W_ i = 0; i < n; i++) {
+            to[offset[((from[i] - min) >> shift) & (RADIX - 1)]++] = from[i];
+        }
+        StgWord *t = from;
+        from = to;
+        to = t;
+    }
+
+    if (from != a) {
+        memcpy(a, from, n * sizeof(StgWord));
+    }
+}
+
+/* Sort the entries of a mutable list by address, dropping duplicates.
+ * Returns the number of entries dropped.
+ */
+W_ sortMutList(bdescr *mut_list)
+{
+    W_ n = 0;
+    for (bdescr *bd = mut_list; bd != NULL; bd = bd->link) {
+        n += bd->free - bd->start;
+    }
+    if (n < 2) {
+        return 0;
+    }
+
+    StgWord *entries = stgMallocBytes(2 * n * sizeof(StgWord), "sortMutList");
+    W_ i = 0;
+    for (bdescr *bd = mut_list; bd != NULL; bd = bd->link) {
+        const W_ m = bd->free - bd->start;
+        memcpy(&entries[i], bd->start, m * sizeof(StgWord));
+        i += m;
+    }
+    radix_sort(entries, entries + n, n);
+
+    W_ kept = 1;
+    for (i = 1; i < n; i++) {
+        if (entries[i] != entries[kept - 1]) {
+            entries[kept++] = entries[i];
+        }
+    }
+
+    // Put them back in the same blocks, in order
+    i = 0;
+    for (bdescr *bd = mut_list; bd != NULL; bd = bd->link) {
+        const W_ m = stg_min((W_) (bd->free - bd->start), kept - i);
+        memcpy(bd->start, &entries[i], m * sizeof(StgWord));
+        bd->free = bd->start + m;
+        i += m;
+    }
+    ASSERT(i == kept);
+
+    stgFree(entries);
+    return n - kept;
+}
+
+/* Sort the static objects on the list *list (gct->static_objects) by
+ * address.
+ */
+void sortStaticObjects(StgClosure **list)
+{
+    W_ n = 0;
+    for (StgClosure *flagged_p = *list;
+         flagged_p != END_OF_STATIC_OBJECT_LIST; n++) {
+        StgClosure *p = UNTAG_STATIC_LIST_PTR(flagged_p);
+        flagged_p = RELAXED_LOAD(STATIC_LINK(get_itbl(p), p));
+    }
+    if (n < 2) {
+        return;
+    }
+
+    StgWord *objects = stgMallocBytes(2 * n * sizeof(StgWord),
+                                      "sortStaticObjects");
+    W_ i = 0;
+    for (StgClosure *flagged_p = *list;
+         flagged_p != END_OF_STATIC_OBJECT_LIST; i++) {
+        StgClosure *p = UNTAG_STATIC_LIST_PTR(flagged_p);
+        objects[i] = (StgWord) flagged_p;
+        flagged_p = RELAXED_LOAD(STATIC_LINK(get_itbl(p), p));
+    }
+    radix_sort(objects, objects + n, n);
+
+    StgClosure *next = END_OF_STATIC_OBJECT_LIST;
+    for (i = n; i > 0; i--) {
+        StgClosure *p = UNTAG_STATIC_LIST_PTR((StgClosure *) objects[i - 1]);
+        RELAXED_STORE(STATIC_LINK(get_itbl(p), p), next);
+        next = (StgClosure *) objects[i - 1];
+    }
+    *list = next;
+
+    stgFree(objects);
+}
@@ -0,0 +1,18 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Sorting the mutable lists and the static object list by address before the
+ * GC scans them.
+ * See Note [Sorting the remembered set] in GCSort.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+W_ sortMutList(bdescr *mut_list);
+void sortStaticObjects(StgClosure **list);
+
+#include "EndPrivate.h"
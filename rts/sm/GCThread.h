@@ -111,6 +111,36 @@ typedef struct gen_workspace_ {
     StgWord      n_part_words;
 } gen_workspace ATTRIBUTE_ALIGNED(GEN_WORKSPACE_ALIGNMENT);
 
+/* ----------------------------------------------------------------------------
+   Large objects that a GC thread has scavenged, or that need no scavenging,
+   waiting to go on gen->scavenged_large_objects (singly linked). One for
+   each generation, in gc_thread rather than gen_workspace, which must stay
+   16 words. See Note [Large objects during GC] in GC.c.
+   ------------------------------------------------------------------------- */
+
+typedef struct scavd_large_list_ {
+    bdescr *     objects;
+    bdescr *     last;
+    StgWord      n_blocks;           // count of blocks in this list
+} scavd_large_list;
+
+/* ----------------------------------------------------------------------------
+   A selector thunk whose selectee, itself a selector thunk, eval_thunk_selector
+   is evaluating. See Note [Selector optimisation depth limit] in Evac.c.
+   ------------------------------------------------------------------------- */
+
+typedef struct SelectorFrame_ {
+    StgSelector *p;                 // the WHITEHOLEd selector thunk
+    StgWord      info_ptr;          // its real info pointer
+    uint32_t     field;             // the field it selects
+    bool         evac;              // evaluating for evacuate()?
+    bdescr      *bd;
+    StgClosure **q;                 // where its value goes
+    StgSelector *prev_thunk_selector; // the chain to update with the value
+    StgClosure  *selectee;          // the selectee being evaluated...
+    StgClosure  *val;               // ... and its value
+} SelectorFrame;
+
 /* ----------------------------------------------------------------------------
    GC thread object
 
@@ -150,6 +180,10 @@ typedef struct gc_thread_ {
     // block that is currently being scanned
     bdescr *     scan_bd;
 
+    // are we scanning a todo block on the way through another block?
+    // See Note [Hierarchical copying] in Scav.c
+    bool         scan_nested;
+
     // Remembered sets on this CPU.  Each GC thread has its own
     // private per-generation remembered sets, so it can add an item
     // to the remembered set without taking a lock.  The mut_lists
@@ -158,6 +192,9 @@ typedef struct gc_thread_ {
     // during GC; see recordMutableGen_GC().
     bdescr **    mut_lists;
 
+    // Scavenged large objects of each generation, indexed by gen->no.
+    scavd_large_list * scavd_large;
+
     // --------------------
     // evacuate flags
 
@@ -177,17 +214,51 @@ typedef struct gc_thread_ {
                                    // instead of the to-space
                                    // corresponding to the object
 
-    W_ thunk_selector_depth;       // used to avoid unbounded recursion in
+    SelectorFrame *selector_frames; // --selector-depth of them, used by
                                    // evacuate() for THUNK_SELECTOR
+    W_ selector_budget;            // selector thunks left to evaluate in
+                                   // this GC (--selector-budget)
+
+    bdescr **weak_key_blocks;      // blocks whose BF_WEAK_KEYS flag this
+                                   // thread cleared, see noteWeakKeyBlock()
+    uint32_t n_weak_key_blocks;
+    uint32_t weak_key_blocks_size;
 
     // -------------------
     // stats
 
     W_ copied;
+    W_ *gen_copied;                // ... into each generation, by gen->no
+                                   // (not in gen_workspace, which must stay
+                                   // 16 words)
     W_ scanned;
     W_ any_work;
     W_ scav_find_work;
     W_ max_n_todo_overflow;
+    W_ stolen_blocks;              // todo blocks stolen from other threads
+    W_ failed_steals;              // steal attempts lost to a race
+    W_ rs_array_elems;             // elements of arrays on the mut lists
+    W_ rs_scanned_elems;           // ... of which were scanned
+    W_ rs_scanned_cards;           // cards scanned, see scavenge_cards()
+    W_ rs_entries;                 // mut list entries scanned
+    W_ rs_duplicates;              // ... and dropped by --sort-mut-lists
+    Time rs_scan_time;             // in scavenge_capability_mut_lists()
+    W_ selectors_eliminated;       // selector thunks turned into INDs
+    W_ selectors_deferred;         // ... or left for later by the limits
+    W_ copy_races;                 // copies lost to another GC thread
+    W_ copy_race_words;            // ... and the words of them left behind
+    W_ static_scavenged;           // static objects scavenged (major GCs)
+    Time static_scan_time;         // in scavenge_static()
+    Time copy_start;               // elapsed time when the thread started
+                                   // copying, see stat_getElapsedTime()
+    Time copy_end;                 // ... and when it last ran out of work
+    Time idle_time;                // waiting in scavenge_until_all_done()
+                                   // for other threads to share work
+
+    struct PretenureSample_ *pretenure_samples;
+                                   // for --pretenure, see Note [Pretenuring]
+    struct _Census *census;        // see Note [Heap census during GC]
+                                   // in ProfHeap.c
 
     Time gc_start_cpu;             // thread CPU time
     Time gc_end_cpu;               // thread CPU time
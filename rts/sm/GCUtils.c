@@ -32,13 +32,20 @@ SpinLock gc_alloc_block_sync;
 
 static void push_todo_block(bdescr *bd, gen_workspace *ws);
 
+// The _sync variants below go through the block cache of the
+// Capability that this gc_thread is attached to, which no one else can
+// touch during GC.  See Note [Per-capability block cache] in BlockAlloc.c.
+
 bdescr* allocGroup_sync(uint32_t n)
 {
     bdescr *bd;
-    uint32_t node = capNoToNumaNode(gct->thread_index);
-    ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
-    bd = allocGroupOnNode(node,n);
-    RELEASE_ALLOC_BLOCK_SPIN_LOCK();
+    BlockCache *cache = &gct->cap->block_cache;
+    bd = blockCacheAlloc(cache, n);
+    if (bd == NULL) {
+        ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
+        bd = blockCacheRefill(cache, n);
+        RELEASE_ALLOC_BLOCK_SPIN_LOCK();
+    }
     return bd;
 }
 
@@ -78,17 +85,36 @@ allocBlocks_sync(uint32_t n, bdescr **hd)
 void
 freeChain_sync(bdescr *bd)
 {
-    ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
-    freeChain(bd);
-    RELEASE_ALLOC_BLOCK_SPIN_LOCK();
+    BlockCache *cache = &gct->cap->block_cache;
+    bdescr *next_bd, *overflow = NULL;
+
+    // Cache what we can without the lock, and free the rest in one go.
+    for (; bd != NULL; bd = next_bd) {
+        next_bd = bd->link;
+        if (!blockCacheFree(cache, bd)) {
+            bd->link = overflow;
+            overflow = bd;
+        }
+    }
+
+    if (overflow != NULL) {
+        ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
+        freeChain(overflow);
+        blockCacheDrain(cache, cache->capacity / 2);
+        RELEASE_ALLOC_BLOCK_SPIN_LOCK();
+    }
 }
 
 void
 freeGroup_sync(bdescr *bd)
 {
-    ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
-    freeGroup(bd);
-    RELEASE_ALLOC_BLOCK_SPIN_LOCK();
+    BlockCache *cache = &gct->cap->block_cache;
+    if (!blockCacheFree(cache, bd)) {
+        ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
+        freeGroup(bd);
+        blockCacheDrain(cache, cache->capacity / 2);
+        RELEASE_ALLOC_BLOCK_SPIN_LOCK();
+    }
 }
 
 /* -----------------------------------------------------------------------------
@@ -106,6 +132,27 @@ grab_local_todo_block (gen_workspace *ws)
         ws->todo_overflow = bd->link;
         bd->link = NULL;
         ws->n_todo_overflow--;
+
+        // Move what we can of the rest back to the deque, where other
+        // threads can steal it. See Note [Stealing GC work].
+        bool moved = false;
+        while (ws->todo_overflow != NULL) {
+            bdescr *ov = ws->todo_overflow;
+            bdescr *rest = ov->link;
+            ov->link = NULL;
+            if (!pushWSDeque(ws->todo_q, ov)) {
+                ov->link = rest;
+                break;
+            }
+            ws->todo_overflow = rest;
+            ws->n_todo_overflow--;
+            moved = true;
+        }
+#if defined(THREADED_RTS)
+        if (moved) notifyTodoBlock();
+#else
+        (void)moved;
+#endif
         return bd;
     }
 
@@ -120,19 +167,76 @@ grab_local_todo_block (gen_workspace *ws)
 }
 
 #if defined(THREADED_RTS)
-bdescr *
-steal_todo_block (uint32_t g)
+/* Note [Stealing GC work]
+   ~~~~~~~~~~~~~~~~~~~~~~~
+   An idle GC thread looks for todo blocks in the todo_q deques of the other
+   threads (steal_todo_block()).  A few things keep this cheap when there
+   are many GC threads:
+
+    * Each thread starts looking at the thread after itself, rather than
+      every thief starting at thread 0 and piling onto the same deques.
+
+    * A steal that loses a race (with the owner or another thief) backs off
+      exponentially, up to STEAL_MAX_BACKOFF spins, before retrying, instead
+      of hammering the deque's top index as stealWSDeque() does.
+
+    * Having found a victim, the thief takes up to half of the victim's
+      remaining blocks (at most STEAL_MAX_BATCH) onto its own todo_q, so
+      that it does not have to come back for every block, and so that the
+      work spreads further through further steals from the thief.
+
+    * Blocks that did not fit in the owner's todo_q go on its private
+      todo_overflow list.  The owner moves them back to the deque as space
+      frees up (grab_local_todo_block()), so a long chain of blocks held by
+      one thread becomes stealable rather than being worked through by that
+      thread alone.
+
+   The number of blocks each thread stole, and the number of steal attempts it
+   lost, are posted to the eventlog after each GC (EVENT_GC_WORK_STEALS).
+*/
+
+#define STEAL_MAX_BACKOFF 64
+#define STEAL_MAX_BATCH   32
+
+static bdescr *
+steal_from (WSDeque *q)
 {
-    uint32_t n;
-    bdescr *bd;
+    uint32_t spins = 1;
 
-    // look for work to steal
-    for (n = 0; n < n_gc_threads; n++) {
-        if (n == gct->thread_index) continue;
-        bd = stealWSDeque(gc_threads[n]->gens[g].todo_q);
-        if (bd) {
+    for (;;) {
+        bdescr *bd = stealWSDeque_(q);
+        if (bd != NULL || looksEmptyWSDeque(q)) {
             return bd;
         }
+        gct->failed_steals++;
+        for (uint32_t i = 0; i < spins; i++) {
+            busy_wait_nop();
+        }
+        if (spins < STEAL_MAX_BACKOFF) {
+            spins *= 2;
+        }
+    }
+}
+
+bdescr *
+steal_todo_block (uint32_t g)
+{
+    // look for work to steal; see Note [Stealing GC work]
+    for (uint32_t i = 1; i < n_gc_threads; i++) {
+        uint32_t n = (gct->thread_index + i) % n_gc_threads;
+        WSDeque *q = gc_threads[n]->gens[g].todo_q;
+        bdescr *bd = steal_from(q);
+        if (bd == NULL) continue;
+        gct->stolen_blocks++;
+
+        StgInt batch = stg_min(dequeElements(q) / 2, STEAL_MAX_BATCH);
+        for (; batch > 0; batch--) {
+            bdescr *more = stealWSDeque_(q);
+            if (more == NULL) break;
+            gct->stolen_blocks++;
+            push_todo_block(more, &gct->gens[g]);
+        }
+        return bd;
     }
     return NULL;
 }
@@ -184,15 +288,12 @@ push_todo_block(bdescr *bd, gen_workspace *ws)
         ws->todo_overflow = bd;
         ws->n_todo_overflow++;
 
-        // In theory, if a gc thread pushes more blocks to it's todo_q than it
-        // pops, the todo_overflow list will continue to grow. Other gc threads
-        // can't steal from the todo_overflwo list, so they may be idle as the
-        // first gc thread works diligently on it's todo_overflow list. In
-        // practice this has not been observed to occur.
+        // Other gc threads can't steal from the todo_overflow list directly,
+        // but grab_local_todo_block() moves blocks back to the todo_q as it
+        // drains. See Note [Stealing GC work].
         //
         // The max_n_todo_overflow counter will allow us to observe large
-        // todo_overflow lists if they ever arise. As of now I've not observed
-        // any nonzero max_n_todo_overflow samples.
+        // todo_overflow lists if they ever arise.
         gct->max_n_todo_overflow =
             stg_max(gct->max_n_todo_overflow, ws->n_todo_overflow);
     }
@@ -284,6 +385,7 @@ todo_block_full (uint32_t size, gen_workspace *ws)
     }
 
     gct->copied += ws->todo_free - RELAXED_LOAD(&bd->free);
+    gct->gen_copied[ws->gen->no] += ws->todo_free - RELAXED_LOAD(&bd->free);
     RELAXED_STORE(&bd->free, ws->todo_free);
 
     ASSERT(bd->u.scan >= bd->start && bd->u.scan <= bd->free);
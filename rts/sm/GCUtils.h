@@ -75,4 +75,21 @@ recordMutableGen_GC (StgClosure *p, uint32_t gen_no)
     // we don't need an atomic increment.
 }
 
+// Put a large object on this GC thread's list of scavenged large objects
+// for ws->gen, which collect_gct_blocks() moves to
+// ws->gen->scavenged_large_objects.
+// See Note [Large objects during GC] in GC.c.
+INLINE_HEADER void
+push_scavd_large_object (gen_workspace *ws, bdescr *bd)
+{
+    scavd_large_list *l = &gct->scavd_large[ws->gen->no];
+
+    if (l->objects == NULL) {
+        l->last = bd;
+    }
+    bd->link = l->objects;
+    l->objects = bd;
+    l->n_blocks += bd->blocks;
+}
+
 #include "EndPrivate.h"
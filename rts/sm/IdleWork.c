@@ -0,0 +1,185 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * GC work deferred to the time the capabilities are idle.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Idle GC work]
+   ~~~~~~~~~~~~~~~~~~~
+   Some of what a GC does at the end of a collection doesn't have to be done
+   within the pause: freeing the dead large objects, and returning the
+   megablocks the heap no longer needs to the OS, which for a heap that just
+   shrank can mean many frees and madvise() calls. With
+   --idle-gc-work-budget=<time> major GCs leave that work behind instead,
+   and capabilities about to go idle do it in slices of at most <time>
+   (doIdleGCWork, called from scheduleYield), together with the C
+   finalizers that are already run this way (runSomeFinalizers). A program
+   that serves bursts of requests then does the work between the bursts,
+   rather than in the pause of the GC that happens to end one.
+
+   The dead large objects of the collected generations are moved onto
+   idle_dead_large_objects instead of being freed. They belong to no
+   generation, so the heap checks in Sanity.c count them separately. A
+   slice frees them one group at a time, checking the clock every
+   IDLE_CHECK_INTERVAL groups.
+
+   The megablocks to return are only known as a target, the number of
+   megablocks the GC would have kept: a slice returns at most
+   IDLE_RETURN_MBLOCKS of them at a time (checking the clock after each)
+   until mblocks_allocated reaches the target, or until returnMemoryToOS can't find free megablocks to return.
+   The target is dropped by the next GC, which sets a new one if it is a
+   major GC. Memory is still returned in the pause when there is a maximum
+   heap size (-M), since the GC then has to check that we are under it.
+
+   When all the work has to be done (doIdleGCWork(cap, true), before a GC or
+   at shutdown) we free all the dead large objects but drop the memory
+   return, as the GC is about to decide again how much memory to keep.
+
+   Only the threaded RTS can do the work: the non-threaded scheduler never
+   yields its capability, so it would never find the time.
+
+   Only one capability does idle work at a time, the others find nothing to
+   do; the dead large objects and the target are accessed with the storage
+   manager lock held.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "BlockAlloc.h"
+#include "GetTime.h"
+#include "IdleWork.h"
+#include "Storage.h"
+#include "Trace.h"
+
+#define IDLE_CHECK_INTERVAL 16
+#define IDLE_RETURN_MBLOCKS 16
+
+bdescr *idle_dead_large_objects = NULL;
+
+// The number of megablocks to return memory down to, or 0 if there's nothing
+// to return.
+static W_ idle_return_target = 0;
+
+// non-zero if a capability is already in idleWorkRun()
+static volatile StgWord idle_work_lock = 0;
+
+bool idleWorkEnabled(void)
+{
+#if defined(THREADED_RTS)
+    return RtsFlags.GcFlags.idleGCWorkBudget > 0;
+#else
+    return false;
+#endif
+}
+
+/* Called by the GC, holding the storage manager lock, in place of
+ * freeChain(bd).
+ */
+void idleDeferLargeObjects(bdescr *bd)
+{
+    if (bd == NULL) {
+        return;
+    }
+    bdescr *last = bd;
+    while (last->link != NULL) {
+        last = last->link;
+    }
+    last->link = idle_dead_large_objects;
+    idle_dead_large_objects = bd;
+}
+
+/* Called by a major GC, holding the storage manager lock, in place of
+ * returning memory down to target_mblocks megablocks.
+ */
+void idleDeferMemoryReturn(W_ target_mblocks)
+{
+    idle_return_target = target_mblocks;
+}
+
+// Called at the start of every GC, holding the storage manager lock.
+void idleCancelMemoryReturn(void)
+{
+    idle_return_target = 0;
+}
+
+// Free one group of dead large objects, returning false if there are none.
+static bool free_one_large_object(void)
+{
+    bdescr *bd = idle_dead_large_objects;
+    if (bd == NULL) {
+        return false;
+    }
+    idle_dead_large_objects = bd->link;
+    freeGroup(bd);
+    return true;
+}
+
+// Return some memory, returning false if there is nothing more to return.
+static bool return_some_memory(void)
+{
+    if (idle_return_target == 0 || mblocks_allocated <= idle_return_target) {
+        idle_return_target = 0;
+        return false;
+    }
+    const W_ n = stg_min(mblocks_allocated - idle_return_target,
+                         (W_) IDLE_RETURN_MBLOCKS);
+    if (returnMemoryToOS(n) == 0) {
+        // The free megablocks are all taken or fragmented
+        idle_return_target = 0;
+        return false;
+    }
+    return true;
+}
+
+/* Do some of the deferred work, for at most the --idle-gc-work-budget, or
+ * all of it. Returns true if there's more to do.
+ */
+bool idleWorkRun(bool all)
+{
+    if (cas(&idle_work_lock, 0, 1) != 0) {
+        // another capability is doing the work
+        return false;
+    }
+
+    const Time deadline = getProcessElapsedTime()
+                          + RtsFlags.GcFlags.idleGCWorkBudget;
+    bool more = true;
+    uint32_t n = 0;
+
+    ACQUIRE_SM_LOCK;
+    if (all) {
+        while (free_one_large_object()) {}
+        idle_return_target = 0;
+        more = false;
+    } else {
+        while (more) {
+            if (free_one_large_object()) {
+                if (++n % IDLE_CHECK_INTERVAL != 0) {
+                    continue;
+                }
+            } else {
+                more = return_some_memory();
+            }
+            if (getProcessElapsedTime() >= deadline) {
+                break;
+            }
+        }
+    }
+    RELEASE_SM_LOCK;
+
+    if (!all && more) {
+        debugTrace(DEBUG_gc, "idle GC work: out of time, more to do");
+    }
+
+    RELEASE_STORE(&idle_work_lock, 0);
+    return more;
+}
+
+// The blocks of the dead large objects not freed yet, for the heap checks.
+W_ countIdleDeferredBlocks(void)
+{
+    return countBlocks(idle_dead_large_objects);
+}
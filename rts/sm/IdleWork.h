@@ -0,0 +1,24 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * GC work deferred to the time the capabilities are idle.
+ * See Note [Idle GC work] in IdleWork.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+// Dead large objects waiting to be freed, chained through their link fields
+extern bdescr *idle_dead_large_objects;
+
+bool idleWorkEnabled(void);
+void idleDeferLargeObjects(bdescr *bd);
+void idleDeferMemoryReturn(W_ target_mblocks);
+void idleCancelMemoryReturn(void);
+bool idleWorkRun(bool all);
+W_ countIdleDeferredBlocks(void);
+
+#include "EndPrivate.h"
@@ -0,0 +1,130 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Memory lent to Haskell as a ByteArray# by rts_loanByteArray.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Loaned byte arrays]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~
+   rts_loanByteArray lets a C program give Haskell a ByteArray# of memory
+   it owns (mmap()ed pages of a file, say) without copying it into the heap.
+   A ByteArray# is an ARR_WORDS closure, a header followed by the bytes, so
+   the caller leaves rts_loanHeaderSize() bytes in front of its data. We
+   write the closure header there, with the info table
+   stg_LOANED_ARR_WORDS_info (of type ARR_WORDS, so that to the rest of the
+   RTS it is any other byte array), and in the word before it a pointer to
+   the loan's LoanedBytes record.
+
+   The closure is outside the heap, so the GC treats it like a static
+   closure: it never moves or frees it. evacuate() does see every reference
+   to it during a major GC, though, and marks the loan live
+   (markLoanedBytes). After each major GC, sweepLoanedBytes hands back the
+   loans that weren't marked, by calling their release function; this is
+   when a pinned byte array of the same size would have been freed. Minor
+   GCs don't see all the references, so they neither mark nor sweep.
+
+   With the non-moving collector the old generation is marked concurrently
+   and evacuate() doesn't see the references from it, so loans are only
+   handed back when the RTS shuts down (exitLoanedBytes), as are any loans
+   still live at that point.
+
+   The release functions run during GC, with the other Haskell threads
+   stopped, so they mustn't call back into Haskell or the RTS API. The
+   primops asking whether a byte array is pinned know about the info table
+   too, and say that a loaned one is (it can't move).
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "LoanedBytes.h"
+#include "RtsUtils.h"
+
+static LoanedBytes *loans = NULL;
+
+#if defined(THREADED_RTS)
+static Mutex loans_mutex;
+#endif
+
+void initLoanedBytes(void)
+{
+#if defined(THREADED_RTS)
+    initMutex(&loans_mutex);
+#endif
+}
+
+HsWord rts_loanHeaderSize(void)
+{
+    return sizeof(LoanedBytes *) + sizeof(StgArrBytes);
+}
+
+HaskellObj rts_loanByteArray(Capability *cap STG_UNUSED, void *bytes,
+                             HsWord n_bytes, LoanReleaseFn release, void *env)
+{
+    if ((W_)bytes % sizeof(W_) != 0) {
+        barf("rts_loanByteArray: %p is not word-aligned", bytes);
+    }
+
+    StgArrBytes *arr = (StgArrBytes *)((StgWord8 *)bytes - sizeof(StgArrBytes));
+    LoanedBytes *loan = stgMallocBytes(sizeof(LoanedBytes), "rts_loanByteArray");
+    loan->arr = arr;
+    loan->release = release;
+    loan->env = env;
+    loan->live = false;
+
+    ((LoanedBytes **)arr)[-1] = loan;
+    SET_HDR(arr, &stg_LOANED_ARR_WORDS_info, CCS_SYSTEM);
+    arr->bytes = n_bytes;
+
+    ACQUIRE_LOCK(&loans_mutex);
+    loan->link = loans;
+    loans = loan;
+    RELEASE_LOCK(&loans_mutex);
+
+    return (HaskellObj)arr;
+}
+
+static void releaseLoan(LoanedBytes *loan)
+{
+    if (loan->release) {
+        loan->release(loan->arr->payload, loan->env);
+    }
+    stgFree(loan);
+}
+
+void sweepLoanedBytes(void)
+{
+    LoanedBytes **prev, *loan, *next;
+
+    ACQUIRE_LOCK(&loans_mutex);
+    prev = &loans;
+    for (loan = loans; loan != NULL; loan = next) {
+        next = loan->link;
+        if (loan->live) {
+            loan->live = false;
+            prev = &loan->link;
+        } else {
+            *prev = next;
+            releaseLoan(loan);
+        }
+    }
+    RELEASE_LOCK(&loans_mutex);
+}
+
+void exitLoanedBytes(void)
+{
+    LoanedBytes *loan, *next;
+
+    ACQUIRE_LOCK(&loans_mutex);
+    for (loan = loans; loan != NULL; loan = next) {
+        next = loan->link;
+        releaseLoan(loan);
+    }
+    loans = NULL;
+    RELEASE_LOCK(&loans_mutex);
+#if defined(THREADED_RTS)
+    closeMutex(&loans_mutex);
+#endif
+}
@@ -0,0 +1,38 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Memory lent to Haskell as a ByteArray# by rts_loanByteArray.
+ * See Note [Loaned byte arrays] in LoanedBytes.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+typedef struct LoanedBytes_ {
+    StgArrBytes *arr;
+    LoanReleaseFn release;
+    void *env;
+    bool live;                  // seen by the current major GC
+    struct LoanedBytes_ *link;
+} LoanedBytes;
+
+void initLoanedBytes(void);
+void sweepLoanedBytes(void);
+void exitLoanedBytes(void);
+
+// Called by evacuate() for an ARR_WORDS that isn't in the heap, which can
+// only be a loaned one.
+INLINE_HEADER void
+markLoanedBytes (StgClosure *q)
+{
+    ASSERT(q->header.info == &stg_LOANED_ARR_WORDS_info);
+    LoanedBytes *loan = ((LoanedBytes **)q)[-1];
+    if (!RELAXED_LOAD(&loan->live)) {
+        RELAXED_STORE(&loan->live, true);
+    }
+}
+
+#include "EndPrivate.h"
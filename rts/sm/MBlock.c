@@ -96,6 +96,28 @@ typedef struct free_list {
 
 static free_list *free_list_head;
 static W_ mblock_high_watermark;
+
+/* Note [Huge page backed heap]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   With -xH we ask the OS to back the heap with transparent huge pages
+   (typically 2MB), which cuts down on TLB misses when the GC walks a large
+   heap. A huge page is larger than an mblock, so committing or
+   decommitting individual mblocks would force the kernel to split the
+   huge page around it ("shattering"), losing the benefit.
+
+   Instead, we commit and decommit memory in units of
+   mblock_commit_granularity (the huge page size with -xH, MBLOCK_SIZE
+   otherwise), and maintain the invariant that
+
+     a granule is committed iff it contains at least one live mblock.
+
+   Hence when an mblock range is freed, we decommit only those granules
+   that lie entirely within the (coalesced) free region around it, and when
+   a range is allocated we commit only those granules that lay entirely
+   within the free region it was taken from. Partially used granules stay
+   committed. See commit_granules_in().
+*/
+static W_ mblock_commit_granularity = MBLOCK_SIZE;
 /*
  * it is quite important that these are in the same cache line as they
  * are both needed by HEAP_ALLOCED. Moreover, we need to ensure that they
@@ -152,6 +174,295 @@ void * getNextMBlock(void **state STG_UNUSED, void *mblock)
     return getAllocatedMBlock(casted_state, (W_)mblock + MBLOCK_SIZE);
 }
 
+/* Note [Background decommit]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   Returning memory to the OS at the end of a major GC (see
+   returnMemoryToOS()) can mean a great many madvise() calls on a large heap,
+   all of which would otherwise be charged to the stop-the-world pause. With
+   --background-decommit the threaded RTS instead hands the ranges to a
+   dedicated OS thread, which decommits them while the mutator runs. How
+   much memory is returned is still decided by the GC, following -Fd.
+
+   The one subtlety is that the mblocks in a range may be reused before the
+   decommit thread gets round to it. So before we commit any memory we
+   cancel all queued decommits overlapping it, and wait for the one in
+   flight (if it overlaps) to finish. All of this is done under
+   decommit_lock; the mblock allocator itself is protected by the storage
+   manager lock as usual.
+
+   The child of forkProcess() has no decommit thread. forkProcess() holds
+   decommit_lock across the fork, so that the child finds the queue in one
+   piece, and releases it again in both the parent and the child. The child
+   then decommits whatever was queued or in flight itself
+   (resetDecommitQueue()). decommit_lock and the conditions stay
+   initialised; the next decommitMemory() in the child only starts a thread
+   of its own.
+*/
+
+#if defined(THREADED_RTS)
+typedef struct decommit_range_ {
+    struct decommit_range_ *next;
+    W_ address;
+    W_ size;
+} decommit_range;
+
+static Mutex decommit_lock;
+static Condition decommit_work_cond;   // queue non-empty, or stop requested
+static Condition decommit_done_cond;   // in-flight range finished
+static decommit_range *decommit_queue; // protected by decommit_lock
+static W_ decommit_busy_lo, decommit_busy_hi; // range in flight, or empty
+static bool decommit_initialised = false;  // decommit_lock and conditions
+static bool decommit_thread_started = false;
+static bool decommit_thread_stop;
+static OSThreadId decommit_thread;
+
+static void* decommitWorker(void *data STG_UNUSED)
+{
+    ACQUIRE_LOCK(&decommit_lock);
+    while (true) {
+        while (decommit_queue == NULL && !decommit_thread_stop) {
+            waitCondition(&decommit_work_cond, &decommit_lock);
+        }
+        if (decommit_thread_stop) {
+            break;
+        }
+
+        decommit_range *r = decommit_queue;
+        decommit_queue = r->next;
+        decommit_busy_lo = r->address;
+        decommit_busy_hi = r->address + r->size;
+        RELEASE_LOCK(&decommit_lock);
+
+        osDecommitMemory((void*)r->address, r->size);
+        stgFree(r);
+
+        ACQUIRE_LOCK(&decommit_lock);
+        decommit_busy_lo = decommit_busy_hi = 0;
+        broadcastCondition(&decommit_done_cond);
+    }
+    RELEASE_LOCK(&decommit_lock);
+    return NULL;
+}
+
+static void startDecommitThread(void)
+{
+    if (!decommit_initialised) {
+        initMutex(&decommit_lock);
+        initCondition(&decommit_work_cond);
+        initCondition(&decommit_done_cond);
+        decommit_queue = NULL;
+        decommit_busy_lo = decommit_busy_hi = 0;
+        decommit_initialised = true;
+    }
+    decommit_thread_stop = false;
+
+    if (createOSThread(&decommit_thread, "ghc_decommit",
+                       decommitWorker, NULL) != 0) {
+        barf("startDecommitThread: failed to spawn decommit thread: %s",
+             strerror(errno));
+    }
+    decommit_thread_started = true;
+}
+
+static void stopDecommitThread(void)
+{
+    if (!decommit_initialised) {
+        return;
+    }
+
+    if (decommit_thread_started) {
+        ACQUIRE_LOCK(&decommit_lock);
+        decommit_thread_stop = true;
+        signalCondition(&decommit_work_cond);
+        RELEASE_LOCK(&decommit_lock);
+        joinOSThread(decommit_thread);
+        decommit_thread_started = false;
+    }
+
+    // We're about to release the whole address space, so whatever is still
+    // queued can simply be dropped.
+    decommit_range *r, *next;
+    for (r = decommit_queue; r != NULL; r = next) {
+        next = r->next;
+        stgFree(r);
+    }
+    decommit_queue = NULL;
+
+    closeMutex(&decommit_lock);
+    closeCondition(&decommit_work_cond);
+    closeCondition(&decommit_done_cond);
+    decommit_initialised = false;
+}
+
+// Remove [lo, hi) from the decommit queue, and wait for it to be out of
+// flight. Must be called before [lo, hi) is committed again.
+static void cancelDecommit(W_ lo, W_ hi)
+{
+    if (!decommit_thread_started) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&decommit_lock);
+    decommit_range **prev = &decommit_queue;
+    decommit_range *r;
+    while ((r = *prev) != NULL) {
+        W_ r_lo = r->address, r_hi = r->address + r->size;
+        if (r_hi <= lo || r_lo >= hi) {
+            prev = &r->next;
+            continue;
+        }
+        // keep whatever lies above hi as a separate range
+        if (r_hi > hi) {
+            decommit_range *above =
+                stgMallocBytes(sizeof(decommit_range), "cancelDecommit");
+            above->address = hi;
+            above->size = r_hi - hi;
+            above->next = r->next;
+            r->next = above;
+        }
+        if (r_lo < lo) {
+            // keep the part below lo
+            r->size = lo - r_lo;
+            prev = &r->next;
+        } else {
+            *prev = r->next;
+            stgFree(r);
+        }
+    }
+
+    while (decommit_busy_lo < hi && lo < decommit_busy_hi) {
+        waitCondition(&decommit_done_cond, &decommit_lock);
+    }
+    RELEASE_LOCK(&decommit_lock);
+}
+#endif /* THREADED_RTS */
+
+// Hold the decommit queue still across forkProcess(), see
+// Note [Background decommit]
+void
+lockDecommitQueue(void)
+{
+#if defined(THREADED_RTS)
+    if (decommit_initialised) {
+        ACQUIRE_LOCK(&decommit_lock);
+    }
+#endif
+}
+
+void
+unlockDecommitQueue(void)
+{
+#if defined(THREADED_RTS)
+    if (decommit_initialised) {
+        RELEASE_LOCK(&decommit_lock);
+    }
+#endif
+}
+
+// In the child of forkProcess(), after unlockDecommitQueue(): the decommit
+// thread is gone, so decommit what it had left to do here, and let
+// decommitMemory() start a new one.
+void
+resetDecommitQueue(void)
+{
+#if defined(THREADED_RTS)
+    if (!decommit_thread_started) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&decommit_lock);
+
+    // the range in flight can't have been committed again, as
+    // cancelDecommit() waits for it, so decommitting it twice is harmless
+    if (decommit_busy_lo < decommit_busy_hi) {
+        osDecommitMemory((void*)decommit_busy_lo,
+                         decommit_busy_hi - decommit_busy_lo);
+    }
+    decommit_range *r, *next;
+    for (r = decommit_queue; r != NULL; r = next) {
+        next = r->next;
+        osDecommitMemory((void*)r->address, r->size);
+        stgFree(r);
+    }
+    decommit_queue = NULL;
+    decommit_busy_lo = decommit_busy_hi = 0;
+    decommit_thread_started = false;
+    RELEASE_LOCK(&decommit_lock);
+#endif
+}
+
+static void
+decommitMemory(W_ address, W_ size)
+{
+#if defined(THREADED_RTS)
+    if (RtsFlags.GcFlags.backgroundDecommit) {
+        if (!decommit_thread_started) {
+            startDecommitThread();
+        }
+        decommit_range *r = stgMallocBytes(sizeof(decommit_range),
+                                           "decommitMemory");
+        r->address = address;
+        r->size = size;
+        ACQUIRE_LOCK(&decommit_lock);
+        r->next = decommit_queue;
+        decommit_queue = r;
+        signalCondition(&decommit_work_cond);
+        RELEASE_LOCK(&decommit_lock);
+        return;
+    }
+#endif
+    osDecommitMemory((void*)address, size);
+}
+
+static void
+commitMemory(W_ address, W_ size)
+{
+#if defined(THREADED_RTS)
+    cancelDecommit(address, address + size);
+#endif
+    osCommitMemory((void*)address, size);
+}
+
+// Find the granules overlapping [addr, addr+size) which lie entirely
+// within the free region [free_lo, free_hi). See Note [Huge page backed heap].
+static bool
+granules_within(W_ addr, W_ size, W_ free_lo, W_ free_hi, W_ *lo, W_ *hi)
+{
+    W_ g = mblock_commit_granularity;
+
+    *lo = addr & ~(g - 1);
+    if (*lo < free_lo) {
+        *lo += g;
+    }
+    *hi = (addr + size + g - 1) & ~(g - 1);
+    if (*hi > free_hi) {
+        *hi -= g;
+    }
+    return *lo < *hi;
+}
+
+// [addr, addr+size) is being allocated out of the free region
+// [free_lo, free_hi).
+static void
+commit_granules_in(W_ addr, W_ size, W_ free_lo, W_ free_hi)
+{
+    W_ lo, hi;
+    if (granules_within(addr, size, free_lo, free_hi, &lo, &hi)) {
+        commitMemory(lo, hi - lo);
+    }
+}
+
+// [addr, addr+size) has been freed, and is now part of the free region
+// [free_lo, free_hi).
+static void
+decommit_granules_in(W_ addr, W_ size, W_ free_lo, W_ free_hi)
+{
+    W_ lo, hi;
+    if (granules_within(addr, size, free_lo, free_hi, &lo, &hi)) {
+        decommitMemory(lo, hi - lo);
+    }
+}
+
 static void *getReusableMBlocks(uint32_t n)
 {
     struct free_list *iter;
@@ -159,11 +470,14 @@ static void *getReusableMBlocks(uint32_t n)
 
     for (iter = free_list_head; iter != NULL; iter = iter->next) {
         void *addr;
+        W_ free_lo, free_hi;
 
         if (iter->size < size)
             continue;
 
         addr = (void*)iter->address;
+        free_lo = iter->address;
+        free_hi = iter->address + iter->size;
         iter->address += size;
         iter->size -= size;
         if (iter->size == 0) {
@@ -183,7 +497,7 @@ static void *getReusableMBlocks(uint32_t n)
             stgFree(iter);
         }
 
-        osCommitMemory(addr, size);
+        commit_granules_in((W_)addr, size, free_lo, free_hi);
         return addr;
     }
 
@@ -202,7 +516,9 @@ static void *getFreshMBlocks(uint32_t n)
         stg_exit(EXIT_HEAPOVERFLOW);
     }
 
-    osCommitMemory(addr, size);
+    // everything above the high watermark is free
+    commit_granules_in((W_)addr, size, mblock_high_watermark,
+                       mblock_address_space.end);
     mblock_high_watermark += size;
     return addr;
 }
@@ -225,8 +541,11 @@ static void decommitMBlocks(char *addr, uint32_t n)
     struct free_list *iter, *prev;
     W_ size = MBLOCK_SIZE * (W_)n;
     W_ address = (W_)addr;
+    W_ end = mblock_address_space.end;
 
-    osDecommitMemory(addr, size);
+    // In each case below we decommit once we know the extent of the free
+    // region that [address, address+size) has become part of.
+    // See Note [Huge page backed heap].
 
     prev = NULL;
     for (iter = free_list_head; iter != NULL; iter = iter->next)
@@ -240,6 +559,7 @@ static void decommitMBlocks(char *addr, uint32_t n)
             iter->size += size;
 
             if (address + size == mblock_high_watermark) {
+                decommit_granules_in(address, size, iter->address, end);
                 mblock_high_watermark -= iter->size;
                 if (iter->prev) {
                     iter->prev->next = NULL;
@@ -268,10 +588,14 @@ static void decommitMBlocks(char *addr, uint32_t n)
 
                 stgFree(next);
             }
+            decommit_granules_in(address, size, iter->address,
+                                 iter->address + iter->size);
             return;
         } else if (address + size == iter->address) {
             iter->address = address;
             iter->size += size;
+            decommit_granules_in(address, size, iter->address,
+                                 iter->address + iter->size);
 
             /* We don't need to consolidate backwards
                (because otherwise it would have been handled by
@@ -286,6 +610,8 @@ static void decommitMBlocks(char *addr, uint32_t n)
             /* All other cases have been handled */
             ASSERT(iter->address > address + size);
 
+            decommit_granules_in(address, size, address, address + size);
+
             new_iter = stgMallocBytes(sizeof(struct free_list), "freeMBlocks");
             new_iter->address = address;
             new_iter->size = size;
@@ -309,10 +635,13 @@ static void decommitMBlocks(char *addr, uint32_t n)
 
     /* Fast path the case of releasing high or all memory */
     if (address + size == mblock_high_watermark) {
+        decommit_granules_in(address, size, address, end);
         mblock_high_watermark -= size;
     } else {
         struct free_list *new_iter;
 
+        decommit_granules_in(address, size, address, address + size);
+
         new_iter = stgMallocBytes(sizeof(struct free_list), "freeMBlocks");
         new_iter->address = address;
         new_iter->size = size;
@@ -622,6 +951,10 @@ freeAllMBlocks(void)
     debugTrace(DEBUG_gc, "freeing all megablocks");
 
 #if defined(USE_LARGE_ADDRESS_SPACE)
+#if defined(THREADED_RTS)
+    stopDecommitThread();
+#endif
+
     {
         struct free_list *iter, *next;
 
@@ -665,6 +998,12 @@ initMBlocks(void)
         }
         void *addr = osReserveHeapMemory(startAddress, &RtsFlags.GcFlags.addressSpaceSize);
 
+        // See Note [Huge page backed heap]
+        if (RtsFlags.GcFlags.hugePages && osHugePageSize() > MBLOCK_SIZE) {
+            mblock_commit_granularity = osHugePageSize();
+            RtsFlags.GcFlags.addressSpaceSize &= ~(mblock_commit_granularity - 1);
+        }
+
         mblock_address_space.begin = (W_)addr;
         mblock_address_space.end = (W_)addr + RtsFlags.GcFlags.addressSpaceSize;
         mblock_high_watermark = (W_)addr;
@@ -24,6 +24,9 @@
 #include "Weak.h"
 #include "Storage.h"
 #include "Threads.h"
+#include "Stats.h"
+#include "Hash.h"
+#include "RtsUtils.h"
 
 #include "sm/GCUtils.h"
 #include "sm/MarkWeak.h"
@@ -77,8 +80,10 @@
 typedef enum { WeakPtrs, WeakThreads, WeakDone } WeakStage;
 static WeakStage weak_stage;
 
-static void    collectDeadWeakPtrs (generation *gen, StgWeak **dead_weak_ptr_list);
+static void    collectDeadWeakPtrs (StgWeak *list, StgWeak **dead_weak_ptr_list);
 static bool tidyWeakList (generation *gen);
+static bool tidyIndexedWeaks (void);
+static StgWeak *takeIndexedWeaks (void);
 static bool resurrectUnreachableThreads (generation *gen, StgTSO **resurrected_threads);
 static void    tidyThreadList (generation *gen);
 
@@ -106,6 +111,48 @@ static void    tidyThreadList (generation *gen);
  *
  */
 
+/*
+ * Note [Indexing weak pointers by key block]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * Each round of traverseWeakPtrList used to call isAlive on the key of every
+ * weak pointer still on the old_weak_ptr_lists, so a program with a million
+ * Weak#s and a long chain of weak pointers keyed on each other's values paid
+ * a million key checks per link of the chain.
+ *
+ * Instead, the first time tidyWeakList finds that the key of a weak pointer
+ * is unreachable it moves the weak off the generation's list and into
+ * weak_key_index, a hash table from the block descriptor of the key to a
+ * chain of all such weaks (linked through their link fields), and sets
+ * BF_WEAK_KEYS on the key's block.  evacuate() checks for that flag on its
+ * existing slow path for unusual blocks: the first GC thread to copy an object
+ * out of such a block clears the flag and records the block in its
+ * weak_key_blocks array (noteWeakKeyBlock).  The next round then only checks
+ * the weaks of the recorded blocks (tidyIndexedWeaks), and sets the flag again
+ * on any block that still holds unreachable keys.
+ *
+ * This relies on every key becoming reachable by a call to evacuate() on a
+ * pointer into the key's block, so only keys that are ordinary objects in
+ * ordinary from-space blocks are indexed.  Keys in static, large, pinned,
+ * compact, compacting (BF_MARKED) or non-moving memory, and keys that are
+ * indirections, blackholes or selector thunks, which isAlive looks through or
+ * the GC may short-cut without evacuating them, stay on old_weak_ptr_list and
+ * are checked every round as before.
+ *
+ * When the fixpoint is reached the weaks left in the index are dead;
+ * takeIndexedWeaks clears the flags and hands them to collectDeadWeakPtrs.
+ * The weak pointers themselves have already been evacuated by
+ * markWeakPtrList, so the link fields of the chains stay valid throughout.
+ *
+ * The time spent in the whole weak pointer fixpoint (including the scavenging
+ * it causes) and in traverseWeakPtrList itself is reported by +RTS -s, see
+ * getWeakPtrStats.
+ */
+
+// See Note [Indexing weak pointers by key block]
+static HashTable *weak_key_index = NULL;
+
+static WeakPtrStats weak_ptr_stats;
+
 /*
  * Prepare the weak object lists for GC. Specifically, reset weak_stage
  * and move all generations' `weak_ptr_list`s to `old_weak_ptr_list`.
@@ -127,6 +174,11 @@ initWeakForGC(void)
         gen->weak_ptr_list = NULL;
     }
 
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        gc_threads[i]->n_weak_key_blocks = 0;
+    }
+    ASSERT(weak_key_index == NULL);
+
     weak_stage = WeakThreads;
 }
 
@@ -138,8 +190,8 @@ initWeakForGC(void)
  * Returns true if new live weak pointers were found, implying that another
  * round of scavenging is necessary.
  */
-bool
-traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
+static bool
+traverseWeakPtrList_(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
 {
   bool flag = false;
 
@@ -167,6 +219,9 @@ traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
               flag = true;
           }
       }
+      if (tidyIndexedWeaks()) {
+          flag = true;
+      }
 
       // if we evacuated anything new, we must scavenge thoroughly
       // before we can determine which threads are unreachable.
@@ -202,14 +257,19 @@ traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
               flag = true;
           }
       }
+      if (tidyIndexedWeaks()) {
+          flag = true;
+      }
 
       /* If we didn't make any changes, then we can go round and kill all
        * the dead weak pointers.  The dead_weak_ptr list is used as a list
        * of pending finalizers later on.
        */
       if (flag == false) {
+          collectDeadWeakPtrs(takeIndexedWeaks(), dead_weak_ptr_list);
           for (g = 0; g <= N; g++) {
-              collectDeadWeakPtrs(&generations[g], dead_weak_ptr_list);
+              collectDeadWeakPtrs(generations[g].old_weak_ptr_list,
+                                  dead_weak_ptr_list);
           }
 
           weak_stage = WeakDone;  // *now* we're done,
@@ -224,15 +284,42 @@ traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
   }
 }
 
+bool
+traverseWeakPtrList(StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads)
+{
+    Time start = stat_getElapsedTime();
+    bool flag = traverseWeakPtrList_(dead_weak_ptr_list, resurrected_threads);
+    weak_ptr_stats.rounds++;
+    weak_ptr_stats.tidy_time += stat_getElapsedTime() - start;
+    return flag;
+}
+
+/*
+ * Called by GarbageCollect once traverseWeakPtrList has returned false, with
+ * the time taken by the whole weak pointer fixpoint.
+ */
+void
+weakPtrFixpointDone(Time elapsed)
+{
+    ASSERT(weak_key_index == NULL);
+    weak_ptr_stats.time += elapsed;
+}
+
+void
+getWeakPtrStats(WeakPtrStats *stats)
+{
+    *stats = weak_ptr_stats;
+}
+
 /*
  * Deal with weak pointers with unreachable keys after GC has concluded.
  * This means marking the finalizer (and possibly value) in preparation for
  * later finalization.
  */
-static void collectDeadWeakPtrs (generation *gen, StgWeak **dead_weak_ptr_list)
+static void collectDeadWeakPtrs (StgWeak *list, StgWeak **dead_weak_ptr_list)
 {
     StgWeak *w, *next_w;
-    for (w = gen->old_weak_ptr_list; w != NULL; w = next_w) {
+    for (w = list; w != NULL; w = next_w) {
         // If we have C finalizers, keep the value alive for this GC.
         // See Note [MallocPtr finalizers] in GHC.ForeignPtr, and #10904
         if (w->cfinalizers != &stg_NO_FINALIZER_closure) {
@@ -286,12 +373,103 @@ static bool resurrectUnreachableThreads (generation *gen, StgTSO **resurrected_t
     return flag;
 }
 
+/*
+ * A weak pointer's key has been found to be reachable (at its new address
+ * key): mark the weak's value and finalizer and put it on the weak_ptr_list
+ * of the generation it lives in.
+ */
+static void tidyLiveWeak (StgWeak *w, StgClosure *key)
+{
+    generation *new_gen;
+
+    w->key = key;
+
+    // Find out which generation this weak ptr is in, and
+    // move it onto the weak ptr list of that generation.
+
+    new_gen = Bdescr((P_)w)->gen;
+    gct->evac_gen_no = new_gen->no;
+    gct->failed_to_evac = false;
+
+    // evacuate the fields of the weak ptr
+    scavengeLiveWeak(w);
+
+    if (gct->failed_to_evac) {
+        debugTrace(DEBUG_weak,
+                   "putting weak pointer %p into mutable list",
+                   w);
+        gct->failed_to_evac = false;
+        recordMutableGen_GC((StgClosure *)w, new_gen->no);
+    }
+
+    // put it on the correct weak ptr list.
+    w->link = new_gen->weak_ptr_list;
+    new_gen->weak_ptr_list = w;
+
+    debugTrace(DEBUG_weak,
+               "weak pointer still alive at %p -> %p",
+               w, w->key);
+}
+
+/*
+ * Can the liveness of this unreachable key be left to evacuate() to report?
+ * See Note [Indexing weak pointers by key block].
+ */
+static bool weakKeyIndexable (StgClosure *key)
+{
+    StgClosure *q = UNTAG_CLOSURE(key);
+
+    if (!HEAP_ALLOCED_GC(q)) {
+        return false;
+    }
+    if (Bdescr((P_)q)->flags & (BF_LARGE | BF_PINNED | BF_MARKED | BF_EVACUATED
+                                | BF_COMPACT | BF_NONMOVING)) {
+        return false;
+    }
+
+    switch (get_itbl(q)->type) {
+    case IND:
+    case BLACKHOLE:
+    case WHITEHOLE:
+    case THUNK_SELECTOR:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Add a weak pointer with an unreachable key to weak_key_index.
+ */
+static void indexWeak (StgWeak *w)
+{
+    bdescr *bd = Bdescr((P_)UNTAG_CLOSURE(w->key));
+    StgWeak *head;
+
+    if (weak_key_index == NULL) {
+        weak_key_index = allocOpenHashTable();
+    }
+
+    head = lookupHashTable(weak_key_index, (StgWord)bd);
+    if (head == NULL) {
+        w->link = NULL;
+        insertHashTable(weak_key_index, (StgWord)bd, w);
+        bd->flags |= BF_WEAK_KEYS;
+    } else {
+        w->link = head->link;
+        head->link = w;
+    }
+    weak_ptr_stats.indexed++;
+}
+
 /*
  * Walk over the `old_weak_ptr_list` of the given generation and:
  *
  *  - remove any DEAD_WEAKs
  *  - move any weaks with reachable keys to the `weak_ptr_list` of the
  *    appropriate to-space and mark the weak's value and finalizer.
+ *  - move the weaks whose keys are unreachable to weak_key_index where
+ *    possible, see Note [Indexing weak pointers by key block].
  */
 static bool tidyWeakList(generation *gen)
 {
@@ -329,49 +507,27 @@ static bool tidyWeakList(generation *gen)
         case WEAK:
             /* Now, check whether the key is reachable.
              */
+            weak_ptr_stats.key_checks++;
             new = isAlive(w->key);
             if (new != NULL) {
-                generation *new_gen;
-
-                w->key = new;
-
-                // Find out which generation this weak ptr is in, and
-                // move it onto the weak ptr list of that generation.
-
-                new_gen = Bdescr((P_)w)->gen;
-                gct->evac_gen_no = new_gen->no;
-                gct->failed_to_evac = false;
-
-                // evacuate the fields of the weak ptr
-                scavengeLiveWeak(w);
-
-                if (gct->failed_to_evac) {
-                    debugTrace(DEBUG_weak,
-                               "putting weak pointer %p into mutable list",
-                               w);
-                    gct->failed_to_evac = false;
-                    recordMutableGen_GC((StgClosure *)w, new_gen->no);
-                }
-
                 // remove this weak ptr from the old_weak_ptr list
                 *last_w = w->link;
                 next_w  = w->link;
 
-                // and put it on the correct weak ptr list.
-                w->link = new_gen->weak_ptr_list;
-                new_gen->weak_ptr_list = w;
-                flag = true;
-
-                if (gen->no != new_gen->no) {
+                if (gen->no != Bdescr((P_)w)->gen_no) {
                     debugTrace(DEBUG_weak,
                       "moving weak pointer %p from %d to %d",
-                      w, gen->no, new_gen->no);
+                      w, gen->no, Bdescr((P_)w)->gen_no);
                 }
 
-
-                debugTrace(DEBUG_weak,
-                           "weak pointer still alive at %p -> %p",
-                           w, w->key);
+                tidyLiveWeak(w, new);
+                flag = true;
+                continue;
+            }
+            else if (weakKeyIndexable(w->key)) {
+                *last_w = w->link;
+                next_w  = w->link;
+                indexWeak(w);
                 continue;
             }
             else {
@@ -388,6 +544,118 @@ static bool tidyWeakList(generation *gen)
     return flag;
 }
 
+/*
+ * Record that an object has been evacuated from a block holding the keys of
+ * weak pointers in weak_key_index.  Called by evacuate(), possibly by several
+ * GC threads at once, so only the thread that clears BF_WEAK_KEYS records
+ * the block.
+ */
+void noteWeakKeyBlock (bdescr *bd)
+{
+    uint16_t old = __atomic_fetch_and(&bd->flags, (uint16_t)~BF_WEAK_KEYS,
+                                      __ATOMIC_RELAXED);
+    if (!(old & BF_WEAK_KEYS)) {
+        return;
+    }
+
+    if (gct->n_weak_key_blocks == gct->weak_key_blocks_size) {
+        gct->weak_key_blocks_size =
+            gct->weak_key_blocks_size == 0 ? 64 : gct->weak_key_blocks_size * 2;
+        gct->weak_key_blocks =
+            stgReallocBytes(gct->weak_key_blocks,
+                            gct->weak_key_blocks_size * sizeof(bdescr *),
+                            "noteWeakKeyBlock");
+    }
+    gct->weak_key_blocks[gct->n_weak_key_blocks++] = bd;
+}
+
+/*
+ * Check the keys of the weak pointers in weak_key_index whose blocks have
+ * been recorded by noteWeakKeyBlock since the last round, treating the ones
+ * that are now reachable as tidyWeakList does.  Evacuating their fields may
+ * record more blocks, so carry on until no thread has any left.
+ */
+static bool tidyIndexedWeaks (void)
+{
+    bool flag = false;
+    bool again;
+
+    if (weak_key_index == NULL) {
+        return false;
+    }
+
+    do {
+        again = false;
+        for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+            gc_thread *t = gc_threads[i];
+            while (t->n_weak_key_blocks > 0) {
+                bdescr *bd = t->weak_key_blocks[--t->n_weak_key_blocks];
+                StgWeak *w, *next_w, *dead = NULL;
+
+                again = true;
+                // the block may have been recorded more than once
+                w = removeHashTable(weak_key_index, (StgWord)bd, NULL);
+                for (; w != NULL; w = next_w) {
+                    StgClosure *new;
+
+                    next_w = w->link;
+                    weak_ptr_stats.key_checks++;
+                    new = isAlive(w->key);
+                    if (new != NULL) {
+                        tidyLiveWeak(w, new);
+                        flag = true;
+                    } else {
+                        w->link = dead;
+                        dead = w;
+                    }
+                }
+
+                if (dead != NULL) {
+                    insertHashTable(weak_key_index, (StgWord)bd, dead);
+                    bd->flags |= BF_WEAK_KEYS;
+                }
+            }
+        }
+    } while (again);
+
+    return flag;
+}
+
+static void takeIndexedWeak (void *data, StgWord key, const void *value)
+{
+    StgWeak **list = (StgWeak **)data;
+    StgWeak *w = (StgWeak *)value;
+    bdescr *bd = (bdescr *)key;
+
+    bd->flags &= ~BF_WEAK_KEYS;
+    while (w->link != NULL) {
+        w = w->link;
+    }
+    w->link = *list;
+    *list = (StgWeak *)value;
+}
+
+/*
+ * Empty weak_key_index once the weak pointers left in it are known to be
+ * dead, returning them as a list.
+ */
+static StgWeak *takeIndexedWeaks (void)
+{
+    StgWeak *list = NULL;
+
+    if (weak_key_index != NULL) {
+        mapHashTable(weak_key_index, &list, takeIndexedWeak);
+        freeHashTable(weak_key_index, NULL);
+        weak_key_index = NULL;
+    }
+
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        gc_threads[i]->n_weak_key_blocks = 0;
+    }
+
+    return list;
+}
+
 /*
  * Walk over the given generation's thread list and promote TSOs which are
  * reachable via the heap. This will move the TSO from gen->old_threads to
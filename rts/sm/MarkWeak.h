@@ -22,5 +22,18 @@ void    initWeakForGC          ( void );
 bool    traverseWeakPtrList    ( StgWeak **dead_weak_ptr_list, StgTSO **resurrected_threads );
 void    markWeakPtrList        ( void );
 void    scavengeLiveWeak       ( StgWeak * );
+void    noteWeakKeyBlock       ( bdescr *bd );
+void    weakPtrFixpointDone    ( Time elapsed );
+
+typedef struct {
+    StgWord rounds;           // calls to traverseWeakPtrList
+    StgWord key_checks;       // weak keys checked by isAlive
+    StgWord indexed;          // weaks moved to the key block index
+    Time tidy_time;           // in traverseWeakPtrList
+    Time time;                // in the weak pointer fixpoint, scavenging
+                              // included
+} WeakPtrStats;
+
+void    getWeakPtrStats        ( WeakPtrStats *stats );
 
 #include "EndPrivate.h"
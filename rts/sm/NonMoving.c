@@ -21,9 +21,12 @@
 #include "Stats.h"
 
 #include "NonMoving.h"
+#include "NonMovingAllocate.h"
 #include "NonMovingMark.h"
 #include "NonMovingSweep.h"
 #include "NonMovingCensus.h"
+#include "NonMovingEvac.h"
+#include "NonMovingSizeClasses.h"
 #include "StablePtr.h" // markStablePtrTable
 #include "Sanity.h"
 #include "Weak.h" // scheduleFinalizers
@@ -35,6 +38,7 @@ struct NonmovingHeap nonmovingHeap;
 uint8_t nonmovingMarkEpoch = 1;
 uint8_t nonmoving_alloca_dense_cnt;
 uint8_t nonmoving_alloca_cnt;
+uint8_t nonmoving_alloca_for_words[NONMOVING_SEGMENT_SIZE_W];
 
 static void nonmovingBumpEpoch(void) {
     nonmovingMarkEpoch = nonmovingMarkEpoch == 1 ? 2 : 1;
@@ -560,6 +564,13 @@ static void nonmovingBumpEpoch(void) {
  * blocks up to a power of 2. This places an upper bound on the waste at half the
  * required block size.
  *
+ * The allocator serving each object size is looked up in
+ * nonmoving_alloca_for_words, which nonmovingInitSizeTable fills with the
+ * allocator of the smallest block size that fits. With
+ * --nonmoving-profile-size-classes further allocators are appended where the
+ * program's object sizes fall in the gaps between the sparse allocators; see
+ * Note [Profiled size classes] in NonMovingSizeClasses.c.
+ *
  * See #23340
  *
  * Note [Segment allocation strategy]
@@ -585,6 +596,10 @@ memcount nonmoving_segment_live_words = 0;
 // See Note [Sync phase marking budget].
 MarkBudget sync_phase_marking_budget = 200000;
 
+// How many update remembered set handshakes may precede a sync.
+// See Note [Update remembered set handshake] in NonMovingMark.c.
+#define NONMOVING_MAX_HANDSHAKES 4
+
 static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO **resurrected_threads, bool concurrent);
 static void nonmovingInitAllocator(struct NonmovingAllocator* alloc, uint16_t block_size);
 static void nonmovingInitAllocators(void);
@@ -592,6 +607,8 @@ static void nonmovingInitAllocators(void);
 static void nonmovingInitConcurrentWorker(void);
 static void nonmovingStartConcurrentMark(MarkQueue *roots);
 static void nonmovingExitConcurrentWorker(void);
+static void nonmovingInitHelpers(void);
+static void nonmovingExitHelpers(void);
 
 // Add a segment to the free list.
 void nonmovingPushFreeSegment(struct NonmovingSegment *seg)
@@ -698,6 +715,7 @@ void nonmovingPruneFreeSegmentList(void)
     }
   }
   size_t pruned_segments = length - new_length;
+  __sync_sub_and_fetch(&nonmovingHeap.n_segments, pruned_segments);
   // See Note [Live data accounting in nonmoving collector].
   oldest_gen->n_blocks -= pruned_segments * NONMOVING_SEGMENT_BLOCKS;
   oldest_gen->n_words  -= pruned_segments * NONMOVING_SEGMENT_SIZE;
@@ -739,6 +757,41 @@ void nonmovingInitAllocators(void)
       uint16_t block_size = 1 << (i + first_sparse_allocator - nonmoving_alloca_dense_cnt);
       nonmovingInitAllocator(&nonmovingHeap.allocators[i], block_size);
     }
+    nonmovingInitSizeTable();
+}
+
+// Map each object size to the allocator with the smallest block that fits.
+void nonmovingInitSizeTable(void)
+{
+    for (StgWord sz = 0; sz < NONMOVING_SEGMENT_SIZE_W; sz++) {
+      uint8_t best = 0;
+      for (uint8_t i = 0; i < nonmoving_alloca_cnt; i++) {
+        const uint16_t block_size = nonmovingHeap.allocators[i].block_size;
+        const uint16_t best_size = nonmovingHeap.allocators[best].block_size;
+        if (block_size >= sz * sizeof(StgWord)
+            && (best_size < sz * sizeof(StgWord) || block_size < best_size)) {
+          best = i;
+        }
+      }
+      nonmoving_alloca_for_words[sz] = best;
+    }
+}
+
+void nonmovingAddAllocator(uint16_t block_size)
+{
+    ASSERT(nonmoving_alloca_cnt < UINT8_MAX);
+    const uint8_t idx = nonmoving_alloca_cnt;
+    nonmovingHeap.allocators =
+        stgReallocBytes(nonmovingHeap.allocators,
+                        sizeof(struct NonmovingAllocator) * (idx + 1),
+                        "nonmovingAddAllocator");
+    nonmovingInitAllocator(&nonmovingHeap.allocators[idx], block_size);
+    nonmoving_alloca_cnt = idx + 1;
+
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+      nonmovingGrowCapability(getCapability(i), idx);
+    }
+    nonmovingInitSizeTable();
 }
 
 
@@ -747,6 +800,7 @@ void nonmovingInit(void)
     if (! RtsFlags.GcFlags.useNonmoving) return;
     nonmovingInitAllocators();
     nonmovingInitConcurrentWorker();
+    nonmovingInitHelpers();
     nonmovingMarkInit();
 }
 
@@ -754,6 +808,8 @@ void nonmovingExit(void)
 {
     if (! RtsFlags.GcFlags.useNonmoving) return;
     nonmovingExitConcurrentWorker();
+    nonmovingExitHelpers();
+    nonmovingMarkExit();
 }
 
 /* Prepare the heap bitmaps and snapshot metadata for a mark */
@@ -855,6 +911,9 @@ void nonmovingCollect(StgWeak **dead_weaks, StgTSO **resurrected_threads, bool c
     trace(TRACE_nonmoving_gc, "Starting nonmoving GC preparation");
     resizeGenerations();
 
+    // See Note [Profiled size classes]
+    nonmovingAdaptSizeClasses();
+
     nonmovingPrepareMark();
 
     // N.B. These should have been cleared at the end of the last sweep.
@@ -946,9 +1005,19 @@ void nonmovingCollect(StgWeak **dead_weaks, StgTSO **resurrected_threads, bool c
         concurrent = false;
     }
 
+    // See Note [Nonmoving evacuation]
+    const bool evacuate = nonmovingEvacuationDue();
+    if (evacuate) {
+        concurrent = false;
+    }
+
     if (concurrent) {
         nonmovingStartConcurrentMark(mark_queue);
     } else {
+        if (evacuate) {
+            nonmovingStartEvacuation(gct->cap);
+        }
+
         RELEASE_SM_LOCK;
 
         // Use the weak and thread lists from the preparation for any new weaks and
@@ -982,6 +1051,156 @@ static bool nonmovingMarkThreadsWeaks(MarkBudget *budget, MarkQueue *mark_queue)
     }
 }
 
+/* Note [Nonmoving GC helper threads]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * The concurrent mark thread can share the mark and the sweep with a pool of
+ * helper threads: --nonmoving-mark-threads=<n> and
+ * --nonmoving-sweep-threads=<n> give the number of threads, counting the mark
+ * thread, for each. The pool is started along with the mark thread and has
+ * as many helpers as the larger of the two flags asks for, less one.
+ *
+ * The mark thread hands work to the pool with nonmovingRunOnHelpers(job, n),
+ * which runs job(0) on the calling thread and job(i) on helpers 1 to n-1, and
+ * returns once all of them are done; helpers numbered n or above sit the job
+ * out. How the work is shared is up to the job, see
+ * Note [Parallel nonmoving mark] in NonMovingMark.c and
+ * Note [Parallel nonmoving sweep] in NonMovingSweep.c.
+ */
+
+// The number of helper threads; always 0 in the non-threaded RTS
+uint32_t n_nonmoving_helpers = 0;
+
+#if defined(THREADED_RTS)
+
+static OSThreadId *nonmoving_helpers;
+
+// Protects the fields below
+static Mutex helpers_lock;
+static Condition helpers_start_cond;
+static Condition helpers_done_cond;
+static void (*helpers_job)(uint32_t worker);
+static uint32_t helpers_job_workers; // workers taking part in helpers_job
+static StgWord helpers_job_no;       // bumped for every job
+static uint32_t helpers_busy;        // helpers yet to finish the current job
+static bool stop_helpers;
+
+static void* nonmovingHelper(void *data)
+{
+    const uint32_t worker = (uint32_t) (StgWord) data;
+    StgWord last_job_no = 0;
+
+    ACQUIRE_LOCK(&helpers_lock);
+    while (true) {
+        while (helpers_job_no == last_job_no && !stop_helpers) {
+            waitCondition(&helpers_start_cond, &helpers_lock);
+        }
+        if (stop_helpers) {
+            RELEASE_LOCK(&helpers_lock);
+            return NULL;
+        }
+
+        last_job_no = helpers_job_no;
+        void (*job)(uint32_t) = helpers_job;
+        const bool take_part = worker < helpers_job_workers;
+        RELEASE_LOCK(&helpers_lock);
+
+        if (take_part) {
+            job(worker);
+        }
+
+        ACQUIRE_LOCK(&helpers_lock);
+        if (--helpers_busy == 0) {
+            signalCondition(&helpers_done_cond);
+        }
+    }
+}
+
+static void nonmovingInitHelpers(void)
+{
+    n_nonmoving_helpers = stg_max(RtsFlags.GcFlags.nonmovingMarkThreads,
+                                  RtsFlags.GcFlags.nonmovingSweepThreads) - 1;
+    if (n_nonmoving_helpers == 0) {
+        return;
+    }
+
+    debugTrace(DEBUG_nonmoving_gc, "Starting %" FMT_Word32 " helper threads",
+               n_nonmoving_helpers);
+    initMutex(&helpers_lock);
+    initCondition(&helpers_start_cond);
+    initCondition(&helpers_done_cond);
+    helpers_job = NULL;
+    helpers_job_workers = 0;
+    helpers_job_no = 0;
+    helpers_busy = 0;
+    stop_helpers = false;
+
+    nonmoving_helpers = stgMallocBytes(n_nonmoving_helpers * sizeof(OSThreadId),
+                                       "nonmovingInitHelpers");
+    for (uint32_t i = 0; i < n_nonmoving_helpers; i++) {
+        if (createOSThread(&nonmoving_helpers[i], "nonmoving-helper",
+                           nonmovingHelper, (void *) (StgWord) (i + 1)) != 0) {
+            barf("nonmovingInitHelpers: failed to spawn helper thread: %s",
+                 strerror(errno));
+        }
+    }
+}
+
+static void nonmovingExitHelpers(void)
+{
+    if (n_nonmoving_helpers == 0) {
+        return;
+    }
+
+    ACQUIRE_LOCK(&helpers_lock);
+    stop_helpers = true;
+    broadcastCondition(&helpers_start_cond);
+    RELEASE_LOCK(&helpers_lock);
+
+    for (uint32_t i = 0; i < n_nonmoving_helpers; i++) {
+        joinOSThread(nonmoving_helpers[i]);
+    }
+    stgFree(nonmoving_helpers);
+    n_nonmoving_helpers = 0;
+
+    closeMutex(&helpers_lock);
+    closeCondition(&helpers_start_cond);
+    closeCondition(&helpers_done_cond);
+}
+
+void nonmovingRunOnHelpers(void (*job)(uint32_t worker), uint32_t n)
+{
+    ASSERT(n >= 1 && n <= n_nonmoving_helpers + 1);
+
+    ACQUIRE_LOCK(&helpers_lock);
+    helpers_job = job;
+    helpers_job_workers = n;
+    helpers_job_no++;
+    helpers_busy = n_nonmoving_helpers;
+    broadcastCondition(&helpers_start_cond);
+    RELEASE_LOCK(&helpers_lock);
+
+    job(0);
+
+    ACQUIRE_LOCK(&helpers_lock);
+    while (helpers_busy > 0) {
+        waitCondition(&helpers_done_cond, &helpers_lock);
+    }
+    RELEASE_LOCK(&helpers_lock);
+}
+
+#else
+
+static void nonmovingInitHelpers(void) {}
+static void nonmovingExitHelpers(void) {}
+
+void nonmovingRunOnHelpers(void (*job)(uint32_t worker), uint32_t n STG_UNUSED)
+{
+    ASSERT(n == 1);
+    job(0);
+}
+
+#endif
+
 #if !defined(THREADED_RTS)
 
 static void nonmovingInitConcurrentWorker(void) {}
@@ -1179,6 +1398,7 @@ static void nonmovingMark_(MarkQueue *mark_queue, StgWeak **dead_weaks, StgTSO *
 
     // Do concurrent marking; most of the heap will get marked here.
 #if defined(THREADED_RTS)
+    uint32_t handshakes = 0;
 concurrent_marking:
 #endif
     {
@@ -1202,6 +1422,16 @@ concurrent_marking:
             goto finish;
         }
 
+        // Collect what the mutators remembered without stopping them first,
+        // as long as there is much of it.
+        // See Note [Update remembered set handshake] in NonMovingMark.c.
+        if (handshakes < NONMOVING_MAX_HANDSHAKES) {
+            handshakes++;
+            if (nonmovingHandshake(myTask())) {
+                goto concurrent_marking;
+            }
+        }
+
         // We're still running, request a sync
         nonmovingBeginFlush(myTask());
 
@@ -1215,6 +1445,7 @@ concurrent_marking:
                 traceConcSyncEnd();
                 stat_endNonmovingGcSync();
                 releaseAllCapabilities(n_capabilities, NULL, myTask());
+                handshakes = 0;
                 goto concurrent_marking;
             }
         } while (!all_caps_syncd);
@@ -1308,14 +1539,19 @@ concurrent_marking:
     nonmoving_large_words = countOccupied(nonmoving_marked_large_objects);
     nonmoving_compact_words = n_nonmoving_marked_compact_blocks * BLOCK_SIZE_W;
     oldest_gen->live_estimate = nonmoving_segment_live_words + nonmoving_large_words + nonmoving_compact_words;
+    nonmovingMarkTunePrefetch(nonmoving_segment_live_words);
     oldest_gen->n_old_blocks = 0;
     resizeGenerations();
 
+    // See Note [Nonmoving evacuation]
+    nonmovingFinishEvacuation();
+
     /****************************************************
      * Sweep
      ****************************************************/
 
     traceConcSweepBegin();
+    perfPhaseStart(PERF_NONMOVING_SWEEP);
 
     // Because we can't mark large object blocks (no room for mark bit) we
     // collect them in a map in mark_queue and we pass it here to sweep large
@@ -1328,6 +1564,7 @@ concurrent_marking:
     nonmovingPruneFreeSegmentList();
     ASSERT(nonmovingHeap.sweep_list == NULL);
     debugTrace(DEBUG_nonmoving_gc, "Finished sweeping.");
+    perfPhaseEnd(PERF_NONMOVING_SWEEP);
     traceConcSweepEnd();
 #if defined(DEBUG)
     if (RtsFlags.DebugFlags.nonmoving_gc)
@@ -1338,11 +1575,13 @@ concurrent_marking:
     if (RtsFlags.TraceFlags.nonmoving_gc)
         nonmovingTraceAllocatorCensus();
 #endif
+    // See Note [Streaming statistics] in Stats.c
+    stat_nonmovingCensusStatsStream();
 
 #if defined(NONCONCURRENT_SWEEP)
 #if defined(DEBUG)
     checkNonmovingHeap(&nonmovingHeap);
-    checkSanity(true, true);
+    checkSanity(true, true, false);
 #endif
     if (concurrent) {
         nonmoving_write_barrier_enabled = false;
@@ -1370,7 +1609,8 @@ void assert_in_nonmoving_heap(StgPtr p)
     if (bd->flags & BF_LARGE) {
         // It should be in a capability (if it's not filled yet) or in non-moving heap
         for (uint32_t cap = 0; cap < getNumCapabilities(); ++cap) {
-            if (bd == getCapability(cap)->pinned_object_block) {
+            if (bd == getCapability(cap)->pinned_object_block
+                || bd == getCapability(cap)->pinned_ephemeral_block) {
                 return;
             }
         }
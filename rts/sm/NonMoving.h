@@ -63,6 +63,9 @@ struct NonmovingSegment {
     struct NonmovingSegment *link;      // for linking together segments into lists
     struct NonmovingSegment *todo_link; // NULL when not in todo list
     nonmoving_block_idx next_free;      // index of the next unallocated block
+    nonmoving_block_idx free_run_end;   // end of the free blocks from next_free,
+                                        // current segments only
+                                        // (see Note [Free runs])
 #if defined(TRACK_SEGMENT_STATE)
     enum NonmovingSegmentState state;
 #endif
@@ -124,6 +127,11 @@ extern uint8_t nonmoving_alloca_dense_cnt;
 // NONMOVING_SEGMENT_SIZE (in bytes)
 extern uint8_t nonmoving_alloca_cnt;
 
+// the allocator serving objects of each size (in words), that is the one
+// with the smallest block size that fits them. Allocators aren't ordered by
+// size once size classes have been added, see Note [Profiled size classes].
+extern uint8_t nonmoving_alloca_for_words[NONMOVING_SEGMENT_SIZE_W];
+
 struct NonmovingHeap {
     struct NonmovingAllocator *allocators;
     // free segment list. This is a cache where we keep segments
@@ -136,6 +144,8 @@ struct NonmovingHeap {
     struct NonmovingSegment *saved_free;
     // how many segments in free segment list? accessed atomically.
     unsigned int n_free;
+    // how many segments in all, free or not? accessed atomically.
+    unsigned int n_segments;
 
     // records the current length of the nonmovingAllocator.current arrays
     unsigned int n_caps;
@@ -151,6 +161,10 @@ extern struct NonmovingHeap nonmovingHeap;
 
 extern memcount nonmoving_segment_live_words;
 
+// See Note [Nonmoving GC helper threads]
+extern uint32_t n_nonmoving_helpers;
+void nonmovingRunOnHelpers(void (*job)(uint32_t worker), uint32_t n);
+
 void nonmovingInit(void);
 void nonmovingExit(void);
 bool nonmovingConcurrentMarkIsRunning(void);
@@ -179,6 +193,11 @@ void nonmovingCollect(StgWeak **dead_weaks,
 void nonmovingPushFreeSegment(struct NonmovingSegment *seg);
 void nonmovingPruneFreeSegmentList(void);
 
+// Add an allocator of the given block size. All capabilities must be stopped
+// and the concurrent mark not running. See Note [Profiled size classes].
+void nonmovingAddAllocator(uint16_t block_size);
+void nonmovingInitSizeTable(void);
+
 INLINE_HEADER unsigned long log2_ceil(unsigned long x)
 {
     return (sizeof(unsigned long)*8) - __builtin_clzl(x-1);
@@ -193,18 +212,12 @@ INLINE_HEADER struct NonmovingAllocator nonmovingSegmentAllocator(struct Nonmovi
     return nonmovingHeap.allocators[nonmovingSegmentInfo(seg)->allocator_idx];
 }
 
-// Determine the index of the allocator for blocks of a certain size
-INLINE_HEADER uint8_t nonmovingAllocatorForSize(uint16_t block_size){
-   if (block_size - NONMOVING_ALLOCA0 < nonmoving_alloca_dense_cnt * (uint16_t) sizeof(StgWord)) {
-       // dense case
-       return (block_size  - NONMOVING_ALLOCA0) / sizeof(StgWord);
-   }
-   else {
-       // sparse case
-       return log2_ceil(block_size)
-              - log2_ceil(NONMOVING_ALLOCA0 + sizeof(StgWord) * nonmoving_alloca_dense_cnt)
-              + nonmoving_alloca_dense_cnt;
-    }
+// Determine the index of the allocator for objects of a certain size (in
+// words). See Note [Allocator sizes].
+INLINE_HEADER uint8_t nonmovingAllocatorForWords(StgWord sz)
+{
+    ASSERT(sz < NONMOVING_SEGMENT_SIZE_W);
+    return nonmoving_alloca_for_words[sz];
 }
 
 // The block size of a given segment in bytes.
@@ -216,7 +229,7 @@ INLINE_HEADER unsigned int nonmovingSegmentBlockSize(struct NonmovingSegment *se
 // Add a segment to the appropriate active list.
 INLINE_HEADER void nonmovingPushActiveSegment(struct NonmovingSegment *seg)
 {
-    struct NonmovingAllocator *alloc = &nonmovingHeap.allocators[nonmovingAllocatorForSize(nonmovingSegmentBlockSize(seg))];
+    struct NonmovingAllocator *alloc = &nonmovingHeap.allocators[nonmovingSegmentInfo(seg)->allocator_idx];
     SET_SEGMENT_STATE(seg, ACTIVE);
     while (true) {
         struct NonmovingSegment *current_active = RELAXED_LOAD(&alloc->active);
@@ -230,7 +243,7 @@ INLINE_HEADER void nonmovingPushActiveSegment(struct NonmovingSegment *seg)
 // Add a segment to the appropriate filled list.
 INLINE_HEADER void nonmovingPushFilledSegment(struct NonmovingSegment *seg)
 {
-    struct NonmovingAllocator *alloc = &nonmovingHeap.allocators[nonmovingAllocatorForSize(nonmovingSegmentBlockSize(seg))];
+    struct NonmovingAllocator *alloc = &nonmovingHeap.allocators[nonmovingSegmentInfo(seg)->allocator_idx];
     SET_SEGMENT_STATE(seg, FILLED);
     while (true) {
         struct NonmovingSegment *current_filled = (struct NonmovingSegment*) RELAXED_LOAD(&alloc->filled);
@@ -14,6 +14,7 @@
 #include "GCUtils.h"
 #include "Capability.h"
 #include "NonMovingAllocate.h"
+#include "NonMovingSizeClasses.h"
 
 enum AllocLockMode { NO_LOCK, ALLOC_SPIN_LOCK, SM_LOCK };
 
@@ -21,6 +22,7 @@ static struct NonmovingSegment *nonmovingAllocSegment(enum AllocLockMode mode, u
 static void nonmovingClearBitmap(struct NonmovingSegment *seg);
 static void nonmovingInitSegment(struct NonmovingSegment *seg, uint16_t block_size);
 static bool advance_next_free(struct NonmovingSegment *seg, const unsigned int blk_count);
+static bool find_free_run(struct NonmovingSegment *seg, unsigned int from, const unsigned int blk_count);
 static struct NonmovingSegment *nonmovingPopFreeSegment(void);
 static struct NonmovingSegment *pop_active_segment(struct NonmovingAllocator *alloca);
 static void *nonmovingAllocate_(enum AllocLockMode mode, Capability *cap, StgWord sz);
@@ -82,6 +84,8 @@ static struct NonmovingSegment *nonmovingAllocSegment(enum AllocLockMode mode, u
         release_alloc_lock(mode);
 
         W_ alloc_blocks = BLOCKS_PER_MBLOCK - (BLOCKS_PER_MBLOCK % NONMOVING_SEGMENT_BLOCKS);
+        __sync_add_and_fetch(&nonmovingHeap.n_segments,
+                             alloc_blocks / NONMOVING_SEGMENT_BLOCKS);
 
         // See Note [Live data accounting in nonmoving collector].
         oldest_gen->n_blocks += alloc_blocks;
@@ -125,6 +129,7 @@ static void nonmovingInitSegment(struct NonmovingSegment *seg, uint16_t allocato
     bd->nonmoving_segment.allocator_idx = allocator_idx;
     bd->nonmoving_segment.next_free_snap = 0;
     bd->u.scan = nonmovingSegmentGetBlock(seg, 0);
+    seg->free_run_end = nonmovingSegmentBlockCount(seg);
     nonmovingClearBitmap(seg);
 }
 
@@ -132,45 +137,127 @@ static void nonmovingInitSegment(struct NonmovingSegment *seg, uint16_t allocato
 void nonmovingInitCapability(Capability *cap)
 {
     // Initialize current segment array
+    cap->current_segments = NULL;
+    nonmovingGrowCapability(cap, 0);
+    cap->nonmoving_size_profile = nonmovingNewSizeProfile();
+
+    // Initialize update remembered set
+    cap->upd_rem_set.queue.blocks = NULL;
+    nonmovingInitUpdRemSet(&cap->upd_rem_set);
+}
+
+/* Give a capability current segments for the allocators from first_new on.
+ * Must hold SM_LOCK. */
+void nonmovingGrowCapability(Capability *cap, uint8_t first_new)
+{
     struct NonmovingSegment **segs =
-        stgMallocBytes(sizeof(struct NonmovingSegment*) * nonmoving_alloca_cnt, "current segment array");
-    for (unsigned int i = 0; i < nonmoving_alloca_cnt; i++) {
+        stgReallocBytes(cap->current_segments,
+                        sizeof(struct NonmovingSegment*) * nonmoving_alloca_cnt,
+                        "current segment array");
+    for (unsigned int i = first_new; i < nonmoving_alloca_cnt; i++) {
         segs[i] = nonmovingAllocSegment(NO_LOCK, cap->node);
         nonmovingInitSegment(segs[i], i);
         SET_SEGMENT_STATE(segs[i], CURRENT);
     }
     cap->current_segments = segs;
-
-    // Initialize update remembered set
-    cap->upd_rem_set.queue.blocks = NULL;
-    nonmovingInitUpdRemSet(&cap->upd_rem_set);
 }
 
-// Advance a segment's next_free pointer. Returns true if segment if full.
-static bool advance_next_free(struct NonmovingSegment *seg, const unsigned int blk_count)
+/* Note [Free runs]
+ * ~~~~~~~~~~~~~~~~
+ * A segment's free blocks (those whose bitmap byte is zero) come in runs,
+ * and a fresh or nearly empty segment is one long run. Rather than search
+ * the bitmap for the next free block after every allocation, a current
+ * segment remembers where the run at next_free ends (free_run_end), so that
+ * allocating inside the run, which is what a promoting GC mostly does, only
+ * bumps next_free. Only at the end of a run do we search the bitmap again,
+ * for the start of the next run and then for its end, a word of bitmap
+ * bytes at a time: a word has a zero (or non-zero) byte if a mask computed
+ * from it is non-zero, and counting its trailing zeros (leading zeros on
+ * big-endian platforms) gives the first such byte.
+ *
+ * The run can't be handed out in bulk, to be filled later: the scavenger
+ * scans every block below next_free that has no mark, so next_free must
+ * only cover filled blocks (see Note [Scavenging the non-moving heap] in
+ * NonMovingScav.c). Nor does the cached end go stale: the concurrent mark
+ * only marks the blocks allocated before its snapshot, which are not free,
+ * and the bitmap bytes of blocks in the current segment only ever become
+ * zero otherwise, which at worst makes a run end early.
+ *
+ * free_run_end is only maintained for current segments; a segment taken from
+ * the active list finds its run when it becomes current.
+ */
+
+#if SIZEOF_VOID_P == SIZEOF_LONG
+#define CLZW(n) (__builtin_clzl(n))
+#define CTZW(n) (__builtin_ctzl(n))
+#else
+#define CLZW(n) (__builtin_clzll(n))
+#define CTZW(n) (__builtin_ctzll(n))
+#endif
+
+// The index of the first block from i on (up to n) which is free, or if
+// !free the first which isn't. Returns n if there is none.
+STATIC_INLINE unsigned int
+scan_bitmap(const uint8_t *bitmap, unsigned int i, const unsigned int n, const bool free)
 {
-    const uint8_t *bitmap = seg->bitmap;
-    ASSERT(blk_count == nonmovingSegmentBlockCount(seg));
-#if defined(NAIVE_ADVANCE_FREE)
-    // reference implementation
-    for (unsigned int i = seg->next_free+1; i < blk_count; i++) {
-        if (!bitmap[i]) {
-            seg->next_free = i;
-            return false;
+#if !defined(NAIVE_ADVANCE_FREE)
+    while (i < n && (W_) &bitmap[i] % sizeof(W_) != 0) {
+        if ((bitmap[i] == 0) == free) {
+            return i;
         }
+        i++;
     }
-    seg->next_free = blk_count;
-    return true;
+
+    const W_ low_bits = ((W_) -1 / 0xff) * 0x7f;   // 0x7f7f...
+    for (; i + sizeof(W_) <= n; i += sizeof(W_)) {
+        const W_ w = *(const W_ *) &bitmap[i];
+        // The top bit of each byte is set iff the byte is non-zero
+        const W_ non_zero = (((w & low_bits) + low_bits) | w) & ~low_bits;
+        const W_ found = free ? non_zero ^ ~low_bits : non_zero;
+        if (found != 0) {
+#if defined(WORDS_BIGENDIAN)
+            return i + CLZW(found) / 8;
 #else
-    const uint8_t *c = memchr(&bitmap[seg->next_free+1], 0, blk_count - seg->next_free - 1);
-    if (c == NULL) {
-        seg->next_free = blk_count;
+            return i + CTZW(found) / 8;
+#endif
+        }
+    }
+#endif
+
+    // reference implementation, and the tail of the bitmap
+    for (; i < n; i++) {
+        if ((bitmap[i] == 0) == free) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// Set next_free to the first free block from from on, and free_run_end to
+// the end of its run. Returns true if the segment is full.
+static bool find_free_run(struct NonmovingSegment *seg, unsigned int from, const unsigned int blk_count)
+{
+    ASSERT(blk_count == nonmovingSegmentBlockCount(seg));
+    const unsigned int start = scan_bitmap(seg->bitmap, from, blk_count, true);
+    seg->next_free = start;
+    if (start == blk_count) {
+        seg->free_run_end = blk_count;
         return true;
-    } else {
-        seg->next_free = c - bitmap;
+    }
+    seg->free_run_end = scan_bitmap(seg->bitmap, start + 1, blk_count, false);
+    return false;
+}
+
+// Advance a segment's next_free pointer. Returns true if segment if full.
+// See Note [Free runs].
+static bool advance_next_free(struct NonmovingSegment *seg, const unsigned int blk_count)
+{
+    ASSERT(seg->next_free < seg->free_run_end);
+    if (RTS_LIKELY(seg->next_free + 1 < seg->free_run_end)) {
+        seg->next_free++;
         return false;
     }
-#endif
+    return find_free_run(seg, seg->next_free + 1, blk_count);
 }
 
 static struct NonmovingSegment *nonmovingPopFreeSegment(void)
@@ -208,20 +295,19 @@ static struct NonmovingSegment *pop_active_segment(struct NonmovingAllocator *al
 
 static void *nonmovingAllocate_(enum AllocLockMode mode, Capability *cap, StgWord sz)
 {
-    unsigned int block_size;
-    if (sz * sizeof(StgWord) <= NONMOVING_ALLOCA0 + (nonmoving_alloca_dense_cnt-1)*sizeof(StgWord)) {
-      block_size = sizeof(StgWord) * sz;
-    } else {
-      unsigned int log_block_size = log2_ceil(sz * sizeof(StgWord));
-      block_size = 1 << log_block_size;
-    }
-
     // The max we ever allocate is NONMOVING_SEGMENT_SIZE bytes (anything larger is a large
-    // object and not moved) which is covered by allocator 9.
-    ASSERT(block_size < NONMOVING_SEGMENT_SIZE);
+    // object and not moved) which is covered by the largest sparse allocator.
+    ASSERT(sz < NONMOVING_SEGMENT_SIZE_W);
+
+    // See Note [Profiled size classes]
+    if (RTS_UNLIKELY(cap->nonmoving_size_profile != NULL)) {
+        cap->nonmoving_size_profile[sz]++;
+    }
 
-    unsigned int alloca_idx = nonmovingAllocatorForSize(block_size);
+    unsigned int alloca_idx = nonmovingAllocatorForWords(sz);
     struct NonmovingAllocator *alloca = &nonmovingHeap.allocators[alloca_idx];
+    unsigned int block_size = alloca->block_size;
+    ASSERT(block_size >= sz * sizeof(StgWord));
 
     // Allocate into current segment
     struct NonmovingSegment *current = cap->current_segments[alloca_idx];
@@ -253,6 +339,9 @@ static void *nonmovingAllocate_(enum AllocLockMode mode, Capability *cap, StgWor
         if (new_current == NULL) {
             new_current = nonmovingAllocSegment(mode, cap->node);
             nonmovingInitSegment(new_current, alloca_idx);
+        } else {
+            // See Note [Free runs]
+            find_free_run(new_current, new_current->next_free, block_count);
         }
 
         // make it current
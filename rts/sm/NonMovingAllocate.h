@@ -15,5 +15,6 @@
 void *nonmovingAllocate(Capability *cap, StgWord sz);
 void *nonmovingAllocateGC(Capability *cap, StgWord sz);
 void nonmovingInitCapability(Capability *cap);
+void nonmovingGrowCapability(Capability *cap, uint8_t first_new);
 
 #include "EndPrivate.h"
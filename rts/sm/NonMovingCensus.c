@@ -95,9 +95,18 @@ nonmovingAllocatorCensus(uint32_t alloc_idx)
 
 static void print_alloc_census(int i, struct NonmovingAllocCensus census)
 {
-    uint32_t blk_size = 1 << (i + NONMOVING_ALLOCA0);
-    int sz_min = 1 << (i + NONMOVING_ALLOCA0 - 1);
-    int sz_max = 1 << (i + NONMOVING_ALLOCA0);
+    // The allocator serves the sizes above the next smaller block size, see
+    // Note [Profiled size classes] for why that isn't necessarily
+    // allocator i-1.
+    uint32_t blk_size = nonmovingHeap.allocators[i].block_size;
+    int sz_min = 1;
+    for (int j=0; j < nonmoving_alloca_cnt; j++) {
+        const int other = nonmovingHeap.allocators[j].block_size;
+        if (other < (int) blk_size && other + 1 > sz_min) {
+            sz_min = other + 1;
+        }
+    }
+    int sz_max = blk_size;
     (void) sz_min; (void) sz_max;
 
     if (census.collected_live_words) {
@@ -0,0 +1,322 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Non-moving garbage collector: evacuation of sparse segments.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Nonmoving evacuation]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The nonmoving collector never moves objects, so a segment can only be
+   freed once all of its blocks are dead. After the heap shrinks its
+   survivors are spread over many active segments, each mostly free, and a
+   long-running program keeps that memory. With --nonmoving-evacuate=<n>
+   every <n>th nonmoving collection runs synchronously and evacuates the
+   live objects from the sparsest active segments into the rest of the heap,
+   so that those segments can be freed.
+
+   nonmovingStartEvacuation picks the segments: for each allocator, the
+   active segments with at most EVAC_MAX_OCCUPANCY_PERCENT of their blocks
+   live after the last sweep, and no more than half of them, the sparsest
+   first. They come off the active list, with BF_NONMOVING_EVACUATING set,
+   and join the sweep list as if they were filled. Their snapshot covers all
+   blocks, so blocks that were free don't count as newly allocated.
+
+   Rather than fixing pointers up afterwards, the mark does the evacuation.
+   The mark queue records where it found each reference (the origin, see
+   Note [Origin references in the nonmoving collector] in NonMovingMark.h),
+   so when mark_closure first reaches an object in an evacuating segment it
+   can copy the object into the capability's current segment (which takes
+   active segments, the denser ones, as it fills) and mark the copy instead,
+   recording the copy in the `forwarded` table. Like the indirection
+   shortcut, the origin is then set to point to the copy; later references
+   to the old copy are redirected the same way. If nothing keeps the old
+   copy alive it stays unmarked, and the sweep frees its segment with the
+   other dead segments through nonmovingPushFreeSegment once all of its
+   blocks have been evacuated.
+
+   This is only correct if we redirect every reference to an object we
+   move, so we move only what the mark can redirect:
+
+    * Everything reached without an origin that we may update (roots,
+      references from younger generations, fields of static closures) stays
+      where it is. If the object has already been copied then both copies
+      remain live. That is why we only move immutable objects,
+      constructors and functions, for which having two copies is harmless.
+
+    * Objects that the RTS refers to outside of the mark are pinned in
+      advance (`pinned`): the objects on the mutable lists, whose entries
+      would otherwise point at the old copy, the keys of weak pointers,
+      which are checked by address, and the objects with stable names.
+
+    * The selector thunk optimisation writes values it found into fields
+      that the mark might not visit again, so it is disabled while
+      evacuating.
+
+   Mutators must not see a half-evacuated heap, nor the
+   concurrent/parallel marking see objects change under them, so
+   evacuating collections are synchronous and mark with a single thread.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "Capability.h"
+#include "Hash.h"
+#include "NonMoving.h"
+#include "NonMovingAllocate.h"
+#include "NonMovingEvac.h"
+#include "RtsUtils.h"
+#include "StableName.h"
+#include "Trace.h"
+
+#define EVAC_MAX_OCCUPANCY_PERCENT 25
+
+bool nonmoving_evacuating = false;
+
+// Where copies are allocated
+static Capability *evac_cap = NULL;
+
+// Maps the objects evacuated so far to their copies
+static HashTable *forwarded = NULL;
+
+// Objects that must not be moved
+static HashTable *pinned = NULL;
+
+// The segments being evacuated
+static struct NonmovingSegment **evac_segs = NULL;
+static uint32_t n_evac_segs = 0;
+
+static uint32_t n_collections = 0;
+static StgWord evacuated_objects = 0;
+static StgWord evacuated_words = 0;
+
+// Should this collection evacuate? Called once per nonmoving collection.
+bool nonmovingEvacuationDue(void)
+{
+    const uint32_t interval = RtsFlags.GcFlags.nonmovingEvacuateInterval;
+    if (interval == 0) {
+        return false;
+    }
+    n_collections++;
+    return n_collections % interval == 0;
+}
+
+static void pin(StgClosure *p)
+{
+    p = UNTAG_CLOSURE(p);
+    if (HEAP_ALLOCED_GC(p) && Bdescr((P_) p)->flags & BF_NONMOVING) {
+        insertHashTable(pinned, (StgWord) p, p);
+    }
+}
+
+static void pin_weak_keys(StgWeak *w)
+{
+    for (; w != NULL; w = w->link) {
+        pin(w->key);
+    }
+}
+
+static void pin_referenced_objects(void)
+{
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        for (bdescr *bd = getCapability(i)->mut_lists[oldest_gen->no];
+             bd != NULL; bd = bd->link) {
+            for (StgPtr q = bd->start; q < bd->free; q++) {
+                pin((StgClosure *) *q);
+            }
+        }
+    }
+
+    pin_weak_keys(nonmoving_old_weak_ptr_list);
+    pin_weak_keys(nonmoving_weak_ptr_list);
+    for (uint32_t g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        pin_weak_keys(generations[g].weak_ptr_list);
+    }
+
+    stableNameLock();
+    FOR_EACH_STABLE_NAME(sn, {
+        if (sn->addr != NULL) {
+            pin((StgClosure *) sn->addr);
+        }
+    });
+    stableNameUnlock();
+}
+
+struct SegOccupancy {
+    struct NonmovingSegment *seg;
+    unsigned int live;
+};
+
+static int cmp_occupancy(const void *a, const void *b)
+{
+    const unsigned int x = ((const struct SegOccupancy *) a)->live;
+    const unsigned int y = ((const struct SegOccupancy *) b)->live;
+    return x < y ? -1 : x > y;
+}
+
+// The blocks left live by the last sweep
+static unsigned int segment_live_blocks(struct NonmovingSegment *seg)
+{
+    const unsigned int n = nonmovingSegmentBlockCount(seg);
+    unsigned int live = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        live += seg->bitmap[i] != 0;
+    }
+    return live;
+}
+
+static void pick_segments(struct NonmovingAllocator *alloc)
+{
+    unsigned int n_active = 0;
+    for (struct NonmovingSegment *seg = alloc->active; seg; seg = seg->link) {
+        n_active++;
+    }
+    if (n_active < 2) {
+        return;
+    }
+
+    struct SegOccupancy *segs =
+        stgMallocBytes(n_active * sizeof(struct SegOccupancy), "pick_segments");
+    unsigned int n = 0;
+    for (struct NonmovingSegment *seg = alloc->active; seg; seg = seg->link) {
+        segs[n].seg = seg;
+        segs[n].live = segment_live_blocks(seg);
+        n++;
+    }
+    qsort(segs, n, sizeof(struct SegOccupancy), cmp_occupancy);
+
+    const unsigned int max_live = alloc->block_count * EVAC_MAX_OCCUPANCY_PERCENT / 100;
+    unsigned int n_picked = 0;
+    while (n_picked < n / 2 && segs[n_picked].live <= max_live) {
+        n_picked++;
+    }
+
+    // The rest stay active, in order of occupancy
+    alloc->active = NULL;
+    for (unsigned int i = n; i > n_picked; i--) {
+        segs[i-1].seg->link = alloc->active;
+        alloc->active = segs[i-1].seg;
+    }
+
+    if (n_picked == 0) {
+        stgFree(segs);
+        return;
+    }
+
+    evac_segs = stgReallocBytes(evac_segs,
+                                (n_evac_segs + n_picked) * sizeof(struct NonmovingSegment *),
+                                "pick_segments");
+    for (unsigned int i = 0; i < n_picked; i++) {
+        struct NonmovingSegment *seg = segs[i].seg;
+        Bdescr((P_) seg)->flags |= BF_NONMOVING_EVACUATING;
+        nonmovingSegmentInfo(seg)->next_free_snap = alloc->block_count;
+        SET_SEGMENT_STATE(seg, FILLED_SWEEPING);
+        seg->link = nonmovingHeap.sweep_list;
+        nonmovingHeap.sweep_list = seg;
+        evac_segs[n_evac_segs++] = seg;
+    }
+    stgFree(segs);
+}
+
+/* Pick the segments to evacuate in this collection. Called with all
+ * capabilities stopped, after nonmovingPrepareMark, before marking.
+ */
+void nonmovingStartEvacuation(Capability *cap)
+{
+    ASSERT(!nonmoving_evacuating);
+    evac_cap = cap;
+    forwarded = allocHashTable();
+    pinned = allocHashTable();
+    evacuated_objects = 0;
+    evacuated_words = 0;
+    pin_referenced_objects();
+
+    for (uint32_t i = 0; i < nonmoving_alloca_cnt; i++) {
+        pick_segments(&nonmovingHeap.allocators[i]);
+    }
+    debugTrace(DEBUG_nonmoving_gc, "Evacuating %" FMT_Word32 " sparse segments",
+               n_evac_segs);
+    nonmoving_evacuating = true;
+}
+
+static bool evacuable(const StgClosure *p)
+{
+    switch (get_itbl(p)->type) {
+    case CONSTR:
+    case CONSTR_1_0:
+    case CONSTR_0_1:
+    case CONSTR_2_0:
+    case CONSTR_1_1:
+    case CONSTR_0_2:
+    case FUN:
+    case FUN_1_0:
+    case FUN_0_1:
+    case FUN_2_0:
+    case FUN_1_1:
+    case FUN_0_2:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* p lives in a segment being evacuated and isn't marked. Returns the copy
+ * the mark should mark in its place and point origin to, or NULL if p stays
+ * where it is.
+ */
+StgClosure *nonmovingEvacuate(StgClosure *p, StgClosure **origin)
+{
+    ASSERT(nonmoving_evacuating);
+
+    // Only fields of heap objects can be redirected, and only if they still
+    // refer to p (rather than to an indirection to it, say)
+    if (origin == NULL || !HEAP_ALLOCED_GC(origin)
+        || UNTAG_CLOSURE(*origin) != p) {
+        return NULL;
+    }
+
+    StgClosure *to = lookupHashTable(forwarded, (StgWord) p);
+    if (to != NULL) {
+        return to;
+    }
+
+    if (!evacuable(p) || lookupHashTable(pinned, (StgWord) p) != NULL) {
+        return NULL;
+    }
+
+    const StgWord size = closure_sizeW(p);
+    to = nonmovingAllocateGC(evac_cap, size);
+    memcpy(to, p, size * sizeof(W_));
+    insertHashTable(forwarded, (StgWord) p, to);
+    evacuated_objects++;
+    evacuated_words += size;
+    return to;
+}
+
+/* Called once marking is done, before the sweep. */
+void nonmovingFinishEvacuation(void)
+{
+    if (!nonmoving_evacuating) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < n_evac_segs; i++) {
+        Bdescr((P_) evac_segs[i])->flags &= ~BF_NONMOVING_EVACUATING;
+    }
+    trace(TRACE_nonmoving_gc,
+          "Evacuated %" FMT_Word " objects (%" FMT_Word " words) from %"
+          FMT_Word32 " segments",
+          evacuated_objects, evacuated_words, n_evac_segs);
+
+    stgFree(evac_segs);
+    evac_segs = NULL;
+    n_evac_segs = 0;
+    freeHashTable(forwarded, NULL);
+    forwarded = NULL;
+    freeHashTable(pinned, NULL);
+    pinned = NULL;
+    evac_cap = NULL;
+    nonmoving_evacuating = false;
+}
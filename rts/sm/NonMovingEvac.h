@@ -0,0 +1,22 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Non-moving garbage collector: evacuation of sparse segments.
+ * See Note [Nonmoving evacuation] in NonMovingEvac.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+// Is the current (synchronous) mark evacuating sparse segments?
+extern bool nonmoving_evacuating;
+
+bool nonmovingEvacuationDue(void);
+void nonmovingStartEvacuation(Capability *cap);
+StgClosure *nonmovingEvacuate(StgClosure *p, StgClosure **origin);
+void nonmovingFinishEvacuation(void);
+
+#include "EndPrivate.h"
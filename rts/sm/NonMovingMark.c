@@ -12,8 +12,10 @@
 // to include the declaration so that the compiler doesn't clobber the register.
 #include "NonMovingMark.h"
 #include "NonMovingShortcut.h"
+#include "NonMovingEvac.h"
 #include "NonMoving.h"
 #include "BlockAlloc.h"  /* for countBlocks */
+#include "RtsUtils.h"
 #include "rts/storage/HeapAlloc.h"
 #include "Task.h"
 #include "Trace.h"
@@ -26,6 +28,7 @@
 #include "MarkWeak.h"
 #include "sm/Storage.h"
 #include "CNF.h"
+#include "GetTime.h"
 
 #if defined(THREADED_RTS)
 static void nonmovingResetUpdRemSetQueue (MarkQueue *rset);
@@ -204,8 +207,8 @@ StgIndStatic *debug_caf_list_snapshot = (StgIndStatic*)END_OF_CAF_LIST;
  *  7. Mark thread marks everything it was sent
  *  8. Mark thread allows capabilities to resume.
  *
- * However, this is obviously a fair amount of complexity and so far the
- * periodic eager flushing approach has been sufficient.
+ * This is what we now do, see Note [Update remembered set handshake]; the
+ * eager flushing during minor GCs remains.
  *
  *
  * Note [Concurrent read barrier on deRefWeak#]
@@ -237,6 +240,40 @@ StgIndStatic *debug_caf_list_snapshot = (StgIndStatic*)END_OF_CAF_LIST;
  *
  */
 bdescr *upd_rem_set_block_list = NULL;
+
+/* The blocks of all mark queues and update remembered sets, for
+ * getRTSMemoryUsage. Updated atomically. */
+static StgWord mark_queue_blocks = 0;
+
+/* Must hold sm_mutex, or gc_alloc_block_sync in the GC. */
+static bdescr *allocMarkQueueBlock (void)
+{
+    RELAXED_ADD(&mark_queue_blocks, MARK_QUEUE_BLOCKS);
+    return allocGroup(MARK_QUEUE_BLOCKS);
+}
+
+/* Must hold sm_mutex. */
+static void freeMarkQueueBlock (bdescr *bd)
+{
+    RELAXED_ADD(&mark_queue_blocks, -(StgWord) MARK_QUEUE_BLOCKS);
+    freeGroup(bd);
+}
+
+static void freeMarkQueueBlocks_lock (bdescr *bd)
+{
+    StgWord n = 0;
+    for (bdescr *p = bd; p != NULL; p = p->link) {
+        n++;
+    }
+    RELAXED_ADD(&mark_queue_blocks, -(StgWord) (n * MARK_QUEUE_BLOCKS));
+    freeChain_lock(bd);
+}
+
+StgWord nonmovingMarkQueueBlocks (void)
+{
+    return RELAXED_LOAD(&mark_queue_blocks);
+}
+
 #if defined(THREADED_RTS)
 static Mutex upd_rem_set_lock;
 
@@ -247,6 +284,17 @@ static volatile StgWord upd_rem_set_flush_count = 0;
 
 /* Signaled by each capability when it has flushed its update remembered set */
 static Condition upd_rem_set_flushed_cond;
+
+/* The state of the current handshake; see Note [Update remembered set
+ * handshake]. All but the epoch are protected by upd_rem_set_lock.
+ */
+volatile StgWord nonmoving_handshake_epoch = 0;
+static bool handshake_open = false;
+static Time handshake_start = 0;
+static uint32_t handshake_answers = 0;
+static Condition handshake_answered_cond;
+
+struct NonmovingHandshakeStats nonmoving_handshake_stats = { 0, 0, 0, 0, 0 };
 #endif
 
 /* Indicates to mutators that the write barrier must be respected. Set while
@@ -259,12 +307,196 @@ StgWord nonmoving_write_barrier_enabled = false;
  */
 MarkQueue *current_mark_queue = NULL;
 
+/* Note [Parallel nonmoving mark]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With --nonmoving-mark-threads=<n>, n > 1, each mark pass with an unlimited
+ * budget, which is where nearly all of the marking happens both concurrently
+ * and in the final synchronisation, is shared by the mark thread and n-1
+ * helper threads (see Note [Nonmoving GC helper threads] in NonMoving.c).
+ * Passes with a limited budget (Note [Sync phase marking budget]) stay on the
+ * mark thread, as does the processing of weak pointers and threads between
+ * passes.
+ *
+ * Each worker marks from its own MarkQueue: the mark thread from the mark
+ * queue of the collection, the helpers from queues that live as long as the
+ * helpers do. Work moves between workers a block at a time through a shared
+ * pool, mark_pool:
+ *
+ *  - a worker that runs out of work counts itself in mark_workers_idle and
+ *    takes a block from the pool, or failing that goes for the blocks on
+ *    upd_rem_set_block_list (steal_mark_work);
+ *
+ *  - a worker whose top block fills up while another worker is idle gives the
+ *    full block to the pool instead of keeping it (push);
+ *
+ *  - at the start of a pass the mark thread gives all but the top block of its
+ *    queue to the pool, and so does a worker that takes the blocks of
+ *    upd_rem_set_block_list, so that the roots and the flushed update
+ *    remembered sets are spread over the workers.
+ *
+ * A worker finishes when it finds all workers idle, and the pool and
+ * upd_rem_set_block_list empty, holding mark_pool_lock; since nobody else has
+ * anything to give away at that point no work can be lost. Workers that
+ * finish stay counted as idle, so mutators flushing their update remembered
+ * sets later in the pass can only leave work to workers still looking.
+ *
+ * Two workers can reach the same object at once. Tracing an object twice is
+ * harmless, but the words of a segment block must only be counted once in
+ * nonmoving_segment_live_words, so during a parallel pass the mark bit is set
+ * with a CAS and only the worker that set it counts the block, in its
+ * queue's live_words. Large objects are marked holding
+ * nonmoving_large_objects_mutex, which compact regions now take as well,
+ * and stacks are claimed with a CAS
+ * (Note [StgStack dirtiness flags and concurrent marking]).
+ *
+ * At the end of a parallel pass each worker emits a CONC_MARK_WORKER_END event
+ * with the number of entries it marked and the time it spent marking and
+ * looking for work.
+ */
+
+#if defined(THREADED_RTS)
+// The queues of the mark workers; the first is set to the mark thread's
+// queue by each parallel pass
+MarkQueue **mark_worker_queues = NULL;
+uint32_t n_mark_worker_queues = 0;
+static uint64_t *mark_worker_counts;
+
+// Protects the fields below
+static Mutex mark_pool_lock;
+static bdescr *mark_pool = NULL;
+static StgWord mark_workers_idle = 0;  // also read without the lock by push
+
+// Is a parallel mark pass running?
+static bool mark_parallel = false;
+#endif
+
+/* Note [Mark prefetch depth]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * markQueuePop keeps a ring of the next nonmoving_mark_prefetch_depth entries
+ * to mark, prefetching each object's header and block descriptor as it
+ * enters the ring so that they are in cache by the time we mark it. How deep
+ * the ring should be depends on the memory latency and the number of
+ * outstanding misses of the machine, so it is a runtime parameter
+ * (--nonmoving-prefetch-depth, 5 by default) rather than a constant. The
+ * ring has room for up to MARK_PREFETCH_QUEUE_MAX_DEPTH entries; a depth of 0
+ * turns prefetching off.
+ *
+ * With --nonmoving-prefetch-depth=auto the collector instead tries each of
+ * prefetch_tune_depths in turn for one collection, measuring the mark
+ * throughput: the bytes of segment blocks marked over the time spent in
+ * nonmovingMark. Collections which mark less than PREFETCH_TUNE_MIN_WORDS
+ * are too short to measure and don't count. Once all the depths have been
+ * tried the one with the best throughput is used from then on, and reported
+ * by +RTS -s.
+ *
+ * The depth only changes at the end of a mark, when all prefetch rings are
+ * empty.
+ */
+
+uint32_t nonmoving_mark_prefetch_depth = 5;
+
+static const uint32_t prefetch_tune_depths[] = { 0, 2, 4, 6, 8, 12, 16 };
+#define PREFETCH_TUNE_STEPS \
+    (sizeof(prefetch_tune_depths) / sizeof(prefetch_tune_depths[0]))
+#define PREFETCH_TUNE_MIN_WORDS ((1024 * 1024) / sizeof(W_))
+
+// Index of the depth being tried, or PREFETCH_TUNE_STEPS when not tuning
+static uint32_t prefetch_tune_step = PREFETCH_TUNE_STEPS;
+static Time prefetch_tune_time;       // time spent marking this collection
+static double prefetch_best_rate;     // in bytes per second
+static uint32_t prefetch_best_depth;
+
+bool nonmovingMarkPrefetchTuning(void)
+{
+    return prefetch_tune_step < PREFETCH_TUNE_STEPS;
+}
+
+// Called by the mark thread at the end of each mark with the number of words
+// marked in segments. See Note [Mark prefetch depth].
+void nonmovingMarkTunePrefetch(memcount marked_words)
+{
+    if (!nonmovingMarkPrefetchTuning()) {
+        return;
+    }
+
+    const Time t = prefetch_tune_time;
+    prefetch_tune_time = 0;
+    if (marked_words < PREFETCH_TUNE_MIN_WORDS || t == 0) {
+        return;
+    }
+
+    const double rate = (double) (marked_words * sizeof(W_)) / TimeToSecondsDbl(t);
+    debugTrace(DEBUG_nonmoving_gc, "Mark prefetch depth %" FMT_Word32 ": %.0f bytes/s",
+               nonmoving_mark_prefetch_depth, rate);
+    if (rate > prefetch_best_rate) {
+        prefetch_best_rate = rate;
+        prefetch_best_depth = nonmoving_mark_prefetch_depth;
+    }
+
+    prefetch_tune_step++;
+    if (prefetch_tune_step < PREFETCH_TUNE_STEPS) {
+        nonmoving_mark_prefetch_depth = prefetch_tune_depths[prefetch_tune_step];
+    } else {
+        nonmoving_mark_prefetch_depth = prefetch_best_depth;
+        debugTrace(DEBUG_nonmoving_gc, "Chose mark prefetch depth %" FMT_Word32,
+                   prefetch_best_depth);
+    }
+}
+
 /* Initialise update remembered set data structures */
 void nonmovingMarkInit(void) {
+    if (RtsFlags.GcFlags.nonmovingPrefetchAuto) {
+        prefetch_tune_step = 0;
+        prefetch_tune_time = 0;
+        prefetch_best_rate = 0;
+        prefetch_best_depth = RtsFlags.GcFlags.nonmovingPrefetchDepth;
+        nonmoving_mark_prefetch_depth = prefetch_tune_depths[0];
+    } else {
+        nonmoving_mark_prefetch_depth = RtsFlags.GcFlags.nonmovingPrefetchDepth;
+    }
+
 #if defined(THREADED_RTS)
     initMutex(&upd_rem_set_lock);
     initCondition(&upd_rem_set_flushed_cond);
+    initCondition(&handshake_answered_cond);
     initMutex(&nonmoving_large_objects_mutex);
+
+    // See Note [Parallel nonmoving mark]
+    n_mark_worker_queues = stg_min(RtsFlags.GcFlags.nonmovingMarkThreads,
+                                   n_nonmoving_helpers + 1);
+    if (n_mark_worker_queues > 1) {
+        initMutex(&mark_pool_lock);
+        mark_worker_queues =
+            stgMallocBytes(n_mark_worker_queues * sizeof(MarkQueue *),
+                           "nonmovingMarkInit");
+        mark_worker_counts =
+            stgMallocBytes(n_mark_worker_queues * sizeof(uint64_t),
+                           "nonmovingMarkInit");
+        mark_worker_queues[0] = NULL;
+        for (uint32_t i = 1; i < n_mark_worker_queues; i++) {
+            mark_worker_queues[i] = stgMallocBytes(sizeof(MarkQueue),
+                                                   "nonmovingMarkInit");
+            memset(mark_worker_queues[i], 0, sizeof(MarkQueue));
+            // N.B. nonmovingInit is called holding sm_mutex
+            initMarkQueue(mark_worker_queues[i]);
+        }
+    }
+#endif
+}
+
+void nonmovingMarkExit(void) {
+#if defined(THREADED_RTS)
+    if (n_mark_worker_queues > 1) {
+        for (uint32_t i = 1; i < n_mark_worker_queues; i++) {
+            freeMarkQueue(mark_worker_queues[i]);
+            stgFree(mark_worker_queues[i]);
+        }
+        stgFree(mark_worker_queues);
+        stgFree(mark_worker_counts);
+        mark_worker_queues = NULL;
+        closeMutex(&mark_pool_lock);
+    }
+    n_mark_worker_queues = 0;
 #endif
 }
 
@@ -439,7 +671,7 @@ void nonmovingFinishFlush(Task *task)
     }
     // Also reset upd_rem_set_block_list in case some of the UpdRemSets were
     // filled and we flushed them.
-    freeChain_lock(upd_rem_set_block_list);
+    freeMarkQueueBlocks_lock(upd_rem_set_block_list);
     upd_rem_set_block_list = NULL;
 
     debugTrace(DEBUG_nonmoving_gc, "Finished update remembered set flush...");
@@ -447,12 +679,176 @@ void nonmovingFinishFlush(Task *task)
     stat_endNonmovingGcSync();
     releaseAllCapabilities(getNumCapabilities(), NULL, task);
 }
+
+/* Note [Update remembered set handshake]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * When the concurrent mark runs out of work the capabilities' update
+ * remembered sets may still hold a good deal to mark, and everything they
+ * hold is marked in the post-mark sync, with the mutators stopped (see Note
+ * [Eager update remembered set flushing]). So before the sync the mark
+ * thread first collects them with a handshake, which doesn't stop anybody:
+ *
+ *  1. nonmovingHandshake bumps nonmoving_handshake_epoch and asks all
+ *     capabilities to context switch, so that their running threads return
+ *     to the scheduler soon.
+ *
+ *  2. At the top of its scheduler loop each capability compares the epoch
+ *     with the last one it answered (UpdRemSet.handshake_epoch) and, if they
+ *     differ, flushes its update remembered set to the global one and carries
+ *     on (nonmovingAnswerHandshake).
+ *
+ *  3. Capabilities with no Haskell thread running (idle, or in a foreign
+ *     call) reach no safe point, so the mark thread grabs them with
+ *     tryGrabCapability while it waits and answers for them.
+ *
+ *  4. The mark thread waits for the answers, but no longer than
+ *     HANDSHAKE_TIMEOUT: a capability running a loop that doesn't allocate
+ *     may not reach a safe point for a long time, and the sync will flush it
+ *     anyway. It then marks what it received while the mutators are still
+ *     running.
+ *
+ * nonmovingMark_ repeats this, at most NONMOVING_MAX_HANDSHAKES times, as
+ * long as a handshake turns up more work, and only then requests the sync.
+ * The sync still stops all capabilities, since it must terminate the mark
+ * and process weak pointers and threads with the heap standing still, but
+ * its final flush now brings only what the mutators remembered since their
+ * last answer, so the pause is short.
+ *
+ * Each answer is traced with its latency, the time from the request to the
+ * flush, as a CONC_UPD_REM_SET_HANDSHAKE event; +RTS -s reports the number
+ * of handshakes and stragglers and the mean and maximum latency. An answer
+ * that comes after the mark thread gave up waiting still flushes, but isn't
+ * counted. Flushing at a safe point is always safe: it is what a capability
+ * does whenever a block of its update remembered set fills.
+ */
+
+#define HANDSHAKE_TIMEOUT MSToTime(10)
+#define HANDSHAKE_RETRY_INTERVAL MSToTime(1)
+
+/* Flush the update remembered set of a capability that hasn't yet answered
+ * the current handshake. The caller must own the capability.
+ */
+void nonmovingAnswerHandshake(Capability *cap)
+{
+    const StgWord epoch = ACQUIRE_LOAD(&nonmoving_handshake_epoch);
+    if (cap->upd_rem_set.handshake_epoch == epoch) {
+        return;
+    }
+    RELAXED_STORE(&cap->upd_rem_set.handshake_epoch, epoch);
+    nonmovingAddUpdRemSetBlocks_lock(&cap->upd_rem_set.queue);
+
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    if (handshake_open && epoch == nonmoving_handshake_epoch) {
+        const Time latency = getProcessElapsedTime() - handshake_start;
+        traceConcUpdRemSetHandshake(cap, latency);
+        debugTrace(DEBUG_nonmoving_gc,
+                   "Capability %d answered handshake after %" FMT_Word64 " us",
+                   cap->no, TimeToUS(latency));
+        nonmoving_handshake_stats.answers++;
+        nonmoving_handshake_stats.total_latency += latency;
+        nonmoving_handshake_stats.max_latency =
+            stg_max(nonmoving_handshake_stats.max_latency, latency);
+        handshake_answers++;
+        signalCondition(&handshake_answered_cond);
+    }
+    RELEASE_LOCK(&upd_rem_set_lock);
+}
+
+// Answer for the capabilities that are free, having no Haskell thread
+// running.
+static void answer_for_free_capabilities(Task *task)
+{
+    const StgWord epoch = RELAXED_LOAD(&nonmoving_handshake_epoch);
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap = getCapability(i);
+        if (RELAXED_LOAD(&cap->upd_rem_set.handshake_epoch) != epoch
+            && tryGrabCapability(cap, task)) {
+            nonmovingAnswerHandshake(cap);
+            releaseCapability(cap);
+        }
+    }
+}
+
+/* Ask all capabilities for their update remembered sets without stopping
+ * them, and wait a while for the answers. Returns true if they gave the mark
+ * more work. See Note [Update remembered set handshake].
+ */
+bool nonmovingHandshake(Task *task)
+{
+    const uint32_t n_caps = getNumCapabilities();
+
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    handshake_start = getProcessElapsedTime();
+    handshake_answers = 0;
+    handshake_open = true;
+    RELEASE_STORE(&nonmoving_handshake_epoch, nonmoving_handshake_epoch + 1);
+    RELEASE_LOCK(&upd_rem_set_lock);
+    debugTrace(DEBUG_nonmoving_gc, "Starting update remembered set handshake");
+    nonmoving_handshake_stats.handshakes++;
+
+    contextSwitchAllCapabilities();
+    answer_for_free_capabilities(task);
+
+    const Time deadline = handshake_start + HANDSHAKE_TIMEOUT;
+    ACQUIRE_LOCK(&upd_rem_set_lock);
+    while (handshake_answers < n_caps) {
+        const Time now = getProcessElapsedTime();
+        if (now >= deadline) {
+            break;
+        }
+        timedWaitCondition(&handshake_answered_cond, &upd_rem_set_lock,
+                           stg_min(deadline - now, HANDSHAKE_RETRY_INTERVAL));
+        if (handshake_answers < n_caps) {
+            // Capabilities may have become free since we last looked
+            RELEASE_LOCK(&upd_rem_set_lock);
+            answer_for_free_capabilities(task);
+            ACQUIRE_LOCK(&upd_rem_set_lock);
+        }
+    }
+    handshake_open = false;
+    const uint32_t stragglers = n_caps - handshake_answers;
+    const bool more_work = upd_rem_set_block_list != NULL;
+    RELEASE_LOCK(&upd_rem_set_lock);
+
+    nonmoving_handshake_stats.stragglers += stragglers;
+    debugTrace(DEBUG_nonmoving_gc,
+               "Finished update remembered set handshake: %" FMT_Word32
+               " stragglers, %s",
+               stragglers, more_work ? "more to mark" : "nothing to mark");
+    return more_work;
+}
 #endif
 
 /*********************************************************
  * Pushing to either the mark queue or remembered set
  *********************************************************/
 
+#if defined(THREADED_RTS)
+// Add the chain of blocks from first to last to the mark pool.
+// See Note [Parallel nonmoving mark].
+static void give_mark_blocks (bdescr *first, bdescr *last)
+{
+    ACQUIRE_LOCK(&mark_pool_lock);
+    last->link = mark_pool;
+    mark_pool = first;
+    RELEASE_LOCK(&mark_pool_lock);
+}
+
+// Give all but the top block of a mark queue to the mark pool.
+static void share_mark_blocks (MarkQueue *q)
+{
+    bdescr *first = q->blocks->link;
+    if (first != NULL) {
+        bdescr *last = first;
+        while (last->link != NULL) {
+            last = last->link;
+        }
+        q->blocks->link = NULL;
+        give_mark_blocks(first, last);
+    }
+}
+#endif
+
 STATIC_INLINE void
 push (MarkQueue *q, const MarkQueueEnt *ent)
 {
@@ -463,14 +859,28 @@ push (MarkQueue *q, const MarkQueueEnt *ent)
             // Flush the block to the global update remembered set
             nonmovingAddUpdRemSetBlocks_lock(q);
         } else {
+#if defined(THREADED_RTS)
+            // Give the full block to an idle mark worker.
+            // See Note [Parallel nonmoving mark].
+            bdescr *full = NULL;
+            if (RELAXED_LOAD(&mark_workers_idle) > 0) {
+                full = q->blocks;
+                q->blocks = full->link;
+            }
+#endif
             // allocate a fresh block.
             ACQUIRE_SM_LOCK;
-            bdescr *bd = allocGroup(MARK_QUEUE_BLOCKS);
+            bdescr *bd = allocMarkQueueBlock();
             bd->link = q->blocks;
             q->blocks = bd;
             q->top = (MarkQueueBlock *) bd->start;
             q->top->head = 0;
             RELEASE_SM_LOCK;
+#if defined(THREADED_RTS)
+            if (full != NULL) {
+                give_mark_blocks(full, full);
+            }
+#endif
         }
     }
 
@@ -503,7 +913,7 @@ markQueuePushClosureGC (MarkQueue *q, StgClosure *p)
         // Yes, this block is full.
         // allocate a fresh block.
         ACQUIRE_ALLOC_BLOCK_SPIN_LOCK();
-        bdescr *bd = allocGroup(MARK_QUEUE_BLOCKS);
+        bdescr *bd = allocMarkQueueBlock();
         bd->link = q->blocks;
         q->blocks = bd;
         q->top = (MarkQueueBlock *) bd->start;
@@ -718,6 +1128,37 @@ void updateRemembSetPushClosure_(StgRegTable *reg, struct StgClosure_ *p)
     updateRemembSetPushClosure(regTableToCapability(reg), p);
 }
 
+/* Note [Copying into arrays under the nonmoving collector]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A copy into a pointer array overwrites n elements at once, and each of
+ * them must go to the update remembered set (stg_copyArray_barrier in
+ * PrimOps.cmm). Two things make this cheaper than n write barriers:
+ *
+ *  - Only an array in the nonmoving heap can be part of the snapshot. An
+ *    array in a younger generation was either allocated after the
+ *    snapshot, or was scavenged by the major GC that took it, which
+ *    pushed every element of it in the nonmoving heap to the mark queue
+ *    then (see evacuate()). Either way what it holds now can't hide
+ *    anything from the mark, so stg_copyArray_barrier looks at the
+ *    destination's block once and does nothing more for such an array.
+ *    needs_upd_rem_set_mark() makes the same argument for TSOs and stacks.
+ *
+ *  - Otherwise the elements are pushed by updateRemembSetPushClosures_(),
+ *    in a single call from C--, rather than with a call (and the
+ *    saving of the STG registers around it) for each.
+ */
+void updateRemembSetPushClosures_(StgRegTable *reg, StgClosure **p, StgWord n)
+{
+    Capability *cap = regTableToCapability(reg);
+    MarkQueue *queue = &cap->upd_rem_set.queue;
+    for (StgWord i = 0; i < n; i++) {
+        StgClosure *q = p[i];
+        if (check_in_nonmoving_heap(q)) {
+            push_closure(queue, q, NULL);
+        }
+    }
+}
+
 STATIC_INLINE bool needs_upd_rem_set_mark(StgClosure *p)
 {
     // TODO: Deduplicate with mark_closure
@@ -881,7 +1322,7 @@ again:
             q->blocks = old_block->link;
             q->top = (MarkQueueBlock*)q->blocks->start;
             ACQUIRE_SM_LOCK;
-            freeGroup(old_block); // TODO: hold on to a block to avoid repeated allocation/deallocation?
+            freeMarkQueueBlock(old_block); // TODO: hold on to a block to avoid repeated allocation/deallocation?
             RELEASE_SM_LOCK;
             goto again;
         }
@@ -894,18 +1335,25 @@ again:
 
 static MarkQueueEnt markQueuePop (MarkQueue *q)
 {
-#if MARK_PREFETCH_QUEUE_DEPTH == 0
+#if MARK_PREFETCH_QUEUE_MAX_DEPTH == 0
     return markQueuePop_(q);
 #else
-    unsigned int i = q->prefetch_head;
+    const unsigned int depth = RELAXED_LOAD(&nonmoving_mark_prefetch_depth);
+    if (depth == 0) {
+        return markQueuePop_(q);
+    }
+
+    // The depth may have changed since this queue was last used, but the
+    // prefetch queue is empty between mark passes.
+    unsigned int i = q->prefetch_head < depth ? q->prefetch_head : 0;
     while (nonmovingMarkQueueEntryType(&q->prefetch_queue[i]) == NULL_ENTRY) {
         MarkQueueEnt new = markQueuePop_(q);
         if (nonmovingMarkQueueEntryType(&new) == NULL_ENTRY) {
             // Mark queue is empty; look for any valid entries in the prefetch
             // queue
-            for (unsigned int j = (i+1) % MARK_PREFETCH_QUEUE_DEPTH;
+            for (unsigned int j = (i+1) % depth;
                  j != i;
-                 j = (j+1) % MARK_PREFETCH_QUEUE_DEPTH)
+                 j = (j+1) % depth)
             {
                 if (nonmovingMarkQueueEntryType(&q->prefetch_queue[j]) != NULL_ENTRY) {
                     i = j;
@@ -923,7 +1371,7 @@ static MarkQueueEnt markQueuePop (MarkQueue *q)
         prefetchForRead(Bdescr((StgPtr) new.mark_closure.p));
 #endif
         q->prefetch_queue[i] = new;
-        i = (i + 1) % MARK_PREFETCH_QUEUE_DEPTH;
+        i = (i + 1) % depth;
     }
 
   done:
@@ -942,12 +1390,13 @@ static MarkQueueEnt markQueuePop (MarkQueue *q)
 /* Must hold sm_mutex. */
 static void init_mark_queue_ (MarkQueue *queue)
 {
-    bdescr *bd = allocGroup(MARK_QUEUE_BLOCKS);
+    bdescr *bd = allocMarkQueueBlock();
     ASSERT(queue->blocks == NULL);
     queue->blocks = bd;
     queue->top = (MarkQueueBlock *) bd->start;
     queue->top->head = 0;
-#if MARK_PREFETCH_QUEUE_DEPTH > 0
+    queue->live_words = 0;
+#if MARK_PREFETCH_QUEUE_MAX_DEPTH > 0
     memset(&queue->prefetch_queue, 0, sizeof(queue->prefetch_queue));
     queue->prefetch_head = 0;
 #endif
@@ -965,6 +1414,9 @@ void nonmovingInitUpdRemSet (UpdRemSet *rset)
 {
     init_mark_queue_(&rset->queue);
     rset->queue.is_upd_rem_set = true;
+#if defined(THREADED_RTS)
+    rset->handshake_epoch = RELAXED_LOAD(&nonmoving_handshake_epoch);
+#endif
 }
 
 #if defined(THREADED_RTS)
@@ -985,7 +1437,7 @@ static void nonmovingResetUpdRemSet (UpdRemSet *rset)
 
 void freeMarkQueue (MarkQueue *queue)
 {
-    freeChain_lock(queue->blocks);
+    freeMarkQueueBlocks_lock(queue->blocks);
 }
 
 #if defined(THREADED_RTS)
@@ -1298,6 +1750,12 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
             return;
         }
 
+        if (type == ARR_WORDS) {
+            // A loaned byte array, kept until exit with the non-moving
+            // collector. See Note [Loaned byte arrays] in LoanedBytes.c.
+            return;
+        }
+
         switch (type) {
 
         case THUNK_STATIC:
@@ -1387,6 +1845,8 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
                 return;
             }
 
+            // See Note [Parallel nonmoving mark]
+            ACQUIRE_LOCK(&nonmoving_large_objects_mutex);
             if (! (bd->flags & BF_MARKED)) {
                 dbl_link_remove(bd, &nonmoving_compact_objects);
                 dbl_link_onto(bd, &nonmoving_marked_compact_objects);
@@ -1395,6 +1855,7 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
                 n_nonmoving_marked_compact_blocks += blocks;
                 bd->flags |= BF_MARKED;
             }
+            RELEASE_LOCK(&nonmoving_large_objects_mutex);
 
             // N.B. the object being marked is in a compact region so by
             // definition there is no need to do any tracing here.
@@ -1431,6 +1892,18 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
                  */
                 goto done;
             }
+
+            // See Note [Nonmoving evacuation]
+            if (RTS_UNLIKELY(Bdescr((P_) seg)->flags & BF_NONMOVING_EVACUATING)) {
+                StgClosure *to = nonmovingEvacuate(p, origin);
+                if (to != NULL) {
+                    p = to;
+                    bd = Bdescr((StgPtr) to);
+                    if (nonmovingClosureMarkedThisCycle((P_) to)) {
+                        goto done;
+                    }
+                }
+            }
         }
     }
 
@@ -1440,7 +1913,8 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
 #if defined(DEBUG)
         bool found_it = false;
         for (uint32_t i = 0; i < getNumCapabilities(); ++i) {
-            if (getCapability(i)->pinned_object_block == bd) {
+            if (getCapability(i)->pinned_object_block == bd
+                || getCapability(i)->pinned_ephemeral_block == bd) {
                 found_it = true;
                 break;
             }
@@ -1625,7 +2099,10 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
         // selectee unreachable. However, we must mark the selectee regardless
         // to satisfy the snapshot invariant.
         PUSH_FIELD(sel, selectee);
-        nonmoving_eval_thunk_selector(queue, sel, origin);
+        // See Note [Nonmoving evacuation]
+        if (!nonmoving_evacuating) {
+            nonmoving_eval_thunk_selector(queue, sel, origin);
+        }
         break;
     }
 
@@ -1757,8 +2234,22 @@ mark_closure (MarkQueue *queue, const StgClosure *p0, StgClosure **origin)
         // TODO: Kill repetition
         struct NonmovingSegment *seg = nonmovingGetSegment((StgPtr) p);
         nonmoving_block_idx block_idx = nonmovingGetBlockIdx((StgPtr) p);
-        nonmovingSetMark(seg, block_idx);
-        nonmoving_segment_live_words += nonmovingSegmentBlockSize(seg) / sizeof(W_);
+        const memcount words = nonmovingSegmentBlockSize(seg) / sizeof(W_);
+#if defined(THREADED_RTS)
+        if (RELAXED_LOAD(&mark_parallel)) {
+            // Only count the block if we are the ones marking it.
+            // See Note [Parallel nonmoving mark].
+            uint8_t mark = nonmovingGetMark(seg, block_idx);
+            if (mark != nonmovingMarkEpoch
+                && cas_word8(&seg->bitmap[block_idx], mark, nonmovingMarkEpoch) == mark) {
+                queue->live_words += words;
+            }
+        } else
+#endif
+        {
+            nonmovingSetMark(seg, block_idx);
+            nonmoving_segment_live_words += words;
+        }
     }
 
     // If we found a indirection to shortcut keep going.
@@ -1777,26 +2268,17 @@ done:
     }
 }
 
-/* This is the main mark loop.
- * Invariants:
- *
- *  a. nonmovingPrepareMark has been called.
- *  b. the nursery has been fully evacuated into the non-moving generation.
- *  c. the mark queue has been seeded with a set of roots.
- *
- * If budget is not UNLIMITED_MARK_BUDGET, then we will mark no more than the
- * indicated number of objects and deduct the work done from the budget.
+/* Mark from queue until it and the global update remembered set are empty,
+ * in which case it returns true, or until the budget runs out. Adds the number
+ * of entries marked to *count.
  */
-GNUC_ATTR_HOT void
-nonmovingMark (MarkBudget* budget, MarkQueue *queue)
+static GNUC_ATTR_HOT bool
+mark_loop (MarkBudget* budget, MarkQueue *queue, uint64_t *count)
 {
-    traceConcMarkBegin();
-    debugTrace(DEBUG_nonmoving_gc, "Starting mark pass");
-    uint64_t count = 0;
     while (true) {
-        count++;
+        (*count)++;
         if (*budget == 0) {
-            return;
+            return false;
         } else if (*budget != UNLIMITED_MARK_BUDGET) {
             *budget -= 1;
         }
@@ -1830,6 +2312,11 @@ nonmovingMark (MarkBudget* budget, MarkQueue *queue)
             // upd_rem_set_lock.
             if (RELAXED_LOAD(&upd_rem_set_block_list) != NULL) {
                 ACQUIRE_LOCK(&upd_rem_set_lock);
+                if (upd_rem_set_block_list == NULL) {
+                    // Another mark worker got there first
+                    RELEASE_LOCK(&upd_rem_set_lock);
+                    break;
+                }
                 bdescr *old = queue->blocks;
                 queue->blocks = upd_rem_set_block_list;
                 queue->top = (MarkQueueBlock *) queue->blocks->start;
@@ -1837,18 +2324,160 @@ nonmovingMark (MarkBudget* budget, MarkQueue *queue)
                 RELEASE_LOCK(&upd_rem_set_lock);
 
                 ACQUIRE_SM_LOCK;
-                freeGroup(old);
+                freeMarkQueueBlock(old);
                 RELEASE_SM_LOCK;
+
+#if defined(THREADED_RTS)
+                if (RELAXED_LOAD(&mark_parallel)) {
+                    share_mark_blocks(queue);
+                }
+#endif
             } else {
                 // Nothing more to do
-                debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
-                traceConcMarkEnd(count);
-                return;
+                return true;
             }
         }
     }
 }
 
+#if defined(THREADED_RTS)
+/* Find more work for a mark worker whose queue is empty, returning false
+ * once the mark pass is over. See Note [Parallel nonmoving mark].
+ */
+static bool steal_mark_work (MarkQueue *queue)
+{
+    ACQUIRE_LOCK(&mark_pool_lock);
+    mark_workers_idle++;
+    while (true) {
+        bdescr *bd = mark_pool;
+        if (bd != NULL) {
+            mark_pool = bd->link;
+            mark_workers_idle--;
+            RELEASE_LOCK(&mark_pool_lock);
+
+            // The queue's last, empty block stays underneath
+            bd->link = queue->blocks;
+            queue->blocks = bd;
+            queue->top = (MarkQueueBlock *) bd->start;
+            return true;
+        }
+
+        if (RELAXED_LOAD(&upd_rem_set_block_list) != NULL) {
+            mark_workers_idle--;
+            RELEASE_LOCK(&mark_pool_lock);
+            return true;
+        }
+
+        if (mark_workers_idle == n_mark_worker_queues) {
+            RELEASE_LOCK(&mark_pool_lock);
+            return false;
+        }
+
+        RELEASE_LOCK(&mark_pool_lock);
+        yieldThread();
+        ACQUIRE_LOCK(&mark_pool_lock);
+    }
+}
+
+static void mark_worker (uint32_t worker)
+{
+    MarkQueue *queue = mark_worker_queues[worker];
+    MarkBudget budget = UNLIMITED_MARK_BUDGET;
+    uint64_t count = 0;
+    Time busy = 0, idle = 0;
+    Time t = getProcessElapsedTime();
+
+    perfPhaseStart(PERF_NONMOVING_MARK);
+    while (true) {
+        mark_loop(&budget, queue, &count);
+        Time now = getProcessElapsedTime();
+        busy += now - t;
+        t = now;
+
+        bool more = steal_mark_work(queue);
+        now = getProcessElapsedTime();
+        idle += now - t;
+        t = now;
+        if (!more) {
+            break;
+        }
+    }
+    perfPhaseEnd(PERF_NONMOVING_MARK);
+
+    mark_worker_counts[worker] = count;
+    traceConcMarkWorkerEnd(worker, count, busy, idle);
+}
+
+// Run a mark pass on all mark workers. See Note [Parallel nonmoving mark].
+static uint64_t parallel_mark (MarkQueue *queue)
+{
+    mark_worker_queues[0] = queue;
+    RELAXED_STORE(&mark_parallel, true);
+    share_mark_blocks(queue);
+
+    nonmovingRunOnHelpers(mark_worker, n_mark_worker_queues);
+
+    RELAXED_STORE(&mark_parallel, false);
+    ASSERT(mark_pool == NULL);
+    mark_workers_idle = 0;
+
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < n_mark_worker_queues; i++) {
+        MarkQueue *q = mark_worker_queues[i];
+        ASSERT(markQueueIsEmpty(q));
+        count += mark_worker_counts[i];
+        nonmoving_segment_live_words += q->live_words;
+        q->live_words = 0;
+    }
+    mark_worker_queues[0] = NULL;
+    return count;
+}
+#endif
+
+/* This is the main mark loop.
+ * Invariants:
+ *
+ *  a. nonmovingPrepareMark has been called.
+ *  b. the nursery has been fully evacuated into the non-moving generation.
+ *  c. the mark queue has been seeded with a set of roots.
+ *
+ * If budget is not UNLIMITED_MARK_BUDGET, then we will mark no more than the
+ * indicated number of objects and deduct the work done from the budget.
+ */
+GNUC_ATTR_HOT void
+nonmovingMark (MarkBudget* budget, MarkQueue *queue)
+{
+    traceConcMarkBegin();
+    debugTrace(DEBUG_nonmoving_gc, "Starting mark pass");
+    // See Note [Mark prefetch depth]
+    const bool tuning = nonmovingMarkPrefetchTuning();
+    const Time start = tuning ? getProcessElapsedTime() : 0;
+    uint64_t count = 0;
+    bool finished = true;
+    perfPhaseStart(PERF_NONMOVING_MARK);
+#if defined(THREADED_RTS)
+    // See Note [Parallel nonmoving mark]
+    if (*budget == UNLIMITED_MARK_BUDGET && !nonmoving_evacuating
+        && stg_min(n_mark_worker_queues, n_nonmoving_helpers + 1) > 1) {
+        count = parallel_mark(queue);
+    } else
+#endif
+    {
+        finished = mark_loop(budget, queue, &count);
+    }
+    perfPhaseEnd(PERF_NONMOVING_MARK);
+
+    if (tuning) {
+        prefetch_tune_time += getProcessElapsedTime() - start;
+    }
+    if (!finished) {
+        return;
+    }
+
+    debugTrace(DEBUG_nonmoving_gc, "Finished mark pass: %d", count);
+    traceConcMarkEnd(count);
+}
+
 // A variant of `isAlive` that works for non-moving heap. Used for:
 //
 // - Collecting weak pointers; checking key of a weak pointer.
@@ -73,8 +73,9 @@ typedef struct {
     MarkQueueEnt entries[];
 } MarkQueueBlock;
 
-// How far ahead in mark queue to prefetch?
-#define MARK_PREFETCH_QUEUE_DEPTH 5
+// How far ahead in mark queue may we prefetch? The depth actually used is
+// nonmoving_mark_prefetch_depth, see Note [Mark prefetch depth].
+#define MARK_PREFETCH_QUEUE_MAX_DEPTH 16
 
 /* The mark queue is not capable of concurrent read or write.
  *
@@ -94,9 +95,14 @@ typedef struct MarkQueue_ {
     // Is this a mark queue or a capability-local update remembered set?
     bool is_upd_rem_set;
 
-#if MARK_PREFETCH_QUEUE_DEPTH > 0
-    // A ring-buffer of entries which we will mark next
-    MarkQueueEnt prefetch_queue[MARK_PREFETCH_QUEUE_DEPTH];
+    // Words of segment blocks marked from this queue during a parallel mark
+    // pass. See Note [Parallel nonmoving mark].
+    memcount live_words;
+
+#if MARK_PREFETCH_QUEUE_MAX_DEPTH > 0
+    // A ring-buffer of entries which we will mark next, of which the first
+    // nonmoving_mark_prefetch_depth are used
+    MarkQueueEnt prefetch_queue[MARK_PREFETCH_QUEUE_MAX_DEPTH];
     // The first free slot in prefetch_queue.
     uint8_t prefetch_head;
 #endif
@@ -109,6 +115,11 @@ typedef struct MarkQueue_ {
  */
 typedef struct {
     MarkQueue queue;
+#if defined(THREADED_RTS)
+    // The last handshake the capability answered.
+    // See Note [Update remembered set handshake].
+    StgWord handshake_epoch;
+#endif
 } UpdRemSet;
 
 // How much marking work we are allowed to perform
@@ -142,13 +153,25 @@ extern StgIndStatic *debug_caf_list_snapshot;
 #endif
 
 extern MarkQueue *current_mark_queue;
+
+// See Note [Mark prefetch depth]
+extern uint32_t nonmoving_mark_prefetch_depth;
+bool nonmovingMarkPrefetchTuning(void);
+void nonmovingMarkTunePrefetch(memcount marked_words);
+#if defined(THREADED_RTS)
+// See Note [Parallel nonmoving mark]
+extern MarkQueue **mark_worker_queues;
+extern uint32_t n_mark_worker_queues;
+#endif
 extern bdescr *upd_rem_set_block_list;
 
 
 void nonmovingMarkInit(void);
+void nonmovingMarkExit(void);
 
 void nonmovingInitUpdRemSet(UpdRemSet *rset);
 void updateRemembSetPushClosure(Capability *cap, StgClosure *p);
+void updateRemembSetPushClosures_(StgRegTable *reg, StgClosure **p, StgWord n);
 void updateRemembSetPushThunk(Capability *cap, StgThunk *p);
 void updateRemembSetPushTSO(Capability *cap, StgTSO *tso);
 void updateRemembSetPushStack(Capability *cap, StgStack *stack);
@@ -159,12 +182,29 @@ void nonmovingFlushCapUpdRemSetBlocks(Capability *cap);
 void nonmovingBeginFlush(Task *task);
 bool nonmovingWaitForFlush(void);
 void nonmovingFinishFlush(Task *task);
+
+// See Note [Update remembered set handshake]
+struct NonmovingHandshakeStats {
+    uint32_t handshakes;        // handshakes requested
+    uint64_t answers;           // capabilities that answered in time ...
+    uint64_t stragglers;        // ... and those left to the sync
+    Time total_latency;         // summed over the answers in time
+    Time max_latency;
+};
+
+extern struct NonmovingHandshakeStats nonmoving_handshake_stats;
+extern volatile StgWord nonmoving_handshake_epoch;
+
+bool nonmovingHandshake(Task *task);
+void nonmovingAnswerHandshake(Capability *cap);
 #endif
 
 void markQueueAddRoot(MarkQueue* q, StgClosure** root);
 
 void initMarkQueue(MarkQueue *queue);
 void freeMarkQueue(MarkQueue *queue);
+// The blocks of all mark queues and update remembered sets
+StgWord nonmovingMarkQueueBlocks(void);
 void nonmovingMark(MarkBudget *budget, struct MarkQueue_ *STG_RESTRICT queue);
 INLINE_HEADER void nonmovingMarkUnlimitedBudget(struct MarkQueue_ *STG_RESTRICT queue) {
     MarkBudget budget = UNLIMITED_MARK_BUDGET;
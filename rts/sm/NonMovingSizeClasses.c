@@ -0,0 +1,195 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Non-moving garbage collector and allocator: size classes chosen from a
+ * profile of the program's object sizes.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Profiled size classes]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The allocators of Note [Allocator sizes] are fixed before the program
+   runs: dense allocators for small objects, then powers of two. An object
+   just above a power of two occupies a block nearly twice its size, and if
+   the program allocates many objects of that size the slop (the unused
+   words at the end of their blocks) can be a good part of the nonmoving
+   heap.
+
+   With --nonmoving-profile-size-classes each capability counts its
+   allocations into the nonmoving heap by size in words
+   (Capability.nonmoving_size_profile), from the start of the program. At the
+   first major GC by which SIZE_PROFILE_MIN_ALLOCS allocations have been
+   counted, nonmovingAdaptSizeClasses merges the profiles and greedily adds
+   allocators of the sizes that remove the most slop from the profiled
+   allocations. Adding an allocator of n words saves, for every allocation
+   of more than the next smaller allocator's block and at most n words, the
+   difference between its current block and n words. Since each allocator
+   costs a current segment on every capability we add at most
+   SIZE_PROFILE_MAX_ADDED of them, each saving at least 1% of the slop. The
+   profiles are then freed: the layout is configured once.
+
+   Allocators are only ever added, never removed or renumbered, so the
+   allocator_idx of the existing segments stays valid and nothing needs to be
+   moved. They are added during the synchronous part of a major GC, with the
+   mutators stopped and no concurrent mark running, so nothing is looking at
+   nonmovingHeap.allocators or the capabilities' current segments while they
+   are reallocated. The new allocators are appended to the array, which is
+   therefore no longer sorted by block size; allocation finds its allocator
+   through nonmoving_alloca_for_words, which is recomputed after each
+   addition.
+
+   The slop of the profiled allocations before and after is reported by +RTS
+   -s, as an estimate of the internal fragmentation the new allocators save.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "Capability.h"
+#include "NonMoving.h"
+#include "NonMovingSizeClasses.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+
+#define SIZE_PROFILE_MIN_ALLOCS 10000
+#define SIZE_PROFILE_MAX_ADDED 8
+
+struct NonmovingSizeClassStats nonmoving_size_class_stats = { 0, 0, 0, 0 };
+
+// Set once the allocators have been configured from the profile
+static bool profile_done = false;
+
+bool nonmovingSizeClassesProfiling(void)
+{
+    return RtsFlags.GcFlags.nonmovingProfileSizeClasses && !profile_done;
+}
+
+// A zeroed size profile for a new capability, or NULL if we aren't
+// profiling.
+StgWord *nonmovingNewSizeProfile(void)
+{
+    if (!nonmovingSizeClassesProfiling()) {
+        return NULL;
+    }
+    return stgCallocBytes(NONMOVING_SEGMENT_SIZE_W, sizeof(StgWord),
+                          "nonmovingNewSizeProfile");
+}
+
+// The slop (in bytes) of the profiled allocations with the current
+// allocators.
+static uint64_t profile_slop(const StgWord *profile)
+{
+    uint64_t slop = 0;
+    for (StgWord sz = 1; sz < NONMOVING_SEGMENT_SIZE_W; sz++) {
+        if (profile[sz] == 0) {
+            continue;
+        }
+        const uint16_t block_size =
+            nonmovingHeap.allocators[nonmovingAllocatorForWords(sz)].block_size;
+        slop += (uint64_t) profile[sz] * (block_size - sz * sizeof(StgWord));
+    }
+    return slop;
+}
+
+// The size (in words) of the allocator that would save the most slop on the
+// profiled allocations, setting *gain to the bytes saved, or 0 if no
+// allocator would save any.
+static StgWord best_new_size(const StgWord *profile, uint64_t *gain)
+{
+    StgWord best = 0;
+    *gain = 0;
+
+    // Sizes served by the same allocator are contiguous; an allocator of sz
+    // words would serve those of them up to sz.
+    uint16_t run_block_size = 0;
+    uint64_t run_allocs = 0;
+    for (StgWord sz = 1; sz < NONMOVING_SEGMENT_SIZE_W; sz++) {
+        const uint16_t block_size =
+            nonmovingHeap.allocators[nonmovingAllocatorForWords(sz)].block_size;
+        if (block_size != run_block_size) {
+            run_block_size = block_size;
+            run_allocs = 0;
+        }
+        run_allocs += profile[sz];
+        if (profile[sz] == 0 || block_size == sz * sizeof(StgWord)) {
+            continue;
+        }
+        const uint64_t g = (block_size - sz * sizeof(StgWord)) * run_allocs;
+        if (g > *gain) {
+            best = sz;
+            *gain = g;
+        }
+    }
+    return best;
+}
+
+/* Add allocators as the size profile suggests, once it is large enough.
+ * Called in the synchronous part of a major GC, holding SM_LOCK.
+ */
+void nonmovingAdaptSizeClasses(void)
+{
+    if (!nonmovingSizeClassesProfiling()) {
+        return;
+    }
+#if defined(THREADED_RTS)
+    if (nonmovingConcurrentMarkIsRunning()) {
+        return;
+    }
+#endif
+
+    StgWord *profile = stgCallocBytes(NONMOVING_SEGMENT_SIZE_W, sizeof(StgWord),
+                                      "nonmovingAdaptSizeClasses");
+    uint64_t n_allocs = 0;
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        const StgWord *p = getCapability(i)->nonmoving_size_profile;
+        if (p == NULL) {
+            continue;
+        }
+        for (StgWord sz = 0; sz < NONMOVING_SEGMENT_SIZE_W; sz++) {
+            profile[sz] += p[sz];
+            n_allocs += p[sz];
+        }
+    }
+
+    if (n_allocs < SIZE_PROFILE_MIN_ALLOCS) {
+        stgFree(profile);
+        return;
+    }
+
+    const uint64_t slop_before = profile_slop(profile);
+    uint64_t slop = slop_before;
+    uint32_t added = 0;
+    while (added < SIZE_PROFILE_MAX_ADDED && nonmoving_alloca_cnt < UINT8_MAX) {
+        uint64_t gain;
+        const StgWord sz = best_new_size(profile, &gain);
+        if (sz == 0 || gain * 100 < slop_before) {
+            break;
+        }
+        debugTrace(DEBUG_nonmoving_gc,
+                   "Adding allocator of %" FMT_Word " byte blocks, saving %"
+                   FMT_Word64 " bytes of slop on the profiled allocations",
+                   (W_) (sz * sizeof(StgWord)), gain);
+        nonmovingAddAllocator(sz * sizeof(StgWord));
+        slop -= gain;
+        added++;
+    }
+    ASSERT(slop == profile_slop(profile));
+
+    nonmoving_size_class_stats = (struct NonmovingSizeClassStats) {
+        .added = added,
+        .profiled_allocs = n_allocs,
+        .slop_before = slop_before,
+        .slop_after = slop,
+    };
+
+    for (uint32_t i = 0; i < getNumCapabilities(); i++) {
+        Capability *cap = getCapability(i);
+        if (cap->nonmoving_size_profile != NULL) {
+            stgFree(cap->nonmoving_size_profile);
+            cap->nonmoving_size_profile = NULL;
+        }
+    }
+    stgFree(profile);
+    profile_done = true;
+}
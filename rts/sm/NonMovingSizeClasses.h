@@ -0,0 +1,28 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Non-moving garbage collector and allocator: size classes chosen from a
+ * profile of the program's object sizes.
+ * See Note [Profiled size classes] in NonMovingSizeClasses.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+struct NonmovingSizeClassStats {
+    uint32_t added;             // allocators added from the profile
+    uint64_t profiled_allocs;   // allocations in the profile
+    uint64_t slop_before;       // slop of the profiled allocations (bytes) ...
+    uint64_t slop_after;        // ... and with the added allocators
+};
+
+extern struct NonmovingSizeClassStats nonmoving_size_class_stats;
+
+StgWord *nonmovingNewSizeProfile(void);
+bool nonmovingSizeClassesProfiling(void);
+void nonmovingAdaptSizeClasses(void);
+
+#include "EndPrivate.h"
@@ -11,6 +11,7 @@
 #include "NonMoving.h"
 #include "NonMovingMark.h" // for nonmovingIsAlive
 #include "Capability.h"
+#include "RtsUtils.h"
 #include "GCThread.h" // for GCUtils.h
 #include "GCUtils.h"
 #include "Storage.h"
@@ -129,15 +130,69 @@ nonmovingClearSegmentFreeBlocks(struct NonmovingSegment* seg)
     }
 }
 
-GNUC_ATTR_HOT void nonmovingSweep(void)
-{
-    while (nonmovingHeap.sweep_list) {
-        struct NonmovingSegment *seg = nonmovingHeap.sweep_list;
+/* Note [Parallel nonmoving sweep]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * With --nonmoving-sweep-threads=<n> the mark thread is joined by n-1 of the
+ * collector's helper threads (see Note [Nonmoving GC helper threads] in
+ * NonMoving.c) for the sweep. The work is handed out in two rounds, each of
+ * which the mark thread waits to complete:
+ *
+ *  1. nonmovingSweepStableNameTable: the workers claim chunks of
+ *     SWEEP_SN_CHUNK entries of the stable name table and decide which
+ *     entries are dead. Freeing an entry updates addrToStableHash and the
+ *     free list, so the dead entries are only chained together (through their
+ *     addr fields, which makes them look like free slots to
+ *     FOR_EACH_STABLE_NAME) and the mark thread frees them once the round is
+ *     done. This round must finish before any segment is swept, as is_alive
+ *     relies on the segments' FILLED_SWEEPING state.
+ *
+ *  2. nonmovingSweep: the workers pop segments off nonmovingHeap.sweep_list
+ *     with a CAS and push them to the free, active or filled lists, all of
+ *     which are lock-free. Nothing is pushed to the sweep list during the
+ *     sweep, so popping doesn't suffer from ABA. The large objects that
+ *     nonmovingSweepLargeObjects found dead are freed by whichever worker
+ *     gets to them first, alongside the segment sweep: freeing blocks needs
+ *     sm_mutex, so splitting the chain between workers would only have them
+ *     contend on the lock.
+ *
+ * With a single sweep thread (the default, and always in the non-threaded
+ * RTS) the mark thread does all of this itself, as before.
+ */
+
+#define SWEEP_SN_CHUNK 4096
 
+// Large objects found dead by nonmovingSweepLargeObjects, waiting for
+// nonmovingSweep to free them
+static bdescr *dead_large_objects = NULL;
+
+static void freeChain_lock_max(bdescr *bd, int max_dur);
+
+static struct NonmovingSegment *pop_sweep_segment(void)
+{
+    while (true) {
+        struct NonmovingSegment *seg = ACQUIRE_LOAD(&nonmovingHeap.sweep_list);
+        if (seg == NULL) {
+            return NULL;
+        }
         // Pushing the segment to one of the free/active/filled segments
         // updates the link field, so update sweep_list here
-        nonmovingHeap.sweep_list = seg->link;
+        struct NonmovingSegment *next = RELAXED_LOAD(&seg->link);
+        if (cas((StgVolatilePtr) &nonmovingHeap.sweep_list,
+                (StgWord) seg, (StgWord) next) == (StgWord) seg) {
+            return seg;
+        }
+    }
+}
+
+static void sweep_segments(void)
+{
+    bdescr *large = (bdescr *) xchg((StgPtr) &dead_large_objects, 0);
+    if (large != NULL) {
+        freeChain_lock_max(large, 10000);
+    }
 
+    struct NonmovingSegment *seg;
+    while ((seg = pop_sweep_segment()) != NULL) {
         enum SweepResult ret = nonmovingSweepSegment(seg);
 
         switch (ret) {
@@ -158,6 +213,31 @@ GNUC_ATTR_HOT void nonmovingSweep(void)
     }
 }
 
+// How many threads sweep: --nonmoving-sweep-threads, limited to the helper
+// threads that have been started
+static uint32_t sweep_workers(void)
+{
+    return stg_min(RtsFlags.GcFlags.nonmovingSweepThreads,
+                   n_nonmoving_helpers + 1);
+}
+
+static void sweep_segments_job(uint32_t worker STG_UNUSED)
+{
+    sweep_segments();
+}
+
+GNUC_ATTR_HOT void nonmovingSweep(void)
+{
+    // See Note [Parallel nonmoving sweep]
+    const uint32_t n = sweep_workers();
+    if (n > 1) {
+        nonmovingRunOnHelpers(sweep_segments_job, n);
+    } else {
+        sweep_segments();
+    }
+    ASSERT(dead_large_objects == NULL);
+}
+
 /* Must a closure remain on the mutable list?
  *
  * A closure must remain if any of the following applies:
@@ -326,7 +406,13 @@ static void freeChain_lock_max(bdescr *bd, int max_dur)
 
 void nonmovingSweepLargeObjects(void)
 {
-    freeChain_lock_max(nonmoving_large_objects, 10000);
+    if (sweep_workers() > 1) {
+        // Freed by nonmovingSweep, see Note [Parallel nonmoving sweep]
+        ASSERT(dead_large_objects == NULL);
+        dead_large_objects = nonmoving_large_objects;
+    } else {
+        freeChain_lock_max(nonmoving_large_objects, 10000);
+    }
     nonmoving_large_objects = nonmoving_marked_large_objects;
     n_nonmoving_large_blocks = n_nonmoving_marked_large_blocks;
     nonmoving_marked_large_objects = NULL;
@@ -367,6 +453,54 @@ static bool is_alive(StgClosure *p)
     }
 }
 
+// The next chunk of the stable name table to sweep, and the entries found
+// dead so far, chained through their addr fields
+static StgWord sweep_sn_next;
+static snEntry *dead_sn_entries;
+
+static void sweep_stable_names(uint32_t worker STG_UNUSED)
+{
+    snEntry *dead = NULL, *dead_tail = NULL;
+
+    while (true) {
+        StgWord from = atomic_inc((StgVolatilePtr) &sweep_sn_next,
+                                  SWEEP_SN_CHUNK) - SWEEP_SN_CHUNK;
+        if (from >= SNT_size) {
+            break;
+        }
+        StgWord to = stg_min(from + SWEEP_SN_CHUNK, SNT_size);
+
+        FOR_EACH_STABLE_NAME_IN(
+            p, from, to, {
+                if (p->sn_obj != NULL) {
+                    if (!is_alive((StgClosure*)p->sn_obj)) {
+                        p->sn_obj = NULL; // Just to make an assertion happy
+                        p->addr = (P_) dead;
+                        dead = p;
+                        if (dead_tail == NULL) {
+                            dead_tail = p;
+                        }
+                    } else if (p->addr != NULL) {
+                        if (!is_alive((StgClosure*)p->addr)) {
+                            p->addr = NULL;
+                        }
+                    }
+                }
+            });
+    }
+
+    if (dead != NULL) {
+        while (true) {
+            snEntry *old = ACQUIRE_LOAD(&dead_sn_entries);
+            dead_tail->addr = (P_) old;
+            if (cas((StgVolatilePtr) &dead_sn_entries,
+                    (StgWord) old, (StgWord) dead) == (StgWord) old) {
+                break;
+            }
+        }
+    }
+}
+
 void nonmovingSweepStableNameTable(void)
 {
     // See comments in gcStableTables
@@ -391,18 +525,33 @@ void nonmovingSweepStableNameTable(void)
     // nonmovingIsAlive on those objects. Inefficient.
 
     stableNameLock();
-    FOR_EACH_STABLE_NAME(
-        p, {
-            if (p->sn_obj != NULL) {
-                if (!is_alive((StgClosure*)p->sn_obj)) {
-                    p->sn_obj = NULL; // Just to make an assertion happy
-                    freeSnEntry(p);
-                } else if (p->addr != NULL) {
-                    if (!is_alive((StgClosure*)p->addr)) {
-                        p->addr = NULL;
+    const uint32_t n = sweep_workers();
+    if (n > 1) {
+        // See Note [Parallel nonmoving sweep]
+        sweep_sn_next = 1;
+        dead_sn_entries = NULL;
+        nonmovingRunOnHelpers(sweep_stable_names, n);
+
+        snEntry *next;
+        for (snEntry *p = dead_sn_entries; p != NULL; p = next) {
+            next = (snEntry *) p->addr;
+            freeSnEntry(p);
+        }
+        dead_sn_entries = NULL;
+    } else {
+        FOR_EACH_STABLE_NAME(
+            p, {
+                if (p->sn_obj != NULL) {
+                    if (!is_alive((StgClosure*)p->sn_obj)) {
+                        p->sn_obj = NULL; // Just to make an assertion happy
+                        freeSnEntry(p);
+                    } else if (p->addr != NULL) {
+                        if (!is_alive((StgClosure*)p->addr)) {
+                            p->addr = NULL;
+                        }
                     }
                 }
-            }
-        });
+            });
+    }
     stableNameUnlock();
 }
@@ -21,8 +21,27 @@ bool osBuiltWithNumaSupport(void); // See #14956
 bool osNumaAvailable(void);
 uint32_t osNumaNodes(void);
 uint64_t osNumaMask(void);
+// Relative distance between two physical NUMA nodes, in the units of the
+// ACPI SLIT table (10 for the local node).
+uint32_t osNumaDistance(uint32_t from, uint32_t to);
 void osBindMBlocksToNode(void *addr, StgWord size, uint32_t node);
 
+// Replace the heap memory at @p, covering @len bytes rounded up to whole
+// pages, with a private copy-on-write mapping of the file @fd from @offset.
+// @p and @offset must be page aligned, and the file must hold @len bytes
+// from @offset. Returns false if the file can't be mapped, in which case
+// the memory is still committed but its contents are undefined.
+bool osMapFileMemory(void *p, W_ len, int fd, StgWord64 offset);
+
+// Undo osMapFileMemory, giving the memory back its ordinary backing.
+void osUnmapFileMemory(void *p, W_ len);
+
+#if defined(wasm32_HOST_ARCH)
+// The end of linear memory, where the next megablocks will come from.
+// See Note [Growing the heap on wasm].
+void *osMBlocksEnd(void);
+#endif
+
 INLINE_HEADER size_t
 roundDownToPage (size_t x)
 {
@@ -84,6 +103,12 @@ void osCommitMemory(void *p, W_ len);
 // from top are concerned).
 void osDecommitMemory(void *p, W_ len);
 
+// Returns the size of a transparent huge page, or 0 if huge pages are not
+// supported on this platform. When -xH is given, the heap is reserved, committed
+// and decommitted in units of this size; see Note [Huge page backed heap] in
+// MBlock.c.
+W_ osHugePageSize(void);
+
 // Release the address space previously obtained and undo the effects of
 // osReserveHeapMemory
 //
@@ -0,0 +1,144 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Accounting of the live data in pinned blocks during GC.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Pinned block liveness]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The GC treats a block of small pinned objects as one large object (see
+   allocatePinned): the first reference into the block evacuates all of it,
+   and nothing records how much of it is still live. With --pinned-liveness
+   we measure that, so that fragmentation of the pinned heap can be seen
+   (and the effect of --pinned-ephemeral, see Note [Ephemeral pinned blocks]
+   in Storage.c, judged).
+
+   When evacuate_large first evacuates a pinned block of a single block in
+   this GC, it adds the block to the pinned_liveness table, with a bitmap of
+   the words of the block holding the start of a live object. Every time
+   evacuate then finds a reference to an object in a block of the table it
+   sets the object's bit, and adds the object's size to the block's live
+   words if the bit wasn't set yet. Pinned objects are byte arrays, so the
+   GC doesn't scavenge them and never finds references from one to another:
+   the references we see are exactly those that keep the objects alive.
+   Blocks of a single large pinned object aren't counted, as they hold
+   nothing else; neither are blocks in generations we aren't collecting, nor
+   the capabilities' current pinned blocks, which aren't evacuated.
+
+   The table is shared by the GC threads and guarded by a spin lock; taking
+   it for every reference to a pinned object is what this costs, which is
+   why it is optional. At the end of the GC pinnedLivenessEndGC adds up the
+   table and posts a PINNED_FRAGMENTATION event (with -lg), giving the number
+   of pinned blocks retained, how many of them are less than half live, and
+   the bytes allocated in them and still live.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "PinnedLiveness.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+
+typedef struct {
+    StgWord live_words;
+    StgWord marks[BLOCK_SIZE_W / BITS_IN(StgWord)];
+} PinnedBlockLiveness;
+
+HashTable *pinned_liveness = NULL;
+
+#if defined(THREADED_RTS)
+static SpinLock pinned_liveness_lock;
+#endif
+
+void pinnedLivenessStartGC(void)
+{
+    ASSERT(pinned_liveness == NULL);
+#if defined(THREADED_RTS)
+    initSpinLock(&pinned_liveness_lock);
+#endif
+    pinned_liveness = allocHashTable();
+}
+
+/* Called by evacuate_large when it finds a pinned block not yet evacuated in
+ * this GC, before it sets BF_EVACUATED. Two GC threads may both get here for
+ * the same block, before one of them claims it; the second does nothing.
+ */
+void pinnedLivenessAddBlock(bdescr *bd)
+{
+    if (bd->blocks != 1) {
+        return;
+    }
+    PinnedBlockLiveness *l =
+        stgCallocBytes(1, sizeof(PinnedBlockLiveness), "pinnedLivenessAddBlock");
+    ACQUIRE_SPIN_LOCK(&pinned_liveness_lock);
+    if (lookupHashTable(pinned_liveness, (StgWord) bd) == NULL) {
+        insertHashTable(pinned_liveness, (StgWord) bd, l);
+        l = NULL;
+    }
+    RELEASE_SPIN_LOCK(&pinned_liveness_lock);
+    stgFree(l);
+}
+
+// We found a reference to q, a pinned object in bd.
+void pinnedLivenessMark(bdescr *bd, StgClosure *q)
+{
+    const StgWord off = (P_) q - bd->start;
+    const StgWord bit = (StgWord) 1 << (off % BITS_IN(StgWord));
+
+    ACQUIRE_SPIN_LOCK(&pinned_liveness_lock);
+    PinnedBlockLiveness *l = lookupHashTable(pinned_liveness, (StgWord) bd);
+    if (l != NULL && !(l->marks[off / BITS_IN(StgWord)] & bit)) {
+        ASSERT(get_itbl(q)->type == ARR_WORDS);
+        l->marks[off / BITS_IN(StgWord)] |= bit;
+        l->live_words += arr_words_sizeW((StgArrBytes *) q);
+    }
+    RELEASE_SPIN_LOCK(&pinned_liveness_lock);
+}
+
+struct PinnedLivenessTotals {
+    uint32_t blocks;
+    uint32_t sparse_blocks;     // blocks less than half live
+    StgWord used_words;
+    StgWord live_words;
+};
+
+static void add_block(void *data, StgWord key, const void *value)
+{
+    struct PinnedLivenessTotals *t = data;
+    const bdescr *bd = (const bdescr *) key;
+    const PinnedBlockLiveness *l = value;
+    const StgWord used = bd->free - bd->start;
+
+    ASSERT(l->live_words <= used);
+    t->blocks++;
+    t->used_words += used;
+    t->live_words += l->live_words;
+    if (l->live_words * 2 < used) {
+        t->sparse_blocks++;
+    }
+}
+
+/* Called by the GC leader once all live objects have been evacuated. */
+void pinnedLivenessEndGC(void)
+{
+    struct PinnedLivenessTotals t = { 0, 0, 0, 0 };
+    mapHashTable(pinned_liveness, &t, add_block);
+
+    debugTrace(DEBUG_gc,
+               "pinned blocks: %" FMT_Word32 " retained (%" FMT_Word32
+               " less than half live), %" FMT_Word " of %" FMT_Word
+               " bytes live",
+               t.blocks, t.sparse_blocks,
+               (W_) (t.live_words * sizeof(W_)),
+               (W_) (t.used_words * sizeof(W_)));
+    traceEventPinnedFragmentation(CAPSET_HEAP_DEFAULT, t.blocks,
+                                  t.sparse_blocks,
+                                  t.used_words * sizeof(W_),
+                                  t.live_words * sizeof(W_));
+
+    freeHashTable(pinned_liveness, stgFree);
+    pinned_liveness = NULL;
+}
@@ -0,0 +1,24 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Accounting of the live data in pinned blocks during GC.
+ * See Note [Pinned block liveness] in PinnedLiveness.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "Hash.h"
+
+#include "BeginPrivate.h"
+
+// The pinned blocks being accounted in this GC, or NULL if we aren't
+extern HashTable *pinned_liveness;
+
+void pinnedLivenessStartGC(void);
+void pinnedLivenessAddBlock(bdescr *bd);
+void pinnedLivenessMark(bdescr *bd, StgClosure *q);
+void pinnedLivenessEndGC(void);
+
+#include "EndPrivate.h"
@@ -0,0 +1,163 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Pretenuring of long-lived objects, guided by per info table survival.
+ *
+ * ---------------------------------------------------------------------------*/
+
+/* Note [Pretenuring]
+   ~~~~~~~~~~~~~~~~~~
+   With three or more generations, an object that lives long is copied out of
+   the nursery, then out of each intermediate generation in turn, before it
+   settles in the oldest generation. With --pretenure the GC learns which
+   info tables such objects have, and evacuates their objects from generation
+   0 straight into the oldest generation, saving the intermediate copies.
+   Objects are still allocated in the nursery: the allocation sites are in
+   compiled code, which we can't redirect.
+
+   Every evacuation of a small object is counted against its info table in a
+   direct-mapped table of PRETENURE_TABLE_SIZE slots private to each GC
+   thread (gc_thread.pretenure_samples), so that the parallel GC threads
+   don't contend for shared counters; an info table that collides with
+   another one already in its slot in this GC just isn't counted. We count
+   "young" copies out of generation 0 and "old" copies out of any older
+   generation. For the objects of one info table, allocated at a steady rate,
+   the ratio old/young is about the number of further collections the
+   survivors of the nursery go on to survive, so a table whose ratio reaches
+   the --pretenure threshold (1 by default) is worth pretenuring.
+
+   After each GC the leader merges the threads' samples into a global table
+   (pretenureMergeSamples) and recomputes which tables are pretenured
+   (pretenureUpdate), once a table has at least PRETENURE_MIN_SAMPLES young
+   copies. Pretenured objects are still counted: their copies out of
+   generation 0 are young copies, and as they now skip the intermediate
+   generations their old copies come from major GCs, so a table stops being
+   pretenured if its objects stop living long. Each major GC halves the
+   global counts, so that the decisions follow changes in the program's
+   behaviour, and frees the slots of tables no longer seen.
+
+   Promoting an object early is always safe: its fields are then scavenged
+   with the oldest generation as evac_gen_no, so whatever it points to is
+   promoted eagerly too, or recorded in the mutable list. The decisions are
+   traced with -Dg, together with the info table's name when the program
+   has info table provenance (IPE) data.
+*/
+
+#include "rts/PosixSource.h"
+#include "Rts.h"
+
+#include "Pretenure.h"
+#include "GCThread.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+
+#include <string.h>
+
+#define PRETENURE_MIN_SAMPLES 1000
+
+const StgInfoTable *pretenured_infos[PRETENURE_TABLE_SIZE];
+
+// The samples of all GCs so far, decayed at every major GC
+static PretenureSample pretenure_stats[PRETENURE_TABLE_SIZE];
+
+PretenureSample *
+allocPretenureSamples (void)
+{
+    PretenureSample *samples =
+        stgMallocBytes(PRETENURE_TABLE_SIZE * sizeof(PretenureSample),
+                       "allocPretenureSamples");
+    memset(samples, 0, PRETENURE_TABLE_SIZE * sizeof(PretenureSample));
+    return samples;
+}
+
+// Add the samples of one GC thread to the global table, and clear them.
+void
+pretenureMergeSamples (PretenureSample *samples)
+{
+    for (uint32_t i = 0; i < PRETENURE_TABLE_SIZE; i++) {
+        PretenureSample *s = &samples[i];
+        PretenureSample *g = &pretenure_stats[i];
+
+        if (s->info == NULL) {
+            continue;
+        }
+
+        // A different table in the slot makes way for a busier one, unless
+        // it is pretenured.
+        if (g->info != s->info && g->info != NULL
+            && (pretenured_infos[i] == g->info
+                || g->young + g->old >= s->young + s->old)) {
+            s->info = NULL;
+            s->young = s->old = 0;
+            continue;
+        }
+
+        if (g->info != s->info) {
+            g->info = s->info;
+            g->young = g->old = 0;
+            pretenured_infos[i] = NULL;
+        }
+        g->young += s->young;
+        g->old += s->old;
+
+        s->info = NULL;
+        s->young = s->old = 0;
+    }
+}
+
+static void
+trace_decision (const PretenureSample *s, bool pretenure)
+{
+#if defined(DEBUG)
+    if (RtsFlags.DebugFlags.gc) {
+        InfoProvEnt ipe;
+        const char *name = "<no IPE>";
+        if (lookupIPE(s->info, &ipe)) {
+            name = ipe.prov.table_name;
+        }
+        debugBelch("pretenure: %s %p %s (%" FMT_Word " young, %" FMT_Word
+                   " old copies)\n",
+                   pretenure ? "start" : "stop", s->info, name,
+                   s->young, s->old);
+    }
+#else
+    (void)s;
+    (void)pretenure;
+#endif
+}
+
+// Recompute the pretenured tables from the global samples.
+void
+pretenureUpdate (bool major_gc)
+{
+    const double threshold = RtsFlags.GcFlags.pretenureThreshold;
+
+    for (uint32_t i = 0; i < PRETENURE_TABLE_SIZE; i++) {
+        PretenureSample *g = &pretenure_stats[i];
+
+        if (g->info == NULL) {
+            continue;
+        }
+
+        if (g->young >= PRETENURE_MIN_SAMPLES) {
+            const bool pretenure = g->old >= g->young * threshold;
+            if (pretenure != (pretenured_infos[i] == g->info)) {
+                trace_decision(g, pretenure);
+                pretenured_infos[i] = pretenure ? g->info : NULL;
+            }
+        }
+
+        if (major_gc) {
+            g->young /= 2;
+            g->old /= 2;
+            if (g->young == 0 && g->old == 0) {
+                if (pretenured_infos[i] == g->info) {
+                    trace_decision(g, false);
+                    pretenured_infos[i] = NULL;
+                }
+                g->info = NULL;
+            }
+        }
+    }
+}
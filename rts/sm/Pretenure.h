@@ -0,0 +1,38 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2026
+ *
+ * Pretenuring of long-lived objects, guided by per info table survival.
+ * See Note [Pretenuring] in Pretenure.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+#define PRETENURE_TABLE_BITS 10
+#define PRETENURE_TABLE_SIZE (1 << PRETENURE_TABLE_BITS)
+
+typedef struct PretenureSample_ {
+    const StgInfoTable *info;
+    StgWord young;              // copies out of generation 0
+    StgWord old;                // copies out of older generations
+} PretenureSample;
+
+// The info tables whose objects are evacuated from generation 0 straight to
+// the oldest generation, indexed by pretenureHash(). Only written between
+// GCs, by pretenureUpdate().
+extern const StgInfoTable *pretenured_infos[PRETENURE_TABLE_SIZE];
+
+INLINE_HEADER StgWord pretenureHash (const StgInfoTable *info)
+{
+    const StgWord w = (StgWord)info >> 3;
+    return (w ^ (w >> PRETENURE_TABLE_BITS)) & (PRETENURE_TABLE_SIZE - 1);
+}
+
+PretenureSample *allocPretenureSamples (void);
+void pretenureMergeSamples (PretenureSample *samples);
+void pretenureUpdate (bool major_gc);
+
+#include "EndPrivate.h"
@@ -21,6 +21,7 @@
 #include "RtsUtils.h"
 #include "sm/Storage.h"
 #include "sm/BlockAlloc.h"
+#include "sm/GC.h"
 #include "GCThread.h"
 #include "Sanity.h"
 #include "Schedule.h"
@@ -29,6 +30,7 @@
 #include "Arena.h"
 #include "RetainerProfile.h"
 #include "CNF.h"
+#include "sm/IdleWork.h"
 #include "sm/NonMoving.h"
 #include "sm/NonMovingMark.h"
 #include "Profiling.h" // prof_arena
@@ -43,7 +45,8 @@ static void  checkSmallBitmap    ( StgPtr payload, StgWord bitmap, uint32_t );
 static void  checkLargeBitmap    ( StgPtr payload, StgLargeBitmap*, uint32_t );
 static void  checkClosureShallow ( const StgClosure * );
 
-static void  checkCompactObjects (bdescr *bd);
+static void  checkLargeObject    (bdescr *bd);
+static void  checkCompactObject  (bdescr *bd);
 
 static W_    countNonMovingSegments ( struct NonmovingSegment *segs );
 static W_    countNonMovingHeap     ( struct NonmovingHeap *heap );
@@ -593,22 +596,27 @@ checkClosure( const StgClosure* p )
    all the objects in the remainder of the chain.
    -------------------------------------------------------------------------- */
 
+static void checkHeapBlock (bdescr *bd)
+{
+    if(!(bd->flags & BF_SWEPT)) {
+        StgPtr p = bd->start;
+        while (p < bd->free) {
+            uint32_t size = checkClosure((StgClosure *)p);
+            /* This is the smallest size of closure that can live in the heap */
+            ASSERT( size >= MIN_PAYLOAD_SIZE + sizeofW(StgHeader) );
+            p += size;
+
+            /* skip over slop, see Note [slop on the heap] */
+            while (p < bd->free &&
+                   (*p < 0x1000 || !LOOKS_LIKE_INFO_PTR(*p))) { p++; }
+        }
+    }
+}
+
 void checkHeapChain (bdescr *bd)
 {
     for (; bd != NULL; bd = bd->link) {
-        if(!(bd->flags & BF_SWEPT)) {
-            StgPtr p = bd->start;
-            while (p < bd->free) {
-                uint32_t size = checkClosure((StgClosure *)p);
-                /* This is the smallest size of closure that can live in the heap */
-                ASSERT( size >= MIN_PAYLOAD_SIZE + sizeofW(StgHeader) );
-                p += size;
-
-                /* skip over slop, see Note [slop on the heap] */
-                while (p < bd->free &&
-                       (*p < 0x1000 || !LOOKS_LIKE_INFO_PTR(*p))) { p++; }
-            }
-        }
+        checkHeapBlock(bd);
     }
 }
 
@@ -618,37 +626,170 @@ void checkHeapChain (bdescr *bd)
  * After a concurrent sweep the nonmoving heap can be checked for validity.
  * -------------------------------------------------------------------------- */
 
-static void checkNonmovingSegments (struct NonmovingSegment *seg)
+static void checkNonmovingSegment (struct NonmovingSegment *seg)
 {
-    while (seg != NULL) {
-        const nonmoving_block_idx count = nonmovingSegmentBlockCount(seg);
-        for (nonmoving_block_idx i=0; i < count; i++) {
-            if (seg->bitmap[i] == nonmovingMarkEpoch) {
-                StgPtr p = nonmovingSegmentGetBlock(seg, i);
-                checkClosure((StgClosure *) p);
-            } else if (i < nonmovingSegmentInfo(seg)->next_free_snap){
-                seg->bitmap[i] = 0;
-            }
+    const nonmoving_block_idx count = nonmovingSegmentBlockCount(seg);
+    for (nonmoving_block_idx i=0; i < count; i++) {
+        if (seg->bitmap[i] == nonmovingMarkEpoch) {
+            StgPtr p = nonmovingSegmentGetBlock(seg, i);
+            checkClosure((StgClosure *) p);
+        } else if (i < nonmovingSegmentInfo(seg)->next_free_snap){
+            seg->bitmap[i] = 0;
+        }
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Note [Parallel and sampled sanity checking]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   Checking every closure of the heap after every GC makes -DS too slow for
+   a realistic heap, so the heap walks of checkFullHeap() and
+   checkNonmovingHeap() can be shared out and sampled:
+
+    * The parts of the heap to check are first listed as SanityItems: a
+      block of a block chain, a large object, a compact region, or a
+      nonmoving segment. These are independent; checking one only reads
+      the heap, apart from checkNonmovingSegment() clearing the bitmap of
+      its own segment.
+
+    * With --sanity-sample=<n>, each item is listed with probability 1/<n>,
+      chosen afresh each time, so every part of the heap is checked every
+      <n> GCs or so on average. The cheap checks (block counts, mutable
+      lists, weak pointer lists, the TSO list, the free lists and the
+      nurseries) are still done in full, and so are nonmoving segments,
+      as checkNonmovingSegment() must clear the bitmap of every one.
+
+    * The threads checking the items claim SANITY_CHUNK of them at a time
+      with an atomic counter. After a parallel GC, checkSanity() is called
+      while the GC threads wait to be released, so it borrows them with
+      runGcTask() (see Note [Running tasks on exited GC threads] in GC.c).
+      The check before GC, and the one at the end of a nonmoving sweep,
+      run on the calling thread only.
+
+   A failed check barfs on whichever thread found it, as before.
+   -------------------------------------------------------------------------- */
+
+typedef enum {
+    SANITY_BLOCK,           // a block of a block chain: checkHeapBlock
+    SANITY_LARGE,           // a large object: checkLargeObject
+    SANITY_COMPACT,         // a compact region: checkCompactObject
+    SANITY_SEGMENT,         // a nonmoving segment: checkNonmovingSegment
+} SanityItemKind;
+
+typedef struct {
+    SanityItemKind kind;
+    void *item;
+} SanityItem;
+
+// Items claimed by a thread at a time
+#define SANITY_CHUNK 16
+
+static SanityItem *sanity_items = NULL;
+static StgWord n_sanity_items = 0;
+static StgWord sanity_items_size = 0;
+static StgWord sanity_items_claimed;    // claimed with atomic_inc()
+static uint32_t sanity_seed = 1;        // xorshift32 state, never 0
+
+static void
+addSanityItem (SanityItemKind kind, void *item)
+{
+    const uint32_t rate = RtsFlags.DebugFlags.sanitySampleRate;
+    if (rate > 1 && kind != SANITY_SEGMENT
+        && xorshift32(&sanity_seed) % rate != 0) {
+        return;
+    }
+    if (n_sanity_items == sanity_items_size) {
+        sanity_items_size = stg_max(2 * sanity_items_size, 1024);
+        sanity_items = stgReallocBytes(sanity_items,
+                                       sanity_items_size * sizeof(SanityItem),
+                                       "addSanityItem");
+    }
+    sanity_items[n_sanity_items++] = (SanityItem) { .kind = kind, .item = item };
+}
+
+// Add every block (or object, or region) of a chain
+static void
+addSanityChain (SanityItemKind kind, bdescr *bd)
+{
+    for (; bd != NULL; bd = bd->link) {
+        addSanityItem(kind, bd);
+    }
+}
+
+static void
+addSanitySegments (struct NonmovingSegment *seg)
+{
+    for (; seg != NULL; seg = seg->link) {
+        addSanityItem(SANITY_SEGMENT, seg);
+    }
+}
+
+static void
+checkSanityItem (SanityItem *item)
+{
+    switch (item->kind) {
+    case SANITY_BLOCK:
+        checkHeapBlock((bdescr *)item->item);
+        break;
+    case SANITY_LARGE:
+        checkLargeObject((bdescr *)item->item);
+        break;
+    case SANITY_COMPACT:
+        checkCompactObject((bdescr *)item->item);
+        break;
+    case SANITY_SEGMENT:
+        checkNonmovingSegment((struct NonmovingSegment *)item->item);
+        break;
+    }
+}
+
+static void
+checkSanityItemsTask (void)
+{
+    while (true) {
+        StgWord end = atomic_inc(&sanity_items_claimed, SANITY_CHUNK);
+        StgWord start = end - SANITY_CHUNK;
+        if (start >= n_sanity_items) {
+            break;
+        }
+        end = stg_min(end, n_sanity_items);
+        for (StgWord i = start; i < end; i++) {
+            checkSanityItem(&sanity_items[i]);
         }
-        seg = seg->link;
     }
 }
 
+// Check the items listed so far, with the help of the GC threads if
+// gc_threads, and empty the list.
+static void
+checkSanityItems (bool gc_threads)
+{
+    sanity_items_claimed = 0;
+    if (gc_threads && isParallelGc()) {
+        runGcTask(checkSanityItemsTask);
+    } else {
+        checkSanityItemsTask();
+    }
+    n_sanity_items = 0;
+}
+
 void checkNonmovingHeap (const struct NonmovingHeap *heap)
 {
-    checkLargeObjects(nonmoving_large_objects);
-    checkLargeObjects(nonmoving_marked_large_objects);
-    checkCompactObjects(nonmoving_compact_objects);
+    addSanityChain(SANITY_LARGE, nonmoving_large_objects);
+    addSanityChain(SANITY_LARGE, nonmoving_marked_large_objects);
+    addSanityChain(SANITY_COMPACT, nonmoving_compact_objects);
     for (unsigned int i=0; i < nonmoving_alloca_cnt; i++) {
         const struct NonmovingAllocator *alloc = &heap->allocators[i];
-        checkNonmovingSegments(alloc->filled);
-        checkNonmovingSegments(alloc->saved_filled);
-        checkNonmovingSegments(alloc->active);
+        addSanitySegments(alloc->filled);
+        addSanitySegments(alloc->saved_filled);
+        addSanitySegments(alloc->active);
         for (unsigned int cap_n=0; cap_n < getNumCapabilities(); cap_n++) {
             Capability *cap = getCapability(cap_n);
-            checkNonmovingSegments(cap->current_segments[i]);
+            addSanitySegments(cap->current_segments[i]);
         }
     }
+    checkSanityItems(false);
 }
 
 
@@ -666,61 +807,66 @@ checkHeapChunk(StgPtr start, StgPtr end)
   }
 }
 
+static void
+checkLargeObject(bdescr *bd)
+{
+  if (!(bd->flags & BF_PINNED)) {
+    checkClosure((StgClosure *)bd->start);
+  }
+}
+
 void
 checkLargeObjects(bdescr *bd)
 {
   while (bd != NULL) {
-    if (!(bd->flags & BF_PINNED)) {
-      checkClosure((StgClosure *)bd->start);
-    }
+    checkLargeObject(bd);
     bd = bd->link;
   }
 }
 
+// Check the compact region starting with the block bd
 static void
-checkCompactObjects(bdescr *bd)
+checkCompactObject(bdescr *bd)
 {
     // Compact objects are similar to large objects, but they have a
     // StgCompactNFDataBlock at the beginning, before the actual closure
 
-    for ( ; bd != NULL; bd = bd->link) {
-        ASSERT(bd->flags & BF_COMPACT);
+    ASSERT(bd->flags & BF_COMPACT);
 
-        StgCompactNFDataBlock *block = (StgCompactNFDataBlock*)bd->start;
-        StgCompactNFData *str = block->owner;
-        ASSERT((W_)str == (W_)block + sizeof(StgCompactNFDataBlock));
+    StgCompactNFDataBlock *block = (StgCompactNFDataBlock*)bd->start;
+    StgCompactNFData *str = block->owner;
+    ASSERT((W_)str == (W_)block + sizeof(StgCompactNFDataBlock));
 
-        StgWord totalW = 0;
-        StgCompactNFDataBlock *last;
-        for ( ; block ; block = block->next) {
-            last = block;
-            ASSERT(block->owner == str);
+    StgWord totalW = 0;
+    StgCompactNFDataBlock *last;
+    for ( ; block ; block = block->next) {
+        last = block;
+        ASSERT(block->owner == str);
 
-            totalW += Bdescr((P_)block)->blocks * BLOCK_SIZE_W;
+        totalW += Bdescr((P_)block)->blocks * BLOCK_SIZE_W;
 
-            StgPtr start = Bdescr((P_)block)->start + sizeofW(StgCompactNFDataBlock);
-            StgPtr free;
-            if (Bdescr((P_)block)->start == (P_)str->nursery) {
-                free = str->hp;
-            } else {
-                free = Bdescr((P_)block)->free;
-            }
-            StgPtr p = start;
-            while (p < free)  {
-                // We can't use checkClosure() here because in
-                // compactAdd#/compactAddWithSharing# when we see a non-
-                // compactable object (a function, mutable object, or pinned
-                // object) we leave the location for the object in the payload
-                // empty.
-                StgClosure *c = (StgClosure*)p;
-                checkClosureShallow(c);
-                p += closure_sizeW(c);
-            }
+        StgPtr start = Bdescr((P_)block)->start + sizeofW(StgCompactNFDataBlock);
+        StgPtr free;
+        if (Bdescr((P_)block)->start == (P_)str->nursery) {
+            free = str->hp;
+        } else {
+            free = Bdescr((P_)block)->free;
+        }
+        StgPtr p = start;
+        while (p < free)  {
+            // We can't use checkClosure() here because in
+            // compactAdd#/compactAddWithSharing# when we see a non-
+            // compactable object (a function, mutable object, or pinned
+            // object) we leave the location for the object in the payload
+            // empty.
+            StgClosure *c = (StgClosure*)p;
+            checkClosureShallow(c);
+            p += closure_sizeW(c);
         }
-
-        ASSERT(str->totalW == totalW);
-        ASSERT(str->last == last);
     }
+
+    ASSERT(str->totalW == totalW);
+    ASSERT(str->last == last);
 }
 
 void
@@ -1012,13 +1158,14 @@ static void checkGeneration (generation *gen,
         ASSERT(counted_cnf_blocks == total_cnf_blocks);
     }
 
-    checkHeapChain(gen->blocks);
+    // The closures are checked by checkSanityItems()
+    addSanityChain(SANITY_BLOCK, gen->blocks);
 
     for (n = 0; n < getNumCapabilities(); n++) {
         ws = &gc_threads[n]->gens[gen->no];
-        checkHeapChain(ws->todo_bd);
-        checkHeapChain(ws->part_list);
-        checkHeapChain(ws->scavd_list);
+        addSanityChain(SANITY_BLOCK, ws->todo_bd);
+        addSanityChain(SANITY_BLOCK, ws->part_list);
+        addSanityChain(SANITY_BLOCK, ws->scavd_list);
     }
 
     // Check weak pointer lists
@@ -1027,26 +1174,28 @@ static void checkGeneration (generation *gen,
       checkGenWeakPtrList(g);
     }
 
-    checkLargeObjects(gen->large_objects);
-    checkCompactObjects(gen->compact_objects);
+    addSanityChain(SANITY_LARGE, gen->large_objects);
+    addSanityChain(SANITY_COMPACT, gen->compact_objects);
 }
 
-/* Full heap sanity check. */
-static void checkFullHeap (bool after_major_gc)
+/* Full heap sanity check. See Note [Parallel and sampled sanity checking]. */
+static void checkFullHeap (bool after_major_gc, bool gc_threads)
 {
     uint32_t g, n;
 
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
         checkGeneration(&generations[g], after_major_gc);
     }
+    checkSanityItems(gc_threads);
+
     for (n = 0; n < getNumCapabilities(); n++) {
         checkNurserySanity(&nurseries[n]);
     }
 }
 
-void checkSanity (bool after_gc, bool major_gc)
+void checkSanity (bool after_gc, bool major_gc, bool gc_threads)
 {
-    checkFullHeap(after_gc && major_gc);
+    checkFullHeap(after_gc && major_gc, gc_threads);
 
     checkFreeListSanity();
 
@@ -1097,6 +1246,8 @@ findMemoryLeak (void)
         markBlocks(generations[g].large_objects);
         markCompactBlocks(generations[g].compact_objects);
     }
+    markCompactBlocks(immortal_compact_objects);
+    markBlocks(idle_dead_large_objects);
 
     for (i = 0; i < n_nurseries; i++) {
         markBlocks(nurseries[i].blocks);
@@ -1105,8 +1256,12 @@ findMemoryLeak (void)
     for (i = 0; i < getNumCapabilities(); i++) {
         markBlocks(gc_threads[i]->free_blocks);
         markBlocks(getCapability(i)->pinned_object_block);
+        markBlocks(getCapability(i)->pinned_ephemeral_block);
         markBlocks(getCapability(i)->pinned_object_blocks);
         markBlocks(getCapability(i)->upd_rem_set.queue.blocks);
+        for (j = 0; j < BLOCK_CACHE_BUCKETS; j++) {
+            markBlocks(getCapability(i)->block_cache.groups[j]);
+        }
     }
 
     if (RtsFlags.GcFlags.useNonmoving) {
@@ -1129,6 +1284,11 @@ findMemoryLeak (void)
         markNonMovingSegments(nonmovingHeap.free);
         if (current_mark_queue)
             markBlocks(current_mark_queue->blocks);
+#if defined(THREADED_RTS)
+        for (i = 1; i < n_mark_worker_queues; i++) {
+            markBlocks(mark_worker_queues[i]->blocks);
+        }
+#endif
     }
 
 #if defined(PROFILING)
@@ -1158,6 +1318,8 @@ checkRunQueue(Capability *cap)
          prev = tso, tso = tso->_link, n++) {
         ASSERT(prev == END_TSO_QUEUE || prev->_link == tso);
         ASSERT(tso->block_info.prev == prev);
+        // See Note [Thread priorities] in Schedule.c
+        ASSERT(prev == END_TSO_QUEUE || prev->priority >= tso->priority);
     }
     ASSERT(cap->run_queue_tl == prev);
     ASSERT(cap->n_run_queue == n);
@@ -1200,6 +1362,11 @@ genBlocks (generation *gen)
         ret += countNonMovingHeap(&nonmovingHeap);
         if (current_mark_queue)
             ret += countBlocks(current_mark_queue->blocks);
+#if defined(THREADED_RTS)
+        for (uint32_t i = 1; i < n_mark_worker_queues; i++) {
+            ret += countBlocks(mark_worker_queues[i]->blocks);
+        }
+#endif
     } else {
         ASSERT(countBlocks(gen->blocks) == gen->n_blocks);
         ASSERT(countCompactBlocks(gen->compact_objects) == gen->n_compact_blocks);
@@ -1254,7 +1421,8 @@ memInventory (bool show)
   W_ gen_blocks[RtsFlags.GcFlags.generations];
   W_ nursery_blocks = 0, free_pinned_blocks = 0, retainer_blocks = 0,
       arena_blocks = 0, exec_blocks = 0, gc_free_blocks = 0,
-      upd_rem_set_blocks = 0;
+      immortal_compact_blocks = 0, idle_dead_blocks = 0,
+      upd_rem_set_blocks = 0, block_cache_blocks = 0;
   W_ live_blocks = 0, free_blocks = 0;
   bool leak;
 
@@ -1289,8 +1457,19 @@ memInventory (bool show)
       if (getCapability(i)->pinned_object_block != NULL) {
           nursery_blocks += getCapability(i)->pinned_object_block->blocks;
       }
+      if (getCapability(i)->pinned_ephemeral_block != NULL) {
+          nursery_blocks += getCapability(i)->pinned_ephemeral_block->blocks;
+      }
       nursery_blocks += countBlocks(getCapability(i)->pinned_object_blocks);
       free_pinned_blocks += countBlocks(getCapability(i)->pinned_object_empty);
+
+      BlockCache *cache = &getCapability(i)->block_cache;
+      W_ cached = 0;
+      for (uint32_t j = 0; j < BLOCK_CACHE_BUCKETS; j++) {
+          cached += countBlocks(cache->groups[j]);
+      }
+      ASSERT(cached == cache->n_blocks);
+      block_cache_blocks += cached;
   }
 
 #if defined(PROFILING)
@@ -1302,6 +1481,12 @@ memInventory (bool show)
   // count the blocks allocated by the arena allocator
   arena_blocks = arenaBlocks();
 
+  // immortal compacts aren't walked; see Note [Immortal compact regions]
+  immortal_compact_blocks = n_immortal_compact_blocks;
+
+  // dead large objects left for idle time; see Note [Idle GC work]
+  idle_dead_blocks = countIdleDeferredBlocks();
+
   // count the blocks containing executable memory
   exec_blocks = countAllocdBlocks(exec_block);
 
@@ -1320,7 +1505,8 @@ memInventory (bool show)
   }
   live_blocks += nursery_blocks +
                + retainer_blocks + arena_blocks + exec_blocks + gc_free_blocks
-               + upd_rem_set_blocks + free_pinned_blocks;
+               + upd_rem_set_blocks + free_pinned_blocks + block_cache_blocks
+               + immortal_compact_blocks + idle_dead_blocks;
 
 #define MB(n) (((double)(n) * BLOCK_SIZE_W) / ((1024*1024)/sizeof(W_)))
 
@@ -1349,6 +1535,12 @@ memInventory (bool show)
                  exec_blocks, MB(exec_blocks));
       debugBelch("  GC free pool : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  gc_free_blocks, MB(gc_free_blocks));
+      debugBelch("  block cache  : %5" FMT_Word " blocks (%6.1lf MB)\n",
+                 block_cache_blocks, MB(block_cache_blocks));
+      debugBelch("  immortal CNF : %5" FMT_Word " blocks (%6.1lf MB)\n",
+                 immortal_compact_blocks, MB(immortal_compact_blocks));
+      debugBelch("  idle free    : %5" FMT_Word " blocks (%6.1lf MB)\n",
+                 idle_dead_blocks, MB(idle_dead_blocks));
       debugBelch("  free         : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  free_blocks, MB(free_blocks));
       debugBelch("  UpdRemSet    : %5" FMT_Word " blocks (%6.1lf MB)\n",
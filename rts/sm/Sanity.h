@@ -20,7 +20,9 @@
 # endif
 
 /* debugging routines */
-void checkSanity        ( bool after_gc, bool major_gc );
+// gc_threads: may the idle GC threads help? See
+// Note [Parallel and sampled sanity checking]
+void checkSanity        ( bool after_gc, bool major_gc, bool gc_threads );
 void checkNurserySanity ( nursery *nursery );
 void checkHeapChain     ( bdescr *bd );
 void checkHeapChunk     ( StgPtr start, StgPtr end );
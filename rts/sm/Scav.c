@@ -65,6 +65,8 @@
 #include "LdvProfile.h"
 #include "HeapUtils.h"
 #include "Hash.h"
+#include "GCSort.h"
+#include "ProfHeap.h"
 
 #include "sm/MarkWeak.h"
 #include "sm/NonMoving.h" // for nonmoving_set_closure_mark_bit
@@ -100,6 +102,58 @@ static void do_evacuate(StgClosure **p, void *user STG_UNUSED)
     evacuate(p);
 }
 
+/* -----------------------------------------------------------------------------
+   Evacuating runs of pointer fields
+
+   Note [Scavenge prefetching]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   evacuate() starts by reading the block descriptor and then the info
+   pointer of the closure a field points to, and in a large heap both are
+   usually cache misses.  When a closure has many pointer fields in a row
+   (constructors, thunks, arrays) we know the next few fields we are going
+   to evacuate, so with --scavenge-prefetch evacuate_fields() issues
+   prefetches for the closure SCAV_PREFETCH_DISTANCE fields ahead of the one
+   it is evacuating, much as the nonmoving collector's mark queue does (see
+   NonMovingMark.c).
+
+   The fields are still evacuated in order and within the same object, so
+   failed_to_evac and eager promotion behave exactly as before. Prefetching
+   a field that does not point into the heap is harmless.
+   -------------------------------------------------------------------------- */
+
+#define SCAV_PREFETCH_DISTANCE 4
+
+STATIC_INLINE void
+prefetch_field (StgPtr p)
+{
+    StgClosure *q = UNTAG_CLOSURE(*(StgClosure **)p);
+    prefetchForRead(Bdescr((StgPtr)q));
+    prefetchForRead(&q->header.info);
+}
+
+// Evacuate the fields [p, end), and return end.
+STATIC_INLINE StgPtr
+evacuate_fields (StgPtr p, StgPtr end)
+{
+    if (RTS_UNLIKELY(RtsFlags.GcFlags.scavengePrefetch)) {
+        StgPtr pf = p;
+        for (; pf < end && pf < p + SCAV_PREFETCH_DISTANCE; pf++) {
+            prefetch_field(pf);
+        }
+        for (; p < end; p++) {
+            if (pf < end) {
+                prefetch_field(pf++);
+            }
+            evacuate((StgClosure **)p);
+        }
+    } else {
+        for (; p < end; p++) {
+            evacuate((StgClosure **)p);
+        }
+    }
+    return end;
+}
+
 /* -----------------------------------------------------------------------------
    Scavenge a TSO.
    -------------------------------------------------------------------------- */
@@ -227,77 +281,77 @@ scavenge_compact(StgCompactNFData *str)
 }
 
 /* -----------------------------------------------------------------------------
-   Mutable arrays of pointers
+   Card tables
+
+   A card table splits an array of pointers into cards of (1 << card_bits)
+   elements, with one byte per card that is set when the card may point into
+   a younger generation. The mutator marks cards in its write barrier, and
+   the GC clears them again once the card no longer has old-to-young
+   pointers, so that a minor GC only needs to scan the marked cards of an
+   array on the mutable list instead of the whole array.
+
+   MUT_ARR_PTRS keep a card table of MUT_ARR_PTRS_CARD_BITS after their
+   payload (see mutArrPtrsCard). scavenge_cards works on any table, so other
+   objects can use a different card size.
+
+   The card scans done for the mutable lists are counted, along with the size
+   of the arrays they were done for, and reported by +RTS -s.
    -------------------------------------------------------------------------- */
 
-StgPtr scavenge_mut_arr_ptrs (StgMutArrPtrs *a)
+// Scavenge the n pointers at payload using the given card table: either all
+// the cards or only the marked ones. Afterwards the cards that still point
+// into a younger generation are marked and the others are clear, and
+// gct->failed_to_evac is set if any card is left marked.
+static void
+scavenge_cards (StgPtr payload, W_ n, StgWord8 *cards, uint32_t card_bits,
+                bool marked_only)
 {
-    W_ m;
-    bool any_failed;
-    StgPtr p, q;
+    const W_ card_size = (W_)1 << card_bits;
+    const W_ n_cards = (n + card_size - 1) >> card_bits;
+    bool any_failed = false;
 
-    any_failed = false;
-    p = (StgPtr)&a->payload[0];
-    for (m = 0; (int)m < (int)mutArrPtrsCards(a->ptrs) - 1; m++)
-    {
-        q = p + (1 << MUT_ARR_PTRS_CARD_BITS);
-        for (; p < q; p++) {
-            evacuate((StgClosure**)p);
+    for (W_ m = 0; m < n_cards; m++) {
+        if (marked_only && cards[m] == 0) {
+            continue;
         }
+
+        StgPtr p = payload + (m << card_bits);
+        StgPtr q = stg_min(p + card_size, payload + n);
+        evacuate_fields(p, q);
         if (gct->failed_to_evac) {
             any_failed = true;
-            *mutArrPtrsCard(a,m) = 1;
+            cards[m] = 1;
             gct->failed_to_evac = false;
         } else {
-            *mutArrPtrsCard(a,m) = 0;
+            cards[m] = 0;
         }
-    }
 
-    q = (StgPtr)&a->payload[a->ptrs];
-    if (p < q) {
-        for (; p < q; p++) {
-            evacuate((StgClosure**)p);
-        }
-        if (gct->failed_to_evac) {
-            any_failed = true;
-            *mutArrPtrsCard(a,m) = 1;
-            gct->failed_to_evac = false;
-        } else {
-            *mutArrPtrsCard(a,m) = 0;
+        if (marked_only) {
+            gct->rs_scanned_cards++;
+            gct->rs_scanned_elems += q - p;
         }
     }
 
     gct->failed_to_evac = any_failed;
+}
+
+/* -----------------------------------------------------------------------------
+   Mutable arrays of pointers
+   -------------------------------------------------------------------------- */
+
+StgPtr scavenge_mut_arr_ptrs (StgMutArrPtrs *a)
+{
+    scavenge_cards((StgPtr)&a->payload[0], a->ptrs, mutArrPtrsCard(a,0),
+                   MUT_ARR_PTRS_CARD_BITS, false);
     return (StgPtr)a + mut_arr_ptrs_sizeW(a);
 }
 
 // scavenge only the marked areas of a MUT_ARR_PTRS
 static StgPtr scavenge_mut_arr_ptrs_marked (StgMutArrPtrs *a)
 {
-    W_ m;
-    StgPtr p, q;
-    bool any_failed;
-
-    any_failed = false;
-    for (m = 0; m < mutArrPtrsCards(a->ptrs); m++)
-    {
-        if (*mutArrPtrsCard(a,m) != 0) {
-            p = (StgPtr)&a->payload[m << MUT_ARR_PTRS_CARD_BITS];
-            q = stg_min(p + (1 << MUT_ARR_PTRS_CARD_BITS),
-                        (StgPtr)&a->payload[a->ptrs]);
-            for (; p < q; p++) {
-                evacuate((StgClosure**)p);
-            }
-            if (gct->failed_to_evac) {
-                any_failed = true;
-                gct->failed_to_evac = false;
-            } else {
-                *mutArrPtrsCard(a,m) = 0;
-            }
-        }
-    }
-
-    gct->failed_to_evac = any_failed;
+    gct->rs_array_elems += a->ptrs;
+    scavenge_cards((StgPtr)&a->payload[0], a->ptrs, mutArrPtrsCard(a,0),
+                   MUT_ARR_PTRS_CARD_BITS, true);
     return (StgPtr)a + mut_arr_ptrs_sizeW(a);
 }
 
@@ -434,6 +488,31 @@ scavenge_fun_srt(const StgInfoTable *info)
     }
 }
 
+/* Note [Hierarchical copying]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   The copying collector is breadth-first: the children of the objects in a
+   block being scanned are copied to the end of the todo block, and only
+   scanned once the scan gets there. By then the children of the objects
+   scanned after them have been copied too, so the nodes of a list or a tree
+   end up spread over the to-space, far from their parents.
+
+   With --hierarchical-copying, scavenge_block follows Wilson, Lam and
+   Moher's hierarchical decomposition: when it scans a block other than the
+   todo block of its workspace, then after each object it first scans the
+   objects just copied into the todo block, and only then carries on with
+   the next object. The children (and their children, as long as they fit)
+   of an object are therefore copied next to each other, in roughly
+   depth-first order, and a linked structure promoted by a GC ends up mostly
+   in contiguous memory, which helps the mutator's caches when it reads the
+   structure later.
+
+   The nested scan is an ordinary scavenge_block of the todo block. That
+   block may fill up and be replaced while we scan it, in which case the
+   nested scan finishes it and returns, and the next object of the outer
+   block starts a scan of the new todo block; gct->scan_nested stops the
+   nested scan from nesting further, so we never recurse more than once.
+*/
+
 /* -----------------------------------------------------------------------------
    Scavenge a block from the given scan pointer up to bd->free.
 
@@ -483,8 +562,6 @@ scavenge_block (bdescr *bd)
     ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
     info = get_itbl((StgClosure *)p);
 
-    ASSERT(gct->thunk_selector_depth == 0);
-
     q = p;
     switch (info->type) {
 
@@ -606,9 +683,7 @@ scavenge_block (bdescr *bd)
 
         scavenge_thunk_srt(info);
         end = (P_)((StgThunk *)p)->payload + info->layout.payload.ptrs;
-        for (p = (P_)((StgThunk *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgThunk *)p)->payload, end);
         p += info->layout.payload.nptrs;
         break;
     }
@@ -622,9 +697,7 @@ scavenge_block (bdescr *bd)
         StgPtr end;
 
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
-        for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgClosure *)p)->payload, end);
         p += info->layout.payload.nptrs;
         break;
     }
@@ -757,9 +830,7 @@ scavenge_block (bdescr *bd)
         // avoid traversing it during minor GCs.
         gct->eager_promotion = false;
         next = p + small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs*)p);
-        for (p = (P_)((StgSmallMutArrPtrs *)p)->payload; p < next; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgSmallMutArrPtrs *)p)->payload, next);
         gct->eager_promotion = saved_eager_promotion;
 
         if (gct->failed_to_evac) {
@@ -779,9 +850,7 @@ scavenge_block (bdescr *bd)
         StgPtr next;
 
         next = p + small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs*)p);
-        for (p = (P_)((StgSmallMutArrPtrs *)p)->payload; p < next; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgSmallMutArrPtrs *)p)->payload, next);
 
         if (gct->failed_to_evac) {
             RELEASE_STORE(&((StgClosure *) q)->header.info, &stg_SMALL_MUT_ARR_PTRS_FROZEN_DIRTY_info);
@@ -819,9 +888,7 @@ scavenge_block (bdescr *bd)
         gct->eager_promotion = false;
 
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
-        for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgClosure *)p)->payload, end);
         p += info->layout.payload.nptrs;
 
         gct->eager_promotion = saved_eager_promotion;
@@ -856,6 +923,11 @@ scavenge_block (bdescr *bd)
              info->type, p);
     }
 
+    // See Note [Heap census during GC] in ProfHeap.c
+    if (RTS_UNLIKELY(gct->census != NULL)) {
+        censusScavengedObject(gct->census, (StgClosure *)q, p - q);
+    }
+
     /*
      * We need to record the current object on the mutable list if
      *  (a) It is actually mutable, or
@@ -869,10 +941,22 @@ scavenge_block (bdescr *bd)
             recordMutableGen_GC((StgClosure *)q, bd->gen_no);
         }
     }
+
+    // See Note [Hierarchical copying]
+    if (RTS_UNLIKELY(RtsFlags.GcFlags.hierarchicalCopying)
+        && bd != ws->todo_bd && !gct->scan_nested
+        && ws->todo_bd->u.scan < ws->todo_free) {
+        gct->scan_nested = true;
+        scavenge_block(ws->todo_bd);
+        gct->scan_nested = false;
+        gct->scan_bd = bd;
+        gct->evac_gen_no = bd->gen_no;
+    }
   }
 
   if (p > bd->free)  {
       gct->copied += ws->todo_free - bd->free;
+      gct->gen_copied[ws->gen->no] += ws->todo_free - bd->free;
       RELEASE_STORE(&bd->free, p);
   }
 
@@ -1009,9 +1093,7 @@ scavenge_mark_stack(void)
 
             scavenge_thunk_srt(info);
             end = (P_)((StgThunk *)p)->payload + info->layout.payload.ptrs;
-            for (p = (P_)((StgThunk *)p)->payload; p < end; p++) {
-                evacuate((StgClosure **)p);
-            }
+            p = evacuate_fields((P_)((StgThunk *)p)->payload, end);
             break;
         }
 
@@ -1024,9 +1106,7 @@ scavenge_mark_stack(void)
             StgPtr end;
 
             end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
-            for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-                evacuate((StgClosure **)p);
-            }
+            p = evacuate_fields((P_)((StgClosure *)p)->payload, end);
             break;
         }
 
@@ -1157,9 +1237,7 @@ scavenge_mark_stack(void)
             saved_eager = gct->eager_promotion;
             gct->eager_promotion = false;
             next = p + small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs*)p);
-            for (p = (P_)((StgSmallMutArrPtrs *)p)->payload; p < next; p++) {
-                evacuate((StgClosure **)p);
-            }
+            p = evacuate_fields((P_)((StgSmallMutArrPtrs *)p)->payload, next);
             gct->eager_promotion = saved_eager;
 
             if (gct->failed_to_evac) {
@@ -1179,9 +1257,7 @@ scavenge_mark_stack(void)
             StgPtr next, q = p;
 
             next = p + small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs*)p);
-            for (p = (P_)((StgSmallMutArrPtrs *)p)->payload; p < next; p++) {
-                evacuate((StgClosure **)p);
-            }
+            p = evacuate_fields((P_)((StgSmallMutArrPtrs *)p)->payload, next);
 
             if (gct->failed_to_evac) {
                 RELEASE_STORE(&((StgClosure *)q)->header.info, &stg_SMALL_MUT_ARR_PTRS_FROZEN_DIRTY_info);
@@ -1217,9 +1293,7 @@ scavenge_mark_stack(void)
             gct->eager_promotion = false;
 
             end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
-            for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-                evacuate((StgClosure **)p);
-            }
+            p = evacuate_fields((P_)((StgClosure *)p)->payload, end);
 
             gct->eager_promotion = saved_eager_promotion;
             gct->failed_to_evac = true; // mutable
@@ -1324,12 +1398,10 @@ scavenge_one(StgPtr p)
     case THUNK_0_2:
     case THUNK_2_0:
     {
-        StgPtr q, end;
+        StgPtr end;
 
         end = (StgPtr)((StgThunk *)p)->payload + info->layout.payload.ptrs;
-        for (q = (StgPtr)((StgThunk *)p)->payload; q < end; q++) {
-            evacuate((StgClosure **)q);
-        }
+        evacuate_fields((StgPtr)((StgThunk *)p)->payload, end);
         break;
     }
 
@@ -1348,12 +1420,10 @@ scavenge_one(StgPtr p)
     case CONSTR_2_0:
     case PRIM:
     {
-        StgPtr q, end;
+        StgPtr end;
 
         end = (StgPtr)((StgClosure *)p)->payload + info->layout.payload.ptrs;
-        for (q = (StgPtr)((StgClosure *)p)->payload; q < end; q++) {
-            evacuate((StgClosure **)q);
-        }
+        evacuate_fields((StgPtr)((StgClosure *)p)->payload, end);
         break;
     }
 
@@ -1479,9 +1549,7 @@ scavenge_one(StgPtr p)
         gct->eager_promotion = false;
         q = p;
         next = p + small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs*)p);
-        for (p = (P_)((StgSmallMutArrPtrs *)p)->payload; p < next; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgSmallMutArrPtrs *)p)->payload, next);
         gct->eager_promotion = saved_eager;
 
         if (gct->failed_to_evac) {
@@ -1501,9 +1569,7 @@ scavenge_one(StgPtr p)
         StgPtr next, q=p;
 
         next = p + small_mut_arr_ptrs_sizeW((StgSmallMutArrPtrs*)p);
-        for (p = (P_)((StgSmallMutArrPtrs *)p)->payload; p < next; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgSmallMutArrPtrs *)p)->payload, next);
 
         if (gct->failed_to_evac) {
             RELEASE_STORE(&((StgClosure *)q)->header.info, &stg_SMALL_MUT_ARR_PTRS_FROZEN_DIRTY_info);
@@ -1539,9 +1605,7 @@ scavenge_one(StgPtr p)
         gct->eager_promotion = false;
 
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
-        for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
-        }
+        p = evacuate_fields((P_)((StgClosure *)p)->payload, end);
 
         gct->eager_promotion = saved_eager_promotion;
         gct->failed_to_evac = true; // mutable
@@ -1647,6 +1711,7 @@ scavenge_mutable_list(bdescr *bd, generation *gen)
     gct->evac_gen_no = gen_no;
 
     for (; bd != NULL; bd = bd->link) {
+        gct->rs_entries += bd->free - bd->start;
         for (q = bd->start; q < bd->free; q++) {
             p = (StgPtr)*q;
             ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
@@ -1694,9 +1759,18 @@ scavenge_mutable_list(bdescr *bd, generation *gen)
             //
             switch (get_itbl((StgClosure *)p)->type) {
             case MUT_ARR_PTRS_CLEAN:
+                gct->rs_array_elems += ((StgMutArrPtrs *)p)->ptrs;
+                recordMutableGen_GC((StgClosure *)p,gen_no);
+                continue;
             case SMALL_MUT_ARR_PTRS_CLEAN:
+                gct->rs_array_elems += ((StgSmallMutArrPtrs *)p)->ptrs;
                 recordMutableGen_GC((StgClosure *)p,gen_no);
                 continue;
+            case SMALL_MUT_ARR_PTRS_DIRTY:
+                // no card table: scavenge_one scans the whole array
+                gct->rs_array_elems += ((StgSmallMutArrPtrs *)p)->ptrs;
+                gct->rs_scanned_elems += ((StgSmallMutArrPtrs *)p)->ptrs;
+                break;
             case MUT_ARR_PTRS_DIRTY:
             {
                 bool saved_eager_promotion;
@@ -1739,15 +1813,28 @@ scavenge_mutable_list(bdescr *bd, generation *gen)
 #endif
 }
 
+// See Note [Sorting the remembered set] in GCSort.c
+static void
+scavenge_saved_mut_list (Capability *cap, generation *gen)
+{
+    const uint32_t g = gen->no;
+    if (RTS_UNLIKELY(RtsFlags.GcFlags.sortMutLists)) {
+        gct->rs_duplicates += sortMutList(cap->saved_mut_lists[g]);
+    }
+    scavenge_mutable_list(cap->saved_mut_lists[g], gen);
+    freeChain_sync(cap->saved_mut_lists[g]);
+    cap->saved_mut_lists[g] = NULL;
+}
+
 void
 scavenge_capability_mut_lists (Capability *cap)
 {
+    const Time start = getProcessElapsedTime();
+
     // In a major GC only nonmoving heap's mut list is root
     if (RtsFlags.GcFlags.useNonmoving && major_gc) {
-        uint32_t g = oldest_gen->no;
-        scavenge_mutable_list(cap->saved_mut_lists[g], oldest_gen);
-        freeChain_sync(cap->saved_mut_lists[g]);
-        cap->saved_mut_lists[g] = NULL;
+        scavenge_saved_mut_list(cap, oldest_gen);
+        gct->rs_scan_time += getProcessElapsedTime() - start;
         return;
     }
 
@@ -1758,10 +1845,9 @@ scavenge_capability_mut_lists (Capability *cap)
      * namely to reduce the likelihood of spurious old->new pointers.
      */
     for (uint32_t g = RtsFlags.GcFlags.generations-1; g > N; g--) {
-        scavenge_mutable_list(cap->saved_mut_lists[g], &generations[g]);
-        freeChain_sync(cap->saved_mut_lists[g]);
-        cap->saved_mut_lists[g] = NULL;
+        scavenge_saved_mut_list(cap, &generations[g]);
     }
+    gct->rs_scan_time += getProcessElapsedTime() - start;
 }
 
 /* -----------------------------------------------------------------------------
@@ -1784,6 +1870,11 @@ scavenge_static(void)
    * objects */
   gct->evac_gen_no = oldest_gen->no;
 
+  // See Note [Sorting the remembered set] in GCSort.c
+  if (RTS_UNLIKELY(RtsFlags.GcFlags.sortStaticObjects)) {
+      sortStaticObjects(&gct->static_objects);
+  }
+
   /* keep going until we've scavenged all the objects on the linked
      list... */
 
@@ -1798,6 +1889,7 @@ scavenge_static(void)
           break;
     }
     p = UNTAG_STATIC_LIST_PTR(flagged_p);
+    gct->static_scavenged++;
 
     ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
     info = get_itbl(p);
@@ -2068,18 +2160,17 @@ scavenge_large (gen_workspace *ws)
         // the front when evacuating.
         ws->todo_large_objects = bd->link;
 
-        ACQUIRE_SPIN_LOCK(&ws->gen->sync);
         if (bd->flags & BF_COMPACT) {
+            ACQUIRE_SPIN_LOCK(&ws->gen->sync);
             dbl_link_onto(bd, &ws->gen->live_compact_objects);
             StgCompactNFData *str = ((StgCompactNFDataBlock*)bd->start)->owner;
             ws->gen->n_live_compact_blocks += str->totalW / BLOCK_SIZE_W;
+            RELEASE_SPIN_LOCK(&ws->gen->sync);
             p = (StgPtr)str;
         } else {
-            dbl_link_onto(bd, &ws->gen->scavenged_large_objects);
-            ws->gen->n_scavenged_large_blocks += bd->blocks;
+            push_scavd_large_object(ws, bd);
             p = bd->start;
         }
-        RELEASE_SPIN_LOCK(&ws->gen->sync);
 
         if (scavenge_one(p)) {
             if (ws->gen->no > 0) {
@@ -2087,6 +2178,13 @@ scavenge_large (gen_workspace *ws)
             }
         }
 
+        // See Note [Heap census during GC] in ProfHeap.c; compact regions
+        // are counted by the census itself
+        if (RTS_UNLIKELY(gct->census != NULL) && !(bd->flags & BF_COMPACT)) {
+            censusScavengedObject(gct->census, (StgClosure *)p,
+                                  closure_sizeW((StgClosure *)p));
+        }
+
         // stats
         gct->scanned += closure_sizeW((StgClosure*)p);
     }
@@ -2206,7 +2304,9 @@ loop:
     // scavenge static objects
     if (major_gc && gct->static_objects != END_OF_STATIC_OBJECT_LIST) {
         IF_DEBUG(sanity, checkStaticObjects(gct->static_objects));
+        Time start = getProcessElapsedTime();
         scavenge_static();
+        gct->static_scan_time += getProcessElapsedTime() - start;
     }
 
     // scavenge objects in compacted generation
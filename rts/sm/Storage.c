@@ -44,6 +44,7 @@
 #include "Evac.h"
 #include "NonMovingAllocate.h"
 #include "NonMovingMark.h"
+#include "CNF.h"
 #if defined(ios_HOST_OS) || defined(darwin_HOST_OS)
 #include "Hash.h"
 #endif
@@ -120,6 +121,13 @@ initGeneration (generation *gen, int g)
     gen->collections = 0;
     gen->par_collections = 0;
     gen->failed_promotions = 0;
+    gen->copied = 0;
+    gen->last_live_words = 0;
+    gen->last_alloc_words = 0;
+    gen->survival_rate = 0;
+    gen->promotion_rate = 0;
+    gen->mut_list_words = 0;
+    gen->live_words_before_gc = 0;
     gen->max_blocks = 0;
     gen->blocks = NULL;
     gen->n_blocks = 0;
@@ -137,6 +145,7 @@ initGeneration (generation *gen, int g)
     gen->n_compact_blocks_in_import = 0;
     gen->scavenged_large_objects = NULL;
     gen->n_scavenged_large_blocks = 0;
+    gen->old_large_objects = NULL;
     gen->live_compact_objects = NULL;
     gen->n_live_compact_blocks = 0;
     gen->compact_blocks_in_import = NULL;
@@ -397,6 +406,9 @@ void listAllBlocks (ListBlocksCb cb, void *user)
       if (getCapability(i)->pinned_object_block != NULL) {
           cb(user, getCapability(i)->pinned_object_block);
       }
+      if (getCapability(i)->pinned_ephemeral_block != NULL) {
+          cb(user, getCapability(i)->pinned_ephemeral_block);
+      }
       cb(user, getCapability(i)->pinned_object_blocks);
       cb(user, getCapability(i)->pinned_object_empty);
 
@@ -533,6 +545,24 @@ void listAllBlocks (ListBlocksCb cb, void *user)
 
      - the nonmoving collector uses the flags in STATIC_LINK as its mark bit.
 
+   ------------------
+   Note [Counting CAFs]
+   ~~~~~~~~~~~~~~~~~~~~
+   A program with very many CAFs might be expected to pay for all of them at
+   every GC, but it doesn't. An entered CAF goes on the mutable list of the
+   oldest generation, and a minor GC scavenges it there like any other
+   mutable list entry: if its value has been promoted to the oldest
+   generation it comes off the list, and is never looked at by a minor GC
+   again (scavenge_one re-records it only if it still points somewhere
+   younger). That is, CAFs are already remembered by generation. Only major
+   GCs walk the static objects, through gct->static_objects, and only those
+   that are reachable, as they would any live object.
+
+   So +RTS -s reports the number of CAFs entered (counted per capability by
+   lockCAF) and the number of static objects major GCs scavenged and the
+   time it took (in scavenge_loop), to show what CAFs do cost; entered CAFs
+   on the mutable lists are in the MUTABLE LISTS line with everything else.
+
    -------------------------------------------------------------------------- */
 
 static StgInd *
@@ -600,6 +630,9 @@ lockCAF (StgRegTable *reg, StgIndStatic *caf)
     RELEASE_STORE(&caf->indirectee, (StgClosure *) bh);
     SET_INFO_RELEASE((StgClosure*)caf, &stg_IND_STATIC_info);
 
+    // see Note [Counting CAFs]
+    cap->cafs_entered++;
+
     return bh;
 }
 
@@ -750,6 +783,8 @@ allocNursery (uint32_t node, bdescr *tail, W_ blocks)
         // small chunks if there are any available.  We must allow
         // single blocks here to avoid fragmentation (#7257)
         bd = allocLargeChunkOnNode(node, 1, n);
+        // nurseries are always node-local; see Note [NUMA block stealing]
+        ASSERT(bd->node == node);
         n = bd->blocks;
         blocks -= n;
 
@@ -791,6 +826,7 @@ assignNurseryToCapability (Capability *cap, uint32_t n)
     cap->r.rCurrentNursery = nurseries[n].blocks;
     newNurseryBlock(nurseries[n].blocks);
     cap->r.rCurrentAlloc   = NULL;
+    cap->mid_alloc_block   = NULL;
     ASSERT(cap->r.rCurrentNursery->node == cap->node);
 }
 
@@ -1102,6 +1138,86 @@ allocate (Capability *cap, W_ n)
     return p;
 }
 
+/* Note [Segregated allocation of mid-size objects]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   allocate() puts every object below LARGE_OBJECT_THRESHOLD into the same
+   block, cap->r.rCurrentAlloc, so the arrays allocated by newArray# and
+   newByteArray# end up interleaved with the small objects allocated
+   around them. An array of a few kilobytes often doesn't fit in what is
+   left of the block, which is then given up with the rest of it unused,
+   and the small objects are spread over more blocks, with the arrays in
+   between.
+
+   With --segregate-alloc=<size>, allocate() puts the objects of at least
+   <size> bytes into a block of their own, cap->mid_alloc_block, taken from
+   the nursery like rCurrentAlloc and accounted in the same way, so the
+   objects are collected as before. The small objects are then packed
+   together, and the space lost at the end of blocks to objects that don't
+   fit is only lost among the mid-size objects, which fill their blocks
+   with little waste at the end relative to their size. Like rCurrentAlloc,
+   mid_alloc_block is forgotten whenever the nurseries are reset.
+*/
+
+/*
+ * Take a block from the nursery for allocate() to allocate into, when the
+ * block it was allocating into (cap->r.rCurrentAlloc or cap->mid_alloc_block)
+ * is full.
+ */
+static bdescr *
+takeNurseryBlock (Capability *cap)
+{
+    bdescr *bd;
+
+    // First, we try taking the next block from the nursery:
+    bd = cap->r.rCurrentNursery->link;
+
+    if (bd == NULL) {
+        // The nursery is empty: allocate a fresh block (we can't
+        // fail here).
+        bd = allocGroupCached_lock(&cap->block_cache, 1);
+        cap->r.rNursery->n_blocks++;
+        initBdescr(bd, g0, g0);
+        bd->flags = 0;
+        // If we had to allocate a new block, then we'll GC
+        // pretty quickly now, because MAYBE_GC() will
+        // notice that CurrentNursery->link is NULL.
+    } else {
+        newNurseryBlock(bd);
+        // we have a block in the nursery: take it and put
+        // it at the *front* of the nursery list, and use it
+        // to allocate() from.
+        //
+        // Previously the nursery looked like this:
+        //
+        //           CurrentNursery
+        //                  /
+        //                +-+    +-+
+        // nursery -> ... |A| -> |B| -> ...
+        //                +-+    +-+
+        //
+        // After doing this, it looks like this:
+        //
+        //                      CurrentNursery
+        //                            /
+        //            +-+           +-+
+        // nursery -> |B| -> ... -> |A| -> ...
+        //            +-+           +-+
+        //             |
+        //             CurrentAlloc
+        //
+        // The point is to get the block out of the way of the
+        // advancing CurrentNursery pointer, while keeping it
+        // on the nursery list so we don't lose track of it.
+        cap->r.rCurrentNursery->link = bd->link;
+        if (bd->link != NULL) {
+            bd->link->u.back = cap->r.rCurrentNursery;
+        }
+    }
+    dbl_link_onto(bd, &cap->r.rNursery->blocks);
+    IF_DEBUG(sanity, checkNurserySanity(cap->r.rNursery));
+    return bd;
+}
+
 /*
  * Allocate some n words of heap memory; returning NULL
  * on heap overflow
@@ -1136,8 +1252,13 @@ allocateMightFail (Capability *cap, W_ n)
         // Only credit allocation after we've passed the size check above
         accountAllocation(cap, n);
 
+        // Try the Capability's block cache first, so that we only need
+        // the lock for the large_objects list.
+        bd = blockCacheAlloc(&cap->block_cache, req_blocks);
         ACQUIRE_SM_LOCK
-        bd = allocGroupOnNode(cap->node,req_blocks);
+        if (bd == NULL) {
+            bd = blockCacheRefill(&cap->block_cache, req_blocks);
+        }
         dbl_link_onto(bd, &g0->large_objects);
         g0->n_large_blocks += bd->blocks; // might be larger than req_blocks
         g0->n_new_large_words += n;
@@ -1152,63 +1273,20 @@ allocateMightFail (Capability *cap, W_ n)
     /* small allocation (<LARGE_OBJECT_THRESHOLD) */
 
     accountAllocation(cap, n);
-    bd = cap->r.rCurrentAlloc;
-    if (RTS_UNLIKELY(bd == NULL || bd->free + n > bd->start + BLOCK_SIZE_W)) {
-
-        if (bd) finishedNurseryBlock(cap,bd);
 
-        // The CurrentAlloc block is full, we need to find another
-        // one.  First, we try taking the next block from the
-        // nursery:
-        bd = cap->r.rCurrentNursery->link;
+    // With --segregate-alloc mid-size objects get blocks of their own.
+    // See Note [Segregated allocation of mid-size objects].
+    bdescr **current = &cap->r.rCurrentAlloc;
+    if (RTS_UNLIKELY(RtsFlags.GcFlags.segregateAllocWords > 0
+                     && n >= RtsFlags.GcFlags.segregateAllocWords)) {
+        current = &cap->mid_alloc_block;
+    }
 
-        if (bd == NULL) {
-            // The nursery is empty: allocate a fresh block (we can't
-            // fail here).
-            ACQUIRE_SM_LOCK;
-            bd = allocBlockOnNode(cap->node);
-            cap->r.rNursery->n_blocks++;
-            RELEASE_SM_LOCK;
-            initBdescr(bd, g0, g0);
-            bd->flags = 0;
-            // If we had to allocate a new block, then we'll GC
-            // pretty quickly now, because MAYBE_GC() will
-            // notice that CurrentNursery->link is NULL.
-        } else {
-            newNurseryBlock(bd);
-            // we have a block in the nursery: take it and put
-            // it at the *front* of the nursery list, and use it
-            // to allocate() from.
-            //
-            // Previously the nursery looked like this:
-            //
-            //           CurrentNursery
-            //                  /
-            //                +-+    +-+
-            // nursery -> ... |A| -> |B| -> ...
-            //                +-+    +-+
-            //
-            // After doing this, it looks like this:
-            //
-            //                      CurrentNursery
-            //                            /
-            //            +-+           +-+
-            // nursery -> |B| -> ... -> |A| -> ...
-            //            +-+           +-+
-            //             |
-            //             CurrentAlloc
-            //
-            // The point is to get the block out of the way of the
-            // advancing CurrentNursery pointer, while keeping it
-            // on the nursery list so we don't lose track of it.
-            cap->r.rCurrentNursery->link = bd->link;
-            if (bd->link != NULL) {
-                bd->link->u.back = cap->r.rCurrentNursery;
-            }
-        }
-        dbl_link_onto(bd, &cap->r.rNursery->blocks);
-        cap->r.rCurrentAlloc = bd;
-        IF_DEBUG(sanity, checkNurserySanity(cap->r.rNursery));
+    bd = *current;
+    if (RTS_UNLIKELY(bd == NULL || bd->free + n > bd->start + BLOCK_SIZE_W)) {
+        if (bd) finishedNurseryBlock(cap,bd);
+        bd = takeNurseryBlock(cap);
+        *current = bd;
     }
     p = bd->free;
     bd->free += n;
@@ -1217,6 +1295,35 @@ allocateMightFail (Capability *cap, W_ n)
     return p;
 }
 
+/*
+ * Make sure that cap->r.rCurrentAlloc has room for n words, so that the
+ * caller can then allocate up to n words in all with allocateReserved(),
+ * which doesn't check. Returns false if allocate() would not put all of
+ * the n words in cap->r.rCurrentAlloc, in which case the caller must use
+ * allocate() instead. Used by the interpreter; see
+ * Note [Interpreter heap checks] in Interpreter.c.
+ */
+bool
+reserveNursery (Capability *cap, W_ n)
+{
+    bdescr *bd;
+
+    // Objects of these sizes don't go in cap->r.rCurrentAlloc
+    if (n >= LARGE_OBJECT_THRESHOLD/sizeof(W_) ||
+        (RtsFlags.GcFlags.segregateAllocWords > 0
+         && n >= RtsFlags.GcFlags.segregateAllocWords)) {
+        return false;
+    }
+
+    bd = cap->r.rCurrentAlloc;
+    if (bd == NULL || bd->free + n > bd->start + BLOCK_SIZE_W) {
+        if (bd) finishedNurseryBlock(cap,bd);
+        bd = takeNurseryBlock(cap);
+        cap->r.rCurrentAlloc = bd;
+    }
+    return true;
+}
+
 /**
  * Calculate the number of words we need to add to 'p' so it satisfies the
  * alignment constraint '(p + off) & (align-1) == 0'.
@@ -1233,13 +1340,14 @@ allocateMightFail (Capability *cap, W_ n)
 #define MEMSET_SLOP_W(p, val, len_w) memset(p, val, (len_w) * sizeof(W_))
 
 /**
- * Finish the capability's current pinned object accumulator block
- * (cap->pinned_object_block), if any, and start a new one.
+ * Finish one of the capability's current pinned object accumulator blocks
+ * (cap->pinned_object_block or cap->pinned_ephemeral_block), if any, and
+ * start a new one.
  */
 static bdescr *
-start_new_pinned_block(Capability *cap)
+start_new_pinned_block(Capability *cap, bdescr **current)
 {
-    bdescr *bd = cap->pinned_object_block;
+    bdescr *bd = *current;
 
     // stash the old block on cap->pinned_object_blocks.  On the
     // next GC cycle these objects will be moved to
@@ -1295,11 +1403,35 @@ start_new_pinned_block(Capability *cap)
     }
     initBdescr(bd, g0, g0);
 
-    cap->pinned_object_block = bd;
+    *current = bd;
     bd->flags  = BF_PINNED | BF_LARGE | BF_EVACUATED;
     return bd;
 }
 
+/* Note [Ephemeral pinned blocks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A pinned block can't be freed while any object in it is live, and its
+   objects are never moved, so a single long-lived ByteString keeps the rest
+   of its block allocated even if everything else in it died long ago. A
+   program that allocates many short-lived buffers and the odd long-lived one
+   (say, a network server keeping a few slices of the packets it reads) can
+   end up with most of its pinned memory in such blocks.
+
+   With --pinned-ephemeral=<size>, pinned objects smaller than <size>
+   bytes go into their own current block, cap->pinned_ephemeral_block, and
+   the larger ones into cap->pinned_object_block as before. We can't tell at
+   allocation how long an object will live, so we take size as the hint:
+   small pinned objects tend to be the transient ones, and keeping them apart
+   means that their blocks more often die whole, and that the long-lived
+   objects are packed together in the other blocks. Both blocks are
+   otherwise handled in the same way, and end up on cap->pinned_object_blocks
+   once full.
+
+   Whether this helps depends on the program; --pinned-liveness measures the
+   live data in the pinned blocks at each GC (see Note [Pinned block
+   liveness] in PinnedLiveness.c), which tells us.
+*/
+
 /* ---------------------------------------------------------------------------
    Allocate a fixed/pinned object.
 
@@ -1333,9 +1465,15 @@ allocatePinned (Capability *cap, W_ n /*words*/, W_ alignment /*bytes*/, W_ alig
     // We don't support sub-word alignments
     CHECK(alignment >= sizeof(W_));
 
-    bdescr *bd = cap->pinned_object_block;
+    // See Note [Ephemeral pinned blocks]
+    bdescr **current = &cap->pinned_object_block;
+    if (n < RtsFlags.GcFlags.pinnedEphemeralWords) {
+        current = &cap->pinned_ephemeral_block;
+    }
+
+    bdescr *bd = *current;
     if (bd == NULL) {
-        bd = start_new_pinned_block(cap);
+        bd = start_new_pinned_block(cap, current);
     }
 
     const StgWord alignment_w = alignment / sizeof(W_);
@@ -1347,7 +1485,7 @@ allocatePinned (Capability *cap, W_ n /*words*/, W_ alignment /*bytes*/, W_ alig
         // If the current pinned object block isn't large enough to hold the new
         // object, get a new one.
         if ((bd->free + off_w + n) > (bd->start + BLOCK_SIZE_W)) {
-            bd = start_new_pinned_block(cap);
+            bd = start_new_pinned_block(cap, current);
 
             // The pinned_object_block remains attached to the capability
             // until it is full, even if a GC occurs.  We want this
@@ -1399,6 +1537,73 @@ allocatePinned (Capability *cap, W_ n /*words*/, W_ alignment /*bytes*/, W_ alig
     }
 }
 
+/* Note [Growing large byte arrays in place]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+   resizeMutableByteArray# used to copy the array whenever it grew, so a
+   buffer grown by doubling (a builder, a growable vector) copied everything
+   it held at each doubling.  A large byte array never moves, and has its
+   block group to itself, so it can often grow where it is instead:
+
+    - into the rest of its group: a group is a whole number of blocks, the
+      array was perhaps shrunk before, and the block cache may have handed
+      out a bigger group than was asked for;
+
+    - into the free blocks after its group, with extendGroup() (see
+      Note [Extending a block group in place] in BlockAlloc.c).
+
+   growLargeByteArray() does that, and stg_resizzeMutableByteArrayzh copies
+   only if it fails.  We don't grow arrays in compact regions, nor those of
+   the nonmoving heap, whose large objects the concurrent mark may be
+   looking at.
+
+   The new words count as allocation, as in allocateMightFail(): towards
+   the next GC (g0->n_new_large_words), the allocation counters and the
+   thread's allocation limit.  In generations that are not collected at
+   the next GC, n_large_words must account for them too.
+*/
+bool
+growLargeByteArray (Capability *cap, StgArrBytes *arr, W_ payload_words)
+{
+    bdescr *bd = Bdescr((StgPtr)arr);
+    StgPtr end = (StgPtr)arr + sizeofW(StgArrBytes) + payload_words;
+
+    if ((bd->flags & (BF_LARGE | BF_COMPACT | BF_NONMOVING)) != BF_LARGE) {
+        return false;
+    }
+
+    ACQUIRE_SM_LOCK;
+
+    if (end > bd->start + (W_)bd->blocks * BLOCK_SIZE_W) {
+        W_ blocks = BLOCK_ROUND_UP((end - bd->start) * sizeof(W_)) / BLOCK_SIZE;
+        W_ old_blocks = bd->blocks;
+        if ((RtsFlags.GcFlags.maxHeapSize > 0 &&
+             blocks >= RtsFlags.GcFlags.maxHeapSize) ||
+            blocks >= HS_INT32_MAX ||
+            !extendGroup(bd, blocks))
+        {
+            RELEASE_SM_LOCK;
+            return false;
+        }
+        bd->gen->n_large_blocks += bd->blocks - old_blocks;
+    }
+
+    W_ n = 0;
+    if (end > bd->free) {
+        n = end - bd->free;
+        if (bd->gen_no > 0) {
+            bd->gen->n_large_words += n;
+        }
+        g0->n_new_large_words += n;
+        bd->free = end;
+    }
+
+    RELEASE_SM_LOCK;
+
+    accountAllocation(cap, n);
+    cap->total_allocated += n;
+    return true;
+}
+
 /* -----------------------------------------------------------------------------
    Write Barriers
    -------------------------------------------------------------------------- */
@@ -1624,12 +1829,15 @@ updateNurseriesStats (void)
     bdescr *bd;
 
     for (i = 0; i < getNumCapabilities(); i++) {
-        // The current nursery block and the current allocate block have not
-        // yet been accounted for in cap->total_allocated, so we add them here.
+        // The current nursery block and the current allocate blocks have
+        // not yet been accounted for in cap->total_allocated, so we add them
+        // here.
         bd = getCapability(i)->r.rCurrentNursery;
         if (bd) finishedNurseryBlock(getCapability(i), bd);
         bd = getCapability(i)->r.rCurrentAlloc;
         if (bd) finishedNurseryBlock(getCapability(i), bd);
+        bd = getCapability(i)->mid_alloc_block;
+        if (bd) finishedNurseryBlock(getCapability(i), bd);
     }
 }
 
@@ -1809,6 +2017,7 @@ StgWord calcTotalCompactW (void)
     }
 
     totalW += nonmoving_compact_words;
+    totalW += n_immortal_compact_blocks * BLOCK_SIZE_W;
 
     return totalW;
 }
@@ -59,7 +59,6 @@ extern nursery *nurseries;
 extern uint32_t n_nurseries;
 
 void     resetNurseries       (void);
-void     clearNursery         (Capability *cap);
 void     resizeNurseries      (StgWord blocks);
 void     resizeNurseriesFixed (void);
 StgWord  countNurseryBlocks   (void);
@@ -122,6 +121,30 @@ StgWord calcTotalCompactW (void);
 
 void accountAllocation(Capability *cap, W_ n);
 
+// See Note [Growing large byte arrays in place] in Storage.c.
+bool growLargeByteArray (Capability *cap, StgArrBytes *arr, W_ payload_words);
+
+/* -----------------------------------------------------------------------------
+   Allocating from space reserved in the nursery
+   -------------------------------------------------------------------------- */
+
+bool reserveNursery (Capability *cap, W_ n);
+
+//
+// Allocate n words from the space that reserveNursery() has made in
+// cap->r.rCurrentAlloc, without checking for room.
+//
+INLINE_HEADER StgPtr allocateReserved (Capability *cap, W_ n)
+{
+    bdescr *bd = cap->r.rCurrentAlloc;
+    StgPtr p = bd->free;
+    ASSERT(p + n <= bd->start + BLOCK_SIZE_W);
+    accountAllocation(cap, n);
+    bd->free = p + n;
+    IF_DEBUG(sanity, ASSERT(*((StgWord8*)p) == 0xaa));
+    return p;
+}
+
 /* ----------------------------------------------------------------------------
    Storage manager internal APIs and globals
    ------------------------------------------------------------------------- */
@@ -19,6 +19,12 @@ void initializeTimer(void)
 {
 }
 
+void initTscClock(void)
+{
+    errorBelch("warning: --tsc-clock is not supported on this platform, "
+               "using the system clock");
+}
+
 static Time getClockTime(clockid_t clock)
 {
     struct timespec ts;
@@ -157,9 +157,41 @@ void rts_scheduleWork(void) {
   __imported_scheduleWork();
 }
 
+// Note [Batching promise callbacks]
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+//
+// When a Promise a thread is blocked on settles, the callback passed to
+// .then() calls one of the rts_promiseResolve*/rts_promiseReject
+// functions below, which wakes up the thread. We used to enter the
+// scheduler loop right there, once per settled Promise. But an app
+// that has thousands of fetches or timers in flight can see thousands
+// of them settle at once, and each scheduler loop creates a thread and
+// goes through rts_lock()/rts_unlock(), only to run the one thread that
+// was just woken up.
+//
+// So the callbacks only put the thread on the run queue, and the first
+// of them queues a microtask that runs the scheduler loop. Promise
+// callbacks are microtasks too, so any others that are already queued
+// run first and add their threads to the same run queue, and one round
+// of the scheduler loop gets through all of them. The woken threads
+// still run before control goes back to the JavaScript event loop,
+// just not from inside the .then() callback itself.
+//
+// Any round of the scheduler loop will do for the woken threads, so
+// rts_schedulerLoop() clears the pending flag whoever called it. If it
+// is re-entered while a loop is already running, it exits at once (see
+// Note [Async JSFFI scheduler]) but the running loop still sees the
+// threads.
+
+__attribute__((import_module("ghc_wasm_jsffi"), import_name("scheduleMicrotask")))
+void __imported_scheduleMicrotask(void);
+
+static bool scheduler_loop_pending = false;
+
 __attribute__((export_name("rts_schedulerLoop")))
 void rts_schedulerLoop(void);
 void rts_schedulerLoop(void) {
+  scheduler_loop_pending = false;
   Capability *cap = rts_lock();
   StgTSO *tso = createThread(cap, RESERVED_STACK_WORDS);
   pushClosure(tso, (StgWord)&stg_scheduler_loop_info);
@@ -168,6 +200,7 @@ void rts_schedulerLoop(void) {
   rts_unlock(cap);
 }
 
+// See Note [Batching promise callbacks]
 #define mk_rtsPromiseCallback(obj)                         \
   {                                                        \
   Capability *cap = &MainCapability;                       \
@@ -184,7 +217,10 @@ void rts_schedulerLoop(void) {
     stack->sp[1] = (StgWord)(obj);                         \
   }                                                        \
   scheduleThreadNow(cap, tso);                             \
-  rts_schedulerLoop();                                     \
+  if (!scheduler_loop_pending) {                           \
+    scheduler_loop_pending = true;                         \
+    __imported_scheduleMicrotask();                        \
+  }                                                        \
   }
 
 #define mk_rtsPromiseResolve(T)                            \
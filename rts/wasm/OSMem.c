@@ -41,6 +41,12 @@
 // megablock allocator already has its internal free-list, we avoid
 // writing our own pooling logic, and simply avoid returning any
 // megablock on Wasm.
+//
+// What we can do is to grow memory as little as possible: see Note
+// [Growing the heap on wasm] in BlockAlloc.c for how a request that
+// doesn't fit in any free group reuses the free megablocks at the top
+// of linear memory. The size of linear memory, which is also its
+// high-water mark, is reported by +RTS -s.
 
 #include "Rts.h"
 #include "sm/OSMem.h"
@@ -61,6 +67,11 @@ osGetMBlocks(uint32_t n)
   return sbrk(PAGESIZE * n);
 }
 
+void *osMBlocksEnd(void)
+{
+  return sbrk(0);
+}
+
 void osBindMBlocksToNode(
     void *addr STG_UNUSED,
     StgWord size STG_UNUSED,
@@ -68,6 +79,19 @@ void osBindMBlocksToNode(
 {
 }
 
+bool osMapFileMemory(
+    void *p STG_UNUSED,
+    W_ len STG_UNUSED,
+    int fd STG_UNUSED,
+    StgWord64 offset STG_UNUSED)
+{
+    return false;
+}
+
+void osUnmapFileMemory(void *p STG_UNUSED, W_ len STG_UNUSED)
+{
+}
+
 StgWord64 getPhysicalMemorySize (void)
 {
     return 1ULL << 32;
@@ -82,3 +106,8 @@ uint64_t osNumaMask(void)
 {
     return 1;
 }
+
+uint32_t osNumaDistance(uint32_t from, uint32_t to)
+{
+    return from == to ? 10 : 20;
+}
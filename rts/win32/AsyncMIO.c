@@ -59,6 +59,14 @@ static int              completed_hw;
 static HANDLE           completed_table_sema;
 static int              issued_reqs;
 
+static int
+compareCompletedReqs(const void *a, const void *b)
+{
+    unsigned int x = ((const CompletedReq *)a)->reqID;
+    unsigned int y = ((const CompletedReq *)b)->reqID;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
 static void
 onIOComplete(unsigned int reqID,
              int   fd STG_UNUSED,
@@ -275,78 +283,83 @@ start:
         }
         goto start;
     } else {
-        int i;
-        StgTSO *tso, *prev;
-
-        for (i=0; i < completed_hw; i++) {
-            /* For each of the completed requests, match up their Ids
-             * with those of the threads on the blocked_queue. If the
-             * thread that made the IO request has been subsequently
-             * killed (and removed from blocked_queue), no match will
-             * be found for that request Id.
-             *
-             * i.e., killing a Haskell thread doesn't attempt to cancel
-             * the IO request it is blocked on.
-             *
-             */
-            unsigned int rID = completedTable[i].reqID;
+        StgTSO *tso, *prev, *next;
 
-            prev = NULL;
-            for(tso = iomgr->blocked_queue_hd; tso != END_TSO_QUEUE;
-                  tso = tso->_link) {
+        /* Match up the completed requests with the threads on the
+         * blocked_queue that made them. If the thread that made a request
+         * has been subsequently killed (and removed from blocked_queue), no
+         * match will be found for that request Id.
+         *
+         * i.e., killing a Haskell thread doesn't attempt to cancel
+         * the IO request it is blocked on.
+         *
+         * The whole table is done in one walk of the blocked_queue,
+         * looking each thread's request up in the sorted table, rather
+         * than walking the queue for each request: with many requests in
+         * flight, both the table and the queue are long.
+         */
+        qsort(completedTable, completed_hw, sizeof(CompletedReq),
+              compareCompletedReqs);
 
-                switch(ACQUIRE_LOAD(&tso->why_blocked)) {
-                case BlockedOnRead:
-                case BlockedOnWrite:
-                case BlockedOnDoProc:
-                    if (tso->block_info.async_result->reqID == rID) {
-                        // Found the thread blocked waiting on request;
-                        // stodgily fill
-                        // in its result block.
-                        tso->block_info.async_result->len =
-                          completedTable[i].len;
-                        tso->block_info.async_result->errCode =
-                          completedTable[i].errCode;
+        prev = NULL;
+        for (tso = iomgr->blocked_queue_hd; tso != END_TSO_QUEUE;
+             tso = next) {
+            next = tso->_link;
 
-                        // Drop the matched TSO from blocked_queue
-                        if (prev) {
-                            setTSOLink(&MainCapability, prev, tso->_link);
-                        } else {
-                            iomgr->blocked_queue_hd = tso->_link;
-                        }
-                        if (iomgr->blocked_queue_tl == tso) {
-                            iomgr->blocked_queue_tl = prev ? prev
-                                                           : END_TSO_QUEUE;
-                        }
-
-                        // Terminates the run queue + this inner for-loop.
-                        tso->_link = END_TSO_QUEUE;
-                        tso->why_blocked = NotBlocked;
-                        // save the StgAsyncIOResult in the
-                        // stg_block_async_info stack frame, because
-                        // the block_info field will be overwritten by
-                        // pushOnRunQueue().
-                        tso->stackobj->sp[1] = (W_)tso->block_info.async_result;
-                        pushOnRunQueue(&MainCapability, tso);
-                        break;
-                    }
-                    break;
-                default:
-                    if (tso->why_blocked != NotBlocked) {
-                        barf("awaitRequests: odd thread state");
-                    }
+            switch(ACQUIRE_LOAD(&tso->why_blocked)) {
+            case BlockedOnRead:
+            case BlockedOnWrite:
+            case BlockedOnDoProc:
+            {
+                CompletedReq key, *req;
+                key.reqID = tso->block_info.async_result->reqID;
+                req = bsearch(&key, completedTable, completed_hw,
+                              sizeof(CompletedReq), compareCompletedReqs);
+                if (req == NULL) {
                     break;
                 }
+                // Found the thread blocked waiting on request;
+                // stodgily fill in its result block.
+                tso->block_info.async_result->len = req->len;
+                tso->block_info.async_result->errCode = req->errCode;
 
-                prev = tso;
+                // Drop the matched TSO from blocked_queue
+                if (prev) {
+                    setTSOLink(&MainCapability, prev, next);
+                } else {
+                    iomgr->blocked_queue_hd = next;
+                }
+                if (iomgr->blocked_queue_tl == tso) {
+                    iomgr->blocked_queue_tl = prev ? prev : END_TSO_QUEUE;
+                }
+
+                tso->_link = END_TSO_QUEUE;
+                tso->why_blocked = NotBlocked;
+                // save the StgAsyncIOResult in the
+                // stg_block_async_info stack frame, because
+                // the block_info field will be overwritten by
+                // pushOnRunQueue().
+                tso->stackobj->sp[1] = (W_)tso->block_info.async_result;
+                pushOnRunQueue(&MainCapability, tso);
+                // tso is off the queue, so prev stays where it is
+                continue;
             }
-            /* Signal that there's completed table slots available */
-            if ( !ReleaseSemaphore(completed_table_sema, 1, NULL) ) {
-                DWORD dw = GetLastError();
-                fprintf(stderr, "awaitRequests: failed to signal semaphore "
-                                "(error code=0x%x)\n", (int)dw);
-                fflush(stderr);
+            default:
+                if (tso->why_blocked != NotBlocked) {
+                    barf("awaitRequests: odd thread state");
+                }
+                break;
             }
+
+            prev = tso;
+        }
+
+        /* Signal that there's completed table slots available */
+        if ( !ReleaseSemaphore(completed_table_sema, completed_hw, NULL) ) {
+            DWORD dw = GetLastError();
+            fprintf(stderr, "awaitRequests: failed to signal semaphore "
+                            "(error code=0x%x)\n", (int)dw);
+            fflush(stderr);
         }
         completed_hw = 0;
         ResetEvent(completed_req_event);
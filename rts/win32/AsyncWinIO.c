@@ -17,6 +17,7 @@
 #include "Schedule.h"
 #include "Rts.h"
 #include "ThreadLabels.h"
+#include "GetTime.h"
 
 #include <stdbool.h>
 #include <windows.h>
@@ -151,6 +152,28 @@
   needed we consider this cheap compared to the complexity of
   properly handling pausing and resuming of the manager.
 
+  Note [WinIO completion batching]
+  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Every batch of completions the runner hands over costs a Haskell thread
+  running processRemoteCompletion, and a round trip through the scheduler.
+  So we want few, large batches:
+
+  * When GetQueuedCompletionStatusEx returns with room left in ENTRIES, we
+    call it once more without waiting, to pick up the completions that
+    arrived in the meantime.
+
+  * ENTRIES doubles whenever a batch fills it (see queue_full), and halves
+    again once SHRINK_AFTER_BATCHES batches in a row used less than a
+    quarter of it, so that a burst of I/O doesn't keep it large for good.
+
+  * When the scheduler is asleep in awaitAsyncRequests, it queues the thread
+    processing a new batch as soon as the runner wakes it, instead of first
+    going round the scheduler loop.
+
+  With +RTS -s we report the sizes of the batches and how long they took to
+  be delivered, from the runner dequeuing them to processRemoteCompletion
+  collecting them with getOverlappedEntries.
+
    */
 
 /* The IOCP Handle all I/O requests are associated with for this RTS.  */
@@ -198,12 +221,28 @@ static CONDITION_VARIABLE threadIOWait;
 
 /* Number of callbacks to reserve slots for in ENTRIES.  This is also the
    total number of concurrent I/O requests we can handle in one go.  */
-static uint32_t num_callbacks = 32;
+#define MIN_CALLBACKS 32
+static uint32_t num_callbacks = MIN_CALLBACKS;
 /* Buffer for I/O request information.  */
 static OVERLAPPED_ENTRY *entries;
 
+/* Shrink ENTRIES after this many batches in a row that used less than a
+   quarter of it.  See Note [WinIO completion batching].
+    Set by:
+      runner
+      registerAlertableWait
+    Read by:
+      registerAlertableWait
+*/
+#define SHRINK_AFTER_BATCHES 64
+static uint32_t small_batches = 0;
+
 /* Notify the Haskell side of this many new finished requests */
 static uint32_t num_notify;
+/* When the runner dequeued them.  */
+static Time notify_time;
+
+static AsyncWinIOStats winio_stats;
 
 /* Indicates to the scheduler that new work is available for processing.
     Set by:
@@ -215,6 +254,7 @@ static uint32_t num_notify;
 static volatile bool canQueueIOThread;
 
 static void notifyScheduler(uint32_t num);
+static uint32_t histBucket (uint64_t v);
 
 static DWORD WINAPI runner (LPVOID lpParam);
 
@@ -339,16 +379,32 @@ void registerAlertableWait (bool has_timeout, DWORD mssec)
   }
   outstanding_service_requests = false;
 
-  /* Resize queue if required.  */
+  /* Resize queue if required.  See Note [WinIO completion batching].  */
   if (queue_full)
   {
-    num_callbacks *= 2;
     OVERLAPPED_ENTRY *new
       = realloc (entries,
-                  sizeof (OVERLAPPED_ENTRY) * num_callbacks);
+                  sizeof (OVERLAPPED_ENTRY) * num_callbacks * 2);
     if (new)
-      entries = new;
+      {
+        entries = new;
+        num_callbacks *= 2;
+      }
     queue_full = false;
+    small_batches = 0;
+  }
+  else if (small_batches >= SHRINK_AFTER_BATCHES
+           && num_callbacks > MIN_CALLBACKS)
+  {
+    OVERLAPPED_ENTRY *new
+      = realloc (entries,
+                  sizeof (OVERLAPPED_ENTRY) * (num_callbacks / 2));
+    if (new)
+      {
+        entries = new;
+        num_callbacks /= 2;
+      }
+    small_batches = 0;
   }
 
   /* If the new timeout is earlier than the old one we have to reschedule the
@@ -383,10 +439,34 @@ void registerAlertableWait (bool has_timeout, DWORD mssec)
          registerAlertableWait call.  */
 OVERLAPPED_ENTRY* getOverlappedEntries (uint32_t *num)
 {
+  Time latency = getProcessElapsedTime () - notify_time;
+  winio_stats.latencies[histBucket (TimeToUS (latency))]++;
+
   *num = num_notify;
   return entries;
 }
 
+/* The bucket of a histogram that V falls into: bucket 0 holds 0, and bucket
+   i > 0 the values from 2^(i-1) to 2^i - 1, with the last bucket taking all
+   the larger ones too.  */
+static uint32_t histBucket (uint64_t v)
+{
+  uint32_t i = 0;
+  while (v > 0 && i < WINIO_HIST_BUCKETS - 1)
+    {
+      v >>= 1;
+      i++;
+    }
+  return i;
+}
+
+/* For +RTS -s, see Note [WinIO completion batching].  The counters aren't
+   synchronised, this is meant to be called as the program exits.  */
+void getAsyncWinIOStats (AsyncWinIOStats *stats)
+{
+  *stats = winio_stats;
+}
+
 
 /* Called by the scheduler when we have ran out of work to do and we have at
    least one thread blocked on an I/O Port.  When WAIT then if this function
@@ -408,6 +488,11 @@ void awaitAsyncRequests (bool wait)
     SleepConditionVariableSRW (&threadIOWait, &wio_runner_lock, INFINITE, 0);
 
   ReleaseSRWLockExclusive (&wio_runner_lock);
+
+  /* If the runner woke us with a new batch, queue the thread to process it
+     right away.  See Note [WinIO completion batching].  */
+  if (wait)
+    queueIOThread ();
 }
 
 
@@ -418,6 +503,10 @@ static void notifyScheduler(uint32_t num) {
   AcquireSRWLockExclusive (&wio_runner_lock);
   ASSERT(!canQueueIOThread);
   num_notify = num;
+  notify_time = getProcessElapsedTime ();
+  winio_stats.completions += num;
+  winio_stats.batches++;
+  winio_stats.batch_sizes[histBucket (num)]++;
   canQueueIOThread = true;
   WakeConditionVariable(&threadIOWait);
   ReleaseSRWLockExclusive (&wio_runner_lock);
@@ -500,6 +589,17 @@ static DWORD WINAPI runner (LPVOID lpParam STG_UNUSED)
                                        num_callbacks, &num_removed, timeout,
                                        false))
         {
+          /* Top up the batch with whatever completed in the meantime.  See
+             Note [WinIO completion batching].  */
+          ULONG num_more = 0;
+          if (num_removed < num_callbacks
+              && GetQueuedCompletionStatusEx (completionPortHandle,
+                                              entries + num_removed,
+                                              num_callbacks - num_removed,
+                                              &num_more, 0, false))
+            {
+              num_removed += num_more;
+            }
           if (num_removed > 0)
             {
               queue_full = num_removed == num_callbacks;
@@ -520,6 +620,10 @@ static DWORD WINAPI runner (LPVOID lpParam STG_UNUSED)
       // * We wake up spuriously
       // * All returned results have been canceled already.
       // It's not realistic nor worthwhile to check for these edge cases so we don't.
+      if (num_removed < num_callbacks / 4)
+        small_batches++;
+      else
+        small_batches = 0;
       notifyScheduler (num_removed);
 
       AcquireSRWLockExclusive (&wio_runner_lock);
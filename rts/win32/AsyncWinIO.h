@@ -14,6 +14,18 @@
 #include <stdbool.h>
 #include <windows.h>
 
+/* Statistics of the non-threaded WinIO manager for +RTS -s.  See
+   Note [WinIO completion batching].  */
+#define WINIO_HIST_BUCKETS 16
+typedef struct {
+    uint64_t completions;
+    uint64_t batches;
+    /* [0]: empty batches, [i]: batches of 2^(i-1) to 2^i - 1 completions */
+    uint64_t batch_sizes[WINIO_HIST_BUCKETS];
+    /* [0]: delivered within 1us, [i]: within 2^(i-1) to 2^i - 1 us */
+    uint64_t latencies[WINIO_HIST_BUCKETS];
+} AsyncWinIOStats;
+
 extern bool startupAsyncWinIO(void);
 extern void shutdownAsyncWinIO(bool wait_threads);
 extern void awaitAsyncRequests(bool wait);
@@ -23,3 +35,4 @@ extern void registerAlertableWait (bool has_timeout, DWORD mssec);
 extern OVERLAPPED_ENTRY* getOverlappedEntries (uint32_t *num);
 extern void completeSynchronousRequest (void);
 extern bool queueIOThread(void);
+extern void getAsyncWinIOStats (AsyncWinIOStats *stats);
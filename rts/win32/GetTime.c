@@ -75,6 +75,12 @@ void initializeTimer(void)
     }
 }
 
+// QueryPerformanceCounter already reads the TSC where it is invariant, so
+// there is nothing for --tsc-clock to do here.
+void initTscClock(void)
+{
+}
+
 HsWord64
 getMonotonicNSec(void)
 {
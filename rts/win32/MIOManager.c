@@ -42,6 +42,24 @@ typedef struct IOManagerState {
 /* ToDo: wrap up this state via a IOManager handle instead? */
 static IOManagerState* ioMan;
 
+/*
+ * Note [Retiring idle MIO workers]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * depositWorkItem() starts a new worker whenever there are more queued
+ * requests than idle workers, so a burst of blocking I/O can leave the
+ * pool with hundreds of threads, which used to stay around, each with its
+ * stack, for the rest of the program. Now a worker that has been idle for
+ * IO_WORKER_IDLE_TIMEOUT milliseconds exits, unless it is one of the last
+ * IO_WORKER_MIN_IDLE idle workers, which we keep so that the next few
+ * requests don't each wait for a thread to be created.
+ *
+ * A worker only exits when nothing is queued, deciding under manLock, which
+ * depositWorkItem() holds while it counts the idle workers, so a request is
+ * never left waiting on a worker that is about to go.
+ */
+#define IO_WORKER_IDLE_TIMEOUT 10000
+#define IO_WORKER_MIN_IDLE     2
+
 static void RegisterWorkItem  ( IOManagerState* iom, WorkItem* wi);
 static void DeregisterWorkItem( IOManagerState* iom, WorkItem* wi);
 
@@ -79,13 +97,23 @@ IOWorkerProc(PVOID param)
         iom->workersIdle++;
         OS_RELEASE_LOCK(&iom->manLock);
 
-        /*
-         * A possible future refinement is to make long-term idle threads
-         * wake up and decide to shut down should the number of idle threads
-         * be above some threshold.
-         *
-         */
-        rc = WaitForMultipleObjects( 2, hWaits, false, INFINITE );
+        /* See Note [Retiring idle MIO workers] */
+        while (1) {
+            rc = WaitForMultipleObjects( 2, hWaits, false,
+                                         IO_WORKER_IDLE_TIMEOUT );
+            if (rc != WAIT_TIMEOUT) {
+                break;
+            }
+            OS_ACQUIRE_LOCK(&iom->manLock);
+            if (iom->queueSize == 0 &&
+                iom->workersIdle > IO_WORKER_MIN_IDLE) {
+                iom->workersIdle--;
+                iom->numWorkers--;
+                OS_RELEASE_LOCK(&iom->manLock);
+                return 0;
+            }
+            OS_RELEASE_LOCK(&iom->manLock);
+        }
 
         if (rc == WAIT_OBJECT_0) {
             // we received the exit event
@@ -514,6 +542,28 @@ AddProcRequest ( void* proc,
     return depositWorkItem(reqID, wItem);
 }
 
+/*
+ * Function: getMIOManagerStats()
+ *
+ * For getRTSStats(): the number of requests waiting for a worker, and the
+ * number of workers, all and idle. All 0 if the MIO manager isn't running.
+ */
+void
+getMIOManagerStats ( uint32_t *queued,
+                     uint32_t *workers,
+                     uint32_t *idle )
+{
+    *queued = *workers = *idle = 0;
+    if (ioMan == NULL) {
+        return;
+    }
+    OS_ACQUIRE_LOCK(&ioMan->manLock);
+    *queued  = ioMan->queueSize;
+    *workers = ioMan->numWorkers;
+    *idle    = ioMan->workersIdle;
+    OS_RELEASE_LOCK(&ioMan->manLock);
+}
+
 void ShutdownIOManager ( bool wait_threads )
 {
     int num;
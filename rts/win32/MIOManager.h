@@ -106,4 +106,8 @@ extern int AddProcRequest ( void*          proc,
 
 extern void abandonWorkRequest ( int reqID );
 
+extern void getMIOManagerStats ( uint32_t *queued,
+                                 uint32_t *workers,
+                                 uint32_t *idle );
+
 extern void interruptIOManagerEvent ( void );
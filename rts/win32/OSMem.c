@@ -256,6 +256,19 @@ static void decommitBlocks(char *addr, W_ nBytes)
     }
 }
 
+bool osMapFileMemory(
+    void *p STG_UNUSED,
+    W_ len STG_UNUSED,
+    int fd STG_UNUSED,
+    StgWord64 offset STG_UNUSED)
+{
+    return false;
+}
+
+void osUnmapFileMemory(void *p STG_UNUSED, W_ len STG_UNUSED)
+{
+}
+
 void osFreeMBlocks(void *addr, uint32_t n)
 {
     W_ nBytes = (W_)n * MBLOCK_SIZE;
@@ -404,6 +417,13 @@ size_t getPageSize (void)
     return pagesize;
 }
 
+W_ osHugePageSize (void)
+{
+    // Large pages on Windows need SeLockMemoryPrivilege and cannot be
+    // decommitted, so we don't support them.
+    return 0;
+}
+
 /* Returns 0 if physical memory size cannot be identified */
 StgWord64 getPhysicalMemorySize (void)
 {
@@ -524,6 +544,13 @@ uint64_t osNumaMask(void)
     return (1 << osNumaNodes()) - 1;
 }
 
+uint32_t osNumaDistance(uint32_t from, uint32_t to)
+{
+    // Windows doesn't expose the SLIT table, so just distinguish local and
+    // remote nodes.
+    return from == to ? 10 : 20;
+}
+
 void osBindMBlocksToNode(
     void *addr,
     StgWord size,
@@ -432,6 +432,51 @@ setThreadAffinity (uint32_t n, uint32_t m) // cap N of M
     stgFree(mask);
 }
 
+// Lets the thread run on the given CPUs only, or on any CPU if n_cpus is 0.
+void
+setThreadAffinityToCPUs (const uint32_t *cpus, uint32_t n_cpus)
+{
+    uint8_t* proc_map      = createProcessorGroupMap();
+    uint32_t n_groups      = getNumberOfProcessorsGroups();
+    uint32_t* proc_cum     = getProcessorsCumulativeSum();
+    uint32_t n_proc        = getNumberOfProcessors();
+    HANDLE hThread         = GetCurrentThread();
+    DWORD_PTR *mask;
+
+    mask = stgMallocBytes(n_groups * sizeof(DWORD_PTR), "setThreadAffinityToCPUs");
+    memset(mask, 0, n_groups * sizeof(DWORD_PTR));
+
+    for (uint32_t i = 0; i < (n_cpus == 0 ? n_proc : n_cpus); i++) {
+        uint32_t cpu = n_cpus == 0 ? i : cpus[i];
+        if (cpu >= n_proc) {
+            continue;
+        }
+        int group = proc_map[cpu];
+        mask[group] |= (DWORD_PTR)1 << (cpu - proc_cum[group]);
+    }
+
+    for (uint32_t i = 0; i < n_groups; i++) {
+        if (mask[i] == 0) {
+            continue;
+        }
+#if defined(x86_64_HOST_ARCH)
+        GROUP_AFFINITY hGroup;
+        ZeroMemory(&hGroup, sizeof(hGroup));
+        hGroup.Mask = mask[i];
+        hGroup.Group = i;
+        if (!SetThreadGroupAffinity(hThread, &hGroup, NULL)) {
+            sysErrorBelch("SetThreadGroupAffinity");
+        }
+#else
+        if (SetThreadAffinityMask(hThread, mask[i]) == 0) {
+            sysErrorBelch("SetThreadAffinityMask");
+        }
+#endif
+    }
+
+    stgFree(mask);
+}
+
 void
 interruptOSThread (OSThreadId id)
 {
@@ -517,6 +562,19 @@ uint32_t getNumberOfProcessors (void)
 
 #endif /* !defined(THREADED_RTS) */
 
+// Job object CPU rate limits aren't taken into account yet.
+uint32_t
+getCPUQuota (void)
+{
+    return 0;
+}
+
+uint32_t
+getNumberOfUsableProcessors (void)
+{
+    return getNumberOfProcessors();
+}
+
 KernelThreadId kernelThreadId (void)
 {
     DWORD tid = GetCurrentThreadId();
@@ -1,5 +1,5 @@
 /*
- * A fixed-size queue; MT-friendly.
+ * A growable queue; MT-friendly.
  *
  * (c) sof, 2002-2003.
  */
@@ -7,6 +7,7 @@
 #include "RtsUtils.h"
 #include "WorkQueue.h"
 #include <stdbool.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,9 +36,14 @@ newSemaphore(int initCount, int max)
 /*
  * Function: NewWorkQueue
  *
- * The queue constructor - semaphores are initialised to match
- * max number of queue entries.
+ * The queue constructor.
  *
+ * The queue used to be a fixed ring of WORKQUEUE_SIZE entries, with a
+ * second semaphore counting the free ones, so that SubmitWork blocked while
+ * the ring was full. In the non-threaded RTS it is the scheduler's OS thread
+ * that submits the work, so a burst of I/O requests stalled every Haskell
+ * thread until a worker got round to taking one. Now the ring doubles when
+ * it is full instead.
  */
 WorkQueue*
 NewWorkQueue(void)
@@ -47,12 +53,13 @@ NewWorkQueue(void)
   memset(wq, 0, sizeof *wq);
 
   OS_INIT_LOCK(&wq->queueLock);
-  wq->workAvailable = newSemaphore(0, WORKQUEUE_SIZE);
-  wq->roomAvailable = newSemaphore(WORKQUEUE_SIZE, WORKQUEUE_SIZE);
+  wq->size = WORKQUEUE_SIZE;
+  wq->items = stgMallocBytes(wq->size * sizeof(void*), "NewWorkQueue");
+  memset(wq->items, 0, wq->size * sizeof(void*));
+  wq->workAvailable = newSemaphore(0, LONG_MAX);
 
-  /* Fail if we were unable to create any of the sync objects. */
-  if ( NULL == wq->workAvailable ||
-       NULL == wq->roomAvailable ) {
+  /* Fail if we were unable to create the semaphore. */
+  if ( NULL == wq->workAvailable ) {
     FreeWorkQueue(wq);
     return NULL;
   }
@@ -66,21 +73,19 @@ FreeWorkQueue ( WorkQueue* pq )
   int i;
 
   /* Free any remaining work items. */
-  for (i = 0; i < WORKQUEUE_SIZE; i++) {
+  for (i = 0; i < pq->size; i++) {
     if (pq->items[i] != NULL) {
       stgFree(pq->items[i]);
     }
   }
+  stgFree(pq->items);
 
-  /* Close the semaphores; any threads blocked waiting
-   * on either will as a result be woken up.
+  /* Close the semaphore; any threads blocked waiting
+   * on it will as a result be woken up.
    */
   if ( pq->workAvailable ) {
     CloseHandle(pq->workAvailable);
   }
-  if ( pq->roomAvailable ) {
-    CloseHandle(pq->roomAvailable);
-  }
   OS_CLOSE_LOCK(&pq->queueLock);
   stgFree(pq);
   return;
@@ -128,14 +133,13 @@ GetWork ( WorkQueue* pq, void** ppw )
 /*
  * Function: FetchWork
  *
- * Fetch a work item from the queue, blocking if none available.
+ * Fetch a work item from the queue, which the caller has already waited
+ * for on the queue's semaphore.
  * Return value indicates of false indicates error/fatal condition.
  */
 BOOL
 FetchWork ( WorkQueue* pq, void** ppw )
 {
-  DWORD rc;
-
   if (!pq) {
     queue_error("FetchWork", "NULL WorkQueue object");
     return false;
@@ -146,16 +150,17 @@ FetchWork ( WorkQueue* pq, void** ppw )
   }
 
   OS_ACQUIRE_LOCK(&pq->queueLock);
+  if (pq->count == 0) {
+    OS_RELEASE_LOCK(&pq->queueLock);
+    queue_error("FetchWork", "empty WorkQueue");
+    return false;
+  }
   *ppw = pq->items[pq->head];
   /* For sanity's sake, zero out the pointer. */
   pq->items[pq->head] = NULL;
-  pq->head = (pq->head + 1) % WORKQUEUE_SIZE;
-  rc = ReleaseSemaphore(pq->roomAvailable,1, NULL);
+  pq->head = (pq->head + 1) % pq->size;
+  pq->count--;
   OS_RELEASE_LOCK(&pq->queueLock);
-  if ( 0 == rc ) {
-    queue_error_rc("FetchWork.ReleaseSemaphore()", GetLastError());
-    return false;
-  }
 
   return true;
 }
@@ -163,7 +168,7 @@ FetchWork ( WorkQueue* pq, void** ppw )
 /*
  * Function: SubmitWork
  *
- * Add work item to the queue, blocking if no room available.
+ * Add work item to the queue, growing it if there is no room.
  * Return value indicates of false indicates error/fatal condition.
  */
 BOOL
@@ -180,18 +185,22 @@ SubmitWork ( WorkQueue* pq, void* pw )
     return false;
   }
 
-  /* Block waiting for work item to become available */
-  if ( (rc = WaitForSingleObject( pq->roomAvailable, INFINITE))
-         != WAIT_OBJECT_0 ) {
-    queue_error_rc("SubmitWork.WaitForSingleObject(workAvailable)",
-                   ( (WAIT_FAILED == rc) ? GetLastError() : rc));
-
-    return false;
-  }
-
   OS_ACQUIRE_LOCK(&pq->queueLock);
-  pq->items[pq->tail] = pw;
-  pq->tail = (pq->tail + 1) % WORKQUEUE_SIZE;
+  if (pq->count == pq->size) {
+    /* Full: double the ring, unwrapping it to start at 0. */
+    int size = pq->size * 2;
+    void** items = stgMallocBytes(size * sizeof(void*), "SubmitWork");
+    for (int i = 0; i < pq->count; i++) {
+      items[i] = pq->items[(pq->head + i) % pq->size];
+    }
+    memset(items + pq->count, 0, (size - pq->count) * sizeof(void*));
+    stgFree(pq->items);
+    pq->items = items;
+    pq->head = 0;
+    pq->size = size;
+  }
+  pq->items[(pq->head + pq->count) % pq->size] = pw;
+  pq->count++;
   rc = ReleaseSemaphore(pq->workAvailable,1, NULL);
   OS_RELEASE_LOCK(&pq->queueLock);
   if ( 0 == rc ) {
@@ -1,6 +1,6 @@
 /* WorkQueue.h
  *
- * A fixed-size queue; MT-friendly.
+ * A growable queue; MT-friendly.
  *
  * (c) sof, 2002-2003
  *
@@ -10,7 +10,8 @@
 
 #include <windows.h>
 
-/* This is a fixed-size queue. */
+/* The initial size of the queue, which doubles whenever it fills up, so
+   that submitting work never blocks. */
 #define WORKQUEUE_SIZE 16
 
 typedef HANDLE           Semaphore;
@@ -22,10 +23,10 @@ typedef struct WorkQueue {
   Mutex   queueLock;
   /* consumers/workers block waiting for 'workAvailable' */
   Semaphore     workAvailable;
-  Semaphore     roomAvailable;
   int           head;
-  int           tail;
-  void**        items[WORKQUEUE_SIZE];
+  int           count;
+  int           size;
+  void**        items;
 } WorkQueue;
 
 extern WorkQueue* NewWorkQueue       ( void );
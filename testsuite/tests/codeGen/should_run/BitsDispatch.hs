@@ -0,0 +1,59 @@
+{-# LANGUAGE MagicHash #-}
+
+-- Compiled without -msse4.2 or -mbmi2, popCount, pdep and pext go to the
+-- C fallbacks in ghc-internal, which use POPCNT and BMI2 when the CPU has
+-- them. Check them against plain Haskell on many masks, sparse and dense.
+
+module Main ( main ) where
+
+import Data.Bits
+import Data.List ( foldl' )
+import Data.Word
+import GHC.Exts
+import GHC.Word
+
+pdep64 :: Word64 -> Word64 -> Word64
+pdep64 (W64# s) (W64# m) = W64# (pdep64# s m)
+
+pext64 :: Word64 -> Word64 -> Word64
+pext64 (W64# s) (W64# m) = W64# (pext64# s m)
+
+refPdep :: Word64 -> Word64 -> Word64
+refPdep src mask = go 0 0 0
+  where
+    go i k acc
+      | i == 64 = acc
+      | testBit mask i = go (i + 1) (k + 1) (if testBit src k then setBit acc i else acc)
+      | otherwise = go (i + 1) k acc
+
+refPext :: Word64 -> Word64 -> Word64
+refPext src mask = go 0 0 0
+  where
+    go i k acc
+      | i == 64 = acc
+      | testBit mask i = go (i + 1) (k + 1) (if testBit src i then setBit acc k else acc)
+      | otherwise = go (i + 1) k acc
+
+refPopCount :: Word64 -> Int
+refPopCount w = length [ () | i <- [0 .. 63], testBit w i ]
+
+xorshift :: Word64 -> Word64
+xorshift x0 = x3
+  where x1 = x0 `xor` (x0 `shiftL` 13)
+        x2 = x1 `xor` (x1 `shiftR` 7)
+        x3 = x2 `xor` (x2 `shiftL` 17)
+
+main :: IO ()
+main = do
+  let rs = take 30000 (iterate xorshift 88172645463325252)
+      cases = zip rs (drop 1 rs)
+      masks (a, b) = [b, b .&. a, b .|. a, 0, maxBound]
+      bad = foldl' (\n (a, b) -> n + length
+                      [ () | m <- masks (a, b)
+                           , pdep64 a m /= refPdep a m
+                             || pext64 a m /= refPext a m ]
+                      + fromEnum (popCount a /= refPopCount a)
+                      + fromEnum (popCount (fromIntegral a :: Word32)
+                                   /= refPopCount (a .&. 0xffffffff)))
+                   0 cases
+  print (bad :: Int)
@@ -0,0 +1,66 @@
+{-# LANGUAGE BangPatterns #-}
+
+-- A benchmark for the I/O manager of the threaded RTS: pairs of threads
+-- echo short messages back and forth over pipes, one message in flight per
+-- pair, so that nearly all of the work is waiting for file descriptors.
+--
+-- With +RTS --io-manager-edge-triggered each pipe is registered with the
+-- kernel once, rather than once for every wait.
+
+import Control.Concurrent
+import Control.Monad
+import Data.Word (Word8)
+import Foreign.Marshal.Alloc (allocaBytes)
+import Foreign.Storable (pokeByteOff)
+import System.Environment
+import System.IO
+import System.Posix.IO (createPipe, fdToHandle)
+
+msgLen :: Int
+msgLen = 32
+
+pipe :: IO (Handle, Handle)
+pipe = do
+  (r, w) <- createPipe
+  hs@[hr, hw] <- mapM fdToHandle [r, w]
+  forM_ hs $ \h -> hSetBinaryMode h True >> hSetBuffering h NoBuffering
+  return (hr, hw)
+
+-- Echo the messages that arrive until the client hangs up.
+server :: Handle -> Handle -> IO ()
+server from to = allocaBytes msgLen $ \buf -> do
+  let loop = do
+        n <- hGetBuf from buf msgLen
+        when (n > 0) $ do
+          hPutBuf to buf n
+          loop
+  loop
+  hClose from
+  hClose to
+
+client :: Int -> Handle -> Handle -> IO Int
+client rounds to from = allocaBytes msgLen $ \buf -> do
+  forM_ [0 .. msgLen - 1] $ \i -> pokeByteOff buf i (fromIntegral i :: Word8)
+  let loop :: Int -> Int -> IO Int
+      loop 0 !echoed = return echoed
+      loop k !echoed = do
+        hPutBuf to buf msgLen
+        n <- hGetBuf from buf msgLen
+        loop (k - 1) (echoed + n)
+  echoed <- loop rounds 0
+  hClose to
+  hClose from
+  return echoed
+
+main :: IO ()
+main = do
+  [pairs, rounds] <- map read <$> getArgs
+  dones <- replicateM pairs $ do
+    (reqR, reqW) <- pipe
+    (respR, respW) <- pipe
+    done <- newEmptyMVar
+    _ <- forkIO $ server reqR respW
+    _ <- forkIO $ client rounds reqW respR >>= putMVar done
+    return done
+  echoed <- sum <$> mapM takeMVar dones
+  print echoed
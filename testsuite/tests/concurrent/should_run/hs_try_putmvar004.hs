@@ -0,0 +1,33 @@
+module Main where
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import GHC.Conc
+
+-- hs_try_putmvar_batch() from a C thread, waking threads on every
+-- capability.
+
+main :: IO ()
+main = do
+  n <- getNumCapabilities
+  mvars <- replicateM 1000 newEmptyMVar :: IO [MVar ()]
+
+  done <- newEmptyMVar
+  forM_ (zip [0 :: Int ..] mvars) $ \(i, m) ->
+    forkOn (i `mod` n) $ do
+      takeMVar m
+      putMVar done ()
+
+  sps <- mask_ $ mapM newStablePtrPrimMVar mvars
+  -- the capability of each put, -1 for some
+  let caps = [ if i `mod` 7 == 0 then -1 else fromIntegral (i `mod` n)
+             | i <- [0 .. length mvars - 1] ]
+  withArray caps $ \pcaps -> withArray sps $ \psps ->
+    batchFromThread (length mvars) pcaps psps
+
+  replicateM_ (length mvars) (takeMVar done)
+  putStrLn "done"
+
+foreign import ccall safe "batchFromThread"
+  batchFromThread :: Int -> Ptr Int32 -> Ptr (StablePtr PrimMVar) -> IO ()
@@ -0,0 +1,25 @@
+#include "HsFFI.h"
+#include <pthread.h>
+
+struct batch {
+    int n;
+    const int *caps;
+    HsStablePtr *mvars;
+};
+
+static void *putAll(void *p)
+{
+    struct batch *b = p;
+    hs_try_putmvar_batch(b->n, b->caps, b->mvars);
+    hs_thread_done();
+    return NULL;
+}
+
+// Put the MVars from a thread of our own, which the RTS has never seen.
+void batchFromThread(HsInt n, const int *caps, HsStablePtr *mvars)
+{
+    pthread_t t;
+    struct batch b = { (int)n, caps, mvars };
+    pthread_create(&t, NULL, putAll, &b);
+    pthread_join(t, NULL);
+}
@@ -0,0 +1,36 @@
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import GHC.Internal.MVar (bargingPutMVar, bargingTakeMVar)
+
+-- bargingPutMVar and bargingTakeMVar wake a single waiter up to try again
+-- rather than handing it the MVar, and fall back to handing over when
+-- several threads wait (see Note [Barging MVar operations] in
+-- rts/PrimOps.cmm). Either way no update may be lost and no thread may be
+-- left blocked.
+
+main :: IO ()
+main = do
+  -- An MVar () used as a lock, released by bargingPutMVar
+  forM_ [2, 8] $ \n -> do
+    lock <- newMVar ()
+    counter <- newIORef (0 :: Int)
+    dones <- forM [1 .. n] $ \_ -> do
+      done <- newEmptyMVar
+      _ <- forkIO $ do
+        replicateM_ 10000 $ do
+          takeMVar lock
+          modifyIORef' counter (+ 1)
+          bargingPutMVar lock ()
+        putMVar done ()
+      return done
+    mapM_ takeMVar dones
+    print =<< readIORef counter
+
+  -- A channel with producers blocked in putMVar, emptied by
+  -- bargingTakeMVar
+  forM_ [1, 4] $ \n -> do
+    chan <- newEmptyMVar
+    forM_ [1 .. n] $ \_ -> forkIO $ forM_ [1 .. 10000] $ putMVar chan
+    total <- sum <$> replicateM (n * 10000) (bargingTakeMVar chan)
+    print (total :: Int)
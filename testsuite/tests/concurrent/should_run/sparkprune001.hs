@@ -0,0 +1,19 @@
+import Control.Monad
+import GHC.Conc
+import System.Mem
+
+-- Sparks that survive a minor GC are skipped by the pruning of later minor
+-- GCs (see Note [Incremental spark pruning] in rts/Sparks.c); they must
+-- still refer to the right closures once older generations are collected.
+
+main :: IO ()
+main = do
+  let xs = [ sum [1..i] | i <- [1 .. 20000 :: Int] ]
+  forM_ xs $ \x -> x `par` return ()
+  replicateM_ 3 performMinorGC
+  let (ys, zs) = splitAt 10000 xs
+  print (sum ys)
+  replicateM_ 3 performMinorGC
+  performMajorGC
+  replicateM_ 3 performMinorGC
+  print (sum zs)
@@ -0,0 +1,37 @@
+import Control.Monad
+import GHC.Conc
+
+-- Transactions touching many TVars have their entries found through an
+-- index (see Note [TRec index] in rts/STM.c), including those of nested
+-- transactions, and across GCs in the middle of a transaction.
+
+modifyTVar' :: TVar Int -> (Int -> Int) -> STM ()
+modifyTVar' tv f = do
+  x <- readTVar tv
+  writeTVar tv $! f x
+
+main :: IO ()
+main = do
+  tvs <- mapM newTVarIO [1 .. 2000 :: Int]
+  -- Read and write every TVar twice in one transaction
+  atomically $ forM_ (tvs ++ reverse tvs) $ \tv -> modifyTVar' tv (* 2)
+  print . sum =<< mapM readTVarIO tvs
+  -- The updates of a failed alternative are discarded; those of the one
+  -- that succeeds are merged into the enclosing transaction
+  r <- atomically $ do
+    forM_ tvs $ \tv -> modifyTVar' tv (+ 1)
+    (do forM_ tvs $ \tv -> modifyTVar' tv negate
+        retry)
+      `orElse` (do forM_ (take 1000 tvs) $ \tv -> modifyTVar' tv (+ 1)
+                   sum <$> mapM readTVar tvs)
+  print r
+  print . sum =<< mapM readTVarIO tvs
+  -- Allocate enough inside the transaction for some GCs to happen
+  s <- atomically $ do
+    xs <- forM tvs $ \tv -> do
+      x <- readTVar tv
+      writeTVar tv (length (show [1 .. x]))
+      return x
+    ys <- mapM readTVar tvs
+    return (sum xs + sum ys)
+  print s
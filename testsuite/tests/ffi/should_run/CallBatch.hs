@@ -0,0 +1,27 @@
+-- A batch of C calls made from a single safe foreign call, in order, from
+-- the calling thread's OS thread.
+
+import Control.Concurrent
+import Foreign
+import GHC.Internal.Foreign.CallBatch
+
+foreign import ccall "&batch_add" p_add :: FunPtr (Ptr Int -> IO Int)
+foreign import ccall "&batch_thread" p_thread :: FunPtr (Ptr () -> IO Int)
+foreign import ccall unsafe "batch_thread" threadNow :: Ptr () -> IO Int
+
+main :: IO ()
+main = do
+  print =<< callBatch []
+
+  -- each call adds its argument's value to a running total and returns it
+  r <- withArray [1 .. 100 :: Int] $ \xs ->
+    callBatch [ BatchCall p_add (xs `advancePtr` i) | i <- [0 .. 99] ]
+  print (length r, last r, and (zipWith (<) r (tail r)))
+
+  -- from a bound thread, every call runs on its OS thread
+  done <- newEmptyMVar
+  _ <- forkOS $ do
+    me <- threadNow nullPtr
+    ts <- callBatch (replicate 10 (BatchCall p_thread nullPtr))
+    putMVar done (all (== me) ts)
+  print =<< takeMVar done
@@ -0,0 +1,16 @@
+#include "HsFFI.h"
+#include <pthread.h>
+
+static HsInt total = 0;
+
+HsInt batch_add(HsInt *x)
+{
+    total += *x;
+    return total;
+}
+
+HsInt batch_thread(void *arg)
+{
+    (void)arg;
+    return (HsInt)pthread_self();
+}
@@ -0,0 +1,40 @@
+-- Round trips of safe foreign calls from bound threads, which return to a
+-- free capability; see Note [Claiming a free capability] in
+-- rts/Capability.c. Pass "report" after the count to print the latency.
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock
+import System.Environment
+import System.IO
+
+foreign import ccall safe "safe_inc" safeInc :: Int -> IO Int
+
+calls :: Int -> IO Int
+calls n = go n 0
+  where
+    go 0 !acc = return acc
+    go i !acc = safeInc acc >>= go (i - 1)
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let n = case args of
+            (a:_) -> read a
+            _     -> 1000000
+      report = "report" `elem` drop 1 args
+
+  t0 <- getMonotonicTimeNSec
+  r <- calls n
+  t1 <- getMonotonicTimeNSec
+  print (r == n)
+
+  -- and from another bound thread, while the main thread waits
+  done <- newEmptyMVar
+  _ <- forkOS $ calls n >>= putMVar done
+  r' <- takeMVar done
+  print (r' == n)
+
+  when report $
+    hPutStrLn stderr $ "safe call round trip: "
+      ++ show (fromIntegral (t1 - t0) / fromIntegral n :: Double) ++ " ns"
@@ -0,0 +1,6 @@
+#include "HsFFI.h"
+
+HsInt safe_inc(HsInt x)
+{
+    return x + 1;
+}
@@ -0,0 +1,54 @@
+-- Creating, calling and freeing "wrapper" FunPtrs from several threads at
+-- once; see Note [Per-capability adjustor caches] in
+-- rts/adjustor/AdjustorPool.c. Pass "report" after the count to print the
+-- throughput.
+
+import Control.Concurrent
+import Control.Monad
+import Foreign.Ptr
+import GHC.Clock
+import System.Environment
+import System.IO
+
+foreign import ccall "wrapper" mkCallback :: (Int -> IO Int) -> IO (FunPtr (Int -> IO Int))
+foreign import ccall "dynamic" callCallback :: FunPtr (Int -> IO Int) -> Int -> IO Int
+
+-- Keep a few callbacks alive at a time, so that their slots are reused in a
+-- different order from the one they were taken in
+wrappers :: Int -> Int -> IO Int
+wrappers k n = go n 0 []
+  where
+    go 0 !acc live = do
+      mapM_ freeHaskellFunPtr live
+      return acc
+    go i !acc live = do
+      f <- mkCallback (\x -> return (x + k))
+      r <- callCallback f i
+      let live' = f : live
+      if length live' > i `mod` 8
+        then do mapM_ freeHaskellFunPtr live'
+                go (i - 1) (acc + r - i) []
+        else go (i - 1) (acc + r - i) live'
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let n = case args of
+            (a:_) -> read a
+            _     -> 1000000
+      report = "report" `elem` drop 1 args
+      threads = 4
+
+  t0 <- getMonotonicTimeNSec
+  dones <- forM [1 .. threads] $ \k -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ wrappers k n >>= putMVar done
+    return (k, done)
+  results <- forM dones $ \(k, done) -> (== k * n) <$> takeMVar done
+  t1 <- getMonotonicTimeNSec
+  print (and results)
+
+  when report $
+    hPutStrLn stderr $ "wrapper create/call/free: "
+      ++ show (fromIntegral (t1 - t0) / fromIntegral (threads * n) :: Double)
+      ++ " ns"
@@ -0,0 +1,74 @@
+{-
+   Micro-benchmarks for the bytecode interpreter, see
+   Note [Threaded interpreter dispatch] in rts/Interpreter.c.
+
+   Each kernel runs a loop in bytecode that mostly dispatches instructions
+   (pushes, tests, returns, applications) rather than calling compiled code.
+   The results go to stdout, and are checked; the time each kernel takes,
+   in iterations per second, goes to stderr, which the testsuite ignores:
+   run the test by hand to see it.
+ -}
+module Main where
+
+import Control.Exception (evaluate)
+import System.CPUTime (getCPUTime)
+import System.IO (hPutStrLn, stderr)
+import Text.Printf (printf)
+
+data Shape = Circle Int | Square Int | Rect Int Int
+
+-- Integer arithmetic and comparisons
+sumTo :: Int -> Int
+sumTo n = go 0 0
+  where
+    go :: Int -> Int -> Int
+    go acc i | i > n     = acc
+             | otherwise = go (acc + i * 3 - 1) (i + 1)
+
+-- Case on constructors and returns
+shapes :: Int -> Int
+shapes n = go 0 0
+  where
+    go :: Int -> Int -> Int
+    go acc i
+      | i >= n    = acc
+      | otherwise = go (acc + area (shape i)) (i + 1)
+    shape i = case i `rem` 3 of
+                0 -> Circle i
+                1 -> Square i
+                _ -> Rect i 2
+    area (Circle r) = 3 * r
+    area (Square s) = s + s
+    area (Rect a b) = a * b
+
+-- Unknown calls and partial applications
+applies :: Int -> Int
+applies n = go 0 0
+  where
+    fs :: [Int -> Int -> Int]
+    fs = [(+), (-), \a b -> a * 2 + b, const]
+    go :: Int -> Int -> Int
+    go acc i
+      | i >= n    = acc
+      | otherwise = go ((fs !! (i `rem` 4)) acc i `rem` 1000003) (i + 1)
+
+-- Allocation of thunks and lazy lists
+lists :: Int -> Int
+lists n = foldr (\x k acc -> k (acc + x `rem` 7)) id [1 .. n] 0
+
+kernel :: String -> (Int -> Int) -> Int -> IO ()
+kernel name f n = do
+  start <- getCPUTime
+  r <- evaluate (f n)
+  end <- getCPUTime
+  printf "%s: %d\n" name r
+  let secs = fromIntegral (end - start) / 1e12 :: Double
+  hPutStrLn stderr $
+    printf "%-8s %12.0f iterations/s" name (fromIntegral n / max secs 1e-6)
+
+main :: IO ()
+main = do
+  kernel "sumTo" sumTo 2000000
+  kernel "shapes" shapes 1000000
+  kernel "applies" applies 1000000
+  kernel "lists" lists 500000
@@ -0,0 +1,11 @@
+module Main (main) where
+
+import qualified Data.Map as M
+
+-- Enough different closure types, over enough censuses, for hp2ps to
+-- choose among the bands
+main :: IO ()
+main = do
+  let m = M.fromList [ (i, (show i, [i .. i + 10])) | i <- [1 .. 20000 :: Int] ]
+  print (M.foldr (\(s, xs) n -> n + length s + sum xs) 0 m)
+  print (sum (map (fromIntegral :: Int -> Double) (concatMap snd (M.elems m))))
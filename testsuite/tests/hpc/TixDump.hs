@@ -0,0 +1,14 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+
+-- | hs_hpc_dump writes the .tix file before the program exits
+module Main where
+
+import Data.List (isPrefixOf)
+
+foreign import ccall "hs_hpc_dump" hs_hpc_dump :: IO ()
+
+main :: IO ()
+main = do
+  hs_hpc_dump
+  tix <- readFile "TixDump.tix"
+  print ("Tix [" `isPrefixOf` tix && "\"Main\"" `elem` words tix)
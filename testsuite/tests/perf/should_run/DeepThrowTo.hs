@@ -0,0 +1,36 @@
+-- Kill threads blocked deep in a recursion that builds no thunks. Their
+-- stacks span many chunks, which raiseAsync should not copy into the heap
+-- only to throw them away at the catch frame of forkIO.
+-- See Note [Freezing the stack lazily] in rts/RaiseAsync.c.
+
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import System.Environment
+
+deep :: MVar () -> MVar () -> Int -> IO Int
+deep ready block 0 = putMVar ready () >> takeMVar block >> return 0
+deep ready block n = do
+  r <- deep ready block (n - 1)
+  return $! r + 1
+{-# NOINLINE deep #-}
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let (rounds, depth) = case args of
+        [r, d] -> (read r, read d)
+        _      -> (20, 200000) :: (Int, Int)
+  killed <- forM [1 .. rounds] $ \_ -> do
+    ready <- newEmptyMVar
+    block <- newEmptyMVar
+    done <- newEmptyMVar
+    t <- forkIO $ do
+      r <- try (evaluate =<< deep ready block depth)
+      putMVar done $ case r of
+        Left ThreadKilled -> True
+        _                 -> False
+    takeMVar ready
+    killThread t
+    takeMVar done
+  print (length (filter id killed))
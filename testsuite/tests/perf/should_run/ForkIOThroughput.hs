@@ -0,0 +1,25 @@
+-- Fork many short-lived threads, a few at a time, as a server forking a
+-- thread per request does. Each thread's stack is reused by a later one;
+-- see Note [Reusing thread stacks] in rts/Threads.c.
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import System.Environment
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let (rounds, width) = case args of
+        [r, w] -> (read r, read w)
+        _      -> (50000, 10) :: (Int, Int)
+  total <- newIORef (0 :: Int)
+  forM_ [1 .. rounds] $ \i -> do
+    dones <- forM [1 .. width] $ \j -> do
+      done <- newEmptyMVar
+      _ <- forkIO $ do
+        atomicModifyIORef' total (\t -> (t + i * j `mod` 7, ()))
+        putMVar done ()
+      return done
+    mapM_ takeMVar dones
+  print =<< readIORef total
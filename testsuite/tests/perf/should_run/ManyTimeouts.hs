@@ -0,0 +1,39 @@
+-- Many threads in threadDelay at once, half of them cancelled by the
+-- timeout around them, half of them cancelling it: a micro-benchmark for
+-- the timer heap of the non-threaded RTS's I/O managers. See
+-- Note [The timer heap] in rts/posix/TimerHeap.c.
+--
+-- Each thread has two timers (timeout forks a thread that sleeps), so
+-- @ManyTimeouts 500000@ has a million timers pending at once.
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import Data.Maybe
+import System.Environment
+import System.Timeout
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let n = case args of
+            [s] -> read s
+            _   -> 50000 :: Int
+  remaining <- newIORef n
+  completed <- newIORef (0 :: Int)
+  done <- newEmptyMVar
+  forM_ [1 .. n] $ \i -> forkIO $ do
+    -- spread the targets over a second, so that they don't all come in
+    -- order, and keep the delay and its timeout far apart
+    let jitter = (i * 7919) `mod` 1000 * 1000
+        (delay, limit)
+          | even i    = (100000 + jitter, 2000000 + jitter)
+          | otherwise = (2000000 + jitter, 100000 + jitter)
+    r <- timeout limit (threadDelay delay)
+    when (isJust r) $ atomicModifyIORef' completed (\c -> (c + 1, ()))
+    left <- atomicModifyIORef' remaining (\m -> (m - 1, m - 1))
+    when (left == 0) $ putMVar done ()
+  takeMVar done
+  c <- readIORef completed
+  putStrLn ("completed: " ++ show c)
+  putStrLn ("timed out: " ++ show (n - c))
@@ -0,0 +1,11 @@
+-- Recursions whose depth goes back and forth across stack chunk
+-- boundaries. Each overflow used to allocate a new 32k chunk; see
+-- Note [Reusing stack chunks] in rts/Threads.c.
+
+down :: Int -> Int
+down 0 = 0
+down n = 1 + down (n - 1)
+{-# NOINLINE down #-}
+
+main :: IO ()
+main = print (sum [ down (5000 + i `mod` 3000) | i <- [1 .. 20000 :: Int] ])
@@ -0,0 +1,92 @@
+{-# LANGUAGE MagicHash #-}
+{-# LANGUAGE UnboxedTuples #-}
+
+-- Growing large byte arrays, which the RTS does in place when it can (see
+-- Note [Growing large byte arrays in place] in rts/sm/Storage.c): the
+-- contents must survive however it was done.
+
+import Control.Monad
+import GHC.Exts
+import GHC.IO (IO(..))
+import GHC.Word
+import System.Mem (performMajorGC)
+
+data MBA = MBA (MutableByteArray# RealWorld)
+
+newMBA :: Int -> IO MBA
+newMBA (I# n) = IO $ \s -> case newByteArray# n s of
+  (# s', a #) -> (# s', MBA a #)
+
+resize :: MBA -> Int -> IO MBA
+resize (MBA a) (I# n) = IO $ \s -> case resizeMutableByteArray# a n s of
+  (# s', a' #) -> (# s', MBA a' #)
+
+shrink :: MBA -> Int -> IO ()
+shrink (MBA a) (I# n) = IO $ \s -> (# shrinkMutableByteArray# a n s, () #)
+
+size :: MBA -> IO Int
+size (MBA a) = IO $ \s -> case getSizeofMutableByteArray# a s of
+  (# s', n #) -> (# s', I# n #)
+
+address :: MBA -> Int
+address (MBA a) = I# (addr2Int# (mutableByteArrayContents# a))
+
+write :: MBA -> Int -> Word8 -> IO ()
+write (MBA a) (I# i) (W8# w) = IO $ \s -> (# writeWord8Array# a i w s, () #)
+
+index :: MBA -> Int -> IO Word8
+index (MBA a) (I# i) = IO $ \s -> case readWord8Array# a i s of
+  (# s', w #) -> (# s', W8# w #)
+
+byte :: Int -> Word8
+byte i = fromIntegral (i * 7 + i `div` 251)
+
+-- Fill [from, to) with the pattern.
+fill :: MBA -> Int -> Int -> IO ()
+fill a from to = forM_ [from .. to - 1] $ \i -> write a i (byte i)
+
+-- Check that the array has the given size, and the pattern up to n.
+check :: String -> MBA -> Int -> Int -> IO ()
+check what a sz n = do
+  sz' <- size a
+  unless (sz' == sz) $
+    putStrLn (what ++ ": size " ++ show sz' ++ ", not " ++ show sz)
+  bad <- filterM (\i -> (/= byte i) <$> index a i) [0 .. n - 1]
+  unless (null bad) $
+    putStrLn (what ++ ": " ++ show (length bad) ++ " bytes lost, from "
+              ++ show (head bad))
+
+main :: IO ()
+main = do
+  -- doubling, from a small array to a large one and on
+  let sizes = takeWhile (<= 4 * 1024 * 1024) (iterate (* 2) 1000)
+  a0 <- newMBA (head sizes)
+  fill a0 0 (head sizes)
+  final <- foldM (\a (old, new) -> do
+                     a' <- resize a new
+                     check ("growing to " ++ show new) a' new old
+                     fill a' old new
+                     return a')
+                 a0 (zip sizes (tail sizes))
+  check "after doubling" final (last sizes) (last sizes)
+
+  -- growing by a little at a time, and with a GC in between
+  b0 <- newMBA 5000
+  fill b0 0 5000
+  b <- foldM (\b n -> do
+                 b' <- resize b n
+                 fill b' (n - 1000) n
+                 when (n `mod` 100000 == 0) performMajorGC
+                 return b')
+             b0 [6000, 7000 .. 300000]
+  check "after creeping" b 300000 300000
+
+  -- growing back into the part of the group that a shrink left
+  c <- newMBA 65536
+  fill c 0 65536
+  shrink c 16384
+  let addr = address c
+  addr `seq` return ()
+  c' <- resize c 49152
+  check "after shrinking and growing" c' 49152 16384
+  print (address c' == addr)
@@ -0,0 +1,14 @@
+{-# LANGUAGE BangPatterns #-}
+module Main where
+
+import GHC.Profiling
+import System.Mem
+import Control.Exception
+
+-- A census counted by the GC, see Note [Heap census during GC] in ProfHeap.c
+main = do
+  let !t = [0..1000000 :: Int]
+  evaluate (length t)
+  requestHeapCensus
+  performMajorGC
+  print (sum t)
@@ -0,0 +1,19 @@
+{-# LANGUAGE BangPatterns #-}
+module Main where
+
+import GHC.Profiling
+import System.Mem
+import Control.Exception
+
+-- Delta-encoded censuses, see Note [Delta-encoded heap profile] in
+-- ProfHeap.c: the second census changes some bands and drops others.
+main = do
+  let !t = [0..100000 :: Int]
+  evaluate (length t)
+  requestHeapCensus
+  performMajorGC
+  let !u = map show t
+  evaluate (sum (map length u))
+  requestHeapCensus
+  performMajorGC
+  print (length u)
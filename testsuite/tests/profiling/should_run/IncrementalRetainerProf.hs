@@ -0,0 +1,17 @@
+{-# LANGUAGE BangPatterns #-}
+module Main where
+
+import GHC.Profiling
+import System.Mem
+import Control.Exception
+import Control.Monad
+
+-- Retainer sets computed over several censuses, see
+-- Note [Incremental retainer profiling] in RetainerProfile.c
+main = do
+  let !t = [0..1000000 :: Int]
+  evaluate (length t)
+  replicateM_ 10 $ do
+    requestHeapCensus
+    performMajorGC
+  print (sum t)
@@ -0,0 +1,15 @@
+{-# LANGUAGE BangPatterns #-}
+module Main where
+
+import GHC.Profiling
+import System.Mem
+import Control.Exception
+
+-- The census taken by performMajorGC runs on the GC threads, see
+-- Note [Parallel heap census] in ProfHeap.c
+main = do
+  let !t = [0..1000000 :: Int]
+  evaluate (length t)
+  requestHeapCensus
+  performMajorGC
+  print (sum t)
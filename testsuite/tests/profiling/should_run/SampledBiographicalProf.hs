@@ -0,0 +1,19 @@
+{-# LANGUAGE BangPatterns #-}
+module Main where
+
+import GHC.Profiling
+import System.Mem
+import Control.Exception
+
+-- A biographical profile from 1 in 4 blocks, see
+-- Note [Sampled biographical profiling] in ProfHeap.c
+main = do
+  let !t = [0..1000000 :: Int]
+  evaluate (length t)
+  requestHeapCensus
+  performMajorGC
+  let !u = map (* 2) t
+  evaluate (length u)
+  requestHeapCensus
+  performMajorGC
+  print (sum t + sum u)
@@ -0,0 +1,54 @@
+-- Test the epoll I/O manager with many threads waiting at once: for timers,
+-- for timers that are cancelled, and for file descriptors.
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock (getMonotonicTimeNSec)
+import Foreign
+import Foreign.C
+import System.Posix.Types (Fd(..))
+import System.Timeout
+
+foreign import ccall unsafe "pipe" c_pipe :: Ptr CInt -> IO CInt
+foreign import ccall unsafe "read" c_read :: CInt -> Ptr Word8 -> CSize -> IO CSsize
+foreign import ccall unsafe "write" c_write :: CInt -> Ptr Word8 -> CSize -> IO CSsize
+
+newPipe :: IO (CInt, CInt)
+newPipe = allocaArray 2 $ \p -> do
+  throwErrnoIfMinus1_ "pipe" (c_pipe p)
+  [r, w] <- peekArray 2 p
+  return (r, w)
+
+main :: IO ()
+main = do
+  -- Many sleeping threads, woken no earlier than they asked
+  done <- newEmptyMVar
+  forM_ [1 .. 1000 :: Int] $ \i -> forkIO $ do
+    let us = (i * 7919) `mod` 20000
+    t0 <- getMonotonicTimeNSec
+    threadDelay us
+    t1 <- getMonotonicTimeNSec
+    putMVar done (t1 - t0 >= fromIntegral us * 1000)
+  oks <- replicateM 1000 (takeMVar done)
+  putStrLn ("delays: " ++ show (and oks))
+
+  -- Many cancelled timers
+  rs <- forM [1 .. 1000 :: Int] $ \_ -> do
+    v <- newEmptyMVar
+    _ <- forkIO $ timeout 1000 (threadDelay 1000000000) >>= putMVar v
+    return v
+  cancelled <- mapM takeMVar rs
+  putStrLn ("timeouts: " ++ show (all (== Nothing) cancelled))
+
+  -- Many threads waiting for pipes
+  pipes <- replicateM 200 newPipe
+  forM_ pipes $ \(r, _) -> forkIO $ do
+    threadWaitRead (Fd r)
+    n <- allocaBytes 1 $ \buf -> c_read r buf 1
+    putMVar done (n == 1)
+  threadDelay 10000
+  forM_ (reverse pipes) $ \(_, w) ->
+    with (1 :: Word8) $ \buf -> c_write w buf 1
+  oks' <- replicateM (length pipes) (takeMVar done)
+  putStrLn ("reads: " ++ show (and oks'))
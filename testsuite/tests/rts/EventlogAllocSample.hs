@@ -0,0 +1,6 @@
+-- Allocate enough to fill many nursery blocks, so that
+-- --eventlog-alloc-sample posts samples; see Note [Allocation sampling] in
+-- rts/Trace.c.
+
+main :: IO ()
+main = print (sum (map fromIntegral [1 .. 100000 :: Int]) :: Integer)
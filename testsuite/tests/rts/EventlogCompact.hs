@@ -0,0 +1,13 @@
+-- Switch threads often, so that most of the eventlog is scheduler events,
+-- which the compact format (+RTS --eventlog-compact) writes in fewer bytes.
+
+import Control.Concurrent
+import Control.Monad
+
+main :: IO ()
+main = do
+  done <- newEmptyMVar
+  forM_ [1, 2 :: Int] $ \_ -> forkIO $ do
+    replicateM_ 1000 yield
+    putMVar done ()
+  replicateM_ 2 (takeMVar done)
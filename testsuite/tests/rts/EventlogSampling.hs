@@ -0,0 +1,21 @@
+-- Switch threads often enough for the scheduler events to be sampled; see
+-- Note [Sampling events] in rts/Trace.c. With an argument, set the sampling
+-- rate from the program rather than with --eventlog-sample-sched.
+
+import Control.Concurrent
+import Control.Monad
+import Data.Word
+import System.Environment
+
+foreign import ccall unsafe "setEventLogSampleRate"
+  setEventLogSampleRate :: Word32 -> Word32 -> IO ()
+
+main :: IO ()
+main = do
+  args <- getArgs
+  forM_ args $ \n -> setEventLogSampleRate 0 (read n)
+  done <- newEmptyMVar
+  forM_ [1, 2 :: Int] $ \_ -> forkIO $ do
+    replicateM_ 1000 yield
+    putMVar done ()
+  replicateM_ 2 (takeMVar done)
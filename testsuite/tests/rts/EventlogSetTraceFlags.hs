@@ -0,0 +1,17 @@
+-- Change the trace classes while running, see
+-- Note [Changing trace classes] in rts/Trace.c.
+
+import Foreign.C.String
+import Foreign.C.Types
+
+foreign import ccall safe "rts_setTraceFlags"
+  rts_setTraceFlags :: CString -> IO CBool
+
+setTraceFlags :: String -> IO Bool
+setTraceFlags flags = (/= 0) <$> withCString flags rts_setTraceFlags
+
+main :: IO ()
+main = do
+  setTraceFlags "-as" >>= print
+  setTraceFlags "-au" >>= print
+  setTraceFlags "x" >>= print
@@ -0,0 +1,17 @@
+-- A consumer joining the eventlog served by --eventlog-socket gets the
+-- header first; see Note [Eventlog socket] in rts/eventlog/EventLogSocket.c.
+
+import Foreign
+import Foreign.C
+
+foreign import ccall safe "read_eventlog_socket"
+  readEventlogSocket :: CString -> CString -> IO CInt
+
+main :: IO ()
+main =
+  withCString "EventlogSocket.sock" $ \path ->
+  allocaBytes 4 $ \buf -> do
+    r <- readEventlogSocket path buf
+    if r /= 0
+      then putStrLn "couldn't read the eventlog socket"
+      else peekCStringLen (buf, 4) >>= putStrLn
@@ -0,0 +1,32 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Connect to the eventlog socket and read the first four bytes of the
+ * eventlog into buf. Returns 0 on success. */
+int read_eventlog_socket(const char *path, char *buf)
+{
+    struct sockaddr_un addr;
+    int fd, got = 0;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    while (got < 4) {
+        ssize_t n = read(fd, buf + got, 4 - got);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        got += n;
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,6 @@
+-- Allocate for long enough that the timer asks for several samples of the
+-- stack with --eventlog-stack-sample; see Note [Stack sampling] in
+-- rts/Trace.c.
+
+main :: IO ()
+main = print (sum (map fromIntegral [1 .. 20000000 :: Int]) :: Integer)
@@ -0,0 +1,16 @@
+-- Post enough events from two capabilities to fill several event buffers
+-- each, with the eventlog written by the writer thread; see
+-- Note [Eventlog writer thread] in rts/eventlog/EventLog.c.
+
+import Control.Concurrent
+import Control.Monad
+import Debug.Trace
+
+main :: IO ()
+main = do
+  done <- newEmptyMVar
+  forM_ [0, 1] $ \c -> forkOn c $ do
+    forM_ [1 .. 100000 :: Int] $ \i ->
+      traceEventIO ("event " ++ show c ++ " " ++ show i)
+    putMVar done ()
+  replicateM_ 2 (takeMVar done)
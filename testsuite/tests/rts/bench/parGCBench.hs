@@ -0,0 +1,178 @@
+{-# LANGUAGE BangPatterns #-}
+
+-- Workloads for measuring how the RTS, and the parallel GC above all,
+-- scales with the number of capabilities. Each does a fixed amount of work
+-- shared out between the capabilities, so running it at -N1, -N2, ... gives
+-- a speedup curve. parscale.py does that, collecting the GC statistics of
+-- each run. See all.T.
+--
+--     parGCBench <workload> [<scale>]
+--
+-- where the workload is one of
+--
+--   alloc   short-lived allocation at a high rate, little live data
+--   live    a large live heap, updated persistently, so much is promoted
+--   marray  random writes of new boxes into large boxed mutable arrays
+--   stm     transactions contending for a few TVars
+--   sparks  divide-and-conquer with par and pseq
+--   all     each of the above in turn
+
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import GHC.Conc
+import GHC.IOArray
+import System.Environment
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let (workload, scale) = case args of
+        [w]    -> (w, 1)
+        [w, s] -> (w, read s)
+        _      -> error "usage: parGCBench <workload> [<scale>]"
+  n <- getNumCapabilities
+  let run w = case lookup w workloads of
+        Just f  -> do
+          ok <- f n scale
+          putStrLn (w ++ if ok then ": ok" else ": FAILED")
+        Nothing -> error ("unknown workload " ++ w)
+  if workload == "all"
+    then mapM_ (run . fst) workloads
+    else run workload
+
+workloads :: [(String, Int -> Int -> IO Bool)]
+workloads =
+  [ ("alloc", allocWork)
+  , ("live", liveWork)
+  , ("marray", marrayWork)
+  , ("stm", stmWork)
+  , ("sparks", sparkWork)
+  ]
+
+-- Run a worker on each capability, given its number, and wait for them.
+onEachCap :: Int -> (Int -> IO a) -> IO [a]
+onEachCap n f = do
+  results <- forM [0 .. n - 1] $ \i -> do
+    r <- newEmptyMVar
+    _ <- forkOn i (f i >>= evaluate >>= putMVar r)
+    return r
+  mapM takeMVar results
+
+-- The share of the total work done by worker i of n.
+share :: Int -> Int -> Int -> Int
+share total n i = total `div` n + (if i < total `mod` n then 1 else 0)
+
+next :: Int -> Int
+next x = (x * 1103515245 + 12345) `mod` 2147483648
+
+------------------------------------------------------------------------------
+
+allocWork :: Int -> Int -> IO Bool
+allocWork n scale = do
+  let total = 500000 * scale
+  sums <- onEachCap n $ \i -> return $! go (share total n i) 0
+  return (sum sums == total * sum (mkList 0))
+  where
+    go :: Int -> Int -> Int
+    go 0 !acc = acc
+    go k !acc = go (k - 1) (acc + sum (mkList k) - 50 * k)
+
+-- Not inlined, so that the list isn't fused away.
+mkList :: Int -> [Int]
+mkList k = [k .. k + 49]
+{-# NOINLINE mkList #-}
+
+------------------------------------------------------------------------------
+
+-- Strict, so that building or updating a tree does all the work at once.
+data Tree = Leaf | Node !Tree !Int !Tree
+
+build :: Int -> Int -> Tree
+build 0 _ = Leaf
+build d x = Node (build (d - 1) (2 * x)) x (build (d - 1) (2 * x + 1))
+
+size :: Tree -> Int
+size Leaf = 0
+size (Node l _ r) = size l + 1 + size r
+
+-- Rebuild the subtree 'depth' levels down the path given by the bits of r.
+replace :: Int -> Int -> Tree -> Tree
+replace 0 r (Node l _ _) = build (depthOf l + 1) r
+replace d r (Node l x rt)
+  | odd r     = Node l x (replace (d - 1) (r `div` 2) rt)
+  | otherwise = Node (replace (d - 1) (r `div` 2) l) x rt
+replace _ _ Leaf = Leaf
+
+depthOf :: Tree -> Int
+depthOf Leaf = 0
+depthOf (Node l _ _) = 1 + depthOf l
+
+liveWork :: Int -> Int -> IO Bool
+liveWork n scale = do
+  -- about 2^20 nodes of live data for each unit of scale in all
+  let depth = max 12 (round (logBase 2 (fromIntegral (scale * 2 ^ (20 :: Int))
+                                          / fromIntegral n) :: Double))
+      updates = 2000 * scale
+  sizes <- onEachCap n $ \i -> do
+    let loop 0 _ !t = return t
+        loop k r !t = do
+          t' <- evaluate (replace 8 (r `div` 65536) t)
+          loop (k - 1 :: Int) (next r) t'
+    t <- loop (share updates n i) i (build depth i)
+    return (size t)
+  return (all (== 2 ^ depth - 1) sizes)
+
+------------------------------------------------------------------------------
+
+marrayWork :: Int -> Int -> IO Bool
+marrayWork n scale = do
+  let len = max 1024 (1000000 `div` n)
+      writes = 5000000 * scale
+  totals <- onEachCap n $ \i -> do
+    arr <- newIOArray (0, len - 1) (0 :: Int)
+    let loop 0 _ = return ()
+        loop k r = do
+          let j = r `mod` len
+          v <- readIOArray arr j
+          writeIOArray arr j $! v + 1
+          loop (k - 1 :: Int) (next r)
+    loop (share writes n i) (i + 1)
+    sum <$> mapM (readIOArray arr) [0 .. len - 1]
+  return (sum totals == writes)
+
+------------------------------------------------------------------------------
+
+stmWork :: Int -> Int -> IO Bool
+stmWork n scale = do
+  let total = 200000 * scale
+  tvs <- replicateM 4 (newTVarIO (0 :: Int))
+  _ <- onEachCap n $ \i ->
+    forM_ [1 .. share total n i] $ \k -> atomically $ do
+      let tv = tvs !! ((k + i) `mod` 4)
+      x <- readTVar tv
+      writeTVar tv $! x + 1
+  counts <- mapM readTVarIO tvs
+  return (sum counts == total)
+
+------------------------------------------------------------------------------
+
+fib :: Int -> Int
+fib k = if k < 2 then 1 else fib (k - 1) + fib (k - 2) + 1
+
+pfib :: Int -> Int
+pfib k
+  | k < 20    = fib k
+  | otherwise = a `par` (b `pseq` a + b + 1)
+  where
+    a = pfib (k - 1)
+    b = pfib (k - 2)
+
+sparkWork :: Int -> Int -> IO Bool
+sparkWork _ scale = do
+  -- the argument varies so that the calls aren't floated out of the loop
+  oks <- forM [1 .. scale] $ \j -> do
+    let k = 29 + j `mod` 2
+    r <- evaluate (pfib k)
+    return (r == fib k)
+  return (and oks)
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Run a program at a range of -N settings and report how it scales, from the
+statistics of +RTS -t --machine-readable: the wall-clock time and the
+speedup over the first setting, the GC's share of the CPU time, and the
+percentiles of the GC pauses. For instance
+
+    ./parscale.py --caps 1,2,4,8 ./parGCBench live 4
+
+The program must have been linked with -threaded -rtsopts. With --csv the
+figures are also written to a file, one row per run.
+"""
+
+import argparse
+import ast
+import csv
+import os
+import subprocess
+import sys
+import tempfile
+
+COLUMNS = [
+    ('caps', 'N', '{:d}'),
+    ('wall', 'wall s', '{:.3f}'),
+    ('speedup', 'speedup', '{:.2f}'),
+    ('gc_cpu', 'GC cpu s', '{:.3f}'),
+    ('gc_cpu_percent', 'GC cpu%', '{:.1f}'),
+    ('minor_p50', 'minor p50 ms', '{:.3f}'),
+    ('minor_p99', 'minor p99 ms', '{:.3f}'),
+    ('major_p50', 'major p50 ms', '{:.3f}'),
+    ('major_p99', 'major p99 ms', '{:.3f}'),
+]
+
+def width(title):
+    return max(len(title), 6)
+
+def default_caps():
+    n = min(os.cpu_count() or 1, 64)
+    caps = []
+    c = 1
+    while c <= n:
+        caps.append(c)
+        c *= 2
+    return caps
+
+def read_stats(path):
+    # The first line is the program's command line, the rest a Haskell list
+    # of pairs of strings, which is also a Python one.
+    with open(path) as f:
+        text = f.read()
+    return dict(ast.literal_eval(text[text.index('['):]))
+
+def run(cmd, caps):
+    with tempfile.NamedTemporaryFile(suffix='.stats', delete=False) as f:
+        path = f.name
+    try:
+        subprocess.run(cmd + ['+RTS', '-N%d' % caps, '-t' + path,
+                              '--machine-readable', '-RTS'],
+                       check=True, stdout=subprocess.DEVNULL)
+        stats = read_stats(path)
+    finally:
+        os.unlink(path)
+
+    def get(key, scale=1.0):
+        return float(stats.get(key, 'nan')) * scale
+
+    return {
+        'caps': caps,
+        'wall': get('total_wall_seconds'),
+        'gc_cpu': get('GC_cpu_seconds'),
+        'gc_cpu_percent': get('gc_cpu_percent'),
+        'minor_p50': get('minor_pause_p50_seconds', 1000),
+        'minor_p99': get('minor_pause_p99_seconds', 1000),
+        'major_p50': get('major_pause_p50_seconds', 1000),
+        'major_p99': get('major_pause_p99_seconds', 1000),
+    }
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--caps', help='comma-separated -N settings '
+                        '(default: powers of two up to the number of CPUs)')
+    parser.add_argument('--csv', help='also write the results to this file')
+    parser.add_argument('command', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+    if not args.command:
+        parser.error('no program to run')
+
+    caps = [int(c) for c in args.caps.split(',')] if args.caps else default_caps()
+
+    print('  '.join(title.rjust(width(title)) for _, title, _ in COLUMNS))
+    rows = []
+    for c in caps:
+        row = run(args.command, c)
+        row['speedup'] = rows[0]['wall'] / row['wall'] if rows else 1.0
+        rows.append(row)
+        print('  '.join(fmt.format(row[key]).rjust(width(title))
+                        for key, title, fmt in COLUMNS))
+        sys.stdout.flush()
+
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            w = csv.writer(f)
+            w.writerow(['command'] + [key for key, _, _ in COLUMNS])
+            for row in rows:
+                w.writerow([' '.join(args.command)] +
+                           [row[key] for key, _, _ in COLUMNS])
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,119 @@
+/*
+ * Benchmarks of the block allocator, allocate(), allocatePinned() and the
+ * StablePtr table, driven from C. The first argument scales the work
+ * done; the results are printed in the format of +RTS -t
+ * --machine-readable. See all.T.
+ */
+
+#include "Rts.h"
+#include "RtsAPI.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int n_results = 0;
+
+static void result(const char *name, double value)
+{
+    printf(" %c(\"%s\", \"%.2f\")\n", n_results++ == 0 ? '[' : ',', name, value);
+}
+
+static uint32_t nextRandom(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+// Groups of 1 to 16 blocks, freed in a different order from the one they
+// were allocated in so that freeGroup has to coalesce.
+static void benchBlockAlloc(int scale)
+{
+    enum { N = 256 };
+    bdescr *bd[N];
+    uint32_t seed = 0xf00f00;
+    W_ rounds = 400 * scale;
+
+    StgWord64 t0 = getMonotonicNSec();
+    for (W_ r = 0; r < rounds; r++) {
+        for (int i = 0; i < N; i++) {
+            bd[i] = allocGroup_lock(1 + nextRandom(&seed) % 16);
+        }
+        for (int i = 0; i < N; i++) {
+            freeGroup_lock(bd[(i * 97) % N]);
+        }
+    }
+    StgWord64 t1 = getMonotonicNSec();
+
+    result("alloc_free_group_ns", (double)(t1 - t0) / (rounds * N));
+}
+
+// Small ARR_WORDS objects, a round at a time with a major GC between the
+// rounds, which isn't timed.
+static void benchAllocate(int scale, bool pinned)
+{
+    const W_ payload = 2;
+    const W_ words = sizeofW(StgArrBytes) + payload;
+    const W_ per_round = 1 << 20;
+    StgWord64 elapsed = 0;
+
+    for (int r = 0; r < scale; r++) {
+        Capability *cap = rts_lock();
+        StgWord64 t0 = getMonotonicNSec();
+        for (W_ i = 0; i < per_round; i++) {
+            StgArrBytes *arr = (StgArrBytes *)
+                (pinned ? allocatePinned(cap, words, sizeof(W_), 0)
+                        : allocate(cap, words));
+            SET_HDR(arr, &stg_ARR_WORDS_info, CCS_SYSTEM);
+            arr->bytes = payload * sizeof(W_);
+        }
+        elapsed += getMonotonicNSec() - t0;
+        rts_unlock(cap);
+        performMajorGC();
+    }
+
+    result(pinned ? "allocate_pinned_ns" : "allocate_ns",
+           (double)elapsed / (per_round * scale));
+}
+
+static void benchStablePtrs(int scale)
+{
+    enum { N = 4096 };
+    static HsStablePtr sp[N];
+    W_ rounds = 100 * scale;
+
+    Capability *cap = rts_lock();
+    HaskellObj x = rts_mkInt(cap, 42);
+    StgWord64 t0 = getMonotonicNSec();
+    for (W_ r = 0; r < rounds; r++) {
+        for (int i = 0; i < N; i++) {
+            sp[i] = getStablePtr((StgPtr)x);
+        }
+        for (int i = 0; i < N; i++) {
+            hs_free_stable_ptr(sp[N - 1 - i]);
+        }
+    }
+    StgWord64 t1 = getMonotonicNSec();
+    rts_unlock(cap);
+
+    result("stable_ptr_new_free_ns", (double)(t1 - t0) / (rounds * N));
+}
+
+int main (int argc, char *argv[])
+{
+    {
+        RtsConfig conf = defaultRtsConfig;
+        conf.rts_opts_enabled = RtsOptsAll;
+        hs_init_ghc(&argc, &argv, conf);
+    }
+
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+
+    benchBlockAlloc(scale);
+    benchAllocate(scale, false);
+    benchAllocate(scale, true);
+    benchStablePtrs(scale);
+    printf(" ]\n");
+
+    hs_exit();
+    exit(0);
+}
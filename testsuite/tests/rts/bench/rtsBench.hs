@@ -0,0 +1,152 @@
+-- Benchmarks of the garbage collectors, MVars, STM, forkIO and the
+-- eventlog, driven from Haskell. The first argument scales the work done;
+-- the results are printed in the format of +RTS -t --machine-readable.
+-- Needs +RTS -T. See all.T.
+
+import Control.Concurrent
+import Control.Exception
+import Control.Monad
+import Data.IORef
+import Debug.Trace (traceEventIO)
+import GHC.Clock (getMonotonicTimeNSec)
+import GHC.Conc
+import GHC.Stats
+import System.Environment
+import System.Mem
+
+main :: IO ()
+main = do
+  args <- getArgs
+  let scale = case args of
+        (a:_) -> read a
+        _     -> 1
+  results <- newIORef []
+  let result name x = modifyIORef results ((name, x) :)
+
+  benchGC scale result
+  benchMVar scale result
+  benchSTM scale result
+  benchFork scale result
+  benchEventlog scale result
+
+  rs <- reverse <$> readIORef results
+  forM_ (zip [0 :: Int ..] rs) $ \(i, (name, x)) ->
+    putStrLn $ (if i == 0 then " [" else " ,")
+      ++ show (name, showRate x)
+  putStrLn " ]"
+
+type Result = String -> Double -> IO ()
+
+showRate :: Double -> String
+showRate x = show (fromIntegral (round (x * 100) :: Integer) / 100 :: Double)
+
+elapsedNs :: IO () -> IO Double
+elapsedNs act = do
+  t0 <- getMonotonicTimeNSec
+  act
+  t1 <- getMonotonicTimeNSec
+  return (fromIntegral (t1 - t0))
+
+-- A fully evaluated list, to give the GC something to copy.
+liveData :: Int -> IO [Int]
+liveData n = evaluate (force [1 .. n])
+  where force xs = sum xs `seq` xs
+
+-- MB copied per second of GC time, for minor GCs of a young list and
+-- major GCs of an old one, or with --nonmoving-gc the rate at which the
+-- nonmoving collector marks and sweeps the old one.
+benchGC :: Int -> Result -> IO ()
+benchGC scale result = do
+  enabled <- getRTSStatsEnabled
+  unless enabled $ fail "needs +RTS -T"
+
+  let copyRate gcs = fromIntegral (sum (map fst gcs))
+                   / (fromIntegral (sum (map snd gcs)) / 1e9) / 1e6
+      lastGC = do
+        s <- getRTSStats
+        return (gcdetails_copied_bytes (gc s), gcdetails_elapsed_ns (gc s))
+
+  minors <- replicateM (20 * scale) $ do
+    xs <- liveData 50000
+    performMinorGC
+    r <- lastGC
+    _ <- evaluate (length xs)
+    return r
+  result "minor_gc_copy_mb_per_s" (copyRate minors)
+
+  old <- liveData (1000000 * scale)
+  s0 <- getRTSStats
+  performMajorGC
+  s1 <- getRTSStats
+  if nonmoving_gc_sync_elapsed_ns s1 + nonmoving_gc_elapsed_ns s1 > 0
+    then benchNonmoving (nonmoving_gc_elapsed_ns s0) old result
+    else do
+      majors <- replicateM 10 $ performMajorGC >> lastGC
+      _ <- evaluate (length old)
+      result "major_gc_copy_mb_per_s" (copyRate majors)
+
+-- MB of live data marked and swept per second by the nonmoving collector.
+-- Each cycle's concurrent mark is waited for before starting the next.
+benchNonmoving :: RtsTime -> [Int] -> Result -> IO ()
+benchNonmoving before old result = do
+  _ <- waitForMark before (1000 :: Int)
+  cycles <- replicateM 10 $ do
+    s0 <- getRTSStats
+    performMajorGC
+    s1 <- waitForMark (nonmoving_gc_elapsed_ns s0) 1000
+    return ( gcdetails_live_bytes (gc s1)
+           , nonmoving_gc_elapsed_ns s1 - nonmoving_gc_elapsed_ns s0 )
+  _ <- evaluate (length old)
+  result "nonmoving_mark_sweep_mb_per_s"
+    (fromIntegral (sum (map fst cycles))
+       / (fromIntegral (sum (map snd cycles)) / 1e9) / 1e6)
+  where
+    waitForMark t tries = do
+      s <- getRTSStats
+      if nonmoving_gc_elapsed_ns s /= t || tries == 0
+        then return s
+        else threadDelay 1000 >> waitForMark t (tries - 1)
+
+-- Round trips between two threads through a pair of MVars.
+benchMVar :: Int -> Result -> IO ()
+benchMVar scale result = do
+  let n = 100000 * scale
+  ping <- newEmptyMVar
+  pong <- newEmptyMVar
+  _ <- forkIO $ replicateM_ n $ takeMVar ping >>= putMVar pong
+  t <- elapsedNs $ forM_ [1 .. n] $ \i -> putMVar ping i >> takeMVar pong
+  result "mvar_round_trip_ns" (t / fromIntegral n)
+
+-- Round trips between two threads taking turns to increment a TVar.
+benchSTM :: Int -> Result -> IO ()
+benchSTM scale result = do
+  let n = 100000 * scale
+  tv <- newTVarIO (0 :: Int)
+  let turn parity = forM_ [1 .. n] $ \_ -> atomically $ do
+        x <- readTVar tv
+        when (x `mod` 2 /= parity) retry
+        writeTVar tv (x + 1)
+  done <- newEmptyMVar
+  _ <- forkIO $ turn 1 >> putMVar done ()
+  t <- elapsedNs $ turn 0 >> takeMVar done
+  result "stm_round_trip_ns" (t / fromIntegral n)
+
+-- Threads forked, run and finished.
+benchFork :: Int -> Result -> IO ()
+benchFork scale result = do
+  let n = 100000 * scale
+  left <- newIORef n
+  done <- newEmptyMVar
+  let child = do
+        l <- atomicModifyIORef' left (\l -> (l - 1, l - 1))
+        when (l == 0) $ putMVar done ()
+  t <- elapsedNs $ replicateM_ n (forkIO child) >> takeMVar done
+  result "forkio_ns" (t / fromIntegral n)
+
+-- User events posted; only meaningful with +RTS -lu, otherwise this just
+-- measures the check that the eventlog is off.
+benchEventlog :: Int -> Result -> IO ()
+benchEventlog scale result = do
+  let n = 100000 * scale
+  t <- elapsedNs $ forM_ [1 .. n] $ \_ -> traceEventIO "rtsBench"
+  result "trace_event_ns" (t / fromIntegral n)
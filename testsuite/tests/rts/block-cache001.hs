@@ -0,0 +1,30 @@
+-- Exercise the per-capability block cache (--block-cache-size) with many
+-- small large-object allocations from several threads, so that groups are
+-- handed out and returned by the mutator and by the parallel GC.
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Data.Array.ST
+import Data.Array.Unboxed
+
+mkArray :: Int -> UArray Int Int
+mkArray n = runSTUArray $ do
+  arr <- newArray (0, n) 0
+  forM_ [0..n] $ \i -> writeArray arr i i
+  return arr
+
+worker :: Int -> MVar Int -> IO ()
+worker k result = do
+  let sizes = [ 500 + (i * k) `mod` 7000 | i <- [1..2000] ]
+      total = sum [ arr ! (n `div` 2) | n <- sizes, let arr = mkArray n ]
+  total `seq` putMVar result total
+
+main :: IO ()
+main = do
+  results <- forM [1..8] $ \k -> do
+    v <- newEmptyMVar
+    _ <- forkIO (worker k v)
+    return v
+  totals <- mapM takeMVar results
+  print (sum totals)
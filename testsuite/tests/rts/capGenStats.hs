@@ -0,0 +1,39 @@
+-- Checks that getRTSCapStats and getRTSGenStats account for allocation and
+-- collections as getRTSStats does.
+module Main (main) where
+
+import Control.Monad
+import Data.IORef
+import GHC.Internal.Stats
+import GHC.Stats
+import System.Mem
+
+main :: IO ()
+main = do
+  ref <- newIORef []
+  forM_ [1 .. 100000 :: Int] $ \i -> modifyIORef' ref (i :)
+  performMajorGC
+  readIORef ref >>= print . sum
+
+  caps <- getRTSCapStats
+  gens <- getRTSGenStats
+  stats <- getRTSStats
+  print (length caps, length gens)
+
+  let allocated = sum (map capstats_allocated_bytes caps)
+  unless (allocated > 0 && allocated <= allocated_bytes stats) $
+    putStrLn ("allocated: " ++ show allocated)
+  unless (sum (map capstats_gcs caps) >= gcs stats) $
+    putStrLn "capability gcs"
+  unless (all ((> 0) . capstats_mutator_cpu_ns) caps) $
+    putStrLn "mutator cpu"
+
+  let oldest = last gens
+  unless (genstats_collections oldest == major_gcs stats) $
+    putStrLn "major collections"
+  unless (sum (map genstats_collections gens) == gcs stats) $
+    putStrLn "collections"
+  unless (sum (map genstats_copied_bytes gens) > 0) $
+    putStrLn "copied"
+  unless (genstats_live_bytes oldest > 0) $
+    putStrLn "live"
@@ -0,0 +1,41 @@
+-- Restores a continuation that spans several stack chunks (the test is run
+-- with 2k chunks) and has a mask frame at the bottom, so that the mask frame
+-- ends up on a different chunk from the top of the continuation; see
+-- Note [Restoring large continuations] in rts/Continuation.c.
+
+import Control.Exception
+import ContIO
+
+data Answer
+  = Done Int
+  | Yield (IO Int -> IO Answer)
+
+getAnswer :: Answer -> Int
+getAnswer (Done n)  = n
+getAnswer (Yield _) = error "getAnswer"
+
+main :: IO ()
+main = do
+  tag <- newPromptTag
+  Yield k <- prompt tag $ mask_ $
+    Done <$> buildBigCont tag 6000
+
+  n <- getAnswer <$> k (getMaskingState >>= print >> pure 0)
+  getMaskingState >>= print
+  print n
+
+  (m, st) <- uninterruptibleMask_ $ do
+    m <- getAnswer <$> k (pure 1)
+    st <- getMaskingState
+    pure (m, st)
+  print st
+  print m
+
+buildBigCont :: PromptTag Answer
+             -> Int
+             -> IO Int
+buildBigCont tag size
+  | size <= 0 = control0 tag (\k -> pure (Yield k))
+  | otherwise = do
+      n <- buildBigCont tag (size - 1)
+      pure $! n + size
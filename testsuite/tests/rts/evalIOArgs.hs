@@ -0,0 +1,27 @@
+module Main where
+
+import Foreign.StablePtr
+
+-- Call Haskell functions from C with rts_evalIOArgs, a lot of times.
+
+foreign import ccall safe "callFromC"
+  callFromC :: StablePtr (IO Int)
+            -> StablePtr (Int -> Int -> IO Int)
+            -> StablePtr (Int -> Int -> Int -> Int -> Int -> Int -> Int -> IO Int)
+            -> IO ()
+
+f0 :: IO Int
+f0 = return 42
+
+f2 :: Int -> Int -> IO Int
+f2 x y = return $! x * 10 + y
+
+f7 :: Int -> Int -> Int -> Int -> Int -> Int -> Int -> IO Int
+f7 a b c d e f g = return $! sum (zipWith (*) [a, b, c, d, e, f, g] [1 ..])
+
+main :: IO ()
+main = do
+  s0 <- newStablePtr f0
+  s2 <- newStablePtr f2
+  s7 <- newStablePtr f7
+  callFromC s0 s2 s7
@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include "Rts.h"
+
+void callFromC(HsStablePtr s0, HsStablePtr s2, HsStablePtr s7)
+{
+    Capability *cap = rts_lock();
+    HaskellObj args[7], ret;
+    HsInt sum = 0;
+
+    rts_evalIOArgs(&cap, (HaskellObj)deRefStablePtr(s0), 0, args, &ret);
+    rts_checkSchedStatus("callFromC", cap);
+    printf("f0 = %" FMT_Int "\n", rts_getInt(ret));
+
+    for (HsInt i = 0; i < 100000; i++) {
+        args[0] = rts_mkInt(cap, i % 10);
+        args[1] = rts_mkInt(cap, i % 7);
+        rts_evalIOArgs(&cap, (HaskellObj)deRefStablePtr(s2), 2, args, &ret);
+        rts_checkSchedStatus("callFromC", cap);
+        sum += rts_getInt(ret);
+    }
+    printf("sum of f2 = %" FMT_Int "\n", sum);
+
+    for (int i = 0; i < 7; i++) {
+        args[i] = rts_mkInt(cap, i + 1);
+    }
+    rts_evalIOArgs(&cap, (HaskellObj)deRefStablePtr(s7), 7, args, &ret);
+    rts_checkSchedStatus("callFromC", cap);
+    printf("f7 = %" FMT_Int "\n", rts_getInt(ret));
+
+    rts_unlock(cap);
+}
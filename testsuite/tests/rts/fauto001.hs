@@ -0,0 +1,21 @@
+-- Exercise the -Fauto heap sizing policy with a live set that keeps
+-- growing while most of what is allocated dies young.
+module Main (main) where
+
+import Control.Monad
+import Data.IORef
+import Data.List (foldl')
+
+main :: IO ()
+main = do
+  kept <- newIORef []
+  forM_ [1 .. 300 :: Int] $ \r -> do
+    let chunk = [r * 1000 .. r * 1000 + 999]
+        s = foldl' (+) 0 chunk
+    -- keep two chunks out of three alive until the end
+    when (r `mod` 3 /= 0) $ s `seq` modifyIORef' kept (chunk :)
+    -- plus some short-lived garbage
+    let garbage = foldl' (+) 0 (map (* r) [1 .. 20000 :: Int])
+    garbage `seq` return ()
+  chunks <- readIORef kept
+  print (length chunks, sum (map sum chunks))
@@ -0,0 +1,73 @@
+#include "Rts.h"
+
+#include <stdio.h>
+
+// Checks the pause histograms of RTSStats (see Note [Pause histograms] in
+// rts/Stats.c): every GC is counted once, as minor or major, and percentiles
+// come out within a bucket of the durations recorded.
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        barf("FAIL: %s", what);
+    }
+}
+
+static uint64_t histTotal(const RTSHistogram *hist)
+{
+    uint64_t n = 0;
+    for (uint32_t b = 0; b < RTS_HIST_BUCKETS; b++) {
+        n += hist->buckets[b];
+    }
+    return n;
+}
+
+int main (int argc, char *argv[])
+{
+    hs_init(&argc, &argv);
+
+    for (int i = 0; i < 10; i++) {
+        performGC();
+    }
+    for (int i = 0; i < 3; i++) {
+        performMajorGC();
+    }
+
+    static RTSStats s;
+    getRTSStats(&s);
+    check(s.minor_pause_hist.count + s.major_pause_hist.count == s.gcs,
+          "every GC counted");
+    check(s.major_pause_hist.count == s.major_gcs, "major GCs counted");
+    check(s.sync_hist.count == s.gcs, "every sync counted");
+    check(histTotal(&s.minor_pause_hist) == s.minor_pause_hist.count,
+          "minor buckets");
+    check(histTotal(&s.major_pause_hist) == s.major_pause_hist.count,
+          "major buckets");
+    check(getRTSHistogramPercentile(&s.major_pause_hist, 1.0)
+            >= s.gc.elapsed_ns, "max pause");
+
+    // 1000 durations of 1us .. 1ms; the percentiles may be rounded up to
+    // the end of their bucket, by at most 1/16
+    static RTSHistogram h;
+    check(getRTSHistogramPercentile(&h, 0.5) == 0, "empty");
+    for (uint32_t b = 0; b < RTS_HIST_BUCKETS; b++) {
+        h.buckets[b] = 0;
+    }
+    for (int i = 1; i <= 1000; i++) {
+        // as histRecord would, via the public percentile function below
+        Time t = (Time)i * 1000;
+        uint32_t e = 63 - __builtin_clzll((uint64_t)t);
+        uint32_t sub = (uint32_t)(t >> (e - RTS_HIST_SUB_BITS));
+        h.buckets[((e - RTS_HIST_SUB_BITS + 1) << RTS_HIST_SUB_BITS)
+                  + sub - (1 << RTS_HIST_SUB_BITS)]++;
+        h.count++;
+    }
+    Time p50 = getRTSHistogramPercentile(&h, 0.5);
+    Time p99 = getRTSHistogramPercentile(&h, 0.99);
+    check(p50 >= 500000 && p50 <= 500000 + 500000 / 16, "p50");
+    check(p99 >= 990000 && p99 <= 990000 + 990000 / 16, "p99");
+
+    printf("OK\n");
+    hs_exit();
+    return 0;
+}
@@ -0,0 +1,36 @@
+{-# LANGUAGE MagicHash #-}
+module Main where
+
+import Data.Array.Byte
+import Data.IORef
+import Foreign.StablePtr
+import GHC.Exts
+import System.Mem
+
+-- Memory lent to Haskell by C with rts_loanByteArray is handed back once a
+-- major GC finds it unreachable, and not before.
+
+foreign import ccall safe "lendToHaskell"
+  lendToHaskell :: StablePtr (ByteArray# -> IO Int) -> IO ()
+
+foreign import ccall unsafe "released"
+  released :: IO Int
+
+use :: IORef (Maybe ByteArray) -> ByteArray# -> IO Int
+use ref ba = do
+  writeIORef ref (Just (ByteArray ba))
+  return $! sum (map fromIntegral (toList (ByteArray ba)))
+
+main :: IO ()
+main = do
+  ref <- newIORef Nothing
+  f <- newStablePtr (use ref)
+  lendToHaskell f
+  performMajorGC
+  released >>= print
+  Just ba@(ByteArray ba#) <- readIORef ref
+  print (isTrue# (isByteArrayPinned# ba#))
+  print (sum (map fromIntegral (toList ba)) :: Int)
+  writeIORef ref Nothing
+  performMajorGC
+  released >>= print
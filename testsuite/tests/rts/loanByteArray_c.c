@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "Rts.h"
+
+static HsInt n_released = 0;
+
+static void release(void *bytes STG_UNUSED, void *block)
+{
+    n_released++;
+    free(block);
+}
+
+void lendToHaskell(HsStablePtr f)
+{
+    HsWord header = rts_loanHeaderSize();
+    char *block = malloc(header + 100);
+    unsigned char *bytes = (unsigned char *)block + header;
+    HaskellObj arr, ret;
+
+    for (int i = 0; i < 100; i++) {
+        bytes[i] = i + 1;
+    }
+
+    Capability *cap = rts_lock();
+    arr = rts_loanByteArray(cap, bytes, 100, release, block);
+    rts_evalIOArgs(&cap, (HaskellObj)deRefStablePtr(f), 1, &arr, &ret);
+    rts_checkSchedStatus("lendToHaskell", cap);
+    printf("sum = %" FMT_Int "\n", rts_getInt(ret));
+    fflush(stdout);
+    rts_unlock(cap);
+}
+
+HsInt released(void)
+{
+    return n_released;
+}
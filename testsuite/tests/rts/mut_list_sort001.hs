@@ -0,0 +1,27 @@
+-- A remembered set micro-benchmark: a large array of IORefs in the old
+-- generation, written in a scattered order between minor GCs, so that each
+-- minor GC scans a big mutable list in no particular order. Compare the
+-- "MUTABLE LISTS" line of +RTS -s with and without --sort-mut-lists; the
+-- test itself checks the result, with -DS checking the heap after each GC.
+module Main (main) where
+
+import Control.Monad
+import Data.Array
+import Data.IORef
+import System.Mem
+
+n, rounds :: Int
+n = 100000
+rounds = 20
+
+main :: IO ()
+main = do
+  refs <- listArray (0, n - 1) <$> mapM newIORef [0 .. n - 1]
+            :: IO (Array Int (IORef Int))
+  performMajorGC
+  forM_ [1 .. rounds] $ \r -> do
+    forM_ [0 .. n - 1] $ \i ->
+      modifyIORef' (refs ! ((i * 7919 + r) `mod` n)) (+ 1)
+    performMinorGC
+  total <- foldM (\acc ref -> (acc +) <$> readIORef ref) 0 (elems refs)
+  print total
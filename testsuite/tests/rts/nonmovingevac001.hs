@@ -0,0 +1,24 @@
+-- Leave most segments of the non-moving heap sparse, then let every
+-- collection evacuate them; -DS checks the heap after each GC.
+module Main (main) where
+
+import Control.Monad
+import Data.IORef
+import Data.List (foldl')
+import System.Mem
+import System.Mem.StableName
+
+main :: IO ()
+main = do
+  let xs = [(i, show i) | i <- [1 .. 200000 :: Int]]
+  ref <- newIORef xs
+  print (foldl' (\a (i, s) -> a + i + length s) 0 xs)
+  performMajorGC
+  -- keep every sixteenth pair
+  modifyIORef' ref (\ys -> [y | (n, y) <- zip [0 :: Int ..] ys, n `mod` 16 == 0])
+  kept <- readIORef ref
+  sn <- makeStableName kept
+  forM_ [1 .. 3 :: Int] $ \_ -> performMajorGC
+  sn' <- makeStableName kept
+  print (sn == sn')
+  print (foldl' (\a (i, s) -> a + i + length s) 0 kept)
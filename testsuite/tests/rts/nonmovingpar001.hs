@@ -0,0 +1,35 @@
+-- Mark and sweep the non-moving heap with several threads while mutators on
+-- other capabilities keep changing it; -DS checks the heap after each GC.
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import Data.List (foldl')
+import System.Mem
+import System.Mem.StableName
+
+worker :: Int -> IO Int
+worker n = do
+  ref <- newIORef []
+  forM_ [1 .. 200 :: Int] $ \r -> do
+    let xs = [n * r .. n * r + 499]
+    -- keep the latest ten chunks, dropping older ones
+    modifyIORef' ref (take 10 . (xs :))
+    when (r `mod` 50 == 0) performMajorGC
+  chunks <- readIORef ref
+  sns <- mapM makeStableName chunks
+  performMajorGC
+  sns' <- mapM makeStableName chunks
+  return $! if sns == sns'
+              then foldl' (+) 0 (map sum chunks)
+              else -1
+
+main :: IO ()
+main = do
+  vars <- forM [1 .. 4] $ \n -> do
+    v <- newEmptyMVar
+    _ <- forkIO (worker n >>= putMVar v)
+    return v
+  rs <- mapM takeMVar vars
+  print rs
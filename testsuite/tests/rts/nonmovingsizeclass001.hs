@@ -0,0 +1,25 @@
+-- Promote many objects of 19 words, which fall between the non-moving
+-- allocators of 16 and 32 words, so that --nonmoving-profile-size-classes
+-- adds an allocator for them; -DS checks the heap after each GC.
+module Main (main) where
+
+import Control.Monad
+import Data.List (foldl')
+import System.Mem
+
+data R = R !Int !Int !Int !Int !Int !Int !Int !Int !Int
+           !Int !Int !Int !Int !Int !Int !Int !Int !Int
+
+mkR :: Int -> R
+mkR i = R i i i i i i i i i i i i i i i i i i
+
+sumR :: R -> Int
+sumR (R a b c d e f g h i j k l m n o p q r) =
+  a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p + q + r
+
+main :: IO ()
+main = do
+  let rs = map mkR [1 .. 20000]
+  print (foldl' (+) 0 (map sumR rs))
+  forM_ [1 .. 3 :: Int] $ \_ -> performMajorGC
+  print (foldl' (+) 0 (map sumR rs))
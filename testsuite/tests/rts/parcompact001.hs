@@ -0,0 +1,23 @@
+-- Exercise the parallel compacting collector (-c -qc): keep a few megabytes
+-- of mixed live data in the old generation, churn part of it between major
+-- collections, and check that everything survives being slid.
+module Main (main) where
+
+import Control.Monad
+import Data.IORef
+import qualified Data.Map.Strict as M
+import System.Mem
+
+build :: Int -> Int -> M.Map Int [Int]
+build seed n = M.fromList [ (k, [k, seed]) | k <- [base + 1 .. base + n] ]
+  where base = seed * 1000000
+
+main :: IO ()
+main = do
+  ref <- newIORef (build 0 100000)
+  forM_ [1..20] $ \i -> do
+    modifyIORef' ref $ \m ->
+      M.union (build i 10000) (M.filterWithKey (\k _ -> k `mod` 20 /= i) m)
+    performMajorGC
+  m <- readIORef ref
+  print (M.size m, sum (map sum (M.elems m)))
@@ -0,0 +1,22 @@
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+
+-- With --per-capability-timers the capability's own timer preempts the
+-- spinning threads, so the main thread, on the same capability, must get to
+-- run. See Note [Per-capability preemption timers].
+main :: IO ()
+main = do
+  stop <- newIORef False
+  dones <- forM [1 .. 4 :: Int] $ \_ -> do
+    done <- newEmptyMVar
+    _ <- forkIO $
+      let spin n = do
+            s <- readIORef stop
+            if s then putMVar done n else spin (n + 1 :: Int)
+      in spin 0
+    return done
+  threadDelay 100000
+  writeIORef stop True
+  mapM_ takeMVar dones
+  putStrLn "done"
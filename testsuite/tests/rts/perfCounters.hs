@@ -0,0 +1,14 @@
+-- Checks that a program runs and reports normally with +RTS --perf-counters,
+-- whether or not the machine lets us use the hardware counters.
+module Main (main) where
+
+import Control.Monad
+import Data.IORef
+import System.Mem
+
+main :: IO ()
+main = do
+  ref <- newIORef []
+  forM_ [1 .. 100000 :: Int] $ \i -> modifyIORef' ref (i :)
+  performMajorGC
+  readIORef ref >>= print . sum
@@ -0,0 +1,27 @@
+{-# LANGUAGE MagicHash, UnboxedTuples #-}
+-- Threads that raise their priority and yield run before the threads of the
+-- default priority forked alongside them.
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+import GHC.Exts
+import GHC.IO (IO(..))
+
+setPriority :: Int -> IO ()
+setPriority (I# p) = IO $ \s -> case setThreadPriority# p s of s' -> (# s', () #)
+
+main :: IO ()
+main = do
+  order <- newIORef []
+  dones <- forM [0 .. 9 :: Int] $ \i -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+      when (even i) $ setPriority 2
+      yield
+      atomicModifyIORef' order (\is -> (i : is, ()))
+      putMVar done ()
+    return done
+  mapM_ takeMVar dones
+  readIORef order >>= print . reverse
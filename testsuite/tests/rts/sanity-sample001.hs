@@ -0,0 +1,31 @@
+-- Sanity checking shared out among the GC threads and sampled
+-- (--sanity-sample): keep a mix of small closures, large arrays and a
+-- compact region in the old generation, and check it after each major GC.
+module Main (main) where
+
+import Control.Monad
+import Data.Array
+import Data.IORef
+import qualified Data.Map.Strict as M
+import GHC.Compact
+import System.Mem
+
+build :: Int -> Int -> M.Map Int [Int]
+build seed n = M.fromList [ (k, [k, seed]) | k <- [base + 1 .. base + n] ]
+  where base = seed * 1000000
+
+main :: IO ()
+main = do
+  ref <- newIORef (build 0 100000)
+  arrs <- newIORef [listArray (0, 9999) [i .. i + 9999] | i <- [1 .. 8 :: Int]]
+  c <- compact (build 100 10000)
+  forM_ [1..20] $ \i -> do
+    modifyIORef' ref $ \m ->
+      M.union (build i 10000) (M.filterWithKey (\k _ -> k `mod` 20 /= i) m)
+    modifyIORef' arrs $ \as ->
+      listArray (0, 9999) [i .. i + 9999] : take 7 as
+    performMajorGC
+  m <- readIORef ref
+  as <- readIORef arrs
+  print (M.size m, sum (map sum (M.elems m)))
+  print (sum (map (! 0) as), M.size (getCompact c))
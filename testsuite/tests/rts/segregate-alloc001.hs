@@ -0,0 +1,20 @@
+-- Allocate mid-size arrays among small objects with --segregate-alloc,
+-- keeping some of each alive across GCs; -DS checks the nursery and the
+-- heap after each GC.
+module Main (main) where
+
+import Control.Monad
+import Data.Array.ST
+import Data.Array.Unboxed
+import System.Mem
+
+mkArray :: Int -> UArray Int Int
+mkArray n = runSTUArray (newArray (0, n) 1)
+
+main :: IO ()
+main = do
+  let kept = [ (i, mkArray (100 + i `mod` 300))
+             | i <- [1 .. 5000 :: Int], i `mod` 10 == 0 ]
+  forM_ [1 .. 3 :: Int] $ \_ -> do
+    print (sum [ i + sum (elems arr) | (i, arr) <- kept ])
+    performMajorGC
@@ -0,0 +1,64 @@
+module Main where
+
+import Control.Concurrent
+import Control.Monad
+import Data.List (isPrefixOf)
+import GHC.Conc
+import GHC.Internal.Stack.CloneStack
+import System.IO.Unsafe
+
+getDeepStack :: Int -> (StackFrames, StackFrames, Int)
+getDeepStack 0 =
+  unsafePerformIO $ do
+    full <- snapshotMyStack maxBound
+    top <- snapshotMyStack 10
+    return (full, top, 0)
+getDeepStack n = case getDeepStack (n - 1) of
+  (full, top, d) -> (full, top, d + 1)
+
+-- Recurses n times, leaving a return frame each time, then blocks.
+deep :: Int -> MVar Int -> IO Int
+deep 0 mv = takeMVar mv
+deep n mv = do
+  r <- deep (n - 1) mv
+  return $! r + 1
+
+assertEqual :: (Eq a, Show a) => a -> a -> IO ()
+assertEqual x y =
+  if x == y
+    then return ()
+    else error $ "assertEqual: " ++ show x ++ " /= " ++ show y
+
+main :: IO ()
+main = do
+  let (full, top, _) = getDeepStack 1000
+  entries <- decodeFrames full
+  -- one frame for each level of the recursion, across many stack chunks
+  assertEqual
+    (length (filter ((== "getDeepStack") . functionName) entries) >= 1000)
+    True
+  -- the limited snapshot is the top of the full one
+  assertEqual (length (stackFrames top)) 10
+  assertEqual (stackFrames top) (take 10 (stackFrames full))
+  assertEqual (length (stackFrames full) > 1000) True
+
+  mv <- newEmptyMVar
+  done <- newEmptyMVar
+  tid <- forkIO $ deep 100 mv >>= putMVar done
+  waitUntilBlocked tid
+  frames <- snapshotThreadStack tid maxBound
+  theirs <- decodeFrames frames
+  assertEqual
+    (length (filter (("deep" `isPrefixOf`) . functionName) theirs) >= 100)
+    True
+  limited <- snapshotThreadStack tid 5
+  assertEqual (stackFrames limited) (take 5 (stackFrames frames))
+  putMVar mv 0
+  takeMVar done >>= print
+
+waitUntilBlocked :: ThreadId -> IO ()
+waitUntilBlocked tid = do
+  status <- threadStatus tid
+  case status of
+    ThreadBlocked _ -> return ()
+    _ -> threadDelay 10000 >> waitUntilBlocked tid
@@ -0,0 +1,5 @@
+-- Checks that +RTS --startup-times doesn't get in the way of the program.
+module Main (main) where
+
+main :: IO ()
+main = putStrLn "started"
@@ -0,0 +1,15 @@
+-- Checks that +RTS --stats-stream writes a JSON line after each major GC.
+module Main (main) where
+
+import Control.Monad
+import Data.List (isInfixOf, isPrefixOf, isSuffixOf)
+import System.Mem
+
+main :: IO ()
+main = do
+  replicateM_ 3 performMajorGC
+  records <- lines <$> readFile "statsStream.jsonl"
+  let major = filter ("\"reason\":\"major-gc\"" `isInfixOf`) records
+  print (length major >= 3)
+  print (all (\r -> "{" `isPrefixOf` r && "}" `isSuffixOf` r) records)
+  print (all ("\"allocated_bytes\":" `isInfixOf`) major)
@@ -0,0 +1,30 @@
+-- A burst of threads forked on one capability, with -qs so that the idle
+-- capabilities ask for some of them. Threads started with forkOn must stay
+-- where they were put.
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+
+work :: Int -> Int
+work k = foldl (\acc i -> (acc * 31 + i) `mod` 1000003) k [1 .. 200000]
+
+main :: IO ()
+main = do
+  results <- forM [1 .. 64] $ \k -> do
+    v <- newEmptyMVar
+    _ <- forkIO $ putMVar v $! work k
+    return v
+  locked <- forM [0 .. 3] $ \c -> do
+    v <- newEmptyMVar
+    _ <- forkOn c $ do
+      _ <- evaluate' (work c)
+      (c', _) <- myThreadId >>= threadCapability
+      putMVar v (c' == c)
+    return v
+  rs <- mapM takeMVar results
+  ls <- mapM takeMVar locked
+  print (length rs, sum rs > 0)
+  print (and ls)
+  where
+    evaluate' x = x `seq` return x
@@ -0,0 +1,226 @@
+#include "Rts.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Checks the linear, open-addressed and concurrent implementations of the RTS
+// hash tables (rts/Hash.c), then times inserting, looking up and removing
+// word keys in the first two.  The timings go to stdout, which the
+// testsuite ignores; run the program by hand to compare the two.
+
+typedef struct hashtable HashTable;
+typedef int HashFunction(const HashTable *table, StgWord key);
+typedef int CompareFunction(StgWord key1, StgWord key2);
+
+extern HashTable *allocHashTable(void);
+extern HashTable *allocOpenHashTable(void);
+extern void insertHashTable(HashTable *table, StgWord key, const void *data);
+extern void *lookupHashTable(const HashTable *table, StgWord key);
+extern void *removeHashTable(HashTable *table, StgWord key, const void *data);
+extern int keyCountHashTable(HashTable *table);
+extern int keysHashTable(HashTable *table, StgWord keys[], int szKeys);
+extern void freeHashTable(HashTable *table, void (*freeDataFun)(void *));
+extern int hashStr(const HashTable *table, StgWord w);
+extern void insertHashTable_(HashTable *table, StgWord key,
+                             const void *data, HashFunction f);
+extern void *lookupHashTable_(const HashTable *table, StgWord key,
+                              HashFunction f, CompareFunction cmp);
+
+typedef struct conchashtable ConcHashTable;
+extern ConcHashTable *allocConcHashTable(void);
+extern void freeConcHashTable(ConcHashTable *table, void (*freeDataFun)(void *));
+extern void insertConcHashTable(ConcHashTable *table, StgWord key,
+                                const void *data);
+extern void *lookupConcHashTable(ConcHashTable *table, StgWord key);
+extern void *removeConcHashTable(ConcHashTable *table, StgWord key);
+extern void concHashSafePoint(void);
+extern void *removeHashTable_(HashTable *table, StgWord key, const void *data,
+                              HashFunction f, CompareFunction cmp);
+
+#define N 200000
+#define ROUNDS 10
+
+static StgWord keys[N];
+
+static int compareStr(StgWord key1, StgWord key2)
+{
+    return strcmp((char *)key1, (char *)key2) == 0;
+}
+
+static void check(bool ok, const char *what, const char *kind)
+{
+    if (!ok) {
+        barf("FAIL: %s (%s table)", what, kind);
+    }
+}
+
+// Pointer-like keys: word aligned, clustered, with the odd collision in
+// their low bits.
+static void make_keys(void)
+{
+    StgWord x = 0x4200000;
+    for (int i = 0; i < N; i++) {
+        x += sizeof(W_) * (1 + (i * 7919) % 13);
+        keys[i] = x;
+    }
+}
+
+static void test_words(HashTable *t, const char *kind)
+{
+    for (int i = 0; i < N; i++) {
+        insertHashTable(t, keys[i], (void *)(keys[i] ^ 1));
+    }
+    check(keyCountHashTable(t) == N, "count after insert", kind);
+    for (int i = 0; i < N; i++) {
+        check(lookupHashTable(t, keys[i]) == (void *)(keys[i] ^ 1),
+              "lookup", kind);
+        check(lookupHashTable(t, keys[i] + 1) == NULL, "lookup absent", kind);
+    }
+
+    // remove every other key, twice over, then put them back
+    for (int r = 0; r < 2; r++) {
+        for (int i = 0; i < N; i += 2) {
+            check(removeHashTable(t, keys[i], NULL) == (void *)(keys[i] ^ 1),
+                  "remove", kind);
+        }
+        check(keyCountHashTable(t) == N / 2, "count after remove", kind);
+        for (int i = 0; i < N; i++) {
+            void *expect = i % 2 == 0 ? NULL : (void *)(keys[i] ^ 1);
+            check(lookupHashTable(t, keys[i]) == expect,
+                  "lookup after remove", kind);
+        }
+        for (int i = 0; i < N; i += 2) {
+            insertHashTable(t, keys[i], (void *)(keys[i] ^ 1));
+        }
+    }
+
+    check(removeHashTable(t, keys[1], (void *)(keys[1] ^ 1))
+            == (void *)(keys[1] ^ 1), "remove with data", kind);
+    insertHashTable(t, keys[1], (void *)(keys[1] ^ 1));
+
+    static StgWord got[N];
+    check(keysHashTable(t, got, N) == N, "keys", kind);
+    for (int i = 0; i < N; i++) {
+        check(lookupHashTable(t, got[i]) != NULL, "listed key", kind);
+    }
+
+    freeHashTable(t, NULL);
+}
+
+static void test_strings(HashTable *t, const char *kind)
+{
+    static char names[1000][16];
+
+    for (int i = 0; i < 1000; i++) {
+        snprintf(names[i], sizeof(names[i]), "sym_%d", i);
+        insertHashTable_(t, (StgWord)names[i], names[i], hashStr);
+    }
+    for (int i = 0; i < 1000; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "sym_%d", i);
+        check(lookupHashTable_(t, (StgWord)name, hashStr, compareStr)
+                == names[i], "string lookup", kind);
+        if (i % 3 == 0) {
+            check(removeHashTable_(t, (StgWord)name, NULL, hashStr, compareStr)
+                    == names[i], "string remove", kind);
+            check(lookupHashTable_(t, (StgWord)name, hashStr, compareStr)
+                    == NULL, "string lookup after remove", kind);
+        }
+    }
+    freeHashTable(t, NULL);
+}
+
+static void test_concurrent(void)
+{
+    const char *kind = "concurrent";
+    ConcHashTable *t = allocConcHashTable();
+
+    for (int i = 0; i < N; i++) {
+        insertConcHashTable(t, keys[i], (void *)(keys[i] ^ 1));
+    }
+    for (int i = 0; i < N; i++) {
+        check(lookupConcHashTable(t, keys[i]) == (void *)(keys[i] ^ 1),
+              "lookup", kind);
+        check(lookupConcHashTable(t, keys[i] + 1) == NULL, "lookup absent", kind);
+    }
+
+    // a repeated key shadows the earlier entry until it is removed
+    insertConcHashTable(t, keys[0], &keys[0]);
+    check(lookupConcHashTable(t, keys[0]) == &keys[0], "shadowed lookup", kind);
+    check(removeConcHashTable(t, keys[0]) == &keys[0], "shadowed remove", kind);
+    check(lookupConcHashTable(t, keys[0]) == (void *)(keys[0] ^ 1),
+          "unshadowed lookup", kind);
+
+    for (int i = 0; i < N; i += 2) {
+        check(removeConcHashTable(t, keys[i]) == (void *)(keys[i] ^ 1),
+              "remove", kind);
+    }
+    // frees the removed nodes and the bucket arrays outgrown above
+    concHashSafePoint();
+    for (int i = 0; i < N; i++) {
+        void *expect = i % 2 == 0 ? NULL : (void *)(keys[i] ^ 1);
+        check(lookupConcHashTable(t, keys[i]) == expect,
+              "lookup after remove", kind);
+    }
+
+    freeConcHashTable(t, NULL);
+}
+
+static double seconds_since(StgWord64 start)
+{
+    return (double)(getMonotonicNSec() - start) / 1e9;
+}
+
+static void bench(HashTable *(*alloc)(void), const char *kind)
+{
+    double insert = 0, lookup = 0, delete = 0;
+    StgWord found = 0;
+
+    for (int r = 0; r < ROUNDS; r++) {
+        HashTable *t = alloc();
+        StgWord64 start = getMonotonicNSec();
+        for (int i = 0; i < N; i++) {
+            insertHashTable(t, keys[i], &keys[i]);
+        }
+        insert += seconds_since(start);
+
+        start = getMonotonicNSec();
+        for (int i = 0; i < N; i++) {
+            found += lookupHashTable(t, keys[(i * 31) % N]) != NULL;
+            found += lookupHashTable(t, keys[i] + 1) != NULL;
+        }
+        lookup += seconds_since(start);
+
+        start = getMonotonicNSec();
+        for (int i = 0; i < N; i++) {
+            removeHashTable(t, keys[i], NULL);
+        }
+        delete += seconds_since(start);
+        freeHashTable(t, NULL);
+    }
+
+    printf("%-6s insert %6.1f ns, lookup %6.1f ns, delete %6.1f ns (%" FMT_Word ")\n",
+           kind,
+           insert * 1e9 / ((double)N * ROUNDS),
+           lookup * 1e9 / (2.0 * N * ROUNDS),
+           delete * 1e9 / ((double)N * ROUNDS),
+           found);
+}
+
+int main (int argc, char *argv[])
+{
+    hs_init(&argc, &argv);
+
+    make_keys();
+    test_words(allocHashTable(), "linear");
+    test_words(allocOpenHashTable(), "open");
+    test_strings(allocHashTable(), "linear");
+    test_strings(allocOpenHashTable(), "open");
+    test_concurrent();
+
+    bench(allocHashTable, "linear");
+    bench(allocOpenHashTable, "open");
+
+    hs_exit();
+    return 0;
+}
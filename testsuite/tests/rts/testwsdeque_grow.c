@@ -0,0 +1,97 @@
+#if !defined(THREADED_RTS)
+#define THREADED_RTS
+#endif
+
+#include "Rts.h"
+#include "WSDeque.h"
+#include <stdio.h>
+
+// Like testwsdeque, but the deque starts small and grows while the thieves
+// take up to half of it at a time; every element must be taken exactly once.
+
+#define SCRATCH_SIZE (1024*1024)
+#define THREADS 3
+#define POP 4
+#define BATCH 8
+
+WSDeque *q;
+
+StgWord scratch[SCRATCH_SIZE];
+StgWord done;
+
+OSThreadId ids[THREADS];
+
+void work(void *p, uint32_t n)
+{
+    StgWord val;
+
+    val = *(StgWord *)p;
+    if (val != 0) {
+        fflush(stdout);
+        fflush(stderr);
+        barf("FAIL: %p %" FMT_Word32 " %" FMT_Word, p, n, val);
+    }
+    *(StgWord*)p = n+10;
+}
+
+void* OSThreadProcAttr thief(void *info)
+{
+    void *batch[BATCH];
+    StgWord n;
+
+    n = (StgWord)info;
+
+    while (!ACQUIRE_LOAD(&done)) {
+        uint32_t got = stealHalfWSDeque(q, batch, BATCH);
+        for (uint32_t i = 0; i < got; i++) {
+            work(batch[i], n+1);
+        }
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    int n;
+    void *p;
+
+    q = newGrowableWSDeque(16, SCRATCH_SIZE);
+    done = 0;
+
+    for (n=0; n < SCRATCH_SIZE; n++) {
+        scratch[n] = 0;
+    }
+
+    for (n=0; n < THREADS; n++) {
+        createOSThread(&ids[n], "thief", (OSThreadProc*)thief, (void*)(StgWord)n);
+    }
+
+    for (n=0; n < SCRATCH_SIZE; n++) {
+        if (n % POP == 0) {
+            p = popWSDeque(q);
+            if (p != NULL) { work(p,0); }
+        }
+        if (!pushWSDeque(q,&scratch[n])) {
+            barf("FAIL: push %d failed", n);
+        }
+    }
+
+    RELEASE_STORE(&done, 1);
+    for (n=0; n < THREADS; n++) {
+        joinOSThread(ids[n]);
+    }
+
+    while ((p = popWSDeque(q)) != NULL) {
+        work(p,0);
+    }
+
+    for (n=0; n < SCRATCH_SIZE; n++) {
+        if (scratch[n] == 0) {
+            barf("FAIL: element %d was lost", n);
+        }
+    }
+
+    freeWSDeque(q);
+    printf("OK\n");
+    exit(0);
+}
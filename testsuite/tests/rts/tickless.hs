@@ -0,0 +1,23 @@
+import Control.Concurrent
+import Control.Monad
+import Data.IORef
+
+-- With --tickless the RTS stops its clock whenever it is idle. Check that it
+-- starts it again when it has threads to run: the spinning thread is only
+-- ever switched out by the clock, so the main thread must get the
+-- capability back after its threadDelay. See Note [Tickless idling].
+main :: IO ()
+main =
+  forM_ [1 .. 3 :: Int] $ \i -> do
+    threadDelay 50000   -- idle: the clock stops
+    stop <- newIORef False
+    done <- newEmptyMVar
+    _ <- forkIO $
+      let spin n = do
+            s <- readIORef stop
+            if s then putMVar done n else spin (n + 1 :: Int)
+      in spin 0
+    threadDelay 20000
+    writeIORef stop True
+    _ <- takeMVar done
+    putStrLn ("round " ++ show i)
@@ -0,0 +1,14 @@
+-- Code compiled with -ticky-sample runs with the usual RTS, and posts its
+-- counters to the eventlog with -lT
+module Main where
+
+import Data.List (foldl')
+
+collatz :: Int -> Int
+collatz 1 = 0
+collatz n
+  | even n    = 1 + collatz (n `div` 2)
+  | otherwise = 1 + collatz (3 * n + 1)
+
+main :: IO ()
+main = print (foldl' (+) 0 (map collatz [1 .. 100000]))
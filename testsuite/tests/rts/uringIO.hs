@@ -0,0 +1,59 @@
+{-# LANGUAGE BangPatterns #-}
+{-# LANGUAGE MagicHash #-}
+{-# LANGUAGE UnboxedTuples #-}
+
+-- Test the io_uring I/O manager: threadDelay, threadWaitRead and the
+-- uringRead# / uringWrite# primitives, with several threads blocked at once.
+module Main (main) where
+
+import Control.Concurrent
+import Control.Monad
+import Foreign
+import Foreign.C
+import GHC.Exts
+import GHC.IO (IO(..))
+import System.Posix.Types (Fd(..))
+
+foreign import ccall unsafe "pipe" c_pipe :: Ptr CInt -> IO CInt
+
+uringRead :: CInt -> Ptr Word8 -> Int -> IO Int
+uringRead fd (Ptr buf) (I# len) = IO $ \s ->
+  case uringRead# fd# buf len (-1#) s of
+    (# s', r #) -> (# s', I# r #)
+  where !(I# fd#) = fromIntegral fd
+
+uringWrite :: CInt -> Ptr Word8 -> Int -> IO Int
+uringWrite fd (Ptr buf) (I# len) = IO $ \s ->
+  case uringWrite# fd# buf len (-1#) s of
+    (# s', r #) -> (# s', I# r #)
+  where !(I# fd#) = fromIntegral fd
+
+newPipe :: IO (CInt, CInt)
+newPipe = allocaArray 2 $ \p -> do
+  throwErrnoIfMinus1_ "pipe" (c_pipe p)
+  [r, w] <- peekArray 2 p
+  return (r, w)
+
+main :: IO ()
+main = do
+  pipes <- replicateM 4 newPipe
+  done <- newEmptyMVar
+  -- Block a reader on each pipe before anything is written
+  forM_ (zip [0..] pipes) $ \(i, (r, _)) -> forkIO $
+    allocaBytes 16 $ \buf -> do
+      n <- uringRead r buf 16
+      bytes <- peekArray n buf
+      putMVar done (i :: Int, bytes)
+  threadDelay 10000
+  forM_ (zip [0..] pipes) $ \(i, (_, w)) ->
+    withArray [fromIntegral i, 42] $ \buf -> do
+      n <- uringWrite w buf 2
+      when (n /= 2) $ fail ("uringWrite: " ++ show n)
+  results <- replicateM (length pipes) (takeMVar done)
+  forM_ [0 .. length pipes - 1] $ \i -> print (lookup i results)
+
+  -- threadWaitRead goes through the same ring
+  let (r, w) = head pipes
+  _ <- forkIO $ threadDelay 10000 >> void (withArray [7] $ \b -> uringWrite w b 1)
+  threadWaitRead (Fd r)
+  putStrLn "readable"
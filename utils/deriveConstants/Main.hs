@@ -334,6 +334,9 @@ wanteds os = concat
           ,constantWord Both "TICKY_BIN_COUNT" "TICKY_BIN_COUNT"
            -- number of bins for histograms used in ticky code
 
+          ,constantWord Both "EAGER_BLACKHOLE_SITES" "EAGER_BLACKHOLE_SITES"
+           -- see Note [Adaptive eager blackholing] in rts/BlackHoles.c
+
           ,fieldOffset Both "StgRegTable" "rR1"
           ,fieldOffset Both "StgRegTable" "rR2"
           ,fieldOffset Both "StgRegTable" "rR3"
@@ -385,6 +388,7 @@ wanteds os = concat
           ,fieldOffset Both "StgRegTable" "rHpAlloc"
           ,structField C    "StgRegTable" "rRet"
           ,structField C    "StgRegTable" "rNursery"
+          ,fieldOffset Both "StgRegTable" "rTickyCountdown"
 
           ,defIntOffset Both "stgEagerBlackholeInfo"
                              "FUN_OFFSET(stgEagerBlackholeInfo)"
@@ -399,6 +403,9 @@ wanteds os = concat
           ,structField C    "Capability" "interrupt"
           ,structField C    "Capability" "sparks"
           ,structField C    "Capability" "total_allocated"
+          ,structField C    "Capability" "mvar_blocks"
+          ,structField C    "Capability" "mvar_barges"
+          ,structField C    "Capability" "alloc_sample_left"
           ,structField C    "Capability" "weak_ptr_list_hd"
           ,structField C    "Capability" "weak_ptr_list_tl"
           ,structField C    "Capability" "n_run_queue"
@@ -470,6 +477,7 @@ wanteds os = concat
           ,closureField  C    "StgTSO"      "bq"
           ,closureField  C    "StgTSO"      "label"
           ,closureField  C    "StgTSO"      "bound"
+          ,closureField  C    "StgTSO"      "priority"
           ,closureField  Both "StgTSO"      "alloc_limit"
           ,closureField_ Both "StgTSO_cccs" "StgTSO" "prof.cccs"
           ,closureField  Both "StgTSO"      "stackobj"
@@ -544,6 +552,7 @@ wanteds os = concat
           ,closureField C "StgTVar" "current_value"
           ,closureField C "StgTVar" "first_watch_queue_entry"
           ,closureField C "StgTVar" "num_updates"
+          ,closureField C "StgTVar" "wake_limit"
 
           ,closureSize  C "StgWeak"
           ,closureField C "StgWeak" "link"
@@ -598,6 +607,7 @@ wanteds os = concat
           ,closureField C "StgCompactNFData" "hp"
           ,closureField C "StgCompactNFData" "hpLim"
           ,closureField C "StgCompactNFData" "hash"
+          ,closureField C "StgCompactNFData" "dedup"
           ,closureField C "StgCompactNFData" "result"
 
           ,structSize   C "StgCompactNFDataBlock"
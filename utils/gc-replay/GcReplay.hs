@@ -0,0 +1,216 @@
+{-# LANGUAGE BangPatterns, MagicHash, UnboxedTuples #-}
+
+-- | Rebuild a heap of the shape described by a shape file from
+-- heap-shape.py, then allocate at it the way the original program did, so
+-- that the collections of the original run can be repeated offline. See
+-- README for how to use it.
+--
+-- The old generations are rebuilt from the size histogram of the census:
+-- for each bucket, as many closures of its average size as the census
+-- counted, scaled so that they add up to the live data of the collection
+-- described. They form a forest of random trees, so that a parallel
+-- collector has as much work to share as in a real heap. Closures of two
+-- or three words are constructors, larger ones arrays of pointers, and
+-- those of a large object's size become large objects.
+--
+-- Then the program allocates short-lived data, keeping as much of it live
+-- across each minor collection as the youngest generation had, and writes
+-- to as many IORefs in the old generation as the mutable lists had
+-- entries, so each minor collection has mutable lists of the same size.
+module Main (main) where
+
+import Control.Exception (evaluate)
+import Control.Monad
+import Data.Bits
+import Data.IORef
+import GHC.Exts
+import GHC.IO (IO(..))
+import System.Environment
+import System.Exit
+import System.IO
+import System.Mem (performMajorGC)
+import Text.Read (readMaybe)
+
+data Shape = Shape
+  { shapeAllocArea :: !Int
+  , shapeAllocRate :: !Int
+  , shapeGens      :: [(Int, Int, Int)]   -- ^ generation, live bytes, mut_list
+  , shapeSizes     :: [(Int, Int)]        -- ^ objects, bytes
+  }
+
+readShape :: FilePath -> IO Shape
+readShape path = do
+  ls <- lines <$> readFile path
+  foldM line (Shape 0 0 [] []) (zip [1 :: Int ..] ls)
+  where
+    line s (n, l) = case words l of
+      [] -> return s
+      ('#' : _) : _ -> return s
+      ["generations", _] -> return s
+      ["alloc-area", a] -> do
+        a' <- num n a
+        return s { shapeAllocArea = a' }
+      ["alloc-rate", a] -> do
+        a' <- num n a
+        return s { shapeAllocRate = a' }
+      ["gen", g, "live", live, "large", _, "mut-list", m] -> do
+        gen <- (,,) <$> num n g <*> num n live <*> num n m
+        return s { shapeGens = shapeGens s ++ [gen] }
+      ["size", _, "objects", o, "bytes", b] -> do
+        size <- (,) <$> num n o <*> num n b
+        return s { shapeSizes = shapeSizes s ++ [size] }
+      "pause" : _ -> return s
+      _ -> die (path ++ ":" ++ show n ++ ": can't parse " ++ show l)
+    num n w = maybe (die (path ++ ":" ++ show n ++ ": bad number " ++ w))
+                    return (readMaybe w)
+
+-- -----------------------------------------------------------------------------
+-- The rebuilt heap
+
+data Obj
+  = Nil
+  | Box !Obj                      -- 2 words
+  | Pair !Obj !Obj                -- 3 words
+  | Arr (SmallArray# Obj)         -- 2 words, and the array's 2 + n
+
+wordSize :: Int
+wordSize = finiteBitSize (0 :: Int) `div` 8
+
+-- | The roots of the trees: each new closure takes the place of a random
+-- root, and points to the closure it replaced, so that everything built
+-- stays reachable.
+data Pool = Pool (SmallMutableArray# RealWorld Obj)
+
+poolSize :: Int
+poolSize = 4096
+
+newPool :: IO Pool
+newPool = case poolSize of
+  I# n -> IO $ \s -> case newSmallArray# n Nil s of
+    (# s', a #) -> (# s', Pool a #)
+
+readPool :: Pool -> Int -> IO Obj
+readPool (Pool a) (I# i) = IO $ readSmallArray# a i
+
+writePool :: Pool -> Int -> Obj -> IO ()
+writePool (Pool a) (I# i) o = IO $ \s -> (# writeSmallArray# a i o s, () #)
+
+-- | A xorshift generator, which is plenty for picking roots.
+next :: Int -> Int
+next x0 = x3
+  where
+    x1 = x0 `xor` (x0 `unsafeShiftL` 13)
+    x2 = x1 `xor` (x1 `unsafeShiftR` 7)
+    x3 = x2 `xor` (x2 `unsafeShiftL` 17)
+
+pick :: Int -> Int
+pick r = (r `unsafeShiftR` 8) `mod` poolSize
+
+-- | Build a closure of about w words, returning the next random number.
+newObj :: Pool -> Int -> Int -> IO Int
+newObj pool !w !r0 = do
+  let i = pick r0
+      r1 = next r0
+  old <- readPool pool i
+  (o, r) <-
+    if w <= 2 then return (Box old, r1)
+    else if w == 3 then do
+      other <- readPool pool (pick r1)
+      return (Pair old other, next r1)
+    else newArr pool (w - 4) old r1
+  _ <- evaluate o
+  writePool pool i o
+  return r
+
+newArr :: Pool -> Int -> Obj -> Int -> IO (Obj, Int)
+newArr pool (I# n) old r0 = do
+  Marr m <- IO $ \s -> case newSmallArray# n old s of
+    (# s', m #) -> (# s', Marr m #)
+  let fill !j !r
+        | j >= I# n = return r
+        | otherwise = do
+            o <- readPool pool (pick r)
+            case j of
+              I# j' -> IO $ \s -> (# writeSmallArray# m j' o s, () #)
+            fill (j + 1) (next r)
+  r <- fill 1 r0
+  IO $ \s -> case unsafeFreezeSmallArray# m s of
+    (# s', a #) -> (# s', (Arr a, r) #)
+
+data Marr = Marr (SmallMutableArray# RealWorld Obj)
+
+-- | Build the old generations, interleaving the buckets a few closures at
+-- a time, as a real heap would mix them.
+buildOld :: Pool -> [(Int, Int)] -> Int -> IO ()
+buildOld pool buckets r0 = go [ (n, w) | (n, w) <- buckets, n > 0 ] r0
+  where
+    go [] _ = return ()
+    go bs r = do
+      (bs', r') <- foldM step ([], r) bs
+      go (reverse bs') r'
+    step (acc, r) (n, w) = do
+      let k = min n 64
+      r' <- foldM (\r'' _ -> newObj pool w r'') r [1 .. k]
+      return (if n > k then (n - k, w) : acc else acc, r')
+
+-- -----------------------------------------------------------------------------
+-- Allocating at it
+
+chain :: Int -> Obj -> Obj
+chain n !acc
+  | n <= 0 = acc
+  | otherwise = chain (n - 1) (Box acc)
+
+-- | Allocate n words in 2-word closures, all garbage by the time we
+-- return.
+allocate :: Int -> IO ()
+{-# NOINLINE allocate #-}
+allocate n = void $ evaluate (chain (n `div` 2) Nil)
+
+main :: IO ()
+main = do
+  args <- getArgs
+  (path, seconds) <- case args of
+    [p] -> return (p, 10)
+    [p, s] | Just s' <- readMaybe s -> return (p, s' :: Double)
+    _ -> die "usage: GcReplay SHAPE-FILE [SECONDS] +RTS -A<n> -G<n> -s -RTS"
+  shape <- readShape path
+
+  let old_live = sum [ live | (g, live, _) <- shapeGens shape, g > 0 ]
+      young_live = sum [ live | (0, live, _) <- shapeGens shape ]
+      mut_list = sum [ m | (g, _, m) <- shapeGens shape, g > 0 ]
+      census = sum (map snd (shapeSizes shape))
+      scale = if census == 0 then 0
+              else fromIntegral old_live / fromIntegral census :: Double
+      buckets = [ (round (fromIntegral n * scale),
+                   max 2 (b `div` (n * wordSize)))
+                | (n, b) <- shapeSizes shape, n > 0 ]
+      alloc_area = max (1024 * 1024) (shapeAllocArea shape)
+      rate = if shapeAllocRate shape > 0 then shapeAllocRate shape
+             else 1024 * 1024 * 1024
+      steps = max 1 (round (fromIntegral rate * seconds)
+                     `div` alloc_area) :: Int
+
+  when (null (shapeSizes shape)) $
+    die (path ++ ": no size histogram")
+
+  hPutStrLn stderr $ "building " ++ show (sum (map fst buckets))
+    ++ " closures of " ++ show old_live ++ " bytes, "
+    ++ show mut_list ++ " mutable list entries"
+  pool <- newPool
+  buildOld pool buckets 2463534242
+  refs <- replicateM mut_list (newIORef Nil)
+  young <- newIORef Nil
+  performMajorGC
+
+  hPutStrLn stderr $ "allocating " ++ show (steps * alloc_area)
+    ++ " bytes, " ++ show young_live ++ " live at each minor GC"
+  forM_ [1 .. steps] $ \_ -> do
+    allocate ((alloc_area - young_live) `div` wordSize)
+    y <- evaluate (chain (young_live `div` (2 * wordSize)) Nil)
+    writeIORef young y
+    mapM_ (\ref -> writeIORef ref y) refs
+
+  -- keep the old generations until the end
+  _ <- readPool pool 0
+  hPutStrLn stderr "done"
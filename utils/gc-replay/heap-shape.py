@@ -0,0 +1,272 @@
+#!/usr/bin/env python3
+"""
+Summarise the shape of a program's heap from its eventlog, as a shape file
+that GcReplay.hs can rebuild and collect offline. See README.
+
+The eventlog must come from a run with +RTS -l -hT (or any other heap
+profile) so that it has the GC_GEN_SHAPE and HEAP_PROF_SIZE_HISTOGRAM
+events; for instance
+
+    ./prog +RTS -l -hT -i0.5 -RTS
+    ./heap-shape.py prog.eventlog > prog.shape
+
+By default the shape is that of the collection with the most live data,
+and of the census closest to it. With --at it is the collection closest to
+the given time instead. With --compare, the pauses of the original run are
+printed next to those of a replay, from its +RTS -t --machine-readable
+statistics.
+"""
+
+import argparse
+import ast
+import struct
+import sys
+
+# From rts/include/rts/EventLogFormat.h
+EVENT_HEADER_BEGIN = 0x68647262
+EVENT_HEADER_END = 0x68647265
+EVENT_HEADER_VERSION = 0x68647276
+EVENT_DATA_BEGIN = 0x64617462
+EVENT_DATA_END = 0xffff
+EVENT_HET_BEGIN = 0x68657462
+EVENT_HET_END = 0x68657465
+EVENT_ET_BEGIN = 0x65746200
+EVENT_ET_END = 0x65746500
+EVENTLOG_FORMAT_VERSION_COMPACT = 1
+
+# From rts/gen_event_types.py
+EVENT_GC_START = 9
+EVENT_GC_END = 10
+EVENT_BLOCK_MARKER = 18
+EVENT_HEAP_ALLOCATED = 49
+EVENT_HEAP_INFO_GHC = 52
+EVENT_GC_STATS_GHC = 53
+EVENT_GC_GEN_SHAPE = 231
+EVENT_HEAP_PROF_SIZE_HISTOGRAM = 232
+
+VARIABLE_SIZE = 0xffff
+
+PERCENTILES = [('p50', 0.5), ('p90', 0.9), ('p99', 0.99), ('p999', 0.999)]
+
+class EventLog:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def word(self, n):
+        if self.pos + n > len(self.data):
+            raise EOFError
+        w = int.from_bytes(self.data[self.pos:self.pos + n], 'big')
+        self.pos += n
+        return w
+
+    def varint(self):
+        w = 0
+        shift = 0
+        while True:
+            b = self.word(1)
+            w |= (b & 0x7f) << shift
+            shift += 7
+            if not b & 0x80:
+                return w
+
+    def skip(self, n):
+        self.pos += n
+
+    def expect(self, marker, what):
+        if self.word(4) != marker:
+            sys.exit('not an eventlog (%s missing)' % what)
+
+    def events(self):
+        """Yield (type, timestamp, payload) for each event."""
+        self.expect(EVENT_HEADER_BEGIN, 'header')
+        marker = self.word(4)
+        compact = False
+        if marker == EVENT_HEADER_VERSION:
+            compact = self.word(4) == EVENTLOG_FORMAT_VERSION_COMPACT
+            marker = self.word(4)
+        if marker != EVENT_HET_BEGIN:
+            sys.exit('not an eventlog (event types missing)')
+        sizes = {}
+        while True:
+            marker = self.word(4)
+            if marker == EVENT_HET_END:
+                break
+            if marker != EVENT_ET_BEGIN:
+                sys.exit('bad event type in eventlog header')
+            ty = self.word(2)
+            sizes[ty] = self.word(2)
+            self.skip(self.word(4))         # description
+            self.skip(self.word(4))         # extra information
+            self.expect(EVENT_ET_END, 'end of event type')
+        self.expect(EVENT_HEADER_END, 'end of header')
+        self.expect(EVENT_DATA_BEGIN, 'data')
+
+        # An eventlog that the program didn't get to finish just stops, so
+        # the end of the file is as good as EVENT_DATA_END.
+        timestamp = 0
+        try:
+            while True:
+                if compact:
+                    # see Note [Compact eventlog format] in
+                    # rts/eventlog/EventLog.c
+                    ty = self.varint()
+                    if ty == EVENT_DATA_END:
+                        return
+                    delta = self.varint()
+                    if ty == EVENT_BLOCK_MARKER:
+                        timestamp = 0
+                    timestamp += (delta >> 1) ^ -(delta & 1)
+                    size = self.varint()
+                else:
+                    ty = self.word(2)
+                    if ty == EVENT_DATA_END:
+                        return
+                    timestamp = self.word(8)
+                    if ty not in sizes:
+                        sys.exit('event of unknown type %d' % ty)
+                    size = sizes[ty]
+                    if size == VARIABLE_SIZE:
+                        size = self.word(2)
+                if self.pos + size > len(self.data):
+                    return
+                yield ty, timestamp, self.data[self.pos:self.pos + size]
+                self.pos += size
+        except EOFError:
+            return
+
+def percentile(xs, p):
+    if not xs:
+        return 0.0
+    xs = sorted(xs)
+    return xs[min(len(xs) - 1, int(p * len(xs)))]
+
+class Shape:
+    def __init__(self):
+        self.generations = 2
+        self.alloc_area = 0
+        self.allocated = {}         # by capability
+        self.end_time = 0
+        self.gcs = []               # (time, [(gen, live, large, mut_list)])
+        self.censuses = []          # (time, [(objects, bytes)])
+        self.pauses = {'minor': [], 'major': []}
+
+    def read(self, path):
+        with open(path, 'rb') as f:
+            log = EventLog(f.read())
+        cap = None
+        gc_start = {}
+        gc_gen = None
+        for ty, t, p in log.events():
+            self.end_time = max(self.end_time, t)
+            if ty == EVENT_BLOCK_MARKER:
+                cap = struct.unpack('>IQH', p[:14])[2]
+            elif ty == EVENT_HEAP_INFO_GHC:
+                _, gens, _, alloc_area = struct.unpack('>IHQQ', p[:22])
+                self.generations = gens
+                self.alloc_area = alloc_area
+            elif ty == EVENT_HEAP_ALLOCATED:
+                self.allocated[cap] = struct.unpack('>IQ', p[:12])[1]
+            elif ty == EVENT_GC_START:
+                gc_start[cap] = t
+            elif ty == EVENT_GC_STATS_GHC:
+                gc_gen = struct.unpack('>IH', p[:6])[1]
+            elif ty == EVENT_GC_END:
+                if cap in gc_start and gc_gen is not None:
+                    kind = 'major' if gc_gen >= self.generations - 1 else 'minor'
+                    self.pauses[kind].append((t - gc_start.pop(cap)) / 1e9)
+                gc_gen = None
+            elif ty == EVENT_GC_GEN_SHAPE:
+                _, gen, live, large, mut = struct.unpack('>IHQQQ', p[:30])
+                if gen == 0 or not self.gcs:
+                    self.gcs.append((t, []))
+                self.gcs[-1][1].append((gen, live, large, mut))
+            elif ty == EVENT_HEAP_PROF_SIZE_HISTOGRAM:
+                _, n = struct.unpack('>BI', p[:5])
+                buckets = [struct.unpack('>QQ', p[5 + 16*i:21 + 16*i])
+                           for i in range(n)]
+                self.censuses.append((t, buckets))
+
+    def choose(self, at):
+        if not self.gcs:
+            sys.exit('no GC_GEN_SHAPE events: was the program run with +RTS -l?')
+        if not self.censuses:
+            sys.exit('no HEAP_PROF_SIZE_HISTOGRAM events: '
+                     'was the program run with +RTS -hT?')
+        if at is None:
+            gc = max(self.gcs, key=lambda g: sum(x[1] for x in g[1]))
+        else:
+            gc = min(self.gcs, key=lambda g: abs(g[0] - at * 1e9))
+        census = min(self.censuses, key=lambda c: abs(c[0] - gc[0]))
+        return gc, census
+
+    def write(self, out, path, at):
+        (t, gens), (census_t, buckets) = self.choose(at)
+        alloc_rate = 0
+        if self.end_time > 0:
+            alloc_rate = int(sum(self.allocated.values()) * 1e9 / self.end_time)
+        out.write('# heap shape of %s\n' % path)
+        out.write('# collection at %.3fs, census at %.3fs\n'
+                  % (t / 1e9, census_t / 1e9))
+        out.write('# replay with +RTS -A%d -G%d\n'
+                  % (self.alloc_area, self.generations))
+        out.write('generations %d\n' % self.generations)
+        out.write('alloc-area %d\n' % self.alloc_area)
+        out.write('alloc-rate %d\n' % alloc_rate)
+        for gen, live, large, mut in sorted(gens):
+            out.write('gen %d live %d large %d mut-list %d\n'
+                      % (gen, live, large, mut))
+        for i, (objects, size) in enumerate(buckets):
+            if objects > 0:
+                out.write('size %d objects %d bytes %d\n' % (i, objects, size))
+        for kind in ('minor', 'major'):
+            for name, p in PERCENTILES:
+                out.write('pause %s %s %.6f\n'
+                          % (kind, name, percentile(self.pauses[kind], p)))
+
+def read_shape_pauses(path):
+    pauses = {}
+    with open(path) as f:
+        for line in f:
+            w = line.split()
+            if len(w) == 4 and w[0] == 'pause':
+                pauses[(w[1], w[2])] = float(w[3])
+    return pauses
+
+def compare(shape_path, stats_path):
+    original = read_shape_pauses(shape_path)
+    # The first line is the program's command line, the rest a Haskell list
+    # of pairs of strings, which is also a Python one.
+    with open(stats_path) as f:
+        text = f.read()
+    stats = dict(ast.literal_eval(text[text.index('['):]))
+    print('%-12s %12s %12s' % ('pause', 'original ms', 'replay ms'))
+    for kind in ('minor', 'major'):
+        for name, _ in PERCENTILES:
+            key = '%s_pause_%s_seconds' % (kind, name)
+            replay = stats.get(key)
+            print('%-12s %12.3f %12s'
+                  % (kind + ' ' + name,
+                     original.get((kind, name), 0.0) * 1e3,
+                     '-' if replay is None else '%.3f' % (float(replay) * 1e3)))
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('eventlog', help='eventlog, or shape file with --compare')
+    ap.add_argument('--at', type=float, metavar='SECONDS',
+                    help='use the collection closest to this time')
+    ap.add_argument('--compare', metavar='STATS',
+                    help='compare the pauses in a shape file with the '
+                         '+RTS -t --machine-readable statistics of a replay')
+    args = ap.parse_args()
+
+    if args.compare:
+        compare(args.eventlog, args.compare)
+    else:
+        shape = Shape()
+        shape.read(args.eventlog)
+        shape.write(sys.stdout, args.eventlog, args.at)
+
+if __name__ == '__main__':
+    main()
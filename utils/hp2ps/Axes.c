@@ -5,6 +5,7 @@
 #include "Defines.h"
 #include "Dimensions.h"
 #include "HpFile.h"
+#include "Svg.h"
 #include "Utilities.h"
 
 /* own stuff */
@@ -30,6 +31,17 @@ Axes(void)
 static void
 XAxisMark(floatish x, floatish num)
 {
+    char number[ NUMBER_LENGTH ];
+
+    if (svgflag) {
+	SvgLine(xpage(x), ypage(0.0), xpage(x), ypage(0.0) - 4.0);
+	sprintf(number, "%.1f", num);
+	SvgTextBegin(xpage(x), borderspace, NORMAL_FONT, "middle", 0);
+	SvgString(number, -1);
+	SvgTextEnd();
+	return;
+    }
+
     /* calibration mark */
     fprintf(psfp, "%f %f moveto\n", xpage(x), ypage(0.0));
     fprintf(psfp, "0 -4 rlineto\n");
@@ -53,12 +65,17 @@ extern floatish xrange;
 extern char *sampleunitstring;
 
 static void
-XAxis(void)
+XAxisLine(void)
 {
-    floatish increment, i; 
-    floatish t, x;
-    floatish legendlen;
- 
+    if (svgflag) {
+	SvgLine(xpage(0.0), ypage(0.0), xpage(0.0) + graphwidth, ypage(0.0));
+	SvgTextBegin(xpage(0.0) + graphwidth, borderspace, NORMAL_FONT,
+		     "end", 0);
+	SvgString(sampleunitstring, -1);
+	SvgTextEnd();
+	return;
+    }
+
     /* draw the x axis line */
     fprintf(psfp, "%f %f moveto\n", xpage(0.0), ypage(0.0));
     fprintf(psfp, "%f 0 rlineto\n", graphwidth);
@@ -73,7 +90,16 @@ XAxis(void)
     fprintf(psfp, "exch sub\n");
     fprintf(psfp, "%f moveto\n", borderspace);
     fprintf(psfp, "show\n");
+}
 
+static void
+XAxis(void)
+{
+    floatish increment, i; 
+    floatish t, x;
+    floatish legendlen;
+
+    XAxisLine();
 
     /* draw x axis scaling */
 
@@ -94,6 +120,26 @@ XAxis(void)
 static void
 YAxisMark(floatish y, floatish num, mkb unit)
 {
+    if (svgflag) {
+	SvgLine(xpage(0.0), ypage(y), xpage(0.0) - 4.0, ypage(y));
+	SvgTextBegin(graphx0 - borderspace, ypage(y), NORMAL_FONT, "end", 0);
+	switch (unit) {
+	case MEGABYTE :
+	    CommaPrint(psfp, (intish) (num / 1e6 + 0.5));
+	    fputc('M', psfp);
+	    break;
+	case KILOBYTE :
+	    CommaPrint(psfp, (intish) (num / 1e3 + 0.5));
+	    fputc('k', psfp);
+	    break;
+	case BYTE:
+	    CommaPrint(psfp, (intish) (num + 0.5));
+	    break;
+	}
+	SvgTextEnd();
+	return;
+    }
+
     /* calibration mark */
     fprintf(psfp, "%f %f moveto\n", xpage(0.0), ypage(y));
     fprintf(psfp, "-4 0 rlineto\n");
@@ -139,12 +185,16 @@ extern floatish yrange;
 extern char *valueunitstring;
 
 static void
-YAxis(void)
+YAxisLine(void)
 {
-    floatish increment, i;
-    floatish t, y;
-    floatish legendlen;
-    mkb unit;
+    if (svgflag) {
+	SvgLine(xpage(0.0), ypage(0.0), xpage(0.0), ypage(0.0) + graphheight);
+	SvgTextBegin(xpage(0.0) - borderspace, ypage(0.0) + graphheight,
+		     NORMAL_FONT, "end", 1);
+	SvgString(valueunitstring, -1);
+	SvgTextEnd();
+	return;
+    }
 
     /* draw the y axis line */
     fprintf(psfp, "%f %f moveto\n", xpage(0.0), ypage(0.0));
@@ -165,6 +215,17 @@ YAxis(void)
     fprintf(psfp, "0 0 moveto\n");
     fprintf(psfp, "show\n");
     fprintf(psfp, "grestore\n");
+}
+
+static void
+YAxis(void)
+{
+    floatish increment, i;
+    floatish t, y;
+    floatish legendlen;
+    mkb unit;
+
+    YAxisLine();
 
     /* draw y axis scaling */
     increment = max( yrange / (floatish) N_Y_MARKS, 1.0);
@@ -5,17 +5,36 @@
 #include "Dimensions.h"
 #include "HpFile.h"
 #include "Shade.h"
+#include "Svg.h"
 #include "Utilities.h"
 
 /* own stuff */
 #include "Curves.h"
 
-static floatish *x;		/* x and y values  */
+/*
+ *	A profile can have many more samples than there is room for across
+ *	the graph, and drawing every one of them only makes the output big
+ *	and slow to view. So we divide the graph into columns,
+ *	COLUMNS_PER_POINT to the point, and draw one point in each column
+ *	for each curve: the greatest height of the curve over the samples
+ *	in the column or, with -a, their average. Either way the curves
+ *	stay stacked, and a column with one sample in it is drawn just as
+ *	the sample. So the size of the output depends on the width of the
+ *	graph rather than the number of samples.
+ */
+
+static floatish *x;		/* x and y values of the columns */
 static floatish *y;
 
 static floatish *py;		/* previous y values */
 
+static intish npoints;		/* number of columns with samples */
+static intish *column;		/* the column of each sample */
+static intish *ncolumn;		/* the number of samples in each column */
+static floatish *sy;		/* y value of each sample */
+
 static void Curve PROTO((struct entry *));	/* forward */
+static void Columns PROTO((void));		/* forward */
 static void ShadeCurve
     PROTO((floatish *x, floatish *y, floatish *py, floatish shade));
 
@@ -42,19 +61,54 @@ Curve(struct entry *e)
   
     for (ch = e->chk; ch; ch = ch->next) {
         for (j = 0; j < ch->nd; j++) {
-	    y[ ch->d[j].bucket ] += ch->d[j].value;
+	    sy[ ch->d[j].bucket ] += ch->d[j].value;
 	}
     }    
 
+    Columns();
+
     ShadeCurve(x, y, py, ShadeOf(e->name));
 }
 
+/*
+ *	Set y[] for the columns from sy[] for the samples.
+ */
+
+static void
+Columns(void)
+{
+    intish i;
+    intish c;
+
+    for (c = 0; c < npoints; c++) {
+	y[c] = 0.0;
+    }
+
+    for (i = 0; i < nsamples; i++) {
+	c = column[i];
+	if (aflag) {
+	    y[c] += sy[i];
+	} else {
+	    y[c] = max(y[c], sy[i]);
+	}
+    }
+
+    if (aflag) {
+	for (c = 0; c < npoints; c++) {
+	    y[c] /= (floatish) ncolumn[c];
+	}
+    }
+}
+
 
 static void PlotCurveLeftToRight PROTO((floatish *, floatish *)); /* forward */
 static void PlotCurveRightToLeft PROTO((floatish *, floatish *)); /* forward */
 
 static void SaveCurve PROTO((floatish *, floatish *)); /* forward */
 
+static void MoveTo PROTO((floatish, floatish)); /* forward */
+static void LineTo PROTO((floatish, floatish)); /* forward */
+
 /*
  *	Map virtual x coord to physical x coord 
  */
@@ -86,13 +140,18 @@ ypage(floatish y)
 static void
 ShadeCurve(floatish *x, floatish *y, floatish *py, floatish shade)
 {
-    fprintf(psfp, "%f %f moveto\n", xpage(x[0]), ypage(py[0]));
+    MoveTo(xpage(x[0]), ypage(py[0]));
     PlotCurveLeftToRight(x, py);
 
-    fprintf(psfp, "%f %f lineto\n", xpage(x[nsamples - 1]), 
-                                    ypage(y[nsamples - 1]));
+    LineTo(xpage(x[npoints - 1]), ypage(y[npoints - 1]));
     PlotCurveRightToLeft(x, y);
 
+    if (svgflag) {
+	SvgClosePath(SVGColour(shade));
+	SaveCurve(y, py);
+	return;
+    }
+
     fprintf(psfp, "closepath\n");
 
     fprintf(psfp, "gsave\n");
@@ -111,8 +170,8 @@ PlotCurveLeftToRight(floatish *x, floatish *y)
 {
     intish i;
 
-    for (i = 0; i < nsamples; i++) {
-        fprintf(psfp, "%f %f lineto\n", xpage(x[i]), ypage(y[i]));
+    for (i = 0; i < npoints; i++) {
+        LineTo(xpage(x[i]), ypage(y[i]));
     }
 }
 
@@ -121,8 +180,28 @@ PlotCurveRightToLeft(floatish *x, floatish *y)
 {
     intish i;
 
-    for (i = nsamples - 1; i >= 0; i-- ) {
-        fprintf(psfp, "%f %f lineto\n", xpage(x[i]), ypage(y[i]));
+    for (i = npoints - 1; i >= 0; i-- ) {
+        LineTo(xpage(x[i]), ypage(y[i]));
+    }
+}
+
+static void
+MoveTo(floatish x, floatish y)
+{
+    if (svgflag) {
+	SvgMoveTo(x, y);
+    } else {
+	fprintf(psfp, "%f %f moveto\n", x, y);
+    }
+}
+
+static void
+LineTo(floatish x, floatish y)
+{
+    if (svgflag) {
+	SvgLineTo(x, y);
+    } else {
+	fprintf(psfp, "%f %f lineto\n", x, y);
     }
 }
 
@@ -135,7 +214,7 @@ SaveCurve(floatish *y, floatish *py)
 {
     intish i;
 
-    for (i = 0; i < nsamples; i++) {
+    for (i = 0; i < npoints; i++) {
 	py[i] = y[i];
     }
 }
@@ -146,13 +225,46 @@ void
 CurvesInit(void)
 {
     intish i;
+    intish c;
+    intish lastc;
+    floatish sx;
 
     x  =  (floatish*) xmalloc(nsamples * sizeof(floatish));
     y  =  (floatish*) xmalloc(nsamples * sizeof(floatish));
     py =  (floatish*) xmalloc(nsamples * sizeof(floatish));
+    sy =  (floatish*) xmalloc(nsamples * sizeof(floatish));
+    column  = (intish*) xmalloc(nsamples * sizeof(intish));
+    ncolumn = (intish*) xmalloc(nsamples * sizeof(intish));
+
+    npoints = 0;
+    lastc = -1;
 
     for (i = 0; i < nsamples; i++) {
-        x[i] = ((samplemap[i] - samplemap[0])/ xrange) * graphwidth;
-        y[i] = py[i] = 0.0; 
+        sx = ((samplemap[i] - samplemap[0])/ xrange) * graphwidth;
+        sy[i] = 0.0;
+
+        c = (intish) (sx * COLUMNS_PER_POINT);
+        if (npoints == 0 || c != lastc) {
+            x[npoints] = 0.0;
+            y[npoints] = py[npoints] = 0.0;
+            ncolumn[npoints] = 0;
+            npoints++;
+            lastc = c;
+        }
+        column[i] = npoints - 1;
+        x[npoints - 1] += sx;
+        ncolumn[npoints - 1]++;
+    }
+
+    /* put each column where its samples are, on average */
+    for (c = 0; c < npoints; c++) {
+        x[c] /= (floatish) ncolumn[c];
+    }
+
+    /* but start and end the curves where the samples do */
+    if (nsamples > 0) {
+        x[0] = 0.0;
+        x[npoints - 1] = ((samplemap[nsamples - 1] - samplemap[0])/ xrange)
+                       * graphwidth;
     }
 }
@@ -33,6 +33,8 @@ extern int _twenty_;
 
 #define KEY_BOX_WIDTH	        14  /* key boxes are 14pt high               */
 
+#define COLUMNS_PER_POINT	 4  /* draw curves at most 4 points per pt   */
+
 #define SMALL_JOB_STRING_WIDTH	35  /* small title for 35 characters or less */
 #define BIG_JOB_STRING_WIDTH    80  /* big title for everything else	     */	
 
@@ -40,6 +40,10 @@ Deviation(void)
     }
  
     for (i = 0; i < nidents; i++) {
+        if (streamflag) {
+	    averages[i] = identtable[i]->sum;
+	    continue;
+	}
         for (ch = identtable[i]->chk; ch; ch = ch->next) {
 	    for (j = 0; j < ch->nd; j++) {
 	        averages[i] += ch->d[j].value; 
@@ -58,6 +62,14 @@ Deviation(void)
     }
  
     for (i = 0; i < nidents; i++) {
+        if (streamflag) {
+	    /* -S keeps only the sums of the values and their squares */
+	    e = identtable[i];
+	    dev = e->sumsq - 2.0 * averages[i] * e->sum
+		+ (floatish) e->count * averages[i] * averages[i];
+	    deviations[i] = dev > 0.0 ? dev : 0.0;
+	    continue;
+	}
         for (ch = identtable[i]->chk; ch; ch = ch->next) {
 	    for (j = 0; j < ch->nd; j++) {
 		dev = ch->d[j].value - averages[i];
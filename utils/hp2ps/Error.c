@@ -40,8 +40,9 @@ void
 Usage(const char *str)
 {
    if (str) printf("error: %s\n", str);
-   printf("usage: %s -b -d -ef -g -i -p -mn -p -s -tf -y [file[.hp]]\n", programname);
-   printf("where -b  use large title box\n");
+   printf("usage: %s -a -b -d -ef -g -i -p -mn -p -s -S -tf -w -y [file[.hp]|file.eventlog]\n", programname);
+   printf("where -a  average the samples drawn at the same point, rather than take the greatest\n");
+   printf("      -b  use large title box\n");
    printf("      -d  sort by standard deviation\n"); 
    printf("      -ef[in|mm|pt] produce Encapsulated PostScript f units wide (f > 2 inches)\n");
    printf("      -g  produce output suitable for GHOSTSCRIPT previever\n");
@@ -51,7 +52,9 @@ Usage(const char *str)
    printf("          -m0 removes the band limit altogether\n");
    printf("      -p  use previous scaling, shading and ordering\n");
    printf("      -s  use small title box\n");
+   printf("      -S  read the file twice, keeping only the bands drawn\n");
    printf("      -tf ignore trace bands which sum below f%% (default 1%%, max 5%%)\n");
+   printf("      -w  produce SVG rather than PostScript\n");
    printf("      -y  traditional\n");
    printf("      -c  colour output\n");
    exit(0);
@@ -0,0 +1,554 @@
+#include "Main.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "Defines.h"
+#include "Error.h"
+#include "HpFile.h"
+#include "Utilities.h"
+
+/* own stuff */
+#include "EventLog.h"
+
+/*
+ *	Read the heap profile of a program run with +RTS -h -l from its
+ *	eventlog, rather than from its .hp file. The heap profiling
+ *	events (see "Heap profiler event log output" in the User's Guide)
+ *	carry the same samples, which we pass to HpFile.c as if we had read
+ *	them from a .hp file, skipping all the other events. Both the
+ *	default encoding and the compact one (+RTS --eventlog-compact) are
+ *	understood.
+ *
+ *	The JOB and DATE come from the PROGRAM_ARGS and WALL_CLOCK_TIME
+ *	events. Cost centre stacks (-hc) are named as in a .hp file, but
+ *	without the "(n)" stack number in front, which the eventlog doesn't
+ *	have. The bands of HEAP_PROF_SAMPLE_DELTA events (--heap-prof-delta)
+ *	keep the residency they last had, and are named by their info
+ *	table's address, as with -hi.
+ */
+
+/* From rts/include/rts/EventLogFormat.h */
+#define EVENT_HEADER_BEGIN	0x68647262
+#define EVENT_HEADER_END	0x68647265
+#define EVENT_HEADER_VERSION	0x68647276
+#define EVENT_DATA_BEGIN	0x64617462
+#define EVENT_DATA_END		0xffff
+#define EVENT_HET_BEGIN		0x68657462
+#define EVENT_HET_END		0x68657465
+#define EVENT_ET_BEGIN		0x65746200
+#define EVENT_ET_END		0x65746500
+
+#define EVENTLOG_FORMAT_VERSION_COMPACT 1
+
+/* From rts/gen_event_types.py */
+#define EVENT_BLOCK_MARKER			 18
+#define EVENT_PROGRAM_ARGS			 30
+#define EVENT_WALL_CLOCK_TIME			 43
+#define EVENT_HEAP_PROF_COST_CENTRE		161
+#define EVENT_HEAP_PROF_SAMPLE_BEGIN		162
+#define EVENT_HEAP_PROF_SAMPLE_COST_CENTRE	163
+#define EVENT_HEAP_PROF_SAMPLE_STRING		164
+#define EVENT_HEAP_PROF_SAMPLE_END		165
+#define EVENT_HEAP_BIO_PROF_SAMPLE_BEGIN	166
+#define EVENT_HEAP_PROF_SAMPLE_DELTA		229
+
+#define N_EVENT_TYPES	0x10000
+#define VARIABLE_SIZE	0xffff	/* size of a variable-length event	*/
+#define UNKNOWN_SIZE	-1	/* an event type not in the header	*/
+
+static FILE *elfp;
+static boolish compact;		/* the compact format (version 1)	*/
+static int *eventsizes;		/* payload size of each event type	*/
+static intish nevents;		/* events read so far			*/
+
+static unsigned char *payload;	/* the payload of the current event	*/
+static size_t payloadsize;
+static size_t payloadmax;
+static size_t payloadpos;	/* how much of it we have decoded	*/
+
+static char **ccnames;		/* cost centre names, by number		*/
+static size_t nccnames;
+
+static char *namebuffer;	/* for building band names		*/
+static size_t namebuffersize;
+
+static struct deltaband {
+    uint64_t info;
+    char *name;
+    floatish value;
+} *deltabands;			/* HEAP_PROF_SAMPLE_DELTA bands		*/
+static intish ndeltabands;
+static intish maxdeltabands;
+static intish *deltahash;	/* index + 1 into deltabands, or 0	*/
+static intish deltahashsize;	/* a power of two			*/
+
+/*
+ *	Reading the file.
+ */
+
+static int
+GetByte(void)
+{
+    int c = getc(elfp);
+
+    if (c == EOF) {
+	Error("%s: unexpected end of eventlog", hpfile);
+    }
+    return c;
+}
+
+static uint64_t
+GetWord(int bytes)
+{
+    uint64_t w = 0;
+
+    while (bytes-- > 0) {
+	w = (w << 8) | (uint64_t) GetByte();
+    }
+    return w;
+}
+
+/* An unsigned LEB128 number, following "first" */
+static uint64_t
+GetVarint(int first)
+{
+    uint64_t w = first & 0x7f;
+    int shift = 7;
+
+    while (first & 0x80) {
+	if (shift > 63) {
+	    Error("%s: bad number in eventlog", hpfile);
+	}
+	first = GetByte();
+	w |= (uint64_t) (first & 0x7f) << shift;
+	shift += 7;
+    }
+    return w;
+}
+
+static void
+Expect(uint32_t marker, char *what)
+{
+    if (GetWord(4) != marker) {
+	Error("%s: not an eventlog (%s missing)", hpfile, what);
+    }
+}
+
+static void
+Skip(uint64_t n)
+{
+    while (n-- > 0) {
+	GetByte();
+    }
+}
+
+static void
+GetPayload(size_t size)
+{
+    if (size > payloadmax) {
+	payloadmax = size;
+	payload = xrealloc(payload, payloadmax);
+    }
+    if (size > 0 && fread(payload, 1, size, elfp) != size) {
+	Error("%s: unexpected end of eventlog", hpfile);
+    }
+    payloadsize = size;
+    payloadpos = 0;
+}
+
+/*
+ *	Decoding the payload of an event.
+ */
+
+static uint64_t
+PayloadWord(int bytes)
+{
+    uint64_t w = 0;
+
+    if (payloadpos + bytes > payloadsize) {
+	Error("%s: event %d is too short", hpfile, (int) nevents);
+    }
+    while (bytes-- > 0) {
+	w = (w << 8) | payload[ payloadpos++ ];
+    }
+    return w;
+}
+
+static char *
+PayloadString(void)
+{
+    char *s = (char *) payload + payloadpos;
+    char *end = memchr(s, '\0', payloadsize - payloadpos);
+
+    if (!end) {
+	Error("%s: event %d has an unterminated string", hpfile, (int) nevents);
+    }
+    payloadpos += end - s + 1;
+    return s;
+}
+
+static void
+NameClear(void)
+{
+    if (!namebuffer) {
+	namebuffersize = 256;
+	namebuffer = xmalloc(namebuffersize);
+    }
+    namebuffer[0] = '\0';
+}
+
+static void
+NameAppend(const char *s)
+{
+    size_t n = strlen(namebuffer);
+    size_t m = strlen(s);
+
+    while (n + m + 1 > namebuffersize) {
+	namebuffersize *= 2;
+	namebuffer = xrealloc(namebuffer, namebuffersize);
+    }
+    memcpy(namebuffer + n, s, m + 1);
+}
+
+/*
+ *	The events we are interested in.
+ */
+
+static void
+ProgramArgs(void)
+{
+    PayloadWord(4);		/* capability set */
+
+    if (jobstring) {
+	return;
+    }
+    NameClear();
+    while (payloadpos < payloadsize) {
+	if (namebuffer[0]) {
+	    NameAppend(" ");
+	}
+	NameAppend(PayloadString());
+    }
+    jobstring = copystring(namebuffer);
+}
+
+static void
+WallClockTime(void)
+{
+    char date[64];
+    time_t secs;
+
+    PayloadWord(4);		/* capability set */
+    secs = (time_t) PayloadWord(8);
+
+    if (datestring) {
+	return;
+    }
+    /* as the RTS writes it in a .hp file */
+    if (strftime(date, sizeof date, "%a %b %e %H:%M %Y", localtime(&secs)) == 0) {
+	date[0] = '\0';
+    }
+    datestring = copystring(date);
+}
+
+static void
+CostCentre(void)
+{
+    uint64_t id = PayloadWord(4);
+    char *label = PayloadString();
+    char *module = PayloadString();
+
+    if (id >= nccnames) {
+	size_t n = nccnames ? nccnames : 256;
+	while (n <= id) {
+	    n *= 2;
+	}
+	ccnames = xrealloc(ccnames, n * sizeof(char *));
+	memset(ccnames + nccnames, 0, (n - nccnames) * sizeof(char *));
+	nccnames = n;
+    }
+    if (ccnames[ id ]) {
+	return;			/* reposted */
+    }
+    /* CAF cost centres are named M.CAF, as in a .hp file */
+    if (strcmp(label, "CAF") == 0) {
+	ccnames[ id ] = copystring2(module, ".CAF");
+    } else {
+	ccnames[ id ] = copystring(label);
+    }
+}
+
+static void
+SampleCostCentre(void)
+{
+    uint64_t residency;
+    uint64_t depth;
+    uint64_t id;
+
+    PayloadWord(1);		/* profile */
+    residency = PayloadWord(8);
+    depth = PayloadWord(1);
+
+    NameClear();
+    if (depth == 0) {
+	NameAppend("MAIN");
+    }
+    while (depth-- > 0) {
+	id = PayloadWord(4);
+	NameAppend(id < nccnames && ccnames[ id ] ? ccnames[ id ] : "???");
+	if (depth > 0) {
+	    NameAppend("/");
+	}
+    }
+    SampleValue(namebuffer, (floatish) residency);
+}
+
+static void
+SampleString(void)
+{
+    uint64_t residency;
+
+    PayloadWord(1);		/* profile */
+    residency = PayloadWord(8);
+    SampleValue(PayloadString(), (floatish) residency);
+}
+
+static uint64_t
+HashInfo(uint64_t info)
+{
+    info ^= info >> 33;
+    info *= 0xff51afd7ed558ccdULL;
+    return info ^ (info >> 33);
+}
+
+static void
+GrowDeltaHash(void)
+{
+    intish i;
+    uint64_t h;
+
+    deltahashsize = deltahashsize ? deltahashsize * 2 : 1024;
+    free(deltahash);
+    deltahash = (intish *) xmalloc(deltahashsize * sizeof(intish));
+    for (i = 0; i < deltahashsize; i++) {
+	deltahash[ i ] = 0;
+    }
+    for (i = 0; i < ndeltabands; i++) {
+	h = HashInfo(deltabands[ i ].info) & (deltahashsize - 1);
+	while (deltahash[ h ]) {
+	    h = (h + 1) & (deltahashsize - 1);
+	}
+	deltahash[ h ] = i + 1;
+    }
+}
+
+static struct deltaband *
+DeltaBand(uint64_t info)
+{
+    uint64_t h;
+    intish i;
+    char name[ 2 + 16 + 1 ];
+
+    if (ndeltabands * 2 >= deltahashsize) {
+	GrowDeltaHash();
+    }
+    h = HashInfo(info) & (deltahashsize - 1);
+    while ((i = deltahash[ h ]) != 0) {
+	if (deltabands[ i - 1 ].info == info) {
+	    return &deltabands[ i - 1 ];
+	}
+	h = (h + 1) & (deltahashsize - 1);
+    }
+
+    if (ndeltabands >= maxdeltabands) {
+	maxdeltabands = maxdeltabands ? maxdeltabands * 2 : 1024;
+	deltabands = xrealloc(deltabands,
+			      maxdeltabands * sizeof(struct deltaband));
+    }
+    sprintf(name, "0x%llx", (unsigned long long) info);
+    deltabands[ ndeltabands ].info = info;
+    deltabands[ ndeltabands ].name = copystring(name);
+    deltabands[ ndeltabands ].value = 0.0;
+    deltahash[ h ] = ++ndeltabands;
+    return &deltabands[ ndeltabands - 1 ];
+}
+
+static void
+SampleDelta(void)
+{
+    uint64_t n;
+    uint64_t info;
+
+    PayloadWord(1);		/* profile */
+    n = PayloadWord(4);
+    while (n-- > 0) {
+	info = PayloadWord(8);
+	DeltaBand(info)->value = (floatish) PayloadWord(8);
+    }
+}
+
+static void
+SampleEnd(void)
+{
+    intish i;
+
+    /* the bands of HEAP_PROF_SAMPLE_DELTA events keep their residency */
+    for (i = 0; i < ndeltabands; i++) {
+	if (deltabands[ i ].value != 0.0) {
+	    SampleValue(deltabands[ i ].name, deltabands[ i ].value);
+	}
+    }
+    EndSample();
+}
+
+static void
+Event(int type, uint64_t timestamp)
+{
+    switch (type) {
+    case EVENT_PROGRAM_ARGS:
+	ProgramArgs();
+	break;
+    case EVENT_WALL_CLOCK_TIME:
+	WallClockTime();
+	break;
+    case EVENT_HEAP_PROF_COST_CENTRE:
+	CostCentre();
+	break;
+    case EVENT_HEAP_PROF_SAMPLE_BEGIN:
+	BeginSample((floatish) timestamp / 1e9);
+	break;
+    case EVENT_HEAP_BIO_PROF_SAMPLE_BEGIN:
+	PayloadWord(8);		/* sample number */
+	BeginSample((floatish) PayloadWord(8) / 1e9);
+	break;
+    case EVENT_HEAP_PROF_SAMPLE_COST_CENTRE:
+	SampleCostCentre();
+	break;
+    case EVENT_HEAP_PROF_SAMPLE_STRING:
+	SampleString();
+	break;
+    case EVENT_HEAP_PROF_SAMPLE_DELTA:
+	SampleDelta();
+	break;
+    case EVENT_HEAP_PROF_SAMPLE_END:
+	SampleEnd();
+	break;
+    default:
+	break;
+    }
+}
+
+/*
+ *	Read the header, which gives the size of each type of event.
+ */
+
+static void
+GetHeader(void)
+{
+    uint64_t marker;
+    uint64_t type;
+    uint64_t size;
+    intish i;
+
+    if (!eventsizes) {
+	eventsizes = (int *) xmalloc(N_EVENT_TYPES * sizeof(int));
+    }
+    for (i = 0; i < N_EVENT_TYPES; i++) {
+	eventsizes[ i ] = UNKNOWN_SIZE;
+    }
+
+    Expect(EVENT_HEADER_BEGIN, "header");
+    marker = GetWord(4);
+    compact = 0;
+    if (marker == EVENT_HEADER_VERSION) {
+	compact = GetWord(4) == EVENTLOG_FORMAT_VERSION_COMPACT;
+	marker = GetWord(4);
+    }
+    if (marker != EVENT_HET_BEGIN) {
+	Error("%s: not an eventlog (event types missing)", hpfile);
+    }
+
+    while ((marker = GetWord(4)) != EVENT_HET_END) {
+	if (marker != EVENT_ET_BEGIN) {
+	    Error("%s: bad event type in eventlog header", hpfile);
+	}
+	type = GetWord(2);
+	size = GetWord(2);
+	eventsizes[ type ] = (int) size;
+	Skip(GetWord(4));	/* description */
+	Skip(GetWord(4));	/* extra information */
+	Expect(EVENT_ET_END, "end of event type");
+    }
+
+    Expect(EVENT_HEADER_END, "end of header");
+    Expect(EVENT_DATA_BEGIN, "data");
+}
+
+void
+GetEventLog(FILE *infp)
+{
+    int c;
+    uint64_t type;
+    uint64_t timestamp = 0;
+    uint64_t delta;
+    size_t size;
+    intish i;
+
+    elfp = infp;
+    nevents = 0;
+    for (i = 0; i < ndeltabands; i++) {
+	deltabands[ i ].value = 0.0;
+    }
+
+    GetHeader();
+
+    /*
+     * An eventlog that the program didn't get to finish just stops, so
+     * the end of the file is as good as EVENT_DATA_END.
+     */
+    while ((c = getc(elfp)) != EOF) {
+	if (compact) {
+	    type = GetVarint(c);
+	    if (type == EVENT_DATA_END) {
+		break;
+	    }
+	    /* see Note [Compact eventlog format] in rts/eventlog/EventLog.c */
+	    delta = GetVarint(GetByte());
+	    if (type == EVENT_BLOCK_MARKER) {
+		timestamp = 0;
+	    }
+	    timestamp += (delta >> 1) ^ (0 - (delta & 1));
+	    size = (size_t) GetVarint(GetByte());
+	} else {
+	    type = ((uint64_t) c << 8) | (uint64_t) GetByte();
+	    if (type == EVENT_DATA_END) {
+		break;
+	    }
+	    timestamp = GetWord(8);
+	    if (eventsizes[ type ] == UNKNOWN_SIZE) {
+		Error("%s: event %d has unknown type %d", hpfile,
+		      (int) nevents, (int) type);
+	    }
+	    size = eventsizes[ type ] == VARIABLE_SIZE
+		 ? (size_t) GetWord(2) : (size_t) eventsizes[ type ];
+	}
+	nevents++;
+	GetPayload(size);
+	Event(type < N_EVENT_TYPES ? (int) type : -1, timestamp);
+    }
+
+    if (!sampleunitstring) {
+	sampleunitstring = copystring("seconds");
+    }
+    if (!valueunitstring) {
+	valueunitstring = copystring("bytes");
+    }
+    if (!jobstring) {
+	jobstring = copystring(hpfile);
+    }
+    if (!datestring) {
+	datestring = copystring("");
+    }
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void GetEventLog PROTO((FILE *));
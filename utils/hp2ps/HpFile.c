@@ -6,6 +6,7 @@
 #include "Defines.h"
 #include "Error.h"
 #include "HpFile.h"
+#include "EventLog.h"
 #include "Utilities.h"
 
 #if !defined(atof)
@@ -26,18 +27,22 @@ token thetok;                                   /* last token           */
 int linenum;                                    /* current line number  */
 int endfile;                                    /* true at end of file  */
 
-static boolish gotjob = 0;                      /* "JOB" read           */
-static boolish gotdate = 0;                     /* "DATE" read          */
-static boolish gotvalueunit = 0;                /* "VALUE_UNIT" read    */
-static boolish gotsampleunit = 0;               /* "SAMPLE_UNIT" read   */
 static boolish insample = 0;                    /* true when in sample  */
 
 static floatish lastsample;                     /* the last sample time */
 
+/* What we keep of the samples we read, see GetHpBands */
+static enum {
+    READ_SAMPLES,                               /* all of them          */
+    READ_TOTALS,                                /* -S: totals only      */
+    READ_BANDS                                  /* -S: the bands drawn  */
+} readmode;
+
 static void GetHpLine PROTO((FILE *));          /* forward */
 static void GetHpTok  PROTO((FILE *, int));     /* forward */
 
 static struct entry *GetEntry PROTO((char *));  /* forward */
+static struct entry *LookupEntry PROTO((char *)); /* forward */
 
 static void GetString PROTO((FILE *));          /* forward */
 
@@ -67,37 +72,52 @@ floatish *markmap;              /* sample marks         */
  *
  */
 
-void
-GetHpFile(FILE *infp)
+static void
+ReadHpFile(FILE *infp)
 {
     nsamples = 0;
-    nmarks   = 0;
-    nidents  = 0;
 
     ch = ' ';
     endfile = 0;
     linenum = 1;
     lastsample = 0.0;
+    insample = 0;
 
-    GetHpTok(infp, 1);
+    if (eventlogflag) {
+        GetEventLog(infp);
+    } else {
+        GetHpTok(infp, 1);
 
-    while (endfile == 0) {
-        GetHpLine(infp);
+        while (endfile == 0) {
+            GetHpLine(infp);
+        }
     }
 
-    if (!gotjob) {
+    fclose(infp);
+}
+
+void
+GetHpFile(FILE *infp)
+{
+    nidents  = 0;
+    nmarks   = 0;
+    readmode = streamflag ? READ_TOTALS : READ_SAMPLES;
+
+    ReadHpFile(infp);
+
+    if (!jobstring) {
         Error("%s: JOB missing", hpfile);
     }
 
-    if (!gotdate) {
+    if (!datestring) {
         Error("%s: DATE missing", hpfile);
     }
 
-    if (!gotvalueunit) {
+    if (!valueunitstring) {
         Error("%s: VALUE_UNIT missing", hpfile);
     }
 
-    if (!gotsampleunit) {
+    if (!sampleunitstring) {
         Error("%s: SAMPLE_UNIT missing", hpfile);
     }
 
@@ -107,8 +127,42 @@ GetHpFile(FILE *infp)
 
 
     MakeIdentTable();
+}
+
+/*
+ *      With -S, GetHpFile keeps only the totals of each identifier and
+ *      the times of the samples, which is all that TraceElement,
+ *      Deviation, TopTwenty and the rest need to choose the bands. Then
+ *      GetHpBands reads the file again, storing the samples of only the
+ *      identifiers in identtable, and adding those of the identifiers
+ *      that TopTwenty grouped together to its OTHER band. So memory
+ *      grows with the number of bands drawn, rather than the number of
+ *      identifiers in the file, times the number of samples.
+ */
+
+static struct entry **pendingbands;             /* bands in this sample */
+static intish npending;
 
-    fclose(hpfp);
+void
+GetHpBands(FILE *infp)
+{
+    intish i;
+    intish samples = nsamples;
+
+    for (i = 0; i < nidents; i++) {
+        /* TopTwenty has set the bands of the identifiers it grouped */
+        identtable[ i ]->band = identtable[ i ];
+    }
+    pendingbands = (struct entry **) xmalloc(nidents * sizeof(struct entry *));
+    npending = 0;
+
+    readmode = READ_BANDS;
+    ReadHpFile(infp);
+
+    if (nsamples != samples) {
+        Error("%s: changed while it was being read", hpfile);
+    }
+    free(pendingbands);
 }
 
 
@@ -120,7 +174,7 @@ GetHpFile(FILE *infp)
 static void
 GetHpLine(FILE *infp)
 {
-    static intish nmarkmax = 0, nsamplemax = 0;
+    static intish nmarkmax = 0;
 
     switch (thetok) {
     case JOB_TOK:
@@ -129,7 +183,6 @@ GetHpLine(FILE *infp)
             Error("%s, line %d: string must follow JOB", hpfile, linenum);
         }
         jobstring = thestring;
-        gotjob = 1;
         GetHpTok(infp, 1);
         break;
 
@@ -139,7 +192,6 @@ GetHpLine(FILE *infp)
             Error("%s, line %d: string must follow DATE", hpfile, linenum);
         }
         datestring = thestring;
-        gotdate = 1;
         GetHpTok(infp, 1);
         break;
 
@@ -150,7 +202,6 @@ GetHpLine(FILE *infp)
                   linenum);
         }
         sampleunitstring = thestring;
-        gotsampleunit = 1;
         GetHpTok(infp, 1);
         break;
 
@@ -161,7 +212,6 @@ GetHpLine(FILE *infp)
                   linenum);
         }
         valueunitstring = thestring;
-        gotvalueunit = 1;
         GetHpTok(infp, 1);
         break;
 
@@ -174,7 +224,9 @@ GetHpLine(FILE *infp)
         if (insample) {
             Error("%s, line %d, MARK occurs within sample", hpfile, linenum);
         }
-        if (nmarks >= nmarkmax) {
+        if (readmode == READ_BANDS) {
+            /* we have them already */
+        } else if (nmarks >= nmarkmax) {
             if (!markmap) {
                 nmarkmax = N_MARKS;
                 markmap = (floatish*) xmalloc(nmarkmax * sizeof(floatish));
@@ -183,43 +235,31 @@ GetHpLine(FILE *infp)
                 markmap = (floatish*) xrealloc(markmap, nmarkmax * sizeof(floatish));
             }
         }
-        markmap[ nmarks++ ] = thefloatish;
+        if (readmode != READ_BANDS) {
+            markmap[ nmarks++ ] = thefloatish;
+        }
         GetHpTok(infp, 1);
         break;
 
     case BEGIN_SAMPLE_TOK:
-        insample = 1;
         GetHpTok(infp, 0);
         if (thetok != FLOAT_TOK) {
             Error("%s, line %d, floating point number must follow BEGIN_SAMPLE",                  hpfile, linenum);
         }
         if (thefloatish < lastsample) {
             Error("%s, line %d, samples out of sequence", hpfile, linenum);
-        } else {
-            lastsample = thefloatish;
-        }
-        if (nsamples >= nsamplemax) {
-            if (!samplemap) {
-                nsamplemax = N_SAMPLES;
-                samplemap = (floatish*) xmalloc(nsamplemax * sizeof(floatish));
-            } else {
-                nsamplemax *= 2;
-                samplemap = (floatish*) xrealloc(samplemap,
-                                              nsamplemax * sizeof(floatish));
-            }
         }
-        samplemap[ nsamples ] = thefloatish;
+        BeginSample(thefloatish);
         GetHpTok(infp, 1);
         break;
 
     case END_SAMPLE_TOK:
-        insample = 0;
         GetHpTok(infp, 0);
         if (thetok != FLOAT_TOK) {
             Error("%s, line %d: floating point number must follow END_SAMPLE",
                   hpfile, linenum);
         }
-        nsamples++;
+        EndSample();
         GetHpTok(infp, 1);
         break;
 
@@ -229,7 +269,7 @@ GetHpLine(FILE *infp)
             Error("%s, line %d: integer must follow identifier", hpfile,
                   linenum);
         }
-        StoreSample(GetEntry(theident), nsamples, thefloatish);
+        SampleValue(theident, thefloatish);
         GetHpTok(infp, 1);
         break;
 
@@ -245,6 +285,97 @@ GetHpLine(FILE *infp)
 }
 
 
+/*
+ *      Record the start of a sample at the given time, which must not
+ *      be before that of the previous one.
+ */
+
+void
+BeginSample(floatish time)
+{
+    static intish nsamplemax = 0;
+
+    if (time < lastsample) {
+        Error("%s: samples out of sequence", hpfile);
+    }
+    insample = 1;
+    lastsample = time;
+    if (readmode == READ_BANDS) {
+        return;                 /* we have the times already */
+    }
+    if (nsamples >= nsamplemax) {
+        if (!samplemap) {
+            nsamplemax = N_SAMPLES;
+            samplemap = (floatish*) xmalloc(nsamplemax * sizeof(floatish));
+        } else {
+            nsamplemax *= 2;
+            samplemap = (floatish*) xrealloc(samplemap,
+                                          nsamplemax * sizeof(floatish));
+        }
+    }
+    samplemap[ nsamples ] = time;
+}
+
+/*
+ *      Record the value of an identifier in the current sample.
+ */
+
+void
+SampleValue(char *name, floatish value)
+{
+    struct entry *e;
+
+    switch (readmode) {
+    case READ_SAMPLES:
+        StoreSample(GetEntry(name), nsamples, value);
+        break;
+
+    case READ_TOTALS:
+        e = GetEntry(name);
+        e->total += value;
+        e->count++;
+        e->sum += value;
+        e->sumsq += value * value;
+        break;
+
+    case READ_BANDS:
+        e = LookupEntry(name);
+        if (!e) {
+            Error("%s: changed while it was being read", hpfile);
+        }
+        e = e->band;
+        if (!e) {
+            break;              /* a trace element */
+        }
+        if (!e->ispending) {
+            e->ispending = 1;
+            pendingbands[ npending++ ] = e;
+        }
+        e->pending += value;
+        break;
+    }
+}
+
+void
+EndSample(void)
+{
+    intish i;
+    struct entry *e;
+
+    insample = 0;
+    if (readmode == READ_BANDS) {
+        for (i = 0; i < npending; i++) {
+            e = pendingbands[ i ];
+            StoreSample(e, nsamples, e->pending);
+            e->pending = 0.0;
+            e->ispending = 0;
+        }
+        npending = 0;
+    }
+    nsamples++;
+}
+
+
 char *
 TokenToString(token t)
 {
@@ -500,33 +631,52 @@ MakeEntry(char *name)
     struct entry* e;
 
     e = (struct entry *) xmalloc(sizeof(struct entry));
-    e->chk = MakeChunk();
+    e->chk = e->last = MakeChunk();
     e->name = copystring(name);
+    e->total = 0;
+    e->count = 0;
+    e->sum = e->sumsq = 0.0;
+    e->band = 0;
+    e->pending = 0.0;
+    e->ispending = 0;
     return e;
 }
 
 /*
- *      Get the entry associated with "name", creating a new entry if
- *      necessary.
+ *      Get the entry associated with "name", or 0 if there isn't one.
  */
 
 static struct entry *
-GetEntry(char *name)
+LookupEntry(char *name)
 {
-    intish h;
     struct entry* e;
 
-    h = Hash(name);
-
-    for (e = hashtable[ h ]; e; e = e->next) {
+    for (e = hashtable[ Hash(name) ]; e; e = e->next) {
         if (strcmp(e->name, name) == 0) {
             break;
         }
     }
 
+    return e;
+}
+
+/*
+ *      Get the entry associated with "name", creating a new entry if
+ *      necessary.
+ */
+
+static struct entry *
+GetEntry(char *name)
+{
+    intish h;
+    struct entry* e;
+
+    e = LookupEntry(name);
+
     if (e) {
         return (e);
     } else {
+        h = Hash(name);
         nidents++;
         e = MakeEntry(name);
         e->next = hashtable[ h ];
@@ -543,10 +693,9 @@ GetEntry(char *name)
 void
 StoreSample(struct entry *en, intish bucket, floatish value)
 {
-    struct chunk* chk;
+    struct chunk* chk = en->last;
 
-    for (chk = en->chk; chk->next != 0; chk = chk->next)
-        ;
+    en->total += value;
 
     if (chk->nd < N_CHUNK) {
         chk->d[ chk->nd ].bucket = bucket;
@@ -554,7 +703,7 @@ StoreSample(struct entry *en, intish bucket, floatish value)
         chk->nd += 1;
     } else {
         struct chunk* t;
-        t = chk->next = MakeChunk();
+        t = chk->next = en->last = MakeChunk();
         t->d[ 0 ].bucket = bucket;
         t->d[ 0 ].value  = value;
         t->nd += 1;
@@ -39,7 +39,17 @@ struct chunk {
 struct entry {
     struct entry *next;
     struct chunk *chk;
+    struct chunk *last;         /* the last chunk of chk                */
     char   *name;
+    intish total;               /* sum of the values, for TraceElement  */
+
+    /* Used by the two passes of -S; see GetHpBands */
+    intish count;               /* number of values                     */
+    floatish sum;               /* sum of the values, for Deviation     */
+    floatish sumsq;             /* sum of their squares, for Deviation  */
+    struct entry *band;         /* the band drawn for it, or 0          */
+    floatish pending;           /* its value in the current sample      */
+    boolish ispending;          /* it has a value in the current sample */
 };
 
 extern char *theident;
@@ -58,9 +68,14 @@ extern floatish *samplemap;
 extern floatish *markmap;
 
 void GetHpFile PROTO((FILE *));
+void GetHpBands PROTO((FILE *));
 void StoreSample PROTO((struct entry *, intish, floatish));
 struct entry *MakeEntry PROTO((char *));
 
+void BeginSample PROTO((floatish));
+void SampleValue PROTO((char *, floatish));
+void EndSample PROTO((void));
+
 token GetNumber PROTO((FILE *));
 void  GetIdent  PROTO((FILE *));
 boolish IsIdChar PROTO((int)); /* int is a "char" from getc */
@@ -8,6 +8,7 @@
 #include "HpFile.h"
 #include "Shade.h"
 #include "PsFile.h"
+#include "Svg.h"
 #include "Utilities.h"
 
 /* own stuff */
@@ -66,6 +67,16 @@ KeyEntry(floatish centreline, char *name, floatish colour)
 
     kstart = graphx0 + (multipageflag ? 0 : graphwidth);
 
+    if (svgflag) {
+	SvgBox(kstart + borderspace, keyboxbase, KEY_BOX_WIDTH, KEY_BOX_WIDTH,
+	       SVGColour(colour));
+	SvgTextBegin(kstart + (floatish) KEY_BOX_WIDTH + 2 * borderspace,
+		     namebase, NORMAL_FONT, "start", 0);
+	SvgString(name, -1);
+	SvgTextEnd();
+	return;
+    }
+
     fprintf(psfp, "%f %f moveto\n", kstart + borderspace, keyboxbase);
     fprintf(psfp, "0 %d rlineto\n", KEY_BOX_WIDTH);
     fprintf(psfp, "%d 0 rlineto\n", KEY_BOX_WIDTH);
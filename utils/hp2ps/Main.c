@@ -27,9 +27,13 @@ boolish sflag = 0;	/* use a small title box		*/
 static int     mflag = 0;	/* max no. of bands displayed (default 20) */
 static boolish tflag = 0;	/* ignored threshold specified          */
 boolish cflag = 0;      /* colour output                        */
+boolish aflag = 0;	/* average the samples in a column	*/
+boolish svgflag = 0;	/* SVG output				*/
 
 static boolish filter;		/* true when running as a filter	*/
 boolish multipageflag = 0;  /* true when the output should be 2 pages - key and profile */ 
+boolish streamflag = 0;	/* read the input twice, keeping less of it */
+boolish eventlogflag = 0;	/* the input is an eventlog		*/
 
 static floatish WidthInPoints PROTO((char *));		  /* forward */
 static FILE *Fp PROTO((char *, char **, char *, char *)); /* forward */
@@ -123,6 +127,15 @@ int main(int argc, char *argv[])
 	    case 'c':
 		cflag++;
 		goto nextarg;
+	    case 'S':
+		streamflag++;
+		goto nextarg;
+	    case 'a':
+		aflag++;
+		goto nextarg;
+	    case 'w':
+		svgflag++;
+		goto nextarg;
 	    case '?':
 	    default:
 		Usage(*argv-1);
@@ -143,16 +156,27 @@ nextarg: ;
 
     if (!filter) {
 	pathName = copystring(argv[0]);
-	DropSuffix(pathName, ".hp");
+	eventlogflag = HasSuffix(pathName, ".eventlog");
+	if (eventlogflag) {
+	    DropSuffix(pathName, ".eventlog");
+	} else {
+	    DropSuffix(pathName, ".hp");
+	}
 #if defined(_WIN32)
 	DropSuffix(pathName, ".exe");
 #endif
 	baseName = copystring(Basename(pathName));
         
-        hpfp  = Fp(pathName, &hpfile, ".hp", "r"); 
-	psfp  = Fp(baseName, &psfile, ".ps", "w"); 
+	if (eventlogflag) {
+	    hpfp  = Fp(pathName, &hpfile, ".eventlog", "rb");
+	} else {
+	    hpfp  = Fp(pathName, &hpfile, ".hp", "r"); 
+	}
+	psfp  = Fp(baseName, &psfile, svgflag ? ".svg" : ".ps", "w"); 
 
 	if (pflag) auxfp = Fp(baseName, &auxfile, ".aux", "r");
+    } else if (streamflag) {
+	Usage("-S reads the input twice, so it needs a file");
     }
 
     GetHpFile(hpfp);
@@ -171,6 +195,12 @@ nextarg: ;
     /* Selects top bands (mflag) - can be more than 20 now */
     if (TWENTY != 0) TopTwenty(); 
 
+    /* Reads the samples of the bands selected (streamflag) */
+    if (streamflag) {
+	hpfp = OpenFile(hpfile, eventlogflag ? "rb" : "r");
+	GetHpBands(hpfp);
+    }
+
     Dimensions();
 
     areabelow = AreaBelow();
@@ -59,8 +59,12 @@ extern boolish yflag;
 extern boolish bflag;
 extern boolish sflag;
 extern boolish cflag;
+extern boolish aflag;
+extern boolish svgflag;
 
 extern boolish multipageflag;
+extern boolish streamflag;
+extern boolish eventlogflag;
 
 extern char *programname;
 
@@ -3,6 +3,7 @@
 #include "Curves.h"
 #include "Dimensions.h"
 #include "HpFile.h"
+#include "Svg.h"
 
 /* own stuff */
 #include "Marks.h"
@@ -29,6 +30,14 @@ Marks(void)
 static void
 Caret(floatish x, floatish y, floatish d)
 {
+    if (svgflag) {
+	SvgMoveTo(x - d, y);
+	SvgLineTo(x, y - d);
+	SvgLineTo(x + d, y);
+	SvgClosePath("white");
+	return;
+    }
+
     fprintf(psfp, "%f %f moveto\n", x - d, y);
     fprintf(psfp, "%f %f rlineto\n",  d, -d);
     fprintf(psfp, "%f %f rlineto\n",  d,  d);
@@ -8,6 +8,7 @@
 #include "Axes.h"
 #include "Key.h"
 #include "Marks.h"
+#include "Svg.h"
 #include "Utilities.h"
 
 /* own stuff */
@@ -38,16 +39,38 @@ static void Landscape PROTO((void));			/* forward */
 static void Portrait  PROTO((void));			/* forward */
 
 void NextPage(void) {
-    fprintf(psfp, "showpage\n");
-    if (gflag) Portrait(); else Landscape();
+    if (svgflag) {
+	SvgNextPage();
+    } else {
+	fprintf(psfp, "showpage\n");
+	if (gflag) Portrait(); else Landscape();
+    }
     DoTitleAndBox();
 }
 
+/*
+ *	The number of pages NextPage will give us, for SvgHeader.
+ */
+
+static intish
+Pages(void)
+{
+    if (!multipageflag) {
+	return 1;
+    }
+    /* the key, 20 entries to a page, then the graph */
+    return 2 + (nidents > 0 ? (nidents - 1) / DEFAULT_TWENTY : 0);
+}
+
 void
 PutPsFile(void)
 {
-    Prologue();
-    Variables();
+    if (svgflag) {
+	SvgHeader(Pages());
+    } else {
+	Prologue();
+	Variables();
+    }
 
     CurvesInit();
 
@@ -66,7 +89,11 @@ PutPsFile(void)
 
     if (!yflag) Marks();
 
-    fprintf(psfp, "showpage\n");
+    if (svgflag) {
+	SvgTrailer();
+    } else {
+	fprintf(psfp, "showpage\n");
+    }
 }
 
 
@@ -150,6 +177,11 @@ Variables(void)
 static void
 BorderOutlineBox(void)
 {
+    if (svgflag) {
+	SvgBox(0.0, 0.0, borderwidth, borderheight, "none");
+	return;
+    }
+
     fprintf(psfp, "newpath\n");
     fprintf(psfp, "0 0 moveto\n");
     fprintf(psfp, "0 %f rlineto\n", borderheight);
@@ -163,6 +195,15 @@ BorderOutlineBox(void)
 static void
 BigTitleOutlineBox(void)
 {
+    if (svgflag) {
+	SvgBox(borderspace, borderheight - titleheight - borderspace,
+	       titlewidth, titleheight, "none");
+	SvgLine(borderspace, borderheight - titleheight / 2 - borderspace,
+		borderspace + titlewidth,
+		borderheight - titleheight / 2 - borderspace);
+	return;
+    }
+
     fprintf(psfp, "newpath\n");
     fprintf(psfp, "%f %f moveto\n", borderspace,
                   borderheight - titleheight - borderspace);
@@ -183,6 +224,12 @@ BigTitleOutlineBox(void)
 static void
 TitleOutlineBox(void)
 {
+    if (svgflag) {
+	SvgBox(borderspace, borderheight - titleheight - borderspace,
+	       titlewidth, titleheight, "none");
+	return;
+    }
+
     fprintf(psfp, "newpath\n");
     fprintf(psfp, "%f %f moveto\n", borderspace, 
                   borderheight - titleheight - borderspace);
@@ -196,6 +243,33 @@ TitleOutlineBox(void)
 
 static void EscapePrint PROTO((char *, int));	/* forward */
 
+/*
+ *	The title in SVG: the job at (x, y), the area below the curves at
+ *	(ax, ay) and the date on the right.
+ */
+
+static void
+SvgTitleText(floatish x, floatish y, int w, floatish ax, floatish ay,
+	     char *anchor)
+{
+    SvgTextBegin(x, y, TITLE_TEXT_FONT, "start", 0);
+    SvgString(jobstring, w);
+    SvgTextEnd();
+
+    SvgTextBegin(ax, ay, TITLE_TEXT_FONT, anchor, 0);
+    CommaPrint(psfp, (intish) areabelow);
+    fputc(' ', psfp);
+    SvgString(valueunitstring, -1);
+    fprintf(psfp, " x ");
+    SvgString(sampleunitstring, -1);
+    SvgTextEnd();
+
+    SvgTextBegin((titlewidth + borderspace) - titletextspace, ay,
+		 TITLE_TEXT_FONT, "end", 0);
+    SvgString(datestring, -1);
+    SvgTextEnd();
+}
+
 static void
 BigTitleText(void)
 {
@@ -204,6 +278,13 @@ BigTitleText(void)
     x = borderspace + titletextspace;
     y = borderheight - titleheight / 2 - borderspace + titletextspace;
 
+    if (svgflag) {
+	SvgTitleText(x, y, BIG_JOB_STRING_WIDTH,
+		     x, borderheight - titleheight - borderspace + titletextspace,
+		     "start");
+	return;
+    }
+
     /* job identifier goes on top at the far left */
 
     fprintf(psfp, "HE%d setfont\n", TITLE_TEXT_FONT);
@@ -242,6 +323,11 @@ TitleText(void)
  
     x = borderspace + titletextspace;
     y = borderheight - titleheight - borderspace + titletextspace;
+
+    if (svgflag) {
+	SvgTitleText(x, y, SMALL_JOB_STRING_WIDTH, titlewidth / 2, y, "middle");
+	return;
+    }
  
     /* job identifier goes at far left */
  
@@ -122,3 +122,30 @@ SetPSColour(floatish shade)
 	fprintf(psfp, "%f setgray\n", shade);
     }
 }
+
+/*
+ *	The same colour for SVG, as "#rrggbb".
+ */
+
+static int
+byte_colour(floatish c)
+{
+    return c <= 0.0 ? 0 : c >= 1.0 ? 255 : (int) (c * 255.0 + 0.5);
+}
+
+char *
+SVGColour(floatish shade)
+{
+    static char colour[ 8 ];
+
+    if (cflag) {
+	sprintf(colour, "#%02x%02x%02x",
+		byte_colour(extract_colour(shade, (intish)100)),
+		byte_colour(extract_colour(shade, (intish)10000)),
+		byte_colour(extract_colour(shade, (intish)1000000)));
+    } else {
+	sprintf(colour, "#%02x%02x%02x", byte_colour(shade),
+		byte_colour(shade), byte_colour(shade));
+    }
+    return colour;
+}
@@ -3,3 +3,4 @@
 floatish ShadeOf  PROTO((char *));
 void     ShadeFor PROTO((char *, floatish));
 void     SetPSColour PROTO((floatish));
+char    *SVGColour PROTO((floatish));
@@ -0,0 +1,173 @@
+#include "Main.h"
+#include <stdio.h>
+#include "Defines.h"
+#include "Dimensions.h"
+#include "HpFile.h"
+
+/* own stuff */
+#include "Svg.h"
+
+/*
+ *	SVG output (-w), for browsers and other viewers that don't show
+ *	PostScript. The graph is laid out just as in the PostScript, but
+ *	always upright (-g makes no difference), and the pages of -M go one
+ *	under the other. The drawing functions take the PostScript
+ *	coordinates of the page, with y going up, and turn them round.
+ *
+ *	Text is placed with text-anchor, rather than by measuring it as the
+ *	PostScript does, so it lines up whatever font the viewer picks.
+ */
+
+static intish page;			/* the page we are drawing	*/
+static intish npages;
+
+static floatish
+SvgY(floatish y)
+{
+    return (floatish) page * borderheight + borderheight - y;
+}
+
+void
+SvgHeader(intish pages)
+{
+    floatish scale;
+
+    /* -e gives the width, as for the EPSF */
+    scale = eflag ? epsfwidth / borderwidth : 1.0;
+    npages = pages;
+    page = 0;
+
+    fprintf(psfp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(psfp, "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\"");
+    fprintf(psfp, " width=\"%.2fpt\" height=\"%.2fpt\"",
+		  borderwidth * scale, npages * borderheight * scale);
+    fprintf(psfp, " viewBox=\"0 0 %.2f %.2f\">\n",
+		  borderwidth, npages * borderheight);
+
+    fprintf(psfp, "<title>");
+    SvgString(jobstring, -1);
+    fprintf(psfp, "</title>\n");
+    fprintf(psfp, "<desc>%s (version %s), ", programname, VERSION);
+    SvgString(datestring, -1);
+    fprintf(psfp, "</desc>\n");
+
+    fprintf(psfp, "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n");
+    fprintf(psfp, "<g font-family=\"Helvetica, Arial, sans-serif\"");
+    fprintf(psfp, " fill=\"none\" stroke=\"black\" stroke-width=\"%.2f\">\n",
+		  borderthick);
+}
+
+void
+SvgTrailer(void)
+{
+    fprintf(psfp, "</g>\n</svg>\n");
+}
+
+void
+SvgNextPage(void)
+{
+    if (page + 1 < npages) {
+	page++;
+    }
+}
+
+/*
+ *	A path: SvgMoveTo, any number of SvgLineTo, then SvgClosePath
+ *	(which fills it with "fill") or SvgStroke.
+ */
+
+void
+SvgMoveTo(floatish x, floatish y)
+{
+    fprintf(psfp, "<path d=\"M%.2f %.2f", x, SvgY(y));
+}
+
+void
+SvgLineTo(floatish x, floatish y)
+{
+    fprintf(psfp, "\nL%.2f %.2f", x, SvgY(y));
+}
+
+void
+SvgClosePath(char *fill)
+{
+    fprintf(psfp, "Z\" fill=\"%s\"/>\n", fill);
+}
+
+void
+SvgStroke(void)
+{
+    fprintf(psfp, "\"/>\n");
+}
+
+void
+SvgLine(floatish x0, floatish y0, floatish x1, floatish y1)
+{
+    SvgMoveTo(x0, y0);
+    SvgLineTo(x1, y1);
+    SvgStroke();
+}
+
+void
+SvgBox(floatish x, floatish y, floatish w, floatish h, char *fill)
+{
+    SvgMoveTo(x, y);
+    SvgLineTo(x, y + h);
+    SvgLineTo(x + w, y + h);
+    SvgLineTo(x + w, y);
+    SvgClosePath(fill);
+}
+
+/*
+ *	Text, with its baseline at y; anchor is "start", "middle" or "end".
+ *	Vertical text reads upwards from (x, y). Write the text itself
+ *	with SvgString (or CommaPrint) between SvgTextBegin and SvgTextEnd.
+ */
+
+void
+SvgTextBegin(floatish x, floatish y, int font, char *anchor, boolish vertical)
+{
+    fprintf(psfp, "<text font-size=\"%d\" fill=\"black\" stroke=\"none\"",
+		  font);
+    fprintf(psfp, " text-anchor=\"%s\"", anchor);
+    if (vertical) {
+	fprintf(psfp, " transform=\"translate(%.2f %.2f) rotate(-90)\">",
+		      x, SvgY(y));
+    } else {
+	fprintf(psfp, " x=\"%.2f\" y=\"%.2f\">", x, SvgY(y));
+    }
+}
+
+void
+SvgTextEnd(void)
+{
+    fprintf(psfp, "</text>\n");
+}
+
+/*
+ *	Write at most w characters of s (all of them if w < 0), escaping
+ *	what XML needs escaped.
+ */
+
+void
+SvgString(char *s, int w)
+{
+    for ( ; *s && w != 0; s++, w--) {
+	switch (*s) {
+	case '&':
+	    fprintf(psfp, "&amp;");
+	    break;
+	case '<':
+	    fprintf(psfp, "&lt;");
+	    break;
+	case '>':
+	    fprintf(psfp, "&gt;");
+	    break;
+	case '"':
+	    fprintf(psfp, "&quot;");
+	    break;
+	default:
+	    fputc(*s, psfp);
+	}
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+void SvgHeader    PROTO((intish));
+void SvgTrailer   PROTO((void));
+void SvgNextPage  PROTO((void));
+
+void SvgMoveTo    PROTO((floatish, floatish));
+void SvgLineTo    PROTO((floatish, floatish));
+void SvgClosePath PROTO((char *));
+void SvgStroke    PROTO((void));
+void SvgLine      PROTO((floatish, floatish, floatish, floatish));
+void SvgBox       PROTO((floatish, floatish, floatish, floatish, char *));
+
+void SvgTextBegin PROTO((floatish, floatish, int, char *, boolish));
+void SvgTextEnd   PROTO((void));
+void SvgString    PROTO((char *, int));
@@ -18,25 +18,21 @@
  *	band which appears as band 20.
  */
 
-void
-TopTwenty(void)
+/*
+ *	Add up the samples of the first "compact" identifiers into "en".
+ */
+
+static void
+OtherSamples(struct entry *en, intish compact)
 {
     intish i;
     intish j;
-    intish compact;
     intish bucket;
     floatish value;
-    struct entry* en;
     struct chunk* ch;
     floatish *other; 
 
-    i = nidents;
-    if (i <= TWENTY) return;	/* nothing to do! */
-
     other = (floatish*) xmalloc(nsamples * sizeof(floatish));
-    /* build a list of samples for "OTHER" */ 
-
-    compact = (i - TWENTY) + 1;
 
     for (i = 0; i < nsamples; i++) {
         other[ i ] = 0.0;
@@ -54,11 +50,37 @@ TopTwenty(void)
         }    
     }    
 
+    for (i = 0; i < nsamples; i++) {
+    	StoreSample(en, i, other[i]);
+    }
+
+    free(other);
+}
+
+void
+TopTwenty(void)
+{
+    intish i;
+    intish compact;
+    struct entry* en;
+
+    i = nidents;
+    if (i <= TWENTY) return;	/* nothing to do! */
+
+    /* build a list of samples for "OTHER" */ 
+
+    compact = (i - TWENTY) + 1;
+
     en = MakeEntry("OTHER");
     en->next = 0;
 
-    for (i = 0; i < nsamples; i++) {
-    	StoreSample(en, i, other[i]);
+    if (streamflag) {
+	/* GetHpBands adds their samples up as it reads them */
+	for (i = 0; i < compact && i < nidents; i++) {
+	    identtable[i]->band = en;
+	}
+    } else {
+	OtherSamples(en, compact);
     }
 
     /* slide samples down */
@@ -68,5 +90,4 @@ TopTwenty(void)
 
     nidents = TWENTY;
     identtable[0] = en;
-    free(other);
 }
@@ -23,7 +23,6 @@ void TraceElement(void)
 {
     intish i;
     intish j;
-    struct chunk* ch;
     floatish grandtotal;
     intish   min;
     floatish t;
@@ -36,16 +35,8 @@ void TraceElement(void)
     /* find totals */
 
     for (i = 0; i < nidents; i++) {
-	totals[ i ] = 0;
+	totals[ i ] = identtable[i]->total;
     }
- 
-    for (i = 0; i < nidents; i++) {
-        for (ch = identtable[i]->chk; ch; ch = ch->next) {
-	    for (j = 0; j < ch->nd; j++) {
-	        totals[ i ] += ch->d[j].value; 
-	    }
-        }
-    }    
 
     /* sort on the basis of total */
 
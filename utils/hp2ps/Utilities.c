@@ -41,6 +41,15 @@ DropSuffix(char *name, char *suffix)
     }
 }
 
+boolish
+HasSuffix(char *name, char *suffix)
+{
+    size_t n = strlen(name);
+    size_t m = strlen(suffix);
+
+    return n >= m && strcmp(name + n - m, suffix) == 0;
+}
+
 FILE*
 OpenFile(char *s, char *mode)
 {
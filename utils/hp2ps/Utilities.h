@@ -2,6 +2,7 @@
 
 char* Basename    PROTO((char *));
 void  DropSuffix  PROTO((char *, char *));
+boolish HasSuffix PROTO((char *, char *));
 FILE* OpenFile    PROTO((char *, char *));
 void  CommaPrint  PROTO((FILE *, intish));
 char *copystring  PROTO((char *));
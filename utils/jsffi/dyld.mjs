@@ -577,6 +577,7 @@ class DyLD {
           getJSVal: (k) => this.#jsvalManager.getJSVal(k),
           freeJSVal: (k) => this.#jsvalManager.freeJSVal(k),
           scheduleWork: () => setImmediate(this.exportFuncs.rts_schedulerLoop),
+          scheduleMicrotask: () => queueMicrotask(this.exportFuncs.rts_schedulerLoop),
         },
         "GOT.mem": this.#gotMem,
         "GOT.func": this.#gotFunc,
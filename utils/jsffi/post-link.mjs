@@ -68,6 +68,7 @@ export async function postLink(mod) {
   src = `${src}\ngetJSVal: (k) => __ghc_wasm_jsffi_jsval_manager.getJSVal(k),`;
   src = `${src}\nfreeJSVal: (k) => __ghc_wasm_jsffi_jsval_manager.freeJSVal(k),`;
   src = `${src}\nscheduleWork: () => setImmediate(__exports.rts_schedulerLoop),`;
+  src = `${src}\nscheduleMicrotask: () => queueMicrotask(__exports.rts_schedulerLoop),`;
   for (const rec of parseSections(mod)) {
     src = `${src}\n${rec[0]}: ${parseRecord(rec)},`;
   }